@@ -20,11 +20,15 @@
 #include "app/commands/params.h"
 #include "app/console.h"
 #include "app/crash/data_recovery.h"
+#include "app/document_cache.h"
 #include "app/document_exporter.h"
 #include "app/document_undo.h"
 #include "app/file/file.h"
+#include "app/file/file_format.h"
 #include "app/file/file_formats_manager.h"
 #include "app/file/palette_file.h"
+#include "app/file/ase_options.h"
+#include "app/file/png_options.h"
 #include "app/file_system.h"
 #include "app/filename_formatter.h"
 #include "app/find_widget.h"
@@ -57,8 +61,12 @@
 #include "app/webserver.h"
 #include "base/exception.h"
 #include "base/fs.h"
+#include "base/fstream_path.h"
 #include "base/path.h"
 #include "base/split_string.h"
+#include "base/string.h"
+#include "base/thread_pool.h"
+#include "base/tracing.h"
 #include "base/unique_ptr.h"
 #include "doc/document_observer.h"
 #include "doc/image.h"
@@ -74,12 +82,100 @@
 #include "ui/intern.h"
 #include "ui/ui.h"
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <vector>
 
 namespace app {
 
 using namespace ui;
 
+namespace {
+
+// Time when App::initialize() was called (in microseconds, see
+// base::tracing::now())
+uint64_t startup_begin = 0;
+
+// Measures each phase of App::initialize(). Phases are saved as
+// tracing zones (see --trace) and printed in the log (see --verbose).
+class StartupPhases {
+public:
+  StartupPhases() : m_begin(base::tracing::now()) { }
+
+  // Finishes the current phase and starts the next one. The name
+  // must be a string literal.
+  void done(const char* name) {
+    uint64_t now = base::tracing::now();
+    if (base::tracing::enabled())
+      base::tracing::add_event(name, m_begin, now);
+
+    PRINTF("Startup phase %s: %.2f ms\n", name, (now - m_begin) / 1000.0);
+    m_begin = now;
+  }
+
+private:
+  uint64_t m_begin;
+};
+
+// Saves each given layer of the document in its own file at the same
+// time (e.g. for --split-layers). The document is shared (read-only)
+// by all threads, and each file renders only its layer without
+// modifying the visibility of the layers. Returns false if the
+// format doesn't save flattened images (the caller has to save each
+// layer with the SaveFileCopyAs command).
+bool save_layers_in_parallel(Context* ctx, Document* doc,
+                             const std::vector<Layer*>& layers,
+                             const std::vector<std::string>& filenames,
+                             const std::vector<std::string>& formats)
+{
+  if (layers.empty())
+    return true;
+
+  FileFormat* format = FileFormatsManager::instance()->getFileFormatByExtension(
+    base::string_to_lower(base::get_file_extension(filenames[0])).c_str());
+  if (!format || !format->support(FILE_SUPPORT_SEQUENCES))
+    return false;
+
+  // The FileOps are created in the main thread (there can be alerts)
+  std::vector<FileOp*> fops;
+  for (std::size_t i=0; i<layers.size(); ++i) {
+    FileOp* fop = fop_to_save_document(ctx, doc,
+      filenames[i].c_str(), formats[i].c_str());
+    if (!fop)
+      continue;
+
+    fop->seq.solo_layer = layers[i];
+    fops.push_back(fop);
+  }
+
+  base::thread_pool::global().parallel_for(
+    int(fops.size()),
+    [&fops](int i) {
+      FileOp* fop = fops[i];
+      if (!fop->has_error()) {
+        try {
+          fop_operate(fop, NULL);
+        }
+        catch (const std::exception& e) {
+          fop_error(fop, "Error saving file:\n%s", e.what());
+        }
+      }
+      fop_done(fop);
+    });
+
+  for (FileOp* fop : fops) {
+    if (fop->has_error()) {
+      Console console;
+      console.printf(fop->error.c_str());
+    }
+    fop_free(fop);
+  }
+  return true;
+}
+
+} // anonymous namespace
+
 class App::CoreModules {
 public:
   ConfigModule m_configModule;
@@ -140,6 +236,7 @@ App::App()
   , m_legacy(NULL)
   , m_isGui(false)
   , m_isShell(false)
+  , m_isServer(false)
   , m_exporter(NULL)
 {
   ASSERT(m_instance == NULL);
@@ -150,27 +247,41 @@ void App::initialize(const AppOptions& options)
 {
   m_isGui = options.startUI();
   m_isShell = options.startShell();
+  m_isServer = options.startServer();
+
+  // Start tracing zones as soon as possible
+  m_traceFilename = options.traceFilename();
+  if (!m_traceFilename.empty())
+    base::tracing::set_enabled(true);
+
+  startup_begin = base::tracing::now();
+  StartupPhases phases;
+
   if (m_isGui)
     m_guiSystem.reset(new ui::GuiSystem);
 
   // Initializes the application loading the modules, setting the
   // graphics mode, loading the configuration and resources, etc.
   m_coreModules = new CoreModules;
+  phases.done("startup.preferences");
+
   m_modules = new Modules(options.verbose());
-  m_legacy = new LegacyModules(isGui() ? REQUIRE_INTERFACE: 0);
+  phases.done("startup.modules");
 
-  if (options.hasExporterParams())
-    m_exporter.reset(new DocumentExporter);
+  m_legacy = new LegacyModules(isGui() ? REQUIRE_INTERFACE: 0);
+  phases.done("startup.legacy_modules");
 
   // Data recovery is enabled only in GUI mode
   if (isGui() && preferences().general.dataRecovery())
     m_modules->createDataRecovery();
+  phases.done("startup.data_recovery");
 
   // Register well-known image file types.
   FileFormatsManager::instance()->registerAllFormats();
 
   // init editor cursor
   Editor::initEditorCursor();
+  phases.done("startup.file_formats");
 
   if (isPortable())
     PRINTF("Running in portable mode\n");
@@ -210,9 +321,9 @@ void App::initialize(const AppOptions& options)
 
   // Set system palette to the default one.
   set_current_palette(NULL, true);
+  phases.done("startup.default_palette");
 
   // Initialize GUI interface
-  UIContext* ctx = UIContext::instance();
   if (isGui()) {
     PRINTF("GUI mode\n");
 
@@ -240,10 +351,48 @@ void App::initialize(const AppOptions& options)
 
     // Redraw the whole screen.
     ui::Manager::getDefault()->invalidate();
+    phases.done("startup.main_window");
   }
 
   // Procress options
   PRINTF("Processing options...\n");
+  processOptions(options, NULL);
+  phases.done("startup.options");
+
+  // Record/replay input events (after opening the files of the
+  // command line, so the replay starts with the same documents)
+  if (isGui()) {
+    try {
+      if (!options.replayInputFilename().empty())
+        gui_replay_input(options.replayInputFilename(),
+                         options.replayReportFilename());
+      else if (!options.recordInputFilename().empty())
+        gui_record_input(options.recordInputFilename());
+    }
+    catch (const std::exception& e) {
+      Console console;
+      console.printf("%s\n", e.what());
+    }
+  }
+
+  // Run export jobs
+  if (!options.jobsFilename().empty())
+    runJobs(options.jobsFilename());
+}
+
+// Opens the files and exports the sprite sheets specified in the
+// given options. If "docs" isn't NULL, files are loaded from that
+// cache (so options cannot modify documents).
+void App::processOptions(const AppOptions& options, DocumentCache* docs)
+{
+  UIContext* ctx = UIContext::instance();
+
+  if (options.hasExporterParams()) {
+    m_exporter.reset(new DocumentExporter);
+
+    // The texture isn't used after it's saved
+    m_exporter->setStreamTexture(true);
+  }
 
   bool ignoreEmpty = false;
   bool trim = false;
@@ -257,6 +406,21 @@ void App::initialize(const AppOptions& options)
     std::string importLayer;
     std::string importLayerSaveAs;
     std::string filenameFormat;
+    base::SharedPtr<PngOptions> pngOptions;
+    base::SharedPtr<AseOptions> aseOptions;
+
+    // All files are decoded at the same time before processing the
+    // options (each document is added to the context in its turn).
+    std::vector<Document*> loadedDocs;
+    std::size_t nextLoadedDoc = 0;
+    if (!docs) {
+      std::vector<std::string> filenames;
+      for (const auto& value : options.values()) {
+        if (!value.option())
+          filenames.push_back(value.value());
+      }
+      loadedDocs = load_documents(ctx, filenames);
+    }
 
     for (const auto& value : options.values()) {
       const AppOptions::Option* opt = value.option();
@@ -349,6 +513,39 @@ void App::initialize(const AppOptions& options)
         else if (opt == &options.filenameFormat()) {
           filenameFormat = value.value();
         }
+        // --export-cache <filename>
+        else if (opt == &options.exportCache()) {
+          if (m_exporter)
+            m_exporter->setCacheFilename(value.value());
+        }
+        // --png-profile <name>
+        // --png-parallel-deflate
+        else if (opt == &options.pngProfile() ||
+                 opt == &options.pngParallelDeflate()) {
+          if (!pngOptions) {
+            pngOptions.reset(new PngOptions);
+            if (m_exporter)
+              m_exporter->setTextureFormatOptions(pngOptions);
+          }
+
+          if (opt == &options.pngParallelDeflate())
+            pngOptions->setParallelDeflate(true);
+          else {
+            PngOptions::Profile profile;
+            if (PngOptions::profileFromString(value.value(), profile))
+              pngOptions->setProfile(profile);
+            else
+              console.printf("Invalid PNG profile \"%s\"\n", value.value().c_str());
+          }
+        }
+        // --ase-tile-size <pixels>
+        else if (opt == &options.aseTileSize()) {
+          int tileSize = strtol(value.value().c_str(), NULL, 0);
+          if (tileSize > 0)
+            aseOptions.reset(new AseOptions(AseOptions::DefaultCompression, tileSize));
+          else
+            aseOptions.reset();
+        }
         // --save-as <filename>
         else if (opt == &options.saveAs()) {
           Document* doc = NULL;
@@ -361,6 +558,16 @@ void App::initialize(const AppOptions& options)
           else {
             ctx->setActiveDocument(doc);
 
+            if (pngOptions &&
+                base::string_to_lower(base::get_file_extension(value.value())) == "png")
+              doc->setFormatOptions(pngOptions);
+
+            if (aseOptions) {
+              std::string ext = base::string_to_lower(base::get_file_extension(value.value()));
+              if (ext == "ase" || ext == "aseprite")
+                doc->setFormatOptions(aseOptions);
+            }
+
             std::string format = filenameFormat;
 
             Command* saveAsCommand = CommandsModule::instance()->getCommandByName(CommandId::SaveFileCopyAs);
@@ -372,7 +579,6 @@ void App::initialize(const AppOptions& options)
               std::vector<Layer*> layers;
               doc->sprite()->getLayersList(layers);
 
-              std::string fn, fmt;
               if (format.empty()) {
                 if (doc->sprite()->totalFrames() > frame_t(1))
                   format = "{path}/{title} ({layer}) {frame}.{extension}";
@@ -380,41 +586,51 @@ void App::initialize(const AppOptions& options)
                   format = "{path}/{title} ({layer}).{extension}";
               }
 
-              // For each layer, hide other ones and save the sprite.
-              for (Layer* show : layers) {
-                for (Layer* hide : layers)
-                  hide->setVisible(hide == show);
-
+              std::vector<std::string> filenames, formats;
+              for (Layer* layer : layers) {
                 FilenameInfo fnInfo;
                 fnInfo
                   .filename(value.value())
-                  .layerName(show->name());
-
-                fn = filename_formatter(format, fnInfo);
-                fmt = filename_formatter(format, fnInfo, false);
-
-                if (!cropParams.empty())
-                  ctx->executeCommand(cropCommand, cropParams);
+                  .layerName(layer->name());
 
-                // TODO --trim command with --save-as doesn't make too
-                // much sense as we lost the trim rectangle
-                // information (e.g. we don't have sheet .json) Also,
-                // we should trim each frame individually (a process
-                // that can be done only in fop_operate()).
-                if (trim)
-                  ctx->executeCommand(trimCommand);
-
-                Params params;
-                params.set("filename", fn.c_str());
-                params.set("filename-format", fmt.c_str());
-                ctx->executeCommand(saveAsCommand, params);
-
-                if (trim) {     // Undo trim command
-                  ctx->executeCommand(undoCommand);
+                filenames.push_back(filename_formatter(format, fnInfo));
+                formats.push_back(filename_formatter(format, fnInfo, false));
+              }
 
-                  // Just in case allow non-linear history is enabled
-                  // we clear redo information
-                  doc->undoHistory()->clearRedo();
+              // Layers of flattened formats are rendered and saved in
+              // parallel (the document isn't modified). Crop/trim
+              // options change the sprite for each layer, so in that
+              // case the layers are saved one by one.
+              if (!cropParams.empty() || trim ||
+                  !save_layers_in_parallel(ctx, doc, layers, filenames, formats)) {
+                // For each layer, hide other ones and save the sprite.
+                for (std::size_t i=0; i<layers.size(); ++i) {
+                  for (Layer* hide : layers)
+                    hide->setVisible(hide == layers[i]);
+
+                  if (!cropParams.empty())
+                    ctx->executeCommand(cropCommand, cropParams);
+
+                  // TODO --trim command with --save-as doesn't make too
+                  // much sense as we lost the trim rectangle
+                  // information (e.g. we don't have sheet .json) Also,
+                  // we should trim each frame individually (a process
+                  // that can be done only in fop_operate()).
+                  if (trim)
+                    ctx->executeCommand(trimCommand);
+
+                  Params params;
+                  params.set("filename", filenames[i].c_str());
+                  params.set("filename-format", formats[i].c_str());
+                  ctx->executeCommand(saveAsCommand, params);
+
+                  if (trim) {   // Undo trim command
+                    ctx->executeCommand(undoCommand);
+
+                    // Just in case allow non-linear history is enabled
+                    // we clear redo information
+                    doc->undoHistory()->clearRedo();
+                  }
                 }
               }
             }
@@ -467,7 +683,14 @@ void App::initialize(const AppOptions& options)
         const std::string& filename = value.value();
 
         // Load the sprite
-        Document* doc = load_document(ctx, filename.c_str());
+        Document* doc;
+        if (docs)
+          doc = docs->getDocument(filename);
+        else {
+          doc = loadedDocs[nextLoadedDoc++];
+          if (doc)
+            doc->setContext(ctx);
+        }
         if (!doc) {
           if (!isGui())
             console.printf("Error loading file \"%s\"\n", filename.c_str());
@@ -534,25 +757,141 @@ void App::initialize(const AppOptions& options)
   }
 }
 
+namespace {
+
+// Maximum number of documents kept in memory between jobs
+const int kMaxCachedJobDocuments = 32;
+
+// Splits a line of a jobs file in arguments (arguments with spaces
+// can be quoted).
+void split_job_args(const std::string& line, std::vector<std::string>& args)
+{
+  std::string arg;
+  bool quoted = false;
+  bool hasArg = false;
+
+  for (char chr : line) {
+    if (chr == '"') {
+      quoted = !quoted;
+      hasArg = true;
+    }
+    else if (!quoted && (chr == ' ' || chr == '\t')) {
+      if (hasArg) {
+        args.push_back(arg);
+        arg.clear();
+        hasArg = false;
+      }
+    }
+    else {
+      arg.push_back(chr);
+      hasArg = true;
+    }
+  }
+
+  if (hasArg)
+    args.push_back(arg);
+}
+
+} // anonymous namespace
+
+// Runs the jobs of the given file. Each line is a job with the same
+// arguments of the command line, e.g.:
+//
+//   player.ase --sheet player.png --data player.json
+//   "enemy 1.ase" --split-layers --sheet enemy1.png
+//
+// All jobs run in the same process and share the loaded documents.
+// Jobs that modify documents (--save-as, --scale, --crop) don't use
+// cached documents, the documents that they load are closed at the
+// end of the job.
+void App::runJobs(const std::string& filename)
+{
+  std::ifstream f(FSTREAM_PATH(filename));
+  if (!f) {
+    Console console;
+    console.printf("Error opening jobs file \"%s\"\n", filename.c_str());
+    return;
+  }
+
+  UIContext* ctx = UIContext::instance();
+  DocumentCache docs(ctx, kMaxCachedJobDocuments);
+  std::string line;
+  int lineNumber = 0;
+
+  while (std::getline(f, line)) {
+    ++lineNumber;
+
+    std::vector<std::string> args;
+    split_job_args(line, args);
+    if (args.empty() || args[0][0] == '#')
+      continue;
+
+    PRINTF("Running job %d: %s\n", lineNumber, line.c_str());
+
+    std::vector<const char*> argv;
+    argv.push_back(PACKAGE);
+    for (const auto& arg : args)
+      argv.push_back(arg.c_str());
+
+    AppOptions jobOptions(int(argv.size()), &argv[0]);
+
+    if (jobOptions.modifiesDocuments()) {
+      // Documents of the cache cannot be modified (e.g. --scale
+      // resizes all opened documents)
+      docs.clear();
+
+      std::vector<doc::Document*> oldDocs(
+        ctx->documents().begin(), ctx->documents().end());
+
+      processOptions(jobOptions, NULL);
+
+      std::vector<doc::Document*> newDocs;
+      for (doc::Document* doc : ctx->documents())
+        if (std::find(oldDocs.begin(), oldDocs.end(), doc) == oldDocs.end())
+          newDocs.push_back(doc);
+
+      for (doc::Document* doc : newDocs) {
+        doc->close();
+        delete doc;
+      }
+    }
+    else
+      processOptions(jobOptions, &docs);
+  }
+}
+
 void App::run()
 {
   // Run the GUI
   if (isGui()) {
+    gui_after_first_frame(
+      []{
+        uint64_t now = base::tracing::now();
+        if (base::tracing::enabled())
+          base::tracing::add_event("startup.first_frame", startup_begin, now);
+
+        PRINTF("First frame displayed after %.2f ms\n",
+               (now - startup_begin) / 1000.0);
+      });
+
+    // Non-essential services are started after the first frame is
+    // displayed (so they don't delay the startup).
+
 #ifdef ENABLE_UPDATER
     // Launch the thread to check for updates.
     app::CheckUpdateThreadLauncher checkUpdate(
       m_mainWindow->getCheckUpdateDelegate());
-    checkUpdate.launch();
+    gui_after_first_frame([&checkUpdate]{ checkUpdate.launch(); });
 #endif
 
 #ifdef ENABLE_WEBSERVER
     // Launch the webserver.
     app::WebServer webServer;
-    webServer.start();
+    gui_after_first_frame([&webServer]{ webServer.start(); });
 #endif
 
     app::SendCrash sendCrash;
-    sendCrash.search();
+    gui_after_first_frame([&sendCrash]{ sendCrash.search(); });
 
     // Run the GUI main message loop
     gui_run();
@@ -569,6 +908,18 @@ void App::run()
     }
   }
 
+  // Start a web server to export sprite sheets (documents are kept
+  // in memory between requests).
+  if (m_isServer) {
+#ifdef ENABLE_WEBSERVER
+    app::WebServer webServer(true);
+    webServer.start();
+    webServer.waitForQuit();
+#else
+    std::cerr << "Your version of " PACKAGE " wasn't compiled with web server support.\n";
+#endif
+  }
+
   // Destroy all documents in the UIContext.
   const doc::Documents& docs = m_modules->m_ui_context.documents();
   while (!docs.empty()) {
@@ -597,6 +948,13 @@ void App::run()
   // Delete backups (this is a normal shutdown, we are not handling
   // exceptions, and we are not in a destructor).
   m_modules->deleteDataRecovery();
+
+  // Save traced zones
+  if (!m_traceFilename.empty()) {
+    base::tracing::set_enabled(false);
+    if (!base::tracing::write_chrome_trace(m_traceFilename))
+      std::cerr << "Error saving trace file \"" << m_traceFilename << "\"\n";
+  }
 }
 
 // Finishes the Aseprite application.
@@ -29,6 +29,7 @@ namespace app {
 
   class AppOptions;
   class Document;
+  class DocumentCache;
   class DocumentExporter;
   class INotificationDelegate;
   class InputChain;
@@ -84,6 +85,9 @@ namespace app {
     class CoreModules;
     class Modules;
 
+    void processOptions(const AppOptions& options, DocumentCache* docs);
+    void runJobs(const std::string& filename);
+
     static App* m_instance;
 
     base::UniquePtr<ui::GuiSystem> m_guiSystem;
@@ -92,9 +96,11 @@ namespace app {
     LegacyModules* m_legacy;
     bool m_isGui;
     bool m_isShell;
+    bool m_isServer;
     base::UniquePtr<MainWindow> m_mainWindow;
     FileList m_files;
     base::UniquePtr<DocumentExporter> m_exporter;
+    std::string m_traceFilename;
   };
 
   void app_refresh_screen();
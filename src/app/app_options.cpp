@@ -24,10 +24,13 @@ AppOptions::AppOptions(int argc, const char* argv[])
   : m_exeName(base::get_file_name(argv[0]))
   , m_startUI(true)
   , m_startShell(false)
+  , m_startServer(false)
   , m_verboseEnabled(false)
   , m_palette(m_po.add("palette").requiresValue("<filename>").description("Use a specific palette by default"))
   , m_shell(m_po.add("shell").description("Start an interactive console to execute scripts"))
   , m_batch(m_po.add("batch").description("Do not start the UI"))
+  , m_server(m_po.add("server").description("Start a web server to export sprite sheets\n(without UI, until /quit is requested)"))
+  , m_jobs(m_po.add("jobs").requiresValue("<filename>").description("Run the export jobs of the given file in\none process (one job per line with the\nsame options of the command line)"))
   , m_saveAs(m_po.add("save-as").requiresValue("<filename>").description("Save the last given document with other format"))
   , m_scale(m_po.add("scale").requiresValue("<factor>").description("Resize all previous opened documents"))
   , m_data(m_po.add("data").requiresValue("<filename.json>").description("File to store the sprite sheet metadata"))
@@ -45,6 +48,14 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_trim(m_po.add("trim").description("Trim all images before exporting"))
   , m_crop(m_po.add("crop").requiresValue("x,y,width,height").description("Crop all the images to the given rectangle"))
   , m_filenameFormat(m_po.add("filename-format").requiresValue("<fmt>").description("Special format to generate filenames"))
+  , m_exportCache(m_po.add("export-cache").requiresValue("<filename>").description("File with the hashes of exported sheets to skip\nsheets that didn't change"))
+  , m_pngProfile(m_po.add("png-profile").requiresValue("<name>").description("Compression of next saved PNG files:\nfastest, balanced (default), or smallest"))
+  , m_pngParallelDeflate(m_po.add("png-parallel-deflate").description("Compress next saved PNG files using all CPUs"))
+  , m_aseTileSize(m_po.add("ase-tile-size").requiresValue("<pixels>").description("Save repeated tiles of this size (e.g. 16) only once\nin next saved .ase files (not supported by old versions)"))
+  , m_recordInput(m_po.add("record-input").requiresValue("<filename>").description("Save the UI input events in the given file"))
+  , m_replayInput(m_po.add("replay-input").requiresValue("<filename>").description("Replay the UI input events of the given file\nand report the time of each frame"))
+  , m_replayReport(m_po.add("replay-report").requiresValue("<filename.json>").description("File to save the report of --replay-input\n(the standard output by default)"))
+  , m_trace(m_po.add("trace").requiresValue("<filename.json>").description("Trace zones of the program and save them at exit\nin Chrome trace format (see chrome://tracing)"))
   , m_verbose(m_po.add("verbose").description("Explain what is being done"))
   , m_help(m_po.add("help").mnemonic('?').description("Display this help and exits"))
   , m_version(m_po.add("version").description("Output version information and exit"))
@@ -54,7 +65,13 @@ AppOptions::AppOptions(int argc, const char* argv[])
 
     m_verboseEnabled = m_po.enabled(m_verbose);
     m_paletteFileName = m_po.value_of(m_palette);
+    m_jobsFilename = m_po.value_of(m_jobs);
+    m_recordInputFilename = m_po.value_of(m_recordInput);
+    m_replayInputFilename = m_po.value_of(m_replayInput);
+    m_replayReportFilename = m_po.value_of(m_replayReport);
+    m_traceFilename = m_po.value_of(m_trace);
     m_startShell = m_po.enabled(m_shell);
+    m_startServer = m_po.enabled(m_server);
 
     if (m_po.enabled(m_help)) {
       showHelp();
@@ -65,7 +82,8 @@ AppOptions::AppOptions(int argc, const char* argv[])
       m_startUI = false;
     }
 
-    if (m_po.enabled(m_shell) || m_po.enabled(m_batch)) {
+    if (m_po.enabled(m_shell) || m_po.enabled(m_batch) ||
+        m_po.enabled(m_server) || m_po.enabled(m_jobs)) {
       m_startUI = false;
     }
   }
@@ -83,6 +101,14 @@ bool AppOptions::hasExporterParams() const
     m_po.enabled(m_sheet);
 }
 
+bool AppOptions::modifiesDocuments() const
+{
+  return
+    m_po.enabled(m_saveAs) ||
+    m_po.enabled(m_scale) ||
+    m_po.enabled(m_crop);
+}
+
 void AppOptions::showHelp()
 {
   std::cout
@@ -27,9 +27,15 @@ public:
 
   bool startUI() const { return m_startUI; }
   bool startShell() const { return m_startShell; }
+  bool startServer() const { return m_startServer; }
   bool verbose() const { return m_verboseEnabled; }
 
   const std::string& paletteFileName() const { return m_paletteFileName; }
+  const std::string& jobsFilename() const { return m_jobsFilename; }
+  const std::string& recordInputFilename() const { return m_recordInputFilename; }
+  const std::string& replayInputFilename() const { return m_replayInputFilename; }
+  const std::string& replayReportFilename() const { return m_replayReportFilename; }
+  const std::string& traceFilename() const { return m_traceFilename; }
 
   const ValueList& values() const {
     return m_po.values();
@@ -53,9 +59,16 @@ public:
   const Option& trim() const { return m_trim; }
   const Option& crop() const { return m_crop; }
   const Option& filenameFormat() const { return m_filenameFormat; }
+  const Option& exportCache() const { return m_exportCache; }
+  const Option& pngProfile() const { return m_pngProfile; }
+  const Option& pngParallelDeflate() const { return m_pngParallelDeflate; }
+  const Option& aseTileSize() const { return m_aseTileSize; }
 
   bool hasExporterParams() const;
 
+  // True if the options modify the opened documents
+  bool modifiesDocuments() const;
+
 private:
   void showHelp();
   void showVersion();
@@ -64,12 +77,20 @@ private:
   base::ProgramOptions m_po;
   bool m_startUI;
   bool m_startShell;
+  bool m_startServer;
   bool m_verboseEnabled;
   std::string m_paletteFileName;
+  std::string m_jobsFilename;
+  std::string m_recordInputFilename;
+  std::string m_replayInputFilename;
+  std::string m_replayReportFilename;
+  std::string m_traceFilename;
 
   Option& m_palette;
   Option& m_shell;
   Option& m_batch;
+  Option& m_server;
+  Option& m_jobs;
   Option& m_saveAs;
   Option& m_scale;
   Option& m_data;
@@ -87,6 +108,14 @@ private:
   Option& m_trim;
   Option& m_crop;
   Option& m_filenameFormat;
+  Option& m_exportCache;
+  Option& m_pngProfile;
+  Option& m_pngParallelDeflate;
+  Option& m_aseTileSize;
+  Option& m_recordInput;
+  Option& m_replayInput;
+  Option& m_replayReport;
+  Option& m_trace;
 
   Option& m_verbose;
   Option& m_help;
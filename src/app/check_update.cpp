@@ -200,6 +200,8 @@ void CheckUpdateThreadLauncher::onMonitoringTick()
 // This method is executed in a special thread to send the HTTP request.
 void CheckUpdateThreadLauncher::checkForUpdates()
 {
+  base::this_thread::set_qos(base::thread_qos::background);
+
   // Add mini-stats in the request
   std::stringstream extraParams;
   extraParams << "inits=" << m_inits
@@ -11,8 +11,55 @@
 
 #include "app/cmd.h"
 
+#include "app/cmd_arena.h"
+
+#include <new>
+
 namespace app {
 
+namespace {
+
+// Each Cmd is prefixed with the arena where it was allocated (or
+// NULL if it's in the heap). The header size keeps the alignment of
+// the object.
+struct CmdHeader {
+  CmdArena* arena;
+};
+
+const std::size_t kHeaderSize = 16;
+
+} // anonymous namespace
+
+// static
+void* Cmd::operator new(std::size_t size)
+{
+  CmdArena* arena = CmdArena::current();
+  CmdHeader* header;
+
+  if (arena) {
+    header = (CmdHeader*)arena->allocate(kHeaderSize + size);
+    arena->addRef();
+  }
+  else
+    header = (CmdHeader*)::operator new(kHeaderSize + size);
+
+  header->arena = arena;
+  return ((char*)header) + kHeaderSize;
+}
+
+// static
+void Cmd::operator delete(void* ptr)
+{
+  if (!ptr)
+    return;
+
+  CmdHeader* header = (CmdHeader*)(((char*)ptr) - kHeaderSize);
+  if (header->arena)
+    header->arena->release();
+  else
+    ::operator delete(header);
+}
+
 Cmd::Cmd()
 #if _DEBUG
   : m_state(State::NotExecuted)
@@ -77,6 +124,16 @@ size_t Cmd::memSize() const
   return onMemSize();
 }
 
+size_t Cmd::swapOut(UndoSwapFile& file)
+{
+  return onSwapOut(file);
+}
+
+void Cmd::compress()
+{
+  onCompress();
+}
+
 void Cmd::onExecute()
 {
   // Do nothing
@@ -107,4 +164,15 @@ size_t Cmd::onMemSize() const {
   return sizeof(*this);
 }
 
+size_t Cmd::onSwapOut(UndoSwapFile& file)
+{
+  // Nothing to release
+  return 0;
+}
+
+void Cmd::onCompress()
+{
+  // Nothing to compress
+}
+
 } // namespace app
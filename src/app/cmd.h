@@ -13,16 +13,23 @@
 #include "doc/sprite_position.h"
 #include "undo/undo_command.h"
 
+#include <cstddef>
 #include <string>
 
 namespace app {
   class Context;
+  class UndoSwapFile;
 
   class Cmd : public undo::UndoCommand {
   public:
     Cmd();
     virtual ~Cmd();
 
+    // Cmds created while a Transaction is alive are allocated in the
+    // CmdArena of its CmdTransaction.
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr);
+
     void execute(Context* ctx);
 
     // undo::UndoCommand impl
@@ -33,6 +40,16 @@ namespace app {
     std::string label() const;
     size_t memSize() const;
 
+    // Moves the undo information of the command (e.g. pixels) to the
+    // swap file to release memory. It's loaded again automatically
+    // when the command is undone/redone. Returns the released bytes.
+    size_t swapOut(UndoSwapFile& file);
+
+    // Starts compressing the undo information of the command in a
+    // background thread. It's decompressed automatically when the
+    // command is undone/redone.
+    void compress();
+
     Context* context() const { return m_ctx; }
 
   protected:
@@ -42,6 +59,8 @@ namespace app {
     virtual void onFireNotifications();
     virtual std::string onLabel() const;
     virtual size_t onMemSize() const;
+    virtual size_t onSwapOut(UndoSwapFile& file);
+    virtual void onCompress();
 
   private:
     Context* m_ctx;
@@ -28,7 +28,7 @@ ClearImage::ClearImage(Image* image, color_t color)
 
 void ClearImage::onExecute()
 {
-  Image* image = this->image();
+  Image* image = imageToModify();
 
   ASSERT(!m_copy);
   m_copy.reset(Image::createCopy(image));
@@ -39,7 +39,12 @@ void ClearImage::onExecute()
 
 void ClearImage::onUndo()
 {
-  Image* image = this->image();
+  Image* image = imageToModify();
+
+  if (m_blob) {
+    m_copy = m_blob->takeImage();
+    m_blob.reset();
+  }
 
   copy_image(image, m_copy.get());
   m_copy.reset();
@@ -47,5 +52,16 @@ void ClearImage::onUndo()
   image->incrementVersion();
 }
 
+void ClearImage::onCompress()
+{
+  if (!m_copy)
+    return;
+
+  m_blob = std::make_shared<UndoBlob>(m_copy);
+  m_copy.reset();
+
+  UndoBlob::compressLater(m_blob);
+}
+
 } // namespace cmd
 } // namespace app
@@ -11,6 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "app/undo_blob.h"
 #include "doc/color.h"
 #include "doc/image_ref.h"
 
@@ -27,11 +28,15 @@ namespace cmd {
     void onExecute() override;
     void onUndo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + (m_copy ? m_copy->getMemSize(): 0);
+      return sizeof(*this) +
+        (m_copy ? m_copy->getMemSize(): 0) +
+        (m_blob ? m_blob->memSize(): 0);
     }
+    void onCompress() override;
 
   private:
     ImageRef m_copy;
+    UndoBlobPtr m_blob;         // Compressed m_copy
     color_t m_color;
   };
 
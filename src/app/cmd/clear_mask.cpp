@@ -15,7 +15,7 @@
 #include "app/document.h"
 #include "doc/cel.h"
 #include "doc/image.h"
-#include "doc/image_bits.h"
+#include "doc/image_span.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
 #include "doc/primitives.h"
@@ -25,6 +25,34 @@ namespace cmd {
 
 using namespace doc;
 
+namespace {
+
+// Paints the pixels of each row that are inside the mask
+class ClearMaskedPixels {
+public:
+  ClearMaskedPixels(const Image* maskBitmap, int maskX, int offsetY, color_t color)
+    : m_maskBitmap(maskBitmap), m_maskX(maskX), m_offsetY(offsetY), m_color(color) {
+  }
+
+  template<typename ImageTraits>
+  void operator()(const ImageSpan<ImageTraits>& span, int y) const {
+    const ImageSpan<BitmapTraits> maskSpan =
+      m_maskBitmap->row<BitmapTraits>(y - m_offsetY).subspan(m_maskX, span.size());
+
+    for (int i=0; i<span.size(); ++i)
+      if (maskSpan.get(i))
+        span.put(i, m_color);
+  }
+
+private:
+  const Image* m_maskBitmap;
+  int m_maskX;                  // Mask column of the first pixel of spans
+  int m_offsetY;
+  color_t m_color;
+};
+
+} // anonymous namespace
+
 ClearMask::ClearMask(Cel* cel)
   : WithCel(cel)
 {
@@ -84,7 +112,7 @@ void ClearMask::onRedo()
 void ClearMask::clear()
 {
   Cel* cel = this->cel();
-  Image* image = m_dstImage->image();
+  Image* image = m_dstImage->imageToModify();
   app::Document* doc = static_cast<app::Document*>(cel->document());
   Mask* mask = doc->mask();
 
@@ -92,28 +120,20 @@ void ClearMask::clear()
   if (!mask->bitmap())
     return;
 
-  const LockImageBits<BitmapTraits> maskBits(mask->bitmap());
-  LockImageBits<BitmapTraits>::const_iterator it = maskBits.begin();
+  gfx::Rect bounds =
+    image->bounds().createIntersection(
+      gfx::Rect(
+        m_offsetX, m_offsetY,
+        mask->bounds().w, mask->bounds().h));
 
   // Clear the masked zones
-  int u, v;
-  for (v=0; v<mask->bounds().h; ++v) {
-    for (u=0; u<mask->bounds().w; ++u, ++it) {
-      ASSERT(it != maskBits.end());
-      if (*it) {
-        put_pixel(image,
-          u + m_offsetX,
-          v + m_offsetY, m_bgcolor);
-      }
-    }
-  }
-
-  ASSERT(it == maskBits.end());
+  for_each_row(image, bounds,
+    ClearMaskedPixels(mask->bitmap(), bounds.x - m_offsetX, m_offsetY, m_bgcolor));
 }
 
 void ClearMask::restore()
 {
-  copy_image(m_dstImage->image(), m_copy.get(), m_offsetX, m_offsetY);
+  copy_image(m_dstImage->imageToModify(), m_copy.get(), m_offsetX, m_offsetY);
 }
 
 } // namespace cmd
@@ -71,7 +71,7 @@ void ClearRect::onRedo()
 
 void ClearRect::clear()
 {
-  fill_rect(m_dstImage->image(),
+  fill_rect(m_dstImage->imageToModify(),
             m_offsetX, m_offsetY,
             m_offsetX + m_copy->width() - 1,
             m_offsetY + m_copy->height() - 1,
@@ -80,7 +80,7 @@ void ClearRect::clear()
 
 void ClearRect::restore()
 {
-  copy_image(m_dstImage->image(), m_copy.get(), m_offsetX, m_offsetY);
+  copy_image(m_dstImage->imageToModify(), m_copy.get(), m_offsetX, m_offsetY);
 }
 
 } // namespace cmd
@@ -62,7 +62,7 @@ void CopyRect::swap()
   if (m_clip.size.w < 1 || m_clip.size.h < 1)
     return;
 
-  Image* image = this->image();
+  Image* image = imageToModify();
   int lineSize = this->lineSize();
   std::vector<uint8_t> tmp(lineSize);
 
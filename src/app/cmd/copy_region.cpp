@@ -11,6 +11,7 @@
 
 #include "app/cmd/copy_region.h"
 
+#include "app/undo_swap_file.h"
 #include "doc/image.h"
 
 #include <algorithm>
@@ -21,6 +22,9 @@ namespace cmd {
 CopyRegion::CopyRegion(Image* dst, Image* src,
   const gfx::Region& region, int dst_dx, int dst_dy)
   : WithImage(dst)
+  , m_size(0)
+  , m_swapFile(nullptr)
+  , m_swapPos(0)
 {
   // Save region pixels
   for (const auto& rc : region) {
@@ -39,9 +43,39 @@ CopyRegion::CopyRegion(Image* dst, Image* src,
         (const char*)src->getPixelAddress(clip.src.x, clip.src.y+y),
         src->getRowStrideSize(clip.size.w));
     }
+    m_size += src->getRowStrideSize(clip.size.w) * clip.size.h;
   }
 }
 
+size_t CopyRegion::onSwapOut(UndoSwapFile& file)
+{
+  // Compressed data is kept in memory
+  if (m_swapFile || m_blob || m_size == 0)
+    return 0;
+
+  std::string data = m_stream.str();
+  ASSERT(data.size() == m_size);
+
+  m_swapPos = file.write(data.c_str(), data.size());
+  m_swapFile = &file;
+
+  m_stream.str(std::string());
+  m_stream.clear();
+  return m_size;
+}
+
+void CopyRegion::onCompress()
+{
+  if (m_swapFile || m_blob || m_size == 0)
+    return;
+
+  m_blob = std::make_shared<UndoBlob>(m_stream.str());
+  m_stream.str(std::string());
+  m_stream.clear();
+
+  UndoBlob::compressLater(m_blob);
+}
+
 void CopyRegion::onExecute()
 {
   swap();
@@ -59,7 +93,22 @@ void CopyRegion::onRedo()
 
 void CopyRegion::swap()
 {
-  Image* image = this->image();
+  Image* image = imageToModify();
+
+  // Load the pixels from the swap file
+  if (m_swapFile) {
+    std::string data(m_size, 0);
+    m_swapFile->read(m_swapPos, &data[0], m_size);
+    m_stream.str(data);
+    m_stream.clear();
+    m_swapFile = nullptr;
+  }
+  // Decompress the pixels
+  else if (m_blob) {
+    m_stream.str(m_blob->takeData());
+    m_stream.clear();
+    m_blob.reset();
+  }
 
   // Save current image region in "tmp" stream
   std::stringstream tmp;
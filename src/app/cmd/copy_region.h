@@ -11,6 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "app/undo_blob.h"
 #include "gfx/region.h"
 
 #include <sstream>
@@ -31,14 +32,25 @@ namespace cmd {
     void onRedo() override;
     size_t onMemSize() const override {
       return sizeof(*this) +
-        (size_t)const_cast<std::stringstream*>(&m_stream)->tellp();
+        (m_blob ? m_blob->memSize():
+         m_swapFile ? 0: m_size);
     }
+    size_t onSwapOut(UndoSwapFile& file) override;
+    void onCompress() override;
 
   private:
     void swap();
 
     gfx::Region m_region;
     std::stringstream m_stream;
+    size_t m_size;              // Bytes of pixels in m_stream
+
+    // Where m_stream is saved when it's swapped out
+    UndoSwapFile* m_swapFile;
+    size_t m_swapPos;
+
+    // Compressed m_stream (it's compressed when the command is old)
+    UndoBlobPtr m_blob;
   };
 
 } // namespace cmd
@@ -36,7 +36,7 @@ void FlipImage::onUndo()
 
 void FlipImage::swap()
 {
-  Image* image = this->image();
+  Image* image = imageToModify();
 
   // Flip the portion of the bitmap.
   doc::algorithm::flip_image(image, m_bounds, m_flipType);
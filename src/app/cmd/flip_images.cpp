@@ -0,0 +1,58 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd/flip_images.h"
+
+#include "base/thread_pool.h"
+#include "doc/algorithm/flip_image.h"
+#include "doc/image.h"
+
+namespace app {
+namespace cmd {
+
+FlipImages::FlipImages(const std::vector<Image*>& images,
+                       doc::algorithm::FlipType flipType)
+  : m_flipType(flipType)
+{
+  m_imageIds.reserve(images.size());
+  for (Image* image : images)
+    m_imageIds.push_back(image->id());
+}
+
+void FlipImages::onExecute()
+{
+  swap();
+}
+
+void FlipImages::onUndo()
+{
+  swap();
+}
+
+void FlipImages::swap()
+{
+  std::vector<Image*> images;
+  images.reserve(m_imageIds.size());
+  for (ObjectId id : m_imageIds)
+    images.push_back(get<Image>(id));
+
+  base::thread_pool::global().parallel_for(
+    int(images.size()),
+    [this, &images](int i) {
+      Image* image = images[i];
+      image->unshareBuffer();
+      doc::algorithm::flip_image(image, image->bounds(), m_flipType);
+      image->incrementVersion();
+    });
+}
+
+} // namespace cmd
+} // namespace app
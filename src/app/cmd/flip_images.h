@@ -0,0 +1,50 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_CMD_FLIP_IMAGES_H_INCLUDED
+#define APP_CMD_FLIP_IMAGES_H_INCLUDED
+#pragma once
+
+#include "app/cmd.h"
+#include "doc/algorithm/flip_type.h"
+#include "doc/object_id.h"
+
+#include <vector>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+namespace cmd {
+  using namespace doc;
+
+  // Flips several whole images in parallel (e.g. all the cels of the
+  // sprite in Flip Canvas).
+  class FlipImages : public Cmd {
+  public:
+    FlipImages(const std::vector<Image*>& images,
+      doc::algorithm::FlipType flipType);
+
+  protected:
+    void onExecute() override;
+    void onUndo() override;
+    size_t onMemSize() const override {
+      return sizeof(*this) + m_imageIds.size()*sizeof(ObjectId);
+    }
+
+  private:
+    void swap();
+
+    std::vector<ObjectId> m_imageIds;
+    doc::algorithm::FlipType m_flipType;
+  };
+
+} // namespace cmd
+} // namespace app
+
+#endif
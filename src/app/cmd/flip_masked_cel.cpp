@@ -50,6 +50,7 @@ void FlipMaskedCel::swap()
   int x = cel->x();
   int y = cel->y();
 
+  image->unshareBuffer();
   mask->offsetOrigin(-x, -y);
   doc::algorithm::flip_image_with_mask(image, mask, m_flipType, m_bgcolor);
   mask->offsetOrigin(x, y);
@@ -0,0 +1,63 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd/move_frame.h"
+
+#include "doc/cel.h"
+#include "doc/cels_range.h"
+#include "doc/sprite.h"
+
+#include <algorithm>
+
+namespace app {
+namespace cmd {
+
+using namespace doc;
+
+MoveFrame::MoveFrame(Sprite* sprite, frame_t frame, frame_t beforeFrame)
+  : WithSprite(sprite)
+  , m_frame(frame)
+  , m_beforeFrame(beforeFrame)
+{
+}
+
+void MoveFrame::onExecute()
+{
+  moveFrame(m_frame, m_beforeFrame);
+}
+
+void MoveFrame::onUndo()
+{
+  // The moved frame is now in the "beforeFrame-1" position (if it was
+  // moved to the future) or in "beforeFrame" (to the past).
+  if (m_frame < m_beforeFrame)
+    moveFrame(m_beforeFrame-1, m_frame);
+  else
+    moveFrame(m_beforeFrame, m_frame+1);
+}
+
+void MoveFrame::moveFrame(frame_t frame, frame_t beforeFrame)
+{
+  Sprite* sprite = this->sprite();
+  sprite->moveFrame(frame, beforeFrame);
+  sprite->incrementVersion();
+
+  // Cels between both frames have a new frame number
+  frame_t first = std::min(frame, beforeFrame);
+  frame_t last = std::max(frame, beforeFrame-1);
+  for (frame_t fr=first; fr<=last; ++fr) {
+    for (Cel* cel : sprite->cels(fr))
+      cel->incrementVersion();
+  }
+}
+
+} // namespace cmd
+} // namespace app
@@ -0,0 +1,45 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_CMD_MOVE_FRAME_H_INCLUDED
+#define APP_CMD_MOVE_FRAME_H_INCLUDED
+#pragma once
+
+#include "app/cmd.h"
+#include "app/cmd/with_sprite.h"
+#include "doc/frame.h"
+
+namespace app {
+namespace cmd {
+  using namespace doc;
+
+  // Moves a frame (its duration and the cels of all layers) before
+  // other frame. It stores only the frame numbers, so moving a frame
+  // doesn't need one undo command per cel/frame duration.
+  class MoveFrame : public Cmd
+                  , public WithSprite {
+  public:
+    MoveFrame(Sprite* sprite, frame_t frame, frame_t beforeFrame);
+
+  protected:
+    void onExecute() override;
+    void onUndo() override;
+    size_t onMemSize() const override {
+      return sizeof(*this);
+    }
+
+  private:
+    void moveFrame(frame_t frame, frame_t beforeFrame);
+
+    frame_t m_frame;
+    frame_t m_beforeFrame;
+  };
+
+} // namespace cmd
+} // namespace app
+
+#endif
@@ -32,25 +32,15 @@ RemapColors::RemapColors(Sprite* sprite, const Remap& remap)
 void RemapColors::onExecute()
 {
   Sprite* spr = sprite();
-  if (spr->pixelFormat() == IMAGE_INDEXED) {
+  if (spr->pixelFormat() == IMAGE_INDEXED)
     spr->remapImages(0, spr->lastFrame(), m_remap);
-    incrementVersions(spr);
-  }
 }
 
 void RemapColors::onUndo()
 {
   Sprite* spr = this->sprite();
-  if (spr->pixelFormat() == IMAGE_INDEXED) {
+  if (spr->pixelFormat() == IMAGE_INDEXED)
     spr->remapImages(0, spr->lastFrame(), m_remap.invert());
-    incrementVersions(spr);
-  }
-}
-
-void RemapColors::incrementVersions(Sprite* spr)
-{
-  for (const Cel* cel : spr->uniqueCels())
-    cel->image()->incrementVersion();
 }
 
 } // namespace cmd
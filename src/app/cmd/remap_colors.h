@@ -30,8 +30,6 @@ namespace cmd {
     }
 
   private:
-    void incrementVersions(Sprite* spr);
-
     Remap m_remap;
   };
 
@@ -11,6 +11,7 @@
 
 #include "app/cmd/replace_image.h"
 
+#include "app/undo_swap_file.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/image.h"
@@ -29,6 +30,9 @@ ReplaceImage::ReplaceImage(Sprite* sprite, const ImageRef& oldImage, const Image
   , m_oldImageId(oldImage->id())
   , m_newImageId(newImage->id())
   , m_newImage(newImage)
+  , m_swapFile(nullptr)
+  , m_swapPos(0)
+  , m_swapSize(0)
 {
 }
 
@@ -50,6 +54,7 @@ void ReplaceImage::onUndo()
   ImageRef newImage = sprite()->getImageRef(m_newImageId);
   ASSERT(newImage);
   ASSERT(!sprite()->getImageRef(m_oldImageId));
+  loadCopy();
   m_copy->setId(m_oldImageId);
 
   replaceImage(m_newImageId, m_copy);
@@ -61,12 +66,62 @@ void ReplaceImage::onRedo()
   ImageRef oldImage = sprite()->getImageRef(m_oldImageId);
   ASSERT(oldImage);
   ASSERT(!sprite()->getImageRef(m_newImageId));
+  loadCopy();
   m_copy->setId(m_newImageId);
 
   replaceImage(m_oldImageId, m_copy);
   m_copy.reset(Image::createCopy(oldImage.get()));
 }
 
+size_t ReplaceImage::onSwapOut(UndoSwapFile& file)
+{
+  if (!m_copy)
+    return 0;
+
+  // Images are compressed, we prefer speed over size
+  std::stringstream s;
+  write_image(s, m_copy.get(), 1);
+  std::string data = s.str();
+
+  m_swapPos = file.write(data.c_str(), data.size());
+  m_swapSize = data.size();
+  m_swapFile = &file;
+
+  size_t size = m_copy->getMemSize();
+  m_copy.reset();
+  return size;
+}
+
+void ReplaceImage::onCompress()
+{
+  if (!m_copy)
+    return;
+
+  m_blob = std::make_shared<UndoBlob>(m_copy);
+  m_copy.reset();
+
+  UndoBlob::compressLater(m_blob);
+}
+
+void ReplaceImage::loadCopy()
+{
+  if (m_blob) {
+    m_copy = m_blob->takeImage();
+    m_blob.reset();
+    return;
+  }
+
+  if (!m_swapFile)
+    return;
+
+  std::string data(m_swapSize, 0);
+  m_swapFile->read(m_swapPos, &data[0], m_swapSize);
+  m_swapFile = nullptr;
+
+  std::stringstream s(data);
+  m_copy.reset(read_image(s, false));
+}
+
 void ReplaceImage::replaceImage(ObjectId oldId, const ImageRef& newImage)
 {
   Sprite* spr = sprite();
@@ -11,6 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_sprite.h"
+#include "app/undo_blob.h"
 #include "doc/image_ref.h"
 
 #include <sstream>
@@ -30,11 +31,15 @@ namespace cmd {
     void onRedo() override;
     size_t onMemSize() const override {
       return sizeof(*this) +
-        (m_copy ? m_copy->getMemSize(): 0);
+        (m_copy ? m_copy->getMemSize(): 0) +
+        (m_blob ? m_blob->memSize(): 0);
     }
+    size_t onSwapOut(UndoSwapFile& file) override;
+    void onCompress() override;
 
   private:
     void replaceImage(ObjectId oldId, const ImageRef& newImage);
+    void loadCopy();
 
     ObjectId m_oldImageId;
     ObjectId m_newImageId;
@@ -44,6 +49,14 @@ namespace cmd {
     // Then the reference is not used anymore.
     ImageRef m_newImage;
     ImageRef m_copy;
+
+    // Where m_copy is saved when it's swapped out
+    UndoSwapFile* m_swapFile;
+    size_t m_swapPos;
+    size_t m_swapSize;
+
+    // Compressed m_copy
+    UndoBlobPtr m_blob;
   };
 
 } // namespace cmd
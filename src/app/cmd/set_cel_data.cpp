@@ -28,6 +28,7 @@ SetCelData::SetCelData(Cel* cel, const CelDataRef& newData)
   , m_oldDataId(cel->data()->id())
   , m_oldImageId(cel->image()->id())
   , m_newDataId(newData->id())
+  , m_copyOpacity(0)
   , m_newData(newData)
 {
 }
@@ -46,6 +47,7 @@ void SetCelData::onExecute()
 void SetCelData::onUndo()
 {
   Cel* cel = this->cel();
+  loadCopy();
 
   if (m_dataCopy) {
     ASSERT(!cel->sprite()->getCelDataRef(m_oldDataId));
@@ -85,5 +87,29 @@ void SetCelData::createCopy()
   m_dataCopy->setImage(ImageRef(Image::createCopy(cel->image())));
 }
 
+void SetCelData::onCompress()
+{
+  if (!m_dataCopy)
+    return;
+
+  m_imageBlob = std::make_shared<UndoBlob>(m_dataCopy->imageRef());
+  m_copyPosition = m_dataCopy->position();
+  m_copyOpacity = m_dataCopy->opacity();
+  m_dataCopy.reset();
+
+  UndoBlob::compressLater(m_imageBlob);
+}
+
+void SetCelData::loadCopy()
+{
+  if (!m_imageBlob)
+    return;
+
+  m_dataCopy.reset(new CelData(m_imageBlob->takeImage()));
+  m_dataCopy->setPosition(m_copyPosition);
+  m_dataCopy->setOpacity(m_copyOpacity);
+  m_imageBlob.reset();
+}
+
 } // namespace cmd
 } // namespace app
@@ -11,7 +11,9 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_cel.h"
+#include "app/undo_blob.h"
 #include "doc/cel_data.h"
+#include "gfx/point.h"
 
 #include <sstream>
 
@@ -30,17 +32,25 @@ namespace cmd {
     void onRedo() override;
     size_t onMemSize() const override {
       return sizeof(*this) +
-        (m_dataCopy ? m_dataCopy->getMemSize(): 0);
+        (m_dataCopy ? m_dataCopy->getMemSize(): 0) +
+        (m_imageBlob ? m_imageBlob->memSize(): 0);
     }
+    void onCompress() override;
 
   private:
     void createCopy();
+    void loadCopy();
 
     ObjectId m_oldDataId;
     ObjectId m_oldImageId;
     ObjectId m_newDataId;
     CelDataRef m_dataCopy;
 
+    // Compressed image of m_dataCopy (and the other CelData fields)
+    UndoBlobPtr m_imageBlob;
+    gfx::Point m_copyPosition;
+    int m_copyOpacity;
+
     // Reference used only to keep the copy of the new CelData from
     // the SetCelData() ctor until the SetCelData::onExecute() call.
     // Then the reference is not used anymore.
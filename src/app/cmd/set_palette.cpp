@@ -15,6 +15,8 @@
 #include "doc/palette.h"
 #include "doc/sprite.h"
 
+#include <algorithm>
+
 namespace app {
 namespace cmd {
 
@@ -42,6 +44,43 @@ SetPalette::SetPalette(Sprite* sprite, frame_t frame, const Palette* newPalette)
   }
 }
 
+void SetPalette::merge(const Palette* newPalette)
+{
+  Sprite* sprite = this->sprite();
+  Palette* palette = sprite->palette(m_frame);
+
+  int from = -1, to = -1;
+  palette->countDiff(newPalette, &from, &to);
+  if (from < 0 || to < from)
+    return;
+
+  // Entries outside the current range weren't modified by this
+  // command, so their current color is the original one.
+  if (!m_newColors.empty()) {
+    from = std::min(from, m_from);
+    to = std::max(to, m_to);
+  }
+
+  size_t ncolors = to-from+1;
+  std::vector<color_t> oldColors(ncolors);
+  for (size_t i=0; i<ncolors; ++i) {
+    int j = from+int(i);
+    if (!m_oldColors.empty() && j >= m_from && j <= m_to)
+      oldColors[i] = m_oldColors[j-m_from];
+    else
+      oldColors[i] = palette->getEntry(j);
+  }
+
+  m_from = from;
+  m_to = to;
+  m_oldColors.swap(oldColors);
+  m_newColors.resize(ncolors);
+  for (size_t i=0; i<ncolors; ++i)
+    m_newColors[i] = newPalette->getEntry(m_from+i);
+
+  onExecute();
+}
+
 void SetPalette::onExecute()
 {
   Sprite* sprite = this->sprite();
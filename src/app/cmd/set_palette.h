@@ -30,6 +30,15 @@ namespace cmd {
   public:
     SetPalette(Sprite* sprite, frame_t frame, const Palette* newPalette);
 
+    frame_t frame() const { return m_frame; }
+
+    // Applies the differences between the sprite palette and
+    // "newPalette" as part of this command (which must be the last
+    // executed one), so consecutive edits (e.g. dragging a slider)
+    // are undone at once. Only the range of modified entries is
+    // stored, with the original colors of the first edit.
+    void merge(const Palette* newPalette);
+
   protected:
     void onExecute() override;
     void onUndo() override;
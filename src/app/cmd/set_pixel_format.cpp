@@ -16,6 +16,7 @@
 #include "app/cmd/set_cel_opacity.h"
 #include "app/cmd/set_palette.h"
 #include "app/document.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
@@ -23,9 +24,14 @@
 #include "doc/document_event.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/rgbmap.h"
 #include "doc/sprite.h"
 #include "render/quantization.h"
 
+#include <exception>
+#include <set>
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -44,34 +50,58 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
   // TODO Review this, why we use the palette in frame 0?
   frame_t frame(0);
 
-  // Use the rgbmap for the specified sprite
-  const RgbMap* rgbmap = sprite->rgbMap(frame);
+  // Use a full precision map (filled lazily) for the palette of the
+  // specified frame
+  RgbMap rgbmap(8);
+  rgbmap.regenerate(sprite->palette(frame),
+                    (sprite->backgroundLayer() ? -1: sprite->transparentColor()));
 
   // Get the list of cels from the background layer (if it
   // exists). This list will be used to check if each image belong to
   // the background layer.
-  CelList bgCels;
-  if (sprite->backgroundLayer() != NULL)
+  std::set<ObjectId> bgImages;
+  if (sprite->backgroundLayer() != NULL) {
+    CelList bgCels;
     sprite->backgroundLayer()->getCels(bgCels);
+    for (Cel* cel : bgCels)
+      bgImages.insert(cel->image()->id());
+  }
 
+  // Convert all images in parallel (they are independent, and the
+  // lazy RgbMap can be shared between threads). Each result depends
+  // only on its source image, so dithering gives the same result
+  // with any number of threads.
   std::vector<Image*> images;
   sprite->getImages(images);
-  for (auto& old_image : images) {
-    bool is_image_from_background = false;
-    for (CelList::iterator it=bgCels.begin(), end=bgCels.end(); it != end; ++it) {
-      if ((*it)->image()->id() == old_image->id()) {
-        is_image_from_background = true;
-        break;
+
+  std::vector<ImageRef> new_images(images.size());
+  std::vector<std::exception_ptr> errors(images.size());
+  base::thread_pool::global().parallel_for(
+    int(images.size()),
+    [&](int i) {
+      Image* old_image = images[i];
+      bool is_image_from_background =
+        (bgImages.find(old_image->id()) != bgImages.end());
+
+      try {
+        new_images[i].reset(render::convert_pixel_format
+          (old_image, NULL, newFormat, m_dithering, &rgbmap,
+            sprite->palette(frame),
+            is_image_from_background));
       }
-    }
+      catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
 
-    ImageRef new_image(render::convert_pixel_format
-      (old_image, NULL, newFormat, m_dithering, rgbmap,
-        sprite->palette(frame),
-        is_image_from_background));
+  for (const auto& error : errors)
+    if (error)
+      std::rethrow_exception(error);
 
+  // The commands are added in the same order of the images.
+  for (std::size_t i=0; i<images.size(); ++i) {
     m_seq.add(new cmd::ReplaceImage(sprite,
-        sprite->getImageRef(old_image->id()), new_image));
+        sprite->getImageRef(images[i]->id()), new_images[i]));
   }
 
   // Set all cels opacity to 100% if we are converting to indexed.
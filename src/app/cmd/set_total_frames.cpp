@@ -12,7 +12,6 @@
 #include "app/cmd/set_total_frames.h"
 
 #include "app/document.h"
-#include "doc/document_event.h"
 #include "doc/sprite.h"
 
 namespace app {
@@ -42,11 +41,7 @@ void SetTotalFrames::onUndo()
 void SetTotalFrames::onFireNotifications()
 {
   Sprite* sprite = this->sprite();
-  doc::Document* doc = sprite->document();
-  DocumentEvent ev(doc);
-  ev.sprite(sprite);
-  ev.frame(sprite->totalFrames());
-  doc->notifyObservers<DocumentEvent&>(&DocumentObserver::onTotalFramesChanged, ev);
+  static_cast<app::Document*>(sprite->document())->notifyTotalFramesChanged(sprite);
 }
 
 } // namespace cmd
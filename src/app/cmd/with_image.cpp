@@ -28,5 +28,13 @@ Image* WithImage::image()
   return get<Image>(m_imageId);
 }
 
+Image* WithImage::imageToModify()
+{
+  Image* image = get<Image>(m_imageId);
+  if (image)
+    image->unshareBuffer();
+  return image;
+}
+
 } // namespace cmd
 } // namespace app
@@ -24,6 +24,11 @@ namespace cmd {
     WithImage(Image* image);
     Image* image();
 
+    // Returns the image to be modified by the command (the pixels
+    // are copied if they are shared with other image, see
+    // Image::createSharedCopy()).
+    Image* imageToModify();
+
   private:
     ObjectId m_imageId;
   };
@@ -0,0 +1,113 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd_arena.h"
+
+#include "base/debug.h"
+
+#include <new>
+
+#ifdef _MSC_VER
+  #define CMD_ARENA_THREAD_LOCAL __declspec(thread)
+#else
+  #define CMD_ARENA_THREAD_LOCAL __thread
+#endif
+
+namespace app {
+
+namespace {
+
+const std::size_t kChunkSize = 16*1024;
+const std::size_t kAlignment = 16;
+
+CMD_ARENA_THREAD_LOCAL CmdArena* g_current = NULL;
+
+} // anonymous namespace
+
+CmdArena::CmdArena()
+  : m_pos(NULL)
+  , m_end(NULL)
+  , m_reserved(0)
+  , m_used(0)
+  , m_refs(1)
+  , m_closed(false)
+{
+}
+
+CmdArena::~CmdArena()
+{
+  ASSERT(g_current != this);
+
+  for (char* chunk : m_chunks)
+    ::operator delete(chunk);
+}
+
+void* CmdArena::allocate(std::size_t size)
+{
+  size = (size + kAlignment - 1) & ~(kAlignment - 1);
+
+  if (std::size_t(m_end - m_pos) < size) {
+    // Big objects use their own chunk (so the free space of the
+    // current chunk isn't lost)
+    if (size > kChunkSize/4) {
+      char* chunk = (char*)::operator new(size);
+      m_chunks.push_back(chunk);
+      m_reserved += size;
+      m_used += size;
+      return chunk;
+    }
+
+    m_pos = (char*)::operator new(kChunkSize);
+    m_end = m_pos + kChunkSize;
+    m_chunks.push_back(m_pos);
+    m_reserved += kChunkSize;
+  }
+
+  void* ptr = m_pos;
+  m_pos += size;
+  m_used += size;
+  return ptr;
+}
+
+void CmdArena::addRef()
+{
+  ++m_refs;
+}
+
+void CmdArena::release()
+{
+  if (--m_refs == 0)
+    delete this;
+}
+
+std::size_t CmdArena::unusedBytes() const
+{
+  return m_reserved - m_used;
+}
+
+// static
+CmdArena* CmdArena::current()
+{
+  return g_current;
+}
+
+// static
+CmdArena* CmdArena::setCurrent(CmdArena* arena)
+{
+  if (arena)
+    arena->addRef();
+
+  CmdArena* prev = g_current;
+  g_current = arena;
+  return prev;
+}
+
+} // namespace app
@@ -0,0 +1,68 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_CMD_ARENA_H_INCLUDED
+#define APP_CMD_ARENA_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace app {
+
+  // Memory where the Cmds of a CmdTransaction are allocated (see
+  // Cmd::operator new). Creating a Cmd is just moving a pointer, and
+  // all the memory is released at once when the arena is released by
+  // its owner and all its Cmds are deleted (there is one reference
+  // for the owner and one for each Cmd).
+  class CmdArena {
+  public:
+    CmdArena();
+
+    void* allocate(std::size_t size);
+
+    void addRef();
+    void release();
+
+    // Bytes reserved by the arena but not used by its Cmds.
+    std::size_t unusedBytes() const;
+
+    // Marks that no more Cmds are allocated in the arena (its
+    // transaction was closed), so it must not be the current arena
+    // again.
+    void close() { m_closed = true; }
+    bool isClosed() const { return m_closed; }
+
+    // Arena used by Cmd::operator new in the current thread (it can
+    // be NULL).
+    static CmdArena* current();
+
+    // Changes the current arena (which keeps one reference to it),
+    // returning the previous one. The caller gets the reference of
+    // the returned arena (it must release() it).
+    static CmdArena* setCurrent(CmdArena* arena);
+
+  private:
+    ~CmdArena();
+
+    std::vector<char*> m_chunks;
+    char* m_pos;
+    char* m_end;
+    std::size_t m_reserved;
+    std::size_t m_used;
+    std::atomic<int> m_refs;
+    bool m_closed;
+
+    DISABLE_COPYING(CmdArena);
+  };
+
+} // namespace app
+
+#endif
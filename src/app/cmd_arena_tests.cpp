@@ -0,0 +1,123 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "tests/test.h"
+
+#include "app/cmd.h"
+#include "app/cmd_arena.h"
+#include "app/context.h"
+#include "app/document.h"
+#include "app/transaction.h"
+#include "base/unique_ptr.h"
+#include "doc/test_context.h"
+
+#include <vector>
+
+using namespace app;
+
+namespace {
+
+class TestCmd : public Cmd {
+public:
+  TestCmd(int* alive) : m_alive(alive) { ++*m_alive; }
+  ~TestCmd() { --*m_alive; }
+private:
+  int* m_alive;
+  char m_data[40];
+};
+
+} // anonymous namespace
+
+TEST(CmdArena, CmdsInHeap)
+{
+  int alive = 0;
+  ASSERT_EQ(NULL, CmdArena::current());
+
+  Cmd* cmd = new TestCmd(&alive);
+  EXPECT_EQ(1, alive);
+  delete cmd;
+  EXPECT_EQ(0, alive);
+}
+
+TEST(CmdArena, CmdsInArena)
+{
+  int alive = 0;
+  CmdArena* arena = new CmdArena;
+  EXPECT_EQ(NULL, CmdArena::setCurrent(arena));
+  EXPECT_EQ(arena, CmdArena::current());
+
+  std::vector<Cmd*> cmds;
+  for (int i=0; i<1000; ++i)
+    cmds.push_back(new TestCmd(&alive));
+  EXPECT_EQ(1000, alive);
+
+  // Consecutive Cmds are in the same chunk
+  EXPECT_LT(((char*)cmds[1]) - ((char*)cmds[0]), 128);
+  EXPECT_EQ(0, (((size_t)cmds[1]) & 15));
+
+  // The arena is alive until all its Cmds are deleted
+  CmdArena* prev = CmdArena::setCurrent(NULL);
+  EXPECT_EQ(arena, prev);
+  prev->release();
+  arena->release();
+
+  for (Cmd* cmd : cmds)
+    delete cmd;
+  EXPECT_EQ(0, alive);
+}
+
+TEST(CmdArena, TransactionsClosedInOrder)
+{
+  TestContextT<app::Context> ctx;
+  base::UniquePtr<app::Document> doc(static_cast<app::Document*>(ctx.documents().add(8, 8)));
+
+  Transaction a(&ctx, "A");
+  CmdArena* arenaA = CmdArena::current();
+  {
+    Transaction b(&ctx, "B");
+    EXPECT_NE(arenaA, CmdArena::current());
+    b.commit();
+  }
+  EXPECT_EQ(arenaA, CmdArena::current());
+  a.commit();
+  EXPECT_EQ(NULL, CmdArena::current());
+}
+
+TEST(CmdArena, TransactionsClosedOutOfOrder)
+{
+  TestContextT<app::Context> ctx;
+  base::UniquePtr<app::Document> doc(static_cast<app::Document*>(ctx.documents().add(8, 8)));
+
+  base::UniquePtr<Transaction> a(new Transaction(&ctx, "A"));
+  CmdArena* arenaA = CmdArena::current();
+  base::UniquePtr<Transaction> b(new Transaction(&ctx, "B"));
+  CmdArena* arenaB = CmdArena::current();
+  ASSERT_TRUE(arenaA != NULL);
+  EXPECT_NE(arenaA, arenaB);
+
+  // A doesn't change the current arena of B
+  a->commit();
+  a.reset();
+  EXPECT_EQ(arenaB, CmdArena::current());
+
+  // B doesn't restore the arena of A (it's already committed)
+  b->commit();
+  b.reset();
+  EXPECT_EQ(NULL, CmdArena::current());
+
+  {
+    Transaction c(&ctx, "C");
+    EXPECT_TRUE(CmdArena::current() != NULL);
+    EXPECT_NE(arenaA, CmdArena::current());
+    c.commit();
+  }
+  EXPECT_EQ(NULL, CmdArena::current());
+}
@@ -56,6 +56,22 @@ size_t CmdSequence::onMemSize() const
   return size;
 }
 
+size_t CmdSequence::onSwapOut(UndoSwapFile& file)
+{
+  size_t size = 0;
+
+  for (auto it = m_cmds.begin(), end=m_cmds.end(); it!=end; ++it)
+    size += (*it)->swapOut(file);
+
+  return size;
+}
+
+void CmdSequence::onCompress()
+{
+  for (auto it = m_cmds.begin(), end=m_cmds.end(); it!=end; ++it)
+    (*it)->compress();
+}
+
 void CmdSequence::executeAndAdd(Cmd* cmd)
 {
   cmd->execute(context());
@@ -22,11 +22,16 @@ namespace app {
 
     void add(Cmd* cmd);
 
+    // Last added Cmd (or NULL if the sequence is empty).
+    Cmd* lastCmd() const { return (m_cmds.empty() ? NULL: m_cmds.back()); }
+
   protected:
     void onExecute() override;
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override;
+    size_t onSwapOut(UndoSwapFile& file) override;
+    void onCompress() override;
 
     // Helper to create a CmdSequence in the same onExecute() member
     // function.
@@ -11,19 +11,60 @@
 
 #include "app/cmd_transaction.h"
 
+#include "app/cmd_arena.h"
 #include "app/context.h"
+#include "app/document.h"
 #include "doc/site.h"
 
 namespace app {
 
+namespace {
+
+// Merges the notifications of all the commands that are undone/redone
+// (as Transaction does when they are executed the first time).
+class NotificationsBatch {
+public:
+  NotificationsBatch(Context* ctx)
+    : m_doc(ctx ? ctx->activeDocument(): NULL) {
+    if (m_doc)
+      m_doc->beginNotificationsBatch();
+  }
+
+  ~NotificationsBatch() {
+    if (m_doc) {
+      m_doc->endNotificationsBatch();
+      try {
+        m_doc->flushNotifications();
+      }
+      catch (...) {
+        // Avoid throwing exceptions from the dtor
+      }
+    }
+  }
+
+private:
+  Document* m_doc;
+};
+
+} // anonymous namespace
+
 CmdTransaction::CmdTransaction(const std::string& label,
   bool changeSavedState, int* savedCounter)
   : m_label(label)
   , m_changeSavedState(changeSavedState)
   , m_savedCounter(savedCounter)
+  , m_memSizeCounter(nullptr)
+  , m_arena(new CmdArena)
 {
 }
 
+CmdTransaction::~CmdTransaction()
+{
+  // The arena is deleted when all the Cmds are deleted too (in
+  // ~CmdSequence)
+  m_arena->release();
+}
+
 void CmdTransaction::commit()
 {
   m_spritePositionAfter = calcSpritePosition();
@@ -43,7 +84,10 @@ void CmdTransaction::onExecute()
 
 void CmdTransaction::onUndo()
 {
+  NotificationsBatch batch(context());
+  size_t oldMemSize = (m_memSizeCounter ? memSize(): 0);
   CmdSequence::onUndo();
+  updateMemSizeCounter(oldMemSize);
 
   if (m_changeSavedState)
     --(*m_savedCounter);
@@ -51,7 +95,10 @@ void CmdTransaction::onUndo()
 
 void CmdTransaction::onRedo()
 {
+  NotificationsBatch batch(context());
+  size_t oldMemSize = (m_memSizeCounter ? memSize(): 0);
   CmdSequence::onRedo();
+  updateMemSizeCounter(oldMemSize);
 
   if (m_changeSavedState)
     ++(*m_savedCounter);
@@ -62,6 +109,18 @@ std::string CmdTransaction::onLabel() const
   return m_label;
 }
 
+size_t CmdTransaction::onMemSize() const
+{
+  // The free space of the arena is memory used by this transaction too
+  return CmdSequence::onMemSize() + m_arena->unusedBytes();
+}
+
+void CmdTransaction::updateMemSizeCounter(size_t oldMemSize)
+{
+  if (m_memSizeCounter)
+    *m_memSizeCounter = *m_memSizeCounter - oldMemSize + memSize();
+}
+
 doc::SpritePosition CmdTransaction::calcSpritePosition()
 {
   doc::Site site = context()->activeSite();
@@ -12,6 +12,7 @@
 #include "app/cmd_sequence.h"
 
 namespace app {
+  class CmdArena;
 
   // Cmds created on each Transaction.
   // The whole DocumentUndo contains a list of these CmdTransaction.
@@ -19,9 +20,22 @@ namespace app {
   public:
     CmdTransaction(const std::string& label,
       bool changeSavedState, int* savedCounter);
+    ~CmdTransaction();
+
+    // Arena where the Cmds of this transaction are allocated.
+    CmdArena* arena() const { return m_arena; }
 
     void commit();
 
+    // Counter of DocumentUndo updated with the memory used/released
+    // when the transaction is undone/redone (e.g. when data is loaded
+    // from the swap file).
+    void setMemSizeCounter(size_t* counter) { m_memSizeCounter = counter; }
+
+    // Updates the counter when a Cmd of the transaction is modified
+    // after it was added (e.g. cmd::SetPalette::merge()).
+    void updateMemSizeCounter(size_t oldMemSize);
+
     doc::SpritePosition spritePositionBeforeExecute() const { return m_spritePositionBefore; }
     doc::SpritePosition spritePositionAfterExecute() const { return m_spritePositionAfter; }
 
@@ -30,6 +44,7 @@ namespace app {
     void onUndo() override;
     void onRedo() override;
     std::string onLabel() const override;
+    size_t onMemSize() const override;
 
   private:
     doc::SpritePosition calcSpritePosition();
@@ -39,6 +54,8 @@ namespace app {
     std::string m_label;
     bool m_changeSavedState;
     int* m_savedCounter;
+    size_t* m_memSizeCounter;
+    CmdArena* m_arena;
   };
 
 } // namespace app
@@ -11,6 +11,7 @@
 
 #include "app/color_picker.h"
 
+#include "app/document.h"
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/primitives.h"
@@ -35,9 +36,14 @@ void ColorPicker::pickColor(const doc::Site& site,
 
   // Get the color from the image
   if (mode == FromComposition) { // Pick from the composed image
-    m_color = app::Color::fromImage(
-      site.sprite()->pixelFormat(),
-      render::get_sprite_pixel(site.sprite(), pos.x, pos.y, site.frame()));
+    // The composited frame is cached in the document, so picking
+    // colors on each mouse movement doesn't render all layers again
+    const app::Document* doc = static_cast<const app::Document*>(site.document());
+    doc::color_t color =
+      (doc ? doc->spritePixelCache()->getPixel(site.sprite(), pos.x, pos.y, site.frame()):
+             render::get_sprite_pixel(site.sprite(), pos.x, pos.y, site.frame()));
+
+    m_color = app::Color::fromImage(site.sprite()->pixelFormat(), color);
 
     doc::CelList cels;
     site.sprite()->pickCels(pos.x, pos.y, site.frame(), 128, cels);
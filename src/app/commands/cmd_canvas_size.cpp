@@ -220,37 +220,37 @@ private:
     int c = 0;
     for (int v=0; v<3; ++v) {
       for (int u=0; u<3; ++u) {
-        const char* iconId = "canvas_empty";
+        const SkinPartPtr* part = &theme->parts.canvasEmpty();
 
         if (c == sel) {
-          iconId = "canvas_c";
+          part = &theme->parts.canvasC();
         }
         else if (u+1 < 3 && (u+1)+3*v == sel) {
-          iconId = "canvas_w";
+          part = &theme->parts.canvasW();
         }
         else if (u-1 >= 0 && (u-1)+3*v == sel) {
-          iconId = "canvas_e";
+          part = &theme->parts.canvasE();
         }
         else if (v+1 < 3 && u+3*(v+1) == sel) {
-          iconId = "canvas_n";
+          part = &theme->parts.canvasN();
         }
         else if (v-1 >= 0 && u+3*(v-1) == sel) {
-          iconId = "canvas_s";
+          part = &theme->parts.canvasS();
         }
         else if (u+1 < 3 && v+1 < 3 && (u+1)+3*(v+1) == sel) {
-          iconId = "canvas_nw";
+          part = &theme->parts.canvasNw();
         }
         else if (u-1 >= 0 && v+1 < 3 && (u-1)+3*(v+1) == sel) {
-          iconId = "canvas_ne";
+          part = &theme->parts.canvasNe();
         }
         else if (u+1 < 3 && v-1 >= 0 && (u+1)+3*(v-1) == sel) {
-          iconId = "canvas_sw";
+          part = &theme->parts.canvasSw();
         }
         else if (u-1 >= 0 && v-1 >= 0 && (u-1)+3*(v-1) == sel) {
-          iconId = "canvas_se";
+          part = &theme->parts.canvasSe();
         }
 
-        dir()->getItem(c)->setIcon(theme->get_part(iconId));
+        dir()->getItem(c)->setIcon((*part)->getBitmap(0));
         ++c;
       }
     }
@@ -56,6 +56,8 @@ void ChangePixelFormatCommand::onLoadParams(const Params& params)
   std::string dithering = params.get("dithering");
   if (dithering == "ordered")
     m_dithering = DitheringMethod::ORDERED;
+  else if (dithering == "error-diffusion")
+    m_dithering = DitheringMethod::ERROR_DIFFUSION;
   else
     m_dithering = DitheringMethod::NONE;
 }
@@ -68,7 +70,7 @@ bool ChangePixelFormatCommand::onEnabled(Context* context)
   if (sprite != NULL &&
       sprite->pixelFormat() == IMAGE_INDEXED &&
       m_format == IMAGE_INDEXED &&
-      m_dithering == DitheringMethod::ORDERED)
+      m_dithering != DitheringMethod::NONE)
     return false;
 
   return sprite != NULL;
@@ -82,7 +84,7 @@ bool ChangePixelFormatCommand::onChecked(Context* context)
   if (sprite != NULL &&
       sprite->pixelFormat() == IMAGE_INDEXED &&
       m_format == IMAGE_INDEXED &&
-      m_dithering == DitheringMethod::ORDERED)
+      m_dithering != DitheringMethod::NONE)
     return false;
 
   return
@@ -26,7 +26,7 @@
 
 #include "generated_export_sprite_sheet.h"
 
-#include <limits>
+#include <cstdint>
 #include <sstream>
 
 namespace app {
@@ -47,13 +47,13 @@ namespace {
     }
   };
 
-  // Calculate best size for the given sprite
-  // TODO this function was programmed in ten minutes, please optimize it
+  // Calculate best size for the given sprite. It's called each time
+  // an option changes in the dialog, so the frames that fit in each
+  // texture size are counted (instead of placing each frame).
   Fit best_fit(Sprite* sprite, int borderPadding, int shapePadding, int innerPadding) {
     int nframes = sprite->totalFrames();
     int framew = sprite->width()+2*innerPadding;
     int frameh = sprite->height()+2*innerPadding;
-    Fit result(framew*nframes, frameh, nframes, std::numeric_limits<int>::max());
     int w, h;
 
     for (w=2; w < framew; w*=2)
@@ -61,44 +61,22 @@ namespace {
     for (h=2; h < frameh; h*=2)
       ;
 
-    int z = 0;
-    bool fully_contained = false;
-    while (!fully_contained) {  // TODO at this moment we're not
-                                // getting the best fit for less
-                                // freearea, just the first one.
-      gfx::Rect rgnSize(w-2*borderPadding, h-2*borderPadding);
-      gfx::Region rgn(rgnSize);
-      int contained_frames = 0;
-
-      for (int v=0; v+frameh <= rgnSize.h && !fully_contained; v+=frameh+shapePadding) {
-        for (int u=0; u+framew <= rgnSize.w; u+=framew+shapePadding) {
-          gfx::Rect framerc = gfx::Rect(u, v, framew, frameh);
-          rgn.createSubtraction(rgn, gfx::Region(framerc));
-
-          ++contained_frames;
-          if (nframes == contained_frames) {
-            fully_contained = true;
-            break;
-          }
-        }
-      }
-
-      if (fully_contained) {
-        // TODO convert this to a template function gfx::area()
-        int freearea = 0;
-        for (const gfx::Rect& rgnRect : rgn)
-          freearea += rgnRect.w * rgnRect.h;
-
-        Fit fit(w, h, (w / framew), freearea);
-        if (fit.freearea < result.freearea)
-          result = fit;
+    // TODO at this moment we're not getting the best fit for less
+    //      freearea, just the first one.
+    for (int z=0; ; ) {
+      int rgnw = w-2*borderPadding;
+      int rgnh = h-2*borderPadding;
+      int columns = (rgnw >= framew ? (rgnw-framew) / (framew+shapePadding) + 1: 0);
+      int rows = (rgnh >= frameh ? (rgnh-frameh) / (frameh+shapePadding) + 1: 0);
+
+      if (int64_t(columns)*rows >= nframes) {
+        int freearea = rgnw*rgnh - nframes*framew*frameh;
+        return Fit(w, h, (w / framew), freearea);
       }
 
       if ((++z) & 1) w *= 2;
       else h *= 2;
     }
-
-    return result;
   }
 
   Fit calculate_sheet_size(Sprite* sprite, int columns, int borderPadding, int shapePadding, int innerPadding) {
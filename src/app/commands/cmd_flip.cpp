@@ -12,6 +12,7 @@
 #include "app/commands/cmd_flip.h"
 
 #include "app/app.h"
+#include "app/cmd/flip_images.h"
 #include "app/cmd/flip_mask.h"
 #include "app/cmd/flip_masked_cel.h"
 #include "app/commands/params.h"
@@ -32,6 +33,8 @@
 #include "doc/sprite.h"
 #include "gfx/size.h"
 
+#include <vector>
+
 namespace app {
 
 FlipCommand::FlipCommand()
@@ -142,6 +145,8 @@ void FlipCommand::onExecute(Context* context)
       }
     }
     else {
+      std::vector<Image*> images;
+
       for (Cel* cel : sprite->uniqueCels()) {
         Image* image = cel->image();
 
@@ -154,8 +159,12 @@ void FlipCommand::onExecute(Context* context)
               sprite->height() - image->height() - cel->y():
               cel->y()));
 
-        api.flipImage(image, image->bounds(), m_flipType);
+        images.push_back(image);
       }
+
+      // All images are flipped in parallel
+      if (!images.empty())
+        transaction.execute(new cmd::FlipImages(images, m_flipType));
     }
 
     transaction.commit();
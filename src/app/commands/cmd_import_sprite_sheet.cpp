@@ -29,8 +29,11 @@
 #include "app/ui/editor/standby_state.h"
 #include "app/ui/workspace.h"
 #include "base/bind.h"
+#include "base/thread_pool.h"
+#include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/image.h"
+#include "doc/image_hash.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
@@ -39,6 +42,10 @@
 
 #include "generated_import_sprite_sheet.h"
 
+#include <map>
+#include <tuple>
+#include <vector>
+
 namespace app {
 
 using namespace ui;
@@ -225,6 +232,17 @@ private:
   DocumentPreferences* m_docPref;
 };
 
+// A tile of the sheet trimmed to its content
+struct ImportedTile {
+  gfx::Point sheetPos;        // Position of the tile in the sheet
+  ImageRef image;             // NULL if the tile is empty
+  gfx::Point celPos;          // Position of the trimmed image in the tile
+  uint64_t hash;
+
+  ImportedTile(const gfx::Point& sheetPos)
+    : sheetPos(sheetPos), celPos(0, 0), hash(0) { }
+};
+
 class ImportSpriteSheetCommand : public Command {
 public:
   ImportSpriteSheetCommand();
@@ -258,26 +276,15 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
     return;
 
   // The list of frames imported from the sheet
-  std::vector<ImageRef> animation;
+  std::vector<ImportedTile> animation;
 
   try {
     Sprite* sprite = document->sprite();
     frame_t currentFrame = context->activeSite().frame();
-    render::Render render;
 
-    // As first step, we cut each tile and add them into "animation" list.
-    for (int y=frameBounds.y; y<sprite->height(); y += frameBounds.h) {
-      for (int x=frameBounds.x; x<sprite->width(); x += frameBounds.w) {
-        ImageRef resultImage(
-          Image::create(sprite->pixelFormat(), frameBounds.w, frameBounds.h));
-
-        // Render the portion of sheet.
-        render.renderSprite(resultImage.get(), sprite, currentFrame,
-          gfx::Clip(0, 0, x, y, frameBounds.w, frameBounds.h));
-
-        animation.push_back(resultImage);
-      }
-    }
+    for (int y=frameBounds.y; y<sprite->height(); y += frameBounds.h)
+      for (int x=frameBounds.x; x<sprite->width(); x += frameBounds.w)
+        animation.push_back(ImportedTile(gfx::Point(x, y)));
 
     if (animation.size() == 0) {
       Alert::show("Import Sprite Sheet"
@@ -287,6 +294,35 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
       return;
     }
 
+    // As first step, we cut each tile in parallel, trimming it to its
+    // content (empty tiles will be frames without cel).
+    base::thread_pool::global().parallel_for(
+      int(animation.size()), [&](int i) {
+        ImportedTile& tile = animation[i];
+        ImageRef tileImage(
+          Image::create(sprite->pixelFormat(), frameBounds.w, frameBounds.h));
+
+        // Render the portion of sheet.
+        render::Render render;
+        render.renderSprite(tileImage.get(), sprite, currentFrame,
+          gfx::Clip(0, 0, tile.sheetPos.x, tile.sheetPos.y,
+                    frameBounds.w, frameBounds.h));
+
+        gfx::Rect bounds;
+        if (!doc::algorithm::shrink_bounds(tileImage.get(), bounds,
+                                           sprite->transparentColor()))
+          return;
+
+        if (bounds != tileImage->bounds())
+          tileImage.reset(crop_image(tileImage.get(),
+                                     bounds.x, bounds.y, bounds.w, bounds.h,
+                                     sprite->transparentColor()));
+
+        tile.image = tileImage;
+        tile.celPos = bounds.getOrigin();
+        tile.hash = doc::hash_image(tileImage.get());
+      });
+
     // The following steps modify the sprite, so we wrap all
     // operations in a undo-transaction.
     ContextWriter writer(context);
@@ -296,10 +332,37 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
     // Add the layer in the sprite.
     LayerImage* resultLayer = api.newLayer(sprite);
 
-    // Add all frames+cels to the new layer
+    // Add all frames+cels to the new layer. Identical tiles are
+    // linked to the first cel with the same image (compared by hash
+    // first, and then with memcmp()).
+    typedef std::tuple<uint64_t, int, int> Key;
+    std::map<Key, std::vector<Cel*> > celsByKey;
+
     for (size_t i=0; i<animation.size(); ++i) {
+      const ImportedTile& tile = animation[i];
+      if (!tile.image)
+        continue;
+
+      Key key(tile.hash, tile.celPos.x, tile.celPos.y);
+      std::vector<Cel*>& sameKey = celsByKey[key];
+
+      Cel* original = nullptr;
+      for (Cel* candidate : sameKey) {
+        if (doc::is_same_image(candidate->image(), tile.image.get())) {
+          original = candidate;
+          break;
+        }
+      }
+
       // Create the cel.
-      base::UniquePtr<Cel> resultCel(new Cel(frame_t(i), animation[i]));
+      base::UniquePtr<Cel> resultCel;
+      if (original)
+        resultCel.reset(new Cel(frame_t(i), original->dataRef()));
+      else {
+        resultCel.reset(new Cel(frame_t(i), tile.image));
+        resultCel->setPosition(tile.celPos);
+        sameKey.push_back(resultCel);
+      }
 
       // Add the cel in the layer.
       api.addCel(resultLayer, resultCel);
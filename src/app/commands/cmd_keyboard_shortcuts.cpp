@@ -50,6 +50,9 @@ public:
     , m_level(level)
     , m_hotAccel(-1) {
     this->border_width.t = this->border_width.b = 0;
+
+    // The preferred size depends on the number of accelerators
+    disableSizeCache();
   }
 
   void restoreKeys() {
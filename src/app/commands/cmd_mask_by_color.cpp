@@ -32,6 +32,7 @@
 #include "ui/button.h"
 #include "ui/label.h"
 #include "ui/slider.h"
+#include "ui/timer.h"
 #include "ui/widget.h"
 #include "ui/window.h"
 
@@ -51,16 +52,23 @@ protected:
 private:
   Mask* generateMask(const Sprite* sprite, const Image* image, int xpos, int ypos);
   void maskPreview(const ContextReader& reader);
+  void schedulePreview();
 
   ColorButton* m_buttonColor;
   CheckBox* m_checkPreview;
   Slider* m_sliderTolerance;
+  Timer* m_previewTimer;
 };
 
+// Milliseconds between preview updates, so a burst of changes (e.g.
+// dragging the tolerance slider) generates only one mask.
+static const int kPreviewDelay = 50;
+
 MaskByColorCommand::MaskByColorCommand()
   : Command("MaskByColor",
             "Mask By Color",
             CmdUIOnlyFlag)
+  , m_previewTimer(nullptr)
 {
 }
 
@@ -111,9 +119,13 @@ void MaskByColorCommand::onExecute(Context* context)
   button_ok->Click.connect(Bind<void>(&Window::closeWindow, window.get(), button_ok));
   button_cancel->Click.connect(Bind<void>(&Window::closeWindow, window.get(), button_cancel));
 
-  m_buttonColor->Change.connect(Bind<void>(&MaskByColorCommand::maskPreview, this, Ref(reader)));
-  m_sliderTolerance->Change.connect(Bind<void>(&MaskByColorCommand::maskPreview, this, Ref(reader)));
-  m_checkPreview->Click.connect(Bind<void>(&MaskByColorCommand::maskPreview, this, Ref(reader)));
+  Timer previewTimer(kPreviewDelay, window.get());
+  m_previewTimer = &previewTimer;
+  previewTimer.Tick.connect(Bind<void>(&MaskByColorCommand::maskPreview, this, Ref(reader)));
+
+  m_buttonColor->Change.connect(Bind<void>(&MaskByColorCommand::schedulePreview, this));
+  m_sliderTolerance->Change.connect(Bind<void>(&MaskByColorCommand::schedulePreview, this));
+  m_checkPreview->Click.connect(Bind<void>(&MaskByColorCommand::schedulePreview, this));
 
   button_ok->setFocusMagnet(true);
   m_buttonColor->setExpansive(true);
@@ -146,6 +158,7 @@ void MaskByColorCommand::onExecute(Context* context)
   window->openWindowInForeground();
 
   bool apply = (window->getKiller() == button_ok);
+  previewTimer.stop();
 
   ContextWriter writer(reader);
   Document* document(writer.document());
@@ -183,8 +196,18 @@ Mask* MaskByColorCommand::generateMask(const Sprite* sprite, const Image* image,
   return mask.release();
 }
 
+void MaskByColorCommand::schedulePreview()
+{
+  // The preview is updated at most once each kPreviewDelay
+  // milliseconds while the parameters are being changed
+  if (!m_previewTimer->isRunning())
+    m_previewTimer->start();
+}
+
 void MaskByColorCommand::maskPreview(const ContextReader& reader)
 {
+  m_previewTimer->stop();
+
   if (m_checkPreview->isSelected()) {
     int xpos, ypos;
     const Image* image = reader.image(&xpos, &ypos);
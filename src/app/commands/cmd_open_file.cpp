@@ -9,8 +9,9 @@
 #include "config.h"
 #endif
 
+#include "app/commands/cmd_open_file.h"
+
 #include "app/app.h"
-#include "app/commands/command.h"
 #include "app/commands/params.h"
 #include "app/console.h"
 #include "app/document.h"
@@ -19,6 +20,7 @@
 #include "app/job.h"
 #include "app/modules/editors.h"
 #include "app/modules/gui.h"
+#include "app/pref/preferences.h"
 #include "app/recent_files.h"
 #include "app/ui/status_bar.h"
 #include "app/ui_context.h"
@@ -33,67 +35,52 @@
 
 namespace app {
 
-class OpenFileCommand : public Command {
-public:
-  OpenFileCommand();
-  Command* clone() const override { return new OpenFileCommand(*this); }
-
-protected:
-  void onLoadParams(const Params& params) override;
-  void onExecute(Context* context) override;
-
-private:
-  std::string m_filename;
-  std::string m_folder;
-};
-
 class OpenFileJob : public Job, public IFileOpProgress
 {
 public:
-  OpenFileJob(FileOp* fop)
-    : Job("Loading file")
-    , m_fop(fop)
+  OpenFileJob(const std::vector<FileOp*>& fops)
+    : Job(fops.size() == 1 ? "Loading file": "Loading files")
+    , m_fops(fops)
   {
   }
 
   void showProgressWindow() {
     startJob();
 
-    if (isCanceled())
-      fop_stop(m_fop);
+    if (isCanceled()) {
+      for (FileOp* fop : m_fops)
+        fop_stop(fop);
+    }
 
     waitJob();
   }
 
 private:
-  // Thread to do the hard work: load the file from the disk.
+  // Thread to do the hard work: load the files from the disk (all
+  // of them at the same time).
   virtual void onJob() override {
-    try {
-      fop_operate(m_fop, this);
-    }
-    catch (const std::exception& e) {
-      fop_error(m_fop, "Error loading file:\n%s", e.what());
-    }
+    fop_operate_all(m_fops, this);
 
-    if (fop_is_stop(m_fop) && m_fop->document) {
-      delete m_fop->document;
-      m_fop->document = NULL;
+    for (FileOp* fop : m_fops) {
+      if (fop_is_stop(fop) && fop->document) {
+        delete fop->document;
+        fop->document = NULL;
+      }
     }
-
-    fop_done(m_fop);
   }
 
   virtual void ackFileOpProgress(double progress) override {
     jobProgress(progress);
   }
 
-  FileOp* m_fop;
+  std::vector<FileOp*> m_fops;
 };
 
 OpenFileCommand::OpenFileCommand()
   : Command("OpenFile",
             "Open Sprite",
             CmdRecordableFlag)
+  , m_lazy(false)
 {
 }
 
@@ -101,63 +88,103 @@ void OpenFileCommand::onLoadParams(const Params& params)
 {
   m_filename = params.get("filename");
   m_folder = params.get("folder"); // Initial folder
+  m_lazy = (params.get("lazy") == "true");
 }
 
 void OpenFileCommand::onExecute(Context* context)
 {
   Console console;
 
-  // interactive
-  if (context->isUIAvailable() && m_filename.empty()) {
-    std::string exts = get_readable_extensions();
+  // Files given with setFilenames() are used only one time
+  std::vector<std::string> filenames;
+  std::swap(filenames, m_filenames);
+
+  if (filenames.empty()) {
+    // interactive
+    if (context->isUIAvailable() && m_filename.empty()) {
+      std::string exts = get_readable_extensions();
 
-    // Add backslash as show_file_selector() expected a filename as
-    // initial path (and the file part is removed from the path).
-    if (!m_folder.empty() && !base::is_path_separator(m_folder[m_folder.size()-1]))
-      m_folder.push_back(base::path_separator);
+      // Add backslash as show_file_selector() expected a filename as
+      // initial path (and the file part is removed from the path).
+      if (!m_folder.empty() && !base::is_path_separator(m_folder[m_folder.size()-1]))
+        m_folder.push_back(base::path_separator);
 
-    m_filename = app::show_file_selector("Open", m_folder, exts,
-      FileSelectorType::Open);
+      m_filename = app::show_file_selector("Open", m_folder, exts,
+        FileSelectorType::Open);
+    }
+
+    if (!m_filename.empty())
+      filenames.push_back(m_filename);
   }
 
-  if (!m_filename.empty()) {
-    base::UniquePtr<FileOp> fop(fop_to_load_document(context, m_filename.c_str(), FILE_LOAD_SEQUENCE_ASK));
-    bool unrecent = false;
+  if (filenames.empty())
+    return;
 
-    if (fop) {
-      if (fop->has_error()) {
-        console.printf(fop->error.c_str());
-        unrecent = true;
-      }
-      else {
-        OpenFileJob task(fop);
-        task.showProgressWindow();
-
-        // Post-load processing, it is called from the GUI because may require user intervention.
-        fop_post_load(fop);
-
-        // Show any error
-        if (fop->has_error())
-          console.printf(fop->error.c_str());
-
-        Document* document = fop->document;
-        if (document) {
-          App::instance()->getRecentFiles()->addRecentFile(fop->filename.c_str());
-          document->setContext(context);
-        }
-        else if (!fop_is_stop(fop))
-          unrecent = true;
-      }
+  // With progressive open the document is displayed as soon as
+  // the structure of the file is read, and the cels are decoded
+  // when they are needed (or in background, see below).
+  bool progressive = (context->isUIAvailable() &&
+                      Preferences::instance().general.progressiveOpen());
 
-      // The file was not found or was loaded loaded with errors,
-      // so we can remove it from the recent-file list
-      if (unrecent) {
-        App::instance()->getRecentFiles()->removeRecentFile(m_filename.c_str());
-      }
+  int flags = FILE_LOAD_SEQUENCE_ASK;
+  if (m_lazy || progressive)
+    flags |= FILE_LOAD_LAZY_CELS;
+
+  RecentFiles* recent = App::instance()->getRecentFiles();
+  std::vector<FileOp*> fops;
+  std::vector<std::string> fopFilenames;
+
+  for (const std::string& filename : filenames) {
+    FileOp* fop = fop_to_load_document(context, filename.c_str(), flags);
+    if (!fop) {
+      // Do nothing (the user cancelled or something like that)
+      continue;
+    }
+
+    if (fop->has_error()) {
+      console.printf(fop->error.c_str());
+      fop_free(fop);
+
+      // The file was not found, so we can remove it from the
+      // recent-file list
+      recent->removeRecentFile(filename.c_str());
     }
     else {
-      // Do nothing (the user cancelled or something like that)
+      fops.push_back(fop);
+      fopFilenames.push_back(filename);
+    }
+  }
+
+  if (fops.empty())
+    return;
+
+  OpenFileJob task(fops);
+  task.showProgressWindow();
+
+  // Documents are added to the context in the same order as the
+  // given files.
+  for (std::size_t i=0; i<fops.size(); ++i) {
+    base::UniquePtr<FileOp> fop(fops[i]);
+
+    // Post-load processing, it is called from the GUI because may require user intervention.
+    fop_post_load(fop);
+
+    // Show any error
+    if (fop->has_error())
+      console.printf(fop->error.c_str());
+
+    Document* document = fop->document;
+    if (document) {
+      recent->addRecentFile(fop->filename.c_str());
+      document->setContext(context);
+
+      if (progressive)
+        document->preloadCelImages(frame_t(0));
     }
+    // The file was loaded with errors, so we can remove it from the
+    // recent-file list
+    else if (!fop_is_stop(fop))
+      recent->removeRecentFile(fopFilenames[i].c_str());
   }
 }
 
@@ -0,0 +1,44 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_COMMANDS_CMD_OPEN_FILE_H_INCLUDED
+#define APP_COMMANDS_CMD_OPEN_FILE_H_INCLUDED
+#pragma once
+
+#include "app/commands/command.h"
+
+#include <string>
+#include <vector>
+
+namespace app {
+
+  class OpenFileCommand : public Command {
+  public:
+    OpenFileCommand();
+    Command* clone() const override { return new OpenFileCommand(*this); }
+
+    // Files to be opened in the next execution of the command
+    // (instead of the "filename" param). All of them are decoded at
+    // the same time with one progress window.
+    void setFilenames(const std::vector<std::string>& filenames) {
+      m_filenames = filenames;
+    }
+
+  protected:
+    void onLoadParams(const Params& params) override;
+    void onExecute(Context* context) override;
+
+  private:
+    std::string m_filename;
+    std::string m_folder;
+    std::vector<std::string> m_filenames;
+    bool m_lazy;
+  };
+
+} // namespace app
+
+#endif
@@ -90,6 +90,9 @@ public:
     if (m_preferences.experimental.flashLayer())
       flashLayer()->setSelected(true);
 
+    if (m_preferences.experimental.asyncRender())
+      asyncRender()->setSelected(true);
+
     if (m_preferences.editor.showScrollbars())
       showScrollbars()->setSelected(true);
 
@@ -142,6 +145,8 @@ public:
 
     // Undo preferences
     undoSizeLimit()->setTextf("%d", m_preferences.undo.sizeLimit());
+    undoGlobalSizeLimit()->setTextf("%d", m_preferences.undo.globalSizeLimit());
+    undoCompressAfter()->setTextf("%d", m_preferences.undo.compressAfter());
     undoGotoModified()->setSelected(m_preferences.undo.gotoModified());
     undoAllowNonlinearHistory()->setSelected(m_preferences.undo.allowNonlinearHistory());
 
@@ -194,6 +199,8 @@ public:
     undo_size_limit_value = MID(1, undo_size_limit_value, 9999);
 
     m_preferences.undo.sizeLimit(undo_size_limit_value);
+    m_preferences.undo.globalSizeLimit(MID(0, undoGlobalSizeLimit()->getTextInt(), 99999));
+    m_preferences.undo.compressAfter(MID(0, undoCompressAfter()->getTextInt(), 9999));
     m_preferences.undo.gotoModified(undoGotoModified()->isSelected());
     m_preferences.undo.allowNonlinearHistory(undoAllowNonlinearHistory()->isSelected());
 
@@ -201,6 +208,7 @@ public:
     m_preferences.experimental.useNativeCursor(nativeCursor()->isSelected());
     m_preferences.experimental.useNativeFileDialog(nativeFileDialog()->isSelected());
     m_preferences.experimental.flashLayer(flashLayer()->isSelected());
+    m_preferences.experimental.asyncRender(asyncRender()->isSelected());
     ui::set_use_native_cursors(
       m_preferences.experimental.useNativeCursor());
 
@@ -11,7 +11,7 @@
 
 #include "app/app.h"
 #include "app/cmd/set_palette.h"
-#include "app/cmd_sequence.h"
+#include "app/cmd_transaction.h"
 #include "app/color.h"
 #include "app/color_utils.h"
 #include "app/commands/command.h"
@@ -105,12 +105,15 @@ private:
   // what the user is writting in the text field.
   bool m_disableHexUpdate;
 
+  // The current editor is invalidated on each change (so it's
+  // painted once per frame), and all editors and PaletteChange
+  // observers are updated when the timer ticks (after the last
+  // change in a short time).
   ui::Timer m_redrawTimer;
-  bool m_redrawAll;
 
-  // True if the palette change must be implant in the UndoHistory
-  // (e.g. when two or more changes in the palette are made in short
-  // time).
+  // True if the palette change must be merged with the last
+  // cmd::SetPalette in the UndoHistory (e.g. when two or more
+  // changes in the palette are made in short time).
   bool m_implantChange;
 
   // True if the PaletteChange signal is generated by the same
@@ -247,7 +250,6 @@ PaletteEntryEditor::PaletteEntryEditor()
   , m_entryLabel("")
   , m_disableHexUpdate(false)
   , m_redrawTimer(250, this)
-  , m_redrawAll(false)
   , m_implantChange(false)
   , m_selfPalChange(false)
   , m_fromPalette(0, Palette::MaxColors)
@@ -352,33 +354,23 @@ bool PaletteEntryEditor::onProcessMessage(Message* msg)
 {
   if (msg->type() == kTimerMessage &&
       static_cast<TimerMessage*>(msg)->timer() == &m_redrawTimer) {
+    m_implantChange = false;
+    m_redrawTimer.stop();
+
+    // Call all observers of PaletteChange event.
+    m_selfPalChange = true;
+    App::instance()->PaletteChange();
+    m_selfPalChange = false;
+
     // Redraw all editors
-    if (m_redrawAll) {
-      m_redrawAll = false;
-      m_implantChange = false;
-      m_redrawTimer.stop();
-
-      // Call all observers of PaletteChange event.
-      m_selfPalChange = true;
-      App::instance()->PaletteChange();
-      m_selfPalChange = false;
-
-      // Redraw all editors
-      try {
-        ContextWriter writer(UIContext::instance());
-        Document* document(writer.document());
-        if (document != NULL)
-          document->notifyGeneralUpdate();
-      }
-      catch (...) {
-        // Do nothing
-      }
+    try {
+      ContextWriter writer(UIContext::instance());
+      Document* document(writer.document());
+      if (document != NULL)
+        document->notifyGeneralUpdate();
     }
-    // Redraw just the current editor
-    else {
-      m_redrawAll = true;
-      if (current_editor != NULL)
-        current_editor->updateEditor();
+    catch (...) {
+      // Do nothing
     }
   }
   return Window::onProcessMessage(msg);
@@ -672,21 +664,29 @@ void PaletteEntryEditor::updateCurrentSpritePalette(const char* operationName)
 
       if (from >= 0 && to >= from) {
         DocumentUndo* undo = document->undoHistory();
-        Cmd* cmd = new cmd::SetPalette(sprite, frame, newPalette);
 
-        // Add undo information to save the range of pal entries that will be modified.
+        // Merge the change with the last cmd::SetPalette if it's
+        // related about the same color palette modifications, so
+        // a drag is undone at once and only its range of modified
+        // entries is stored.
+        CmdTransaction* lastTransaction = NULL;
+        cmd::SetPalette* lastCmd = NULL;
         if (m_implantChange &&
             undo->lastExecutedCmd() &&
             undo->lastExecutedCmd()->label() == operationName) {
-          // Implant the cmd in the last CmdSequence if it's
-          // related about color palette modifications
-          ASSERT(dynamic_cast<CmdSequence*>(undo->lastExecutedCmd()));
-          static_cast<CmdSequence*>(undo->lastExecutedCmd())->add(cmd);
-          cmd->execute(UIContext::instance());
+          ASSERT(dynamic_cast<CmdTransaction*>(undo->lastExecutedCmd()));
+          lastTransaction = static_cast<CmdTransaction*>(undo->lastExecutedCmd());
+          lastCmd = dynamic_cast<cmd::SetPalette*>(lastTransaction->lastCmd());
+        }
+
+        if (lastCmd && lastCmd->frame() == frame) {
+          size_t oldMemSize = lastTransaction->memSize();
+          lastCmd->merge(newPalette);
+          lastTransaction->updateMemSizeCounter(oldMemSize);
         }
         else {
           Transaction transaction(writer.context(), operationName, ModifyDocument);
-          transaction.execute(cmd);
+          transaction.execute(new cmd::SetPalette(sprite, frame, newPalette));
           transaction.commit();
         }
       }
@@ -699,10 +699,15 @@ void PaletteEntryEditor::updateCurrentSpritePalette(const char* operationName)
   PaletteView* palette_editor = ColorBar::instance()->getPaletteView();
   palette_editor->invalidate();
 
-  if (!m_redrawTimer.isRunning())
-    m_redrawTimer.start();
+  // Widgets are painted once per frame (see ui::Manager), so
+  // several changes in the same frame regenerate the RgbMap and
+  // repaint the current editor just once.
+  if (current_editor != NULL)
+    current_editor->invalidate();
+
+  // Restart the timer, all editors are updated after the last change
+  m_redrawTimer.start();
 
-  m_redrawAll = false;
   m_implantChange = true;
 }
 
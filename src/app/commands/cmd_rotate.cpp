@@ -23,6 +23,7 @@
 #include "app/ui/timeline.h"
 #include "app/util/range_utils.h"
 #include "base/convert_to.h"
+#include "base/thread_pool.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/image.h"
@@ -30,6 +31,9 @@
 #include "doc/sprite.h"
 #include "ui/ui.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 class RotateCommand : public Command {
@@ -103,21 +107,37 @@ protected:
       }
     }
 
-    // 2) Rotate images
-    int i = 0;
-    for (Cel* cel : m_cels) {
-      Image* image = cel->image();
-      if (image) {
-        ImageRef new_image(Image::create(image->pixelFormat(),
-            m_angle == 180 ? image->width(): image->height(),
-            m_angle == 180 ? image->height(): image->width()));
-        doc::rotate_image(image, new_image.get(), m_angle);
-
-        api.replaceImage(m_sprite, cel->imageRef(), new_image);
+    // 2) Rotate images (in parallel batches, the progress is updated
+    // and the operation can be canceled between batches)
+    const int cels_count = int(m_cels.size());
+    const int batch = 4*(base::thread_pool::global().workers()+1);
+    std::vector<ImageRef> new_images;
+
+    for (int i=0; i<cels_count; i+=batch) {
+      int n = std::min(batch, cels_count-i);
+      new_images.assign(n, ImageRef());
+
+      base::thread_pool::global().parallel_for(
+        n, [this, &new_images, i](int j) {
+          Image* image = m_cels[i+j]->image();
+          if (!image)
+            return;
+
+          ImageRef new_image(Image::create(image->pixelFormat(),
+              m_angle == 180 ? image->width(): image->height(),
+              m_angle == 180 ? image->height(): image->width()));
+          doc::rotate_image(image, new_image.get(), m_angle);
+
+          new_images[j] = new_image;
+        });
+
+      for (int j=0; j<n; ++j) {
+        if (new_images[j])
+          api.replaceImage(m_sprite, m_cels[i+j]->imageRef(), new_images[j]);
       }
+      new_images.clear();
 
-      jobProgress((float)i / m_cels.size());
-      ++i;
+      jobProgress((float)(i+n) / cels_count);
 
       // cancel all the operation?
       if (isCanceled())
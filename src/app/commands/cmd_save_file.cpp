@@ -20,19 +20,30 @@
 #include "app/file/file.h"
 #include "app/file_selector.h"
 #include "app/job.h"
+#include "app/document_undo.h"
 #include "app/modules/gui.h"
+#include "app/notification_delegate.h"
 #include "app/pref/preferences.h"
 #include "app/recent_files.h"
+#include "app/ui/main_window.h"
 #include "app/ui/status_bar.h"
+#include "app/ui/workspace_tabs.h"
+#include "app/ui_context.h"
 #include "base/bind.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
+#include "base/launcher.h"
 #include "base/path.h"
 #include "base/thread.h"
 #include "base/unique_ptr.h"
 #include "doc/sprite.h"
 #include "ui/ui.h"
 
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <vector>
+
 namespace app {
 
 class SaveAsCopyDelegate : public FileSelectorDelegate {
@@ -130,6 +141,227 @@ static void save_document_in_background(const Context* context,
   }
 }
 
+//////////////////////////////////////////////////////////////////////
+// Background saves
+
+namespace {
+
+// Notification with the result of a background save. Clicking it
+// opens the folder of the file.
+class SaveNotification : public INotificationDelegate {
+public:
+  SaveNotification(const std::string& text, const std::string& filename)
+    : m_text(text), m_filename(filename) { }
+
+  std::string notificationText() override {
+    return m_text;
+  }
+
+  void notificationClick() override {
+    base::launcher::open_folder(m_filename);
+  }
+
+private:
+  std::string m_text;
+  std::string m_filename;
+};
+
+// Menu items of the notifications reference these objects until
+// the program ends.
+std::list<std::unique_ptr<SaveNotification>> save_notifications;
+
+// A copy of a document saved by a background thread while the user
+// keeps editing the original one.
+class BackgroundSave {
+public:
+  BackgroundSave(Document* document, Document* snapshot,
+                 FileOp* fop, int savedCounter)
+    : m_documentId(document->id())
+    , m_snapshot(snapshot)
+    , m_fop(fop)
+    , m_savedCounter(savedCounter)
+    , m_thread(Bind<void>(&BackgroundSave::onThread, this)) {
+  }
+
+  ~BackgroundSave() {
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  doc::ObjectId documentId() const { return m_documentId; }
+  bool isDone() { return fop_is_done(m_fop); }
+  void wait() {
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  // Reports the result to the original document (if it's still
+  // open). [main thread]
+  void finish() {
+    wait();
+
+    Document* document = nullptr;
+    doc::Object* obj = doc::get_object(m_documentId);
+    if (obj && obj->type() == doc::ObjectType::Document)
+      document = static_cast<Document*>(obj);
+
+    std::string filename = m_snapshot->filename();
+    std::string text;
+
+    if (m_fop->has_error()) {
+      Console console;
+      console.printf(m_fop->error.c_str());
+
+      if (document)
+        document->impossibleToBackToSavedState();
+      text = "Error saving " + base::get_file_name(filename);
+    }
+    else if (fop_is_stop(m_fop)) {
+      if (document)
+        document->impossibleToBackToSavedState();
+      return;
+    }
+    else {
+      App::instance()->getRecentFiles()->addRecentFile(filename.c_str());
+
+      // The saved state is the state of the snapshot, so the changes
+      // made while it was being saved keep the document modified.
+      if (document) {
+        document->undoHistory()->markSavedState(m_savedCounter);
+        document->setFormatOptions(m_snapshot->getFormatOptions());
+      }
+
+      StatusBar::instance()->setStatusText(
+        2000, "File %s, saved.", base::get_file_name(filename).c_str());
+      text = base::get_file_name(filename) + " saved";
+    }
+
+    save_notifications.push_back(
+      std::unique_ptr<SaveNotification>(new SaveNotification(text, filename)));
+    App::instance()->showNotification(save_notifications.back().get());
+    App::instance()->getMainWindow()->getTabsBar()->invalidate();
+  }
+
+private:
+  void onThread() {
+    base::this_thread::set_qos(base::thread_qos::user_initiated);
+    try {
+      fop_operate(m_fop, nullptr);
+    }
+    catch (const std::exception& e) {
+      fop_error(m_fop, "Error saving file:\n%s", e.what());
+    }
+    fop_done(m_fop);
+  }
+
+  doc::ObjectId m_documentId;
+  base::UniquePtr<Document> m_snapshot;
+  base::UniquePtr<FileOp> m_fop;
+  int m_savedCounter;
+  base::thread m_thread;
+};
+
+// Background saves in progress. A timer reports the finished ones
+// in the main thread, and the program waits the pending ones
+// before it exits.
+class BackgroundSaves {
+public:
+  static BackgroundSaves* instance() {
+    static BackgroundSaves* saves = nullptr;
+    if (!saves) {
+      saves = new BackgroundSaves;
+      App::instance()->Exit.connect([]{ delete saves; saves = nullptr; });
+    }
+    return saves;
+  }
+
+  void add(BackgroundSave* save) {
+    m_saves.push_back(save);
+    m_timer.start();
+  }
+
+  // Waits the background saves of the given document (so the saves
+  // of one document are finished in order).
+  void wait(const Document* document) {
+    for (auto it=m_saves.begin(); it!=m_saves.end(); ) {
+      BackgroundSave* save = *it;
+      if (save->documentId() == document->id()) {
+        save->finish();
+        delete save;
+        it = m_saves.erase(it);
+      }
+      else
+        ++it;
+    }
+  }
+
+private:
+  BackgroundSaves() : m_timer(100) {
+    m_timer.Tick.connect(&BackgroundSaves::onTick, this);
+  }
+
+  ~BackgroundSaves() {
+    m_timer.stop();
+    for (BackgroundSave* save : m_saves)
+      delete save;                // Waits the thread
+  }
+
+  void onTick() {
+    for (auto it=m_saves.begin(); it!=m_saves.end(); ) {
+      BackgroundSave* save = *it;
+      if (save->isDone()) {
+        save->finish();
+        delete save;
+        it = m_saves.erase(it);
+      }
+      else
+        ++it;
+    }
+    if (m_saves.empty())
+      m_timer.stop();
+  }
+
+  std::vector<BackgroundSave*> m_saves;
+  ui::Timer m_timer;
+};
+
+} // anonymous namespace
+
+// Saves a copy of the document (taken with a read lock) in a
+// background thread. Returns false if the file format needs to ask
+// something to the user that was cancelled.
+static bool save_document_copy_in_background(Context* context,
+                                             Document* document,
+                                             const std::string& fn_format)
+{
+  BackgroundSaves::instance()->wait(document);
+
+  base::UniquePtr<Document> snapshot;
+  int savedCounter;
+  {
+    ContextReader reader(context);
+    snapshot.reset(document->duplicate(DuplicateExactCopy));
+    snapshot->setFilename(document->filename());
+    snapshot->setFormatOptions(document->getFormatOptions());
+    snapshot->sprite()->setTransparentColor(
+      document->sprite()->transparentColor());
+    savedCounter = *document->undoHistory()->savedCounter();
+  }
+
+  // The format options are asked here (in the main thread)
+  FileOp* fop = fop_to_save_document(context,
+    snapshot, snapshot->filename().c_str(), fn_format.c_str());
+  if (!fop)
+    return false;
+
+  StatusBar::instance()->setStatusText(
+    0, "Saving %s...", base::get_file_name(snapshot->filename()).c_str());
+
+  BackgroundSaves::instance()->add(
+    new BackgroundSave(document, snapshot.release(), fop, savedCounter));
+  return true;
+}
+
 //////////////////////////////////////////////////////////////////////
 
 SaveFileBaseCommand::SaveFileBaseCommand(const char* short_name, const char* friendly_name, CommandFlags flags)
@@ -185,6 +417,10 @@ bool SaveFileBaseCommand::saveAsDialog(Context* context,
     }
   }
 
+  // Finish the background saves of this document first (they could
+  // mark the document as saved)
+  BackgroundSaves::instance()->wait(document);
+
   std::string oldFilename;
   {
     ContextWriter writer(context);
@@ -270,6 +506,13 @@ void SaveFileCommand::onExecute(Context* context)
   // If the document is associated to a file in the file-system, we can
   // save it directly without user interaction.
   if (document->isAssociatedToFile()) {
+    // The document can be modified while a copy of it is saved
+    if (context->isUIAvailable() &&
+        Preferences::instance().general.backgroundSave()) {
+      save_document_copy_in_background(context, document, m_filenameFormat);
+      return;
+    }
+
     ContextWriter writer(context);
     Document* documentWriter = writer.document();
 
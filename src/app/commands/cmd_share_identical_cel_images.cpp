@@ -0,0 +1,172 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/cmd/replace_image.h"
+#include "app/commands/command.h"
+#include "app/context_access.h"
+#include "app/modules/gui.h"
+#include "app/transaction.h"
+#include "app/ui/main_window.h"
+#include "app/ui/status_bar.h"
+#include "app/ui/timeline.h"
+#include "doc/cel.h"
+#include "doc/image_hash.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace app {
+
+// Shares the pixels of the cels with identical images (see
+// Image::createSharedCopy()). Cels aren't linked, so each one can
+// still be modified independently: the pixels are copied again when
+// one of the images is modified.
+class ShareIdenticalCelImagesCommand : public Command {
+public:
+  ShareIdenticalCelImagesCommand();
+  Command* clone() const override { return new ShareIdenticalCelImagesCommand(*this); }
+
+protected:
+  bool onEnabled(Context* context);
+  void onExecute(Context* context);
+
+private:
+  int shareImages(Transaction& transaction, Sprite* sprite,
+                  const std::vector<Cel*>& cels);
+};
+
+ShareIdenticalCelImagesCommand::ShareIdenticalCelImagesCommand()
+  : Command("ShareIdenticalCelImages",
+            "Share Pixels of Identical Cels",
+            CmdRecordableFlag)
+{
+}
+
+bool ShareIdenticalCelImagesCommand::onEnabled(Context* context)
+{
+  return context->checkFlags(ContextFlags::ActiveDocumentIsWritable |
+                             ContextFlags::HasActiveLayer);
+}
+
+void ShareIdenticalCelImagesCommand::onExecute(Context* context)
+{
+  ContextWriter writer(context);
+  Document* document(writer.document());
+  Sprite* sprite = writer.sprite();
+  bool nonEditableLayers = false;
+  int shared = 0;
+  {
+    Transaction transaction(writer.context(), "Share Pixels of Identical Cels");
+
+    // TODO the range of selected frames should be in doc::Site.
+    Timeline::Range range = App::instance()->getMainWindow()->getTimeline()->range();
+    LayerIndex layerBegin, layerEnd;
+    frame_t frameBegin, frameEnd;
+    if (range.enabled()) {
+      layerBegin = range.layerBegin();
+      layerEnd = range.layerEnd();
+      frameBegin = range.frameBegin();
+      frameEnd = range.frameEnd();
+    }
+    else {
+      layerBegin = layerEnd = sprite->layerToIndex(writer.layer());
+      frameBegin = frame_t(0);
+      frameEnd = sprite->lastFrame();
+    }
+
+    // Images can be shared between cels of different layers too
+    std::vector<Cel*> cels;
+    for (LayerIndex layerIdx = layerBegin; layerIdx <= layerEnd; ++layerIdx) {
+      Layer* layer = sprite->indexToLayer(layerIdx);
+      if (!layer || !layer->isImage())
+        continue;
+
+      if (!layer->isEditable()) {
+        nonEditableLayers = true;
+        continue;
+      }
+
+      LayerImage* layerImage = static_cast<LayerImage*>(layer);
+      for (auto it=layerImage->getCelBegin(); it!=layerImage->getCelEnd(); ++it)
+        if ((*it)->frame() >= frameBegin && (*it)->frame() <= frameEnd)
+          cels.push_back(*it);
+    }
+
+    shared = shareImages(transaction, sprite, cels);
+    transaction.commit();
+  }
+
+  if (nonEditableLayers)
+    StatusBar::instance()->showTip(1000,
+      "There are locked layers");
+  else
+    StatusBar::instance()->showTip(1000,
+      "%d cel(s) sharing pixels", shared);
+
+  update_screen_for_document(document);
+}
+
+// Replaces the image of each cel that has the same pixels of a
+// previous cel with a shared copy of the previous image. Images are
+// compared by hash first, and then with is_same_image() to confirm
+// that they are equal.
+int ShareIdenticalCelImagesCommand::shareImages(Transaction& transaction, Sprite* sprite,
+                                                const std::vector<Cel*>& cels)
+{
+  std::map<uint64_t, std::vector<Image*> > candidates;
+  std::set<ObjectId> checked;
+  int shared = 0;
+
+  for (Cel* cel : cels) {
+    Image* image = cel->image();
+
+    // Linked cels have the same image, it's replaced only once
+    if (!checked.insert(image->id()).second)
+      continue;
+
+    std::vector<Image*>& sameHash = candidates[doc::hash_image(image)];
+
+    Image* original = nullptr;
+    for (Image* candidate : sameHash) {
+      if (doc::is_same_image(candidate, image)) {
+        original = candidate;
+        break;
+      }
+    }
+
+    if (!original) {
+      sameHash.push_back(image);
+      continue;
+    }
+
+    // Already sharing the pixels
+    if (original->getPixelAddress(0, 0) == image->getPixelAddress(0, 0))
+      continue;
+
+    ImageRef newImage(Image::createSharedCopy(original));
+    transaction.execute(new cmd::ReplaceImage(sprite, cel->imageRef(), newImage));
+    ++shared;
+  }
+
+  return shared;
+}
+
+Command* CommandFactory::createShareIdenticalCelImagesCommand()
+{
+  return new ShareIdenticalCelImagesCommand;
+}
+
+} // namespace app
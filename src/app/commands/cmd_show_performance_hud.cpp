@@ -0,0 +1,48 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/commands/command.h"
+#include "app/context.h"
+#include "app/pref/preferences.h"
+
+namespace app {
+
+class ShowPerformanceHudCommand : public Command {
+public:
+  ShowPerformanceHudCommand()
+    : Command("ShowPerformanceHud",
+              "Show Performance HUD",
+              CmdUIOnlyFlag)
+  {
+  }
+
+  Command* clone() const override { return new ShowPerformanceHudCommand(*this); }
+
+protected:
+  bool onChecked(Context* context)
+  {
+    return Preferences::instance().experimental.performanceHud();
+  }
+
+  void onExecute(Context* context)
+  {
+    Preferences& pref = Preferences::instance();
+    pref.experimental.performanceHud(!pref.experimental.performanceHud());
+  }
+};
+
+Command* CommandFactory::createShowPerformanceHudCommand()
+{
+  return new ShowPerformanceHudCommand;
+}
+
+} // namespace app
@@ -23,16 +23,24 @@
 #include "app/transaction.h"
 #include "app/ui_context.h"
 #include "base/bind.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/image.h"
 #include "doc/mask.h"
+#include "doc/palette.h"
 #include "doc/primitives.h"
+#include "doc/rgbmap.h"
+#include "doc/rgbmap_cache.h"
 #include "doc/sprite.h"
 #include "ui/ui.h"
 
+#include <map>
+#include <memory>
+#include <vector>
+
 #define PERC_FORMAT     "%.1f"
 
 namespace app {
@@ -74,37 +82,74 @@ protected:
     Transaction transaction(m_writer.context(), "Sprite Size");
     DocumentApi api = m_writer.document()->getApi(transaction);
 
-    int cels_count = 0;
-    for (Cel* cel : m_sprite->uniqueCels()) { // TODO add size() member function to CelsRange
-      (void)cel;
-      ++cels_count;
+    std::vector<Cel*> cels;
+    for (Cel* cel : m_sprite->uniqueCels())
+      cels.push_back(cel);
+
+    // Cels are resized in parallel, so we get the map of each palette
+    // before (Sprite::rgbMap() cannot be used from several threads).
+    std::map<const Palette*, RgbMapRef> rgbmaps;
+    if (m_sprite->pixelFormat() == IMAGE_INDEXED &&
+        m_resize_method == doc::algorithm::RESIZE_METHOD_BILINEAR) {
+      int mask_color = (m_sprite->backgroundLayer() ? -1: m_sprite->transparentColor());
+      for (Cel* cel : cels) {
+        const Palette* pal = m_sprite->palette(cel->frame());
+        RgbMapRef& rgbmap = rgbmaps[pal];
+        if (!rgbmap)
+          rgbmap = RgbMapCache::global().get(pal, mask_color);
+      }
     }
 
-    // For each cel...
-    int progress = 0;
-    for (Cel* cel : m_sprite->uniqueCels()) {
-      // Change its location
-      api.setCelPosition(m_sprite, cel, scale_x(cel->x()), scale_y(cel->y()));
-
-      // Get cel's image
-      Image* image = cel->image();
-      if (image && !cel->link()) {
-        // Resize the image
-        int w = scale_x(image->width());
-        int h = scale_y(image->height());
-        ImageRef new_image(Image::create(image->pixelFormat(), MAX(1, w), MAX(1, h)));
-
-        doc::algorithm::fixup_image_transparent_colors(image);
-        doc::algorithm::resize_image(image, new_image.get(),
-          m_resize_method,
-          m_sprite->palette(cel->frame()),
-          m_sprite->rgbMap(cel->frame()));
+    // Cels are resized in parallel in batches, so the progress is
+    // updated and the operation can be canceled between batches (and
+    // only the new images of one batch are kept in memory).
+    const int cels_count = int(cels.size());
+    const int batch = 4*(base::thread_pool::global().workers()+1);
+    std::vector<ImageRef> new_images;
+
+    for (int i=0; i<cels_count; i+=batch) {
+      int n = MIN(batch, cels_count-i);
+      new_images.assign(n, ImageRef());
+
+      base::thread_pool::global().parallel_for(
+        n, [this, &cels, &new_images, &rgbmaps, i](int j) {
+          Cel* cel = cels[i+j];
+          Image* image = cel->image();
+          if (!image || cel->link())
+            return;
+
+          // Resize the image
+          int w = scale_x(image->width());
+          int h = scale_y(image->height());
+          ImageRef new_image(Image::create(image->pixelFormat(), MAX(1, w), MAX(1, h)));
+
+          // Colors of transparent pixels are used only by the
+          // bilinear interpolation
+          if (m_resize_method == doc::algorithm::RESIZE_METHOD_BILINEAR)
+            doc::algorithm::fixup_image_transparent_colors(image);
+
+          const Palette* pal = m_sprite->palette(cel->frame());
+          auto rgbmap = rgbmaps.find(pal);
+
+          doc::algorithm::resize_image(image, new_image.get(),
+            m_resize_method, pal,
+            (rgbmap != rgbmaps.end() ? rgbmap->second.get(): nullptr));
+
+          new_images[j] = new_image;
+        });
+
+      for (int j=0; j<n; ++j) {
+        Cel* cel = cels[i+j];
+
+        // Change its location
+        api.setCelPosition(m_sprite, cel, scale_x(cel->x()), scale_y(cel->y()));
 
-        api.replaceImage(m_sprite, cel->imageRef(), new_image);
+        if (new_images[j])
+          api.replaceImage(m_sprite, cel->imageRef(), new_images[j]);
       }
+      new_images.clear();
 
-      jobProgress((float)progress / cels_count);
-      ++progress;
+      jobProgress((float)(i+n) / cels_count);
 
       // cancel all the operation?
       if (isCanceled())
@@ -20,6 +20,7 @@
 #include "app/pref/preferences.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/status_bar.h"
+#include "base/mem_utils.h"
 #include "base/thread.h"
 #include "doc/sprite.h"
 #include "ui/system.h"
@@ -96,11 +97,13 @@ void UndoCommand::onExecute(Context* context)
 
   StatusBar* statusbar = StatusBar::instance();
   if (statusbar)
-    statusbar->showTip(1000, "%s %s",
+    statusbar->showTip(1000, "%s %s (undo memory: %s, all sprites: %s)",
       (m_type == Undo ? "Undid": "Redid"),
       (m_type == Undo ?
         undo->nextUndoLabel().c_str():
-        undo->nextRedoLabel().c_str()));
+        undo->nextRedoLabel().c_str()),
+      base::get_pretty_memory_size(undo->memSize()).c_str(),
+      base::get_pretty_memory_size(DocumentUndo::totalMemSize()).c_str());
 
   // Effectively undo/redo.
   if (m_type == Undo)
@@ -101,8 +101,10 @@ FOR_EACH_COMMAND(Scroll)
 FOR_EACH_COMMAND(SetLoopSection)
 FOR_EACH_COMMAND(SetPalette)
 FOR_EACH_COMMAND(SetPaletteEntrySize)
+FOR_EACH_COMMAND(ShareIdenticalCelImages)
 FOR_EACH_COMMAND(ShowGrid)
 FOR_EACH_COMMAND(ShowOnionSkin)
+FOR_EACH_COMMAND(ShowPerformanceHud)
 FOR_EACH_COMMAND(ShowPixelGrid)
 FOR_EACH_COMMAND(SnapToGrid)
 FOR_EACH_COMMAND(SpriteProperties)
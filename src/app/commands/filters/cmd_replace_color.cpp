@@ -86,18 +86,21 @@ public:
 protected:
   void onFromChange(const app::Color& color)
   {
+    stopPreview();
     m_filter.setFrom(color);
     restartPreview();
   }
 
   void onToChange(const app::Color& color)
   {
+    stopPreview();
     m_filter.setTo(color);
     restartPreview();
   }
 
   void onToleranceChange()
   {
+    stopPreview();
     m_filter.setTolerance(m_toleranceSlider->getValue());
     restartPreview();
   }
@@ -49,6 +49,7 @@ ColorCurveEditor::ColorCurveEditor(ColorCurve* curve, const gfx::Rect& viewBound
 {
   setFocusStop(true);
   setDoubleBuffered(true);
+  disableSizeCache();
 
   border_width.l = border_width.r = 1;
   border_width.t = border_width.b = 1;
@@ -19,11 +19,16 @@
 #include "app/modules/editors.h"
 #include "app/transaction.h"
 #include "app/ui/editor/editor.h"
+#include "base/thread_pool.h"
+#include "base/tracing.h"
+#include "doc/bitmap_ops.h"
 #include "doc/cel.h"
 #include "doc/image.h"
+#include "doc/image_buffer_recycler.h"
 #include "doc/images_collector.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
+#include "doc/primitives.h"
 #include "doc/site.h"
 #include "doc/sprite.h"
 #include "filters/filter.h"
@@ -31,22 +36,168 @@
 #include "ui/view.h"
 #include "ui/widget.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <set>
+#include <vector>
 
 namespace app {
 
 using namespace std;
 using namespace ui;
 
+namespace {
+
+// Rows skipped by the first pass of the preview
+const int kPreviewCoarseStep = 4;
+
+// FilterManager used to apply the filter to rows of one image from
+// one thread. Each thread uses its own instance (with its own row and
+// mask iterator), so the filter can be applied to several bands of
+// rows (and several images) at the same time.
+class BandFilterManager : public FilterManager {
+public:
+  BandFilterManager(FilterIndexedData* indexedData,
+                    const Image* src, Image* dst,
+                    const Mask* mask, int offset_x, int offset_y,
+                    const gfx::Rect& bounds, Target target)
+    : m_indexedData(indexedData)
+    , m_src(src)
+    , m_dst(dst)
+    , m_mask(mask && mask->bitmap() ? mask: NULL)
+    , m_offset_x(offset_x)
+    , m_offset_y(offset_y)
+    , m_bounds(bounds)
+    , m_target(target)
+    , m_y(bounds.y)
+    , m_maskRow(NULL)
+    , m_maskBit(0) {
+  }
+
+  void applyToRow(Filter* filter, PixelFormat pixelFormat, int y) {
+    m_y = y;
+
+    // The row of the mask is read directly (1 bit per pixel, from
+    // the LSB to the MSB of each byte)
+    if (m_mask) {
+      m_maskRow = (const uint8_t*)m_mask->bitmap()->getPixelAddress(
+        0, m_y - m_mask->bounds().y + m_offset_y);
+      m_maskBit = m_bounds.x - m_mask->bounds().x + m_offset_x;
+    }
+
+    switch (pixelFormat) {
+      case IMAGE_RGB:       filter->applyToRgba(this); break;
+      case IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+      case IMAGE_INDEXED:   filter->applyToIndexed(this); break;
+    }
+  }
+
+  // FilterManager implementation
+  const void* getSourceAddress() override { return m_src->getPixelAddress(m_bounds.x, m_y); }
+  void* getDestinationAddress() override { return m_dst->getPixelAddress(m_bounds.x, m_y); }
+  int getWidth() override { return m_bounds.w; }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override { return m_indexedData; }
+  const Image* getSourceImage() override { return m_src; }
+  int x() override { return m_bounds.x; }
+  int y() override { return m_y; }
+
+  bool skipPixel() override {
+    if (m_mask)
+      return !bitmap_row_get(m_maskRow, m_maskBit++);
+    else
+      return false;
+  }
+
+  int skipRun(int n, bool& skip) override {
+    if (!m_mask) {
+      skip = false;
+      return n;
+    }
+
+    // The run ends in the first pixel with other value (64 pixels
+    // are compared at once)
+    const int begin = m_maskBit;
+    const bool selected = bitmap_row_get(m_maskRow, begin);
+    m_maskBit = bitmap_row_find(m_maskRow, begin+1, begin+n, !selected);
+
+    skip = !selected;
+    return m_maskBit - begin;
+  }
+
+private:
+
+  FilterIndexedData* m_indexedData;
+  const Image* m_src;
+  Image* m_dst;
+  const Mask* m_mask;
+  int m_offset_x, m_offset_y;
+  gfx::Rect m_bounds;
+  Target m_target;
+  int m_y;
+  const uint8_t* m_maskRow;
+  int m_maskBit;                // Current pixel in m_maskRow
+};
+
+// An image to be filtered by FilterManagerImpl::applyToTarget()
+struct FilterJob {
+  Layer* layer;
+  Image* image;
+  int offset_x, offset_y;
+  gfx::Rect bounds;             // Area to filter (in image coordinates)
+  Image* dst;                   // Filtered image (NULL if it was cancelled)
+  std::exception_ptr error;
+
+  FilterJob() : dst(NULL) { }
+};
+
+// Copies the pixels of row "srcY" to row "dstY" (only pixels inside
+// the mask), to fill the rows skipped by the coarse pass of the
+// preview.
+void copy_masked_row(Image* image, const Mask* mask,
+                     int offset_x, int offset_y,
+                     int x, int w, int srcY, int dstY)
+{
+  const int bytesPerPixel = image->getRowStrideSize(1);
+  auto copyRun = [=](int u, int n) {
+    std::memmove(image->getPixelAddress(u, dstY),
+                 image->getPixelAddress(u, srcY), bytesPerPixel*n);
+  };
+
+  if (!mask) {
+    copyRun(x, w);
+    return;
+  }
+
+  const gfx::Rect& bounds = mask->bounds();
+  const int v = dstY + offset_y - bounds.y;
+  const int u1 = std::max(x, bounds.x - offset_x);
+  const int u2 = std::min(x+w, bounds.x2() - offset_x);
+  if (v < 0 || v >= bounds.h || u1 >= u2)
+    return;
+
+  // Copy each run of selected pixels
+  BitmapRowRuns runs(mask->bitmap()->getPixelAddress(0, v),
+                     u1 + offset_x - bounds.x, u2 - u1);
+  for (int u, n; runs.next(u, n); )
+    copyRun(u + bounds.x - offset_x, n);
+}
+
+} // anonymous namespace
+
 FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   : m_context(context)
   , m_site(context->activeSite())
   , m_filter(filter)
   , m_dst(NULL)
   , m_preview_mask(NULL)
-  , m_progressDelegate(NULL)
+  , m_progress(NULL)
+  , m_previewCancelled(false)
+  , m_previewRows(0)
+  , m_previewRowsFlushed(0)
 {
   int offset_x, offset_y;
 
@@ -67,6 +218,7 @@ FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
 
 FilterManagerImpl::~FilterManagerImpl()
 {
+  stopPreview();
 }
 
 app::Document* FilterManagerImpl::document()
@@ -74,9 +226,9 @@ app::Document* FilterManagerImpl::document()
   return static_cast<app::Document*>(m_site.document());
 }
 
-void FilterManagerImpl::setProgressDelegate(IProgressDelegate* progressDelegate)
+void FilterManagerImpl::setProgressToken(base::progress_token* progress)
 {
-  m_progressDelegate = progressDelegate;
+  m_progress = progress;
 }
 
 PixelFormat FilterManagerImpl::pixelFormat() const
@@ -107,6 +259,9 @@ void FilterManagerImpl::begin()
 
 void FilterManagerImpl::beginForPreview()
 {
+  // The preview mask is used by the worker threads
+  stopPreview();
+
   Document* document = static_cast<app::Document*>(m_site.document());
 
   if (document->isMaskVisible())
@@ -147,63 +302,102 @@ void FilterManagerImpl::beginForPreview()
 
 void FilterManagerImpl::end()
 {
-  m_maskBits.unlock();
 }
 
-bool FilterManagerImpl::applyStep()
+void FilterManagerImpl::startPreview()
 {
-  if (m_row < 0 || m_row >= m_h)
-    return false;
+  stopPreview();
 
-  if ((m_mask) && (m_mask->bitmap())) {
-    int x = m_x - m_mask->bounds().x + m_offset_x;
-    int y = m_y - m_mask->bounds().y + m_offset_y + m_row;
+  if (m_row < 0)
+    return;
 
-    if ((m_w - x < 1) || (m_h - y < 1))
-      return false;
+  // Filters can ask for the RgbMap from several threads, so we
+  // regenerate it (if it's needed) before.
+  if (m_site.sprite()->pixelFormat() == IMAGE_INDEXED)
+    getRgbMap();
 
-    m_maskBits = m_mask->bitmap()
-      ->lockBits<BitmapTraits>(Image::ReadLock,
-        gfx::Rect(x, y, m_w - x, m_h - y));
+  m_previewCancelled = false;
+  m_previewRows = 0;
+  m_previewRowsFlushed = 0;
+  m_previewToken.reset(new base::task_token);
 
-    m_maskIterator = m_maskBits.begin();
-  }
+  base::thread_pool::global().execute(
+    [this]{ applyToPreview(); }, m_previewToken);
+}
 
-  switch (m_site.sprite()->pixelFormat()) {
-    case IMAGE_RGB:       m_filter->applyToRgba(this); break;
-    case IMAGE_GRAYSCALE: m_filter->applyToGrayscale(this); break;
-    case IMAGE_INDEXED:   m_filter->applyToIndexed(this); break;
+void FilterManagerImpl::stopPreview()
+{
+  if (m_previewToken) {
+    m_previewCancelled = true;
+    m_previewToken->cancel();
+    m_previewToken.reset();
   }
-  ++m_row;
-
-  return true;
 }
 
-void FilterManagerImpl::apply(Transaction& transaction)
+bool FilterManagerImpl::isPreviewRunning() const
 {
-  bool cancelled = false;
+  return (m_previewToken &&
+          !m_previewToken->finished() &&
+          !m_previewToken->canceled());
+}
 
-  begin();
-  while (!cancelled && applyStep()) {
-    if (m_progressDelegate) {
-      // Report progress.
-      m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * (m_row+1) / m_h);
+bool FilterManagerImpl::previewChanged()
+{
+  int rows = m_previewRows;
+  if (rows == m_previewRowsFlushed)
+    return false;
 
-      // Does the user cancelled the whole process?
-      cancelled = m_progressDelegate->isCancelled();
-    }
-  }
+  m_previewRowsFlushed = rows;
+  return true;
+}
 
-  if (!cancelled) {
-    // Copy "dst" to "src"
-    transaction.execute(new cmd::CopyRect(
-        m_src, m_dst, gfx::Clip(m_x, m_y, m_x, m_y, m_w, m_h)));
+// [worker thread]
+void FilterManagerImpl::applyToPreview()
+{
+  TRACE_ZONE("FilterManagerImpl::applyToPreview");
+
+  const gfx::Rect bounds(m_x, m_y, m_w, m_h);
+  const PixelFormat pixelFormat = m_site.sprite()->pixelFormat();
+  base::thread_pool& pool = base::thread_pool::global();
+
+  for (int pass=0; pass<2 && !m_previewCancelled; ++pass) {
+    const bool coarse = (pass == 0);
+
+    std::vector<int> rows;
+    for (int i=0; i<bounds.h; ++i)
+      if ((i % kPreviewCoarseStep == 0) == coarse)
+        rows.push_back(bounds.y + i);
+
+    const int n = int(rows.size());
+    const int bandHeight = std::max(1, n / (4 * (pool.workers()+1)));
+    const int bands = (n + bandHeight - 1) / bandHeight;
+
+    pool.parallel_for(
+      bands, [&](int band) {
+        BandFilterManager mgr(this, m_src, m_dst, m_mask,
+                              m_offset_x, m_offset_y, bounds, m_target);
+
+        int i1 = band*bandHeight;
+        int i2 = std::min(i1 + bandHeight, n);
+        for (int i=i1; i<i2 && !m_previewCancelled; ++i) {
+          int y = rows[i];
+          mgr.applyToRow(m_filter, pixelFormat, y);
+
+          if (coarse) {
+            int y2 = std::min(y + kPreviewCoarseStep, bounds.y2());
+            for (int v=y+1; v<y2; ++v)
+              copy_masked_row(m_dst, m_mask, m_offset_x, m_offset_y,
+                              bounds.x, bounds.w, y, v);
+          }
+          ++m_previewRows;
+        }
+      });
   }
 }
 
 void FilterManagerImpl::applyToTarget()
 {
-  bool cancelled = false;
+  TRACE_ZONE("FilterManagerImpl::applyToTarget");
 
   ImagesCollector images((m_target & TARGET_ALL_LAYERS ?
                           m_site.sprite()->folder():
@@ -219,35 +413,147 @@ void FilterManagerImpl::applyToTarget()
   ContextWriter writer(reader);
   Transaction transaction(writer.context(), m_filter->getName(), ModifyDocument);
 
-  m_progressBase = 0.0f;
-  m_progressWidth = 1.0f / images.size();
+  Document* document = static_cast<app::Document*>(m_site.document());
+  const Mask* mask = (document->isMaskVisible() ? document->mask(): NULL);
 
+  // Avoid applying the filter two times to the same image
+  std::vector<FilterJob> jobs;
   std::set<ObjectId> visited;
-
-  // For each target image
-  for (auto it = images.begin();
-       it != images.end() && !cancelled;
-       ++it) {
+  int totalRows = 0;
+  for (auto it = images.begin(); it != images.end(); ++it) {
     Image* image = it->image();
+    if (visited.find(image->id()) != visited.end())
+      continue;
+    visited.insert(image->id());
+
+    m_offset_x = it->cel()->x();
+    m_offset_y = it->cel()->y();
+    if (!updateMask(document->mask(), image))
+      throw InvalidAreaException();
+
+    if (!updateMask(mask, image))
+      continue;
+
+    jobs.push_back(FilterJob());
+    FilterJob& job = jobs.back();
+    job.layer = it->layer();
+    job.image = image;
+    job.offset_x = it->cel()->x();
+    job.offset_y = it->cel()->y();
+    job.bounds = gfx::Rect(m_x, m_y, m_w, m_h);
+    totalRows += m_h;
+  }
 
-    // Avoid applying the filter two times to the same image
-    if (visited.find(image->id()) == visited.end()) {
-      visited.insert(image->id());
-      applyToImage(transaction, it->layer(),
-        image, it->cel()->x(), it->cel()->y());
+  // Filters can ask for the RgbMap from several threads, so we
+  // regenerate it (if it's needed) before.
+  if (m_site.sprite()->pixelFormat() == IMAGE_INDEXED)
+    getRgbMap();
+
+  // Each filtered row is a step of the progress
+  if (m_progress)
+    m_progress->set_steps(totalRows);
+
+  std::atomic<bool> cancelled(false);
+
+  // Images are filtered in groups (to limit the memory used by the
+  // filtered copies), each image of the group in parallel, and each
+  // image in parallel bands of rows.
+  base::thread_pool& pool = base::thread_pool::global();
+  const int groupSize = pool.workers()+1;
+
+  for (int first=0; first<int(jobs.size()) && !cancelled; first+=groupSize) {
+    int n = std::min(groupSize, int(jobs.size())-first);
+
+    pool.parallel_for(
+      n, [&, first](int i) {
+        FilterJob& job = jobs[first+i];
+        try {
+          job.dst =
+            applyToImage(job.layer, job.image,
+                         job.offset_x, job.offset_y,
+                         mask, job.bounds, cancelled);
+        }
+        catch (...) {
+          job.error = std::current_exception();
+          cancelled = true;
+        }
+      });
+
+    std::exception_ptr error;
+    for (int i=first; i<first+n; ++i) {
+      FilterJob& job = jobs[i];
+      base::UniquePtr<Image> dst(job.dst);
+      job.dst = NULL;
+
+      if (job.error && !error)
+        error = job.error;
+
+      if (dst && !cancelled) {
+        // Copy "dst" to "src"
+        const gfx::Rect& rc = job.bounds;
+        transaction.execute(new cmd::CopyRect(
+            job.image, dst, gfx::Clip(rc.x, rc.y, rc.x, rc.y, rc.w, rc.h)));
+      }
     }
-
-    // Is there a delegate to know if the process was cancelled by the user?
-    if (m_progressDelegate)
-      cancelled = m_progressDelegate->isCancelled();
-
-    // Make progress
-    m_progressBase += m_progressWidth;
+    if (error)
+      std::rethrow_exception(error);
   }
 
   transaction.commit();
 }
 
+// Returns a copy of the given image with the filter applied to the
+// given bounds, or NULL if the process was cancelled. The rows are
+// split in bands filtered in parallel.
+//
+// [called from several threads]
+Image* FilterManagerImpl::applyToImage(Layer* layer, Image* image,
+                                       int offset_x, int offset_y,
+                                       const Mask* mask,
+                                       const gfx::Rect& bounds,
+                                       std::atomic<bool>& cancelled)
+{
+  base::UniquePtr<Image> dst(
+    Image::createCopy(image, ImageBufferRecycler::global().getForImage(
+                        image->pixelFormat(), image->width(), image->height())));
+  PixelFormat pixelFormat = m_site.sprite()->pixelFormat();
+
+  // The alpha channel of the background layer can't be modified
+  Target target = m_targetOrig;
+  if (layer->isBackground())
+    target &= ~TARGET_ALPHA_CHANNEL;
+
+  base::thread_pool& pool = base::thread_pool::global();
+  const int bandHeight = std::max(1, bounds.h / (4 * (pool.workers()+1)));
+  const int bands = (bounds.h + bandHeight - 1) / bandHeight;
+
+  pool.parallel_for(
+    bands, [&](int band) {
+      BandFilterManager mgr(this, image, dst, mask,
+                            offset_x, offset_y, bounds, target);
+
+      int y1 = bounds.y + band*bandHeight;
+      int y2 = std::min(y1 + bandHeight, bounds.y2());
+      for (int y=y1; y<y2 && !cancelled; ++y) {
+        mgr.applyToRow(m_filter, pixelFormat, y);
+
+        if (m_progress) {
+          // Report progress.
+          m_progress->step();
+
+          // Does the user cancelled the whole process?
+          if (m_progress->canceled())
+            cancelled = true;
+        }
+      }
+    });
+
+  if (cancelled)
+    return NULL;
+
+  return dst.release();
+}
+
 void FilterManagerImpl::flush()
 {
   if (m_row >= 0) {
@@ -256,10 +562,10 @@ void FilterManagerImpl::flush()
       editor->editorToScreen(
         gfx::Point(
           m_x+m_offset_x,
-          m_y+m_offset_y+m_row-1)),
+          m_y+m_offset_y)),
       gfx::Size(
         editor->zoom().apply(m_w),
-        editor->zoom().apply(1)));
+        editor->zoom().apply(m_h)));
 
     gfx::Region reg1(rect);
     gfx::Region reg2;
@@ -282,16 +588,10 @@ void* FilterManagerImpl::getDestinationAddress()
 
 bool FilterManagerImpl::skipPixel()
 {
-  bool skip = false;
-
-  if ((m_mask) && (m_mask->bitmap())) {
-    if (!*m_maskIterator)
-      skip = true;
-
-    ++m_maskIterator;
-  }
-
-  return skip;
+  // Rows are filtered by BandFilterManager, here we check the pixel
+  // of getSourceAddress()
+  return (m_mask && !m_mask->containsPoint(m_x+m_offset_x,
+                                           m_row+m_y+m_offset_y));
 }
 
 Palette* FilterManagerImpl::getPalette()
@@ -313,7 +613,9 @@ void FilterManagerImpl::init(const Layer* layer, Image* image, int offset_x, int
     throw InvalidAreaException();
 
   m_src = image;
-  m_dst.reset(crop_image(image, 0, 0, image->width(), image->height(), 0));
+  m_dst.reset(
+    Image::createCopy(image, ImageBufferRecycler::global().getForImage(
+                        image->pixelFormat(), image->width(), image->height())));
   m_row = -1;
   m_mask = NULL;
   m_preview_mask.reset(NULL);
@@ -325,13 +627,7 @@ void FilterManagerImpl::init(const Layer* layer, Image* image, int offset_x, int
     m_target &= ~TARGET_ALPHA_CHANNEL;
 }
 
-void FilterManagerImpl::applyToImage(Transaction& transaction, Layer* layer, Image* image, int x, int y)
-{
-  init(layer, image, x, y);
-  apply(transaction);
-}
-
-bool FilterManagerImpl::updateMask(Mask* mask, const Image* image)
+bool FilterManagerImpl::updateMask(const Mask* mask, const Image* image)
 {
   int x, y, w, h;
 
@@ -11,13 +11,16 @@
 
 #include "base/exception.h"
 #include "base/unique_ptr.h"
-#include "doc/image_bits.h"
-#include "doc/image_traits.h"
 #include "doc/pixel_format.h"
 #include "doc/site.h"
 #include "filters/filter_indexed_data.h"
 #include "filters/filter_manager.h"
+#include "gfx/fwd.h"
 
+#include "base/progress_token.h"
+#include "base/thread_pool.h"
+
+#include <atomic>
 #include <cstring>
 
 namespace doc {
@@ -54,23 +57,13 @@ namespace app {
   class FilterManagerImpl : public FilterManager
                           , public FilterIndexedData {
   public:
-    // Interface to report progress to the user and take input from him
-    // to cancel the whole process.
-    class IProgressDelegate {
-    public:
-      virtual ~IProgressDelegate() { }
-
-      // Called to report the progress of the filter (with progress from 0.0 to 1.0).
-      virtual void reportProgress(float progress) = 0;
-
-      // Should return true if the user wants to cancel the filter.
-      virtual bool isCancelled() = 0;
-    };
-
     FilterManagerImpl(Context* context, Filter* filter);
     ~FilterManagerImpl();
 
-    void setProgressDelegate(IProgressDelegate* progressDelegate);
+    // Token used by applyToTarget() to report the progress to the
+    // user and to know if the whole process was cancelled (it's
+    // updated from several threads at the same time).
+    void setProgressToken(base::progress_token* progress);
 
     doc::PixelFormat pixelFormat() const;
 
@@ -79,9 +72,27 @@ namespace app {
     void begin();
     void beginForPreview();
     void end();
-    bool applyStep();
     void applyToTarget();
 
+    // Starts to apply the filter to the preview area (the visible
+    // part of the image, see beginForPreview()) in background. The
+    // first pass filters one of each kPreviewCoarseStep rows (copied
+    // to the next rows), so a low resolution preview is displayed
+    // quickly, and the second pass filters the remaining rows. Rows
+    // of each pass are filtered in parallel bands.
+    void startPreview();
+
+    // Cancels the preview and waits until the worker threads stop
+    // using the filter. It must be called before modifying the
+    // parameters of the filter.
+    void stopPreview();
+
+    bool isPreviewRunning() const;
+
+    // Returns true if rows were filtered since the last call (to
+    // flush() them).
+    bool previewChanged();
+
     app::Document* document();
     doc::Sprite* sprite() { return m_site.sprite(); }
     doc::Layer* layer() { return m_site.layer(); }
@@ -108,9 +119,13 @@ namespace app {
 
   private:
     void init(const doc::Layer* layer, doc::Image* image, int offset_x, int offset_y);
-    void apply(Transaction& transaction);
-    void applyToImage(Transaction& transaction, doc::Layer* layer, doc::Image* image, int x, int y);
-    bool updateMask(doc::Mask* mask, const doc::Image* image);
+    doc::Image* applyToImage(doc::Layer* layer, doc::Image* image,
+                             int offset_x, int offset_y,
+                             const doc::Mask* mask,
+                             const gfx::Rect& bounds,
+                             std::atomic<bool>& cancelled);
+    bool updateMask(const doc::Mask* mask, const doc::Image* image);
+    void applyToPreview();
 
     Context* m_context;
     doc::Site m_site;
@@ -122,15 +137,17 @@ namespace app {
     int m_offset_x, m_offset_y;
     doc::Mask* m_mask;
     base::UniquePtr<doc::Mask> m_preview_mask;
-    doc::ImageBits<doc::BitmapTraits> m_maskBits;
-    doc::ImageBits<doc::BitmapTraits>::iterator m_maskIterator;
     Target m_targetOrig;          // Original targets
     Target m_target;              // Filtered targets
 
     // Hooks
-    float m_progressBase;
-    float m_progressWidth;
-    IProgressDelegate* m_progressDelegate;
+    base::progress_token* m_progress;
+
+    // Background preview
+    base::task_token_ptr m_previewToken;
+    std::atomic<bool> m_previewCancelled;
+    std::atomic<int> m_previewRows;
+    int m_previewRowsFlushed;
   };
 
 } // namespace app
@@ -26,7 +26,7 @@ using namespace filters;
 FilterPreview::FilterPreview(FilterManagerImpl* filterMgr)
   : Widget(kGenericWidget)
   , m_filterMgr(filterMgr)
-  , m_timer(1, this)
+  , m_timer(30, this)
 {
   setVisible(false);
 }
@@ -38,6 +38,9 @@ FilterPreview::~FilterPreview()
 
 void FilterPreview::stop()
 {
+  if (m_filterMgr)
+    m_filterMgr->stopPreview();
+
   if (m_timer.isRunning()) {
     ASSERT(m_filterMgr != NULL);
 
@@ -51,9 +54,16 @@ void FilterPreview::stop()
 void FilterPreview::restartPreview()
 {
   m_filterMgr->beginForPreview();
+  m_filterMgr->startPreview();
   m_timer.start();
 }
 
+void FilterPreview::stopPreview()
+{
+  if (m_filterMgr)
+    m_filterMgr->stopPreview();
+}
+
 FilterManagerImpl* FilterPreview::getFilterManager() const
 {
   return m_filterMgr;
@@ -64,24 +74,28 @@ bool FilterPreview::onProcessMessage(Message* msg)
   switch (msg->type()) {
 
     case kOpenMessage:
-      Editor::renderEngine().setPreviewImage(
+      Editor::setPreviewImage(
         m_filterMgr->layer(),
         m_filterMgr->frame(),
         m_filterMgr->destinationImage());
       break;
 
     case kCloseMessage:
-      Editor::renderEngine().removePreviewImage();
+      Editor::removePreviewImage();
 
-      // Stop the preview timer.
+      // Stop the preview job and timer.
+      stopPreview();
       m_timer.stop();
       break;
 
     case kTimerMessage:
       if (m_filterMgr) {
-        if (m_filterMgr->applyStep())
+        // Check the state before flushing, so the last filtered rows
+        // are flushed before stopping the timer.
+        bool running = m_filterMgr->isPreviewRunning();
+        if (m_filterMgr->previewChanged())
           m_filterMgr->flush();
-        else
+        if (!running)
           m_timer.stop();
       }
       break;
@@ -16,7 +16,9 @@ namespace app {
 
   class FilterManagerImpl;
 
-  // Invisible widget to control a effect-preview in the current editor.
+  // Invisible widget to control a effect-preview in the current
+  // editor. The preview is generated in background threads, and this
+  // widget flushes the filtered rows to the editor periodically.
   class FilterPreview : public ui::Widget {
   public:
     FilterPreview(FilterManagerImpl* filterMgr);
@@ -24,6 +26,7 @@ namespace app {
 
     void stop();
     void restartPreview();
+    void stopPreview();
     FilterManagerImpl* getFilterManager() const;
 
   protected:
@@ -120,6 +120,11 @@ void FilterWindow::restartPreview()
     m_preview.restartPreview();
 }
 
+void FilterWindow::stopPreview()
+{
+  m_preview.stopPreview();
+}
+
 void FilterWindow::setNewTarget(Target target)
 {
   m_filterMgr->setTarget(target);
@@ -145,6 +150,7 @@ void FilterWindow::onShowPreview(Event& ev)
 void FilterWindow::onTargetButtonChange()
 {
   // Change the targets in the filter manager and restart the filter preview.
+  stopPreview();
   m_filterMgr->setTarget(m_targetButton.getTarget());
   restartPreview();
 }
@@ -155,6 +161,7 @@ void FilterWindow::onTiledChange()
 
   // Call derived class implementation of setupTiledMode() so the
   // filter is modified.
+  stopPreview();
   setupTiledMode(m_tiledCheck->isSelected() ?
     TiledMode::BOTH:
     TiledMode::NONE);
@@ -44,6 +44,11 @@ namespace app {
     // method each time the user modifies parameters of the Filter.
     void restartPreview();
 
+    // Stops the preview in progress. You must call this method
+    // before modifying parameters of the Filter (the preview is
+    // generated in background threads using the Filter).
+    void stopPreview();
+
   protected:
     // Changes the target buttons. Used by convolution matrix filter
     // which specified different targets for each matrix.
@@ -16,12 +16,12 @@
 #include "app/modules/editors.h"
 #include "app/modules/gui.h"
 #include "app/ui/editor/editor.h"
-#include "base/mutex.h"
-#include "base/scoped_lock.h"
+#include "base/progress_token.h"
 #include "base/thread.h"
 #include "doc/sprite.h"
 #include "ui/ui.h"
 
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 
@@ -36,17 +36,13 @@ static const int kMonitoringPeriod = 100;
 // modify the sprite, and the main thread to monitoring the progress
 // (and given to the user the possibility to cancel the process).
 
-class FilterWorker : public FilterManagerImpl::IProgressDelegate {
+class FilterWorker {
 public:
   FilterWorker(FilterManagerImpl* filterMgr);
   ~FilterWorker();
 
   void run();
 
-  // IProgressDelegate implementation
-  void reportProgress(float progress);
-  bool isCancelled();
-
 private:
   void applyFilterInBackground();
   void onMonitoringTick();
@@ -57,11 +53,9 @@ private:
   }
 
   FilterManagerImpl* m_filterMgr; // Effect to be applied.
-  base::mutex m_mutex;          // Mutex to access to 'pos', 'done' and 'cancelled' fields in different threads.
-  float m_pos;                  // Current progress position
-  bool m_done;                  // Was the effect completelly applied?
-  bool m_cancelled;             // Was the effect cancelled by the user?
-  bool m_abort;                 // An exception was thrown
+  base::progress_token m_progress; // Current progress position, and cancelled by the user?
+  std::atomic<bool> m_done;     // Was the effect completelly applied?
+  std::atomic<bool> m_abort;    // An exception was thrown
   ui::Timer m_timer;            // Monitoring timer to update the progress-bar
   AlertPtr m_alertWindow;       // Alert for the user to cancel the filter-progress if he wants.
   std::string m_error;
@@ -71,11 +65,9 @@ FilterWorker::FilterWorker(FilterManagerImpl* filterMgr)
   : m_filterMgr(filterMgr)
   , m_timer(kMonitoringPeriod)
 {
-  m_filterMgr->setProgressDelegate(this);
+  m_filterMgr->setProgressToken(&m_progress);
 
-  m_pos = 0.0;
   m_done = false;
-  m_cancelled = false;
   m_abort = false;
 
   m_alertWindow = ui::Alert::create(PACKAGE
@@ -103,11 +95,8 @@ void FilterWorker::run()
   // Stop the monitoring timer.
   m_timer.stop();
 
-  {
-    scoped_lock lock(m_mutex);
-    if (!m_done)
-      m_cancelled = true;
-  }
+  if (!m_done)
+    m_progress.cancel();
 
   // Wait the `effect_bg' thread
   thread.join();
@@ -118,42 +107,19 @@ void FilterWorker::run()
   }
 }
 
-// Called by FilterManagerImpl to informate the progress of the filter.
-//
-// [effect thread]
-//
-void FilterWorker::reportProgress(float progress)
-{
-  scoped_lock lock(m_mutex);
-  m_pos = progress;
-}
-
-// Called by effect_apply to know if the user cancelled the operation.
-//
-// [effect thread]
-//
-bool FilterWorker::isCancelled()
-{
-  bool cancelled;
-
-  scoped_lock lock(m_mutex);
-  cancelled = (m_cancelled || m_abort);
-
-  return cancelled;
-}
-
 // Applies the effect to the sprite in a background thread.
 //
 // [effect thread]
 //
 void FilterWorker::applyFilterInBackground()
 {
+  base::this_thread::set_qos(base::thread_qos::user_initiated);
+
   try {
     // Apply the filter
     m_filterMgr->applyToTarget();
 
     // Mark the work as 'done'.
-    scoped_lock lock(m_mutex);
     m_done = true;
   }
   catch (std::exception& e) {
@@ -166,10 +132,8 @@ void FilterWorker::applyFilterInBackground()
 // every 100 milliseconds).
 void FilterWorker::onMonitoringTick()
 {
-  scoped_lock lock(m_mutex);
-
   if (m_alertWindow)
-    m_alertWindow->setProgress(m_pos);
+    m_alertWindow->setProgress(m_progress.progress());
 
   if (m_done || m_abort)
     m_alertWindow->closeWindow(NULL);
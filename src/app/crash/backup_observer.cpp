@@ -14,6 +14,7 @@
 #include "app/app.h"
 #include "app/crash/session.h"
 #include "app/document.h"
+#include "app/document_undo.h"
 #include "app/pref/preferences.h"
 #include "base/bind.h"
 #include "base/chrono.h"
@@ -21,9 +22,28 @@
 #include "base/scoped_lock.h"
 #include "doc/context.h"
 
+#include <algorithm>
+
 namespace app {
 namespace crash {
 
+// A document is backed up when it's not modified for kIdleTime
+// seconds (so we don't compete with a stroke or a sequence of
+// commands), with at least kMinBytes modified or kMinStale seconds of
+// changes without backup. Anyway, changes of the last data recovery
+// period (the maximum time of work that can be lost) are always
+// saved as soon as the document can be locked.
+static const int kIdleTime = 3;
+static const size_t kMinBytes = 4*1024*1024;
+static const int kMinStale = 30;
+
+// Seconds to wait after a failed backup (the document was locked)
+static const int kLockedCooldown = 2;
+
+// Each backup takes at most 1/kTimeShare of the time (e.g. if the
+// disk is slow, backups are less frequent)
+static const int kTimeShare = 10;
+
 BackupObserver::BackupObserver(Session* session, doc::Context* ctx)
   : m_session(session)
   , m_ctx(ctx)
@@ -50,7 +70,11 @@ void BackupObserver::onAddDocument(doc::Document* document)
 {
   TRACE("DataRecovery: Observe document %p\n", document);
   base::scoped_lock hold(m_mutex);
-  m_documents.push_back(static_cast<app::Document*>(document));
+  app::Document* doc = static_cast<app::Document*>(document);
+  m_documents.push_back(doc);
+
+  DocumentState& state = m_states[doc];
+  state.backedUpBytes = state.lastBytes = doc->undoHistory()->modifiedBytes();
 }
 
 void BackupObserver::onRemoveDocument(doc::Document* document)
@@ -59,50 +83,88 @@ void BackupObserver::onRemoveDocument(doc::Document* document)
   {
     base::scoped_lock hold(m_mutex);
     base::remove_from_container(m_documents, static_cast<app::Document*>(document));
+    m_states.erase(static_cast<app::Document*>(document));
   }
   m_session->removeDocument(static_cast<app::Document*>(document));
 }
 
 void BackupObserver::backgroundThread()
 {
-  int normalPeriod = 60*Preferences::instance().general.dataRecoveryPeriod();
-  int lockedPeriod = 10;
+  base::this_thread::set_qos(base::thread_qos::background);
+
+  while (!m_done) {
+    base::this_thread::sleep_for(1.0);
+
+    int maxStale = 60*Preferences::instance().general.dataRecoveryPeriod();
 #if 0                           // Just for testing purposes
-  normalPeriod = 5;
-  lockedPeriod = 5;
+    maxStale = 5;
 #endif
 
-  int waitUntil = normalPeriod;
-  int seconds = 0;
+    base::scoped_lock hold(m_mutex);
 
-  while (!m_done) {
-    seconds++;
-    if (seconds >= waitUntil) {
-      TRACE("DataRecovery: Start backup process for %d documents\n", m_documents.size());
+    for (app::Document* doc : m_documents) {
+      DocumentState& state = m_states[doc];
+      const size_t bytes = doc->undoHistory()->modifiedBytes();
 
-      base::scoped_lock hold(m_mutex);
-      base::Chrono chrono;
-      bool somethingLocked = false;
-
-      for (app::Document* doc : m_documents) {
-        try {
-          if (doc->needsBackup())
-            m_session->saveDocumentChanges(doc);
-        }
-        catch (const std::exception&) {
-          TRACE("DataRecovery: Document '%d' is locked\n", doc->id());
-          somethingLocked = true;
-        }
+      if (bytes != state.lastBytes) {
+        state.lastBytes = bytes;
+        state.idle = 0;
+      }
+      else
+        ++state.idle;
+
+      if (bytes != state.backedUpBytes)
+        ++state.stale;
+      else
+        state.stale = 0;
+
+      if (state.cooldown > 0)
+        --state.cooldown;
+
+      if (!shouldBackup(state, maxStale))
+        continue;
+
+      if (!doc->needsBackup()) {
+        state.backedUpBytes = bytes;
+        state.stale = 0;
+        continue;
       }
 
-      seconds = 0;
-      waitUntil = (somethingLocked ? lockedPeriod: normalPeriod);
+      TRACE("DataRecovery: Start backup of document %d (%d bytes modified, %d seconds)\n",
+            doc->id(), int(bytes - state.backedUpBytes), state.stale);
 
-      TRACE("DataRecovery: Backup process done (%.16g)\n", chrono.elapsed());
+      base::Chrono chrono;
+      try {
+        m_session->saveDocumentChanges(doc);
+
+        state.backedUpBytes = bytes;
+        state.stale = 0;
+        state.cooldown = std::min(int(kTimeShare * chrono.elapsed()),
+                                  maxStale / 4);
+
+        TRACE("DataRecovery: Backup done (%.16g)\n", chrono.elapsed());
+      }
+      catch (const std::exception&) {
+        TRACE("DataRecovery: Document '%d' is locked\n", doc->id());
+        state.cooldown = kLockedCooldown;
+      }
     }
-    base::this_thread::sleep_for(1.0);
   }
 }
 
+bool BackupObserver::shouldBackup(const DocumentState& state, int maxStale) const
+{
+  if (state.stale == 0 || state.cooldown > 0)
+    return false;
+
+  // Too much time without backup, we don't wait for the user
+  if (state.stale >= maxStale)
+    return true;
+
+  return (state.idle >= kIdleTime &&
+          (state.lastBytes - state.backedUpBytes >= kMinBytes ||
+           state.stale >= kMinStale));
+}
+
 } // namespace crash
 } // namespace app
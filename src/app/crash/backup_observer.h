@@ -15,6 +15,7 @@
 #include "doc/document_observer.h"
 #include "doc/documents_observer.h"
 
+#include <map>
 #include <vector>
 
 namespace doc {
@@ -39,12 +40,28 @@ namespace crash {
     void onRemoveDocument(doc::Document* document) override;
 
   private:
+    // Backup state of each document (all times in seconds)
+    struct DocumentState {
+      size_t backedUpBytes;     // DocumentUndo::modifiedBytes() in the last backup
+      size_t lastBytes;         // DocumentUndo::modifiedBytes() in the last tick
+      int idle;                 // Time since the last modification
+      int stale;                // Time since the first change not backed up
+      int cooldown;             // Time to wait before the next backup
+
+      DocumentState()
+        : backedUpBytes(0), lastBytes(0)
+        , idle(0), stale(0), cooldown(0) {
+      }
+    };
+
     void backgroundThread();
+    bool shouldBackup(const DocumentState& state, int maxStale) const;
 
     Session* m_session;
     base::mutex m_mutex;
     doc::Context* m_ctx;
     std::vector<app::Document*> m_documents;
+    std::map<app::Document*, DocumentState> m_states;
     bool m_done;
     base::thread m_thread;
   };
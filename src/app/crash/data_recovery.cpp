@@ -14,6 +14,7 @@
 #include "app/crash/backup_observer.h"
 #include "app/crash/session.h"
 #include "app/resource_finder.h"
+#include "app/undo_swap_file.h"
 #include "base/fs.h"
 #include "base/path.h"
 #include "base/time.h"
@@ -38,6 +39,8 @@ DataRecovery::DataRecovery(doc::Context* ctx)
 
       SessionPtr session(new Session(itempath));
       if (!session->isRunning()) {
+        session->removeSwapFiles();
+
         if (!session->isEmpty()) {
           TRACE("to be loaded\n");
           m_sessions.push_back(session);
@@ -79,6 +82,10 @@ DataRecovery::DataRecovery(doc::Context* ctx)
   TRACE("DataRecovery: Session in progress '%s'\n", newSessionDir.c_str());
 
   m_backup = new BackupObserver(m_inProgress.get(), ctx);
+
+  // Old undo states are swapped out in the session directory (which
+  // is in the user disk, where std::tmpfile() could use RAM)
+  UndoSwapFile::setDirectory(newSessionDir);
 }
 
 DataRecovery::~DataRecovery()
@@ -86,6 +93,8 @@ DataRecovery::~DataRecovery()
   m_backup->stop();
   delete m_backup;
 
+  UndoSwapFile::setDirectory(std::string());
+
   if (m_inProgress)
     m_inProgress->removeFromDisk();
 
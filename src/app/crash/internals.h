@@ -9,11 +9,13 @@
 #define APP_CRASH_INTERNALS_H_INCLUDED
 #pragma once
 
+#include "base/convert_to.h"
 #include "doc/object.h"
 
 #include <algorithm>
 #include <functional>
 #include <map>
+#include <string>
 
 namespace app {
 namespace crash {
@@ -57,6 +59,19 @@ namespace crash {
 
   typedef std::map<doc::ObjectId, ObjVersions> ObjVersionsMap;
 
+  // Name of the file where the given version of an object is saved
+  // (e.g. "img-5.2" for the version 2 of the image with ID 5).
+  inline std::string object_filename(const char* prefix,
+                                     doc::ObjectId id,
+                                     doc::ObjectVersion ver) {
+    std::string fn = prefix;
+    fn.push_back('-');
+    fn += base::convert_to<std::string>(id);
+    fn.push_back('.');
+    fn += base::convert_to<std::string>(ver);
+    return fn;
+  }
+
 } // namespace crash
 } // namespace app
 
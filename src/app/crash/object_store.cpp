@@ -0,0 +1,391 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/crash/object_store.h"
+
+#include "base/exception.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/path.h"
+
+#include "zlib.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace app {
+namespace crash {
+
+namespace {
+
+const char* kStoreFilename = "objects";
+const char* kTmpFilename = "objects.tmp";
+
+// Record header (all values in little endian):
+//   DWORD   Magic number
+//   BYTE    Record type
+//   WORD    Size of the object name
+//   DWORD   Size of the uncompressed data
+//   DWORD   Size of the data
+//   DWORD   CRC-32 of the header (without this field), name, and data
+// Followed by the name and the data.
+const uint32_t kRecordMagic = 0x4A424F53; // 'SOBJ' in ASCII
+const size_t kHeaderSize = 19;
+const size_t kCrcOffset = 15;
+
+enum {
+  kRawObject = 1,
+  kCompressedObject = 2,
+  kErasedObject = 3,
+};
+
+// The file is compacted only if it has at least 1MB of old records
+const size_t kMinGarbage = 1024*1024;
+
+void put16(std::string& buf, size_t pos, uint16_t value)
+{
+  buf[pos  ] = char(value & 0xff);
+  buf[pos+1] = char((value >> 8) & 0xff);
+}
+
+void put32(std::string& buf, size_t pos, uint32_t value)
+{
+  buf[pos  ] = char(value & 0xff);
+  buf[pos+1] = char((value >> 8) & 0xff);
+  buf[pos+2] = char((value >> 16) & 0xff);
+  buf[pos+3] = char((value >> 24) & 0xff);
+}
+
+uint16_t get16(const std::string& buf, size_t pos)
+{
+  return
+    uint16_t(uint8_t(buf[pos])) |
+    (uint16_t(uint8_t(buf[pos+1])) << 8);
+}
+
+uint32_t get32(const std::string& buf, size_t pos)
+{
+  return
+    uint32_t(uint8_t(buf[pos])) |
+    (uint32_t(uint8_t(buf[pos+1])) << 8) |
+    (uint32_t(uint8_t(buf[pos+2])) << 16) |
+    (uint32_t(uint8_t(buf[pos+3])) << 24);
+}
+
+uint32_t record_crc(const std::string& record)
+{
+  uLong crc = crc32(0, nullptr, 0);
+  crc = crc32(crc, (const Bytef*)record.c_str(), kCrcOffset);
+  if (record.size() > kHeaderSize)
+    crc = crc32(crc, (const Bytef*)record.c_str() + kHeaderSize,
+                uInt(record.size() - kHeaderSize));
+  return uint32_t(crc);
+}
+
+} // anonymous namespace
+
+ObjectStore::ObjectStore(const std::string& dir)
+  : m_filename(base::join_path(dir, kStoreFilename))
+  , m_tmpFilename(base::join_path(dir, kTmpFilename))
+  , m_size(0)
+  , m_liveSize(0)
+  , m_damaged(false)
+{
+  loadIndex();
+}
+
+ObjectStore::~ObjectStore()
+{
+  if (m_file.is_open())
+    m_file.close();
+}
+
+// static
+bool ObjectStore::isStoreFile(const std::string& name)
+{
+  return (name == kStoreFilename || name == kTmpFilename);
+}
+
+bool ObjectStore::contains(const std::string& name) const
+{
+  return (m_index.find(name) != m_index.end());
+}
+
+std::vector<std::string> ObjectStore::names() const
+{
+  std::vector<std::string> result;
+  for (const auto& item : m_index)
+    result.push_back(item.first);
+  return result;
+}
+
+void ObjectStore::loadContent()
+{
+  if (!m_content.empty() || m_size == 0)
+    return;
+
+  std::ifstream s(FSTREAM_PATH(m_filename), std::ifstream::binary);
+  std::string content(m_size, 0);
+  if (s.read(&content[0], m_size))
+    std::swap(m_content, content);
+}
+
+bool ObjectStore::read(const std::string& name, std::string& data) const
+{
+  auto it = m_index.find(name);
+  if (it == m_index.end())
+    return false;
+
+  std::string record;
+  if (!readRecord(it->second, record) ||
+      record_crc(record) != get32(record, kCrcOffset)) {
+    TRACE(" - Damaged record of '%s' in the backup\n", name.c_str());
+    return false;
+  }
+
+  const size_t dataOffset = kHeaderSize + get16(record, 5);
+  const size_t rawSize = get32(record, 7);
+
+  if (record[4] == kRawObject) {
+    data = record.substr(dataOffset);
+    return true;
+  }
+  else {
+    std::string raw(rawSize, 0);
+    uLongf size = uLongf(rawSize);
+    if (rawSize == 0 ||
+        uncompress((Bytef*)&raw[0], &size,
+                   (const Bytef*)record.c_str() + dataOffset,
+                   uLong(record.size() - dataOffset)) != Z_OK ||
+        size != rawSize)
+      return false;
+
+    std::swap(data, raw);
+    return true;
+  }
+}
+
+void ObjectStore::write(const std::string& name, const std::string& data,
+                        bool compress)
+{
+  if (compress && !data.empty()) {
+    std::string compressed(compressBound(uLong(data.size())), 0);
+    uLongf size = uLongf(compressed.size());
+
+    // Backups are written frequently, so we prefer speed over size
+    if (compress2((Bytef*)&compressed[0], &size,
+                  (const Bytef*)data.c_str(), uLong(data.size()), 1) == Z_OK &&
+        size < data.size()) {
+      compressed.resize(size);
+      appendRecord(kCompressedObject, name, compressed, data.size());
+      return;
+    }
+  }
+
+  appendRecord(kRawObject, name, data, data.size());
+}
+
+void ObjectStore::erase(const std::string& name)
+{
+  if (contains(name))
+    appendRecord(kErasedObject, name, std::string(), 0);
+}
+
+void ObjectStore::flush()
+{
+  if (m_file.is_open())
+    m_file.flush();
+}
+
+void ObjectStore::compactIfNeeded()
+{
+  size_t garbage = m_size - m_liveSize;
+  if (garbage >= kMinGarbage && garbage > m_liveSize)
+    compact();
+}
+
+void ObjectStore::loadIndex()
+{
+  // Recover from a compaction that was interrupted
+  if (base::is_file(m_tmpFilename)) {
+    if (base::is_file(m_filename))
+      base::delete_file(m_tmpFilename);
+    else
+      base::move_file(m_tmpFilename, m_filename);
+  }
+
+  if (!base::is_file(m_filename))
+    return;
+
+  const size_t fileSize = base::file_size(m_filename);
+  std::ifstream s(FSTREAM_PATH(m_filename), std::ifstream::binary);
+  std::string header(kHeaderSize, 0);
+  std::string name;
+  size_t pos = 0;
+
+  while (pos + kHeaderSize <= fileSize) {
+    if (!s.read(&header[0], kHeaderSize))
+      break;
+
+    const int type = header[4];
+    const size_t nameSize = get16(header, 5);
+    const size_t dataSize = get32(header, 11);
+    const size_t recordSize = kHeaderSize + nameSize + dataSize;
+
+    if (get32(header, 0) != kRecordMagic ||
+        type < kRawObject || type > kErasedObject ||
+        nameSize == 0 ||
+        pos + recordSize > fileSize)
+      break;
+
+    name.resize(nameSize);
+    if (!s.read(&name[0], nameSize) ||
+        !s.seekg(dataSize, std::ios::cur))
+      break;
+
+    if (type == kErasedObject)
+      m_index.erase(name);
+    else {
+      Entry& entry = m_index[name];
+      entry.offset = pos;
+      entry.size = recordSize;
+    }
+
+    pos += recordSize;
+  }
+
+  m_size = pos;
+  m_damaged = (pos != fileSize);
+
+  m_liveSize = 0;
+  for (const auto& item : m_index)
+    m_liveSize += item.second.size;
+}
+
+void ObjectStore::openForAppend()
+{
+  if (m_file.is_open())
+    return;
+
+  // We cannot append records after invalid data (they would be
+  // ignored the next time the file is loaded)
+  if (m_damaged)
+    compact();
+
+  m_file.open(FSTREAM_PATH(m_filename),
+              std::ofstream::binary | std::ofstream::app);
+  if (!m_file)
+    throw base::Exception("Error opening backup file '%s'", m_filename.c_str());
+}
+
+void ObjectStore::compact()
+{
+  TRACE(" - Compacting backup (%d of %d bytes are used)\n",
+        int(m_liveSize), int(m_size));
+
+  if (m_file.is_open())
+    m_file.close();
+
+  // Copy records in the same order as they are in the file (so it's
+  // a sequential read)
+  std::vector<Entry*> entries;
+  for (auto& item : m_index)
+    entries.push_back(&item.second);
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry* a, const Entry* b) {
+              return a->offset < b->offset;
+            });
+
+  size_t pos = 0;
+  {
+    std::ifstream src(FSTREAM_PATH(m_filename), std::ifstream::binary);
+    std::ofstream dst(FSTREAM_PATH(m_tmpFilename),
+                      std::ofstream::binary | std::ofstream::trunc);
+    std::string record;
+
+    for (Entry* entry : entries) {
+      record.resize(entry->size);
+      if (!src.seekg(entry->offset) ||
+          !src.read(&record[0], entry->size) ||
+          !dst.write(record.c_str(), record.size())) {
+        dst.close();
+        base::delete_file(m_tmpFilename);
+        throw base::Exception("Error compacting backup file '%s'", m_filename.c_str());
+      }
+      entry->offset = pos;
+      pos += entry->size;
+    }
+  }
+
+  if (base::is_file(m_filename))
+    base::delete_file(m_filename);
+  base::move_file(m_tmpFilename, m_filename);
+
+  m_size = m_liveSize = pos;
+  m_damaged = false;
+  m_content.clear();
+}
+
+void ObjectStore::appendRecord(int type, const std::string& name,
+                               const std::string& data, size_t rawSize)
+{
+  ASSERT(!name.empty() && name.size() < 0xffff);
+
+  openForAppend();
+
+  std::string record(kHeaderSize, 0);
+  put32(record, 0, kRecordMagic);
+  record[4] = char(type);
+  put16(record, 5, uint16_t(name.size()));
+  put32(record, 7, uint32_t(rawSize));
+  put32(record, 11, uint32_t(data.size()));
+  record += name;
+  record += data;
+  put32(record, kCrcOffset, record_crc(record));
+
+  if (!m_file.write(record.c_str(), record.size()))
+    throw base::Exception("Error writing backup file '%s'", m_filename.c_str());
+
+  auto it = m_index.find(name);
+  if (it != m_index.end()) {
+    m_liveSize -= it->second.size;
+    m_index.erase(it);
+  }
+
+  if (type != kErasedObject) {
+    Entry& entry = m_index[name];
+    entry.offset = m_size;
+    entry.size = record.size();
+    m_liveSize += entry.size;
+  }
+
+  m_size += record.size();
+  m_content.clear();
+}
+
+bool ObjectStore::readRecord(const Entry& entry, std::string& record) const
+{
+  if (entry.size < kHeaderSize)
+    return false;
+
+  if (entry.offset + entry.size <= m_content.size()) {
+    record = m_content.substr(entry.offset, entry.size);
+    return true;
+  }
+
+  std::ifstream s(FSTREAM_PATH(m_filename), std::ifstream::binary);
+  record.resize(entry.size);
+  return (s.seekg(entry.offset) &&
+          s.read(&record[0], entry.size));
+}
+
+} // namespace crash
+} // namespace app
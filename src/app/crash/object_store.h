@@ -0,0 +1,98 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_CRASH_OBJECT_STORE_H_INCLUDED
+#define APP_CRASH_OBJECT_STORE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace app {
+namespace crash {
+
+  // Append-only log file ("objects") with all the object files of a
+  // document backup (e.g. "img-5.2"), so a backup is a sequential
+  // write of one file instead of thousands of small files, and a
+  // restore is a sequential read.
+  //
+  // Each record contains the content of an object (compressed with
+  // zlib when it's worth it) with a CRC-32 checksum, or the erasure
+  // of an object. The index of records is created reading their
+  // headers when the store is opened. Records that were written
+  // partially (e.g. the program crashed in the middle of a backup)
+  // are ignored, and records with a wrong checksum are reported as
+  // missing objects (so older versions can be used).
+  class ObjectStore {
+  public:
+    ObjectStore(const std::string& dir);
+    ~ObjectStore();
+
+    // Returns true if the given name is the name of a file used by
+    // the store.
+    static bool isStoreFile(const std::string& name);
+
+    bool contains(const std::string& name) const;
+    std::vector<std::string> names() const;
+
+    // Reads the whole file in memory, so read() doesn't need to
+    // access the disk anymore.
+    void loadContent();
+
+    // Gets the content of the given object. It can be called from
+    // several threads at the same time. Returns false if the object
+    // doesn't exist or its record is damaged.
+    bool read(const std::string& name, std::string& data) const;
+
+    // Appends a new version of the object. "compress" can be false
+    // for data which is already compressed (e.g. images).
+    void write(const std::string& name, const std::string& data,
+               bool compress = true);
+
+    // Appends the erasure of the given object.
+    void erase(const std::string& name);
+
+    // Saves the appended records to disk.
+    void flush();
+
+    // Rewrites the file without the old versions of erased/replaced
+    // objects when they use most of the file.
+    void compactIfNeeded();
+
+  private:
+    struct Entry {
+      size_t offset;            // Offset of the record in the file
+      size_t size;              // Size of the whole record
+    };
+
+    void loadIndex();
+    void openForAppend();
+    void compact();
+    void appendRecord(int type, const std::string& name,
+                      const std::string& data, size_t rawSize);
+    bool readRecord(const Entry& entry, std::string& record) const;
+
+    std::string m_filename;
+    std::string m_tmpFilename;
+    std::map<std::string, Entry> m_index;
+    size_t m_size;              // Bytes of valid records in the file
+    size_t m_liveSize;          // Bytes of records in the index
+    bool m_damaged;             // The file has invalid data after m_size bytes
+    std::string m_content;      // Content of the file (see loadContent())
+    std::ofstream m_file;       // File to append records
+
+    DISABLE_COPYING(ObjectStore);
+  };
+
+} // namespace crash
+} // namespace app
+
+#endif
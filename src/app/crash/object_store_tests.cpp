@@ -0,0 +1,169 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/crash/object_store.h"
+#include "base/fs.h"
+#include "base/path.h"
+
+#include <cstdio>
+
+using namespace app::crash;
+using namespace base;
+
+namespace {
+
+const char* kDir = "object_store_test";
+
+void delete_test_dir()
+{
+  if (!is_directory(kDir))
+    return;
+
+  for (const auto& fn : list_files(kDir))
+    delete_file(join_path(kDir, fn));
+  remove_directory(kDir);
+}
+
+class ObjectStoreTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    delete_test_dir();
+    make_directory(kDir);
+  }
+  void TearDown() override {
+    delete_test_dir();
+  }
+};
+
+} // anonymous namespace
+
+TEST_F(ObjectStoreTest, WriteAndRead)
+{
+  std::string big(100000, 'x');
+  {
+    ObjectStore store(kDir);
+    store.write("a-1.1", "hello");
+    store.write("b-2.1", big);
+    store.write("c-3.1", "raw", false);
+    store.write("a-1.2", "world");
+    store.erase("c-3.1");
+    store.flush();
+
+    std::string data;
+    EXPECT_TRUE(store.read("a-1.2", data));
+    EXPECT_EQ("world", data);
+    EXPECT_FALSE(store.contains("c-3.1"));
+  }
+
+  // Compressed data uses less space
+  EXPECT_LT(file_size(join_path(kDir, "objects")), big.size());
+
+  ObjectStore store(kDir);
+  std::vector<std::string> names = store.names();
+  ASSERT_EQ(3u, names.size());
+  EXPECT_EQ("a-1.1", names[0]);
+  EXPECT_EQ("a-1.2", names[1]);
+  EXPECT_EQ("b-2.1", names[2]);
+
+  std::string data;
+  EXPECT_TRUE(store.read("a-1.1", data));
+  EXPECT_EQ("hello", data);
+  store.loadContent();
+  EXPECT_TRUE(store.read("b-2.1", data));
+  EXPECT_EQ(big, data);
+  EXPECT_FALSE(store.read("c-3.1", data));
+}
+
+TEST_F(ObjectStoreTest, IgnorePartialRecords)
+{
+  std::string fn = join_path(kDir, "objects");
+  {
+    ObjectStore store(kDir);
+    store.write("a-1.1", "first");
+    store.write("a-1.2", "second");
+  }
+
+  // Simulate a crash in the middle of the last record
+  size_t size = file_size(fn);
+  {
+    std::string content(size, 0);
+    FILE* f = std::fopen(fn.c_str(), "rb");
+    ASSERT_TRUE(f != NULL);
+    ASSERT_EQ(size, std::fread(&content[0], 1, size, f));
+    std::fclose(f);
+
+    f = std::fopen(fn.c_str(), "wb");
+    std::fwrite(&content[0], 1, size-2, f);
+    std::fclose(f);
+  }
+
+  ObjectStore store(kDir);
+  std::string data;
+  EXPECT_FALSE(store.contains("a-1.2"));
+  EXPECT_TRUE(store.read("a-1.1", data));
+  EXPECT_EQ("first", data);
+
+  // New records are not lost after the damaged data
+  store.write("a-1.3", "third");
+  store.flush();
+  ObjectStore store2(kDir);
+  EXPECT_TRUE(store2.read("a-1.3", data));
+  EXPECT_EQ("third", data);
+}
+
+TEST_F(ObjectStoreTest, DetectDamagedRecords)
+{
+  std::string fn = join_path(kDir, "objects");
+  {
+    ObjectStore store(kDir);
+    store.write("a-1.1", "abcdefgh", false);
+  }
+
+  // Change the last byte of the data
+  size_t size = file_size(fn);
+  FILE* f = std::fopen(fn.c_str(), "r+b");
+  ASSERT_TRUE(f != NULL);
+  std::fseek(f, long(size-1), SEEK_SET);
+  std::fputc('x', f);
+  std::fclose(f);
+
+  ObjectStore store(kDir);
+  std::string data;
+  EXPECT_TRUE(store.contains("a-1.1"));
+  EXPECT_FALSE(store.read("a-1.1", data));
+}
+
+TEST_F(ObjectStoreTest, Compact)
+{
+  std::string fn = join_path(kDir, "objects");
+  std::string data(256*1024, 0);
+  for (size_t i=0; i<data.size(); ++i)
+    data[i] = char(i*7919 % 251);
+
+  ObjectStore store(kDir);
+  for (int i=1; i<=10; ++i) {
+    store.write("img-1." + std::to_string(i), data, false);
+    if (i > 1)
+      store.erase("img-1." + std::to_string(i-1));
+    store.flush();
+    store.compactIfNeeded();
+  }
+
+  EXPECT_LT(file_size(fn), 3*data.size());
+  EXPECT_FALSE(is_file(join_path(kDir, "objects.tmp")));
+
+  std::string result;
+  EXPECT_TRUE(store.read("img-1.10", result));
+  EXPECT_EQ(data, result);
+
+  ObjectStore store2(kDir);
+  ASSERT_EQ(1u, store2.names().size());
+  EXPECT_TRUE(store2.read("img-1.10", result));
+  EXPECT_EQ(data, result);
+}
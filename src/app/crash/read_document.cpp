@@ -13,6 +13,7 @@
 
 #include "app/console.h"
 #include "app/crash/internals.h"
+#include "app/crash/object_store.h"
 #include "app/document.h"
 #include "base/convert_to.h"
 #include "base/exception.h"
@@ -21,6 +22,7 @@
 #include "base/path.h"
 #include "base/serialization.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/cel.h"
 #include "doc/cel_data_io.h"
@@ -29,16 +31,21 @@
 #include "doc/frame.h"
 #include "doc/frame_tag.h"
 #include "doc/frame_tag_io.h"
+#include "doc/image.h"
 #include "doc/image_io.h"
+#include "doc/image_loader.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/palette_io.h"
+#include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "doc/string_io.h"
 #include "doc/subobjects_io.h"
 
 #include <fstream>
 #include <map>
+#include <sstream>
+#include <vector>
 
 namespace app {
 namespace crash {
@@ -49,15 +56,210 @@ using namespace doc;
 
 namespace {
 
+// Objects are read from the object store of the backup directory,
+// or from individual files (backups of old versions).
+bool object_exists(const ObjectStore& store, const std::string& dir,
+                   const std::string& fn)
+{
+  return (store.contains(fn) ||
+          base::is_file(base::join_path(dir, fn)));
+}
+
+bool read_object(const ObjectStore& store, const std::string& dir,
+                 const std::string& fn, std::string& data)
+{
+  if (store.read(fn, data))
+    return true;
+
+  std::ifstream s(FSTREAM_PATH(base::join_path(dir, fn)), std::ifstream::binary);
+  if (!s)
+    return false;
+
+  std::ostringstream buf;
+  buf << s.rdbuf();
+  data = buf.str();
+  return true;
+}
+
+// Loads an image from the "img" (or "imgdelta") objects of a backup.
+// The objects are read in memory by readFiles() (which can be called
+// from worker threads while the store exists), but the pixels are
+// inflated only when the image is needed. So the backup directory
+// can be deleted after the document is restored.
+class BackupImageLoader : public ImageLoader {
+public:
+  BackupImageLoader(const ObjectStore* store, const std::string& dir,
+                    ObjectId id, const ObjVersions& versions)
+    : m_store(store)
+    , m_dir(dir)
+    , m_id(id)
+    , m_versions(versions)
+    , m_delta(false)
+    , m_pixelFormat(IMAGE_RGB) {
+  }
+
+  ObjectId id() const { return m_id; }
+
+  // Returns true if a valid version of the image was found
+  bool isValid() const {
+    return (m_size.w > 0 && m_size.h > 0);
+  }
+
+  // Reads the files of the newest version of the image with a valid
+  // header.
+  void readFiles() {
+    for (size_t i=0; i<m_versions.size(); ++i) {
+      ObjectVersion ver = m_versions[i];
+      if (!ver)
+        continue;
+
+      m_delta = object_exists(*m_store, m_dir,
+                              object_filename("imgdelta", m_id, ver));
+
+      if (m_delta) {
+        if (!readFile("imgdelta", m_id, ver, m_deltaData))
+          continue;
+
+        std::istringstream s(m_deltaData);
+        read32(s);              // Magic number
+        ObjectId id = read32(s);
+        ObjectVersion baseVersion = read32(s);
+        if (!readFile("img", id, baseVersion, m_data))
+          continue;
+      }
+      else if (!readFile("img", m_id, ver, m_data))
+        continue;
+
+      // Image header (see doc::write_image())
+      std::istringstream s(m_data);
+      read32(s);                // Magic number
+      read32(s);                // ID
+      int pixelFormat = read8(s);
+      int w = read16(s);
+      int h = read16(s);
+      if (s &&
+          (pixelFormat == IMAGE_RGB ||
+           pixelFormat == IMAGE_GRAYSCALE ||
+           pixelFormat == IMAGE_INDEXED ||
+           pixelFormat == IMAGE_BITMAP) &&
+          w >= 1 && h >= 1 && w <= 0xfffff && h <= 0xfffff) {
+        m_pixelFormat = (PixelFormat)pixelFormat;
+        m_size = gfx::Size(w, h);
+        return;
+      }
+    }
+
+    m_data.clear();
+    m_deltaData.clear();
+  }
+
+  gfx::Size imageSize() const override {
+    return m_size;
+  }
+
+  Image* loadImage() override {
+    if (!isValid())
+      return nullptr;
+
+    base::UniquePtr<Image> image;
+    try {
+      image.reset(m_delta ? readImageDelta(): readImage());
+    }
+    catch (const std::exception& ex) {
+      TRACE(" - Error inflating image #%d: %s\n", m_id, ex.what());
+    }
+
+    // Damaged images are restored as transparent images (the rest of
+    // the document is still useful)
+    if (!image ||
+        image->pixelFormat() != m_pixelFormat ||
+        image->width() != m_size.w ||
+        image->height() != m_size.h) {
+      TRACE(" - img #%d was not restored\n", m_id);
+      image.reset(Image::create(m_pixelFormat, m_size.w, m_size.h));
+      clear_image(image.get(), image->maskColor());
+    }
+
+    return image.release();
+  }
+
+private:
+  bool readFile(const char* prefix, ObjectId id, ObjectVersion ver,
+                std::string& data) {
+    if (!read_object(*m_store, m_dir, object_filename(prefix, id, ver), data))
+      return false;
+
+    std::istringstream magic(data);
+    return (read32(magic) == MAGIC_NUMBER);
+  }
+
+  Image* readImage() {
+    std::istringstream s(m_data);
+    read32(s);                  // Magic number
+    return read_image(s, false);
+  }
+
+  // Images can be saved completely or as a delta from a previous
+  // version (only the modified rows).
+  Image* readImageDelta() {
+    std::istringstream s(m_deltaData);
+    read32(s);                  // Magic number
+    read32(s);                  // ID
+    read32(s);                  // Base version
+    color_t maskColor = read32(s);
+    int nbands = read32(s);
+
+    base::UniquePtr<Image> image(readImage());
+    if (!image)
+      return nullptr;
+
+    int rowSize = image->getRowStrideSize();
+    for (int i=0; i<nbands; ++i) {
+      int y = read32(s);
+      base::UniquePtr<Image> band(read_image(s, false));
+      if (!band ||
+          band->pixelFormat() != image->pixelFormat() ||
+          band->width() != image->width() ||
+          y < 0 || y+band->height() > image->height())
+        return nullptr;
+
+      for (int v=0; v<band->height(); ++v)
+        std::copy(band->getPixelAddress(0, v),
+                  band->getPixelAddress(0, v) + rowSize,
+                  image->getPixelAddress(0, y+v));
+    }
+
+    image->setMaskColor(maskColor);
+    return image.release();
+  }
+
+  const ObjectStore* m_store;
+  std::string m_dir;
+  ObjectId m_id;
+  ObjVersions m_versions;
+  bool m_delta;
+  std::string m_data;           // "img" file
+  std::string m_deltaData;      // "imgdelta" file
+  PixelFormat m_pixelFormat;
+  gfx::Size m_size;
+};
+
 class Reader : public SubObjectsIO {
 public:
   Reader(const std::string& dir)
     : m_sprite(nullptr)
     , m_dir(dir)
+    , m_store(dir)
     , m_docId(0)
     , m_docVersions(nullptr)
     , m_loadInfo(nullptr) {
+    std::vector<std::string> names = m_store.names();
     for (const auto& fn : base::list_files(dir)) {
+      if (!ObjectStore::isStoreFile(fn))
+        names.push_back(fn);
+    }
+
+    for (const auto& fn : names) {
       auto i = fn.find('-');
       if (i == std::string::npos)
         continue;               // Has no ID
@@ -87,6 +289,9 @@ public:
   }
 
   app::Document* loadDocument() {
+    // Read all records with one sequential read
+    m_store.loadContent();
+
     app::Document* doc = loadObject<app::Document*>("doc", m_docId, &Reader::readDocument);
     if (!doc)
       Console().printf("Error recovering the document\n");
@@ -118,10 +323,57 @@ private:
     if (m_images.find(imageId) != m_images.end())
       return m_images[imageId];
 
-    ImageRef image(loadObject<Image*>("img", imageId, &Reader::readImage));
+    base::SharedPtr<BackupImageLoader> loader = getImageLoader(imageId);
+    if (!loader->isValid())
+      loader->readFiles();
+
+    ImageRef image(loader->loadImage());
     return m_images[imageId] = image;
   }
 
+  // Returns the loader of the given image. Its files are read later
+  // (see readImageFiles()).
+  base::SharedPtr<BackupImageLoader> getImageLoader(ObjectId imageId) {
+    auto it = m_loaders.find(imageId);
+    if (it != m_loaders.end())
+      return it->second;
+
+    base::SharedPtr<BackupImageLoader> loader(
+      new BackupImageLoader(&m_store, m_dir, imageId, m_objVersions[imageId]));
+    m_loaders[imageId] = loader;
+    return loader;
+  }
+
+  // Reads the files of all images in parallel, and removes the cels
+  // without a valid image. Their pixels are inflated when they are
+  // needed (e.g. by Document::preloadCelImages()).
+  void readImageFiles(Sprite* spr) {
+    std::vector<BackupImageLoader*> loaders;
+    for (auto& item : m_loaders)
+      loaders.push_back(item.second.get());
+
+    base::thread_pool::global().parallel_for(
+      int(loaders.size()), [&loaders](int i) {
+        loaders[i]->readFiles();
+      });
+
+    for (BackupImageLoader* loader : loaders) {
+      if (!loader->isValid())
+        Console().printf("Error loading object img #%d\n", loader->id());
+    }
+
+    std::vector<Cel*> invalidCels;
+    for (Cel* cel : spr->cels()) {
+      if (!cel->data()->isImageLoaded() &&
+          cel->data()->imageSize().w == 0)
+        invalidCels.push_back(cel);
+    }
+    for (Cel* cel : invalidCels) {
+      static_cast<LayerImage*>(cel->layer())->removeCel(cel);
+      delete cel;
+    }
+  }
+
   CelDataRef getCelDataRef(ObjectId celdataId) {
     if (m_celdatas.find(celdataId) != m_celdatas.end())
       return m_celdatas[celdataId];
@@ -131,7 +383,7 @@ private:
   }
 
   template<typename T>
-  T loadObject(const char* prefix, ObjectId id, T (Reader::*readMember)(std::ifstream&)) {
+  T loadObject(const char* prefix, ObjectId id, T (Reader::*readMember)(std::istream&)) {
     const ObjVersions& versions = m_objVersions[id];
 
     for (size_t i=0; i<versions.size(); ++i) {
@@ -139,19 +391,7 @@ private:
       if (!ver)
         continue;
 
-      TRACE(" - Restoring %s #%d v%d\n", prefix, id, ver);
-
-      std::string fn = prefix;
-      fn.push_back('-');
-      fn += base::convert_to<std::string>(id);
-      fn.push_back('.');
-      fn += base::convert_to<std::string>(ver);
-
-      std::ifstream s(FSTREAM_PATH(base::join_path(m_dir, fn)), std::ifstream::binary);
-      T obj = nullptr;
-      if (read32(s) == MAGIC_NUMBER)
-        obj = (this->*readMember)(s);
-
+      T obj = loadObjectVersion(prefix, id, ver, readMember);
       if (obj) {
         TRACE(" - %s #%d v%d restored successfully\n", prefix, id, ver);
         return obj;
@@ -166,7 +406,23 @@ private:
     return nullptr;
   }
 
-  app::Document* readDocument(std::ifstream& s) {
+  template<typename T>
+  T loadObjectVersion(const char* prefix, ObjectId id, ObjectVersion ver,
+                      T (Reader::*readMember)(std::istream&)) {
+    TRACE(" - Restoring %s #%d v%d\n", prefix, id, ver);
+
+    std::string data;
+    if (!read_object(m_store, m_dir, object_filename(prefix, id, ver), data))
+      return nullptr;
+
+    std::istringstream s(data);
+    T obj = nullptr;
+    if (read32(s) == MAGIC_NUMBER)
+      obj = (this->*readMember)(s);
+    return obj;
+  }
+
+  app::Document* readDocument(std::istream& s) {
     ObjectId sprId = read32(s);
     std::string filename = read_string(s);
 
@@ -189,7 +445,7 @@ private:
     }
   }
 
-  Sprite* readSprite(std::ifstream& s) {
+  Sprite* readSprite(std::istream& s) {
     PixelFormat format = (PixelFormat)read8(s);
     int w = read16(s);
     int h = read16(s);
@@ -258,10 +514,13 @@ private:
       }
     }
 
+    // Layers and cels are ready, now we can read all image files
+    readImageFiles(spr.get());
+
     return spr.release();
   }
 
-  Layer* readLayer(std::ifstream& s) {
+  Layer* readLayer(std::istream& s) {
     LayerFlags flags = (LayerFlags)read32(s);
     ObjectType type = (ObjectType)read16(s);
     ASSERT(type == ObjectType::LayerImage);
@@ -290,30 +549,42 @@ private:
     }
   }
 
-  Cel* readCel(std::ifstream& s) {
+  Cel* readCel(std::istream& s) {
     return read_cel(s, this, false);
   }
 
-  CelData* readCelData(std::ifstream& s) {
-    return read_celdata(s, this, false);
-  }
+  // Same format as doc::read_celdata(), but the image is loaded
+  // through a BackupImageLoader.
+  CelData* readCelData(std::istream& s) {
+    read32(s);                  // ID
+    int x = read32(s);
+    int y = read32(s);
+    int opacity = read8(s);
+    ObjectId imageId = read32(s);
+    if (!s || !imageId)
+      return nullptr;
 
-  Image* readImage(std::ifstream& s) {
-    return read_image(s, false);
+    ImageLoaderRef loader(getImageLoader(imageId));
+    base::UniquePtr<CelData> celdata(new CelData(loader));
+    celdata->setPosition(x, y);
+    celdata->setOpacity(opacity);
+    return celdata.release();
   }
 
-  Palette* readPalette(std::ifstream& s) {
+  Palette* readPalette(std::istream& s) {
     return read_palette(s);
   }
 
   Sprite* m_sprite;    // Used to pass the sprite in LayerImage() ctor
   std::string m_dir;
+  ObjectStore m_store;
   ObjectVersion m_docId;
   ObjVersionsMap m_objVersions;
   ObjVersions* m_docVersions;
   DocumentInfo* m_loadInfo;
   std::map<ObjectId, ImageRef> m_images;
   std::map<ObjectId, CelDataRef> m_celdatas;
+  std::map<ObjectId, base::SharedPtr<BackupImageLoader> > m_loaders;
 };
 
 } // anonymous namespace
@@ -19,6 +19,7 @@
 #include "app/document_access.h"
 #include "app/file/file.h"
 #include "app/ui_context.h"
+#include "app/undo_swap_file.h"
 #include "base/bind.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
@@ -27,6 +28,8 @@
 #include "base/process.h"
 #include "base/split_string.h"
 #include "base/string.h"
+#include "base/tracing.h"
+#include "base/unique_ptr.h"
 
 namespace app {
 namespace crash {
@@ -120,6 +123,7 @@ void Session::removeFromDisk()
     if (base::is_file(verFilename()))
       base::delete_file(verFilename());
 
+    removeSwapFiles();
     base::remove_directory(m_path);
   }
   catch (const std::exception& ex) {
@@ -129,10 +133,30 @@ void Session::removeFromDisk()
   }
 }
 
+void Session::removeSwapFiles()
+{
+  for (auto& item : base::list_files(m_path)) {
+    std::string fn = base::join_path(m_path, item);
+    if (base::is_file(fn) &&
+        base::utf8_icmp(base::get_file_extension(fn), UndoSwapFile::extension()) == 0) {
+      TRACE("DataRecovery: Deleting swap file '%s'\n", fn.c_str());
+      base::delete_file(fn);
+    }
+  }
+}
+
 void Session::saveDocumentChanges(app::Document* doc)
 {
-  DocumentReader reader(doc, 250);
+  TRACE_ZONE("Session::saveDocumentChanges");
+
   app::Context ctx;
+  base::UniquePtr<DocumentSnapshot> snapshot;
+  {
+    // The document is locked only to copy the modified objects
+    DocumentReader reader(doc, 250);
+    snapshot.reset(new DocumentSnapshot(doc));
+  }
+
   std::string dir = base::join_path(m_path,
     base::convert_to<std::string>(doc->id()));
   TRACE("DataRecovery: Saving document '%s'...\n", dir.c_str());
@@ -141,7 +165,7 @@ void Session::saveDocumentChanges(app::Document* doc)
     base::make_directory(dir);
 
   // Save document information
-  write_document(dir, doc);
+  snapshot->write(dir);
 }
 
 void Session::removeDocument(app::Document* doc)
@@ -179,6 +203,9 @@ void Session::restoreBackup(Backup* backup)
       }
 
       UIContext::instance()->documents().add(doc);
+
+      // Cel images are inflated in background
+      doc->preloadCelImages(doc::frame_t(0));
     }
   }
   catch (const std::exception& ex) {
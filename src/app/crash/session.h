@@ -48,6 +48,10 @@ namespace crash {
     void create(base::pid pid);
     void removeFromDisk();
 
+    // Deletes the undo swap files (see UndoSwapFile) that a crashed
+    // process left in the session directory.
+    void removeSwapFiles();
+
     void saveDocumentChanges(app::Document* doc);
     void removeDocument(app::Document* doc);
 
@@ -12,12 +12,11 @@
 #include "app/crash/write_document.h"
 
 #include "app/crash/internals.h"
+#include "app/crash/object_store.h"
 #include "app/document.h"
 #include "base/convert_to.h"
-#include "base/fs.h"
-#include "base/fstream_path.h"
-#include "base/path.h"
 #include "base/serialization.h"
+#include "base/shared_ptr.h"
 #include "base/string.h"
 #include "base/unique_ptr.h"
 #include "doc/cel.h"
@@ -27,6 +26,7 @@
 #include "doc/frame.h"
 #include "doc/frame_tag.h"
 #include "doc/frame_tag_io.h"
+#include "doc/image.h"
 #include "doc/image_io.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
@@ -34,8 +34,10 @@
 #include "doc/sprite.h"
 #include "doc/string_io.h"
 
-#include <fstream>
+#include <sstream>
 #include <map>
+#include <utility>
+#include <vector>
 
 namespace app {
 namespace crash {
@@ -46,53 +48,86 @@ using namespace doc;
 
 namespace {
 
+// Information about the backup files of an image. Images are saved
+// as deltas (only the modified rows) from the last full version
+// ("base" version) while the modified area is small.
+struct ImageBackup {
+  ObjectVersion baseVersion;
+  PixelFormat pixelFormat;
+  int width, height;
+  std::vector<uint64_t> baseRows; // Hash of each row of the base version
+
+  // Saved versions from older to newer, each one with the base
+  // version it depends on (0 for full versions).
+  std::vector<std::pair<ObjectVersion, ObjectVersion> > files;
+
+  ImageBackup() : baseVersion(0), pixelFormat(IMAGE_RGB), width(0), height(0) { }
+};
+
+typedef std::map<ObjectId, ImageBackup> ImageBackupsMap;
+
 static std::map<ObjectId, ObjVersionsMap> g_docVersions;
+static std::map<ObjectId, ImageBackupsMap> g_docImages;
+static std::map<ObjectId, base::SharedPtr<ObjectStore> > g_docStores;
 
-class Writer {
+// FNV-1a hash of a row of pixels
+static uint64_t hash_row(const uint8_t* p, int size)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (const uint8_t* end=p+size; p != end; ++p) {
+    hash ^= *p;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// Serializes the objects of the document in memory while it's locked
+class SnapshotBuilder {
 public:
-  Writer(const std::string& dir, app::Document* doc)
-    : m_dir(dir)
-    , m_doc(doc)
+  SnapshotBuilder(app::Document* doc,
+                  std::vector<DocumentSnapshot::Object>& objects)
+    : m_doc(doc)
+    , m_objects(objects)
     , m_objVersions(g_docVersions[doc->id()]) {
   }
 
-  void saveDocument() {
+  void takeSnapshot() {
     Sprite* spr = m_doc->sprite();
 
     // Save from objects without children (e.g. images), to aggregated
     // objects (e.g. cels, layers, etc.)
 
     for (Palette* pal : spr->getPalettes())
-      saveObject("pal", pal, &Writer::writePalette);
+      addObject("pal", pal, &SnapshotBuilder::writePalette);
 
     for (FrameTag* frtag : spr->frameTags())
-      saveObject("frtag", frtag, &Writer::writeFrameTag);
+      addObject("frtag", frtag, &SnapshotBuilder::writeFrameTag);
 
     for (Cel* cel : spr->uniqueCels()) {
-      saveObject("img", cel->image(), &Writer::writeImage);
-      saveObject("celdata", cel->data(), &Writer::writeCelData);
+      addImage(cel->image());
+      addObject("celdata", cel->data(), &SnapshotBuilder::writeCelData);
     }
 
     for (Cel* cel : spr->cels())
-      saveObject("cel", cel, &Writer::writeCel);
+      addObject("cel", cel, &SnapshotBuilder::writeCel);
 
     std::vector<Layer*> layers;
     spr->getLayersList(layers);
     for (Layer* lay : layers)
-      saveObject("lay", lay, &Writer::writeLayerStructure);
+      addObject("lay", lay, &SnapshotBuilder::writeLayerStructure);
 
-    saveObject("spr", spr, &Writer::writeSprite);
-    saveObject("doc", m_doc, &Writer::writeDocumentFile);
+    addObject("spr", spr, &SnapshotBuilder::writeSprite);
+    addObject("doc", m_doc, &SnapshotBuilder::writeDocumentFile);
   }
 
 private:
 
-  void writeDocumentFile(std::ofstream& s, app::Document* doc) {
+  void writeDocumentFile(std::ostream& s, app::Document* doc) {
     write32(s, doc->sprite()->id());
     write_string(s, doc->filename());
   }
 
-  void writeSprite(std::ofstream& s, Sprite* spr) {
+  void writeSprite(std::ostream& s, Sprite* spr) {
     write8(s, spr->pixelFormat());
     write16(s, spr->width());
     write16(s, spr->height());
@@ -116,7 +151,7 @@ private:
       write32(s, pal->id());
   }
 
-  void writeLayerStructure(std::ofstream& s, Layer* lay) {
+  void writeLayerStructure(std::ostream& s, Layer* lay) {
     write32(s, static_cast<int>(lay->flags())); // Flags
     write16(s, static_cast<int>(lay->type()));  // Type
     write_string(s, lay->name());
@@ -134,69 +169,259 @@ private:
     }
   }
 
-  void writeCel(std::ofstream& s, Cel* cel) {
+  void writeCel(std::ostream& s, Cel* cel) {
     write_cel(s, cel);
   }
 
-  void writeCelData(std::ofstream& s, CelData* celdata) {
+  void writeCelData(std::ostream& s, CelData* celdata) {
     write_celdata(s, celdata);
   }
 
-  void writeImage(std::ofstream& s, Image* img) {
-    write_image(s, img);
-  }
-
-  void writePalette(std::ofstream& s, Palette* pal) {
+  void writePalette(std::ostream& s, Palette* pal) {
     write_palette(s, pal);
   }
 
-  void writeFrameTag(std::ofstream& s, FrameTag* frameTag) {
+  void writeFrameTag(std::ostream& s, FrameTag* frameTag) {
     write_frame_tag(s, frameTag);
   }
 
   template<typename T>
-  void saveObject(const char* prefix, T* obj, void (Writer::*writeMember)(std::ofstream&, T*)) {
+  bool isModified(T* obj) {
     if (!obj->version())
       obj->incrementVersion();
 
-    ObjVersions& versions = m_objVersions[obj->id()];
-    if (versions.newer() == obj->version())
+    return (m_objVersions[obj->id()].newer() != obj->version());
+  }
+
+  template<typename T>
+  void addObject(const char* prefix, T* obj, void (SnapshotBuilder::*writeMember)(std::ostream&, T*)) {
+    if (!isModified(obj))
       return;
 
-    std::string fn = prefix;
-    fn.push_back('-');
-    fn += base::convert_to<std::string>(obj->id());
+    std::ostringstream s;
+    (this->*writeMember)(s, obj);
 
-    std::string fullfn = base::join_path(m_dir, fn);
-    std::string oldfn = fullfn + "." + base::convert_to<std::string>(versions.older());
-    fullfn += "." + base::convert_to<std::string>(obj->version());
+    DocumentSnapshot::Object item;
+    item.prefix = prefix;
+    item.id = obj->id();
+    item.version = obj->version();
+    item.data = s.str();
+    m_objects.push_back(item);
+  }
 
-    std::ofstream s(FSTREAM_PATH(fullfn), std::ofstream::binary);
-    write32(s, 0);                // Leave a room for the magic number
-    (this->*writeMember)(s, obj); // Write the object
+  // Images are copied, they are compared with the previous backup
+  // and compressed later (without locking the document).
+  void addImage(Image* img) {
+    if (!isModified(img))
+      return;
 
-    // Write the magic number
-    s.seekp(0);
-    write32(s, MAGIC_NUMBER);
+    DocumentSnapshot::Object item;
+    item.prefix = "img";
+    item.id = img->id();
+    item.version = img->version();
+    item.image.reset(Image::createCopy(img));
+    m_objects.push_back(item);
+  }
+
+  app::Document* m_doc;
+  std::vector<DocumentSnapshot::Object>& m_objects;
+  ObjVersionsMap& m_objVersions;
+};
+
+// Writes the objects of a snapshot in the object store of the
+// backup directory
+class Writer {
+public:
+  Writer(const std::string& dir, ObjectId docId)
+    : m_objVersions(g_docVersions[docId])
+    , m_images(g_docImages[docId]) {
+    base::SharedPtr<ObjectStore>& store = g_docStores[docId];
+    if (!store)
+      store.reset(new ObjectStore(dir));
+    m_store = store;
+  }
+
+  ~Writer() {
+    m_store->flush();
+  }
+
+  // Removes old versions of objects from the store (called after
+  // writing each snapshot, in the backup thread).
+  void compact() {
+    m_store->flush();
+    m_store->compactIfNeeded();
+  }
+
+  void saveObject(const DocumentSnapshot::Object& obj) {
+    if (obj.image) {
+      saveImage(obj.id, obj.version, obj.image.get());
+      return;
+    }
+
+    const char* prefix = obj.prefix.c_str();
+    ObjVersions& versions = m_objVersions[obj.id];
+    if (versions.newer() == obj.version)
+      return;
+
+    writeFile(object_filename(prefix, obj.id, obj.version), true,
+              [&obj](std::ostream& s) {
+                s.write(obj.data.c_str(), obj.data.size());
+              });
 
     // Remove the older version
-    try {
-      if (versions.older() && base::is_file(oldfn))
-        base::delete_file(oldfn);
+    if (versions.older())
+      deleteFile(prefix, obj.id, versions.older());
+
+    // Rotate versions and add the latest one
+    versions.rotateRevisions(obj.version);
+
+    TRACE(" - Saved %s #%d v%d\n", prefix, obj.id, obj.version);
+  }
+
+private:
+
+  // An image delta contains the rows that differ from the base
+  // version. Each band of consecutive rows is saved as an image.
+  void writeImageDelta(std::ostream& s, ObjectId id, const Image* img,
+                       ObjectVersion baseVersion,
+                       const std::vector<std::pair<int, int> >& bands) {
+    write32(s, id);
+    write32(s, baseVersion);
+    write32(s, img->maskColor());
+    write32(s, bands.size());
+
+    int rowSize = img->getRowStrideSize();
+    for (const auto& band : bands) {
+      base::UniquePtr<Image> bandImg(
+        Image::create(img->pixelFormat(), img->width(), band.second));
+      for (int y=0; y<band.second; ++y)
+        std::copy(img->getPixelAddress(0, band.first+y),
+                  img->getPixelAddress(0, band.first+y) + rowSize,
+                  bandImg->getPixelAddress(0, y));
+
+      write32(s, band.first);
+      write_image(s, bandImg.get(), 1);
     }
-    catch (const std::exception&) {
-      TRACE(" - Cannot delete %s #%d v%d\n", prefix, obj->id(), versions.older());
+  }
+
+  void saveImage(ObjectId id, ObjectVersion version, Image* img) {
+    ObjVersions& versions = m_objVersions[id];
+    if (versions.newer() == version)
+      return;
+
+    // "img" is a copy of the original image, so it has other ID (the
+    // ID saved by write_image() is not used to restore the image).
+    ImageBackup& backup = m_images[id];
+    int rowSize = img->getRowStrideSize();
+    std::vector<uint64_t> rows(img->height());
+    for (int y=0; y<img->height(); ++y)
+      rows[y] = hash_row(img->getPixelAddress(0, y), rowSize);
+
+    // Bands of rows modified since the base version
+    std::vector<std::pair<int, int> > bands;
+    int modifiedRows = 0;
+    bool delta =
+      (backup.baseVersion &&
+       backup.pixelFormat == img->pixelFormat() &&
+       backup.width == img->width() &&
+       backup.height == img->height());
+
+    if (delta) {
+      for (int y=0; y<img->height(); ++y) {
+        if (rows[y] == backup.baseRows[y])
+          continue;
+
+        if (!bands.empty() && bands.back().first+bands.back().second == y)
+          ++bands.back().second;
+        else
+          bands.push_back(std::make_pair(y, 1));
+        ++modifiedRows;
+      }
+
+      // Save a full version when the delta is too big (so the old
+      // base version and its deltas can be deleted)
+      delta = (modifiedRows <= img->height()/2 &&
+               m_store->contains(object_filename("img", id, backup.baseVersion)));
     }
 
-    // Rotate versions and add the latest one
-    versions.rotateRevisions(obj->version());
+    if (delta) {
+      ObjectVersion baseVersion = backup.baseVersion;
+      writeFile(object_filename("imgdelta", id, version), false,
+                [this, id, img, baseVersion, &bands](std::ostream& s) {
+                  writeImageDelta(s, id, img, baseVersion, bands);
+                });
+      backup.files.push_back(std::make_pair(version, baseVersion));
+
+      TRACE(" - Saved delta img #%d v%d (%d rows from v%d)\n",
+            id, version, modifiedRows, baseVersion);
+    }
+    else {
+      writeFile(object_filename("img", id, version), false,
+                [img](std::ostream& s) {
+                  // Backups are written frequently, so we prefer speed over size
+                  write_image(s, img, 1);
+                });
+      backup.files.push_back(std::make_pair(version, ObjectVersion(0)));
+      backup.baseVersion = version;
+      backup.pixelFormat = img->pixelFormat();
+      backup.width = img->width();
+      backup.height = img->height();
+      std::swap(backup.baseRows, rows);
+
+      TRACE(" - Saved img #%d v%d\n", id, version);
+    }
 
-    TRACE(" - Saved %s #%d v%d\n", prefix, obj->id(), obj->version());
+    versions.rotateRevisions(version);
+    compactImageFiles(id, backup, versions.size());
+  }
+
+  // Deletes the files of the image versions that are not needed
+  // anymore: versions older than the last "keep" ones that aren't the
+  // base of a newer delta.
+  void compactImageFiles(ObjectId id, ImageBackup& backup, size_t keep) {
+    auto& files = backup.files;
+    if (files.size() <= keep)
+      return;
+
+    auto firstKept = files.end() - keep;
+    for (auto it=files.begin(); it != firstKept; ) {
+      bool needed = false;
+      for (auto it2=firstKept; it2 != files.end(); ++it2) {
+        if (it2->second == it->first) {
+          needed = true;
+          break;
+        }
+      }
+
+      if (needed) {
+        ++it;
+      }
+      else {
+        deleteFile(it->second ? "imgdelta": "img", id, it->first);
+        it = files.erase(it);
+        firstKept = files.end() - keep;
+      }
+    }
+  }
+
+  // Objects have the same content as the old backup files (one file
+  // for each object), so they can be read in the same way. "compress"
+  // is false for images (their pixels are already compressed).
+  void writeFile(const std::string& fn, bool compress,
+                 const std::function<void(std::ostream&)>& writeContent) {
+    std::ostringstream s;
+    write32(s, MAGIC_NUMBER);
+    writeContent(s);              // Write the object
+    m_store->write(fn, s.str(), compress);
+  }
+
+  void deleteFile(const char* prefix, ObjectId id, ObjectVersion ver) {
+    m_store->erase(object_filename(prefix, id, ver));
   }
 
-  std::string m_dir;
-  app::Document* m_doc;
   ObjVersionsMap& m_objVersions;
+  ImageBackupsMap& m_images;
+  base::SharedPtr<ObjectStore> m_store;
 };
 
 } // anonymous namespace
@@ -204,10 +429,26 @@ private:
 //////////////////////////////////////////////////////////////////////
 // Public API
 
+DocumentSnapshot::DocumentSnapshot(app::Document* doc)
+  : m_docId(doc->id())
+{
+  SnapshotBuilder builder(doc, m_objects);
+  builder.takeSnapshot();
+}
+
+void DocumentSnapshot::write(const std::string& dir)
+{
+  Writer writer(dir, m_docId);
+  for (const auto& obj : m_objects)
+    writer.saveObject(obj);
+  writer.compact();
+
+  m_objects.clear();
+}
+
 void write_document(const std::string& dir, app::Document* doc)
 {
-  Writer writer(dir, doc);
-  writer.saveDocument();
+  DocumentSnapshot(doc).write(dir);
 }
 
 void delete_document_internals(app::Document* doc)
@@ -219,6 +460,15 @@ void delete_document_internals(app::Document* doc)
   // never saved by the backup process.
   if (it != g_docVersions.end())
     g_docVersions.erase(it);
+
+  auto it2 = g_docImages.find(doc->id());
+  if (it2 != g_docImages.end())
+    g_docImages.erase(it2);
+
+  // Close the store file (so the backup directory can be deleted)
+  auto it3 = g_docStores.find(doc->id());
+  if (it3 != g_docStores.end())
+    g_docStores.erase(it3);
 }
 
 } // namespace crash
@@ -9,12 +9,44 @@
 #define APP_CRASH_WRITE_DOCUMENT_H_INCLUDED
 #pragma once
 
+#include "base/disable_copying.h"
+#include "doc/image_ref.h"
+#include "doc/object.h"
+
 #include <string>
+#include <vector>
 
 namespace app {
 class Document;
 namespace crash {
 
+  // Copy of the objects of a document that were modified since the
+  // last backup. The document must be locked only while the snapshot
+  // is created (pixels are copied and small objects are serialized in
+  // memory), then it can be written without locking the document
+  // (images are compressed and all objects saved in disk).
+  class DocumentSnapshot {
+  public:
+    struct Object {
+      std::string prefix;
+      doc::ObjectId id;
+      doc::ObjectVersion version;
+      std::string data;         // Serialized object (if it's not an image)
+      doc::ImageRef image;      // Copy of the image
+    };
+
+    explicit DocumentSnapshot(app::Document* doc);
+
+    // Saves the objects in the given backup directory.
+    void write(const std::string& dir);
+
+  private:
+    doc::ObjectId m_docId;
+    std::vector<Object> m_objects;
+
+    DISABLE_COPYING(DocumentSnapshot);
+  };
+
   void write_document(const std::string& dir, app::Document* doc);
   void delete_document_internals(app::Document* doc);
 
@@ -22,8 +22,7 @@
 #include "app/pref/preferences.h"
 #include "app/util/boundary.h"
 #include "base/memory.h"
-#include "base/mutex.h"
-#include "base/scoped_lock.h"
+#include "base/scoped_value.h"
 #include "base/thread.h"
 #include "base/unique_ptr.h"
 #include "doc/cel.h"
@@ -35,7 +34,9 @@
 #include "doc/mask.h"
 #include "doc/palette.h"
 #include "doc/sprite.h"
+#include "render/get_sprite_pixel.h"
 
+#include <cstring>
 #include <map>
 
 namespace app {
@@ -46,8 +47,6 @@ using namespace doc;
 Document::Document(Sprite* sprite)
   : m_undo(new DocumentUndo)
   , m_associated_to_file(false)
-  , m_write_lock(false)
-  , m_read_locks(0)
     // Information about the file format used to load/save this document
   , m_format_options(NULL)
     // Extra cel
@@ -58,6 +57,7 @@ Document::Document(Sprite* sprite)
   // Mask
   , m_mask(new Mask())
   , m_maskVisible(true)
+  , m_preloadCanceled(false)
 {
   setFilename("Sprite");
 
@@ -65,6 +65,12 @@ Document::Document(Sprite* sprite)
   m_bound.nseg = 0;
   m_bound.seg = NULL;
 
+  m_batch.level = 0;
+  m_batch.pending = false;
+  m_batch.generalUpdate = false;
+  m_batch.totalFramesChanged = false;
+  m_batch.sprite = NULL;
+
   if (sprite)
     sprites().add(sprite);
 }
@@ -78,6 +84,8 @@ Document::~Document()
   // fully created app::Document.
   ASSERT(context() == NULL);
 
+  cancelCelImagesPreload();
+
   if (m_bound.seg)
     base_free(m_bound.seg);
 
@@ -92,6 +100,95 @@ DocumentApi Document::getApi(Transaction& transaction)
 //////////////////////////////////////////////////////////////////////
 // Main properties
 
+void Document::getMemoryUsage(MemoryUsage& usage) const
+{
+  Sprite::MemoryUsage spriteUsage;
+  sprite()->getMemoryUsage(spriteUsage);
+
+  usage.images = spriteUsage.images;
+  usage.sharedImages = spriteUsage.sharedImages;
+  usage.palettes = spriteUsage.palettes;
+  usage.other = spriteUsage.other + sizeof(Document);
+
+  usage.masks = m_bound.nseg * sizeof(BoundSeg);
+  if (m_mask)
+    usage.masks += m_mask->getMemSize();
+  if (m_bound.mask)
+    usage.masks += m_bound.mask->getMemSize();
+
+  usage.undo = m_undo->memSize();
+
+  if (m_extraCel)
+    usage.other += sizeof(Cel);
+  if (m_extraImage)
+    usage.other += m_extraImage->getMemSize();
+}
+
+void Document::preloadCelImages(frame_t fromFrame)
+{
+  cancelCelImagesPreload();
+
+  m_preloadCanceled = false;
+  m_preloadToken.reset(new base::task_token);
+
+  base::thread_pool::global().execute(
+    [this, fromFrame]{ preloadCelImagesTask(fromFrame); },
+    m_preloadToken,
+    base::thread_pool::priority::low);
+}
+
+bool Document::isPreloadingCelImages() const
+{
+  return (m_preloadToken &&
+          !m_preloadToken->finished() &&
+          !m_preloadToken->canceled());
+}
+
+void Document::preloadCelImagesTask(frame_t fromFrame)
+{
+  // The sprite can be modified between two cels, so the number of
+  // frames/layers is checked again each time the document is locked.
+  for (int i=0; ; ++i) {
+    while (!lock(ReadLock, 0)) {
+      if (m_preloadCanceled)
+        return;
+      base::this_thread::sleep_for(0.01);
+    }
+
+    if (m_preloadCanceled) {
+      unlock();
+      return;
+    }
+
+    const Sprite* spr = sprite();
+    const int frames = spr->totalFrames();
+    const int layers = spr->countLayers();
+    if (i >= frames*layers) {
+      unlock();
+      return;
+    }
+
+    frame_t frame = frame_t((fromFrame + i/layers) % frames);
+    Layer* layer = spr->indexToLayer(LayerIndex(i % layers));
+    if (layer && layer->isImage()) {
+      Cel* cel = layer->cel(frame);
+      if (cel && !cel->data()->isImageLoaded())
+        cel->image();
+    }
+
+    unlock();
+  }
+}
+
+void Document::cancelCelImagesPreload()
+{
+  if (m_preloadToken) {
+    m_preloadCanceled = true;
+    m_preloadToken->cancel();
+    m_preloadToken.reset();
+  }
+}
+
 color_t Document::bgColor() const
 {
   return color_utils::color_for_target(
@@ -116,12 +213,29 @@ color_t Document::bgColor(Layer* layer) const
 
 void Document::notifyGeneralUpdate()
 {
+  if (m_spritePixelCache)
+    m_spritePixelCache->invalidate();
+
+  if (queueNotification(sprite())) {
+    m_batch.generalUpdate = true;
+    return;
+  }
+
   doc::DocumentEvent ev(this);
   notifyObservers<doc::DocumentEvent&>(&doc::DocumentObserver::onGeneralUpdate, ev);
 }
 
 void Document::notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region)
 {
+  if (m_spritePixelCache)
+    m_spritePixelCache->invalidate(region);
+
+  if (queueNotification(sprite)) {
+    m_batch.pixels.createUnion(m_batch.pixels, region);
+    m_batch.pixels.simplify();
+    return;
+  }
+
   doc::DocumentEvent ev(this);
   ev.sprite(sprite);
   ev.region(region);
@@ -130,14 +244,47 @@ void Document::notifySpritePixelsModified(Sprite* sprite, const gfx::Region& reg
 
 void Document::notifyExposeSpritePixels(Sprite* sprite, const gfx::Region& region)
 {
+  if (m_spritePixelCache)
+    m_spritePixelCache->invalidate(region);
+
+  if (queueNotification(sprite)) {
+    m_batch.exposed.createUnion(m_batch.exposed, region);
+    return;
+  }
+
   doc::DocumentEvent ev(this);
   ev.sprite(sprite);
   ev.region(region);
   notifyObservers<doc::DocumentEvent&>(&doc::DocumentObserver::onExposeSpritePixels, ev);
 }
 
+void Document::notifyExtraCelModified(Sprite* sprite, const gfx::Region& region)
+{
+  // It's never queued in a batch, the extra cel is displayed only in
+  // the UI (it doesn't modify the sprite)
+  doc::DocumentEvent ev(this);
+  ev.sprite(sprite);
+  ev.region(region);
+  notifyObservers<doc::DocumentEvent&>(&doc::DocumentObserver::onExtraCelModified, ev);
+}
+
+void Document::notifyTotalFramesChanged(Sprite* sprite)
+{
+  if (queueNotification(sprite)) {
+    m_batch.totalFramesChanged = true;
+    return;
+  }
+
+  doc::DocumentEvent ev(this);
+  ev.sprite(sprite);
+  ev.frame(sprite->totalFrames());
+  notifyObservers<doc::DocumentEvent&>(&doc::DocumentObserver::onTotalFramesChanged, ev);
+}
+
 void Document::notifyLayerMergedDown(Layer* srcLayer, Layer* targetLayer)
 {
+  flushNotifications();
+
   doc::DocumentEvent ev(this);
   ev.sprite(srcLayer->sprite());
   ev.layer(srcLayer);
@@ -147,6 +294,8 @@ void Document::notifyLayerMergedDown(Layer* srcLayer, Layer* targetLayer)
 
 void Document::notifyCelMoved(Layer* fromLayer, frame_t fromFrame, Layer* toLayer, frame_t toFrame)
 {
+  flushNotifications();
+
   doc::DocumentEvent ev(this);
   ev.sprite(fromLayer->sprite());
   ev.layer(fromLayer);
@@ -158,6 +307,8 @@ void Document::notifyCelMoved(Layer* fromLayer, frame_t fromFrame, Layer* toLaye
 
 void Document::notifyCelCopied(Layer* fromLayer, frame_t fromFrame, Layer* toLayer, frame_t toFrame)
 {
+  flushNotifications();
+
   doc::DocumentEvent ev(this);
   ev.sprite(fromLayer->sprite());
   ev.layer(fromLayer);
@@ -169,6 +320,8 @@ void Document::notifyCelCopied(Layer* fromLayer, frame_t fromFrame, Layer* toLay
 
 void Document::notifySelectionChanged()
 {
+  flushNotifications();
+
   doc::DocumentEvent ev(this);
   notifyObservers<doc::DocumentEvent&>(&doc::DocumentObserver::onSelectionChanged, ev);
 }
@@ -222,33 +375,120 @@ const BoundSeg* Document::getBoundariesSegments() const
   return m_bound.seg;
 }
 
-void Document::generateMaskBoundaries(Mask* mask)
+void Document::destroyMaskBoundaries()
 {
   if (m_bound.seg) {
     base_free(m_bound.seg);
     m_bound.seg = NULL;
     m_bound.nseg = 0;
   }
+  m_bound.mask.reset(NULL);
+}
+
+// Returns true if both masks have the same bitmap (without
+// comparing their origins).
+static bool is_same_mask_bitmap(const Mask* a, const Mask* b)
+{
+  if (a->isEmpty() || b->isEmpty())
+    return (a->isEmpty() == b->isEmpty());
+
+  // Avoid creating the bitmaps of rectangular masks
+  if (a->isRectangular() || b->isRectangular())
+    return (a->isRectangular() == b->isRectangular() &&
+            a->bounds().w == b->bounds().w &&
+            a->bounds().h == b->bounds().h);
+
+  const Image* bitmapA = a->bitmap();
+  const Image* bitmapB = b->bitmap();
+  if (bitmapA->width() != bitmapB->width() ||
+      bitmapA->height() != bitmapB->height())
+    return false;
+
+  // Compare whole bytes, and the used bits of the last byte of each row
+  int w = bitmapA->width();
+  int bytes = w / 8;
+  uint8_t lastMask = uint8_t((1 << (w % 8)) - 1);
+
+  for (int y=0; y<bitmapA->height(); ++y) {
+    const uint8_t* rowA = bitmapA->getPixelAddress(0, y);
+    const uint8_t* rowB = bitmapB->getPixelAddress(0, y);
+    if (std::memcmp(rowA, rowB, bytes) != 0)
+      return false;
+    if (lastMask && ((rowA[bytes] ^ rowB[bytes]) & lastMask))
+      return false;
+  }
+  return true;
+}
 
+void Document::generateMaskBoundaries(Mask* mask)
+{
   // No mask specified? Use the current one in the document
   if (!mask) {
-    if (!isMaskVisible())       // The mask is hidden
+    if (!isMaskVisible()) {     // The mask is hidden
+      destroyMaskBoundaries();
       return;                   // Done, without boundaries
+    }
     else
       mask = this->mask();      // Use the document mask
   }
 
   ASSERT(mask != NULL);
 
-  if (!mask->isEmpty()) {
-    m_bound.seg = find_mask_boundary(mask->bitmap(),
-                                     &m_bound.nseg,
-                                     IgnoreBounds, 0, 0, 0, 0);
-    for (int c=0; c<m_bound.nseg; c++) {
-      m_bound.seg[c].x1 += mask->bounds().x;
-      m_bound.seg[c].y1 += mask->bounds().y;
-      m_bound.seg[c].x2 += mask->bounds().x;
-      m_bound.seg[c].y2 += mask->bounds().y;
+  // The same bitmap is used again (e.g. after undoing a command that
+  // doesn't modify the selection, or when the selection is moved), so
+  // the segments are just displaced to the new origin.
+  if (!mask->isEmpty() &&
+      m_bound.mask && is_same_mask_bitmap(mask, m_bound.mask)) {
+    int dx = mask->bounds().x - m_bound.mask->bounds().x;
+    int dy = mask->bounds().y - m_bound.mask->bounds().y;
+    if (dx || dy) {
+      for (int c=0; c<m_bound.nseg; c++) {
+        m_bound.seg[c].x1 += dx;
+        m_bound.seg[c].y1 += dy;
+        m_bound.seg[c].x2 += dx;
+        m_bound.seg[c].y2 += dy;
+      }
+      m_bound.mask->setOrigin(mask->bounds().x, mask->bounds().y);
+    }
+  }
+  else {
+    destroyMaskBoundaries();
+
+    if (mask->isRectangular()) {
+      // The same four segments that find_mask_boundary() would
+      // generate, without creating the mask bitmap.
+      const int w = mask->bounds().w;
+      const int h = mask->bounds().h;
+      const int segs[4][5] = { { 0, 0, w, 0, 1 },
+                               { 0, 0, 0, h, 1 },
+                               { w, 0, w, h, 0 },
+                               { 0, h, w, h, 0 } };
+
+      m_bound.nseg = 4;
+      m_bound.seg = (BoundSeg*)base_malloc(sizeof(BoundSeg) * 4);
+      for (int c=0; c<4; c++) {
+        m_bound.seg[c].x1 = segs[c][0];
+        m_bound.seg[c].y1 = segs[c][1];
+        m_bound.seg[c].x2 = segs[c][2];
+        m_bound.seg[c].y2 = segs[c][3];
+        m_bound.seg[c].open = segs[c][4];
+        m_bound.seg[c].visited = 0;
+      }
+    }
+    else if (!mask->isEmpty()) {
+      m_bound.seg = find_mask_boundary(mask->bitmap(),
+                                       &m_bound.nseg,
+                                       IgnoreBounds, 0, 0, 0, 0);
+    }
+
+    if (!mask->isEmpty()) {
+      for (int c=0; c<m_bound.nseg; c++) {
+        m_bound.seg[c].x1 += mask->bounds().x;
+        m_bound.seg[c].y1 += mask->bounds().y;
+        m_bound.seg[c].x2 += mask->bounds().x;
+        m_bound.seg[c].y2 += mask->bounds().y;
+      }
+      m_bound.mask.reset(new Mask(*mask));
     }
   }
 
@@ -302,6 +542,16 @@ Image* Document::getExtraCelImage() const
   return m_extraImage.get();
 }
 
+//////////////////////////////////////////////////////////////////////
+// Composited pixels
+
+render::SpritePixelCache* Document::spritePixelCache() const
+{
+  if (!m_spritePixelCache)
+    m_spritePixelCache.reset(new render::SpritePixelCache);
+  return m_spritePixelCache;
+}
+
 //////////////////////////////////////////////////////////////////////
 // Mask
 
@@ -387,7 +637,9 @@ void Document::copyLayerContent(const Layer* sourceLayer0, Document* destDoc, La
         newCel->setFrame(sourceCel->frame());
       }
       else {
-        newCel.reset(Cel::createCopy(sourceCel));
+        // The pixels are shared with the source cel until one of
+        // both images is modified.
+        newCel.reset(Cel::createSharedCopy(sourceCel));
         linked.insert(std::make_pair(sourceCel->data()->id(), newCel.get()));
       }
 
@@ -512,103 +764,99 @@ Document* Document::duplicate(DuplicateType type) const
 
 bool Document::lock(LockType lockType, int timeout)
 {
-  while (timeout >= 0) {
-    {
-      scoped_lock lock(m_mutex);
-      switch (lockType) {
-
-        case ReadLock:
-          // If no body is writting the sprite...
-          if (!m_write_lock) {
-            // We can read it
-            ++m_read_locks;
-            return true;
-          }
-          break;
-
-        case WriteLock:
-          // If no body is reading and writting...
-          if (m_read_locks == 0 && !m_write_lock) {
-            // We can start writting the sprite...
-            m_write_lock = true;
-            TRACE("Document::lock: Locked <%d> to write\n", id());
-            return true;
-          }
-          break;
-
-      }
-    }
-
-    if (timeout > 0) {
-      int delay = MIN(100, timeout);
-      timeout -= delay;
-
-      TRACE("Document::lock: wait 100 msecs for <%d>\n", id());
-      base::this_thread::sleep_for(double(delay) / 1000.0);
-    }
-    else
-      break;
+  if (m_rwLock.lock(lockType == ReadLock ? base::rw_lock::read_lock:
+                                           base::rw_lock::write_lock, timeout)) {
+    if (lockType == WriteLock)
+      TRACE("Document::lock: Locked <%d> to write\n", id());
+    return true;
   }
 
   TRACE("Document::lock: Cannot lock <%d> to %s (has %d read locks and %d write locks)\n",
-    id(), (lockType == ReadLock ? "read": "write"), m_read_locks, m_write_lock);
+    id(), (lockType == ReadLock ? "read": "write"),
+    m_rwLock.read_locks(), m_rwLock.write_locked());
   return false;
 }
 
 bool Document::lockToWrite(int timeout)
 {
-  while (timeout >= 0) {
-    {
-      scoped_lock lock(m_mutex);
-      // this only is possible if there are just one reader
-      if (m_read_locks == 1) {
-        ASSERT(!m_write_lock);
-        m_read_locks = 0;
-        m_write_lock = true;
-        TRACE("Document::lockToWrite: Locked <%d> to write\n", id());
-        return true;
-      }
-    }
-
-    if (timeout > 0) {
-      int delay = MIN(100, timeout);
-      timeout -= delay;
-
-      TRACE("Document::lockToWrite: wait 100 msecs for <%d>\n", id());
-      base::this_thread::sleep_for(double(delay) / 1000.0);
-    }
-    else
-      break;
+  if (m_rwLock.upgrade_to_write(timeout)) {
+    TRACE("Document::lockToWrite: Locked <%d> to write\n", id());
+    return true;
   }
 
   TRACE("Document::lockToWrite: Cannot lock <%d> to write (has %d read locks and %d write locks)\n",
-    id(), m_read_locks, m_write_lock);
+    id(), m_rwLock.read_locks(), m_rwLock.write_locked());
   return false;
 }
 
 void Document::unlockToRead()
 {
-  scoped_lock lock(m_mutex);
+  m_rwLock.downgrade_to_read();
+}
+
+void Document::unlock()
+{
+  m_rwLock.unlock();
+}
 
-  ASSERT(m_read_locks == 0);
-  ASSERT(m_write_lock);
+void Document::beginNotificationsBatch()
+{
+  ++m_batch.level;
+}
 
-  m_write_lock = false;
-  m_read_locks = 1;
+void Document::endNotificationsBatch()
+{
+  ASSERT(m_batch.level > 0);
+  --m_batch.level;
 }
 
-void Document::unlock()
+void Document::flushNotifications()
 {
-  scoped_lock lock(m_mutex);
+  if (!m_batch.pending)
+    return;
 
-  if (m_write_lock) {
-    m_write_lock = false;
-  }
-  else if (m_read_locks > 0) {
-    --m_read_locks;
+  Sprite* sprite = m_batch.sprite;
+  bool generalUpdate = m_batch.generalUpdate;
+  bool totalFramesChanged = m_batch.totalFramesChanged;
+  gfx::Region pixels = m_batch.pixels;
+  gfx::Region exposed = m_batch.exposed;
+
+  m_batch.pending = false;
+  m_batch.generalUpdate = false;
+  m_batch.totalFramesChanged = false;
+  m_batch.sprite = NULL;
+  m_batch.pixels.clear();
+  m_batch.exposed.clear();
+
+  // Fire the merged notifications (outside the batch)
+  base::ScopedValue<int> outside(m_batch.level, 0, m_batch.level);
+
+  if (totalFramesChanged)
+    notifyTotalFramesChanged(sprite);
+  if (!pixels.isEmpty())
+    notifySpritePixelsModified(sprite, pixels);
+  if (!exposed.isEmpty())
+    notifyExposeSpritePixels(sprite, exposed);
+  if (generalUpdate)
+    notifyGeneralUpdate();
+}
+
+// Returns true if the notification for the given sprite must be
+// queued in the current batch.
+bool Document::queueNotification(Sprite* sprite)
+{
+  if (m_batch.level > 0) {
+    // All queued notifications are for the same sprite
+    if (m_batch.pending && m_batch.sprite != sprite)
+      flushNotifications();
+
+    m_batch.pending = true;
+    m_batch.sprite = sprite;
+    return true;
   }
   else {
-    ASSERT(false);
+    flushNotifications();
+    return false;
   }
 }
 
@@ -11,9 +11,10 @@
 
 #include "app/file/format_options.h"
 #include "base/disable_copying.h"
-#include "base/mutex.h"
 #include "base/observable.h"
+#include "base/rw_lock.h"
 #include "base/shared_ptr.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/color.h"
 #include "doc/document.h"
@@ -21,9 +22,11 @@
 #include "doc/image_ref.h"
 #include "doc/pixel_format.h"
 #include "gfx/rect.h"
+#include "gfx/region.h"
 #include "gfx/transformation.h"
 #include "render/extra_type.h"
 
+#include <atomic>
 #include <string>
 
 namespace doc {
@@ -37,6 +40,10 @@ namespace gfx {
   class Region;
 }
 
+namespace render {
+  class SpritePixelCache;
+}
+
 namespace app {
   class DocumentApi;
   class DocumentUndo;
@@ -74,16 +81,54 @@ namespace app {
     color_t bgColor() const;
     color_t bgColor(Layer* layer) const;
 
+    // Bytes used by the document by category (see
+    // doc::Sprite::getMemoryUsage()). Caches of the UI (e.g. editors
+    // or timeline) aren't included.
+    struct MemoryUsage {
+      std::size_t images;
+      std::size_t sharedImages;
+      std::size_t palettes;
+      std::size_t masks;        // Current mask and its boundaries
+      std::size_t undo;
+      std::size_t other;        // Layers, cels, frame tags, extra cel, etc.
+
+      std::size_t total() const {
+        return images + sharedImages + palettes + masks + undo + other;
+      }
+    };
+
+    void getMemoryUsage(MemoryUsage& usage) const;
+
+    // Decodes the images of lazy loaded cels (see
+    // FILE_LOAD_LAZY_CELS) in a background thread, frame by frame
+    // starting from "fromFrame", so they are ready when the user
+    // goes to other frames. Each cel is decoded with a read lock, and
+    // locked cels are tried again later.
+    void preloadCelImages(frame_t fromFrame);
+    bool isPreloadingCelImages() const;
+
     //////////////////////////////////////////////////////////////////////
     // Notifications
 
     void notifyGeneralUpdate();
     void notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region);
     void notifyExposeSpritePixels(Sprite* sprite, const gfx::Region& region);
+    void notifyExtraCelModified(Sprite* sprite, const gfx::Region& region);
     void notifyLayerMergedDown(Layer* srcLayer, Layer* targetLayer);
     void notifyCelMoved(Layer* fromLayer, frame_t fromFrame, Layer* toLayer, frame_t toFrame);
     void notifyCelCopied(Layer* fromLayer, frame_t fromFrame, Layer* toLayer, frame_t toFrame);
     void notifySelectionChanged();
+    void notifyTotalFramesChanged(Sprite* sprite);
+
+    // Notifications that only refresh the sprite (general updates,
+    // modified pixels and total frames changes) fired between
+    // beginNotificationsBatch() and endNotificationsBatch() (e.g. by
+    // the commands of a Transaction) are queued and merged. Queued
+    // notifications are fired by flushNotifications(), or before any
+    // other notification fired outside the batch.
+    void beginNotificationsBatch();
+    void endNotificationsBatch();
+    void flushNotifications();
 
     //////////////////////////////////////////////////////////////////////
     // File related properties
@@ -129,6 +174,13 @@ namespace app {
     int getExtraCelBlendMode() const { return m_extraCelBlendMode; }
     void setExtraCelBlendMode(int mode) { m_extraCelBlendMode = mode; }
 
+    //////////////////////////////////////////////////////////////////////
+    // Composited pixels
+
+    // Cache to pick colors from the composited sprite (e.g. the
+    // eyedropper). It's invalidated with the pixels notifications.
+    render::SpritePixelCache* spritePixelCache() const;
+
     //////////////////////////////////////////////////////////////////////
     // Mask
 
@@ -168,7 +220,8 @@ namespace app {
     // Multi-threading ("sprite wrappers" use this)
 
     // Locks the sprite to read or write on it, returning true if the
-    // sprite can be accessed in the desired mode.
+    // sprite can be accessed in the desired mode. It waits until the
+    // lock is available or "timeout" milliseconds have passed.
     bool lock(LockType lockType, int timeout);
 
     // If you've locked the sprite to read, using this method you can
@@ -185,6 +238,11 @@ namespace app {
     virtual void onContextChanged() override;
 
   private:
+    void destroyMaskBoundaries();
+    bool queueNotification(Sprite* sprite);
+    void preloadCelImagesTask(frame_t fromFrame);
+    void cancelCelImagesPreload();
+
     // Undo and redo information about the document.
     base::UniquePtr<DocumentUndo> m_undo;
 
@@ -195,16 +253,24 @@ namespace app {
     struct {
       int nseg;
       BoundSeg* seg;
+      // Copy of the mask used to generate the segments, so they are
+      // re-used (or just displaced) if the same mask is used again.
+      base::UniquePtr<Mask> mask;
     } m_bound;
 
-    // Mutex to modify the 'locked' flag.
-    base::mutex m_mutex;
-
-    // True if some thread is writing the sprite.
-    bool m_write_lock;
+    // Readers/writer lock to access the sprite from several threads.
+    base::rw_lock m_rwLock;
 
-    // Greater than zero when one or more threads are reading the sprite.
-    int m_read_locks;
+    // Notifications queued in a batch
+    struct {
+      int level;
+      bool pending;
+      bool generalUpdate;
+      bool totalFramesChanged;
+      Sprite* sprite;
+      gfx::Region pixels;
+      gfx::Region exposed;
+    } m_batch;
 
     // Data to save the file in the same format that it was loaded
     base::SharedPtr<FormatOptions> m_format_options;
@@ -217,6 +283,9 @@ namespace app {
     int m_extraCelBlendMode;
     render::ExtraType m_extraCelType;
 
+    // Tiles of the composited sprite to pick colors.
+    mutable base::UniquePtr<render::SpritePixelCache> m_spritePixelCache;
+
     // Current mask.
     base::UniquePtr<Mask> m_mask;
     bool m_maskVisible;
@@ -224,6 +293,10 @@ namespace app {
     // Current transformation.
     gfx::Transformation m_transformation;
 
+    // Background task to decode lazy loaded cels
+    base::task_token_ptr m_preloadToken;
+    std::atomic<bool> m_preloadCanceled;
+
     DISABLE_COPYING(Document);
   };
 
@@ -23,6 +23,7 @@
 #include "app/cmd/flip_image.h"
 #include "app/cmd/layer_from_background.h"
 #include "app/cmd/move_cel.h"
+#include "app/cmd/move_frame.h"
 #include "app/cmd/move_layer.h"
 #include "app/cmd/remove_cel.h"
 #include "app/cmd/remove_frame.h"
@@ -46,6 +47,7 @@
 #include "app/document.h"
 #include "app/document_undo.h"
 #include "app/transaction.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/algorithm/flip_image.h"
 #include "doc/algorithm/shrink_bounds.h"
@@ -53,6 +55,7 @@
 #include "doc/context.h"
 #include "doc/frame_tag.h"
 #include "doc/frame_tags.h"
+#include "doc/image_buffer_recycler.h"
 #include "doc/mask.h"
 #include "render/quantization.h"
 #include "render/render.h"
@@ -85,6 +88,12 @@ void DocumentApi::cropSprite(Sprite* sprite, const gfx::Rect& bounds)
   app::Document* doc = static_cast<app::Document*>(sprite->document());
   std::vector<Layer*> layers;
   sprite->getLayersList(layers);
+
+  // Images of background cels that must be cropped (cels of other
+  // layers are just moved, their images aren't copied)
+  std::vector<Cel*> bgCels;
+  std::vector<color_t> bgColors;
+
   for (Layer* layer : layers) {
     if (!layer->isImage())
       continue;
@@ -104,15 +113,8 @@ void DocumentApi::cropSprite(Sprite* sprite, const gfx::Rect& bounds)
           ASSERT(cel->x() == 0);
           ASSERT(cel->y() == 0);
 
-          // Create the new image through a crop
-          ImageRef new_image(
-            crop_image(image,
-              bounds.x, bounds.y,
-              bounds.w, bounds.h,
-              doc->bgColor(layer)));
-
-          // Replace the image in the stock that is pointed by the cel
-          replaceImage(sprite, cel->imageRef(), new_image);
+          bgCels.push_back(cel);
+          bgColors.push_back(doc->bgColor(layer));
         }
       }
       else {
@@ -123,6 +125,23 @@ void DocumentApi::cropSprite(Sprite* sprite, const gfx::Rect& bounds)
     }
   }
 
+  // Create the new images through a crop in parallel (each one is an
+  // independent copy)
+  std::vector<ImageRef> newImages(bgCels.size());
+  base::thread_pool::global().parallel_for(
+    int(bgCels.size()), [&](int i) {
+      newImages[i].reset(
+        crop_image(bgCels[i]->image(),
+          bounds.x, bounds.y,
+          bounds.w, bounds.h,
+          bgColors[i]));
+    });
+
+  // Replace the images in the stock that are pointed by the cels
+  // (the transaction must be modified from this thread only)
+  for (std::size_t i=0; i<bgCels.size(); ++i)
+    replaceImage(sprite, bgCels[i]->imageRef(), newImages[i]);
+
   if (!m_document->mask()->isEmpty())
     setMaskPosition(m_document->mask()->bounds().x-bounds.x,
                     m_document->mask()->bounds().y-bounds.y);
@@ -130,23 +149,35 @@ void DocumentApi::cropSprite(Sprite* sprite, const gfx::Rect& bounds)
 
 void DocumentApi::trimSprite(Sprite* sprite)
 {
-  gfx::Rect bounds;
-
-  base::UniquePtr<Image> image_wrap(Image::create(sprite->pixelFormat(),
-                                                  sprite->width(),
-                                                  sprite->height()));
-  Image* image = image_wrap.get();
-  render::Render render;
+  // Render each frame in parallel (with one render::Render for each
+  // frame, as it isn't thread-safe). Temporary images come from the
+  // recycler, so only a few images are allocated at the same time.
+  std::vector<gfx::Rect> framesBounds(sprite->totalFrames());
+  base::thread_pool::global().parallel_for(
+    int(framesBounds.size()), [&](int i) {
+      base::UniquePtr<Image> image(
+        Image::create(sprite->pixelFormat(),
+                      sprite->width(),
+                      sprite->height(),
+                      ImageBufferRecycler::global().getForImage(
+                        sprite->pixelFormat(),
+                        sprite->width(),
+                        sprite->height())));
+
+      render::Render render;
+      render.renderSprite(image.get(), sprite, frame_t(i));
+
+      // TODO configurable (what color pixel to use as "refpixel",
+      // here we are using the top-left pixel by default)
+      gfx::Rect frameBounds;
+      if (doc::algorithm::shrink_bounds(image.get(), frameBounds,
+                                        get_pixel(image.get(), 0, 0)))
+        framesBounds[i] = frameBounds;
+    });
 
-  for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
-    render.renderSprite(image, sprite, frame);
-
-    // TODO configurable (what color pixel to use as "refpixel",
-    // here we are using the top-left pixel by default)
-    gfx::Rect frameBounds;
-    if (doc::algorithm::shrink_bounds(image, frameBounds, get_pixel(image, 0, 0)))
-      bounds = bounds.createUnion(frameBounds);
-  }
+  gfx::Rect bounds;
+  for (const gfx::Rect& frameBounds : framesBounds)
+    bounds = bounds.createUnion(frameBounds);
 
   if (!bounds.isEmpty())
     cropSprite(sprite, bounds);
@@ -219,86 +250,11 @@ void DocumentApi::moveFrame(Sprite* sprite, frame_t frame, frame_t beforeFrame)
       frame <= sprite->lastFrame() &&
       beforeFrame >= 0 &&
       beforeFrame <= sprite->lastFrame()+1) {
-    // Change the frame-lengths.
-    int frlen_aux = sprite->frameDuration(frame);
-
-    // Moving the frame to the future.
-    if (frame < beforeFrame) {
-      for (frame_t c=frame; c<beforeFrame-1; ++c)
-        setFrameDuration(sprite, c, sprite->frameDuration(c+1));
-      setFrameDuration(sprite, beforeFrame-1, frlen_aux);
-    }
-    // Moving the frame to the past.
-    else if (beforeFrame < frame) {
-      for (frame_t c=frame; c>beforeFrame; --c)
-        setFrameDuration(sprite, c, sprite->frameDuration(c-1));
-      setFrameDuration(sprite, beforeFrame, frlen_aux);
-    }
-
     adjustFrameTags(sprite, frame, -1, true);
     adjustFrameTags(sprite, beforeFrame, +1, true);
 
-    // Change cel positions.
-    moveFrameLayer(sprite->folder(), frame, beforeFrame);
-  }
-}
-
-void DocumentApi::moveFrameLayer(Layer* layer, frame_t frame, frame_t beforeFrame)
-{
-  ASSERT(layer);
-
-  switch (layer->type()) {
-
-    case ObjectType::LayerImage: {
-      LayerImage* imglayer = static_cast<LayerImage*>(layer);
-
-      CelList cels;
-      imglayer->getCels(cels);
-
-      CelIterator it = cels.begin();
-      CelIterator end = cels.end();
-
-      for (; it != end; ++it) {
-        Cel* cel = *it;
-        frame_t celFrame = cel->frame();
-        frame_t newFrame = celFrame;
-
-        // moving the frame to the future
-        if (frame < beforeFrame) {
-          if (celFrame == frame) {
-            newFrame = beforeFrame-1;
-          }
-          else if (celFrame > frame &&
-                   celFrame < beforeFrame) {
-            --newFrame;
-          }
-        }
-        // moving the frame to the past
-        else if (beforeFrame < frame) {
-          if (celFrame == frame) {
-            newFrame = beforeFrame;
-          }
-          else if (celFrame >= beforeFrame &&
-                   celFrame < frame) {
-            ++newFrame;
-          }
-        }
-
-        if (celFrame != newFrame)
-          setCelFramePosition(cel, newFrame);
-      }
-      break;
-    }
-
-    case ObjectType::LayerFolder: {
-      LayerIterator it = static_cast<LayerFolder*>(layer)->getLayerBegin();
-      LayerIterator end = static_cast<LayerFolder*>(layer)->getLayerEnd();
-
-      for (; it != end; ++it)
-        moveFrameLayer(*it, frame, beforeFrame);
-      break;
-    }
-
+    // Change frame durations and cel positions.
+    m_transaction.execute(new cmd::MoveFrame(sprite, frame, beforeFrame));
   }
 }
 
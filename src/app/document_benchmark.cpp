@@ -0,0 +1,229 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/benchmark.h"
+#include "tests/benchmark_allocs.h"
+
+#include "app/context.h"
+#include "app/document.h"
+#include "app/document_api.h"
+#include "app/document_range.h"
+#include "app/document_range_ops.h"
+#include "app/document_undo.h"
+#include "app/transaction.h"
+#include "base/unique_ptr.h"
+#include "doc/doc.h"
+#include "doc/test_context.h"
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+typedef base::UniquePtr<app::Document> DocumentPtr;
+
+// Document with range_x layers and range_y frames, and one small
+// image in each cel.
+class SyntheticDocument {
+public:
+  SyntheticDocument(int layers, int frames)
+    : m_doc(static_cast<app::Document*>(m_ctx.documents().add(16, 16))) {
+    Sprite* sprite = m_doc->sprite();
+    sprite->setTotalFrames(frame_t(frames));
+
+    for (int i=0; i<layers; ++i) {
+      LayerImage* layer;
+      if (i == 0)
+        layer = static_cast<LayerImage*>(sprite->folder()->getFirstLayer());
+      else {
+        layer = new LayerImage(sprite);
+        sprite->folder()->addLayer(layer);
+      }
+
+      for (frame_t frame(0); frame<frames; ++frame) {
+        if (layer->cel(frame))
+          continue;
+
+        ImageRef image(Image::create(IMAGE_RGB, 4, 4));
+        clear_image(image.get(), 0);
+        layer->addCel(new Cel(frame, image));
+      }
+    }
+  }
+
+  ~SyntheticDocument() {
+    m_doc->close();
+  }
+
+  app::Context* context() { return &m_ctx; }
+  app::Document* document() { return m_doc; }
+  Sprite* sprite() { return m_doc->sprite(); }
+  DocumentUndo* undo() { return m_doc->undoHistory(); }
+
+  LayerImage* layer(int i) {
+    return static_cast<LayerImage*>(sprite()->indexToLayer(LayerIndex(i)));
+  }
+
+private:
+  TestContextT<app::Context> m_ctx;
+  DocumentPtr m_doc;
+};
+
+void report_allocs(benchmark::State& state, const benchmark::AllocCounter& allocs)
+{
+  double n = allocs.perIteration(state);
+  state.counters["allocs"] = n;
+}
+
+// range_x = layers, range_y = frames (from 1k to 100k cels)
+void document_sizes(benchmark::Benchmark* b)
+{
+  b->ArgPair(10, 100)
+   ->ArgPair(100, 100)
+   ->ArgPair(1000, 100)
+   ->ArgPair(10, 10000)
+   ->ArgPair(100, 1000);
+}
+
+} // anonymous namespace
+
+// Adds a frame in the middle of the sprite (moving all the next
+// cels) and undoes it.
+static void BM_DocumentApiAddFrame(benchmark::State& state)
+{
+  SyntheticDocument doc(state.range_x(), state.range_y());
+  frame_t frame(state.range_y() / 2);
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    {
+      Transaction transaction(doc.context(), "Add Frame");
+      doc.document()->getApi(transaction).addFrame(doc.sprite(), frame);
+      transaction.commit();
+    }
+    doc.undo()->undo();
+  }
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_DocumentApiAddFrame)->Apply(document_sizes);
+
+static void BM_DocumentApiRemoveFrame(benchmark::State& state)
+{
+  SyntheticDocument doc(state.range_x(), state.range_y());
+  frame_t frame(state.range_y() / 2);
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    {
+      Transaction transaction(doc.context(), "Remove Frame");
+      doc.document()->getApi(transaction).removeFrame(doc.sprite(), frame);
+      transaction.commit();
+    }
+    doc.undo()->undo();
+  }
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_DocumentApiRemoveFrame)->Apply(document_sizes);
+
+static void BM_DocumentApiNewLayer(benchmark::State& state)
+{
+  SyntheticDocument doc(state.range_x(), state.range_y());
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    {
+      Transaction transaction(doc.context(), "New Layer");
+      doc.document()->getApi(transaction).newLayer(doc.sprite());
+      transaction.commit();
+    }
+    doc.undo()->undo();
+  }
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_DocumentApiNewLayer)->Apply(document_sizes);
+
+static void BM_DocumentApiRemoveLayer(benchmark::State& state)
+{
+  SyntheticDocument doc(state.range_x(), state.range_y());
+  LayerImage* layer = doc.layer(state.range_x() / 2);
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    {
+      Transaction transaction(doc.context(), "Remove Layer");
+      doc.document()->getApi(transaction).removeLayer(layer);
+      transaction.commit();
+    }
+    doc.undo()->undo();
+  }
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_DocumentApiRemoveLayer)->Apply(document_sizes);
+
+// Moves a cel to other layer (replacing its cel) and undoes it.
+static void BM_DocumentApiMoveCel(benchmark::State& state)
+{
+  SyntheticDocument doc(state.range_x(), state.range_y());
+  LayerImage* layer1 = doc.layer(0);
+  LayerImage* layer2 = doc.layer(state.range_x() - 1);
+  frame_t frame(state.range_y() / 2);
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    {
+      Transaction transaction(doc.context(), "Move Cel");
+      doc.document()->getApi(transaction).moveCel(layer1, frame, layer2, frame);
+      transaction.commit();
+    }
+    doc.undo()->undo();
+  }
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_DocumentApiMoveCel)->Apply(document_sizes);
+
+// Moves the first 10% of frames after the last frame (with
+// app::move_range()) and undoes it.
+static void BM_MoveRangeOfFrames(benchmark::State& state)
+{
+  SyntheticDocument doc(state.range_x(), state.range_y());
+  frame_t frames(state.range_y());
+
+  DocumentRange from, to;
+  from.startRange(LayerIndex(0), frame_t(0), DocumentRange::kFrames);
+  from.endRange(LayerIndex(0), frame_t(frames/10 - 1));
+  to.startRange(LayerIndex(0), frames-1, DocumentRange::kFrames);
+  to.endRange(LayerIndex(0), frames-1);
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    move_range(doc.document(), from, to, kDocumentRangeAfter);
+    doc.undo()->undo();
+  }
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_MoveRangeOfFrames)->Apply(document_sizes);
+
+// Undoes and redoes one transaction that modifies all cels (reverse
+// all frames).
+static void BM_UndoRedoLargeTransaction(benchmark::State& state)
+{
+  SyntheticDocument doc(state.range_x(), state.range_y());
+
+  DocumentRange range;
+  range.startRange(LayerIndex(0), frame_t(0), DocumentRange::kFrames);
+  range.endRange(LayerIndex(0), frame_t(state.range_y()-1));
+  reverse_frames(doc.document(), range);
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    doc.undo()->undo();
+    doc.undo()->redo();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range_x() * state.range_y());
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_UndoRedoLargeTransaction)->Apply(document_sizes);
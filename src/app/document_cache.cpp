@@ -0,0 +1,86 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/document_cache.h"
+
+#include "app/document.h"
+#include "app/file/file.h"
+#include "base/fs.h"
+#include "base/path.h"
+
+namespace app {
+
+DocumentCache::DocumentCache(Context* context, int maxDocuments)
+  : m_context(context)
+  , m_maxDocuments(maxDocuments)
+{
+  ASSERT(m_maxDocuments > 0);
+}
+
+DocumentCache::~DocumentCache()
+{
+  clear();
+}
+
+Document* DocumentCache::getDocument(const std::string& filename)
+{
+  std::string fn = base::fix_path_separators(filename);
+  base::Time time = base::get_modification_time(fn);
+
+  for (Items::iterator it=m_items.begin(); it!=m_items.end(); ++it) {
+    if (it->filename != fn)
+      continue;
+
+    Item item = *it;
+    m_items.erase(it);
+
+    // The file was modified since the last time it was loaded
+    if (item.time != time) {
+      closeDocument(item.doc);
+      break;
+    }
+
+    m_items.push_front(item);
+    return item.doc;
+  }
+
+  Document* doc = load_document(m_context, fn.c_str());
+  if (!doc)
+    return NULL;
+
+  Item item = { fn, time, doc };
+  m_items.push_front(item);
+
+  // Close the least recently used documents
+  while (int(m_items.size()) > m_maxDocuments) {
+    closeDocument(m_items.back().doc);
+    m_items.pop_back();
+  }
+
+  return doc;
+}
+
+void DocumentCache::clear()
+{
+  for (Item& item : m_items)
+    closeDocument(item.doc);
+  m_items.clear();
+}
+
+void DocumentCache::closeDocument(Document* doc)
+{
+  // Close the document first so observers receive the notification
+  // of an app::Document (see App::run()).
+  doc->close();
+  delete doc;
+}
+
+} // namespace app
@@ -0,0 +1,60 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_DOCUMENT_CACHE_H_INCLUDED
+#define APP_DOCUMENT_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/time.h"
+
+#include <list>
+#include <string>
+
+namespace app {
+  class Context;
+  class Document;
+
+  // Keeps the recently used documents loaded in memory to avoid
+  // loading the same files again and again (e.g. in batch exports).
+  // A document is loaded again if its file was modified.
+  //
+  // This class isn't thread-safe, documents must be used in the
+  // same thread (or under the same lock) of the cache.
+  class DocumentCache {
+  public:
+    DocumentCache(Context* context, int maxDocuments);
+    ~DocumentCache();
+
+    // Returns the loaded document of the given file or NULL if it
+    // cannot be loaded. The document is owned by the cache, so it
+    // must not be modified or closed.
+    Document* getDocument(const std::string& filename);
+
+    int size() const { return int(m_items.size()); }
+    void clear();
+
+  private:
+    struct Item {
+      std::string filename;
+      base::Time time;
+      Document* doc;
+    };
+    typedef std::list<Item> Items;
+
+    void closeDocument(Document* doc);
+
+    Context* m_context;
+    int m_maxDocuments;
+    Items m_items;              // Most recently used first
+
+    DISABLE_COPYING(DocumentCache);
+  };
+
+} // namespace app
+
+#endif
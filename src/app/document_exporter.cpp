@@ -14,36 +14,99 @@
 #include "app/cmd/set_pixel_format.h"
 #include "app/console.h"
 #include "app/document.h"
+#include "app/document_undo.h"
 #include "app/file/file.h"
+#include "app/file/png_bands.h"
+#include "app/file/png_options.h"
 #include "app/filename_formatter.h"
 #include "app/ui_context.h"
 #include "base/convert_to.h"
 #include "base/fstream_path.h"
+#include "base/fs.h"
 #include "base/path.h"
+#include "base/sha1.h"
 #include "base/shared_ptr.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/dithering_method.h"
 #include "doc/frame_tag.h"
 #include "doc/image.h"
+#include "doc/image_buffer_recycler.h"
+#include "doc/image_ref.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "gfx/clip.h"
 #include "gfx/packing_rects.h"
 #include "gfx/size.h"
+#include "render/content_cache.h"
 #include "render/render.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
 
 using namespace doc;
 
 namespace app {
 
+namespace {
+
+// Format of each line of the cache file:
+//   <output filename>\t<inputs hash>\t<outputs hash>
+typedef std::map<std::string, std::pair<std::string, std::string> > ExportCache;
+
+void load_export_cache(const std::string& filename, ExportCache& cache)
+{
+  std::ifstream f(FSTREAM_PATH(filename));
+  std::string line;
+  while (std::getline(f, line)) {
+    std::size_t i = line.find('\t');
+    std::size_t j = (i != std::string::npos ? line.find('\t', i+1): i);
+    if (j == std::string::npos)
+      continue;
+
+    cache[line.substr(0, i)] =
+      std::make_pair(line.substr(i+1, j-i-1), line.substr(j+1));
+  }
+}
+
+void save_export_cache(const std::string& filename, const ExportCache& cache)
+{
+  std::ofstream f(FSTREAM_PATH(filename));
+  for (const auto& entry : cache)
+    f << entry.first << '\t'
+      << entry.second.first << '\t'
+      << entry.second.second << '\n';
+}
+
+std::string sha1_string(const std::string& str)
+{
+  return base::convert_to<std::string>(base::Sha1::calculateFromString(str));
+}
+
+std::string sha1_file(const std::string& filename)
+{
+  if (filename.empty() || !base::is_file(filename))
+    return std::string();
+  return base::convert_to<std::string>(base::Sha1::calculateFromFile(filename));
+}
+
+// Content bounds of the cel images rendered by all exports (samples
+// are rendered from several threads at the same time)
+render::ContentCache content_cache;
+
+} // anonymous namespace
+
 class SampleBounds {
 public:
   SampleBounds(Sprite* sprite) :
@@ -74,6 +137,42 @@ private:
 
 typedef base::SharedPtr<SampleBounds> SampleBoundsPtr;
 
+// FNV-1a hash of the pixels of a rendered sample, used to find
+// identical samples. The bounds (and the palette of indexed images)
+// are part of the hash because identical samples share their bounds.
+static uint64_t hash_sample(const Sprite* sprite, frame_t frame,
+                            const Image* image, const gfx::Rect& bounds)
+{
+  uint64_t hash = 14695981039346656037ull;
+  auto add = [&hash](const void* data, std::size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (const uint8_t* end=p+size; p != end; ++p) {
+      hash ^= *p;
+      hash *= 1099511628211ull;
+    }
+  };
+
+  int values[] = {
+    int(image->pixelFormat()), int(sprite->transparentColor()),
+    image->width(), image->height(),
+    bounds.x, bounds.y, bounds.w, bounds.h };
+  add(values, sizeof(values));
+
+  if (image->pixelFormat() == IMAGE_INDEXED) {
+    const Palette* palette = sprite->palette(frame);
+    for (int i=0; i<palette->size(); ++i) {
+      color_t c = palette->getEntry(i);
+      add(&c, sizeof(c));
+    }
+  }
+
+  int rowSize = image->getRowStrideSize(bounds.w);
+  for (int y=bounds.y; y<bounds.y2(); ++y)
+    add(image->getPixelAddress(bounds.x, y), rowSize);
+
+  return hash;
+}
+
 class DocumentExporter::Sample {
 public:
   Sample(Document* document, Sprite* sprite, Layer* layer,
@@ -110,6 +209,7 @@ public:
 
   void setTrimmedBounds(const gfx::Rect& bounds) { m_bounds->setTrimmedBounds(bounds); }
   void setInTextureBounds(const gfx::Rect& bounds) { m_bounds->setInTextureBounds(bounds); }
+  void setInnerPadding(int padding) { m_innerPadding = padding; }
 
   bool isDuplicated() const { return m_isDuplicated; }
   SampleBoundsPtr sharedBounds() const { return m_bounds; }
@@ -153,6 +253,37 @@ private:
   List m_samples;
 };
 
+// Rendered frames of the samples kept between exports (while the
+// documents aren't modified). Each sample can be rendered in several
+// pixel formats/background colors (e.g. to calculate its bounds and
+// to blit it in the texture).
+class DocumentExporter::SampleRenders {
+public:
+  SampleRenders(const std::string& version) : m_version(version) {
+  }
+
+  const std::string& version() const { return m_version; }
+
+  ImageRef find(const Sample& sample, PixelFormat pixelFormat, color_t bgColor) const {
+    auto it = m_renders.find(key(sample, pixelFormat, bgColor));
+    return (it != m_renders.end() ? it->second: ImageRef());
+  }
+
+  void add(const Sample& sample, color_t bgColor, const ImageRef& image) {
+    m_renders[key(sample, image->pixelFormat(), bgColor)] = image;
+  }
+
+private:
+  typedef std::tuple<Sprite*, Layer*, frame_t, PixelFormat, color_t> Key;
+
+  static Key key(const Sample& sample, PixelFormat pixelFormat, color_t bgColor) {
+    return Key(sample.sprite(), sample.layer(), sample.frame(), pixelFormat, bgColor);
+  }
+
+  std::string m_version;
+  std::map<Key, ImageRef> m_renders;
+};
+
 class DocumentExporter::LayoutSamples {
 public:
   virtual ~LayoutSamples() { }
@@ -233,8 +364,8 @@ public:
 
     auto it = samples.begin();
     for (auto& rc : pr) {
-      if (it->isDuplicated())
-        continue;
+      while (it != samples.end() && it->isDuplicated())
+        ++it;
 
       ASSERT(it != samples.end());
       it->setInTextureBounds(rc);
@@ -245,6 +376,7 @@ public:
 
 DocumentExporter::DocumentExporter()
  : m_dataFormat(DefaultDataFormat)
+ , m_dataStream(NULL)
  , m_textureFormat(DefaultTextureFormat)
  , m_textureWidth(0)
  , m_textureHeight(0)
@@ -256,15 +388,44 @@ DocumentExporter::DocumentExporter()
  , m_shapePadding(0)
  , m_innerPadding(0)
  , m_trimCels(false)
+ , m_streamTexture(false)
+ , m_cacheSamples(false)
+{
+}
+
+DocumentExporter::~DocumentExporter()
 {
 }
 
 Document* DocumentExporter::exportSheet()
 {
+  // Check if the sheet was already exported with the same inputs (and
+  // then skip this export)
+  std::string inputsHash;
+  ExportCache cache;
+  const std::string& cacheKey =
+    (!m_textureFilename.empty() ? m_textureFilename: m_dataFilename);
+  if (!m_cacheFilename.empty() && !m_dataStream && !m_dataFilename.empty()) {
+    inputsHash = calculateInputsHash();
+    if (!inputsHash.empty()) {
+      load_export_cache(m_cacheFilename, cache);
+
+      auto it = cache.find(cacheKey);
+      if (it != cache.end() &&
+          it->second.first == inputsHash &&
+          it->second.second == calculateOutputsHash()) {
+        PRINTF("Sprite sheet \"%s\" is up to date\n", cacheKey.c_str());
+        return nullptr;
+      }
+    }
+  }
+
   // We output the metadata to std::cout if the user didn't specify a file.
   std::ofstream fos;
   std::streambuf* osbuf;
-  if (m_dataFilename.empty())
+  if (m_dataStream)
+    osbuf = m_dataStream->rdbuf();
+  else if (m_dataFilename.empty())
     osbuf = std::cout.rdbuf();
   else {
     fos.open(FSTREAM_PATH(m_dataFilename), std::ios::out);
@@ -274,52 +435,185 @@ Document* DocumentExporter::exportSheet()
 
   // Steps for sheet construction:
   // 1) Capture the samples (each sprite+frame pair)
-  Samples samples;
-  captureSamples(samples);
+  Samples capturedSamples;
+  if (!m_cacheSamples)
+    captureSamples(capturedSamples);
+  Samples& samples = (m_cacheSamples ? keptSamples(): capturedSamples);
   if (samples.empty()) {
     Console console;
     console.printf("No documents to export");
     return nullptr;
   }
 
-  // 2) Layout those samples in a texture field.
+  // 2) Layout those samples in a texture field (the calculated size
+  // isn't saved in m_texture* fields so the same exporter can export
+  // the sheet again with other options).
+  int textureWidth = m_textureWidth;
+  int textureHeight = m_textureHeight;
   if (m_texturePack) {
     BestFitLayoutSamples layout;
     layout.layoutSamples(samples,
-      m_borderPadding, m_shapePadding, m_textureWidth, m_textureHeight);
+      m_borderPadding, m_shapePadding, textureWidth, textureHeight);
   }
   else {
     SimpleLayoutSamples layout;
     layout.layoutSamples(samples,
-      m_borderPadding, m_shapePadding, m_textureWidth, m_textureHeight);
+      m_borderPadding, m_shapePadding, textureWidth, textureHeight);
   }
 
-  // 3) Create and render the texture.
+  // 3) Create and render the texture (a streamed texture is rendered
+  // when it's saved).
+#ifdef ENABLE_SAVE
+  const bool stream =
+    (m_streamTexture && !m_textureFilename.empty() &&
+     base::string_to_lower(base::get_file_extension(m_textureFilename)) == "png");
+#else
+  const bool stream = false;
+#endif
+
   base::UniquePtr<Document> textureDocument(
-    createEmptyTexture(samples));
+    createEmptyTexture(samples, gfx::Size(textureWidth, textureHeight), !stream));
 
   Sprite* texture = textureDocument->sprite();
-  Image* textureImage = texture->folder()->getFirstLayer()
-    ->cel(frame_t(0))->image();
+  if (!stream) {
+    Image* textureImage = texture->folder()->getFirstLayer()
+      ->cel(frame_t(0))->image();
 
-  renderTexture(samples, textureImage);
+    renderTexture(samples, textureImage);
+  }
 
   // Save the metadata.
-  createDataFile(samples, os, textureImage);
+  createDataFile(samples, os, texture);
 
   // Save the image files.
   if (!m_textureFilename.empty()) {
     textureDocument->setFilename(m_textureFilename.c_str());
-    int ret = save_document(UIContext::instance(), textureDocument.get());
-    if (ret == 0)
-      textureDocument->markAsSaved();
+    if (m_textureFormatOptions)
+      textureDocument->setFormatOptions(m_textureFormatOptions);
+
+    if (stream) {
+      if (saveTextureByBands(samples, texture))
+        textureDocument->markAsSaved();
+      else {
+        Console console;
+        console.printf("Error saving the texture \"%s\"\n", m_textureFilename.c_str());
+      }
+    }
+    else {
+      int ret = save_document(UIContext::instance(), textureDocument.get());
+      if (ret == 0)
+        textureDocument->markAsSaved();
+    }
+  }
+
+  // Save the hashes of this export
+  if (!inputsHash.empty()) {
+    fos.close();
+    cache[cacheKey] = std::make_pair(inputsHash, calculateOutputsHash());
+    save_export_cache(m_cacheFilename, cache);
   }
 
   return textureDocument.release();
 }
 
+// Calculates a hash of the contents of the files of the documents
+// and the options of the export. Returns an empty string if some
+// document isn't saved in a file (so the export cannot be cached).
+std::string DocumentExporter::calculateInputsHash() const
+{
+  std::ostringstream inputs;
+  inputs << VERSION << '\n'
+         << m_dataFormat << ' '
+         << m_dataFilename << '\n'
+         << m_textureFormat << ' '
+         << m_textureFilename << '\n'
+         << m_textureWidth << ' '
+         << m_textureHeight << ' '
+         << m_texturePack << ' '
+         << m_scale << ' '
+         << m_scaleMode << ' '
+         << m_ignoreEmptyCels << ' '
+         << m_borderPadding << ' '
+         << m_shapePadding << ' '
+         << m_innerPadding << ' '
+         << m_trimCels << '\n'
+         << m_filenameFormat << '\n';
+
+  for (const auto& item : m_documents) {
+    if (!item.doc->isAssociatedToFile() || item.doc->isModified())
+      return std::string();
+
+    std::string fileHash = sha1_file(item.doc->filename());
+    if (fileHash.empty())
+      return std::string();
+
+    inputs << item.doc->filename() << ' ' << fileHash << ' '
+           << (item.layer ? item.layer->name(): "") << '\n';
+  }
+
+  return sha1_string(inputs.str());
+}
+
+// Returns the samples kept from previous exports, capturing them
+// again only if the documents or the options used to capture them
+// were changed.
+DocumentExporter::Samples& DocumentExporter::keptSamples()
+{
+  std::string version = calculateDocumentsVersion();
+  if (!m_renders || m_renders->version() != version) {
+    m_renders.reset(new SampleRenders(version));
+    m_samples.reset();
+  }
+
+  std::ostringstream key;
+  key << m_ignoreEmptyCels << ' '
+      << m_trimCels << ' '
+      << m_filenameFormat;
+
+  if (!m_samples || m_samplesKey != key.str()) {
+    m_samples.reset(new Samples);
+    m_samplesKey = key.str();
+    captureSamples(*m_samples);
+  }
+
+  for (auto& sample : *m_samples)
+    sample.setInnerPadding(m_innerPadding);
+
+  return *m_samples;
+}
+
+// The last executed command and the modified bytes of their undo
+// history change each time a document is modified (or undone/redone).
+std::string DocumentExporter::calculateDocumentsVersion() const
+{
+  std::ostringstream version;
+  for (const auto& item : m_documents) {
+    const DocumentUndo* undo = item.doc->undoHistory();
+    version << item.doc << ' '
+            << item.layer << ' '
+            << undo->lastExecutedCmd() << ' '
+            << undo->modifiedBytes() << '\n';
+  }
+  return version.str();
+}
+
+// Hash of the output files (to know if they were modified or
+// removed after the last export)
+std::string DocumentExporter::calculateOutputsHash() const
+{
+  return sha1_string(sha1_file(m_textureFilename) + " " +
+                     sha1_file(m_dataFilename));
+}
+
 void DocumentExporter::captureSamples(Samples& samples)
 {
+  // All samples are collected first, then the ones that must be
+  // rendered to calculate their bounds are rendered in parallel.
+  std::vector<Sample> candidates;
+  std::vector<int> originals;   // Index of the original sample of a linked cel (or -1)
+  std::vector<int> toRender;
+  std::map<std::tuple<Sprite*, Layer*, frame_t>, int> originalsMap;
+
   for (auto& item : m_documents) {
     Document* doc = item.doc;
     Sprite* sprite = doc->sprite();
@@ -356,7 +650,7 @@ void DocumentExporter::captureSamples(Samples& samples)
       Sample sample(doc, sprite, layer, frame, filename, m_innerPadding);
       Cel* cel = nullptr;
       Cel* link = nullptr;
-      bool done = false;
+      int original = -1;
 
       if (layer && layer->isImage())
         cel = layer->cel(frame);
@@ -366,34 +660,84 @@ void DocumentExporter::captureSamples(Samples& samples)
 
       // Re-use linked samples
       if (link) {
-        for (const Sample& other : samples) {
-          if (other.sprite() == sprite &&
-              other.layer() == layer &&
-              other.frame() == link->frame()) {
-            ASSERT(!other.isDuplicated());
-
-            sample.setSharedBounds(other.sharedBounds());
-            done = true;
-            break;
-          }
+        auto it = originalsMap.find(std::make_tuple(sprite, layer, link->frame()));
+        if (it != originalsMap.end())
+          original = it->second;
+        ASSERT(original >= 0);
+      }
+
+      if (original < 0) {
+        if (m_ignoreEmptyCels || m_trimCels) {
+          // Ignore empty cels
+          if (layer && layer->isImage() && !cel)
+            continue;
+
+          toRender.push_back(int(candidates.size()));
         }
-        ASSERT(done);
+
+        originalsMap[std::make_tuple(sprite, layer, frame)] = int(candidates.size());
       }
 
-      if (!done && (m_ignoreEmptyCels || m_trimCels)) {
-        // Ignore empty cels
-        if (layer && layer->isImage() && !cel)
-          continue;
+      candidates.push_back(sample);
+      originals.push_back(original);
+    }
+  }
+
+  // Render samples to calculate their bounds. They are rendered in
+  // groups, each one in its own buffer, to limit the used memory
+  // (or in images that are kept to be re-used in next exports).
+  std::vector<ImageRef> renders(candidates.size());
+  if (m_cacheSamples) {
+    for (int i : toRender) {
+      const Sample& sample = candidates[i];
+      renders[i] = m_renders->find(sample, sample.sprite()->pixelFormat(),
+                                   sample.sprite()->transparentColor());
+    }
+  }
 
-        base::UniquePtr<Image> sampleRender(
-          Image::create(sprite->pixelFormat(),
-            sprite->width(),
-            sprite->height(),
-            m_sampleRenderBuf));
+  std::vector<bool> empty(candidates.size(), false);
+  std::vector<bool> hashed(candidates.size(), false);
+  std::vector<uint64_t> hashes(candidates.size(), 0);
+  base::thread_pool& pool = base::thread_pool::global();
+  const int groupSize = pool.workers()+1;
+
+  for (int first=0; first<int(toRender.size()); first+=groupSize) {
+    int n = std::min(groupSize, int(toRender.size())-first);
+
+    // std::vector<bool> elements cannot be written concurrently
+    std::vector<char> groupEmpty(n, 0);
+
+    pool.parallel_for(
+      n, [&, first](int j) {
+        const int i = toRender[first+j];
+        Sample& sample = candidates[i];
+        Sprite* sprite = sample.sprite();
+        Layer* layer = sample.layer();
+
+        base::UniquePtr<Image> tmpRender;
+        Image* sampleRender = renders[i].get();
+        if (!sampleRender) {
+          if (m_cacheSamples) {
+            renders[i].reset(
+              Image::create(sprite->pixelFormat(),
+                sprite->width(),
+                sprite->height()));
+            sampleRender = renders[i].get();
+          }
+          else {
+            tmpRender.reset(
+              Image::create(sprite->pixelFormat(),
+                sprite->width(),
+                sprite->height(),
+                ImageBufferRecycler::global().getForImage(
+                  sprite->pixelFormat(), sprite->width(), sprite->height())));
+            sampleRender = tmpRender.get();
+          }
 
-        sampleRender->setMaskColor(sprite->transparentColor());
-        clear_image(sampleRender, sprite->transparentColor());
-        renderSample(sample, sampleRender, 0, 0);
+          sampleRender->setMaskColor(sprite->transparentColor());
+          clear_image(sampleRender, sprite->transparentColor());
+          renderSample(sample, sampleRender, gfx::Clip(0, 0, sample.trimmedBounds()));
+        }
 
         gfx::Rect frameBounds;
         doc::color_t refColor = 0;
@@ -416,23 +760,59 @@ void DocumentExporter::captureSamples(Samples& samples)
         if (!algorithm::shrink_bounds(sampleRender, frameBounds, refColor)) {
           // If shrink_bounds() returns false, it's because the whole
           // image is transparent (equal to the mask color).
-          continue;
+          groupEmpty[j] = 1;
+          return;
         }
 
         if (m_trimCels)
           sample.setTrimmedBounds(frameBounds);
-      }
 
-      samples.addSample(sample);
+        hashes[toRender[first+j]] =
+          hash_sample(sprite, sample.frame(), sampleRender,
+                      m_trimCels ? frameBounds: sampleRender->bounds());
+      });
+
+    for (int j=0; j<n; ++j) {
+      empty[toRender[first+j]] = (groupEmpty[j] != 0);
+      hashed[toRender[first+j]] = (groupEmpty[j] == 0);
     }
   }
+
+  if (m_cacheSamples) {
+    for (int i : toRender)
+      m_renders->add(candidates[i], candidates[i].sprite()->transparentColor(), renders[i]);
+  }
+
+  // Add the samples in the same order they were collected. Linked
+  // cels share the bounds of the original cel (and they are empty if
+  // the original is empty), and samples with identical pixels share
+  // the bounds of the first one.
+  std::unordered_map<uint64_t, int> uniqueSamples;
+  for (int i=0; i<int(candidates.size()); ++i) {
+    if (originals[i] >= 0) {
+      empty[i] = empty[originals[i]];
+      candidates[i].setSharedBounds(candidates[originals[i]].sharedBounds());
+    }
+    else if (hashed[i]) {
+      auto it = uniqueSamples.find(hashes[i]);
+      if (it != uniqueSamples.end())
+        candidates[i].setSharedBounds(candidates[it->second].sharedBounds());
+      else
+        uniqueSamples[hashes[i]] = i;
+    }
+
+    if (!empty[i])
+      samples.addSample(candidates[i]);
+  }
 }
 
-Document* DocumentExporter::createEmptyTexture(const Samples& samples)
+// Creates the document of the texture. Without image, the texture
+// layer doesn't have a cel (its pixels are rendered only to be saved).
+Document* DocumentExporter::createEmptyTexture(const Samples& samples, const gfx::Size& textureSize, bool withImage)
 {
   Palette* palette = NULL;
   PixelFormat pixelFormat = IMAGE_INDEXED;
-  gfx::Rect fullTextureBounds(0, 0, m_textureWidth, m_textureHeight);
+  gfx::Rect fullTextureBounds(gfx::Point(0, 0), textureSize);
   int maxColors = 256;
 
   for (Samples::const_iterator
@@ -460,8 +840,19 @@ Document* DocumentExporter::createEmptyTexture(const Samples& samples)
       gfx::Rect(it->inTextureBounds()).inflate(m_borderPadding);
   }
 
-  base::UniquePtr<Sprite> sprite(Sprite::createBasicSprite(
-      pixelFormat, fullTextureBounds.w, fullTextureBounds.h, maxColors));
+  base::UniquePtr<Sprite> sprite;
+  if (withImage)
+    sprite.reset(Sprite::createBasicSprite(
+        pixelFormat, fullTextureBounds.w, fullTextureBounds.h, maxColors));
+  else {
+    sprite.reset(new Sprite(
+        pixelFormat, fullTextureBounds.w, fullTextureBounds.h, maxColors));
+    sprite->setTotalFrames(frame_t(1));
+
+    LayerImage* layer = new LayerImage(sprite);
+    layer->setName("Layer 1");
+    sprite->folder()->addLayer(layer);
+  }
 
   if (palette != NULL)
     sprite->setPalette(palette, false);
@@ -472,30 +863,129 @@ Document* DocumentExporter::createEmptyTexture(const Samples& samples)
   return document.release();
 }
 
-void DocumentExporter::renderTexture(const Samples& samples, Image* textureImage)
+// Returns the samples that must be rendered in the texture (without
+// duplicates) converting their sprites to the texture pixel format.
+void DocumentExporter::prepareSamples(const Samples& samples, PixelFormat pixelFormat,
+                                      std::vector<const Sample*>& toRender)
 {
-  textureImage->clear(0);
-
   for (const auto& sample : samples) {
     if (sample.isDuplicated())
       continue;
 
     // Make the sprite compatible with the texture so the render()
     // works correctly.
-    if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
+    if (sample.sprite()->pixelFormat() != pixelFormat) {
       cmd::SetPixelFormat(
         sample.sprite(),
-        textureImage->pixelFormat(),
+        pixelFormat,
         DitheringMethod::NONE).execute(UIContext::instance());
     }
 
-    renderSample(sample, textureImage,
-      sample.inTextureBounds().x+m_innerPadding,
-      sample.inTextureBounds().y+m_innerPadding);
+    toRender.push_back(&sample);
+  }
+}
+
+void DocumentExporter::renderTexture(const Samples& samples, Image* textureImage)
+{
+  textureImage->clear(0);
+
+  std::vector<const Sample*> toRender;
+  prepareSamples(samples, textureImage->pixelFormat(), toRender);
+
+  // Kept samples are blitted from their rendered frames (the missing
+  // frames are rendered first, over the same background as the
+  // texture, so the result is the same as rendering them directly).
+  std::vector<ImageRef> renders;
+  if (m_cacheSamples) {
+    const PixelFormat pixelFormat = textureImage->pixelFormat();
+    std::vector<int> missing;
+
+    renders.resize(toRender.size());
+    for (int i=0; i<int(toRender.size()); ++i) {
+      const Sample& sample = *toRender[i];
+      renders[i] = m_renders->find(sample, pixelFormat, 0);
+      if (!renders[i]) {
+        renders[i].reset(
+          Image::create(pixelFormat,
+            sample.sprite()->width(),
+            sample.sprite()->height()));
+        missing.push_back(i);
+      }
+    }
+
+    base::thread_pool::global().parallel_for(
+      int(missing.size()), [&](int j) {
+        Image* image = renders[missing[j]].get();
+        image->clear(0);
+        renderSample(*toRender[missing[j]], image, gfx::Clip(image->bounds()));
+      });
+
+    for (int i : missing)
+      m_renders->add(*toRender[i], 0, renders[i]);
+  }
+
+  // Each sample is rendered in its own area of the texture, so they
+  // can be rendered in parallel.
+  base::thread_pool::global().parallel_for(
+    int(toRender.size()), [&](int i) {
+      const Sample& sample = *toRender[i];
+      gfx::Clip clip(sample.inTextureBounds().x+m_innerPadding,
+                     sample.inTextureBounds().y+m_innerPadding,
+                     sample.trimmedBounds());
+      if (m_cacheSamples)
+        textureImage->copy(renders[i].get(), clip);
+      else
+        renderSample(sample, textureImage, clip);
+    });
+}
+
+// Renders the texture band by band in the PNG encoder. Each band
+// contains only the rows of the samples that intersect it.
+bool DocumentExporter::saveTextureByBands(const Samples& samples, const Sprite* texture)
+{
+#ifdef ENABLE_SAVE
+  std::vector<const Sample*> toRender;
+  prepareSamples(samples, texture->pixelFormat(), toRender);
+
+  PngOptions defaultOptions;
+  const PngOptions* options = dynamic_cast<PngOptions*>(m_textureFormatOptions.get());
+  if (!options)
+    options = &defaultOptions;
+
+  try {
+    return save_png_by_bands(
+      m_textureFilename, texture, *options,
+      [this, &toRender](Image* band, int y) {
+        std::vector<gfx::Clip> clips;
+        std::vector<const Sample*> inBand;
+        for (const Sample* sample : toRender) {
+          const gfx::Rect src = sample->trimmedBounds();
+          const int x = sample->inTextureBounds().x+m_innerPadding;
+          const int top = sample->inTextureBounds().y+m_innerPadding;
+          const int y1 = std::max(top, y);
+          const int y2 = std::min(top+src.h, y+band->height());
+          if (y1 < y2) {
+            clips.push_back(gfx::Clip(x, y1-y,
+                                      gfx::Rect(src.x, src.y+y1-top, src.w, y2-y1)));
+            inBand.push_back(sample);
+          }
+        }
+
+        base::thread_pool::global().parallel_for(
+          int(inBand.size()), [&](int i) {
+            renderSample(*inBand[i], band, clips[i]);
+          });
+      });
   }
+  catch (const std::exception&) {
+    return false;
+  }
+#else
+  return false;
+#endif
 }
 
-void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os, Image* textureImage)
+void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os, const Sprite* texture)
 {
   std::string frames_begin;
   std::string frames_end;
@@ -563,19 +1053,19 @@ void DocumentExporter::createDataFile(const Samples& samples, std::ostream& os,
      << "  \"version\": \"" << VERSION << "\",\n";
   if (!m_textureFilename.empty())
     os << "  \"image\": \"" << m_textureFilename.c_str() << "\",\n";
-  os << "  \"format\": \"" << (textureImage->pixelFormat() == IMAGE_RGB ? "RGBA8888": "I8") << "\",\n"
+  os << "  \"format\": \"" << (texture->pixelFormat() == IMAGE_RGB ? "RGBA8888": "I8") << "\",\n"
      << "  \"size\": { "
-     << "\"w\": " << textureImage->width() << ", "
-     << "\"h\": " << textureImage->height() << " },\n"
+     << "\"w\": " << texture->width() << ", "
+     << "\"h\": " << texture->height() << " },\n"
      << "  \"scale\": \"" << m_scale << "\"\n"
      << " }\n"
      << "}\n";
 }
 
-void DocumentExporter::renderSample(const Sample& sample, doc::Image* dst, int x, int y)
+void DocumentExporter::renderSample(const Sample& sample, doc::Image* dst, const gfx::Clip& clip)
 {
   render::Render render;
-  gfx::Clip clip(x, y, sample.trimmedBounds());
+  render.setContentCache(&content_cache);
 
   if (sample.layer()) {
     render.renderLayer(dst, sample.layer(), sample.frame(), clip);
@@ -9,8 +9,11 @@
 #define APP_DOCUMENT_EXPORTER_H_INCLUDED
 #pragma once
 
+#include "app/file/format_options.h"
 #include "base/disable_copying.h"
-#include "doc/image_buffer.h"
+#include "base/shared_ptr.h"
+#include "base/unique_ptr.h"
+#include "doc/pixel_format.h"
 #include "gfx/fwd.h"
 
 #include <iosfwd>
@@ -20,6 +23,11 @@
 namespace doc {
   class Image;
   class Layer;
+  class Sprite;
+}
+
+namespace gfx {
+  class Clip;
 }
 
 namespace app {
@@ -43,9 +51,12 @@ namespace app {
     };
 
     DocumentExporter();
+    ~DocumentExporter();
 
     void setDataFormat(DataFormat format) { m_dataFormat = format; }
     void setDataFilename(const std::string& filename) { m_dataFilename = filename; }
+    // The metadata is written in the given stream (instead of a file)
+    void setDataStream(std::ostream* os) { m_dataStream = os; }
     void setTextureFormat(TextureFormat format) { m_textureFormat = format; }
     void setTextureFilename(const std::string& filename) { m_textureFilename = filename; }
     void setTextureWidth(int width) { m_textureWidth = width; }
@@ -60,6 +71,27 @@ namespace app {
     void setTrimCels(bool trim) { m_trimCels = trim; }
     void setFilenameFormat(const std::string& format) { m_filenameFormat = format; }
 
+    // File where the hashes of the inputs and outputs of each export
+    // are kept. If the documents (their files) and the options didn't
+    // change since the last export, and the output files weren't
+    // modified, exportSheet() doesn't export anything (and returns
+    // NULL). It's used only if the data is saved in a file.
+    void setCacheFilename(const std::string& filename) { m_cacheFilename = filename; }
+    void setTextureFormatOptions(const base::SharedPtr<FormatOptions>& options) { m_textureFormatOptions = options; }
+
+    // Renders and saves the texture band by band (only for .png
+    // files), so the whole texture is never in memory. The document
+    // returned by exportSheet() doesn't have the texture pixels then.
+    void setStreamTexture(bool state) { m_streamTexture = state; }
+
+    // Keeps the captured samples and their rendered pixels between
+    // calls to exportSheet() (e.g. to preview the sheet while its
+    // options are changed). If the documents weren't modified, layout
+    // options (texture size/pack and paddings) only pack and blit the
+    // samples again, and the trim/empty cels options calculate the
+    // bounds of the samples from the kept pixels.
+    void setCacheSamples(bool state) { m_cacheSamples = state; }
+
     void addDocument(Document* document, doc::Layer* layer = NULL) {
       m_documents.push_back(Item(document, layer));
     }
@@ -72,12 +104,20 @@ namespace app {
     class LayoutSamples;
     class SimpleLayoutSamples;
     class BestFitLayoutSamples;
+    class SampleRenders;
 
+    Samples& keptSamples();
+    std::string calculateDocumentsVersion() const;
     void captureSamples(Samples& samples);
-    Document* createEmptyTexture(const Samples& samples);
+    Document* createEmptyTexture(const Samples& samples, const gfx::Size& textureSize, bool withImage);
+    void prepareSamples(const Samples& samples, doc::PixelFormat pixelFormat,
+                        std::vector<const Sample*>& toRender);
     void renderTexture(const Samples& samples, doc::Image* textureImage);
-    void createDataFile(const Samples& samples, std::ostream& os, doc::Image* textureImage);
-    void renderSample(const Sample& sample, doc::Image* dst, int x, int y);
+    bool saveTextureByBands(const Samples& samples, const doc::Sprite* texture);
+    void createDataFile(const Samples& samples, std::ostream& os, const doc::Sprite* texture);
+    void renderSample(const Sample& sample, doc::Image* dst, const gfx::Clip& clip);
+    std::string calculateInputsHash() const;
+    std::string calculateOutputsHash() const;
 
     class Item {
     public:
@@ -91,6 +131,7 @@ namespace app {
 
     DataFormat m_dataFormat;
     std::string m_dataFilename;
+    std::ostream* m_dataStream;
     TextureFormat m_textureFormat;
     std::string m_textureFilename;
     int m_textureWidth;
@@ -105,7 +146,16 @@ namespace app {
     bool m_trimCels;
     Items m_documents;
     std::string m_filenameFormat;
-    doc::ImageBufferPtr m_sampleRenderBuf;
+    std::string m_cacheFilename;
+    base::SharedPtr<FormatOptions> m_textureFormatOptions;
+    bool m_streamTexture;
+    bool m_cacheSamples;
+
+    // Kept samples (and the options used to capture them) and
+    // rendered pixels when m_cacheSamples is true
+    base::UniquePtr<Samples> m_samples;
+    std::string m_samplesKey;
+    base::UniquePtr<SampleRenders> m_renders;
 
     DISABLE_COPYING(DocumentExporter);
   };
@@ -0,0 +1,131 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/test.h"
+
+#include "app/context.h"
+#include "app/document.h"
+#include "app/document_api.h"
+#include "app/document_exporter.h"
+#include "app/transaction.h"
+#include "base/unique_ptr.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/test_context.h"
+
+#include <sstream>
+
+using namespace app;
+using namespace doc;
+
+typedef base::UniquePtr<app::Document> DocumentPtr;
+
+namespace {
+
+  struct Options {
+    bool texturePack;
+    bool trimCels;
+    bool ignoreEmptyCels;
+    int width, height;
+    int borderPadding, shapePadding, innerPadding;
+  };
+
+  void set_options(DocumentExporter& exporter, const Options& options) {
+    exporter.setTexturePack(options.texturePack);
+    exporter.setTrimCels(options.trimCels);
+    exporter.setIgnoreEmptyCels(options.ignoreEmptyCels);
+    exporter.setTextureWidth(options.width);
+    exporter.setTextureHeight(options.height);
+    exporter.setBorderPadding(options.borderPadding);
+    exporter.setShapePadding(options.shapePadding);
+    exporter.setInnerPadding(options.innerPadding);
+  }
+
+  // Exports the sheet returning a copy of its texture and its data
+  Image* export_sheet(DocumentExporter& exporter, std::string& data) {
+    std::ostringstream os;
+    exporter.setDataStream(&os);
+
+    DocumentPtr sheet(exporter.exportSheet());
+    EXPECT_TRUE(sheet != NULL);
+    data = os.str();
+
+    return Image::createCopy(
+      sheet->sprite()->folder()->getFirstLayer()->cel(frame_t(0))->image());
+  }
+
+}
+
+TEST(DocumentExporter, CachedSamplesAreEqualToNewExports)
+{
+  TestContextT<app::Context> ctx;
+  DocumentPtr doc(static_cast<app::Document*>(ctx.documents().add(16, 8)));
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->folder()->getFirstLayer());
+
+  // Frames with a rectangle in different positions (the last frame
+  // is equal to the first one, and frame 2 is empty)
+  sprite->setTotalFrames(frame_t(5));
+  for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
+    if (frame == 2)
+      continue;
+
+    if (!layer->cel(frame)) {
+      ImageRef image(Image::create(IMAGE_RGB, 16, 8));
+      layer->addCel(new Cel(frame, image));
+    }
+
+    Image* image = layer->cel(frame)->image();
+    int i = (frame == 4 ? 0: frame);
+    clear_image(image, 0);
+    fill_rect(image, 2*i, i, 4*i+5, i+3, rgba(255, 32*i, 0, 255));
+  }
+
+  Options options[] = {
+    { false, false, false, 0, 0, 0, 0, 0 },
+    { false, false, false, 64, 0, 1, 2, 0 },
+    { false, true, false, 64, 0, 1, 2, 0 },
+    { false, true, false, 64, 0, 1, 2, 3 },
+    { true, true, false, 0, 0, 1, 2, 3 },
+    { true, false, true, 0, 0, 0, 0, 1 },
+    { false, false, true, 40, 0, 2, 0, 1 },
+    { false, false, false, 0, 0, 0, 0, 0 },
+  };
+
+  DocumentExporter cached;
+  cached.setCacheSamples(true);
+  cached.addDocument(doc);
+
+  for (int modified=0; modified<2; ++modified) {
+    // Modify the document to check that the kept samples are
+    // captured again
+    if (modified) {
+      Transaction transaction(&ctx, "Add Frame");
+      doc->getApi(transaction).addFrame(sprite, frame_t(1));
+      transaction.commit();
+    }
+
+    for (const Options& opts : options) {
+      DocumentExporter exporter;
+      exporter.addDocument(doc);
+      set_options(exporter, opts);
+      set_options(cached, opts);
+
+      std::string expectedData, data;
+      base::UniquePtr<Image> expected(export_sheet(exporter, expectedData));
+      base::UniquePtr<Image> result(export_sheet(cached, data));
+
+      ASSERT_EQ(expected->width(), result->width());
+      ASSERT_EQ(expected->height(), result->height());
+      EXPECT_EQ(0, count_diff_between_images(expected, result));
+      EXPECT_EQ(expectedData, data);
+    }
+  }
+}
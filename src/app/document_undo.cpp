@@ -15,20 +15,54 @@
 #include "app/cmd.h"
 #include "app/cmd_transaction.h"
 #include "app/pref/preferences.h"
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
 #include "doc/context.h"
 #include "undo/undo_history.h"
 #include "undo/undo_state.h"
 
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
+#include <vector>
 
 namespace app {
 
+namespace {
+
+// All DocumentUndo instances to enforce the global memory limit
+// (documents can be created in other threads, e.g. when a file is
+// opened)
+base::mutex undos_mutex;
+std::vector<DocumentUndo*> undos;
+
+} // anonymous namespace
+
 DocumentUndo::DocumentUndo()
   : m_ctx(NULL)
   , m_savedCounter(0)
   , m_savedStateIsLost(false)
+  , m_memSize(0)
+  , m_modifiedBytes(0)
+{
+  base::scoped_lock lock(undos_mutex);
+  undos.push_back(this);
+}
+
+DocumentUndo::~DocumentUndo()
 {
+  base::scoped_lock lock(undos_mutex);
+  undos.erase(std::find(undos.begin(), undos.end(), this));
+}
+
+// static
+size_t DocumentUndo::totalMemSize()
+{
+  base::scoped_lock lock(undos_mutex);
+  size_t size = 0;
+  for (const DocumentUndo* undo : undos)
+    size += undo->m_memSize;
+  return size;
 }
 
 void DocumentUndo::setContext(doc::Context* ctx)
@@ -43,10 +77,25 @@ void DocumentUndo::add(CmdTransaction* cmd)
   // A linear undo history is the default behavior
   if (!App::instance() ||
       !App::instance()->preferences().undo.allowNonlinearHistory()) {
-    m_undoHistory.clearRedo();
+    clearRedo();
   }
 
+  cmd->setMemSizeCounter(&m_memSize);
   m_undoHistory.add(cmd);
+  m_memSize += cmd->memSize();
+  m_modifiedBytes += cmd->memSize();
+
+  if (App::instance()) {
+    auto& undoPref = App::instance()->preferences().undo;
+
+    // Compress the undo information of old states
+    compressOldStates(undoPref.compressAfter());
+
+    // Keep in memory the newest undo states only (of this document
+    // and of all documents)
+    limitMemSize(size_t(undoPref.sizeLimit())*1024*1024);
+    limitTotalMemSize(size_t(undoPref.globalSizeLimit())*1024*1024);
+  }
 }
 
 bool DocumentUndo::canUndo() const
@@ -61,17 +110,31 @@ bool DocumentUndo::canRedo() const
 
 void DocumentUndo::undo()
 {
+  if (const undo::UndoState* state = nextUndo())
+    m_modifiedBytes += static_cast<Cmd*>(state->cmd())->memSize();
+
   return m_undoHistory.undo();
 }
 
 void DocumentUndo::redo()
 {
+  if (const undo::UndoState* state = nextRedo())
+    m_modifiedBytes += static_cast<Cmd*>(state->cmd())->memSize();
+
   return m_undoHistory.redo();
 }
 
 void DocumentUndo::clearRedo()
 {
-  return m_undoHistory.clearRedo();
+  // States after the current one are deleted
+  for (const undo::UndoState* state = m_undoHistory.lastState();
+       state && state != m_undoHistory.currentState();
+       state = state->prev()) {
+    m_memSize -= std::min(m_memSize,
+                          static_cast<Cmd*>(state->cmd())->memSize());
+  }
+
+  m_undoHistory.clearRedo();
 }
 
 bool DocumentUndo::isSavedState() const
@@ -85,6 +148,12 @@ void DocumentUndo::markSavedState()
   m_savedStateIsLost = false;
 }
 
+void DocumentUndo::markSavedState(int counter)
+{
+  m_savedCounter -= counter;
+  m_savedStateIsLost = false;
+}
+
 void DocumentUndo::impossibleToBackToSavedState()
 {
   m_savedStateIsLost = true;
@@ -137,6 +206,130 @@ Cmd* DocumentUndo::lastExecutedCmd() const
     return NULL;
 }
 
+// Swaps out the oldest states to keep in memory "memoryLimit" bytes
+// at most. It recalculates m_memSize too.
+void DocumentUndo::swapOutOldStates(size_t memoryLimit)
+{
+  size_t size = 0;
+  bool swap = true;
+
+  for (const undo::UndoState* state = m_undoHistory.lastState();
+       state; state = state->prev()) {
+    Cmd* cmd = static_cast<Cmd*>(state->cmd());
+    size += cmd->memSize();
+
+    if (swap && size > memoryLimit) {
+      try {
+        size -= cmd->swapOut(m_swapFile);
+      }
+      catch (const std::exception&) {
+        // Keep the undo information in memory
+        swap = false;
+      }
+    }
+  }
+
+  m_memSize = size;
+}
+
+void DocumentUndo::swapOutAllStates()
+{
+  swapOutOldStates(0);
+}
+
+// Swaps out old states, or deletes them if they cannot be swapped
+// out (e.g. the swap file cannot be written), until the undo
+// information in memory is less than "memoryLimit".
+void DocumentUndo::limitMemSize(size_t memoryLimit)
+{
+  if (m_memSize <= memoryLimit)
+    return;
+
+  swapOutOldStates(memoryLimit);
+
+  while (m_memSize > memoryLimit && deleteFirstState())
+    ;
+}
+
+// Deletes the oldest state of the history. The current state is not
+// deleted, so the last change can be undone.
+bool DocumentUndo::deleteFirstState()
+{
+  const undo::UndoState* first = m_undoHistory.firstState();
+  if (!first || first == m_undoHistory.currentState())
+    return false;
+
+  size_t size = static_cast<Cmd*>(first->cmd())->memSize();
+  if (!m_undoHistory.deleteFirstState())
+    return false;
+
+  m_memSize -= std::min(m_memSize, size);
+
+  // Check if we can go back to the saved state yet (the saved state
+  // is "m_savedCounter" undos from here)
+  int undoableStates = 0;
+  for (const undo::UndoState* state = m_undoHistory.currentState();
+       state; state = state->prev())
+    ++undoableStates;
+
+  if (m_savedCounter > undoableStates)
+    impossibleToBackToSavedState();
+
+  return true;
+}
+
+// Releases memory of the biggest undo histories first (deleting or
+// swapping out their oldest states) until the undo information of
+// all documents is less than "memoryLimit". Zero means no limit.
+// static
+void DocumentUndo::limitTotalMemSize(size_t memoryLimit)
+{
+  if (memoryLimit == 0)
+    return;
+
+  size_t total = totalMemSize();
+  if (total <= memoryLimit)
+    return;
+
+  std::vector<DocumentUndo*> sorted;
+  {
+    base::scoped_lock lock(undos_mutex);
+    sorted = undos;
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const DocumentUndo* a, const DocumentUndo* b) {
+              return a->m_memSize > b->m_memSize;
+            });
+
+  for (DocumentUndo* undo : sorted) {
+    size_t excess = total - memoryLimit;
+    size_t oldSize = undo->m_memSize;
+
+    undo->limitMemSize(oldSize > excess ? oldSize - excess: 0);
+
+    total = total - oldSize + undo->m_memSize;
+    if (total <= memoryLimit)
+      break;
+  }
+}
+
+// Compresses the states that are "steps" or more behind the current
+// state. Commands that were decompressed by an undo/redo are
+// compressed again when they are old enough (already compressed
+// commands do nothing in Cmd::compress()).
+void DocumentUndo::compressOldStates(int steps)
+{
+  if (steps <= 0)
+    return;
+
+  const undo::UndoState* state = m_undoHistory.currentState();
+  for (int i=0; state && i<steps; ++i)
+    state = state->prev();
+
+  for (; state; state = state->prev())
+    static_cast<Cmd*>(state->cmd())->compress();
+}
+
 const undo::UndoState* DocumentUndo::nextUndo() const
 {
   return m_undoHistory.currentState();
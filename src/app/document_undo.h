@@ -10,10 +10,12 @@
 #pragma once
 
 #include "base/disable_copying.h"
+#include "app/undo_swap_file.h"
 #include "base/unique_ptr.h"
 #include "doc/sprite_position.h"
 #include "undo/undo_history.h"
 
+#include <atomic>
 #include <string>
 
 namespace doc {
@@ -29,6 +31,7 @@ namespace app {
   class DocumentUndo {
   public:
     DocumentUndo();
+    ~DocumentUndo();
 
     void setContext(doc::Context* ctx);
 
@@ -43,6 +46,11 @@ namespace app {
 
     bool isSavedState() const;
     void markSavedState();
+
+    // Marks as saved the state that was the current one when
+    // savedCounter() was equal to "counter" (e.g. the state of a copy
+    // of the document saved in background while it was modified).
+    void markSavedState(int counter);
     void impossibleToBackToSavedState();
 
     std::string nextUndoLabel() const;
@@ -55,10 +63,36 @@ namespace app {
 
     int* savedCounter() { return &m_savedCounter; }
 
+    // Bytes of undo information in memory (swapped out data is not
+    // included).
+    size_t memSize() const { return m_memSize; }
+
+    // Running total of bytes modified in the document (the size of
+    // each executed, undone or redone transaction). It can be read
+    // from other threads to know how much has changed since a
+    // previous read (e.g. since the last backup).
+    size_t modifiedBytes() const { return m_modifiedBytes; }
+
+    // Bytes of undo information in memory of all documents.
+    static size_t totalMemSize();
+
+    // Swaps out all states that can be swapped out (e.g. when the
+    // document isn't used for a while). They are loaded again when
+    // they are undone/redone.
+    void swapOutAllStates();
+
   private:
     const undo::UndoState* nextUndo() const;
     const undo::UndoState* nextRedo() const;
-
+    void swapOutOldStates(size_t memoryLimit);
+    void compressOldStates(int steps);
+    void limitMemSize(size_t memoryLimit);
+    bool deleteFirstState();
+    static void limitTotalMemSize(size_t memoryLimit);
+
+    // Old undo information is saved here (it must be destroyed after
+    // the undo history, as commands reference it).
+    UndoSwapFile m_swapFile;
     undo::UndoHistory m_undoHistory;
     doc::Context* m_ctx;
 
@@ -73,6 +107,15 @@ namespace app {
     // way. E.g. If the save process fails.
     bool m_savedStateIsLost;
 
+    // Running total of memSize() of all undo states. It's updated
+    // when states are added/removed/undone/redone/swapped out, and
+    // recalculated when it's over the memory limit (as the memory
+    // of some states can be released in background, e.g. when they
+    // are compressed).
+    size_t m_memSize;
+
+    std::atomic<size_t> m_modifiedBytes;
+
     DISABLE_COPYING(DocumentUndo);
   };
 
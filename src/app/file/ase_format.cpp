@@ -10,19 +10,34 @@
 #endif
 
 #include "app/document.h"
+#include "app/file/ase_options.h"
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
 #include "base/cfile.h"
 #include "base/exception.h"
 #include "base/file_handle.h"
+#include "base/mapped_file.h"
+#include "base/thread_pool.h"
+#include "doc/cels_range.h"
 #include "doc/doc.h"
+#include "doc/image_loader.h"
 #include "zlib.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <stdio.h>
+#include <thread>
+#include <unordered_map>
 
 #define ASE_FILE_MAGIC                  0xA5E0
 #define ASE_FILE_FRAME_MAGIC            0xF1FA
+#define ASE_FILE_INDEX_MAGIC            0xF1DE
 
 #define ASE_FILE_CHUNK_FLI_COLOR2       4
 #define ASE_FILE_CHUNK_FLI_COLOR        11
@@ -31,10 +46,12 @@
 #define ASE_FILE_CHUNK_MASK             0x2016
 #define ASE_FILE_CHUNK_PATH             0x2017
 #define ASE_FILE_CHUNK_FRAME_TAGS       0x2018
+#define ASE_FILE_CHUNK_TILESET          0x2019
 
 #define ASE_FILE_RAW_CEL                0
 #define ASE_FILE_LINK_CEL               1
 #define ASE_FILE_COMPRESSED_CEL         2
+#define ASE_FILE_TILED_CEL              3
 
 namespace app {
 
@@ -56,6 +73,7 @@ struct ASE_Header {
   uint8_t transparent_index;
   uint8_t ignore[3];
   uint16_t ncolors;
+  uint32_t frame_index; // Position of the frame index (0 if there isn't one)
 };
 
 struct ASE_FrameHeader {
@@ -70,17 +88,40 @@ struct ASE_Chunk {
   int start;
 };
 
+// Positions of the chunks of a frame (see ase_file_write_frame_index)
+struct ASE_CelIndex {
+  uint16_t layer;
+  uint32_t pos;
+};
+
+struct ASE_FrameIndex {
+  uint32_t pos;                 // Frame header
+  uint32_t palette_pos;         // Color chunk used by this frame
+  std::vector<ASE_CelIndex> cels;
+
+  ASE_FrameIndex() : pos(0), palette_pos(0) { }
+};
+
+class CelDecoder;
+class CelEncoder;
+class TileDictionary;
+
 static bool ase_file_read_header(FILE* f, ASE_Header* header);
+static void ase_file_read_chunk(FILE* f, FileOp* fop, Sprite* sprite, frame_t frame, CelDecoder* decoder, Layer** last_layer, int* current_level, bool cels);
 static void ase_file_prepare_header(FILE* f, ASE_Header* header, const Sprite* sprite);
 static void ase_file_write_header(FILE* f, ASE_Header* header);
 static void ase_file_write_header_filesize(FILE* f, ASE_Header* header);
+static void ase_file_write_header_frame_index(FILE* f, ASE_Header* header);
+
+static bool ase_file_read_frame_index(FILE* f, ASE_Header* header, std::vector<ASE_FrameIndex>& index);
+static uint32_t ase_file_write_frame_index(FILE* f, const std::vector<ASE_FrameIndex>& index);
 
 static void ase_file_read_frame_header(FILE* f, ASE_FrameHeader* frame_header);
 static void ase_file_prepare_frame_header(FILE* f, ASE_FrameHeader* frame_header);
 static void ase_file_write_frame_header(FILE* f, ASE_FrameHeader* frame_header);
 
 static void ase_file_write_layers(FILE* f, ASE_FrameHeader* frame_header, Layer* layer);
-static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, frame_t frame);
+static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, frame_t frame, CelEncoder* encoder, ASE_FrameIndex* index);
 
 static void ase_file_read_padding(FILE* f, int bytes);
 static void ase_file_write_padding(FILE* f, int bytes);
@@ -95,14 +136,17 @@ static Palette* ase_file_read_color2_chunk(FILE* f, Sprite* sprite, frame_t fram
 static void ase_file_write_color2_chunk(FILE* f, ASE_FrameHeader* frame_header, Palette* pal);
 static Layer* ase_file_read_layer_chunk(FILE* f, Sprite* sprite, Layer** previous_layer, int* current_level);
 static void ase_file_write_layer_chunk(FILE* f, ASE_FrameHeader* frame_header, Layer* layer);
-static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame, PixelFormat pixelFormat, FileOp* fop, ASE_Header* header, size_t chunk_end);
-static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite);
+static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame, PixelFormat pixelFormat, FileOp* fop, CelDecoder* decoder, size_t chunk_end);
+static Cel* ase_file_read_indexed_cel(FILE* f, Sprite* sprite, frame_t frame, FileOp* fop, CelDecoder* decoder, const std::vector<ASE_FrameIndex>& index, const ASE_CelIndex& cel);
+static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite, CelEncoder* encoder);
 static Mask* ase_file_read_mask_chunk(FILE* f);
 #if 0
 static void ase_file_write_mask_chunk(FILE* f, ASE_FrameHeader* frame_header, Mask* mask);
 #endif
 static void ase_file_read_frame_tags_chunk(FILE* f, FrameTags* frameTags);
 static void ase_file_write_frame_tags_chunk(FILE* f, ASE_FrameHeader* frame_header, FrameTags* frameTags);
+static void ase_file_read_tileset_chunk(FILE* f, PixelFormat pixelFormat, CelDecoder* decoder, size_t chunk_end);
+static void ase_file_write_tileset_chunk(FILE* f, ASE_FrameHeader* frame_header, const TileDictionary* tiles);
 
 class ChunkWriter {
 public:
@@ -119,6 +163,164 @@ private:
   ASE_Chunk m_chunk;
 };
 
+// Compressed cels read from the file wait here to be inflated. The
+// file is read sequentially, and then the pending cels are inflated
+// in parallel (each one directly in its image) by the global thread
+// pool.
+class CelDecoder {
+public:
+  // Maximum size of compressed data that we keep in memory before
+  // inflating it.
+  static const size_t kMaxPendingBytes = 64*1024*1024;
+
+  CelDecoder(FileOp* fop, size_t fileSize)
+    : m_fop(fop)
+    , m_fileSize(fileSize)
+    , m_filePos(0)
+    , m_pendingBytes(0)
+    , m_decodedBytes(0)
+    , m_tileSize(0) {
+  }
+
+  // Adds the compressed pixels of the given image (the "compressed"
+  // vector is swapped, so it ends empty).
+  void add(const ImageRef& image, std::vector<uint8_t>& compressed) {
+    m_pendingBytes += compressed.size();
+
+    m_jobs.push_back(Job());
+    m_jobs.back().image = image;
+    m_jobs.back().compressed.swap(compressed);
+
+    if (m_pendingBytes >= kMaxPendingBytes)
+      flush();
+  }
+
+  // Inflates all pending cels. Errors are reported (in the same order
+  // of the file) when all cels are finished.
+  void flush();
+
+  // In lazy mode, compressed cels are decoded from the mapped file
+  // when they are needed (instead of using add()/flush()).
+  const base::SharedPtr<base::mapped_file>& mappedFile() const { return m_mappedFile; }
+  void setMappedFile(const base::SharedPtr<base::mapped_file>& file) { m_mappedFile = file; }
+
+  // Unique tiles of tiled cels (stacked vertically), read from the
+  // tileset chunk.
+  const Image* tileset() const { return m_tileset.get(); }
+  int tileSize() const { return m_tileSize; }
+  void setTileset(const ImageRef& tileset, int tileSize) {
+    m_tileset = tileset;
+    m_tileSize = tileSize;
+  }
+
+  // Reports the progress of the whole load process (reading the
+  // file + inflating cels).
+  void progress(size_t filePos) {
+    m_filePos = filePos;
+    if (m_fileSize > 0)
+      fop_progress(m_fop, 0.5 * double(filePos + m_decodedBytes) / double(m_fileSize));
+  }
+
+private:
+  struct Job {
+    ImageRef image;
+    std::vector<uint8_t> compressed;
+    std::string error;
+  };
+
+  FileOp* m_fop;
+  size_t m_fileSize;
+  size_t m_filePos;
+  size_t m_pendingBytes;
+  std::atomic<size_t> m_decodedBytes;
+  std::vector<Job> m_jobs;
+  base::SharedPtr<base::mapped_file> m_mappedFile;
+  ImageRef m_tileset;
+  int m_tileSize;
+};
+
+// Tiles of the cel images that are repeated in the sprite (e.g. tiled
+// backgrounds). Each unique tile is saved once in the tileset chunk,
+// and tiled cels contain only the index of each one of their tiles.
+// Only images with enough repeated tiles are saved as tiled cels.
+class TileDictionary {
+public:
+  TileDictionary(Sprite* sprite, int tileSize, int compressionLevel);
+
+  bool empty() const { return m_tileCount == 0; }
+  int tileSize() const { return m_tileSize; }
+  int tileCount() const { return m_tileCount; }
+  int compressionLevel() const { return m_compressionLevel; }
+
+  // All unique tiles stacked vertically (tile N is in y=N*tileSize).
+  const Image* tilesImage() const { return m_tilesImage.get(); }
+
+  // Returns the index of each tile of the image (row by row), or
+  // NULL if the image isn't saved as a tiled cel.
+  const std::vector<uint32_t>* tileIndexes(const Image* image) const {
+    auto it = m_indexes.find(image);
+    return (it != m_indexes.end() ? &it->second: NULL);
+  }
+
+private:
+  int m_tileSize;
+  int m_tileCount;
+  int m_compressionLevel;
+  UniquePtr<Image> m_tilesImage;
+  std::map<const Image*, std::vector<uint32_t> > m_indexes;
+};
+
+// Compresses the images of the cels in the global thread pool while
+// the file is written. Images are compressed in the same order that
+// they are written (so the file is the same as compressing them one
+// by one), and only a few images ahead of the current one are kept
+// in memory.
+class CelEncoder {
+public:
+  CelEncoder(Sprite* sprite, int compressionLevel,
+             const TileDictionary* tiles);
+  ~CelEncoder();
+
+  // Images saved as tiled cels aren't compressed by the encoder.
+  const TileDictionary* tiles() const { return m_tiles; }
+
+  // Writes the compressed pixels of the given image, which must be
+  // the next image to be written.
+  void write(FILE* f, const Image* image);
+
+private:
+  enum { Pending, Running, Done };
+
+  struct Job {
+    const Image* image;
+    int compressionLevel;
+    std::atomic<int> state;
+    std::vector<uint8_t> compressed;
+    std::string error;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    Job(const Image* image, int compressionLevel)
+      : image(image)
+      , compressionLevel(compressionLevel)
+      , state(Pending) {
+    }
+  };
+
+  typedef std::shared_ptr<Job> JobPtr;
+
+  void collectImages(Layer* layer, frame_t frame, int compressionLevel);
+  void schedule();
+  static void run(const JobPtr& job);
+  static void wait(const JobPtr& job);
+
+  const TileDictionary* m_tiles;
+  std::vector<JobPtr> m_jobs;
+  size_t m_next;                // Next image to be written
+  size_t m_scheduled;           // Images sent to the thread pool
+  size_t m_window;
+};
+
 class AseFormat : public FileFormat {
   const char* onGetName() const { return "ase"; }
   const char* onGetExtensions() const { return "ase,aseprite"; }
@@ -175,11 +377,40 @@ bool AseFormat::onLoad(FileOp* fop)
   Layer* last_layer = sprite->folder();
   int current_level = -1;
 
+  // Compressed cels are inflated in parallel
+  CelDecoder decoder(fop, header.size);
+
+  // Map the file to decode cels only when they are needed (a
+  // preview decodes only the cels that are rendered)
+  if (fop->lazycels || fop->preview_size > 0) {
+    try {
+      decoder.setMappedFile(base::SharedPtr<base::mapped_file>(
+                              new base::mapped_file(fop->filename)));
+    }
+    catch (const std::exception&) {
+      // Decode all cels now
+    }
+  }
+
+  // Files saved by new versions have the position of each frame and
+  // cel, so we can seek the frame to load directly
+  std::vector<ASE_FrameIndex> index;
+  if (header.frame_index > 0 &&
+      !ase_file_read_frame_index(f, &header, index))
+    index.clear();
+
+  // Load just one frame (the first one by default)
+  frame_t onlyFrame(-1);
+  if (fop->oneframe || fop->preview_size > 0)
+    onlyFrame = MID(frame_t(0), fop->preview_frame, sprite->lastFrame());
+  const bool seekFrame = (onlyFrame > 0 && !index.empty());
+
   /* read frame by frame to end-of-file */
   for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
     /* start frame position */
-    int frame_pos = ftell(f);
-    fop_progress(fop, (float)frame_pos / (float)header.size);
+    int frame_pos = (index.empty() ? ftell(f): index[frame].pos);
+    fseek(f, frame_pos, SEEK_SET);
+    decoder.progress(frame_pos);
 
     /* read frame header */
     ASE_FrameHeader frame_header;
@@ -191,81 +422,26 @@ bool AseFormat::onLoad(FileOp* fop)
       if (frame_header.duration > 0)
         sprite->setFrameDuration(frame, frame_header.duration);
 
-      // Read chunks
-      for (int c=0; c<frame_header.chunks; c++) {
-        /* start chunk position */
-        int chunk_pos = ftell(f);
-        fop_progress(fop, (float)chunk_pos / (float)header.size);
-
-        // Read chunk information
-        int chunk_size = fgetl(f);
-        int chunk_type = fgetw(f);
-
-        switch (chunk_type) {
-
-          /* only for 8 bpp images */
-          case ASE_FILE_CHUNK_FLI_COLOR:
-          case ASE_FILE_CHUNK_FLI_COLOR2: {
-            Palette* prev_pal = sprite->palette(frame);
-            Palette* pal =
-              chunk_type == ASE_FILE_CHUNK_FLI_COLOR ?
-              ase_file_read_color_chunk(f, sprite, frame):
-              ase_file_read_color2_chunk(f, sprite, frame);
-
-            if (prev_pal->countDiff(pal, NULL, NULL) > 0)
-              sprite->setPalette(pal, true);
-
-            delete pal;
-            break;
-          }
-
-          case ASE_FILE_CHUNK_LAYER: {
-            /* fop_error(fop, "Layer chunk\n"); */
-
-            ase_file_read_layer_chunk(f, sprite,
-                                      &last_layer,
-                                      &current_level);
-            break;
-          }
-
-          case ASE_FILE_CHUNK_CEL: {
-            /* fop_error(fop, "Cel chunk\n"); */
-
-            ase_file_read_cel_chunk(f, sprite, frame,
-                                    sprite->pixelFormat(), fop, &header,
-                                    chunk_pos+chunk_size);
-            break;
-          }
-
-          case ASE_FILE_CHUNK_MASK: {
-            Mask* mask;
-
-            /* fop_error(fop, "Mask chunk\n"); */
-
-            mask = ase_file_read_mask_chunk(f);
-            if (mask)
-              delete mask;      // TODO add the mask in some place?
-            else
-              fop_error(fop, "Warning: error loading a mask chunk\n");
-
-            break;
-          }
-
-          case ASE_FILE_CHUNK_PATH:
-            /* fop_error(fop, "Path chunk\n"); */
-            break;
-
-          case ASE_FILE_CHUNK_FRAME_TAGS:
-            ase_file_read_frame_tags_chunk(f, &sprite->frameTags());
-            break;
-
-          default:
-            fop_error(fop, "Warning: Unsupported chunk type %d (skipping)\n", chunk_type);
-            break;
+      // Read only the palette and cels of the frame to load (the
+      // first frame was read without cels)
+      if (seekFrame && frame == onlyFrame) {
+        if (index[frame].palette_pos > 0) {
+          fseek(f, index[frame].palette_pos, SEEK_SET);
+          ase_file_read_chunk(f, fop, sprite, frame, &decoder,
+                              &last_layer, &current_level, false);
         }
 
-        /* skip chunk size */
-        fseek(f, chunk_pos+chunk_size, SEEK_SET);
+        for (const ASE_CelIndex& cel : index[frame].cels)
+          ase_file_read_indexed_cel(f, sprite, frame, fop, &decoder, index, cel);
+      }
+      // Read chunks
+      else {
+        for (int c=0; c<frame_header.chunks; c++)
+          ase_file_read_chunk(f, fop, sprite, frame, &decoder,
+                              &last_layer, &current_level,
+                              // Cels of the first frame aren't needed
+                              // if we are going to seek other frame
+                              !seekFrame);
       }
     }
 
@@ -273,13 +449,21 @@ bool AseFormat::onLoad(FileOp* fop)
     fseek(f, frame_pos+frame_header.size, SEEK_SET);
 
     /* just one frame? */
-    if (fop->oneframe)
-      break;
+    if (onlyFrame >= 0) {
+      if (frame >= onlyFrame)
+        break;
+      // Jump to the frame to load
+      else if (seekFrame)
+        frame = onlyFrame-1;
+    }
 
     if (fop_is_stop(fop))
       break;
   }
 
+  // Inflate the remaining cels
+  decoder.flush();
+
   fop->createDocument(sprite);
   sprite.release();
 
@@ -296,16 +480,42 @@ bool AseFormat::onLoad(FileOp* fop)
 bool AseFormat::onSave(FileOp* fop)
 {
   Sprite* sprite = fop->document->sprite();
+
+  // Cels which are not decoded yet (lazy loaded) are decoded now.
+  // The file could be the same one where they are read from.
+  for (Cel* cel : sprite->uniqueCels())
+    cel->data()->setImage(cel->imageRef());
+
   FileHandle handle(open_file_with_exception(fop->filename, "wb"));
   FILE* f = handle.get();
 
+  // Compression level for cels
+  int compressionLevel = AseOptions::DefaultCompression;
+  int tileSize = 0;
+  if (AseOptions* options = dynamic_cast<AseOptions*>(fop->document->getFormatOptions().get())) {
+    compressionLevel = options->compressionLevel();
+    tileSize = options->tileSize();
+  }
+
+  // Repeated tiles of cel images
+  TileDictionary tiles(sprite, tileSize, compressionLevel);
+
   // Write the header
   ASE_Header header;
   ase_file_prepare_header(f, &header, sprite);
   ase_file_write_header(f, &header);
 
+  // Cel images are compressed in parallel
+  CelEncoder encoder(sprite, compressionLevel, &tiles);
+
+  // Position of frames and cels
+  std::vector<ASE_FrameIndex> index(sprite->totalFrames());
+  uint32_t palette_pos = 0;
+
   // Write frames
   for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
+    index[frame].pos = ftell(f);
+
     // Prepare the frame header
     ASE_FrameHeader frame_header;
     ase_file_prepare_frame_header(f, &frame_header);
@@ -317,8 +527,10 @@ bool AseFormat::onSave(FileOp* fop)
     if ((frame == 0 ||
          sprite->palette(frame-1)->countDiff(sprite->palette(frame), NULL, NULL) > 0)) {
       // Write the color chunk
+      palette_pos = ftell(f);
       ase_file_write_color2_chunk(f, &frame_header, sprite->palette(frame));
     }
+    index[frame].palette_pos = palette_pos;
 
     // Write extra chunks in the first frame
     if (frame == 0) {
@@ -332,10 +544,14 @@ bool AseFormat::onSave(FileOp* fop)
       // Writer frame tags
       if (sprite->frameTags().size() > 0)
         ase_file_write_frame_tags_chunk(f, &frame_header, &sprite->frameTags());
+
+      // Write the tileset before any tiled cel
+      if (!tiles.empty())
+        ase_file_write_tileset_chunk(f, &frame_header, &tiles);
     }
 
     // Write cel chunks
-    ase_file_write_cels(f, &frame_header, sprite, sprite->folder(), frame);
+    ase_file_write_cels(f, &frame_header, sprite, sprite->folder(), frame, &encoder, &index[frame]);
 
     // Write the frame header
     ase_file_write_frame_header(f, &frame_header);
@@ -348,8 +564,13 @@ bool AseFormat::onSave(FileOp* fop)
       break;
   }
 
-  // Write the missing field (filesize) of the header.
+  // Write the frame index (only complete files have one)
+  if (!fop_is_stop(fop))
+    header.frame_index = ase_file_write_frame_index(f, index);
+
+  // Write the missing fields (filesize and frame index) of the header.
   ase_file_write_header_filesize(f, &header);
+  ase_file_write_header_frame_index(f, &header);
 
   if (ferror(f)) {
     fop_error(fop, "Error writing file.\n");
@@ -361,6 +582,93 @@ bool AseFormat::onSave(FileOp* fop)
 }
 #endif
 
+// Reads the chunk in the current position of the file and skips to
+// the end of it. Cel chunks are skipped if "cels" is false.
+static void ase_file_read_chunk(FILE* f, FileOp* fop, Sprite* sprite, frame_t frame,
+                                CelDecoder* decoder, Layer** last_layer, int* current_level,
+                                bool cels)
+{
+  /* start chunk position */
+  int chunk_pos = ftell(f);
+  decoder->progress(chunk_pos);
+
+  // Read chunk information
+  int chunk_size = fgetl(f);
+  int chunk_type = fgetw(f);
+
+  switch (chunk_type) {
+
+    /* only for 8 bpp images */
+    case ASE_FILE_CHUNK_FLI_COLOR:
+    case ASE_FILE_CHUNK_FLI_COLOR2: {
+      Palette* prev_pal = sprite->palette(frame);
+      Palette* pal =
+        chunk_type == ASE_FILE_CHUNK_FLI_COLOR ?
+        ase_file_read_color_chunk(f, sprite, frame):
+        ase_file_read_color2_chunk(f, sprite, frame);
+
+      if (prev_pal->countDiff(pal, NULL, NULL) > 0)
+        sprite->setPalette(pal, true);
+
+      delete pal;
+      break;
+    }
+
+    case ASE_FILE_CHUNK_LAYER: {
+      /* fop_error(fop, "Layer chunk\n"); */
+
+      ase_file_read_layer_chunk(f, sprite,
+                                last_layer,
+                                current_level);
+      break;
+    }
+
+    case ASE_FILE_CHUNK_CEL: {
+      /* fop_error(fop, "Cel chunk\n"); */
+
+      if (cels)
+        ase_file_read_cel_chunk(f, sprite, frame,
+                                sprite->pixelFormat(), fop, decoder,
+                                chunk_pos+chunk_size);
+      break;
+    }
+
+    case ASE_FILE_CHUNK_MASK: {
+      Mask* mask;
+
+      /* fop_error(fop, "Mask chunk\n"); */
+
+      mask = ase_file_read_mask_chunk(f);
+      if (mask)
+        delete mask;      // TODO add the mask in some place?
+      else
+        fop_error(fop, "Warning: error loading a mask chunk\n");
+
+      break;
+    }
+
+    case ASE_FILE_CHUNK_PATH:
+      /* fop_error(fop, "Path chunk\n"); */
+      break;
+
+    case ASE_FILE_CHUNK_FRAME_TAGS:
+      ase_file_read_frame_tags_chunk(f, &sprite->frameTags());
+      break;
+
+    case ASE_FILE_CHUNK_TILESET:
+      ase_file_read_tileset_chunk(f, sprite->pixelFormat(), decoder,
+                                  chunk_pos+chunk_size);
+      break;
+
+    default:
+      fop_error(fop, "Warning: Unsupported chunk type %d (skipping)\n", chunk_type);
+      break;
+  }
+
+  /* skip chunk size */
+  fseek(f, chunk_pos+chunk_size, SEEK_SET);
+}
+
 static bool ase_file_read_header(FILE* f, ASE_Header* header)
 {
   header->pos = ftell(f);
@@ -385,6 +693,7 @@ static bool ase_file_read_header(FILE* f, ASE_Header* header)
   header->ncolors    = fgetw(f);
   if (header->ncolors == 0)     // 0 means 256 (old .ase files)
     header->ncolors = 256;
+  header->frame_index = fgetl(f);
 
   fseek(f, header->pos+128, SEEK_SET);
   return true;
@@ -411,6 +720,7 @@ static void ase_file_prepare_header(FILE* f, ASE_Header* header, const Sprite* s
   header->ignore[1] = 0;
   header->ignore[2] = 0;
   header->ncolors = sprite->palette(frame_t(0))->size();
+  header->frame_index = 0;
 }
 
 static void ase_file_write_header(FILE* f, ASE_Header* header)
@@ -432,6 +742,7 @@ static void ase_file_write_header(FILE* f, ASE_Header* header)
   fputc(header->ignore[1], f);
   fputc(header->ignore[2], f);
   fputw(header->ncolors, f);
+  fputl(header->frame_index, f);
 
   fseek(f, header->pos+128, SEEK_SET);
 }
@@ -446,6 +757,83 @@ static void ase_file_write_header_filesize(FILE* f, ASE_Header* header)
   fseek(f, header->pos+header->size, SEEK_SET);
 }
 
+static void ase_file_write_header_frame_index(FILE* f, ASE_Header* header)
+{
+  int end = ftell(f);
+
+  fseek(f, header->pos+34, SEEK_SET);
+  fputl(header->frame_index, f);
+
+  fseek(f, end, SEEK_SET);
+}
+
+// Reads the frame index saved at the end of the file. Returns false
+// if it's invalid (e.g. the file was modified by other program).
+static bool ase_file_read_frame_index(FILE* f, ASE_Header* header, std::vector<ASE_FrameIndex>& index)
+{
+  const uint32_t end = header->pos+header->size;
+  bool valid = false;
+
+  fseek(f, header->pos+header->frame_index, SEEK_SET);
+
+  fgetl(f);                     // Size of the index
+  if (fgetw(f) == ASE_FILE_INDEX_MAGIC &&
+      fgetw(f) == header->frames) {
+    ase_file_read_padding(f, 8);
+
+    index.resize(header->frames);
+    valid = true;
+
+    for (ASE_FrameIndex& frame : index) {
+      frame.pos = fgetl(f);
+      frame.palette_pos = fgetl(f);
+      frame.cels.resize(fgetw(f));
+      for (ASE_CelIndex& cel : frame.cels) {
+        cel.layer = fgetw(f);
+        cel.pos = fgetl(f);
+        if (cel.pos >= end)
+          valid = false;
+      }
+
+      if (frame.pos >= end || frame.palette_pos >= end || feof(f)) {
+        valid = false;
+        break;
+      }
+    }
+  }
+
+  fseek(f, header->pos+128, SEEK_SET);
+  return valid;
+}
+
+// Writes the position of each frame, its color chunk and cel chunks
+// at the end of the file. Returns the position of the index.
+static uint32_t ase_file_write_frame_index(FILE* f, const std::vector<ASE_FrameIndex>& index)
+{
+  uint32_t pos = ftell(f);
+
+  fputl(0, f);                  // Size of the index (written later)
+  fputw(ASE_FILE_INDEX_MAGIC, f);
+  fputw(index.size(), f);
+  ase_file_write_padding(f, 8);
+
+  for (const ASE_FrameIndex& frame : index) {
+    fputl(frame.pos, f);
+    fputl(frame.palette_pos, f);
+    fputw(frame.cels.size(), f);
+    for (const ASE_CelIndex& cel : frame.cels) {
+      fputw(cel.layer, f);
+      fputl(cel.pos, f);
+    }
+  }
+
+  uint32_t end = ftell(f);
+  fseek(f, pos, SEEK_SET);
+  fputl(end-pos, f);
+  fseek(f, end, SEEK_SET);
+  return pos;
+}
+
 static void ase_file_read_frame_header(FILE* f, ASE_FrameHeader* frame_header)
 {
   frame_header->size = fgetl(f);
@@ -498,7 +886,7 @@ static void ase_file_write_layers(FILE* f, ASE_FrameHeader* frame_header, Layer*
   }
 }
 
-static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, frame_t frame)
+static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite* sprite, Layer* layer, frame_t frame, CelEncoder* encoder, ASE_FrameIndex* index)
 {
   if (layer->isImage()) {
     Cel* cel = layer->cel(frame);
@@ -506,7 +894,12 @@ static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite*
 /*       fop_error(fop, "New cel in frame %d, in layer %d\n", */
 /*                   frame, sprite_layer2index(sprite, layer)); */
 
-      ase_file_write_cel_chunk(f, frame_header, cel, static_cast<LayerImage*>(layer), sprite);
+      ASE_CelIndex cel_index;
+      cel_index.layer = sprite->layerToIndex(layer);
+      cel_index.pos = ftell(f);
+      index->cels.push_back(cel_index);
+
+      ase_file_write_cel_chunk(f, frame_header, cel, static_cast<LayerImage*>(layer), sprite, encoder);
     }
   }
 
@@ -515,7 +908,7 @@ static void ase_file_write_cels(FILE* f, ASE_FrameHeader* frame_header, Sprite*
     LayerIterator end = static_cast<LayerFolder*>(layer)->getLayerEnd();
 
     for (; it != end; ++it)
-      ase_file_write_cels(f, frame_header, sprite, *it, frame);
+      ase_file_write_cels(f, frame_header, sprite, *it, frame, encoder, index);
   }
 }
 
@@ -826,7 +1219,8 @@ public:
   }
   void read_scanline(IndexedTraits::address_t address, int w, uint8_t* buffer)
   {
-    memcpy(address, buffer, w);
+    if (address != buffer)
+      memcpy(address, buffer, w);
   }
   void write_scanline(IndexedTraits::address_t address, int w, uint8_t* buffer)
   {
@@ -839,7 +1233,7 @@ public:
 //////////////////////////////////////////////////////////////////////
 
 template<typename ImageTraits>
-static void read_raw_image(FILE* f, Image* image, FileOp* fop, ASE_Header* header)
+static void read_raw_image(FILE* f, Image* image, CelDecoder* decoder)
 {
   PixelIO<ImageTraits> pixel_io;
   int x, y;
@@ -848,7 +1242,7 @@ static void read_raw_image(FILE* f, Image* image, FileOp* fop, ASE_Header* heade
     for (x=0; x<image->width(); x++)
       put_pixel_fast<ImageTraits>(image, x, y, pixel_io.read_pixel(f));
 
-    fop_progress(fop, (float)ftell(f) / (float)header->size);
+    decoder->progress(ftell(f));
   }
 }
 
@@ -867,8 +1261,10 @@ static void write_raw_image(FILE* f, Image* image)
 // Compressed Image
 //////////////////////////////////////////////////////////////////////
 
+// Inflates the compressed pixels of a cel directly in the rows of
+// the image (each row is converted in-place from the file format).
 template<typename ImageTraits>
-static void read_compressed_image(FILE* f, Image* image, size_t chunk_end, FileOp* fop, ASE_Header* header)
+static void read_compressed_image(const uint8_t* compressed, size_t size, Image* image)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -877,73 +1273,161 @@ static void read_compressed_image(FILE* f, Image* image, size_t chunk_end, FileO
   zstream.zalloc = (alloc_func)0;
   zstream.zfree  = (free_func)0;
   zstream.opaque = (voidpf)0;
+  zstream.next_in = (Bytef*)compressed;
+  zstream.avail_in = size;
 
   err = inflateInit(&zstream);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in inflateInit().", err);
 
-  std::vector<uint8_t> scanline(ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> uncompressed(image->height() * ImageTraits::getRowStrideBytes(image->width()));
-  std::vector<uint8_t> compressed(4096);
-  int uncompressed_offset = 0;
+  const int rowBytes = ImageTraits::getRowStrideBytes(image->width());
+  err = Z_OK;
 
-  while (true) {
-    size_t input_bytes;
+  for (y=0; y<image->height(); y++) {
+    uint8_t* row = image->getPixelAddress(0, y);
 
-    if (ftell(f)+compressed.size() > chunk_end) {
-      input_bytes = chunk_end - ftell(f); // Remaining bytes
-      ASSERT(input_bytes < compressed.size());
+    zstream.next_out = (Bytef*)row;
+    zstream.avail_out = rowBytes;
 
-      if (input_bytes == 0)
-        break;                  // Done, we consumed all chunk
+    while (zstream.avail_out > 0 && err != Z_STREAM_END) {
+      err = inflate(&zstream, Z_NO_FLUSH);
+      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR) {
+        inflateEnd(&zstream);
+        throw base::Exception("ZLib error %d in inflate().", err);
+      }
+      // Buffer error: all the input was consumed
+      if (err == Z_BUF_ERROR)
+        break;
     }
-    else
-      input_bytes = compressed.size();
 
-    size_t bytes_read = fread(&compressed[0], 1, input_bytes, f);
-    zstream.next_in = (Bytef*)&compressed[0];
-    zstream.avail_in = bytes_read;
+    // Missing pixels are zero
+    if (zstream.avail_out > 0)
+      std::fill(row+rowBytes-zstream.avail_out, row+rowBytes, 0);
 
-    do {
-      zstream.next_out = (Bytef*)&scanline[0];
-      zstream.avail_out = scanline.size();
+    pixel_io.read_scanline((typename ImageTraits::address_t)row,
+                           image->width(), row);
+  }
 
-      err = inflate(&zstream, Z_NO_FLUSH);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
-        throw base::Exception("ZLib error %d in inflate().", err);
+  // Check that there aren't more pixels than expected
+  bool bad = false;
+  if (err != Z_STREAM_END && zstream.avail_in > 0) {
+    Bytef extra;
+    zstream.next_out = &extra;
+    zstream.avail_out = 1;
+    err = inflate(&zstream, Z_NO_FLUSH);
+    bad = (zstream.avail_out == 0);
+  }
 
-      size_t uncompressed_bytes = scanline.size() - zstream.avail_out;
-      if (uncompressed_bytes > 0) {
-        if (uncompressed_offset+uncompressed_bytes > uncompressed.size())
-          throw base::Exception("Bad compressed image.");
+  err = inflateEnd(&zstream);
+  if (bad)
+    throw base::Exception("Bad compressed image.");
+  if (err != Z_OK)
+    throw base::Exception("ZLib error %d in inflateEnd().", err);
+}
+
+void CelDecoder::flush()
+{
+  if (m_jobs.empty())
+    return;
 
-        std::copy(scanline.begin(), scanline.begin()+uncompressed_bytes,
-                  uncompressed.begin()+uncompressed_offset);
+  std::thread::id caller = std::this_thread::get_id();
 
-        uncompressed_offset += uncompressed_bytes;
+  base::thread_pool::global().parallel_for(
+    int(m_jobs.size()),
+    [this, caller](int i) {
+      Job& job = m_jobs[i];
+      try {
+        switch (job.image->pixelFormat()) {
+          case IMAGE_RGB:
+            read_compressed_image<RgbTraits>(job.compressed.data(), job.compressed.size(), job.image.get());
+            break;
+          case IMAGE_GRAYSCALE:
+            read_compressed_image<GrayscaleTraits>(job.compressed.data(), job.compressed.size(), job.image.get());
+            break;
+          case IMAGE_INDEXED:
+            read_compressed_image<IndexedTraits>(job.compressed.data(), job.compressed.size(), job.image.get());
+            break;
+        }
       }
-    } while (zstream.avail_out == 0);
+      catch (const std::exception& e) {
+        job.error = e.what();
+      }
+
+      m_decodedBytes += job.compressed.size();
+      std::vector<uint8_t>().swap(job.compressed);
 
-    fop_progress(fop, (float)ftell(f) / (float)header->size);
+      // The progress is notified from the calling thread only
+      if (std::this_thread::get_id() == caller)
+        progress(m_filePos);
+    });
+
+  // OK, in case of error we can show the problem, but continue
+  // loading more cels.
+  for (const Job& job : m_jobs)
+    if (!job.error.empty())
+      fop_error(m_fop, job.error.c_str());
+
+  m_jobs.clear();
+  m_pendingBytes = 0;
+}
+
+// Decodes a compressed cel from the mapped .ase file each time its
+// image is needed.
+class AseCelLoader : public ImageLoader {
+public:
+  AseCelLoader(const base::SharedPtr<base::mapped_file>& file,
+               size_t offset, size_t size,
+               PixelFormat pixelFormat, int width, int height)
+    : m_file(file)
+    , m_offset(offset)
+    , m_size(size)
+    , m_pixelFormat(pixelFormat)
+    , m_width(width)
+    , m_height(height) {
   }
 
-  uncompressed_offset = 0;
-  for (y=0; y<image->height(); y++) {
-    typename ImageTraits::address_t address =
-      (typename ImageTraits::address_t)image->getPixelAddress(0, y);
+  gfx::Size imageSize() const override {
+    return gfx::Size(m_width, m_height);
+  }
 
-    pixel_io.read_scanline(address, image->width(), &uncompressed[uncompressed_offset]);
+  Image* loadImage() override {
+    base::UniquePtr<Image> image(Image::create(m_pixelFormat, m_width, m_height));
+    const uint8_t* data = m_file->data() + m_offset;
+
+    try {
+      switch (m_pixelFormat) {
+        case IMAGE_RGB:
+          read_compressed_image<RgbTraits>(data, m_size, image.get());
+          break;
+        case IMAGE_GRAYSCALE:
+          read_compressed_image<GrayscaleTraits>(data, m_size, image.get());
+          break;
+        case IMAGE_INDEXED:
+          read_compressed_image<IndexedTraits>(data, m_size, image.get());
+          break;
+      }
+    }
+    catch (const std::exception&) {
+      // Keep the pixels that could be decoded (as when the whole
+      // file is loaded, but here there is no FileOp to report the
+      // error)
+    }
 
-    uncompressed_offset += ImageTraits::getRowStrideBytes(image->width());
+    return image.release();
   }
 
-  err = inflateEnd(&zstream);
-  if (err != Z_OK)
-    throw base::Exception("ZLib error %d in inflateEnd().", err);
-}
+private:
+  base::SharedPtr<base::mapped_file> m_file;
+  size_t m_offset;
+  size_t m_size;
+  PixelFormat m_pixelFormat;
+  int m_width;
+  int m_height;
+};
 
 template<typename ImageTraits>
-static void write_compressed_image(FILE* f, Image* image)
+static void write_compressed_image(const Image* image, int compressionLevel,
+                                   std::vector<uint8_t>& output)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -952,7 +1436,7 @@ static void write_compressed_image(FILE* f, Image* image)
   zstream.zalloc = (alloc_func)0;
   zstream.zfree  = (free_func)0;
   zstream.opaque = (voidpf)0;
-  err = deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+  err = deflateInit(&zstream, compressionLevel);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateInit().", err);
 
@@ -975,15 +1459,14 @@ static void write_compressed_image(FILE* f, Image* image)
 
       // Compress
       err = deflate(&zstream, flush);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR) {
+        deflateEnd(&zstream);
         throw base::Exception("ZLib error %d in deflate().", err);
+      }
 
       int output_bytes = compressed.size() - zstream.avail_out;
-      if (output_bytes > 0) {
-        if ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
-            || ferror(f))
-          throw base::Exception("Error writing compressed image pixels.\n");
-      }
+      if (output_bytes > 0)
+        output.insert(output.end(), compressed.begin(), compressed.begin()+output_bytes);
     } while (zstream.avail_out == 0);
   }
 
@@ -992,13 +1475,254 @@ static void write_compressed_image(FILE* f, Image* image)
     throw base::Exception("ZLib error %d in deflateEnd().", err);
 }
 
+CelEncoder::CelEncoder(Sprite* sprite, int compressionLevel,
+                       const TileDictionary* tiles)
+  : m_tiles(tiles)
+  , m_next(0)
+  , m_scheduled(0)
+  , m_window(2*(base::thread_pool::global().workers()+1))
+{
+  for (frame_t frame(0); frame<sprite->totalFrames(); ++frame)
+    collectImages(sprite->folder(), frame, compressionLevel);
+}
+
+CelEncoder::~CelEncoder()
+{
+  // Cancel pending jobs and wait the running ones (they use the
+  // sprite images)
+  for (size_t i=m_next; i<m_scheduled; ++i) {
+    int expected = Pending;
+    if (!m_jobs[i]->state.compare_exchange_strong(expected, Done))
+      wait(m_jobs[i]);
+  }
+}
+
+void CelEncoder::write(FILE* f, const Image* image)
+{
+  ASSERT(m_next < m_jobs.size());
+  ASSERT(m_jobs[m_next]->image == image);
+
+  schedule();
+  JobPtr job = m_jobs[m_next];
+  m_jobs[m_next++].reset();
+
+  // Compress the image in this thread if no worker has started it
+  run(job);
+  wait(job);
+
+  if (!job->error.empty())
+    throw base::Exception(job->error);
+
+  if (!job->compressed.empty()) {
+    if ((fwrite(&job->compressed[0], 1, job->compressed.size(), f) != job->compressed.size())
+        || ferror(f))
+      throw base::Exception("Error writing compressed image pixels.\n");
+  }
+}
+
+// Same order used in ase_file_write_cels()
+void CelEncoder::collectImages(Layer* layer, frame_t frame, int compressionLevel)
+{
+  if (layer->isImage()) {
+    Cel* cel = layer->cel(frame);
+    if (cel && !cel->link() && cel->image() &&
+        !(m_tiles && m_tiles->tileIndexes(cel->image())))
+      m_jobs.push_back(JobPtr(new Job(cel->image(), compressionLevel)));
+  }
+
+  if (layer->isFolder()) {
+    LayerIterator it = static_cast<LayerFolder*>(layer)->getLayerBegin();
+    LayerIterator end = static_cast<LayerFolder*>(layer)->getLayerEnd();
+
+    for (; it != end; ++it)
+      collectImages(*it, frame, compressionLevel);
+  }
+}
+
+void CelEncoder::schedule()
+{
+  base::thread_pool& pool = base::thread_pool::global();
+
+  for (; m_scheduled < m_jobs.size() && m_scheduled < m_next + m_window; ++m_scheduled) {
+    JobPtr job = m_jobs[m_scheduled];
+    pool.execute([job]{ run(job); });
+  }
+}
+
+// static
+void CelEncoder::run(const JobPtr& job)
+{
+  int expected = Pending;
+  if (!job->state.compare_exchange_strong(expected, Running))
+    return;
+
+  try {
+    switch (job->image->pixelFormat()) {
+      case IMAGE_RGB:
+        write_compressed_image<RgbTraits>(job->image, job->compressionLevel, job->compressed);
+        break;
+      case IMAGE_GRAYSCALE:
+        write_compressed_image<GrayscaleTraits>(job->image, job->compressionLevel, job->compressed);
+        break;
+      case IMAGE_INDEXED:
+        write_compressed_image<IndexedTraits>(job->image, job->compressionLevel, job->compressed);
+        break;
+    }
+  }
+  catch (const std::exception& e) {
+    job->error = e.what();
+  }
+
+  {
+    std::unique_lock<std::mutex> hold(job->mutex);
+    job->state = Done;
+  }
+  job->cv.notify_all();
+}
+
+// static
+void CelEncoder::wait(const JobPtr& job)
+{
+  std::unique_lock<std::mutex> hold(job->mutex);
+  job->cv.wait(hold, [&job]{ return job->state == Done; });
+}
+
+//////////////////////////////////////////////////////////////////////
+// Tile Dictionary
+//////////////////////////////////////////////////////////////////////
+
+// Copies the pixels of the tile (tx, ty) of the image in "tile"
+// (pixels outside the image are zero).
+static void get_tile(const Image* image, int tileSize, int tx, int ty,
+                     std::vector<uint8_t>& tile)
+{
+  const int rowSize = image->getRowStrideSize(tileSize);
+  const int x = tx*tileSize;
+  const int y = ty*tileSize;
+  const int w = std::min(tileSize, image->width()-x);
+  const int h = std::min(tileSize, image->height()-y);
+  const int bytes = image->getRowStrideSize(w);
+
+  std::fill(tile.begin(), tile.end(), 0);
+  for (int v=0; v<h; ++v) {
+    const uint8_t* src = image->getPixelAddress(x, y+v);
+    std::copy(src, src+bytes, &tile[v*rowSize]);
+  }
+}
+
+// FNV-1a hash of the pixels of a tile
+static uint64_t hash_tile(const std::vector<uint8_t>& tile)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (uint8_t value : tile) {
+    hash ^= value;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+TileDictionary::TileDictionary(Sprite* sprite, int tileSize, int compressionLevel)
+  : m_tileSize(tileSize)
+  , m_tileCount(0)
+  , m_compressionLevel(compressionLevel)
+{
+  // The tile size is saved as a WORD
+  if (tileSize <= 0 || tileSize > 0xffff)
+    return;
+
+  const int tileBytes = calculate_rowstride_bytes(sprite->pixelFormat(), tileSize) * tileSize;
+  std::vector<std::vector<uint8_t> > tiles;
+  std::vector<int> counts;
+  std::unordered_multimap<uint64_t, int> hashes;
+  std::vector<uint8_t> tile(tileBytes);
+
+  // Split each image in tiles (identical tiles share their index)
+  std::map<const Image*, std::vector<uint32_t> > candidates;
+  for (Cel* cel : sprite->uniqueCels()) {
+    const Image* image = cel->image();
+    if (!image ||
+        (image->width() <= tileSize && image->height() <= tileSize) ||
+        candidates.find(image) != candidates.end())
+      continue;
+
+    const int cols = (image->width()+tileSize-1) / tileSize;
+    const int rows = (image->height()+tileSize-1) / tileSize;
+    std::vector<uint32_t>& indexes = candidates[image];
+    indexes.reserve(cols*rows);
+
+    for (int ty=0; ty<rows; ++ty) {
+      for (int tx=0; tx<cols; ++tx) {
+        get_tile(image, tileSize, tx, ty, tile);
+
+        uint64_t hash = hash_tile(tile);
+        int index = -1;
+        auto range = hashes.equal_range(hash);
+        for (auto it=range.first; it!=range.second; ++it) {
+          if (std::memcmp(&tiles[it->second][0], &tile[0], tileBytes) == 0) {
+            index = it->second;
+            break;
+          }
+        }
+
+        if (index < 0) {
+          index = int(tiles.size());
+          tiles.push_back(tile);
+          counts.push_back(0);
+          hashes.insert(std::make_pair(hash, index));
+        }
+
+        ++counts[index];
+        indexes.push_back(uint32_t(index));
+      }
+    }
+  }
+
+  // Only images where at least 1/4 of the tiles are repeated are
+  // saved as tiled cels (other images are compressed better as a
+  // whole), and only their tiles are saved in the dictionary.
+  std::vector<int> remap(tiles.size(), -1);
+  for (auto& candidate : candidates) {
+    const std::vector<uint32_t>& indexes = candidate.second;
+    size_t repeated = 0;
+    for (uint32_t index : indexes)
+      if (counts[index] > 1)
+        ++repeated;
+
+    if (4*repeated < indexes.size())
+      continue;
+
+    std::vector<uint32_t>& output = m_indexes[candidate.first];
+    output.reserve(indexes.size());
+    for (uint32_t index : indexes) {
+      if (remap[index] < 0)
+        remap[index] = m_tileCount++;
+      output.push_back(uint32_t(remap[index]));
+    }
+  }
+
+  if (m_tileCount == 0)
+    return;
+
+  m_tilesImage.reset(Image::create(sprite->pixelFormat(), tileSize, tileSize*m_tileCount));
+
+  const int rowSize = m_tilesImage->getRowStrideSize();
+  for (size_t i=0; i<tiles.size(); ++i) {
+    if (remap[i] < 0)
+      continue;
+
+    for (int v=0; v<tileSize; ++v)
+      std::copy(&tiles[i][v*rowSize], &tiles[i][v*rowSize]+rowSize,
+                m_tilesImage->getPixelAddress(0, remap[i]*tileSize+v));
+  }
+}
+
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
 
 static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
                                     PixelFormat pixelFormat,
-                                    FileOp* fop, ASE_Header* header, size_t chunk_end)
+                                    FileOp* fop, CelDecoder* decoder, size_t chunk_end)
 {
   /* read chunk data */
   LayerIndex layer_index = LayerIndex(fgetw(f));
@@ -1022,6 +1746,14 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
     return NULL;
   }
 
+  // Cels of hidden layers are not needed to render a preview
+  if (fop->preview_size > 0) {
+    for (Layer* l=layer; l && l != sprite->folder(); l=l->parent()) {
+      if (!l->isVisible())
+        return NULL;
+    }
+  }
+
   // Create the new frame.
   base::UniquePtr<Cel> cel;
 
@@ -1039,15 +1771,15 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
         switch (image->pixelFormat()) {
 
           case IMAGE_RGB:
-            read_raw_image<RgbTraits>(f, image.get(), fop, header);
+            read_raw_image<RgbTraits>(f, image.get(), decoder);
             break;
 
           case IMAGE_GRAYSCALE:
-            read_raw_image<GrayscaleTraits>(f, image.get(), fop, header);
+            read_raw_image<GrayscaleTraits>(f, image.get(), decoder);
             break;
 
           case IMAGE_INDEXED:
-            read_raw_image<IndexedTraits>(f, image.get(), fop, header);
+            read_raw_image<IndexedTraits>(f, image.get(), decoder);
             break;
         }
 
@@ -1072,6 +1804,9 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
           cel->setFrame(frame);
         }
         else {
+          // The pixels of the linked cel must be ready to copy them
+          decoder->flush();
+
           cel.reset(Cel::createCopy(link));
           cel->setFrame(frame);
           cel->setPosition(x, y);
@@ -1091,30 +1826,88 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
       int h = fgetw(f);
 
       if (w > 0 && h > 0) {
-        ImageRef image(Image::create(pixelFormat, w, h));
+        size_t pos = ftell(f);
+        size_t size = (chunk_end > pos ? chunk_end - pos: 0);
+        const base::SharedPtr<base::mapped_file>& file = decoder->mappedFile();
+
+        // Lazy mode: the pixels are decoded when they are needed
+        if (file && pos+size <= file->size()) {
+          ImageLoaderRef loader(
+            new AseCelLoader(file, pos, size, pixelFormat, w, h));
+          cel.reset(new Cel(frame, CelDataRef(new CelData(loader))));
+        }
+        else {
+          ImageRef image(Image::create(pixelFormat, w, h));
+
+          // Read the compressed pixel data (it's inflated later)
+          std::vector<uint8_t> compressed(size);
+          if (!compressed.empty())
+            compressed.resize(fread(&compressed[0], 1, compressed.size(), f));
+
+          decoder->add(image, compressed);
+          cel.reset(new Cel(frame, image));
+        }
 
-        // Try to read pixel data
-        try {
-          switch (image->pixelFormat()) {
+        cel->setPosition(x, y);
+        cel->setOpacity(opacity);
+      }
+      break;
+    }
 
-            case IMAGE_RGB:
-              read_compressed_image<RgbTraits>(f, image.get(), chunk_end, fop, header);
-              break;
+    case ASE_FILE_TILED_CEL: {
+      // Read width and height
+      int w = fgetw(f);
+      int h = fgetw(f);
+
+      if (w > 0 && h > 0) {
+        const Image* tileset = decoder->tileset();
+        if (!tileset) {
+          fop_error(fop, "Tiled cel without tileset in frame %d\n", (int)frame);
+          return NULL;
+        }
 
-            case IMAGE_GRAYSCALE:
-              read_compressed_image<GrayscaleTraits>(f, image.get(), chunk_end, fop, header);
-              break;
+        const int tileSize = decoder->tileSize();
+        const int cols = (w+tileSize-1) / tileSize;
+        const int rows = (h+tileSize-1) / tileSize;
+        const uint32_t tileCount = uint32_t(tileset->height() / tileSize);
+
+        // Read the compressed tile indexes
+        size_t pos = ftell(f);
+        std::vector<uint8_t> compressed(chunk_end > pos ? chunk_end - pos: 0);
+        if (!compressed.empty())
+          compressed.resize(fread(&compressed[0], 1, compressed.size(), f));
+
+        std::vector<uint8_t> indexes(4*cols*rows);
+        uLongf indexesSize = indexes.size();
+        if (compressed.empty() ||
+            uncompress(&indexes[0], &indexesSize,
+                       &compressed[0], compressed.size()) != Z_OK ||
+            indexesSize != indexes.size()) {
+          fop_error(fop, "Invalid tiled cel in frame %d\n", (int)frame);
+          return NULL;
+        }
 
-            case IMAGE_INDEXED:
-              read_compressed_image<IndexedTraits>(f, image.get(), chunk_end, fop, header);
-              break;
+        // Copy the pixels of each tile from the tileset
+        ImageRef image(Image::create(pixelFormat, w, h));
+        const uint8_t* p = &indexes[0];
+        for (int ty=0; ty<rows; ++ty) {
+          for (int tx=0; tx<cols; ++tx, p+=4) {
+            uint32_t index = (uint32_t(p[0]) | (uint32_t(p[1]) << 8) |
+                              (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24));
+            if (index >= tileCount) {
+              fop_error(fop, "Invalid tile %d in frame %d\n", (int)index, (int)frame);
+              return NULL;
+            }
+
+            const int x = tx*tileSize;
+            const int y = ty*tileSize;
+            const int bytes = image->getRowStrideSize(std::min(tileSize, w-x));
+            for (int v=0; v<tileSize && y+v<h; ++v) {
+              const uint8_t* src = tileset->getPixelAddress(0, index*tileSize+v);
+              std::copy(src, src+bytes, image->getPixelAddress(x, y+v));
+            }
           }
         }
-        // OK, in case of error we can show the problem, but continue
-        // loading more cels.
-        catch (const std::exception& e) {
-          fop_error(fop, e.what());
-        }
 
         cel.reset(new Cel(frame, image));
         cel->setPosition(x, y);
@@ -1132,13 +1925,58 @@ static Cel* ase_file_read_cel_chunk(FILE* f, Sprite* sprite, frame_t frame,
   return cel.release();
 }
 
-static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite)
+// Reads the cel chunk in the given position of the frame index. A
+// linked cel is read from the chunk of the original cel (so the
+// frame of the original cel isn't needed).
+static Cel* ase_file_read_indexed_cel(FILE* f, Sprite* sprite, frame_t frame,
+                                      FileOp* fop, CelDecoder* decoder,
+                                      const std::vector<ASE_FrameIndex>& index,
+                                      const ASE_CelIndex& cel)
+{
+  uint32_t pos = cel.pos;
+
+  // Cel type
+  fseek(f, pos+6+7, SEEK_SET);
+  if (fgetw(f) == ASE_FILE_LINK_CEL) {
+    ase_file_read_padding(f, 7);
+    frame_t link_frame = frame_t(fgetw(f));
+    if (link_frame >= frame_t(index.size()))
+      return NULL;
+
+    auto it = std::find_if(index[link_frame].cels.begin(),
+                           index[link_frame].cels.end(),
+                           [&cel](const ASE_CelIndex& link) {
+                             return link.layer == cel.layer;
+                           });
+    if (it == index[link_frame].cels.end())
+      return NULL;
+
+    pos = it->pos;
+  }
+
+  fseek(f, pos, SEEK_SET);
+  decoder->progress(pos);
+
+  int chunk_size = fgetl(f);
+  if (fgetw(f) != ASE_FILE_CHUNK_CEL)
+    return NULL;
+
+  return ase_file_read_cel_chunk(f, sprite, frame, sprite->pixelFormat(),
+                                 fop, decoder, pos+chunk_size);
+}
+
+static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel* cel, LayerImage* layer, Sprite* sprite, CelEncoder* encoder)
 {
   ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_CEL);
 
   int layer_index = sprite->layerToIndex(layer);
   Cel* link = cel->link();
-  int cel_type = (link ? ASE_FILE_LINK_CEL: ASE_FILE_COMPRESSED_CEL);
+  const TileDictionary* tiles = encoder->tiles();
+  const std::vector<uint32_t>* tileIndexes =
+    (!link && cel->image() && tiles ? tiles->tileIndexes(cel->image()): NULL);
+  int cel_type = (link ? ASE_FILE_LINK_CEL:
+                  tileIndexes ? ASE_FILE_TILED_CEL:
+                                ASE_FILE_COMPRESSED_CEL);
 
   fputw(layer_index, f);
   fputw(cel->x(), f);
@@ -1195,20 +2033,7 @@ static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel
         fputw(image->height(), f);
 
         // Pixel data
-        switch (image->pixelFormat()) {
-
-          case IMAGE_RGB:
-            write_compressed_image<RgbTraits>(f, image);
-            break;
-
-          case IMAGE_GRAYSCALE:
-            write_compressed_image<GrayscaleTraits>(f, image);
-            break;
-
-          case IMAGE_INDEXED:
-            write_compressed_image<IndexedTraits>(f, image);
-            break;
-        }
+        encoder->write(f, image);
       }
       else {
         // Width and height
@@ -1217,6 +2042,36 @@ static void ase_file_write_cel_chunk(FILE* f, ASE_FrameHeader* frame_header, Cel
       }
       break;
     }
+
+    case ASE_FILE_TILED_CEL: {
+      Image* image = cel->image();
+
+      // Width and height
+      fputw(image->width(), f);
+      fputw(image->height(), f);
+
+      // Index of each tile (little-endian)
+      std::vector<uint8_t> indexes(4*tileIndexes->size());
+      uint8_t* p = &indexes[0];
+      for (uint32_t index : *tileIndexes) {
+        *(p++) = index & 0xff;
+        *(p++) = (index >> 8) & 0xff;
+        *(p++) = (index >> 16) & 0xff;
+        *(p++) = (index >> 24) & 0xff;
+      }
+
+      std::vector<uint8_t> compressed(compressBound(indexes.size()));
+      uLongf compressedSize = compressed.size();
+      int err = compress2(&compressed[0], &compressedSize,
+                          &indexes[0], indexes.size(),
+                          tiles->compressionLevel());
+      if (err != Z_OK)
+        throw base::Exception("ZLib error %d in compress2().", err);
+
+      if (fwrite(&compressed[0], 1, compressedSize, f) != compressedSize || ferror(f))
+        throw base::Exception("Error writing tile indexes.\n");
+      break;
+    }
   }
 }
 
@@ -1338,4 +2193,69 @@ static void ase_file_write_frame_tags_chunk(FILE* f, ASE_FrameHeader* frame_head
   }
 }
 
+static void ase_file_read_tileset_chunk(FILE* f, PixelFormat pixelFormat, CelDecoder* decoder, size_t chunk_end)
+{
+  int tileWidth = fgetw(f);
+  int tileHeight = fgetw(f);
+  uint32_t tiles = fgetl(f);
+  ase_file_read_padding(f, 8);
+
+  // Only square tiles are supported
+  if (tileWidth <= 0 || tileWidth != tileHeight || tiles == 0)
+    return;
+
+  size_t pos = ftell(f);
+  std::vector<uint8_t> compressed(chunk_end > pos ? chunk_end - pos: 0);
+  if (!compressed.empty())
+    compressed.resize(fread(&compressed[0], 1, compressed.size(), f));
+  if (compressed.empty())
+    return;
+
+  // The tileset is decoded now because it's used to create the
+  // images of the tiled cels
+  ImageRef tileset(Image::create(pixelFormat, tileWidth, tileWidth*tiles));
+  switch (pixelFormat) {
+    case IMAGE_RGB:
+      read_compressed_image<RgbTraits>(&compressed[0], compressed.size(), tileset.get());
+      break;
+    case IMAGE_GRAYSCALE:
+      read_compressed_image<GrayscaleTraits>(&compressed[0], compressed.size(), tileset.get());
+      break;
+    case IMAGE_INDEXED:
+      read_compressed_image<IndexedTraits>(&compressed[0], compressed.size(), tileset.get());
+      break;
+  }
+
+  decoder->setTileset(tileset, tileWidth);
+}
+
+static void ase_file_write_tileset_chunk(FILE* f, ASE_FrameHeader* frame_header, const TileDictionary* tiles)
+{
+  ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_TILESET);
+
+  fputw(tiles->tileSize(), f);
+  fputw(tiles->tileSize(), f);
+  fputl(tiles->tileCount(), f);
+  ase_file_write_padding(f, 8);
+
+  const Image* image = tiles->tilesImage();
+  std::vector<uint8_t> compressed;
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+      write_compressed_image<RgbTraits>(image, tiles->compressionLevel(), compressed);
+      break;
+    case IMAGE_GRAYSCALE:
+      write_compressed_image<GrayscaleTraits>(image, tiles->compressionLevel(), compressed);
+      break;
+    case IMAGE_INDEXED:
+      write_compressed_image<IndexedTraits>(image, tiles->compressionLevel(), compressed);
+      break;
+  }
+
+  if (!compressed.empty()) {
+    if (fwrite(&compressed[0], 1, compressed.size(), f) != compressed.size() || ferror(f))
+      throw base::Exception("Error writing tileset pixels.\n");
+  }
+}
+
 } // namespace app
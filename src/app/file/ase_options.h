@@ -0,0 +1,48 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_FILE_ASE_OPTIONS_H_INCLUDED
+#define APP_FILE_ASE_OPTIONS_H_INCLUDED
+#pragma once
+
+#include "app/file/format_options.h"
+
+namespace app {
+
+  // Data for .ase files
+  class AseOptions : public FormatOptions {
+  public:
+    // zlib compression levels for cel pixels (from 1 to 9)
+    enum {
+      DefaultCompression = -1,
+      FastCompression = 1,
+      BestCompression = 9
+    };
+
+    AseOptions(int compressionLevel = DefaultCompression,
+               int tileSize = 0)
+      : m_compressionLevel(compressionLevel)
+      , m_tileSize(tileSize) {
+    }
+
+    int compressionLevel() const { return m_compressionLevel; }
+    void setCompressionLevel(int level) { m_compressionLevel = level; }
+
+    // Size of tiles (e.g. 16 or 32) to save repeated tiles of cel
+    // images only once (0 to save each cel image independently, which
+    // is compatible with old versions).
+    int tileSize() const { return m_tileSize; }
+    void setTileSize(int size) { m_tileSize = size; }
+
+  private:
+    int m_compressionLevel;
+    int m_tileSize;
+  };
+
+} // namespace app
+
+#endif
@@ -18,6 +18,9 @@
 #include "base/file_handle.h"
 #include "doc/doc.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 using namespace base;
@@ -206,138 +209,81 @@ static void read_bmicolors(FileOp *fop, int bytes, FILE *f, bool win_flag)
     fgetc(f);
 }
 
+// Reads a whole scanline (with the padding to 32 bits) in "buf".
+// If the file ends before, the rest of the scanline is zero.
+static void read_line(FILE* f, std::vector<uint8_t>& buf)
+{
+  std::size_t n = (buf.empty() ? 0: fread(&buf[0], 1, buf.size(), f));
+  if (n < buf.size())
+    std::fill(buf.begin()+n, buf.end(), 0);
+}
+
 /* read_1bit_line:
  *  Support function for reading the 1 bit bitmap file format.
  */
-static void read_1bit_line(int length, FILE *f, Image *image, int line)
+static void read_1bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[32];
-  unsigned long n;
-  int i, j, k;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 32;
-    if (j == 0) {
-      n = fgetl(f);
-      n =
-        ((n&0x000000ff)<<24) |
-        ((n&0x0000ff00)<< 8) |
-        ((n&0x00ff0000)>> 8) |
-        ((n&0xff000000)>>24);
-      for (k=0; k<32; k++) {
-        b[31-k] = (char)(n & 1);
-        n = n >> 1;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  IndexedTraits::address_t dst =
+    (IndexedTraits::address_t)image->getPixelAddress(0, line);
+
+  for (int i=0; i<length; i++)
+    dst[i] = (src[i/8] >> (7 - (i & 7))) & 1;
 }
 
 /* read_4bit_line:
  *  Support function for reading the 4 bit bitmap file format.
  */
-static void read_4bit_line(int length, FILE *f, Image *image, int line)
+static void read_4bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[8];
-  unsigned long n;
-  int i, j, k;
-  int temp;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 8;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        temp = n & 255;
-        b[k*2+1] = temp & 15;
-        temp = temp >> 4;
-        b[k*2] = temp & 15;
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  IndexedTraits::address_t dst =
+    (IndexedTraits::address_t)image->getPixelAddress(0, line);
+
+  for (int i=0; i<length; i++)
+    dst[i] = ((i & 1) ? (src[i/2] & 15): (src[i/2] >> 4));
 }
 
 /* read_8bit_line:
  *  Support function for reading the 8 bit bitmap file format.
  */
-static void read_8bit_line(int length, FILE *f, Image *image, int line)
+static void read_8bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[4];
-  unsigned long n;
-  int i, j, k;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 4;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        b[k] = (char)(n & 255);
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  std::copy(src, src+length,
+            (IndexedTraits::address_t)image->getPixelAddress(0, line));
 }
 
-static void read_16bit_line(int length, FILE *f, Image *image, int line)
+static void read_16bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  int i, r, g, b, word;
-
-  for (i=0; i<length; i++) {
-    word = fgetw(f);
-
-    r = (word >> 10) & 0x1f;
-    g = (word >> 5) & 0x1f;
-    b = (word) & 0x1f;
-
-    put_pixel(image, i, line,
-              rgba(scale_5bits_to_8bits(r),
-                   scale_5bits_to_8bits(g),
-                   scale_5bits_to_8bits(b), 255));
+  RgbTraits::address_t dst =
+    (RgbTraits::address_t)image->getPixelAddress(0, line);
+
+  for (int i=0; i<length; i++, src+=2) {
+    int word = src[0] | (src[1] << 8);
+    int r = (word >> 10) & 0x1f;
+    int g = (word >> 5) & 0x1f;
+    int b = (word) & 0x1f;
+
+    dst[i] = rgba(scale_5bits_to_8bits(r),
+                  scale_5bits_to_8bits(g),
+                  scale_5bits_to_8bits(b), 255);
   }
-
-  i = (2*i) % 4;
-  if (i > 0)
-    while (i++ < 4)
-      fgetc(f);
 }
 
-static void read_24bit_line(int length, FILE *f, Image *image, int line)
+static void read_24bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  int i, r, g, b;
-
-  for (i=0; i<length; i++) {
-    b = fgetc(f);
-    g = fgetc(f);
-    r = fgetc(f);
-    put_pixel(image, i, line, rgba(r, g, b, 255));
-  }
+  RgbTraits::address_t dst =
+    (RgbTraits::address_t)image->getPixelAddress(0, line);
 
-  i = (3*i) % 4;
-  if (i > 0)
-    while (i++ < 4)
-      fgetc(f);
+  for (int i=0; i<length; i++, src+=3)
+    dst[i] = rgba(src[2], src[1], src[0], 255);
 }
 
-static void read_32bit_line(int length, FILE *f, Image *image, int line)
+static void read_32bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  int i, r, g, b;
+  RgbTraits::address_t dst =
+    (RgbTraits::address_t)image->getPixelAddress(0, line);
 
-  for (i=0; i<length; i++) {
-    b = fgetc(f);
-    g = fgetc(f);
-    r = fgetc(f);
-    fgetc(f);
-    put_pixel(image, i, line, rgba(r, g, b, 255));
-  }
+  for (int i=0; i<length; i++, src+=4)
+    dst[i] = rgba(src[2], src[1], src[0], 255);
 }
 
 /* read_image:
@@ -346,20 +292,26 @@ static void read_32bit_line(int length, FILE *f, Image *image, int line)
 static void read_image(FILE *f, Image *image, const BITMAPINFOHEADER *infoheader, FileOp *fop)
 {
   int i, line, height, dir;
+  int width = (int)infoheader->biWidth;
 
   height = (int)infoheader->biHeight;
   line   = height < 0 ? 0: height-1;
   dir    = height < 0 ? 1: -1;
   height = ABS(height);
 
+  // Each scanline is padded to 32 bits
+  std::vector<uint8_t> buf(((width*infoheader->biBitCount + 31) / 32) * 4);
+
   for (i=0; i<height; i++, line+=dir) {
+    read_line(f, buf);
+
     switch (infoheader->biBitCount) {
-      case 1: read_1bit_line(infoheader->biWidth, f, image, line); break;
-      case 4: read_4bit_line(infoheader->biWidth, f, image, line); break;
-      case 8: read_8bit_line(infoheader->biWidth, f, image, line); break;
-      case 16: read_16bit_line(infoheader->biWidth, f, image, line); break;
-      case 24: read_24bit_line(infoheader->biWidth, f, image, line); break;
-      case 32: read_32bit_line(infoheader->biWidth, f, image, line); break;
+      case 1: read_1bit_line(width, &buf[0], image, line); break;
+      case 4: read_4bit_line(width, &buf[0], image, line); break;
+      case 8: read_8bit_line(width, &buf[0], image, line); break;
+      case 16: read_16bit_line(width, &buf[0], image, line); break;
+      case 24: read_24bit_line(width, &buf[0], image, line); break;
+      case 32: read_32bit_line(width, &buf[0], image, line); break;
     }
 
     fop_progress(fop, (float)(i+1) / (float)(height));
@@ -566,12 +518,21 @@ static int read_bitfields_image(FILE *f, Image *image, BITMAPINFOHEADER *infohea
   bytes_per_pixel = ((bits_per_pixel / 8) +
                      ((bits_per_pixel % 8) > 0 ? 1: 0));
 
+  // Each scanline is padded to 32 bits
+  std::vector<uint8_t> buf(((bytes_per_pixel*(int)infoheader->biWidth + 3) / 4) * 4);
+
   for (i=0; i<height; i++, line+=dir) {
-    for (j=0; j<(int)infoheader->biWidth; j++) {
+    read_line(f, buf);
+
+    const uint8_t* src = (buf.empty() ? nullptr: &buf[0]);
+    RgbTraits::address_t dst =
+      (RgbTraits::address_t)image->getPixelAddress(0, line);
+
+    for (j=0; j<(int)infoheader->biWidth; j++, src+=bytes_per_pixel) {
       /* read the DWORD, WORD or BYTE in little-endian order */
       buffer = 0;
       for (k=0; k<bytes_per_pixel; k++)
-        buffer |= fgetc(f) << (k<<3);
+        buffer |= (unsigned long)src[k] << (k<<3);
 
       r = (buffer & rmask) >> rshift;
       g = (buffer & gmask) >> gshift;
@@ -581,13 +542,8 @@ static int read_bitfields_image(FILE *f, Image *image, BITMAPINFOHEADER *infohea
       g = gscale ? gscale(g): g;
       b = bscale ? bscale(b): b;
 
-      put_pixel_fast<RgbTraits>(image, j, line, rgba(r, g, b, 255));
+      dst[j] = rgba(r, g, b, 255);
     }
-
-    j = (bytes_per_pixel*j) % 4;
-    if (j > 0)
-      while (j++ < 4)
-        fgetc(f);
   }
 
   return 0;
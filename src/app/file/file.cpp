@@ -28,11 +28,14 @@
 #include "base/scoped_lock.h"
 #include "base/shared_ptr.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
+#include "base/tracing.h"
 #include "doc/doc.h"
 #include "render/quantization.h"
 #include "render/render.h"
 #include "ui/alert.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cstdarg>
 
@@ -43,6 +46,30 @@ using namespace base;
 static FileOp* fop_new(FileOpType type, Context* context);
 static void fop_prepare_for_sequence(FileOp* fop);
 
+namespace {
+
+// Reports the combined progress of several file operations (the
+// progress of each operation is a part of the "total" token). It's
+// called from several worker threads at the same time.
+class FileOpsProgress : public IFileOpProgress {
+public:
+  FileOpsProgress(const base::progress_token* total, IFileOpProgress* delegate)
+    : m_total(total)
+    , m_delegate(delegate) {
+  }
+
+  void ackFileOpProgress(double progress) override {
+    if (m_delegate)
+      m_delegate->ackFileOpProgress(m_total->progress());
+  }
+
+private:
+  const base::progress_token* m_total;
+  IFileOpProgress* m_delegate;
+};
+
+} // anonymous namespace
+
 std::string get_readable_extensions()
 {
   std::string buf;
@@ -102,6 +129,39 @@ Document* load_document(Context* context, const char* filename)
   return document;
 }
 
+std::vector<Document*> load_documents(Context* context, const std::vector<std::string>& filenames)
+{
+  std::vector<FileOp*> fops(filenames.size(), nullptr);
+  std::vector<FileOp*> validFops;
+  for (std::size_t i=0; i<filenames.size(); ++i) {
+    fops[i] = fop_to_load_document(context, filenames[i].c_str(), FILE_LOAD_SEQUENCE_NONE);
+    if (fops[i])
+      validFops.push_back(fops[i]);
+  }
+
+  fop_operate_all(validFops, NULL);
+
+  // Post-load processing and errors in the original order
+  std::vector<Document*> documents(filenames.size(), nullptr);
+  for (std::size_t i=0; i<fops.size(); ++i) {
+    FileOp* fop = fops[i];
+    if (!fop)
+      continue;
+
+    fop_post_load(fop);
+
+    if (fop->has_error()) {
+      Console console(context);
+      console.printf(fop->error.c_str());
+    }
+
+    documents[i] = fop->document;
+    fop_free(fop);
+  }
+
+  return documents;
+}
+
 int save_document(Context* context, doc::Document* document)
 {
   ASSERT(dynamic_cast<app::Document*>(document));
@@ -220,6 +280,10 @@ FileOp* fop_to_load_document(Context* context, const char* filename, int flags)
   if (flags & FILE_LOAD_ONE_FRAME)
     fop->oneframe = true;
 
+  // Decode cels when they are needed
+  if (flags & FILE_LOAD_LAZY_CELS)
+    fop->lazycels = true;
+
 done:;
   return fop;
 }
@@ -456,20 +520,144 @@ FileOp* fop_to_save_document(const Context* context, const Document* document,
 //
 // After this function you must to mark the "fop" as "done" calling
 // fop_done() function.
+namespace {
+
+  // Group of files of a sequence that are loaded/saved in parallel.
+  // Each file is processed with its own FileOp (with a copy of the
+  // palette and the format options of the sequence), and then the
+  // results are added to the sequence in order from the calling
+  // thread.
+  class SequenceFiles {
+  public:
+    SequenceFiles(FileOp* fop, int first, int n)
+      : m_results(n, 0) {
+      try {
+        for (int i=0; i<n; ++i)
+          m_fops.push_back(createFileOp(fop, first+i));
+      }
+      catch (...) {
+        destroyFileOps();
+        throw;
+      }
+    }
+
+    ~SequenceFiles() {
+      destroyFileOps();
+    }
+
+    int size() const { return int(m_fops.size()); }
+    FileOp* operator[](int i) const { return m_fops[i]; }
+    bool result(int i) const { return (m_results[i] != 0); }
+
+    // Calls "f" for each file in parallel, "f" returns true if the
+    // file was loaded/saved successfully.
+    template<typename Func>
+    void operate(Func f) {
+      base::thread_pool::global().parallel_for(
+        size(), [this, &f](int i) {
+          FileOp* fop = m_fops[i];
+          try {
+            m_results[i] = (f(fop, i) ? 1: 0);
+          }
+          catch (const std::exception& e) {
+            fop_error(fop, "%s\n", e.what());
+            m_results[i] = 0;
+          }
+        });
+    }
+
+  private:
+    static FileOp* createFileOp(FileOp* seqFop, int index) {
+      FileOp* fop = new FileOp;
+      fop->type = seqFop->type;
+      fop->format = seqFop->format;
+      fop->format_data = NULL;
+      fop->context = seqFop->context;
+      fop->document = NULL;
+      fop->filename = seqFop->seq.filename_list[index];
+      fop->mutex = new base::mutex();
+      fop->progressInterface = NULL;
+      fop->done = false;
+      fop->oneframe = false;
+      fop->lazycels = false;
+      fop->preview_size = 0;
+      fop->preview_frame = frame_t(0);
+      fop->seq.palette = new Palette(*seqFop->seq.palette);
+      fop->seq.progress_offset = 0.0f;
+      fop->seq.progress_fraction = 0.0f;
+      fop->seq.frame = frame_t(index);
+      fop->seq.has_alpha = false;
+      fop->seq.layer = NULL;
+      fop->seq.last_cel = NULL;
+      fop->seq.format_options = seqFop->seq.format_options;
+      fop->seq.solo_layer = NULL;
+
+      // Stopping the sequence stops each file (the progress is
+      // reported by the sequence FileOp).
+      fop->progress.set_parent(&seqFop->progress, 0.0);
+
+      // To load a file, the FileOp has its own document (with the
+      // properties of the sequence document) to receive the image.
+      // To save a file, the sequence document is shared (read-only).
+      if (seqFop->type == FileOpLoad) {
+        const Sprite* seqSprite = seqFop->document->sprite();
+        Sprite* sprite = new Sprite(seqSprite->pixelFormat(),
+                                    seqSprite->width(),
+                                    seqSprite->height(), 256);
+        try {
+          sprite->setTransparentColor(seqSprite->transparentColor());
+          fop->seq.layer = new LayerImage(sprite);
+          sprite->folder()->addLayer(fop->seq.layer);
+          fop->createDocument(sprite);
+        }
+        catch (...) {
+          delete sprite;
+          delete fop;
+          throw;
+        }
+      }
+      else
+        fop->document = seqFop->document;
+
+      return fop;
+    }
+
+    void destroyFileOps() {
+      for (FileOp* fop : m_fops) {
+        if (fop->type == FileOpLoad) {
+          delete fop->seq.last_cel;
+          delete fop->document;
+        }
+        delete fop;
+      }
+      m_fops.clear();
+    }
+
+    std::vector<FileOp*> m_fops;
+    std::vector<char> m_results;
+  };
+
+} // anonymous namespace
+
 void fop_operate(FileOp *fop, IFileOpProgress* progress)
 {
+  TRACE_ZONE("fop_operate");
+
   ASSERT(fop != NULL);
   ASSERT(!fop_is_done(fop));
 
   fop->progressInterface = progress;
 
+  // Sequences are loaded/saved in groups of files processed in
+  // parallel (the size of the group limits the used memory).
+  const int groupSize = base::thread_pool::global().workers()+1;
+
   // Load //////////////////////////////////////////////////////////////////////
   if (fop->type == FileOpLoad &&
       fop->format != NULL &&
       fop->format->support(FILE_SUPPORT_LOAD)) {
     // Load a sequence
     if (fop->is_sequence()) {
-      Image* old_image;
       bool loadres;
 
       // Default palette
@@ -487,7 +675,6 @@ void fop_operate(FileOp *fop, IFileOpProgress* progress)
           fop->document->sprite()->setPalette(fop->seq.palette, true);  \
         }                                                               \
                                                                         \
-        old_image = fop->seq.image.get();                               \
         fop->seq.image.reset(NULL);                                     \
         fop->seq.last_cel = NULL;                                       \
       } while (0)
@@ -495,72 +682,81 @@ void fop_operate(FileOp *fop, IFileOpProgress* progress)
       // Load the sequence
       frame_t frames(fop->seq.filename_list.size());
       frame_t frame(0);
-      old_image = nullptr;
 
       fop->seq.has_alpha = false;
       fop->seq.progress_offset = 0.0f;
       fop->seq.progress_fraction = 1.0f / (double)frames;
 
-      std::vector<std::string>::iterator it = fop->seq.filename_list.begin();
-      std::vector<std::string>::iterator end = fop->seq.filename_list.end();
-      for (; it != end; ++it) {
-        fop->filename = it->c_str();
+      // The first file is loaded directly in "fop" to create the
+      // document.
+      fop->filename = fop->seq.filename_list[0];
+      loadres = fop->format->load(fop);
+      if (!loadres) {
+        fop_error(fop, "Error loading frame %d from file \"%s\"\n",
+                  frame+1, fop->filename.c_str());
+      }
 
-        // Call the "load" procedure to read the first bitmap.
-        loadres = fop->format->load(fop);
-        if (!loadres) {
-          fop_error(fop, "Error loading frame %d from file \"%s\"\n",
-                    frame+1, fop->filename.c_str());
-        }
+      // Error reading the first frame
+      if (!loadres || !fop->document || !fop->seq.last_cel) {
+        fop->seq.image.reset();
+        delete fop->seq.last_cel;
+        delete fop->document;
+        fop->document = nullptr;
+      }
+      // Read ok
+      else {
+        // Add the keyframe
+        SEQUENCE_IMAGE();
 
-        // For the first frame...
-        if (!old_image) {
-          // Error reading the first frame
-          if (!loadres || !fop->document || !fop->seq.last_cel) {
-            fop->seq.image.reset();
-            delete fop->seq.last_cel;
-            delete fop->document;
-            fop->document = nullptr;
-            break;
-          }
-          // Read ok
-          else {
-            // Add the keyframe
-            SEQUENCE_IMAGE();
-          }
-        }
-        // For other frames
-        else {
-          // All done (or maybe not enough memory)
-          if (!loadres || !fop->seq.last_cel) {
-            fop->seq.image.reset();
-            delete fop->seq.last_cel;
-            break;
-          }
+        ++frame;
+        fop->seq.progress_offset += fop->seq.progress_fraction;
 
-          // Compare the old frame with the new one
-#if USE_LINK // TODO this should be configurable through a check-box
-          if (count_diff_between_images(old_image, fop->seq.image)) {
-            SEQUENCE_IMAGE();
-          }
-          // We don't need this image
-          else {
-            delete fop->seq.image;
+        // Other frames
+        bool ok = true;
+        while (ok && frame < frames && !fop_is_stop(fop)) {
+          SequenceFiles files(fop, frame, std::min<int>(groupSize, frames-frame));
+          files.operate(
+            [](FileOp* fileFop, int i) -> bool {
+              return fileFop->format->load(fileFop);
+            });
+
+          for (int i=0; i<files.size(); ++i) {
+            FileOp* fileFop = files[i];
+            loadres = files.result(i);
+
+            if (fileFop->has_error())
+              fop_error(fop, "%s", fileFop->error.c_str());
+
+            if (!loadres) {
+              fop_error(fop, "Error loading frame %d from file \"%s\"\n",
+                        frame+1, fileFop->filename.c_str());
+            }
+
+            // All done (or maybe not enough memory)
+            if (!loadres || !fileFop->seq.last_cel) {
+              ok = false;
+              break;
+            }
+
+            // Move the loaded image to the sequence
+            fop->seq.image = fileFop->seq.image;
+            fop->seq.last_cel = fileFop->seq.last_cel;
+            fileFop->seq.image.reset(NULL);
+            fileFop->seq.last_cel = NULL;
+
+            fileFop->seq.palette->copyColorsTo(fop->seq.palette);
+            if (fileFop->seq.has_alpha)
+              fop->seq.has_alpha = true;
+            fop->document->sprite()->setTransparentColor(
+              fileFop->document->sprite()->transparentColor());
 
-            // But add a link frame
-            fop->seq.last_cel->image = image_index;
-            layer_add_frame(fop->seq.layer, fop->seq.last_cel);
+            SEQUENCE_IMAGE();
 
-            fop->seq.last_image = NULL;
-            fop->seq.last_cel = NULL;
+            fop_progress(fop, 1.0f);
+            ++frame;
+            fop->seq.progress_offset += fop->seq.progress_fraction;
           }
-#else
-          SEQUENCE_IMAGE();
-#endif
         }
-
-        ++frame;
-        fop->seq.progress_offset += fop->seq.progress_fraction;
       }
       fop->filename = *fop->seq.filename_list.begin();
 
@@ -597,39 +793,55 @@ void fop_operate(FileOp *fop, IFileOpProgress* progress)
 
       Sprite* sprite = fop->document->sprite();
 
-      // Create a temporary bitmap
-      fop->seq.image.reset(Image::create(sprite->pixelFormat(),
-          sprite->width(),
-          sprite->height()));
-
       fop->seq.progress_offset = 0.0f;
       fop->seq.progress_fraction = 1.0f / (double)sprite->totalFrames();
 
-      // For each frame in the sprite.
-      render::Render render;
-      for (frame_t frame(0); frame < sprite->totalFrames(); ++frame) {
-        // Draw the "frame" in "fop->seq.image"
-        render.renderSprite(fop->seq.image.get(), sprite, frame);
-
-        // Setup the palette.
-        sprite->palette(frame)->copyColorsTo(fop->seq.palette);
-
-        // Setup the filename to be used.
-        fop->filename = fop->seq.filename_list[frame];
+      // For each group of frames in the sprite.
+      bool ok = true;
+      for (frame_t first(0);
+           ok && first < sprite->totalFrames() && !fop_is_stop(fop);
+           first += groupSize) {
+        SequenceFiles files(fop, first,
+                            std::min<int>(groupSize, sprite->totalFrames()-first));
+        const Layer* soloLayer = fop->seq.solo_layer;
+        files.operate(
+          [sprite, first, soloLayer](FileOp* fileFop, int i) -> bool {
+            frame_t frame = first+i;
+
+            // Draw the "frame" in the image of this file
+            fileFop->seq.image.reset(Image::create(sprite->pixelFormat(),
+                sprite->width(),
+                sprite->height()));
+
+            render::Render render;
+            render.setSoloLayer(soloLayer);
+            render.renderSprite(fileFop->seq.image.get(), sprite, frame);
+
+            // Setup the palette.
+            sprite->palette(frame)->copyColorsTo(fileFop->seq.palette);
+
+            return fileFop->format->save(fileFop);
+          });
+
+        for (int i=0; i<files.size(); ++i) {
+          FileOp* fileFop = files[i];
+
+          if (fileFop->has_error())
+            fop_error(fop, "%s", fileFop->error.c_str());
+
+          // Did the "save" procedure fail?
+          if (!files.result(i)) {
+            fop_error(fop, "Error saving frame %d in the file \"%s\"\n",
+              first+i+1, fileFop->filename.c_str());
+            ok = false;
+            break;
+          }
 
-        // Call the "save" procedure... did it fail?
-        if (!fop->format->save(fop)) {
-          fop_error(fop, "Error saving frame %d in the file \"%s\"\n",
-            frame+1, fop->filename.c_str());
-          break;
+          fop_progress(fop, 1.0f);
+          fop->seq.progress_offset += fop->seq.progress_fraction;
         }
-
-        fop->seq.progress_offset += fop->seq.progress_fraction;
       }
       fop->filename = *fop->seq.filename_list.begin();
-
-      // Destroy the image
-      fop->seq.image.reset(NULL);
     }
     // Direct save to a file.
     else {
@@ -649,19 +861,48 @@ void fop_operate(FileOp *fop, IFileOpProgress* progress)
   fop_progress(fop, 1.0f);
 }
 
+void fop_operate_all(const std::vector<FileOp*>& fops, IFileOpProgress* progress)
+{
+  TRACE_ZONE("fop_operate_all");
+
+  base::progress_token total;
+  for (FileOp* fop : fops)
+    fop->progress.set_parent(&total, 1.0 / fops.size());
+
+  FileOpsProgress progresses(&total, progress);
+
+  base::thread_pool::global().parallel_for(
+    int(fops.size()),
+    [&fops, &progresses](int i) {
+      FileOp* fop = fops[i];
+
+      // An exception only aborts the operation of its own file
+      try {
+        fop_operate(fop, &progresses);
+      }
+      catch (const std::exception& e) {
+        fop_error(fop, "Error %s file:\n%s",
+                  (fop->type == FileOpLoad ? "loading": "saving"), e.what());
+      }
+
+      fop_done(fop);
+    });
+
+  for (FileOp* fop : fops)
+    fop->progress.set_parent(nullptr, 0.0);
+}
+
 // After mark the 'fop' as 'done' you must to free it calling fop_free().
 void fop_done(FileOp *fop)
 {
   // Finally done.
-  scoped_lock lock(*fop->mutex);
   fop->done = true;
 }
 
 void fop_stop(FileOp *fop)
 {
-  scoped_lock lock(*fop->mutex);
   if (!fop->done)
-    fop->stop = true;
+    fop->progress.cancel();
 }
 
 FileOp::~FileOp()
@@ -802,16 +1043,13 @@ void fop_error(FileOp *fop, const char *format, ...)
 
 void fop_progress(FileOp *fop, double progress)
 {
-  scoped_lock lock(*fop->mutex);
-
   if (fop->is_sequence()) {
-    fop->progress =
+    progress =
       fop->seq.progress_offset +
       fop->seq.progress_fraction*progress;
   }
-  else {
-    fop->progress = progress;
-  }
+
+  fop->progress.set_progress(progress);
 
   if (fop->progressInterface)
     fop->progressInterface->ackFileOpProgress(progress);
@@ -819,34 +1057,19 @@ void fop_progress(FileOp *fop, double progress)
 
 double fop_get_progress(FileOp *fop)
 {
-  double progress;
-  {
-    scoped_lock lock(*fop->mutex);
-    progress = fop->progress;
-  }
-  return progress;
+  return fop->progress.progress();
 }
 
 // Returns true when the file operation finished, this means, when the
 // fop_operate() routine ends.
 bool fop_is_done(FileOp *fop)
 {
-  bool done;
-  {
-    scoped_lock lock(*fop->mutex);
-    done = fop->done;
-  }
-  return done;
+  return fop->done;
 }
 
 bool fop_is_stop(FileOp *fop)
 {
-  bool stop;
-  {
-    scoped_lock lock(*fop->mutex);
-    stop = fop->stop;
-  }
-  return stop;
+  return fop->progress.canceled();
 }
 
 static FileOp* fop_new(FileOpType type, Context* context)
@@ -860,11 +1083,12 @@ static FileOp* fop_new(FileOpType type, Context* context)
   fop->document = NULL;
 
   fop->mutex = new base::mutex();
-  fop->progress = 0.0f;
   fop->progressInterface = NULL;
   fop->done = false;
-  fop->stop = false;
   fop->oneframe = false;
+  fop->lazycels = false;
+  fop->preview_size = 0;
+  fop->preview_frame = frame_t(0);
 
   fop->seq.palette = NULL;
   fop->seq.image.reset(NULL);
@@ -873,6 +1097,7 @@ static FileOp* fop_new(FileOpType type, Context* context)
   fop->seq.frame = frame_t(0);
   fop->seq.layer = NULL;
   fop->seq.last_cel = NULL;
+  fop->seq.solo_layer = NULL;
 
   return fop;
 }
@@ -9,11 +9,13 @@
 #define APP_FILE_FILE_H_INCLUDED
 #pragma once
 
+#include "base/progress_token.h"
 #include "base/shared_ptr.h"
 #include "doc/frame.h"
 #include "doc/image_ref.h"
 #include "doc/pixel_format.h"
 
+#include <atomic>
 #include <stdio.h>
 #include <string>
 #include <vector>
@@ -22,6 +24,7 @@
 #define FILE_LOAD_SEQUENCE_ASK          0x00000002
 #define FILE_LOAD_SEQUENCE_YES          0x00000004
 #define FILE_LOAD_ONE_FRAME             0x00000008
+#define FILE_LOAD_LAZY_CELS             0x00000010
 
 namespace base {
   class mutex;
@@ -71,15 +74,28 @@ namespace app {
     std::string filename;         // File-name to load/save.
 
     // Shared fields between threads.
-    base::mutex* mutex;           // Mutex to access to the next two fields.
-    double progress;              // Progress (1.0 is ready).
+    base::progress_token progress; // Progress (1.0 is ready), and
+                                  // flag to force the break of the
+                                  // operation (fop_stop()).
     IFileOpProgress* progressInterface;
+    base::mutex* mutex;           // Mutex to access to the error string.
     std::string error;            // Error string.
-    bool done;                    // True if the operation finished.
-    bool stop;                    // Force the break of the operation.
+    std::atomic<bool> done;       // True if the operation finished.
     bool oneframe;                // Load just one frame (in formats
                                   // that support animation like
                                   // GIF/FLI/ASE).
+    bool lazycels;                // Decode cel images when they are
+                                  // used for first time (ASE only).
+    int preview_size;             // If it's > 0, the document is used
+                                  // just for a preview (e.g. a
+                                  // thumbnail) of this size, so
+                                  // formats can load a smaller image
+                                  // (not smaller than this size)
+                                  // and only the first frame.
+    frame_t preview_frame;        // Frame to load with "oneframe" or
+                                  // "preview_size" (ASE files with a
+                                  // frame index seek it directly,
+                                  // other formats load the first one).
 
     // Data for sequences.
     struct {
@@ -95,6 +111,9 @@ namespace app {
       LayerImage* layer;
       Cel* last_cel;
       base::SharedPtr<FormatOptions> format_options;
+      // To save sequences.
+      const Layer* solo_layer;    // If it's not NULL, only this layer is
+                                  // saved (even if it's hidden).
     } seq;
 
     ~FileOp();
@@ -118,6 +137,12 @@ namespace app {
   // High-level routines to load/save documents.
 
   app::Document* load_document(Context* context, const char* filename);
+
+  // Loads all the given files at the same time. Returns the
+  // documents in the same order as "filenames" (NULL for files that
+  // couldn't be loaded). The documents are not added to the context,
+  // so the caller decides when each one is available.
+  std::vector<app::Document*> load_documents(Context* context, const std::vector<std::string>& filenames);
   int save_document(Context* context, doc::Document* document);
 
   // Low-level routines to load/save documents.
@@ -125,6 +150,11 @@ namespace app {
   FileOp* fop_to_load_document(Context* context, const char* filename, int flags);
   FileOp* fop_to_save_document(const Context* context, const Document* document, const char* filename, const char* fn_format);
   void fop_operate(FileOp* fop, IFileOpProgress* progress);
+
+  // Operates all the given file operations concurrently in the
+  // global thread pool and marks them as done. "progress" receives
+  // the average progress of all operations.
+  void fop_operate_all(const std::vector<FileOp*>& fops, IFileOpProgress* progress);
   void fop_done(FileOp* fop);
   void fop_stop(FileOp* fop);
   void fop_free(FileOp* fop);
@@ -0,0 +1,336 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/benchmark.h"
+
+#include "app/context.h"
+#include "app/document.h"
+#include "app/file/file.h"
+#include "app/file/file_formats_manager.h"
+#include "base/chrono.h"
+#include "base/fs.h"
+#include "doc/doc.h"
+#include "doc/test_context.h"
+
+#include <string>
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+using namespace app;
+
+namespace {
+
+// Formats to benchmark (range_x of each benchmark)
+const char* kFormats[] = {
+  "ase", "png", "gif", "jpg", "bmp", "tga", "pcx", "fli", "ico"
+};
+
+enum { ASE, PNG, GIF, JPG, BMP, TGA, PCX, FLI, ICO };
+
+// Synthetic sprites (range_y of each benchmark)
+enum {
+  LAYERS_RGB,           // 256x256, 32 layers
+  LAYERS_INDEXED,
+  ANIMATION_RGB,        // 128x128, 2 layers, 100 frames
+  ANIMATION_INDEXED,
+  LARGE_RGB,            // 2048x2048, 1 layer
+  LARGE_INDEXED,
+  ICON_RGB,             // 64x64, 1 layer
+  ICON_INDEXED,
+};
+
+struct Corpus {
+  const char* name;
+  int width, height;
+  int layers;
+  int frames;
+  bool indexed;
+};
+
+const Corpus kCorpus[] = {
+  { "layers rgb",         256,  256, 32,   1, false },
+  { "layers indexed",     256,  256, 32,   1, true  },
+  { "animation rgb",      128,  128,  2, 100, false },
+  { "animation indexed",  128,  128,  2, 100, true  },
+  { "large rgb",         2048, 2048,  1,   1, false },
+  { "large indexed",     2048, 2048,  1,   1, true  },
+  { "icon rgb",            64,   64,  1,   1, false },
+  { "icon indexed",        64,   64,  1,   1, true  },
+};
+
+// Peak of memory used by the process (in MB). It's the peak of all
+// the benchmarks executed before, use --benchmark_filter to get the
+// value of only one benchmark.
+double peak_memory_mb()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (::GetProcessMemoryInfo(::GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return pmc.PeakWorkingSetSize / (1024.0*1024.0);
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+  #ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0*1024.0); // In bytes
+  #else
+    return usage.ru_maxrss / 1024.0;          // In KB
+  #endif
+  }
+#endif
+  return 0.0;
+}
+
+// Pixels similar to real sprites (areas of the same color and noise)
+// so compressed formats don't take the best or the worst case.
+void fill_image(Image* image, bool indexed, uint32_t seed)
+{
+  color_t c = 0;
+  for (int y=0; y<image->height(); ++y) {
+    for (int x=0; x<image->width(); ++x) {
+      seed = seed*1103515245 + 12345;
+      if (((seed >> 16) & 7) == 0) {
+        if (indexed)
+          c = (seed >> 8) & 0xff;
+        else
+          c = rgba((seed >> 8) & 0xff, (seed >> 16) & 0xff, (seed >> 24) & 0xff, 255);
+      }
+      put_pixel(image, x, y, c);
+    }
+  }
+}
+
+doc::Document* create_document(app::Context* ctx, const Corpus& corpus,
+                               const std::string& filename)
+{
+  doc::Document* doc = ctx->documents().add(
+    corpus.width, corpus.height,
+    (corpus.indexed ? doc::ColorMode::INDEXED: doc::ColorMode::RGB), 256);
+  doc->setFilename(filename);
+
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(frame_t(corpus.frames));
+
+  Palette* pal = sprite->palette(frame_t(0));
+  for (int i=0; i<pal->size(); ++i)
+    pal->setEntry(i, rgba(i, 255-i, (i*7) & 0xff, 255));
+
+  LayerImage* firstLayer = static_cast<LayerImage*>(sprite->folder()->getFirstLayer());
+  uint32_t seed = 1;
+  for (int i=0; i<corpus.layers; ++i) {
+    LayerImage* layer = firstLayer;
+    if (i > 0) {
+      layer = new LayerImage(sprite);
+      sprite->folder()->addLayer(layer);
+    }
+
+    for (frame_t frame(0); frame<corpus.frames; ++frame) {
+      Cel* cel = layer->cel(frame);
+      if (!cel) {
+        ImageRef image(Image::create(sprite->pixelFormat(), corpus.width, corpus.height));
+        cel = new Cel(frame, image);
+        layer->addCel(cel);
+      }
+      fill_image(cel->image(), corpus.indexed, seed++);
+    }
+  }
+
+  return doc;
+}
+
+// Total size of the saved file (or files if it's a sequence)
+double saved_bytes(const FileOp* fop)
+{
+  double bytes = 0.0;
+  if (fop->is_sequence()) {
+    for (const std::string& fn : fop->seq.filename_list)
+      bytes += double(base::file_size(fn));
+  }
+  else
+    bytes = double(base::file_size(fop->filename));
+  return bytes;
+}
+
+void delete_saved_files(const FileOp* fop)
+{
+  if (fop->is_sequence()) {
+    for (const std::string& fn : fop->seq.filename_list)
+      if (base::is_file(fn))
+        base::delete_file(fn);
+  }
+  else if (base::is_file(fop->filename))
+    base::delete_file(fop->filename);
+}
+
+void register_all_formats()
+{
+  static bool registered = false;
+  if (!registered) {
+    FileFormatsManager::instance()->registerAllFormats();
+    registered = true;
+  }
+}
+
+std::string corpus_filename(int format)
+{
+  return std::string("benchmark_corpus.") + kFormats[format];
+}
+
+// Saves the corpus range_y with the format range_x
+void BM_SaveDocument(benchmark::State& state)
+{
+  const int format = state.range_x();
+  const Corpus& corpus = kCorpus[state.range_y()];
+
+  register_all_formats();
+  doc::TestContextT<app::Context> ctx;
+
+  const std::string fn = corpus_filename(format);
+  doc::Document* doc = create_document(&ctx, corpus, fn);
+
+  base::Chrono chrono;
+  double prepare = 0.0, operate = 0.0, bytes = 0.0;
+
+  while (state.KeepRunning()) {
+    chrono.reset();
+    FileOp* fop = fop_to_save_document(&ctx, static_cast<app::Document*>(doc), fn.c_str(), "");
+    prepare += chrono.elapsed();
+    if (!fop) {
+      state.SkipWithError("Cannot save " + fn);
+      continue;
+    }
+
+    chrono.reset();
+    fop_operate(fop, NULL);
+    fop_done(fop);
+    operate += chrono.elapsed();
+
+    if (fop->has_error()) {
+      state.SkipWithError(fop->error);
+      fop_free(fop);
+      continue;
+    }
+
+    bytes += saved_bytes(fop);
+    if (state.iterations() == 1)
+      state.counters["file_kb"] = saved_bytes(fop) / 1024.0;
+
+    delete_saved_files(fop);
+    fop_free(fop);
+  }
+
+  doc->close();
+  delete doc;
+
+  state.SetLabel(corpus.name);
+  state.SetBytesProcessed((long long)bytes);
+  state.counters["prepare_ms"] = 1000.0 * prepare / state.iterations();
+  state.counters["operate_ms"] = 1000.0 * operate / state.iterations();
+  state.counters["peak_rss_mb"] = peak_memory_mb();
+}
+
+// Loads the corpus range_y saved with the format range_x
+void BM_LoadDocument(benchmark::State& state)
+{
+  const int format = state.range_x();
+  const Corpus& corpus = kCorpus[state.range_y()];
+
+  register_all_formats();
+  doc::TestContextT<app::Context> ctx;
+
+  // Save the file to be loaded
+  const std::string fn = corpus_filename(format);
+  {
+    doc::Document* doc = create_document(&ctx, corpus, fn);
+    save_document(&ctx, doc);
+    doc->close();
+    delete doc;
+  }
+
+  const double bytes = double(base::is_file(fn) ? base::file_size(fn): 0);
+  base::Chrono chrono;
+  double open = 0.0, operate = 0.0, postLoad = 0.0;
+
+  while (state.KeepRunning()) {
+    chrono.reset();
+    FileOp* fop = fop_to_load_document(&ctx, fn.c_str(), FILE_LOAD_SEQUENCE_NONE);
+    open += chrono.elapsed();
+    if (!fop) {
+      state.SkipWithError("Cannot load " + fn);
+      continue;
+    }
+
+    chrono.reset();
+    fop_operate(fop, NULL);
+    fop_done(fop);
+    operate += chrono.elapsed();
+
+    chrono.reset();
+    fop_post_load(fop);
+    postLoad += chrono.elapsed();
+
+    if (fop->has_error())
+      state.SkipWithError(fop->error);
+
+    app::Document* doc = fop->document;
+    fop_free(fop);
+
+    if (doc) {
+      doc->close();
+      delete doc;
+    }
+  }
+
+  if (base::is_file(fn))
+    base::delete_file(fn);
+
+  state.SetLabel(corpus.name);
+  state.SetBytesProcessed((long long)(bytes * state.iterations()));
+  state.counters["file_kb"] = bytes / 1024.0;
+  state.counters["open_ms"] = 1000.0 * open / state.iterations();
+  state.counters["operate_ms"] = 1000.0 * operate / state.iterations();
+  state.counters["post_load_ms"] = 1000.0 * postLoad / state.iterations();
+  state.counters["peak_rss_mb"] = peak_memory_mb();
+}
+
+} // anonymous namespace
+
+// Each file format with the corpus that it can save without losing
+// information (or flattening layers, as most formats only support
+// one layer). Animations are saved only with formats that support
+// frames (other formats would create sequences of files).
+#define FILE_BENCHMARK(func)                    \
+  BENCHMARK(func)                               \
+  ->ArgPair(ASE, LAYERS_RGB)                    \
+  ->ArgPair(ASE, LAYERS_INDEXED)                \
+  ->ArgPair(ASE, ANIMATION_RGB)                 \
+  ->ArgPair(ASE, ANIMATION_INDEXED)             \
+  ->ArgPair(ASE, LARGE_RGB)                     \
+  ->ArgPair(ASE, LARGE_INDEXED)                 \
+  ->ArgPair(PNG, LAYERS_RGB)                    \
+  ->ArgPair(PNG, LARGE_RGB)                     \
+  ->ArgPair(PNG, LARGE_INDEXED)                 \
+  ->ArgPair(GIF, ANIMATION_RGB)                 \
+  ->ArgPair(GIF, ANIMATION_INDEXED)             \
+  ->ArgPair(GIF, LARGE_INDEXED)                 \
+  ->ArgPair(JPG, LARGE_RGB)                     \
+  ->ArgPair(BMP, LARGE_RGB)                     \
+  ->ArgPair(BMP, LARGE_INDEXED)                 \
+  ->ArgPair(TGA, LARGE_RGB)                     \
+  ->ArgPair(TGA, LARGE_INDEXED)                 \
+  ->ArgPair(PCX, LARGE_RGB)                     \
+  ->ArgPair(PCX, LARGE_INDEXED)                 \
+  ->ArgPair(FLI, ANIMATION_INDEXED)             \
+  ->ArgPair(ICO, ICON_RGB)                      \
+  ->ArgPair(ICO, ICON_INDEXED)
+
+FILE_BENCHMARK(BM_SaveDocument);
+FILE_BENCHMARK(BM_LoadDocument);
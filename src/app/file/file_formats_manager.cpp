@@ -28,6 +28,7 @@ extern FileFormat* CreateIcoFormat();
 extern FileFormat* CreateJpegFormat();
 extern FileFormat* CreatePcxFormat();
 extern FileFormat* CreatePngFormat();
+extern FileFormat* CreateRawFramesFormat();
 extern FileFormat* CreateTgaFormat();
 
 static FileFormatsManager* singleton = NULL;
@@ -66,6 +67,7 @@ void FileFormatsManager::registerAllFormats()
   registerFormat(CreateJpegFormat());
   registerFormat(CreatePcxFormat());
   registerFormat(CreatePngFormat());
+  registerFormat(CreateRawFramesFormat());
   registerFormat(CreateTgaFormat());
 }
 
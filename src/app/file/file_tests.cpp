@@ -10,6 +10,7 @@
 #include "app/app.h"
 #include "app/context.h"
 #include "app/document.h"
+#include "app/file/ase_options.h"
 #include "app/file/file.h"
 #include "app/file/file_formats_manager.h"
 #include "doc/doc.h"
@@ -80,3 +81,102 @@ TEST(File, SeveralSizes)
     }
   }
 }
+
+TEST(File, TiledCels)
+{
+  FileFormatsManager::instance()->registerAllFormats();
+  app::Context ctx;
+  const int w = 100, h = 70;
+
+  {
+    app::Document* doc(static_cast<app::Document*>(
+        ctx.documents().add(w, h, doc::ColorMode::RGB, 256)));
+    doc->setFilename("test.ase");
+    doc->setFormatOptions(base::SharedPtr<FormatOptions>(
+        new AseOptions(AseOptions::DefaultCompression, 16)));
+
+    // Repeated 16x16 tiles (the last column and row of tiles are
+    // cropped)
+    Image* image = doc->sprite()->folder()->getFirstLayer()->cel(frame_t(0))->image();
+    for (int y=0; y<h; y++)
+      for (int x=0; x<w; x++)
+        put_pixel(image, x, y, rgba(x%16, y%16, 0, 255));
+
+    save_document(&ctx, doc);
+    doc->close();
+    delete doc;
+  }
+
+  {
+    app::Document* doc = load_document(&ctx, "test.ase");
+    Image* image = doc->sprite()->folder()->getFirstLayer()->cel(frame_t(0))->image();
+    ASSERT_EQ(w, image->width());
+    ASSERT_EQ(h, image->height());
+
+    for (int y=0; y<h; y++)
+      for (int x=0; x<w; x++)
+        ASSERT_EQ(rgba(x%16, y%16, 0, 255), get_pixel(image, x, y));
+
+    doc->close();
+    delete doc;
+  }
+}
+
+TEST(File, SeekFrameWithFrameIndex)
+{
+  FileFormatsManager::instance()->registerAllFormats();
+  app::Context ctx;
+
+  {
+    doc::Document* doc = ctx.documents().add(8, 8, doc::ColorMode::RGB, 256);
+    doc->setFilename("test.ase");
+
+    // Frame N is filled with the color N, and the last frame is a
+    // link to frame 1
+    Sprite* sprite = doc->sprite();
+    LayerImage* layer = static_cast<LayerImage*>(sprite->folder()->getFirstLayer());
+    sprite->setTotalFrames(frame_t(4));
+    for (frame_t frame(0); frame<3; ++frame) {
+      Cel* cel = layer->cel(frame);
+      if (!cel) {
+        cel = new Cel(frame, ImageRef(Image::create(IMAGE_RGB, 8, 8)));
+        layer->addCel(cel);
+      }
+      clear_image(cel->image(), rgba(frame, 0, 0, 255));
+    }
+    Cel* link = Cel::createLink(layer->cel(frame_t(1)));
+    link->setFrame(frame_t(3));
+    layer->addCel(link);
+
+    save_document(&ctx, doc);
+    doc->close();
+    delete doc;
+  }
+
+  for (frame_t frame(0); frame<4; ++frame) {
+    FileOp* fop = fop_to_load_document(&ctx, "test.ase", FILE_LOAD_ONE_FRAME);
+    ASSERT_TRUE(fop != NULL);
+    fop->preview_frame = frame;
+    fop_operate(fop, NULL);
+    fop_done(fop);
+
+    app::Document* doc = fop->document;
+    fop_free(fop);
+    ASSERT_TRUE(doc != NULL);
+
+    // Only the cel of the given frame is loaded
+    Layer* layer = doc->sprite()->folder()->getFirstLayer();
+    for (frame_t i(0); i<4; ++i) {
+      if (i == frame) {
+        ASSERT_TRUE(layer->cel(i) != NULL);
+        EXPECT_EQ(rgba(frame == 3 ? 1: frame, 0, 0, 255),
+                  get_pixel(layer->cel(i)->image(), 0, 0));
+      }
+      else
+        EXPECT_TRUE(layer->cel(i) == NULL);
+    }
+
+    doc->close();
+    delete doc;
+  }
+}
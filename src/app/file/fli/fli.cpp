@@ -130,13 +130,23 @@ void fli_write_header(FILE *f, s_fli_header *fli_header)
         }
 }
 
-void fli_read_frame(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *old_cmap, unsigned char *framebuf, unsigned char *cmap)
+/*
+ * The frame can be decoded in place (framebuf == old_framebuf), and
+ * "dirty" (optional) receives the bounds of the modified pixels.
+ */
+void fli_read_frame(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *old_cmap, unsigned char *framebuf, unsigned char *cmap, s_fli_rect *dirty)
 {
         s_fli_frame fli_frame;
+        s_fli_rect full, unused;
         unsigned long framepos;
         int c;
         framepos=ftell(f);
 
+        full.x1=0; full.y1=0;
+        full.x2=fli_header->width; full.y2=fli_header->height;
+        if (!dirty) dirty=&unused;
+        dirty->x1=dirty->y1=dirty->x2=dirty->y2=0;
+
         fli_frame.size=fli_read_long(f);
         fli_frame.magic=fli_read_short(f);
         fli_frame.chunks=fli_read_short(f);
@@ -152,11 +162,11 @@ void fli_read_frame(FILE *f, s_fli_header *fli_header, unsigned char *old_frameb
                         switch (chunk.magic) {
                                 case FLI_COLOR:   fli_read_color(f, fli_header, old_cmap, cmap); break;
                                 case FLI_COLOR_2: fli_read_color_2(f, fli_header, old_cmap, cmap); break;
-                                case FLI_BLACK:   fli_read_black(f, fli_header, framebuf); break;
-                                case FLI_BRUN:    fli_read_brun(f, fli_header, framebuf); break;
-                                case FLI_COPY:    fli_read_copy(f, fli_header, framebuf); break;
-                                case FLI_LC:      fli_read_lc(f, fli_header, old_framebuf, framebuf); break;
-                                case FLI_LC_2:    fli_read_lc_2(f, fli_header, old_framebuf, framebuf); break;
+                                case FLI_BLACK:   fli_read_black(f, fli_header, framebuf); *dirty=full; break;
+                                case FLI_BRUN:    fli_read_brun(f, fli_header, framebuf); *dirty=full; break;
+                                case FLI_COPY:    fli_read_copy(f, fli_header, framebuf); *dirty=full; break;
+                                case FLI_LC:      fli_read_lc(f, fli_header, old_framebuf, framebuf, dirty); break;
+                                case FLI_LC_2:    fli_read_lc_2(f, fli_header, old_framebuf, framebuf, dirty); break;
                                 case FLI_MINI:    /* unused, skip */ break;
                                 default: /* unknown, skip */ break;
                         }
@@ -165,6 +175,13 @@ void fli_read_frame(FILE *f, s_fli_header *fli_header, unsigned char *old_frameb
                 }
         } /* else: unknown, skip */
         fseek(f, framepos+fli_frame.size, SEEK_SET);
+
+        /* word-oriented packets can write the first pixel of the next line */
+        if (dirty->x2 > full.x2) {
+                dirty->x1=0;
+                dirty->x2=full.x2;
+                if (dirty->y2 < full.y2) dirty->y2++;
+        }
 }
 
 void fli_write_frame(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *old_cmap, unsigned char *framebuf, unsigned char *cmap, unsigned short codec_mask)
@@ -548,17 +565,35 @@ void fli_write_brun(FILE *f, s_fli_header *fli_header, unsigned char *framebuf)
         fseek(f,chunkpos+chunk.size,SEEK_SET);
 }
 
+/*
+ * adds the pixels [x1,x2) of line y to the dirty rectangle
+ */
+static void fli_add_dirty(s_fli_rect *dirty, int x1, int x2, int y)
+{
+        if (x1 >= x2) return;
+        if (dirty->x1 >= dirty->x2) {
+                dirty->x1=x1; dirty->y1=y;
+                dirty->x2=x2; dirty->y2=y+1;
+        } else {
+                if (x1 < dirty->x1) dirty->x1=x1;
+                if (x2 > dirty->x2) dirty->x2=x2;
+                if (y < dirty->y1) dirty->y1=y;
+                if (y+1 > dirty->y2) dirty->y2=y+1;
+        }
+}
+
 /*
  * This is the delta-compression method from the classic Autodesk Animator.
  * It's basically the RLE method from above, but it allows to skip unchanged
  * lines at the beginning and end of an image, and unchanged pixels in a line
  * This chunk is used in FLI files.
  */
-void fli_read_lc(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *framebuf)
+void fli_read_lc(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *framebuf, s_fli_rect *dirty)
 {
         unsigned short yc, firstline, numline;
         unsigned char *pos;
-        memcpy(framebuf, old_framebuf, fli_header->width * fli_header->height);
+        if (framebuf != old_framebuf)
+                memcpy(framebuf, old_framebuf, fli_header->width * fli_header->height);
         firstline = fli_read_short(f);
         numline = fli_read_short(f);
         for (yc=0; yc < numline; yc++) {
@@ -576,9 +611,11 @@ void fli_read_lc(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf,
                                 ps=-(signed char)ps;
                                 val=fli_read_char(f);
                                 memset(&(pos[xc]), val, ps);
+                                fli_add_dirty(dirty, xc, xc+ps, firstline+yc);
                                 xc+=ps;
                         } else {
                                 fread(&(pos[xc]), ps, 1, f);
+                                fli_add_dirty(dirty, xc, xc+ps, firstline+yc);
                                 xc+=ps;
                         }
                 }
@@ -678,11 +715,12 @@ void fli_write_lc(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf
  * the autodesk animator pro. It's word-oriented, and allows to skip
  * larger parts of the image. This chunk is used in FLC files.
  */
-void fli_read_lc_2(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *framebuf)
+void fli_read_lc_2(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *framebuf, s_fli_rect *dirty)
 {
         unsigned short yc, lc, numline;
         unsigned char *pos;
-        memcpy(framebuf, old_framebuf, fli_header->width * fli_header->height);
+        if (framebuf != old_framebuf)
+                memcpy(framebuf, old_framebuf, fli_header->width * fli_header->height);
         yc=0;
         numline = fli_read_short(f);
         for (lc=0; lc < numline; lc++) {
@@ -709,6 +747,7 @@ void fli_read_lc_2(FILE *f, s_fli_header *fli_header, unsigned char *old_framebu
                                 ps=-(signed char)ps;
                                 v1=fli_read_char(f);
                                 v2=fli_read_char(f);
+                                fli_add_dirty(dirty, xc, xc+(ps << 1), yc);
                                 while (ps>0) {
                                         pos[xc++]=v1;
                                         pos[xc++]=v2;
@@ -716,10 +755,14 @@ void fli_read_lc_2(FILE *f, s_fli_header *fli_header, unsigned char *old_framebu
                                 }
                         } else {
                                 fread(&(pos[xc]), ps, 2, f);
+                                fli_add_dirty(dirty, xc, xc+(ps << 1), yc);
                                 xc+=ps << 1;
                         }
                 }
-                if (lpf) pos[xc]=(unsigned char)lpn;
+                if (lpf) {
+                        pos[xc]=(unsigned char)lpn;
+                        fli_add_dirty(dirty, xc, xc+1, yc);
+                }
                 yc++;
         }
 }
@@ -44,6 +44,11 @@ typedef struct _fli_frame {
         unsigned short chunks;
 } s_fli_frame;
 
+/* bounds of modified pixels (x2/y2 are exclusive, empty if x1 >= x2) */
+typedef struct _fli_rect {
+        int x1, y1, x2, y2;
+} s_fli_rect;
+
 typedef struct _fli_chunk {
         unsigned long size;
         unsigned short magic;
@@ -79,15 +84,15 @@ typedef struct _fli_chunk {
 
 /** functions */
 void fli_read_header(FILE *f, s_fli_header *fli_header);
-void fli_read_frame(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *old_cmap, unsigned char *framebuf, unsigned char *cmap);
+void fli_read_frame(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *old_cmap, unsigned char *framebuf, unsigned char *cmap, s_fli_rect *dirty);
 
 void fli_read_color(FILE *f, s_fli_header *fli_header, unsigned char *old_cmap, unsigned char *cmap);
 void fli_read_color_2(FILE *f, s_fli_header *fli_header, unsigned char *old_cmap, unsigned char *cmap);
 void fli_read_black(FILE *f, s_fli_header *fli_header, unsigned char *framebuf);
 void fli_read_brun(FILE *f, s_fli_header *fli_header, unsigned char *framebuf);
 void fli_read_copy(FILE *f, s_fli_header *fli_header, unsigned char *framebuf);
-void fli_read_lc(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *framebuf);
-void fli_read_lc_2(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *framebuf);
+void fli_read_lc(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *framebuf, s_fli_rect *dirty);
+void fli_read_lc_2(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *framebuf, s_fli_rect *dirty);
 
 void fli_write_header(FILE *f, s_fli_header *fli_header);
 void fli_write_frame(FILE *f, s_fli_header *fli_header, unsigned char *old_framebuf, unsigned char *old_cmap, unsigned char *framebuf, unsigned char *cmap, unsigned short codec_mask);
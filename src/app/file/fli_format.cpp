@@ -66,12 +66,10 @@ bool FliFormat::onLoad(FileOp* fop)
   unsigned char cmap[768];
   unsigned char omap[768];
   s_fli_header fli_header;
+  s_fli_rect dirty;
   int c, w, h;
   frame_t frpos_in;
   frame_t frpos_out;
-#ifdef USE_LINK
-  int index = 0;                // TODO this is used to create linked cels
-#endif
 
   // Open the file to read in binary mode
   FileHandle handle(open_file_with_exception(fop->filename, "rb"));
@@ -89,10 +87,12 @@ bool FliFormat::onLoad(FileOp* fop)
   w = fli_header.width;
   h = fli_header.height;
 
-  // Create the bitmaps
+  // Create the bitmaps. Frames are decoded in place in "bmp" (delta
+  // chunks only modify the changed pixels of the previous frame).
   base::UniquePtr<Image> bmp(Image::create(IMAGE_INDEXED, w, h));
-  base::UniquePtr<Image> old(Image::create(IMAGE_INDEXED, w, h));
   base::UniquePtr<Palette> pal(new Palette(frame_t(0), 256));
+  clear_image(bmp, 0);
+  memset(cmap, 0, 768);
 
   // Create the image
   Sprite* sprite = new Sprite(IMAGE_INDEXED, w, h, 256);
@@ -104,56 +104,58 @@ bool FliFormat::onLoad(FileOp* fop)
   sprite->setTotalFrames(frame_t(fli_header.frames));
   sprite->setDurationForAllFrames(fli_header.speed);
 
+  // Last added cel (its image is the previous frame)
+  Cel* last_cel = NULL;
+
   // Write frame by frame
   for (frpos_in = frpos_out = frame_t(0);
        frpos_in < sprite->totalFrames();
        ++frpos_in) {
+    memcpy(omap, cmap, 768);
+
     // Read the frame
     fli_read_frame(f, &fli_header,
-                   (unsigned char *)old->getPixelAddress(0, 0), omap,
-                   (unsigned char *)bmp->getPixelAddress(0, 0), cmap);
+                   (unsigned char *)bmp->getPixelAddress(0, 0), omap,
+                   (unsigned char *)bmp->getPixelAddress(0, 0), cmap,
+                   &dirty);
+
+    // Compare only the modified pixels with the previous frame
+    bool image_changes = (frpos_in == 0);
+    if (!image_changes && dirty.x1 < dirty.x2) {
+      const Image* old = last_cel->image();
+      for (int y=dirty.y1; y<dirty.y2 && !image_changes; ++y)
+        image_changes = (memcmp(bmp->getPixelAddress(dirty.x1, y),
+                                old->getPixelAddress(dirty.x1, y),
+                                dirty.x2 - dirty.x1) != 0);
+    }
+    bool palette_changes = (frpos_in == 0 || memcmp(omap, cmap, 768) != 0);
 
     // First frame, or the frames changes, or the palette changes
-    if ((frpos_in == 0) ||
-        (count_diff_between_images(old, bmp))
-#ifndef USE_LINK /* TODO this should be configurable through a check-box */
-        || (memcmp(omap, cmap, 768) != 0)
-#endif
-        ) {
-      // The image changes?
+    if (image_changes || palette_changes) {
       if (frpos_in != 0)
         ++frpos_out;
 
-      // Add the new frame
-      ImageRef image(Image::createCopy(bmp));
-      Cel* cel = new Cel(frpos_out, image);
+      // Add the new frame, a link to the previous cel if only the
+      // palette changes
+      Cel* cel;
+      if (image_changes)
+        cel = new Cel(frpos_out, ImageRef(Image::createCopy(bmp)));
+      else {
+        cel = Cel::createLink(last_cel);
+        cel->setFrame(frpos_out);
+      }
       layer->addCel(cel);
+      last_cel = cel;
 
-      // First frame or the palette changes
-      if ((frpos_in == 0) || (memcmp(omap, cmap, 768) != 0))
+      if (palette_changes)
         SETPAL();
     }
-#ifdef USE_LINK
-    // The palette changes
-    else if (memcmp(omap, cmap, 768) != 0) {
-      ++frpos_out;
-      SETPAL();
-
-      // Add link
-      Cel* cel = new Cel(frpos_out, index);
-      layer_add_cel(layer, cel);
-    }
-#endif
     // The palette and the image don't change: add duration to the last added frame
     else {
       sprite->setFrameDuration(frpos_out,
                                sprite->frameDuration(frpos_out)+fli_header.speed);
     }
 
-    // Update the old image and color-map to the new ones to compare later
-    copy_image(old, bmp);
-    memcpy(omap, cmap, 768);
-
     // Update progress
     fop_progress(fop, (float)(frpos_in+1) / (float)(sprite->totalFrames()));
     if (fop_is_stop(fop))
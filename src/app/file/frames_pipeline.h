@@ -0,0 +1,117 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_FILE_FRAMES_PIPELINE_H_INCLUDED
+#define APP_FILE_FRAMES_PIPELINE_H_INCLUDED
+#pragma once
+
+#include "base/exception.h"
+#include "base/thread_pool.h"
+#include "base/unique_ptr.h"
+#include "doc/frame.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+
+#include <functional>
+#include <vector>
+
+namespace app {
+
+  // Frames prepared by worker threads (e.g. rendered and converted
+  // to the pixel format of the file) while the previous frames are
+  // written in the file, in order. Only "size" frames are kept in
+  // memory at the same time.
+  class FramesPipeline {
+  public:
+    typedef std::function<void(doc::frame_t, doc::Image*, doc::Palette*)> Prepare;
+
+    FramesPipeline(doc::frame_t nframes, int size,
+                   const doc::Image* image, const doc::Palette* palette,
+                   const Prepare& prepare)
+      : m_nframes(nframes)
+      , m_prepare(prepare)
+      , m_slots(size) {
+      for (int i=0; i<size; ++i) {
+        m_slots[i].image.reset(doc::Image::createCopy(image));
+        m_slots[i].palette.reset(new doc::Palette(*palette));
+      }
+      for (doc::frame_t frame(0); frame<size && frame<nframes; ++frame)
+        start(frame);
+    }
+
+    ~FramesPipeline() {
+      // Wait the running tasks (they use our images).
+      for (Slot& slot : m_slots)
+        if (slot.token)
+          slot.token->cancel();
+    }
+
+    // Returns the image of the given frame (and its palette in
+    // "palette"). If the frame wasn't started by a worker thread yet,
+    // it's prepared in the calling thread.
+    const doc::Image* image(doc::frame_t frame, const doc::Palette** palette) {
+      Slot& slot = m_slots[frame % m_slots.size()];
+      ASSERT(slot.frame == frame);
+
+      if (!slot.ready) {
+        slot.token->cancel();
+        if (slot.token->canceled()) {
+          m_prepare(frame, slot.image, slot.palette);
+          slot.ok = true;
+        }
+        slot.ready = true;
+      }
+
+      if (!slot.ok)
+        throw base::Exception("Error preparing frame %d.\n", (int)frame);
+
+      if (palette)
+        *palette = slot.palette;
+      return slot.image;
+    }
+
+    // The given frame was written, so its memory can be used to
+    // prepare the next one.
+    void release(doc::frame_t frame) {
+      frame += doc::frame_t(m_slots.size());
+      if (frame < m_nframes)
+        start(frame);
+    }
+
+  private:
+    struct Slot {
+      doc::frame_t frame;
+      base::UniquePtr<doc::Image> image;
+      base::UniquePtr<doc::Palette> palette;
+      base::task_token_ptr token;
+      bool ready;
+      bool ok;
+    };
+
+    void start(doc::frame_t frame) {
+      Slot& slot = m_slots[frame % m_slots.size()];
+      slot.frame = frame;
+      slot.token.reset(new base::task_token);
+      slot.ready = false;
+      slot.ok = false;
+
+      Slot* slotPtr = &slot;
+      base::thread_pool::global().execute(
+        [this, frame, slotPtr]{
+          m_prepare(frame, slotPtr->image, slotPtr->palette);
+          slotPtr->ok = true;
+        }, slot.token, base::thread_pool::priority::high);
+    }
+
+    doc::frame_t m_nframes;
+    Prepare m_prepare;
+    std::vector<Slot> m_slots;
+  };
+
+} // namespace app
+
+#endif
@@ -15,12 +15,15 @@
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "app/file/frames_pipeline.h"
 #include "app/file/gif_options.h"
 #include "app/ini_file.h"
 #include "app/modules/gui.h"
 #include "app/util/autocrop.h"
 #include "base/file_handle.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
+#include "doc/algorithm/shrink_bounds.h"
 #include "doc/doc.h"
 #include "render/quantization.h"
 #include "render/render.h"
@@ -31,6 +34,11 @@
 
 #include <gif_lib.h>
 
+#include <algorithm>
+#include <bitset>
+#include <functional>
+#include <vector>
+
 #if GIFLIB_MAJOR < 5
 #define GifMakeMapObject MakeMapObject
 #endif
@@ -331,6 +339,104 @@ bool GifFormat::onLoad(FileOp* fop)
   return true;
 }
 
+// Maps the indexes of the palettes of GIF frames (which can change
+// in each frame) to the entries of one palette shared by several
+// frames of the sprite. Entries that aren't used by previous frames
+// can be redefined with the new colors, so animations with local
+// colormaps don't need a new sprite palette in each frame.
+class GifPaletteMapper {
+public:
+  // The "reserved" index (the transparent color) is never used for
+  // a new color.
+  GifPaletteMapper(int reserved)
+    : m_reserved(reserved)
+    , m_source(NULL) {
+  }
+
+  const Palette* palette() const { return m_palette.get(); }
+
+  int index(int i) const {
+    return m_map[i & 0xff];
+  }
+
+  // Starts a new shared palette in the given frame with the colors of
+  // "palette". The entries used by the "canvas" cannot be redefined.
+  void reset(const Palette* palette, const Image* canvas, frame_t frame) {
+    m_palette.reset(new Palette(*palette));
+    m_palette->setFrame(frame);
+    m_source = palette;
+
+    get_used_indexes(canvas, m_used);
+    for (int i=0; i<256; ++i)
+      m_map[i] = i;
+    m_mapped.set();
+  }
+
+  // Palette of the next frames (all its indexes must be mapped again).
+  void setSource(const Palette* source) {
+    if (m_source != source) {
+      m_source = source;
+      m_mapped.reset();
+    }
+  }
+
+  // Maps the given indexes of the source palette to entries with the
+  // same color, or to unused entries. Returns false (without
+  // modifying the mapper) if there aren't enough unused entries.
+  bool map(const std::bitset<256>& indexes) {
+    Palette palette(*m_palette);
+    std::bitset<256> used = m_used;
+    std::bitset<256> mapped = m_mapped;
+    int map[256];
+    std::copy(m_map, m_map+256, map);
+
+    const int n = std::min(256, palette.size());
+    for (int i=0; i<256; ++i) {
+      if (!indexes[i])
+        continue;
+
+      if (!mapped[i]) {
+        color_t c = m_source->getEntry(i);
+        int j = -1;
+
+        // Same index (the most common case), other entry with the
+        // same color, or the first unused entry
+        if (i < n && i != m_reserved && palette.getEntry(i) == c)
+          j = i;
+        for (int k=0; k<n && j < 0; ++k)
+          if (k != m_reserved && palette.getEntry(k) == c)
+            j = k;
+        for (int k=0; k<n && j < 0; ++k)
+          if (k != m_reserved && !used[k]) {
+            palette.setEntry(k, c);
+            j = k;
+          }
+
+        if (j < 0)
+          return false;
+
+        map[i] = j;
+        mapped[i] = true;
+      }
+      used[map[i]] = true;
+    }
+
+    palette.copyColorsTo(m_palette.get());
+    m_used = used;
+    m_mapped = mapped;
+    std::copy(map, map+256, m_map);
+    return true;
+  }
+
+private:
+  int m_reserved;
+  const Palette* m_source;
+  UniquePtr<Palette> m_palette;
+  std::bitset<256> m_used;      // Entries of m_palette used by frames
+  std::bitset<256> m_mapped;    // Indexes of m_source already in m_map
+  int m_map[256];
+};
+
 bool GifFormat::onPostLoad(FileOp* fop)
 {
   GifData* data = reinterpret_cast<GifData*>(fop->format_data);
@@ -421,9 +527,14 @@ bool GifFormat::onPostLoad(FileOp* fop)
   clear_image(current_image, bgcolor);
   clear_image(previous_image, bgcolor);
 
+  // Content of the last added cel (to link frames without changes)
+  UniquePtr<Image> last_cel_image(Image::createCopy(current_image));
+  Cel* last_cel = NULL;
+
   // Add all frames in the sprite.
   sprite->setTotalFrames(frame_t(data->frames.size()));
   Palette* current_palette = NULL;
+  GifPaletteMapper palette_mapper(data->bgcolor_index);
 
   frame_t frame_num(0);
   for (GifFrames::iterator
@@ -435,13 +546,37 @@ bool GifFormat::onPostLoad(FileOp* fop)
 
     // Set frame palette
     if (frame_it->palette) {
-      sprite->setPalette(frame_it->palette, true);
       current_palette = frame_it->palette;
+
+      if (pixelFormat == IMAGE_INDEXED) {
+        if (frame_num == 0)
+          palette_mapper.reset(current_palette, current_image, frame_num);
+        palette_mapper.setSource(current_palette);
+      }
+      else
+        sprite->setPalette(frame_it->palette, true);
     }
 
+    const gfx::Rect frame_bounds(frame_it->x, frame_it->y,
+                                 frame_it->image->width(),
+                                 frame_it->image->height());
+
     switch (pixelFormat) {
 
-      case IMAGE_INDEXED:
+      case IMAGE_INDEXED: {
+        // Map the colors of the frame into the shared palette, or
+        // start a new palette in this frame if they don't fit.
+        std::bitset<256> used;
+        get_used_indexes(frame_it->image, used);
+        if (frame_it->mask_index >= 0 && frame_it->mask_index < 256)
+          used.reset(frame_it->mask_index);
+
+        if (!palette_mapper.map(used)) {
+          sprite->setPalette(palette_mapper.palette(), true);
+          palette_mapper.reset(current_palette, current_image, frame_num);
+          palette_mapper.map(used);
+        }
+
         for (int y = 0; y < frame_it->image->height(); ++y)
           for (int x = 0; x < frame_it->image->width(); ++x) {
             int pixel_index = get_pixel_fast<IndexedTraits>(frame_it->image, x, y);
@@ -449,9 +584,10 @@ bool GifFormat::onPostLoad(FileOp* fop)
               put_pixel_fast<IndexedTraits>(current_image,
                                             frame_it->x + x,
                                             frame_it->y + y,
-                                            pixel_index);
+                                            palette_mapper.index(pixel_index));
           }
         break;
+      }
 
       case IMAGE_RGB:
         // Convert the indexed image to RGB
@@ -468,24 +604,37 @@ bool GifFormat::onPostLoad(FileOp* fop)
 
     }
 
-    // Create a new Cel and a image with the whole content of "current_image"
-    Cel* cel = new Cel(frame_num, ImageRef(0));
-    try {
-      ImageRef cel_image(Image::createCopy(current_image));
-      try {
-        // Add the image in the sprite's stock and update the cel's
-        // reference to the new stock's image.
-        cel->data()->setImage(cel_image);
-      }
-      catch (...) {
-        throw;
-      }
-
+    // The frame pixels are already in current_image, so we can free
+    // them now (the memory used to load long animations is limited
+    // to the changed rectangles of the next frames).
+    delete frame_it->image;
+    frame_it->image = NULL;
+
+    // A frame without changes is a link to the previous cel, and
+    // cels of transparent layers contain only the bounds of the
+    // non-transparent pixels.
+    if (last_cel && is_same_image(current_image, last_cel_image)) {
+      Cel* cel = Cel::createLink(last_cel);
+      cel->setFrame(frame_num);
       layer->addCel(cel);
+      last_cel = cel;
     }
-    catch (...) {
-      delete cel;
-      throw;
+    else {
+      gfx::Rect bounds = current_image->bounds();
+      if (layer->isBackground() ||
+          algorithm::shrink_bounds(current_image, bounds, bgcolor)) {
+        ImageRef cel_image(crop_image(current_image,
+                                      bounds.x, bounds.y, bounds.w, bounds.h,
+                                      bgcolor));
+        Cel* cel = new Cel(frame_num, cel_image);
+        cel->setPosition(bounds.x, bounds.y);
+        layer->addCel(cel);
+        last_cel = cel;
+      }
+      else
+        last_cel = NULL;        // Empty frame (without cel)
+
+      copy_image(last_cel_image, current_image);
     }
 
     // The current_image was already copied to represent the
@@ -501,10 +650,10 @@ bool GifFormat::onPostLoad(FileOp* fop)
 
       case DISPOSAL_METHOD_RESTORE_BGCOLOR:
         fill_rect(current_image,
-                  frame_it->x,
-                  frame_it->y,
-                  frame_it->x+frame_it->image->width()-1,
-                  frame_it->y+frame_it->image->height()-1,
+                  frame_bounds.x,
+                  frame_bounds.y,
+                  frame_bounds.x2()-1,
+                  frame_bounds.y2()-1,
                   bgcolor);
         break;
 
@@ -521,6 +670,9 @@ bool GifFormat::onPostLoad(FileOp* fop)
       copy_image(previous_image, current_image);
   }
 
+  if (pixelFormat == IMAGE_INDEXED && palette_mapper.palette())
+    sprite->setPalette(palette_mapper.palette(), true);
+
   fop->document->sprites().add(sprite);
   sprite.release();             // Now the sprite is owned by fop->document
 
@@ -544,6 +696,92 @@ void GifFormat::onDestroyData(FileOp* fop)
 }
 
 #ifdef ENABLE_SAVE
+
+// Returns the bounds of the pixels of the indexed "image" that will
+// be displayed with a different color than the one in the "canvas"
+// (the RGB image that the GIF decoder displays before this frame).
+static gfx::Rect get_changed_bounds(const Image* image, const Image* canvas,
+                                    const color_t* colors)
+{
+  int x1 = image->width(), y1 = image->height(), x2 = -1, y2 = -1;
+
+  for (int y=0; y<image->height(); ++y) {
+    const IndexedTraits::pixel_t* src = (IndexedTraits::address_t)image->getPixelAddress(0, y);
+    const RgbTraits::pixel_t* dst = (RgbTraits::address_t)canvas->getPixelAddress(0, y);
+
+    for (int x=0; x<image->width(); ++x) {
+      if (colors[src[x]] != dst[x]) {
+        x1 = MIN(x1, x);
+        x2 = MAX(x2, x);
+        y1 = MIN(y1, y);
+        y2 = y;
+      }
+    }
+  }
+
+  if (x2 < 0)
+    return gfx::Rect();
+  else
+    return gfx::Rect(x1, y1, x2-x1+1, y2-y1+1);
+}
+
+// Returns the bounds of the non-transparent pixels of "image".
+static gfx::Rect get_opaque_bounds(const Image* image, int transparent_index)
+{
+  int x1, y1, x2, y2;
+  if (get_shrink_rect(&x1, &y1, &x2, &y2, const_cast<Image*>(image), transparent_index))
+    return gfx::Rect(x1, y1, x2-x1+1, y2-y1+1);
+  else
+    return gfx::Rect();
+}
+
+// Returns true if the indexed "next" frame has transparent pixels
+// where "image" has opaque pixels. In this case "image" must be
+// disposed after it's displayed, because the next frame cannot make
+// those pixels transparent again.
+static bool has_new_transparent_pixels(const Image* next, const Image* image,
+                                       int transparent_index)
+{
+  for (int y=0; y<image->height(); ++y) {
+    const IndexedTraits::pixel_t* src = (IndexedTraits::address_t)image->getPixelAddress(0, y);
+    const IndexedTraits::pixel_t* dst = (IndexedTraits::address_t)next->getPixelAddress(0, y);
+
+    for (int x=0; x<image->width(); ++x) {
+      if (src[x] != transparent_index &&
+          dst[x] == transparent_index)
+        return true;
+    }
+  }
+  return false;
+}
+
+// Returns a palette index (less than "ncolors") that is not used by
+// the changed pixels inside "bounds", so it can be used as the
+// transparent index of the frame to skip the unchanged pixels. Returns
+// -1 if all indexes are used.
+static int find_unused_index(const Image* image, const Image* canvas,
+                             const gfx::Rect& bounds,
+                             const color_t* colors, int ncolors)
+{
+  bool used[256] = { false };
+
+  for (int y=bounds.y; y<bounds.y+bounds.h; ++y) {
+    const IndexedTraits::pixel_t* src = (IndexedTraits::address_t)image->getPixelAddress(0, y);
+    const RgbTraits::pixel_t* dst = (RgbTraits::address_t)canvas->getPixelAddress(0, y);
+
+    for (int x=bounds.x; x<bounds.x+bounds.w; ++x) {
+      if (colors[src[x]] != dst[x])
+        used[src[x]] = true;
+    }
+  }
+
+  for (int i=0; i<ncolors && i<256; ++i)
+    if (!used[i])
+      return i;
+
+  return -1;
+}
+
 bool GifFormat::onSave(FileOp* fop)
 {
 #if GIFLIB_MAJOR >= 5
@@ -571,7 +809,7 @@ bool GifFormat::onSave(FileOp* fop)
 
   Palette current_palette = *sprite->palette(frame_t(0));
   Palette previous_palette(current_palette);
-  RgbMap rgbmap;
+  RgbMap rgbmap(8);             // Lazy map with full precision
 
   // The color map must be a power of two.
   int color_map_size = current_palette.size();
@@ -613,29 +851,41 @@ bool GifFormat::onSave(FileOp* fop)
                         background_color, color_map) == GIF_ERROR)
     throw Exception("Error writing GIF header.\n");
 
-  UniquePtr<Image> buffer_image;
   UniquePtr<Image> current_image(Image::create(IMAGE_INDEXED, sprite_w, sprite_h));
   UniquePtr<Image> previous_image(Image::create(IMAGE_INDEXED, sprite_w, sprite_h));
   int frame_x, frame_y, frame_w, frame_h;
   int u1, v1, u2, v2;
   int i1, j1, i2, j2;
 
-  // If the sprite is not Indexed type, we will need a temporary
-  // buffer to render the full RGB or Grayscale sprite.
-  if (sprite_format != IMAGE_INDEXED)
-    buffer_image.reset(Image::create(sprite_format, sprite_w, sprite_h));
-
   clear_image(current_image, background_color);
   clear_image(previous_image, background_color);
 
-  ColorMapObject* image_color_map = NULL;
+  // In optimized mode we keep the image that the GIF decoder displays
+  // after each frame (the "canvas"), so only the rectangle of pixels
+  // that change is encoded, and the unchanged pixels inside it are
+  // written as the transparent index (they compress better). For
+  // transparent sprites we look at the next frame to know if the
+  // current frame must be disposed (the only way to make opaque
+  // pixels transparent again in the next frame).
+  bool optimize = gif_options->optimize();
+  UniquePtr<Image> canvas_image;
+  UniquePtr<Image> first_image; // First frame (the next one of the last frame in loops)
+  std::vector<uint8_t> frame_pixels;
+
+  if (optimize) {
+    canvas_image.reset(Image::create(IMAGE_RGB, sprite_w, sprite_h));
+    clear_image(canvas_image, 0);
+  }
 
-  render::Render render;
-  render.setBgType(render::BgType::NONE);
+  ColorMapObject* image_color_map = NULL;
 
   // Check if the user wants one optimized palette for all frames.
   if (sprite_format != IMAGE_INDEXED &&
       gif_options->quantize() == GifOptions::QuantizeAll) {
+    render::Render render;
+    render.setBgType(render::BgType::NONE);
+    UniquePtr<Image> buffer_image(Image::create(sprite_format, sprite_w, sprite_h));
+
     // Feed the optimizer with all rendered frames.
     render::PaletteOptimizer optimizer;
     for (frame_t frame_num(0); frame_num<sprite->totalFrames(); ++frame_num) {
@@ -646,52 +896,158 @@ bool GifFormat::onSave(FileOp* fop)
 
     current_palette.makeBlack();
     optimizer.calculate(&current_palette, has_background);
-
-    rgbmap.regenerate(&current_palette, transparent_index);
   }
 
-  for (frame_t frame_num(0); frame_num<sprite->totalFrames(); ++frame_num) {
-    // If the sprite is RGB or Grayscale, we must to convert it to Indexed on the fly.
-    if (sprite_format != IMAGE_INDEXED) {
+  // Palette for QuantizeAll mode (it cannot be "current_palette"
+  // because the lazy "rgbmap" needs an unmodified palette).
+  const Palette all_frames_palette(current_palette);
+  rgbmap.regenerate(&all_frames_palette, transparent_index);
+
+  // Function to render the given frame and convert it to Indexed
+  // (it's called from worker threads, so the global "rgbmap" (lazy
+  // and thread-safe) is used only by QuantizeAll, the other modes
+  // create a map for the palette of each frame).
+  FramesPipeline::Prepare prepare =
+    [&](frame_t frame_num, Image* indexed_image, Palette* palette) {
+      render::Render render;
+      render.setBgType(render::BgType::NONE);
+
+      // If the sprite is Indexed, we can render directly into "indexed_image".
+      if (sprite_format == IMAGE_INDEXED) {
+        clear_image(indexed_image, background_color);
+        render.renderSprite(indexed_image, sprite, frame_num);
+        return;
+      }
+
+      // If the sprite is RGB or Grayscale, we must to convert it to Indexed on the fly.
+      UniquePtr<Image> buffer_image(Image::create(sprite_format, sprite_w, sprite_h));
       clear_image(buffer_image, background_color);
       render.renderSprite(buffer_image, sprite, frame_num);
 
+      UniquePtr<RgbMap> frame_rgbmap;
       switch (gif_options->quantize()) {
         case GifOptions::NoQuantize:
-          sprite->palette(frame_num)->copyColorsTo(&current_palette);
-          rgbmap.regenerate(&current_palette, transparent_index);
+          sprite->palette(frame_num)->copyColorsTo(palette);
+          frame_rgbmap.reset(new RgbMap(8));
+          frame_rgbmap->regenerate(palette, transparent_index);
           break;
         case GifOptions::QuantizeEach:
           {
-            current_palette.makeBlack();
+            palette->makeBlack();
 
             std::vector<Image*> imgarray(1);
             imgarray[0] = buffer_image;
-            render::create_palette_from_images(imgarray, &current_palette, has_background);
-            rgbmap.regenerate(&current_palette, transparent_index);
+            render::create_palette_from_images(imgarray, palette, has_background);
+            frame_rgbmap.reset(new RgbMap(8));
+            frame_rgbmap->regenerate(palette, transparent_index);
           }
           break;
         case GifOptions::QuantizeAll:
-          // Do nothing, we've already calculate the palette for all frames.
+          // We've already calculate the palette for all frames.
+          all_frames_palette.copyColorsTo(palette);
           break;
       }
 
       render::convert_pixel_format(
         buffer_image,
-        current_image,
+        indexed_image,
         IMAGE_INDEXED,
         gif_options->dithering(),
-        &rgbmap,
-        &current_palette,
+        (frame_rgbmap ? frame_rgbmap.get(): &rgbmap),
+        palette,
         has_background);
-    }
-    // If the sprite is Indexed, we can render directly into "current_image".
-    else {
-      clear_image(current_image, background_color);
-      render.renderSprite(current_image, sprite, frame_num);
-    }
+    };
+
+  // Workers convert the next frames while the current one is written
+  // (one frame for each worker plus the one being written).
+  FramesPipeline frames(sprite->totalFrames(),
+                           base::thread_pool::global().workers()+1,
+                           current_image, &current_palette,
+                           prepare);
+
+  for (frame_t frame_num(0); frame_num<sprite->totalFrames(); ++frame_num) {
+    const Palette* frame_palette = NULL;
+    copy_image(current_image, frames.image(frame_num, &frame_palette));
+    frame_palette->copyColorsTo(&current_palette);
+
+    if (frame_num == 0 && optimize && transparent_index >= 0 && loop >= 0)
+      first_image.reset(Image::createCopy(current_image));
+
+    int disposal_method = (sprite->backgroundLayer() ? DISPOSAL_METHOD_DO_NOT_DISPOSE:
+                                                       DISPOSAL_METHOD_RESTORE_BGCOLOR);
+    int frame_transparent_index = transparent_index;
+    color_t colors[256];
+
+    if (optimize) {
+      // Colors displayed by the decoder for each index of this frame.
+      for (int i=0; i<256; ++i)
+        colors[i] = (i < current_palette.size() ? (current_palette.getEntry(i) | rgba_a_mask): 0);
+      if (transparent_index >= 0)
+        colors[transparent_index] = 0;
+
+      gfx::Rect bounds;
+      if (frame_num == 0)
+        bounds = gfx::Rect(0, 0, sprite_w, sprite_h);
+      else {
+        bounds = get_changed_bounds(current_image, canvas_image, colors);
+
+        // An empty frame (just to keep the duration of the previous one).
+        if (bounds.isEmpty())
+          bounds = gfx::Rect(0, 0, 1, 1);
+      }
+
+      disposal_method = DISPOSAL_METHOD_DO_NOT_DISPOSE;
+
+      if (transparent_index >= 0) {
+        // The frame displayed after this one (the first one again if
+        // the animation loops).
+        frame_t next_frame = frame_num+1;
+        if (next_frame == sprite->totalFrames() && loop >= 0)
+          next_frame = 0;
+
+        if (next_frame != frame_num && next_frame < sprite->totalFrames()) {
+          const Image* next_image = (next_frame == 0 ? first_image.get():
+                                                       frames.image(next_frame, NULL));
+
+          if (has_new_transparent_pixels(next_image, current_image, transparent_index)) {
+            disposal_method = DISPOSAL_METHOD_RESTORE_BGCOLOR;
+
+            // All opaque pixels must be inside the frame rectangle to
+            // be cleared.
+            bounds |= get_opaque_bounds(current_image, transparent_index);
+          }
+        }
+      }
+      // Opaque sprites don't have a transparent index, so we look for
+      // an unused index in this frame to skip the unchanged pixels.
+      else if (frame_num > 0) {
+        frame_transparent_index =
+          find_unused_index(current_image, canvas_image, bounds,
+                            colors, current_palette.size());
+      }
+
+      frame_x = bounds.x;
+      frame_y = bounds.y;
+      frame_w = bounds.w;
+      frame_h = bounds.h;
+
+      // Replace the unchanged pixels with the transparent index.
+      if (frame_transparent_index >= 0) {
+        frame_pixels.resize(frame_w*frame_h);
 
-    if (frame_num == 0) {
+        uint8_t* dst = &frame_pixels[0];
+        for (int y=0; y<frame_h; ++y) {
+          const IndexedTraits::pixel_t* src =
+            (IndexedTraits::address_t)current_image->getPixelAddress(frame_x, frame_y + y);
+          const RgbTraits::pixel_t* canvas =
+            (RgbTraits::address_t)canvas_image->getPixelAddress(frame_x, frame_y + y);
+
+          for (int x=0; x<frame_w; ++x, ++dst)
+            *dst = (colors[src[x]] == canvas[x] ? frame_transparent_index: src[x]);
+        }
+      }
+    }
+    else if (frame_num == 0) {
       frame_x = 0;
       frame_y = 0;
       frame_w = sprite->width();
@@ -752,15 +1108,13 @@ bool GifFormat::onSave(FileOp* fop)
     // frame and maybe the transparency index).
     {
       unsigned char extension_bytes[5];
-      int disposal_method = (sprite->backgroundLayer() ? DISPOSAL_METHOD_DO_NOT_DISPOSE:
-                                                         DISPOSAL_METHOD_RESTORE_BGCOLOR);
       int frame_delay = sprite->frameDuration(frame_num) / 10;
 
       extension_bytes[0] = (((disposal_method & 7) << 2) |
-                            (transparent_index >= 0 ? 1: 0));
+                            (frame_transparent_index >= 0 ? 1: 0));
       extension_bytes[1] = (frame_delay & 0xff);
       extension_bytes[2] = (frame_delay >> 8) & 0xff;
-      extension_bytes[3] = (transparent_index >= 0 ? transparent_index: 0);
+      extension_bytes[3] = (frame_transparent_index >= 0 ? frame_transparent_index: 0);
 
       if (EGifPutExtension(gif_file, GRAPHICS_EXT_FUNC_CODE, 4, extension_bytes) == GIF_ERROR)
         throw Exception("Error writing GIF graphics extension record for frame %d.\n", (int)frame_num);
@@ -791,13 +1145,22 @@ bool GifFormat::onSave(FileOp* fop)
                          image_color_map) == GIF_ERROR)
       throw Exception("Error writing GIF frame %d.\n", (int)frame_num);
 
+    // Scanline "y" of the frame rectangle to be written.
+    bool masked = (optimize && frame_transparent_index >= 0);
+    auto frame_line =
+      [&](int y) -> IndexedTraits::address_t {
+        if (masked)
+          return &frame_pixels[y*frame_w];
+        else
+          return (IndexedTraits::address_t)current_image->getPixelAddress(frame_x, frame_y + y);
+      };
+
     // Write the image data (pixels).
     if (interlaced) {
       // Need to perform 4 passes on the images.
       for (int i=0; i<4; ++i)
         for (int y = interlaced_offset[i]; y < frame_h; y += interlaced_jumps[i]) {
-          IndexedTraits::address_t addr =
-            (IndexedTraits::address_t)current_image->getPixelAddress(frame_x, frame_y + y);
+          IndexedTraits::address_t addr = frame_line(y);
 
           if (EGifPutLine(gif_file, addr, frame_w) == GIF_ERROR)
             throw Exception("Error writing GIF image scanlines for frame %d.\n", (int)frame_num);
@@ -806,15 +1169,34 @@ bool GifFormat::onSave(FileOp* fop)
     else {
       // Write all image scanlines (not interlaced in this case).
       for (int y=0; y<frame_h; ++y) {
-        IndexedTraits::address_t addr =
-          (IndexedTraits::address_t)current_image->getPixelAddress(frame_x, frame_y + y);
+        IndexedTraits::address_t addr = frame_line(y);
 
         if (EGifPutLine(gif_file, addr, frame_w) == GIF_ERROR)
           throw Exception("Error writing GIF image scanlines for frame %d.\n", (int)frame_num);
       }
     }
 
-    copy_image(previous_image, current_image);
+    if (optimize) {
+      // Update the image displayed by the decoder.
+      if (disposal_method == DISPOSAL_METHOD_RESTORE_BGCOLOR)
+        clear_image(canvas_image, 0);
+      else {
+        for (int y=frame_y; y<frame_y+frame_h; ++y) {
+          const IndexedTraits::pixel_t* src =
+            (IndexedTraits::address_t)current_image->getPixelAddress(0, y);
+          RgbTraits::address_t dst =
+            (RgbTraits::address_t)canvas_image->getPixelAddress(0, y);
+
+          for (int x=frame_x; x<frame_x+frame_w; ++x)
+            if (src[x] != transparent_index)
+              dst[x] = colors[src[x]];
+        }
+      }
+    }
+    else
+      copy_image(previous_image, current_image);
+
+    frames.release(frame_num);
   }
 
   return true;
@@ -840,6 +1222,7 @@ base::SharedPtr<FormatOptions> GifFormat::onGetFormatOptions(FileOp* fop)
     gif_options->setInterlaced(get_config_bool("GIF", "Interlaced", gif_options->interlaced()));
     gif_options->setLoop(get_config_bool("GIF", "Loop", gif_options->loop()));
     gif_options->setDithering((doc::DitheringMethod)get_config_int("GIF", "Dither", (int)gif_options->dithering()));
+    gif_options->setOptimize(get_config_bool("GIF", "Optimize", gif_options->optimize()));
 
     // Load the window to ask to the user the GIF options he wants.
 
@@ -853,6 +1236,7 @@ base::SharedPtr<FormatOptions> GifFormat::onGetFormatOptions(FileOp* fop)
     }
     win.interlaced()->setSelected(gif_options->interlaced());
     win.loop()->setSelected(gif_options->loop());
+    win.optimize()->setSelected(gif_options->optimize());
 
     win.dither()->setEnabled(true);
     win.dither()->setSelected(gif_options->dithering() == doc::DitheringMethod::ORDERED);
@@ -869,6 +1253,7 @@ base::SharedPtr<FormatOptions> GifFormat::onGetFormatOptions(FileOp* fop)
 
       gif_options->setInterlaced(win.interlaced()->isSelected());
       gif_options->setLoop(win.loop()->isSelected());
+      gif_options->setOptimize(win.optimize()->isSelected());
       gif_options->setDithering(win.dither()->isSelected() ?
         doc::DitheringMethod::ORDERED:
         doc::DitheringMethod::NONE);
@@ -876,6 +1261,7 @@ base::SharedPtr<FormatOptions> GifFormat::onGetFormatOptions(FileOp* fop)
       set_config_int("GIF", "Quantize", gif_options->quantize());
       set_config_bool("GIF", "Interlaced", gif_options->interlaced());
       set_config_bool("GIF", "Loop", gif_options->loop());
+      set_config_bool("GIF", "Optimize", gif_options->optimize());
       set_config_int("GIF", "Dither", int(gif_options->dithering()));
     }
     else {
@@ -23,28 +23,33 @@ namespace app {
       Quantize quantize = QuantizeEach,
       bool interlaced = false,
       bool loop = true,
-      DitheringMethod dithering = doc::DitheringMethod::NONE)
+      DitheringMethod dithering = doc::DitheringMethod::NONE,
+      bool optimize = true)
       : m_quantize(quantize)
       , m_interlaced(interlaced)
       , m_loop(loop)
-      , m_dithering(dithering) {
+      , m_dithering(dithering)
+      , m_optimize(optimize) {
     }
 
     Quantize quantize() const { return m_quantize; }
     bool interlaced() const { return m_interlaced; }
     bool loop() const { return m_loop; }
     doc::DitheringMethod dithering() const { return m_dithering; }
+    bool optimize() const { return m_optimize; }
 
     void setQuantize(const Quantize quantize) { m_quantize = quantize; }
     void setInterlaced(bool interlaced) { m_interlaced = interlaced; }
     void setLoop(bool loop) { m_loop = loop; }
     void setDithering(const doc::DitheringMethod dithering) { m_dithering = dithering; }
+    void setOptimize(bool optimize) { m_optimize = optimize; }
 
   private:
     Quantize m_quantize;
     bool m_interlaced;
     bool m_loop;
     doc::DitheringMethod m_dithering;
+    bool m_optimize;            // Encode only the changed pixels of each frame
   };
 
 } // namespace app
@@ -330,3 +330,161 @@ TEST_F(GifFormat, OpaqueRgbQuantizationTwoLayers)
     delete doc;
   }
 }
+
+TEST_F(GifFormat, LinkedAndCroppedFrames)
+{
+  const char* fn = "test.gif";
+
+  {
+    app::Document* doc(static_cast<app::Document*>(m_ctx.documents().add(8, 8, doc::ColorMode::INDEXED, 4)));
+    Sprite* sprite = doc->sprite();
+    doc->setFilename(fn);
+    sprite->setTransparentColor(0);
+    sprite->setTotalFrames(frame_t(3));
+
+    Palette* pal = sprite->palette(frame_t(0));
+    pal->setEntry(0, rgb(255, 255, 255));
+    pal->setEntry(1, rgb(255, 13, 254));
+    pal->setEntry(2, rgb(129, 255, 32));
+    pal->setEntry(3, rgb(0, 0, 255));
+
+    LayerImage* layer = dynamic_cast<LayerImage*>(sprite->folder()->getFirstLayer());
+    ASSERT_NE((LayerImage*)NULL, layer);
+
+    for (frame_t frame(0); frame<3; ++frame) {
+      Cel* cel = layer->cel(frame);
+      if (!cel) {
+        cel = new Cel(frame, ImageRef(Image::create(IMAGE_INDEXED, 8, 8)));
+        layer->addCel(cel);
+      }
+      clear_image(cel->image(), 0);
+      if (frame < 2) {
+        cel->image()->putPixel(2, 3, 1);
+        cel->image()->putPixel(5, 4, 2);
+      }
+      else
+        cel->image()->putPixel(0, 0, 3);
+    }
+
+    doc->setFormatOptions(base::SharedPtr<FormatOptions>(new GifOptions));
+    save_document(&m_ctx, doc);
+
+    doc->close();
+    delete doc;
+  }
+
+  {
+    app::Document* doc = load_document(&m_ctx, fn);
+    Sprite* sprite = doc->sprite();
+    ASSERT_EQ(3, sprite->totalFrames());
+
+    LayerImage* layer = dynamic_cast<LayerImage*>(sprite->folder()->getFirstLayer());
+    ASSERT_NE((LayerImage*)NULL, layer);
+    EXPECT_FALSE(layer->isBackground());
+
+    // Only the bounds of the non-transparent pixels
+    Cel* cel0 = layer->cel(frame_t(0));
+    ASSERT_NE((Cel*)NULL, cel0);
+    EXPECT_EQ(gfx::Rect(2, 3, 4, 2), cel0->bounds());
+    EXPECT_EQ(1, cel0->image()->getPixel(0, 0));
+    EXPECT_EQ(2, cel0->image()->getPixel(3, 1));
+
+    // Same content as frame 0
+    Cel* cel1 = layer->cel(frame_t(1));
+    ASSERT_NE((Cel*)NULL, cel1);
+    EXPECT_EQ(cel0->data(), cel1->data());
+
+    Cel* cel2 = layer->cel(frame_t(2));
+    ASSERT_NE((Cel*)NULL, cel2);
+    EXPECT_EQ(gfx::Rect(0, 0, 1, 1), cel2->bounds());
+    EXPECT_EQ(3, cel2->image()->getPixel(0, 0));
+
+    doc->close();
+    delete doc;
+  }
+}
+
+static void test_optimized_frames(doc::TestContextT<app::Context>& ctx, bool background)
+{
+  const char* fn = "test.gif";
+  const int frames[4][4*4] = {
+    { 1, 1, 2, 2,
+      1, 1, 2, 2,
+      3, 3, 0, 0,
+      3, 3, 0, 0 },
+    { 1, 1, 2, 2,
+      1, 3, 2, 2,
+      3, 3, 0, 0,
+      3, 3, 0, 0 },
+    { 1, 1, 2, 2,
+      1, 3, 0, 2,
+      3, 3, 0, 1,
+      0, 3, 0, 0 },
+    { 1, 1, 2, 2,
+      1, 3, 0, 2,
+      3, 3, 0, 1,
+      0, 3, 0, 0 } };
+
+  {
+    app::Document* doc(static_cast<app::Document*>(ctx.documents().add(4, 4, doc::ColorMode::INDEXED, 4)));
+    Sprite* sprite = doc->sprite();
+    doc->setFilename(fn);
+    sprite->setTotalFrames(frame_t(4));
+
+    Palette* pal = sprite->palette(frame_t(0));
+    pal->setEntry(0, rgb(255, 255, 255));
+    pal->setEntry(1, rgb(255, 13, 254));
+    pal->setEntry(2, rgb(129, 255, 32));
+    pal->setEntry(3, rgb(0, 0, 255));
+
+    LayerImage* layer = dynamic_cast<LayerImage*>(sprite->folder()->getFirstLayer());
+    ASSERT_NE((LayerImage*)NULL, layer);
+    layer->setBackground(background);
+
+    for (frame_t frame(0); frame<4; ++frame) {
+      Cel* cel = layer->cel(frame);
+      if (!cel) {
+        cel = new Cel(frame, ImageRef(Image::create(IMAGE_INDEXED, 4, 4)));
+        layer->addCel(cel);
+      }
+      for (int i=0; i<4*4; ++i)
+        cel->image()->putPixel(i%4, i/4, frames[frame][i]);
+    }
+
+    doc->setFormatOptions(base::SharedPtr<FormatOptions>(new GifOptions));
+    save_document(&ctx, doc);
+
+    doc->close();
+    delete doc;
+  }
+
+  {
+    app::Document* doc = load_document(&ctx, fn);
+    Sprite* sprite = doc->sprite();
+    ASSERT_EQ(4, sprite->totalFrames());
+
+    LayerImage* layer = dynamic_cast<LayerImage*>(sprite->folder()->getFirstLayer());
+    ASSERT_NE((LayerImage*)NULL, layer);
+    EXPECT_EQ(background, layer->isBackground());
+
+    for (frame_t frame(0); frame<4; ++frame) {
+      Image* image = layer->cel(frame)->image();
+      for (int i=0; i<4*4; ++i)
+        EXPECT_EQ(frames[frame][i], image->getPixel(i%4, i/4))
+          << "frame " << frame << " pixel " << i;
+    }
+
+    doc->close();
+    delete doc;
+  }
+}
+
+TEST_F(GifFormat, OptimizedOpaqueFrames)
+{
+  test_optimized_frames(m_ctx, true);
+}
+
+TEST_F(GifFormat, OptimizedTransparentFrames)
+{
+  test_optimized_frames(m_ctx, false);
+}
@@ -20,6 +20,9 @@
 #include "doc/doc.h"
 #include "render/render.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 using namespace base;
@@ -78,6 +81,17 @@ struct BITMAPINFOHEADER {
   uint32_t clrImportant;
 };
 
+// Reads "size" bytes from the file in "buf" (the rest is zero if the
+// file ends before).
+static const uint8_t* read_line(FILE* f, std::vector<uint8_t>& buf, std::size_t size)
+{
+  ASSERT(size <= buf.size());
+  std::size_t n = fread(&buf[0], 1, size, f);
+  if (n < size)
+    std::fill(buf.begin()+n, buf.begin()+size, 0);
+  return &buf[0];
+}
+
 bool IcoFormat::onLoad(FileOp* fop)
 {
   FileHandle handle(open_file_with_exception(fop->filename, "rb"));
@@ -169,54 +183,49 @@ bool IcoFormat::onLoad(FileOp* fop)
     delete pal;
   }
 
-  // Read XOR MASK
-  int x, y, c, r, g, b;
+  // Read XOR MASK (every scanline is 32-bit aligned)
+  int x, y;
+  std::vector<uint8_t> buf(((image->width()*entry.bpp + 31) / 32) * 4 + 1);
   for (y=image->height()-1; y>=0; --y) {
-    for (x=0; x<image->width(); ++x) {
-      switch (entry.bpp) {
+    const uint8_t* src = read_line(f, buf, buf.size()-1);
+
+    switch (entry.bpp) {
 
-        case 8:
-          c = fgetc(f);
+      case 8: {
+        IndexedTraits::address_t dst =
+          (IndexedTraits::address_t)image->getPixelAddress(0, y);
+        for (x=0; x<image->width(); ++x) {
+          int c = src[x];
           ASSERT(c >= 0 && c < numcolors);
-          if (c >= 0 && c < numcolors)
-            put_pixel(image.get(), x, y, c);
-          else
-            put_pixel(image.get(), x, y, 0);
-          break;
-
-        case 24:
-          b = fgetc(f);
-          g = fgetc(f);
-          r = fgetc(f);
-          put_pixel(image.get(), x, y, rgba(r, g, b, 255));
-          break;
+          dst[x] = (c < numcolors ? c: 0);
+        }
+        break;
       }
-    }
 
-    // every scanline must be 32-bit aligned
-    while (x & 3) {
-      fgetc(f);
-      x++;
+      case 24: {
+        RgbTraits::address_t dst =
+          (RgbTraits::address_t)image->getPixelAddress(0, y);
+        for (x=0; x<image->width(); ++x, src+=3)
+          dst[x] = rgba(src[2], src[1], src[0], 255);
+        break;
+      }
     }
   }
 
-  // AND mask
-  int m, v;
+  // AND mask (1 bit per pixel, every scanline is 32-bit aligned)
+  buf.resize(((image->width() + 31) / 32) * 4 + 1);
   for (y=image->height()-1; y>=0; --y) {
-    for (x=0; x<(image->width()+7)/8; ++x) {
-      m = fgetc(f);
-      v = 128;
-      for (b=0; b<8; b++) {
-        if ((m & v) == v)
-          put_pixel(image.get(), x*8+b, y, 0); // TODO mask color
-        v >>= 1;
-      }
-    }
+    const uint8_t* src = read_line(f, buf, buf.size()-1);
+    uint8_t* row = image->getPixelAddress(0, y);
 
-    // every scanline must be 32-bit aligned
-    while (x & 3) {
-      fgetc(f);
-      x++;
+    for (x=0; x<image->width(); ++x) {
+      if (src[x/8] & (128 >> (x & 7))) {
+        // TODO mask color
+        if (pixelFormat == IMAGE_RGB)
+          ((RgbTraits::address_t)row)[x] = 0;
+        else
+          ((IndexedTraits::address_t)row)[x] = 0;
+      }
     }
   }
 
@@ -134,6 +134,20 @@ bool JpegFormat::onLoad(FileOp* fop)
   else
     cinfo.out_color_space = JCS_RGB;
 
+  // For previews the DCT can decode the image directly at 1/2, 1/4
+  // or 1/8 of its size.
+  if (fop->preview_size > 0) {
+    int size = MAX(cinfo.image_width, cinfo.image_height);
+    int denom = 1;
+    while (denom < 8 && size / (denom*2) >= fop->preview_size)
+      denom *= 2;
+
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = denom;
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.do_fancy_upsampling = false;
+  }
+
   // Start decompressor.
   jpeg_start_decompress(&cinfo);
 
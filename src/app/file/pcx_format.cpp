@@ -18,6 +18,9 @@
 #include "base/file_handle.h"
 #include "doc/doc.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 using namespace base;
@@ -51,9 +54,9 @@ bool PcxFormat::onLoad(FileOp* fop)
   int c, r, g, b;
   int width, height;
   int bpp, bytes_per_line;
-  int xx, po;
+  int xx;
   int x, y;
-  char ch = 0;
+  uint8_t ch = 0;
 
   FileHandle handle(open_file_with_exception(fop->filename, "rb"));
   FILE* f = handle.get();
@@ -104,46 +107,54 @@ bool PcxFormat::onLoad(FileOp* fop)
   if (bpp == 24)
     clear_image(image, rgba(0, 0, 0, 255));
 
+  // Read the rest of the file (RLE encoded PCX data and the palette)
+  // in memory
+  std::vector<uint8_t> data;
+  {
+    long pos = ftell(f);
+    fseek(f, 0, SEEK_END);
+    long end = ftell(f);
+    fseek(f, pos, SEEK_SET);
+    if (end > pos) {
+      data.resize(end - pos);
+      data.resize(fread(&data[0], 1, data.size(), f));
+    }
+  }
+
+  // Decoded scanline (one plane after the other)
+  int line_size = bytes_per_line*bpp/8;
+  std::vector<uint8_t> line(line_size+1, 0);
+  std::size_t p = 0;
+
   for (y=0; y<height; y++) {       /* read RLE encoded PCX data */
-    x = xx = 0;
-    po = rgba_r_shift;
+    x = 0;
 
-    while (x < bytes_per_line*bpp/8) {
-      ch = fgetc(f);
+    while (x < line_size && p < data.size()) {
+      ch = data[p++];
       if ((ch & 0xC0) == 0xC0) {
         c = (ch & 0x3F);
-        ch = fgetc(f);
+        ch = (p < data.size() ? data[p++]: 0);
       }
       else
         c = 1;
 
-      if (bpp == 8) {
-        while (c--) {
-          if (x < image->width())
-            put_pixel_fast<IndexedTraits>(image, x, y, ch);
+      for (; c > 0 && x < line_size; --c)
+        line[x++] = ch;
+    }
 
-          x++;
-        }
-      }
-      else {
-        while (c--) {
-          if (xx < image->width())
-            put_pixel_fast<RgbTraits>(image, xx, y,
-                                      get_pixel_fast<RgbTraits>(image, xx, y) | ((ch & 0xff) << po));
-
-          x++;
-          if (x == bytes_per_line) {
-            xx = 0;
-            po = rgba_g_shift;
-          }
-          else if (x == bytes_per_line*2) {
-            xx = 0;
-            po = rgba_b_shift;
-          }
-          else
-            xx++;
-        }
-      }
+    if (bpp == 8) {
+      std::copy(line.begin(), line.begin()+MAX(0, MIN(width, line_size)),
+                (IndexedTraits::address_t)image->getPixelAddress(0, y));
+    }
+    else {
+      RgbTraits::address_t dst =
+        (RgbTraits::address_t)image->getPixelAddress(0, y);
+      const uint8_t* r_plane = &line[0];
+      const uint8_t* g_plane = r_plane + bytes_per_line;
+      const uint8_t* b_plane = g_plane + bytes_per_line;
+
+      for (xx=0; xx<MIN(width, bytes_per_line); ++xx)
+        dst[xx] = rgba(r_plane[xx], g_plane[xx], b_plane[xx], 255);
     }
 
     fop_progress(fop, (float)(y+1) / (float)(height));
@@ -153,14 +164,10 @@ bool PcxFormat::onLoad(FileOp* fop)
 
   if (!fop_is_stop(fop)) {
     if (bpp == 8) {                  /* look for a 256 color palette */
-      while ((c = fgetc(f)) != EOF) {
-        if (c == 12) {
-          for (c=0; c<256; c++) {
-            r = fgetc(f);
-            g = fgetc(f);
-            b = fgetc(f);
-            fop_sequence_set_color(fop, c, r, g, b);
-          }
+      while (p < data.size()) {
+        if (data[p++] == 12) {
+          for (c=0; c<256 && p+3 <= data.size(); c++, p+=3)
+            fop_sequence_set_color(fop, c, data[p], data[p+1], data[p+2]);
           break;
         }
       }
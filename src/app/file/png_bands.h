@@ -0,0 +1,40 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_FILE_PNG_BANDS_H_INCLUDED
+#define APP_FILE_PNG_BANDS_H_INCLUDED
+#pragma once
+
+#include <functional>
+#include <string>
+
+namespace doc {
+  class Image;
+  class Sprite;
+}
+
+namespace app {
+  class PngOptions;
+
+  // Renders the rows [y, y+band->height()) of the whole image in the
+  // "band" image (the last band can have more rows than the image).
+  typedef std::function<void(doc::Image* band, int y)> PngBandRenderer;
+
+  // Saves a PNG file with the pixel format, size, palette (of the
+  // first frame) and transparency of the given sprite, but its
+  // pixels are rendered by "renderer" band by band, so the whole
+  // image is never in memory. The next band is rendered in a worker
+  // thread while the current one is compressed. Returns false if the
+  // file cannot be saved.
+  bool save_png_by_bands(const std::string& filename,
+                         const doc::Sprite* sprite,
+                         const PngOptions& options,
+                         const PngBandRenderer& renderer);
+
+} // namespace app
+
+#endif
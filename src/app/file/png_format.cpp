@@ -14,14 +14,22 @@
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "app/file/png_bands.h"
+#include "app/file/png_options.h"
 #include "app/ini_file.h"
 #include "base/file_handle.h"
+#include "base/thread_pool.h"
 #include "doc/doc.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 
 #include "png.h"
+#include "zlib.h"
 
 namespace app {
 
@@ -53,6 +61,19 @@ FileFormat* CreatePngFormat()
   return new PngFormat;
 }
 
+// True if the bytes of rgba()/graya() pixels are in the same order as
+// the RGBA/GA channels of a PNG row (so libpng can read the rows
+// directly into the image).
+static bool png_layout_matches_image()
+{
+  const uint32_t c = rgba(1, 2, 3, 4);
+  const uint16_t k = graya(1, 2);
+  const uint8_t* cb = (const uint8_t*)&c;
+  const uint8_t* kb = (const uint8_t*)&k;
+  return (cb[0] == 1 && cb[1] == 2 && cb[2] == 3 && cb[3] == 4 &&
+          kb[0] == 1 && kb[1] == 2);
+}
+
 static void report_png_error(png_structp png_ptr, png_const_charp error)
 {
   fop_error((FileOp*)png_get_error_ptr(png_ptr), "libpng: %s\n", error);
@@ -139,6 +160,15 @@ bool PngFormat::onLoad(FileOp* fop)
   if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
     png_set_expand_gray_1_2_4_to_8(png_ptr);
 
+  /* Add an opaque alpha channel to RGB/GRAY rows, so all rows have
+   * the layout of image pixels and can be read directly.
+   */
+  const bool directRows = png_layout_matches_image();
+  if (directRows &&
+      (color_type == PNG_COLOR_TYPE_RGB ||
+       color_type == PNG_COLOR_TYPE_GRAY))
+    png_set_filler(png_ptr, 0xff, PNG_FILLER_AFTER);
+
   /* Turn on interlace handling.  REQUIRED if you are not using
    * png_read_image().  To see how to handle interlacing passes,
    * see the png_read_row() method below:
@@ -227,6 +257,42 @@ bool PngFormat::onLoad(FileOp* fop)
 
   mask_entry = fop->document->sprite()->transparentColor();
 
+  // Read each row directly in the image (so libpng combines the
+  // passes of interlaced images in the image itself)
+  if (directRows) {
+    ASSERT(png_get_rowbytes(png_ptr, info_ptr) ==
+           png_size_t(image->getRowStrideSize()));
+
+    for (pass = 0; pass < number_passes; pass++) {
+      for (y = 0; y < height; y++) {
+        png_read_row(png_ptr, image->getPixelAddress(0, y), (png_byte*)NULL);
+
+        fop_progress(fop,
+                     (double)((double)pass + (double)(y+1) / (double)(height))
+                     / (double)number_passes);
+
+        if (fop_is_stop(fop))
+          break;
+      }
+    }
+
+    // Transparent palette entries are replaced with the mask entry
+    if (pixelFormat == IMAGE_INDEXED) {
+      Remap remap(256);
+      bool identity = true;
+      for (int c=0; c<256; ++c) {
+        remap.map(c, (pal_alphas[c] < 128 ? mask_entry: c));
+        if (remap[c] != c)
+          identity = false;
+      }
+      if (!identity)
+        remap_image(image, remap);
+    }
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    return true;
+  }
+
   /* Allocate the memory to hold the image using the fields of info_ptr. */
 
    /* The easiest way to read the image: */
@@ -320,6 +386,294 @@ bool PngFormat::onLoad(FileOp* fop)
 }
 
 #ifdef ENABLE_SAVE
+
+// Minimum number of bytes of filtered rows that each thread
+// compresses with the parallel deflate (smaller images are
+// compressed by libpng).
+static const std::size_t kMinDeflateChunkSize = 128*1024;
+
+// The last bytes of each chunk are used as the dictionary to
+// compress the next one (so the ratio is almost the same of a
+// sequential deflate).
+static const std::size_t kDeflateWindowSize = 32*1024;
+
+// Converts the row "y" of the image to the PNG format of the given
+// color type.
+static void fill_png_row(const Image* image, int y, int color_type, uint8_t* dst_address)
+{
+  const int width = image->width();
+  int x;
+
+  switch (color_type) {
+
+    case PNG_COLOR_TYPE_RGB_ALPHA: {
+      const uint32_t* src_address = (const uint32_t*)image->getPixelAddress(0, y);
+      for (x=0; x<width; ++x) {
+        uint32_t c = *(src_address++);
+        *(dst_address++) = rgba_getr(c);
+        *(dst_address++) = rgba_getg(c);
+        *(dst_address++) = rgba_getb(c);
+        *(dst_address++) = rgba_geta(c);
+      }
+      break;
+    }
+
+    case PNG_COLOR_TYPE_RGB: {
+      const uint32_t* src_address = (const uint32_t*)image->getPixelAddress(0, y);
+      for (x=0; x<width; ++x) {
+        uint32_t c = *(src_address++);
+        *(dst_address++) = rgba_getr(c);
+        *(dst_address++) = rgba_getg(c);
+        *(dst_address++) = rgba_getb(c);
+      }
+      break;
+    }
+
+    case PNG_COLOR_TYPE_GRAY_ALPHA: {
+      const uint16_t* src_address = (const uint16_t*)image->getPixelAddress(0, y);
+      for (x=0; x<width; ++x) {
+        uint16_t c = *(src_address++);
+        *(dst_address++) = graya_getv(c);
+        *(dst_address++) = graya_geta(c);
+      }
+      break;
+    }
+
+    case PNG_COLOR_TYPE_GRAY: {
+      const uint16_t* src_address = (const uint16_t*)image->getPixelAddress(0, y);
+      for (x=0; x<width; ++x)
+        *(dst_address++) = graya_getv(*(src_address++));
+      break;
+    }
+
+    case PNG_COLOR_TYPE_PALETTE:
+      std::memcpy(dst_address, image->getPixelAddress(0, y), width);
+      break;
+  }
+}
+
+static inline uint8_t paeth_predictor(int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = std::abs(p - a);
+  int pb = std::abs(p - b);
+  int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  else if (pb <= pc)
+    return b;
+  else
+    return c;
+}
+
+// Applies the given PNG filter type (from 0=None to 4=Paeth) to the
+// row. "prev" is the previous unfiltered row (NULL for the first row).
+static void apply_png_filter(int filter, const uint8_t* row, const uint8_t* prev,
+                             std::size_t rowbytes, int bpp, uint8_t* dst)
+{
+  for (std::size_t i=0; i<rowbytes; ++i) {
+    int a = (i >= std::size_t(bpp) ? row[i-bpp]: 0);
+    int b = (prev ? prev[i]: 0);
+    int c = (prev && i >= std::size_t(bpp) ? prev[i-bpp]: 0);
+    int predictor;
+    switch (filter) {
+      case PNG_FILTER_VALUE_SUB: predictor = a; break;
+      case PNG_FILTER_VALUE_UP: predictor = b; break;
+      case PNG_FILTER_VALUE_AVG: predictor = (a + b) / 2; break;
+      case PNG_FILTER_VALUE_PAETH: predictor = paeth_predictor(a, b, c); break;
+      default: predictor = 0; break;
+    }
+    dst[i] = uint8_t(row[i] - predictor);
+  }
+}
+
+// Filters a row in "dst" (the filter type byte plus "rowbytes" of
+// filtered data). With "adaptive" it uses the same heuristic of
+// libpng: the filter with the minimum sum of absolute differences
+// (bytes as signed values). "tmp" must have space for "rowbytes".
+static void filter_png_row(const uint8_t* row, const uint8_t* prev,
+                           std::size_t rowbytes, int bpp,
+                           bool adaptive, int fixedFilter,
+                           uint8_t* tmp, uint8_t* dst)
+{
+  if (!adaptive) {
+    dst[0] = fixedFilter;
+    apply_png_filter(fixedFilter, row, prev, rowbytes, bpp, dst+1);
+    return;
+  }
+
+  uint64_t bestSum = 0;
+  for (int filter=PNG_FILTER_VALUE_NONE; filter<PNG_FILTER_VALUE_LAST; ++filter) {
+    apply_png_filter(filter, row, prev, rowbytes, bpp, tmp);
+
+    uint64_t sum = 0;
+    for (std::size_t i=0; i<rowbytes; ++i)
+      sum += (tmp[i] < 128 ? tmp[i]: 256 - tmp[i]);
+
+    if (filter == PNG_FILTER_VALUE_NONE || sum < bestSum) {
+      bestSum = sum;
+      dst[0] = filter;
+      std::memcpy(dst+1, tmp, rowbytes);
+    }
+  }
+}
+
+// Compresses a chunk of the zlib stream as raw deflate data. Chunks
+// that are not the last one finish with a sync flush (byte aligned
+// and without the final block bit) so they can be concatenated.
+static bool deflate_png_chunk(const uint8_t* data, std::size_t size,
+                              const uint8_t* dict, std::size_t dictSize,
+                              int level, int memLevel, bool last,
+                              std::vector<uint8_t>& output)
+{
+  z_stream zstream;
+  std::memset(&zstream, 0, sizeof(zstream));
+  if (deflateInit2(&zstream, level, Z_DEFLATED, -MAX_WBITS,
+                   memLevel, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+
+  if (dictSize > 0)
+    deflateSetDictionary(&zstream, (const Bytef*)dict, uInt(dictSize));
+
+  output.resize(deflateBound(&zstream, uLong(size)) + 16);
+  zstream.next_in = (Bytef*)data;
+  zstream.avail_in = uInt(size);
+  zstream.next_out = (Bytef*)&output[0];
+  zstream.avail_out = uInt(output.size());
+
+  int ret = deflate(&zstream, last ? Z_FINISH: Z_SYNC_FLUSH);
+  output.resize(output.size() - zstream.avail_out);
+  deflateEnd(&zstream);
+
+  return (last ? ret == Z_STREAM_END:
+                 ret == Z_OK && zstream.avail_in == 0);
+}
+
+// Writes the image data (IDAT chunks) and the IEND chunk instead of
+// png_write_rows()/png_write_end(), filtering and compressing chunks
+// of rows in parallel. The zlib stream is combined from the
+// compressed chunks: a zlib header, the concatenated deflate data,
+// and the Adler-32 of all filtered rows (calculated from the Adler-32
+// of each chunk).
+static bool write_png_parallel(png_structp png_ptr, const Image* image,
+                               int color_type, std::size_t rowbytes, int bpp,
+                               bool adaptive, int fixedFilter,
+                               int level, int memLevel, int chunks)
+{
+  const int height = image->height();
+  const std::size_t stride = rowbytes+1;
+  const int rowsPerChunk = (height + chunks - 1) / chunks;
+  chunks = (height + rowsPerChunk - 1) / rowsPerChunk;
+
+  std::vector<uint8_t> raw(rowbytes*height);
+  std::vector<uint8_t> filtered(stride*height);
+  std::vector<std::vector<uint8_t> > outputs(chunks);
+  std::vector<uLong> adlers(chunks);
+  std::vector<char> oks(chunks, 0);
+
+  base::thread_pool::global().parallel_for(
+    chunks,
+    [&](int i) {
+      const int y0 = i*rowsPerChunk;
+      const int y1 = std::min(height, y0+rowsPerChunk);
+      for (int y=y0; y<y1; ++y)
+        fill_png_row(image, y, color_type, &raw[rowbytes*y]);
+    });
+
+  base::thread_pool::global().parallel_for(
+    chunks,
+    [&](int i) {
+      const int y0 = i*rowsPerChunk;
+      const int y1 = std::min(height, y0+rowsPerChunk);
+      std::vector<uint8_t> tmp(rowbytes);
+      for (int y=y0; y<y1; ++y)
+        filter_png_row(&raw[rowbytes*y],
+                       (y > 0 ? &raw[rowbytes*(y-1)]: NULL),
+                       rowbytes, bpp, adaptive, fixedFilter,
+                       &tmp[0], &filtered[stride*y]);
+    });
+
+  base::thread_pool::global().parallel_for(
+    chunks,
+    [&](int i) {
+      const std::size_t begin = stride*(i*rowsPerChunk);
+      const std::size_t end = std::min(filtered.size(), stride*((i+1)*rowsPerChunk));
+      const std::size_t dictSize = std::min(begin, kDeflateWindowSize);
+
+      adlers[i] = adler32(adler32(0, NULL, 0), &filtered[begin], uInt(end-begin));
+      oks[i] = deflate_png_chunk(&filtered[begin], end-begin,
+                                 &filtered[begin-dictSize], dictSize,
+                                 level, memLevel, (i == chunks-1),
+                                 outputs[i]);
+    });
+
+  for (int i=0; i<chunks; ++i)
+    if (!oks[i])
+      return false;
+
+  // zlib header (32K window) with the compression level hint
+  int flevel = (level == Z_DEFAULT_COMPRESSION ? 2:
+                level < 2 ? 0:
+                level < 6 ? 1:
+                level == 6 ? 2: 3);
+  int header = (0x78 << 8) | (flevel << 6);
+  header += 31 - (header % 31);
+  outputs[0].insert(outputs[0].begin(), uint8_t(header & 0xff));
+  outputs[0].insert(outputs[0].begin(), uint8_t(header >> 8));
+
+  uLong adler = adlers[0];
+  for (int i=1; i<chunks; ++i) {
+    const std::size_t begin = stride*(i*rowsPerChunk);
+    const std::size_t end = std::min(filtered.size(), stride*((i+1)*rowsPerChunk));
+    adler = adler32_combine(adler, adlers[i], z_off_t(end-begin));
+  }
+  std::vector<uint8_t>& last = outputs[chunks-1];
+  last.push_back(uint8_t((adler >> 24) & 0xff));
+  last.push_back(uint8_t((adler >> 16) & 0xff));
+  last.push_back(uint8_t((adler >> 8) & 0xff));
+  last.push_back(uint8_t(adler & 0xff));
+
+  for (int i=0; i<chunks; ++i)
+    png_write_chunk(png_ptr, (png_const_bytep)"IDAT",
+                    &outputs[i][0], outputs[i].size());
+
+  png_write_chunk(png_ptr, (png_const_bytep)"IEND", NULL, 0);
+  return true;
+}
+
+// Sets the compression level and row filters of the profile.
+static void set_png_compression(png_structp png_ptr, const PngOptions* options,
+                                int color_type, int& level, int& memLevel,
+                                bool& adaptive, int& fixedFilter)
+{
+  level = Z_DEFAULT_COMPRESSION;
+  memLevel = 8;
+  adaptive = (color_type != PNG_COLOR_TYPE_PALETTE);
+  fixedFilter = PNG_FILTER_VALUE_NONE;
+
+  switch (options->profile()) {
+    case PngOptions::Fastest:
+      level = 1;
+      adaptive = false;
+      if (color_type != PNG_COLOR_TYPE_PALETTE)
+        fixedFilter = PNG_FILTER_VALUE_SUB;
+      break;
+    case PngOptions::Balanced:
+      break;
+    case PngOptions::Smallest:
+      level = Z_BEST_COMPRESSION;
+      memLevel = 9;
+      break;
+  }
+
+  png_set_compression_level(png_ptr, level);
+  png_set_compression_mem_level(png_ptr, memLevel);
+  png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE,
+                 adaptive ? PNG_ALL_FILTERS:
+                 fixedFilter == PNG_FILTER_VALUE_SUB ? PNG_FILTER_SUB:
+                                                       PNG_FILTER_NONE);
+}
+
 bool PngFormat::onSave(FileOp* fop)
 {
   Image* image = fop->seq.image.get();
@@ -431,16 +785,53 @@ bool PngFormat::onSave(FileOp* fop)
     }
   }
 
+  // Compression level and row filters of the profile
+  PngOptions defaultOptions;
+  const PngOptions* options = dynamic_cast<PngOptions*>(fop->document->getFormatOptions().get());
+  if (!options)
+    options = &defaultOptions;
+
+  int level, memLevel, fixedFilter;
+  bool adaptive;
+  set_png_compression(png_ptr, options, color_type,
+                      level, memLevel, adaptive, fixedFilter);
+
   /* Write the file header information. */
   png_write_info(png_ptr, info_ptr);
 
   /* pack pixels into bytes */
   png_set_packing(png_ptr);
 
+  const std::size_t rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+
+  // Compress chunks of rows in parallel (only if each thread has
+  // enough data to compress)
+  if (options->parallelDeflate()) {
+    const int threads = base::thread_pool::global().workers()+1;
+    const int chunks = int(std::min<std::size_t>(
+        threads, (rowbytes+1)*height / kMinDeflateChunkSize));
+
+    if (chunks > 1) {
+      bool ok = write_png_parallel(png_ptr, image, color_type,
+                                   rowbytes, png_get_channels(png_ptr, info_ptr),
+                                   adaptive, fixedFilter, level, memLevel,
+                                   chunks);
+      if (image->pixelFormat() == IMAGE_INDEXED)
+        png_free(png_ptr, palette);
+      png_destroy_write_struct(&png_ptr, &info_ptr);
+
+      if (!ok)
+        fop_error(fop, "Error compressing PNG image data\n");
+      else
+        fop_progress(fop, 1.0);
+      return ok;
+    }
+  }
+
   /* non-interlaced */
   number_passes = 1;
 
-  row_pointer = (png_bytep)png_malloc(png_ptr, png_get_rowbytes(png_ptr, info_ptr));
+  row_pointer = (png_bytep)png_malloc(png_ptr, rowbytes);
 
   /* The number of passes is either 1 for non-interlaced images,
    * or 7 for interlaced images.
@@ -448,65 +839,7 @@ bool PngFormat::onSave(FileOp* fop)
   for (pass = 0; pass < number_passes; pass++) {
     /* If you are only writing one row at a time, this works */
     for (y = 0; y < height; y++) {
-      /* RGB_ALPHA */
-      if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_RGB_ALPHA) {
-        uint32_t* src_address = (uint32_t*)image->getPixelAddress(0, y);
-        uint8_t* dst_address = row_pointer;
-        unsigned int x, c;
-
-        for (x=0; x<width; x++) {
-          c = *(src_address++);
-          *(dst_address++) = rgba_getr(c);
-          *(dst_address++) = rgba_getg(c);
-          *(dst_address++) = rgba_getb(c);
-          *(dst_address++) = rgba_geta(c);
-        }
-      }
-      /* RGB */
-      else if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_RGB) {
-        uint32_t* src_address = (uint32_t*)image->getPixelAddress(0, y);
-        uint8_t* dst_address = row_pointer;
-        unsigned int x, c;
-
-        for (x=0; x<width; x++) {
-          c = *(src_address++);
-          *(dst_address++) = rgba_getr(c);
-          *(dst_address++) = rgba_getg(c);
-          *(dst_address++) = rgba_getb(c);
-        }
-      }
-      /* GRAY_ALPHA */
-      else if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_GRAY_ALPHA) {
-        uint16_t* src_address = (uint16_t*)image->getPixelAddress(0, y);
-        uint8_t* dst_address = row_pointer;
-        unsigned int x, c;
-
-        for (x=0; x<width; x++) {
-          c = *(src_address++);
-          *(dst_address++) = graya_getv(c);
-          *(dst_address++) = graya_geta(c);
-        }
-      }
-      /* GRAY */
-      else if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_GRAY) {
-        uint16_t* src_address = (uint16_t*)image->getPixelAddress(0, y);
-        uint8_t* dst_address = row_pointer;
-        unsigned int x, c;
-
-        for (x=0; x<width; x++) {
-          c = *(src_address++);
-          *(dst_address++) = graya_getv(c);
-        }
-      }
-      /* PALETTE */
-      else if (png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_PALETTE) {
-        uint8_t* src_address = (uint8_t*)image->getPixelAddress(0, y);
-        uint8_t* dst_address = row_pointer;
-        unsigned int x;
-
-        for (x=0; x<width; x++)
-          *(dst_address++) = *(src_address++);
-      }
+      fill_png_row(image, y, color_type, row_pointer);
 
       /* write the line */
       png_write_rows(png_ptr, &row_pointer, 1);
@@ -538,6 +871,157 @@ bool PngFormat::onSave(FileOp* fop)
   /* all right */
   return true;
 }
+
+// Maximum size of a band of rows rendered by save_png_by_bands()
+static const std::size_t kMaxBandSize = 8*1024*1024;
+
+namespace {
+
+// State of save_png_by_bands() shared with write_png_bands() (which
+// cannot have objects with destructors because a libpng error
+// longjmps to it).
+struct PngBands {
+  const PngBandRenderer* renderer;
+  ImageRef images[2];
+  base::task_token_ptr tokens[2];
+  int height;
+
+  // Renders the band that starts in the row "y" in the given image
+  // in a worker thread.
+  void render(int i, int y) {
+    tokens[i].reset(new base::task_token);
+    Image* image = images[i].get();
+    const PngBandRenderer* f = renderer;
+    base::thread_pool::global().execute(
+      [f, image, y]{
+        image->clear(0);
+        (*f)(image, y);
+      }, tokens[i]);
+  }
+
+  void wait(int i) {
+    if (tokens[i])
+      tokens[i]->wait();
+  }
+};
+
+} // anonymous namespace
+
+static bool write_png_bands(png_structp png_ptr, png_infop info_ptr,
+                            PngBands* bands, int color_type, png_bytep row)
+{
+  if (setjmp(png_jmpbuf(png_ptr)))
+    return false;
+
+  png_write_info(png_ptr, info_ptr);
+  png_set_packing(png_ptr);
+
+  const int bandHeight = bands->images[0]->height();
+  int i = 0;
+
+  bands->render(0, 0);
+  for (int y=0; y<bands->height; y+=bandHeight, i^=1) {
+    bands->wait(i);
+
+    // Render the next band while this one is compressed
+    if (y+bandHeight < bands->height)
+      bands->render(i^1, y+bandHeight);
+
+    const Image* image = bands->images[i].get();
+    for (int v=0; v<bandHeight && y+v<bands->height; ++v) {
+      fill_png_row(image, v, color_type, row);
+      png_write_rows(png_ptr, &row, 1);
+    }
+  }
+
+  png_write_end(png_ptr, info_ptr);
+  return true;
+}
+
+bool save_png_by_bands(const std::string& filename,
+                       const Sprite* sprite,
+                       const PngOptions& options,
+                       const PngBandRenderer& renderer)
+{
+  FileHandle handle(open_file_with_exception(filename, "wb"));
+
+  png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (!png_ptr)
+    return false;
+
+  png_infop info_ptr = png_create_info_struct(png_ptr);
+  if (!info_ptr || setjmp(png_jmpbuf(png_ptr))) {
+    png_destroy_write_struct(&png_ptr, info_ptr ? &info_ptr: NULL);
+    return false;
+  }
+
+  png_init_io(png_ptr, handle.get());
+
+  const int width = sprite->width();
+  const int height = sprite->height();
+  int color_type = 0;
+  switch (sprite->pixelFormat()) {
+    case IMAGE_RGB:
+      color_type = (sprite->needAlpha() ? PNG_COLOR_TYPE_RGB_ALPHA: PNG_COLOR_TYPE_RGB);
+      break;
+    case IMAGE_GRAYSCALE:
+      color_type = (sprite->needAlpha() ? PNG_COLOR_TYPE_GRAY_ALPHA: PNG_COLOR_TYPE_GRAY);
+      break;
+    case IMAGE_INDEXED:
+      color_type = PNG_COLOR_TYPE_PALETTE;
+      break;
+  }
+
+  png_set_IHDR(png_ptr, info_ptr, width, height, 8, color_type,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+  // Same palette and transparent entry of PngFormat::onSave()
+  png_color palette[PNG_MAX_PALETTE_LENGTH];
+  png_byte trans[PNG_MAX_PALETTE_LENGTH];
+  if (color_type == PNG_COLOR_TYPE_PALETTE) {
+    const Palette* pal = sprite->palette(frame_t(0));
+    for (int c=0; c<PNG_MAX_PALETTE_LENGTH; ++c) {
+      color_t color = (c < pal->size() ? pal->getEntry(c): rgba(0, 0, 0, 255));
+      palette[c].red   = rgba_getr(color);
+      palette[c].green = rgba_getg(color);
+      palette[c].blue  = rgba_getb(color);
+    }
+    png_set_PLTE(png_ptr, info_ptr, palette, PNG_MAX_PALETTE_LENGTH);
+
+    if (sprite->backgroundLayer() == NULL ||
+        !sprite->backgroundLayer()->isVisible()) {
+      int mask_entry = sprite->transparentColor();
+      for (int c=0; c<=mask_entry; ++c)
+        trans[c] = (c == mask_entry ? 0: 255);
+      png_set_tRNS(png_ptr, info_ptr, trans, mask_entry+1, NULL);
+    }
+  }
+
+  int level, memLevel, fixedFilter;
+  bool adaptive;
+  set_png_compression(png_ptr, &options, color_type,
+                      level, memLevel, adaptive, fixedFilter);
+
+  // Two bands: one is compressed while the other is rendered
+  const std::size_t rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+  const int bandHeight = MID(1, int(kMaxBandSize / rowbytes), height);
+  PngBands bands;
+  bands.renderer = &renderer;
+  bands.height = height;
+  for (int i=0; i<2; ++i)
+    bands.images[i].reset(Image::create(sprite->pixelFormat(), width, bandHeight));
+  std::vector<uint8_t> row(rowbytes);
+
+  bool ok = write_png_bands(png_ptr, info_ptr, &bands, color_type, &row[0]);
+
+  // The pending band cannot be rendered after this point
+  bands.wait(0);
+  bands.wait(1);
+
+  png_destroy_write_struct(&png_ptr, &info_ptr);
+  return ok;
+}
+
 #endif
 
 } // namespace app
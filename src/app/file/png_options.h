@@ -0,0 +1,59 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_FILE_PNG_OPTIONS_H_INCLUDED
+#define APP_FILE_PNG_OPTIONS_H_INCLUDED
+#pragma once
+
+#include "app/file/format_options.h"
+
+#include <string>
+
+namespace app {
+
+  // Data for PNG files
+  class PngOptions : public FormatOptions {
+  public:
+    // Presets of zlib compression level and row filters. Indexed
+    // images never use filters (as the PNG spec recommends).
+    enum Profile {
+      Fastest,                  // Level 1 and the Sub filter
+      Balanced,                 // libpng defaults (level 6 and adaptive filters)
+      Smallest                  // Level 9 and adaptive filters
+    };
+
+    PngOptions(Profile profile = Balanced,
+               bool parallelDeflate = false)
+      : m_profile(profile)
+      , m_parallelDeflate(parallelDeflate) {
+    }
+
+    Profile profile() const { return m_profile; }
+    bool parallelDeflate() const { return m_parallelDeflate; }
+
+    void setProfile(Profile profile) { m_profile = profile; }
+    void setParallelDeflate(bool state) { m_parallelDeflate = state; }
+
+    // Converts "fastest", "balanced" or "smallest" to a profile.
+    // Returns false if the name is invalid.
+    static bool profileFromString(const std::string& name, Profile& profile) {
+      if (name == "fastest") profile = Fastest;
+      else if (name == "balanced") profile = Balanced;
+      else if (name == "smallest") profile = Smallest;
+      else
+        return false;
+      return true;
+    }
+
+  private:
+    Profile m_profile;
+    bool m_parallelDeflate;     // Compress chunks of rows in parallel
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,197 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+// Uncompressed frames to be piped to an external encoder (e.g. a
+// video encoder reading a named pipe, or the standard output when
+// the file title is "-", e.g. "-.rawframes"). All values are
+// little-endian:
+//
+//   char[4]   "AFRM"
+//   u16       Version (1)
+//   u16       Pixel format (0 = RGBA, 1 = Indexed)
+//   u32       Width
+//   u32       Height
+//   u32       Number of frames
+//   u32[n]    Duration in milliseconds of each frame
+//
+// Then each frame: for RGBA, width*height*4 bytes (R, G, B, A of
+// each pixel); for Indexed, the palette (256 R, G, B, A entries)
+// and width*height bytes.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/document.h"
+#include "app/file/file.h"
+#include "app/file/file_format.h"
+#include "app/file/format_options.h"
+#include "app/file/frames_pipeline.h"
+#include "base/cfile.h"
+#include "base/file_handle.h"
+#include "base/path.h"
+#include "base/thread_pool.h"
+#include "base/unique_ptr.h"
+#include "doc/doc.h"
+#include "render/render.h"
+
+#include <cstdio>
+#include <vector>
+
+#ifdef _WIN32
+  #include <fcntl.h>
+  #include <io.h>
+#endif
+
+namespace app {
+
+using namespace base;
+
+class RawFramesFormat : public FileFormat {
+  enum { kRgba = 0, kIndexed = 1 };
+
+  const char* onGetName() const { return "rawframes"; }
+  const char* onGetExtensions() const { return "rawframes"; }
+  int onGetFlags() const {
+    return
+      FILE_SUPPORT_SAVE |
+      FILE_SUPPORT_RGB |
+      FILE_SUPPORT_RGBA |
+      FILE_SUPPORT_GRAY |
+      FILE_SUPPORT_GRAYA |
+      FILE_SUPPORT_INDEXED |
+      FILE_SUPPORT_FRAMES |
+      FILE_SUPPORT_PALETTES;
+  }
+
+  bool onLoad(FileOp* fop) override;
+#ifdef ENABLE_SAVE
+  bool onSave(FileOp* fop) override;
+#endif
+};
+
+FileFormat* CreateRawFramesFormat()
+{
+  return new RawFramesFormat;
+}
+
+bool RawFramesFormat::onLoad(FileOp* fop)
+{
+  fop_error(fop, "Raw frames cannot be loaded.\n");
+  return false;
+}
+
+#ifdef ENABLE_SAVE
+
+static void write_bytes(FILE* f, const std::vector<uint8_t>& bytes)
+{
+  if (fwrite(&bytes[0], 1, bytes.size(), f) != bytes.size())
+    throw Exception("Error writing frames (the pipe was closed?).\n");
+}
+
+bool RawFramesFormat::onSave(FileOp* fop)
+{
+  const Sprite* sprite = fop->document->sprite();
+  const int w = sprite->width();
+  const int h = sprite->height();
+  const frame_t nframes = sprite->totalFrames();
+  const bool indexed = (sprite->pixelFormat() == IMAGE_INDEXED);
+
+  FileHandle handle;
+  if (get_file_title(fop->filename) == "-") {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    handle = FileHandle(stdout, fflush);
+  }
+  else
+    handle = open_file_with_exception(fop->filename, "wb");
+  FILE* f = handle.get();
+
+  fputc('A', f);
+  fputc('F', f);
+  fputc('R', f);
+  fputc('M', f);
+  fputw(1, f);
+  fputw(indexed ? kIndexed: kRgba, f);
+  fputl(w, f);
+  fputl(h, f);
+  fputl(nframes, f);
+  for (frame_t frame(0); frame<nframes; ++frame)
+    fputl(sprite->frameDuration(frame), f);
+
+  // Frames are rendered by worker threads (one frame for each worker
+  // plus the one being written), and written in order.
+  base::UniquePtr<Image> image(Image::create(indexed ? IMAGE_INDEXED: IMAGE_RGB, w, h));
+  Palette palette(frame_t(0), 256);
+
+  FramesPipeline frames(
+    nframes, base::thread_pool::global().workers()+1,
+    image, &palette,
+    [sprite](frame_t frame, Image* image, Palette* palette) {
+      render::Render render;
+      render.setBgType(render::BgType::NONE);
+      clear_image(image, (image->pixelFormat() == IMAGE_INDEXED ?
+                          sprite->transparentColor(): 0));
+      render.renderSprite(image, sprite, frame);
+      sprite->palette(frame)->copyColorsTo(palette);
+    });
+
+  std::vector<uint8_t> bytes(indexed ? w: 4*w);
+  std::vector<uint8_t> paletteBytes(4*256);
+
+  for (frame_t frame(0); frame<nframes; ++frame) {
+    const Palette* framePalette = NULL;
+    const Image* frameImage = frames.image(frame, &framePalette);
+
+    if (indexed) {
+      for (int i=0; i<256; ++i) {
+        color_t c = (i < framePalette->size() ? framePalette->getEntry(i): 0);
+        paletteBytes[4*i  ] = rgba_getr(c);
+        paletteBytes[4*i+1] = rgba_getg(c);
+        paletteBytes[4*i+2] = rgba_getb(c);
+        paletteBytes[4*i+3] = rgba_geta(c);
+      }
+      write_bytes(f, paletteBytes);
+
+      for (int y=0; y<h; ++y) {
+        const uint8_t* src = (const uint8_t*)frameImage->getPixelAddress(0, y);
+        std::copy(src, src+w, bytes.begin());
+        write_bytes(f, bytes);
+      }
+    }
+    else {
+      for (int y=0; y<h; ++y) {
+        const uint32_t* src = (const uint32_t*)frameImage->getPixelAddress(0, y);
+        uint8_t* dst = &bytes[0];
+        for (int x=0; x<w; ++x, ++src) {
+          *(dst++) = rgba_getr(*src);
+          *(dst++) = rgba_getg(*src);
+          *(dst++) = rgba_getb(*src);
+          *(dst++) = rgba_geta(*src);
+        }
+        write_bytes(f, bytes);
+      }
+    }
+
+    frames.release(frame);
+
+    fop_progress(fop, double(frame+1) / double(nframes));
+    if (fop_is_stop(fop))
+      break;
+  }
+
+  if (ferror(f)) {
+    fop_error(fop, "Error writing frames.\n");
+    return false;
+  }
+  return true;
+}
+
+#endif
+
+} // namespace app
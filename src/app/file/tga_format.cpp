@@ -18,6 +18,10 @@
 #include "base/cfile.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
+#include "doc/image_span.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace app {
 
@@ -184,12 +188,23 @@ static void rle_tga_read16(uint32_t* address, int w, FILE *f)
   } while (c < w);
 }
 
+// Reads "size" bytes from the file in "buf" (the rest is zero if the
+// file ends before).
+static const uint8_t* read_line(FILE* f, std::vector<uint8_t>& buf, std::size_t size)
+{
+  ASSERT(size <= buf.size());
+  std::size_t n = fread(&buf[0], 1, size, f);
+  if (n < size)
+    std::fill(buf.begin()+n, buf.begin()+size, 0);
+  return &buf[0];
+}
+
 // Loads a 256 color or 24 bit uncompressed TGA file, returning a bitmap
 // structure and storing the palette data in the specified palette (this
 // should be an array of at least 256 RGB structures).
 bool TgaFormat::onLoad(FileOp* fop)
 {
-  unsigned char image_id[256], image_palette[256][3], rgb[4];
+  unsigned char image_id[256], image_palette[256][3];
   unsigned char id_length, palette_type, image_type, palette_entry_size;
   unsigned char bpp, descriptor_bits;
   short unsigned int palette_colors;
@@ -305,6 +320,10 @@ bool TgaFormat::onLoad(FileOp* fop)
   if (!image)
     return false;
 
+  // Buffer to read whole scanlines of uncompressed images
+  std::vector<uint8_t> buf(image_width * ((bpp+7)/8) + 1);
+  const uint8_t* src;
+
   for (y=image_height; y; y--) {
     yc = (descriptor_bits & 0x20) ? image_height-y : y-1;
 
@@ -317,8 +336,11 @@ bool TgaFormat::onLoad(FileOp* fop)
         else if (image_type == 1)
           fread(image->getPixelAddress(0, yc), 1, image_width, f);
         else {
+          GrayscaleTraits::address_t dst =
+            (GrayscaleTraits::address_t)image->getPixelAddress(0, yc);
+          src = read_line(f, buf, image_width);
           for (x=0; x<image_width; x++)
-            put_pixel_fast<GrayscaleTraits>(image, x, yc, graya(fgetc(f), 255));
+            dst[x] = graya(src[x], 255);
         }
         break;
 
@@ -328,10 +350,11 @@ bool TgaFormat::onLoad(FileOp* fop)
             rle_tga_read32((uint32_t*)image->getPixelAddress(0, yc), image_width, f);
           }
           else {
-            for (x=0; x<image_width; x++) {
-              fread(rgb, 1, 4, f);
-              put_pixel_fast<RgbTraits>(image, x, yc, rgba(rgb[2], rgb[1], rgb[0], rgb[3]));
-            }
+            RgbTraits::address_t dst =
+              (RgbTraits::address_t)image->getPixelAddress(0, yc);
+            src = read_line(f, buf, 4*image_width);
+            for (x=0; x<image_width; x++, src+=4)
+              dst[x] = rgba(src[2], src[1], src[0], src[3]);
           }
         }
         else if (bpp == 24) {
@@ -339,10 +362,11 @@ bool TgaFormat::onLoad(FileOp* fop)
             rle_tga_read24((uint32_t*)image->getPixelAddress(0, yc), image_width, f);
           }
           else {
-            for (x=0; x<image_width; x++) {
-              fread(rgb, 1, 3, f);
-              put_pixel_fast<RgbTraits>(image, x, yc, rgba(rgb[2], rgb[1], rgb[0], 255));
-            }
+            RgbTraits::address_t dst =
+              (RgbTraits::address_t)image->getPixelAddress(0, yc);
+            src = read_line(f, buf, 3*image_width);
+            for (x=0; x<image_width; x++, src+=3)
+              dst[x] = rgba(src[2], src[1], src[0], 255);
           }
         }
         else {
@@ -350,11 +374,14 @@ bool TgaFormat::onLoad(FileOp* fop)
             rle_tga_read16((uint32_t*)image->getPixelAddress(0, yc), image_width, f);
           }
           else {
-            for (x=0; x<image_width; x++) {
-              c = fgetw(f);
-              put_pixel_fast<RgbTraits>(image, x, yc, rgba(((c >> 10) & 0x1F),
-                                                           ((c >> 5) & 0x1F),
-                                                           (c & 0x1F), 255));
+            RgbTraits::address_t dst =
+              (RgbTraits::address_t)image->getPixelAddress(0, yc);
+            src = read_line(f, buf, 2*image_width);
+            for (x=0; x<image_width; x++, src+=2) {
+              c = src[0] | (src[1] << 8);
+              dst[x] = rgba(((c >> 10) & 0x1F),
+                            ((c >> 5) & 0x1F),
+                            (c & 0x1F), 255);
             }
           }
         }
@@ -384,7 +411,7 @@ bool TgaFormat::onSave(FileOp* fop)
 {
   Image* image = fop->seq.image.get();
   unsigned char image_palette[256][3];
-  int x, y, c, r, g, b;
+  int y, r, g, b;
   int depth = (image->pixelFormat() == IMAGE_RGB) ? 32 : 8;
   bool need_pal = (image->pixelFormat() == IMAGE_INDEXED)? true: false;
 
@@ -423,8 +450,7 @@ bool TgaFormat::onSave(FileOp* fop)
 
     case IMAGE_RGB:
       for (y=image->height()-1; y>=0; y--) {
-        for (x=0; x<image->width(); x++) {
-          c = get_pixel(image, x, y);
+        for (RgbTraits::pixel_t c : image->row<RgbTraits>(y)) {
           fputc(rgba_getb(c), f);
           fputc(rgba_getg(c), f);
           fputc(rgba_getr(c), f);
@@ -437,8 +463,8 @@ bool TgaFormat::onSave(FileOp* fop)
 
     case IMAGE_GRAYSCALE:
       for (y=image->height()-1; y>=0; y--) {
-        for (x=0; x<image->width(); x++)
-          fputc(graya_getv(get_pixel(image, x, y)), f);
+        for (GrayscaleTraits::pixel_t c : image->row<GrayscaleTraits>(y))
+          fputc(graya_getv(c), f);
 
         fop_progress(fop, (float)(image->height()-y) / (float)(image->height()));
       }
@@ -446,8 +472,8 @@ bool TgaFormat::onSave(FileOp* fop)
 
     case IMAGE_INDEXED:
       for (y=image->height()-1; y>=0; y--) {
-        for (x=0; x<image->width(); x++)
-          fputc(get_pixel(image, x, y), f);
+        for (IndexedTraits::pixel_t c : image->row<IndexedTraits>(y))
+          fputc(c, f);
 
         fop_progress(fop, (float)(image->height()-y) / (float)(image->height()));
       }
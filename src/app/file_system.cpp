@@ -17,6 +17,7 @@
 
 #include "app/file_system.h"
 
+#include "base/folder_watcher.h"
 #include "base/fs.h"
 #include "base/path.h"
 #include "base/string.h"
@@ -25,6 +26,7 @@
 #include "she/system.h"
 
 #include <algorithm>
+#include <climits>
 #include <cstdio>
 #include <map>
 #include <utility>
@@ -61,18 +63,28 @@ public:
   FileItemList children;
   unsigned int version;
   bool removed;
+  bool listed;                  // True if it's in the parent's children list
   bool is_folder;
+  bool listing;                 // True if children are being listed
+  bool watched;                 // True if changes in the folder are notified
 #ifdef _WIN32
   LPITEMIDLIST pidl;            // relative to parent
   LPITEMIDLIST fullpidl;        // relative to the Desktop folder
                                 // (like a full path-name, because the
                                 // desktop is the root on Windows)
+  IShellFolder* listFolder;
+  IEnumIDList* listEnum;
+#else
+  DIR* listDir;
 #endif
 
   FileItem(FileItem* parent);
   ~FileItem();
 
-  void insertChildSorted(FileItem* child);
+  void startListing();
+  bool readEntries(int maxEntries, FileItemList& newChildren);
+  void stopListing();
+  void mergeChildren(FileItemList& newChildren);
   int compare(const FileItem& that) const;
 
   bool operator<(const FileItem& that) const { return compare(that) < 0; }
@@ -92,6 +104,8 @@ public:
 
   IFileItem* getParent() const;
   const FileItemList& getChildren();
+  bool updateChildren(int maxEntries);
+  void cancelChildrenUpdate();
   void createDirectory(const std::string& dirname);
 
   bool hasExtension(const std::string& csv_extensions);
@@ -110,6 +124,11 @@ static FileItemMap* fileitems_map;
 static ThumbnailMap* thumbnail_map;
 static unsigned int current_file_system_version = 0;
 
+// Folders watched to know when their content changes (so they don't
+// need to be listed again in each refresh)
+static base::FolderWatcher* folder_watcher;
+static FileItemMap* watched_folders;
+
 #ifdef _WIN32
   static IMalloc* shl_imalloc = NULL;
   static IShellFolder* shl_idesktop = NULL;
@@ -137,6 +156,10 @@ static unsigned int current_file_system_version = 0;
   static void put_fileitem(FileItem* fileitem);
 #endif
 
+static void watch_folder(FileItem* fileitem);
+static void unwatch_folder(FileItem* fileitem);
+static void remove_thumbnail(const std::string& filename);
+
 FileSystemModule* FileSystemModule::m_instance = NULL;
 
 FileSystemModule::FileSystemModule()
@@ -146,6 +169,8 @@ FileSystemModule::FileSystemModule()
 
   fileitems_map = new FileItemMap;
   thumbnail_map = new ThumbnailMap;
+  folder_watcher = new base::FolderWatcher;
+  watched_folders = new FileItemMap;
 
 #ifdef _WIN32
   /* get the IMalloc interface */
@@ -197,6 +222,8 @@ FileSystemModule::~FileSystemModule()
 
   delete fileitems_map;
   delete thumbnail_map;
+  delete watched_folders;
+  delete folder_watcher;
 
   PRINTF("File system module: uninstalled\n");
   m_instance = NULL;
@@ -209,6 +236,34 @@ FileSystemModule* FileSystemModule::instance()
 
 void FileSystemModule::refresh()
 {
+  // Invalidate the watched folders and thumbnails that changed
+  base::FolderWatcher::Changes changes;
+  folder_watcher->getChanges(changes);
+
+  for (const auto& change : changes) {
+    FileItemMap::iterator it = watched_folders->find(change.path);
+    if (it == watched_folders->end())
+      continue;
+
+    FileItem* folder = it->second;
+
+    if (change.type == base::FolderWatcher::EntriesChanged) {
+      folder->cancelChildrenUpdate();
+      folder->version = 0;
+    }
+
+    if (!change.name.empty())
+      remove_thumbnail(base::join_path(change.path, change.name));
+    else {
+      // We don't know what changed (or the folder was removed), so
+      // the folder will be watched again when it's listed.
+      for (IFileItem* child : folder->children)
+        remove_thumbnail(child->getFileName());
+      unwatch_folder(folder);
+    }
+  }
+
+  // Folders that aren't watched are listed again
   ++current_file_system_version;
 }
 
@@ -358,147 +413,75 @@ IFileItem* FileItem::getParent() const
 
 const FileItemList& FileItem::getChildren()
 {
-  // Is the file-item a folder?
-  if (isFolder() &&
-      // if the children list is empty, or the file-system version
-      // change (it's like to say: the current this->children list
-      // is outdated)...
-      (this->children.empty() ||
-       current_file_system_version > this->version)) {
-    FileItemList::iterator it;
-    FileItem* child;
-
-    // we have to mark current items as deprecated
-    for (it=this->children.begin();
-         it!=this->children.end(); ++it) {
-      child = static_cast<FileItem*>(*it);
-      child->removed = true;
-    }
+  // If the children are being listed (with updateChildren()), we
+  // return the partial list, in other case we list all the children
+  // now (if it's needed).
+  if (!this->listing) {
+    while (!updateChildren(INT_MAX))
+      ;
+  }
+  return this->children;
+}
 
-    //PRINTF("FS: Loading files for %p (%s)\n", fileitem, fileitem->displayname);
-#ifdef _WIN32
-    {
-      IShellFolder* pFolder = NULL;
-      HRESULT hr;
+bool FileItem::updateChildren(int maxEntries)
+{
+  if (!isFolder())
+    return true;
+
+  if (!this->listing) {
+    // If the children list isn't empty and it wasn't invalidated, it
+    // is updated: watched folders are invalidated only when a change
+    // is notified, other folders when the file-system version changes.
+    if (!this->children.empty() &&
+        this->version != 0 &&
+        (this->watched ||
+         current_file_system_version <= this->version))
+      return true;
+
+    startListing();
+  }
 
-      if (this == rootitem)
-        pFolder = shl_idesktop;
-      else {
-        hr = shl_idesktop->BindToObject(this->fullpidl,
-          NULL, IID_IShellFolder, (LPVOID *)&pFolder);
+  FileItemList newChildren;
+  bool more = readEntries(maxEntries, newChildren);
+  mergeChildren(newChildren);
+  if (more)
+    return false;
 
-        if (hr != S_OK)
-          pFolder = NULL;
-      }
+  stopListing();
 
-      if (pFolder != NULL) {
-        IEnumIDList *pEnum = NULL;
-        ULONG c, fetched;
-
-        /* get the interface to enumerate subitems */
-        hr = pFolder->EnumObjects(reinterpret_cast<HWND>(she::instance()->defaultDisplay()->nativeHandle()),
-          SHCONTF_FOLDERS | SHCONTF_NONFOLDERS, &pEnum);
-
-        if (hr == S_OK && pEnum != NULL) {
-          LPITEMIDLIST itempidl[256];
-          SFGAOF attribs[256];
-
-          /* enumerate the items in the folder */
-          while (pEnum->Next(256, itempidl, &fetched) == S_OK && fetched > 0) {
-            /* request the SFGAO_FOLDER attribute to know what of the
-               item is a folder */
-            for (c=0; c<fetched; ++c) {
-              attribs[c] = SFGAO_FOLDER;
-              pFolder->GetAttributesOf(1, (LPCITEMIDLIST *)itempidl, attribs+c);
-            }
-
-            /* generate the FileItems */
-            for (c=0; c<fetched; ++c) {
-              LPITEMIDLIST fullpidl = concat_pidl(this->fullpidl,
-                                                  itempidl[c]);
-
-              child = get_fileitem_by_fullpidl(fullpidl, false);
-              if (!child) {
-                child = new FileItem(this);
-
-                child->pidl = itempidl[c];
-                child->fullpidl = fullpidl;
-
-                update_by_pidl(child, attribs[c]);
-                put_fileitem(child);
-              }
-              else {
-                ASSERT(child->parent == this);
-                free_pidl(fullpidl);
-                free_pidl(itempidl[c]);
-              }
-
-              this->insertChildSorted(child);
-            }
-          }
+  // check old file-items (maybe removed directories or file-items)
+  for (FileItemList::iterator it=this->children.begin();
+       it!=this->children.end(); ) {
+    FileItem* child = static_cast<FileItem*>(*it);
+    ASSERT(child != NULL);
 
-          pEnum->Release();
-        }
+    if (child && child->removed) {
+      it = this->children.erase(it);
 
-        if (pFolder != shl_idesktop)
-          pFolder->Release();
-      }
+      fileitems_map->erase(fileitems_map->find(child->keyname));
+      delete child;
     }
-#else
-    {
-      DIR* dir = opendir(this->filename.c_str());
-      if (dir) {
-        dirent* entry;
-        while ((entry = readdir(dir)) != NULL) {
-          FileItem* child;
-          std::string fn = entry->d_name;
-          std::string fullfn = base::join_path(filename, fn);
-
-          if (fn == "." || fn == "..")
-            continue;
-
-          child = get_fileitem_by_path(fullfn, false);
-          if (!child) {
-            child = new FileItem(this);
-
-            child->filename = fullfn;
-            child->displayname = fn;
-            child->is_folder = (entry->d_type == DT_DIR);
-
-            put_fileitem(child);
-          }
-          else {
-            ASSERT(child->parent == this);
-          }
-
-          insertChildSorted(child);
-        }
-        closedir(dir);
-      }
+    else
+      ++it;
   }
-#endif
-
-    // check old file-items (maybe removed directories or file-items)
-    for (it=this->children.begin();
-         it!=this->children.end(); ) {
-      child = static_cast<FileItem*>(*it);
-      ASSERT(child != NULL);
 
-      if (child && child->removed) {
-        it = this->children.erase(it);
+  // now this file-item is updated
+  this->version = current_file_system_version;
+  return true;
+}
 
-        fileitems_map->erase(fileitems_map->find(child->keyname));
-        delete child;
-      }
-      else
-        ++it;
-    }
+void FileItem::cancelChildrenUpdate()
+{
+  if (!this->listing)
+    return;
 
-    // now this file-item is updated
-    this->version = current_file_system_version;
-  }
+  stopListing();
 
-  return this->children;
+  // The partial list isn't updated (it will be listed again the next
+  // time).
+  for (IFileItem* child : this->children)
+    static_cast<FileItem*>(child)->removed = false;
+  this->version = 0;
 }
 
 void FileItem::createDirectory(const std::string& dirname)
@@ -506,6 +489,7 @@ void FileItem::createDirectory(const std::string& dirname)
   base::make_directory(base::join_path(filename, dirname));
 
   // Invalidate the children list.
+  cancelChildrenUpdate();
   this->version = 0;
 }
 
@@ -528,11 +512,7 @@ she::Surface* FileItem::getThumbnail()
 void FileItem::setThumbnail(she::Surface* thumbnail)
 {
   // destroy the current thumbnail of the file (if exists)
-  ThumbnailMap::iterator it = thumbnail_map->find(this->filename);
-  if (it != thumbnail_map->end()) {
-    it->second->dispose();
-    thumbnail_map->erase(it);
-  }
+  remove_thumbnail(this->filename);
 
   // insert the new one in the map
   thumbnail_map->insert(std::make_pair(this->filename, thumbnail));
@@ -548,10 +528,17 @@ FileItem::FileItem(FileItem* parent)
   this->parent = parent;
   this->version = current_file_system_version;
   this->removed = false;
+  this->listed = false;
   this->is_folder = false;
+  this->listing = false;
+  this->watched = false;
 #ifdef _WIN32
   this->pidl = NULL;
   this->fullpidl = NULL;
+  this->listFolder = NULL;
+  this->listEnum = NULL;
+#else
+  this->listDir = NULL;
 #endif
 }
 
@@ -559,6 +546,12 @@ FileItem::~FileItem()
 {
   PRINTF("FS: Destroying FileItem() with parent %p\n", parent);
 
+  if (this->listing)
+    stopListing();
+
+  if (this->watched)
+    unwatch_folder(this);
+
 #ifdef _WIN32
   if (this->fullpidl && this->fullpidl != this->pidl) {
     free_pidl(this->fullpidl);
@@ -572,24 +565,221 @@ FileItem::~FileItem()
 #endif
 }
 
-void FileItem::insertChildSorted(FileItem* child)
+void FileItem::startListing()
 {
-  // this file-item wasn't removed from the last lookup
-  child->removed = false;
+  ASSERT(!this->listing);
+  this->listing = true;
 
-  // if the fileitem is already in the list we can go back
-  if (std::find(children.begin(), children.end(), child) != children.end())
-    return;
+  // we have to mark current items as deprecated
+  for (IFileItem* child : this->children)
+    static_cast<FileItem*>(child)->removed = true;
+
+  // Start watching the folder before listing it, so changes made
+  // while it's being listed are notified too.
+  if (!this->watched)
+    watch_folder(this);
+
+  //PRINTF("FS: Loading files for %p (%s)\n", fileitem, fileitem->displayname);
+#ifdef _WIN32
+  {
+    HRESULT hr;
+
+    if (this == rootitem)
+      this->listFolder = shl_idesktop;
+    else {
+      hr = shl_idesktop->BindToObject(this->fullpidl,
+        NULL, IID_IShellFolder, (LPVOID *)&this->listFolder);
+
+      if (hr != S_OK)
+        this->listFolder = NULL;
+    }
+
+    if (this->listFolder != NULL) {
+      /* get the interface to enumerate subitems */
+      hr = this->listFolder->EnumObjects(reinterpret_cast<HWND>(she::instance()->defaultDisplay()->nativeHandle()),
+        SHCONTF_FOLDERS | SHCONTF_NONFOLDERS, &this->listEnum);
+
+      if (hr != S_OK)
+        this->listEnum = NULL;
+    }
+  }
+#else
+  this->listDir = opendir(this->filename.c_str());
+#endif
+}
+
+// Reads at most "maxEntries" entries of the folder, and adds the
+// new children (the ones that aren't in the "children" list) in
+// "newChildren". Returns false if there are no more entries.
+bool FileItem::readEntries(int maxEntries, FileItemList& newChildren)
+{
+  ASSERT(this->listing);
+  int n = 0;
+
+#ifdef _WIN32
+  if (!this->listEnum)
+    return false;
+
+  while (n < maxEntries) {
+    LPITEMIDLIST itempidl[256];
+    SFGAOF attribs[256];
+    ULONG c, fetched = 0;
+
+    /* enumerate the items in the folder */
+    HRESULT hr = this->listEnum->Next(ULONG(std::min(256, maxEntries-n)),
+                                      itempidl, &fetched);
+
+    /* request the SFGAO_FOLDER attribute to know what of the
+       item is a folder */
+    for (c=0; c<fetched; ++c) {
+      attribs[c] = SFGAO_FOLDER;
+      this->listFolder->GetAttributesOf(1, (LPCITEMIDLIST *)(itempidl+c), attribs+c);
+    }
+
+    /* generate the FileItems */
+    for (c=0; c<fetched; ++c) {
+      LPITEMIDLIST fullpidl = concat_pidl(this->fullpidl,
+                                          itempidl[c]);
+
+      FileItem* child = get_fileitem_by_fullpidl(fullpidl, false);
+      if (!child) {
+        child = new FileItem(this);
+
+        child->pidl = itempidl[c];
+        child->fullpidl = fullpidl;
+
+        update_by_pidl(child, attribs[c]);
+        put_fileitem(child);
+      }
+      else {
+        ASSERT(child->parent == this);
+        free_pidl(fullpidl);
+        free_pidl(itempidl[c]);
+      }
+
+      child->removed = false;
+      if (!child->listed)
+        newChildren.push_back(child);
+    }
+
+    n += int(fetched);
+    if (hr != S_OK || fetched == 0)
+      return false;
+  }
+#else
+  if (!this->listDir)
+    return false;
+
+  while (n < maxEntries) {
+    dirent* entry = readdir(this->listDir);
+    if (!entry)
+      return false;
+
+    FileItem* child;
+    std::string fn = entry->d_name;
+    std::string fullfn = base::join_path(filename, fn);
+
+    if (fn == "." || fn == "..")
+      continue;
 
-  for (FileItemList::iterator
-         it=children.begin(); it!=children.end(); ++it) {
-    if (*child < *static_cast<FileItem*>(*it)) {
-      children.insert(it, child);
-      return;
+    child = get_fileitem_by_path(fullfn, false);
+    if (!child) {
+      child = new FileItem(this);
+
+      child->filename = fullfn;
+      child->displayname = fn;
+      child->is_folder = (entry->d_type == DT_DIR);
+
+      put_fileitem(child);
     }
+    else {
+      ASSERT(child->parent == this);
+    }
+
+    child->removed = false;
+    if (!child->listed)
+      newChildren.push_back(child);
+    ++n;
+  }
+#endif
+
+  return true;
+}
+
+void FileItem::stopListing()
+{
+  ASSERT(this->listing);
+  this->listing = false;
+
+#ifdef _WIN32
+  if (this->listEnum) {
+    this->listEnum->Release();
+    this->listEnum = NULL;
+  }
+  if (this->listFolder) {
+    if (this->listFolder != shl_idesktop)
+      this->listFolder->Release();
+    this->listFolder = NULL;
+  }
+#else
+  if (this->listDir) {
+    closedir(this->listDir);
+    this->listDir = NULL;
+  }
+#endif
+}
+
+// Adds the new children keeping the list sorted (new children are
+// sorted and merged with the current list, instead of inserting each
+// one in its position, to avoid a quadratic time in big folders).
+void FileItem::mergeChildren(FileItemList& newChildren)
+{
+  if (newChildren.empty())
+    return;
+
+  auto lessThan = [](IFileItem* a, IFileItem* b) -> bool {
+    return *static_cast<FileItem*>(a) < *static_cast<FileItem*>(b);
+  };
+
+  for (IFileItem* child : newChildren)
+    static_cast<FileItem*>(child)->listed = true;
+
+  std::sort(newChildren.begin(), newChildren.end(), lessThan);
+
+  std::size_t n = this->children.size();
+  this->children.insert(this->children.end(), newChildren.begin(), newChildren.end());
+  std::inplace_merge(this->children.begin(),
+                     this->children.begin()+n,
+                     this->children.end(), lessThan);
+}
+
+static void watch_folder(FileItem* fileitem)
+{
+  ASSERT(!fileitem->watched);
+
+  if (folder_watcher->watch(fileitem->filename)) {
+    fileitem->watched = true;
+    (*watched_folders)[fileitem->filename] = fileitem;
   }
+}
+
+static void unwatch_folder(FileItem* fileitem)
+{
+  if (!fileitem->watched)
+    return;
+
+  folder_watcher->unwatch(fileitem->filename);
+  watched_folders->erase(fileitem->filename);
+  fileitem->watched = false;
+}
 
-  children.push_back(child);
+static void remove_thumbnail(const std::string& filename)
+{
+  ThumbnailMap::iterator it = thumbnail_map->find(filename);
+  if (it != thumbnail_map->end()) {
+    it->second->dispose();
+    thumbnail_map->erase(it);
+  }
 }
 
 int FileItem::compare(const FileItem& that) const
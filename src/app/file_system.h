@@ -33,8 +33,9 @@ namespace app {
 
     static FileSystemModule* instance();
 
-    // Marks all FileItems as deprecated to be refresh the next time
-    // they are queried through @ref FileItem::getChildren().
+    // Marks FileItems as deprecated to be refresh the next time they
+    // are queried through @ref FileItem::getChildren(). Folders
+    // watched with OS notifications are marked only if they changed.
     void refresh();
 
     IFileItem* getRootFileItem();
@@ -75,7 +76,21 @@ namespace app {
     virtual std::string getDisplayName() const = 0;
 
     virtual IFileItem* getParent() const = 0;
+
+    // Returns the children of the folder (sorted). It lists the
+    // folder if it's needed. If the folder is being listed with
+    // updateChildren(), it returns the children listed until now.
     virtual const FileItemList& getChildren() = 0;
+
+    // Lists at most "maxEntries" entries of the folder, so big
+    // folders can be listed incrementally. Returns true when the
+    // children list is complete (or it was already updated).
+    virtual bool updateChildren(int maxEntries) = 0;
+
+    // Stops listing the folder (it will be listed again the next
+    // time its children are requested).
+    virtual void cancelChildrenUpdate() = 0;
+
     virtual void createDirectory(const std::string& dirname) = 0;
 
     virtual bool hasExtension(const std::string& csv_extensions) = 0;
@@ -9,6 +9,7 @@
 #include "config.h"
 #endif
 
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/cel.h"
 #include "doc/frame.h"
@@ -18,37 +19,88 @@
 #include "gfx/rect.h"
 #include "render/render.h"
 
+#include <map>
+#include <vector>
+
 namespace app {
 
 using namespace doc;
 
+// Cel data of each visible image layer (NULL for layers without cel)
+// in a frame. Two frames with the same key are rendered in the same
+// way.
+typedef std::vector<const CelData*> FrameKey;
+
 static bool has_cels(const Layer* layer, frame_t frame);
+static void get_frame_key(const Layer* layer, frame_t frame, FrameKey& key);
 
 LayerImage* create_flatten_layer_copy(Sprite* dstSprite, const Layer* srcLayer,
                                       const gfx::Rect& bounds,
                                       frame_t frmin, frame_t frmax)
 {
   base::UniquePtr<LayerImage> flatLayer(new LayerImage(dstSprite));
-  render::Render render;
+
+  // Frames with cels to render, and the first frame with the same
+  // cels (linked cels in all layers) for each one of them
+  std::vector<frame_t> frames;
+  std::vector<int> firstSame;
+  std::vector<frame_t> toRender;
+  std::map<FrameKey, int> keys;
+  FrameKey key;
 
   for (frame_t frame=frmin; frame<=frmax; ++frame) {
     // Does this frame have cels to render?
-    if (has_cels(srcLayer, frame)) {
+    if (!has_cels(srcLayer, frame))
+      continue;
+
+    key.clear();
+    get_frame_key(srcLayer, frame, key);
+
+    auto it = keys.find(key);
+    if (it != keys.end())
+      firstSame.push_back(it->second);
+    else {
+      keys[key] = int(frames.size());
+      firstSame.push_back(int(frames.size()));
+      toRender.push_back(frame);
+    }
+    frames.push_back(frame);
+  }
+
+  // Render each different frame in parallel (with one render::Render
+  // for each frame, as it isn't thread-safe)
+  std::vector<ImageRef> images(toRender.size());
+  base::thread_pool::global().parallel_for(
+    int(toRender.size()), [&](int i) {
       // Create a new image to render each frame.
       ImageRef image(Image::create(flatLayer->sprite()->pixelFormat(), bounds.w, bounds.h));
 
-      // Create the new cel for the output layer.
-      base::UniquePtr<Cel> cel(new Cel(frame, image));
-      cel->setPosition(bounds.x, bounds.y);
-
       // Render this frame.
-      render.renderLayer(image.get(), srcLayer, frame,
+      render::Render render;
+      render.renderLayer(image.get(), srcLayer, toRender[i],
         gfx::Clip(0, 0, bounds));
 
-      // Add the cel (and release the base::UniquePtr).
-      flatLayer->addCel(cel);
-      cel.release();
+      images[i] = image;
+    });
+
+  std::vector<Cel*> cels(frames.size(), nullptr);
+  for (std::size_t i=0, j=0; i<frames.size(); ++i) {
+    base::UniquePtr<Cel> cel;
+
+    // Create the new cel for the output layer (linked to the cel of
+    // a previous frame if it has the same source cels).
+    if (firstSame[i] != int(i)) {
+      cel.reset(new Cel(frames[i], cels[firstSame[i]]->dataRef()));
+    }
+    else {
+      cel.reset(new Cel(frames[i], images[j++]));
+      cel->setPosition(bounds.x, bounds.y);
     }
+
+    // Add the cel (and release the base::UniquePtr).
+    cels[i] = cel;
+    flatLayer->addCel(cel);
+    cel.release();
   }
 
   return flatLayer.release();
@@ -82,4 +134,29 @@ static bool has_cels(const Layer* layer, frame_t frame)
   return false;
 }
 
+static void get_frame_key(const Layer* layer, frame_t frame, FrameKey& key)
+{
+  if (!layer->isVisible())
+    return;
+
+  switch (layer->type()) {
+
+    case ObjectType::LayerImage: {
+      const Cel* cel = layer->cel(frame);
+      key.push_back(cel ? cel->data(): nullptr);
+      break;
+    }
+
+    case ObjectType::LayerFolder: {
+      LayerConstIterator it = static_cast<const LayerFolder*>(layer)->getLayerBegin();
+      LayerConstIterator end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
+
+      for (; it != end; ++it)
+        get_frame_key(*it, frame, key);
+      break;
+    }
+
+  }
+}
+
 } // namespace app
@@ -0,0 +1,283 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/input_recorder.h"
+
+#include "base/exception.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace app {
+
+static const char* kHeader = "# Aseprite input events v1\n";
+
+static bool is_input_event(const she::Event& ev)
+{
+  switch (ev.type()) {
+    case she::Event::MouseMove:
+    case she::Event::MouseDown:
+    case she::Event::MouseUp:
+    case she::Event::MouseWheel:
+    case she::Event::MouseDoubleClick:
+    case she::Event::KeyDown:
+    case she::Event::KeyUp:
+      return true;
+    default:
+      return false;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+// InputRecorder
+
+InputRecorder::InputRecorder(she::EventQueue* queue, const std::string& filename)
+  : m_queue(queue)
+  , m_file(base::open_file_with_exception(filename, "w"))
+  , m_cycle(0)
+{
+  std::fputs(kHeader, m_file.get());
+  std::fputs("# cycle msecs type button x y wheel_x wheel_y scancode unicode repeat\n", m_file.get());
+}
+
+void InputRecorder::getEvent(she::Event& ev, double timeout)
+{
+  m_queue->getEvent(ev, timeout);
+
+  // The ui::Manager reads events until it receives a None event, so
+  // it's the end of the cycle.
+  if (ev.type() == she::Event::None) {
+    ++m_cycle;
+    return;
+  }
+
+  if (ev.type() == she::Event::DropFiles)
+    return;
+
+  std::fprintf(m_file.get(), "%d %.3f %d %d %d %d %d %d %d %d %d\n",
+               m_cycle, m_chrono.elapsed()*1000.0,
+               int(ev.type()), int(ev.button()),
+               ev.position().x, ev.position().y,
+               ev.wheelDelta().x, ev.wheelDelta().y,
+               int(ev.scancode()), ev.unicodeChar(), ev.repeat());
+
+  // Flush so the file is complete even if the program crashes
+  std::fflush(m_file.get());
+}
+
+void InputRecorder::queueEvent(const she::Event& ev)
+{
+  m_queue->queueEvent(ev);
+}
+
+//////////////////////////////////////////////////////////////////////
+// InputReplayer
+
+InputReplayer::InputReplayer(she::EventQueue* queue,
+                             she::Display* display,
+                             const std::string& filename,
+                             const std::string& reportFilename)
+  : m_queue(queue)
+  , m_reportFilename(reportFilename)
+  , m_next(0)
+  , m_cycle(0)
+  , m_inCycle(false)
+  , m_done(false)
+  , m_lastFlip(0.0)
+{
+  base::FileHandle file(base::open_file_with_exception(filename, "r"));
+
+  char buf[1024];
+  if (!std::fgets(buf, sizeof(buf), file.get()) ||
+      std::string(buf) != kHeader)
+    throw base::Exception("'%s' is not a file with input events", filename.c_str());
+
+  while (std::fgets(buf, sizeof(buf), file.get())) {
+    if (buf[0] == '#')
+      continue;
+
+    Record rec;
+    double msecs;
+    int type, button, x, y, wx, wy, scancode, unicode, repeat;
+    if (std::sscanf(buf, "%d %lf %d %d %d %d %d %d %d %d %d",
+                    &rec.cycle, &msecs, &type, &button, &x, &y,
+                    &wx, &wy, &scancode, &unicode, &repeat) != 11)
+      continue;
+
+    rec.time = msecs / 1000.0;
+    rec.event.setType(she::Event::Type(type));
+    rec.event.setDisplay(display);
+    rec.event.setButton(she::Event::MouseButton(button));
+    rec.event.setPosition(gfx::Point(x, y));
+    rec.event.setWheelDelta(gfx::Point(wx, wy));
+    rec.event.setScancode(she::KeyScancode(scancode));
+    rec.event.setUnicodeChar(unicode);
+    rec.event.setRepeat(repeat);
+    m_records.push_back(rec);
+  }
+}
+
+InputReplayer::~InputReplayer()
+{
+  // The program was closed before the end of the replay
+  if (!m_done)
+    stopReplay();
+}
+
+void InputReplayer::onFlip(double paintTime, double flipTime)
+{
+  if (m_done)
+    return;
+
+  double now = m_chrono.elapsed();
+
+  Frame frame;
+  frame.paint = paintTime;
+  frame.flip = flipTime;
+  frame.frame = now - m_lastFlip;
+  m_frames.push_back(frame);
+  m_lastFlip = now;
+
+  for (double t : m_pendingInput)
+    m_latencies.push_back(now - t);
+  m_pendingInput.clear();
+
+  // All events were replayed and their results are on the screen
+  if (m_next == m_records.size() && !m_inCycle)
+    stopReplay();
+}
+
+void InputReplayer::getEvent(she::Event& ev, double timeout)
+{
+  if (m_done) {
+    m_queue->getEvent(ev, timeout);
+    return;
+  }
+
+  ev.setType(she::Event::None);
+
+  // Continue with the events of the same cycle
+  if (m_inCycle) {
+    if (m_next < m_records.size() &&
+        m_records[m_next].cycle == m_cycle) {
+      ev = m_records[m_next++].event;
+      if (is_input_event(ev))
+        m_pendingInput.push_back(m_chrono.elapsed());
+    }
+    else
+      m_inCycle = false;        // End of the cycle (None event)
+    return;
+  }
+
+  // All events were replayed and the manager doesn't have anything
+  // else to do (so there is no flip pending)
+  if (m_next == m_records.size()) {
+    if (timeout != 0.0) {
+      stopReplay();
+      m_queue->getEvent(ev, timeout);
+    }
+    return;
+  }
+
+  // Wait the time of the next event (ignoring events of the real
+  // queue)
+  double wait = m_records[m_next].time - m_chrono.elapsed();
+  if (wait > 0.0) {
+    she::Event realEv;
+    m_queue->getEvent(realEv, (timeout < 0.0 ? wait: std::min(wait, timeout)));
+
+    if (realEv.type() == she::Event::CloseDisplay) {
+      stopReplay();
+      ev = realEv;
+    }
+    return;
+  }
+
+  m_inCycle = true;
+  m_cycle = m_records[m_next].cycle;
+  ev = m_records[m_next++].event;
+  if (is_input_event(ev))
+    m_pendingInput.push_back(m_chrono.elapsed());
+}
+
+void InputReplayer::queueEvent(const she::Event& ev)
+{
+  m_queue->queueEvent(ev);
+}
+
+void InputReplayer::stopReplay()
+{
+  m_done = true;
+  writeReport();
+}
+
+static void write_stats(FILE* f, const char* name, std::vector<double> values, bool last = false)
+{
+  std::sort(values.begin(), values.end());
+
+  std::fprintf(f, "  \"%s\": {", name);
+  if (!values.empty()) {
+    const double k = (values.size()-1) / 100.0;
+    double sum = 0.0;
+    for (double v : values)
+      sum += v;
+
+    std::fprintf(f, " \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f ",
+                 1000.0 * sum / values.size(),
+                 1000.0 * values[int(50*k + 0.5)],
+                 1000.0 * values[int(90*k + 0.5)],
+                 1000.0 * values[int(99*k + 0.5)],
+                 1000.0 * values.back());
+  }
+  std::fprintf(f, "}%s\n", (last ? "": ","));
+}
+
+// Writes the report in JSON format (all times in milliseconds).
+void InputReplayer::writeReport()
+{
+  base::FileHandle file;
+  FILE* f = stdout;
+  if (!m_reportFilename.empty()) {
+    file = base::open_file(m_reportFilename, "w");
+    if (!file)
+      return;
+    f = file.get();
+  }
+
+  std::vector<double> paint, flip, frame;
+  for (const Frame& fr : m_frames) {
+    paint.push_back(fr.paint);
+    flip.push_back(fr.flip);
+    frame.push_back(fr.frame);
+  }
+
+  std::fprintf(f, "{\n");
+  std::fprintf(f, "  \"complete\": %s,\n", (m_next == m_records.size() ? "true": "false"));
+  std::fprintf(f, "  \"events\": %d,\n", int(m_next));
+  std::fprintf(f, "  \"duration_ms\": %.3f,\n", 1000.0 * m_chrono.elapsed());
+  std::fprintf(f, "  \"frames\": %d,\n", int(m_frames.size()));
+  write_stats(f, "paint_ms", paint);
+  write_stats(f, "flip_ms", flip);
+  write_stats(f, "frame_ms", frame);
+  write_stats(f, "input_latency_ms", m_latencies);
+
+  // Each frame as [paint, flip, time since the previous frame]
+  std::fprintf(f, "  \"per_frame_ms\": [");
+  for (size_t i=0; i<m_frames.size(); ++i)
+    std::fprintf(f, "%s\n    [%.3f, %.3f, %.3f]", (i > 0 ? ",": ""),
+                 1000.0 * m_frames[i].paint,
+                 1000.0 * m_frames[i].flip,
+                 1000.0 * m_frames[i].frame);
+  std::fprintf(f, "\n  ]\n}\n");
+  std::fflush(f);
+}
+
+} // namespace app
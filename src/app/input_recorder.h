@@ -0,0 +1,115 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_INPUT_RECORDER_H_INCLUDED
+#define APP_INPUT_RECORDER_H_INCLUDED
+#pragma once
+
+#include "base/chrono.h"
+#include "base/disable_copying.h"
+#include "base/file_handle.h"
+#include "she/event.h"
+#include "she/event_queue.h"
+
+#include <string>
+#include <vector>
+
+namespace she {
+  class Display;
+}
+
+namespace app {
+
+  // Saves the events of the given queue in a text file (one event
+  // per line) while they are read by the ui::Manager, so they can be
+  // replayed later with InputReplayer. Each event is saved with its
+  // time and the number of the loop cycle where it was read (events
+  // of the same cycle are replayed together). DropFiles events are
+  // not saved.
+  class InputRecorder : public she::EventQueue {
+  public:
+    InputRecorder(she::EventQueue* queue, const std::string& filename);
+
+    she::EventQueue* queue() const { return m_queue; }
+
+    // she::EventQueue impl
+    void getEvent(she::Event& ev, double timeout) override;
+    void queueEvent(const she::Event& ev) override;
+
+  private:
+    she::EventQueue* m_queue;
+    base::FileHandle m_file;
+    base::Chrono m_chrono;
+    int m_cycle;
+
+    DISABLE_COPYING(InputRecorder);
+  };
+
+  // Replays the events saved by InputRecorder with the same timing,
+  // and measures each frame of the UI (time to paint widgets and to
+  // flip the display) and the latency between each replayed input
+  // event and the flip that shows its result. The events of the
+  // real queue are discarded while the replay is running (except
+  // CloseDisplay). When all events are replayed, a JSON report is
+  // written and real events are used again.
+  class InputReplayer : public she::EventQueue {
+  public:
+    InputReplayer(she::EventQueue* queue,
+                  she::Display* display,
+                  const std::string& filename,
+                  const std::string& reportFilename);
+    ~InputReplayer();
+
+    she::EventQueue* queue() const { return m_queue; }
+    bool isDone() const { return m_done; }
+
+    // Must be called after each flip of the display with the time
+    // (in seconds) used to paint widgets and to flip.
+    void onFlip(double paintTime, double flipTime);
+
+    // she::EventQueue impl
+    void getEvent(she::Event& ev, double timeout) override;
+    void queueEvent(const she::Event& ev) override;
+
+  private:
+    struct Record {
+      int cycle;
+      double time;              // In seconds from the start
+      she::Event event;
+    };
+
+    struct Frame {
+      double paint;
+      double flip;
+      double frame;             // Time since the previous flip
+    };
+
+    void stopReplay();
+    void writeReport();
+
+    she::EventQueue* m_queue;
+    std::string m_reportFilename;
+    std::vector<Record> m_records;
+    size_t m_next;              // Next record to replay
+    int m_cycle;                // Cycle of the events being replayed
+    bool m_inCycle;
+    bool m_done;
+    base::Chrono m_chrono;
+    double m_lastFlip;
+
+    // Times of replayed input events waiting for the next flip
+    std::vector<double> m_pendingInput;
+
+    std::vector<Frame> m_frames;
+    std::vector<double> m_latencies;
+
+    DISABLE_COPYING(InputReplayer);
+  };
+
+} // namespace app
+
+#endif
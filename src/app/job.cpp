@@ -12,9 +12,7 @@
 #include "app/job.h"
 
 #include "app/app.h"
-#include "base/mutex.h"
-#include "base/scoped_lock.h"
-#include "base/thread.h"
+#include "base/thread_pool.h"
 #include "ui/alert.h"
 #include "ui/widget.h"
 #include "ui/window.h"
@@ -24,15 +22,8 @@ static const int kMonitoringPeriod = 100;
 namespace app {
 
 Job::Job(const char* jobName)
+  : m_done_flag(false)
 {
-  m_mutex = NULL;
-  m_thread = NULL;
-  m_last_progress = 0.0;
-  m_done_flag = false;
-  m_canceled_flag = false;
-
-  m_mutex = new base::mutex();
-
   if (App::instance()->isGui()) {
     m_alert_window = ui::Alert::create("%s<<Working...||&Cancel", jobName);
     m_alert_window->addProgress();
@@ -47,29 +38,25 @@ Job::~Job()
 {
   if (App::instance()->isGui()) {
     ASSERT(!m_timer->isRunning());
-    ASSERT(m_thread == NULL);
+    ASSERT(!m_token);
 
     if (m_alert_window)
       m_alert_window->closeWindow(NULL);
   }
-
-  if (m_mutex)
-    delete m_mutex;
 }
 
 void Job::startJob()
 {
-  m_thread = new base::thread(&Job::thread_proc, this);
+  m_token.reset(new base::task_token);
+  base::thread_pool::global().execute(
+    [this]{ thread_proc(this); }, m_token);
 
   if (m_alert_window) {
     m_alert_window->openWindowInForeground();
 
     // The job was canceled by the user?
-    {
-      base::scoped_lock hold(*m_mutex);
-      if (!m_done_flag)
-        m_canceled_flag = true;
-    }
+    if (!m_done_flag)
+      m_progress.cancel();
   }
 }
 
@@ -78,32 +65,29 @@ void Job::waitJob()
   if (m_timer && m_timer->isRunning())
     m_timer->stop();
 
-  if (m_thread) {
-    m_thread->join();
-    delete m_thread;
-    m_thread = NULL;
+  if (m_token) {
+    m_token->wait();
+    m_token.reset();
   }
 }
 
 void Job::jobProgress(double f)
 {
-  m_last_progress = f;
+  m_progress.set_progress(f);
 }
 
 bool Job::isCanceled()
 {
-  return m_canceled_flag;
+  return m_progress.canceled();
 }
 
 void Job::onMonitoringTick()
 {
-  base::scoped_lock hold(*m_mutex);
-
   // update progress
-  m_alert_window->setProgress(m_last_progress);
+  m_alert_window->setProgress(m_progress.progress());
 
   // is job done? we can close the monitor
-  if (m_done_flag || m_canceled_flag) {
+  if (m_done_flag || m_progress.canceled()) {
     m_timer->stop();
     m_alert_window->closeWindow(NULL);
   }
@@ -111,7 +95,6 @@ void Job::onMonitoringTick()
 
 void Job::done()
 {
-  base::scoped_lock hold(*m_mutex);
   m_done_flag = true;
 }
 
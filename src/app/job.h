@@ -9,25 +9,24 @@
 #define APP_JOB_H_INCLUDED
 #pragma once
 
+#include "base/progress_token.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "ui/alert.h"
 #include "ui/timer.h"
 
-namespace base {
-  class thread;
-  class mutex;
-}
+#include <atomic>
 
 namespace app {
-  class Progress;
 
   class Job {
   public:
     Job(const char* jobName);
     virtual ~Job();
 
-    // Starts the job calling onJob() event in another thread and
-    // monitoring the progress with onMonitorTick() event.
+    // Starts the job calling onJob() event in a worker thread of the
+    // global thread pool and monitoring the progress with
+    // onMonitorTick() event.
     void startJob();
 
     void waitJob();
@@ -43,8 +42,8 @@ namespace app {
 
   protected:
 
-    // This member function is called from another dedicated thread
-    // outside the GUI one, so you can do some image processing here.
+    // This member function is called from a worker thread outside
+    // the GUI one, so you can do some image processing here.
     // Remember that you cannot use any GUI element in this handler.
     virtual void onJob() = 0;
 
@@ -59,14 +58,14 @@ namespace app {
     static void monitor_proc(void* data);
     static void monitor_free(void* data);
 
-    base::thread* m_thread;
+    base::task_token_ptr m_token;
     base::UniquePtr<ui::Timer> m_timer;
-    Progress* m_progress;
-    base::mutex* m_mutex;
     ui::AlertPtr m_alert_window;
-    double m_last_progress;
-    bool m_done_flag;
-    bool m_canceled_flag;
+
+    // Progress and cancel flag of the job (accessed from the job and
+    // GUI threads without locks).
+    base::progress_token m_progress;
+    std::atomic<bool> m_done_flag;
 
     // these methods are privated and not defined
     Job();
@@ -13,6 +13,7 @@
 
 #include "app/modules/gui.h"
 #include "app/modules/palettes.h"
+#include "base/tracing.h"
 
 namespace app {
 
@@ -44,6 +45,7 @@ LegacyModules::LegacyModules(int requirements)
     if ((module[c].reqs & requirements) == module[c].reqs) {
       PRINTF("Installing module: %s\n", module[c].name);
 
+      base::tracing::zone zone(module[c].name);
       if ((*module[c].init)() < 0)
         throw base::Exception("Error initializing module: %s",
                               static_cast<const char*>(module[c].name));
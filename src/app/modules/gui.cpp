@@ -10,12 +10,14 @@
 #endif
 
 #include "app/app.h"
+#include "app/commands/cmd_open_file.h"
 #include "app/commands/command.h"
 #include "app/commands/commands.h"
 #include "app/commands/params.h"
 #include "app/console.h"
 #include "app/document.h"
 #include "app/ini_file.h"
+#include "app/input_recorder.h"
 #include "app/modules/editors.h"
 #include "app/modules/gfx.h"
 #include "app/modules/gui.h"
@@ -34,9 +36,12 @@
 #include "app/ui/status_bar.h"
 #include "app/ui/toolbar.h"
 #include "app/ui_context.h"
+#include "base/chrono.h"
 #include "base/memory.h"
 #include "base/shared_ptr.h"
+#include "base/tracing.h"
 #include "base/unique_ptr.h"
+#include "doc/image_buffer_recycler.h"
 #include "doc/sprite.h"
 #include "she/clipboard.h"
 #include "she/display.h"
@@ -89,7 +94,19 @@ static Theme* gui_theme = NULL;
 static ui::Timer* defered_invalid_timer = nullptr;
 static gfx::Region defered_invalid_region;
 
+// Frees buffers of temporary images that aren't used anymore
+static ui::Timer* trim_buffers_timer = nullptr;
+static const int kTrimBuffersInterval = 10000; // In milliseconds
+
 // Load & save graphics configuration
+// Used to record/replay input events (--record-input/--replay-input)
+static InputRecorder* input_recorder = nullptr;
+static InputReplayer* input_replayer = nullptr;
+
+// Functions to be called after the first frame is displayed
+static bool first_frame_displayed = false;
+static std::vector<std::function<void()> > after_first_frame;
+
 static void load_gui_config(int& w, int& h, bool& maximized);
 static void save_gui_config();
 
@@ -146,6 +163,9 @@ int init_module_gui()
   manager->setDisplay(main_display);
   manager->setClipboard(main_clipboard);
 
+  trim_buffers_timer = new ui::Timer(kTrimBuffersInterval, manager);
+  trim_buffers_timer->start();
+
   // Setup the GUI theme for all widgets
   gui_theme = new SkinTheme();
   gui_theme->setScale(Preferences::instance().experimental.uiScale());
@@ -166,9 +186,25 @@ void exit_module_gui()
 {
   save_gui_config();
 
+  // Restore the real event queue
+  if (input_recorder) {
+    manager->setEventQueue(input_recorder->queue());
+    delete input_recorder;
+    input_recorder = nullptr;
+  }
+  if (input_replayer) {
+    manager->setEventQueue(input_replayer->queue());
+    manager->setMeasurePaintTime(false);
+    delete input_replayer;
+    input_replayer = nullptr;
+  }
+
   delete defered_invalid_timer;
+  delete trim_buffers_timer;
   delete manager;
 
+  doc::ImageBufferRecycler::global().clear();
+
   // Now we can destroy theme
   CurrentTheme::set(NULL);
   delete gui_theme;
@@ -217,8 +253,45 @@ void update_screen_for_document(const Document* document)
 void gui_run()
 {
   manager->run();
+
+  // These functions could use objects that don't exist anymore
+  after_first_frame.clear();
 }
 
+void gui_after_first_frame(const std::function<void()>& func)
+{
+  if (first_frame_displayed)
+    func();
+  else
+    after_first_frame.push_back(func);
+}
+
+void gui_record_input(const std::string& filename)
+{
+  ASSERT(!input_recorder && !input_replayer);
+
+  input_recorder = new InputRecorder(manager->getEventQueue(), filename);
+  manager->setEventQueue(input_recorder);
+}
+
+void gui_replay_input(const std::string& filename,
+                      const std::string& reportFilename)
+{
+  ASSERT(!input_recorder && !input_replayer);
+
+  input_replayer = new InputReplayer(manager->getEventQueue(), main_display,
+                                     filename, reportFilename);
+  manager->setEventQueue(input_replayer);
+  manager->setMeasurePaintTime(true);
+
+  // Each replayed event is painted and flipped
+  manager->setFrameInterval(0.0);
+}
+
+// Number of flipped frames, used to calculate allocations or paints
+// per frame (see DevConsoleView)
+static base::tracing::counter frames_counter("ui.frames");
+
 void gui_feedback()
 {
   OverlayManager* overlays = OverlayManager::instance();
@@ -235,12 +308,29 @@ void gui_feedback()
   overlays->captureOverlappedAreas();
   overlays->drawOverlays();
 
-  if (!manager->getDisplay()->flip()) {
+  base::Chrono chrono;
+  bool flipped = ui::flip_display(manager->getDisplay());
+
+  if (input_replayer)
+    input_replayer->onFlip(manager->takePaintTime(), chrono.elapsed());
+
+  if (!flipped) {
     // In case that the display was resized.
     gui_setup_screen();
   }
-  else
+  else {
     overlays->restoreOverlappedAreas();
+    frames_counter.add(1);
+
+    if (!first_frame_displayed) {
+      first_frame_displayed = true;
+
+      std::vector<std::function<void()> > funcs;
+      funcs.swap(after_first_frame);
+      for (const auto& func : funcs)
+        func();
+    }
+  }
 
   dirty_display_flag = false;
 }
@@ -346,6 +436,7 @@ void defer_invalid_rect(const gfx::Rect& rc)
   defered_invalid_timer->stop();
   defered_invalid_timer->start();
   defered_invalid_region.createUnion(defered_invalid_region, gfx::Region(rc));
+  defered_invalid_region.simplify();
 }
 
 // Manager event handler.
@@ -370,12 +461,8 @@ bool CustomizedGuiManager::onProcessMessage(Message* msg)
 
         const DropFilesMessage::Files& files = static_cast<DropFilesMessage*>(msg)->files();
 
-        // Open all files
-        Command* cmd_open_file =
-          CommandsModule::instance()->getCommandByName(CommandId::OpenFile);
-        Params params;
-
         UIContext* ctx = UIContext::instance();
+        std::vector<std::string> filenames;
 
         for (const auto& fn : files) {
           // If the document is already open, select it.
@@ -389,10 +476,16 @@ bool CustomizedGuiManager::onProcessMessage(Message* msg)
             }
           }
           // Load the file
-          else {
-            params.set("filename", fn.c_str());
-            ctx->executeCommand(cmd_open_file, params);
-          }
+          else
+            filenames.push_back(fn);
+        }
+
+        // Open all files at the same time
+        if (!filenames.empty()) {
+          OpenFileCommand* cmd_open_file = static_cast<OpenFileCommand*>(
+            CommandsModule::instance()->getCommandByName(CommandId::OpenFile));
+          cmd_open_file->setFilenames(filenames);
+          ctx->executeCommand(cmd_open_file);
         }
       }
       break;
@@ -418,86 +511,84 @@ bool CustomizedGuiManager::onProcessMessage(Message* msg)
       if (Manager::onProcessMessage(msg))
         return true;
 
-      for (const Key* key : *KeyboardShortcuts::instance()) {
-        if (key->isPressed(msg)) {
-          // Cancel menu-bar loops (to close any popup menu)
-          App::instance()->getMainWindow()->getMenuBar()->cancelMenuLoop();
+      Key* key = KeyboardShortcuts::instance()->getKeyFromKeyMessage(msg);
+      if (key) {
+        // Cancel menu-bar loops (to close any popup menu)
+        App::instance()->getMainWindow()->getMenuBar()->cancelMenuLoop();
 
-          switch (key->type()) {
+        switch (key->type()) {
 
-            case KeyType::Tool: {
-              tools::Tool* current_tool = App::instance()->activeTool();
-              tools::Tool* select_this_tool = key->tool();
-              tools::ToolBox* toolbox = App::instance()->getToolBox();
-              std::vector<tools::Tool*> possibles;
+          case KeyType::Tool: {
+            tools::Tool* current_tool = App::instance()->activeTool();
+            tools::Tool* select_this_tool = key->tool();
+            tools::ToolBox* toolbox = App::instance()->getToolBox();
+            std::vector<tools::Tool*> possibles;
 
-              // Collect all tools with the pressed keyboard-shortcut
-              for (tools::Tool* tool : *toolbox) {
-                Key* key = KeyboardShortcuts::instance()->tool(tool);
-                if (key && key->isPressed(msg))
-                  possibles.push_back(tool);
-              }
+            // Collect all tools with the pressed keyboard-shortcut
+            for (tools::Tool* tool : *toolbox) {
+              Key* key = KeyboardShortcuts::instance()->tool(tool);
+              if (key && key->isPressed(msg))
+                possibles.push_back(tool);
+            }
 
-              if (possibles.size() >= 2) {
-                bool done = false;
+            if (possibles.size() >= 2) {
+              bool done = false;
 
-                for (size_t i=0; i<possibles.size(); ++i) {
-                  if (possibles[i] != current_tool &&
-                      ToolBar::instance()->isToolVisible(possibles[i])) {
-                    select_this_tool = possibles[i];
-                    done = true;
-                    break;
-                  }
+              for (size_t i=0; i<possibles.size(); ++i) {
+                if (possibles[i] != current_tool &&
+                    ToolBar::instance()->isToolVisible(possibles[i])) {
+                  select_this_tool = possibles[i];
+                  done = true;
+                  break;
                 }
+              }
 
-                if (!done) {
-                  for (size_t i=0; i<possibles.size(); ++i) {
-                    // If one of the possibilities is the current tool
-                    if (possibles[i] == current_tool) {
-                      // We select the next tool in the possibilities
-                      select_this_tool = possibles[(i+1) % possibles.size()];
-                      break;
-                    }
+              if (!done) {
+                for (size_t i=0; i<possibles.size(); ++i) {
+                  // If one of the possibilities is the current tool
+                  if (possibles[i] == current_tool) {
+                    // We select the next tool in the possibilities
+                    select_this_tool = possibles[(i+1) % possibles.size()];
+                    break;
                   }
                 }
               }
-
-              ToolBar::instance()->selectTool(select_this_tool);
-              return true;
             }
 
-            case KeyType::Command: {
-              Command* command = key->command();
+            ToolBar::instance()->selectTool(select_this_tool);
+            return true;
+          }
 
-              // Commands are executed only when the main window is
-              // the current window running at foreground.
-              UI_FOREACH_WIDGET(getChildren(), it) {
-                Window* child = static_cast<Window*>(*it);
+          case KeyType::Command: {
+            Command* command = key->command();
 
-                // There are a foreground window executing?
-                if (child->isForeground()) {
-                  break;
-                }
-                // Is it the desktop and the top-window=
-                else if (child->isDesktop() && child == App::instance()->getMainWindow()) {
-                  // OK, so we can execute the command represented
-                  // by the pressed-key in the message...
-                  UIContext::instance()->executeCommand(
-                    command, key->params());
-                  return true;
-                }
-              }
-              break;
-            }
+            // Commands are executed only when the main window is
+            // the current window running at foreground.
+            UI_FOREACH_WIDGET(getChildren(), it) {
+              Window* child = static_cast<Window*>(*it);
 
-            case KeyType::Quicktool: {
-              // Do nothing, it is used in the editor through the
-              // KeyboardShortcuts::getCurrentQuicktool() function.
-              break;
+              // There are a foreground window executing?
+              if (child->isForeground()) {
+                break;
+              }
+              // Is it the desktop and the top-window=
+              else if (child->isDesktop() && child == App::instance()->getMainWindow()) {
+                // OK, so we can execute the command represented
+                // by the pressed-key in the message...
+                UIContext::instance()->executeCommand(
+                  command, key->params());
+                return true;
+              }
             }
+            break;
+          }
 
+          case KeyType::Quicktool: {
+            // Do nothing, it is used in the editor through the
+            // KeyboardShortcuts::getCurrentQuicktool() function.
+            break;
           }
-          break;
+
         }
       }
       break;
@@ -509,6 +600,9 @@ bool CustomizedGuiManager::onProcessMessage(Message* msg)
         defered_invalid_region.clear();
         defered_invalid_timer->stop();
       }
+      else if (static_cast<TimerMessage*>(msg)->timer() == trim_buffers_timer) {
+        doc::ImageBufferRecycler::global().trim();
+      }
       break;
 
   }
@@ -14,6 +14,9 @@
 #include "gfx/rect.h"
 #include "ui/base.h"
 
+#include <functional>
+#include <string>
+
 namespace ui {
   class ButtonBase;
   class CheckBox;
@@ -39,6 +42,19 @@ namespace app {
 
   void gui_run();
   void gui_feedback();
+
+  // Calls the given function after the first frame is displayed (or
+  // right now if it was already displayed). It's used to start
+  // non-essential services without delaying the startup. Functions
+  // that weren't called when gui_run() returns are discarded.
+  void gui_after_first_frame(const std::function<void()>& func);
+
+  // Records the input events in the given file, or replays the events
+  // of a file (writing a JSON report with the frame times in
+  // reportFilename, or in stdout if it's empty).
+  void gui_record_input(const std::string& filename);
+  void gui_replay_input(const std::string& filename,
+                        const std::string& reportFilename);
   void gui_setup_screen();
 
   void load_window_pos(ui::Widget* window, const char *section);
@@ -45,6 +45,8 @@ void HttpLoader::cancel()
 
 void HttpLoader::threadHttpRequest()
 {
+  base::this_thread::set_qos(base::thread_qos::background);
+
   try {
     base::ScopedValue<bool> scoped(m_done, false, true);
 
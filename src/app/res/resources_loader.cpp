@@ -58,6 +58,9 @@ void ResourcesLoader::threadLoadResources()
 {
   PRINTF("threadLoadResources()\n");
 
+  // Resources are listed in a popup that the user has opened
+  base::this_thread::set_qos(base::thread_qos::user_initiated);
+
   base::ScopedValue<bool> scoped(m_done, false, true);
 
   std::string path = m_delegate->resourcesLocation();
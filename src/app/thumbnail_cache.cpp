@@ -0,0 +1,246 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/thumbnail_cache.h"
+
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/path.h"
+#include "base/scoped_lock.h"
+#include "base/time.h"
+#include "base/unique_ptr.h"
+#include "doc/image.h"
+
+#include <cstdio>
+#include <fstream>
+
+namespace app {
+
+using namespace doc;
+
+static const char* kIndexFilename = "index.txt";
+static const char* kMagic = "ASEPRITE-THUMBNAIL-1";
+
+// Returns the string that identifies the current version of the
+// given file, or an empty string if the file doesn't exist.
+static std::string file_key(const std::string& filename)
+{
+  if (!base::is_file(filename))
+    return std::string();
+
+  base::Time t = base::get_modification_time(filename);
+  char buf[256];
+  sprintf(buf, "|%lu|%04d%02d%02d%02d%02d%02d",
+          (unsigned long)base::file_size(filename),
+          t.year, t.month, t.day, t.hour, t.minute, t.second);
+
+  return filename + buf;
+}
+
+// FNV-1a hash of the key to get the file name of the cached thumbnail
+static std::string entry_name(const std::string& key)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : key) {
+    hash ^= uint8_t(c);
+    hash *= 1099511628211ull;
+  }
+
+  char buf[32];
+  sprintf(buf, "%08x%08x.thumb",
+          unsigned(hash >> 32), unsigned(hash & 0xffffffff));
+  return buf;
+}
+
+ThumbnailCache::ThumbnailCache(const std::string& dir, std::size_t maxSize)
+  : m_dir(dir)
+  , m_maxSize(maxSize)
+  , m_size(0)
+  , m_modified(false)
+{
+  loadIndex();
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+  if (m_modified)
+    saveIndex();
+}
+
+Image* ThumbnailCache::load(const std::string& filename)
+{
+  std::string key = file_key(filename);
+  if (key.empty())
+    return nullptr;
+
+  base::scoped_lock hold(m_mutex);
+  std::string name = entry_name(key);
+  auto it = m_map.find(name);
+  if (it == m_map.end())
+    return nullptr;
+
+  base::FileHandle handle(base::open_file(entryPath(name), "rb"));
+  FILE* f = handle.get();
+  if (!f) {
+    removeEntry(it->second);
+    return nullptr;
+  }
+
+  // The key is saved in the file to detect collisions of entry names
+  std::string header = std::string(kMagic) + "\n" + key + "\n";
+  std::string fileHeader(header.size(), 0);
+  uint32_t size[2];
+  if (fread(&fileHeader[0], 1, header.size(), f) != header.size() ||
+      fileHeader != header ||
+      fread(size, sizeof(uint32_t), 2, f) != 2 ||
+      size[0] == 0 || size[1] == 0 ||
+      size[0] > 0x4000 || size[1] > 0x4000) {
+    return nullptr;
+  }
+
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, size[0], size[1]));
+  int rowSize = image->getRowStrideSize();
+  for (int y=0; y<image->height(); ++y) {
+    if (fread(image->getPixelAddress(0, y), 1, rowSize, f) != std::size_t(rowSize)) {
+      removeEntry(it->second);
+      return nullptr;
+    }
+  }
+
+  // Move the entry to the front of the list (most recently used)
+  m_entries.splice(m_entries.begin(), m_entries, it->second);
+  m_modified = true;
+
+  return image.release();
+}
+
+void ThumbnailCache::save(const std::string& filename, const Image* thumbnail)
+{
+  ASSERT(thumbnail->pixelFormat() == IMAGE_RGB);
+
+  std::string key = file_key(filename);
+  if (key.empty())
+    return;
+
+  base::scoped_lock hold(m_mutex);
+  std::string name = entry_name(key);
+  auto it = m_map.find(name);
+  if (it != m_map.end())
+    removeEntry(it->second);
+
+  std::string header = std::string(kMagic) + "\n" + key + "\n";
+  uint32_t size[2] = { uint32_t(thumbnail->width()),
+                       uint32_t(thumbnail->height()) };
+  int rowSize = thumbnail->getRowStrideSize();
+  {
+    base::FileHandle handle(base::open_file(entryPath(name), "wb"));
+    FILE* f = handle.get();
+    if (!f)
+      return;
+
+    bool ok =
+      (fwrite(header.c_str(), 1, header.size(), f) == header.size() &&
+       fwrite(size, sizeof(uint32_t), 2, f) == 2);
+    for (int y=0; ok && y<thumbnail->height(); ++y)
+      ok = (fwrite(thumbnail->getPixelAddress(0, y), 1, rowSize, f) == std::size_t(rowSize));
+
+    if (!ok) {
+      handle.reset();
+      base::delete_file(entryPath(name));
+      return;
+    }
+  }
+
+  Entry entry;
+  entry.name = name;
+  entry.size = header.size() + sizeof(size) + rowSize*thumbnail->height();
+  m_entries.push_front(entry);
+  m_map[name] = m_entries.begin();
+  m_size += entry.size;
+  m_modified = true;
+
+  removeOldEntries();
+}
+
+// The index is a text file with the name and size of each cached
+// thumbnail, from the most to the least recently used.
+void ThumbnailCache::loadIndex()
+{
+  std::ifstream in(FSTREAM_PATH(entryPath(kIndexFilename)));
+  std::string name;
+  std::size_t size;
+  while (in >> name >> size) {
+    if (m_map.find(name) != m_map.end() ||
+        !base::is_file(entryPath(name)))
+      continue;
+
+    Entry entry;
+    entry.name = name;
+    entry.size = size;
+    m_entries.push_back(entry);
+    m_map[name] = --m_entries.end();
+    m_size += size;
+  }
+
+  // Delete cached files that aren't in the index (e.g. if the
+  // program crashed before saving the index)
+  for (const auto& fn : base::list_files(m_dir)) {
+    if (base::get_file_extension(fn) == "thumb" &&
+        m_map.find(fn) == m_map.end()) {
+      try {
+        base::delete_file(entryPath(fn));
+      }
+      catch (...) {
+        // Ignore errors
+      }
+    }
+  }
+
+  removeOldEntries();
+}
+
+void ThumbnailCache::saveIndex()
+{
+  std::ofstream out(FSTREAM_PATH(entryPath(kIndexFilename)));
+  for (const auto& entry : m_entries)
+    out << entry.name << " " << entry.size << "\n";
+}
+
+void ThumbnailCache::removeOldEntries()
+{
+  while (m_size > m_maxSize && !m_entries.empty())
+    removeEntry(--m_entries.end());
+}
+
+void ThumbnailCache::removeEntry(Entries::iterator it)
+{
+  try {
+    if (base::is_file(entryPath(it->name)))
+      base::delete_file(entryPath(it->name));
+  }
+  catch (...) {
+    // Ignore errors, the file will be deleted the next time the
+    // index is loaded
+  }
+
+  m_size -= it->size;
+  m_map.erase(it->name);
+  m_entries.erase(it);
+  m_modified = true;
+}
+
+std::string ThumbnailCache::entryPath(const std::string& name) const
+{
+  return base::join_path(m_dir, name);
+}
+
+} // namespace app
@@ -0,0 +1,75 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_THUMBNAIL_CACHE_H_INCLUDED
+#define APP_THUMBNAIL_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/mutex.h"
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+
+  // Persistent cache of the thumbnails shown in the file selector.
+  // Each thumbnail is saved in its own file inside the given
+  // directory, identified by the path, size and modification time of
+  // the original file. When the cache is bigger than the given size,
+  // the least recently used thumbnails are deleted.
+  //
+  // It can be used from several threads at the same time.
+  class ThumbnailCache {
+  public:
+    ThumbnailCache(const std::string& dir, std::size_t maxSize);
+    ~ThumbnailCache();
+
+    // Returns a new RGB image with the cached thumbnail of the given
+    // file, or nullptr if it's not in the cache (or if the file was
+    // modified after the thumbnail was saved).
+    doc::Image* load(const std::string& filename);
+
+    // Saves the thumbnail (an RGB image) of the given file.
+    void save(const std::string& filename, const doc::Image* thumbnail);
+
+  private:
+    struct Entry {
+      std::string name;         // File name of the cached thumbnail
+      std::size_t size;         // Size of the cached file in bytes
+    };
+
+    // Entries sorted from the most to the least recently used.
+    typedef std::list<Entry> Entries;
+    typedef std::unordered_map<std::string, Entries::iterator> EntriesMap;
+
+    void loadIndex();
+    void saveIndex();
+    void removeOldEntries();
+    void removeEntry(Entries::iterator it);
+    std::string entryPath(const std::string& name) const;
+
+    std::string m_dir;
+    std::size_t m_maxSize;
+    std::size_t m_size;
+    Entries m_entries;
+    EntriesMap m_map;
+    bool m_modified;
+    base::mutex m_mutex;
+
+    DISABLE_COPYING(ThumbnailCache);
+  };
+
+} // namespace app
+
+#endif
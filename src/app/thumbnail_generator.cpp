@@ -16,9 +16,13 @@
 #include "app/document.h"
 #include "app/file/file.h"
 #include "app/file_system.h"
+#include "app/resource_finder.h"
+#include "app/thumbnail_cache.h"
 #include "base/bind.h"
+#include "base/path.h"
 #include "base/scoped_lock.h"
 #include "base/thread.h"
+#include "base/thread_pool.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/conversion_she.h"
 #include "doc/image.h"
@@ -28,22 +32,29 @@
 #include "she/system.h"
 
 #define MAX_THUMBNAIL_SIZE              128
+#define MAX_THUMBNAIL_CACHE_SIZE        (32*1024*1024)
 
 namespace app {
 
 class ThumbnailGenerator::Worker {
 public:
-  Worker(FileOp* fop, IFileItem* fileitem)
+  Worker(FileOp* fop, IFileItem* fileitem, ThumbnailCache* cache)
     : m_fop(fop)
     , m_fileitem(fileitem)
+    , m_cache(cache)
     , m_thumbnail(NULL)
-    , m_palette(NULL)
-    , m_thread(Bind<void>(&Worker::loadBgThread, this)) {
+    , m_token(new base::task_token) {
+    // Thumbnails are generated in the shared thread pool with low
+    // priority (and background QoS), so several thumbnails don't
+    // oversubscribe the CPU or compete with the GUI thread.
+    base::thread_pool::global().execute(
+      [this]{ loadBgThread(); }, m_token,
+      base::thread_pool::priority::low);
   }
 
   ~Worker() {
     fop_stop(m_fop);
-    m_thread.join();
+    m_token->cancel();
 
     fop_free(m_fop);
   }
@@ -55,7 +66,32 @@ public:
 private:
   void loadBgThread() {
     try {
-      fop_operate(m_fop, NULL);
+      if (m_cache)
+        m_thumbnail.reset(m_cache->load(m_fop->filename));
+
+      if (!m_thumbnail)
+        generateThumbnail();
+
+      // Set the thumbnail of the file-item.
+      if (m_thumbnail) {
+        she::Surface* thumbnail = she::instance()->createRgbaSurface(
+          m_thumbnail->width(),
+          m_thumbnail->height());
+
+        convert_image_to_surface(m_thumbnail, NULL, thumbnail,
+          0, 0, 0, 0, m_thumbnail->width(), m_thumbnail->height());
+
+        m_fileitem->setThumbnail(thumbnail);
+      }
+    }
+    catch (const std::exception& e) {
+      fop_error(m_fop, "Error loading file:\n%s", e.what());
+    }
+    fop_done(m_fop);
+  }
+
+  void generateThumbnail() {
+    fop_operate(m_fop, NULL);
 
       // Post load
       fop_post_load(m_fop);
@@ -65,12 +101,10 @@ private:
         m_fop->document->sprite(): NULL;
 
       if (!fop_is_stop(m_fop) && sprite) {
-        // The palette to convert the Image
-        m_palette.reset(new Palette(*sprite->palette(frame_t(0))));
-
-        // Render first frame of the sprite in 'image'
+        // Render first frame of the sprite in 'image' (thumbnails are
+        // RGB images to be saved in the cache without a palette)
         base::UniquePtr<Image> image(Image::create(
-            sprite->pixelFormat(), sprite->width(), sprite->height()));
+            IMAGE_RGB, sprite->width(), sprite->height()));
 
         AppRender render;
         render.setupBackground(NULL, image->pixelFormat());
@@ -95,30 +129,17 @@ private:
 
       // Close file
       delete m_fop->document;
+      m_fop->document = NULL;
 
-      // Set the thumbnail of the file-item.
-      if (m_thumbnail) {
-        she::Surface* thumbnail = she::instance()->createRgbaSurface(
-          m_thumbnail->width(),
-          m_thumbnail->height());
-
-        convert_image_to_surface(m_thumbnail, m_palette, thumbnail,
-          0, 0, 0, 0, m_thumbnail->width(), m_thumbnail->height());
-
-        m_fileitem->setThumbnail(thumbnail);
-      }
-    }
-    catch (const std::exception& e) {
-      fop_error(m_fop, "Error loading file:\n%s", e.what());
-    }
-    fop_done(m_fop);
+      if (m_thumbnail && m_cache)
+        m_cache->save(m_fop->filename, m_thumbnail);
   }
 
   FileOp* m_fop;
   IFileItem* m_fileitem;
+  ThumbnailCache* m_cache;
   base::UniquePtr<Image> m_thumbnail;
-  base::UniquePtr<Palette> m_palette;
-  base::thread m_thread;
+  base::task_token_ptr m_token;
 };
 
 static void delete_singleton(ThumbnailGenerator* singleton)
@@ -136,6 +157,28 @@ ThumbnailGenerator* ThumbnailGenerator::instance()
   return singleton;
 }
 
+ThumbnailGenerator::ThumbnailGenerator()
+{
+  try {
+    ResourceFinder rf;
+    rf.includeUserDir(base::join_path("thumbnails", ".").c_str());
+    m_cache.reset(new ThumbnailCache(rf.getFirstOrCreateDefault(),
+                                     MAX_THUMBNAIL_CACHE_SIZE));
+  }
+  catch (const std::exception& e) {
+    // Thumbnails will be generated each time without cache
+    PRINTF("Cannot create the thumbnails cache: %s\n", e.what());
+  }
+}
+
+ThumbnailGenerator::~ThumbnailGenerator()
+{
+  // Workers must be destroyed before the cache
+  if (m_stopThread && m_stopThread->joinable())
+    m_stopThread->join();
+  stopAllWorkersBackground();
+}
+
 ThumbnailGenerator::WorkerStatus ThumbnailGenerator::getWorkerStatus(IFileItem* fileitem, double& progress)
 {
   base::scoped_lock hold(m_workersAccess);
@@ -191,11 +234,14 @@ void ThumbnailGenerator::addWorkerToGenerateThumbnail(IFileItem* fileitem)
   if (!fop)
     return;
 
+  // Formats can decode a smaller image for the thumbnail
+  fop->preview_size = MAX_THUMBNAIL_SIZE;
+
   if (fop->has_error()) {
     fop_free(fop);
   }
   else {
-    Worker* worker = new Worker(fop, fileitem);
+    Worker* worker = new Worker(fop, fileitem, m_cache.get());
     try {
       base::scoped_lock hold(m_workersAccess);
       m_workers.push_back(worker);
@@ -215,6 +261,8 @@ void ThumbnailGenerator::stopAllWorkers()
 
 void ThumbnailGenerator::stopAllWorkersBackground()
 {
+  base::this_thread::set_qos(base::thread_qos::background);
+
   WorkerList workersCopy;
   {
     base::scoped_lock hold(m_workersAccess);
@@ -20,11 +20,15 @@ namespace base {
 
 namespace app {
   class IFileItem;
+  class ThumbnailCache;
 
   class ThumbnailGenerator {
   public:
     enum WorkerStatus { WithoutWorker, WorkingOnThumbnail, ThumbnailIsDone };
 
+    ThumbnailGenerator();
+    ~ThumbnailGenerator();
+
     static ThumbnailGenerator* instance();
 
     // Generate a thumbnail for the given file-item.  It must be called
@@ -52,6 +56,7 @@ namespace app {
     class Worker;
     typedef std::vector<Worker*> WorkerList;
 
+    base::UniquePtr<ThumbnailCache> m_cache;
     WorkerList m_workers;
     base::mutex m_workersAccess;
     base::UniquePtr<base::thread> m_stopThread;
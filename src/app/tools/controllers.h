@@ -22,6 +22,11 @@ class FreehandController : public Controller {
 public:
   bool isFreehand() { return true; }
 
+  void prepareController() override
+  {
+    m_lastInterwined = 0;
+  }
+
   void pressButton(Points& points, const Point& point)
   {
     points.push_back(point);
@@ -38,10 +43,14 @@ public:
   {
     if (input.size() == 1) {
       output.push_back(input[0]);
+      m_lastInterwined = 0;
     }
     else if (input.size() >= 2) {
-      output.push_back(input[input.size()-2]);
-      output.push_back(input[input.size()-1]);
+      // All points added since the last call are joined (several
+      // movements can be drawn in the same tool loop step).
+      size_t first = MIN(m_lastInterwined, input.size()-2);
+      output.insert(output.end(), input.begin()+first, input.end());
+      m_lastInterwined = input.size()-1;
     }
   }
   void getStatusBarText(const Points& points, std::string& text)
@@ -57,6 +66,10 @@ public:
             points[points.size()-1].y);
     text = buf;
   }
+
+private:
+  // Index of the last point returned by getPointsToInterwine()
+  size_t m_lastInterwined;
 };
 
 // Controls clicks for tools like line
@@ -8,12 +8,15 @@
 #include "app/modules/palettes.h"
 #include "app/tools/shade_table.h"
 #include "app/tools/shading_options.h"
+#include "doc/bitmap_ops.h"
 #include "doc/palette.h"
 #include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
 #include "doc/sprite.h"
 #include "filters/neighboring_pixels.h"
 
+#include <algorithm>
+
 namespace app {
 namespace tools {
 
@@ -30,12 +33,11 @@ template<typename Derived>
 class InkProcessing {
 public:
   void operator()(int x1, int y, int x2, ToolLoop* loop) {
-    int x;
-
     // Use mask
     if (loop->useMask()) {
       Point maskOrigin(loop->getMaskOrigin());
-      const Rect& maskBounds(loop->getMask()->bounds());
+      const Mask* mask = loop->getMask();
+      const Rect& maskBounds(mask->bounds());
 
       if ((y < maskOrigin.y) || (y >= maskOrigin.y+maskBounds.h))
         return;
@@ -46,21 +48,30 @@ public:
       if (x2 > maskOrigin.x+maskBounds.w-1)
         x2 = maskOrigin.x+maskBounds.w-1;
 
-      if (Image* bitmap = loop->getMask()->bitmap()) {
-        static_cast<Derived*>(this)->initIterators(loop, x1, y);
-
-        for (x=x1; x<=x2; ++x) {
-          if (bitmap->getPixel(x-maskOrigin.x, y-maskOrigin.y))
-            static_cast<Derived*>(this)->processPixel(x, y);
+      if (x1 > x2)
+        return;
 
-          static_cast<Derived*>(this)->moveIterators();
-        }
+      // Process each run of selected pixels as a span (the const
+      // bitmap() keeps rectangular masks as rectangles)
+      if (const Image* bitmap = mask->bitmap()) {
+        BitmapRowRuns runs(bitmap->getPixelAddress(0, y-maskOrigin.y),
+                           x1-maskOrigin.x, x2-x1+1);
+        for (int u, n; runs.next(u, n); )
+          static_cast<Derived*>(this)->processSpan(
+            loop, u+maskOrigin.x, y, u+n-1+maskOrigin.x);
         return;
       }
     }
 
+    static_cast<Derived*>(this)->processSpan(loop, x1, y, x2);
+  }
+
+  // Default implementation to process a span [x1, x2] pixel by
+  // pixel. Inks can hide this member function to process several
+  // pixels at the same time.
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
     static_cast<Derived*>(this)->initIterators(loop, x1, y);
-    for (x=x1; x<=x2; ++x) {
+    for (int x=x1; x<=x2; ++x) {
       static_cast<Derived*>(this)->processPixel(x, y);
       static_cast<Derived*>(this)->moveIterators();
     }
@@ -115,6 +126,12 @@ public:
     *SimpleInkProcessing<OpaqueInkProcessing<ImageTraits>, ImageTraits>::m_dstAddress = m_color;
   }
 
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
+    typename ImageTraits::address_t dst =
+      (typename ImageTraits::address_t)loop->getDstImage()->getPixelAddress(x1, y);
+    std::fill(dst, dst+x2-x1+1, typename ImageTraits::pixel_t(m_color));
+  }
+
 private:
   color_t m_color;
 };
@@ -218,6 +235,10 @@ public:
     // Do nothing
   }
 
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
+    DoubleInkProcessing<TransparentInkProcessing<ImageTraits>, ImageTraits>::processSpan(loop, x1, y, x2);
+  }
+
 private:
   color_t m_color;
   int m_opacity;
@@ -228,6 +249,24 @@ void TransparentInkProcessing<RgbTraits>::processPixel(int x, int y) {
   *m_dstAddress = rgba_blend_normal(*m_srcAddress, m_color, m_opacity);
 }
 
+// Blends the color with the whole span using the SSE2 span blender
+template<>
+void TransparentInkProcessing<RgbTraits>::processSpan(ToolLoop* loop, int x1, int y, int x2) {
+  const int n = x2-x1+1;
+  const uint32_t* src = (const uint32_t*)loop->getSrcImage()->getPixelAddress(x1, y);
+  uint32_t* dst = (uint32_t*)loop->getDstImage()->getPixelAddress(x1, y);
+  if (dst != src)
+    std::copy(src, src+n, dst);
+
+  // The span is blended in chunks, and ~m_color is used as the mask
+  // color so every pixel is blended.
+  const int kChunk = 64;
+  uint32_t colors[kChunk];
+  std::fill(colors, colors+MIN(n, kChunk), m_color);
+  for (int i=0; i<n; i+=kChunk)
+    rgba_blend_span_normal(dst+i, colors, MIN(kChunk, n-i), m_opacity, ~m_color);
+}
+
 template<>
 void TransparentInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   *m_dstAddress = graya_blend_normal(*m_srcAddress, m_color, m_opacity);
@@ -261,6 +300,61 @@ private:
 // Blur Ink
 //////////////////////////////////////////////////////////////////////
 
+// Sliding 3x3 window over the pixels of a span. The area of each
+// pixel is the sum of three columns (of the rows y-1, y, and y+1), so
+// two of them are reused from the previous pixel. The coordinates are
+// tiled or clamped in the same way as get_neighboring_pixels() does.
+template<typename ImageTraits, typename Delegate>
+class BlurWindow {
+public:
+  BlurWindow(const Image* image, int x, int y, TiledMode tiledMode,
+             const Delegate& delegate)
+    : m_left(delegate)
+    , m_center(delegate)
+    , m_right(delegate)
+    , m_width(image->width())
+    , m_tiledX((int(tiledMode) & int(TiledMode::X_AXIS)) != 0)
+    , m_x(x) {
+    bool tiledY = ((int(tiledMode) & int(TiledMode::Y_AXIS)) != 0);
+    for (int i=0; i<3; ++i) {
+      int v = get_neighboring_coord(y-1+i, image->height(), tiledY);
+      m_rows[i] = (typename ImageTraits::const_address_t)image->getPixelAddress(0, v);
+    }
+    getColumn(x-1, m_left);
+    getColumn(x, m_center);
+    getColumn(x+1, m_right);
+  }
+
+  // Returns the sum of the 3x3 area of the current pixel
+  void getArea(Delegate& area) const {
+    area = m_left;
+    area += m_center;
+    area += m_right;
+  }
+
+  // Moves the window to the next pixel
+  void next() {
+    m_left = m_center;
+    m_center = m_right;
+    ++m_x;
+    getColumn(m_x+1, m_right);
+  }
+
+private:
+  void getColumn(int x, Delegate& column) const {
+    int u = get_neighboring_coord(x, m_width, m_tiledX);
+    column.reset();
+    for (int i=0; i<3; ++i)
+      column(m_rows[i][u]);
+  }
+
+  typename ImageTraits::const_address_t m_rows[3];
+  Delegate m_left, m_center, m_right; // Columns x-1, x, and x+1
+  int m_width;
+  bool m_tiledX;
+  int m_x;
+};
+
 template<typename ImageTraits>
 class BlurInkProcessing : public DoubleInkProcessing<BlurInkProcessing<ImageTraits>, ImageTraits> {
 public:
@@ -280,10 +374,19 @@ public:
     m_srcImage(loop->getSrcImage()) {
   }
 
-  void processPixel(int x, int y) {
-    m_area.reset();
-    get_neighboring_pixels<RgbTraits>(m_srcImage, x, y, 3, 3, 1, 1, m_tiledMode, m_area);
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
+    initIterators(loop, x1, y);
+    BlurWindow<RgbTraits, GetPixelsDelegate> window(m_srcImage, x1, y, m_tiledMode, m_area);
+    for (int x=x1; x<=x2; ++x) {
+      window.getArea(m_area);
+      blurPixel();
+      window.next();
+      moveIterators();
+    }
+  }
 
+private:
+  void blurPixel() {
     if (m_area.count > 0) {
       m_area.r /= m_area.count;
       m_area.g /= m_area.count;
@@ -303,12 +406,16 @@ public:
     }
   }
 
-private:
   struct GetPixelsDelegate {
     int count, r, g, b, a;
 
     void reset() { count = r = g = b = a = 0; }
 
+    GetPixelsDelegate& operator+=(const GetPixelsDelegate& o) {
+      count += o.count; r += o.r; g += o.g; b += o.b; a += o.a;
+      return *this;
+    }
+
     void operator()(RgbTraits::pixel_t color)
     {
       if (rgba_geta(color) != 0) {
@@ -336,10 +443,19 @@ public:
     m_srcImage(loop->getSrcImage()) {
   }
 
-  void processPixel(int x, int y) {
-    m_area.reset();
-    get_neighboring_pixels<GrayscaleTraits>(m_srcImage, x, y, 3, 3, 1, 1, m_tiledMode, m_area);
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
+    initIterators(loop, x1, y);
+    BlurWindow<GrayscaleTraits, GetPixelsDelegate> window(m_srcImage, x1, y, m_tiledMode, m_area);
+    for (int x=x1; x<=x2; ++x) {
+      window.getArea(m_area);
+      blurPixel();
+      window.next();
+      moveIterators();
+    }
+  }
 
+private:
+  void blurPixel() {
     if (m_area.count > 0) {
       m_area.v /= m_area.count;
       m_area.a /= 9;
@@ -355,12 +471,16 @@ public:
     }
   }
 
-private:
   struct GetPixelsDelegate {
     int count, v, a;
 
     void reset() { count = v = a = 0; }
 
+    GetPixelsDelegate& operator+=(const GetPixelsDelegate& o) {
+      count += o.count; v += o.v; a += o.a;
+      return *this;
+    }
+
     void operator()(GrayscaleTraits::pixel_t color)
     {
       if (graya_geta(color) > 0) {
@@ -389,10 +509,19 @@ public:
     m_area(get_current_palette()) {
   }
 
-  void processPixel(int x, int y) {
-    m_area.reset();
-    get_neighboring_pixels<IndexedTraits>(m_srcImage, x, y, 3, 3, 1, 1, m_tiledMode, m_area);
+  void processSpan(ToolLoop* loop, int x1, int y, int x2) {
+    initIterators(loop, x1, y);
+    BlurWindow<IndexedTraits, GetPixelsDelegate> window(m_srcImage, x1, y, m_tiledMode, m_area);
+    for (int x=x1; x<=x2; ++x) {
+      window.getArea(m_area);
+      blurPixel();
+      window.next();
+      moveIterators();
+    }
+  }
 
+private:
+  void blurPixel() {
     if (m_area.count > 0 && m_area.a/9 >= 128) {
       m_area.r /= m_area.count;
       m_area.g /= m_area.count;
@@ -410,7 +539,6 @@ public:
     }
   }
 
-private:
   struct GetPixelsDelegate {
     const Palette* pal;
     int count, r, g, b, a;
@@ -419,6 +547,11 @@ private:
 
     void reset() { count = r = g = b = a = 0; }
 
+    GetPixelsDelegate& operator+=(const GetPixelsDelegate& o) {
+      count += o.count; r += o.r; g += o.g; b += o.b; a += o.a;
+      return *this;
+    }
+
     void operator()(IndexedTraits::pixel_t color)
     {
       a += (color == 0 ? 0: 255);
@@ -631,23 +764,23 @@ public:
 template<>
 class ShadingInkProcessing<IndexedTraits> : public DoubleInkProcessing<ShadingInkProcessing<IndexedTraits>, IndexedTraits> {
 public:
-  ShadingInkProcessing(ToolLoop* loop) :
-    m_palette(get_current_palette()),
-    m_shadeTable(loop->getShadingOptions()->getShadeTable()),
-    m_left(loop->getMouseButton() == ToolLoop::Left) {
+  ShadingInkProcessing(ToolLoop* loop) {
+    tools::ShadeTable8* shadeTable = loop->getShadingOptions()->getShadeTable();
+
+    // The mouse button cannot change in the middle of the stroke, so
+    // we choose the table only once.
+    if (loop->getMouseButton() == ToolLoop::Left)
+      m_table = shadeTable->leftTable();
+    else
+      m_table = shadeTable->rightTable();
   }
 
   void processPixel(int x, int y) {
-    if (m_left)
-      *m_dstAddress = m_shadeTable->left(*m_srcAddress);
-    else
-      *m_dstAddress = m_shadeTable->right(*m_srcAddress);
+    *m_dstAddress = m_table[*m_srcAddress];
   }
 
 private:
-  const Palette* m_palette;
-  tools::ShadeTable8* m_shadeTable;
-  bool m_left;
+  const uint8_t* m_table;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -39,7 +39,7 @@ public:
 
   void preparePointShape(ToolLoop* loop) override {
     m_brush = loop->getBrush();
-    m_compressedImage.reset(new CompressedImage(m_brush->image(), false));
+    m_compressedImage = m_brush->compressedImage();
     m_firstPoint = true;
   }
 
@@ -27,6 +27,11 @@ namespace app {
       uint8_t left(uint8_t index) { return m_left[index]; }
       uint8_t right(uint8_t index) { return m_right[index]; }
 
+      // Returns the 256-entry table used by left() or right(), so the
+      // ink can resolve each pixel with a single lookup.
+      const uint8_t* leftTable() const { return &m_left[0]; }
+      const uint8_t* rightTable() const { return &m_right[0]; }
+
     private:
       std::vector<uint8_t> m_left;
       std::vector<uint8_t> m_right;
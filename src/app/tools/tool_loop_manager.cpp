@@ -19,10 +19,12 @@
 #include "app/tools/point_shape.h"
 #include "app/tools/tool_loop.h"
 #include "app/ui/editor/editor.h"
+#include "base/tracing.h"
 #include "doc/image.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "gfx/region.h"
+#include "ui/system.h"
 
 namespace app {
 namespace tools {
@@ -34,6 +36,8 @@ using namespace filters;
 ToolLoopManager::ToolLoopManager(ToolLoop* toolLoop)
   : m_toolLoop(toolLoop)
   , m_dirtyArea(toolLoop->getDirtyArea())
+  , m_pendingMovement(false)
+  , m_lastStepTime(0)
 {
 }
 
@@ -59,7 +63,7 @@ void ToolLoopManager::prepareLoop(const Pointer& pointer)
 
   // Prepare preview image (the destination image will be our preview
   // in the tool-loop time, so we can see what we are drawing)
-  Editor::renderEngine().setPreviewImage(
+  Editor::setPreviewImage(
     m_toolLoop->getLayer(),
     m_toolLoop->getFrame(),
     m_toolLoop->getDstImage());
@@ -68,7 +72,7 @@ void ToolLoopManager::prepareLoop(const Pointer& pointer)
 void ToolLoopManager::releaseLoop(const Pointer& pointer)
 {
   // No more preview image
-  Editor::renderEngine().removePreviewImage();
+  Editor::removePreviewImage();
 }
 
 void ToolLoopManager::pressKey(ui::KeyScancode key)
@@ -105,6 +109,8 @@ void ToolLoopManager::pressButton(const Pointer& pointer)
     return;
   }
 
+  flushMovement();
+
   // Convert the screen point to a sprite point
   Point spritePoint = m_toolLoop->screenToSprite(Point(pointer.x(), pointer.y()));
   m_toolLoop->setSpeed(Point(0, 0));
@@ -113,10 +119,7 @@ void ToolLoopManager::pressButton(const Pointer& pointer)
 
   m_toolLoop->getController()->pressButton(m_points, spritePoint);
 
-  std::string statusText;
-  m_toolLoop->getController()->getStatusBarText(m_points, statusText);
-  m_toolLoop->updateStatusBar(statusText.c_str());
-
+  updateStatusBar();
   doLoopStep(false);
 }
 
@@ -125,6 +128,8 @@ bool ToolLoopManager::releaseButton(const Pointer& pointer)
   if (isCanceled())
     return false;
 
+  flushMovement();
+
   Point spritePoint = m_toolLoop->screenToSprite(Point(pointer.x(), pointer.y()));
   snapToGrid(spritePoint);
 
@@ -153,15 +158,36 @@ void ToolLoopManager::movement(const Pointer& pointer)
 
   m_toolLoop->getController()->movement(m_toolLoop, m_points, spritePoint);
 
+  // Movements received faster than the screen can be refreshed are
+  // accumulated and drawn together in the next step.
+  m_pendingMovement = true;
+  if (ui::clock() - m_lastStepTime >= kMinStepInterval)
+    flushMovement();
+}
+
+void ToolLoopManager::flushMovement()
+{
+  if (!m_pendingMovement || isCanceled())
+    return;
+
+  updateStatusBar();
+  doLoopStep(false);
+}
+
+void ToolLoopManager::updateStatusBar()
+{
   std::string statusText;
   m_toolLoop->getController()->getStatusBarText(m_points, statusText);
   m_toolLoop->updateStatusBar(statusText.c_str());
-
-  doLoopStep(false);
 }
 
 void ToolLoopManager::doLoopStep(bool last_step)
 {
+  TRACE_ZONE("ToolLoopManager::doLoopStep");
+
+  m_pendingMovement = false;
+  m_lastStepTime = ui::clock();
+
   Points points_to_interwine;
   if (!last_step)
     m_toolLoop->getController()->getPointsToInterwine(m_points, points_to_interwine);
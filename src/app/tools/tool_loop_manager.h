@@ -84,12 +84,27 @@ namespace app {
       bool releaseButton(const Pointer& pointer);
 
       // Should be called each time the user moves the mouse inside the editor.
+      //
+      // To limit the cost of high-rate input devices, a new loop step
+      // is done only if kMinStepInterval milliseconds have passed
+      // since the previous one. In other case the movement is kept
+      // pending and drawn with the next one (or with flushMovement()).
       void movement(const Pointer& pointer);
 
+      // Returns true if there are movements that weren't drawn yet.
+      bool hasPendingMovement() const { return m_pendingMovement; }
+
+      // Draws all pending movements in one loop step.
+      void flushMovement();
+
+      // Minimum milliseconds between two loop steps in movement()
+      static const int kMinStepInterval = 16;
+
     private:
       typedef std::vector<gfx::Point> Points;
 
       void doLoopStep(bool last_step);
+      void updateStatusBar();
       void snapToGrid(gfx::Point& point);
 
       void calculateDirtyArea(const Points& points);
@@ -101,6 +116,8 @@ namespace app {
       Points m_points;
       gfx::Point m_oldPoint;
       gfx::Region& m_dirtyArea;
+      bool m_pendingMovement;
+      int m_lastStepTime;
     };
 
   } // namespace tools
@@ -11,6 +11,7 @@
 
 #include "app/transaction.h"
 
+#include "app/cmd_arena.h"
 #include "app/cmd_transaction.h"
 #include "app/context_access.h"
 #include "app/document.h"
@@ -23,9 +24,12 @@ using namespace doc;
 
 Transaction::Transaction(Context* ctx, const std::string& label, Modification modification)
   : m_ctx(ctx)
+  , m_doc(NULL)
   , m_cmds(NULL)
+  , m_prevArena(NULL)
 {
-  m_undo = m_ctx->activeDocument()->undoHistory();
+  m_doc = m_ctx->activeDocument();
+  m_undo = m_doc->undoHistory();
   m_cmds = new CmdTransaction(label,
     modification == Modification::ModifyDocument,
     m_undo->savedCounter());
@@ -34,14 +38,21 @@ Transaction::Transaction(Context* ctx, const std::string& label, Modification mo
   // SpritePosition. Sub-cmds are executed then one by one, in
   // Transaction::execute()
   m_cmds->execute(m_ctx);
+
+  // New Cmds are allocated in the arena of this transaction
+  m_prevArena = CmdArena::setCurrent(m_cmds->arena());
 }
 
 Transaction::~Transaction()
 {
   try {
     // If it isn't committed, we have to rollback all changes.
-    if (m_cmds)
+    if (m_cmds) {
+      restoreArena();
       rollback();
+    }
+
+    m_doc->flushNotifications();
   }
   catch (...) {
     // Just avoid throwing an exception in the dtor (just in case
@@ -55,9 +66,37 @@ void Transaction::commit()
 {
   ASSERT(m_cmds);
 
+  restoreArena();
+
   m_cmds->commit();
   m_undo->add(m_cmds);
   m_cmds = NULL;
+
+  // Fire the notifications of all commands together
+  m_doc->flushNotifications();
+}
+
+// Transactions can be destroyed in any order (e.g. interactive
+// transactions alive between UI messages), so the arena of the
+// previous transaction is kept alive until it's restored. Only the
+// transaction that owns the current arena changes it, and the
+// previous arena is restored only if its transaction is still open
+// (if not, new Cmds are allocated in the heap).
+void Transaction::restoreArena()
+{
+  CmdArena* arena = m_cmds->arena();
+  arena->close();
+
+  if (CmdArena::current() == arena) {
+    CmdArena::setCurrent(
+      m_prevArena && !m_prevArena->isClosed() ? m_prevArena: NULL);
+    arena->release();
+  }
+
+  if (m_prevArena) {
+    m_prevArena->release();
+    m_prevArena = NULL;
+  }
 }
 
 void Transaction::rollback()
@@ -72,13 +111,19 @@ void Transaction::rollback()
 
 void Transaction::execute(Cmd* cmd)
 {
+  // Notifications of commands are merged until the transaction is
+  // committed (so big operations with a lot of commands refresh the
+  // sprite only once)
+  m_doc->beginNotificationsBatch();
   try {
     cmd->execute(m_ctx);
   }
   catch (...) {
+    m_doc->endNotificationsBatch();
     delete cmd;
     throw;
   }
+  m_doc->endNotificationsBatch();
 
   try {
     m_cmds->add(cmd);
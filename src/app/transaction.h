@@ -14,8 +14,10 @@
 namespace app {
 
   class Cmd;
+  class CmdArena;
   class CmdTransaction;
   class Context;
+  class Document;
   class DocumentUndo;
 
   enum Modification {
@@ -58,10 +60,13 @@ namespace app {
 
   private:
     void rollback();
+    void restoreArena();
 
     Context* m_ctx;
+    Document* m_doc;
     DocumentUndo* m_undo;
     CmdTransaction* m_cmds;
+    CmdArena* m_prevArena;
   };
 
 } // namespace app
@@ -45,6 +45,8 @@ ButtonSet::Item::Item()
   : Widget(buttonset_item_type())
   , m_icon(NULL)
 {
+  // The preferred size depends on the position in the ButtonSet
+  disableSizeCache();
   setup_mini_font(this);
 }
 
@@ -0,0 +1,330 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/cel_thumbnails.h"
+
+#include "app/document.h"
+#include "base/thread_pool.h"
+#include "doc/cel.h"
+#include "doc/conversion_she.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/layer.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "she/surface.h"
+#include "she/system.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace app {
+
+using namespace doc;
+
+// Maximum number of cached thumbnails (each one uses a few hundred
+// bytes, the timeline displays 12x12 thumbnails scaled by guiscale)
+static const int kMaxEntries = 16384;
+
+struct CelThumbnails::Job {
+  Document* document;
+  ObjectId celId;
+  gfx::Size size;
+  std::vector<int> key;
+  ImageRef image;
+  bool ok;                      // True if the thumbnail was generated
+  base::task_token_ptr token;
+
+  Job(Document* document, ObjectId celId,
+      const gfx::Size& size, const std::vector<int>& key)
+    : document(document)
+    , celId(celId)
+    , size(size)
+    , key(key)
+    , ok(false)
+    , token(new base::task_token) {
+  }
+
+  // Executed in a worker thread
+  void run() {
+    // The document can be in the middle of a modification, we'll
+    // try again in the next paint.
+    if (!document->lock(Document::ReadLock, 0))
+      return;
+
+    try {
+      const Cel* cel = doc::get<Cel>(celId);
+      std::vector<int> currentKey;
+      if (cel) {
+        getKey(cel, currentKey);
+
+        // Generate the thumbnail only if the cel wasn't modified
+        // since the job was queued.
+        if (currentKey == key)
+          generate(cel);
+      }
+    }
+    catch (...) {
+      // The thumbnail will be generated again
+    }
+
+    document->unlock();
+  }
+
+  // Samples the sprite canvas (nearest neighbor) to show where the
+  // cel is located inside the sprite.
+  void generate(const Cel* cel) {
+    const Sprite* sprite = cel->sprite();
+    const Image* src = cel->image();
+    const Palette* pal = sprite->palette(cel->frame());
+    const color_t mask = sprite->transparentColor();
+    const bool background = cel->layer()->isBackground();
+    const int sw = sprite->width();
+    const int sh = sprite->height();
+
+    // Keep the aspect ratio of the sprite
+    int w, h;
+    if (sw*size.h > sh*size.w) {
+      w = size.w;
+      h = std::max(1, sh*size.w/sw);
+    }
+    else {
+      w = std::max(1, sw*size.h/sh);
+      h = size.h;
+    }
+
+    image.reset(Image::create(IMAGE_RGB, w, h));
+    clear_image(image.get(), rgba(0, 0, 0, 0));
+
+    for (int y=0; y<h; ++y) {
+      int v = y*sh/h - cel->y();
+      if (v < 0 || v >= src->height())
+        continue;
+
+      for (int x=0; x<w; ++x) {
+        int u = x*sw/w - cel->x();
+        if (u < 0 || u >= src->width())
+          continue;
+
+        color_t c = get_pixel(src, u, v);
+        switch (src->pixelFormat()) {
+          case IMAGE_RGB:
+            break;
+          case IMAGE_GRAYSCALE:
+            c = rgba(graya_getv(c), graya_getv(c), graya_getv(c), graya_geta(c));
+            break;
+          case IMAGE_INDEXED:
+            if ((c == mask && !background) || int(c) >= pal->size())
+              continue;
+            c = pal->getEntry(c);
+            break;
+          default:
+            continue;
+        }
+        put_pixel(image.get(), x, y, c);
+      }
+    }
+
+    ok = true;
+  }
+};
+
+CelThumbnails::Entry::~Entry()
+{
+  if (job)
+    job->token->cancel();
+
+  if (surface)
+    surface->dispose();
+}
+
+CelThumbnails::CelThumbnails()
+  : m_time(0)
+{
+}
+
+CelThumbnails::~CelThumbnails()
+{
+  clear();
+}
+
+she::Surface* CelThumbnails::get(Document* document, const Cel* cel,
+                                 const gfx::Size& size)
+{
+  getKey(cel, m_key);
+  ++m_time;
+
+  Entry& entry = m_entries[cel->id()];
+  entry.lastUse = m_time;
+
+  if (entry.size == size && entry.key == m_key) {
+    // The thumbnail is ready or it's being generated
+    if (entry.surface || entry.job)
+      return entry.surface;
+  }
+  // The cel was modified, the old thumbnail is discarded
+  else {
+    if (entry.job) {
+      entry.job->token->cancel();
+      entry.job.reset();
+    }
+    if (entry.surface) {
+      entry.surface->dispose();
+      entry.surface = nullptr;
+    }
+    entry.size = size;
+    entry.key = m_key;
+  }
+  entry.imageId = cel->image()->id();
+
+  JobPtr job(new Job(document, cel->id(), size, m_key));
+  entry.job = job;
+  m_jobs.push_back(job);
+
+  base::thread_pool::global().execute(
+    [job]{ job->run(); }, job->token,
+    base::thread_pool::priority::low);
+
+  removeOldEntries();
+  return nullptr;
+}
+
+bool CelThumbnails::update()
+{
+  bool repaint = false;
+
+  for (auto it=m_jobs.begin(); it!=m_jobs.end(); ) {
+    JobPtr job = *it;
+    if (!job->token->finished()) {
+      ++it;
+      continue;
+    }
+
+    auto entryIt = m_entries.find(job->celId);
+    if (entryIt != m_entries.end() && entryIt->second.job == job) {
+      Entry& entry = entryIt->second;
+      if (job->ok) {
+        const Image* image = job->image.get();
+        entry.surface = she::instance()->createRgbaSurface(
+          image->width(), image->height());
+        convert_image_to_surface(image, nullptr, entry.surface,
+          0, 0, 0, 0, image->width(), image->height());
+      }
+      // When the job fails (the document was locked) the thumbnail
+      // is generated again in the next paint.
+      else
+        entry.key.clear();
+      entry.job.reset();
+
+      repaint = true;
+    }
+
+    it = m_jobs.erase(it);
+  }
+
+  return repaint;
+}
+
+void CelThumbnails::invalidateImage(ObjectId imageId)
+{
+  for (auto& it : m_entries) {
+    Entry& entry = it.second;
+    if (entry.imageId == imageId)
+      entry.key.clear();
+  }
+}
+
+void CelThumbnails::clear()
+{
+  for (const JobPtr& job : m_jobs)
+    job->token->cancel();
+
+  m_jobs.clear();
+  m_entries.clear();
+}
+
+void CelThumbnails::clear(const Sprite* sprite)
+{
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ) {
+    const Cel* cel = doc::get<Cel>(it->first);
+    if (cel && cel->sprite() == sprite && !it->second.job)
+      it = m_entries.erase(it);
+    else
+      ++it;
+  }
+}
+
+std::size_t CelThumbnails::memSize(const Sprite* sprite) const
+{
+  std::size_t size = 0;
+  for (const auto& it : m_entries) {
+    const Entry& entry = it.second;
+    if (!entry.surface)
+      continue;
+
+    const Cel* cel = doc::get<Cel>(it.first);
+    if (cel && cel->sprite() == sprite)
+      size += 4 * entry.surface->width() * entry.surface->height();
+  }
+  return size;
+}
+
+// static
+void CelThumbnails::getKey(const Cel* cel, std::vector<int>& key)
+{
+  const Sprite* sprite = cel->sprite();
+  const Image* image = cel->image();
+  const Palette* pal = sprite->palette(cel->frame());
+
+  key.clear();
+  key.push_back(sprite->version());
+  key.push_back(int(sprite->pixelFormat()));
+  key.push_back(sprite->width());
+  key.push_back(sprite->height());
+  key.push_back(int(sprite->transparentColor()));
+  key.push_back(pal->id());
+  key.push_back(pal->version());
+  key.push_back(cel->version());
+  key.push_back(cel->x());
+  key.push_back(cel->y());
+  key.push_back(cel->layer()->isBackground() ? 1: 0);
+  key.push_back(image->id());
+  key.push_back(image->version());
+}
+
+void CelThumbnails::removeOldEntries()
+{
+  if (int(m_entries.size()) <= kMaxEntries)
+    return;
+
+  // Remove the least recently used half of the thumbnails
+  std::vector<int> uses;
+  uses.reserve(m_entries.size());
+  for (const auto& it : m_entries)
+    uses.push_back(it.second.lastUse);
+
+  auto median = uses.begin() + uses.size()/2;
+  std::nth_element(uses.begin(), median, uses.end());
+
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ) {
+    if (it->second.lastUse < *median) {
+      JobPtr job = it->second.job;
+      if (job)
+        m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), job));
+      it = m_entries.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
+} // namespace app
@@ -0,0 +1,106 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_UI_CEL_THUMBNAILS_H_INCLUDED
+#define APP_UI_CEL_THUMBNAILS_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/object_id.h"
+#include "gfx/size.h"
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace doc {
+  class Cel;
+  class Sprite;
+}
+
+namespace she {
+  class Surface;
+}
+
+namespace app {
+  class Document;
+
+  // Cache of small previews of cels (e.g. to be displayed in the
+  // timeline). Thumbnails are generated by low priority tasks of
+  // base::thread_pool::global(), so get() returns nullptr the first
+  // time a thumbnail is requested, and update() says when the new
+  // thumbnails are ready.
+  //
+  // Modified cels are detected comparing the versions of the cel, its
+  // image, sprite and palette, but the pixels modified directly
+  // (without commands, e.g. by the tool loop) must be notified with
+  // invalidateImage().
+  class CelThumbnails {
+  public:
+    CelThumbnails();
+    ~CelThumbnails();
+
+    // Returns the thumbnail of the given cel fitting in "size", or
+    // nullptr if it isn't ready yet (in that case its generation is
+    // queued).
+    she::Surface* get(Document* document, const doc::Cel* cel,
+                      const gfx::Size& size);
+
+    // Collects the thumbnails generated in background. Returns true
+    // if new thumbnails are ready.
+    bool update();
+
+    bool hasPendingJobs() const { return !m_jobs.empty(); }
+
+    // Removes the thumbnails of cels that use the given image.
+    void invalidateImage(doc::ObjectId imageId);
+
+    // Cancels the pending jobs and removes all thumbnails.
+    void clear();
+
+    // Removes the thumbnails of cels of the given sprite.
+    void clear(const doc::Sprite* sprite);
+
+    // Bytes used by the thumbnails of cels of the given sprite
+    // (surfaces are counted as 32-bit RGBA pixels).
+    std::size_t memSize(const doc::Sprite* sprite) const;
+
+  private:
+    struct Job;
+    typedef std::shared_ptr<Job> JobPtr;
+
+    struct Entry {
+      gfx::Size size;
+      doc::ObjectId imageId;
+      std::vector<int> key;
+      she::Surface* surface;
+      JobPtr job;
+      int lastUse;
+
+      Entry() : imageId(doc::NullId), surface(nullptr), lastUse(0) { }
+      ~Entry();
+
+      DISABLE_COPYING(Entry);
+    };
+
+    typedef std::map<doc::ObjectId, Entry> Entries; // Cel ID -> Entry
+
+    static void getKey(const doc::Cel* cel, std::vector<int>& key);
+    void removeOldEntries();
+
+    Entries m_entries;
+    std::vector<JobPtr> m_jobs;
+    std::vector<int> m_key;
+    int m_time;
+
+    DISABLE_COPYING(CelThumbnails);
+  };
+
+} // namespace app
+
+#endif
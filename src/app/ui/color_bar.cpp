@@ -537,10 +537,8 @@ void ColorBar::onBgColorChangeFromPreferences()
 
 void ColorBar::onFgColorButtonChange(const app::Color& color)
 {
-  if (!m_lock) {
+  if (!m_lock)
     m_paletteView.deselect();
-    m_paletteView.invalidate();
-  }
 
   if (!m_syncingWithPref) {
     base::ScopedValue<bool> sync(m_syncingWithPref, true, false);
@@ -552,10 +550,8 @@ void ColorBar::onFgColorButtonChange(const app::Color& color)
 
 void ColorBar::onBgColorButtonChange(const app::Color& color)
 {
-  if (!m_lock) {
+  if (!m_lock)
     m_paletteView.deselect();
-    m_paletteView.invalidate();
-  }
 
   if (!m_syncingWithPref) {
     base::ScopedValue<bool> sync(m_syncingWithPref, true, false);
@@ -569,13 +565,12 @@ void ColorBar::onColorButtonChange(const app::Color& color)
 {
   if (color.getType() == app::Color::IndexType)
     m_paletteView.selectColor(color.getIndex());
-  else {
+  else
     m_paletteView.selectExactMatchColor(color);
 
-    // As foreground or background color changed, we've to redraw the
-    // palette view fg/bg indicators.
-    m_paletteView.invalidate();
-  }
+  // As foreground or background color changed, we've to redraw the
+  // palette view fg/bg indicators.
+  m_paletteView.invalidateFgBgIndicators();
 }
 
 void ColorBar::onPickSpectrum(const app::Color& color, ui::MouseButtons buttons)
@@ -13,6 +13,14 @@
 #include "app/ui/color_sliders.h"
 #include "base/bind.h"
 #include "app/ui/skin/skin_slider_property.h"
+#include "base/unique_ptr.h"
+#include "doc/conversion_she.h"
+#include "doc/image.h"
+#include "doc/image_traits.h"
+#include "gfx/hsv.h"
+#include "gfx/rgb.h"
+#include "she/surface.h"
+#include "she/system.h"
 #include "ui/box.h"
 #include "ui/entry.h"
 #include "ui/graphics.h"
@@ -20,6 +28,8 @@
 #include "ui/preferred_size_event.h"
 #include "ui/slider.h"
 
+#include <algorithm>
+
 namespace app {
 
 using namespace app::skin;
@@ -29,50 +39,128 @@ using namespace ui;
 namespace {
 
   // This class is used as SkinSliderProperty for RGB/HSV sliders to
-  // draw the background of them.
+  // draw the background of them. The gradient is rendered in a
+  // surface that is regenerated only when the size of the slider or
+  // the other components of the color change.
   class ColorSliderBgPainter : public ISliderBgPainter {
   public:
     ColorSliderBgPainter(ColorSliders::Channel channel)
       : m_channel(channel)
+      , m_surface(nullptr)
+      , m_key1(-1)
+      , m_key2(-1)
     { }
 
+    ~ColorSliderBgPainter() {
+      if (m_surface)
+        m_surface->dispose();
+    }
+
     void setColor(const app::Color& color) {
       m_color = color;
     }
 
     void paint(Slider* slider, Graphics* g, const gfx::Rect& rc) {
-      gfx::Color color = gfx::ColorNone;
-      for (int x=0; x < rc.w; ++x) {
+      if (rc.isEmpty())
+        return;
+
+      // Components of the color that modify the gradient of this channel
+      int key1 = 0, key2 = 0;
+      switch (m_channel) {
+        case ColorSliders::Red:        key1 = m_color.getGreen(); key2 = m_color.getBlue(); break;
+        case ColorSliders::Green:      key1 = m_color.getRed(); key2 = m_color.getBlue(); break;
+        case ColorSliders::Blue:       key1 = m_color.getRed(); key2 = m_color.getGreen(); break;
+        case ColorSliders::Hue:        key1 = m_color.getSaturation(); key2 = m_color.getValue(); break;
+        case ColorSliders::Saturation: key1 = m_color.getHue(); key2 = m_color.getValue(); break;
+        case ColorSliders::Value:      key1 = m_color.getHue(); key2 = m_color.getSaturation(); break;
+        case ColorSliders::Gray:       break;
+      }
+
+      if (!m_surface ||
+          m_surface->width() != rc.w ||
+          m_surface->height() != rc.h ||
+          m_key1 != key1 ||
+          m_key2 != key2) {
+        regenerateSurface(rc.getSize());
+        m_key1 = key1;
+        m_key2 = key2;
+      }
+
+      g->drawSurface(m_surface, rc.x, rc.y);
+    }
+
+  private:
+    void regenerateSurface(const gfx::Size& size) {
+      const int xmax = MAX(1, size.w-1);
+
+      base::UniquePtr<doc::Image> image(
+        doc::Image::create(doc::IMAGE_RGB, size.w, size.h));
+
+      // First row
+      doc::RgbTraits::address_t row =
+        (doc::RgbTraits::address_t)image->getPixelAddress(0, 0);
+
+      for (int x=0; x<size.w; ++x) {
+        int r = 0, g = 0, b = 0;
         switch (m_channel) {
           case ColorSliders::Red:
-            color = gfx::rgba(255 * x / (rc.w-1), m_color.getGreen(), m_color.getBlue());
+            r = 255 * x / xmax;
+            g = m_color.getGreen();
+            b = m_color.getBlue();
             break;
           case ColorSliders::Green:
-            color = gfx::rgba(m_color.getRed(), 255 * x / (rc.w-1), m_color.getBlue());
+            r = m_color.getRed();
+            g = 255 * x / xmax;
+            b = m_color.getBlue();
             break;
           case ColorSliders::Blue:
-            color = gfx::rgba(m_color.getRed(), m_color.getGreen(), 255 * x / (rc.w-1));
+            r = m_color.getRed();
+            g = m_color.getGreen();
+            b = 255 * x / xmax;
             break;
           case ColorSliders::Hue:
-            color = color_utils::color_for_ui(app::Color::fromHsv(360 * x / (rc.w-1), m_color.getSaturation(), m_color.getValue()));
-            break;
           case ColorSliders::Saturation:
-            color = color_utils::color_for_ui(app::Color::fromHsv(m_color.getHue(), 100 * x / (rc.w-1), m_color.getValue()));
-            break;
-          case ColorSliders::Value:
-            color = color_utils::color_for_ui(app::Color::fromHsv(m_color.getHue(), m_color.getSaturation(), 100 * x / (rc.w-1)));
+          case ColorSliders::Value: {
+            int hue = m_color.getHue();
+            int sat = m_color.getSaturation();
+            int val = m_color.getValue();
+            if (m_channel == ColorSliders::Hue)
+              hue = 360 * x / xmax;
+            else if (m_channel == ColorSliders::Saturation)
+              sat = 100 * x / xmax;
+            else
+              val = 100 * x / xmax;
+
+            gfx::Rgb rgb(gfx::Hsv(hue, sat / 100.0, val / 100.0));
+            r = rgb.red();
+            g = rgb.green();
+            b = rgb.blue();
             break;
+          }
           case ColorSliders::Gray:
-            color = color_utils::color_for_ui(app::Color::fromGray(255 * x / (rc.w-1)));
+            r = g = b = 255 * x / xmax;
             break;
         }
-        g->drawVLine(color, rc.x+x, rc.y, rc.h);
+        row[x] = doc::rgba(r, g, b, 255);
       }
+
+      // Other rows are equal to the first one
+      for (int y=1; y<size.h; ++y)
+        std::copy(row, row+size.w,
+                  (doc::RgbTraits::address_t)image->getPixelAddress(0, y));
+
+      if (m_surface)
+        m_surface->dispose();
+
+      m_surface = she::instance()->createSurface(size.w, size.h);
+      doc::convert_image_to_surface(image.get(), nullptr, m_surface,
+                                    0, 0, 0, 0, size.w, size.h);
     }
 
-  private:
     ColorSliders::Channel m_channel;
     app::Color m_color;
+    she::Surface* m_surface;
+    int m_key1, m_key2;
   };
 
 }
@@ -14,6 +14,14 @@
 #include "app/color_utils.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/status_bar.h"
+#include "base/unique_ptr.h"
+#include "doc/conversion_she.h"
+#include "doc/image.h"
+#include "doc/image_traits.h"
+#include "gfx/hsv.h"
+#include "gfx/rgb.h"
+#include "she/surface.h"
+#include "she/system.h"
 #include "ui/graphics.h"
 #include "ui/message.h"
 #include "ui/paint_event.h"
@@ -29,12 +37,16 @@ using namespace ui;
 
 ColorSpectrum::ColorSpectrum()
   : Widget(kGenericWidget)
+  , m_surface(nullptr)
+  , m_surfaceAlign(0)
 {
   setAlign(JI_HORIZONTAL);
 }
 
 ColorSpectrum::~ColorSpectrum()
 {
+  if (m_surface)
+    m_surface->dispose();
 }
 
 app::Color ColorSpectrum::pickColor(const gfx::Point& pos) const
@@ -90,36 +102,54 @@ void ColorSpectrum::onPaint(ui::PaintEvent& ev)
   if (rc.isEmpty())
     return;
 
-  int vmid = (getAlign() & JI_HORIZONTAL ? rc.h/2 : rc.w/2);
-  vmid = MAX(1, vmid);
+  if (!m_surface ||
+      m_surface->width() != rc.w ||
+      m_surface->height() != rc.h ||
+      m_surfaceAlign != getAlign())
+    regenerateSurface(rc.getSize());
 
-  for (int y=0; y<rc.h; ++y) {
-    for (int x=0; x<rc.w; ++x) {
-      int u, v, umax;
-      if (getAlign() & JI_HORIZONTAL) {
-        u = x;
-        v = y;
-        umax = MAX(1, rc.w-1);
-      }
-      else {
-        u = y;
-        v = x;
-        umax = MAX(1, rc.h-1);
-      }
+  g->drawSurface(m_surface, rc.x, rc.y);
+}
+
+// Renders the whole spectrum in an RGB image (the HSV->RGB conversion
+// is done once per pixel) and converts it to a surface in just one
+// step (instead of using Graphics::putPixel() for each pixel).
+void ColorSpectrum::regenerateSurface(const gfx::Size& size)
+{
+  const bool horizontal = (getAlign() & JI_HORIZONTAL ? true: false);
+  const int umax = MAX(1, (horizontal ? size.w: size.h)-1);
+  const int vmid = MAX(1, (horizontal ? size.h/2: size.w/2));
+
+  base::UniquePtr<doc::Image> image(
+    doc::Image::create(doc::IMAGE_RGB, size.w, size.h));
+
+  for (int y=0; y<size.h; ++y) {
+    doc::RgbTraits::address_t dst =
+      (doc::RgbTraits::address_t)image->getPixelAddress(0, y);
 
+    for (int x=0; x<size.w; ++x, ++dst) {
+      int u = (horizontal ? x: y);
+      int v = (horizontal ? y: x);
       int hue = 360 * u / umax;
       int sat = (v < vmid ? 100 * v / vmid : 100);
       int val = (v < vmid ? 100 : 100-(100 * (v-vmid) / vmid));
 
-      gfx::Color color = color_utils::color_for_ui(
-        app::Color::fromHsv(
-          MID(0, hue, 360),
-          MID(0, sat, 100),
-          MID(0, val, 100)));
+      gfx::Rgb rgb(gfx::Hsv(MID(0, hue, 360),
+                            MID(0, sat, 100) / 100.0,
+                            MID(0, val, 100) / 100.0));
 
-      g->putPixel(color, rc.x+x, rc.y+y);
+      *dst = doc::rgba(rgb.red(), rgb.green(), rgb.blue(), 255);
     }
   }
+
+  if (m_surface)
+    m_surface->dispose();
+
+  m_surface = she::instance()->createSurface(size.w, size.h);
+  m_surfaceAlign = getAlign();
+
+  doc::convert_image_to_surface(image.get(), nullptr, m_surface,
+                                0, 0, 0, 0, size.w, size.h);
 }
 
 bool ColorSpectrum::onProcessMessage(ui::Message* msg)
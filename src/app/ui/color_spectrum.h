@@ -14,6 +14,10 @@
 #include "ui/mouse_buttons.h"
 #include "ui/widget.h"
 
+namespace she {
+  class Surface;
+}
+
 namespace app {
 
   class ColorSpectrum : public ui::Widget {
@@ -31,6 +35,14 @@ namespace app {
     void onResize(ui::ResizeEvent& ev) override;
     void onPaint(ui::PaintEvent& ev) override;
     bool onProcessMessage(ui::Message* msg) override;
+
+  private:
+    void regenerateSurface(const gfx::Size& size);
+
+    // Spectrum painted in the last onPaint() (it's regenerated only
+    // when the size or the alignment of the widget changes).
+    she::Surface* m_surface;
+    int m_surfaceAlign;
   };
 
 } // namespace app
@@ -53,6 +53,7 @@ ConfigureTimelinePopup::ConfigureTimelinePopup()
   m_box->opacityStep()->Change.connect(Bind<void>(&ConfigureTimelinePopup::onOpacityStep, this));
   m_box->resetOnionskin()->Click.connect(Bind<void>(&ConfigureTimelinePopup::onResetOnionskin, this));
   m_box->loopTag()->Click.connect(Bind<void>(&ConfigureTimelinePopup::onLoopTagChange, this));
+  m_box->thumbnails()->Click.connect(Bind<void>(&ConfigureTimelinePopup::onThumbnailsChange, this));
 }
 
 app::Document* ConfigureTimelinePopup::doc()
@@ -81,6 +82,7 @@ void ConfigureTimelinePopup::updateWidgetsFromCurrentSettings()
   m_box->opacity()->setValue(docPref.onionskin.opacityBase());
   m_box->opacityStep()->setValue(docPref.onionskin.opacityStep());
   m_box->loopTag()->setSelected(docPref.onionskin.loopTag());
+  m_box->thumbnails()->setSelected(Preferences::instance().timeline.thumbnails());
 
   switch (docPref.onionskin.type()) {
     case app::gen::OnionskinType::MERGE:
@@ -148,4 +150,9 @@ void ConfigureTimelinePopup::onLoopTagChange()
   docPref().onionskin.loopTag(m_box->loopTag()->isSelected());
 }
 
+void ConfigureTimelinePopup::onThumbnailsChange()
+{
+  Preferences::instance().timeline.thumbnails(m_box->thumbnails()->isSelected());
+}
+
 } // namespace app
@@ -11,21 +11,115 @@
 
 #include "app/ui/devconsole_view.h"
 
+#include "app/app.h"
 #include "app/app_menus.h"
+#include "app/document.h"
+#include "app/document_undo.h"
+#include "app/ui/cel_thumbnails.h"
+#include "app/ui/document_view.h"
+#include "app/ui/editor/editor.h"
+#include "app/ui/main_window.h"
+#include "app/ui/timeline.h"
 #include "app/ui/skin/skin_style_property.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/workspace.h"
+#include "app/ui_context.h"
+#include "base/mem_utils.h"
+#include "base/memory.h"
+#include "base/path.h"
+#include "base/tracing.h"
 #include "ui/entry.h"
 #include "ui/message.h"
 #include "ui/system.h"
 #include "ui/textbox.h"
 #include "ui/view.h"
 
+#include <cstdio>
+
 namespace app {
 
 using namespace ui;
 using namespace app::skin;
 
+// Flipped frames when the allocation profiling was started/stopped
+static int64_t alloc_frames_start = 0;
+static int64_t alloc_frames_end = 0;
+
+static int64_t frames_count()
+{
+  base::tracing::counter* frames = base::tracing::counter::find("ui.frames");
+  return (frames ? frames->value(): 0);
+}
+
+static void start_alloc_profiling()
+{
+  if (base::alloc_profiling())
+    return;
+
+  // To count frames
+  base::tracing::add_counters_user();
+
+  base::reset_alloc_stats();
+  alloc_frames_start = frames_count();
+  base::set_alloc_profiling(true);
+}
+
+static void stop_alloc_profiling()
+{
+  if (!base::alloc_profiling())
+    return;
+
+  base::set_alloc_profiling(false);
+  alloc_frames_end = frames_count();
+  base::tracing::remove_counters_user();
+}
+
+static std::string alloc_report()
+{
+  base::alloc_stats stats;
+  base::get_alloc_stats(stats);
+
+  int64_t frames = (base::alloc_profiling() ? frames_count(): alloc_frames_end)
+    - alloc_frames_start;
+
+  std::string text;
+  char buf[256];
+  std::sprintf(buf, "\n  Profiling: %s", (base::alloc_profiling() ? "on": "off"));
+  text += buf;
+  std::sprintf(buf, "\n  Frames: %lld", (long long)frames);
+  text += buf;
+  std::sprintf(buf, "\n  Allocations: %llu (%.1f per frame)",
+               (unsigned long long)stats.count,
+               (frames > 0 ? double(stats.count) / frames: 0.0));
+  text += buf;
+  text += "\n  Allocated: " + base::get_pretty_memory_size(std::size_t(stats.bytes)) +
+    " (" + base::get_pretty_memory_size(std::size_t(frames > 0 ? stats.bytes / frames: 0)) +
+    " per frame)";
+
+  text += "\n  Sizes:";
+  for (int i=0; i<base::kAllocSizeBuckets; ++i) {
+    if (!stats.sizes[i])
+      continue;
+
+    std::size_t limit = base::alloc_size_bucket_limit(i);
+    if (limit)
+      std::sprintf(buf, "\n    <= %d: %llu", int(limit), (unsigned long long)stats.sizes[i]);
+    else
+      std::sprintf(buf, "\n    > %d: %llu",
+                   int(base::alloc_size_bucket_limit(i-1)), (unsigned long long)stats.sizes[i]);
+    text += buf;
+  }
+
+  std::sprintf(buf, "\n  Top call sites (1 of each %d allocations):", base::kAllocSampleRate);
+  text += buf;
+  for (std::size_t i=0; i<stats.call_sites.size() && i<10; ++i) {
+    const base::alloc_call_site& site = stats.call_sites[i];
+    std::sprintf(buf, "\n    %p: %llu (", site.address, (unsigned long long)site.count);
+    text += buf + base::get_pretty_memory_size(std::size_t(site.bytes)) + ")";
+  }
+  return text;
+}
+
 class DevConsoleView::CommmandEntry : public Entry {
 public:
   CommmandEntry() : Entry(256, "") {
@@ -130,7 +224,75 @@ bool DevConsoleView::onProcessMessage(Message* msg)
 
 void DevConsoleView::onExecuteCommand(const std::string& cmd)
 {
-  m_textBox.setText(m_textBox.getText() + "\n" + cmd);
+  std::string text = m_textBox.getText() + "\n" + cmd;
+
+  // Memory used by the undo history of each document
+  if (cmd == "undo") {
+    for (doc::Document* doc : UIContext::instance()->documents()) {
+      text += "\n  " + base::get_file_name(doc->filename()) + ": " +
+        base::get_pretty_memory_size(
+          static_cast<Document*>(doc)->undoHistory()->memSize());
+    }
+    text += "\n  Total: " +
+      base::get_pretty_memory_size(DocumentUndo::totalMemSize());
+  }
+  // Memory used by each document (sprite data, undo history, and
+  // caches of the UI)
+  else if (cmd == "memory") {
+    MainWindow* mainWindow = App::instance()->getMainWindow();
+    Workspace* workspace = mainWindow->getWorkspace();
+    std::size_t total = 0;
+
+    for (doc::Document* doc : UIContext::instance()->documents()) {
+      Document::MemoryUsage usage;
+      static_cast<Document*>(doc)->getMemoryUsage(usage);
+
+      // Render caches of the editors that display this document
+      std::size_t renderCaches = 0;
+      for (WorkspaceView* view : *workspace) {
+        DocumentView* docView = dynamic_cast<DocumentView*>(view);
+        if (docView && docView->getDocument() == doc)
+          renderCaches += docView->getEditor()->renderCachesMemSize();
+      }
+
+      std::size_t thumbnails =
+        mainWindow->getTimeline()->thumbnails().memSize(doc->sprite());
+      std::size_t docTotal = usage.total() + renderCaches + thumbnails;
+      total += docTotal;
+
+      text += "\n  " + base::get_file_name(doc->filename()) + ": " +
+        base::get_pretty_memory_size(docTotal);
+      text += "\n    Cel images: " + base::get_pretty_memory_size(usage.images);
+      text += "\n    Linked images: " + base::get_pretty_memory_size(usage.sharedImages);
+      text += "\n    Palettes: " + base::get_pretty_memory_size(usage.palettes);
+      text += "\n    Masks: " + base::get_pretty_memory_size(usage.masks);
+      text += "\n    Undo: " + base::get_pretty_memory_size(usage.undo);
+      text += "\n    Render caches: " + base::get_pretty_memory_size(renderCaches);
+      text += "\n    Thumbnails: " + base::get_pretty_memory_size(thumbnails);
+      text += "\n    Other: " + base::get_pretty_memory_size(usage.other);
+    }
+
+    std::size_t mipmaps = Editor::mipmapCacheMemSize();
+    text += "\n  Mipmap cache (all editors): " + base::get_pretty_memory_size(mipmaps);
+    text += "\n  Total: " + base::get_pretty_memory_size(total + mipmaps);
+  }
+  // Allocation profiling: "allocs on" resets the counters and starts
+  // counting, "allocs off" stops it, and "allocs" shows the report
+  // (e.g. to know the allocations per frame while painting a stroke
+  // or playing an animation)
+  else if (cmd == "allocs on") {
+    start_alloc_profiling();
+    text += "\n  Allocation profiling started";
+  }
+  else if (cmd == "allocs off") {
+    stop_alloc_profiling();
+    text += alloc_report();
+  }
+  else if (cmd == "allocs") {
+    text += alloc_report();
+  }
+
+  m_textBox.setText(text);
 }
 
 } // namespace app
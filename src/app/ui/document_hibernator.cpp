@@ -0,0 +1,112 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/document_hibernator.h"
+
+#include "app/document.h"
+#include "app/document_undo.h"
+#include "app/pref/preferences.h"
+#include "app/ui/document_view.h"
+#include "app/ui/editor/editor.h"
+#include "app/ui/timeline.h"
+#include "app/ui/workspace.h"
+#include "app/ui_context.h"
+#include "doc/site.h"
+
+namespace app {
+
+static const int kInterval = 60*1000; // One minute
+
+DocumentHibernator::DocumentHibernator(UIContext* context,
+                                       Workspace* workspace,
+                                       Timeline* timeline)
+  : m_context(context)
+  , m_workspace(workspace)
+  , m_timeline(timeline)
+  , m_timer(kInterval)
+{
+  m_context->addObserver(this);
+  m_context->documents().addObserver(this);
+
+  m_timer.Tick.connect(&DocumentHibernator::onTick, this);
+  m_timer.start();
+}
+
+DocumentHibernator::~DocumentHibernator()
+{
+  m_timer.stop();
+  m_context->documents().removeObserver(this);
+  m_context->removeObserver(this);
+}
+
+void DocumentHibernator::onActiveSiteChange(const doc::Site& site)
+{
+  if (site.document())
+    m_states[site.document()] = State();
+}
+
+void DocumentHibernator::onRemoveDocument(doc::Document* document)
+{
+  m_states.erase(document);
+}
+
+void DocumentHibernator::onTick()
+{
+  int minutes = Preferences::instance().general.hibernateDocumentsAfter();
+  doc::Document* active = m_context->activeDocument();
+
+  for (doc::Document* document : m_context->documents()) {
+    State& state = m_states[document];
+    if (document == active) {
+      state = State();
+      continue;
+    }
+
+    ++state.idleMinutes;
+    if (minutes > 0 &&
+        state.idleMinutes >= minutes &&
+        !state.hibernated) {
+      // If the document is locked (e.g. it's being saved) we'll try
+      // again in the next tick
+      state.hibernated = hibernate(static_cast<Document*>(document));
+    }
+  }
+}
+
+bool DocumentHibernator::hibernate(Document* document)
+{
+  if (!document->lock(Document::WriteLock, 0))
+    return false;
+
+  std::size_t undoSize = document->undoHistory()->memSize();
+  try {
+    document->undoHistory()->swapOutAllStates();
+  }
+  catch (...) {
+    // Undo states that cannot be swapped out are kept in memory
+  }
+  document->unlock();
+
+  TRACE("DocumentHibernator: Document '%s' hibernated (undo %d -> %d bytes)\n",
+        document->filename().c_str(),
+        int(undoSize), int(document->undoHistory()->memSize()));
+
+  for (WorkspaceView* view : *m_workspace) {
+    DocumentView* docView = dynamic_cast<DocumentView*>(view);
+    if (docView && docView->getDocument() == document)
+      docView->getEditor()->releaseRenderCaches();
+  }
+
+  m_timeline->thumbnails().clear(document->sprite());
+  return true;
+}
+
+} // namespace app
@@ -0,0 +1,68 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_UI_DOCUMENT_HIBERNATOR_H_INCLUDED
+#define APP_UI_DOCUMENT_HIBERNATOR_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/context_observer.h"
+#include "doc/documents_observer.h"
+#include "ui/timer.h"
+
+#include <map>
+
+namespace app {
+  class Document;
+  class Timeline;
+  class UIContext;
+  class Workspace;
+
+  // Releases the memory of documents that weren't active in the
+  // last "general.hibernate_documents_after" minutes: their undo
+  // history is swapped out (see DocumentUndo::swapOutAllStates()),
+  // and the render caches of their editors and their cel
+  // thumbnails are removed. Nothing else changes in the document,
+  // so it's restored transparently: undo states are read from the
+  // swap file when they are undone/redone, and caches are
+  // recreated when the document is displayed again.
+  class DocumentHibernator : public doc::ContextObserver
+                           , public doc::DocumentsObserver {
+  public:
+    DocumentHibernator(UIContext* context,
+                       Workspace* workspace,
+                       Timeline* timeline);
+    ~DocumentHibernator();
+
+    // doc::ContextObserver impl
+    void onActiveSiteChange(const doc::Site& site) override;
+
+    // doc::DocumentsObserver impl
+    void onRemoveDocument(doc::Document* document) override;
+
+  private:
+    struct State {
+      int idleMinutes;
+      bool hibernated;
+      State() : idleMinutes(0), hibernated(false) { }
+    };
+
+    void onTick();
+    bool hibernate(Document* document);
+
+    UIContext* m_context;
+    Workspace* m_workspace;
+    Timeline* m_timeline;
+    ui::Timer m_timer;
+    std::map<const doc::Document*, State> m_states;
+
+    DISABLE_COPYING(DocumentHibernator);
+  };
+
+} // namespace app
+
+#endif
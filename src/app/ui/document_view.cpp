@@ -377,6 +377,12 @@ void DocumentView::onSpritePixelsModified(doc::DocumentEvent& ev)
     m_editor->drawSpriteClipped(ev.region());
 }
 
+void DocumentView::onExtraCelModified(doc::DocumentEvent& ev)
+{
+  if (m_editor->isVisible())
+    m_editor->drawSpriteClipped(ev.region());
+}
+
 void DocumentView::onLayerMergedDown(doc::DocumentEvent& ev)
 {
   m_editor->setLayer(ev.targetLayer());
@@ -64,6 +64,7 @@ namespace app {
     // DocumentObserver implementation
     void onGeneralUpdate(doc::DocumentEvent& ev) override;
     void onSpritePixelsModified(doc::DocumentEvent& ev) override;
+    void onExtraCelModified(doc::DocumentEvent& ev) override;
     void onLayerMergedDown(doc::DocumentEvent& ev) override;
     void onAddLayer(doc::DocumentEvent& ev) override;
     void onBeforeRemoveLayer(doc::DocumentEvent& ev) override;
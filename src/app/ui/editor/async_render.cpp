@@ -0,0 +1,452 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/async_render.h"
+
+#include "app/document.h"
+#include "base/thread_pool.h"
+#include "base/unique_ptr.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "gfx/clip.h"
+#include "render/render.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace app {
+
+using namespace doc;
+
+// Approximated size of each tile (in screen pixels)
+static const int kTileSize = 256;
+
+// Maximum number of cached tiles (~256 KB each one)
+static const int kMaxTiles = 256;
+
+// Maximum memory used by pre-rendered frames
+static const int kMaxFramesBytes = 64*1024*1024;
+
+static std::vector<AsyncRender*> g_instances;
+static int g_paused = 0;
+
+struct AsyncRender::Job {
+  Document* document;
+  render::Render renderer;
+  const Sprite* sprite;
+  frame_t frame;
+  render::Zoom zoom;
+  gfx::Rect bounds;             // Tile bounds (in zoomed sprite coordinates)
+  std::vector<int> key;
+  TileIndex index;
+  ImageRef image;
+  bool ok;                      // True if the image was rendered
+  std::atomic<bool> obsolete;   // True if the tile was invalidated before rendering it
+  base::task_token_ptr token;
+
+  Job(Document* document,
+      const render::Render& renderer,
+      const Sprite* sprite,
+      frame_t frame,
+      render::Zoom zoom,
+      const gfx::Rect& bounds,
+      const std::vector<int>& key,
+      const TileIndex& index)
+    : document(document)
+    , renderer(renderer)
+    , sprite(sprite)
+    , frame(frame)
+    , zoom(zoom)
+    , bounds(bounds)
+    , key(key)
+    , index(index)
+    , ok(false)
+    , obsolete(false)
+    , token(new base::task_token) {
+    // Background tiles are already rendered in parallel
+    this->renderer.setTiledRendering(false);
+    this->renderer.removeLayersCache();
+    this->renderer.setOnionskinCache(nullptr);
+  }
+
+  // Executed in a worker thread
+  void run() {
+    if (obsolete)
+      return;
+
+    // The document can be in the middle of a modification, we'll
+    // try again in the next paint.
+    if (!document->lock(Document::ReadLock, 0))
+      return;
+
+    try {
+      image.reset(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+      renderer.renderSprite(image.get(), sprite, frame,
+                            gfx::Clip(0, 0, bounds), zoom);
+      ok = true;
+    }
+    catch (...) {
+      // The tile will be rendered again
+    }
+
+    document->unlock();
+  }
+};
+
+AsyncRender::AsyncRender()
+  : m_zoom(1, 1)
+  , m_time(0)
+{
+  g_instances.push_back(this);
+}
+
+AsyncRender::~AsyncRender()
+{
+  cancel();
+
+  auto it = std::find(g_instances.begin(), g_instances.end(), this);
+  ASSERT(it != g_instances.end());
+  if (it != g_instances.end())
+    g_instances.erase(it);
+}
+
+void AsyncRender::render(Document* document,
+                         const render::Render& renderer,
+                         const Sprite* sprite,
+                         frame_t frame,
+                         render::Zoom zoom,
+                         Image* dst,
+                         const gfx::Rect& rc)
+{
+  ASSERT(dst->pixelFormat() == IMAGE_RGB);
+
+  // Tiles of other zoom levels cannot be used as a preview
+  if (m_zoom != zoom) {
+    cancel();
+    clear();
+    m_zoom = zoom;
+  }
+
+  renderer.getRenderKey(sprite, frame, m_key);
+  ++m_time;
+
+  // Each tile is a square of sprite pixels, so tiles are aligned to
+  // the zoomed pixel grid.
+  const int tileSize = MAX(1, zoom.remove(kTileSize));
+  const gfx::Rect spriteBounds = zoom.apply(sprite->bounds());
+  const gfx::Rect spriteRc = zoom.remove(rc);
+
+  int col1 = MAX(0, spriteRc.x / tileSize - 1);
+  int row1 = MAX(0, spriteRc.y / tileSize - 1);
+  int col2 = (spriteRc.x + spriteRc.w) / tileSize + 1;
+  int row2 = (spriteRc.y + spriteRc.h) / tileSize + 1;
+
+  base::thread_pool& pool = base::thread_pool::global();
+
+  for (int row=row1; row<=row2; ++row) {
+    for (int col=col1; col<=col2; ++col) {
+      gfx::Rect tileBounds =
+        zoom.apply(gfx::Rect(col*tileSize, row*tileSize,
+                             tileSize, tileSize))
+        .createIntersection(spriteBounds);
+
+      if (!tileBounds.intersects(rc))
+        continue;
+
+      TileIndex index(col, row);
+      Tile& tile = m_tiles[index];
+      tile.lastUse = m_time;
+
+      if (tile.image && tile.key == m_key) {
+        copy_image(dst, tile.image.get(),
+                   tileBounds.x - rc.x, tileBounds.y - rc.y);
+        continue;
+      }
+
+      // Render the tile in background (if it's not being rendered
+      // with the same key)
+      if (!tile.job || tile.job->key != m_key) {
+        if (tile.job)
+          tile.job->obsolete = true;
+
+        JobPtr job(new Job(document, renderer, sprite, frame, zoom,
+                           tileBounds, m_key, index));
+        tile.job = job;
+        m_jobs.push_back(job);
+        pool.execute([job]{ job->run(); }, job->token);
+      }
+
+      // Show the old version of the tile or a low resolution version
+      // while it's being rendered.
+      if (tile.image)
+        copy_image(dst, tile.image.get(),
+                   tileBounds.x - rc.x, tileBounds.y - rc.y);
+      else
+        renderLowResolution(renderer, sprite, frame, tileBounds, dst, rc);
+    }
+  }
+
+  removeOldTiles();
+}
+
+void AsyncRender::prerenderFrames(Document* document,
+                                  const Sprite* sprite,
+                                  render::Zoom zoom,
+                                  const gfx::Rect& bounds,
+                                  const std::vector<frame_t>& frames,
+                                  const std::vector<render::Render>& renderers)
+{
+  ASSERT(frames.size() == renderers.size());
+
+  // Number of frames that fit in memory
+  int n = int(frames.size());
+  if (!bounds.isEmpty())
+    n = MIN(n, MAX(1, kMaxFramesBytes / (bounds.w*bounds.h*4)));
+
+  // Remove frames that aren't needed anymore
+  for (auto it=m_frames.begin(); it!=m_frames.end(); ) {
+    auto end = frames.begin()+n;
+    if (it->zoom != zoom ||
+        !it->bounds.contains(bounds) ||
+        std::find(frames.begin(), end, it->frame) == end) {
+      if (it->job)
+        it->job->obsolete = true;
+      it = m_frames.erase(it);
+    }
+    else
+      ++it;
+  }
+
+  if (bounds.isEmpty())
+    return;
+
+  base::thread_pool& pool = base::thread_pool::global();
+  std::vector<int> key;
+
+  for (int i=0; i<n; ++i) {
+    renderers[i].getRenderKey(sprite, frames[i], key);
+
+    auto it = std::find_if(m_frames.begin(), m_frames.end(),
+                           [&](const Frame& f){ return f.frame == frames[i]; });
+    if (it == m_frames.end())
+      it = m_frames.insert(m_frames.end(), Frame());
+    else if (it->key == key && (it->image || it->job))
+      continue;                 // It's ready or being rendered
+
+    Frame& f = *it;
+    if (f.job)
+      f.job->obsolete = true;
+
+    f.frame = frames[i];
+    f.zoom = zoom;
+    f.bounds = bounds;
+    f.key = key;
+    f.image.reset();
+    f.job.reset(new Job(document, renderers[i], sprite, frames[i], zoom,
+                        bounds, key, TileIndex(-1, -1)));
+    m_jobs.push_back(f.job);
+
+    JobPtr job = f.job;
+    pool.execute([job]{ job->run(); }, job->token);
+  }
+}
+
+bool AsyncRender::getPrerenderedFrame(const render::Render& renderer,
+                                      const Sprite* sprite,
+                                      frame_t frame,
+                                      render::Zoom zoom,
+                                      Image* dst,
+                                      const gfx::Rect& rc)
+{
+  update();
+
+  for (const Frame& f : m_frames) {
+    if (f.frame == frame && f.image &&
+        f.zoom == zoom && f.bounds.contains(rc)) {
+      std::vector<int> key;
+      renderer.getRenderKey(sprite, frame, key);
+      if (f.key != key)
+        return false;
+
+      copy_image(dst, f.image.get(), f.bounds.x - rc.x, f.bounds.y - rc.y);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AsyncRender::update()
+{
+  bool repaint = false;
+
+  for (auto it=m_jobs.begin(); it!=m_jobs.end(); ) {
+    JobPtr job = *it;
+    if (!job->token->finished()) {
+      ++it;
+      continue;
+    }
+
+    auto frameIt = std::find_if(m_frames.begin(), m_frames.end(),
+                                [&](const Frame& f){ return f.job == job; });
+    if (frameIt != m_frames.end()) {
+      if (job->ok)
+        frameIt->image = job->image;
+      frameIt->job.reset();
+      it = m_jobs.erase(it);
+      continue;
+    }
+
+    auto tileIt = m_tiles.find(job->index);
+    if (tileIt != m_tiles.end() && tileIt->second.job == job) {
+      Tile& tile = tileIt->second;
+      if (job->ok) {
+        tile.image = job->image;
+        tile.key = job->key;
+      }
+      tile.job.reset();
+
+      // When the job fails (the document was locked) the tile is
+      // scheduled again in the next paint.
+      repaint = true;
+    }
+
+    it = m_jobs.erase(it);
+  }
+
+  return repaint;
+}
+
+void AsyncRender::cancel()
+{
+  for (const JobPtr& job : m_jobs)
+    job->token->cancel();
+
+  // Keep the finished tiles
+  update();
+
+  ASSERT(m_jobs.empty());
+}
+
+void AsyncRender::clear()
+{
+  ASSERT(m_jobs.empty());
+  m_tiles.clear();
+}
+
+std::size_t AsyncRender::memSize() const
+{
+  std::size_t size = 0;
+  for (const auto& it : m_tiles)
+    if (it.second.image)
+      size += it.second.image->getMemSize();
+  for (const Frame& frame : m_frames)
+    if (frame.image)
+      size += frame.image->getMemSize();
+  return size;
+}
+
+// static
+void AsyncRender::pause()
+{
+  if (g_paused++ == 0)
+    cancelAll();
+}
+
+// static
+void AsyncRender::resume()
+{
+  ASSERT(g_paused > 0);
+  --g_paused;
+}
+
+// static
+bool AsyncRender::paused()
+{
+  return (g_paused > 0);
+}
+
+// static
+void AsyncRender::cancelAll()
+{
+  for (AsyncRender* instance : g_instances)
+    instance->cancel();
+}
+
+// Renders the tile with 1/4 of its resolution (or less) and
+// stretches the result to the tile bounds.
+void AsyncRender::renderLowResolution(const render::Render& renderer,
+                                      const Sprite* sprite,
+                                      frame_t frame,
+                                      const gfx::Rect& tileBounds,
+                                      Image* dst,
+                                      const gfx::Rect& rc)
+{
+  int scale = 1;
+  while (scale*m_zoom.scale() < 4.0)
+    scale <<= 1;
+
+  render::Zoom lowZoom(1, scale);
+  gfx::Rect spriteBounds = m_zoom.remove(tileBounds);
+  gfx::Rect lowBounds(
+    spriteBounds.x / scale,
+    spriteBounds.y / scale,
+    (spriteBounds.x+spriteBounds.w-1) / scale - spriteBounds.x / scale + 1,
+    (spriteBounds.y+spriteBounds.h-1) / scale - spriteBounds.y / scale + 1);
+
+  base::UniquePtr<Image> low(Image::create(IMAGE_RGB, lowBounds.w, lowBounds.h));
+  render::Render lowRenderer(renderer);
+  lowRenderer.removeLayersCache();
+  lowRenderer.renderSprite(low.get(), sprite, frame,
+                           gfx::Clip(0, 0, lowBounds), lowZoom);
+
+  gfx::Rect area = tileBounds.createIntersection(rc);
+  for (int y=area.y; y<area.y+area.h; ++y) {
+    int v = MID(0, m_zoom.remove(y) / scale - lowBounds.y, lowBounds.h-1);
+    const color_t* src = (const color_t*)low->getPixelAddress(0, v);
+    color_t* dstPtr = (color_t*)dst->getPixelAddress(area.x - rc.x, y - rc.y);
+
+    for (int x=area.x; x<area.x+area.w; ++x, ++dstPtr) {
+      int u = MID(0, m_zoom.remove(x) / scale - lowBounds.x, lowBounds.w-1);
+      *dstPtr = src[u];
+    }
+  }
+}
+
+// Removes the least recently used tiles when there are too many
+void AsyncRender::removeOldTiles()
+{
+  if (int(m_tiles.size()) <= kMaxTiles)
+    return;
+
+  std::vector<int> times;
+  for (const auto& it : m_tiles)
+    if (!it.second.job)
+      times.push_back(it.second.lastUse);
+
+  int remove = int(m_tiles.size()) - kMaxTiles;
+  if (remove > int(times.size()))
+    remove = int(times.size());
+  if (remove == 0)
+    return;
+
+  std::nth_element(times.begin(), times.begin()+remove-1, times.end());
+  int oldest = times[remove-1];
+
+  for (auto it=m_tiles.begin(); it!=m_tiles.end(); ) {
+    if (!it->second.job && it->second.lastUse <= oldest && it->second.lastUse < m_time)
+      it = m_tiles.erase(it);
+    else
+      ++it;
+  }
+}
+
+} // namespace app
@@ -0,0 +1,158 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_UI_EDITOR_ASYNC_RENDER_H_INCLUDED
+#define APP_UI_EDITOR_ASYNC_RENDER_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "gfx/rect.h"
+#include "render/zoom.h"
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace doc {
+  class Image;
+  class Sprite;
+}
+
+namespace render {
+  class Render;
+}
+
+namespace app {
+  class Document;
+
+  // Renders the sprite of an editor in tiles using the background
+  // threads of base::thread_pool::global(). While a tile is being
+  // rendered, the previous version of the tile (or a low resolution
+  // version rendered in the UI thread) is displayed, and the editor
+  // is repainted when update() says that new tiles are ready.
+  //
+  // Background tasks lock the document to read it (without waiting),
+  // so they never see it in the middle of a command. The editor must
+  // call cancel() before the sprite is modified without locking the
+  // document (e.g. before executing a command, or see pause()).
+  class AsyncRender {
+  public:
+    AsyncRender();
+    ~AsyncRender();
+
+    // Fills "dst" with the area "rc" (in zoomed sprite coordinates)
+    // of the given sprite frame, using the settings of "renderer"
+    // (which must be configured for the IMAGE_RGB format).
+    void render(Document* document,
+                const render::Render& renderer,
+                const doc::Sprite* sprite,
+                doc::frame_t frame,
+                render::Zoom zoom,
+                doc::Image* dst,
+                const gfx::Rect& rc);
+
+    // Renders the area "bounds" of the given frames in background
+    // (e.g. the next frames of the animation playback). Each frame
+    // is rendered with the renderer of the same index. Pre-rendered
+    // frames that aren't in the list are removed (so an empty list
+    // removes all of them).
+    void prerenderFrames(Document* document,
+                         const doc::Sprite* sprite,
+                         render::Zoom zoom,
+                         const gfx::Rect& bounds,
+                         const std::vector<doc::frame_t>& frames,
+                         const std::vector<render::Render>& renderers);
+
+    // Fills "dst" with the area "rc" of the given frame if it was
+    // pre-rendered with the same settings of "renderer". Returns
+    // false if the frame isn't ready.
+    bool getPrerenderedFrame(const render::Render& renderer,
+                             const doc::Sprite* sprite,
+                             doc::frame_t frame,
+                             render::Zoom zoom,
+                             doc::Image* dst,
+                             const gfx::Rect& rc);
+
+    // Collects the tiles rendered in background threads. Returns
+    // true if the editor must be repainted to show them.
+    bool update();
+
+    bool hasPendingTiles() const { return !m_jobs.empty(); }
+
+    // Cancels all pending tiles (waiting the ones that are being
+    // rendered right now).
+    void cancel();
+
+    // Removes all cached tiles.
+    void clear();
+
+    // Bytes used by the finished tiles and pre-rendered frames.
+    std::size_t memSize() const;
+
+    // Stops the background rendering of all editors while the sprite
+    // is modified directly from the UI thread (e.g. while the user is
+    // painting with a tool), i.e. render() renders the tiles in the
+    // UI thread. Calls can be nested.
+    static void pause();
+    static void resume();
+    static bool paused();
+
+    // Cancels the pending tiles of all editors.
+    static void cancelAll();
+
+  private:
+    struct Job;
+    typedef std::shared_ptr<Job> JobPtr;
+
+    struct Tile {
+      std::vector<int> key;
+      doc::ImageRef image;
+      JobPtr job;
+      int lastUse;
+
+      Tile() : lastUse(0) { }
+    };
+
+    typedef std::pair<int, int> TileIndex; // Column, row
+    typedef std::map<TileIndex, Tile> Tiles;
+
+    struct Frame {
+      doc::frame_t frame;
+      render::Zoom zoom;
+      gfx::Rect bounds;
+      std::vector<int> key;
+      doc::ImageRef image;
+      JobPtr job;
+
+      Frame() : frame(0), zoom(1, 1) { }
+    };
+
+    void renderLowResolution(const render::Render& renderer,
+                             const doc::Sprite* sprite,
+                             doc::frame_t frame,
+                             const gfx::Rect& tileBounds,
+                             doc::Image* dst,
+                             const gfx::Rect& rc);
+    void removeOldTiles();
+
+    render::Zoom m_zoom;
+    Tiles m_tiles;
+    std::vector<Frame> m_frames;  // Pre-rendered frames
+    std::vector<JobPtr> m_jobs;
+    std::vector<int> m_key;
+    int m_time;
+
+    DISABLE_COPYING(AsyncRender);
+  };
+
+} // namespace app
+
+#endif
@@ -44,6 +44,9 @@
 #include "ui/widget.h"
 
 #include <algorithm>
+#include <list>
+#include <utility>
+#include <vector>
 
 namespace app {
 
@@ -52,13 +55,35 @@ using namespace ui;
 // Returns true if the cursor of the editor needs subpixel movement.
 #define IS_SUBPIXEL(editor)     ((editor)->m_zoom.scale() >= 4.0)
 
-static struct {
-  int nseg;
-  BoundSeg* seg;
+namespace {
+
+typedef std::pair<gfx::Point, gfx::Point> CursorLine;
+
+// Boundaries of one brush to draw the CURSOR_BRUSHBOUNDS cursor
+struct CursorBoundary {
   int brush_gen;
   int brush_width;
   int brush_height;
-} cursor_bound = { 0, nullptr, 0, 0, 0 };
+  std::vector<BoundSeg> segs;
+
+  // Segments converted to lines in screen pixels (relative to the
+  // brush position in the screen) for the "zoom" level. Only for
+  // integer zoom levels (when the zoom of a sprite position is the
+  // sum of the zoom of its parts).
+  render::Zoom zoom;
+  std::vector<CursorLine> lines;
+
+  CursorBoundary() : zoom(1, 1) { }
+};
+
+} // anonymous namespace
+
+// Boundaries of the last used brushes (the most recently used at the
+// front), so switching between a few brushes doesn't recalculate
+// them each time.
+static const std::size_t kMaxCursorBoundaries = 4;
+static std::list<CursorBoundary> cursor_boundaries;
+static CursorBoundary* cursor_bound = nullptr;
 
 enum {
   CURSOR_THINCROSS   = 1,
@@ -79,6 +104,10 @@ static gfx::Region old_clipping_region;
 
 static gfx::Rect lastBrushBounds;
 
+// Area of the old brush preview that must be repainted with the new
+// one (see Editor::moveBrushPreview())
+static gfx::Region pendingBrushRegion;
+
 static void generate_cursor_boundaries();
 
 static void trace_thincross_pixels(ui::Graphics* g, Editor* editor, const gfx::Point& pt, gfx::Color color, Editor::PixelDelegate pixel);
@@ -123,8 +152,8 @@ void Editor::initEditorCursor()
 
 void Editor::exitEditorCursor()
 {
-  if (cursor_bound.seg)
-    base_free(cursor_bound.seg);
+  cursor_bound = nullptr;
+  cursor_boundaries.clear();
 }
 
 // Draws the brush cursor in the specified absolute mouse position
@@ -225,9 +254,19 @@ void Editor::drawBrushPreview(const gfx::Point& pos)
       delete loop;
     }
 
-    m_document->notifySpritePixelsModified(
-      m_sprite,
-      gfx::Region(lastBrushBounds = brushBounds));
+    lastBrushBounds = brushBounds;
+    pendingBrushRegion.createUnion(pendingBrushRegion, gfx::Region(brushBounds));
+  }
+  // The old brush preview isn't needed anymore
+  else if (!pendingBrushRegion.isEmpty()) {
+    m_document->destroyExtraCel();
+  }
+
+  // Repaint the old and the new brush preview areas at the same time
+  // (before the cursor is drawn over them)
+  if (!pendingBrushRegion.isEmpty()) {
+    m_document->notifyExtraCelModified(m_sprite, pendingBrushRegion.simplify());
+    pendingBrushRegion.clear();
   }
 
   // Save area and draw the cursor
@@ -251,8 +290,9 @@ void Editor::drawBrushPreview(const gfx::Point& pos)
 //
 // The mouse position is got from the last call to drawBrushPreview()
 // (m_cursorEditor). So you must to use this routine only if you
-// called drawBrushPreview() before.
-void Editor::clearBrushPreview()
+// called drawBrushPreview() before. If "refresh" is false, the
+// brush preview is kept until the next drawBrushPreview() call.
+void Editor::clearBrushPreview(bool refresh)
 {
   ASSERT(m_cursorOnScreen);
   ASSERT(m_sprite);
@@ -271,9 +311,13 @@ void Editor::clearBrushPreview()
 
   // Clean pixel/brush preview
   if (cursor_type & CURSOR_THINCROSS && m_state->requireBrushPreview()) {
-    m_document->destroyExtraCel();
-    m_document->notifySpritePixelsModified(
-      m_sprite, gfx::Region(lastBrushBounds));
+    if (refresh) {
+      m_document->destroyExtraCel();
+      m_document->notifyExtraCelModified(
+        m_sprite, gfx::Region(lastBrushBounds));
+    }
+    else
+      pendingBrushRegion.createUnion(pendingBrushRegion, gfx::Region(lastBrushBounds));
   }
 
   m_cursorOnScreen = false;
@@ -282,6 +326,16 @@ void Editor::clearBrushPreview()
   old_clipping_region.clear();
 }
 
+// Moves the brush cursor to the given position. It's like
+// clearBrushPreview() + drawBrushPreview(), but the extra cel is
+// reused and the old and the new areas of the brush preview are
+// repainted at the same time.
+void Editor::moveBrushPreview(const gfx::Point& pos)
+{
+  clearBrushPreview(false);
+  drawBrushPreview(pos);
+}
+
 // Returns true if the cursor to draw in the editor has subpixel
 // movement (a little pixel of the screen that indicates where is the
 // mouse inside the pixel of the sprite).
@@ -296,18 +350,18 @@ static void generate_cursor_boundaries()
 {
   Brush* brush = get_current_brush();
 
-  if (cursor_bound.seg &&
-      cursor_bound.brush_gen == brush->gen())
-    return;
+  for (auto it=cursor_boundaries.begin(); it!=cursor_boundaries.end(); ++it) {
+    if (it->brush_gen == brush->gen()) {
+      cursor_boundaries.splice(cursor_boundaries.begin(), cursor_boundaries, it);
+      cursor_bound = &cursor_boundaries.front();
+      return;
+    }
+  }
 
   Image* brush_image = brush->image();
   int w = brush_image->width();
   int h = brush_image->height();
 
-  cursor_bound.brush_gen = brush->gen();
-  cursor_bound.brush_width = w;
-  cursor_bound.brush_height = h;
-
   ImageRef mask;
   if (brush_image->pixelFormat() != IMAGE_BITMAP) {
     mask.reset(Image::create(IMAGE_BITMAP, w, h));
@@ -322,10 +376,24 @@ static void generate_cursor_boundaries()
     }
   }
 
-  cursor_bound.seg = find_mask_boundary(
+  int nseg = 0;
+  BoundSeg* seg = find_mask_boundary(
     (mask ? mask.get(): brush_image),
-    &cursor_bound.nseg,
+    &nseg,
     IgnoreBounds, 0, 0, 0, 0);
+
+  cursor_boundaries.push_front(CursorBoundary());
+  cursor_bound = &cursor_boundaries.front();
+  cursor_bound->brush_gen = brush->gen();
+  cursor_bound->brush_width = w;
+  cursor_bound->brush_height = h;
+  if (seg) {
+    cursor_bound->segs.assign(seg, seg+nseg);
+    base_free(seg);
+  }
+
+  if (cursor_boundaries.size() > kMaxCursorBoundaries)
+    cursor_boundaries.pop_back();
 }
 
 void Editor::forEachBrushPixel(
@@ -429,50 +497,76 @@ static void algo_line_proxy(int x, int y, void* _data)
   data->pixelDelegate(data->g, gfx::Point(x, y), data->color);
 }
 
+// Moves the end points of a segment converted to screen pixels so
+// the line is drawn outside (or inside) the brush pixels.
+static void adjust_segment_points(const BoundSeg& seg, gfx::Point& pt1, gfx::Point& pt2)
+{
+  if (seg.open) {               // Outside
+    if (pt1.x == pt2.x) {
+      pt1.x--;
+      pt2.x--;
+      pt2.y--;
+    }
+    else {
+      pt1.y--;
+      pt2.y--;
+      pt2.x--;
+    }
+  }
+  else {
+    if (pt1.x == pt2.x) {
+      pt2.y--;
+    }
+    else {
+      pt2.x--;
+    }
+  }
+}
+
 static void trace_brush_bounds(ui::Graphics* g, Editor* editor,
   gfx::Point pos, gfx::Color color, Editor::PixelDelegate pixelDelegate)
 {
+  if (!cursor_bound)
+    return;
+
   Data data = { g, color, pixelDelegate };
+  const render::Zoom& zoom = editor->zoom();
+  const gfx::Point origin = editor->editorToScreen(gfx::Point(0, 0));
   gfx::Point pt1, pt2;
-  BoundSeg* seg;
-  int c;
 
-  pos.x -= cursor_bound.brush_width/2;
-  pos.y -= cursor_bound.brush_height/2;
-
-  for (c=0; c<cursor_bound.nseg; c++) {
-    seg = cursor_bound.seg+c;
-
-    pt1.x = pos.x + seg->x1;
-    pt1.y = pos.y + seg->y1;
-    pt2.x = pos.x + seg->x2;
-    pt2.y = pos.y + seg->y2;
-
-    pt1 = editor->editorToScreen(pt1);
-    pt2 = editor->editorToScreen(pt2);
-
-    if (seg->open) {            // Outside
-      if (pt1.x == pt2.x) {
-        pt1.x--;
-        pt2.x--;
-        pt2.y--;
-      }
-      else {
-        pt1.y--;
-        pt2.y--;
-        pt2.x--;
-      }
-    }
-    else {
-      if (pt1.x == pt2.x) {
-        pt2.y--;
-      }
-      else {
-        pt2.x--;
+  pos.x -= cursor_bound->brush_width/2;
+  pos.y -= cursor_bound->brush_height/2;
+
+  // With integer zoom levels the lines are converted to screen pixels
+  // one time, and then they are just translated to the cursor
+  // position.
+  const double scale = zoom.scale();
+  if (scale >= 1.0 && scale == double(int(scale))) {
+    if (cursor_bound->zoom != zoom || cursor_bound->lines.size() != cursor_bound->segs.size()) {
+      cursor_bound->zoom = zoom;
+      cursor_bound->lines.clear();
+      for (const BoundSeg& seg : cursor_bound->segs) {
+        pt1 = gfx::Point(zoom.apply(seg.x1), zoom.apply(seg.y1));
+        pt2 = gfx::Point(zoom.apply(seg.x2), zoom.apply(seg.y2));
+        adjust_segment_points(seg, pt1, pt2);
+        cursor_bound->lines.push_back(CursorLine(pt1, pt2));
       }
     }
 
-    doc::algo_line(pt1.x, pt1.y, pt2.x, pt2.y, (void*)&data, algo_line_proxy);
+    gfx::Point base = origin + gfx::Point(zoom.apply(pos.x), zoom.apply(pos.y));
+    for (const CursorLine& line : cursor_bound->lines) {
+      pt1 = base + line.first;
+      pt2 = base + line.second;
+      doc::algo_line(pt1.x, pt1.y, pt2.x, pt2.y, (void*)&data, algo_line_proxy);
+    }
+  }
+  else {
+    for (const BoundSeg& seg : cursor_bound->segs) {
+      pt1 = origin + gfx::Point(zoom.apply(pos.x + seg.x1), zoom.apply(pos.y + seg.y1));
+      pt2 = origin + gfx::Point(zoom.apply(pos.x + seg.x2), zoom.apply(pos.y + seg.y2));
+      adjust_segment_points(seg, pt1, pt2);
+      doc::algo_line(pt1.x, pt1.y, pt2.x, pt2.y, (void*)&data, algo_line_proxy);
+    }
   }
 }
 
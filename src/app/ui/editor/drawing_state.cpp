@@ -24,6 +24,7 @@
 #include "app/ui/keyboard_shortcuts.h"
 #include "app/ui_context.h"
 #include "doc/blend.h"
+#include "ui/manager.h"
 #include "ui/message.h"
 #include "ui/system.h"
 
@@ -53,10 +54,13 @@ static tools::ToolLoopManager::Pointer pointer_from_msg(MouseMessage* msg)
 }
 
 DrawingState::DrawingState(tools::ToolLoop* toolLoop)
-  : m_toolLoop(toolLoop)
+  : m_editor(NULL)
+  , m_toolLoop(toolLoop)
   , m_toolLoopManager(new tools::ToolLoopManager(toolLoop))
   , m_mouseMoveReceived(false)
+  , m_movementTimer(tools::ToolLoopManager::kMinStepInterval)
 {
+  m_movementTimer.Tick.connect(&DrawingState::onMovementTick, this);
 }
 
 DrawingState::~DrawingState()
@@ -68,6 +72,7 @@ void DrawingState::initToolLoop(Editor* editor, MouseMessage* msg)
 {
   HideShowDrawingCursor hideShow(editor);
 
+  m_editor = editor;
   m_toolLoopManager->prepareLoop(pointer_from_msg(msg));
   m_toolLoopManager->pressButton(pointer_from_msg(msg));
 
@@ -145,6 +150,17 @@ bool DrawingState::onMouseMove(Editor* editor, MouseMessage* msg)
     ->movement(tools::ToolLoopManager::Pointer(mousePos.x, mousePos.y,
                                                button_from_msg(msg)));
 
+  // The stroke is painted as soon as possible (without waiting the
+  // next frame of the UI manager)
+  editor->getManager()->requestImmediatePaint();
+
+  if (m_toolLoopManager->hasPendingMovement()) {
+    if (!m_movementTimer.isRunning())
+      m_movementTimer.start();
+  }
+  else
+    m_movementTimer.stop();
+
   return true;
 }
 
@@ -198,8 +214,21 @@ void DrawingState::onExposeSpritePixels(const gfx::Region& rgn)
     m_toolLoop->validateDstImage(rgn);
 }
 
+void DrawingState::onMovementTick()
+{
+  m_movementTimer.stop();
+
+  if (m_toolLoopManager && m_toolLoopManager->hasPendingMovement()) {
+    HideShowDrawingCursor hideShow(m_editor);
+    m_toolLoopManager->flushMovement();
+    m_editor->getManager()->requestImmediatePaint();
+  }
+}
+
 void DrawingState::destroyLoop()
 {
+  m_movementTimer.stop();
+
   if (m_toolLoop)
     m_toolLoop->dispose();
 
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/ui/editor/standby_state.h"
+#include "ui/timer.h"
 
 namespace app {
   namespace tools {
@@ -21,6 +22,7 @@ namespace app {
   public:
     DrawingState(tools::ToolLoop* loop);
     virtual ~DrawingState();
+    virtual bool allowBackgroundRendering() const override { return false; }
     virtual bool onMouseDown(Editor* editor, ui::MouseMessage* msg) override;
     virtual bool onMouseUp(Editor* editor, ui::MouseMessage* msg) override;
     virtual bool onMouseMove(Editor* editor, ui::MouseMessage* msg) override;
@@ -38,6 +40,10 @@ namespace app {
 
   private:
     void destroyLoop();
+    void onMovementTick();
+
+    // Editor where we are drawing.
+    Editor* m_editor;
 
     // The tool-loop.
     tools::ToolLoop* m_toolLoop;
@@ -49,6 +55,10 @@ namespace app {
     // cancel selection tool (deselect) when the user click (press and
     // release the mouse button in the same location).
     bool m_mouseMoveReceived;
+
+    // Draws the last mouse movements when the mouse stops (see
+    // ToolLoopManager::hasPendingMovement()).
+    ui::Timer m_movementTimer;
   };
 
 } // namespace app
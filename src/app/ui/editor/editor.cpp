@@ -31,6 +31,7 @@
 #include "app/ui/editor/editor_customization_delegate.h"
 #include "app/ui/editor/editor_decorator.h"
 #include "app/ui/editor/moving_pixels_state.h"
+#include "app/ui/editor/performance_hud.h"
 #include "app/ui/editor/pixels_movement.h"
 #include "app/ui/editor/play_state.h"
 #include "app/ui/editor/scoped_cursor.h"
@@ -43,10 +44,12 @@
 #include "app/util/boundary.h"
 #include "base/bind.h"
 #include "base/convert_to.h"
+#include "base/tracing.h"
 #include "base/unique_ptr.h"
 #include "doc/conversion_she.h"
 #include "doc/doc.h"
 #include "doc/document_event.h"
+#include "she/scoped_surface_lock.h"
 #include "she/surface.h"
 #include "she/system.h"
 #include "ui/ui.h"
@@ -60,6 +63,10 @@ using namespace gfx;
 using namespace ui;
 using namespace render;
 
+// Counters used by the performance HUD
+static base::tracing::counter paints_counter("editor.paints");
+static base::tracing::counter paint_time_counter("editor.paint_time");
+
 class EditorPreRenderImpl : public EditorPreRender {
 public:
   EditorPreRenderImpl(Editor* editor, Image* image, const Point& offset, Zoom zoom)
@@ -120,6 +127,15 @@ public:
     m_g->drawLine(screenColor, a, b);
   }
 
+  void fillClientRect(const gfx::Rect& rc, gfx::Color color) override {
+    m_g->fillRect(color, rc);
+  }
+
+  void drawClientText(const std::string& text, const gfx::Point& pt,
+                      gfx::Color fg, gfx::Color bg) override {
+    m_g->drawString(text, fg, bg, pt);
+  }
+
   void drawRectXor(const gfx::Rect& rc) override {
     gfx::Rect rc2 = m_editor->editorToScreen(rc);
     gfx::Rect bounds = m_editor->getBounds();
@@ -137,10 +153,16 @@ private:
 };
 
 // static
-doc::ImageBufferPtr Editor::m_renderBuffer;
+doc::ImageBufferPool Editor::m_renderBuffers(4);
+
+// static
+const Layer* Editor::m_previewLayer = nullptr;
+frame_t Editor::m_previewFrame = frame_t(0);
+Image* Editor::m_previewImage = nullptr;
 
 // static
-AppRender Editor::m_renderEngine;
+render::MipmapCache Editor::m_mipmapCache;
+render::ContentCache Editor::m_contentCache;
 
 Editor::Editor(Document* document, EditorFlags flags)
   : Widget(editor_type())
@@ -165,12 +187,17 @@ Editor::Editor(Document* document, EditorFlags flags)
   , m_flags(flags)
   , m_secondaryButton(false)
   , m_aniSpeed(1.0)
+  , m_asyncRenderTimer(30, this)
+  , m_asyncRenderPaused(false)
 {
   // Add the first state into the history.
   m_statesHistory.push(m_state);
 
   this->setFocusStop(true);
 
+  // The preferred size depends on the zoom and the viewport
+  disableSizeCache();
+
   m_currentToolChangeConn =
     Preferences::instance().toolBox.activeTool.AfterChange.connect(
       Bind<void>(&Editor::onCurrentToolChange, this));
@@ -186,16 +213,37 @@ Editor::Editor(Document* document, EditorFlags flags)
   m_pixelGridConn = docPref.pixelGrid.AfterChange.connect(Bind<void>(&Editor::invalidate, this));
   m_onionskinConn = docPref.onionskin.AfterChange.connect(Bind<void>(&Editor::invalidate, this));
 
+  // Background renders cannot read the sprite while a command is
+  // modifying it.
+  m_beforeCmdConn = UIContext::instance()->BeforeCommandExecution.connect(
+    &Editor::onBeforeCommandExecution, this);
+
+  m_perfHudConn =
+    Preferences::instance().experimental.performanceHud.AfterChange.connect(
+      Bind<void>(&Editor::onPerformanceHudChange, this));
+  onPerformanceHudChange();
+
   m_document->addObserver(this);
+  m_document->addObserver(&m_layersCache);
 
   m_state->onEnterState(this);
 }
 
 Editor::~Editor()
 {
+  m_asyncRenderTimer.stop();
+  m_asyncRender.cancel();
+  if (m_asyncRenderPaused)
+    AsyncRender::resume();
+
   m_observers.notifyDestroyEditor(this);
+  m_document->removeObserver(&m_layersCache);
   m_document->removeObserver(this);
 
+  // Levels of the images of this document are not needed anymore
+  // (other editors re-create their levels lazily).
+  m_mipmapCache.clear();
+
   setCustomizationDelegate(NULL);
 
   m_mask_timer.stop();
@@ -203,7 +251,7 @@ Editor::~Editor()
 
 void Editor::destroyEditorSharedInternals()
 {
-  m_renderBuffer.reset();
+  m_renderBuffers.clear();
   exitEditorCursor();
 }
 
@@ -247,6 +295,17 @@ void Editor::setStateInternal(const EditorStatePtr& newState)
 
   ASSERT(m_state);
 
+  // Stop the background rendering of all editors if the new state
+  // modifies the sprite directly.
+  bool pauseAsyncRender = !m_state->allowBackgroundRendering();
+  if (m_asyncRenderPaused != pauseAsyncRender) {
+    if (pauseAsyncRender)
+      AsyncRender::pause();
+    else
+      AsyncRender::resume();
+    m_asyncRenderPaused = pauseAsyncRender;
+  }
+
   // Change to the new state.
   m_state->onEnterState(this);
 
@@ -365,41 +424,117 @@ void Editor::updateEditor()
   View::getView(this)->updateView();
 }
 
-void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw, int dx, int dy)
+void Editor::drawSpriteCopiesUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw,
+                                           const gfx::Point* offsets, int ncopies)
 {
-  // Clip from sprite and apply zoom
-  gfx::Rect rc = m_sprite->bounds().createIntersection(spriteRectToDraw);
-  rc = m_zoom.apply(rc);
+  TRACE_ZONE("Editor::drawSpriteCopiesUnclippedRect");
 
-  int dest_x = dx + m_offset_x + rc.x;
-  int dest_y = dy + m_offset_y + rc.y;
+  // Clip from sprite and apply zoom
+  gfx::Rect zoomedRc = m_sprite->bounds().createIntersection(spriteRectToDraw);
+  zoomedRc = m_zoom.apply(zoomedRc);
 
-  // Clip from graphics/screen
+  // Visible part of each copy (in the zoomed sprite) and its
+  // position in the graphics
   const gfx::Rect& clip = g->getClipBounds();
-  if (dest_x < clip.x) {
-    rc.x += clip.x - dest_x;
-    rc.w -= clip.x - dest_x;
-    dest_x = clip.x;
-  }
-  if (dest_y < clip.y) {
-    rc.y += clip.y - dest_y;
-    rc.h -= clip.y - dest_y;
-    dest_y = clip.y;
-  }
-  if (dest_x+rc.w > clip.x+clip.w) {
-    rc.w = clip.x+clip.w-dest_x;
-  }
-  if (dest_y+rc.h > clip.y+clip.h) {
-    rc.h = clip.y+clip.h-dest_y;
+  std::vector<gfx::Rect> copyRcs;
+  std::vector<gfx::Point> copyDests;
+  gfx::Rect rc;
+  int copiesArea = 0;
+
+  for (int i=0; i<ncopies; ++i) {
+    gfx::Rect copyRc = zoomedRc;
+    int dest_x = offsets[i].x + m_offset_x + copyRc.x;
+    int dest_y = offsets[i].y + m_offset_y + copyRc.y;
+
+    // Clip from graphics/screen
+    if (dest_x < clip.x) {
+      copyRc.x += clip.x - dest_x;
+      copyRc.w -= clip.x - dest_x;
+      dest_x = clip.x;
+    }
+    if (dest_y < clip.y) {
+      copyRc.y += clip.y - dest_y;
+      copyRc.h -= clip.y - dest_y;
+      dest_y = clip.y;
+    }
+    if (dest_x+copyRc.w > clip.x+clip.w) {
+      copyRc.w = clip.x+clip.w-dest_x;
+    }
+    if (dest_y+copyRc.h > clip.y+clip.h) {
+      copyRc.h = clip.y+clip.h-dest_y;
+    }
+
+    if (copyRc.isEmpty())
+      continue;
+
+    copyRcs.push_back(copyRc);
+    copyDests.push_back(gfx::Point(dest_x, dest_y));
+    copiesArea += copyRc.w * copyRc.h;
+    rc |= copyRc;
   }
 
-  if (rc.isEmpty())
+  if (copyRcs.empty())
+    return;
+
+  // The sprite is rendered once for all copies (e.g. in tiled mode)
+  // when the copies show the same part of the sprite. If they show
+  // different parts (e.g. corners of the sprite around the
+  // intersection of four copies), each copy is rendered separately
+  // to avoid rendering pixels that aren't visible.
+  if (copyRcs.size() > 1 && rc.w * rc.h > copiesArea) {
+    for (std::size_t i=0; i<copyRcs.size(); ++i)
+      drawSpriteRenderedRect(g, copyRcs[i], &copyRcs[i], &copyDests[i], 1);
     return;
+  }
+
+  drawSpriteRenderedRect(g, rc, &copyRcs[0], &copyDests[0], int(copyRcs.size()));
+}
 
+// Renders the "rc" area of the zoomed sprite one time, and draws the
+// "copyRcs" parts of it (included in "rc") in the "copyDests"
+// positions of the graphics.
+void Editor::drawSpriteRenderedRect(ui::Graphics* g, const gfx::Rect& rc,
+                                    const gfx::Rect* copyRcs,
+                                    const gfx::Point* copyDests, int ncopies)
+{
   // Generate the rendered image
-  if (!m_renderBuffer)
-    m_renderBuffer.reset(new doc::ImageBuffer());
+  ImageBufferPtr renderBuffer = m_renderBuffers.get();
+
+  // Render tiles in background threads (showing a preview of the
+  // missing tiles) if the sprite isn't being modified.
+  bool asyncRender =
+    (!isPlaying() &&
+     Preferences::instance().experimental.asyncRender() &&
+     m_state->allowBackgroundRendering() &&
+     !AsyncRender::paused() &&
+     m_document->getExtraCelType() == render::ExtraType::NONE);
+
+  // If the display is GPU accelerated, zoomed-in views are rendered
+  // at 100% (sprite pixels) and the GPU scales them to the screen
+  // (only when the checked background is zoomed with the sprite, so
+  // we get the same result).
+  gfx::Rect spriteRc = rc;
+  bool gpuZoom =
+    (!isPlaying() && !asyncRender &&
+     m_zoom.scale() > 1.0 &&
+     (int(she::instance()->capabilities()) & int(she::kGpuAccelerationCapability)) &&
+     Preferences::instance().document(m_document).bg.zoom());
+  if (gpuZoom) {
+    spriteRc = gfx::Rect(
+      gfx::Point(m_zoom.remove(rc.x), m_zoom.remove(rc.y)),
+      gfx::Point(m_zoom.remove(rc.x+rc.w-1)+1, m_zoom.remove(rc.y+rc.h-1)+1));
+  }
+
+  // Surface where the sprite is rendered to be drawn in the screen
+  static she::Surface* tmp;
+  if (!tmp || tmp->width() < spriteRc.w || tmp->height() < spriteRc.h) {
+    if (tmp)
+      tmp->dispose();
+
+    tmp = she::instance()->createRgbaSurface(spriteRc.w, spriteRc.h);
+  }
 
+  base::UniquePtr<she::ScopedSurfaceLock> tmpLock;
   base::UniquePtr<Image> rendered(NULL);
   try {
     // Generate a "expose sprite pixels" notification. This is used by
@@ -424,36 +559,20 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
       m_document->notifyExposeSpritePixels(m_sprite, gfx::Region(expose));
     }
 
-    // Create a temporary RGB bitmap to draw all to it
-    rendered.reset(Image::create(IMAGE_RGB, rc.w, rc.h, m_renderBuffer));
-    m_renderEngine.setupBackground(m_document, rendered->pixelFormat());
-    m_renderEngine.disableOnionskin();
-
-    if ((m_flags & kShowOnionskin) == kShowOnionskin) {
-      DocumentPreferences& docPref = Preferences::instance()
-        .document(m_document);
-
-      if (docPref.onionskin.active()) {
-        OnionskinOptions opts(
-          (docPref.onionskin.type() == app::gen::OnionskinType::MERGE ?
-           render::OnionskinType::MERGE:
-           (docPref.onionskin.type() == app::gen::OnionskinType::RED_BLUE_TINT ?
-            render::OnionskinType::RED_BLUE_TINT:
-            render::OnionskinType::NONE)));
-
-        opts.prevFrames(docPref.onionskin.prevFrames());
-        opts.nextFrames(docPref.onionskin.nextFrames());
-        opts.opacityBase(docPref.onionskin.opacityBase());
-        opts.opacityStep(docPref.onionskin.opacityStep());
-
-        FrameTag* tag = nullptr;
-        if (docPref.onionskin.loopTag())
-          tag = m_sprite->frameTags().innerTag(m_frame);
-        opts.loopTag(tag);
-
-        m_renderEngine.setOnionskin(opts);
-      }
+    // Render directly in the surface memory if it has the same
+    // format as RGB images (so the rendered image doesn't need to be
+    // converted), in other case we create a temporary RGB bitmap to
+    // draw all to it.
+    if (tmp->nativeHandle()) {
+      tmpLock.reset(new she::ScopedSurfaceLock(tmp));
+      rendered.reset(create_image_from_surface(*tmpLock,
+          gfx::Rect(0, 0, spriteRc.w, spriteRc.h)));
+      if (!rendered)
+        tmpLock.reset();
     }
+    if (!rendered)
+      rendered.reset(Image::create(IMAGE_RGB, spriteRc.w, spriteRc.h, renderBuffer));
+    setupRenderEngine(m_renderEngine, m_frame);
 
     if (m_document->getExtraCelType() != render::ExtraType::NONE) {
       ASSERT(m_document->getExtraCel());
@@ -466,8 +585,30 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
         m_layer, m_frame);
     }
 
-    m_renderEngine.renderSprite(rendered, m_sprite, m_frame,
-      gfx::Clip(0, 0, rc), m_zoom);
+    m_renderEngine.setMipmapCache(&m_mipmapCache);
+    m_renderEngine.setContentCache(&m_contentCache);
+
+    // Use the frame pre-rendered by the animation playback
+    if (isPlaying() &&
+        m_asyncRender.getPrerenderedFrame(m_renderEngine, m_sprite, m_frame,
+                                          m_zoom, rendered, rc)) {
+      // Done
+    }
+    else if (asyncRender) {
+      m_asyncRender.render(m_document, m_renderEngine, m_sprite, m_frame,
+                           m_zoom, rendered, rc);
+
+      if (m_asyncRender.hasPendingTiles() && !m_asyncRenderTimer.isRunning())
+        m_asyncRenderTimer.start();
+    }
+    else {
+      m_renderEngine.setLayersCache(&m_layersCache, m_layer);
+      m_renderEngine.setOnionskinCache(&m_onionskinCache);
+      m_renderEngine.renderSprite(rendered, m_sprite, m_frame,
+        gfx::Clip(0, 0, spriteRc), (gpuZoom ? render::Zoom(1, 1): m_zoom));
+      m_renderEngine.setOnionskinCache(nullptr);
+      m_renderEngine.removeLayersCache();
+    }
 
     m_renderEngine.removeExtraImage();
   }
@@ -479,28 +620,118 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     // Pre-render decorator.
     if ((m_flags & kShowDecorators) && m_decorator) {
       EditorPreRenderImpl preRender(this, rendered,
-        Point(-rc.x, -rc.y), m_zoom);
+        Point(-spriteRc.x, -spriteRc.y),
+        (gpuZoom ? render::Zoom(1, 1): m_zoom));
       m_decorator->preRenderDecorator(&preRender);
     }
 
-    // Convert the render to a she::Surface
-    static she::Surface* tmp;
-    if (!tmp || tmp->width() < rc.w || tmp->height() < rc.h) {
-      if (tmp)
-        tmp->dispose();
-
-      tmp = she::instance()->createRgbaSurface(rc.w, rc.h);
+    // Convert the render to a she::Surface (if it wasn't rendered
+    // in the surface memory)
+    if (tmpLock) {
+      rendered.reset();
+      tmpLock.reset();
+    }
+    else if (tmp->nativeHandle()) {
+      convert_image_to_surface(rendered, m_sprite->palette(m_frame),
+        tmp, 0, 0, 0, 0, spriteRc.w, spriteRc.h);
     }
 
     if (tmp->nativeHandle()) {
-      convert_image_to_surface(rendered, m_sprite->palette(m_frame),
-        tmp, 0, 0, 0, 0, rc.w, rc.h);
 
-      g->blit(tmp, 0, 0, dest_x, dest_y, rc.w, rc.h);
+      for (int i=0; i<ncopies; ++i) {
+        const gfx::Rect& copyRc = copyRcs[i];
+        const gfx::Point& dest = copyDests[i];
+
+        if (gpuZoom) {
+          IntersectClip clip(g, gfx::Rect(dest, copyRc.getSize()));
+          if (clip) {
+            g->drawScaledSurface(tmp,
+              gfx::Rect(0, 0, spriteRc.w, spriteRc.h),
+              m_zoom.apply(spriteRc).offset(dest.x - copyRc.x, dest.y - copyRc.y));
+          }
+        }
+        else
+          g->blit(tmp, copyRc.x - rc.x, copyRc.y - rc.y,
+                  dest.x, dest.y, copyRc.w, copyRc.h);
+      }
     }
   }
 }
 
+// Configures the given render engine to draw the sprite frame in an
+// IMAGE_RGB image with the settings of this editor.
+void Editor::setupRenderEngine(AppRender& renderEngine, frame_t frame)
+{
+  renderEngine.setupBackground(m_document, IMAGE_RGB);
+  renderEngine.disableOnionskin();
+
+  if (m_previewImage)
+    renderEngine.setPreviewImage(m_previewLayer, m_previewFrame, m_previewImage);
+  else
+    renderEngine.removePreviewImage();
+
+  if ((m_flags & kShowOnionskin) == kShowOnionskin) {
+    DocumentPreferences& docPref = Preferences::instance()
+      .document(m_document);
+
+    if (docPref.onionskin.active()) {
+      OnionskinOptions opts(
+        (docPref.onionskin.type() == app::gen::OnionskinType::MERGE ?
+         render::OnionskinType::MERGE:
+         (docPref.onionskin.type() == app::gen::OnionskinType::RED_BLUE_TINT ?
+          render::OnionskinType::RED_BLUE_TINT:
+          render::OnionskinType::NONE)));
+
+      opts.prevFrames(docPref.onionskin.prevFrames());
+      opts.nextFrames(docPref.onionskin.nextFrames());
+      opts.opacityBase(docPref.onionskin.opacityBase());
+      opts.opacityStep(docPref.onionskin.opacityStep());
+
+      FrameTag* tag = nullptr;
+      if (docPref.onionskin.loopTag())
+        tag = m_sprite->frameTags().innerTag(frame);
+      opts.loopTag(tag);
+
+      renderEngine.setOnionskin(opts);
+    }
+  }
+}
+
+void Editor::prerenderFrames(const std::vector<frame_t>& frames)
+{
+  std::vector<frame_t> framesToRender;
+  std::vector<render::Render> renderers;
+  gfx::Rect bounds;
+
+  // Frames cannot be rendered in background while the sprite is
+  // being modified (e.g. the user paints in other editor)
+  if (!frames.empty() && !AsyncRender::paused()) {
+    // The area of the sprite that can be painted in the viewport
+    // (with an extra sprite pixel because of the zoomed out
+    // rendering, see drawSpriteUnclippedRect())
+    gfx::Rect visible = getVisibleSpriteBounds();
+    visible.enlarge(1);
+    bounds = m_zoom.apply(visible).createIntersection(
+      m_zoom.apply(m_sprite->bounds()));
+
+    for (frame_t frame : frames) {
+      AppRender renderEngine;
+      setupRenderEngine(renderEngine, frame);
+      renderEngine.setMipmapCache(&m_mipmapCache);
+      renderEngine.setContentCache(&m_contentCache);
+
+      framesToRender.push_back(frame);
+      renderers.push_back(renderEngine);
+    }
+  }
+
+  m_asyncRender.prerenderFrames(m_document, m_sprite, m_zoom, bounds,
+                                framesToRender, renderers);
+
+  if (m_asyncRender.hasPendingTiles() && !m_asyncRenderTimer.isRunning())
+    m_asyncRenderTimer.start();
+}
+
 void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
 {
   gfx::Rect rc = _rc;
@@ -517,9 +748,6 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
     m_zoom.apply(m_sprite->height()));
   gfx::Rect enclosingRect = spriteRect;
 
-  // Draw the main sprite at the center.
-  drawOneSpriteUnclippedRect(g, rc, 0, 0);
-
   gfx::Region outside(client);
   outside.createSubtraction(outside, gfx::Region(spriteRect));
 
@@ -527,27 +755,31 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
   DocumentPreferences& docPref =
       Preferences::instance().document(m_document);
 
+  // The main sprite at the center and its copies in tiled mode
+  std::vector<gfx::Point> copies;
+  copies.push_back(gfx::Point(0, 0));
+
   if (int(docPref.tiled.mode()) & int(filters::TiledMode::X_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, -spriteRect.w, 0);
-    drawOneSpriteUnclippedRect(g, rc, +spriteRect.w, 0);
+    copies.push_back(gfx::Point(-spriteRect.w, 0));
+    copies.push_back(gfx::Point(+spriteRect.w, 0));
 
     enclosingRect = gfx::Rect(spriteRect.x-spriteRect.w, spriteRect.y, spriteRect.w*3, spriteRect.h);
     outside.createSubtraction(outside, gfx::Region(enclosingRect));
   }
 
   if (int(docPref.tiled.mode()) & int(filters::TiledMode::Y_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, 0, -spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, 0, +spriteRect.h);
+    copies.push_back(gfx::Point(0, -spriteRect.h));
+    copies.push_back(gfx::Point(0, +spriteRect.h));
 
     enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y-spriteRect.h, spriteRect.w, spriteRect.h*3);
     outside.createSubtraction(outside, gfx::Region(enclosingRect));
   }
 
   if (docPref.tiled.mode() == filters::TiledMode::BOTH) {
-    drawOneSpriteUnclippedRect(g, rc, -spriteRect.w, -spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, +spriteRect.w, -spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, -spriteRect.w, +spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, +spriteRect.w, +spriteRect.h);
+    copies.push_back(gfx::Point(-spriteRect.w, -spriteRect.h));
+    copies.push_back(gfx::Point(+spriteRect.w, -spriteRect.h));
+    copies.push_back(gfx::Point(-spriteRect.w, +spriteRect.h));
+    copies.push_back(gfx::Point(+spriteRect.w, +spriteRect.h));
 
     enclosingRect = gfx::Rect(
       spriteRect.x-spriteRect.w,
@@ -555,6 +787,9 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
     outside.createSubtraction(outside, gfx::Region(enclosingRect));
   }
 
+  // Render the sprite once for all copies
+  drawSpriteCopiesUnclippedRect(g, rc, &copies[0], int(copies.size()));
+
   // Fill the outside (parts of the editor that aren't covered by the
   // sprite).
   SkinTheme* theme = static_cast<SkinTheme*>(this->getTheme());
@@ -622,6 +857,12 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
     EditorPostRenderImpl postRender(this, g);
     m_decorator->postRenderDecorator(&postRender);
   }
+
+  // Performance overlay (above everything)
+  if ((m_flags & kShowDecorators) && m_perfHud) {
+    EditorPostRenderImpl postRender(this, g);
+    m_perfHud->postRenderDecorator(&postRender);
+  }
 }
 
 void Editor::drawSpriteClipped(const gfx::Region& updateRegion)
@@ -632,6 +873,9 @@ void Editor::drawSpriteClipped(const gfx::Region& updateRegion)
   ScreenGraphics screenGraphics;
   GraphicsPtr editorGraphics = getGraphics(getClientBounds());
 
+  TRACE_ZONE_COUNTER("Editor::drawSpriteClipped", paint_time_counter);
+  paints_counter.add(1);
+
   for (const Rect& updateRect : updateRegion) {
     for (const Rect& screenRect : screenRegion) {
       IntersectClip clip(&screenGraphics, screenRect);
@@ -660,9 +904,16 @@ void Editor::drawMask(Graphics* g)
   int nseg = m_document->getBoundariesSegmentsCount();
   const BoundSeg* seg = m_document->getBoundariesSegments();
 
-  for (int c=0; c<nseg; ++c, ++seg) {
-    CheckedDrawMode checked(g, m_offset_count);
+  // Segments outside the clipping area are skipped (drawMaskSafe()
+  // calls this function for each rectangle of the drawable region)
+  gfx::Rect clip = g->getClipBounds();
+  if (clip.isEmpty())
+    return;
+  clip.offset(-x, -y);
+
+  CheckedDrawMode checked(g, m_offset_count);
 
+  for (int c=0; c<nseg; ++c, ++seg) {
     x1 = m_zoom.apply(seg->x1);
     y1 = m_zoom.apply(seg->y1);
     x2 = m_zoom.apply(seg->x2);
@@ -694,6 +945,10 @@ void Editor::drawMask(Graphics* g)
       }
     }
 
+    if (MAX(x1, x2) < clip.x || MIN(x1, x2) >= clip.x2() ||
+        MAX(y1, y2) < clip.y || MIN(y1, y2) >= clip.y2())
+      continue;
+
     // The color doesn't matter, we are using CheckedDrawMode
     g->drawLine(gfx::rgba(0, 0, 0),
       gfx::Point(x+x1, y+y1), gfx::Point(x+x2, y+y2));
@@ -735,6 +990,16 @@ void Editor::drawMaskSafe()
   }
 }
 
+// Returns the position of the first grid line >= "pos", where lines
+// are located at "origin + k*size".
+static int first_grid_line(int origin, int size, int pos)
+{
+  int mod = (pos - origin) % size;
+  if (mod < 0)
+    mod += size;
+  return (mod == 0 ? pos: pos + size - mod);
+}
+
 void Editor::drawGrid(Graphics* g, const gfx::Rect& spriteBounds, const Rect& gridBounds, const app::Color& color, int alpha)
 {
   if ((m_flags & kShowGrid) == 0)
@@ -764,9 +1029,6 @@ void Editor::drawGrid(Graphics* g, const gfx::Rect& spriteBounds, const Rect& gr
   gfx::Rect bounds = getBounds();
   grid.offset(-bounds.getOrigin());
 
-  while (grid.x-grid.w >= spriteBounds.x) grid.x -= grid.w;
-  while (grid.y-grid.h >= spriteBounds.y) grid.y -= grid.h;
-
   // Get the grid's color
   gfx::Color grid_color = color_utils::color_for_ui(color);
   grid_color = gfx::rgba(
@@ -774,21 +1036,27 @@ void Editor::drawGrid(Graphics* g, const gfx::Rect& spriteBounds, const Rect& gr
     gfx::getg(grid_color),
     gfx::getb(grid_color), alpha);
 
-  // Draw horizontal lines
-  int x1 = spriteBounds.x;
-  int y1 = grid.y;
-  int x2 = spriteBounds.x + spriteBounds.w;
-  int y2 = spriteBounds.y + spriteBounds.h;
+  // Only the lines inside the clipping bounds are drawn (e.g. when
+  // the editor is scrolled, or a small part of the sprite is
+  // modified, just a few rows/columns of the grid are painted again).
+  const gfx::Rect clip = g->getClipBounds();
+  const gfx::Rect area = spriteBounds.createIntersection(clip);
+  if (area.isEmpty())
+    return;
+
+  // Draw horizontal lines (the last one can be spriteBounds.y2())
+  int y1 = first_grid_line(grid.y, grid.h, area.y);
+  int y2 = MIN(spriteBounds.y2(), clip.y2()-1);
 
   for (int c=y1; c<=y2; c+=grid.h)
-    g->drawHLine(grid_color, x1, c, spriteBounds.w);
+    g->drawHLine(grid_color, area.x, c, area.w);
 
   // Draw vertical lines
-  x1 = grid.x;
-  y1 = spriteBounds.y;
+  int x1 = first_grid_line(grid.x, grid.w, area.x);
+  int x2 = MIN(spriteBounds.x2(), clip.x2()-1);
 
   for (int c=x1; c<=x2; c+=grid.w)
-    g->drawVLine(grid_color, c, y1, spriteBounds.h);
+    g->drawVLine(grid_color, c, area.y, area.h);
 }
 
 void Editor::flashCurrentLayer()
@@ -801,7 +1069,7 @@ void Editor::flashCurrentLayer()
   int x, y;
   const Image* src_image = site.image(&x, &y);
   if (src_image) {
-    m_renderEngine.removePreviewImage();
+    removePreviewImage();
 
     m_document->prepareExtraCel(m_sprite->bounds(), 255);
     m_document->setExtraCelType(render::ExtraType::COMPOSITE);
@@ -1050,8 +1318,7 @@ void Editor::moveDrawingCursor()
     // the mouse just moves).
     if (m_cursorScreen != mousePos) {
       ui::hide_mouse_cursor();
-      clearBrushPreview();
-      drawBrushPreview(mousePos);
+      moveBrushPreview(mousePos);
       ui::show_mouse_cursor();
     }
   }
@@ -1224,6 +1491,14 @@ bool Editor::onProcessMessage(Message* msg)
           m_mask_timer.stop();
         }
       }
+      else if (static_cast<TimerMessage*>(msg)->timer() == &m_asyncRenderTimer) {
+        // Repaint the editor to show the new tiles
+        if (m_asyncRender.update())
+          invalidate();
+
+        if (!m_asyncRender.hasPendingTiles())
+          m_asyncRenderTimer.stop();
+      }
       break;
 
     case kMouseEnterMessage:
@@ -1381,6 +1656,12 @@ void Editor::onPaint(ui::PaintEvent& ev)
   }
   // Editor with sprite
   else {
+    // Repaints of the performance overlay only aren't counted
+    bool hudOnly = (m_perfHud && m_perfHud->bounds().contains(g->getClipBounds()));
+    base::tracing::zone zone("Editor::onPaint", (hudOnly ? nullptr: &paint_time_counter));
+    if (!hudOnly)
+      paints_counter.add(1);
+
     try {
       // Lock the sprite to read/render it.
       DocumentReader documentReader(m_document, 0);
@@ -1439,6 +1720,26 @@ void Editor::onBrushSizeOrAngleChange()
   }
 }
 
+void Editor::onBeforeCommandExecution(Command* command)
+{
+  m_asyncRender.cancel();
+}
+
+void Editor::onPerformanceHudChange()
+{
+  bool state = ((m_flags & kShowDecorators) &&
+                Preferences::instance().experimental.performanceHud());
+  if (state == (m_perfHud != nullptr))
+    return;
+
+  if (state)
+    m_perfHud.reset(new PerformanceHud(this));
+  else
+    m_perfHud.reset(nullptr);
+
+  invalidate();
+}
+
 void Editor::onExposeSpritePixels(doc::DocumentEvent& ev)
 {
   if (m_state && ev.sprite() == m_sprite)
@@ -1521,7 +1822,7 @@ void Editor::setZoomAndCenterInMouse(Zoom zoom,
   }
 }
 
-void Editor::pasteImage(const Image* image, const gfx::Point& pos)
+void Editor::pasteImage(const ImageRef& image, const gfx::Point& pos)
 {
   // Change to a selection tool: it's necessary for PixelsMovement
   // which will use the extra cel for transformation preview, and is
@@ -1560,7 +1861,7 @@ void Editor::pasteImage(const Image* image, const gfx::Point& pos)
       getSite(), image, gfx::Point(x, y), opacity, "Paste"));
 
   // Select the pasted image so the user can move it and transform it.
-  pixelsMovement->maskImage(image);
+  pixelsMovement->maskImage(image.get());
 
   setState(EditorStatePtr(new MovingPixelsState(this, NULL, pixelsMovement, NoHandle)));
 }
@@ -1633,7 +1934,44 @@ void Editor::setAnimationSpeedMultiplier(double speed)
 // static
 ImageBufferPtr Editor::getRenderImageBuffer()
 {
-  return m_renderBuffer;
+  return m_renderBuffers.get();
+}
+
+// static
+void Editor::setPreviewImage(const Layer* layer, frame_t frame, Image* image)
+{
+  m_previewLayer = layer;
+  m_previewFrame = frame;
+  m_previewImage = image;
+}
+
+// static
+void Editor::removePreviewImage()
+{
+  m_previewLayer = nullptr;
+  m_previewFrame = frame_t(0);
+  m_previewImage = nullptr;
+}
+
+std::size_t Editor::renderCachesMemSize() const
+{
+  return (m_layersCache.memSize() +
+          m_onionskinCache.memSize() +
+          m_asyncRender.memSize());
+}
+
+void Editor::releaseRenderCaches()
+{
+  m_layersCache.clear();
+  m_onionskinCache.clear();
+  m_asyncRender.cancel();
+  m_asyncRender.clear();
+}
+
+// static
+std::size_t Editor::mipmapCacheMemSize()
+{
+  return m_mipmapCache.bytes();
 }
 
 } // namespace app
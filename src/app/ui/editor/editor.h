@@ -13,15 +13,23 @@
 #include "app/color.h"
 #include "app/document.h"
 #include "app/tools/selection_mode.h"
+#include "app/ui/editor/async_render.h"
 #include "app/ui/editor/editor_observers.h"
 #include "app/ui/editor/editor_state.h"
 #include "app/ui/editor/editor_states_history.h"
 #include "base/connection.h"
+#include "base/unique_ptr.h"
 #include "doc/document_observer.h"
 #include "doc/frame.h"
 #include "doc/image_buffer.h"
+#include "doc/image_buffer_pool.h"
+#include "doc/image_ref.h"
 #include "filters/tiled_mode.h"
 #include "gfx/fwd.h"
+#include "render/content_cache.h"
+#include "render/layers_cache.h"
+#include "render/mipmap_cache.h"
+#include "render/onionskin_cache.h"
 #include "render/zoom.h"
 #include "ui/base.h"
 #include "ui/timer.h"
@@ -41,9 +49,11 @@ namespace ui {
 }
 
 namespace app {
+  class Command;
   class Context;
   class DocumentView;
   class EditorCustomizationDelegate;
+  class PerformanceHud;
   class PixelsMovement;
 
   namespace tools {
@@ -183,7 +193,7 @@ namespace app {
     void setZoomAndCenterInMouse(render::Zoom zoom,
       const gfx::Point& mousePos, ZoomBehavior zoomBehavior);
 
-    void pasteImage(const Image* image, const gfx::Point& pos);
+    void pasteImage(const ImageRef& image, const gfx::Point& pos);
 
     void startSelectionTransformation(const gfx::Point& move);
 
@@ -196,16 +206,37 @@ namespace app {
     void stop();
     bool isPlaying() const;
 
+    // Renders the given frames in background threads to display
+    // them without delays in the animation playback (see PlayState).
+    // An empty list removes the pre-rendered frames.
+    void prerenderFrames(const std::vector<frame_t>& frames);
+
     // Shows a popup menu to change the editor animation speed.
     void showAnimationSpeedMultiplierPopup();
     double getAnimationSpeedMultiplier() const;
     void setAnimationSpeedMultiplier(double speed);
 
-    // Returns the buffer used to render editor viewports.
-    // E.g. It can be re-used by PreviewCommand
+    // Returns a buffer (that isn't being used) of the pool used to
+    // render editor viewports. E.g. It can be re-used by
+    // PreviewCommand
     static ImageBufferPtr getRenderImageBuffer();
 
-    static AppRender& renderEngine() { return m_renderEngine; }
+    // Sets the image used by all editors to render the given
+    // layer/frame (e.g. the destination image of the tool loop
+    // while the user paints, see render::Render::setPreviewImage()).
+    static void setPreviewImage(const Layer* layer, frame_t frame, Image* image);
+    static void removePreviewImage();
+
+    // Bytes used by the render caches of this editor (layers below
+    // the active one, onion skin frames, and background tiles).
+    std::size_t renderCachesMemSize() const;
+
+    // Removes the images of the render caches (they are recreated
+    // in the next paint).
+    void releaseRenderCaches();
+
+    // Bytes used by the mipmap cache (shared by all editors).
+    static std::size_t mipmapCacheMemSize();
 
     // in cursor.cpp
 
@@ -220,6 +251,8 @@ namespace app {
     void onFgColorChange();
     void onBrushSizeOrAngleChange();
     void onExposeSpritePixels(doc::DocumentEvent& ev);
+    void onBeforeCommandExecution(Command* command);
+    void onPerformanceHudChange();
 
   private:
     static void exitEditorCursor();
@@ -227,7 +260,8 @@ namespace app {
     void updateQuicktool();
     void updateContextBarFromModifiers();
     void drawBrushPreview(const gfx::Point& pos);
-    void clearBrushPreview();
+    void clearBrushPreview(bool refresh = true);
+    void moveBrushPreview(const gfx::Point& pos);
     bool doesBrushPreviewNeedSubpixel();
     bool isCurrentToolAffectedByRightClickMode();
 
@@ -245,10 +279,16 @@ namespace app {
       gfx::Color color,
       PixelDelegate pixelDelegate);
 
-    // Draws the specified portion of sprite in the editor.  Warning:
-    // You should setup the clip of the screen before calling this
-    // routine.
-    void drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc, int dx, int dy);
+    // Draws the specified portion of sprite in the editor, and its
+    // copies displaced by "offsets" in the screen (in tiled mode),
+    // rendering the sprite just one time.  Warning: You should setup
+    // the clip of the screen before calling this routine.
+    void drawSpriteCopiesUnclippedRect(ui::Graphics* g, const gfx::Rect& rc,
+                                       const gfx::Point* offsets, int ncopies);
+    void drawSpriteRenderedRect(ui::Graphics* g, const gfx::Rect& rc,
+                                const gfx::Rect* copyRcs,
+                                const gfx::Point* copyDests, int ncopies);
+    void setupRenderEngine(AppRender& renderEngine, frame_t frame);
 
     // Stack of states. The top element in the stack is the current state (m_state).
     EditorStatesHistory m_statesHistory;
@@ -319,8 +359,48 @@ namespace app {
     // Animation speed multiplier.
     double m_aniSpeed;
 
-    static doc::ImageBufferPtr m_renderBuffer;
-    static AppRender m_renderEngine;
+    // Layers below the active layer composited to repaint the
+    // editor faster while the user paints.
+    render::LayersCache m_layersCache;
+
+    // Neighboring frames composited to draw the onion skin.
+    render::OnionskinCache m_onionskinCache;
+
+    // Tiles of the sprite rendered in background threads (when the
+    // "experimental.async_render" option is enabled). The timer
+    // repaints the editor when new tiles are ready.
+    AsyncRender m_asyncRender;
+    ui::Timer m_asyncRenderTimer;
+    ScopedConnection m_beforeCmdConn;
+
+    // True if this editor paused the background rendering of all
+    // editors (see EditorState::allowBackgroundRendering()).
+    bool m_asyncRenderPaused;
+
+    // Overlay with render statistics (when the
+    // "experimental.performance_hud" option is enabled).
+    base::UniquePtr<PerformanceHud> m_perfHud;
+    ScopedConnection m_perfHudConn;
+
+    // Each editor has its own render engine, so the settings of
+    // one editor don't affect the others (e.g. the background or
+    // the onion skin of the preview window).
+    AppRender m_renderEngine;
+
+    // Buffers to render editor viewports (shared by all editors).
+    static doc::ImageBufferPool m_renderBuffers;
+
+    // Preview image used by all editors (see setPreviewImage())
+    static const Layer* m_previewLayer;
+    static frame_t m_previewFrame;
+    static Image* m_previewImage;
+
+    // Reduced cel images to render zoomed out editors (shared by all
+    // editors, e.g. the preview window).
+    static render::MipmapCache m_mipmapCache;
+
+    // Content bounds of cel images (shared by all editors)
+    static render::ContentCache m_contentCache;
   };
 
   ui::WidgetType editor_type();
@@ -10,8 +10,11 @@
 #pragma once
 
 #include "gfx/color.h"
+#include "gfx/point.h"
 #include "gfx/rect.h"
 
+#include <string>
+
 namespace doc {
   class Image;
 }
@@ -39,6 +42,12 @@ namespace app {
     virtual Editor* getEditor() = 0;
     virtual void drawLine(int x1, int y1, int x2, int y2, gfx::Color screenColor) = 0;
     virtual void drawRectXor(const gfx::Rect& rc) = 0;
+
+    // These functions use editor client coordinates (instead of
+    // sprite coordinates).
+    virtual void fillClientRect(const gfx::Rect& rc, gfx::Color color) = 0;
+    virtual void drawClientText(const std::string& text, const gfx::Point& pt,
+                                gfx::Color fg, gfx::Color bg) = 0;
   };
 
   // Used by editor's states to pre- and post-render customized
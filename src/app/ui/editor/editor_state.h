@@ -49,6 +49,12 @@ namespace app {
     // this state doesn't go to other state than the previous one.
     virtual bool isTemporalState() const { return false; }
 
+    // Returns true if the sprite can be rendered in background
+    // threads while this state is active, i.e. the state doesn't
+    // modify the sprite without locking the document (like the
+    // drawing state does while the user paints).
+    virtual bool allowBackgroundRendering() const { return false; }
+
     // Called just before this state is replaced by a new state in the
     // Editor::setState() method.  Returns true if this state should be
     // kept in the EditorStatesHistory.
@@ -28,6 +28,7 @@ namespace app {
     virtual bool onUpdateStatusBar(Editor* editor) override;
 
     virtual bool requireBrushPreview() override { return false; }
+    virtual bool allowBackgroundRendering() const override { return false; }
 
   private:
     Cel* m_cel;
@@ -16,6 +16,7 @@ namespace app {
   class NavigateState : public StateWithWheelBehavior {
   public:
     NavigateState();
+    virtual bool allowBackgroundRendering() const override { return true; }
     virtual bool onMouseDown(Editor* editor, ui::MouseMessage* msg) override;
     virtual bool onMouseUp(Editor* editor, ui::MouseMessage* msg) override;
     virtual bool onMouseMove(Editor* editor, ui::MouseMessage* msg) override;
@@ -0,0 +1,192 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/performance_hud.h"
+
+#include "app/document.h"
+#include "app/document_undo.h"
+#include "app/ui/editor/editor.h"
+#include "base/memory.h"
+#include "gfx/color.h"
+#include "she/font.h"
+#include "ui/theme.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace app {
+
+static const int kInterval = 500; // In milliseconds
+
+// Names of base::tracing counters (in the same order of the enum)
+static const char* kCounterNames[] = {
+  "editor.paints",
+  "editor.paint_time",
+  "render.layers",
+  "render.pixels",
+  "render.layers_cache.hits",
+  "render.layers_cache.misses",
+  "render.onionskin_cache.hits",
+  "render.onionskin_cache.misses",
+  "render.mipmap_cache.hits",
+  "render.mipmap_cache.misses",
+  "render.content_cache.hits",
+  "render.content_cache.misses",
+};
+
+static std::string hit_rate(int64_t hits, int64_t misses)
+{
+  if (hits+misses == 0)
+    return "-";
+
+  char buf[32];
+  std::sprintf(buf, "%d%%", int(100 * hits / (hits+misses)));
+  return buf;
+}
+
+PerformanceHud::PerformanceHud(Editor* editor)
+  : m_editor(editor)
+  , m_timer(kInterval)
+  , m_lastAllocs(base::alloc_count())
+{
+  static_assert(sizeof(kCounterNames)/sizeof(kCounterNames[0]) == Counters,
+                "Invalid number of counter names");
+
+  for (int i=0; i<Counters; ++i)
+    m_counters[i] = base::tracing::counter::find(kCounterNames[i]);
+
+  base::tracing::add_counters_user();
+  sampleCounters(m_lastValues);
+
+  m_timer.Tick.connect(&PerformanceHud::onTick, this);
+  m_timer.start();
+
+  onTick();
+}
+
+PerformanceHud::~PerformanceHud()
+{
+  m_timer.stop();
+  base::tracing::remove_counters_user();
+}
+
+gfx::Rect PerformanceHud::bounds() const
+{
+  she::Font* font = m_editor->getFont();
+  const int border = 2*ui::guiscale();
+
+  int w = 0;
+  for (const std::string& line : m_lines)
+    w = std::max(w, font->textLength(line));
+
+  gfx::Rect client = m_editor->getClientBounds();
+  return gfx::Rect(client.x, client.y,
+                   w + 2*border,
+                   font->height()*int(m_lines.size()) + 2*border);
+}
+
+void PerformanceHud::preRenderDecorator(EditorPreRender* render)
+{
+  // Do nothing
+}
+
+void PerformanceHud::postRenderDecorator(EditorPostRender* render)
+{
+  she::Font* font = m_editor->getFont();
+  const int border = 2*ui::guiscale();
+  const gfx::Color bg = gfx::rgba(0, 0, 0);
+  const gfx::Color fg = gfx::rgba(255, 255, 0);
+  gfx::Rect rc = bounds();
+
+  render->fillClientRect(rc, bg);
+
+  gfx::Point pt(rc.x+border, rc.y+border);
+  for (const std::string& line : m_lines) {
+    render->drawClientText(line, pt, fg, bg);
+    pt.y += font->height();
+  }
+}
+
+void PerformanceHud::sampleCounters(int64_t values[Counters]) const
+{
+  for (int i=0; i<Counters; ++i)
+    values[i] = (m_counters[i] ? m_counters[i]->value(): 0);
+}
+
+void PerformanceHud::onTick()
+{
+  int64_t values[Counters];
+  int64_t delta[Counters];
+  sampleCounters(values);
+  for (int i=0; i<Counters; ++i) {
+    delta[i] = values[i] - m_lastValues[i];
+    m_lastValues[i] = values[i];
+  }
+
+  uint64_t allocs = base::alloc_count();
+  uint64_t deltaAllocs = (allocs >= m_lastAllocs ? allocs - m_lastAllocs: allocs); // Stats were reset
+  m_lastAllocs = allocs;
+
+  double seconds = m_chrono.elapsed();
+  m_chrono.reset();
+
+  std::vector<std::string> lines;
+  char buf[256];
+  const int64_t paints = delta[Paints];
+
+  std::sprintf(buf, "FPS: %.1f", (seconds > 0.0 ? paints / seconds: 0.0));
+  lines.push_back(buf);
+
+  if (paints > 0) {
+    std::sprintf(buf, "Paint: %.2f ms", delta[PaintTime] / 1000.0 / paints);
+    lines.push_back(buf);
+    std::sprintf(buf, "Layers: %.1f", double(delta[Layers]) / paints);
+    lines.push_back(buf);
+    std::sprintf(buf, "Pixels: %.1fK", delta[Pixels] / 1000.0 / paints);
+    lines.push_back(buf);
+  }
+  else {
+    lines.push_back("Paint: -");
+    lines.push_back("Layers: -");
+    lines.push_back("Pixels: -");
+  }
+
+  lines.push_back("Layers cache: " + hit_rate(delta[LayersCacheHits], delta[LayersCacheMisses]));
+  lines.push_back("Onion skin cache: " + hit_rate(delta[OnionskinCacheHits], delta[OnionskinCacheMisses]));
+  lines.push_back("Mipmap cache: " + hit_rate(delta[MipmapCacheHits], delta[MipmapCacheMisses]));
+  lines.push_back("Content cache: " + hit_rate(delta[ContentCacheHits], delta[ContentCacheMisses]));
+
+  if (base::alloc_profiling()) {
+    if (paints > 0)
+      std::sprintf(buf, "Allocs: %.1f", double(deltaAllocs) / paints);
+    else
+      std::sprintf(buf, "Allocs: -");
+    lines.push_back(buf);
+  }
+
+  Document* doc = m_editor->document();
+  std::sprintf(buf, "Undo: %.2f MB",
+               (doc ? doc->undoHistory()->memSize() / (1024.0*1024.0): 0.0));
+  lines.push_back(buf);
+
+  if (lines == m_lines)
+    return;
+
+  // Invalidate the old and the new bounds (in screen coordinates)
+  gfx::Point origin = m_editor->getBounds().getOrigin();
+  gfx::Rect oldBounds = bounds();
+  m_lines = lines;
+  gfx::Rect newBounds = bounds();
+
+  m_editor->invalidateRect(oldBounds.createUnion(newBounds).offset(origin));
+}
+
+} // namespace app
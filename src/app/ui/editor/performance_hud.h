@@ -0,0 +1,77 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_UI_EDITOR_PERFORMANCE_HUD_H_INCLUDED
+#define APP_UI_EDITOR_PERFORMANCE_HUD_H_INCLUDED
+#pragma once
+
+#include "app/ui/editor/editor_decorator.h"
+#include "base/chrono.h"
+#include "base/disable_copying.h"
+#include "base/tracing.h"
+#include "gfx/rect.h"
+#include "ui/timer.h"
+
+#include <string>
+#include <vector>
+
+namespace app {
+  class Editor;
+
+  // Overlay in the top-left corner of the editor with the render
+  // time per paint, number of composited layers, blended pixels,
+  // cache hit rates, undo memory, paints per second, and allocations
+  // per paint (when the allocation profiling is on). Values are
+  // the differences of base::tracing counters between two ticks of a
+  // timer (each half second), and the overlay is invalidated only
+  // when its text changes.
+  class PerformanceHud : public EditorDecorator {
+  public:
+    PerformanceHud(Editor* editor);
+    ~PerformanceHud();
+
+    // Bounds of the overlay in editor client coordinates.
+    gfx::Rect bounds() const;
+
+    // EditorDecorator impl
+    void preRenderDecorator(EditorPreRender* render) override;
+    void postRenderDecorator(EditorPostRender* render) override;
+
+  private:
+    enum {
+      Paints,
+      PaintTime,
+      Layers,
+      Pixels,
+      LayersCacheHits,
+      LayersCacheMisses,
+      OnionskinCacheHits,
+      OnionskinCacheMisses,
+      MipmapCacheHits,
+      MipmapCacheMisses,
+      ContentCacheHits,
+      ContentCacheMisses,
+      Counters
+    };
+
+    void onTick();
+    void sampleCounters(int64_t values[Counters]) const;
+
+    Editor* m_editor;
+    ui::Timer m_timer;
+    base::Chrono m_chrono;
+    base::tracing::counter* m_counters[Counters];
+    int64_t m_lastValues[Counters];
+    uint64_t m_lastAllocs;
+    std::vector<std::string> m_lines;
+
+    DISABLE_COPYING(PerformanceHud);
+  };
+
+} // namespace app
+
+#endif
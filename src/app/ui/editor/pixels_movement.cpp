@@ -25,29 +25,87 @@
 #include "app/ui_context.h"
 #include "app/util/expand_cel_canvas.h"
 #include "base/bind.h"
+#include "base/thread_pool.h"
 #include "base/vector2d.h"
 #include "doc/algorithm/flip_image.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/algorithm/rotsprite.h"
 #include "doc/cel.h"
 #include "doc/image.h"
+#include "doc/image_buffer_recycler.h"
+#include "doc/image_ref.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
+#include "doc/primitives.h"
 #include "doc/site.h"
 #include "doc/sprite.h"
 #include "gfx/region.h"
 #include "render/render.h"
 
+#include <atomic>
+
 namespace app {
 
+// Milliseconds without mouse movements to start the RotSprite
+// refinement of the preview, and interval to check if it's ready.
+static const int kRefineDelay = 150;
+static const int kRefinePollInterval = 30;
+
 template<typename T>
 static inline const base::Vector2d<double> point2Vector(const gfx::PointT<T>& pt) {
   return base::Vector2d<double>(pt.x, pt.y);
 }
 
+static gfx::Rect corners_bounds(const gfx::Transformation::Corners& corners)
+{
+  gfx::Rect bounds;
+  for (int i=0; i<gfx::Transformation::Corners::NUM_OF_CORNERS; ++i)
+    bounds = bounds.createUnion(gfx::Rect((int)corners[i].x, (int)corners[i].y, 1, 1));
+  return bounds;
+}
+
+struct PixelsMovement::RefineJob {
+  ImageRef dst;
+  ImageRef src;
+  gfx::Transformation::Corners corners;
+  std::atomic<bool> abandoned;  // The result isn't needed anymore
+  bool ok;                      // True if "dst" contains the result
+  base::task_token_ptr token;
+
+  RefineJob(Image* dst, Image* src,
+            const gfx::Transformation::Corners& corners)
+    : dst(dst)
+    , src(src)
+    , corners(corners)
+    , abandoned(false)
+    , ok(false)
+    , token(new base::task_token) {
+  }
+
+  // Executed in a worker thread. The job uses copies of the images,
+  // so it doesn't need to lock the document.
+  void run() {
+    // A new movement was made before the job was started
+    if (abandoned)
+      return;
+
+    try {
+      doc::algorithm::rotsprite_image(dst.get(), src.get(),
+        int(corners.leftTop().x), int(corners.leftTop().y),
+        int(corners.rightTop().x), int(corners.rightTop().y),
+        int(corners.rightBottom().x), int(corners.rightBottom().y),
+        int(corners.leftBottom().x), int(corners.leftBottom().y));
+      ok = true;
+    }
+    catch (const std::bad_alloc&) {
+      // Keep the fast preview
+    }
+  }
+};
+
 PixelsMovement::PixelsMovement(Context* context,
   Site site,
-  const Image* moveThis, const gfx::Point& initialPos, int opacity,
+  const ImageRef& moveThis, const gfx::Point& initialPos, int opacity,
   const char* operationName)
   : m_reader(context)
   , m_site(site)
@@ -59,8 +117,12 @@ PixelsMovement::PixelsMovement(Context* context,
   , m_isDragging(false)
   , m_adjustPivot(false)
   , m_handle(NoHandle)
-  , m_originalImage(Image::createCopy(moveThis))
+  , m_originalImage(moveThis)
   , m_maskColor(m_sprite->transparentColor())
+  , m_opacity(opacity)
+  , m_translatedExtraImage(false)
+  , m_lowQualityPreview(false)
+  , m_refineTimer(kRefineDelay)
 {
   m_initialData = gfx::Transformation(gfx::Rect(initialPos, gfx::Size(moveThis->width(), moveThis->height())));
   m_currentData = m_initialData;
@@ -71,11 +133,13 @@ PixelsMovement::PixelsMovement(Context* context,
   ASSERT(!m_document->getExtraCel());
 
   ContextWriter writer(m_reader, 500);
-  m_document->prepareExtraCel(m_sprite->bounds(), opacity);
+  m_document->prepareExtraCel(m_initialData.bounds(), opacity);
   m_document->setExtraCelType(render::ExtraType::COMPOSITE);
   m_document->setExtraCelBlendMode(
     static_cast<LayerImage*>(m_layer)->getBlendMode());
 
+  m_refineTimer.Tick.connect(&PixelsMovement::onRefinePreviewTick, this);
+
   redrawExtraImage();
 
   m_initialMask = new Mask(*m_document->mask());
@@ -88,15 +152,22 @@ PixelsMovement::PixelsMovement(Context* context,
 
 PixelsMovement::~PixelsMovement()
 {
-  delete m_originalImage;
+  m_refineTimer.stop();
+  abandonRefineJob();
+
   delete m_initialMask;
   delete m_currentMask;
 }
 
 void PixelsMovement::flipImage(doc::algorithm::FlipType flipType)
 {
+  // The original image can be shared with other objects (e.g. the
+  // clipboard), so it's copied before it's modified.
+  if (!m_originalImage.unique())
+    m_originalImage.reset(Image::createCopy(m_originalImage.get()));
+
   // Flip the image.
-  doc::algorithm::flip_image(m_originalImage,
+  doc::algorithm::flip_image(m_originalImage.get(),
                                 gfx::Rect(gfx::Point(0, 0),
                                           gfx::Size(m_originalImage->width(),
                                                     m_originalImage->height())),
@@ -185,6 +256,7 @@ void PixelsMovement::moveImage(const gfx::Point& pos, MoveModifier moveModifier)
 {
   gfx::Transformation::Corners oldCorners;
   m_currentData.transformBox(oldCorners);
+  const gfx::Rect oldBounds = m_currentData.bounds();
 
   ContextWriter writer(m_reader, 5000);
   int x1, y1, x2, y2;
@@ -393,6 +465,22 @@ void PixelsMovement::moveImage(const gfx::Point& pos, MoveModifier moveModifier)
     m_adjustPivot = true;
   }
 
+  // If the extra cel already contains the original pixels and the
+  // image is still just translated, we move the extra cel, and only
+  // the old and new image bounds must be redrawn.
+  if (m_translatedExtraImage && isTranslation()) {
+    const gfx::Rect newBounds = m_currentData.bounds();
+    m_document->getExtraCel()->setPosition(newBounds.getOrigin());
+    m_document->setTransformation(m_currentData);
+
+    if (newBounds != oldBounds) {
+      gfx::Region region;
+      region.createUnion(gfx::Region(oldBounds), gfx::Region(newBounds));
+      m_document->notifySpritePixelsModified(m_sprite, region);
+    }
+    return;
+  }
+
   redrawExtraImage();
 
   m_document->setTransformation(m_currentData);
@@ -434,7 +522,7 @@ Image* PixelsMovement::getDraggedImageCopy(gfx::Point& origin)
   int height = rightBottom.y - leftTop.y;
   base::UniquePtr<Image> image(Image::create(m_sprite->pixelFormat(), width, height));
 
-  drawImage(image, leftTop);
+  drawImage(image, leftTop, rotationAlgorithm(m_originalImage.get()));
 
   origin = leftTop;
 
@@ -443,6 +531,8 @@ Image* PixelsMovement::getDraggedImageCopy(gfx::Point& origin)
 
 void PixelsMovement::stampImage()
 {
+  refinePreviewNow();
+
   const Cel* cel = m_document->getExtraCel();
   const Image* image = m_document->getExtraCelImage();
 
@@ -455,7 +545,9 @@ void PixelsMovement::stampImage()
       // portion of sprite.
       ExpandCelCanvas expand(m_site,
         TiledMode::NONE, m_transaction,
-        ExpandCelCanvas::None);
+        (Preferences::instance().editor.autoShrinkCels() ?
+          ExpandCelCanvas::AutoShrink:
+          ExpandCelCanvas::None));
 
       // TODO can we reduce this region?
       gfx::Region modifiedRegion(expand.getDestCanvas()->bounds());
@@ -582,11 +674,47 @@ void PixelsMovement::setMaskColor(color_t mask_color)
 
 void PixelsMovement::redrawExtraImage()
 {
-  ASSERT(m_document->getExtraCelImage());
+  ASSERT(m_document->getExtraCel());
+
+  // Any RotSprite result being calculated is now outdated.
+  abandonRefineJob();
+  m_refineTimer.stop();
+
+  // A translated image is drawn in an extra cel with its same size,
+  // so moving it again only changes the extra cel position (see
+  // moveImage()).
+  if (isTranslation()) {
+    const gfx::Rect bounds = m_currentData.bounds();
+    m_document->prepareExtraCel(bounds, m_opacity);
+    drawImage(m_document->getExtraCelImage(), bounds.getOrigin(),
+      tools::RotationAlgorithm::FAST);
+
+    m_translatedExtraImage = true;
+    m_lowQualityPreview = false;
+    return;
+  }
+
+  m_document->prepareExtraCel(m_sprite->bounds(), m_opacity);
+  m_translatedExtraImage = false;
+
+  tools::RotationAlgorithm rotAlgo = rotationAlgorithm(m_originalImage.get());
+
+  // RotSprite is too slow to be used on each mouse movement, so
+  // while the user is dragging the image we show a fast preview, and
+  // the RotSprite version is calculated in background when the mouse
+  // stops (see onRefinePreviewTick()).
+  m_lowQualityPreview =
+    (m_isDragging && rotAlgo == tools::RotationAlgorithm::ROTSPRITE);
+  if (m_lowQualityPreview) {
+    rotAlgo = tools::RotationAlgorithm::FAST;
+
+    m_refineTimer.setInterval(kRefineDelay);
+    m_refineTimer.start();
+  }
 
   // Draw the transformed pixels in the extra-cel which is the chunk
   // of pixels that the user is moving.
-  drawImage(m_document->getExtraCelImage(), gfx::Point(0, 0));
+  drawImage(m_document->getExtraCelImage(), gfx::Point(0, 0), rotAlgo);
 }
 
 void PixelsMovement::redrawCurrentMask()
@@ -600,39 +728,140 @@ void PixelsMovement::redrawCurrentMask()
   m_currentMask->freeze();
   clear_image(m_currentMask->bitmap(), 0);
   drawParallelogram(m_currentMask->bitmap(), m_initialMask->bitmap(),
-    corners, gfx::Point(0, 0));
+    corners, gfx::Point(0, 0),
+    rotationAlgorithm(m_initialMask->bitmap()));
 
   m_currentMask->unfreeze();
 }
 
-void PixelsMovement::drawImage(doc::Image* dst, const gfx::Point& pt)
+void PixelsMovement::refinePreviewNow()
 {
-  ASSERT(dst);
+  if (!m_lowQualityPreview)
+    return;
 
-  gfx::Transformation::Corners corners;
-  m_currentData.transformBox(corners);
+  abandonRefineJob();
+  m_refineTimer.stop();
 
-  dst->setMaskColor(m_sprite->transparentColor());
-  clear_image(dst, dst->maskColor());
+  drawImage(m_document->getExtraCelImage(), gfx::Point(0, 0),
+    rotationAlgorithm(m_originalImage.get()));
+  m_lowQualityPreview = false;
+}
 
-  m_originalImage->setMaskColor(m_maskColor);
-  drawParallelogram(dst, m_originalImage, corners, pt);
+void PixelsMovement::abandonRefineJob()
+{
+  if (m_refineJob) {
+    // We don't wait the job if it's running (task_token::cancel()
+    // would block the UI thread), its result is just discarded.
+    m_refineJob->abandoned = true;
+    m_refineJob.reset();
+  }
 }
 
-void PixelsMovement::drawParallelogram(doc::Image* dst, doc::Image* src,
-  const gfx::Transformation::Corners& corners,
-  const gfx::Point& leftTop)
+void PixelsMovement::onRefinePreviewTick()
+{
+  // The mouse was stopped, start the RotSprite job.
+  if (!m_refineJob) {
+    const Image* extraImage = m_document->getExtraCelImage();
+    if (!m_lowQualityPreview || !extraImage) {
+      m_refineTimer.stop();
+      return;
+    }
+
+    gfx::Transformation::Corners corners;
+    m_currentData.transformBox(corners);
+
+    // Temporary images of the job
+    ImageBufferRecycler& recycler = ImageBufferRecycler::global();
+    Image* dst = Image::create(extraImage->pixelFormat(),
+      extraImage->width(), extraImage->height(),
+      recycler.getForImage(extraImage->pixelFormat(),
+                           extraImage->width(), extraImage->height()));
+    dst->setMaskColor(m_sprite->transparentColor());
+    clear_image(dst, dst->maskColor());
+
+    Image* src = Image::createCopy(m_originalImage.get(),
+      recycler.getForImage(m_originalImage->pixelFormat(),
+                           m_originalImage->width(), m_originalImage->height()));
+    src->setMaskColor(m_maskColor);
+
+    RefineJobPtr job(new RefineJob(dst, src, corners));
+    m_refineJob = job;
+
+    base::thread_pool::global().execute(
+      [job]{ job->run(); }, job->token);
+
+    m_refineTimer.setInterval(kRefinePollInterval);
+    return;
+  }
+
+  if (!m_refineJob->token->finished())
+    return;
+
+  RefineJobPtr job = m_refineJob;
+  m_refineJob.reset();
+  m_refineTimer.stop();
+
+  if (!job->ok)
+    return;
+
+  try {
+    ContextWriter writer(m_reader, 500);
+
+    Image* extraImage = m_document->getExtraCelImage();
+    if (!extraImage || extraImage->size() != job->dst->size())
+      return;
+
+    copy_image(extraImage, job->dst.get());
+    m_lowQualityPreview = false;
+
+    gfx::Rect bounds = corners_bounds(job->corners);
+    if (!bounds.isEmpty())
+      m_document->notifySpritePixelsModified(m_sprite, gfx::Region(bounds));
+  }
+  catch (const std::exception& ex) {
+    Console::showException(ex);
+  }
+}
+
+bool PixelsMovement::isTranslation() const
 {
-  tools::RotationAlgorithm rotAlgo = Preferences::instance().selection.rotationAlgorithm();
+  return (m_currentData.angle() == 0.0 &&
+          m_currentData.bounds().getSize() == m_originalImage->size());
+}
 
+tools::RotationAlgorithm PixelsMovement::rotationAlgorithm(const doc::Image* src) const
+{
   // If the angle and the scale weren't modified, we should use the
   // fast rotation algorithm, as it's pixel-perfect match with the
   // original selection when just a translation is applied.
   if (m_currentData.angle() == 0.0 &&
       m_currentData.bounds().getSize() == src->size()) {
-    rotAlgo = tools::RotationAlgorithm::FAST;
+    return tools::RotationAlgorithm::FAST;
   }
 
+  return Preferences::instance().selection.rotationAlgorithm();
+}
+
+void PixelsMovement::drawImage(doc::Image* dst, const gfx::Point& pt,
+  tools::RotationAlgorithm rotAlgo)
+{
+  ASSERT(dst);
+
+  gfx::Transformation::Corners corners;
+  m_currentData.transformBox(corners);
+
+  dst->setMaskColor(m_sprite->transparentColor());
+  clear_image(dst, dst->maskColor());
+
+  m_originalImage->setMaskColor(m_maskColor);
+  drawParallelogram(dst, m_originalImage.get(), corners, pt, rotAlgo);
+}
+
+void PixelsMovement::drawParallelogram(doc::Image* dst, doc::Image* src,
+  const gfx::Transformation::Corners& corners,
+  const gfx::Point& leftTop,
+  tools::RotationAlgorithm rotAlgo)
+{
 retry:;      // In case that we don't have enough memory for RotSprite
              // we can try with the fast algorithm anyway.
 
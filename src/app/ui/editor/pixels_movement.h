@@ -10,13 +10,18 @@
 #pragma once
 
 #include "app/context_access.h"
+#include "app/tools/rotation_algorithm.h"
 #include "app/transaction.h"
 #include "app/ui/editor/handle_type.h"
 #include "base/connection.h"
 #include "base/shared_ptr.h"
 #include "doc/algorithm/flip_type.h"
+#include "doc/image_ref.h"
 #include "doc/site.h"
 #include "gfx/size.h"
+#include "ui/timer.h"
+
+#include <memory>
 
 namespace doc {
   class Image;
@@ -45,11 +50,13 @@ namespace app {
       LockAxisMovement = 16
     };
 
-    // The "moveThis" image specifies the chunk of pixels to be moved.
-    // The "x" and "y" parameters specify the initial position of the image.
+    // The "moveThis" image specifies the chunk of pixels to be moved
+    // (it's shared, e.g. with the clipboard, and copied only if the
+    // pixels are flipped). The "x" and "y" parameters specify the
+    // initial position of the image.
     PixelsMovement(Context* context,
       Site site,
-      const Image* moveThis,
+      const ImageRef& moveThis,
       const gfx::Point& initialPos, int opacity,
       const char* operationName);
     ~PixelsMovement();
@@ -93,13 +100,25 @@ namespace app {
     const gfx::Transformation& getTransformation() const { return m_currentData; }
 
   private:
+    // RotSprite result of the current transformation calculated in a
+    // background thread (while the extra cel shows a fast preview).
+    struct RefineJob;
+    typedef std::shared_ptr<RefineJob> RefineJobPtr;
+
     void onRotationAlgorithmChange();
+    void onRefinePreviewTick();
     void redrawExtraImage();
     void redrawCurrentMask();
-    void drawImage(doc::Image* dst, const gfx::Point& pos);
+    void refinePreviewNow();
+    void abandonRefineJob();
+    bool isTranslation() const;
+    tools::RotationAlgorithm rotationAlgorithm(const doc::Image* src) const;
+    void drawImage(doc::Image* dst, const gfx::Point& pos,
+      tools::RotationAlgorithm rotAlgo);
     void drawParallelogram(doc::Image* dst, doc::Image* src,
       const gfx::Transformation::Corners& corners,
-      const gfx::Point& leftTop);
+      const gfx::Point& leftTop,
+      tools::RotationAlgorithm rotAlgo);
     void updateDocumentMask();
 
     const ContextReader m_reader;
@@ -112,14 +131,27 @@ namespace app {
     bool m_isDragging;
     bool m_adjustPivot;
     HandleType m_handle;
-    Image* m_originalImage;
+    ImageRef m_originalImage;
     gfx::Point m_catchPos;
     gfx::Transformation m_initialData;
     gfx::Transformation m_currentData;
     Mask* m_initialMask;
     Mask* m_currentMask;
     color_t m_maskColor;
+    int m_opacity;
+
+    // True if the extra cel contains the original image (with its
+    // same size) at the current position, i.e. the transformation is
+    // just a translation.
+    bool m_translatedExtraImage;
+
     ScopedConnection m_rotAlgoConn;
+
+    // True if the extra cel contains a fast preview of a RotSprite
+    // transformation (the pixels are refined when the mouse stops).
+    bool m_lowQualityPreview;
+    ui::Timer m_refineTimer;
+    RefineJobPtr m_refineJob;
   };
 
   inline PixelsMovement::MoveModifier& operator|=(PixelsMovement::MoveModifier& a,
@@ -22,10 +22,16 @@
 #include "ui/message.h"
 #include "ui/system.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 using namespace ui;
 
+// Number of frames rendered in advance (including the current one)
+static const int kPrerenderFrames = 8;
+
 PlayState::PlayState()
   : m_editor(nullptr)
   , m_toScroll(false)
@@ -59,6 +65,8 @@ void PlayState::onEnterState(Editor* editor)
   // running.
   if (!m_playTimer.isRunning())
     m_playTimer.start();
+
+  prerenderNextFrames();
 }
 
 EditorState::LeaveAction PlayState::onLeaveState(Editor* editor, EditorState* newState)
@@ -69,6 +77,8 @@ EditorState::LeaveAction PlayState::onLeaveState(Editor* editor, EditorState* ne
     // We don't stop the timer if we are going to the ScrollingState
     // (we keep playing the animation).
     m_playTimer.stop();
+
+    m_editor->prerenderFrames(std::vector<doc::frame_t>());
   }
   return KeepState;
 }
@@ -132,6 +142,7 @@ void PlayState::onPlaybackTick()
   doc::Sprite* sprite = m_editor->sprite();
   doc::FrameTag* tag = get_animation_tag(sprite, m_refFrame);
 
+  bool frameChanged = false;
   while (m_nextFrameTime <= 0) {
     doc::frame_t frame = calculate_next_frame(
       sprite, m_editor->frame(), frame_t(1), tag,
@@ -139,8 +150,12 @@ void PlayState::onPlaybackTick()
 
     m_editor->setFrame(frame);
     m_nextFrameTime += getNextFrameTime();
+    frameChanged = true;
   }
 
+  if (frameChanged)
+    prerenderNextFrames();
+
   m_curFrameTick = ui::clock();
   m_editor->invalidate();
 }
@@ -174,6 +189,35 @@ void PlayState::onBeforeCommandExecution(Command* command)
   m_editor->stop();
 }
 
+// Renders the current frame and the next ones in background threads
+// (in the same order that they will be displayed, following the
+// animation direction of the loop tag), so the editor can display
+// them without delays.
+void PlayState::prerenderNextFrames()
+{
+  doc::Sprite* sprite = m_editor->sprite();
+  doc::FrameTag* tag = get_animation_tag(sprite, m_refFrame);
+  doc::frame_t frame = m_editor->frame();
+  bool pingPongForward = m_pingPongForward;
+
+  std::vector<doc::frame_t> frames;
+  frames.push_back(frame);
+
+  while (int(frames.size()) < kPrerenderFrames) {
+    frame = calculate_next_frame(
+      sprite, frame, frame_t(1), tag,
+      pingPongForward);
+
+    // The animation loops
+    if (std::find(frames.begin(), frames.end(), frame) != frames.end())
+      break;
+
+    frames.push_back(frame);
+  }
+
+  m_editor->prerenderFrames(frames);
+}
+
 double PlayState::getNextFrameTime()
 {
   return
@@ -22,6 +22,7 @@ namespace app {
   public:
     PlayState();
 
+    bool allowBackgroundRendering() const override { return true; }
     void onEnterState(Editor* editor) override;
     LeaveAction onLeaveState(Editor* editor, EditorState* newState) override;
     bool onMouseDown(Editor* editor, ui::MouseMessage* msg) override;
@@ -37,6 +38,7 @@ namespace app {
     void onBeforeCommandExecution(Command* command);
 
     double getNextFrameTime();
+    void prerenderNextFrames();
 
     Editor* m_editor;
     bool m_toScroll;
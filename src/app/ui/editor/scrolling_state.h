@@ -19,6 +19,7 @@ namespace app {
     ScrollingState();
     virtual ~ScrollingState();
     virtual bool isTemporalState() const override { return true; }
+    virtual bool allowBackgroundRendering() const override { return true; }
     virtual bool onMouseDown(Editor* editor, ui::MouseMessage* msg) override;
     virtual bool onMouseUp(Editor* editor, ui::MouseMessage* msg) override;
     virtual bool onMouseMove(Editor* editor, ui::MouseMessage* msg) override;
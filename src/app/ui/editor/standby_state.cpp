@@ -423,7 +423,7 @@ void StandbyState::transformSelection(Editor* editor, MouseMessage* msg, HandleT
 
     EditorCustomizationDelegate* customization = editor->getCustomizationDelegate();
     Document* document = editor->document();
-    base::UniquePtr<Image> tmpImage(new_image_from_mask(editor->getSite()));
+    ImageRef tmpImage(new_image_from_mask(editor->getSite()));
     gfx::Point origin = document->mask()->bounds().getOrigin();
     int opacity = 255;
     PixelsMovementPtr pixelsMovement(
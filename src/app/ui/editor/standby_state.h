@@ -35,6 +35,7 @@ namespace app {
     // Returns true as the standby state is the only one which shows
     // the brush-preview.
     virtual bool requireBrushPreview() override { return true; }
+    virtual bool allowBackgroundRendering() const override { return true; }
 
     virtual gfx::Transformation getTransformation(Editor* editor);
 
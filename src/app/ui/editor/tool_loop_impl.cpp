@@ -33,6 +33,7 @@
 #include "app/transaction.h"
 #include "app/ui/color_bar.h"
 #include "app/ui/context_bar.h"
+#include "app/ui/editor/async_render.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/main_window.h"
 #include "app/ui/status_bar.h"
@@ -236,6 +237,9 @@ public:
         m_transaction,
         ExpandCelCanvas::Flags(
           ExpandCelCanvas::NeedsSource |
+          (Preferences::instance().editor.autoShrinkCels() ?
+            ExpandCelCanvas::AutoShrink:
+            ExpandCelCanvas::None) |
           // If the tool is freehand-like, we can use the modified
           // region directly as undo information to save the modified
           // pixels (it's faster than creating a Dirty object).
@@ -404,6 +408,11 @@ tools::ToolLoop* create_tool_loop(Editor* editor, Context* context)
     return NULL;
   }
 
+  // The tool loop modifies the sprite without locking the document,
+  // so tiles cannot be rendered in background from now on (see
+  // DrawingState::allowBackgroundRendering()).
+  AsyncRender::cancelAll();
+
   // Create the new tool loop
   try {
     return new ToolLoopImpl(
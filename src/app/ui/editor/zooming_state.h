@@ -20,6 +20,7 @@ namespace app {
     ZoomingState();
     virtual ~ZoomingState();
     virtual bool isTemporalState() const override { return true; }
+    virtual bool allowBackgroundRendering() const override { return true; }
     virtual bool onMouseDown(Editor* editor, ui::MouseMessage* msg) override;
     virtual bool onMouseUp(Editor* editor, ui::MouseMessage* msg) override;
     virtual bool onMouseMove(Editor* editor, ui::MouseMessage* msg) override;
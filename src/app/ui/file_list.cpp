@@ -25,6 +25,11 @@
 
 #define ISEARCH_KEYPRESS_INTERVAL_MSECS 500
 
+// Big folders are listed incrementally, at most this time
+// (milliseconds) in each monitoring tick.
+#define LISTING_INTERVAL_MSECS          20
+#define LISTING_ENTRIES                 256
+
 namespace app {
 
 using namespace app::skin;
@@ -39,8 +44,13 @@ FileList::FileList()
   setFocusStop(true);
   setDoubleBuffered(true);
 
+  // FileList caches its own preferred size (see m_req_valid)
+  disableSizeCache();
+
   m_currentFolder = FileSystemModule::instance()->getRootFileItem();
   m_req_valid = false;
+  m_maxRowWidth = 0;
+  m_maxRowWidthChanged = false;
   m_selected = NULL;
   m_isearchClock = 0;
 
@@ -50,6 +60,7 @@ FileList::FileList()
   m_monitoringTimer.Tick.connect(&FileList::onMonitoringTick, this);
   m_monitoringTimer.start();
 
+  m_listing = !listCurrentFolder();
   regenerateList();
 }
 
@@ -59,6 +70,9 @@ FileList::~FileList()
   m_generateThumbnailTimer.stop();
   m_monitoringTimer.stop();
 
+  if (m_listing)
+    m_currentFolder->cancelChildrenUpdate();
+
   // Stop workers creating thumbnails.
   ThumbnailGenerator::instance()->stopAllWorkers();
 }
@@ -77,10 +91,16 @@ void FileList::setCurrentFolder(IFileItem* folder)
   ASSERT(folder != NULL);
   ASSERT(folder->isBrowsable());
 
+  // Stop listing the previous folder
+  if (m_listing && m_currentFolder != folder)
+    m_currentFolder->cancelChildrenUpdate();
+
   m_currentFolder = folder;
   m_req_valid = false;
+  m_maxRowWidth = 0;
   m_selected = NULL;
 
+  m_listing = !listCurrentFolder();
   regenerateList();
 
   // select first folder
@@ -119,28 +139,17 @@ bool FileList::onProcessMessage(Message* msg)
     case kMouseMoveMessage:
       if (hasCapture()) {
         MouseMessage* mouseMsg = static_cast<MouseMessage*>(msg);
-        int th = getTextHeight();
-        int y = getBounds().y;
         IFileItem* old_selected = m_selected;
         m_selected = NULL;
 
-        // rows
-        for (FileItemList::iterator
-               it=m_list.begin();
-             it!=m_list.end(); ++it) {
-          IFileItem* fi = *it;
-          gfx::Size itemSize = getFileItemSize(fi);
-
-          if (((mouseMsg->position().y >= y) &&
-               (mouseMsg->position().y < y+th+4*guiscale())) ||
-              (it == m_list.begin() && mouseMsg->position().y < y) ||
-              (it == m_list.end()-1 && mouseMsg->position().y >= y+th+4*guiscale())) {
-            m_selected = fi;
-            makeSelectedFileitemVisible();
-            break;
-          }
-
-          y += itemSize.h;
+        // All rows have the same height, so the row is calculated
+        // directly (rows above/below the list select the first/last
+        // item).
+        if (!m_list.empty()) {
+          int y = mouseMsg->position().y - getBounds().y;
+          int i = (y < 0 ? 0: y / getRowHeight());
+          m_selected = m_list[MID(0, i, int(m_list.size())-1)];
+          makeSelectedFileitemVisible();
         }
 
         if (old_selected != m_selected) {
@@ -199,7 +208,7 @@ bool FileList::onProcessMessage(Message* msg)
             gfx::Rect vp = view->getViewportBounds();
             if (select < 0)
               select = 0;
-            select += sgn * vp.h / (getTextHeight()+4*guiscale());
+            select += sgn * vp.h / getRowHeight();
             break;
           }
 
@@ -278,7 +287,7 @@ bool FileList::onProcessMessage(Message* msg)
       View* view = View::getView(this);
       if (view) {
         gfx::Point scroll = view->getViewScroll();
-        scroll += static_cast<MouseMessage*>(msg)->wheelDelta() * 3*(getTextHeight()+4*guiscale());
+        scroll += static_cast<MouseMessage*>(msg)->wheelDelta() * 3*getRowHeight();
         view->setViewScroll(scroll);
       }
       break;
@@ -309,8 +318,9 @@ void FileList::onPaint(ui::PaintEvent& ev)
   View* view = View::getView(this);
   gfx::Rect vp = view->getViewportBounds();
   gfx::Rect bounds = getClientBounds();
-  int x, y = bounds.y;
-  int evenRow = 0;
+  gfx::Rect clip = g->getClipBounds();
+  const int rowHeight = getRowHeight();
+  int x, y;
   gfx::Color bgcolor;
   gfx::Color fgcolor;
   she::Surface* thumbnail = NULL;
@@ -318,11 +328,23 @@ void FileList::onPaint(ui::PaintEvent& ev)
 
   g->fillRect(theme->colors.background(), bounds);
 
+  // Only visible rows are painted (big folders can contain thousands
+  // of items)
+  int first = MAX(0, (clip.y - bounds.y) / rowHeight);
+  int last = MIN(int(m_list.size())-1, (clip.y2() - 1 - bounds.y) / rowHeight);
+
   // rows
-  for (FileItemList::iterator
-         it=m_list.begin(), end=m_list.end(); it!=end; ++it) {
-    IFileItem* fi = *it;
+  for (int i=first; i<=last; ++i) {
+    IFileItem* fi = m_list[i];
     gfx::Size itemSize = getFileItemSize(fi);
+    bool evenRow = ((i & 1) == 1);
+
+    y = bounds.y + i*rowHeight;
+
+    if (m_maxRowWidth < itemSize.w) {
+      m_maxRowWidth = itemSize.w;
+      m_maxRowWidthChanged = true;
+    }
 
     if (fi == m_selected) {
       fgcolor = theme->colors.filelistSelectedRowText();
@@ -371,16 +393,13 @@ void FileList::onPaint(ui::PaintEvent& ev)
           barw, 6*guiscale()),
         progress);
     }
+  }
 
-    // Thumbnail position
-    if (fi == m_selected) {
-      thumbnail = fi->getThumbnail();
-      if (thumbnail)
-        thumbnail_y = y + itemSize.h/2;
-    }
-
-    y += itemSize.h;
-    evenRow ^= 1;
+  // Thumbnail position
+  if (m_selected) {
+    thumbnail = m_selected->getThumbnail();
+    if (thumbnail)
+      thumbnail_y = bounds.y + getSelectedIndex()*rowHeight + rowHeight/2;
   }
 
   // Draw the thumbnail
@@ -400,21 +419,26 @@ void FileList::onPaint(ui::PaintEvent& ev)
 void FileList::onPreferredSize(PreferredSizeEvent& ev)
 {
   if (!m_req_valid) {
-    gfx::Size reqSize(0, 0);
-
-    // rows
-    for (FileItemList::iterator
-           it=m_list.begin();
-         it!=m_list.end(); ++it) {
-      IFileItem* fi = *it;
-      gfx::Size itemSize = getFileItemSize(fi);
-      reqSize.w = MAX(reqSize.w, itemSize.w);
-      reqSize.h += itemSize.h;
+    const int rowHeight = getRowHeight();
+    int first = 0;
+    int last = int(m_list.size())-1;
+
+    // Measure the rows in the viewport only (the other rows are
+    // measured when they are painted).
+    View* view = View::getView(this);
+    if (view) {
+      gfx::Rect vp = view->getViewportBounds();
+      gfx::Point scroll = view->getViewScroll();
+      first = MAX(first, scroll.y / rowHeight);
+      last = MIN(last, (scroll.y + vp.h) / rowHeight);
     }
 
+    for (int i=first; i<=last; ++i)
+      m_maxRowWidth = MAX(m_maxRowWidth, getFileItemSize(m_list[i]).w);
+
     m_req_valid = true;
-    m_req_w = reqSize.w;
-    m_req_h = reqSize.h;
+    m_req_w = m_maxRowWidth;
+    m_req_h = int(m_list.size()) * rowHeight;
   }
   ev.setPreferredSize(Size(m_req_w, m_req_h));
 }
@@ -436,10 +460,49 @@ void FileList::onCurrentFolderChanged()
 
 void FileList::onMonitoringTick()
 {
+  // Continue listing the current folder
+  if (m_listing) {
+    m_listing = !listCurrentFolder();
+    regenerateList();
+
+    // select first folder
+    if (!m_selected && !m_list.empty() && m_list.front()->isBrowsable())
+      selectIndex(0);
+
+    m_req_valid = false;
+    invalidate();
+    View::getView(this)->updateView();
+  }
+  // New rows, wider than the previous ones, were painted
+  else if (m_maxRowWidthChanged) {
+    m_maxRowWidthChanged = false;
+    m_req_valid = false;
+    View::getView(this)->updateView();
+  }
+
   if (ThumbnailGenerator::instance()->checkWorkers())
     invalidate();
 }
 
+// Lists the current folder for some milliseconds, so big folders (or
+// slow network drives) don't block the UI. Returns true if the list
+// is complete, or false if the listing must continue in the next
+// monitoring tick.
+bool FileList::listCurrentFolder()
+{
+  int t0 = ui::clock();
+  while (!m_currentFolder->updateChildren(LISTING_ENTRIES)) {
+    if (ui::clock() - t0 >= LISTING_INTERVAL_MSECS)
+      return false;
+  }
+  return true;
+}
+
+int FileList::getRowHeight() const
+{
+  return getTextHeight()+4*guiscale();
+}
+
 void FileList::onGenerateThumbnailTick()
 {
   m_generateThumbnailTimer.stop();
@@ -458,36 +521,27 @@ gfx::Size FileList::getFileItemSize(IFileItem* fi) const
 
   len += getFont()->textLength(fi->getDisplayName().c_str());
 
-  return gfx::Size(len+4*guiscale(), getTextHeight()+4*guiscale());
+  return gfx::Size(len+4*guiscale(), getRowHeight());
 }
 
 void FileList::makeSelectedFileitemVisible()
 {
+  int i = getSelectedIndex();
+  if (i < 0)
+    return;
+
   View* view = View::getView(this);
   gfx::Rect vp = view->getViewportBounds();
   gfx::Point scroll = view->getViewScroll();
-  int th = getTextHeight();
-  int y = getBounds().y;
+  int rowHeight = getRowHeight();
+  int y = getBounds().y + i*rowHeight;
 
-  // rows
-  for (FileItemList::iterator
-         it=m_list.begin();
-       it!=m_list.end(); ++it) {
-    IFileItem* fi = *it;
-    gfx::Size itemSize = getFileItemSize(fi);
-
-    if (fi == m_selected) {
-      if (y < vp.y)
-        scroll.y = y - getBounds().y;
-      else if (y > vp.y + vp.h - (th+4*guiscale()))
-        scroll.y = y - getBounds().y - vp.h + (th+4*guiscale());
+  if (y < vp.y)
+    scroll.y = y - getBounds().y;
+  else if (y > vp.y + vp.h - rowHeight)
+    scroll.y = y - getBounds().y - vp.h + rowHeight;
 
-      view->setViewScroll(scroll);
-      break;
-    }
-
-    y += itemSize.h;
-  }
+  view->setViewScroll(scroll);
 }
 
 void FileList::regenerateList()
@@ -511,6 +565,15 @@ void FileList::regenerateList()
         ++it;
     }
   }
+
+  // Items removed from the folder
+  if (m_selected &&
+      std::find(m_list.begin(), m_list.end(), m_selected) == m_list.end())
+    m_selected = NULL;
+
+  if (m_itemToGenerateThumbnail &&
+      std::find(m_list.begin(), m_list.end(), m_itemToGenerateThumbnail) == m_list.end())
+    m_itemToGenerateThumbnail = NULL;
 }
 
 int FileList::getSelectedIndex()
@@ -49,6 +49,8 @@ namespace app {
   private:
     void onGenerateThumbnailTick();
     void onMonitoringTick();
+    bool listCurrentFolder();
+    int getRowHeight() const;
     gfx::Size getFileItemSize(IFileItem* fi) const;
     void makeSelectedFileitemVisible();
     void regenerateList();
@@ -60,6 +62,15 @@ namespace app {
     FileItemList m_list;
     bool m_req_valid;
     int m_req_w, m_req_h;
+
+    // True if the current folder is being listed (see
+    // listCurrentFolder()).
+    bool m_listing;
+
+    // Only visible rows are measured, so this is the width of the
+    // widest row painted until now.
+    int m_maxRowWidth;
+    bool m_maxRowWidthChanged;
     IFileItem* m_selected;
     std::string m_exts;
 
@@ -26,6 +26,8 @@
 #include "ui/accelerator.h"
 #include "ui/message.h"
 
+#include <algorithm>
+
 #define XML_KEYBOARD_FILE_VERSION "1"
 
 namespace {
@@ -66,6 +68,20 @@ namespace {
     return shortcut;
   }
 
+  // Fields of an accelerator that can be indexed (see
+  // Accelerator::isPressed() to know how they are compared)
+  enum { kIndexScancode, kIndexUnicode, kIndexModifiers };
+
+  uint64_t accel_index_key(app::KeyContext keyContext, int field,
+                           ui::KeyModifiers modifiers, int value)
+  {
+    return
+      (uint64_t(keyContext) << 56) |
+      (uint64_t(field) << 48) |
+      (uint64_t(modifiers & 0xffff) << 32) |
+      uint64_t(uint32_t(value));
+  }
+
   std::string get_user_friendly_string_for_keyaction(app::KeyAction action)
   {
     for (int c=0; actions[c].name; ++c) {
@@ -187,6 +203,7 @@ void Key::add(const ui::Accelerator& accel, KeySource source)
 
   // Add the accelerator
   accels->add(accel);
+  KeyboardShortcuts::instance()->invalidateAccelsIndex();
 }
 
 bool Key::isPressed(Message* msg) const
@@ -231,6 +248,8 @@ void Key::disableAccel(const ui::Accelerator& accel)
 
   if (m_accels.has(accel))
     m_userRemoved.add(accel);
+
+  KeyboardShortcuts::instance()->invalidateAccelsIndex();
 }
 
 void Key::reset()
@@ -238,6 +257,8 @@ void Key::reset()
   m_users.clear();
   m_userRemoved.clear();
   m_useUsers = false;
+
+  KeyboardShortcuts::instance()->invalidateAccelsIndex();
 }
 
 std::string Key::triggerString() const
@@ -271,6 +292,7 @@ KeyboardShortcuts* KeyboardShortcuts::instance()
 }
 
 KeyboardShortcuts::KeyboardShortcuts()
+  : m_accelsIndexDirty(true)
 {
 }
 
@@ -285,6 +307,13 @@ void KeyboardShortcuts::clear()
     delete key;
   }
   m_keys.clear();
+
+  m_commandKeys.clear();
+  m_toolKeys.clear();
+  m_quicktoolKeys.clear();
+  m_actionKeys.clear();
+  m_accelsIndex.clear();
+  m_accelsIndexDirty = true;
 }
 
 void KeyboardShortcuts::importFile(TiXmlElement* rootElement, KeySource source)
@@ -566,59 +595,57 @@ Key* KeyboardShortcuts::command(const char* commandName, const Params& params, K
   if (!command)
     return NULL;
 
-  for (Key* key : m_keys) {
-    if (key->type() == KeyType::Command &&
-        key->keycontext() == keyContext &&
-        key->command() == command &&
+  auto range = m_commandKeys.equal_range(command);
+  for (auto it=range.first; it!=range.second; ++it) {
+    Key* key = it->second;
+    if (key->keycontext() == keyContext &&
         key->params() == params) {
       return key;
     }
   }
 
-  Key* key = new Key(command, params, keyContext);
-  m_keys.push_back(key);
+  Key* key = addKey(new Key(command, params, keyContext));
+  m_commandKeys.insert(std::make_pair(command, key));
   return key;
 }
 
 Key* KeyboardShortcuts::tool(tools::Tool* tool)
 {
-  for (Key* key : m_keys) {
-    if (key->type() == KeyType::Tool &&
-        key->tool() == tool) {
-      return key;
-    }
-  }
+  auto it = m_toolKeys.find(tool);
+  if (it != m_toolKeys.end())
+    return it->second;
 
-  Key* key = new Key(KeyType::Tool, tool);
-  m_keys.push_back(key);
+  Key* key = addKey(new Key(KeyType::Tool, tool));
+  m_toolKeys[tool] = key;
   return key;
 }
 
 Key* KeyboardShortcuts::quicktool(tools::Tool* tool)
 {
-  for (Key* key : m_keys) {
-    if (key->type() == KeyType::Quicktool &&
-        key->tool() == tool) {
-      return key;
-    }
-  }
+  auto it = m_quicktoolKeys.find(tool);
+  if (it != m_quicktoolKeys.end())
+    return it->second;
 
-  Key* key = new Key(KeyType::Quicktool, tool);
-  m_keys.push_back(key);
+  Key* key = addKey(new Key(KeyType::Quicktool, tool));
+  m_quicktoolKeys[tool] = key;
   return key;
 }
 
 Key* KeyboardShortcuts::action(KeyAction action)
 {
-  for (Key* key : m_keys) {
-    if (key->type() == KeyType::Action &&
-        key->action() == action) {
-      return key;
-    }
-  }
+  auto it = m_actionKeys.find(action);
+  if (it != m_actionKeys.end())
+    return it->second;
 
-  Key* key = new Key(action);
+  Key* key = addKey(new Key(action));
+  m_actionKeys[action] = key;
+  return key;
+}
+
+Key* KeyboardShortcuts::addKey(Key* key)
+{
   m_keys.push_back(key);
+  invalidateAccelsIndex();
   return key;
 }
 
@@ -644,16 +671,107 @@ KeyContext KeyboardShortcuts::getCurrentKeyContext()
 
 bool KeyboardShortcuts::getCommandFromKeyMessage(Message* msg, Command** command, Params* params)
 {
-  for (Key* key : m_keys) {
-    if (key->type() == KeyType::Command && key->isPressed(msg)) {
-      if (command) *command = key->command();
-      if (params) *params = key->params();
-      return true;
-    }
+  Key* key = findKeyFromKeyMessage(msg,
+    [](const Key* key){ return key->type() == KeyType::Command; });
+  if (key) {
+    if (command) *command = key->command();
+    if (params) *params = key->params();
+    return true;
   }
   return false;
 }
 
+Key* KeyboardShortcuts::getKeyFromKeyMessage(Message* msg)
+{
+  return findKeyFromKeyMessage(msg, [](const Key*){ return true; });
+}
+
+// Returns the first key in m_keys that is triggered by the keyboard
+// message (like Key::isPressed(msg)) and satisfies the predicate, but
+// looking only the keys that have an accelerator with the pressed
+// scancode/unicode char and modifiers.
+template<typename Pred>
+Key* KeyboardShortcuts::findKeyFromKeyMessage(Message* msg, Pred pred)
+{
+  ASSERT(dynamic_cast<KeyMessage*>(msg) != NULL);
+
+  if (m_accelsIndexDirty)
+    rebuildAccelsIndex();
+
+  KeyModifiers modifiers = msg->keyModifiers();
+  KeyScancode scancode = static_cast<KeyMessage*>(msg)->scancode();
+  int unicodeChar = static_cast<KeyMessage*>(msg)->unicodeChar();
+  Accelerator::preprocessKey(modifiers, scancode, unicodeChar);
+
+  const KeyContext keyContexts[] = { KeyContext::Any, getCurrentKeyContext() };
+  int best = int(m_keys.size());
+
+  for (KeyContext keyContext : keyContexts) {
+    AccelIndexKey indexKeys[3];
+    int n = 0;
+    if (scancode != kKeyNil)
+      indexKeys[n++] = accel_index_key(keyContext, kIndexScancode, modifiers, scancode);
+    if (unicodeChar)
+      indexKeys[n++] = accel_index_key(keyContext, kIndexUnicode, modifiers, unicodeChar);
+    if (scancode == kKeyNil && !unicodeChar)
+      indexKeys[n++] = accel_index_key(keyContext, kIndexModifiers, modifiers, 0);
+
+    for (int i=0; i<n; ++i) {
+      auto it = m_accelsIndex.find(indexKeys[i]);
+      if (it == m_accelsIndex.end())
+        continue;
+
+      // Indexes are sorted, so the first one that satisfies the
+      // predicate is the best candidate of this list.
+      for (int j : it->second) {
+        if (j >= best)
+          break;
+        if (pred(m_keys[j])) {
+          best = j;
+          break;
+        }
+      }
+    }
+
+    // Both contexts are the same one
+    if (keyContext == keyContexts[1])
+      break;
+  }
+
+  return (best < int(m_keys.size()) ? m_keys[best]: NULL);
+}
+
+void KeyboardShortcuts::rebuildAccelsIndex()
+{
+  m_accelsIndex.clear();
+
+  for (int i=0; i<int(m_keys.size()); ++i) {
+    const Key* key = m_keys[i];
+
+    for (const Accelerator& accel : key->accels()) {
+      AccelIndexKey indexKeys[3];
+      int n = 0;
+      if (accel.scancode() != kKeyNil)
+        indexKeys[n++] = accel_index_key(key->keycontext(), kIndexScancode,
+                                         accel.modifiers(), accel.scancode());
+      if (accel.unicodeChar())
+        indexKeys[n++] = accel_index_key(key->keycontext(), kIndexUnicode,
+                                         accel.modifiers(), accel.unicodeChar());
+      if (accel.scancode() == kKeyNil && !accel.unicodeChar())
+        indexKeys[n++] = accel_index_key(key->keycontext(), kIndexModifiers,
+                                         accel.modifiers(), 0);
+
+      for (int k=0; k<n; ++k) {
+        KeyIndexes& indexes = m_accelsIndex[indexKeys[k]];
+        if (indexes.empty() || indexes.back() != i)
+          indexes.push_back(i);
+      }
+    }
+  }
+
+  m_accelsIndexDirty = false;
+}
+
 tools::Tool* KeyboardShortcuts::getCurrentQuicktool(tools::Tool* currentTool)
 {
   if (currentTool && currentTool->getInk(0)->isSelection()) {
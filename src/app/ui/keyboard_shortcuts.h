@@ -13,6 +13,10 @@
 #include "base/convert_to.h"
 #include "base/disable_copying.h"
 #include "ui/accelerator.h"
+
+#include <map>
+#include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 class TiXmlElement;
@@ -148,14 +152,44 @@ namespace app {
     bool getCommandFromKeyMessage(ui::Message* msg, Command** command, Params* params);
     tools::Tool* getCurrentQuicktool(tools::Tool* currentTool);
 
+    // Returns the first key (in the order of the list) triggered by
+    // the given keyboard message in the current key context, or NULL.
+    Key* getKeyFromKeyMessage(ui::Message* msg);
+
   private:
+    friend class Key;
+
+    // Key of the accelerators index, it packs the key context, the
+    // modifiers and the scancode or unicode char of an accelerator.
+    typedef uint64_t AccelIndexKey;
+    // Indexes of m_keys sorted in ascending order.
+    typedef std::vector<int> KeyIndexes;
+    typedef std::unordered_map<AccelIndexKey, KeyIndexes> AccelsIndex;
+
     KeyboardShortcuts();
 
+    Key* addKey(Key* key);
     void exportKeys(TiXmlElement& parent, KeyType type);
     void exportAccel(TiXmlElement& parent, Key* key, const ui::Accelerator& accel, bool removed);
+    void invalidateAccelsIndex() { m_accelsIndexDirty = true; }
+    void rebuildAccelsIndex();
+    template<typename Pred>
+    Key* findKeyFromKeyMessage(ui::Message* msg, Pred pred);
 
     Keys m_keys;
 
+    // Indexes to find keys without walking the whole list (for each
+    // keystroke or each time a modifier is pressed)
+    std::unordered_multimap<Command*, Key*> m_commandKeys;
+    std::unordered_map<tools::Tool*, Key*> m_toolKeys;
+    std::unordered_map<tools::Tool*, Key*> m_quicktoolKeys;
+    std::map<KeyAction, Key*> m_actionKeys;
+
+    // Accelerators index, it's rebuilt the next time it's needed when
+    // some accelerator is changed
+    AccelsIndex m_accelsIndex;
+    bool m_accelsIndexDirty;
+
     DISABLE_COPYING(KeyboardShortcuts);
   };
 
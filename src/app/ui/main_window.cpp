@@ -21,6 +21,7 @@
 #include "app/ui/color_bar.h"
 #include "app/ui/context_bar.h"
 #include "app/ui/devconsole_view.h"
+#include "app/ui/document_hibernator.h"
 #include "app/ui/document_view.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/editor/editor_view.h"
@@ -67,6 +68,9 @@ MainWindow::MainWindow()
   m_workspace->setTabsBar(m_tabsBar);
   m_workspace->ActiveViewChanged.connect(&MainWindow::onActiveViewChange, this);
 
+  m_hibernator = new DocumentHibernator(UIContext::instance(),
+                                        m_workspace, m_timeline);
+
   // configure all widgets to expansives
   m_menuBar->setExpansive(true);
   m_contextBar->setExpansive(true);
@@ -115,6 +119,7 @@ MainWindow::~MainWindow()
       m_workspace->removeView(m_homeView);
     delete m_homeView;
   }
+  delete m_hibernator;
   delete m_contextBar;
   delete m_previewEditor;
 
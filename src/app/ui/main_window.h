@@ -27,6 +27,7 @@ namespace app {
   class ColorBar;
   class ContextBar;
   class DevConsoleView;
+  class DocumentHibernator;
   class DocumentView;
   class HomeView;
   class INotificationDelegate;
@@ -116,6 +117,7 @@ namespace app {
     HomeView* m_homeView;
     DevConsoleView* m_devConsoleView;
     Notifications* m_notifications;
+    DocumentHibernator* m_hibernator;
   };
 
 }
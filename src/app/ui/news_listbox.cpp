@@ -123,6 +123,8 @@ public:
     const std::string& desc)
     : LinkLabel(link, title)
     , m_desc(desc) {
+    // The preferred size depends on the size of the view
+    disableSizeCache();
   }
 
 protected:
@@ -187,11 +189,9 @@ NewsListBox::NewsListBox()
 {
   m_timer.Tick.connect(&NewsListBox::onTick, this);
 
-  std::string cache = Preferences::instance().news.cacheFile();
-  if (!cache.empty() && base::is_file(cache) && validCache(cache))
-    parseFile(cache);
-  else
-    reload();
+  // The news are loaded in the first tick (so they don't delay the
+  // startup)
+  m_timer.start();
 }
 
 NewsListBox::~NewsListBox()
@@ -221,7 +221,19 @@ void NewsListBox::reload()
 
 void NewsListBox::onTick()
 {
-  if (!m_loader || !m_loader->isDone())
+  // First tick, load the cached news or download them
+  if (!m_loader) {
+    m_timer.stop();
+
+    std::string cache = Preferences::instance().news.cacheFile();
+    if (!cache.empty() && base::is_file(cache) && validCache(cache))
+      parseFile(cache);
+    else
+      reload();
+    return;
+  }
+
+  if (!m_loader->isDone())
     return;
 
   std::string fn = m_loader->filename();
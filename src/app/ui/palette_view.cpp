@@ -69,9 +69,13 @@ PaletteView::PaletteView(bool editable, PaletteViewStyle style, PaletteViewDeleg
   , m_isUpdatingColumns(false)
   , m_hot(Hit::NONE)
   , m_copy(false)
+  , m_paintedFgIndex(-1)
+  , m_paintedBgIndex(-1)
+  , m_paintedTransparentIndex(-1)
 {
   setFocusStop(true);
   setDoubleBuffered(true);
+  disableSizeCache();           // Depends on the number of columns
 
   this->border_width.l = this->border_width.r = 1 * guiscale();
   this->border_width.t = this->border_width.b = 1 * guiscale();
@@ -98,13 +102,14 @@ void PaletteView::setColumns(int columns)
 
 void PaletteView::deselect()
 {
-  bool invalidate = (m_selectedEntries.picks() > 0);
+  if (m_selectedEntries.picks() == 0)
+    return;
 
+  PalettePicks oldPicks = m_selectedEntries;
   std::fill(m_selectedEntries.begin(),
             m_selectedEntries.end(), false);
 
-  if (invalidate)
-    this->invalidate();
+  invalidateChangedPicks(oldPicks, -1);
 }
 
 void PaletteView::selectColor(int index)
@@ -112,11 +117,12 @@ void PaletteView::selectColor(int index)
   ASSERT(index >= 0 && index < Palette::MaxColors);
 
   if (m_currentEntry != index || !m_selectedEntries[index]) {
+    int oldEntry = m_currentEntry;
     m_currentEntry = index;
     m_rangeAnchor = index;
 
     update_scroll(m_currentEntry);
-    invalidate();
+    invalidateChangedPicks(m_selectedEntries, oldEntry);
   }
 }
 
@@ -129,6 +135,9 @@ void PaletteView::selectExactMatchColor(const app::Color& color)
 
 void PaletteView::selectRange(int index1, int index2)
 {
+  PalettePicks oldPicks = m_selectedEntries;
+  int oldEntry = m_currentEntry;
+
   m_rangeAnchor = index1;
   m_currentEntry = index2;
 
@@ -136,7 +145,7 @@ void PaletteView::selectRange(int index1, int index2)
             m_selectedEntries.begin()+std::max(index1, index2)+1, true);
 
   update_scroll(index2);
-  invalidate();
+  invalidateChangedPicks(oldPicks, oldEntry);
 }
 
 int PaletteView::getSelectedEntry() const
@@ -277,6 +286,23 @@ void PaletteView::discardClipboardSelection()
   }
 }
 
+void PaletteView::invalidateFgBgIndicators()
+{
+  int fgIndex, bgIndex, transparentIndex;
+  getFgBgIndexes(fgIndex, bgIndex, transparentIndex);
+
+  if (fgIndex == m_paintedFgIndex &&
+      bgIndex == m_paintedBgIndex &&
+      transparentIndex == m_paintedTransparentIndex)
+    return;
+
+  gfx::Region region;
+  for (int i : { m_paintedFgIndex, m_paintedBgIndex, m_paintedTransparentIndex,
+                 fgIndex, bgIndex, transparentIndex })
+    addEntryBounds(region, i);
+  invalidateEntries(region);
+}
+
 bool PaletteView::onProcessMessage(Message* msg)
 {
   switch (msg->type()) {
@@ -408,22 +434,30 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
   ui::Graphics* g = ev.getGraphics();
   gfx::Rect bounds = getClientBounds();
   Palette* palette = get_current_palette();
-  int fgIndex = -1;
-  int bgIndex = -1;
-  int transparentIndex = -1;
-
-  if (m_style == FgBgColors && m_delegate) {
-    fgIndex = findExactIndex(m_delegate->onPaletteViewGetForegroundIndex());
-    bgIndex = findExactIndex(m_delegate->onPaletteViewGetBackgroundIndex());
-
-    if (current_editor && current_editor->sprite()->pixelFormat() == IMAGE_INDEXED)
-      transparentIndex = current_editor->sprite()->transparentColor();
-  }
+  int fgIndex, bgIndex, transparentIndex;
+  getFgBgIndexes(fgIndex, bgIndex, transparentIndex);
+
+  m_paintedColors.resize(palette->size());
+  for (int i=0; i<palette->size(); ++i)
+    m_paintedColors[i] = palette->getEntry(i);
+  m_paintedFgIndex = fgIndex;
+  m_paintedBgIndex = bgIndex;
+  m_paintedTransparentIndex = transparentIndex;
+
+  // Only entries in visible rows are painted (the selection outline
+  // can be painted in the spacing between rows)
+  gfx::Rect clip = g->getClipBounds();
+  clip.enlarge(outlineWidth + this->child_spacing);
+  const int rowHeight = m_boxsize + this->child_spacing;
+  int firstRow = std::max(0, (clip.y - bounds.y - this->border_width.t) / rowHeight);
+  int lastRow = std::max(0, (clip.y2() - bounds.y - this->border_width.t) / rowHeight);
+  int first = firstRow*m_columns;
+  int last = std::min(palette->size(), (lastRow+1)*m_columns);
 
   g->fillRect(gfx::rgba(0, 0, 0), bounds);
 
   // Draw palette entries
-  for (int i=0; i<palette->size(); ++i) {
+  for (int i=first; i<last; ++i) {
     gfx::Rect box = getPaletteEntryBounds(i);
     gfx::Color color = gfx::rgba(
       rgba_getr(palette->getEntry(i)),
@@ -464,7 +498,7 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
   Style::State state = Style::active();
   if (m_hot.part == Hit::OUTLINE) state += Style::hover();
 
-  for (int i=0; i<palette->size(); ++i) {
+  for (int i=first; i<last; ++i) {
     if (!m_selectedEntries[i])
       continue;
 
@@ -486,7 +520,7 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
 
     if (clipboardPalette &&
         clipboardPalette->countDiff(palette, nullptr, nullptr) == 0) {
-      for (int i=0; i<clipboardPicks.size(); ++i) {
+      for (int i=first; i<std::min(last, clipboardPicks.size()); ++i) {
         if (!clipboardPicks[i])
           continue;
 
@@ -596,7 +630,24 @@ void PaletteView::update_scroll(int color)
 
 void PaletteView::onAppPaletteChange()
 {
-  invalidate();
+  Palette* palette = get_current_palette();
+
+  // The marching ants depend on the whole palette
+  if (palette->size() != int(m_paintedColors.size()) ||
+      isMarchingAntsRunning()) {
+    invalidate();
+    return;
+  }
+
+  gfx::Region region;
+  for (int i=0; i<palette->size(); ++i) {
+    if (palette->getEntry(i) != m_paintedColors[i])
+      addEntryBounds(region, i);
+  }
+  invalidateEntries(region);
+
+  // The exact match of RGB fg/bg colors can change too
+  invalidateFgBgIndicators();
 }
 
 gfx::Rect PaletteView::getPaletteEntryBounds(int index) const
@@ -612,6 +663,55 @@ gfx::Rect PaletteView::getPaletteEntryBounds(int index) const
     m_boxsize, m_boxsize);
 }
 
+void PaletteView::invalidateEntries(const gfx::Region& entriesBounds)
+{
+  if (entriesBounds.isEmpty())
+    return;
+
+  gfx::Region region(entriesBounds);
+  region.offset(getBounds().getOrigin());
+  invalidateRegion(region);
+}
+
+void PaletteView::invalidateChangedPicks(const PalettePicks& oldPicks, int oldEntry)
+{
+  gfx::Region region;
+  for (int i=0; i<m_selectedEntries.size(); ++i) {
+    if (oldPicks[i] != m_selectedEntries[i])
+      addEntryBounds(region, i);
+  }
+  addEntryBounds(region, oldEntry);
+  addEntryBounds(region, m_currentEntry);
+  invalidateEntries(region);
+}
+
+// Adds the bounds of the given entry (including the selection
+// outline, which changes in neighbor entries too) in client
+// coordinates.
+void PaletteView::addEntryBounds(gfx::Region& region, int index) const
+{
+  if (index < 0 || index >= Palette::MaxColors)
+    return;
+
+  SkinTheme* theme = static_cast<SkinTheme*>(getTheme());
+  gfx::Rect box = getPaletteEntryBounds(index);
+  box.enlarge(theme->dimensions.paletteOutlineWidth() + this->child_spacing);
+  region.createUnion(region, gfx::Region(box));
+}
+
+void PaletteView::getFgBgIndexes(int& fgIndex, int& bgIndex, int& transparentIndex) const
+{
+  fgIndex = bgIndex = transparentIndex = -1;
+
+  if (m_style == FgBgColors && m_delegate) {
+    fgIndex = findExactIndex(m_delegate->onPaletteViewGetForegroundIndex());
+    bgIndex = findExactIndex(m_delegate->onPaletteViewGetBackgroundIndex());
+
+    if (current_editor && current_editor->sprite()->pixelFormat() == IMAGE_INDEXED)
+      transparentIndex = current_editor->sprite()->transparentColor();
+  }
+}
+
 PaletteView::Hit PaletteView::hitTest(const gfx::Point& pos)
 {
   SkinTheme* theme = static_cast<SkinTheme*>(getTheme());
@@ -12,7 +12,9 @@
 #include "app/color.h"
 #include "app/ui/marching_ants.h"
 #include "base/connection.h"
+#include "doc/color.h"
 #include "doc/palette_picks.h"
+#include "gfx/region.h"
 #include "ui/event.h"
 #include "ui/mouse_buttons.h"
 #include "ui/widget.h"
@@ -73,6 +75,11 @@ namespace app {
     void pasteFromClipboard();
     void discardClipboardSelection();
 
+    // Invalidates the entries where the foreground/background
+    // indicators were painted and the entries where they should be
+    // painted now (instead of invalidating the whole widget).
+    void invalidateFgBgIndicators();
+
     Signal0<void> FocusEnter;
 
   protected:
@@ -118,6 +125,10 @@ namespace app {
     void update_scroll(int color);
     void onAppPaletteChange();
     gfx::Rect getPaletteEntryBounds(int index) const;
+    void invalidateEntries(const gfx::Region& entriesBounds);
+    void invalidateChangedPicks(const doc::PalettePicks& oldPicks, int oldEntry);
+    void addEntryBounds(gfx::Region& region, int index) const;
+    void getFgBgIndexes(int& fgIndex, int& bgIndex, int& transparentIndex) const;
     Hit hitTest(const gfx::Point& pos);
     void dropColors(int beforeIndex);
     void getEntryBoundsAndClip(int i, const doc::PalettePicks& entries,
@@ -141,6 +152,13 @@ namespace app {
     ScopedConnection m_conn;
     Hit m_hot;
     bool m_copy;
+
+    // Colors and indicators painted in the last onPaint() to
+    // invalidate only modified entries.
+    std::vector<doc::color_t> m_paintedColors;
+    int m_paintedFgIndex;
+    int m_paintedBgIndex;
+    int m_paintedTransparentIndex;
   };
 
   ui::WidgetType palette_view_type();
@@ -27,10 +27,11 @@ namespace app {
 using namespace ui;
 using namespace skin;
 
-class ResourceListItem : public ListItem {
+class ResourcesListBox::ResourceListItem : public ListItem {
 public:
   ResourceListItem(Resource* resource)
     : ListItem(resource->name()), m_resource(resource) {
+    disableSizeCache();
   }
 
   Resource* resource() const {
@@ -92,20 +93,16 @@ protected:
   }
 
 private:
-  base::UniquePtr<Resource> m_resource;
+  Resource* m_resource;         // Owned by the ResourcesListBox
 };
 
 class ResourcesListBox::LoadingItem : public ListItem {
 public:
-  LoadingItem()
-    : ListItem("Loading")
-    , m_state(0) {
-  }
-
-  void makeProgress() {
-    std::string text = "Loading ";
+  LoadingItem(int state)
+    : ListItem("Loading ") {
+    std::string text = getText();
 
-    switch ((++m_state) % 4) {
+    switch (state % 4) {
       case 0: text += "/"; break;
       case 1: text += "-"; break;
       case 2: text += "\\"; break;
@@ -114,23 +111,52 @@ public:
 
     setText(text);
   }
+};
+
+class ResourcesListBox::ResourcesModel : public ListBoxModel {
+public:
+  ResourcesModel(ResourcesListBox* listBox)
+    : m_listBox(listBox) {
+  }
+
+  int getItemsCount() override {
+    return int(m_listBox->m_resources.size()) + (m_listBox->m_loading ? 1: 0);
+  }
+
+  ListItem* createItem(int index) override {
+    if (index < int(m_listBox->m_resources.size()))
+      return new ResourceListItem(m_listBox->m_resources[index]);
+    else
+      return new LoadingItem(m_listBox->m_loadingState);
+  }
 
 private:
-  int m_state;
+  ResourcesListBox* m_listBox;
 };
 
 ResourcesListBox::ResourcesListBox(ResourcesLoader* resourcesLoader)
   : m_resourcesLoader(resourcesLoader)
   , m_resourcesTimer(100)
-  , m_loadingItem(NULL)
+  , m_loading(false)
+  , m_loadingState(0)
+  , m_resourcesModel(new ResourcesModel(this))
 {
   m_resourcesTimer.Tick.connect(Bind<void>(&ResourcesListBox::onTick, this));
+
+  setModel(m_resourcesModel);
+}
+
+ResourcesListBox::~ResourcesListBox()
+{
+  for (Resource* resource : m_resources)
+    delete resource;
 }
 
 Resource* ResourcesListBox::selectedResource()
 {
-  if (ResourceListItem* listItem = dynamic_cast<ResourceListItem*>(getSelectedChild()))
-    return listItem->resource();
+  int index = getSelectedIndex();
+  if (index >= 0 && index < int(m_resources.size()))
+    return m_resources[index];
   else
     return NULL;
 }
@@ -184,11 +210,8 @@ void ResourcesListBox::onTick()
     return;
   }
 
-  if (!m_loadingItem) {
-    m_loadingItem = new LoadingItem;
-    addChild(m_loadingItem);
-  }
-  m_loadingItem->makeProgress();
+  m_loading = true;
+  ++m_loadingState;
 
   base::UniquePtr<Resource> resource;
   std::string name;
@@ -199,28 +222,20 @@ void ResourcesListBox::onTick()
 
       PRINTF("Done\n");
     }
+    else
+      resetItems();             // Update the "Loading" item
     return;
   }
 
-  base::UniquePtr<ResourceListItem> listItem(new ResourceListItem(resource));
-  insertChild(getItemsCount()-1, listItem);
-  layout();
-
-  View* view = View::getView(this);
-  if (view)
-    view->updateView();
-
-  resource.release();
-  listItem.release();
+  m_resources.push_back(resource.release());
+  resetItems();
 }
 
 void ResourcesListBox::stop()
 {
-  if (m_loadingItem) {
-    removeChild(m_loadingItem);
-    delete m_loadingItem;
-    m_loadingItem = NULL;
-
+  if (m_loading) {
+    m_loading = false;
+    resetItems();
     invalidate();
   }
 
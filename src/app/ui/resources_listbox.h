@@ -14,11 +14,14 @@
 #include "ui/listbox.h"
 #include "ui/timer.h"
 
+#include <vector>
+
 namespace app {
 
   class ResourcesListBox : public ui::ListBox {
   public:
     ResourcesListBox(ResourcesLoader* resourcesLoader);
+    ~ResourcesListBox();
 
     Resource* selectedResource();
 
@@ -41,8 +44,15 @@ namespace app {
     ResourcesLoader* m_resourcesLoader;
     ui::Timer m_resourcesTimer;
 
+    // Loaded resources (only the visible ones have a ListItem)
+    std::vector<Resource*> m_resources;
+    bool m_loading;             // Show the "Loading" item at the end
+    int m_loadingState;
+
+    class ResourceListItem;
     class LoadingItem;
-    LoadingItem* m_loadingItem;
+    class ResourcesModel;
+    base::UniquePtr<ResourcesModel> m_resourcesModel;
   };
 
 } // namespace app
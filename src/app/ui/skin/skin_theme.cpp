@@ -41,6 +41,8 @@
 
 #include "tinyxml.h"
 
+#include <algorithm>
+
 #define BGCOLOR                 (getWidgetBgColor(widget))
 
 namespace app {
@@ -51,6 +53,45 @@ using namespace ui;
 
 static std::map<std::string, int> sheet_mapping;
 
+// Limits of the cache of pre-composited 3x3-1 parts
+static const int kMaxNinePatchArea = 128*128;
+static const size_t kMaxNinePatches = 64;
+
+// Draws "src" in (x, y) of "dst" (inside the given clipping
+// rectangle) merging the alpha channel of both surfaces, i.e. "dst"
+// can be a transparent surface.
+static void compose_part(she::Surface* dst, she::Surface* src,
+                         int x, int y, const gfx::Rect& clip)
+{
+  gfx::Rect rc = clip;
+  rc &= gfx::Rect(x, y, src->width(), src->height());
+  rc &= gfx::Rect(0, 0, dst->width(), dst->height());
+  if (rc.isEmpty())
+    return;
+
+  she::ScopedSurfaceLock dstLock(dst);
+  she::ScopedSurfaceLock srcLock(src);
+
+  for (int v=rc.y; v<rc.y+rc.h; ++v) {
+    for (int u=rc.x; u<rc.x+rc.w; ++u) {
+      gfx::Color c = srcLock->getPixel(u-x, v-y);
+      int sa = gfx::geta(c);
+      if (sa == 0)
+        continue;
+
+      if (sa < 255) {
+        gfx::Color d = dstLock->getPixel(u, v);
+        int da = gfx::geta(d) * (255-sa) / 255;
+        int a = sa + da;
+        c = gfx::rgba((gfx::getr(c)*sa + gfx::getr(d)*da) / a,
+                      (gfx::getg(c)*sa + gfx::getg(d)*da) / a,
+                      (gfx::getb(c)*sa + gfx::getb(d)*da) / a, a);
+      }
+      dstLock->putPixel(c, u, v);
+    }
+  }
+}
+
 const char* SkinTheme::kThemeCloseButtonId = "theme_close_button";
 
 // Controls the "X" button in a window to close it.
@@ -291,6 +332,8 @@ SkinTheme::~SkinTheme()
     it->second->dispose();
   }
 
+  clearNinePatches();
+
   if (m_sheet)
     m_sheet->dispose();
 
@@ -310,6 +353,10 @@ void SkinTheme::loadSheet()
 {
   TRACE("SkinTheme::loadSheet()\n");
 
+  // Parts are sliced again from the new sheet, maybe in the same
+  // surfaces, so old composited 3x3-1 parts cannot be used anymore.
+  clearNinePatches();
+
   if (m_sheet) {
     m_sheet->dispose();
     m_sheet = NULL;
@@ -1840,7 +1887,8 @@ void SkinTheme::paintTooltip(PaintEvent& ev)
 
 she::Surface* SkinTheme::get_part(const std::string& id) const
 {
-  return get_part_by_id(id)->getBitmap(0);
+  SkinPartPtr part = getPartById(id);
+  return (part ? part->getBitmap(0): NULL);
 }
 
 gfx::Color SkinTheme::getWidgetBgColor(Widget* widget)
@@ -1977,6 +2025,21 @@ void SkinTheme::draw_bounds_template(Graphics* g, const Rect& rc,
   she::Surface* e, she::Surface* se, she::Surface* s,
   she::Surface* sw, she::Surface* w)
 {
+  // Small boxes (buttons, entries, tabs, etc.) are drawn with one
+  // pre-composited surface instead of tiling each piece of the part
+  // in every paint.
+  if (rc.w > 0 && rc.h > 0 && rc.w*rc.h <= kMaxNinePatchArea) {
+    NinePatchKey key;
+    key.parts[0] = nw; key.parts[1] = n;
+    key.parts[2] = ne; key.parts[3] = e;
+    key.parts[4] = se; key.parts[5] = s;
+    key.parts[6] = sw; key.parts[7] = w;
+    key.size = rc.getSize();
+
+    g->drawRgbaSurface(getNinePatch(key), rc.x, rc.y);
+    return;
+  }
+
   int x, y;
 
   // Top
@@ -2033,6 +2096,83 @@ void SkinTheme::draw_bounds_template(Graphics* g, const Rect& rc,
   }
 }
 
+bool SkinTheme::NinePatchKey::operator<(const NinePatchKey& other) const
+{
+  if (size.w != other.size.w) return (size.w < other.size.w);
+  if (size.h != other.size.h) return (size.h < other.size.h);
+  return std::lexicographical_compare(parts, parts+8,
+                                      other.parts, other.parts+8);
+}
+
+she::Surface* SkinTheme::getNinePatch(const NinePatchKey& key)
+{
+  auto it = m_ninePatches.find(key);
+  if (it != m_ninePatches.end())
+    return it->second;
+
+  if (m_ninePatches.size() >= kMaxNinePatches)
+    clearNinePatches();
+
+  she::Surface* nw = key.parts[0];
+  she::Surface* n  = key.parts[1];
+  she::Surface* ne = key.parts[2];
+  she::Surface* e  = key.parts[3];
+  she::Surface* se = key.parts[4];
+  she::Surface* s  = key.parts[5];
+  she::Surface* sw = key.parts[6];
+  she::Surface* w  = key.parts[7];
+  const Rect rc(key.size);
+  int x, y;
+
+  she::Surface* sur = she::instance()->createRgbaSurface(rc.w, rc.h);
+  {
+    she::ScopedSurfaceLock lock(sur);
+    lock->clear();
+  }
+
+  // Same layout of the pieces as in draw_bounds_template()
+
+  // Top
+  compose_part(sur, nw, 0, 0, rc);
+  {
+    Rect clip(nw->width(), 0, rc.w-nw->width()-ne->width(), rc.h);
+    for (x = nw->width(); x < rc.w-ne->width(); x += n->width())
+      compose_part(sur, n, x, 0, clip);
+  }
+  compose_part(sur, ne, rc.w-ne->width(), 0, rc);
+
+  // Bottom
+  compose_part(sur, sw, 0, rc.h-sw->height(), rc);
+  {
+    Rect clip(sw->width(), 0, rc.w-sw->width()-se->width(), rc.h);
+    for (x = sw->width(); x < rc.w-se->width(); x += s->width())
+      compose_part(sur, s, x, rc.h-s->height(), clip);
+  }
+  compose_part(sur, se, rc.w-se->width(), rc.h-se->height(), rc);
+
+  {
+    Rect clip(0, nw->height(), rc.w, rc.h-nw->height()-sw->height());
+
+    // Left
+    for (y = nw->height(); y < rc.h-sw->height(); y += w->height())
+      compose_part(sur, w, 0, y, clip);
+
+    // Right
+    for (y = ne->height(); y < rc.h-se->height(); y += e->height())
+      compose_part(sur, e, rc.w-e->width(), y, clip);
+  }
+
+  m_ninePatches[key] = sur;
+  return sur;
+}
+
+void SkinTheme::clearNinePatches()
+{
+  for (auto& item : m_ninePatches)
+    item.second->dispose();
+  m_ninePatches.clear();
+}
+
 void SkinTheme::draw_bounds_array(ui::Graphics* g, const gfx::Rect& rc, int parts[8])
 {
   int nw = parts[0];
@@ -14,6 +14,7 @@
 #include "app/ui/skin/style_sheet.h"
 #include "gfx/color.h"
 #include "gfx/fwd.h"
+#include "gfx/size.h"
 #include "ui/manager.h"
 #include "ui/theme.h"
 
@@ -103,8 +104,12 @@ namespace app {
         return m_stylesheet.getStyle(id);
       }
 
-      SkinPartPtr getPartById(const std::string& id) {
-        return m_parts_by_id[id];
+      SkinPartPtr getPartById(const std::string& id) const {
+        auto it = m_parts_by_id.find(id);
+        if (it != m_parts_by_id.end())
+          return it->second;
+        else
+          return SkinPartPtr();
       }
 
       int getDimensionById(const std::string& id) {
@@ -120,6 +125,14 @@ namespace app {
       void onRegenerate() override;
 
     private:
+      // Key of a 3x3-1 part pre-composited with a specific size (see
+      // draw_bounds_template())
+      struct NinePatchKey {
+        she::Surface* parts[8];
+        gfx::Size size;
+        bool operator<(const NinePatchKey& other) const;
+      };
+
       void loadSheet();
       void loadFonts();
       void draw_bounds_template(ui::Graphics* g, const gfx::Rect& rc,
@@ -129,6 +142,8 @@ namespace app {
         she::Surface* nw, she::Surface* n, she::Surface* ne,
         she::Surface* e, she::Surface* se, she::Surface* s,
         she::Surface* sw, she::Surface* w);
+      she::Surface* getNinePatch(const NinePatchKey& key);
+      void clearNinePatches();
 
       she::Surface* sliceSheet(she::Surface* sur, const gfx::Rect& bounds);
       gfx::Color getWidgetBgColor(ui::Widget* widget);
@@ -146,6 +161,7 @@ namespace app {
       std::vector<she::Surface*> m_part;
       std::map<std::string, SkinPartPtr> m_parts_by_id;
       std::map<std::string, she::Surface*> m_toolicon;
+      std::map<NinePatchKey, she::Surface*> m_ninePatches;
       std::map<std::string, gfx::Color> m_colors_by_id;
       std::map<std::string, int> m_dimensions_by_id;
       std::vector<ui::Cursor*> m_cursors;
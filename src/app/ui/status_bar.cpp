@@ -144,6 +144,9 @@ StatusBar::StatusBar()
 
   setDoubleBuffered(true);
 
+  // The layout depends on the current document
+  disableResizeCache();
+
   SkinTheme* theme = static_cast<SkinTheme*>(this->getTheme());
   setBgColor(theme->getColorById(kStatusBarFace));
 
@@ -64,6 +64,7 @@ Tabs::Tabs(TabsDelegate* delegate)
   , m_dropNewIndex(-1)
 {
   setDoubleBuffered(true);
+  disableSizeCache();           // Depends on m_tabsHeight
   initTheme();
 
   SkinTheme* theme = static_cast<SkinTheme*>(getTheme());
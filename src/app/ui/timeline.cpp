@@ -39,6 +39,7 @@
 #include "app/ui/workspace.h"
 #include "app/ui_context.h"
 #include "app/util/clipboard.h"
+#include "base/bind.h"
 #include "base/convert_to.h"
 #include "base/memory.h"
 #include "doc/doc.h"
@@ -47,6 +48,7 @@
 #include "gfx/point.h"
 #include "gfx/rect.h"
 #include "she/font.h"
+#include "she/surface.h"
 #include "ui/ui.h"
 
 #include <cstdio>
@@ -118,9 +120,17 @@ Timeline::Timeline()
   , m_confPopup(NULL)
   , m_clipboard_timer(100, this)
   , m_offset_count(0)
+  , m_thumbnails_timer(30, this)
+  , m_thumbnails_unloaded(false)
+  , m_activeCelFirstLink(0)
+  , m_activeCelLastLink(-1)
   , m_scroll(false)
 {
+  disableResizeCache();
+
   m_ctxConn = m_context->AfterCommandExecution.connect(&Timeline::onAfterCommandExecution, this);
+  m_thumbnailsConn = Preferences::instance().timeline.thumbnails.AfterChange.connect(
+    Bind<void>(&Timeline::onThumbnailsChange, this));
   m_context->documents().addObserver(this);
 
   setDoubleBuffered(true);
@@ -130,6 +140,7 @@ Timeline::Timeline()
 Timeline::~Timeline()
 {
   m_clipboard_timer.stop();
+  m_thumbnails_timer.stop();
 
   detachDocument();
   m_context->documents().removeObserver(this);
@@ -193,6 +204,7 @@ void Timeline::detachDocument()
     m_editor = NULL;
   }
 
+  m_thumbnails.clear();
   invalidate();
 }
 
@@ -245,7 +257,21 @@ bool Timeline::onProcessMessage(Message* msg)
       break;
 
     case kTimerMessage:
-      if (static_cast<TimerMessage*>(msg)->timer() == &m_clipboard_timer) {
+      if (static_cast<TimerMessage*>(msg)->timer() == &m_thumbnails_timer) {
+        if (m_thumbnails.update())
+          invalidate();
+        if (!m_thumbnails.hasPendingJobs()) {
+          m_thumbnails_timer.stop();
+
+          // Repaint cels loaded in background since the last paint
+          if (m_thumbnails_unloaded) {
+            m_thumbnails_unloaded = false;
+            invalidate();
+          }
+        }
+        break;
+      }
+      else if (static_cast<TimerMessage*>(msg)->timer() == &m_clipboard_timer) {
         Document* clipboard_document;
         DocumentRange clipboard_range;
         clipboard::get_document_range_info(
@@ -841,6 +867,8 @@ void Timeline::onPaint(ui::PaintEvent& ev)
       }
     }
 
+    updateActiveCelLinks();
+
     // Draw each visible layer.
     for (layer=last_layer; layer>=first_layer; --layer) {
       {
@@ -849,14 +877,14 @@ void Timeline::onPaint(ui::PaintEvent& ev)
           drawLayer(g, layer);
       }
 
-      // Get the first CelIterator to be drawn (it is the first cel with cel->frame >= first_frame)
-      CelIterator it, end;
+      // Get the first CelIterator to be drawn (it is the first cel
+      // with cel->frame >= first_frame), so we don't walk the cels of
+      // frames that are not visible.
+      CelConstIterator it, end;
       Layer* layerPtr = m_layers[layer];
       if (layerPtr->isImage()) {
-        it = static_cast<LayerImage*>(layerPtr)->getCelBegin();
+        it = static_cast<LayerImage*>(layerPtr)->findCel(first_frame);
         end = static_cast<LayerImage*>(layerPtr)->getCelEnd();
-        for (; it != end && (*it)->frame() < first_frame; ++it)
-          ;
       }
 
       IntersectClip clip(g, getCelsBounds());
@@ -986,6 +1014,20 @@ void Timeline::onSelectionChanged(doc::DocumentEvent& ev)
   invalidate();
 }
 
+void Timeline::onSpritePixelsModified(doc::DocumentEvent& ev)
+{
+  // Pixels modified directly (e.g. by the tool loop) don't change the
+  // version of the image of the active cel.
+  if (!Preferences::instance().timeline.thumbnails() || !m_layer)
+    return;
+
+  Cel* cel = m_layer->cel(m_frame);
+  if (cel) {
+    m_thumbnails.invalidateImage(cel->image()->id());
+    invalidateHit(Hit(PART_CEL, getLayerIndex(m_layer), m_frame));
+  }
+}
+
 void Timeline::onStateChanged(Editor* editor)
 {
   m_aniControls.updateUsingEditor(editor);
@@ -1258,12 +1300,11 @@ void Timeline::drawCel(ui::Graphics* g, LayerIndex layerIndex, frame_t frame, Ce
 {
   SkinTheme::Styles& styles = skinTheme()->styles;
   Layer* layer = m_layers[layerIndex];
-  Image* image = (cel ? cel->image(): NULL);
   bool is_hover = (m_hot.part == PART_CEL &&
     m_hot.layer == layerIndex &&
     m_hot.frame == frame);
   bool is_active = (isLayerActive(layerIndex) || isFrameActive(frame));
-  bool is_empty = (image == NULL);
+  bool is_empty = (cel == NULL);
   gfx::Rect bounds = getPartBounds(Hit(PART_CEL, layerIndex, frame));
   IntersectClip clip(g, bounds);
   if (!clip)
@@ -1283,10 +1324,12 @@ void Timeline::drawCel(ui::Graphics* g, LayerIndex layerIndex, frame_t frame, Ce
   else {
     Cel* left = (layer->isImage() ? layer->cel(frame-1): NULL);
     Cel* right = (layer->isImage() ? layer->cel(frame+1): NULL);
-    ObjectId leftImg = (left ? left->image()->id(): 0);
-    ObjectId rightImg = (right ? right->image()->id(): 0);
-    fromLeft = (leftImg == cel->image()->id());
-    fromRight = (rightImg == cel->image()->id());
+    // Linked cels share the same data, so we can compare IDs of
+    // cel data (instead of images that might not be loaded yet)
+    ObjectId leftData = (left ? left->data()->id(): 0);
+    ObjectId rightData = (right ? right->data()->id(): 0);
+    fromLeft = (leftData == cel->data()->id());
+    fromRight = (rightData == cel->data()->id());
 
     if (fromLeft && fromRight)
       style = styles.timelineFromBoth();
@@ -1297,7 +1340,11 @@ void Timeline::drawCel(ui::Graphics* g, LayerIndex layerIndex, frame_t frame, Ce
     else
       style = styles.timelineKeyframe();
   }
-  drawPart(g, bounds, NULL, style, is_active, is_hover);
+
+  // The thumbnail replaces the keyframe icon (links to the left or
+  // right cels are still displayed)
+  if (is_empty || fromLeft || fromRight || !drawCelThumbnail(g, bounds, cel))
+    drawPart(g, bounds, NULL, style, is_active, is_hover);
 
   // Draw decorators to link the activeCel with its links.
   if (layer == m_layer) {
@@ -1311,46 +1358,103 @@ void Timeline::drawCelLinkDecorators(ui::Graphics* g, const gfx::Rect& bounds,
   Cel* cel, Cel* activeCel, frame_t frame, bool is_active, bool is_hover)
 {
   SkinTheme::Styles& styles = skinTheme()->styles;
-  ObjectId imageId = activeCel->image()->id();
-
-  // Link in some cel at the left side
-  bool left = false;
-  for (frame_t fr=frame-1; fr>=0; --fr) {
-    Cel* c = m_layer->cel(fr);
-    if (c && c->image()->id() == imageId) {
-      left = true;
-      break;
-    }
-  }
+  ObjectId dataId = activeCel->data()->id();
 
-  // Link in some cel at the right side
-  bool right = false;
-  for (frame_t fr=frame+1; fr<m_sprite->totalFrames(); ++fr) {
-    Cel* c = m_layer->cel(fr);
-    if (c && c->image()->id() == imageId) {
-      right = true;
-      break;
-    }
-  }
+  // Link in some cel at the left/right side
+  bool left = (m_activeCelFirstLink < frame);
+  bool right = (m_activeCelLastLink > frame);
 
-  if (!cel || cel->image()->id() != imageId) {
+  if (!cel || cel->data()->id() != dataId) {
     if (left && right)
       drawPart(g, bounds, NULL, styles.timelineBothLinks(), is_active, is_hover);
   }
   else {
     if (left) {
       Cel* prevCel = m_layer->cel(cel->frame()-1);
-      if (!prevCel || prevCel->image()->id() != imageId)
+      if (!prevCel || prevCel->data()->id() != dataId)
         drawPart(g, bounds, NULL, styles.timelineLeftLink(), is_active, is_hover);
     }
     if (right) {
       Cel* nextCel = m_layer->cel(cel->frame()+1);
-      if (!nextCel || nextCel->image()->id() != imageId)
+      if (!nextCel || nextCel->data()->id() != dataId)
         drawPart(g, bounds, NULL, styles.timelineRightLink(), is_active, is_hover);
     }
   }
 }
 
+bool Timeline::drawCelThumbnail(ui::Graphics* g, const gfx::Rect& bounds, Cel* cel)
+{
+  if (!Preferences::instance().timeline.thumbnails())
+    return false;
+
+  gfx::Rect rc = bounds;
+  rc.shrink(guiscale());
+  if (rc.isEmpty())
+    return false;
+
+  // Cels that are still being loaded (see
+  // Document::preloadCelImages()) display the keyframe icon as a
+  // placeholder, and the timer checks them again later.
+  if (!cel->data()->isImageLoaded()) {
+    m_thumbnails_unloaded = true;
+    if (!m_thumbnails_timer.isRunning())
+      m_thumbnails_timer.start();
+    return false;
+  }
+
+  she::Surface* thumbnail = m_thumbnails.get(m_document, cel, rc.getSize());
+  if (!thumbnail) {
+    if (m_thumbnails.hasPendingJobs() && !m_thumbnails_timer.isRunning())
+      m_thumbnails_timer.start();
+    return false;
+  }
+
+  g->drawRgbaSurface(thumbnail,
+    rc.x + rc.w/2 - thumbnail->width()/2,
+    rc.y + rc.h/2 - thumbnail->height()/2);
+  return true;
+}
+
+// Calculates the range of frames where the data of the active cel
+// is used, walking the cels of the active layer just one time
+// (instead of doing it for each cel in drawCelLinkDecorators()).
+void Timeline::updateActiveCelLinks()
+{
+  m_activeCelFirstLink = 0;
+  m_activeCelLastLink = -1;
+
+  if (!m_layer || !m_layer->isImage())
+    return;
+
+  Cel* activeCel = m_layer->cel(m_frame);
+  if (!activeCel)
+    return;
+
+  ObjectId dataId = activeCel->data()->id();
+  bool first = true;
+  LayerImage* layer = static_cast<LayerImage*>(m_layer);
+  CelConstIterator it = layer->getCelBegin();
+  CelConstIterator end = layer->getCelEnd();
+  for (; it != end; ++it) {
+    const Cel* cel = *it;
+    if (cel->data()->id() != dataId)
+      continue;
+
+    if (first) {
+      m_activeCelFirstLink = cel->frame();
+      first = false;
+    }
+    m_activeCelLastLink = cel->frame();
+  }
+}
+
+void Timeline::onThumbnailsChange()
+{
+  m_thumbnails_timer.stop();
+  m_thumbnails.clear();
+  invalidate();
+}
+
 void Timeline::drawFrameTags(ui::Graphics* g)
 {
   IntersectClip clip(g, getPartBounds(Hit(PART_HEADER_FRAME_TAGS)));
@@ -1986,9 +2090,10 @@ void Timeline::updateStatusBar(ui::Message* msg)
       case PART_HEADER_FRAME:
         if (validFrame(m_hot.frame)) {
           sb->setStatusText(0,
-            "Frame %d [%d msecs]",
+            "Frame %d [%d msecs] starts at %.3f secs",
             (int)m_hot.frame+1,
-            m_sprite->frameDuration(m_hot.frame));
+            m_sprite->frameDuration(m_hot.frame),
+            m_sprite->frameTime(m_hot.frame) / 1000.0);
           return;
         }
         break;
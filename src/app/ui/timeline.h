@@ -12,6 +12,7 @@
 #include "app/document_range.h"
 #include "app/pref/preferences.h"
 #include "app/ui/ani_controls.h"
+#include "app/ui/cel_thumbnails.h"
 #include "app/ui/editor/editor_observer.h"
 #include "app/ui/input_chain_element.h"
 #include "base/connection.h"
@@ -96,6 +97,9 @@ namespace app {
     // called from popup menus.
     void dropRange(DropOp op);
 
+    const CelThumbnails& thumbnails() const { return m_thumbnails; }
+    CelThumbnails& thumbnails() { return m_thumbnails; }
+
   protected:
     bool onProcessMessage(ui::Message* msg) override;
     void onPreferredSize(ui::PreferredSizeEvent& ev) override;
@@ -108,6 +112,7 @@ namespace app {
     void onAddFrame(doc::DocumentEvent& ev) override;
     void onRemoveFrame(doc::DocumentEvent& ev) override;
     void onSelectionChanged(doc::DocumentEvent& ev) override;
+    void onSpritePixelsModified(doc::DocumentEvent& ev) override;
 
     // app::Context slots.
     void onAfterCommandExecution(Command* command);
@@ -192,6 +197,9 @@ namespace app {
     void drawCel(ui::Graphics* g, LayerIndex layerIdx, frame_t frame, Cel* cel);
     void drawCelLinkDecorators(ui::Graphics* g, const gfx::Rect& bounds,
       Cel* cel, Cel* activeCel, frame_t frame, bool is_active, bool is_hover);
+    bool drawCelThumbnail(ui::Graphics* g, const gfx::Rect& bounds, Cel* cel);
+    void updateActiveCelLinks();
+    void onThumbnailsChange();
     void drawFrameTags(ui::Graphics* g);
     void drawRangeOutline(ui::Graphics* g);
     void drawPaddings(ui::Graphics* g);
@@ -267,6 +275,18 @@ namespace app {
     ui::Timer m_clipboard_timer;
     int m_offset_count;
 
+    // Thumbnails of cels (generated in background) and the timer to
+    // check when they are ready.
+    CelThumbnails m_thumbnails;
+    ui::Timer m_thumbnails_timer;
+    bool m_thumbnails_unloaded;     // Some cel wasn't loaded in the last paint
+    ScopedConnection m_thumbnailsConn;
+
+    // First and last frames where the image of the active cel is
+    // used (calculated once for each paint to draw the links).
+    frame_t m_activeCelFirstLink;
+    frame_t m_activeCelLastLink;
+
     bool m_scroll;   // True if the drag-and-drop operation is a scroll operation.
     bool m_copy;     // True if the drag-and-drop operation is a copy.
 
@@ -84,6 +84,7 @@ ToolBar::ToolBar()
   , m_tipTimer(300, this)
 {
   m_instance = this;
+  disableSizeCache();           // Depends on the tool groups
 
   this->border_width.l = 1*guiscale();
   this->border_width.t = 0;
@@ -44,6 +44,7 @@ Workspace::Workspace()
 {
   SkinTheme* theme = static_cast<SkinTheme*>(getTheme());
   setBgColor(theme->colors.workspace());
+  disableResizeCache();
 
   addChild(&m_mainPanel);
 }
@@ -50,6 +50,9 @@ WorkspacePanel::WorkspacePanel(PanelType panelType)
 {
   SkinTheme* theme = static_cast<SkinTheme*>(getTheme());
   setBgColor(theme->colors.workspace());
+
+  // The active view is resized by the drop area animation
+  disableResizeCache();
 }
 
 WorkspacePanel::~WorkspacePanel()
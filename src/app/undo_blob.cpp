@@ -0,0 +1,154 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/undo_blob.h"
+
+#include "base/exception.h"
+#include "base/thread_pool.h"
+#include "doc/image.h"
+#include "doc/image_io.h"
+#include "zlib.h"
+
+#include <sstream>
+
+namespace app {
+
+// We prefer speed over size (old undo states are compressed while
+// the user is still working)
+const int kCompressionLevel = 1;
+
+UndoBlob::UndoBlob(const std::string& data)
+  : m_data(data)
+  , m_rawSize(data.size())
+  , m_isImage(false)
+  , m_compressed(false)
+{
+  updateMemSize();
+}
+
+UndoBlob::UndoBlob(const doc::ImageRef& image)
+  : m_image(image)
+  , m_rawSize(image->getMemSize())
+  , m_isImage(true)
+  , m_compressed(false)
+{
+  updateMemSize();
+}
+
+// static
+void UndoBlob::compressLater(const UndoBlobPtr& blob)
+{
+  std::weak_ptr<UndoBlob> weak(blob);
+
+  base::thread_pool::global().execute(
+    [weak]{
+      UndoBlobPtr blob = weak.lock();
+      if (blob)
+        blob->compress();
+    },
+    base::thread_pool::priority::low);
+}
+
+std::string UndoBlob::takeData()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ASSERT(!m_isImage);
+
+  std::string data;
+  if (m_compressed) {
+    data.resize(m_rawSize);
+    uLongf size = uLongf(m_rawSize);
+    int err = uncompress((Bytef*)&data[0], &size,
+                         (const Bytef*)m_data.c_str(), uLong(m_data.size()));
+    if (err != Z_OK || size != m_rawSize)
+      throw base::Exception("ZLib error %d uncompressing undo information.", err);
+  }
+  else
+    data.swap(m_data);
+
+  m_data.clear();
+  m_compressed = false;
+  updateMemSize();
+  return data;
+}
+
+doc::ImageRef UndoBlob::takeImage()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ASSERT(m_isImage);
+
+  doc::ImageRef image;
+  if (m_compressed) {
+    std::stringstream s(m_data);
+    image.reset(doc::read_image(s, false));
+    if (!image)
+      throw base::Exception("Invalid image in undo information.");
+  }
+  else
+    image = m_image;
+
+  m_image.reset();
+  m_data.clear();
+  m_compressed = false;
+  updateMemSize();
+  return image;
+}
+
+// Executed in a worker thread. The mutex is locked all the time so
+// takeData()/takeImage() wait the compression instead of copying the
+// data in the meantime.
+void UndoBlob::compress()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_compressed)
+    return;
+
+  try {
+    if (m_isImage) {
+      if (!m_image)             // The image was already taken
+        return;
+
+      std::stringstream s;
+      doc::write_image(s, m_image.get(), kCompressionLevel);
+      m_data = s.str();
+      m_image.reset();
+    }
+    else {
+      if (m_data.empty())
+        return;
+
+      std::string data(compressBound(uLong(m_data.size())), 0);
+      uLongf size = uLongf(data.size());
+      if (compress2((Bytef*)&data[0], &size,
+                    (const Bytef*)m_data.c_str(), uLong(m_data.size()),
+                    kCompressionLevel) != Z_OK ||
+          size >= m_data.size())  // Keep incompressible data as it is
+        return;
+
+      // Copy the compressed bytes to release the unused capacity
+      std::string(data.c_str(), size).swap(m_data);
+    }
+    m_compressed = true;
+    updateMemSize();
+  }
+  catch (const std::exception&) {
+    // Keep the original data
+  }
+}
+
+// The mutex must be locked (or the blob is being constructed)
+void UndoBlob::updateMemSize()
+{
+  m_memSize = sizeof(*this) + m_data.size() +
+    (m_image ? m_image->getMemSize(): 0);
+}
+
+} // namespace app
@@ -0,0 +1,64 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_UNDO_BLOB_H_INCLUDED
+#define APP_UNDO_BLOB_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/image_ref.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace app {
+
+  // Undo information of a command (raw bytes or an image copy) that
+  // is compressed in a background thread when the command is old
+  // enough (see DocumentUndo). The original data is restored when
+  // the command needs it again (i.e. when it's undone/redone).
+  class UndoBlob {
+  public:
+    explicit UndoBlob(const std::string& data);
+    explicit UndoBlob(const doc::ImageRef& image);
+
+    // Compresses the blob in a low priority task of the global
+    // thread pool. Nothing is done if the blob is destroyed before
+    // the task starts.
+    static void compressLater(const std::shared_ptr<UndoBlob>& blob);
+
+    // It doesn't wait the compression (returns the current size).
+    std::size_t memSize() const { return m_memSize; }
+
+    // Returns the original data (waiting the compression if it's in
+    // progress) and leaves the blob empty.
+    std::string takeData();
+    doc::ImageRef takeImage();
+
+  private:
+    void compress();
+    void updateMemSize();
+
+    mutable std::mutex m_mutex;
+    std::string m_data;         // Raw bytes or the compressed data
+    doc::ImageRef m_image;      // Image not compressed yet
+    std::size_t m_rawSize;      // Size of the uncompressed bytes
+    bool m_isImage;
+    bool m_compressed;
+    std::atomic<std::size_t> m_memSize;
+
+    DISABLE_COPYING(UndoBlob);
+  };
+
+  typedef std::shared_ptr<UndoBlob> UndoBlobPtr;
+
+} // namespace app
+
+#endif
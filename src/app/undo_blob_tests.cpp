@@ -0,0 +1,77 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "tests/test.h"
+
+#include "app/undo_blob.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+// Waits the background compression of the blob
+void wait_compression(const UndoBlobPtr& blob, std::size_t rawSize)
+{
+  for (int i=0; i<1000 && blob->memSize() >= rawSize; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+} // anonymous namespace
+
+TEST(UndoBlob, Data)
+{
+  std::string data;
+  for (int i=0; i<64*1024; ++i)
+    data.push_back(char((i/256) & 3));
+
+  UndoBlobPtr blob = std::make_shared<UndoBlob>(data);
+  UndoBlob::compressLater(blob);
+  wait_compression(blob, data.size());
+  EXPECT_LT(blob->memSize(), data.size() / 10);
+
+  EXPECT_EQ(data, blob->takeData());
+  EXPECT_EQ("", blob->takeData());
+}
+
+TEST(UndoBlob, Image)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 64, 64));
+  clear_image(image.get(), rgba(0, 0, 0, 0));
+  for (int x=0; x<64; ++x)
+    put_pixel(image.get(), x, x, rgba(255, x, 0, 255));
+
+  UndoBlobPtr blob = std::make_shared<UndoBlob>(ImageRef(Image::createCopy(image.get())));
+  UndoBlob::compressLater(blob);
+  wait_compression(blob, image->getMemSize());
+  EXPECT_LT(blob->memSize(), std::size_t(image->getMemSize()));
+
+  ImageRef copy = blob->takeImage();
+  ASSERT_TRUE(copy.get() != nullptr);
+  EXPECT_EQ(64, copy->width());
+  EXPECT_EQ(64, copy->height());
+  EXPECT_EQ(0, count_diff_between_images(image.get(), copy.get()));
+}
+
+TEST(UndoBlob, TakeBeforeCompression)
+{
+  UndoBlobPtr blob = std::make_shared<UndoBlob>(std::string("abc"));
+  EXPECT_EQ("abc", blob->takeData());
+
+  // The task doesn't find anything to compress
+  UndoBlob::compressLater(blob);
+  blob.reset();
+}
@@ -0,0 +1,103 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/undo_swap_file.h"
+
+#include "base/exception.h"
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "base/mutex.h"
+#include "base/path.h"
+#include "base/scoped_lock.h"
+
+#include <atomic>
+
+namespace app {
+
+static base::mutex swap_dir_mutex;
+static std::string swap_dir;
+static std::atomic<int> swap_counter(0);
+
+// static
+void UndoSwapFile::setDirectory(const std::string& dir)
+{
+  base::scoped_lock lock(swap_dir_mutex);
+  swap_dir = dir;
+}
+
+UndoSwapFile::UndoSwapFile()
+  : m_file(nullptr)
+  , m_size(0)
+{
+}
+
+UndoSwapFile::~UndoSwapFile()
+{
+  if (m_file) {
+    fclose(m_file);
+
+    if (!m_filename.empty()) {
+      try {
+        base::delete_file(m_filename);
+      }
+      catch (...) {
+        // Stale swap files are deleted with the session directory
+      }
+    }
+  }
+}
+
+std::size_t UndoSwapFile::write(const void* data, std::size_t size)
+{
+  if (!m_file) {
+    std::string dir;
+    {
+      base::scoped_lock lock(swap_dir_mutex);
+      dir = swap_dir;
+    }
+
+    if (!dir.empty()) {
+      char buf[64];
+      std::sprintf(buf, "undo-%d.%s", ++swap_counter, extension());
+      m_filename = base::join_path(dir, buf);
+      m_file = base::open_file_raw(m_filename, "w+b");
+      if (!m_file)
+        m_filename.clear();
+    }
+
+    // Fallback to the system temporary directory
+    if (!m_file)
+      m_file = std::tmpfile();
+    if (!m_file)
+      throw base::Exception("Cannot create the temporary file for undo information");
+  }
+
+  std::size_t pos = m_size;
+  if (fseek(m_file, long(pos), SEEK_SET) != 0 ||
+      fwrite(data, 1, size, m_file) != size)
+    throw base::Exception("Error writing undo information in the temporary file");
+
+  m_size += size;
+  return pos;
+}
+
+void UndoSwapFile::read(std::size_t pos, void* data, std::size_t size)
+{
+  ASSERT(m_file);
+  ASSERT(pos+size <= m_size);
+
+  if (!m_file ||
+      fseek(m_file, long(pos), SEEK_SET) != 0 ||
+      fread(data, 1, size, m_file) != size)
+    throw base::Exception("Error reading undo information from the temporary file");
+}
+
+} // namespace app
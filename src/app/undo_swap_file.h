@@ -0,0 +1,56 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef APP_UNDO_SWAP_FILE_H_INCLUDED
+#define APP_UNDO_SWAP_FILE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace app {
+
+  // Temporary file where the data of old undo states is saved to
+  // keep bounded the memory used by the undo history. The file is
+  // created when the first block is written, and it's deleted
+  // automatically when it's closed.
+  //
+  // Files are created in the directory of the data recovery session
+  // in progress (see setDirectory()), or with std::tmpfile() if
+  // there is no session.
+  class UndoSwapFile {
+  public:
+    UndoSwapFile();
+    ~UndoSwapFile();
+
+    // Saves the given data at the end of the file and returns its
+    // position to read it later. Throws an exception if the data
+    // cannot be saved.
+    std::size_t write(const void* data, std::size_t size);
+    void read(std::size_t pos, void* data, std::size_t size);
+
+    std::size_t size() const { return m_size; }
+
+    // Directory for new swap files (an empty string to use
+    // std::tmpfile()). Files are named "undo-N.swap".
+    static void setDirectory(const std::string& dir);
+    static const char* extension() { return "swap"; }
+
+  private:
+    FILE* m_file;
+    std::string m_filename;
+    std::size_t m_size;
+
+    DISABLE_COPYING(UndoSwapFile);
+  };
+
+} // namespace app
+
+#endif
@@ -91,6 +91,19 @@ static ImageRef clipboard_image;
 static ClipboardRange clipboard_range;
 static gfx::Point clipboard_pos(0, 0);
 
+#ifdef USE_NATIVE_WIN32_CLIPBOARD
+// Sequence number of the Windows clipboard when its content was
+// changed/read by us. If it's the same, the Windows clipboard still
+// contains our clipboard_image, so we can use it directly (instead of
+// converting the Windows bitmap to a new image).
+static DWORD clipboard_win32_seq = 0;
+
+static bool win32_clipboard_changed()
+{
+  return (GetClipboardSequenceNumber() != clipboard_win32_seq);
+}
+#endif
+
 static void on_exit_delete_clipboard()
 {
   clipboard_palette.reset();
@@ -112,6 +125,7 @@ static void set_clipboard_image(Image* image, Palette* palette, bool set_system_
 #ifdef USE_NATIVE_WIN32_CLIPBOARD
   if (set_system_clipboard)
     set_win32_clipboard_bitmap(image, palette);
+  clipboard_win32_seq = GetClipboardSequenceNumber();
 #endif
 
   clipboard_range.invalidate();
@@ -138,7 +152,7 @@ static bool copy_from_document(const Site& site)
 clipboard::ClipboardFormat clipboard::get_current_format()
 {
 #ifdef USE_NATIVE_WIN32_CLIPBOARD
-  if (win32_clipboard_contains_bitmap())
+  if (win32_clipboard_changed() && win32_clipboard_contains_bitmap())
     return ClipboardImage;
 #endif
 
@@ -246,8 +260,9 @@ void clipboard::paste()
 
     case clipboard::ClipboardImage: {
 #ifdef USE_NATIVE_WIN32_CLIPBOARD
-      // Get the image from the clipboard.
-      {
+      // Get the image from the clipboard (only if it was changed by
+      // other application).
+      if (win32_clipboard_changed()) {
         Image* win32_image = NULL;
         Palette* win32_palette = NULL;
         get_win32_clipboard_bitmap(win32_image, win32_palette);
@@ -280,8 +295,9 @@ void clipboard::paste()
             false));
       }
 
-      // Change to MovingPixelsState
-      editor->pasteImage(src_image.get(), clipboard_pos);
+      // Change to MovingPixelsState (the image is shared with the
+      // clipboard, it isn't copied)
+      editor->pasteImage(src_image, clipboard_pos);
       break;
     }
 
@@ -417,8 +433,10 @@ bool clipboard::get_image_size(gfx::Size& size)
 {
 #ifdef USE_NATIVE_WIN32_CLIPBOARD
   // Get the image from the clipboard.
-  return get_win32_clipboard_bitmap_size(size);
-#else
+  if (win32_clipboard_changed())
+    return get_win32_clipboard_bitmap_size(size);
+#endif
+
   if (clipboard_image) {
     size.w = clipboard_image->width();
     size.h = clipboard_image->height();
@@ -426,7 +444,6 @@ bool clipboard::get_image_size(gfx::Size& size)
   }
   else
     return false;
-#endif
 }
 
 Palette* clipboard::get_palette()
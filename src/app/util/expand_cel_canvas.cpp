@@ -11,7 +11,6 @@
 
 #include "app/util/expand_cel_canvas.h"
 
-#include "app/app.h"
 #include "app/cmd/add_cel.h"
 #include "app/cmd/copy_region.h"
 #include "app/cmd/replace_image.h"
@@ -21,35 +20,16 @@
 #include "app/transaction.h"
 #include "app/util/range_utils.h"
 #include "base/unique_ptr.h"
+#include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/image.h"
+#include "doc/image_buffer_recycler.h"
 #include "doc/layer.h"
 #include "doc/primitives.h"
 #include "doc/site.h"
 #include "doc/sprite.h"
 
-namespace {
-
-static doc::ImageBufferPtr src_buffer;
-static doc::ImageBufferPtr dst_buffer;
-
-static void destroy_buffers()
-{
-  src_buffer.reset(NULL);
-  dst_buffer.reset(NULL);
-}
-
-static void create_buffers()
-{
-  if (!src_buffer) {
-    app::App::instance()->Exit.connect(&destroy_buffers);
-
-    src_buffer.reset(new doc::ImageBuffer(1));
-    dst_buffer.reset(new doc::ImageBuffer(1));
-  }
-}
-
-}
+#include <cstring>
 
 namespace app {
 
@@ -68,8 +48,6 @@ ExpandCelCanvas::ExpandCelCanvas(Site site,
   , m_committed(false)
   , m_transaction(transaction)
 {
-  create_buffers();
-
   if (m_layer->isImage()) {
     m_cel = m_layer->cel(site.frame());
     if (m_cel)
@@ -142,8 +120,13 @@ void ExpandCelCanvas::commit()
     // We can temporary remove the cel.
     static_cast<LayerImage*>(m_layer)->removeCel(m_cel);
 
-    // Add a copy of m_dstImage in the sprite's image stock
-    ImageRef newImage(Image::createCopy(m_dstImage.get()));
+    // Add a copy of the painted area of m_dstImage in the sprite's
+    // image stock
+    gfx::Rect trimmed = getTrimmedBounds();
+    ImageRef newImage(crop_image(m_dstImage.get(),
+        trimmed.x, trimmed.y, trimmed.w, trimmed.h,
+        m_dstImage->maskColor()));
+    m_cel->setPosition(m_bounds.x+trimmed.x, m_bounds.y+trimmed.y);
     m_cel->data()->setImage(newImage);
 
     // And finally we add the cel again in the layer.
@@ -155,39 +138,76 @@ void ExpandCelCanvas::commit()
       m_document->context()->notifyActiveSiteChanged();
   }
   else if (m_celImage) {
+    // Areas where the tool could have painted
+    gfx::Region modified(m_validDstRegion);
+    gfx::Rect trimmed(m_dstImage->bounds());
+
     // If the size of each image is the same, we can create an undo
     // with only the differences between both images.
-    if (m_cel->position() == m_origCelPos &&
-        m_bounds.getOrigin() == m_origCelPos &&
-        m_celImage->width() == m_dstImage->width() &&
-        m_celImage->height() == m_dstImage->height()) {
-      int dx = -m_bounds.x + m_origCelPos.x;
-      int dy = -m_bounds.y + m_origCelPos.y;
-
-      if ((m_flags & UseModifiedRegionAsUndoInfo) != UseModifiedRegionAsUndoInfo) {
-        // TODO Reduce m_validDstRegion to modified areas between
-        //      m_celImage and m_dstImage
+    bool sameBounds =
+      (m_cel->position() == m_origCelPos &&
+       m_bounds.getOrigin() == m_origCelPos &&
+       m_celImage->width() == m_dstImage->width() &&
+       m_celImage->height() == m_dstImage->height());
+
+    const bool autoShrink = ((m_flags & AutoShrink) == AutoShrink);
+
+    // Painting inside the cel keeps its bounds if the borders of the
+    // cel still have painted pixels, so we can avoid validating and
+    // trimming the whole m_dstImage (which can be huge). And if the
+    // canvas is the cel itself (e.g. a cel with the sprite size), the
+    // same check tells us if the borders were erased, so the cel can
+    // be shrunk.
+    if (!m_layer->isBackground()) {
+      if (!sameBounds) {
+        if (keepsCelBounds(modified))
+          sameBounds = true;
       }
+      else if (autoShrink && !keepsCelBounds(modified))
+        sameBounds = false;
+    }
+
+    if (!sameBounds) {
+      // Validate the whole m_dstImage copying invalid areas from m_celImage
+      validateDestCanvas(gfx::Region(m_bounds));
 
-      // Copy the destination to the cel image.
-      m_transaction.execute(new cmd::CopyRegion(
-          m_celImage.get(), m_dstImage.get(), m_validDstRegion, dx, dy));
+      // The painted area could be the same one of the cel (e.g. if we
+      // paint inside a cel, the canvas is expanded to the sprite
+      // bounds and then trimmed again).
+      trimmed = getTrimmedBounds();
+      if (!autoShrink)
+        trimmed |= gfx::Rect(m_origCelPos - m_bounds.getOrigin(),
+                             m_celImage->size()).createIntersection(m_dstImage->bounds());
+      sameBounds =
+        (gfx::Rect(m_bounds.x+trimmed.x, m_bounds.y+trimmed.y, trimmed.w, trimmed.h) ==
+         gfx::Rect(m_origCelPos, m_celImage->size()));
+    }
+
+    if (sameBounds) {
+      int dx = m_bounds.x - m_origCelPos.x;
+      int dy = m_bounds.y - m_origCelPos.y;
+      m_cel->setPosition(m_origCelPos);
+
+      // Copy the destination to the cel image. The undo information
+      // contains only the tiles with modified pixels.
+      gfx::Region undoRgn = getModifiedTiles(modified, dx, dy);
+      if (!undoRgn.isEmpty())
+        m_transaction.execute(new cmd::CopyRegion(
+            m_celImage.get(), m_dstImage.get(), undoRgn, dx, dy));
     }
     // If the size of both images are different, we have to
     // replace the entire image.
     else {
-      if (m_cel->position() != m_origCelPos) {
-        gfx::Point newPos = m_cel->position();
-        m_cel->setPosition(m_origCelPos);
+      gfx::Point newPos(m_bounds.x+trimmed.x, m_bounds.y+trimmed.y);
+      m_cel->setPosition(m_origCelPos);
+      if (newPos != m_origCelPos)
         m_transaction.execute(new cmd::SetCelPosition(m_cel, newPos.x, newPos.y));
-      }
-
-      // Validate the whole m_dstImage copying invalid areas from m_celImage
-      validateDestCanvas(gfx::Region(m_bounds));
 
       // Replace the image in the stock. We need to create a copy of
       // image because m_dstImage's ImageBuffer cannot be shared.
-      ImageRef newImage(Image::createCopy(m_dstImage.get()));
+      ImageRef newImage(crop_image(m_dstImage.get(),
+          trimmed.x, trimmed.y, trimmed.w, trimmed.h,
+          m_dstImage->maskColor()));
       m_transaction.execute(new cmd::ReplaceImage(
           m_sprite, m_celImage, newImage));
     }
@@ -216,13 +236,124 @@ void ExpandCelCanvas::rollback()
   m_closed = true;
 }
 
+gfx::Rect ExpandCelCanvas::getTrimmedBounds()
+{
+  gfx::Rect bounds = m_dstImage->bounds();
+
+  // Transparent borders of images in transparent layers aren't
+  // kept, so the memory used by a cel depends on its painted area
+  // (and not on the sprite size). Background cels and completely
+  // transparent images are kept as they are.
+  if (!m_layer->isBackground()) {
+    gfx::Rect painted;
+    if (doc::algorithm::shrink_bounds(m_dstImage.get(), painted,
+                                      m_dstImage->maskColor()))
+      bounds = painted;
+  }
+
+  return bounds;
+}
+
+// Returns true if some pixel of "image" inside "rgn" is not the mask color
+static bool has_painted_pixels(const Image* image, const gfx::Region& rgn)
+{
+  const color_t mask = image->maskColor();
+  for (const auto& rc : rgn)
+    for (int y=rc.y; y<rc.y2(); ++y)
+      for (int x=rc.x; x<rc.x2(); ++x)
+        if (get_pixel(image, x, y) != mask)
+          return true;
+  return false;
+}
+
+bool ExpandCelCanvas::keepsCelBounds(const gfx::Region& modified)
+{
+  // Cel bounds in m_dstImage coordinates
+  gfx::Rect celBounds(m_origCelPos - m_bounds.getOrigin(), m_celImage->size());
+
+  // The tool painted outside the cel
+  gfx::Region outside;
+  outside.createSubtraction(modified, gfx::Region(celBounds));
+  if (has_painted_pixels(m_dstImage.get(), outside))
+    return false;
+
+  // The trimmed bounds are the cel bounds only if each border (row or
+  // column) of the cel bounds has painted pixels (in m_dstImage where
+  // it's valid, or in m_celImage)
+  const gfx::Rect borders[] = {
+    gfx::Rect(celBounds.x, celBounds.y, celBounds.w, 1),
+    gfx::Rect(celBounds.x, celBounds.y2()-1, celBounds.w, 1),
+    gfx::Rect(celBounds.x, celBounds.y, 1, celBounds.h),
+    gfx::Rect(celBounds.x2()-1, celBounds.y, 1, celBounds.h),
+  };
+
+  for (const gfx::Rect& border : borders) {
+    gfx::Region dstRgn(border);
+    dstRgn.createIntersection(dstRgn, modified);
+
+    gfx::Region celRgn(border);
+    celRgn.createSubtraction(celRgn, modified);
+    celRgn.offset(-celBounds.x, -celBounds.y);
+
+    if (!has_painted_pixels(m_dstImage.get(), dstRgn) &&
+        !has_painted_pixels(m_celImage.get(), celRgn))
+      return false;
+  }
+
+  return true;
+}
+
+gfx::Region ExpandCelCanvas::getModifiedTiles(const gfx::Region& rgn, int dx, int dy)
+{
+  const int kTileSize = 64;
+
+  // Area of m_dstImage that is inside the cel image
+  gfx::Region area(m_celImage->bounds().offset(-dx, -dy));
+  area.createIntersection(area, rgn);
+  area.createIntersection(area, gfx::Region(m_dstImage->bounds()));
+
+  gfx::Region result;
+  gfx::Rect bounds = area.bounds();
+  int x0 = bounds.x - (bounds.x % kTileSize);
+  int y0 = bounds.y - (bounds.y % kTileSize);
+
+  for (int ty=y0; ty<bounds.y2(); ty+=kTileSize) {
+    for (int tx=x0; tx<bounds.x2(); tx+=kTileSize) {
+      gfx::Region tileRgn(gfx::Rect(tx, ty, kTileSize, kTileSize));
+      tileRgn.createIntersection(tileRgn, area);
+
+      bool modified = false;
+      for (const auto& rc : tileRgn) {
+        int bytes = m_dstImage->getRowStrideSize(rc.w);
+        for (int y=rc.y; y<rc.y2(); ++y) {
+          if (std::memcmp(m_dstImage->getPixelAddress(rc.x, y),
+                          m_celImage->getPixelAddress(rc.x+dx, y+dy),
+                          bytes) != 0) {
+            modified = true;
+            break;
+          }
+        }
+        if (modified)
+          break;
+      }
+
+      if (modified)
+        result.createUnion(result, tileRgn);
+    }
+  }
+
+  return result;
+}
+
 Image* ExpandCelCanvas::getSourceCanvas()
 {
   ASSERT((m_flags & NeedsSource) == NeedsSource);
 
   if (!m_srcImage) {
     m_srcImage.reset(Image::create(m_sprite->pixelFormat(),
-        m_bounds.w, m_bounds.h, src_buffer));
+        m_bounds.w, m_bounds.h,
+        ImageBufferRecycler::global().getForImage(
+          m_sprite->pixelFormat(), m_bounds.w, m_bounds.h)));
 
     m_srcImage->setMaskColor(m_sprite->transparentColor());
   }
@@ -233,7 +364,9 @@ Image* ExpandCelCanvas::getDestCanvas()
 {
   if (!m_dstImage) {
     m_dstImage.reset(Image::create(m_sprite->pixelFormat(),
-        m_bounds.w, m_bounds.h, dst_buffer));
+        m_bounds.w, m_bounds.h,
+        ImageBufferRecycler::global().getForImage(
+          m_sprite->pixelFormat(), m_bounds.w, m_bounds.h)));
 
     m_dstImage->setMaskColor(m_sprite->transparentColor());
   }
@@ -43,6 +43,10 @@ namespace app {
       None = 0,
       NeedsSource = 1,
       UseModifiedRegionAsUndoInfo = 2,
+      // Crops the image of an existing cel to its painted bounds when
+      // the changes are committed (e.g. the cel borders were erased).
+      // Without this flag the cel can only grow.
+      AutoShrink = 4,
     };
 
     ExpandCelCanvas(Site site,
@@ -70,6 +74,19 @@ namespace app {
     const Cel* getCel() const { return m_cel; }
 
   private:
+    // Bounds of the painted area of m_dstImage
+    gfx::Rect getTrimmedBounds();
+
+    // Returns true if the trimmed bounds of m_dstImage (with the
+    // "modified" region painted, in m_dstImage coordinates) are the
+    // same bounds of m_celImage, checking only the cel borders.
+    bool keepsCelBounds(const gfx::Region& modified);
+
+    // Returns the part of "rgn" (in m_dstImage coordinates) inside
+    // tiles where m_dstImage and m_celImage (displaced dx/dy pixels)
+    // have different pixels.
+    gfx::Region getModifiedTiles(const gfx::Region& rgn, int dx, int dy);
+
     Document* m_document;
     Sprite* m_sprite;
     Layer* m_layer;
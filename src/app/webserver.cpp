@@ -13,19 +13,124 @@
 
 #include "app/webserver.h"
 
+#include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/path.h"
+#include "app/document.h"
+#include "app/document_cache.h"
+#include "app/document_exporter.h"
 #include "app/resource_finder.h"
+#include "app/ui_context.h"
+#include "doc/layer.h"
+#include "doc/sprite.h"
 #include "webserver/webserver.h"
 
+#include <cctype>
+#include <cstdlib>
 #include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
 
 #define API_VERSION 1
 
 namespace app {
 
-WebServer::WebServer()
+namespace {
+
+// Maximum number of documents kept in memory between export jobs
+const int kMaxCachedDocuments = 32;
+
+typedef std::vector<std::pair<std::string, std::string> > QueryVars;
+
+std::string url_decode(const std::string& str)
+{
+  std::string result;
+  result.reserve(str.size());
+
+  for (std::size_t i=0; i<str.size(); ++i) {
+    if (str[i] == '+')
+      result.push_back(' ');
+    else if (str[i] == '%' && i+2 < str.size() &&
+             std::isxdigit((unsigned char)str[i+1]) &&
+             std::isxdigit((unsigned char)str[i+2])) {
+      result.push_back((char)std::strtol(str.substr(i+1, 2).c_str(), NULL, 16));
+      i += 2;
+    }
+    else
+      result.push_back(str[i]);
+  }
+  return result;
+}
+
+// Parses "a=1&b=2&c" (the same variable can be specified several
+// times, e.g. to export several files)
+void parse_query_string(const char* qs, QueryVars& vars)
+{
+  if (!qs)
+    return;
+
+  std::istringstream is(qs);
+  std::string var;
+  while (std::getline(is, var, '&')) {
+    if (var.empty())
+      continue;
+
+    std::size_t i = var.find('=');
+    if (i == std::string::npos)
+      vars.push_back(std::make_pair(url_decode(var), std::string()));
+    else
+      vars.push_back(std::make_pair(url_decode(var.substr(0, i)),
+                                    url_decode(var.substr(i+1))));
+  }
+}
+
+bool has_var(const QueryVars& vars, const char* name)
+{
+  for (const auto& var : vars)
+    if (var.first == name)
+      return true;
+  return false;
+}
+
+std::string var_value(const QueryVars& vars, const char* name)
+{
+  for (const auto& var : vars)
+    if (var.first == name)
+      return var.second;
+  return std::string();
+}
+
+int var_int(const QueryVars& vars, const char* name)
+{
+  return std::strtol(var_value(vars, name).c_str(), NULL, 0);
+}
+
+std::string json_escape(const std::string& str)
+{
+  std::string result;
+  for (char chr : str) {
+    if (chr == '"' || chr == '\\')
+      result.push_back('\\');
+    result.push_back(chr);
+  }
+  return result;
+}
+
+void send_error(webserver::IResponse* response, int code, const std::string& msg)
+{
+  response->setStatusCode(code);
+  response->setContentType("application/json");
+  response->getStream() << "{\"error\":\"" << json_escape(msg) << "\"}";
+}
+
+} // anonymous namespace
+
+WebServer::WebServer(bool exportJobs)
   : m_webServer(NULL)
+  , m_exportJobs(exportJobs)
+  , m_jobCounter(0)
+  , m_quit(false)
 {
   ResourceFinder rf;
   rf.includeDataDir("www");
@@ -40,14 +145,26 @@ WebServer::WebServer()
 
 WebServer::~WebServer()
 {
+  // Stop the server before the cached documents are closed
   delete m_webServer;
+  m_docs.reset(NULL);
 }
 
 void WebServer::start()
 {
+  if (m_exportJobs)
+    m_docs.reset(new DocumentCache(UIContext::instance(), kMaxCachedDocuments));
+
   m_webServer = new webserver::WebServer(this);
 }
 
+void WebServer::waitForQuit()
+{
+  std::unique_lock<std::mutex> lock(m_quitMutex);
+  while (!m_quit)
+    m_quitCv.wait(lock);
+}
+
 void WebServer::onProcessRequest(webserver::IRequest* request,
                                  webserver::IResponse* response)
 {
@@ -62,6 +179,17 @@ void WebServer::onProcessRequest(webserver::IRequest* request,
                           << "\"webserver\":\"" << m_webServer->getName() << "\","
                           << "\"api\":\"" << API_VERSION << "\"}";
   }
+  else if (m_exportJobs && uri == "/export") {
+    onExport(request, response);
+  }
+  else if (m_exportJobs && uri == "/quit") {
+    response->setContentType("application/json");
+    response->getStream() << "{\"quit\":true}";
+
+    std::unique_lock<std::mutex> lock(m_quitMutex);
+    m_quit = true;
+    m_quitCv.notify_all();
+  }
   else {
     if (uri == "/" || uri.empty())
       uri = "/index.html";
@@ -79,6 +207,111 @@ void WebServer::onProcessRequest(webserver::IRequest* request,
   }
 }
 
+// Exports a sprite sheet of the given files. Query variables:
+//
+//   file=<filename>     Document to export (it can be repeated)
+//   layer=<name>        Export only the given layer of each file
+//   split-layers        Export each layer as a separated image
+//   sheet=<file.png>    Save the texture in the server side
+//   output=png          Reply with the texture (by default the
+//                       reply is the JSON metadata)
+//   format, sheet-width, sheet-height, sheet-pack, ignore-empty,
+//   trim, border-padding, shape-padding, inner-padding,
+//   filename-format     Same as the command line options
+//
+// Documents are kept in memory between jobs (and loaded again only
+// if their file was modified).
+void WebServer::onExport(webserver::IRequest* request,
+                         webserver::IResponse* response)
+{
+  QueryVars vars;
+  parse_query_string(request->getQueryString(), vars);
+
+  if (!has_var(vars, "file")) {
+    send_error(response, 400, "No file specified");
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_jobMutex);
+
+  DocumentExporter exporter;
+  std::stringstream data;
+  exporter.setDataStream(&data);
+  exporter.setStreamTexture(true);
+
+  std::string format = var_value(vars, "format");
+  if (format == "json-array")
+    exporter.setDataFormat(DocumentExporter::JsonArrayDataFormat);
+  else if (format == "json-hash")
+    exporter.setDataFormat(DocumentExporter::JsonHashDataFormat);
+
+  exporter.setTextureWidth(var_int(vars, "sheet-width"));
+  exporter.setTextureHeight(var_int(vars, "sheet-height"));
+  exporter.setTexturePack(has_var(vars, "sheet-pack"));
+  exporter.setIgnoreEmptyCels(has_var(vars, "ignore-empty"));
+  exporter.setTrimCels(has_var(vars, "trim"));
+  exporter.setBorderPadding(var_int(vars, "border-padding"));
+  exporter.setShapePadding(var_int(vars, "shape-padding"));
+  exporter.setInnerPadding(var_int(vars, "inner-padding"));
+  if (has_var(vars, "filename-format"))
+    exporter.setFilenameFormat(var_value(vars, "filename-format"));
+
+  const std::string layerName = var_value(vars, "layer");
+  const bool splitLayers = has_var(vars, "split-layers");
+
+  for (const auto& var : vars) {
+    if (var.first != "file")
+      continue;
+
+    Document* doc = m_docs->getDocument(var.second);
+    if (!doc) {
+      send_error(response, 404, "Error loading file \"" + var.second + "\"");
+      return;
+    }
+
+    if (!layerName.empty() || splitLayers) {
+      std::vector<doc::Layer*> layers;
+      doc->sprite()->getLayersList(layers);
+      for (doc::Layer* layer : layers)
+        if (splitLayers || layer->name() == layerName)
+          exporter.addDocument(doc, layer);
+    }
+    else
+      exporter.addDocument(doc);
+  }
+
+  // The texture is saved in a temporary file to reply it
+  const bool replyTexture = (var_value(vars, "output") == "png");
+  std::string textureFilename = var_value(vars, "sheet");
+  std::string tempFilename;
+  if (replyTexture && textureFilename.empty()) {
+    tempFilename = base::join_path(base::get_temp_path(),
+      "aseprite-export-" + base::convert_to<std::string>(++m_jobCounter) + ".png");
+    textureFilename = tempFilename;
+  }
+  exporter.setTextureFilename(textureFilename);
+
+  base::UniquePtr<Document> texture(exporter.exportSheet());
+  if (!texture) {
+    send_error(response, 422, "No documents to export");
+    return;
+  }
+
+  if (replyTexture) {
+    if (base::is_file(textureFilename))
+      response->sendFile(textureFilename.c_str());
+    else
+      send_error(response, 500, "Error saving the texture");
+  }
+  else {
+    response->setContentType("application/json");
+    response->getStream() << data.str();
+  }
+
+  if (!tempFilename.empty() && base::is_file(tempFilename))
+    base::delete_file(tempFilename);
+}
+
 }
 
 #endif // ENABLE_WEBSERVER
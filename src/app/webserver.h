@@ -11,24 +11,51 @@
 
 #ifdef ENABLE_WEBSERVER
 
+#include "base/unique_ptr.h"
 #include "webserver/webserver.h"
 
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
 namespace app {
+  class DocumentCache;
 
   class WebServer : public webserver::IDelegate {
   public:
-    WebServer();
+    // If "exportJobs" is true the server accepts /export and /quit
+    // requests. It can be used only when there is no UI (--server),
+    // because export jobs use documents from the server threads.
+    WebServer(bool exportJobs = false);
     ~WebServer();
 
     void start();
 
+    // Waits until a /quit request is received.
+    void waitForQuit();
+
     // webserver::IDelegate implementation
     virtual void onProcessRequest(webserver::IRequest* request,
                                   webserver::IResponse* response) override;
 
   private:
+    void onExport(webserver::IRequest* request,
+                  webserver::IResponse* response);
+
     webserver::WebServer* m_webServer;
     std::string m_wwwpath;
+    bool m_exportJobs;
+
+    // Recently used documents in export jobs (used with m_jobMutex)
+    base::UniquePtr<DocumentCache> m_docs;
+
+    // Export jobs are executed one at a time
+    std::mutex m_jobMutex;
+    int m_jobCounter;
+
+    std::mutex m_quitMutex;
+    std::condition_variable m_quitCv;
+    bool m_quit;
   };
 
 } // namespace app
@@ -25,6 +25,7 @@
 #include "base/bind.h"
 #include "base/fs.h"
 #include "base/memory.h"
+#include "base/time.h"
 #include "she/system.h"
 #include "ui/ui.h"
 
@@ -34,6 +35,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <map>
 
 namespace app {
 
@@ -43,6 +45,69 @@ using namespace app::skin;
 static int convert_align_value_to_flags(const char *value);
 static int int_attr(const TiXmlElement* elem, const char* attribute_name, int default_value);
 
+namespace {
+
+  // A parsed .xml file with widgets
+  struct WidgetsXml {
+    std::string filename;       // Full path of the file found
+    base::Time mtime;
+    XmlDocumentRef doc;
+  };
+
+  typedef std::map<std::string, WidgetsXml> WidgetsXmlMap;
+
+}
+
+// Parsed .xml files by file name (e.g. "new_layer.xml"). Dialogs are
+// created each time they are shown, so with this cache their .xml
+// files are found and parsed only once (or again if they are
+// modified).
+static WidgetsXmlMap* widgets_xml = NULL;
+
+static void on_exit_delete_widgets_xml()
+{
+  delete widgets_xml;
+  widgets_xml = NULL;
+}
+
+static XmlDocumentRef get_widgets_xml(const char* fileName)
+{
+  if (!widgets_xml) {
+    widgets_xml = new WidgetsXmlMap;
+    App::instance()->Exit.connect(&on_exit_delete_widgets_xml);
+  }
+
+  WidgetsXmlMap::iterator it = widgets_xml->find(fileName);
+  if (it != widgets_xml->end()) {
+    WidgetsXml& xml = it->second;
+    base::Time mtime = base::get_modification_time(xml.filename);
+    if (mtime == xml.mtime)
+      return xml.doc;
+
+    widgets_xml->erase(it);
+  }
+
+  std::string buf;
+
+  ResourceFinder rf;
+  rf.addPath(fileName);
+
+  buf = "widgets/";
+  buf += fileName;
+  rf.includeDataDir(buf.c_str());
+
+  if (!rf.findFirst())
+    return XmlDocumentRef();
+
+  WidgetsXml xml;
+  xml.filename = rf.filename();
+  xml.mtime = base::get_modification_time(xml.filename);
+  xml.doc = open_xml(xml.filename);
+
+  (*widgets_xml)[fileName] = xml;
+  return xml.doc;
+}
+
 WidgetLoader::WidgetLoader()
   : m_tooltipManager(NULL)
 {
@@ -62,19 +127,11 @@ void WidgetLoader::addWidgetType(const char* tagName, IWidgetTypeCreator* creato
 
 Widget* WidgetLoader::loadWidget(const char* fileName, const char* widgetId, ui::Widget* widget)
 {
-  std::string buf;
-
-  ResourceFinder rf;
-  rf.addPath(fileName);
-
-  buf = "widgets/";
-  buf += fileName;
-  rf.includeDataDir(buf.c_str());
-
-  if (!rf.findFirst())
+  XmlDocumentRef doc = get_widgets_xml(fileName);
+  if (!doc)
     throw WidgetNotFound(widgetId);
 
-  widget = loadWidgetFromXmlFile(rf.filename(), widgetId, widget);
+  widget = loadWidgetFromXmlFile(doc, widgetId, widget);
   if (!widget)
     throw WidgetNotFound(widgetId);
 
@@ -82,13 +139,12 @@ Widget* WidgetLoader::loadWidget(const char* fileName, const char* widgetId, ui:
 }
 
 Widget* WidgetLoader::loadWidgetFromXmlFile(
-  const std::string& xmlFilename,
+  const XmlDocumentRef& doc,
   const std::string& widgetId,
   ui::Widget* widget)
 {
   m_tooltipManager = NULL;
 
-  XmlDocumentRef doc(open_xml(xmlFilename));
   TiXmlHandle handle(doc.get());
 
   // Search the requested widget.
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/widget_type_mismatch.h"
+#include "app/xml_document.h"
 
 #include <map>
 #include <string>
@@ -58,7 +59,7 @@ namespace app {
 
   private:
     ui::Widget* loadWidgetFromXmlFile(
-      const std::string& xmlFilename,
+      const XmlDocumentRef& doc,
       const std::string& widgetId,
       ui::Widget* widget);
 
@@ -0,0 +1,50 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/folder_watcher.h"
+
+#if defined(_WIN32)
+  #include "base/folder_watcher_win32.h"
+#elif defined(__linux__)
+  #include "base/folder_watcher_inotify.h"
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+  #include "base/folder_watcher_kqueue.h"
+#else
+  #include "base/folder_watcher_none.h"
+#endif
+
+namespace base {
+
+FolderWatcher::FolderWatcher()
+  : m_impl(new FolderWatcherImpl)
+{
+}
+
+FolderWatcher::~FolderWatcher()
+{
+  delete m_impl;
+}
+
+bool FolderWatcher::watch(const std::string& path)
+{
+  return m_impl->watch(path);
+}
+
+void FolderWatcher::unwatch(const std::string& path)
+{
+  m_impl->unwatch(path);
+}
+
+void FolderWatcher::getChanges(Changes& changes)
+{
+  m_impl->getChanges(changes);
+}
+
+} // namespace base
@@ -0,0 +1,62 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_FOLDER_WATCHER_H_INCLUDED
+#define BASE_FOLDER_WATCHER_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <string>
+#include <vector>
+
+namespace base {
+
+  // Receives notifications from the OS (inotify, kqueue, or
+  // ReadDirectoryChangesW) when the content of watched folders
+  // changes. Changes are queued by the OS and collected with
+  // getChanges() (it doesn't block).
+  class FolderWatcher {
+  public:
+    enum ChangeType {
+      // The file "name" was modified
+      FileModified,
+      // Files were added/removed/renamed in the folder ("name" is the
+      // changed file, or empty if it's unknown)
+      EntriesChanged,
+    };
+
+    struct Change {
+      ChangeType type;
+      std::string path;         // Watched folder
+      std::string name;         // File inside the folder
+    };
+
+    typedef std::vector<Change> Changes;
+
+    FolderWatcher();
+    ~FolderWatcher();
+
+    // Returns false if the folder cannot be watched (e.g. it doesn't
+    // exist or the platform doesn't support notifications), in that
+    // case changes in the folder aren't reported.
+    bool watch(const std::string& path);
+    void unwatch(const std::string& path);
+
+    // Adds to "changes" all changes in watched folders since the
+    // last call.
+    void getChanges(Changes& changes);
+
+  private:
+    class FolderWatcherImpl;
+    FolderWatcherImpl* m_impl;
+
+    DISABLE_COPYING(FolderWatcher);
+  };
+
+} // namespace base
+
+#endif
@@ -0,0 +1,124 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <map>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+class base::FolderWatcher::FolderWatcherImpl {
+public:
+  FolderWatcherImpl() {
+    m_fd = inotify_init();
+    if (m_fd >= 0) {
+      fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+      fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+    }
+  }
+
+  ~FolderWatcherImpl() {
+    if (m_fd >= 0)
+      close(m_fd);
+  }
+
+  bool watch(const std::string& path) {
+    if (m_fd < 0)
+      return false;
+
+    if (m_paths.find(path) != m_paths.end())
+      return true;
+
+    int wd = inotify_add_watch(m_fd, path.c_str(),
+                               IN_CREATE | IN_DELETE |
+                               IN_MOVED_FROM | IN_MOVED_TO |
+                               IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB |
+                               IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    if (wd < 0)
+      return false;
+
+    m_paths[path] = wd;
+    m_wds[wd] = path;
+    return true;
+  }
+
+  void unwatch(const std::string& path) {
+    auto it = m_paths.find(path);
+    if (it == m_paths.end())
+      return;
+
+    inotify_rm_watch(m_fd, it->second);
+    m_wds.erase(it->second);
+    m_paths.erase(it);
+  }
+
+  void getChanges(Changes& changes) {
+    if (m_fd < 0)
+      return;
+
+    // Buffer aligned for inotify_event structs
+    union {
+      inotify_event event;
+      char bytes[64 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    } buf;
+
+    for (;;) {
+      ssize_t size = read(m_fd, buf.bytes, sizeof(buf.bytes));
+      if (size <= 0)
+        break;
+
+      for (ssize_t i=0; i<size; ) {
+        const inotify_event* ev = (const inotify_event*)(buf.bytes + i);
+        i += sizeof(inotify_event) + ev->len;
+
+        // Too many events, we don't know what changed
+        if (ev->mask & IN_Q_OVERFLOW) {
+          for (const auto& it : m_paths)
+            addChange(changes, EntriesChanged, it.first, std::string());
+          continue;
+        }
+
+        auto it = m_wds.find(ev->wd);
+        if (it == m_wds.end())
+          continue;
+
+        std::string path = it->second;
+        std::string name = (ev->len > 0 ? std::string(ev->name): std::string());
+
+        if (ev->mask & IN_IGNORED) {
+          // The folder was removed (or unmounted)
+          m_paths.erase(path);
+          m_wds.erase(it);
+          addChange(changes, EntriesChanged, path, std::string());
+        }
+        else if (ev->mask & (IN_CREATE | IN_DELETE |
+                             IN_MOVED_FROM | IN_MOVED_TO |
+                             IN_DELETE_SELF | IN_MOVE_SELF)) {
+          addChange(changes, EntriesChanged, path, name);
+        }
+        else if (!name.empty()) {
+          addChange(changes, FileModified, path, name);
+        }
+      }
+    }
+  }
+
+private:
+  static void addChange(Changes& changes, ChangeType type,
+                        const std::string& path, const std::string& name) {
+    Change change;
+    change.type = type;
+    change.path = path;
+    change.name = name;
+    changes.push_back(change);
+  }
+
+  int m_fd;
+  std::map<std::string, int> m_paths;
+  std::map<int, std::string> m_wds;
+};
@@ -0,0 +1,101 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <map>
+
+#include <fcntl.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef O_EVTONLY
+  #define O_EVTONLY O_RDONLY
+#endif
+
+// kqueue only notifies that the folder entries changed (it doesn't
+// say which files, and modifications inside files aren't notified).
+class base::FolderWatcher::FolderWatcherImpl {
+public:
+  FolderWatcherImpl() {
+    m_kq = kqueue();
+  }
+
+  ~FolderWatcherImpl() {
+    for (const auto& it : m_fds)
+      close(it.first);
+    if (m_kq >= 0)
+      close(m_kq);
+  }
+
+  bool watch(const std::string& path) {
+    if (m_kq < 0)
+      return false;
+
+    if (m_paths.find(path) != m_paths.end())
+      return true;
+
+    int fd = open(path.c_str(), O_EVTONLY);
+    if (fd < 0)
+      return false;
+
+    struct kevent ev;
+    EV_SET(&ev, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+           NOTE_WRITE | NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE, 0, NULL);
+    if (kevent(m_kq, &ev, 1, NULL, 0, NULL) < 0) {
+      close(fd);
+      return false;
+    }
+
+    m_paths[path] = fd;
+    m_fds[fd] = path;
+    return true;
+  }
+
+  void unwatch(const std::string& path) {
+    auto it = m_paths.find(path);
+    if (it == m_paths.end())
+      return;
+
+    // Closing the file descriptor removes its events from the kqueue
+    close(it->second);
+    m_fds.erase(it->second);
+    m_paths.erase(it);
+  }
+
+  void getChanges(Changes& changes) {
+    if (m_kq < 0)
+      return;
+
+    struct timespec zero = { 0, 0 };
+    struct kevent evs[64];
+    int n;
+
+    do {
+      n = kevent(m_kq, NULL, 0, evs, 64, &zero);
+
+      for (int i=0; i<n; ++i) {
+        auto it = m_fds.find(int(evs[i].ident));
+        if (it == m_fds.end())
+          continue;
+
+        Change change;
+        change.type = EntriesChanged;
+        change.path = it->second;
+        changes.push_back(change);
+
+        // The folder itself was removed or renamed
+        if (evs[i].fflags & (NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE))
+          unwatch(change.path);
+      }
+    } while (n == 64);
+  }
+
+private:
+  int m_kq;
+  std::map<std::string, int> m_paths;
+  std::map<int, std::string> m_fds;
+};
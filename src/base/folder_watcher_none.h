@@ -0,0 +1,18 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+class base::FolderWatcher::FolderWatcherImpl {
+public:
+  bool watch(const std::string& path) {
+    return false;
+  }
+
+  void unwatch(const std::string& path) {
+  }
+
+  void getChanges(Changes& changes) {
+  }
+};
@@ -0,0 +1,67 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/folder_watcher.h"
+#include "base/fs.h"
+#include "base/path.h"
+#include "base/thread.h"
+
+#include <cstdio>
+
+using namespace base;
+
+static bool has_change(FolderWatcher& watcher,
+                       FolderWatcher::ChangeType type,
+                       const std::string& name)
+{
+  // Notifications can arrive some milliseconds later
+  for (int i=0; i<50; ++i) {
+    FolderWatcher::Changes changes;
+    watcher.getChanges(changes);
+    for (const auto& change : changes)
+      if (change.type == type &&
+          (change.name == name || change.name.empty())) // Unknown file
+        return true;
+    this_thread::sleep_for(0.01);
+  }
+  return false;
+}
+
+TEST(FolderWatcher, AddModifyAndRemoveFiles)
+{
+  make_directory("watched");
+
+  FolderWatcher watcher;
+  if (!watcher.watch("watched")) {
+    remove_directory("watched");
+    return;                     // Notifications are not supported
+  }
+
+  std::string fn = join_path("watched", "a.txt");
+  FILE* f = std::fopen(fn.c_str(), "wb");
+  ASSERT_TRUE(f != NULL);
+  EXPECT_TRUE(has_change(watcher, FolderWatcher::EntriesChanged, "a.txt"));
+
+  std::fputs("data", f);
+  std::fclose(f);
+#if !defined(__APPLE__) && !defined(__FreeBSD__) // kqueue doesn't notify file modifications
+  EXPECT_TRUE(has_change(watcher, FolderWatcher::FileModified, "a.txt"));
+#endif
+
+  delete_file(fn);
+  EXPECT_TRUE(has_change(watcher, FolderWatcher::EntriesChanged, "a.txt"));
+
+  watcher.unwatch("watched");
+  remove_directory("watched");
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
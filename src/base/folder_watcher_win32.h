@@ -0,0 +1,144 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "base/string.h"
+
+#include <map>
+
+#include <windows.h>
+
+class base::FolderWatcher::FolderWatcherImpl {
+  struct Folder {
+    HANDLE handle;
+    OVERLAPPED overlapped;
+    DWORD buffer[16*1024];      // FILE_NOTIFY_INFORMATION entries
+  };
+
+  typedef std::map<std::string, Folder*> Folders;
+
+public:
+  ~FolderWatcherImpl() {
+    while (!m_folders.empty())
+      unwatch(m_folders.begin()->first);
+  }
+
+  bool watch(const std::string& path) {
+    if (m_folders.find(path) != m_folders.end())
+      return true;
+
+    HANDLE handle = CreateFile(from_utf8(path).c_str(),
+                               FILE_LIST_DIRECTORY,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                               NULL, OPEN_EXISTING,
+                               FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                               NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+      return false;
+
+    Folder* folder = new Folder;
+    folder->handle = handle;
+    ZeroMemory(&folder->overlapped, sizeof(OVERLAPPED));
+    folder->overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    if (!readChanges(folder)) {
+      CloseHandle(folder->overlapped.hEvent);
+      CloseHandle(handle);
+      delete folder;
+      return false;
+    }
+
+    m_folders[path] = folder;
+    return true;
+  }
+
+  void unwatch(const std::string& path) {
+    Folders::iterator it = m_folders.find(path);
+    if (it == m_folders.end())
+      return;
+
+    Folder* folder = it->second;
+    m_folders.erase(it);
+
+    // Wait the cancelled operation before deleting its buffer
+    DWORD bytes;
+    CancelIo(folder->handle);
+    GetOverlappedResult(folder->handle, &folder->overlapped, &bytes, TRUE);
+
+    CloseHandle(folder->overlapped.hEvent);
+    CloseHandle(folder->handle);
+    delete folder;
+  }
+
+  void getChanges(Changes& changes) {
+    std::vector<std::string> removed;
+
+    for (Folders::iterator it=m_folders.begin(); it!=m_folders.end(); ++it) {
+      Folder* folder = it->second;
+      DWORD bytes = 0;
+
+      if (!GetOverlappedResult(folder->handle, &folder->overlapped, &bytes, FALSE)) {
+        if (GetLastError() == ERROR_IO_INCOMPLETE)
+          continue;             // No changes
+
+        // The folder was removed (or it isn't accessible)
+        addChange(changes, EntriesChanged, it->first, std::string());
+        removed.push_back(it->first);
+        continue;
+      }
+
+      // Zero bytes means that the buffer overflowed (we don't know
+      // what changed).
+      if (bytes == 0)
+        addChange(changes, EntriesChanged, it->first, std::string());
+      else {
+        const BYTE* p = (const BYTE*)folder->buffer;
+        for (;;) {
+          const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)p;
+          std::string name = to_utf8(std::wstring(info->FileName,
+                                                  info->FileNameLength / sizeof(WCHAR)));
+
+          addChange(changes,
+                    (info->Action == FILE_ACTION_MODIFIED ? FileModified: EntriesChanged),
+                    it->first, name);
+
+          if (info->NextEntryOffset == 0)
+            break;
+          p += info->NextEntryOffset;
+        }
+      }
+
+      ResetEvent(folder->overlapped.hEvent);
+      if (!readChanges(folder))
+        removed.push_back(it->first);
+    }
+
+    for (const auto& path : removed)
+      unwatch(path);
+  }
+
+private:
+  static bool readChanges(Folder* folder) {
+    return (ReadDirectoryChangesW(folder->handle,
+                                  folder->buffer, sizeof(folder->buffer),
+                                  FALSE,
+                                  FILE_NOTIFY_CHANGE_FILE_NAME |
+                                  FILE_NOTIFY_CHANGE_DIR_NAME |
+                                  FILE_NOTIFY_CHANGE_SIZE |
+                                  FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                  NULL, &folder->overlapped, NULL) ? true: false);
+  }
+
+  static void addChange(Changes& changes, ChangeType type,
+                        const std::string& path, const std::string& name) {
+    Change change;
+    change.type = type;
+    change.path = path;
+    change.name = name;
+    changes.push_back(change);
+  }
+
+  Folders m_folders;
+};
@@ -0,0 +1,138 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/mapped_file.h"
+
+#include "base/string.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace base {
+
+#ifdef _WIN32
+
+class mapped_file::impl {
+public:
+  impl(const std::string& filename)
+    : m_data(nullptr), m_size(0), m_mapping(nullptr) {
+    m_file = CreateFileW(from_utf8(filename).c_str(),
+                         GENERIC_READ, FILE_SHARE_READ, nullptr,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+      throw std::runtime_error("Cannot open " + filename);
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+      CloseHandle(m_file);
+      throw std::runtime_error("Cannot get the size of " + filename);
+    }
+    m_size = std::size_t(size.QuadPart);
+    if (m_size == 0)
+      return;
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping)
+      m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!m_data) {
+      if (m_mapping)
+        CloseHandle(m_mapping);
+      CloseHandle(m_file);
+      throw std::runtime_error("Cannot map " + filename);
+    }
+  }
+
+  ~impl() {
+    if (m_data)
+      UnmapViewOfFile(m_data);
+    if (m_mapping)
+      CloseHandle(m_mapping);
+    CloseHandle(m_file);
+  }
+
+  const uint8_t* m_data;
+  std::size_t m_size;
+
+private:
+  HANDLE m_file;
+  HANDLE m_mapping;
+};
+
+#else
+
+class mapped_file::impl {
+public:
+  impl(const std::string& filename)
+    : m_data(nullptr), m_size(0) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("Cannot open " + filename);
+
+    struct stat sts;
+    if (fstat(fd, &sts) != 0) {
+      ::close(fd);
+      throw std::runtime_error("Cannot get the size of " + filename);
+    }
+    m_size = std::size_t(sts.st_size);
+
+    if (m_size > 0) {
+      void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("Cannot map " + filename);
+      }
+      m_data = (const uint8_t*)data;
+    }
+
+    // The mapping is still valid after closing the file descriptor
+    ::close(fd);
+  }
+
+  ~impl() {
+    if (m_data)
+      munmap((void*)m_data, m_size);
+  }
+
+  const uint8_t* m_data;
+  std::size_t m_size;
+};
+
+#endif
+
+mapped_file::mapped_file(const std::string& filename)
+  : m_impl(new impl(filename))
+{
+}
+
+mapped_file::~mapped_file()
+{
+  delete m_impl;
+}
+
+const uint8_t* mapped_file::data() const
+{
+  return m_impl->m_data;
+}
+
+std::size_t mapped_file::size() const
+{
+  return m_impl->m_size;
+}
+
+} // namespace base
@@ -0,0 +1,38 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_MAPPED_FILE_H_INCLUDED
+#define BASE_MAPPED_FILE_H_INCLUDED
+#pragma once
+
+#include "base/base.h"
+#include "base/disable_copying.h"
+
+#include <cstddef>
+#include <string>
+
+namespace base {
+
+  // Read-only view of the whole content of a file mapped in memory.
+  class mapped_file {
+  public:
+    // Throws an exception if the file cannot be opened or mapped.
+    explicit mapped_file(const std::string& filename);
+    ~mapped_file();
+
+    const uint8_t* data() const;
+    std::size_t size() const;
+
+  private:
+    class impl;
+    impl* m_impl;
+
+    DISABLE_COPYING(mapped_file);
+  };
+
+} // namespace base
+
+#endif
@@ -0,0 +1,58 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "base/mapped_file.h"
+
+#include <cstring>
+
+using namespace base;
+
+TEST(MappedFile, Content)
+{
+  const char* fn = "test_mapped_file.txt";
+  const char* content = "Hello mapped file";
+
+  {
+    FileHandle f(open_file_with_exception(fn, "wb"));
+    fwrite(content, 1, std::strlen(content), f.get());
+  }
+
+  {
+    mapped_file m(fn);
+    ASSERT_EQ(std::strlen(content), m.size());
+    EXPECT_EQ(0, std::memcmp(content, m.data(), m.size()));
+  }
+
+  delete_file(fn);
+}
+
+TEST(MappedFile, EmptyFile)
+{
+  const char* fn = "test_mapped_file.txt";
+  open_file_with_exception(fn, "wb");
+
+  {
+    mapped_file m(fn);
+    EXPECT_EQ(0u, m.size());
+  }
+
+  delete_file(fn);
+}
+
+TEST(MappedFile, NonExistentFile)
+{
+  EXPECT_THROW(mapped_file("this_file_does_not_exist.txt"), std::exception);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
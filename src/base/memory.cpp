@@ -8,33 +8,185 @@
 #include "config.h"
 #endif
 
+#include "base/memory.h"
+
+#include "base/debug.h"
+
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <new>
 
 #include "base/mutex.h"
 #include "base/scoped_lock.h"
 
+#ifdef _MSC_VER
+  #include <intrin.h>
+  #pragma intrinsic(_ReturnAddress)
+  #define BASE_RETURN_ADDRESS() _ReturnAddress()
+#else
+  #define BASE_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+
 using namespace std;
 
+//////////////////////////////////////////////////////////////////////
+// Allocation profiling
+
+namespace base {
+
+namespace details {
+  std::atomic<bool> alloc_profiling_flag(false);
+}
+
+namespace {
+
+// Number of call sites that can be saved (must be a power of two)
+const int kCallSites = 1024;
+
+// All these variables are zero-initialized before any allocation
+// (constructors of other static objects can allocate memory).
+std::atomic<uint64_t> alloc_count_value;
+std::atomic<uint64_t> alloc_bytes_value;
+std::atomic<uint64_t> alloc_sizes[kAllocSizeBuckets];
+
+// Sampled call sites (an open addressing hash table). It's guarded
+// by a spin lock because a mutex could need to be constructed or
+// could allocate memory.
+std::atomic_flag call_sites_lock = ATOMIC_FLAG_INIT;
+alloc_call_site call_sites[kCallSites];
+
+class call_sites_guard {
+public:
+  call_sites_guard() {
+    while (call_sites_lock.test_and_set(std::memory_order_acquire))
+      ;
+  }
+  ~call_sites_guard() {
+    call_sites_lock.clear(std::memory_order_release);
+  }
+};
+
+int size_bucket(size_t size)
+{
+  int bucket = 0;
+  for (size_t limit=16; size > limit && bucket < kAllocSizeBuckets-1; limit <<= 1)
+    ++bucket;
+  return bucket;
+}
+
+void add_call_site(void* address, size_t size)
+{
+  size_t i = size_t((uintptr_t(address) >> 2) * 2654435761u);
+
+  call_sites_guard guard;
+  for (int probe=0; probe<kCallSites; ++probe, ++i) {
+    alloc_call_site& site = call_sites[i & (kCallSites-1)];
+    if (site.address == address || !site.address) {
+      site.address = address;
+      ++site.count;
+      site.bytes += size;
+      return;
+    }
+  }
+  // The table is full, the call site is discarded
+}
+
+// It must not allocate memory.
+inline void record_alloc(size_t size, void* caller)
+{
+  if (!alloc_profiling())
+    return;
+
+  uint64_t n = alloc_count_value.fetch_add(1, std::memory_order_relaxed);
+  alloc_bytes_value.fetch_add(size, std::memory_order_relaxed);
+  alloc_sizes[size_bucket(size)].fetch_add(1, std::memory_order_relaxed);
+
+  if ((n % kAllocSampleRate) == 0)
+    add_call_site(caller, size);
+}
+
+} // anonymous namespace
+
+void set_alloc_profiling(bool state)
+{
+  details::alloc_profiling_flag.store(state);
+}
+
+uint64_t alloc_count()
+{
+  return alloc_count_value.load(std::memory_order_relaxed);
+}
+
+void get_alloc_stats(alloc_stats& stats)
+{
+  // Reserve memory before locking the call sites (the vector cannot
+  // allocate memory with the lock acquired)
+  stats.call_sites.clear();
+  stats.call_sites.reserve(kCallSites);
+
+  stats.count = alloc_count_value.load();
+  stats.bytes = alloc_bytes_value.load();
+  for (int i=0; i<kAllocSizeBuckets; ++i)
+    stats.sizes[i] = alloc_sizes[i].load();
+
+  {
+    call_sites_guard guard;
+    for (int i=0; i<kCallSites; ++i)
+      if (call_sites[i].address)
+        stats.call_sites.push_back(call_sites[i]);
+  }
+
+  std::sort(stats.call_sites.begin(), stats.call_sites.end(),
+            [](const alloc_call_site& a, const alloc_call_site& b) {
+              return a.count > b.count;
+            });
+}
+
+void reset_alloc_stats()
+{
+  alloc_count_value.store(0);
+  alloc_bytes_value.store(0);
+  for (int i=0; i<kAllocSizeBuckets; ++i)
+    alloc_sizes[i].store(0);
+
+  call_sites_guard guard;
+  std::memset(call_sites, 0, sizeof(call_sites));
+}
+
+size_t alloc_size_bucket_limit(int bucket)
+{
+  ASSERT(bucket >= 0 && bucket < kAllocSizeBuckets);
+  if (bucket == kAllocSizeBuckets-1)
+    return 0;
+  else
+    return size_t(16) << bucket;
+}
+
+} // namespace base
+
 #if !defined MEMLEAK            // Without leak detection
 
 void* base_malloc(size_t bytes)
 {
   assert(bytes != 0);
+  base::record_alloc(bytes, BASE_RETURN_ADDRESS());
   return malloc(bytes);
 }
 
 void* base_malloc0(size_t bytes)
 {
   assert(bytes != 0);
+  base::record_alloc(bytes, BASE_RETURN_ADDRESS());
   return calloc(1, bytes);
 }
 
 void* base_realloc(void* mem, size_t bytes)
 {
   assert(bytes != 0);
+  base::record_alloc(bytes, BASE_RETURN_ADDRESS());
   return realloc(mem, bytes);
 }
 
@@ -47,6 +199,7 @@ void base_free(void* mem)
 char* base_strdup(const char* string)
 {
   assert(string != NULL);
+  base::record_alloc(strlen(string)+1, BASE_RETURN_ADDRESS());
 #ifdef _MSC_VER
   return _strdup(string);
 #else
@@ -54,6 +207,64 @@ char* base_strdup(const char* string)
 #endif
 }
 
+// Global new/delete operators are replaced to count allocations
+// (when the leak detector is enabled, they are defined in
+// base/base.h and use base_malloc()).
+
+void* operator new(size_t size)
+{
+  void* ptr = malloc(size ? size: 1);
+  if (!ptr)
+    throw std::bad_alloc();
+  base::record_alloc(size, BASE_RETURN_ADDRESS());
+  return ptr;
+}
+
+void* operator new[](size_t size)
+{
+  void* ptr = malloc(size ? size: 1);
+  if (!ptr)
+    throw std::bad_alloc();
+  base::record_alloc(size, BASE_RETURN_ADDRESS());
+  return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+  void* ptr = malloc(size ? size: 1);
+  if (ptr)
+    base::record_alloc(size, BASE_RETURN_ADDRESS());
+  return ptr;
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw()
+{
+  void* ptr = malloc(size ? size: 1);
+  if (ptr)
+    base::record_alloc(size, BASE_RETURN_ADDRESS());
+  return ptr;
+}
+
+void operator delete(void* ptr) throw()
+{
+  free(ptr);
+}
+
+void operator delete[](void* ptr) throw()
+{
+  free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) throw()
+{
+  free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) throw()
+{
+  free(ptr);
+}
+
 #else  // With leak detection
 
 #define BACKTRACE_LEVELS 16
@@ -223,6 +434,7 @@ void* base_malloc(size_t bytes)
 
   void* mem = malloc(bytes);
   if (mem != NULL) {
+    base::record_alloc(bytes, BASE_RETURN_ADDRESS());
     addslot(mem, bytes);
     return mem;
   }
@@ -236,6 +448,7 @@ void* base_malloc0(size_t bytes)
 
   void* mem = calloc(1, bytes);
   if (mem != NULL) {
+    base::record_alloc(bytes, BASE_RETURN_ADDRESS());
     addslot(mem, bytes);
     return mem;
   }
@@ -249,6 +462,7 @@ void* base_realloc(void* mem, size_t bytes)
 
   void* newmem = realloc(mem, bytes);
   if (newmem != NULL) {
+    base::record_alloc(bytes, BASE_RETURN_ADDRESS());
     if (mem != NULL)
       delslot(mem);
 
@@ -272,8 +486,10 @@ char* base_strdup(const char* string)
   assert(string != NULL);
 
   char* mem = strdup(string);
-  if (mem != NULL)
+  if (mem != NULL) {
+    base::record_alloc(strlen(mem) + 1, BASE_RETURN_ADDRESS());
     addslot(mem, strlen(mem) + 1);
+  }
 
   return mem;
 }
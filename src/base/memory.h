@@ -8,7 +8,11 @@
 #define BASE_MEMORY_H_INCLUDED
 #pragma once
 
+#include "base/base.h"
+
+#include <atomic>
 #include <cstddef>
+#include <vector>
 
 void* base_malloc (std::size_t bytes);
 void* base_malloc0(std::size_t bytes);
@@ -21,4 +25,50 @@ void base_memleak_init();
 void base_memleak_exit();
 #endif
 
+namespace base {
+
+  // Allocation profiling. When it's enabled, each allocation (global
+  // operator new and base_malloc() functions) is counted in a
+  // histogram of sizes, and one of each kAllocSampleRate allocations
+  // saves its call site (the return address of the allocation
+  // function). When it's disabled an allocation only checks a flag.
+
+  const int kAllocSizeBuckets = 12;
+  const int kAllocSampleRate = 64;
+
+  struct alloc_call_site {
+    void* address;
+    uint64_t count;             // Sampled allocations
+    uint64_t bytes;
+  };
+
+  struct alloc_stats {
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t sizes[kAllocSizeBuckets]; // Allocations in each bucket (see alloc_size_bucket_limit())
+    std::vector<alloc_call_site> call_sites; // Sorted by count (most frequent first)
+  };
+
+  namespace details {
+    extern std::atomic<bool> alloc_profiling_flag;
+  }
+
+  inline bool alloc_profiling() {
+    return details::alloc_profiling_flag.load(std::memory_order_relaxed);
+  }
+
+  void set_alloc_profiling(bool state);
+
+  // Number of allocations counted since the last reset.
+  uint64_t alloc_count();
+
+  void get_alloc_stats(alloc_stats& stats);
+  void reset_alloc_stats();
+
+  // Maximum size of the allocations of the given bucket (the last
+  // bucket has all bigger allocations, so it returns 0).
+  std::size_t alloc_size_bucket_limit(int bucket);
+
+} // namespace base
+
 #endif
@@ -0,0 +1,85 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/memory.h"
+
+#include <vector>
+
+using namespace base;
+
+static std::vector<char*> allocate_buffers(int n, int size)
+{
+  std::vector<char*> buffers(n);
+  for (int i=0; i<n; ++i)
+    buffers[i] = new char[size];
+  return buffers;
+}
+
+static void free_buffers(std::vector<char*>& buffers)
+{
+  for (char* buf : buffers)
+    delete[] buf;
+  buffers.clear();
+}
+
+TEST(Memory, DisabledProfilingDoesntCount)
+{
+  set_alloc_profiling(false);
+  reset_alloc_stats();
+
+  std::vector<char*> buffers = allocate_buffers(100, 100);
+  free_buffers(buffers);
+
+  alloc_stats stats;
+  get_alloc_stats(stats);
+  EXPECT_EQ(0, stats.count);
+  EXPECT_EQ(0, stats.bytes);
+  EXPECT_TRUE(stats.call_sites.empty());
+}
+
+TEST(Memory, CountAllocations)
+{
+  const int n = 10*kAllocSampleRate;
+  std::vector<char*> buffers;
+  buffers.reserve(n);
+
+  reset_alloc_stats();
+  set_alloc_profiling(true);
+  for (int i=0; i<n; ++i)
+    buffers.push_back(new char[100]);
+  void* mem = base_malloc(5000);
+  set_alloc_profiling(false);
+
+  base_free(mem);
+  free_buffers(buffers);
+
+  alloc_stats stats;
+  get_alloc_stats(stats);
+  EXPECT_EQ(n+1, stats.count);
+  EXPECT_EQ(n*100+5000, stats.bytes);
+  EXPECT_EQ(n, stats.sizes[3]);          // 64 < 100 <= 128
+  EXPECT_EQ(1, stats.sizes[9]);          // 4096 < 5000 <= 8192
+  EXPECT_EQ(n/kAllocSampleRate, stats.call_sites[0].count);
+  EXPECT_EQ(n/kAllocSampleRate*100, stats.call_sites[0].bytes);
+
+  reset_alloc_stats();
+  EXPECT_EQ(0, alloc_count());
+}
+
+TEST(Memory, SizeBuckets)
+{
+  EXPECT_EQ(16, alloc_size_bucket_limit(0));
+  EXPECT_EQ(32, alloc_size_bucket_limit(1));
+  EXPECT_EQ(0, alloc_size_bucket_limit(kAllocSizeBuckets-1));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,80 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/progress_token.h"
+
+#include <cmath>
+
+namespace base {
+
+// Value of a completed progress. Changes are propagated to parents
+// as deltas (which can be added from several threads in any order).
+static const std::int64_t kOne = std::int64_t(1) << 40;
+
+progress_token::progress_token()
+  : m_value(0)
+  , m_stepSize(0)
+  , m_canceled(false)
+  , m_parent(nullptr)
+  , m_weight(0.0)
+{
+}
+
+void progress_token::set_parent(progress_token* parent, double weight)
+{
+  m_parent = parent;
+  m_weight = weight;
+}
+
+double progress_token::progress() const
+{
+  double progress = double(m_value) / double(kOne);
+  return (progress < 0.0 ? 0.0: (progress > 1.0 ? 1.0: progress));
+}
+
+void progress_token::set_progress(double progress)
+{
+  if (progress < 0.0) progress = 0.0;
+  else if (progress > 1.0) progress = 1.0;
+
+  std::int64_t value = std::int64_t(progress * double(kOne));
+  std::int64_t old = m_value.exchange(value);
+  if (m_parent && value != old)
+    m_parent->add(std::int64_t(std::floor(double(value - old) * m_weight + 0.5)));
+}
+
+void progress_token::set_steps(int steps)
+{
+  m_stepSize = (steps > 0 ? kOne / steps: 0);
+}
+
+void progress_token::step()
+{
+  add(m_stepSize);
+}
+
+bool progress_token::canceled() const
+{
+  return (m_canceled || (m_parent && m_parent->canceled()));
+}
+
+void progress_token::cancel()
+{
+  m_canceled = true;
+}
+
+void progress_token::add(std::int64_t delta)
+{
+  m_value += delta;
+  if (m_parent && delta != 0)
+    m_parent->add(std::int64_t(std::floor(double(delta) * m_weight + 0.5)));
+}
+
+} // namespace base
@@ -0,0 +1,63 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_PROGRESS_TOKEN_H_INCLUDED
+#define BASE_PROGRESS_TOKEN_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace base {
+
+  // Progress (from 0.0 to 1.0) and cancel flag of a long operation,
+  // shared between the threads that do the work and the thread that
+  // shows the progress to the user (e.g. a progress bar with a
+  // "Cancel" button). Member functions don't lock mutexes, so they
+  // can be called from inner loops of several threads.
+  //
+  // A token can be a part of a parent token (e.g. each file of a
+  // group of files, or each stage of an operation): its progress
+  // multiplied by a weight is added to the parent progress, and
+  // canceling the parent cancels all its parts.
+  class progress_token {
+  public:
+    progress_token();
+
+    // Makes this token a part of "parent" (or an independent token
+    // if it's nullptr). It must be called before the operation
+    // starts, and the parent must be alive while it's used.
+    void set_parent(progress_token* parent, double weight);
+
+    double progress() const;
+    void set_progress(double progress);
+
+    // For work split in "steps" parts of the same size (which could
+    // be done by several threads): each step() call increments the
+    // progress by 1/steps.
+    void set_steps(int steps);
+    void step();
+
+    bool canceled() const;
+    void cancel();
+
+  private:
+    void add(std::int64_t delta);
+
+    std::atomic<std::int64_t> m_value;  // Fixed point progress
+    std::atomic<std::int64_t> m_stepSize;
+    std::atomic<bool> m_canceled;
+    progress_token* m_parent;
+    double m_weight;
+
+    DISABLE_COPYING(progress_token);
+  };
+
+} // namespace base
+
+#endif
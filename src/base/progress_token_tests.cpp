@@ -0,0 +1,76 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/progress_token.h"
+
+#include "base/thread_pool.h"
+
+using namespace base;
+
+TEST(ProgressToken, SetProgressAndCancel)
+{
+  progress_token token;
+  EXPECT_EQ(0.0, token.progress());
+  EXPECT_FALSE(token.canceled());
+
+  token.set_progress(0.25);
+  EXPECT_DOUBLE_EQ(0.25, token.progress());
+  token.set_progress(2.0);
+  EXPECT_DOUBLE_EQ(1.0, token.progress());
+
+  token.cancel();
+  EXPECT_TRUE(token.canceled());
+}
+
+TEST(ProgressToken, Parts)
+{
+  progress_token total;
+  progress_token a, b;
+  a.set_parent(&total, 0.25);
+  b.set_parent(&total, 0.75);
+
+  a.set_progress(1.0);
+  EXPECT_NEAR(0.25, total.progress(), 1e-9);
+  b.set_progress(0.5);
+  EXPECT_NEAR(0.625, total.progress(), 1e-9);
+  b.set_progress(0.0);
+  EXPECT_NEAR(0.25, total.progress(), 1e-9);
+  b.set_progress(1.0);
+  EXPECT_NEAR(1.0, total.progress(), 1e-9);
+
+  // Canceling the parent cancels the parts
+  EXPECT_FALSE(a.canceled());
+  total.cancel();
+  EXPECT_TRUE(a.canceled());
+  EXPECT_TRUE(b.canceled());
+}
+
+TEST(ProgressToken, StepsFromSeveralThreads)
+{
+  const int n = 10000;
+  progress_token total;
+  progress_token stage1, stage2;
+  stage1.set_parent(&total, 0.5);
+  stage2.set_parent(&total, 0.5);
+
+  stage1.set_steps(n);
+  thread_pool::global().parallel_for(n, [&stage1](int){ stage1.step(); });
+  EXPECT_NEAR(1.0, stage1.progress(), 1e-6);
+  EXPECT_NEAR(0.5, total.progress(), 1e-6);
+
+  stage2.set_steps(n);
+  thread_pool::global().parallel_for(n/2, [&stage2](int){ stage2.step(); });
+  EXPECT_NEAR(0.5, stage2.progress(), 1e-6);
+  EXPECT_NEAR(0.75, total.progress(), 1e-6);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
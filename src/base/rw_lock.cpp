@@ -0,0 +1,153 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/rw_lock.h"
+
+#include "base/debug.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace base {
+
+template<typename Pred>
+bool rw_lock::wait_for(std::unique_lock<std::mutex>& hold, int timeout, Pred pred)
+{
+  if (timeout > 0)
+    return m_cv.wait_for(hold, std::chrono::milliseconds(timeout), pred);
+  else
+    return pred();
+}
+
+rw_lock::rw_lock()
+  : m_write_locked(false)
+  , m_waiting_writers(0)
+{
+}
+
+rw_lock::~rw_lock()
+{
+  ASSERT(!m_write_locked);
+  ASSERT(m_readers.empty());
+}
+
+bool rw_lock::lock(lock_type type, int timeout)
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+
+  switch (type) {
+
+    case read_lock: {
+      bool nested = is_reader();
+      if (!wait_for(hold, timeout, [this, nested]{
+            return (!m_write_locked &&
+                    (m_waiting_writers == 0 || nested));
+          }))
+        return false;
+
+      m_readers.push_back(std::this_thread::get_id());
+      return true;
+    }
+
+    case write_lock: {
+      ++m_waiting_writers;
+      bool res = wait_for(hold, timeout, [this]{
+          return (!m_write_locked && m_readers.empty());
+        });
+      --m_waiting_writers;
+
+      if (res)
+        m_write_locked = true;
+      else
+        m_cv.notify_all();      // Readers waiting for this writer can continue
+      return res;
+    }
+  }
+
+  return false;
+}
+
+bool rw_lock::upgrade_to_write(int timeout)
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  ASSERT(is_reader());
+
+  ++m_waiting_writers;
+  bool res = wait_for(hold, timeout, [this]{
+      return (!m_write_locked && m_readers.size() == 1);
+    });
+  --m_waiting_writers;
+
+  if (res) {
+    m_readers.clear();
+    m_write_locked = true;
+  }
+  else
+    m_cv.notify_all();
+  return res;
+}
+
+void rw_lock::downgrade_to_read()
+{
+  {
+    std::unique_lock<std::mutex> hold(m_mutex);
+    ASSERT(m_write_locked);
+    ASSERT(m_readers.empty());
+
+    m_write_locked = false;
+    m_readers.push_back(std::this_thread::get_id());
+  }
+  m_cv.notify_all();
+}
+
+void rw_lock::unlock()
+{
+  {
+    std::unique_lock<std::mutex> hold(m_mutex);
+
+    if (m_write_locked) {
+      m_write_locked = false;
+    }
+    else if (!m_readers.empty()) {
+      // Read locks can be released from other thread, in that case we
+      // remove any of them.
+      auto it = std::find(m_readers.begin(), m_readers.end(),
+                          std::this_thread::get_id());
+      if (it == m_readers.end())
+        --it;
+      m_readers.erase(it);
+    }
+    else {
+      ASSERT(false);
+      return;
+    }
+  }
+  m_cv.notify_all();
+}
+
+int rw_lock::read_locks() const
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  return int(m_readers.size());
+}
+
+bool rw_lock::write_locked() const
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  return m_write_locked;
+}
+
+bool rw_lock::is_reader() const
+{
+  return (std::find(m_readers.begin(), m_readers.end(),
+                    std::this_thread::get_id()) != m_readers.end());
+}
+
+} // namespace base
@@ -0,0 +1,72 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_RW_LOCK_H_INCLUDED
+#define BASE_RW_LOCK_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace base {
+
+  // Readers/writer lock with timed waits. Threads are blocked on a
+  // condition variable (woken up as soon as the lock is released).
+  //
+  // Threads waiting to write have preference over new readers, so a
+  // continuous flow of readers cannot starve writers. Anyway a thread
+  // that already has a read lock can always lock to read again
+  // (nested readers).
+  class rw_lock {
+  public:
+    enum lock_type { read_lock, write_lock };
+
+    rw_lock();
+    ~rw_lock();
+
+    // Locks to read or write waiting "timeout" milliseconds at most
+    // (0 to try to lock it without waiting). Returns false if the
+    // lock couldn't be obtained.
+    bool lock(lock_type type, int timeout);
+
+    // Converts the read lock of the current thread to a write lock.
+    // It's possible only if it's the only reader.
+    bool upgrade_to_write(int timeout);
+
+    // Converts the write lock to a read lock.
+    void downgrade_to_read();
+
+    // Unlocks the write lock, or one read lock of the current thread.
+    void unlock();
+
+    int read_locks() const;
+    bool write_locked() const;
+
+  private:
+    bool is_reader() const;
+
+    // Waits until "pred" is true or the timeout expires
+    template<typename Pred>
+    bool wait_for(std::unique_lock<std::mutex>& hold, int timeout, Pred pred);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_write_locked;
+    int m_waiting_writers;
+
+    // One item for each read lock (the thread that got it)
+    std::vector<std::thread::id> m_readers;
+
+    DISABLE_COPYING(rw_lock);
+  };
+
+} // namespace base
+
+#endif
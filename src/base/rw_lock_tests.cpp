@@ -0,0 +1,124 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/rw_lock.h"
+
+#include "base/thread.h"
+
+#include <atomic>
+#include <chrono>
+
+using namespace base;
+
+TEST(RWLock, ReadersAndWriters)
+{
+  rw_lock lock;
+
+  EXPECT_TRUE(lock.lock(rw_lock::read_lock, 0));
+  EXPECT_TRUE(lock.lock(rw_lock::read_lock, 0));
+  EXPECT_FALSE(lock.lock(rw_lock::write_lock, 0));
+  EXPECT_EQ(2, lock.read_locks());
+
+  // Only one reader can be upgraded
+  EXPECT_FALSE(lock.upgrade_to_write(0));
+  lock.unlock();
+  EXPECT_TRUE(lock.upgrade_to_write(0));
+  EXPECT_TRUE(lock.write_locked());
+  EXPECT_FALSE(lock.lock(rw_lock::read_lock, 0));
+  EXPECT_FALSE(lock.lock(rw_lock::write_lock, 0));
+
+  lock.downgrade_to_read();
+  EXPECT_FALSE(lock.write_locked());
+  EXPECT_EQ(1, lock.read_locks());
+  lock.unlock();
+
+  EXPECT_TRUE(lock.lock(rw_lock::write_lock, 0));
+  lock.unlock();
+}
+
+TEST(RWLock, TimedWait)
+{
+  rw_lock lock;
+  ASSERT_TRUE(lock.lock(rw_lock::write_lock, 0));
+
+  auto t0 = std::chrono::steady_clock::now();
+  std::atomic<bool> res(true);
+  thread t([&lock, &res]{ res = lock.lock(rw_lock::read_lock, 50); });
+  t.join();
+
+  EXPECT_FALSE(res);
+  EXPECT_LE(40, std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - t0).count());
+  lock.unlock();
+}
+
+TEST(RWLock, WakeUpWhenUnlocked)
+{
+  rw_lock lock;
+  ASSERT_TRUE(lock.lock(rw_lock::read_lock, 0));
+
+  std::atomic<bool> res(false);
+  thread t([&lock, &res]{
+      res = lock.lock(rw_lock::write_lock, 10000);
+      if (res)
+        lock.unlock();
+    });
+
+  this_thread::sleep_for(0.02);
+  auto t0 = std::chrono::steady_clock::now();
+  lock.unlock();
+  t.join();
+
+  // The writer is woken up immediately (not after the timeout)
+  EXPECT_TRUE(res);
+  EXPECT_GT(5000, std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - t0).count());
+}
+
+TEST(RWLock, WaitingWritersHavePreference)
+{
+  rw_lock lock;
+  ASSERT_TRUE(lock.lock(rw_lock::read_lock, 0));
+
+  std::atomic<bool> writing(false);
+  thread t([&lock, &writing]{
+      if (lock.lock(rw_lock::write_lock, 10000)) {
+        writing = true;
+        lock.unlock();
+      }
+    });
+
+  // New readers must wait for the writer (so other thread cannot
+  // lock it after the writer is blocked)...
+  std::atomic<bool> otherReader(true);
+  thread t2([&lock, &otherReader]{
+      for (int i=0; i<1000 && otherReader; ++i) {
+        otherReader = lock.lock(rw_lock::read_lock, 0);
+        if (otherReader) {
+          lock.unlock();
+          this_thread::sleep_for(0.001);
+        }
+      }
+    });
+  t2.join();
+  EXPECT_FALSE(otherReader);
+
+  // ...but the current reader can lock it again.
+  EXPECT_TRUE(lock.lock(rw_lock::read_lock, 0));
+  lock.unlock();
+  lock.unlock();
+
+  t.join();
+  EXPECT_TRUE(writing);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -26,72 +26,71 @@ uint8_t read8(std::istream& is)
   return (uint8_t)is.get();
 }
 
+// Multi-byte values are written/read with one write()/read() call
+// (instead of one put()/get() call for each byte).
+
 std::ostream& little_endian::write16(std::ostream& os, uint16_t word)
 {
-  os.put((int)((word & 0x00ff)));
-  os.put((int)((word & 0xff00) >> 8));
-  return os;
+  char buf[2] = {
+    char(word & 0x00ff),
+    char((word & 0xff00) >> 8) };
+  return os.write(buf, 2);
 }
 
 std::ostream& little_endian::write32(std::ostream& os, uint32_t dword)
 {
-  os.put((int)((dword & 0x000000ffl)));
-  os.put((int)((dword & 0x0000ff00l) >> 8));
-  os.put((int)((dword & 0x00ff0000l) >> 16));
-  os.put((int)((dword & 0xff000000l) >> 24));
-  return os;
+  char buf[4] = {
+    char(dword & 0x000000ffl),
+    char((dword & 0x0000ff00l) >> 8),
+    char((dword & 0x00ff0000l) >> 16),
+    char((dword & 0xff000000l) >> 24) };
+  return os.write(buf, 4);
 }
 
 uint16_t little_endian::read16(std::istream& is)
 {
-  int b1, b2;
-  b1 = is.get();
-  b2 = is.get();
-  return ((b2 << 8) | b1);
+  uint8_t buf[2] = { 0, 0 };
+  is.read((char*)buf, 2);
+  return ((buf[1] << 8) | buf[0]);
 }
 
 uint32_t little_endian::read32(std::istream& is)
 {
-  int b1, b2, b3, b4;
-  b1 = is.get();
-  b2 = is.get();
-  b3 = is.get();
-  b4 = is.get();
-  return ((b4 << 24) | (b3 << 16) | (b2 << 8) | b1);
+  uint8_t buf[4] = { 0, 0, 0, 0 };
+  is.read((char*)buf, 4);
+  return ((uint32_t(buf[3]) << 24) | (buf[2] << 16) | (buf[1] << 8) | buf[0]);
 }
 
 std::ostream& big_endian::write16(std::ostream& os, uint16_t word)
 {
-  os.put((int)((word & 0xff00) >> 8));
-  os.put((int)((word & 0x00ff)));
-  return os;
+  char buf[2] = {
+    char((word & 0xff00) >> 8),
+    char(word & 0x00ff) };
+  return os.write(buf, 2);
 }
 
 std::ostream& big_endian::write32(std::ostream& os, uint32_t dword)
 {
-  os.put((int)((dword & 0xff000000l) >> 24));
-  os.put((int)((dword & 0x00ff0000l) >> 16));
-  os.put((int)((dword & 0x0000ff00l) >> 8));
-  os.put((int)((dword & 0x000000ffl)));
-  return os;
+  char buf[4] = {
+    char((dword & 0xff000000l) >> 24),
+    char((dword & 0x00ff0000l) >> 16),
+    char((dword & 0x0000ff00l) >> 8),
+    char(dword & 0x000000ffl) };
+  return os.write(buf, 4);
 }
 
 uint16_t big_endian::read16(std::istream& is)
 {
-  int b1, b2;
-  b2 = is.get();
-  b1 = is.get();
-  return ((b2 << 8) | b1);
+  uint8_t buf[2] = { 0, 0 };
+  is.read((char*)buf, 2);
+  return ((buf[0] << 8) | buf[1]);
 }
 
 uint32_t big_endian::read32(std::istream& is)
 {
-  int b1, b2, b3, b4;
-  b4 = is.get();
-  b3 = is.get();
-  b2 = is.get();
-  b1 = is.get();
-  return ((b4 << 24) | (b3 << 16) | (b2 << 8) | b1);
+  uint8_t buf[4] = { 0, 0, 0, 0 };
+  is.read((char*)buf, 4);
+  return ((uint32_t(buf[0]) << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3]);
 }
 
 } // namespace serialization
@@ -0,0 +1,41 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/serialization.h"
+
+#include <sstream>
+
+using namespace base::serialization;
+
+TEST(Serialization, LittleAndBigEndian)
+{
+  std::stringstream s;
+  write8(s, 0x12);
+  little_endian::write16(s, 0x3456);
+  little_endian::write32(s, 0x789abcde);
+  big_endian::write16(s, 0x3456);
+  big_endian::write32(s, 0xf789abcd);
+
+  EXPECT_EQ(std::string("\x12\x56\x34\xde\xbc\x9a\x78\x34\x56\xf7\x89\xab\xcd", 13), s.str());
+
+  EXPECT_EQ(0x12, read8(s));
+  EXPECT_EQ(0x3456, little_endian::read16(s));
+  EXPECT_EQ(0x789abcde, little_endian::read32(s));
+  EXPECT_EQ(0x3456, big_endian::read16(s));
+  EXPECT_EQ(0xf789abcd, big_endian::read32(s));
+  EXPECT_TRUE(s.good());
+
+  little_endian::read32(s);
+  EXPECT_TRUE(s.fail());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -54,6 +54,19 @@ Sha1 Sha1::calculateFromFile(const std::string& fileName)
   return Sha1(digest);
 }
 
+Sha1 Sha1::calculateFromString(const std::string& str)
+{
+  SHA1Context sha;
+  SHA1Reset(&sha);
+  if (!str.empty())
+    SHA1Input(&sha, (const uint8_t*)str.c_str(), (unsigned int)str.size());
+
+  std::vector<uint8_t> digest(HashSize);
+  SHA1Result(&sha, &digest[0]);
+
+  return Sha1(digest);
+}
+
 bool Sha1::operator==(const Sha1& other) const
 {
   return m_digest == other.m_digest;
@@ -25,6 +25,9 @@ namespace base {
     // Calculates the SHA1 of the given file.
     static Sha1 calculateFromFile(const std::string& fileName);
 
+    // Calculates the SHA1 of the given bytes.
+    static Sha1 calculateFromString(const std::string& str);
+
     bool operator==(const Sha1& other) const;
     bool operator!=(const Sha1& other) const;
 
@@ -10,9 +10,13 @@
 
 #include "base/debug.h"
 
+#include <atomic>
+
 namespace base {
 
-// This class counts references for a SharedPtr.
+// This class counts references for a SharedPtr. The counter is
+// atomic, so SharedPtrs to the same object can be copied and
+// destroyed from different threads.
 class SharedPtrRefCounterBase {
 public:
   SharedPtrRefCounterBase() : m_count(0) { }
@@ -23,8 +27,7 @@ public:
   }
 
   void release() {
-    --m_count;
-    if (m_count == 0)
+    if (--m_count == 0)
       delete this;
   }
 
@@ -33,7 +36,7 @@ public:
   }
 
 private:
-  long m_count;         // Number of references.
+  std::atomic<long> m_count; // Number of references.
 };
 
 // Default deleter used by shared pointer (it calls "delete"
@@ -22,6 +22,13 @@
   #include <sys/time.h>
 #endif
 
+#if defined(__APPLE__)
+  #include <pthread/qos.h>
+#elif defined(__linux__)
+  #include <sys/resource.h>
+  #include <sys/syscall.h>
+#endif
+
 namespace {
 
 #ifdef _WIN32
@@ -152,3 +159,60 @@ void base::this_thread::sleep_for(double seconds)
 
 #endif
 }
+
+bool base::this_thread::set_qos(thread_qos qos)
+{
+#ifdef _WIN32
+
+  int priority;
+  switch (qos) {
+    case thread_qos::user_initiated: priority = THREAD_PRIORITY_BELOW_NORMAL; break;
+    case thread_qos::background: priority = THREAD_PRIORITY_LOWEST; break;
+    default: priority = THREAD_PRIORITY_NORMAL; break;
+  }
+  return (::SetThreadPriority(::GetCurrentThread(), priority) ? true: false);
+
+#elif defined(__APPLE__)
+
+  qos_class_t qosClass;
+  switch (qos) {
+    case thread_qos::user_initiated: qosClass = QOS_CLASS_USER_INITIATED; break;
+    case thread_qos::background: qosClass = QOS_CLASS_BACKGROUND; break;
+    default: qosClass = QOS_CLASS_USER_INTERACTIVE; break;
+  }
+  return (::pthread_set_qos_class_self_np(qosClass, 0) == 0);
+
+#elif defined(__linux__)
+
+  // setpriority() with a thread ID changes only that thread
+  int nice;
+  switch (qos) {
+    case thread_qos::user_initiated: nice = 5; break;
+    case thread_qos::background: nice = 10; break;
+    default: nice = 0; break;
+  }
+  return (::setpriority(PRIO_PROCESS, (id_t)::syscall(SYS_gettid), nice) == 0);
+
+#else
+
+  return false;
+
+#endif
+}
+
+bool base::this_thread::can_raise_qos()
+{
+#if defined(__linux__)
+
+  // RLIMIT_NICE is 20 minus the lowest nice value allowed (we need 0)
+  struct rlimit limit;
+  return (::geteuid() == 0 ||
+          (::getrlimit(RLIMIT_NICE, &limit) == 0 &&
+           (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur >= 20)));
+
+#else
+
+  return true;
+
+#endif
+}
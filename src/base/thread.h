@@ -10,6 +10,15 @@
 
 namespace base {                // Based on C++0x threads lib
 
+  // Quality of service class of a thread, so the OS can give less
+  // priority to work that the user is not waiting for (the GUI
+  // thread is interactive).
+  enum class thread_qos {
+    interactive,                // Painting and input handling
+    user_initiated,             // Work that the user is waiting for (saving a file, applying a filter)
+    background,                 // Work that the user doesn't see (backups, update checks)
+  };
+
   class thread {
   public:
     typedef void* native_handle_type;
@@ -92,6 +101,18 @@ namespace base {                // Based on C++0x threads lib
   {
     void yield();
     void sleep_for(double seconds);
+
+    // Changes the class of the calling thread. Returns false if the
+    // OS doesn't support it (or doesn't allow it, see can_raise_qos()).
+    //
+    // It uses QoS classes on OS X, thread priorities on Windows, and
+    // nice values of the thread on Linux.
+    bool set_qos(thread_qos qos);
+
+    // Returns true if a thread can go back to a higher class after a
+    // set_qos() call. On Linux, unprivileged threads cannot decrease
+    // their nice value.
+    bool can_raise_qos();
   }
 
   // This class joins the thread in its destructor.
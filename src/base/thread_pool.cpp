@@ -0,0 +1,298 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/thread_pool.h"
+
+#include "base/thread.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <unistd.h>
+#endif
+
+namespace base {
+
+int hardware_concurrency()
+{
+  int n = 1;
+#ifdef _WIN32
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  n = int(si.dwNumberOfProcessors);
+#elif defined(_SC_NPROCESSORS_ONLN)
+  n = int(sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+  return (n > 0 ? n: 1);
+}
+
+class thread_pool::impl {
+public:
+  impl(int workers)
+    : m_running(true)
+    , m_changeQos(this_thread::can_raise_qos()) {
+    for (int i=0; i<workers; ++i)
+      m_threads.push_back(new thread(&impl::worker_proc, this));
+  }
+
+  ~impl() {
+    {
+      std::unique_lock<std::mutex> hold(m_mutex);
+      m_running = false;
+    }
+    m_cv.notify_all();
+
+    for (thread* t : m_threads) {
+      t->join();
+      delete t;
+    }
+  }
+
+  int workers() const {
+    return int(m_threads.size());
+  }
+
+  void execute(const task& t, priority p) {
+    {
+      std::unique_lock<std::mutex> hold(m_mutex);
+      m_tasks[int(p)].push(t);
+    }
+    m_cv.notify_one();
+  }
+
+private:
+  static void worker_proc(impl* self) {
+    self->worker_loop();
+  }
+
+  void worker_loop() {
+    thread_qos qos = thread_qos::interactive;
+    for (;;) {
+      task t;
+      priority p = priority::normal;
+      {
+        std::unique_lock<std::mutex> hold(m_mutex);
+        m_cv.wait(hold, [this]{ return !m_running || !empty(); });
+        if (empty())
+          return;           // !m_running
+
+        for (int i=0; i<3; ++i) {
+          if (!m_tasks[i].empty()) {
+            t = m_tasks[i].front();
+            m_tasks[i].pop();
+            p = priority(i);
+            break;
+          }
+        }
+      }
+
+      // The worker runs each task with the class of its priority
+      // (only if it can go back to a higher class for the next task).
+      if (m_changeQos) {
+        thread_qos taskQos = qos_of(p);
+        if (taskQos != qos && this_thread::set_qos(taskQos))
+          qos = taskQos;
+      }
+
+      t();
+    }
+  }
+
+  static thread_qos qos_of(priority p) {
+    switch (p) {
+      case priority::normal: return thread_qos::user_initiated;
+      case priority::low: return thread_qos::background;
+      default: return thread_qos::interactive;
+    }
+  }
+
+  bool empty() const {
+    for (const auto& tasks : m_tasks)
+      if (!tasks.empty())
+        return false;
+    return true;
+  }
+
+  std::vector<thread*> m_threads;
+  std::queue<task> m_tasks[3];  // One queue for each priority
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_running;
+  bool m_changeQos;
+};
+
+namespace {
+
+  // State shared between the caller of parallel_for() and the
+  // helper tasks. Helpers that start after all items were claimed
+  // just return, so the caller never waits for a task that didn't
+  // start.
+  struct parallel_for_state {
+    thread_pool::indexed_task f;
+    int n;
+    std::atomic<int> next;
+    int done;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    parallel_for_state(int n, const thread_pool::indexed_task& f)
+      : f(f), n(n), next(0), done(0) {
+    }
+
+    void run() {
+      int count = 0;
+      int i;
+      while ((i = next++) < n) {
+        f(i);
+        ++count;
+      }
+      if (count > 0) {
+        std::unique_lock<std::mutex> hold(mutex);
+        done += count;
+        if (done == n)
+          cv.notify_all();
+      }
+    }
+
+    void wait() {
+      std::unique_lock<std::mutex> hold(mutex);
+      cv.wait(hold, [this]{ return done == n; });
+    }
+  };
+
+} // anonymous namespace
+
+task_token::task_token()
+  : m_state(pending)
+{
+}
+
+bool task_token::canceled() const
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  return (m_state == canceled_state);
+}
+
+bool task_token::finished() const
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  return (m_state == done || m_state == canceled_state);
+}
+
+void task_token::cancel()
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  if (m_state == pending) {
+    m_state = canceled_state;
+    m_cv.notify_all();
+  }
+  else
+    m_cv.wait(hold, [this]{ return m_state != running; });
+}
+
+void task_token::wait()
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  m_cv.wait(hold, [this]{ return m_state == done || m_state == canceled_state; });
+}
+
+bool task_token::start()
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  if (m_state != pending)
+    return false;
+
+  m_state = running;
+  return true;
+}
+
+void task_token::finish()
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  m_state = done;
+  m_cv.notify_all();
+}
+
+thread_pool::thread_pool(int workers)
+  : m_impl(new impl(workers > 0 ? workers: 0))
+{
+}
+
+thread_pool::~thread_pool()
+{
+  delete m_impl;
+}
+
+int thread_pool::workers() const
+{
+  return m_impl->workers();
+}
+
+void thread_pool::execute(const task& t, priority p)
+{
+  if (m_impl->workers() > 0)
+    m_impl->execute(t, p);
+  else
+    t();
+}
+
+void thread_pool::execute(const task& t, const task_token_ptr& token, priority p)
+{
+  execute(
+    [t, token]{
+      if (!token->start())
+        return;
+
+      try {
+        t();
+      }
+      catch (...) {
+        // Tasks should handle their own exceptions
+      }
+      token->finish();
+    }, p);
+}
+
+void thread_pool::parallel_for(int n, const indexed_task& f)
+{
+  if (n <= 0)
+    return;
+
+  int helpers = std::min(n-1, m_impl->workers());
+  if (helpers == 0) {
+    for (int i=0; i<n; ++i)
+      f(i);
+    return;
+  }
+
+  std::shared_ptr<parallel_for_state> state(new parallel_for_state(n, f));
+  for (int i=0; i<helpers; ++i)
+    m_impl->execute([state]{ state->run(); }, priority::high);
+
+  state->run();
+  state->wait();
+}
+
+// static
+thread_pool& thread_pool::global()
+{
+  static thread_pool pool(std::max(1, hardware_concurrency()-1));
+  return pool;
+}
+
+} // namespace base
@@ -0,0 +1,109 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_THREAD_POOL_H_INCLUDED
+#define BASE_THREAD_POOL_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace base {
+
+  // Returns the number of hardware threads (always >= 1).
+  int hardware_concurrency();
+
+  // Shared between a task queued in a thread_pool and its owner, so
+  // the owner can cancel the task (if it wasn't started yet) or wait
+  // until it's finished before destroying the data used by the task.
+  class task_token {
+  public:
+    task_token();
+
+    bool canceled() const;
+    bool finished() const;
+
+    // Cancels the task if it wasn't started yet, in other case waits
+    // until it's finished.
+    void cancel();
+
+    // Waits until the task is finished (or canceled).
+    void wait();
+
+  private:
+    friend class thread_pool;
+    enum state { pending, running, done, canceled_state };
+
+    bool start();
+    void finish();
+
+    state m_state;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    DISABLE_COPYING(task_token);
+  };
+
+  typedef std::shared_ptr<task_token> task_token_ptr;
+
+  // A fixed set of worker threads waiting for tasks to execute.
+  class thread_pool {
+  public:
+    typedef std::function<void()> task;
+    typedef std::function<void(int)> indexed_task;
+
+    // Tasks with higher priority are started first. E.g. parallel_for()
+    // uses the high priority because the calling thread is waiting
+    // for them, and long background tasks (like loading thumbnails)
+    // should use the low priority. Workers run high priority tasks
+    // as thread_qos::interactive, normal ones as user_initiated, and
+    // low ones as background (where this_thread::can_raise_qos()).
+    enum class priority { high, normal, low };
+
+    // Creates a pool with the given number of worker threads. A pool
+    // with zero workers is valid, all the work is done in the
+    // calling thread.
+    explicit thread_pool(int workers);
+    ~thread_pool();
+
+    int workers() const;
+
+    // Queues a task to be executed by some worker thread as soon as
+    // possible. If the pool doesn't have workers, the task is
+    // executed immediately in the calling thread.
+    void execute(const task& t, priority p = priority::normal);
+
+    // Same as execute(), but the task is not executed if the token is
+    // canceled before a worker starts it.
+    void execute(const task& t, const task_token_ptr& token,
+                 priority p = priority::normal);
+
+    // Calls f(i) for each i in [0, n) distributing the calls between
+    // the worker threads and the calling thread. Returns when all
+    // calls were made. It's safe to call this function from a worker
+    // thread of the same pool (the calling thread executes the
+    // pending items itself instead of waiting for busy workers).
+    void parallel_for(int n, const indexed_task& f);
+
+    // Shared pool with hardware_concurrency()-1 workers (the calling
+    // thread is the remaining one), and at least one worker so
+    // background tasks never run in the calling thread.
+    static thread_pool& global();
+
+  private:
+    class impl;
+    impl* m_impl;
+
+    DISABLE_COPYING(thread_pool);
+  };
+
+} // namespace base
+
+#endif
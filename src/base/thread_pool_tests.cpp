@@ -0,0 +1,133 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/thread_pool.h"
+
+#include "base/thread.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace base;
+
+TEST(ThreadPool, HardwareConcurrency)
+{
+  EXPECT_LE(1, hardware_concurrency());
+}
+
+TEST(ThreadPool, ParallelForWithoutWorkers)
+{
+  thread_pool pool(0);
+  std::vector<int> v(100, 0);
+  pool.parallel_for(int(v.size()), [&v](int i){ v[i] = i*2; });
+  for (int i=0; i<int(v.size()); ++i)
+    EXPECT_EQ(i*2, v[i]);
+}
+
+TEST(ThreadPool, ParallelForVisitsEachIndexOnce)
+{
+  thread_pool pool(4);
+  std::vector<std::atomic<int>> v(1000);
+  for (auto& x : v) x = 0;
+  pool.parallel_for(int(v.size()), [&v](int i){ ++v[i]; });
+  for (auto& x : v)
+    EXPECT_EQ(1, x);
+}
+
+TEST(ThreadPool, NestedParallelFor)
+{
+  thread_pool pool(2);
+  std::atomic<int> count(0);
+  pool.parallel_for(8, [&pool, &count](int){
+      pool.parallel_for(8, [&count](int){ ++count; });
+    });
+  EXPECT_EQ(64, count);
+}
+
+TEST(ThreadPool, Execute)
+{
+  std::atomic<int> count(0);
+  {
+    thread_pool pool(2);
+    for (int i=0; i<10; ++i)
+      pool.execute([&count]{ ++count; });
+  } // Pending tasks are finished before the pool is destroyed
+  EXPECT_EQ(10, count);
+}
+
+TEST(ThreadPool, CanceledTasksAreNotExecuted)
+{
+  std::atomic<int> count(0);
+  thread_pool pool(1);
+
+  // Block the only worker until the second task is canceled
+  task_token_ptr first(new task_token);
+  task_token_ptr second(new task_token);
+  std::mutex mutex;
+  mutex.lock();
+  pool.execute([&mutex, &count]{ mutex.lock(); mutex.unlock(); ++count; }, first);
+  pool.execute([&count]{ ++count; }, second);
+
+  second->cancel();
+  EXPECT_TRUE(second->canceled());
+  mutex.unlock();
+
+  first->wait();
+  EXPECT_TRUE(first->finished());
+  EXPECT_FALSE(first->canceled());
+  EXPECT_EQ(1, count);
+}
+
+TEST(ThreadPool, CancelWaitsRunningTask)
+{
+  std::atomic<bool> started(false);
+  std::atomic<bool> finished(false);
+  thread_pool pool(1);
+
+  task_token_ptr token(new task_token);
+  pool.execute([&started, &finished]{
+      started = true;
+      base::this_thread::sleep_for(0.05);
+      finished = true;
+    }, token);
+
+  while (!started)
+    base::this_thread::yield();
+
+  token->cancel();
+  EXPECT_TRUE(finished);
+  EXPECT_FALSE(token->canceled());
+}
+
+TEST(ThreadPool, HigherPriorityTasksFirst)
+{
+  std::vector<int> order;
+  std::mutex mutex;
+  mutex.lock();
+  {
+    thread_pool pool(1);
+    pool.execute([&mutex]{ mutex.lock(); mutex.unlock(); });
+
+    // The worker is blocked, so these tasks are queued
+    pool.execute([&order]{ order.push_back(3); }, thread_pool::priority::low);
+    pool.execute([&order]{ order.push_back(2); });
+    pool.execute([&order]{ order.push_back(1); }, thread_pool::priority::high);
+    mutex.unlock();
+  }
+  ASSERT_EQ(3, int(order.size()));
+  EXPECT_EQ(1, order[0]);
+  EXPECT_EQ(2, order[1]);
+  EXPECT_EQ(3, order[2]);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -68,6 +68,17 @@ TEST(Thread, TwoArgs)
   EXPECT_TRUE(flag);
 }
 
+TEST(Thread, BackgroundQos)
+{
+  // Any thread can lower its own class
+  bool result = false;
+  thread t([&result]{ result = this_thread::set_qos(thread_qos::background); });
+  t.join();
+#if defined(_WIN32) || defined(__APPLE__) || defined(__linux__)
+  EXPECT_TRUE(result);
+#endif
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,280 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/tracing.h"
+
+#include "base/debug.h"
+#include "base/file_handle.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+#else
+  #include <chrono>
+#endif
+
+// VS2013 doesn't support thread_local (and we only need a pointer)
+#ifdef _MSC_VER
+  #define BASE_THREAD_LOCAL __declspec(thread)
+#else
+  #define BASE_THREAD_LOCAL __thread
+#endif
+
+namespace base {
+namespace tracing {
+
+namespace details {
+  std::atomic<bool> enabled_flag(false);
+  std::atomic<int> counters_users(0);
+}
+
+namespace {
+
+// Events of each thread (must be a power of two)
+const uint64_t kBufferSize = 32*1024;
+
+// Maximum number of threads that can trace zones. Buffers are never
+// deleted (we cannot know when a thread finishes), so events of
+// threads created after this limit are discarded.
+const int kMaxThreads = 64;
+
+struct raw_event {
+  const char* name;
+  uint64_t begin;
+  uint64_t duration;
+};
+
+// Ring buffer written only by its thread and read by events().
+class ring_buffer {
+public:
+  ring_buffer(int thread)
+    : m_thread(thread)
+    , m_head(0)
+    , m_tail(0) {
+  }
+
+  void add(const char* name, uint64_t begin, uint64_t duration) {
+    uint64_t i = m_head.load(std::memory_order_relaxed);
+    raw_event& ev = m_events[i & (kBufferSize-1)];
+    ev.name = name;
+    ev.begin = begin;
+    ev.duration = duration;
+    m_head.store(i+1, std::memory_order_release);
+  }
+
+  void copy_to(std::vector<event>& output) const {
+    const uint64_t head = m_head.load(std::memory_order_acquire);
+    const uint64_t start = std::max(head < kBufferSize ? 0: head-kBufferSize, m_tail);
+    const std::size_t first = output.size();
+
+    for (uint64_t i=start; i<head; ++i) {
+      const raw_event& raw = m_events[i & (kBufferSize-1)];
+      event ev = { raw.name, raw.begin, raw.duration, m_thread };
+      output.push_back(ev);
+    }
+
+    // Discard events that the thread could have overwritten while we
+    // were copying them (the slot of the new head could be in use too)
+    const uint64_t newHead = m_head.load(std::memory_order_acquire);
+    const uint64_t firstValid = (newHead < kBufferSize ? 0: newHead-kBufferSize+1);
+    if (start < firstValid) {
+      std::size_t n = std::size_t(std::min(firstValid, head) - start);
+      output.erase(output.begin()+first, output.begin()+first+n);
+    }
+  }
+
+  void clear() {
+    m_tail = m_head.load(std::memory_order_acquire);
+  }
+
+private:
+  int m_thread;
+  std::atomic<uint64_t> m_head;
+  uint64_t m_tail;              // Used only by the reader (with the registry mutex locked)
+  raw_event m_events[kBufferSize];
+};
+
+// List of all counters (it's zero-initialized before any counter
+// constructor is called)
+counter* first_counter;
+
+std::mutex registry_mutex;
+ring_buffer* registry[kMaxThreads];
+int registry_count = 0;
+
+BASE_THREAD_LOCAL ring_buffer* thread_buffer = nullptr;
+BASE_THREAD_LOCAL bool thread_without_buffer = false;
+
+ring_buffer* get_thread_buffer()
+{
+  if (!thread_buffer && !thread_without_buffer) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    if (registry_count < kMaxThreads) {
+      thread_buffer = new ring_buffer(registry_count);
+      registry[registry_count++] = thread_buffer;
+    }
+    else
+      thread_without_buffer = true;
+  }
+  return thread_buffer;
+}
+
+void write_json_string(FILE* f, const char* s)
+{
+  std::fputc('"', f);
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\')
+      std::fputc('\\', f);
+    if ((unsigned char)*s >= ' ')
+      std::fputc(*s, f);
+  }
+  std::fputc('"', f);
+}
+
+} // anonymous namespace
+
+void set_enabled(bool state)
+{
+  if (details::enabled_flag.exchange(state) != state) {
+    if (state)
+      add_counters_user();
+    else
+      remove_counters_user();
+  }
+}
+
+void add_counters_user()
+{
+  ++details::counters_users;
+}
+
+void remove_counters_user()
+{
+  ASSERT(details::counters_users > 0);
+  --details::counters_users;
+}
+
+counter::counter(const char* name)
+  : m_name(name)
+  , m_value(0)
+  , m_next(first_counter)
+{
+  first_counter = this;
+}
+
+// static
+counter* counter::find(const char* name)
+{
+  for (counter* c=first_counter; c; c=c->m_next)
+    if (std::strcmp(c->m_name, name) == 0)
+      return c;
+  return nullptr;
+}
+
+// static
+counter* counter::first()
+{
+  return first_counter;
+}
+
+uint64_t now()
+{
+#ifdef _WIN32
+  static LARGE_INTEGER freq = { 0 };
+  if (freq.QuadPart == 0)
+    QueryPerformanceFrequency(&freq);
+
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return uint64_t(counter.QuadPart / freq.QuadPart * 1000000 +
+                  (counter.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart);
+#else
+  return uint64_t(
+    std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+void add_event(const char* name, uint64_t begin, uint64_t end)
+{
+  ring_buffer* buffer = get_thread_buffer();
+  if (buffer)
+    buffer->add(name, begin, (end > begin ? end-begin: 0));
+}
+
+std::vector<event> events()
+{
+  std::vector<event> output;
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (int i=0; i<registry_count; ++i)
+      registry[i]->copy_to(output);
+  }
+
+  // Outer zones first when two zones start at the same time
+  std::stable_sort(output.begin(), output.end(),
+                   [](const event& a, const event& b) {
+                     return (a.begin < b.begin ||
+                             (a.begin == b.begin && a.duration > b.duration));
+                   });
+  return output;
+}
+
+void clear()
+{
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (int i=0; i<registry_count; ++i)
+    registry[i]->clear();
+}
+
+void write_chrome_trace(FILE* f)
+{
+  std::vector<event> evs = events();
+
+  std::fprintf(f, "{\"traceEvents\":[");
+  for (std::size_t i=0; i<evs.size(); ++i) {
+    const event& ev = evs[i];
+    std::fprintf(f, "%s\n{\"name\":", (i > 0 ? ",": ""));
+    write_json_string(f, ev.name);
+    std::fprintf(f, ",\"cat\":\"aseprite\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu,\"dur\":%llu}",
+                 ev.thread,
+                 (unsigned long long)ev.begin,
+                 (unsigned long long)ev.duration);
+  }
+
+  // Final value of each counter
+  const uint64_t ts = now();
+  for (counter* c=first_counter; c; c=c->next()) {
+    std::fprintf(f, "%s\n{\"name\":", (evs.empty() && c == first_counter ? "": ","));
+    write_json_string(f, c->name());
+    std::fprintf(f, ",\"cat\":\"aseprite\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":%llu,\"args\":{\"value\":%lld}}",
+                 (unsigned long long)ts,
+                 (long long)c->value());
+  }
+  std::fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  std::fflush(f);
+}
+
+bool write_chrome_trace(const std::string& filename)
+{
+  FileHandle f(open_file(filename, "wb"));
+  if (!f)
+    return false;
+
+  write_chrome_trace(f.get());
+  return true;
+}
+
+} // namespace tracing
+} // namespace base
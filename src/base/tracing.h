@@ -0,0 +1,153 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_TRACING_H_INCLUDED
+#define BASE_TRACING_H_INCLUDED
+#pragma once
+
+#include "base/base.h"
+#include "base/disable_copying.h"
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace base {
+namespace tracing {
+
+  // A finished zone. Times are in microseconds.
+  struct event {
+    const char* name;
+    uint64_t begin;
+    uint64_t duration;
+    int thread;                 // Index of the thread (0 is the first thread that traced a zone)
+  };
+
+  namespace details {
+    extern std::atomic<bool> enabled_flag;
+    extern std::atomic<int> counters_users;
+  }
+
+  // Tracing is disabled by default. When it's disabled a zone only
+  // checks this flag (it doesn't read the clock or touch any buffer).
+  inline bool enabled() {
+    return details::enabled_flag.load(std::memory_order_relaxed);
+  }
+
+  // Enabling tracing enables counters too.
+  void set_enabled(bool state);
+
+  // Counters are enabled while there is at least one user of them
+  // (e.g. the tracing or a performance HUD).
+  inline bool counters_enabled() {
+    return details::counters_users.load(std::memory_order_relaxed) > 0;
+  }
+
+  void add_counters_user();
+  void remove_counters_user();
+
+  // Monotonic time in microseconds.
+  uint64_t now();
+
+  // Saves an event in the ring buffer of the current thread. The
+  // buffer is lock-free (only the first event of each thread takes a
+  // lock to register the buffer). When a buffer is full, the oldest
+  // events are overwritten. The name must be a string literal (only
+  // the pointer is saved).
+  void add_event(const char* name, uint64_t begin, uint64_t end);
+
+  // Returns a copy of the events of all threads (sorted by begin
+  // time, outer zones first). It can be called while other threads
+  // are adding events, events that could be overwritten while they
+  // were copied are discarded.
+  std::vector<event> events();
+
+  // Forgets all events saved until now.
+  void clear();
+
+  // Writes all events in the Chrome trace_event JSON format (it can be
+  // opened with chrome://tracing).
+  void write_chrome_trace(FILE* f);
+  bool write_chrome_trace(const std::string& filename);
+
+  // An accumulated value (e.g. number of rendered pixels) that can be
+  // read at any time. Counters must be global/static objects, they
+  // are registered in a global list in their constructors (so they
+  // can be found by name). The value is modified only if
+  // counters_enabled() is true.
+  class counter {
+  public:
+    counter(const char* name);
+
+    const char* name() const { return m_name; }
+    int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+    void add(int64_t delta) {
+      if (counters_enabled())
+        m_value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    counter* next() const { return m_next; }
+
+    // Returns nullptr if there is no counter with the given name.
+    static counter* find(const char* name);
+    static counter* first();
+
+  private:
+    const char* m_name;
+    std::atomic<int64_t> m_value;
+    counter* m_next;
+
+    DISABLE_COPYING(counter);
+  };
+
+  // Measures the time from the constructor to the destructor. Use the
+  // TRACE_ZONE() macro. The time (in microseconds) can be
+  // accumulated in a counter too.
+  class zone {
+  public:
+    zone(const char* name, counter* time = nullptr)
+      : m_name(enabled() ? name: nullptr)
+      , m_counter(time && counters_enabled() ? time: nullptr) {
+      if (m_name || m_counter)
+        m_begin = now();
+    }
+
+    ~zone() {
+      if (m_name || m_counter) {
+        uint64_t end = now();
+        if (m_name)
+          add_event(m_name, m_begin, end);
+        if (m_counter)
+          m_counter->add(int64_t(end - m_begin));
+      }
+    }
+
+  private:
+    const char* m_name;
+    counter* m_counter;
+    uint64_t m_begin;
+
+    DISABLE_COPYING(zone);
+  };
+
+} // namespace tracing
+} // namespace base
+
+#define TRACE_ZONE_CONCAT2(a, b) a##b
+#define TRACE_ZONE_CONCAT(a, b) TRACE_ZONE_CONCAT2(a, b)
+
+// Traces the rest of the current scope with the given name.
+#define TRACE_ZONE(name) \
+  base::tracing::zone TRACE_ZONE_CONCAT(trace_zone_, __LINE__)(name)
+
+// Same as TRACE_ZONE() but the time is accumulated in the given
+// counter too.
+#define TRACE_ZONE_COUNTER(name, timeCounter) \
+  base::tracing::zone TRACE_ZONE_CONCAT(trace_zone_, __LINE__)(name, &(timeCounter))
+
+#endif
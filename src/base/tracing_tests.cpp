@@ -0,0 +1,163 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/tracing.h"
+
+#include "base/thread.h"
+
+#include <cstring>
+
+using namespace base;
+
+static int count_events(const char* name)
+{
+  int n = 0;
+  for (const tracing::event& ev : tracing::events())
+    if (std::strcmp(ev.name, name) == 0)
+      ++n;
+  return n;
+}
+
+TEST(Tracing, DisabledZonesAreIgnored)
+{
+  tracing::set_enabled(false);
+  tracing::clear();
+  {
+    TRACE_ZONE("disabled");
+  }
+  EXPECT_EQ(0, count_events("disabled"));
+}
+
+TEST(Tracing, NestedZones)
+{
+  tracing::set_enabled(true);
+  tracing::clear();
+  {
+    TRACE_ZONE("outer");
+    {
+      TRACE_ZONE("inner");
+    }
+  }
+  tracing::set_enabled(false);
+
+  std::vector<tracing::event> evs = tracing::events();
+  ASSERT_EQ(2, int(evs.size()));
+  EXPECT_STREQ("outer", evs[0].name);
+  EXPECT_STREQ("inner", evs[1].name);
+  EXPECT_LE(evs[0].begin, evs[1].begin);
+  EXPECT_LE(evs[1].begin + evs[1].duration, evs[0].begin + evs[0].duration);
+}
+
+TEST(Tracing, RingBufferKeepsLastEvents)
+{
+  tracing::set_enabled(true);
+  tracing::clear();
+  for (int i=0; i<100000; ++i)
+    tracing::add_event("many", i, i+1);
+  tracing::set_enabled(false);
+
+  std::vector<tracing::event> evs = tracing::events();
+  ASSERT_FALSE(evs.empty());
+  EXPECT_GT(100000, int(evs.size()));
+  EXPECT_EQ(99999, int(evs.back().begin));
+  for (std::size_t i=1; i<evs.size(); ++i)
+    EXPECT_EQ(evs[i-1].begin+1, evs[i].begin);
+}
+
+static void trace_in_thread()
+{
+  for (int i=0; i<10; ++i) {
+    TRACE_ZONE("thread");
+  }
+}
+
+TEST(Tracing, EachThreadHasItsBuffer)
+{
+  tracing::set_enabled(true);
+  tracing::clear();
+  {
+    TRACE_ZONE("main");
+  }
+  base::thread t1(&trace_in_thread);
+  base::thread t2(&trace_in_thread);
+  t1.join();
+  t2.join();
+  tracing::set_enabled(false);
+
+  std::vector<tracing::event> evs = tracing::events();
+  EXPECT_EQ(21, int(evs.size()));
+
+  int mainThread = -1;
+  for (const tracing::event& ev : evs)
+    if (std::strcmp(ev.name, "main") == 0)
+      mainThread = ev.thread;
+  for (const tracing::event& ev : evs)
+    if (std::strcmp(ev.name, "thread") == 0)
+      EXPECT_NE(mainThread, ev.thread);
+}
+
+TEST(Tracing, ChromeTraceFormat)
+{
+  tracing::set_enabled(true);
+  tracing::clear();
+  tracing::add_event("a \"quoted\" zone", 10, 15);
+  tracing::set_enabled(false);
+
+  FILE* f = std::tmpfile();
+  ASSERT_TRUE(f != NULL);
+  tracing::write_chrome_trace(f);
+  std::rewind(f);
+
+  char buf[1024];
+  std::size_t n = std::fread(buf, 1, sizeof(buf)-1, f);
+  buf[n] = 0;
+  std::fclose(f);
+
+  std::string json(buf);
+  EXPECT_NE(std::string::npos, json.find("\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"a \\\"quoted\\\" zone\""));
+  EXPECT_NE(std::string::npos, json.find("\"ph\":\"X\""));
+  EXPECT_NE(std::string::npos, json.find("\"ts\":10,\"dur\":5"));
+}
+
+static tracing::counter test_counter("test.counter");
+static tracing::counter test_time("test.time");
+
+TEST(Tracing, Counters)
+{
+  EXPECT_EQ(&test_counter, tracing::counter::find("test.counter"));
+  EXPECT_EQ(nullptr, tracing::counter::find("test.unknown"));
+
+  int64_t value = test_counter.value();
+  test_counter.add(5);
+  EXPECT_EQ(value, test_counter.value()); // Disabled
+
+  tracing::add_counters_user();
+  test_counter.add(5);
+  test_counter.add(2);
+  {
+    TRACE_ZONE_COUNTER("timed", test_time);
+  }
+  tracing::remove_counters_user();
+  EXPECT_EQ(value+7, test_counter.value());
+  EXPECT_LE(0, test_time.value());
+
+  // Counters are enabled with the tracing too
+  tracing::set_enabled(true);
+  test_counter.add(1);
+  tracing::set_enabled(false);
+  test_counter.add(1);
+  EXPECT_EQ(value+8, test_counter.value());
+  EXPECT_FALSE(tracing::counters_enabled());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
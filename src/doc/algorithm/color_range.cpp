@@ -0,0 +1,224 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/algorithm/color_range.h"
+
+#include "doc/image.h"
+#include "doc/image_traits.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_COLOR_RANGE_SSE2
+  #include <emmintrin.h>
+#endif
+
+namespace doc {
+namespace algorithm {
+
+static inline bool channel_in_range(int a, int b, int tolerance)
+{
+  return (std::abs(a - b) <= tolerance);
+}
+
+struct RgbInRange {
+  bool operator()(color_t c, color_t color, int tolerance, bool transparent) const {
+    return ((transparent && rgba_geta(c) == 0) ||
+            (channel_in_range(rgba_getr(c), rgba_getr(color), tolerance) &&
+             channel_in_range(rgba_getg(c), rgba_getg(color), tolerance) &&
+             channel_in_range(rgba_getb(c), rgba_getb(color), tolerance) &&
+             channel_in_range(rgba_geta(c), rgba_geta(color), tolerance)));
+  }
+};
+
+struct GrayscaleInRange {
+  bool operator()(color_t c, color_t color, int tolerance, bool transparent) const {
+    return ((transparent && graya_geta(c) == 0) ||
+            (channel_in_range(graya_getv(c), graya_getv(color), tolerance) &&
+             channel_in_range(graya_geta(c), graya_geta(color), tolerance)));
+  }
+};
+
+struct IndexedInRange {
+  bool operator()(color_t c, color_t color, int tolerance, bool transparent) const {
+    return channel_in_range(c, color, tolerance);
+  }
+};
+
+// Writes the bits of the pixels [x, w) one by one ("x" must be the
+// first pixel of a byte)
+template<typename ImageTraits, typename InRange>
+static inline void row_in_range_tail(const typename ImageTraits::pixel_t* src,
+                                     uint8_t* dst, int x, int w,
+                                     color_t color, int tolerance,
+                                     bool transparent)
+{
+  ASSERT((x % 8) == 0);
+  InRange inRange;
+  dst += x / 8;
+  for (; x<w; x+=8) {
+    int n = MIN(8, w-x);
+    uint8_t bits = 0;
+    for (int i=0; i<n; ++i)
+      if (inRange(src[x+i], color, tolerance, transparent))
+        bits |= (1 << i);
+    *(dst++) = bits;
+  }
+}
+
+#ifdef DOC_COLOR_RANGE_SSE2
+
+// Returns a vector with 0xff in each byte which is inside the range
+static inline __m128i bytes_in_range(__m128i a, __m128i b, __m128i tolerance)
+{
+  __m128i diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+  return _mm_cmpeq_epi8(_mm_subs_epu8(diff, tolerance), _mm_setzero_si128());
+}
+
+static void rgb_row_in_range(const uint32_t* src, uint8_t* dst, int w,
+                             color_t color, uint8_t tolerance, bool transparent)
+{
+  const __m128i c = _mm_set1_epi32(color);
+  const __m128i t = _mm_set1_epi8(char(tolerance));
+  const __m128i all = _mm_set1_epi32(-1);
+  const __m128i zero = _mm_setzero_si128();
+  // The alpha mask is zero when transparent pixels aren't selected
+  const __m128i alpha = _mm_set1_epi32(transparent ? rgba_a_mask: 0);
+  int x = 0;
+
+  for (; x+8<=w; x+=8) {
+    __m128i pa = _mm_loadu_si128((const __m128i*)(src+x));
+    __m128i pb = _mm_loadu_si128((const __m128i*)(src+x+4));
+
+    // A pixel is selected if its four bytes are in range
+    __m128i a = _mm_cmpeq_epi32(bytes_in_range(pa, c, t), all);
+    __m128i b = _mm_cmpeq_epi32(bytes_in_range(pb, c, t), all);
+    if (transparent) {
+      a = _mm_or_si128(a, _mm_cmpeq_epi32(_mm_and_si128(pa, alpha), zero));
+      b = _mm_or_si128(b, _mm_cmpeq_epi32(_mm_and_si128(pb, alpha), zero));
+    }
+
+    dst[x/8] = uint8_t(_mm_movemask_ps(_mm_castsi128_ps(a)) |
+                       (_mm_movemask_ps(_mm_castsi128_ps(b)) << 4));
+  }
+
+  row_in_range_tail<RgbTraits, RgbInRange>(src, dst, x, w, color, tolerance, transparent);
+}
+
+static void grayscale_row_in_range(const uint16_t* src, uint8_t* dst, int w,
+                                   color_t color, uint8_t tolerance, bool transparent)
+{
+  const __m128i c = _mm_set1_epi16(short(color));
+  const __m128i t = _mm_set1_epi8(char(tolerance));
+  const __m128i all = _mm_set1_epi16(-1);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi16(short(graya_a_mask));
+  int x = 0;
+
+  for (; x+8<=w; x+=8) {
+    __m128i p = _mm_loadu_si128((const __m128i*)(src+x));
+
+    // A pixel is selected if its two bytes are in range
+    __m128i a = _mm_cmpeq_epi16(bytes_in_range(p, c, t), all);
+    if (transparent)
+      a = _mm_or_si128(a, _mm_cmpeq_epi16(_mm_and_si128(p, alpha), zero));
+
+    dst[x/8] = uint8_t(_mm_movemask_epi8(_mm_packs_epi16(a, a)));
+  }
+
+  row_in_range_tail<GrayscaleTraits, GrayscaleInRange>(src, dst, x, w, color, tolerance, transparent);
+}
+
+static void indexed_row_in_range(const uint8_t* src, uint8_t* dst, int w,
+                                 color_t color, uint8_t tolerance, bool transparent)
+{
+  const __m128i c = _mm_set1_epi8(char(color));
+  const __m128i t = _mm_set1_epi8(char(tolerance));
+  int x = 0;
+
+  for (; x+16<=w; x+=16) {
+    int bits = _mm_movemask_epi8(bytes_in_range(_mm_loadu_si128((const __m128i*)(src+x)), c, t));
+    dst[x/8] = uint8_t(bits);
+    dst[x/8+1] = uint8_t(bits >> 8);
+  }
+
+  row_in_range_tail<IndexedTraits, IndexedInRange>(src, dst, x, w, color, tolerance, transparent);
+}
+
+#else
+
+static void rgb_row_in_range(const uint32_t* src, uint8_t* dst, int w,
+                             color_t color, uint8_t tolerance, bool transparent)
+{
+  row_in_range_tail<RgbTraits, RgbInRange>(src, dst, 0, w, color, tolerance, transparent);
+}
+
+static void grayscale_row_in_range(const uint16_t* src, uint8_t* dst, int w,
+                                   color_t color, uint8_t tolerance, bool transparent)
+{
+  row_in_range_tail<GrayscaleTraits, GrayscaleInRange>(src, dst, 0, w, color, tolerance, transparent);
+}
+
+static void indexed_row_in_range(const uint8_t* src, uint8_t* dst, int w,
+                                 color_t color, uint8_t tolerance, bool transparent)
+{
+  row_in_range_tail<IndexedTraits, IndexedInRange>(src, dst, 0, w, color, tolerance, transparent);
+}
+
+#endif
+
+void row_in_color_range(const Image* image, int x, int y, int w,
+                        color_t color, int tolerance,
+                        bool transparentMatches,
+                        uint8_t* dst)
+{
+  ASSERT(x >= 0 && x+w <= image->width());
+  ASSERT(y >= 0 && y < image->height());
+
+  if (tolerance < 0) {
+    std::memset(dst, 0, (w+7) / 8);
+    return;
+  }
+
+  const uint8_t t = uint8_t(MIN(tolerance, 255));
+
+  switch (image->pixelFormat()) {
+
+    case IMAGE_RGB:
+      rgb_row_in_range(
+        (const RgbTraits::pixel_t*)image->getPixelAddress(x, y),
+        dst, w, color, t, transparentMatches);
+      break;
+
+    case IMAGE_GRAYSCALE:
+      grayscale_row_in_range(
+        (const GrayscaleTraits::pixel_t*)image->getPixelAddress(x, y),
+        dst, w, color, t, transparentMatches);
+      break;
+
+    case IMAGE_INDEXED:
+      indexed_row_in_range(
+        (const IndexedTraits::pixel_t*)image->getPixelAddress(x, y),
+        dst, w, color, t, transparentMatches);
+      break;
+
+    default:
+      std::memset(dst, 0, (w+7) / 8);
+      for (int i=0; i<w; ++i)
+        if (channel_in_range(get_pixel(image, x+i, y), color, t))
+          dst[i/8] |= (1 << (i%8));
+      break;
+  }
+}
+
+} // namespace algorithm
+} // namespace doc
@@ -0,0 +1,35 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_ALGORITHM_COLOR_RANGE_H_INCLUDED
+#define DOC_ALGORITHM_COLOR_RANGE_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+
+#include <cstdint>
+
+namespace doc {
+  class Image;
+
+  namespace algorithm {
+
+    // Writes in "dst" one bit for each pixel of the row segment
+    // [x, x+w) of "image" at "y": 1 if each channel of the pixel is
+    // in the range [c-tolerance, c+tolerance] (where "c" is the same
+    // channel of "color"). If "transparentMatches" is true, pixels
+    // with alpha=0 are set too. The first pixel is the least
+    // significant bit of dst[0], the unused bits of the last byte are
+    // zero.
+    void row_in_color_range(const Image* image, int x, int y, int w,
+                            color_t color, int tolerance,
+                            bool transparentMatches,
+                            uint8_t* dst);
+
+  } // algorithm
+} // doc
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,17 +11,110 @@
 #include "doc/algorithm/flip_image.h"
 
 #include "base/unique_ptr.h"
-#include "gfx/rect.h"
+#include "doc/algorithm/row_bands.h"
 #include "doc/image.h"
+#include "doc/image_traits.h"
 #include "doc/mask.h"
 #include "doc/primitives.h"
+#include "doc/primitives_fast.h"
+#include "gfx/rect.h"
 
+#include <algorithm>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_FLIP_IMAGE_SSE2
+  #include <emmintrin.h>
+#endif
+
 namespace doc {
 namespace algorithm {
 
-void flip_image(Image* image, const gfx::Rect& bounds, FlipType flipType)
+namespace {
+
+// Reverses "n" pixels of a row. With SSE2 both ends are swapped
+// reversing 16 bytes at the same time.
+template<typename pixel_t>
+void reverse_pixels(pixel_t* p, int n)
+{
+  std::reverse(p, p+n);
+}
+
+#ifdef DOC_FLIP_IMAGE_SSE2
+
+inline __m128i reverse_128(__m128i v, uint32_t)
+{
+  return _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+inline __m128i reverse_128(__m128i v, uint16_t)
+{
+  v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+inline __m128i reverse_128(__m128i v, uint8_t)
+{
+  v = reverse_128(v, uint16_t());
+  return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+template<typename pixel_t>
+void reverse_pixels_sse2(pixel_t* p, int n)
+{
+  const int k = 16 / sizeof(pixel_t);   // Pixels in 16 bytes
+  pixel_t* a = p;
+  pixel_t* b = p+n;
+
+  for (; b-a >= 2*k; a+=k, b-=k) {
+    __m128i u = _mm_loadu_si128((const __m128i*)a);
+    __m128i v = _mm_loadu_si128((const __m128i*)(b-k));
+    _mm_storeu_si128((__m128i*)a, reverse_128(v, pixel_t()));
+    _mm_storeu_si128((__m128i*)(b-k), reverse_128(u, pixel_t()));
+  }
+
+  std::reverse(a, b);
+}
+
+template<> void reverse_pixels<uint32_t>(uint32_t* p, int n) { reverse_pixels_sse2(p, n); }
+template<> void reverse_pixels<uint16_t>(uint16_t* p, int n) { reverse_pixels_sse2(p, n); }
+template<> void reverse_pixels<uint8_t>(uint8_t* p, int n) { reverse_pixels_sse2(p, n); }
+
+#endif
+
+template<typename ImageTraits>
+void flip_image_tpl(Image* image, const gfx::Rect& bounds, FlipType flipType)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  switch (flipType) {
+
+    case FlipHorizontal:
+      for_each_row_band(bounds.w, bounds.h,
+        [image, &bounds](int y1, int y2) {
+          for (int y=bounds.y+y1; y<bounds.y+y2; ++y)
+            reverse_pixels((pixel_t*)image->getPixelAddress(bounds.x, y), bounds.w);
+        });
+      break;
+
+    case FlipVertical:
+      // Each band swaps some of the first rows with the last rows
+      for_each_row_band(bounds.w, bounds.h/2,
+        [image, &bounds](int y1, int y2) {
+          for (int y=y1; y<y2; ++y) {
+            pixel_t* a = (pixel_t*)image->getPixelAddress(bounds.x, bounds.y+y);
+            pixel_t* b = (pixel_t*)image->getPixelAddress(bounds.x, bounds.y2()-1-y);
+            std::swap_ranges(a, a+bounds.w, b);
+          }
+        });
+      break;
+  }
+}
+
+// Pixels of bitmaps aren't aligned to bytes
+template<>
+void flip_image_tpl<BitmapTraits>(Image* image, const gfx::Rect& bounds, FlipType flipType)
 {
   switch (flipType) {
 
@@ -29,10 +122,10 @@ void flip_image(Image* image, const gfx::Rect& bounds, FlipType flipType)
       for (int y=bounds.y; y<bounds.y+bounds.h; ++y) {
         int u = bounds.x+bounds.w-1;
         for (int x=bounds.x; x<bounds.x+bounds.w/2; ++x, --u) {
-          uint32_t c1 = get_pixel(image, x, y);
-          uint32_t c2 = get_pixel(image, u, y);
-          put_pixel(image, x, y, c2);
-          put_pixel(image, u, y, c1);
+          color_t c1 = get_pixel_fast<BitmapTraits>(image, x, y);
+          color_t c2 = get_pixel_fast<BitmapTraits>(image, u, y);
+          put_pixel_fast<BitmapTraits>(image, x, y, c2);
+          put_pixel_fast<BitmapTraits>(image, u, y, c1);
         }
       }
       break;
@@ -41,10 +134,10 @@ void flip_image(Image* image, const gfx::Rect& bounds, FlipType flipType)
       int v = bounds.y+bounds.h-1;
       for (int y=bounds.y; y<bounds.y+bounds.h/2; ++y, --v) {
         for (int x=bounds.x; x<bounds.x+bounds.w; ++x) {
-          uint32_t c1 = get_pixel(image, x, y);
-          uint32_t c2 = get_pixel(image, x, v);
-          put_pixel(image, x, y, c2);
-          put_pixel(image, x, v, c1);
+          color_t c1 = get_pixel_fast<BitmapTraits>(image, x, y);
+          color_t c2 = get_pixel_fast<BitmapTraits>(image, x, v);
+          put_pixel_fast<BitmapTraits>(image, x, y, c2);
+          put_pixel_fast<BitmapTraits>(image, x, v, c1);
         }
       }
       break;
@@ -52,6 +145,22 @@ void flip_image(Image* image, const gfx::Rect& bounds, FlipType flipType)
   }
 }
 
+} // anonymous namespace
+
+void flip_image(Image* image, const gfx::Rect& bounds0, FlipType flipType)
+{
+  gfx::Rect bounds = bounds0.createIntersection(image->bounds());
+  if (bounds.isEmpty())
+    return;
+
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       flip_image_tpl<RgbTraits>(image, bounds, flipType); break;
+    case IMAGE_GRAYSCALE: flip_image_tpl<GrayscaleTraits>(image, bounds, flipType); break;
+    case IMAGE_INDEXED:   flip_image_tpl<IndexedTraits>(image, bounds, flipType); break;
+    case IMAGE_BITMAP:    flip_image_tpl<BitmapTraits>(image, bounds, flipType); break;
+  }
+}
+
 void flip_image_with_mask(Image* image, const Mask* mask, FlipType flipType, int bgcolor)
 {
   gfx::Rect bounds = mask->bounds();
@@ -1,327 +1,222 @@
-// The floodfill routine.
-// By Shawn Hargreaves.
-//
-// Adapted to Aseprite by David Capello
-// Added non-contiguous mode by David Capello
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
-//
-// TODO rewrite this algorithm from scratch
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
-#include "doc/algo.h"
+#include "doc/algorithm/floodfill.h"
+
+#include "base/thread_pool.h"
+#include "doc/algorithm/color_range.h"
 #include "doc/image.h"
 #include "doc/primitives.h"
+#include "gfx/rect.h"
 
-#include <climits>
-#include <cmath>
+#include <cstring>
 #include <vector>
 
 namespace doc {
 namespace algorithm {
 
-struct FLOODED_LINE {   // store segments which have been flooded
-  short flags;          // status of the segment
-  short lpos, rpos;     // left and right ends of segment
-  short y;              // y coordinate of the segment
-  int next;             // linked list if several per line
-};
-
-/* Note: a 'short' is not sufficient for 'next' above in some corner cases. */
-
-
-static std::vector<FLOODED_LINE> flood_buf;
-static int flood_count;          /* number of flooded segments */
-
-#define FLOOD_IN_USE             1
-#define FLOOD_TODO_ABOVE         2
-#define FLOOD_TODO_BELOW         4
-
-#define FLOOD_LINE(c)            (&flood_buf[c])
-
-static inline bool color_equal_32(color_t c1, color_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2) || (rgba_geta(c1) == 0 && rgba_geta(c2) == 0);
-  else {
-    int r1 = rgba_getr(c1);
-    int g1 = rgba_getg(c1);
-    int b1 = rgba_getb(c1);
-    int a1 = rgba_geta(c1);
-    int r2 = rgba_getr(c2);
-    int g2 = rgba_getg(c2);
-    int b2 = rgba_getb(c2);
-    int a2 = rgba_geta(c2);
-
-    if (a1 == 0 && a2 == 0)
-      return true;
-
-    return ((ABS(r1-r2) <= tolerance) &&
-            (ABS(g1-g2) <= tolerance) &&
-            (ABS(b1-b2) <= tolerance) &&
-            (ABS(a1-a2) <= tolerance));
+namespace {
+
+// Fills the area of pixels similar to a color (4-connected) using a
+// stack of spans. The "similar" bits of each row of the bounds are
+// calculated (a whole row at a time) the first time the fill reaches
+// the row, and the "filled" bits avoid visiting a pixel twice. In
+// both cases the first pixel of a row is the least significant bit
+// of its first byte.
+class FloodFill {
+public:
+  FloodFill(const Image* image, const gfx::Rect& bounds,
+            color_t color, int tolerance)
+    : m_image(image)
+    , m_bounds(bounds)
+    , m_color(color)
+    , m_tolerance(tolerance)
+    , m_stride((bounds.w+7) / 8)
+    , m_similar(m_stride * bounds.h)
+    , m_ready(bounds.h, false) {
+    // All transparent pixels are similar to a transparent color (their
+    // RGB components don't matter)
+    switch (image->pixelFormat()) {
+      case IMAGE_RGB: m_transparent = (rgba_geta(color) == 0); break;
+      case IMAGE_GRAYSCALE: m_transparent = (graya_geta(color) == 0); break;
+      default: m_transparent = false; break;
+    }
   }
-}
 
-static inline bool color_equal_16(color_t c1, color_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2) || (graya_geta(c1) == 0 && graya_geta(c2) == 0);
-  else {
-    int k1 = graya_getv(c1);
-    int a1 = graya_geta(c1);
-    int k2 = graya_getv(c2);
-    int a2 = graya_geta(c2);
-
-    if (a1 == 0 && a2 == 0)
-      return true;
-
-    return ((ABS(k1-k2) <= tolerance) &&
-            (ABS(a1-a2) <= tolerance));
+  // Calls "proc" for each span of the bounds similar to the color
+  void replaceColor(void* data, AlgoHLine proc) {
+    // The comparison of rows is distributed in bands of at least 64K
+    // pixels, the spans are reported from the calling thread.
+    const int bandRows = MAX(1, 65536 / m_bounds.w);
+    const int bands = (m_bounds.h + bandRows - 1) / bandRows;
+
+    base::thread_pool::global().parallel_for(
+      bands, [this, bandRows](int band) {
+        int v = band * bandRows;
+        int v2 = MIN(v + bandRows, m_bounds.h);
+        for (; v<v2; ++v)
+          calcRow(v);
+      });
+
+    for (int v=0; v<m_bounds.h; ++v) {
+      const uint8_t* similar = &m_similar[v*m_stride];
+      int u = 0;
+      while ((u = nextBit(similar, nullptr, u, m_bounds.w-1)) >= 0) {
+        int r = lastBit(similar, nullptr, u);
+        (*proc)(m_bounds.x+u, m_bounds.y+v, m_bounds.x+r, data);
+        u = r+1;
+      }
+    }
   }
-}
 
-static inline bool color_equal_8(color_t c1, color_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2);
-  else
-    return ABS((int)c1 - (int)c2) <= tolerance;
-}
+  // Calls "proc" for each span of the area connected to (x, y)
+  void fill(int x, int y, void* data, AlgoHLine proc) {
+    m_filled.resize(m_stride * m_bounds.h, 0);
 
-template<typename ImageTraits>
-static inline bool color_equal(color_t c1, color_t c2, int tolerance)
-{
-  static_assert(false && sizeof(ImageTraits), "Invalid color comparison");
-  return false;
-}
+    int u = x - m_bounds.x;
+    int v = y - m_bounds.y;
+    if (!isFillable(u, v))
+      return;
 
-template<>
-inline bool color_equal<RgbTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_32(c1, c2, tolerance);
-}
+    m_spans.clear();
+    fillSpan(u, v, data, proc);
 
-template<>
-inline bool color_equal<GrayscaleTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_16(c1, c2, tolerance);
-}
+    while (!m_spans.empty()) {
+      Span span = m_spans.back();
+      m_spans.pop_back();
 
-template<>
-inline bool color_equal<IndexedTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_8(c1, c2, tolerance);
-}
+      const uint8_t* similar = row(span.v);
+      const uint8_t* filled = &m_filled[span.v*m_stride];
 
+      u = span.u1;
+      while ((u = nextBit(similar, filled, u, span.u2)) >= 0)
+        u = fillSpan(u, span.v, data, proc) + 1;
+    }
+  }
 
+private:
+  // Pixels of row "v" that must be checked (from "u1" to "u2")
+  struct Span {
+    int v, u1, u2;
+    Span(int v, int u1, int u2) : v(v), u1(u1), u2(u2) { }
+  };
+
+  void calcRow(int v) {
+    row_in_color_range(m_image, m_bounds.x, m_bounds.y+v, m_bounds.w,
+                       m_color, m_tolerance, m_transparent,
+                       &m_similar[v*m_stride]);
+  }
 
-/* flooder:
- *  Fills a horizontal line around the specified position, and adds it
- *  to the list of drawn segments. Returns the first x coordinate after
- *  the part of the line which it has dealt with.
- */
-static int flooder(Image *image, int x, int y,
-  const gfx::Rect& bounds,
-  color_t src_color, int tolerance, void *data, AlgoHLine proc)
-{
-  FLOODED_LINE *p;
-  int left = 0, right = 0;
-  int c;
-
-  switch (image->pixelFormat()) {
-
-    case IMAGE_RGB:
-      {
-        uint32_t* address = reinterpret_cast<uint32_t*>(image->getPixelAddress(0, y));
+  const uint8_t* row(int v) {
+    if (!m_ready[v]) {
+      calcRow(v);
+      m_ready[v] = true;
+    }
+    return &m_similar[v*m_stride];
+  }
 
-        // Check start pixel
-        if (!color_equal_32((int)*(address+x), src_color, tolerance))
-          return x+1;
+  bool isFillable(int u, int v) {
+    if (u < 0 || v < 0 || u >= m_bounds.w || v >= m_bounds.h)
+      return false;
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_32((int)*(address+left), src_color, tolerance))
-            break;
-        }
+    const int i = v*m_stride + u/8;
+    const int bit = (1 << (u % 8));
+    return ((row(v)[u/8] & bit) && !(m_filled[i] & bit));
+  }
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_32((int)*(address+right), src_color, tolerance))
-            break;
-        }
+  // Fills the whole span of row "v" that contains the fillable pixel
+  // "u", and queues the rows above and below. Returns the last pixel
+  // of the span.
+  int fillSpan(int u, int v, void* data, AlgoHLine proc) {
+    const uint8_t* similar = row(v);
+    uint8_t* filled = &m_filled[v*m_stride];
+
+    int l = u;
+    while (l > 0 && isFillable(l-1, v))
+      --l;
+    int r = lastBit(similar, filled, u);
+
+    for (int i=l; i<=r; ) {
+      if ((i % 8) == 0 && i+8 <= r+1) {
+        filled[i/8] = 0xff;
+        i += 8;
       }
-      break;
-
-    case IMAGE_GRAYSCALE:
-      {
-        uint16_t* address = reinterpret_cast<uint16_t*>(image->getPixelAddress(0, y));
-
-        // Check start pixel
-        if (!color_equal_16((int)*(address+x), src_color, tolerance))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_16((int)*(address+left), src_color, tolerance))
-            break;
-        }
-
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_16((int)*(address+right), src_color, tolerance))
-            break;
-        }
+      else {
+        filled[i/8] |= (1 << (i % 8));
+        ++i;
       }
-      break;
-
-    case IMAGE_INDEXED:
-      {
-        uint8_t* address = image->getPixelAddress(0, y);
+    }
 
-        // Check start pixel
-        if (!color_equal_8((int)*(address+x), src_color, tolerance))
-          return x+1;
+    (*proc)(m_bounds.x+l, m_bounds.y+v, m_bounds.x+r, data);
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_8((int)*(address+left), src_color, tolerance))
-            break;
-        }
+    if (v > 0)
+      m_spans.push_back(Span(v-1, l, r));
+    if (v+1 < m_bounds.h)
+      m_spans.push_back(Span(v+1, l, r));
+    return r;
+  }
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_8((int)*(address+right), src_color, tolerance))
-            break;
+  // Returns the first pixel from "u" to "u2" which is similar (and not
+  // filled if "filled" isn't nullptr), or -1 if there is no one.
+  static int nextBit(const uint8_t* similar, const uint8_t* filled,
+                     int u, int u2) {
+    while (u <= u2) {
+      uint8_t bits = similar[u/8];
+      if (filled)
+        bits &= ~filled[u/8];
+      bits >>= (u % 8);
+
+      if (bits) {
+        while (!(bits & 1)) {
+          bits >>= 1;
+          ++u;
         }
+        return (u <= u2 ? u: -1);
       }
-      break;
-
-    default:
-      // Check start pixel
-      if (get_pixel(image, x, y) != src_color)
-        return x+1;
-
-      // Work left from starting point
-      for (left=x-1; left>=bounds.x; left--) {
-        if (get_pixel(image, left, y) != src_color)
-          break;
-      }
-
-      // Work right from starting point
-      for (right=x+1; right<bounds.x2(); right++) {
-        if (get_pixel(image, right, y) != src_color)
-          break;
-      }
-      break;
-  }
-
-  left++;
-  right--;
-
-  /* draw the line */
-  (*proc)(left, y, right, data);
-
-  /* store it in the list of flooded segments */
-  c = y;
-  p = FLOOD_LINE(c);
-
-  if (p->flags) {
-    while (p->next) {
-      c = p->next;
-      p = FLOOD_LINE(c);
+      u = (u/8 + 1) * 8;
     }
-
-    p->next = c = flood_count++;
-    flood_buf.resize(flood_count);
-    p = FLOOD_LINE(c);
+    return -1;
   }
 
-  p->flags = FLOOD_IN_USE;
-  p->lpos = left;
-  p->rpos = right;
-  p->y = y;
-  p->next = 0;
-
-  if (y > bounds.y)
-    p->flags |= FLOOD_TODO_ABOVE;
-
-  if (y+1 < bounds.y2())
-    p->flags |= FLOOD_TODO_BELOW;
-
-  return right+2;
-}
-
-
-
-/* check_flood_line:
- *  Checks a line segment, using the scratch buffer is to store a list of
- *  segments which have already been drawn in order to minimise the required
- *  number of tests.
- */
-static int check_flood_line(Image* image, int y, int left, int right,
-  const gfx::Rect& bounds,
-  int src_color, int tolerance, void *data, AlgoHLine proc)
-{
-  int c;
-  FLOODED_LINE *p;
-  int ret = false;
-
-  while (left <= right) {
-    c = y;
-
-    for (;;) {
-      p = FLOOD_LINE(c);
-
-      if ((left >= p->lpos) && (left <= p->rpos)) {
-        left = p->rpos+2;
-        break;
-      }
-
-      c = p->next;
-
-      if (!c) {
-        left = flooder(image, left, y, bounds, src_color, tolerance, data, proc);
-        ret = true;
+  // Returns the last pixel of the run of similar (and not filled)
+  // pixels that starts at "u".
+  int lastBit(const uint8_t* similar, const uint8_t* filled, int u) const {
+    for (++u; u < m_bounds.w; ) {
+      uint8_t bits = similar[u/8];
+      if (filled)
+        bits &= ~filled[u/8];
+
+      if ((u % 8) == 0 && bits == 0xff)
+        u += 8;
+      else if (bits & (1 << (u % 8)))
+        ++u;
+      else
         break;
-      }
     }
+    return MIN(u, m_bounds.w) - 1;
   }
 
-  return ret;
-}
-
-template<typename ImageTraits>
-static void replace_color(Image* image, const gfx::Rect& bounds, int src_color, int tolerance, void *data, AlgoHLine proc)
-{
-  typename ImageTraits::address_t address;
-
-  for (int y=bounds.y; y<bounds.y2(); ++y) {
-    address = reinterpret_cast<typename ImageTraits::address_t>(image->getPixelAddress(bounds.x, y));
-
-    for (int x=bounds.x; x<bounds.x2(); ++x, ++address) {
-      int right = -1;
+  const Image* m_image;
+  gfx::Rect m_bounds;
+  color_t m_color;
+  int m_tolerance;
+  bool m_transparent;
+  int m_stride;
+  std::vector<uint8_t> m_similar;
+  std::vector<uint8_t> m_filled;
+  std::vector<bool> m_ready;
+  std::vector<Span> m_spans;
+};
 
-      if (color_equal<ImageTraits>((int)(*address), src_color, tolerance)) {
-        ++address;
-        for (right=x+1; right<bounds.x2(); ++right, ++address) {
-          if (!color_equal<ImageTraits>((int)(*address), src_color, tolerance))
-            break;
-        }
-        (*proc)(x, y, right-1, data);
-        x = right;
-      }
-    }
-  }
-}
+} // anonymous namespace
 
-/* floodfill:
- *  Fills an enclosed area (starting at point x, y) with the specified color.
- */
 void floodfill(Image* image, int x, int y,
   const gfx::Rect& bounds,
   int tolerance, bool contiguous,
@@ -332,73 +227,19 @@ void floodfill(Image* image, int x, int y,
       (y < 0) || (y >= image->height()))
     return;
 
+  gfx::Rect rc = bounds.createIntersection(image->bounds());
+  if (rc.isEmpty())
+    return;
+
   // What color to replace?
   color_t src_color = get_pixel(image, x, y);
+  FloodFill floodFill(image, rc, src_color, tolerance);
 
   // Non-contiguous case, we replace colors in the whole image.
-  if (!contiguous) {
-    switch (image->pixelFormat()) {
-      case IMAGE_RGB:
-        replace_color<RgbTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_GRAYSCALE:
-        replace_color<GrayscaleTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-      case IMAGE_INDEXED:
-        replace_color<IndexedTraits>(image, bounds, src_color, tolerance, data, proc);
-        break;
-    }
-    return;
-  }
-
-  /* set up the list of flooded segments */
-  flood_buf.resize(image->height());
-  flood_count = image->height();
-  FLOODED_LINE* p = (FLOODED_LINE*)&flood_buf[0];
-  for (int c=0; c<flood_count; c++) {
-    p[c].flags = 0;
-    p[c].lpos = SHRT_MAX;
-    p[c].rpos = SHRT_MIN;
-    p[c].y = y;
-    p[c].next = 0;
-  }
-
-  // Start up the flood algorithm
-  flooder(image, x, y, bounds, src_color, tolerance, data, proc);
-
-  // Continue as long as there are some segments still to test
-  bool done;
-  do {
-    done = true;
-
-    // For each line on the screen
-    for (int c=0; c<flood_count; c++) {
-
-      p = FLOOD_LINE(c);
-
-      // Check below the segment?
-      if (p->flags & FLOOD_TODO_BELOW) {
-        p->flags &= ~FLOOD_TODO_BELOW;
-        if (check_flood_line(image, p->y+1, p->lpos, p->rpos, bounds,
-            src_color, tolerance, data, proc)) {
-          done = false;
-          p = FLOOD_LINE(c);
-        }
-      }
-
-      // Check above the segment?
-      if (p->flags & FLOOD_TODO_ABOVE) {
-        p->flags &= ~FLOOD_TODO_ABOVE;
-        if (check_flood_line(image, p->y-1, p->lpos, p->rpos, bounds,
-                             src_color, tolerance, data, proc)) {
-          done = false;
-          // Special case shortcut for going backwards
-          if ((c > bounds.y) && (c < bounds.y2()))
-            c -= 2;
-        }
-      }
-    }
-  } while (!done);
+  if (!contiguous)
+    floodFill.replaceColor(data, proc);
+  else
+    floodFill.fill(x, y, data, proc);
 }
 
 } // namespace algorithm
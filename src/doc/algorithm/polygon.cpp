@@ -1,10 +1,8 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
-//
-// TODO rewrite this algorithm from scratch
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -12,133 +10,110 @@
 
 #include "doc/algorithm/polygon.h"
 
-#include "gfx/point.h"
-
+#include <algorithm>
 #include <vector>
 
 namespace doc {
+namespace algorithm {
+
+namespace {
+
+// A non-horizontal edge of the polygon (from top to bottom). It
+// intersects the scanlines [y1, yEnd).
+struct Edge {
+  int x1, y1;
+  int x2, y2;
+  int yEnd;
 
-using namespace gfx;
+  // Intersection with the scanline "y". It's the same formula used by
+  // the old filler (an adaptation from GD library) to generate the
+  // same footprint.
+  int xAt(int y) const {
+    return (int)((float)((y - y1) * (x2 - x1)) / (float)(y2 - y1) + 0.5 + x1);
+  }
 
-// polygon() is an adaptation from Matthieu Haller code of GD library
+  bool operator<(const Edge& other) const {
+    return y1 < other.y1;
+  }
+};
 
-// THANKS to Kirsten Schulz for the polygon fixes!
+struct ActiveEdge {
+  int x;
+  const Edge* edge;
+};
 
-/* The intersection finding technique of this code could be improved  */
-/* by remembering the previous intertersection, and by using the slope. */
-/* That could help to adjust intersections  to produce a nice */
-/* interior_extrema. */
+} // anonymous namespace
 
-void algorithm::polygon(int vertices, const int* points, void* data, AlgoHLine proc)
+// Scanline filler with an edge table sorted by the top of each edge
+// and a list of active edges sorted by their intersection with the
+// current scanline. As intersections of consecutive scanlines are
+// almost in the same order, the active list is kept sorted with an
+// insertion sort (each scanline costs O(active edges)).
+void polygon(int vertices, const int* points, void* data, AlgoHLine proc)
 {
-  int n = vertices;
+  const int n = vertices;
   if (!n)
     return;
 
-  int i;
-  int j;
-  int index;
-  int y;
-  int miny, maxy;
-  int x1, y1;
-  int x2, y2;
-  int ind1, ind2;
-  int ints;
-
-  std::vector<int> polyInts(n);
-  std::vector<Point> p(n);
-  for (i = 0; (i < n); i++) {
-    p[i].x = points[i*2];
-    p[i].y = points[i*2+1];
+  int miny = points[1];
+  int maxy = points[1];
+  for (int i=1; i<n; ++i) {
+    miny = std::min(miny, points[i*2+1]);
+    maxy = std::max(maxy, points[i*2+1]);
   }
 
-  miny = p[0].y;
-  maxy = p[0].y;
-  for (i = 1; (i < n); i++) {
-    if (p[i].y < miny) miny = p[i].y;
-    if (p[i].y > maxy) maxy = p[i].y;
+  // Edge table (horizontal edges are ignored). The edges that end in
+  // the last scanline include it, so the bottom of the polygon is
+  // filled too.
+  std::vector<Edge> edges;
+  edges.reserve(n);
+  for (int i=0; i<n; ++i) {
+    const int* a = points + (i > 0 ? i-1: n-1)*2;
+    const int* b = points + i*2;
+    if (a[1] == b[1])
+      continue;
+    if (a[1] > b[1])
+      std::swap(a, b);
+
+    Edge edge = { a[0], a[1], b[0], b[1], (b[1] == maxy ? b[1]+1: b[1]) };
+    edges.push_back(edge);
   }
-
-  /* 2.0.16: Optimization by Ilia Chipitsine -- don't waste time offscreen */
-  /* 2.0.26: clipping rectangle is even better */
-// if (miny < im->cy1) {
-//   miny = im->cy1;
-// }
-// if (maxy > im->cy2) {
-//   maxy = im->cy2;
-// }
-
-  /* Fix in 1.3: count a vertex only once */
-  for (y = miny; (y <= maxy); y++) {
-    /*1.4           int interLast = 0; */
-    /*              int dirLast = 0; */
-    /*              int interFirst = 1; */
-    /* 2.0.26+      int yshift = 0; */
-
-    ints = 0;
-    for (i = 0; (i < n); i++) {
-      if (!i) {
-        ind1 = n - 1;
-        ind2 = 0;
-      }
-      else {
-        ind1 = i - 1;
-        ind2 = i;
-      }
-      y1 = p[ind1].y;
-      y2 = p[ind2].y;
-      if (y1 < y2) {
-        x1 = p[ind1].x;
-        x2 = p[ind2].x;
-      }
-      else if (y1 > y2) {
-        y2 = p[ind1].y;
-        y1 = p[ind2].y;
-        x2 = p[ind1].x;
-        x1 = p[ind2].x;
-      }
-      else {
-        continue;
-      }
-
-      /* Do the following math as float intermediately, and round to ensure
-       * that Polygon and FilledPolygon for the same set of points have the
-       * same footprint. */
-
-      if ((y >= y1) && (y < y2)) {
-        polyInts[ints++] = (int) ((float) ((y - y1) * (x2 - x1)) /
-                                  (float) (y2 - y1) + 0.5 + x1);
-      }
-      else if ((y == maxy) && (y > y1) && (y <= y2)) {
-        polyInts[ints++] = (int) ((float) ((y - y1) * (x2 - x1)) /
-                                  (float) (y2 - y1) + 0.5 + x1);
+  std::stable_sort(edges.begin(), edges.end());
+
+  std::vector<ActiveEdge> active;
+  std::vector<Edge>::const_iterator next = edges.begin();
+
+  for (int y=miny; y<=maxy; ++y) {
+    // Remove edges that are over and calculate the new intersections
+    size_t j = 0;
+    for (size_t i=0; i<active.size(); ++i) {
+      if (y < active[i].edge->yEnd) {
+        active[j].edge = active[i].edge;
+        active[j].x = active[i].edge->xAt(y);
+        ++j;
       }
     }
-    /*
-       2.0.26: polygons pretty much always have less than 100 points,
-       and most of the time they have considerably less. For such trivial
-       cases, insertion sort is a good choice. Also a good choice for
-       future implementations that may wish to indirect through a table.
-    */
-    for (i = 1; (i < ints); i++) {
-      index = polyInts[i];
-      j = i;
-      while ((j > 0) && (polyInts[j - 1] > index)) {
-        polyInts[j] = polyInts[j - 1];
-        j--;
-      }
-      polyInts[j] = index;
+    active.resize(j);
+
+    // Add edges that start in this scanline
+    for (; next != edges.end() && next->y1 == y; ++next) {
+      ActiveEdge e = { next->xAt(y), &*next };
+      active.push_back(e);
     }
-    for (i = 0; (i < (ints)); i += 2) {
-#if 0
-      int minx = polyInts[i];
-      int maxx = polyInts[i + 1];
-#endif
-      /* 2.0.29: back to gdImageLine to prevent segfaults when
-         performing a pattern fill */
-      proc(polyInts[i], y, polyInts[i + 1], data);
+
+    // Insertion sort by intersection
+    for (size_t i=1; i<active.size(); ++i) {
+      ActiveEdge e = active[i];
+      size_t k = i;
+      for (; k > 0 && active[k-1].x > e.x; --k)
+        active[k] = active[k-1];
+      active[k] = e;
     }
+
+    for (size_t i=0; i+1<active.size(); i+=2)
+      proc(active[i].x, y, active[i+1].x, data);
   }
 }
 
+} // namespace algorithm
 } // namespace doc
@@ -10,214 +10,446 @@
 
 #include "doc/algorithm/resize_image.h"
 
-#include "gfx/point.h"
+#include "doc/algorithm/row_bands.h"
 #include "doc/image.h"
-#include "doc/image_bits.h"
+#include "doc/image_traits.h"
 #include "doc/palette.h"
+#include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_RESIZE_IMAGE_SSE2
+  #include <emmintrin.h>
+#endif
+
 namespace doc {
 namespace algorithm {
 
-void resize_image(const Image* src, Image* dst, ResizeMethod method, const Palette* pal, const RgbMap* rgbmap)
+namespace {
+
+//////////////////////////////////////////////////////////////////////
+// Nearest neighbor
+
+// Repeats each pixel of the source row K times (integer upscale).
+// K is a template argument so the inner loop is unrolled and the
+// compiler can use wide stores.
+template<typename pixel_t, int K>
+void replicate_row(const pixel_t* s, pixel_t* d, int srcWidth)
 {
-  switch (method) {
+  for (int x=0; x<srcWidth; ++x, d+=K) {
+    const pixel_t c = s[x];
+    for (int k=0; k<K; ++k)
+      d[k] = c;
+  }
+}
 
-    // TODO optimize this
-    case RESIZE_METHOD_NEAREST_NEIGHBOR:
-    {
-      int o_width = src->width(), o_height = src->height();
-      int n_width = dst->width(), n_height = dst->height();
-      double x_ratio = o_width / (double)n_width;
-      double y_ratio = o_height / (double)n_height;
-      double px, py;
-      int i;
-
-      for (int y = 0; y < n_height; y++) {
-        for (int x = 0; x < n_width; x++) {
-          px = floor(x * x_ratio);
-          py = floor(y * y_ratio);
-          i = (int)(py * o_width + px);
-          dst->putPixel(x, y, src->getPixel(i % o_width, i / o_width));
-        }
-      }
-      break;
-    }
+#ifdef DOC_RESIZE_IMAGE_SSE2
 
-    // TODO optimize this
-    case RESIZE_METHOD_BILINEAR: {
-      uint32_t color[4], dst_color = 0;
-      double u, v, du, dv;
-      int u_floor, u_floor2;
-      int v_floor, v_floor2;
-      int x, y;
-
-      u = v = 0.0;
-      du = (src->width()-1) * 1.0 / (dst->width()-1);
-      dv = (src->height()-1) * 1.0 / (dst->height()-1);
-      for (y=0; y<dst->height(); ++y) {
-        for (x=0; x<dst->width(); ++x) {
-          u_floor = (int)floor(u);
-          v_floor = (int)floor(v);
-
-          if (u_floor > src->width()-1) {
-            u_floor = src->width()-1;
-            u_floor2 = src->width()-1;
-          }
-          else if (u_floor == src->width()-1)
-            u_floor2 = u_floor;
-          else
-            u_floor2 = u_floor+1;
-
-          if (v_floor > src->height()-1) {
-            v_floor = src->height()-1;
-            v_floor2 = src->height()-1;
-          }
-          else if (v_floor == src->height()-1)
-            v_floor2 = v_floor;
-          else
-            v_floor2 = v_floor+1;
-
-          // get the four colors
-          color[0] = src->getPixel(u_floor,  v_floor);
-          color[1] = src->getPixel(u_floor2, v_floor);
-          color[2] = src->getPixel(u_floor,  v_floor2);
-          color[3] = src->getPixel(u_floor2, v_floor2);
-
-          // calculate the interpolated color
-          double u1 = u - u_floor;
-          double v1 = v - v_floor;
-          double u2 = 1 - u1;
-          double v2 = 1 - v1;
-
-          switch (dst->pixelFormat()) {
-            case IMAGE_RGB: {
-              int r = int((rgba_getr(color[0])*u2 + rgba_getr(color[1])*u1)*v2 +
-                          (rgba_getr(color[2])*u2 + rgba_getr(color[3])*u1)*v1);
-              int g = int((rgba_getg(color[0])*u2 + rgba_getg(color[1])*u1)*v2 +
-                          (rgba_getg(color[2])*u2 + rgba_getg(color[3])*u1)*v1);
-              int b = int((rgba_getb(color[0])*u2 + rgba_getb(color[1])*u1)*v2 +
-                          (rgba_getb(color[2])*u2 + rgba_getb(color[3])*u1)*v1);
-              int a = int((rgba_geta(color[0])*u2 + rgba_geta(color[1])*u1)*v2 +
-                          (rgba_geta(color[2])*u2 + rgba_geta(color[3])*u1)*v1);
-              dst_color = rgba(r, g, b, a);
-              break;
-            }
-            case IMAGE_GRAYSCALE: {
-              int v = int((graya_getv(color[0])*u2 + graya_getv(color[1])*u1)*v2 +
-                          (graya_getv(color[2])*u2 + graya_getv(color[3])*u1)*v1);
-              int a = int((graya_geta(color[0])*u2 + graya_geta(color[1])*u1)*v2 +
-                          (graya_geta(color[2])*u2 + graya_geta(color[3])*u1)*v1);
-              dst_color = graya(v, a);
-              break;
-            }
-            case IMAGE_INDEXED: {
-              int r = int((rgba_getr(pal->getEntry(color[0]))*u2 + rgba_getr(pal->getEntry(color[1]))*u1)*v2 +
-                          (rgba_getr(pal->getEntry(color[2]))*u2 + rgba_getr(pal->getEntry(color[3]))*u1)*v1);
-              int g = int((rgba_getg(pal->getEntry(color[0]))*u2 + rgba_getg(pal->getEntry(color[1]))*u1)*v2 +
-                          (rgba_getg(pal->getEntry(color[2]))*u2 + rgba_getg(pal->getEntry(color[3]))*u1)*v1);
-              int b = int((rgba_getb(pal->getEntry(color[0]))*u2 + rgba_getb(pal->getEntry(color[1]))*u1)*v2 +
-                          (rgba_getb(pal->getEntry(color[2]))*u2 + rgba_getb(pal->getEntry(color[3]))*u1)*v1);
-              int a = int(((color[0] == 0 ? 0: 255)*u2 + (color[1] == 0 ? 0: 255)*u1)*v2 +
-                          ((color[2] == 0 ? 0: 255)*u2 + (color[3] == 0 ? 0: 255)*u1)*v1);
-              dst_color = a > 127 ? rgbmap->mapColor(r, g, b): 0;
-              break;
-            }
-          }
+// RGBA pixels scaled 4x are stored with one 128-bit store each.
+template<>
+void replicate_row<uint32_t, 4>(const uint32_t* s, uint32_t* d, int srcWidth)
+{
+  for (int x=0; x<srcWidth; ++x, d+=4)
+    _mm_storeu_si128((__m128i*)d, _mm_set1_epi32(int(s[x])));
+}
 
-          dst->putPixel(x, y, dst_color);
-          u += du;
-        }
-        u = 0.0;
-        v += dv;
-      }
-      break;
+#endif
+
+template<typename ImageTraits>
+void resize_nearest_rows(const Image* src, Image* dst,
+                         const std::vector<int>& cols,
+                         const std::vector<int>& rows,
+                         int factor,
+                         int y1, int y2)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+  const int w = dst->width();
+  const int srcWidth = src->width();
+
+  for (int y=y1; y<y2; ++y) {
+    pixel_t* d = (pixel_t*)dst->getPixelAddress(0, y);
+
+    // In upscales the same source row is used several times, so the
+    // previous row is copied (rows of other bands are being written
+    // in other threads, so the first row of the band is rendered).
+    if (y > y1 && rows[y] == rows[y-1]) {
+      const pixel_t* prev = (const pixel_t*)dst->getPixelAddress(0, y-1);
+      std::copy(prev, prev+w, d);
+      continue;
     }
 
+    const pixel_t* s = (const pixel_t*)src->getPixelAddress(0, rows[y]);
+    switch (factor) {
+      case 2: replicate_row<pixel_t, 2>(s, d, srcWidth); break;
+      case 3: replicate_row<pixel_t, 3>(s, d, srcWidth); break;
+      case 4: replicate_row<pixel_t, 4>(s, d, srcWidth); break;
+      default:
+        for (int x=0; x<w; ++x)
+          d[x] = s[cols[x]];
+        break;
+    }
   }
 }
 
-void fixup_image_transparent_colors(Image* image)
+template<>
+void resize_nearest_rows<BitmapTraits>(const Image* src, Image* dst,
+                                       const std::vector<int>& cols,
+                                       const std::vector<int>& rows,
+                                       int factor,
+                                       int y1, int y2)
 {
-  int x, y;
+  const int w = dst->width();
 
-  switch (image->pixelFormat()) {
+  for (int y=y1; y<y2; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel_fast<BitmapTraits>(dst, x, y,
+        get_pixel_fast<BitmapTraits>(src, cols[x], rows[y]));
+}
+
+// Source pixel of each destination pixel in one axis
+void nearest_table(int srcSize, int dstSize, std::vector<int>& table)
+{
+  double ratio = srcSize / (double)dstSize;
+
+  table.resize(dstSize);
+  for (int i=0; i<dstSize; ++i)
+    table[i] = MIN(int(std::floor(i * ratio)), srcSize-1);
+}
+
+// Returns the integer factor of an upscale (each source pixel is
+// repeated "factor" times in the table), or 0 if it isn't one.
+int integer_factor(int srcSize, int dstSize, const std::vector<int>& table)
+{
+  if (srcSize <= 0 || dstSize <= srcSize || dstSize % srcSize != 0)
+    return 0;
+
+  const int factor = dstSize / srcSize;
+  for (int i=0; i<dstSize; ++i)
+    if (table[i] != i / factor)
+      return 0;
+  return factor;
+}
+
+template<typename ImageTraits>
+void resize_nearest(const Image* src, Image* dst)
+{
+  std::vector<int> cols, rows;
+  nearest_table(src->width(), dst->width(), cols);
+  nearest_table(src->height(), dst->height(), rows);
+
+  const int factor = integer_factor(src->width(), dst->width(), cols);
+
+  for_each_row_band(dst->width(), dst->height(),
+    [&](int y1, int y2) {
+      resize_nearest_rows<ImageTraits>(src, dst, cols, rows, factor, y1, y2);
+    });
+}
+
+//////////////////////////////////////////////////////////////////////
+// Bilinear
+
+// The two source pixels that are interpolated for each destination
+// pixel in one axis, "w1" is the weight of "i1" and "w2" the weight
+// of "i2".
+struct Sample {
+  int i1, i2;
+  double w1, w2;
+};
+
+// The source coordinate is accumulated pixel by pixel (instead of
+// being multiplied) to get exactly the same result of the original
+// per-pixel implementation.
+void bilinear_table(int srcSize, int dstSize, std::vector<Sample>& table)
+{
+  double u = 0.0;
+  double du = (srcSize-1) * 1.0 / (dstSize-1);
+
+  table.resize(dstSize);
+  for (int i=0; i<dstSize; ++i, u+=du) {
+    Sample& s = table[i];
+    s.i1 = (int)std::floor(u);
+
+    if (s.i1 > srcSize-1)
+      s.i1 = s.i2 = srcSize-1;
+    else if (s.i1 == srcSize-1)
+      s.i2 = s.i1;
+    else
+      s.i2 = s.i1+1;
+
+    s.w2 = u - s.i1;
+    s.w1 = 1 - s.w2;
+  }
+}
+
+inline int bilinear(int c0, int c1, int c2, int c3,
+                    const Sample& u, const Sample& v)
+{
+  return int((c0*u.w1 + c1*u.w2)*v.w1 +
+             (c2*u.w1 + c3*u.w2)*v.w2);
+}
+
+#ifdef DOC_RESIZE_IMAGE_SSE2
+
+// Interpolates two channels at the same time (with the same order
+// of operations than bilinear(), so the result is the same).
+inline __m128i bilinear_sse2(__m128d c0, __m128d c1, __m128d c2, __m128d c3,
+                             __m128d u1, __m128d u2, __m128d v1, __m128d v2)
+{
+  __m128d top = _mm_add_pd(_mm_mul_pd(c0, u1), _mm_mul_pd(c1, u2));
+  __m128d bottom = _mm_add_pd(_mm_mul_pd(c2, u1), _mm_mul_pd(c3, u2));
+  return _mm_cvttpd_epi32(_mm_add_pd(_mm_mul_pd(top, v1),
+                                     _mm_mul_pd(bottom, v2)));
+}
+
+// Returns the four 8-bit channels of the given pixel as 32-bit ints
+inline __m128i unpack_channels(uint32_t c)
+{
+  const __m128i zero = _mm_setzero_si128();
+  return _mm_unpacklo_epi16(
+    _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(c)), zero), zero);
+}
+
+#endif
+
+struct RgbBilinear {
+  typedef RgbTraits::pixel_t pixel_t;
+
+  pixel_t operator()(pixel_t c0, pixel_t c1, pixel_t c2, pixel_t c3,
+                     const Sample& u, const Sample& v) const {
+#ifdef DOC_RESIZE_IMAGE_SSE2
+    __m128i p0 = unpack_channels(c0);
+    __m128i p1 = unpack_channels(c1);
+    __m128i p2 = unpack_channels(c2);
+    __m128i p3 = unpack_channels(c3);
+    __m128d u1 = _mm_set1_pd(u.w1), u2 = _mm_set1_pd(u.w2);
+    __m128d v1 = _mm_set1_pd(v.w1), v2 = _mm_set1_pd(v.w2);
+
+    // Red/green and blue/alpha
+    __m128i rg = bilinear_sse2(
+      _mm_cvtepi32_pd(p0), _mm_cvtepi32_pd(p1),
+      _mm_cvtepi32_pd(p2), _mm_cvtepi32_pd(p3), u1, u2, v1, v2);
+    __m128i ba = bilinear_sse2(
+      _mm_cvtepi32_pd(_mm_srli_si128(p0, 8)), _mm_cvtepi32_pd(_mm_srli_si128(p1, 8)),
+      _mm_cvtepi32_pd(_mm_srli_si128(p2, 8)), _mm_cvtepi32_pd(_mm_srli_si128(p3, 8)),
+      u1, u2, v1, v2);
+
+    __m128i rgba = _mm_packs_epi32(_mm_unpacklo_epi64(rg, ba), rg);
+    return (pixel_t)_mm_cvtsi128_si32(_mm_packus_epi16(rgba, rgba));
+#else
+    return rgba(bilinear(rgba_getr(c0), rgba_getr(c1), rgba_getr(c2), rgba_getr(c3), u, v),
+                bilinear(rgba_getg(c0), rgba_getg(c1), rgba_getg(c2), rgba_getg(c3), u, v),
+                bilinear(rgba_getb(c0), rgba_getb(c1), rgba_getb(c2), rgba_getb(c3), u, v),
+                bilinear(rgba_geta(c0), rgba_geta(c1), rgba_geta(c2), rgba_geta(c3), u, v));
+#endif
+  }
+};
+
+struct GrayscaleBilinear {
+  typedef GrayscaleTraits::pixel_t pixel_t;
+
+  pixel_t operator()(pixel_t c0, pixel_t c1, pixel_t c2, pixel_t c3,
+                     const Sample& u, const Sample& v) const {
+#ifdef DOC_RESIZE_IMAGE_SSE2
+    __m128i va = bilinear_sse2(
+      _mm_cvtepi32_pd(unpack_channels(c0)), _mm_cvtepi32_pd(unpack_channels(c1)),
+      _mm_cvtepi32_pd(unpack_channels(c2)), _mm_cvtepi32_pd(unpack_channels(c3)),
+      _mm_set1_pd(u.w1), _mm_set1_pd(u.w2),
+      _mm_set1_pd(v.w1), _mm_set1_pd(v.w2));
+
+    va = _mm_packs_epi32(va, va);
+    return (pixel_t)(_mm_cvtsi128_si32(_mm_packus_epi16(va, va)) & 0xffff);
+#else
+    return graya(bilinear(graya_getv(c0), graya_getv(c1), graya_getv(c2), graya_getv(c3), u, v),
+                 bilinear(graya_geta(c0), graya_geta(c1), graya_geta(c2), graya_geta(c3), u, v));
+#endif
+  }
+};
+
+class IndexedBilinear {
+public:
+  typedef IndexedTraits::pixel_t pixel_t;
+
+  IndexedBilinear(const Palette* pal, const RgbMap* rgbmap)
+    : m_pal(pal), m_rgbmap(rgbmap) { }
+
+  pixel_t operator()(pixel_t c0, pixel_t c1, pixel_t c2, pixel_t c3,
+                     const Sample& u, const Sample& v) const {
+    color_t p0 = m_pal->getEntry(c0);
+    color_t p1 = m_pal->getEntry(c1);
+    color_t p2 = m_pal->getEntry(c2);
+    color_t p3 = m_pal->getEntry(c3);
+
+    int a = bilinear(c0 == 0 ? 0: 255, c1 == 0 ? 0: 255,
+                     c2 == 0 ? 0: 255, c3 == 0 ? 0: 255, u, v);
+    if (a <= 127)
+      return 0;
+
+    return m_rgbmap->mapColor(
+      bilinear(rgba_getr(p0), rgba_getr(p1), rgba_getr(p2), rgba_getr(p3), u, v),
+      bilinear(rgba_getg(p0), rgba_getg(p1), rgba_getg(p2), rgba_getg(p3), u, v),
+      bilinear(rgba_getb(p0), rgba_getb(p1), rgba_getb(p2), rgba_getb(p3), u, v));
+  }
+
+private:
+  const Palette* m_pal;
+  const RgbMap* m_rgbmap;
+};
+
+template<typename ImageTraits, typename Interpolator>
+void resize_bilinear(const Image* src, Image* dst, const Interpolator& interpolate)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  std::vector<Sample> cols, rows;
+  bilinear_table(src->width(), dst->width(), cols);
+  bilinear_table(src->height(), dst->height(), rows);
+
+  const int w = dst->width();
 
-    case IMAGE_RGB: {
-      int r, g, b, count;
-      LockImageBits<RgbTraits> bits(image);
-      LockImageBits<RgbTraits>::iterator it = bits.begin();
-
-      for (y=0; y<image->height(); ++y) {
-        for (x=0; x<image->width(); ++x, ++it) {
-          uint32_t c = *it;
-
-          // if this is a completelly-transparent pixel...
-          if (rgba_geta(c) == 0) {
-            count = 0;
-            r = g = b = 0;
-
-            gfx::Rect area = gfx::Rect(x-1, y-1, 3, 3).createIntersection(image->bounds());
-            LockImageBits<RgbTraits>::iterator it2 = bits.begin_area(area);
-            LockImageBits<RgbTraits>::iterator end2 = bits.end_area(area);
-
-            for (; it2 != end2; ++it2) {
-              c = *it2;
-              if (rgba_geta(c) > 0) {
-                r += rgba_getr(c);
-                g += rgba_getg(c);
-                b += rgba_getb(c);
-                ++count;
-              }
-            }
-
-            if (count > 0) {
-              r /= count;
-              g /= count;
-              b /= count;
-              *it = rgba(r, g, b, 0);
-            }
+  for_each_row_band(dst->width(), dst->height(),
+    [&](int y1, int y2) {
+      for (int y=y1; y<y2; ++y) {
+        const Sample& v = rows[y];
+        const pixel_t* s1 = (const pixel_t*)src->getPixelAddress(0, v.i1);
+        const pixel_t* s2 = (const pixel_t*)src->getPixelAddress(0, v.i2);
+        pixel_t* d = (pixel_t*)dst->getPixelAddress(0, y);
+
+        for (int x=0; x<w; ++x) {
+          const Sample& u = cols[x];
+          d[x] = interpolate(s1[u.i1], s1[u.i2], s2[u.i1], s2[u.i2], u, v);
+        }
+      }
+    });
+}
+
+//////////////////////////////////////////////////////////////////////
+// Fixup of transparent colors
+
+// Only the color of transparent pixels is modified (using the colors
+// of opaque neighbors), so rows can be processed in parallel as long
+// as adjacent bands aren't processed at the same time.
+void fixup_rgb_rows(Image* image, int y1, int y2)
+{
+  typedef RgbTraits::pixel_t pixel_t;
+  const int w = image->width();
+  const int h = image->height();
+
+  for (int y=y1; y<y2; ++y) {
+    pixel_t* row = (pixel_t*)image->getPixelAddress(0, y);
+
+    for (int x=0; x<w; ++x) {
+      // If this is a completelly-transparent pixel...
+      if (rgba_geta(row[x]) != 0)
+        continue;
+
+      int r = 0, g = 0, b = 0, count = 0;
+
+      for (int v=MAX(0, y-1); v<=MIN(h-1, y+1); ++v) {
+        const pixel_t* it = (const pixel_t*)image->getPixelAddress(0, v);
+        for (int u=MAX(0, x-1); u<=MIN(w-1, x+1); ++u) {
+          color_t c = it[u];
+          if (rgba_geta(c) > 0) {
+            r += rgba_getr(c);
+            g += rgba_getg(c);
+            b += rgba_getb(c);
+            ++count;
           }
         }
       }
-      break;
+
+      if (count > 0)
+        row[x] = rgba(r / count, g / count, b / count, 0);
     }
+  }
+}
 
-    case IMAGE_GRAYSCALE: {
-      int k, count;
-      LockImageBits<GrayscaleTraits> bits(image);
-      LockImageBits<GrayscaleTraits>::iterator it = bits.begin();
-
-      for (y=0; y<image->height(); ++y) {
-        for (x=0; x<image->width(); ++x, ++it) {
-          uint16_t c = *it;
-
-          // If this is a completelly-transparent pixel...
-          if (graya_geta(c) == 0) {
-            count = 0;
-            k = 0;
-
-            gfx::Rect area = gfx::Rect(x-1, y-1, 3, 3).createIntersection(image->bounds());
-            LockImageBits<GrayscaleTraits>::iterator it2 = bits.begin_area(area);
-            LockImageBits<GrayscaleTraits>::iterator end2 = bits.end_area(area);
-
-            for (; it2 != end2; ++it2) {
-              c = *it2;
-              if (graya_geta(c) > 0) {
-                k += graya_getv(c);
-                ++count;
-              }
-            }
-
-            if (count > 0) {
-              k /= count;
-              *it = graya(k, 0);
-            }
+void fixup_grayscale_rows(Image* image, int y1, int y2)
+{
+  typedef GrayscaleTraits::pixel_t pixel_t;
+  const int w = image->width();
+  const int h = image->height();
+
+  for (int y=y1; y<y2; ++y) {
+    pixel_t* row = (pixel_t*)image->getPixelAddress(0, y);
+
+    for (int x=0; x<w; ++x) {
+      // If this is a completelly-transparent pixel...
+      if (graya_geta(row[x]) != 0)
+        continue;
+
+      int k = 0, count = 0;
+
+      for (int v=MAX(0, y-1); v<=MIN(h-1, y+1); ++v) {
+        const pixel_t* it = (const pixel_t*)image->getPixelAddress(0, v);
+        for (int u=MAX(0, x-1); u<=MIN(w-1, x+1); ++u) {
+          color_t c = it[u];
+          if (graya_geta(c) > 0) {
+            k += graya_getv(c);
+            ++count;
           }
         }
       }
-      break;
+
+      if (count > 0)
+        row[x] = graya(k / count, 0);
     }
+  }
+}
+
+} // anonymous namespace
+
+void resize_image(const Image* src, Image* dst, ResizeMethod method, const Palette* pal, const RgbMap* rgbmap)
+{
+  // Bitmaps (e.g. masks) cannot be interpolated
+  if (method == RESIZE_METHOD_BILINEAR &&
+      dst->pixelFormat() == IMAGE_BITMAP)
+    method = RESIZE_METHOD_NEAREST_NEIGHBOR;
+
+  switch (method) {
+
+    case RESIZE_METHOD_NEAREST_NEIGHBOR:
+      switch (dst->pixelFormat()) {
+        case IMAGE_RGB:       resize_nearest<RgbTraits>(src, dst); break;
+        case IMAGE_GRAYSCALE: resize_nearest<GrayscaleTraits>(src, dst); break;
+        case IMAGE_INDEXED:   resize_nearest<IndexedTraits>(src, dst); break;
+        case IMAGE_BITMAP:    resize_nearest<BitmapTraits>(src, dst); break;
+      }
+      break;
+
+    case RESIZE_METHOD_BILINEAR:
+      switch (dst->pixelFormat()) {
+        case IMAGE_RGB:
+          resize_bilinear<RgbTraits>(src, dst, RgbBilinear());
+          break;
+        case IMAGE_GRAYSCALE:
+          resize_bilinear<GrayscaleTraits>(src, dst, GrayscaleBilinear());
+          break;
+        case IMAGE_INDEXED:
+          resize_bilinear<IndexedTraits>(src, dst, IndexedBilinear(pal, rgbmap));
+          break;
+      }
+      break;
+
+  }
+}
+
+void fixup_image_transparent_colors(Image* image)
+{
+  switch (image->pixelFormat()) {
+
+    case IMAGE_RGB:
+      for_each_row_band(image->width(), image->height(),
+        [image](int y1, int y2) { fixup_rgb_rows(image, y1, y2); }, 2);
+      break;
+
+    case IMAGE_GRAYSCALE:
+      for_each_row_band(image->width(), image->height(),
+        [image](int y1, int y2) { fixup_grayscale_rows(image, y1, y2); }, 2);
+      break;
 
   }
 }
@@ -12,6 +12,7 @@
 #endif
 
 #include "fixmath/fixmath.h"
+#include "doc/algorithm/row_bands.h"
 #include "doc/blend.h"
 #include "doc/image.h"
 #include "doc/image_bits.h"
@@ -19,6 +20,7 @@
 #include "doc/primitives_fast.h"
 
 #include <cmath>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
@@ -190,7 +192,7 @@ public:
   void feedLine(Image* spr, int spr_x, int spr_y) {
     ASSERT(m_it != m_end);
 
-    int c = spr->getPixel(spr_x, spr_y);
+    int c = get_pixel_fast<RgbTraits>(spr, spr_x, spr_y);
     if ((rgba_geta(m_mask_color) == 0) || ((c & rgba_rgb_mask) != (m_mask_color & rgba_rgb_mask)))
       *m_it = m_blender(*m_it, c, 255);
 
@@ -212,7 +214,7 @@ public:
   void feedLine(Image* spr, int spr_x, int spr_y) {
     ASSERT(m_it != m_end);
 
-    int c = spr->getPixel(spr_x, spr_y);
+    int c = get_pixel_fast<GrayscaleTraits>(spr, spr_x, spr_y);
     if ((graya_geta(m_mask_color) == 0) || ((c & graya_v_mask) != (m_mask_color & graya_v_mask)))
       *m_it = m_blender(*m_it, c, 255);
 
@@ -233,7 +235,7 @@ public:
   void feedLine(Image* spr, int spr_x, int spr_y) {
     ASSERT(m_it != m_end);
 
-    color_t c = spr->getPixel(spr_x, spr_y);
+    color_t c = get_pixel_fast<IndexedTraits>(spr, spr_x, spr_y);
     if (c != m_mask_color)
       *m_it = c;
     ++m_it;
@@ -248,7 +250,7 @@ public:
   void feedLine(Image* spr, int spr_x, int spr_y) {
     ASSERT(m_it != m_end);
 
-    int c = spr->getPixel(spr_x, spr_y);
+    int c = get_pixel_fast<BitmapTraits>(spr, spr_x, spr_y);
     if (c != 0)                 // TODO
       *m_it = c;
     ++m_it;
@@ -325,6 +327,14 @@ static void ase_parallelogram_map(
   int bmp_y_i;
   /* Right edge of scanline. */
   int right_edge_test;
+  /* Scanlines to be drawn once all of them are calculated. */
+  struct Scanline {
+    fixed l_bmp_x;
+    int bmp_y;
+    fixed r_bmp_x;
+    fixed l_spr_x, l_spr_y;
+  };
+  std::vector<Scanline> scanlines;
 
   /* Get index of topmost point. */
   top_index = 0;
@@ -653,11 +663,10 @@ static void ase_parallelogram_map(
           }
         }
       }
-      draw_scanline<Traits, Delegate>(bmp, spr,
+      Scanline scanline = {
         l_bmp_x_rounded, bmp_y_i, r_bmp_x_rounded,
-        l_spr_x_rounded, l_spr_y_rounded,
-        spr_dx, spr_dy, delegate);
-
+        l_spr_x_rounded, l_spr_y_rounded };
+      scanlines.push_back(scanline);
     }
     /* I'm not going to apoligize for this label and its gotos: to get
        rid of it would just make the code look worse. */
@@ -676,6 +685,22 @@ static void ase_parallelogram_map(
     r_spr_y += r_spr_dy;
 #endif
   }
+
+  // Each scanline writes a different row of "bmp", so they can be
+  // drawn in parallel (each task with its own copy of the delegate).
+  ASSERT(spr->pixelFormat() == bmp->pixelFormat());
+  for_each_row_band(
+    bmp->width(), int(scanlines.size()),
+    [&](int i1, int i2) {
+      Delegate bandDelegate(delegate);
+      for (int i=i1; i<i2; ++i) {
+        const Scanline& scanline = scanlines[i];
+        draw_scanline<Traits, Delegate>(bmp, spr,
+          scanline.l_bmp_x, scanline.bmp_y, scanline.r_bmp_x,
+          scanline.l_spr_x, scanline.l_spr_y,
+          spr_dx, spr_dy, bandDelegate);
+      }
+    });
 }
 
 /* _parallelogram_map_standard:
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -8,188 +8,336 @@
 #include "config.h"
 #endif
 
-#include "base/unique_ptr.h"
-#include "doc/algorithm/rotate.h"
+#include "doc/algorithm/rotsprite.h"
+
+#include "base/thread_pool.h"
 #include "doc/blend.h"
 #include "doc/image.h"
-#include "doc/image_bits.h"
-#include "doc/primitives.h"
+#include "doc/image_traits.h"
 #include "doc/primitives_fast.h"
+#include "gfx/rect.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
+namespace {
+
+// RotSprite upscales the sprite 8x with three Scale2x passes, and
+// then it's rotated and downscaled with nearest neighbor, i.e. each
+// output pixel samples one pixel of the upscaled sprite. Instead of
+// upscaling the whole sprite (which needs 64 times its memory), the
+// output is rendered in tiles, and each tile upscales just the
+// portion of the sprite that it samples.
+const int kScale = 8;
+const int kTileSize = 64;
+
+// Maximum number of pixels of the upscaled portion of the sprite
+// used by one tile (tiles that sample a bigger area, e.g. when the
+// sprite is downscaled, are subdivided).
+const int kMaxScaledPixels = 1024*1024;
+
+// Pixels around the sampled portion of the sprite needed to get the
+// same Scale2x result of the whole sprite in the sampled area.
+const int kMargin = 3;
+
 // More information about EPX/Scale2x:
 // http://en.wikipedia.org/wiki/Pixel_art_scaling_algorithms#EPX.2FScale2.C3.97.2FAdvMAME2.C3.97
 // http://scale2x.sourceforge.net/algorithm.html
 // http://scale2x.sourceforge.net/scale2xandepx.html
-template<typename ImageTraits>
-static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h)
+void scale2x(const color_t* src, int w, int h, color_t* dst)
 {
-#if 0      // TODO complete this implementation that should be faster
-           // than using a lot of get/put_pixel_fast calls.
-  int dst_w = src_w*2;
-  int dst_h = src_h*2;
-
-  LockImageBits<ImageTraits> dstBits(dst, Image::WriteLock, gfx::Rect(0, 0, dst_w, dst_h));
-  const LockImageBits<ImageTraits> srcBits(src);
-
-  LockImageBits<ImageTraits>::iterator dstRow0_it = dstBits.begin();
-  LockImageBits<ImageTraits>::iterator dstRow1_it = dstBits.begin();
-  LockImageBits<ImageTraits>::iterator dstRow0_end = dstBits.end();
-  LockImageBits<ImageTraits>::iterator dstRow1_end = dstBits.end();
-
-  // Iterators:
-  //   A
-  // C P B
-  //   D
-  //
-  // These iterators are displaced through src image and are modified in this way:
-  //
-  // P: is the simplest one, we just start from (0, 0) to srcEnd.
-  // A: starts from row 0 (so A = P in the first row), then we start
-  //    again from the row 0.
-  // B: It starts from (1, row) and in the last pixel we don't moved it.
-  // C: It starts from (0, 0) and then it is moved with a delay.
-  // D: It starts from row 1 and continues until we reach the last
-  //    row, in that case we start D iterator again.
-  //
-  LockImageBits<ImageTraits>::const_iterator itP, itA, itB, itC, itD, savedD;
-  LockImageBits<ImageTraits>::const_iterator srcEnd = srcBits.end();
-  color_t P, A, B, C, D;
-
-  // Adjust iterators
-  itP = itA = itB = itC = itD = savedD = srcBits.begin();
-  dstRow1_it += dst_w;
-  itD += src->width();
-
-  for (int y=0; y<src_h; ++y) {
-    if (y == 1) itA = srcBits.begin();
-    if (y == src_h-2) savedD = itD;
-    if (y == src_h-1) itD = savedD;
-    ++itB;
-
-    for (int x=0; x<src_w; ++x) {
-      ASSERT(itP != srcEnd);
-      ASSERT(itA != srcEnd);
-      ASSERT(itB != srcEnd);
-      ASSERT(itC != srcEnd);
-      ASSERT(itD != srcEnd);
-      ASSERT(dstRow0_it != dstRow0_end);
-      ASSERT(dstRow1_it != dstRow1_end);
-
-      P = *itP;
-      A = *itA;                 // y-1
-      B = *itB;                 // x+1
-      C = *itC;                 // x-1
-      D = *itD;                 // y+1
-
-      *dstRow0_it = (C == A && C != D && A != B ? A: P);
-      ++dstRow0_it;
-      *dstRow0_it = (A == B && A != C && B != D ? B: P);
-      ++dstRow0_it;
-
-      *dstRow1_it = (D == C && D != B && C != A ? C: P);
-      ++dstRow1_it;
-      *dstRow1_it = (B == D && B != A && D != C ? D: P);
-      ++dstRow1_it;
-
-      ++itP;
-      ++itA;
-      if (x < src_w-2) ++itB;
-      if (x > 0) ++itC;
-      ++itD;
+  for (int y=0; y<h; ++y) {
+    const color_t* row = src + y*w;
+    const color_t* prev = (y > 0 ? row-w: row);
+    const color_t* next = (y < h-1 ? row+w: row);
+    color_t* dst0 = dst + 4*y*w;
+    color_t* dst1 = dst0 + 2*w;
+
+    for (int x=0; x<w; ++x) {
+      color_t P = row[x];
+      color_t A = prev[x];
+      color_t B = (x < w-1 ? row[x+1]: P);
+      color_t C = (x > 0 ? row[x-1]: P);
+      color_t D = next[x];
+
+      dst0[2*x]   = (C == A && C != D && A != B ? A: P);
+      dst0[2*x+1] = (A == B && A != C && B != D ? B: P);
+      dst1[2*x]   = (D == C && D != B && C != A ? C: P);
+      dst1[2*x+1] = (B == D && B != A && D != C ? D: P);
     }
+  }
+}
 
-    // Adjust iterators for the next two rows.
-    ++itB;
-    ++itC;
-    dstRow0_it += dst_w;
-    if (y < src_h-1)
-      dstRow1_it += dst_w;
+// Output of each format: "c" is the sampled pixel (or nullptr if the
+// output pixel isn't covered by the sprite) and "back" the current
+// pixel of the output image.
+class RgbOutput {
+public:
+  RgbOutput(color_t bmpMask, color_t sprMask)
+    : m_bmpMask(bmpMask), m_sprMask(sprMask)
+    , m_blender(rgba_blenders[BLEND_MODE_NORMAL]) { }
+
+  color_t operator()(color_t back, const color_t* c) const {
+    color_t value = m_bmpMask;
+    if (c && (rgba_geta(m_sprMask) == 0 ||
+              (*c & rgba_rgb_mask) != (m_sprMask & rgba_rgb_mask)))
+      value = m_blender(value, *c, 255);
+    return m_blender(back, value, 255);
   }
 
-  // ASSERT(itP == srcEnd);
-  // ASSERT(itA == srcEnd);
-  // ASSERT(itB == srcEnd);
-  // ASSERT(itC == srcEnd);
-  // ASSERT(itD == srcEnd);
-  ASSERT(dstRow0_it == dstRow0_end);
-  ASSERT(dstRow1_it == dstRow1_end);
-#else
-
-#define A c[0]
-#define B c[1]
-#define C c[2]
-#define D c[3]
-#define P c[4]
-
-  color_t c[5];
-  for (int y=0; y<src_h; ++y) {
-    for (int x=0; x<src_w; ++x) {
-      P = get_pixel_fast<ImageTraits>(src, x, y);
-      A = (y > 0 ? get_pixel_fast<ImageTraits>(src, x, y-1): P);
-      B = (x < src_w-1 ? get_pixel_fast<ImageTraits>(src, x+1, y): P);
-      C = (x > 0 ? get_pixel_fast<ImageTraits>(src, x-1, y): P);
-      D = (y < src_h-1 ? get_pixel_fast<ImageTraits>(src, x, y+1): P);
-
-      put_pixel_fast<ImageTraits>(dst, 2*x,   2*y,   (C == A && C != D && A != B ? A: P));
-      put_pixel_fast<ImageTraits>(dst, 2*x+1, 2*y,   (A == B && A != C && B != D ? B: P));
-      put_pixel_fast<ImageTraits>(dst, 2*x,   2*y+1, (D == C && D != B && C != A ? C: P));
-      put_pixel_fast<ImageTraits>(dst, 2*x+1, 2*y+1, (B == D && B != A && D != C ? D: P));
-    }
+private:
+  color_t m_bmpMask, m_sprMask;
+  BLEND_COLOR m_blender;
+};
+
+class GrayscaleOutput {
+public:
+  GrayscaleOutput(color_t bmpMask, color_t sprMask)
+    : m_bmpMask(bmpMask), m_sprMask(sprMask)
+    , m_blender(graya_blenders[BLEND_MODE_NORMAL]) { }
+
+  color_t operator()(color_t back, const color_t* c) const {
+    color_t value = m_bmpMask;
+    if (c && (graya_geta(m_sprMask) == 0 ||
+              (*c & graya_v_mask) != (m_sprMask & graya_v_mask)))
+      value = m_blender(value, *c, 255);
+    return m_blender(back, value, 255);
   }
 
-#endif
-}
+private:
+  color_t m_bmpMask, m_sprMask;
+  BLEND_COLOR m_blender;
+};
 
-static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h)
-{
-  switch (src->pixelFormat()) {
-    case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_GRAYSCALE: image_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_INDEXED:   image_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h); break;
+class IndexedOutput {
+public:
+  IndexedOutput(color_t bmpMask, color_t sprMask)
+    : m_bmpMask(bmpMask), m_sprMask(sprMask) { }
+
+  color_t operator()(color_t back, const color_t* c) const {
+    color_t value = (c && *c != m_sprMask ? *c: m_bmpMask);
+    return (value != m_sprMask ? value: back);
+  }
+
+private:
+  color_t m_bmpMask, m_sprMask;
+};
+
+class BitmapOutput {
+public:
+  BitmapOutput(color_t bmpMask, color_t sprMask)
+    : m_bmpMask(bmpMask) { }
+
+  color_t operator()(color_t back, const color_t* c) const {
+    color_t value = (c && *c != 0 ? *c: m_bmpMask);
+    return (value != 0 ? value: back);
+  }
+
+private:
+  color_t m_bmpMask;
+};
+
+template<typename ImageTraits, typename Output>
+class RotSprite {
+public:
+  RotSprite(Image* bmp, const Image* spr,
+            int x1, int y1, int x2, int y2, int x4, int y4)
+    : m_bmp(bmp)
+    , m_spr(spr)
+    , m_output(bmp->maskColor(), spr->maskColor())
+    , m_ox(x1), m_oy(y1)
+    , m_e1x(x2-x1), m_e1y(y2-y1)
+    , m_e2x(x4-x1), m_e2y(y4-y1)
+    , m_det(double(m_e1x)*m_e2y - double(m_e1y)*m_e2x)
+    , m_scaledW(spr->width()*kScale)
+    , m_scaledH(spr->height()*kScale) {
   }
-}
-  
-void rotsprite_image(Image* bmp, Image* spr,
-  int x1, int y1, int x2, int y2,
-  int x3, int y3, int x4, int y4)
-{
-  static ImageBufferPtr buf1, buf2, buf3; // TODO non-thread safe
 
-  if (!buf1) buf1.reset(new ImageBuffer(1));
-  if (!buf2) buf2.reset(new ImageBuffer(1));
-  if (!buf3) buf3.reset(new ImageBuffer(1));
+  void draw() {
+    int cols = (m_bmp->width()+kTileSize-1) / kTileSize;
+    int rows = (m_bmp->height()+kTileSize-1) / kTileSize;
 
-  int scale = 8;
-  base::UniquePtr<Image> bmp_copy(Image::create(bmp->pixelFormat(), bmp->width()*scale, bmp->height()*scale, buf1));
-  base::UniquePtr<Image> tmp_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf2));
-  base::UniquePtr<Image> spr_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf3));
+    // Tiles are multiple of 8 pixels, so two tasks never write the
+    // same byte of a bitmap.
+    base::thread_pool::global().parallel_for(
+      cols*rows,
+      [this, cols](int i) {
+        gfx::Rect tile((i % cols) * kTileSize,
+                       (i / cols) * kTileSize,
+                       kTileSize, kTileSize);
+        drawTile(tile.createIntersection(m_bmp->bounds()));
+      });
+  }
+
+private:
+  // Returns the pixel of the upscaled sprite sampled by the output
+  // pixel (u, v). Returns false if the pixel isn't covered by the
+  // sprite.
+  bool sample(int u, int v, int& x, int& y) const {
+    if (m_det == 0.0)
+      return false;
+
+    // The 8x upscaled output is sampled in the center of its
+    // top-left pixel.
+    double dx = u + 0.5/kScale - m_ox;
+    double dy = v + 0.5/kScale - m_oy;
+    double s = (dx*m_e2y - dy*m_e2x) / m_det;
+    double t = (m_e1x*dy - m_e1y*dx) / m_det;
+    if (s < 0.0 || s >= 1.0 || t < 0.0 || t >= 1.0)
+      return false;
+
+    x = std::min(int(s*m_scaledW), m_scaledW-1);
+    y = std::min(int(t*m_scaledH), m_scaledH-1);
+    return true;
+  }
+
+  // Returns the area of the upscaled sprite sampled by the given
+  // output tile.
+  gfx::Rect sampledArea(const gfx::Rect& tile) const {
+    if (m_det == 0.0)
+      return gfx::Rect();
+
+    double x1 = m_scaledW, y1 = m_scaledH, x2 = 0.0, y2 = 0.0;
+    for (int i=0; i<4; ++i) {
+      // As the sprite is mapped with an affine transformation, the
+      // corners of the tile are the extremes of the sampled area.
+      double dx = (i & 1 ? tile.x2()-1: tile.x) + 0.5/kScale - m_ox;
+      double dy = (i & 2 ? tile.y2()-1: tile.y) + 0.5/kScale - m_oy;
+      double x = m_scaledW * (dx*m_e2y - dy*m_e2x) / m_det;
+      double y = m_scaledH * (m_e1x*dy - m_e1y*dx) / m_det;
+      x1 = std::min(x1, x);
+      y1 = std::min(y1, y);
+      x2 = std::max(x2, x);
+      y2 = std::max(y2, y);
+    }
+
+    gfx::Rect area(int(std::floor(x1)), int(std::floor(y1)), 0, 0);
+    area.w = int(std::floor(x2)) - area.x + 1;
+    area.h = int(std::floor(y2)) - area.y + 1;
+    return area.createIntersection(gfx::Rect(0, 0, m_scaledW, m_scaledH));
+  }
+
+  void drawTile(const gfx::Rect& tile) {
+    if (tile.isEmpty())
+      return;
+
+    gfx::Rect area = sampledArea(tile);
+    if (area.isEmpty()) {
+      drawPixels(tile, nullptr, gfx::Rect());
+      return;
+    }
+
+    // Portion of the original sprite that must be upscaled
+    gfx::Rect src(area.x/kScale - kMargin,
+                  area.y/kScale - kMargin, 0, 0);
+    src.w = (area.x2()-1)/kScale + 1 + kMargin - src.x;
+    src.h = (area.y2()-1)/kScale + 1 + kMargin - src.y;
+    src = src.createIntersection(m_spr->bounds());
+
+    if (src.w*src.h > kMaxScaledPixels/(kScale*kScale) &&
+        (tile.w > 1 || tile.h > 1)) {
+      // Split the tile in two halves (keeping the multiple of 8 with
+      // bitmaps isn't needed here as it's the same task).
+      gfx::Rect a = tile, b = tile;
+      if (tile.w >= tile.h) {
+        a.w = tile.w/2;
+        b.x += a.w;
+        b.w -= a.w;
+      }
+      else {
+        a.h = tile.h/2;
+        b.y += a.h;
+        b.h -= a.h;
+      }
+      drawTile(a);
+      drawTile(b);
+      return;
+    }
+
+    // Upscale the portion of the sprite. The edges of the portion
+    // are the Scale2x edges only if they are the sprite edges, in
+    // other case the kMargin pixels contain the neighbors.
+    std::vector<color_t> buf1(src.w*src.h);
+    std::vector<color_t> buf2;
 
-  color_t maskColor = spr->maskColor();
+    for (int y=0; y<src.h; ++y)
+      for (int x=0; x<src.w; ++x)
+        buf1[y*src.w+x] = get_pixel_fast<ImageTraits>(m_spr, src.x+x, src.y+y);
+
+    int w = src.w, h = src.h;
+    for (int i=0; i<3; ++i) {
+      buf2.resize(4*w*h);
+      scale2x(&buf1[0], w, h, &buf2[0]);
+      buf1.swap(buf2);
+      w *= 2;
+      h *= 2;
+    }
 
-  bmp_copy->setMaskColor(maskColor);
-  tmp_copy->setMaskColor(maskColor);
-  spr_copy->setMaskColor(maskColor);
+    drawPixels(tile, &buf1[0],
+               gfx::Rect(src.x*kScale, src.y*kScale, w, h));
+  }
 
-  bmp_copy->clear(bmp->maskColor());
-  spr_copy->clear(maskColor);
-  spr_copy->copy(spr, gfx::Clip(spr->bounds()));
+  void drawPixels(const gfx::Rect& tile,
+                  const color_t* scaled, const gfx::Rect& scaledBounds) {
+    for (int v=tile.y; v<tile.y2(); ++v) {
+      for (int u=tile.x; u<tile.x2(); ++u) {
+        const color_t* c = nullptr;
+        int x, y;
+        if (scaled && sample(u, v, x, y)) {
+          x = MID(scaledBounds.x, x, scaledBounds.x2()-1) - scaledBounds.x;
+          y = MID(scaledBounds.y, y, scaledBounds.y2()-1) - scaledBounds.y;
+          c = scaled + y*scaledBounds.w + x;
+        }
 
-  for (int i=0; i<3; ++i) {
-    tmp_copy->clear(maskColor);
-    image_scale2x(tmp_copy, spr_copy, spr->width()*(1<<i), spr->height()*(1<<i));
-    spr_copy->copy(tmp_copy, gfx::Clip(tmp_copy->bounds()));
+        put_pixel_fast<ImageTraits>(m_bmp, u, v,
+          m_output(get_pixel_fast<ImageTraits>(m_bmp, u, v), c));
+      }
+    }
   }
 
-  doc::algorithm::parallelogram(bmp_copy, spr_copy,
-    x1*scale, y1*scale, x2*scale, y2*scale,
-    x3*scale, y3*scale, x4*scale, y4*scale);
+  Image* m_bmp;
+  const Image* m_spr;
+  Output m_output;
+  int m_ox, m_oy;
+  int m_e1x, m_e1y;             // Top edge (corner 1 to 2)
+  int m_e2x, m_e2y;             // Left edge (corner 1 to 4)
+  double m_det;
+  int m_scaledW, m_scaledH;
+};
 
-  doc::algorithm::scale_image(bmp, bmp_copy,
-    0, 0, bmp->width(), bmp->height());
+template<typename ImageTraits, typename Output>
+void rotsprite_tpl(Image* bmp, const Image* spr,
+                   int x1, int y1, int x2, int y2, int x4, int y4)
+{
+  RotSprite<ImageTraits, Output>(bmp, spr, x1, y1, x2, y2, x4, y4).draw();
+}
+
+} // anonymous namespace
+
+void rotsprite_image(Image* bmp, Image* spr,
+  int x1, int y1, int x2, int y2,
+  int x3, int y3, int x4, int y4)
+{
+  // The corners form a parallelogram, so the mapping is defined by
+  // the top and left edges (x3/y3 is the opposite corner).
+  switch (bmp->pixelFormat()) {
+    case IMAGE_RGB:
+      rotsprite_tpl<RgbTraits, RgbOutput>(bmp, spr, x1, y1, x2, y2, x4, y4);
+      break;
+    case IMAGE_GRAYSCALE:
+      rotsprite_tpl<GrayscaleTraits, GrayscaleOutput>(bmp, spr, x1, y1, x2, y2, x4, y4);
+      break;
+    case IMAGE_INDEXED:
+      rotsprite_tpl<IndexedTraits, IndexedOutput>(bmp, spr, x1, y1, x2, y2, x4, y4);
+      break;
+    case IMAGE_BITMAP:
+      rotsprite_tpl<BitmapTraits, BitmapOutput>(bmp, spr, x1, y1, x2, y2, x4, y4);
+      break;
+  }
 }
 
 } // namespace algorithm
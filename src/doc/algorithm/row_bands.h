@@ -0,0 +1,47 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_ALGORITHM_ROW_BANDS_H_INCLUDED
+#define DOC_ALGORITHM_ROW_BANDS_H_INCLUDED
+#pragma once
+
+#include "base/thread_pool.h"
+
+namespace doc {
+  namespace algorithm {
+
+    // Minimum number of pixels processed by each parallel task
+    const int kRowBandPixels = 64*1024;
+
+    // Calls f(y1, y2) for bands of rows [y1, y2) of an image of the
+    // given size using base::thread_pool::global().parallel_for().
+    // If "step" is 2, even bands are processed before odd bands (so
+    // bands processed at the same time are never adjacent).
+    template<typename F>
+    void for_each_row_band(int width, int height, const F& f, int step = 1)
+    {
+      if (height <= 0)
+        return;
+
+      int rows = kRowBandPixels / (width > 0 ? width: 1);
+      if (rows < 1) rows = 1;
+      if (rows > height) rows = height;
+      int bands = (height + rows - 1) / rows;
+
+      for (int first=0; first<step; ++first) {
+        base::thread_pool::global().parallel_for(
+          (bands - first + step - 1) / step,
+          [&](int i) {
+            int y = (first + i*step) * rows;
+            f(y, (y+rows < height ? y+rows: height));
+          });
+      }
+    }
+
+  } // namespace algorithm
+} // namespace doc
+
+#endif
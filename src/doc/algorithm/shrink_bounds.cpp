@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,91 +11,209 @@
 #include "doc/algorithm/shrink_bounds.h"
 
 #include "doc/image.h"
+#include "doc/image_traits.h"
+#include "doc/primitives_fast.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_SHRINK_BOUNDS_SSE2
+  #include <emmintrin.h>
+#endif
 
 namespace doc {
 namespace algorithm {
 
-static bool is_same_pixel(PixelFormat pixelFormat, color_t pixel1, color_t pixel2)
+namespace {
+
+#ifdef DOC_SHRINK_BOUNDS_SSE2
+inline __m128i set1_128(uint32_t v) { return _mm_set1_epi32(int(v)); }
+inline __m128i set1_128(uint16_t v) { return _mm_set1_epi16(short(v)); }
+inline __m128i set1_128(uint8_t v) { return _mm_set1_epi8(char(v)); }
+#endif
+
+// Returns the index of the first of "n" pixels where (pixel & mask)
+// != value, or "n" if all pixels are equal to the reference.
+template<typename pixel_t>
+int first_different(const pixel_t* p, int n, pixel_t mask, pixel_t value)
 {
-  switch (pixelFormat) {
-    case IMAGE_RGB:
-      if (rgba_geta(pixel1) == 0 && rgba_geta(pixel2) == 0)
-        return true;
-      break;
-    case IMAGE_GRAYSCALE:
-      if (graya_geta(pixel1) == 0 && graya_geta(pixel2) == 0)
-        return true;
+  int i = 0;
+
+#ifdef DOC_SHRINK_BOUNDS_SSE2
+  const int k = 16 / sizeof(pixel_t);   // Pixels in 16 bytes
+  const __m128i m = set1_128(mask);
+  const __m128i v = set1_128(value);
+
+  // Skip blocks of 16 bytes equal to the reference, the exact pixel
+  // is found by the loop below.
+  for (; i+k <= n; i+=k) {
+    __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(p+i)), m);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, v)) != 0xffff)
       break;
   }
-  return pixel1 == pixel2;
+#endif
+
+  for (; i<n; ++i)
+    if ((p[i] & mask) != value)
+      return i;
+  return n;
 }
 
-bool shrink_bounds(Image *image, gfx::Rect& bounds, color_t refpixel)
+// Returns the index of the last of "n" pixels where (pixel & mask)
+// != value, or -1 if all pixels are equal to the reference.
+template<typename pixel_t>
+int last_different(const pixel_t* p, int n, pixel_t mask, pixel_t value)
 {
-  bool shrink;
-  int u, v;
+  int i = n;
 
-  bounds = image->bounds();
+#ifdef DOC_SHRINK_BOUNDS_SSE2
+  const int k = 16 / sizeof(pixel_t);
+  const __m128i m = set1_128(mask);
+  const __m128i v = set1_128(value);
 
-  // Shrink left side
-  for (u=bounds.x; u<bounds.x+bounds.w; ++u) {
-    shrink = true;
-    for (v=bounds.y; v<bounds.y+bounds.h; ++v) {
-      if (!is_same_pixel(image->pixelFormat(), image->getPixel(u, v), refpixel)) {
-        shrink = false;
-        break;
-      }
-    }
-    if (!shrink)
+  for (; i-k >= 0; i-=k) {
+    __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(p+i-k)), m);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, v)) != 0xffff)
       break;
-    ++bounds.x;
-    --bounds.w;
+  }
+#endif
+
+  for (--i; i>=0; --i)
+    if ((p[i] & mask) != value)
+      return i;
+  return -1;
+}
+
+// Finds pixels that aren't equal to the reference pixel in ranges
+// [x1, x2) of rows of the image.
+template<typename ImageTraits>
+class RowScanner {
+public:
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  RowScanner(const Image* image, pixel_t mask, pixel_t value)
+    : m_image(image), m_mask(mask), m_value(value) {
+  }
+
+  // Returns the first different pixel or x2
+  int first(int y, int x1, int x2) const {
+    return x1 + first_different(row(y)+x1, x2-x1, m_mask, m_value);
+  }
+
+  // Returns the last different pixel or x1-1
+  int last(int y, int x1, int x2) const {
+    return x1 + last_different(row(y)+x1, x2-x1, m_mask, m_value);
+  }
+
+private:
+  const pixel_t* row(int y) const {
+    return (const pixel_t*)m_image->getPixelAddress(0, y);
+  }
+
+  const Image* m_image;
+  pixel_t m_mask;
+  pixel_t m_value;
+};
+
+// Bitmaps have 8 pixels in each byte, they are compared one by one.
+template<>
+class RowScanner<BitmapTraits> {
+public:
+  typedef BitmapTraits::pixel_t pixel_t;
+
+  RowScanner(const Image* image, pixel_t mask, pixel_t value)
+    : m_image(image), m_value(value) {
   }
 
-  // Shrink right side
-  for (u=bounds.x+bounds.w-1; u>=bounds.x; --u) {
-    shrink = true;
-    for (v=bounds.y; v<bounds.y+bounds.h; ++v) {
-      if (!is_same_pixel(image->pixelFormat(), image->getPixel(u, v), refpixel)) {
-        shrink = false;
+  int first(int y, int x1, int x2) const {
+    for (; x1<x2; ++x1)
+      if (get_pixel_fast<BitmapTraits>(m_image, x1, y) != m_value)
         break;
-      }
-    }
-    if (!shrink)
-      break;
-    --bounds.w;
+    return x1;
   }
 
-  // Shrink top side
-  for (v=bounds.y; v<bounds.y+bounds.h; ++v) {
-    shrink = true;
-    for (u=bounds.x; u<bounds.x+bounds.w; ++u) {
-      if (!is_same_pixel(image->pixelFormat(), image->getPixel(u, v), refpixel)) {
-        shrink = false;
+  int last(int y, int x1, int x2) const {
+    for (--x2; x2>=x1; --x2)
+      if (get_pixel_fast<BitmapTraits>(m_image, x2, y) != m_value)
         break;
-      }
-    }
-    if (!shrink)
+    return x2;
+  }
+
+private:
+  const Image* m_image;
+  pixel_t m_value;
+};
+
+// Calculates the bounds scanning whole rows (the memory layout of
+// the image): first empty rows are skipped from the top and the
+// bottom, then each remaining row is only scanned from both sides
+// until the current left/right bounds.
+template<typename ImageTraits>
+bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds,
+                         typename ImageTraits::pixel_t mask,
+                         typename ImageTraits::pixel_t value)
+{
+  const RowScanner<ImageTraits> scanner(image, mask, value);
+  const int w = image->width();
+  const int h = image->height();
+  int x1, y1, x2, y2, y;
+
+  // Shrink top side
+  for (y1=0; y1<h; ++y1)
+    if (scanner.first(y1, 0, w) < w)
       break;
-    ++bounds.y;
-    --bounds.h;
+
+  if (y1 == h) {
+    bounds = gfx::Rect(0, 0, 0, 0);
+    return false;
   }
 
-  // Shrink bottom side
-  for (v=bounds.y+bounds.h-1; v>=bounds.y; --v) {
-    shrink = true;
-    for (u=bounds.x; u<bounds.x+bounds.w; ++u) {
-      if (!is_same_pixel(image->pixelFormat(), image->getPixel(u, v), refpixel)) {
-        shrink = false;
-        break;
-      }
-    }
-    if (!shrink)
+  // Shrink bottom side (we know that row y1 isn't empty)
+  for (y2=h; y2-1>y1; --y2)
+    if (scanner.first(y2-1, 0, w) < w)
       break;
-    --bounds.h;
+
+  // Shrink left side
+  x1 = w;
+  for (y=y1; y<y2 && x1>0; ++y)
+    x1 = scanner.first(y, 0, x1);
+
+  // Shrink right side (pixel x1 of some row is different)
+  x2 = x1+1;
+  for (y=y1; y<y2 && x2<w; ++y)
+    x2 = scanner.last(y, x2, w)+1;
+
+  bounds = gfx::Rect(x1, y1, x2-x1, y2-y1);
+  return true;
+}
+
+} // anonymous namespace
+
+bool shrink_bounds(Image *image, gfx::Rect& bounds, color_t refpixel)
+{
+  // Pixels are equal to the reference pixel if they are the same
+  // color, or if both of them are completely transparent.
+  switch (image->pixelFormat()) {
+
+    case IMAGE_RGB:
+      if (rgba_geta(refpixel) == 0)
+        return shrink_bounds_templ<RgbTraits>(image, bounds, rgba_a_mask, 0);
+      else
+        return shrink_bounds_templ<RgbTraits>(image, bounds, 0xffffffff, refpixel);
+
+    case IMAGE_GRAYSCALE:
+      if (graya_geta(refpixel) == 0)
+        return shrink_bounds_templ<GrayscaleTraits>(image, bounds, graya_a_mask, 0);
+      else
+        return shrink_bounds_templ<GrayscaleTraits>(image, bounds, 0xffff, refpixel);
+
+    case IMAGE_INDEXED:
+      return shrink_bounds_templ<IndexedTraits>(image, bounds, 0xff, refpixel);
+
+    case IMAGE_BITMAP:
+      return shrink_bounds_templ<BitmapTraits>(image, bounds, 1, refpixel);
   }
 
-  return (!bounds.isEmpty());
+  bounds = image->bounds();
+  return true;
 }
 
 } // namespace algorithm
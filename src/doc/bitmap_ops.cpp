@@ -0,0 +1,336 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/bitmap_ops.h"
+
+#include "doc/image.h"
+#include "doc/image_traits.h"
+
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_BITMAP_OPS_SSE2
+  #include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+  #include <intrin.h>
+#endif
+
+namespace doc {
+
+namespace {
+
+// Words are loaded/stored byte by byte, so the first pixel is the
+// LSB in any platform (compilers use one load/store instruction in
+// little-endian platforms).
+inline uint64_t load64(const uint8_t* p)
+{
+  return
+    (uint64_t(p[0])      ) | (uint64_t(p[1]) <<  8) |
+    (uint64_t(p[2]) << 16) | (uint64_t(p[3]) << 24) |
+    (uint64_t(p[4]) << 32) | (uint64_t(p[5]) << 40) |
+    (uint64_t(p[6]) << 48) | (uint64_t(p[7]) << 56);
+}
+
+inline void store64(uint8_t* p, uint64_t v)
+{
+  for (int i=0; i<8; ++i, v >>= 8)
+    p[i] = uint8_t(v);
+}
+
+// 64/8 bits starting in the pixel "x" (the next byte is read only
+// if it contains some of those bits)
+inline uint64_t load_bits64(const uint8_t* row, int x)
+{
+  const uint8_t* p = row + (x >> 3);
+  const int s = (x & 7);
+  uint64_t v = load64(p);
+  if (s)
+    v = (v >> s) | (uint64_t(p[8]) << (64-s));
+  return v;
+}
+
+inline uint8_t load_bits8(const uint8_t* row, int x)
+{
+  const uint8_t* p = row + (x >> 3);
+  const int s = (x & 7);
+  if (s)
+    return uint8_t((p[0] >> s) | (p[1] << (8-s)));
+  else
+    return p[0];
+}
+
+inline void set_bit(uint8_t* row, int x, bool value)
+{
+  if (value)
+    row[x >> 3] |= uint8_t(1 << (x & 7));
+  else
+    row[x >> 3] &= uint8_t(~(1 << (x & 7)));
+}
+
+inline int popcount64(uint64_t v)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll(v);
+#else
+  v = v - ((v >> 1) & 0x5555555555555555ULL);
+  v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+  v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return int((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Index of the first bit set ("v" cannot be 0)
+inline int first_bit64(uint64_t v)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long i;
+  _BitScanForward64(&i, v);
+  return int(i);
+#else
+  int i = 0;
+  for (; !(v & 0xff); v >>= 8)
+    i += 8;
+  for (; !(v & 1); v >>= 1)
+    ++i;
+  return i;
+#endif
+}
+
+struct FillOp {
+  bool value;
+  FillOp(bool value) : value(value) { }
+  uint64_t operator()(uint64_t, uint64_t) const { return (value ? ~uint64_t(0): 0); }
+#ifdef DOC_BITMAP_OPS_SSE2
+  __m128i operator()(__m128i, __m128i) const { return _mm_set1_epi32(value ? -1: 0); }
+#endif
+};
+
+struct CopyOp {
+  uint64_t operator()(uint64_t, uint64_t s) const { return s; }
+#ifdef DOC_BITMAP_OPS_SSE2
+  __m128i operator()(__m128i, __m128i s) const { return s; }
+#endif
+};
+
+struct AndOp {
+  uint64_t operator()(uint64_t d, uint64_t s) const { return d & s; }
+#ifdef DOC_BITMAP_OPS_SSE2
+  __m128i operator()(__m128i d, __m128i s) const { return _mm_and_si128(d, s); }
+#endif
+};
+
+struct OrOp {
+  uint64_t operator()(uint64_t d, uint64_t s) const { return d | s; }
+#ifdef DOC_BITMAP_OPS_SSE2
+  __m128i operator()(__m128i d, __m128i s) const { return _mm_or_si128(d, s); }
+#endif
+};
+
+struct XorOp {
+  uint64_t operator()(uint64_t d, uint64_t s) const { return d ^ s; }
+#ifdef DOC_BITMAP_OPS_SSE2
+  __m128i operator()(__m128i d, __m128i s) const { return _mm_xor_si128(d, s); }
+#endif
+};
+
+// The source is ignored (it's used with src=dst)
+struct NotOp {
+  uint64_t operator()(uint64_t d, uint64_t) const { return ~d; }
+#ifdef DOC_BITMAP_OPS_SSE2
+  __m128i operator()(__m128i d, __m128i) const { return _mm_xor_si128(d, _mm_set1_epi32(-1)); }
+#endif
+};
+
+template<typename Op>
+void row_op(uint8_t* dst, int dstX, const uint8_t* src, int srcX, int w, Op op)
+{
+  int i = 0;
+
+  // Bits until the destination is aligned to a byte
+  for (; i<w && ((dstX+i) & 7); ++i)
+    set_bit(dst, dstX+i,
+            (op(bitmap_row_get(dst, dstX+i),
+                bitmap_row_get(src, srcX+i)) & 1) ? true: false);
+
+  uint8_t* d = dst + ((dstX+i) >> 3);
+
+#ifdef DOC_BITMAP_OPS_SSE2
+  // 128 bits at once if the source is aligned too
+  if (((srcX+i) & 7) == 0) {
+    const uint8_t* s = src + ((srcX+i) >> 3);
+    for (; w-i >= 128; i += 128, d += 16, s += 16)
+      _mm_storeu_si128((__m128i*)d,
+                       op(_mm_loadu_si128((const __m128i*)d),
+                          _mm_loadu_si128((const __m128i*)s)));
+  }
+#endif
+
+  for (; w-i >= 64; i += 64, d += 8)
+    store64(d, op(load64(d), load_bits64(src, srcX+i)));
+
+  for (; w-i >= 8; i += 8, ++d)
+    *d = uint8_t(op(*d, load_bits8(src, srcX+i)));
+
+  for (; i<w; ++i)
+    set_bit(dst, dstX+i,
+            (op(bitmap_row_get(dst, dstX+i),
+                bitmap_row_get(src, srcX+i)) & 1) ? true: false);
+}
+
+// Last pixel in [x, end) with a bit set, or x-1 if there is no one
+int row_find_last(const uint8_t* row, int x, int end)
+{
+  int i = end;
+  while (i > x) {
+    if ((i & 7) == 0 && i-8 >= x && row[(i-8) >> 3] == 0) {
+      i -= 8;
+      continue;
+    }
+    --i;
+    if (bitmap_row_get(row, i))
+      return i;
+  }
+  return x-1;
+}
+
+} // anonymous namespace
+
+void bitmap_row_fill(uint8_t* row, int x, int w, bool value)
+{
+  row_op(row, x, row, x, w, FillOp(value));
+}
+
+void bitmap_row_not(uint8_t* row, int x, int w)
+{
+  row_op(row, x, row, x, w, NotOp());
+}
+
+void bitmap_row_copy(uint8_t* dst, int dstX, const uint8_t* src, int srcX, int w)
+{
+  row_op(dst, dstX, src, srcX, w, CopyOp());
+}
+
+void bitmap_row_and(uint8_t* dst, int dstX, const uint8_t* src, int srcX, int w)
+{
+  row_op(dst, dstX, src, srcX, w, AndOp());
+}
+
+void bitmap_row_or(uint8_t* dst, int dstX, const uint8_t* src, int srcX, int w)
+{
+  row_op(dst, dstX, src, srcX, w, OrOp());
+}
+
+void bitmap_row_xor(uint8_t* dst, int dstX, const uint8_t* src, int srcX, int w)
+{
+  row_op(dst, dstX, src, srcX, w, XorOp());
+}
+
+int bitmap_row_count(const uint8_t* row, int x, int w)
+{
+  const int end = x+w;
+  int count = 0;
+  int i = x;
+
+  for (; i<end && (i & 7); ++i)
+    count += (bitmap_row_get(row, i) ? 1: 0);
+
+  for (; end-i >= 64; i += 64)
+    count += popcount64(load64(row + (i >> 3)));
+
+  for (; end-i >= 8; i += 8)
+    count += popcount64(row[i >> 3]);
+
+  for (; i<end; ++i)
+    count += (bitmap_row_get(row, i) ? 1: 0);
+
+  return count;
+}
+
+int bitmap_row_find(const uint8_t* row, int x, int end, bool value)
+{
+  // Bits are inverted to look for the first bit set
+  const uint64_t inv = (value ? 0: ~uint64_t(0));
+  int i = x;
+
+  for (; i<end && (i & 7); ++i)
+    if (bitmap_row_get(row, i) == value)
+      return i;
+
+  for (; end-i >= 64; i += 64) {
+    uint64_t v = load64(row + (i >> 3)) ^ inv;
+    if (v)
+      return i + first_bit64(v);
+  }
+
+  for (; end-i >= 8; i += 8) {
+    uint64_t v = (row[i >> 3] ^ inv) & 0xff;
+    if (v)
+      return i + first_bit64(v);
+  }
+
+  for (; i<end; ++i)
+    if (bitmap_row_get(row, i) == value)
+      return i;
+
+  return end;
+}
+
+void bitmap_invert(Image* bitmap)
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  for (int y=0; y<bitmap->height(); ++y)
+    bitmap_row_not(bitmap->getPixelAddress(0, y), 0, bitmap->width());
+}
+
+int bitmap_count(const Image* bitmap)
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  int count = 0;
+  for (int y=0; y<bitmap->height(); ++y)
+    count += bitmap_row_count(bitmap->getPixelAddress(0, y), 0, bitmap->width());
+  return count;
+}
+
+gfx::Rect bitmap_bounds(const Image* bitmap)
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  const int w = bitmap->width();
+  const int h = bitmap->height();
+  auto emptyRow = [bitmap, w](int y) -> bool {
+    return (bitmap_row_find(bitmap->getPixelAddress(0, y), 0, w, true) == w);
+  };
+
+  // First/last rows with selected pixels
+  int y1 = 0, y2 = h-1;
+  while (y1 <= y2 && emptyRow(y1))
+    ++y1;
+  if (y1 > y2)
+    return gfx::Rect();
+  while (emptyRow(y2))
+    --y2;
+
+  // Columns with selected pixels
+  std::vector<uint8_t> cols(BitmapTraits::getRowStrideBytes(w), 0);
+  for (int y=y1; y<=y2; ++y)
+    bitmap_row_or(&cols[0], 0, bitmap->getPixelAddress(0, y), 0, w);
+
+  int x1 = bitmap_row_find(&cols[0], 0, w, true);
+  int x2 = row_find_last(&cols[0], 0, w);
+  return gfx::Rect(x1, y1, x2-x1+1, y2-y1+1);
+}
+
+} // namespace doc
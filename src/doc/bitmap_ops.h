@@ -0,0 +1,85 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_BITMAP_OPS_H_INCLUDED
+#define DOC_BITMAP_OPS_H_INCLUDED
+#pragma once
+
+#include "gfx/rect.h"
+
+#include <cstdint>
+
+namespace doc {
+
+  class Image;
+
+  // Operations over rows of IMAGE_BITMAP images (e.g. masks), where
+  // the pixel "x" is the bit (x & 7) of the byte (x >> 3). They
+  // process 64 pixels (or 128 pixels with SSE2 when both rows are
+  // aligned to the same bit) in each step, and only modify/read the
+  // bits in the given range [x, x+w).
+
+  inline bool bitmap_row_get(const uint8_t* row, int x) {
+    return ((row[x >> 3] >> (x & 7)) & 1) ? true: false;
+  }
+
+  void bitmap_row_fill(uint8_t* row, int x, int w, bool value);
+  void bitmap_row_not(uint8_t* row, int x, int w);
+
+  // dst[dstX+i] = src[srcX+i] (or dst[dstX+i] op src[srcX+i]) for
+  // each i in [0, w). The source bits can start in any position of
+  // a byte (they are shifted to the destination position). Both
+  // ranges cannot overlap (unless they are the same range).
+  void bitmap_row_copy(uint8_t* dst, int dstX, const uint8_t* src, int srcX, int w);
+  void bitmap_row_and(uint8_t* dst, int dstX, const uint8_t* src, int srcX, int w);
+  void bitmap_row_or(uint8_t* dst, int dstX, const uint8_t* src, int srcX, int w);
+  void bitmap_row_xor(uint8_t* dst, int dstX, const uint8_t* src, int srcX, int w);
+
+  // Number of bits set in [x, x+w)
+  int bitmap_row_count(const uint8_t* row, int x, int w);
+
+  // Returns the first pixel in [x, end) with the given value, or
+  // "end" if there is no one. Words without that value are skipped.
+  int bitmap_row_find(const uint8_t* row, int x, int end, bool value);
+
+  // Runs of selected pixels (bits set) of a row:
+  //
+  //   BitmapRowRuns runs(row, x, w);
+  //   for (int u, n; runs.next(u, n); )
+  //     ...pixels [u, u+n) are selected...
+  //
+  class BitmapRowRuns {
+  public:
+    BitmapRowRuns(const uint8_t* row, int x, int w)
+      : m_row(row), m_x(x), m_end(x+w) {
+    }
+
+    bool next(int& x, int& w) {
+      x = bitmap_row_find(m_row, m_x, m_end, true);
+      if (x >= m_end)
+        return false;
+
+      m_x = bitmap_row_find(m_row, x+1, m_end, false);
+      w = m_x - x;
+      return true;
+    }
+
+  private:
+    const uint8_t* m_row;
+    int m_x, m_end;
+  };
+
+  // Whole IMAGE_BITMAP images
+  void bitmap_invert(Image* bitmap);
+  int bitmap_count(const Image* bitmap);
+
+  // Bounds of the selected pixels (an empty rectangle if there are
+  // no pixels selected)
+  gfx::Rect bitmap_bounds(const Image* bitmap);
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,182 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/bitmap_ops.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+  const int kBytes = 64;        // 512 pixels in each row
+
+  // Sparse, dense, or random bits
+  std::vector<uint8_t> random_row(int type) {
+    std::vector<uint8_t> row(kBytes);
+    for (int i=0; i<kBytes; ++i) {
+      switch (type) {
+        case 0: row[i] = ((std::rand() % 16) == 0 ? uint8_t(1 << (std::rand() % 8)): 0); break;
+        case 1: row[i] = ((std::rand() % 16) == 0 ? uint8_t(~(1 << (std::rand() % 8))): 0xff); break;
+        default: row[i] = uint8_t(std::rand()); break;
+      }
+    }
+    return row;
+  }
+
+  void set_bit(std::vector<uint8_t>& row, int x, bool value) {
+    if (value)
+      row[x/8] |= (1 << (x%8));
+    else
+      row[x/8] &= ~(1 << (x%8));
+  }
+
+  // Random ranges with all the possible alignments of x and w
+  void random_range(int& dstX, int& srcX, int& w) {
+    dstX = std::rand() % 200;
+    srcX = std::rand() % 200;
+    w = std::rand() % (kBytes*8 - std::max(dstX, srcX) + 1);
+  }
+
+}
+
+TEST(BitmapOps, RowOperations)
+{
+  std::srand(1);
+
+  for (int test=0; test<2000; ++test) {
+    std::vector<uint8_t> src = random_row(test % 3);
+    std::vector<uint8_t> dst = random_row((test/3) % 3);
+    int dstX, srcX, w;
+    random_range(dstX, srcX, w);
+
+    for (int op=0; op<6; ++op) {
+      std::vector<uint8_t> res = dst;
+      std::vector<uint8_t> exp = dst;
+
+      for (int i=0; i<w; ++i) {
+        bool d = bitmap_row_get(&dst[0], dstX+i);
+        bool s = bitmap_row_get(&src[0], srcX+i);
+        bool v = false;
+        switch (op) {
+          case 0: v = s; break;
+          case 1: v = d && s; break;
+          case 2: v = d || s; break;
+          case 3: v = d != s; break;
+          case 4: v = !d; break;
+          case 5: v = ((test & 1) == 1); break;
+        }
+        set_bit(exp, dstX+i, v);
+      }
+
+      switch (op) {
+        case 0: bitmap_row_copy(&res[0], dstX, &src[0], srcX, w); break;
+        case 1: bitmap_row_and(&res[0], dstX, &src[0], srcX, w); break;
+        case 2: bitmap_row_or(&res[0], dstX, &src[0], srcX, w); break;
+        case 3: bitmap_row_xor(&res[0], dstX, &src[0], srcX, w); break;
+        case 4: bitmap_row_not(&res[0], dstX, w); break;
+        case 5: bitmap_row_fill(&res[0], dstX, w, (test & 1) == 1); break;
+      }
+
+      ASSERT_EQ(exp, res) << "op=" << op << " dstX=" << dstX << " srcX=" << srcX << " w=" << w;
+    }
+  }
+}
+
+TEST(BitmapOps, CountFindAndRuns)
+{
+  std::srand(2);
+
+  for (int test=0; test<2000; ++test) {
+    std::vector<uint8_t> row = random_row(test % 3);
+    int x, unused, w;
+    random_range(x, unused, w);
+
+    int count = 0;
+    for (int i=x; i<x+w; ++i)
+      count += (bitmap_row_get(&row[0], i) ? 1: 0);
+    ASSERT_EQ(count, bitmap_row_count(&row[0], x, w));
+
+    for (int value=0; value<2; ++value) {
+      int i = x;
+      while (i < x+w && bitmap_row_get(&row[0], i) != (value == 1))
+        ++i;
+      ASSERT_EQ(i, bitmap_row_find(&row[0], x, x+w, value == 1));
+    }
+
+    // Runs cover exactly the bits set
+    std::vector<uint8_t> res(kBytes, 0);
+    BitmapRowRuns runs(&row[0], x, w);
+    int lastEnd = -1;
+    for (int u, n; runs.next(u, n); ) {
+      ASSERT_GE(n, 1);
+      ASSERT_GT(u, lastEnd);    // Runs are separated by unselected pixels
+      for (int i=u; i<u+n; ++i)
+        set_bit(res, i, true);
+      lastEnd = u+n;
+    }
+    for (int i=0; i<kBytes*8; ++i)
+      ASSERT_EQ(i >= x && i < x+w && bitmap_row_get(&row[0], i),
+                bitmap_row_get(&res[0], i)) << i;
+  }
+}
+
+TEST(BitmapOps, Bounds)
+{
+  ImageRef bitmap(Image::create(IMAGE_BITMAP, 150, 70));
+  clear_image(bitmap.get(), 0);
+  EXPECT_TRUE(bitmap_bounds(bitmap.get()).isEmpty());
+  EXPECT_EQ(0, bitmap_count(bitmap.get()));
+
+  put_pixel(bitmap.get(), 3, 60, 1);
+  put_pixel(bitmap.get(), 130, 5, 1);
+  put_pixel(bitmap.get(), 131, 5, 1);
+  EXPECT_EQ(gfx::Rect(3, 5, 129, 56), bitmap_bounds(bitmap.get()));
+  EXPECT_EQ(3, bitmap_count(bitmap.get()));
+
+  bitmap_invert(bitmap.get());
+  EXPECT_EQ(gfx::Rect(0, 0, 150, 70), bitmap_bounds(bitmap.get()));
+  EXPECT_EQ(150*70-3, bitmap_count(bitmap.get()));
+}
+
+TEST(BitmapOps, CopyUnalignedImage)
+{
+  std::srand(3);
+
+  ImageRef src(Image::create(IMAGE_BITMAP, 100, 20));
+  for (int y=0; y<20; ++y)
+    for (int x=0; x<100; ++x)
+      put_pixel(src.get(), x, y, std::rand() & 1);
+
+  ImageRef dst(Image::create(IMAGE_BITMAP, 90, 20));
+  clear_image(dst.get(), 0);
+  dst->copy(src.get(), gfx::Clip(5, 2, 13, 1, 70, 15));
+
+  for (int y=0; y<20; ++y)
+    for (int x=0; x<90; ++x) {
+      color_t expected = 0;
+      if (x >= 5 && x < 75 && y >= 2 && y < 17)
+        expected = get_pixel(src.get(), x-5+13, y-2+1);
+      ASSERT_EQ(expected, get_pixel(dst.get(), x, y)) << x << "," << y;
+    }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
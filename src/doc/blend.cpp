@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,6 +11,11 @@
 #include "doc/blend.h"
 #include "doc/image.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_BLEND_SSE2
+  #include <emmintrin.h>
+#endif
+
 namespace doc {
 
 BLEND_COLOR rgba_blenders[] =
@@ -33,6 +38,16 @@ BLEND_COLOR graya_blenders[] =
   graya_blend_blackandwhite,
 };
 
+BLEND_SPAN rgba_span_blenders[] =
+{
+  rgba_blend_span_normal,
+  rgba_blend_span_copy,
+  rgba_blend_span_merge,
+  rgba_blend_span_red_tint,
+  rgba_blend_span_blue_tint,
+  rgba_blend_span_blackandwhite,
+};
+
 //////////////////////////////////////////////////////////////////////
 // RGB blenders
 
@@ -208,6 +223,127 @@ int rgba_blend_blackandwhite(int back, int front, int opacity)
   return rgba(D_v, D_v, D_v, 255);
 }
 
+//////////////////////////////////////////////////////////////////////
+// RGB span blenders
+
+// Generic span blender, the compiler can inline the per pixel
+// blender as it's known at compile time.
+template<int (*blender)(int, int, int)>
+static inline void rgba_blend_span(uint32_t* dst, const uint32_t* src, int n,
+                                   int opacity, uint32_t mask_color)
+{
+  for (int i=0; i<n; ++i) {
+    if (src[i] != mask_color)
+      dst[i] = (*blender)(dst[i], src[i], opacity);
+  }
+}
+
+#ifdef DOC_BLEND_SSE2
+
+// Blends 4 pixels with the same formula used in rgba_blend_normal()
+static inline __m128i rgba_blend_normal_sse2(__m128i back, __m128i front, __m128i opacity)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i mask8 = _mm_set1_epi32(0xff);
+  const __m128i half = _mm_set1_epi32(0x80);
+
+  __m128i B_a = _mm_srli_epi32(back, rgba_a_shift);
+  __m128i F_a = _mm_srli_epi32(front, rgba_a_shift);
+
+  // F_a = INT_MULT(F_a, opacity, t) (values are < 256 so
+  // _mm_madd_epi16() is a 32-bit multiplication here)
+  __m128i t = _mm_add_epi32(_mm_madd_epi16(F_a, opacity), half);
+  F_a = _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(t, 8), t), 8);
+
+  // D_a = B_a + F_a - INT_MULT(B_a, F_a, t)
+  t = _mm_add_epi32(_mm_madd_epi16(B_a, F_a), half);
+  __m128i D_a = _mm_sub_epi32(_mm_add_epi32(B_a, F_a),
+                              _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(t, 8), t), 8));
+
+  // Lanes where B_a == 0 (D_a is zero only in these lanes, so we
+  // can use max(D_a, 1) to avoid divisions by zero).
+  __m128i back_empty = _mm_cmpeq_epi32(B_a, zero);
+  __m128 D_a_f = _mm_cvtepi32_ps(_mm_or_si128(D_a, _mm_and_si128(back_empty, _mm_set1_epi32(1))));
+  __m128 F_a_f = _mm_cvtepi32_ps(F_a);
+
+  // D_c = B_c + (F_c-B_c) * F_a / D_a (products are < 2^24 so they
+  // are exact in float, and the truncated quotient is exact too)
+  __m128i D = _mm_slli_epi32(D_a, rgba_a_shift);
+  for (int shift=0; shift<24; shift+=8) {
+    __m128i B_c = _mm_and_si128(_mm_srli_epi32(back, shift), mask8);
+    __m128i F_c = _mm_and_si128(_mm_srli_epi32(front, shift), mask8);
+    __m128 q = _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(F_c, B_c)), F_a_f), D_a_f);
+    __m128i D_c = _mm_add_epi32(B_c, _mm_cvttps_epi32(q));
+    D = _mm_or_si128(D, _mm_slli_epi32(D_c, shift));
+  }
+
+  // if (B_a == 0) return (front & 0xffffff) | (F_a << 24)
+  __m128i empty_result = _mm_or_si128(
+    _mm_and_si128(front, _mm_set1_epi32(rgba_rgb_mask)),
+    _mm_slli_epi32(F_a, rgba_a_shift));
+  D = _mm_or_si128(_mm_and_si128(back_empty, empty_result),
+                   _mm_andnot_si128(back_empty, D));
+
+  // else if (front alpha == 0) return back
+  __m128i front_empty = _mm_andnot_si128(
+    back_empty,
+    _mm_cmpeq_epi32(_mm_srli_epi32(front, rgba_a_shift), zero));
+  return _mm_or_si128(_mm_and_si128(front_empty, back),
+                      _mm_andnot_si128(front_empty, D));
+}
+
+#endif
+
+void rgba_blend_span_normal(uint32_t* dst, const uint32_t* src, int n,
+                            int opacity, uint32_t mask_color)
+{
+  int i = 0;
+#ifdef DOC_BLEND_SSE2
+  const __m128i opacity4 = _mm_set1_epi32(opacity);
+  const __m128i mask4 = _mm_set1_epi32(mask_color);
+  for (; i+4<=n; i+=4) {
+    __m128i back = _mm_loadu_si128((const __m128i*)(dst+i));
+    __m128i front = _mm_loadu_si128((const __m128i*)(src+i));
+    __m128i keep = _mm_cmpeq_epi32(front, mask4);
+    __m128i D = rgba_blend_normal_sse2(back, front, opacity4);
+    _mm_storeu_si128((__m128i*)(dst+i),
+                     _mm_or_si128(_mm_and_si128(keep, back),
+                                  _mm_andnot_si128(keep, D)));
+  }
+#endif
+  rgba_blend_span<rgba_blend_normal>(dst+i, src+i, n-i, opacity, mask_color);
+}
+
+void rgba_blend_span_copy(uint32_t* dst, const uint32_t* src, int n,
+                          int opacity, uint32_t mask_color)
+{
+  rgba_blend_span<rgba_blend_copy>(dst, src, n, opacity, mask_color);
+}
+
+void rgba_blend_span_merge(uint32_t* dst, const uint32_t* src, int n,
+                           int opacity, uint32_t mask_color)
+{
+  rgba_blend_span<rgba_blend_merge>(dst, src, n, opacity, mask_color);
+}
+
+void rgba_blend_span_red_tint(uint32_t* dst, const uint32_t* src, int n,
+                              int opacity, uint32_t mask_color)
+{
+  rgba_blend_span<rgba_blend_red_tint>(dst, src, n, opacity, mask_color);
+}
+
+void rgba_blend_span_blue_tint(uint32_t* dst, const uint32_t* src, int n,
+                               int opacity, uint32_t mask_color)
+{
+  rgba_blend_span<rgba_blend_blue_tint>(dst, src, n, opacity, mask_color);
+}
+
+void rgba_blend_span_blackandwhite(uint32_t* dst, const uint32_t* src, int n,
+                                   int opacity, uint32_t mask_color)
+{
+  rgba_blend_span<rgba_blend_blackandwhite>(dst, src, n, opacity, mask_color);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Grayscale blenders
 
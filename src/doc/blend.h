@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -25,8 +25,17 @@ namespace doc {
 
   typedef int (*BLEND_COLOR)(int back, int front, int opacity);
 
+  // Blends a whole span of "n" RGBA pixels in place:
+  //   dst[i] = blender(dst[i], src[i], opacity)
+  // for each src[i] != mask_color (other dst[i] are kept). The result
+  // is exactly the same as using the BLEND_COLOR of the same blend
+  // mode pixel by pixel.
+  typedef void (*BLEND_SPAN)(uint32_t* dst, const uint32_t* src, int n,
+                             int opacity, uint32_t mask_color);
+
   extern BLEND_COLOR rgba_blenders[];
   extern BLEND_COLOR graya_blenders[];
+  extern BLEND_SPAN rgba_span_blenders[];
 
   int rgba_blend_normal(int back, int front, int opacity);
   int rgba_blend_copy(int back, int front, int opacity);
@@ -44,6 +53,13 @@ namespace doc {
 
   int indexed_blend_direct(int back, int front, int opacity);
 
+  void rgba_blend_span_normal(uint32_t* dst, const uint32_t* src, int n, int opacity, uint32_t mask_color);
+  void rgba_blend_span_copy(uint32_t* dst, const uint32_t* src, int n, int opacity, uint32_t mask_color);
+  void rgba_blend_span_merge(uint32_t* dst, const uint32_t* src, int n, int opacity, uint32_t mask_color);
+  void rgba_blend_span_red_tint(uint32_t* dst, const uint32_t* src, int n, int opacity, uint32_t mask_color);
+  void rgba_blend_span_blue_tint(uint32_t* dst, const uint32_t* src, int n, int opacity, uint32_t mask_color);
+  void rgba_blend_span_blackandwhite(uint32_t* dst, const uint32_t* src, int n, int opacity, uint32_t mask_color);
+
 } // namespace doc
 
 #endif
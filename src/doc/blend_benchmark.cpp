@@ -0,0 +1,91 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "tests/benchmark.h"
+
+#include "doc/blend.h"
+#include "doc/color.h"
+
+#include <vector>
+
+using namespace doc;
+
+static void fill_pixels(std::vector<uint32_t>& pixels, uint32_t seed)
+{
+  for (size_t i=0; i<pixels.size(); ++i) {
+    seed = seed*1103515245 + 12345;
+    pixels[i] = seed;
+  }
+}
+
+// Blends a span of pixels with the span blender of the given blend
+// mode (range_x) and width (range_y)
+static void BM_BlendSpan(benchmark::State& state)
+{
+  const int mode = state.range_x();
+  const int n = state.range_y();
+  std::vector<uint32_t> dst(n), src(n);
+  fill_pixels(dst, 1);
+  fill_pixels(src, 2);
+
+  while (state.KeepRunning()) {
+    rgba_span_blenders[mode](&dst[0], &src[0], n, 128, 0);
+    benchmark::DoNotOptimize(dst[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 4);
+}
+BENCHMARK(BM_BlendSpan)
+  ->ArgPair(BLEND_MODE_NORMAL, 64)
+  ->ArgPair(BLEND_MODE_NORMAL, 4096)
+  ->ArgPair(BLEND_MODE_COPY, 4096)
+  ->ArgPair(BLEND_MODE_MERGE, 4096)
+  ->ArgPair(BLEND_MODE_BLACKANDWHITE, 4096);
+
+// The same using the BLEND_COLOR function pixel by pixel
+static void BM_BlendPixels(benchmark::State& state)
+{
+  const int mode = state.range_x();
+  const int n = state.range_y();
+  std::vector<uint32_t> dst(n), src(n);
+  fill_pixels(dst, 1);
+  fill_pixels(src, 2);
+
+  BLEND_COLOR blender = rgba_blenders[mode];
+  while (state.KeepRunning()) {
+    for (int i=0; i<n; ++i)
+      dst[i] = blender(dst[i], src[i], 128);
+    benchmark::DoNotOptimize(dst[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 4);
+}
+BENCHMARK(BM_BlendPixels)
+  ->ArgPair(BLEND_MODE_NORMAL, 4096)
+  ->ArgPair(BLEND_MODE_MERGE, 4096);
+
+static void BM_BlendGrayPixels(benchmark::State& state)
+{
+  const int mode = state.range_x();
+  const int n = state.range_y();
+  std::vector<uint32_t> dst(n), src(n);
+  fill_pixels(dst, 1);
+  fill_pixels(src, 2);
+  for (int i=0; i<n; ++i) {
+    dst[i] &= 0xffff;
+    src[i] &= 0xffff;
+  }
+
+  BLEND_COLOR blender = graya_blenders[mode];
+  while (state.KeepRunning()) {
+    for (int i=0; i<n; ++i)
+      dst[i] = blender(dst[i], src[i], 128);
+    benchmark::DoNotOptimize(dst[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_BlendGrayPixels)
+  ->ArgPair(BLEND_MODE_NORMAL, 4096);
@@ -0,0 +1,68 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/blend.h"
+#include "doc/color.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+
+static uint32_t random_rgba()
+{
+  // Give more chances to the special alpha values (0 and 255)
+  int a;
+  switch (std::rand() % 4) {
+    case 0: a = 0; break;
+    case 1: a = 255; break;
+    default: a = std::rand() % 256; break;
+  }
+  return rgba(std::rand() % 256, std::rand() % 256, std::rand() % 256, a);
+}
+
+TEST(Blend, SpanBlendersMatchPixelBlenders)
+{
+  const int n = 1027;           // Not a multiple of the SIMD width
+  std::vector<uint32_t> back(n), front(n), expected(n), result(n);
+  int opacities[] = { 0, 1, 127, 128, 254, 255 };
+  uint32_t mask_colors[] = { 0, rgba(255, 0, 255, 255) };
+
+  std::srand(1);
+  for (int mode=0; mode<BLEND_MODE_MAX; ++mode) {
+    for (int opacity : opacities) {
+      for (uint32_t mask : mask_colors) {
+        for (int i=0; i<n; ++i) {
+          back[i] = random_rgba();
+          front[i] = (i % 7 == 0 ? mask: random_rgba());
+          expected[i] = (front[i] != mask ?
+                         (*rgba_blenders[mode])(back[i], front[i], opacity):
+                         back[i]);
+        }
+
+        result = back;
+        (*rgba_span_blenders[mode])(&result[0], &front[0], n, opacity, mask);
+
+        for (int i=0; i<n; ++i)
+          ASSERT_EQ(expected[i], result[i])
+            << "mode=" << mode << " opacity=" << opacity << " i=" << i
+            << " back=" << std::hex << back[i] << " front=" << front[i];
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
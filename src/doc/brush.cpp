@@ -10,17 +10,41 @@
 
 #include "doc/brush.h"
 
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
 #include "doc/algo.h"
 #include "doc/algorithm/polygon.h"
+#include "doc/compressed_image.h"
 #include "doc/image.h"
 #include "doc/primitives.h"
 
 #include <cmath>
+#include <map>
+#include <tuple>
 
 namespace doc {
 
 static int generation = 0;
 
+// Images (and scanlines) of the generated brushes, so changing the
+// size or angle of the brush back and forth doesn't generate the same
+// images again. The whole cache is cleared when it's full.
+namespace {
+
+  typedef std::tuple<int, int, int> BrushKey; // Type, size, angle
+
+  struct BrushCacheEntry {
+    ImageRef image;
+    base::SharedPtr<CompressedImage> compressedImage;
+  };
+
+  const std::size_t kMaxCachedBrushes = 512;
+
+  base::mutex brush_cache_mutex;
+  std::map<BrushKey, BrushCacheEntry> brush_cache;
+
+} // anonymous namespace
+
 Brush::Brush()
 {
   m_type = kCircleBrushType;
@@ -86,6 +110,7 @@ void Brush::setImage(const Image* image)
 {
   m_type = kImageBrushType;
   m_image.reset(Image::createCopy(image));
+  m_compressedImage.reset();
   m_bounds = gfx::Rect(
     -m_image.get()->width()/2, -m_image.get()->height()/2,
     m_image.get()->width(), m_image.get()->height());
@@ -96,6 +121,15 @@ void Brush::clean()
 {
   m_gen = ++generation;
   m_image.reset();
+  m_compressedImage.reset();
+}
+
+base::SharedPtr<CompressedImage> Brush::compressedImage() const
+{
+  if (!m_compressedImage && m_image)
+    m_compressedImage.reset(new CompressedImage(m_image.get(), false));
+
+  return m_compressedImage;
 }
 
 static void algo_hline(int x1, int y, int x2, void *data)
@@ -110,6 +144,27 @@ void Brush::regenerate()
 
   ASSERT(m_size > 0);
 
+  // Re-use the image of a brush with the same parameters
+  BrushKey key(int(m_type), m_size, m_angle);
+  {
+    base::scoped_lock lock(brush_cache_mutex);
+    auto it = brush_cache.find(key);
+    if (it != brush_cache.end()) {
+      m_image = it->second.image;
+      m_compressedImage = it->second.compressedImage;
+    }
+  }
+
+  if (!m_image)
+    generateImage();
+
+  m_bounds = gfx::Rect(
+    -m_image->width()/2, -m_image->height()/2,
+    m_image->width(), m_image->height());
+}
+
+void Brush::generateImage()
+{
   int size = m_size;
   if (m_type == kSquareBrushType && m_angle != 0 && m_size > 2)
     size = (int)std::sqrt((double)2*m_size*m_size)+2;
@@ -166,9 +221,15 @@ void Brush::regenerate()
     }
   }
 
-  m_bounds = gfx::Rect(
-    -m_image->width()/2, -m_image->height()/2,
-    m_image->width(), m_image->height());
+  m_compressedImage.reset(new CompressedImage(m_image.get(), false));
+
+  base::scoped_lock lock(brush_cache_mutex);
+  if (brush_cache.size() >= kMaxCachedBrushes)
+    brush_cache.clear();
+
+  BrushCacheEntry& entry = brush_cache[BrushKey(int(m_type), m_size, m_angle)];
+  entry.image = m_image;
+  entry.compressedImage = m_compressedImage;
 }
 
 } // namespace doc
@@ -18,6 +18,8 @@
 
 namespace doc {
 
+  class CompressedImage;
+
   class Brush {
   public:
     static const int kMinBrushSize = 1;
@@ -39,6 +41,11 @@ namespace doc {
 
     const gfx::Rect& bounds() const { return m_bounds; }
 
+    // Returns the scanlines of the brush image to stamp it. For
+    // generated brushes they are shared between all brushes with the
+    // same type, size, and angle.
+    base::SharedPtr<CompressedImage> compressedImage() const;
+
     void setType(BrushType type);
     void setSize(int size);
     void setAngle(int angle);
@@ -53,11 +60,13 @@ namespace doc {
   private:
     void clean();
     void regenerate();
+    void generateImage();
 
     BrushType m_type;                     // Type of brush
     int m_size;                           // Size (diameter)
     int m_angle;                          // Angle in degrees 0-360
     ImageRef m_image;                     // Image of the brush
+    mutable base::SharedPtr<CompressedImage> m_compressedImage;
     gfx::Rect m_bounds;
     BrushPattern m_pattern;               // How the image should be replicated
     gfx::Point m_patternOrigin;           // From what position the brush was taken
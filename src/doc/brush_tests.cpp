@@ -0,0 +1,64 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/brush.h"
+#include "doc/compressed_image.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+using namespace doc;
+
+TEST(Brush, SameParametersShareImage)
+{
+  Brush a(kCircleBrushType, 17, 0);
+  Brush b(kSquareBrushType, 17, 30);
+  b.setType(kCircleBrushType);
+  b.setAngle(0);
+
+  EXPECT_EQ(a.image(), b.image());
+  EXPECT_EQ(a.compressedImage().get(), b.compressedImage().get());
+  EXPECT_EQ(a.bounds(), b.bounds());
+
+  // A different generation is used to know that the brush changed
+  EXPECT_NE(a.gen(), b.gen());
+
+  b.setSize(16);
+  EXPECT_NE(a.image(), b.image());
+  EXPECT_EQ(16, b.image()->width());
+}
+
+TEST(Brush, CompressedImage)
+{
+  for (int type=kCircleBrushType; type<=kLineBrushType; ++type) {
+    Brush brush(BrushType(type), 13, 45);
+    const Image* image = brush.image();
+
+    int pixels = 0;
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        pixels += (get_pixel(image, x, y) ? 1: 0);
+
+    int scanlinePixels = 0;
+    for (const auto& scanline : *brush.compressedImage()) {
+      for (int x=scanline.x; x<scanline.x+scanline.w; ++x)
+        EXPECT_NE(0, get_pixel(image, x, scanline.y));
+      scanlinePixels += scanline.w;
+    }
+    EXPECT_EQ(pixels, scanlinePixels);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -44,6 +44,17 @@ Cel* Cel::createCopy(const Cel* other)
   return cel;
 }
 
+// static
+Cel* Cel::createSharedCopy(const Cel* other)
+{
+  Cel* cel = new Cel(other->frame(),
+    ImageRef(Image::createSharedCopy(other->image())));
+
+  cel->setPosition(other->position());
+  cel->setOpacity(other->opacity());
+  return cel;
+}
+
 // static
 Cel* Cel::createLink(const Cel* other)
 {
@@ -60,6 +71,9 @@ void Cel::setDataRef(const CelDataRef& celData)
 {
   ASSERT(celData);
   m_data = celData;
+
+  if (m_layer && m_layer->sprite())
+    m_layer->sprite()->indexCel(this);
 }
 
 void Cel::setPosition(int x, int y)
@@ -128,12 +142,11 @@ std::size_t Cel::links() const
 
 gfx::Rect Cel::bounds() const
 {
-  Image* image = this->image();
-  ASSERT(image);
-  if (image)
-    return gfx::Rect(
-      position().x, position().y,
-      image->width(), image->height());
+  // The size is known without loading the image
+  gfx::Size size = m_data->imageSize();
+  ASSERT(size.w > 0 && size.h > 0);
+  if (size.w > 0 && size.h > 0)
+    return gfx::Rect(position(), size);
   else
     return gfx::Rect();
 }
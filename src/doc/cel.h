@@ -28,6 +28,9 @@ namespace doc {
     Cel(frame_t frame, const CelDataRef& celData);
 
     static Cel* createCopy(const Cel* other);
+    // Same as createCopy() but the image shares the pixels with the
+    // original one (see Image::createSharedCopy()).
+    static Cel* createSharedCopy(const Cel* other);
     static Cel* createLink(const Cel* other);
 
     frame_t frame() const { return m_frame; }
@@ -65,6 +68,10 @@ namespace doc {
   private:
     void fixupImage();
 
+    // LayerImage can renumber its cels directly when the order of
+    // the cels doesn't change (see LayerImage::displaceFrames()).
+    friend class LayerImage;
+
     LayerImage* m_layer;
     frame_t m_frame;            // Frame position
     CelDataRef m_data;
@@ -10,6 +10,8 @@
 
 #include "doc/cel_data.h"
 
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
 #include "gfx/rect.h"
 #include "doc/image.h"
 #include "doc/layer.h"
@@ -17,9 +19,16 @@
 
 namespace doc {
 
+// Images are loaded one at a time (render threads can ask for the
+// image of the same cel).
+static base::mutex g_loadMutex;
+
 CelData::CelData(const ImageRef& image)
   : Object(ObjectType::CelData)
   , m_image(image)
+  , m_imagePtr(image.get())
+  , m_imageId(0)
+  , m_imageVersion(0)
   , m_position(0, 0)
   , m_opacity(255)
 {
@@ -28,16 +37,92 @@ CelData::CelData(const ImageRef& image)
 CelData::CelData(const CelData& celData)
   : Object(ObjectType::CelData)
   , m_image(celData.m_image)
+  , m_imagePtr(celData.m_image.get())
+  , m_loader(celData.m_loader)
+  , m_imageId(celData.m_imageId)
+  , m_imageVersion(celData.m_imageVersion)
   , m_position(celData.m_position)
   , m_opacity(celData.m_opacity)
 {
 }
 
+CelData::CelData(const ImageLoaderRef& loader)
+  : Object(ObjectType::CelData)
+  , m_imagePtr(nullptr)
+  , m_loader(loader)
+  , m_imageId(0)
+  , m_imageVersion(0)
+  , m_position(0, 0)
+  , m_opacity(255)
+{
+  ASSERT(loader);
+}
+
+gfx::Size CelData::imageSize() const
+{
+  if (Image* image = m_imagePtr)
+    return gfx::Size(image->width(), image->height());
+  else if (m_loader)
+    return m_loader->imageSize();
+  else
+    return gfx::Size(0, 0);
+}
+
 void CelData::setImage(const ImageRef& image)
 {
   ASSERT(image.get());
 
   m_image = image;
+  m_imagePtr = image.get();
+
+  // The new image cannot be loaded from the old source
+  m_loader.reset();
+}
+
+bool CelData::unloadImage()
+{
+  if (!m_loader || !m_image || !m_image.unique() ||
+      m_image->version() != m_imageVersion)
+    return false;
+
+  // The same ID is used when the image is loaded again (so it's the
+  // same object for undo commands, backups, etc.)
+  m_imageId = m_image->id();
+  m_imagePtr = nullptr;
+  m_image.reset();
+  return true;
+}
+
+Image* CelData::loadImage() const
+{
+  base::scoped_lock hold(g_loadMutex);
+
+  // Other thread could load the image while we were waiting
+  if (Image* image = m_imagePtr)
+    return image;
+
+  if (!m_loader)
+    return nullptr;
+
+  ImageRef image(m_loader->loadImage());
+  if (!image)
+    return nullptr;
+
+  if (m_imageId) {
+    image->setId(m_imageId);
+    image->setVersion(m_imageVersion);
+  }
+  else {
+    // Loaded images start with version 1 (so the crash backup doesn't
+    // need to change the version to save them, and they can still be
+    // unloaded after that)
+    image->incrementVersion();
+    m_imageVersion = image->version();
+  }
+
+  m_image = image;
+  m_imagePtr = image.get();
+  return image.get();
 }
 
 } // namespace doc
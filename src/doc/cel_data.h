@@ -9,9 +9,12 @@
 #pragma once
 
 #include "base/shared_ptr.h"
+#include "doc/image_loader.h"
 #include "doc/image_ref.h"
 #include "doc/object.h"
 
+#include <atomic>
+
 namespace doc {
 
   class CelData : public Object {
@@ -19,12 +22,39 @@ namespace doc {
     CelData(const ImageRef& image);
     CelData(const CelData& celData);
 
+    // Creates a cel data which image is loaded the first time that
+    // it's used.
+    CelData(const ImageLoaderRef& loader);
+
     const gfx::Point& position() const { return m_position; }
     int opacity() const { return m_opacity; }
-    Image* image() const { return const_cast<Image*>(m_image.get()); };
-    ImageRef imageRef() const { return m_image; }
+    Image* image() const {
+      Image* image = m_imagePtr;
+      return (image ? image: loadImage());
+    }
+    ImageRef imageRef() const {
+      image();
+      return m_image;
+    }
+    gfx::Size imageSize() const;
+
+    // ID of the image without loading it (0 if it's an image that
+    // was never loaded, nobody can know its ID yet).
+    ObjectId imageId() const {
+      Image* image = m_imagePtr;
+      return (image ? image->id(): m_imageId);
+    }
 
     void setImage(const ImageRef& image);
+
+    // Returns true if the image is in memory.
+    bool isImageLoaded() const { return m_imagePtr != nullptr; }
+
+    // Releases the image if it can be loaded again from the
+    // ImageLoader (i.e. it wasn't modified and nobody else references
+    // it). It must not be called while other threads could be using
+    // the image.
+    bool unloadImage();
     void setPosition(int x, int y) {
       m_position.x = x;
       m_position.y = y;
@@ -33,12 +63,17 @@ namespace doc {
     void setOpacity(int opacity) { m_opacity = opacity; }
 
     virtual int getMemSize() const override {
-      ASSERT(m_image);
-      return sizeof(CelData) + m_image->getMemSize();
+      return sizeof(CelData) + (m_image ? m_image->getMemSize(): 0);
     }
 
   private:
-    ImageRef m_image;
+    Image* loadImage() const;
+
+    mutable ImageRef m_image;
+    mutable std::atomic<Image*> m_imagePtr; // Same as m_image.get()
+    ImageLoaderRef m_loader;
+    mutable ObjectId m_imageId;             // ID/version of unloaded image
+    mutable ObjectVersion m_imageVersion;
     gfx::Point m_position;      // X/Y screen position
     int m_opacity;              // Opacity level
   };
@@ -0,0 +1,98 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/cel_data.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+using namespace doc;
+
+class TestLoader : public ImageLoader {
+public:
+  TestLoader() : loads(0) { }
+
+  gfx::Size imageSize() const override {
+    return gfx::Size(4, 3);
+  }
+
+  Image* loadImage() override {
+    ++loads;
+    Image* image = Image::create(IMAGE_INDEXED, 4, 3);
+    clear_image(image, 7);
+    return image;
+  }
+
+  int loads;
+};
+
+TEST(CelData, LoadImageWhenNeeded)
+{
+  TestLoader* loader = new TestLoader;
+  CelData data((ImageLoaderRef(loader)));
+
+  EXPECT_FALSE(data.isImageLoaded());
+  EXPECT_EQ(gfx::Size(4, 3), data.imageSize());
+  EXPECT_EQ(0, loader->loads);
+
+  Image* image = data.image();
+  ASSERT_TRUE(image != nullptr);
+  EXPECT_TRUE(data.isImageLoaded());
+  EXPECT_EQ(7, get_pixel(image, 0, 0));
+  EXPECT_EQ(image, data.image());
+  EXPECT_EQ(1, loader->loads);
+}
+
+TEST(CelData, UnloadImage)
+{
+  TestLoader* loader = new TestLoader;
+  CelData data((ImageLoaderRef(loader)));
+
+  ObjectId id = data.image()->id();
+  EXPECT_TRUE(data.unloadImage());
+  EXPECT_FALSE(data.isImageLoaded());
+  EXPECT_EQ(0, data.getMemSize() - int(sizeof(CelData)));
+
+  // Same object ID when it's loaded again
+  EXPECT_EQ(id, data.image()->id());
+  EXPECT_EQ(2, loader->loads);
+
+  // Referenced images cannot be unloaded
+  {
+    ImageRef ref = data.imageRef();
+    EXPECT_FALSE(data.unloadImage());
+  }
+
+  // Modified images cannot be unloaded
+  data.image()->incrementVersion();
+  EXPECT_FALSE(data.unloadImage());
+  EXPECT_TRUE(data.isImageLoaded());
+}
+
+TEST(CelData, ImagesWithoutLoaderCannotBeUnloaded)
+{
+  CelData data(ImageRef(Image::create(IMAGE_RGB, 2, 2)));
+  EXPECT_TRUE(data.isImageLoaded());
+  EXPECT_FALSE(data.unloadImage());
+
+  TestLoader* loader = new TestLoader;
+  ImageLoaderRef loaderRef(loader);
+  CelData data2(loaderRef);
+  data2.setImage(ImageRef(Image::create(IMAGE_INDEXED, 4, 3)));
+  EXPECT_FALSE(data2.unloadImage());
+  EXPECT_EQ(0, loader->loads);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,15 +8,17 @@
 #define DOC_CEL_LIST_H_INCLUDED
 #pragma once
 
-#include <list>
+#include <vector>
 
 namespace doc {
 
   class Cel;
 
-  typedef std::list<Cel*> CelList;
-  typedef std::list<Cel*>::iterator CelIterator;
-  typedef std::list<Cel*>::const_iterator CelConstIterator;
+  // LayerImage keeps its cels in a CelList sorted by frame, so a cel
+  // can be found with a binary search.
+  typedef std::vector<Cel*> CelList;
+  typedef CelList::iterator CelIterator;
+  typedef CelList::const_iterator CelConstIterator;
 
 } // namespace doc
 
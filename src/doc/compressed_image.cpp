@@ -10,39 +10,111 @@
 
 #include "doc/compressed_image.h"
 
-#include "doc/primitives.h"
+#include "doc/image_traits.h"
 
 namespace doc {
 
-CompressedImage::CompressedImage(const Image* image, bool diffColors)
-  : m_image(image)
+namespace {
+
+// Generates the scanlines walking the raw rows of the image
+template<typename ImageTraits>
+void create_scanlines(const Image* image, bool diffColors,
+                      CompressedImage::Scanlines& scanlines)
 {
-  color_t c1, c2, mask = image->maskColor();
+  typedef typename ImageTraits::pixel_t pixel_t;
+  const pixel_t mask = pixel_t(image->maskColor());
+  const int w = image->width();
 
   for (int y=0; y<image->height(); ++y) {
-    Scanline scanline(y);
+    const pixel_t* row = (const pixel_t*)image->getPixelAddress(0, y);
+    CompressedImage::Scanline scanline(y);
+
+    for (int x=0; x<w; ) {
+      const pixel_t c = row[x];
+      if (c == mask) {
+        ++x;
+        continue;
+      }
+
+      scanline.color = c;
+      scanline.x = x;
 
-    for (int x=0; x<image->width(); ) {
-      c1 = get_pixel(image, x, y);
-      if (c1 != mask) {
-        scanline.color = c1;
-        scanline.x = x;
+      if (diffColors)
+        for (++x; x<w && row[x] == c; ++x)
+          ;
+      else
+        for (++x; x<w && row[x] != mask; ++x)
+          ;
 
-        for (++x; x<image->width(); ++x) {
-          c2 = get_pixel(image, x, y);
+      scanline.w = x - scanline.x;
+      scanlines.push_back(scanline);
+    }
+  }
+}
 
-          if ((diffColors && c1 != c2) ||
-              (!diffColors && c2 == mask))
-            break;
-        }
+// Bitmaps only have two colors, so both modes are the same and whole
+// bytes are skipped/included at once.
+template<>
+void create_scanlines<BitmapTraits>(const Image* image, bool diffColors,
+                                    CompressedImage::Scanlines& scanlines)
+{
+  const bool maskBit = (image->maskColor() != 0);
+  const uint8_t skip = (maskBit ? 0xff: 0);
+  const int w = image->width();
+
+  for (int y=0; y<image->height(); ++y) {
+    const uint8_t* row = image->getPixelAddress(0, y);
+    CompressedImage::Scanline scanline(y);
+    scanline.color = (maskBit ? 0: 1);
 
-        scanline.w = x - scanline.x;
-        m_scanlines.push_back(scanline);
+    for (int x=0; x<w; ) {
+      if ((x % 8) == 0 && row[x/8] == skip) {
+        x += 8;
+        continue;
       }
-      else
+      if (bool(row[x/8] & (1 << (x % 8))) == maskBit) {
         ++x;
+        continue;
+      }
+
+      scanline.x = x;
+      for (++x; x<w; ) {
+        if ((x % 8) == 0 && x+8 <= w && row[x/8] == uint8_t(~skip))
+          x += 8;
+        else if (bool(row[x/8] & (1 << (x % 8))) != maskBit)
+          ++x;
+        else
+          break;
+      }
+
+      scanline.w = x - scanline.x;
+      scanlines.push_back(scanline);
     }
   }
 }
 
+} // anonymous namespace
+
+CompressedImage::CompressedImage(const Image* image, bool diffColors)
+  : m_image(image)
+{
+  // At least one scanline for each row is expected (e.g. brushes)
+  m_scanlines.reserve(image->height());
+
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+      create_scanlines<RgbTraits>(image, diffColors, m_scanlines);
+      break;
+    case IMAGE_GRAYSCALE:
+      create_scanlines<GrayscaleTraits>(image, diffColors, m_scanlines);
+      break;
+    case IMAGE_INDEXED:
+      create_scanlines<IndexedTraits>(image, diffColors, m_scanlines);
+      break;
+    case IMAGE_BITMAP:
+      create_scanlines<BitmapTraits>(image, diffColors, m_scanlines);
+      break;
+  }
+}
+
 } // namespace doc
@@ -0,0 +1,99 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/compressed_image.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <iterator>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// Returns the scanlines calculated pixel by pixel
+std::vector<CompressedImage::Scanline> reference_scanlines(const Image* image, bool diffColors)
+{
+  std::vector<CompressedImage::Scanline> result;
+  color_t mask = image->maskColor();
+
+  for (int y=0; y<image->height(); ++y) {
+    CompressedImage::Scanline scanline(y);
+    for (int x=0; x<image->width(); ) {
+      color_t c = get_pixel(image, x, y);
+      if (c == mask) {
+        ++x;
+        continue;
+      }
+      scanline.x = x;
+      scanline.color = c;
+      for (++x; x<image->width(); ++x) {
+        color_t c2 = get_pixel(image, x, y);
+        if ((diffColors && c2 != c) || (!diffColors && c2 == mask))
+          break;
+      }
+      scanline.w = x - scanline.x;
+      result.push_back(scanline);
+    }
+  }
+  return result;
+}
+
+} // anonymous namespace
+
+TEST(CompressedImage, SameAsPixelByPixel)
+{
+  const PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+
+  std::srand(3);
+  for (PixelFormat format : formats) {
+    for (int w=1; w<40; w+=7) {
+      ImageRef image(Image::create(format, w, 9));
+      for (int y=0; y<image->height(); ++y) {
+        for (int x=0; x<image->width(); ++x) {
+          // Rows with long runs of the same color and mostly full rows
+          int r = std::rand() % 8;
+          color_t c = (y % 3 == 0 ? (x > 2): (r < 2 ? 0: (r < 6 ? 1: 2)));
+          if (format == IMAGE_BITMAP)
+            c = (c ? 1: 0);
+          put_pixel(image.get(), x, y, c);
+        }
+      }
+
+      for (int diff=0; diff<2; ++diff) {
+        CompressedImage compressed(image.get(), diff == 1);
+        auto expected = reference_scanlines(image.get(), diff == 1);
+
+        ASSERT_EQ(int(expected.size()), int(std::distance(compressed.begin(), compressed.end())))
+          << "format=" << format << " w=" << w << " diff=" << diff;
+
+        auto it = compressed.begin();
+        for (const auto& scanline : expected) {
+          EXPECT_EQ(scanline.x, it->x);
+          EXPECT_EQ(scanline.y, it->y);
+          EXPECT_EQ(scanline.w, it->w);
+          EXPECT_EQ(scanline.color, it->color);
+          ++it;
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
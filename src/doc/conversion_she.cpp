@@ -22,8 +22,15 @@
 #include "she/surface_format.h"
 #include "she/scoped_surface_lock.h"
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_CONVERSION_SSE2
+  #include <emmintrin.h>
+#endif
+
 namespace doc {
 
 namespace {
@@ -131,6 +138,124 @@ void convert_image_to_surface_selector(const Image* image, she::LockedSurface* s
   }
 }
 
+// Returns true if the 32bpp surface format has the same layout as
+// doc::rgba() colors.
+bool is_rgba_layout(const she::SurfaceFormatData* fd)
+{
+  return (fd->bitsPerPixel == 32 &&
+          fd->redShift == rgba_r_shift &&
+          fd->greenShift == rgba_g_shift &&
+          fd->blueShift == rgba_b_shift &&
+          fd->alphaShift == rgba_a_shift &&
+          fd->redMask == rgba_r_mask &&
+          fd->greenMask == rgba_g_mask &&
+          fd->blueMask == rgba_b_mask &&
+          fd->alphaMask == rgba_a_mask);
+}
+
+// Returns true if the 32bpp surface format is the doc::rgba() layout
+// with the red and blue channels swapped (BGRA).
+bool is_bgra_layout(const she::SurfaceFormatData* fd)
+{
+  return (fd->bitsPerPixel == 32 &&
+          fd->redShift == rgba_b_shift &&
+          fd->greenShift == rgba_g_shift &&
+          fd->blueShift == rgba_r_shift &&
+          fd->alphaShift == rgba_a_shift &&
+          fd->redMask == rgba_b_mask &&
+          fd->greenMask == rgba_g_mask &&
+          fd->blueMask == rgba_r_mask &&
+          fd->alphaMask == rgba_a_mask);
+}
+
+// Swaps the red and blue channels of "n" pixels.
+void swap_red_and_blue(const uint32_t* src, uint32_t* dst, int n)
+{
+  int i = 0;
+#ifdef DOC_CONVERSION_SSE2
+  const __m128i ga_mask = _mm_set1_epi32(rgba_g_mask | rgba_a_mask);
+  const __m128i rb_mask = _mm_set1_epi32(rgba_r_mask | rgba_b_mask);
+  for (; i+4<=n; i+=4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+    __m128i rb = _mm_and_si128(v, rb_mask);
+    rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+    _mm_storeu_si128((__m128i*)(dst+i),
+                     _mm_or_si128(_mm_and_si128(v, ga_mask), rb));
+  }
+#endif
+  for (; i<n; ++i) {
+    uint32_t c = src[i];
+    uint32_t rb = c & (rgba_r_mask | rgba_b_mask);
+    dst[i] = (c & (rgba_g_mask | rgba_a_mask)) | (rb << 16) | (rb >> 16);
+  }
+}
+
+// Converts rows of RGB, Grayscale, and Indexed images to 32bpp
+// surfaces without the generic per-pixel conversion (copying,
+// swizzling, or using a table of surface colors). Returns false if
+// there is no fast path for the given formats.
+bool convert_image_to_surface32(const Image* image, she::LockedSurface* dst,
+  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const she::SurfaceFormatData* fd)
+{
+  if (fd->bitsPerPixel != 32)
+    return false;
+
+  switch (image->pixelFormat()) {
+
+    case IMAGE_RGB:
+      if (is_rgba_layout(fd)) {
+        for (int v=0; v<h; ++v)
+          std::memcpy(dst->getData(dst_x, dst_y+v),
+                      image->getPixelAddress(src_x, src_y+v),
+                      4*w);
+        return true;
+      }
+      else if (is_bgra_layout(fd)) {
+        for (int v=0; v<h; ++v)
+          swap_red_and_blue((const uint32_t*)image->getPixelAddress(src_x, src_y+v),
+                            (uint32_t*)dst->getData(dst_x, dst_y+v), w);
+        return true;
+      }
+      break;
+
+    case IMAGE_GRAYSCALE: {
+      // Surface colors for each gray value and alpha
+      uint32_t values[256], alphas[256];
+      for (int i=0; i<256; ++i) {
+        values[i] = convert_color_to_surface<GrayscaleTraits, she::kRgbaSurfaceFormat>(graya(i, 0), palette, fd);
+        alphas[i] = convert_color_to_surface<GrayscaleTraits, she::kRgbaSurfaceFormat>(graya(0, i), palette, fd);
+      }
+
+      for (int v=0; v<h; ++v) {
+        const GrayscaleTraits::pixel_t* src = (GrayscaleTraits::address_t)image->getPixelAddress(src_x, src_y+v);
+        uint32_t* dst_address = (uint32_t*)dst->getData(dst_x, dst_y+v);
+        for (int u=0; u<w; ++u, ++src)
+          dst_address[u] = values[graya_getv(*src)] | alphas[graya_geta(*src)];
+      }
+      return true;
+    }
+
+    case IMAGE_INDEXED: {
+      // Surface colors for each palette entry
+      uint32_t colors[256];
+      int n = std::min(256, palette->size());
+      for (int i=0; i<n; ++i)
+        colors[i] = convert_color_to_surface<IndexedTraits, she::kRgbaSurfaceFormat>(i, palette, fd);
+      std::fill(colors+n, colors+256, 0);
+
+      for (int v=0; v<h; ++v) {
+        const IndexedTraits::pixel_t* src = (IndexedTraits::address_t)image->getPixelAddress(src_x, src_y+v);
+        uint32_t* dst_address = (uint32_t*)dst->getData(dst_x, dst_y+v);
+        for (int u=0; u<w; ++u)
+          dst_address[u] = colors[src[u]];
+      }
+      return true;
+    }
+  }
+
+  return false;
+}
+
 } // anonymous namespace
 
 void convert_image_to_surface(const Image* image, const Palette* palette,
@@ -162,6 +287,9 @@ void convert_image_to_surface(const Image* image, const Palette* palette,
   she::SurfaceFormatData fd;
   dst->getFormat(&fd);
 
+  if (convert_image_to_surface32(image, dst, src_x, src_y, dst_x, dst_y, w, h, palette, &fd))
+    return;
+
   switch (image->pixelFormat()) {
 
     case IMAGE_RGB:
@@ -186,4 +314,27 @@ void convert_image_to_surface(const Image* image, const Palette* palette,
   }
 }
 
+Image* create_image_from_surface(she::LockedSurface* surface,
+                                 const gfx::Rect& rc)
+{
+  she::SurfaceFormatData fd;
+  surface->getFormat(&fd);
+  if (!is_rgba_layout(&fd) || rc.isEmpty())
+    return NULL;
+
+  // Rows must be at the same distance in memory
+  uint8_t* bits = surface->getData(rc.x, rc.y);
+  std::ptrdiff_t rowStride = 0;
+  if (rc.h > 1) {
+    rowStride = surface->getData(rc.x, rc.y+1) - bits;
+    if (rowStride < 4*rc.w ||
+        surface->getData(rc.x, rc.y+rc.h-1) != bits + rowStride*(rc.h-1))
+      return NULL;
+  }
+  else
+    rowStride = 4*rc.w;
+
+  return Image::createFromMemory(IMAGE_RGB, rc.w, rc.h, bits, int(rowStride));
+}
+
 } // namespace doc
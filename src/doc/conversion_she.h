@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -8,7 +8,10 @@
 #define DOC_CONVERSION_SHE_H_INCLUDED
 #pragma once
 
+#include "gfx/fwd.h"
+
 namespace she {
+  class LockedSurface;
   class Surface;
 }
 
@@ -20,6 +23,14 @@ namespace doc {
     she::Surface* surface,
     int src_x, int src_y, int dst_x, int dst_y, int w, int h);
 
+  // Returns an IMAGE_RGB image that uses the pixels of the "rc" area
+  // of the locked surface (so an image can be rendered directly in
+  // the surface without a conversion), or NULL if the surface
+  // format is not the same as doc::rgba() colors. The surface must
+  // be locked while the image is used.
+  Image* create_image_from_surface(she::LockedSurface* surface,
+                                   const gfx::Rect& rc);
+
 } // namespace doc
 
 #endif
@@ -14,6 +14,7 @@ namespace doc {
   enum class DitheringMethod {
     NONE,
     ORDERED,
+    ERROR_DIFFUSION,            // Floyd-Steinberg
   };
 
 } // namespace doc
@@ -55,6 +55,11 @@ namespace doc {
     virtual void onSpritePixelsModified(DocumentEvent& ev) { }
     virtual void onExposeSpritePixels(DocumentEvent& ev) { }
 
+    // The extra content displayed over the sprite (e.g. the brush
+    // preview) was modified in the given region, but the sprite
+    // pixels weren't modified.
+    virtual void onExtraCelModified(DocumentEvent& ev) { }
+
     // When the number of total frames available is modified.
     virtual void onTotalFramesChanged(DocumentEvent& ev) { }
 
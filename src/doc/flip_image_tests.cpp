@@ -0,0 +1,108 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/flip_image.h"
+#include "doc/color.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "gfx/rect.h"
+
+using namespace doc;
+
+namespace {
+
+// Sizes that aren't multiple of the SIMD registers or the rotation
+// blocks
+const int kW = 147;
+const int kH = 71;
+
+ImageRef create_test_image(PixelFormat format)
+{
+  ImageRef image(Image::create(format, kW, kH));
+  for (int y=0; y<kH; ++y)
+    for (int x=0; x<kW; ++x)
+      put_pixel(image.get(), x, y,
+        (format == IMAGE_BITMAP ? (x*y+x) % 3 == 0:
+                                  (x*7919 + y*104729) & 0xffffff));
+  return image;
+}
+
+const PixelFormat kFormats[] = {
+  IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP
+};
+
+} // anonymous namespace
+
+TEST(FlipImage, Horizontal)
+{
+  const gfx::Rect bounds(3, 2, kW-10, kH-4);
+
+  for (PixelFormat format : kFormats) {
+    ImageRef src = create_test_image(format);
+    ImageRef dst(Image::createCopy(src.get()));
+    algorithm::flip_image(dst.get(), bounds, algorithm::FlipHorizontal);
+
+    for (int y=0; y<kH; ++y)
+      for (int x=0; x<kW; ++x) {
+        int u = (bounds.contains(gfx::Point(x, y)) ? bounds.x2()-1-(x-bounds.x): x);
+        ASSERT_EQ(get_pixel(src.get(), u, y), get_pixel(dst.get(), x, y))
+          << "Format " << format << " pixel " << x << "," << y;
+      }
+  }
+}
+
+TEST(FlipImage, Vertical)
+{
+  const gfx::Rect bounds(5, 1, kW-7, kH-2);
+
+  for (PixelFormat format : kFormats) {
+    ImageRef src = create_test_image(format);
+    ImageRef dst(Image::createCopy(src.get()));
+    algorithm::flip_image(dst.get(), bounds, algorithm::FlipVertical);
+
+    for (int y=0; y<kH; ++y)
+      for (int x=0; x<kW; ++x) {
+        int v = (bounds.contains(gfx::Point(x, y)) ? bounds.y2()-1-(y-bounds.y): y);
+        ASSERT_EQ(get_pixel(src.get(), x, v), get_pixel(dst.get(), x, y))
+          << "Format " << format << " pixel " << x << "," << y;
+      }
+  }
+}
+
+TEST(RotateImage, Angles)
+{
+  for (PixelFormat format : kFormats) {
+    ImageRef src = create_test_image(format);
+
+    for (int angle : { 90, -90, 180 }) {
+      ImageRef dst(angle == 180 ? Image::create(format, kW, kH):
+                                  Image::create(format, kH, kW));
+      rotate_image(src.get(), dst.get(), angle);
+
+      for (int y=0; y<kH; ++y)
+        for (int x=0; x<kW; ++x) {
+          gfx::Point pt = (angle == 90 ? gfx::Point(kH-y-1, x):
+                           angle == -90 ? gfx::Point(y, kW-x-1):
+                                          gfx::Point(kW-x-1, kH-y-1));
+          ASSERT_EQ(get_pixel(src.get(), x, y), get_pixel(dst.get(), pt.x, pt.y))
+            << "Format " << format << " angle " << angle << " pixel " << x << "," << y;
+        }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,149 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/floodfill.h"
+#include "doc/color.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "gfx/rect.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// Counts how many times each pixel is filled
+struct Counter {
+  gfx::Rect bounds;
+  std::vector<int> count;
+
+  Counter(const gfx::Rect& bounds)
+    : bounds(bounds)
+    , count(bounds.w*bounds.h, 0) {
+  }
+
+  int& operator()(int x, int y) {
+    return count[(y-bounds.y)*bounds.w + (x-bounds.x)];
+  }
+
+  static void hline(int x1, int y, int x2, void* data) {
+    Counter* counter = (Counter*)data;
+    for (int x=x1; x<=x2; ++x)
+      ++(*counter)(x, y);
+  }
+};
+
+// Pixel-by-pixel 4-connected flood fill
+void reference_fill(const Image* image, int x, int y,
+                    const gfx::Rect& bounds, int tolerance,
+                    Counter& result)
+{
+  color_t color = get_pixel(image, x, y);
+  std::vector<gfx::Point> stack(1, gfx::Point(x, y));
+
+  while (!stack.empty()) {
+    gfx::Point pt = stack.back();
+    stack.pop_back();
+
+    if (!bounds.contains(pt) || result(pt.x, pt.y))
+      continue;
+
+    if (std::abs(int(get_pixel(image, pt.x, pt.y)) - int(color)) > tolerance)
+      continue;
+
+    result(pt.x, pt.y) = 1;
+    stack.push_back(gfx::Point(pt.x-1, pt.y));
+    stack.push_back(gfx::Point(pt.x+1, pt.y));
+    stack.push_back(gfx::Point(pt.x, pt.y-1));
+    stack.push_back(gfx::Point(pt.x, pt.y+1));
+  }
+}
+
+} // anonymous namespace
+
+TEST(FloodFill, Contiguous)
+{
+  std::srand(2);
+
+  ImageRef image(Image::create(IMAGE_INDEXED, 77, 41));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image.get(), x, y, (std::rand() % 10) < 6 ? 1: std::rand() % 4);
+
+  const gfx::Rect boundsList[] = {
+    image->bounds(),
+    gfx::Rect(3, 5, 40, 30),
+    gfx::Rect(17, 0, 9, 41),
+  };
+
+  for (const gfx::Rect& bounds : boundsList) {
+    for (int tolerance=0; tolerance<3; ++tolerance) {
+      for (int i=0; i<10; ++i) {
+        int x = bounds.x + (std::rand() % bounds.w);
+        int y = bounds.y + (std::rand() % bounds.h);
+
+        Counter expected(bounds), result(bounds);
+        reference_fill(image.get(), x, y, bounds, tolerance, expected);
+        algorithm::floodfill(image.get(), x, y, bounds, tolerance, true,
+                             &result, &Counter::hline);
+
+        EXPECT_EQ(expected.count, result.count)
+          << "seed " << x << "," << y << " tolerance " << tolerance;
+      }
+    }
+  }
+}
+
+TEST(FloodFill, NonContiguous)
+{
+  ImageRef image(Image::create(IMAGE_INDEXED, 45, 7));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image.get(), x, y, (x*y) % 5);
+
+  gfx::Rect bounds(2, 1, 40, 5);
+  Counter result(bounds);
+  algorithm::floodfill(image.get(), 3, 2, bounds, 1, false,
+                       &result, &Counter::hline);
+
+  color_t color = get_pixel(image.get(), 3, 2);
+  for (int y=bounds.y; y<bounds.y2(); ++y)
+    for (int x=bounds.x; x<bounds.x2(); ++x)
+      EXPECT_EQ(std::abs(int(get_pixel(image.get(), x, y)) - int(color)) <= 1 ? 1: 0,
+                result(x, y)) << x << "," << y;
+}
+
+TEST(FloodFill, TransparentPixels)
+{
+  // Transparent pixels are equal even with different RGB values
+  ImageRef image(Image::create(IMAGE_RGB, 20, 3));
+  clear_image(image.get(), rgba(255, 0, 0, 255));
+  for (int x=0; x<image->width(); ++x)
+    put_pixel(image.get(), x, 1, rgba(x, 2*x, 3*x, 0));
+
+  Counter result(image->bounds());
+  algorithm::floodfill(image.get(), 0, 1, image->bounds(), 0, true,
+                       &result, &Counter::hline);
+
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      EXPECT_EQ(y == 1 ? 1: 0, result(x, y)) << x << "," << y;
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
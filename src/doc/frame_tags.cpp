@@ -10,6 +10,7 @@
 
 #include "doc/frame_tags.h"
 
+#include "base/scoped_lock.h"
 #include "doc/frame_tag.h"
 
 #include <algorithm>
@@ -18,6 +19,7 @@ namespace doc {
 
 FrameTags::FrameTags(Sprite* sprite)
   : m_sprite(sprite)
+  , m_hasSegments(false)
 {
 }
 
@@ -38,6 +40,9 @@ void FrameTags::add(FrameTag* tag)
   }
   m_tags.insert(it, tag);
   tag->setOwner(this);
+
+  base::scoped_lock lock(m_segmentsMutex);
+  m_hasSegments = false;
 }
 
 void FrameTags::remove(FrameTag* tag)
@@ -48,6 +53,9 @@ void FrameTags::remove(FrameTag* tag)
     m_tags.erase(it);
 
   tag->setOwner(nullptr);
+
+  base::scoped_lock lock(m_segmentsMutex);
+  m_hasSegments = false;
 }
 
 FrameTag* FrameTags::getByName(const std::string& name) const
@@ -70,32 +78,73 @@ FrameTag* FrameTags::getById(ObjectId id) const
 
 FrameTag* FrameTags::innerTag(frame_t frame) const
 {
-  const FrameTag* found = nullptr;
-  for (const FrameTag* tag : *this) {
-    if (frame >= tag->fromFrame() &&
-        frame <= tag->toFrame()) {
-      if (!found ||
-          (tag->toFrame() - tag->fromFrame()) < (found->toFrame() - found->fromFrame())) {
-        found = tag;
-      }
-    }
-  }
-  return const_cast<FrameTag*>(found);
+  base::scoped_lock lock(m_segmentsMutex);
+  const Segment* segment = findSegment(frame);
+  return (segment ? segment->inner: nullptr);
 }
 
 FrameTag* FrameTags::outerTag(frame_t frame) const
 {
-  const FrameTag* found = nullptr;
-  for (const FrameTag* tag : *this) {
-    if (frame >= tag->fromFrame() &&
-        frame <= tag->toFrame()) {
-      if (!found ||
-          (tag->toFrame() - tag->fromFrame()) > (found->toFrame() - found->fromFrame())) {
-        found = tag;
+  base::scoped_lock lock(m_segmentsMutex);
+  const Segment* segment = findSegment(frame);
+  return (segment ? segment->outer: nullptr);
+}
+
+// The mutex must be locked
+const FrameTags::Segment* FrameTags::findSegment(frame_t frame) const
+{
+  updateSegments();
+
+  auto it = std::upper_bound(
+    m_segments.begin(), m_segments.end(), frame,
+    [](frame_t frame, const Segment& segment) {
+      return frame < segment.frame;
+    });
+
+  if (it != m_segments.begin())
+    return &*(--it);
+  else
+    return nullptr;
+}
+
+// The mutex must be locked
+void FrameTags::updateSegments() const
+{
+  if (m_hasSegments)
+    return;
+
+  // Tags start/end only in these frames, so all frames of a segment
+  // have the same inner/outer tags
+  std::vector<frame_t> frames;
+  for (const FrameTag* tag : m_tags) {
+    frames.push_back(tag->fromFrame());
+    frames.push_back(tag->toFrame()+1);
+  }
+  std::sort(frames.begin(), frames.end());
+  frames.erase(std::unique(frames.begin(), frames.end()), frames.end());
+
+  m_segments.clear();
+  for (frame_t frame : frames) {
+    Segment segment = { frame, nullptr, nullptr };
+
+    // Same comparisons of the old per-query search to choose the
+    // same tag in case of ties
+    for (FrameTag* tag : m_tags) {
+      if (frame >= tag->fromFrame() &&
+          frame <= tag->toFrame()) {
+        frame_t length = tag->toFrame() - tag->fromFrame();
+        if (!segment.inner ||
+            length < (segment.inner->toFrame() - segment.inner->fromFrame()))
+          segment.inner = tag;
+        if (!segment.outer ||
+            length > (segment.outer->toFrame() - segment.outer->fromFrame()))
+          segment.outer = tag;
       }
     }
+    m_segments.push_back(segment);
   }
-  return const_cast<FrameTag*>(found);
+
+  m_hasSegments = true;
 }
 
 } // namespace doc
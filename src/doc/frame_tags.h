@@ -9,6 +9,7 @@
 #pragma once
 
 #include "base/disable_copying.h"
+#include "base/mutex.h"
 #include "doc/frame.h"
 #include "doc/object_id.h"
 
@@ -46,13 +47,34 @@ namespace doc {
     std::size_t size() const { return m_tags.size(); }
     bool empty() const { return m_tags.empty(); }
 
+    // Returns the shortest/longest tag that contains the given frame
+    // (the first one in case of ties). They use a table of frame
+    // segments with the same inner/outer tags, created again after
+    // a tag is added or removed (FrameTag::setFrameRange() removes
+    // and adds the tag again).
     FrameTag* innerTag(frame_t frame) const;
     FrameTag* outerTag(frame_t frame) const;
 
   private:
+    // Frames from "frame" to the next segment
+    struct Segment {
+      frame_t frame;
+      FrameTag* inner;
+      FrameTag* outer;
+    };
+
+    const Segment* findSegment(frame_t frame) const;
+    void updateSegments() const;
+
     Sprite* m_sprite;
     List m_tags;
 
+    // Accessed with the mutex locked (several threads can read the
+    // sprite at the same time)
+    mutable base::mutex m_segmentsMutex;
+    mutable bool m_hasSegments;
+    mutable std::vector<Segment> m_segments;
+
     DISABLE_COPYING(FrameTags);
   };
 
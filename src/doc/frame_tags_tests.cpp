@@ -0,0 +1,84 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/frame_tag.h"
+#include "doc/frame_tags.h"
+#include "doc/sprite.h"
+
+using namespace doc;
+
+static FrameTag* brute_force_tag(const FrameTags& tags, frame_t frame, bool inner)
+{
+  FrameTag* found = nullptr;
+  for (FrameTag* tag : tags) {
+    if (frame >= tag->fromFrame() &&
+        frame <= tag->toFrame()) {
+      frame_t length = tag->toFrame() - tag->fromFrame();
+      frame_t foundLength = (found ? found->toFrame() - found->fromFrame(): 0);
+      if (!found ||
+          (inner ? length < foundLength: length > foundLength))
+        found = tag;
+    }
+  }
+  return found;
+}
+
+static void expect_tags(const FrameTags& tags)
+{
+  for (frame_t frame=-1; frame<=20; ++frame) {
+    EXPECT_EQ(brute_force_tag(tags, frame, true), tags.innerTag(frame)) << frame;
+    EXPECT_EQ(brute_force_tag(tags, frame, false), tags.outerTag(frame)) << frame;
+  }
+}
+
+TEST(FrameTags, InnerAndOuterTags)
+{
+  Sprite* spr = new Sprite(IMAGE_RGB, 4, 4, 256);
+  spr->setTotalFrames(20);
+
+  FrameTags& tags = spr->frameTags();
+  EXPECT_EQ(nullptr, tags.innerTag(0));
+  EXPECT_EQ(nullptr, tags.outerTag(0));
+
+  FrameTag* a = new FrameTag(0, 9);
+  FrameTag* b = new FrameTag(2, 4);
+  FrameTag* c = new FrameTag(3, 5);   // Same length as "b"
+  FrameTag* d = new FrameTag(12, 12);
+  tags.add(a);
+  tags.add(b);
+  tags.add(c);
+  tags.add(d);
+  expect_tags(tags);
+
+  EXPECT_EQ(b, tags.innerTag(3));
+  EXPECT_EQ(a, tags.outerTag(3));
+  EXPECT_EQ(d, tags.innerTag(12));
+  EXPECT_EQ(nullptr, tags.outerTag(11));
+
+  // Change ranges, remove and add tags
+  b->setFrameRange(8, 15);
+  expect_tags(tags);
+
+  tags.remove(a);
+  expect_tags(tags);
+
+  tags.add(a);
+  expect_tags(tags);
+
+  delete spr;
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
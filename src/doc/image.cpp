@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -26,6 +26,8 @@ Image::Image(PixelFormat format, int width, int height)
 {
   m_width = width;
   m_height = height;
+  m_bits = NULL;
+  m_rowStride = getRowStrideSize();
   m_maskColor = 0;
 }
 
@@ -35,7 +37,7 @@ Image::~Image()
 
 int Image::getMemSize() const
 {
-  return sizeof(Image) + getRowStrideSize()*m_height;
+  return sizeof(Image) + m_rowStride*m_height;
 }
 
 int Image::getRowStrideSize() const
@@ -61,6 +63,32 @@ Image* Image::create(PixelFormat format, int width, int height,
   return NULL;
 }
 
+// static
+Image* Image::createAligned(PixelFormat format, int width, int height,
+                            int alignment, const ImageBufferPtr& buffer)
+{
+  switch (format) {
+    case IMAGE_RGB:       return new ImageImpl<RgbTraits>(width, height, buffer, alignment);
+    case IMAGE_GRAYSCALE: return new ImageImpl<GrayscaleTraits>(width, height, buffer, alignment);
+    case IMAGE_INDEXED:   return new ImageImpl<IndexedTraits>(width, height, buffer, alignment);
+    case IMAGE_BITMAP:    return new ImageImpl<BitmapTraits>(width, height, buffer, alignment);
+  }
+  return NULL;
+}
+
+// static
+Image* Image::createFromMemory(PixelFormat format, int width, int height,
+                               uint8_t* bits, int rowStride)
+{
+  switch (format) {
+    case IMAGE_RGB:       return new ImageImpl<RgbTraits>(width, height, bits, rowStride);
+    case IMAGE_GRAYSCALE: return new ImageImpl<GrayscaleTraits>(width, height, bits, rowStride);
+    case IMAGE_INDEXED:   return new ImageImpl<IndexedTraits>(width, height, bits, rowStride);
+    case IMAGE_BITMAP:    return new ImageImpl<BitmapTraits>(width, height, bits, rowStride);
+  }
+  return NULL;
+}
+
 // static
 Image* Image::createCopy(const Image* image, const ImageBufferPtr& buffer)
 {
@@ -69,4 +97,18 @@ Image* Image::createCopy(const Image* image, const ImageBufferPtr& buffer)
     image->maskColor(), buffer);
 }
 
+// static
+Image* Image::createSharedCopy(const Image* image)
+{
+  ASSERT(image);
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       return new ImageImpl<RgbTraits>(static_cast<const ImageImpl<RgbTraits>*>(image));
+    case IMAGE_GRAYSCALE: return new ImageImpl<GrayscaleTraits>(static_cast<const ImageImpl<GrayscaleTraits>*>(image));
+    case IMAGE_INDEXED:   return new ImageImpl<IndexedTraits>(static_cast<const ImageImpl<IndexedTraits>*>(image));
+    case IMAGE_BITMAP:    return new ImageImpl<BitmapTraits>(static_cast<const ImageImpl<BitmapTraits>*>(image));
+  }
+  return NULL;
+}
+
 } // namespace doc
+
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -17,9 +17,12 @@
 #include "gfx/rect.h"
 #include "gfx/size.h"
 
+#include <cstddef>
+
 namespace doc {
 
   template<typename ImageTraits> class ImageBits;
+  template<typename ImageTraits> class ImageSpan;
   class Palette;
   class Pen;
   class RgbMap;
@@ -34,8 +37,24 @@ namespace doc {
 
     static Image* create(PixelFormat format, int width, int height,
                          const ImageBufferPtr& buffer = ImageBufferPtr());
+    // Creates an image where each row starts in an address aligned
+    // to "alignment" bytes (a power of two, e.g. 32 or 64 for SIMD
+    // loads). Rows are padded so they aren't contiguous in memory.
+    static Image* createAligned(PixelFormat format, int width, int height,
+                                int alignment,
+                                const ImageBufferPtr& buffer = ImageBufferPtr());
     static Image* createCopy(const Image* image,
                              const ImageBufferPtr& buffer = ImageBufferPtr());
+    // Creates a copy of the image that uses the same pixels (i.e. the
+    // same ImageBuffer) until one of both images is modified. Code
+    // that modifies the pixels of an image that can be shared (the
+    // image of a cel) must call unshareBuffer() before.
+    static Image* createSharedCopy(const Image* image);
+    // Creates an image that uses the given memory as its pixels (it's
+    // not copied nor freed, so it must be alive while the image is
+    // used), e.g. the memory of a locked she::Surface.
+    static Image* createFromMemory(PixelFormat format, int width, int height,
+                                   uint8_t* bits, int rowStride);
 
     virtual ~Image();
 
@@ -51,6 +70,22 @@ namespace doc {
     int getRowStrideSize() const;
     int getRowStrideSize(int pixels_per_row) const;
 
+    // Bytes between the start of two consecutive rows in memory (it
+    // can be greater than getRowStrideSize() for aligned images).
+    int rowStride() const { return m_rowStride; }
+
+    // Address of the row "y" calculated without virtual calls.
+    uint8_t* getRowAddress(int y) const {
+      ASSERT(y >= 0 && y < m_height);
+      return m_bits + std::ptrdiff_t(y)*m_rowStride;
+    }
+
+    // Returns the pixels of the row "y" (defined in
+    // doc/image_span.h). It can be used to access pixels without a
+    // virtual call per pixel (e.g. with for_each_row()).
+    template<typename ImageTraits>
+    ImageSpan<ImageTraits> row(int y) const;
+
     template<typename ImageTraits>
     ImageBits<ImageTraits> lockBits(LockType lockType, const gfx::Rect& bounds) {
       return ImageBits<ImageTraits>(this, bounds);
@@ -78,13 +113,29 @@ namespace doc {
     virtual void fillRect(int x1, int y1, int x2, int y2, color_t color) = 0;
     virtual void blendRect(int x1, int y1, int x2, int y2, color_t color, int opacity) = 0;
 
+    // Returns true if other image uses the same pixels (see
+    // createSharedCopy()).
+    virtual bool isBufferShared() const = 0;
+
+    // Copies the pixels to a new buffer if they are shared with other
+    // image, so this image can be modified.
+    virtual void unshareBuffer() = 0;
+
   protected:
     Image(PixelFormat format, int width, int height);
 
+    uint8_t* getBitsAddress() const { return m_bits; }
+    void setBitsAddress(uint8_t* bits, int rowStride) {
+      m_bits = bits;
+      m_rowStride = rowStride;
+    }
+
   private:
     PixelFormat m_format;
     int m_width;
     int m_height;
+    uint8_t* m_bits;      // First row (set by ImageImpl)
+    int m_rowStride;
     color_t m_maskColor;  // Skipped color in merge process.
   };
 
@@ -107,6 +158,24 @@ namespace doc {
     return 0;
   }
 
+  // Row stride padded to a multiple of "alignment" bytes (if it's
+  // greater than 1).
+  inline int calculate_rowstride_bytes(PixelFormat pixelFormat, int pixels_per_row, int alignment)
+  {
+    int bytes = calculate_rowstride_bytes(pixelFormat, pixels_per_row);
+    if (alignment > 1)
+      bytes = (bytes + alignment - 1) & ~(alignment - 1);
+    return bytes;
+  }
+
+  // Size of the ImageBuffer needed by an image (including the extra
+  // bytes to align the first row).
+  inline std::size_t get_image_buffer_size(PixelFormat pixelFormat, int width, int height, int alignment = 0)
+  {
+    return std::size_t(calculate_rowstride_bytes(pixelFormat, width, alignment)) * height
+      + (alignment > 1 ? alignment - 1: 0);
+  }
+
 } // namespace doc
 
 #endif
@@ -0,0 +1,57 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_buffer_pool.h"
+
+#include "base/scoped_lock.h"
+
+namespace doc {
+
+ImageBufferPool::ImageBufferPool(int maxBuffers)
+  : m_maxBuffers(maxBuffers)
+{
+}
+
+ImageBufferPtr ImageBufferPool::get()
+{
+  base::scoped_lock hold(m_mutex);
+
+  // Only the pool references unused buffers, and nobody else can
+  // get a new reference while the pool is locked.
+  for (const ImageBufferPtr& buffer : m_buffers) {
+    if (buffer.unique())
+      return buffer;
+  }
+
+  ImageBufferPtr buffer(new ImageBuffer);
+  if (int(m_buffers.size()) < m_maxBuffers)
+    m_buffers.push_back(buffer);
+  return buffer;
+}
+
+void ImageBufferPool::clear()
+{
+  base::scoped_lock hold(m_mutex);
+
+  for (auto it=m_buffers.begin(); it!=m_buffers.end(); ) {
+    if (it->unique())
+      it = m_buffers.erase(it);
+    else
+      ++it;
+  }
+}
+
+int ImageBufferPool::size() const
+{
+  base::scoped_lock hold(m_mutex);
+  return int(m_buffers.size());
+}
+
+} // namespace doc
@@ -0,0 +1,48 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_BUFFER_POOL_H_INCLUDED
+#define DOC_IMAGE_BUFFER_POOL_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/mutex.h"
+#include "doc/image_buffer.h"
+
+#include <vector>
+
+namespace doc {
+
+  // A bounded set of buffers to create temporary images without
+  // allocating memory each time (e.g. to render the editors). A
+  // buffer is returned again by get() only when nobody else is
+  // referencing it. It's thread-safe.
+  class ImageBufferPool {
+  public:
+    explicit ImageBufferPool(int maxBuffers);
+
+    // Returns a buffer that isn't being used. If all buffers are
+    // being used and the pool is full, a new buffer is returned
+    // that isn't kept in the pool (so the memory of the pool never
+    // grows beyond "maxBuffers" buffers).
+    ImageBufferPtr get();
+
+    // Releases the buffers that aren't being used.
+    void clear();
+
+    int size() const;
+
+  private:
+    int m_maxBuffers;
+    std::vector<ImageBufferPtr> m_buffers;
+    mutable base::mutex m_mutex;
+
+    DISABLE_COPYING(ImageBufferPool);
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,78 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_buffer_pool.h"
+
+#include "base/unique_ptr.h"
+#include "doc/image.h"
+
+using namespace doc;
+
+TEST(ImageBufferPool, ReuseUnusedBuffers)
+{
+  ImageBufferPool pool(2);
+
+  ImageBufferPtr a = pool.get();
+  ImageBufferPtr b = pool.get();
+  EXPECT_NE(a.get(), b.get());
+  EXPECT_EQ(2, pool.size());
+
+  // "a" is released, so it's returned again
+  ImageBuffer* aPtr = a.get();
+  a.reset();
+  a = pool.get();
+  EXPECT_EQ(aPtr, a.get());
+  EXPECT_EQ(2, pool.size());
+}
+
+TEST(ImageBufferPool, BoundedSize)
+{
+  ImageBufferPool pool(1);
+
+  ImageBufferPtr a = pool.get();
+  ImageBufferPtr b = pool.get();
+  ImageBufferPtr c = pool.get();
+  EXPECT_NE(a.get(), b.get());
+  EXPECT_NE(b.get(), c.get());
+  EXPECT_EQ(1, pool.size());
+
+  // "a" is still being used
+  b.reset();
+  c.reset();
+  EXPECT_NE(a.get(), pool.get().get());
+  EXPECT_EQ(1, pool.size());
+
+  ImageBuffer* aPtr = a.get();
+  a.reset();
+  a = pool.get();
+  EXPECT_EQ(aPtr, a.get());
+
+  a.reset();
+  pool.clear();
+  EXPECT_EQ(0, pool.size());
+}
+
+TEST(ImageBufferPool, ImagesKeepTheirBuffers)
+{
+  ImageBufferPool pool(2);
+
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 8, 8, pool.get()));
+  ImageBufferPtr other = pool.get();
+  base::UniquePtr<Image> image2(Image::create(IMAGE_RGB, 8, 8, other));
+  EXPECT_NE(image->getPixelAddress(0, 0), image2->getPixelAddress(0, 0));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
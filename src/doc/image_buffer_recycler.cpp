@@ -0,0 +1,218 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_buffer_recycler.h"
+
+#include "doc/image.h"
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace doc {
+
+namespace {
+
+// Smaller buffers are rounded to this size
+const std::size_t kMinClassSize = 256;
+
+std::size_t highest_power_of_two(std::size_t size)
+{
+  std::size_t p = 1;
+  while (p <= size/2)
+    p *= 2;
+  return p;
+}
+
+// Size class for a new buffer of the given size (where p is the
+// biggest power of two <= size, classes are p, p*5/4, p*6/4, p*7/4)
+std::size_t size_class_up(std::size_t size)
+{
+  if (size <= kMinClassSize)
+    return kMinClassSize;
+
+  std::size_t q = highest_power_of_two(size) / 4;
+  return ((size + q - 1) / q) * q;
+}
+
+// Biggest size class that can be served with a buffer of the given
+// size
+std::size_t size_class_down(std::size_t size)
+{
+  std::size_t q = highest_power_of_two(size) / 4;
+  return (q > 0 ? (size / q) * q: size);
+}
+
+} // anonymous namespace
+
+// Shared with the deleter of each buffer, so buffers can be released
+// after the ImageBufferRecycler is destroyed.
+class ImageBufferRecycler::impl {
+public:
+  // Deleter of ImageBufferPtr that gives the buffer back to the
+  // recycler
+  class Deleter {
+  public:
+    Deleter(const std::shared_ptr<impl>& impl) : m_impl(impl) { }
+    void operator()(ImageBuffer* buffer) { m_impl->release(buffer); }
+  private:
+    std::shared_ptr<impl> m_impl;
+  };
+
+  explicit impl(std::size_t maxBytes)
+    : m_maxBytes(maxBytes)
+    , m_releasedBytes(0)
+    , m_alive(true) {
+  }
+
+  ~impl() {
+    clear();
+  }
+
+  void kill() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_alive = false;
+  }
+
+  ImageBuffer* take(std::size_t classSize) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_classes.find(classSize);
+    if (it == m_classes.end() || it->second.empty())
+      return nullptr;
+
+    ImageBuffer* buffer = it->second.back().buffer;
+    it->second.pop_back();
+    m_releasedBytes -= buffer->size();
+    return buffer;
+  }
+
+  void release(ImageBuffer* buffer) {
+    std::size_t size = buffer->size();
+    std::size_t classSize = size_class_down(size);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_alive &&
+          classSize >= kMinClassSize &&
+          m_releasedBytes + size <= m_maxBytes) {
+        Entry entry = { buffer, true };
+        m_classes[classSize].push_back(entry);
+        m_releasedBytes += size;
+        return;
+      }
+    }
+    delete buffer;
+  }
+
+  void trim(bool all) {
+    std::vector<ImageBuffer*> unused;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      for (auto it=m_classes.begin(); it!=m_classes.end(); ) {
+        std::vector<Entry>& entries = it->second;
+        std::size_t j = 0;
+        for (std::size_t i=0; i<entries.size(); ++i) {
+          if (entries[i].recent && !all) {
+            entries[i].recent = false;
+            entries[j++] = entries[i];
+          }
+          else {
+            unused.push_back(entries[i].buffer);
+            m_releasedBytes -= entries[i].buffer->size();
+          }
+        }
+        entries.resize(j);
+
+        if (entries.empty())
+          it = m_classes.erase(it);
+        else
+          ++it;
+      }
+    }
+
+    // Free memory outside the lock
+    for (ImageBuffer* buffer : unused)
+      delete buffer;
+  }
+
+  void clear() {
+    trim(true);
+  }
+
+  std::size_t releasedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_releasedBytes;
+  }
+
+private:
+  struct Entry {
+    ImageBuffer* buffer;
+    bool recent;                // Released after the last trim()
+  };
+
+  std::size_t m_maxBytes;
+  std::size_t m_releasedBytes;
+  bool m_alive;
+  std::map<std::size_t, std::vector<Entry>> m_classes;
+  mutable std::mutex m_mutex;
+};
+
+ImageBufferRecycler::ImageBufferRecycler(std::size_t maxBytes)
+  : m_impl(std::make_shared<impl>(maxBytes))
+{
+}
+
+ImageBufferRecycler::~ImageBufferRecycler()
+{
+  m_impl->kill();
+  m_impl->clear();
+}
+
+ImageBufferPtr ImageBufferRecycler::get(std::size_t size)
+{
+  std::size_t classSize = size_class_up(size);
+
+  ImageBuffer* buffer = m_impl->take(classSize);
+  if (!buffer)
+    buffer = new ImageBuffer(classSize);
+
+  return ImageBufferPtr(buffer, impl::Deleter(m_impl));
+}
+
+ImageBufferPtr ImageBufferRecycler::getForImage(PixelFormat format, int width, int height)
+{
+  return get(get_image_buffer_size(format, width, height));
+}
+
+void ImageBufferRecycler::trim()
+{
+  m_impl->trim(false);
+}
+
+void ImageBufferRecycler::clear()
+{
+  m_impl->clear();
+}
+
+std::size_t ImageBufferRecycler::releasedBytes() const
+{
+  return m_impl->releasedBytes();
+}
+
+// static
+ImageBufferRecycler& ImageBufferRecycler::global()
+{
+  // 64 MB of released buffers at most
+  static ImageBufferRecycler recycler(64*1024*1024);
+  return recycler;
+}
+
+} // namespace doc
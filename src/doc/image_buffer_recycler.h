@@ -0,0 +1,64 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_BUFFER_RECYCLER_H_INCLUDED
+#define DOC_IMAGE_BUFFER_RECYCLER_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/image_buffer.h"
+#include "doc/pixel_format.h"
+
+#include <cstddef>
+#include <memory>
+
+namespace doc {
+
+  // Keeps the buffers of temporary images after they are released
+  // to reuse them for new images of the same size class, so steady
+  // operations (e.g. tool loops, previews) don't allocate/free big
+  // blocks of memory each time. Buffers are grouped in size classes
+  // (four classes for each power of two). It's thread-safe.
+  class ImageBufferRecycler {
+  public:
+    // The memory of released buffers is limited to "maxBytes" (the
+    // rest of released buffers are freed).
+    explicit ImageBufferRecycler(std::size_t maxBytes);
+    ~ImageBufferRecycler();
+
+    // Returns a buffer of at least "size" bytes. When its last
+    // reference is released, the buffer goes back to the recycler
+    // (or it's freed if the recycler was destroyed in the meantime).
+    ImageBufferPtr get(std::size_t size);
+
+    // Returns a buffer for an image of the given format and size.
+    ImageBufferPtr getForImage(PixelFormat format, int width, int height);
+
+    // Frees the released buffers that weren't reused since the
+    // previous trim() call. It's called periodically, so buffers of
+    // sizes that aren't used anymore are freed when the program is
+    // idle.
+    void trim();
+
+    // Frees all released buffers.
+    void clear();
+
+    // Memory of the released buffers.
+    std::size_t releasedBytes() const;
+
+    // Shared recycler for temporary images.
+    static ImageBufferRecycler& global();
+
+  private:
+    class impl;
+    std::shared_ptr<impl> m_impl;
+
+    DISABLE_COPYING(ImageBufferRecycler);
+  };
+
+} // namespace doc
+
+#endif
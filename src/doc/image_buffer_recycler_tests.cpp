@@ -0,0 +1,107 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_buffer_recycler.h"
+
+#include "base/unique_ptr.h"
+#include "doc/image.h"
+
+using namespace doc;
+
+TEST(ImageBufferRecycler, ReuseReleasedBuffers)
+{
+  ImageBufferRecycler recycler(1024*1024);
+
+  ImageBufferPtr a = recycler.get(1000);
+  EXPECT_LE(1000u, a->size());
+  EXPECT_EQ(0u, recycler.releasedBytes());
+
+  // Same size class
+  ImageBuffer* aPtr = a.get();
+  a.reset();
+  EXPECT_EQ(aPtr->size(), recycler.releasedBytes());
+  a = recycler.get(900);
+  EXPECT_EQ(aPtr, a.get());
+  EXPECT_EQ(0u, recycler.releasedBytes());
+
+  // Other size class
+  ImageBufferPtr b = recycler.get(100000);
+  EXPECT_NE(a.get(), b.get());
+  EXPECT_LE(100000u, b->size());
+  EXPECT_GT(100000u*5/4, b->size());
+}
+
+TEST(ImageBufferRecycler, MaxBytes)
+{
+  ImageBufferRecycler recycler(4096);
+
+  ImageBufferPtr a = recycler.get(4096);
+  ImageBufferPtr b = recycler.get(4096);
+  a.reset();
+  b.reset();                    // It's freed, the recycler is full
+  EXPECT_EQ(4096u, recycler.releasedBytes());
+}
+
+TEST(ImageBufferRecycler, Trim)
+{
+  ImageBufferRecycler recycler(1024*1024);
+
+  recycler.get(5000);
+  recycler.get(10000);
+  EXPECT_LT(15000u, recycler.releasedBytes());
+
+  // Buffers are freed if they aren't used between two trim() calls
+  recycler.trim();
+  EXPECT_LT(15000u, recycler.releasedBytes());
+  recycler.get(10000);
+  recycler.trim();
+  EXPECT_GT(15000u, recycler.releasedBytes());
+  EXPECT_LE(10000u, recycler.releasedBytes());
+  recycler.trim();
+  EXPECT_EQ(0u, recycler.releasedBytes());
+
+  recycler.get(5000);
+  recycler.clear();
+  EXPECT_EQ(0u, recycler.releasedBytes());
+}
+
+TEST(ImageBufferRecycler, Images)
+{
+  ImageBufferRecycler recycler(1024*1024);
+
+  {
+    ImageBufferPtr buffer = recycler.getForImage(IMAGE_RGB, 33, 17);
+    std::size_t size = buffer->size();
+    base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 33, 17, buffer));
+    EXPECT_EQ(size, buffer->size()); // Without resizing the buffer
+  }
+
+  // The buffer is in the recycler when the image is deleted
+  EXPECT_LT(33u*17*4, recycler.releasedBytes());
+}
+
+TEST(ImageBufferRecycler, BuffersOutliveTheRecycler)
+{
+  ImageBufferPtr a;
+  {
+    ImageBufferRecycler recycler(1024*1024);
+    a = recycler.get(1000);
+  }
+  a->buffer()[0] = 1;
+  a.reset();
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
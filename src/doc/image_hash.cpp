@@ -0,0 +1,287 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_hash.h"
+
+#include "base/thread_pool.h"
+#include "doc/image.h"
+#include "gfx/region.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace doc {
+
+namespace {
+
+const uint64_t kPrime1 = 11400714785074694791ULL;
+const uint64_t kPrime2 = 14029467366897019727ULL;
+const uint64_t kPrime3 =  1609587929392839161ULL;
+const uint64_t kPrime4 =  9650029242287828579ULL;
+const uint64_t kPrime5 =  2870177450012600261ULL;
+
+// Minimum number of pixels to hash tiles in parallel
+const int kParallelPixels = 256*1024;
+
+inline uint64_t rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const uint8_t* p) {
+  uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+inline uint32_t read32(const uint8_t* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  acc = rotl(acc, 31);
+  return acc * kPrime1;
+}
+
+inline uint64_t merge_round(uint64_t acc, uint64_t val) {
+  acc ^= xxh_round(0, val);
+  return acc * kPrime1 + kPrime4;
+}
+
+// XXH64 calculated by parts (e.g. row by row). The four
+// accumulators are independent, so the main loop can be executed in
+// parallel by the CPU (and vectorized by the compiler).
+class Hasher {
+public:
+  Hasher(uint64_t seed)
+    : m_seed(seed)
+    , m_totalSize(0)
+    , m_bufSize(0) {
+    m_v[0] = seed + kPrime1 + kPrime2;
+    m_v[1] = seed + kPrime2;
+    m_v[2] = seed;
+    m_v[3] = seed - kPrime1;
+  }
+
+  void update(const uint8_t* p, std::size_t size) {
+    if (size == 0)
+      return;
+
+    m_totalSize += size;
+
+    if (m_bufSize + size < 32) {
+      std::memcpy(m_buf + m_bufSize, p, size);
+      m_bufSize += int(size);
+      return;
+    }
+
+    if (m_bufSize > 0) {
+      int n = 32 - m_bufSize;
+      std::memcpy(m_buf + m_bufSize, p, n);
+      consume(m_buf);
+      p += n;
+      size -= n;
+      m_bufSize = 0;
+    }
+
+    for (; size >= 32; p += 32, size -= 32)
+      consume(p);
+
+    std::memcpy(m_buf, p, size);
+    m_bufSize = int(size);
+  }
+
+  uint64_t digest() const {
+    uint64_t h;
+
+    if (m_totalSize >= 32) {
+      h = rotl(m_v[0], 1) + rotl(m_v[1], 7) + rotl(m_v[2], 12) + rotl(m_v[3], 18);
+      for (int i=0; i<4; ++i)
+        h = merge_round(h, m_v[i]);
+    }
+    else
+      h = m_seed + kPrime5;
+
+    h += m_totalSize;
+
+    const uint8_t* p = m_buf;
+    const uint8_t* end = m_buf + m_bufSize;
+    for (; p+8 <= end; p += 8) {
+      h ^= xxh_round(0, read64(p));
+      h = rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (p+4 <= end) {
+      h ^= uint64_t(read32(p)) * kPrime1;
+      h = rotl(h, 23) * kPrime2 + kPrime3;
+      p += 4;
+    }
+    for (; p < end; ++p) {
+      h ^= (*p) * kPrime5;
+      h = rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+  }
+
+private:
+  void consume(const uint8_t* p) {
+    m_v[0] = xxh_round(m_v[0], read64(p));
+    m_v[1] = xxh_round(m_v[1], read64(p+8));
+    m_v[2] = xxh_round(m_v[2], read64(p+16));
+    m_v[3] = xxh_round(m_v[3], read64(p+24));
+  }
+
+  uint64_t m_seed;
+  uint64_t m_v[4];
+  uint64_t m_totalSize;
+  uint8_t m_buf[32];
+  int m_bufSize;
+};
+
+// The pixel format and size are part of the hash (so images with the
+// same bytes but different sizes have different hashes).
+uint64_t image_seed(const Image* image, const gfx::Rect& bounds)
+{
+  return (uint64_t(image->pixelFormat()) << 56) ^
+         (uint64_t(bounds.w) << 28) ^
+         uint64_t(bounds.h);
+}
+
+} // anonymous namespace
+
+uint64_t hash_bytes(const void* data, std::size_t size, uint64_t seed)
+{
+  Hasher hasher(seed);
+  hasher.update((const uint8_t*)data, size);
+  return hasher.digest();
+}
+
+uint64_t hash_image(const Image* image)
+{
+  return hash_image(image, image->bounds());
+}
+
+uint64_t hash_image(const Image* image, const gfx::Rect& bounds)
+{
+  ASSERT(image->bounds().contains(bounds) || bounds.isEmpty());
+
+  Hasher hasher(image_seed(image, bounds));
+  if (bounds.isEmpty())
+    return hasher.digest();
+
+  if (image->pixelFormat() == IMAGE_BITMAP) {
+    // Bits of each row are aligned to the first byte (and bits
+    // outside the image aren't used).
+    std::vector<uint8_t> row((bounds.w+7) / 8);
+    for (int y=bounds.y; y<bounds.y2(); ++y) {
+      const uint8_t* src = image->getRowAddress(y);
+      std::fill(row.begin(), row.end(), 0);
+      for (int i=0; i<bounds.w; ++i) {
+        int x = bounds.x+i;
+        if (src[x / 8] & (1 << (x % 8)))
+          row[i / 8] |= (1 << (i % 8));
+      }
+      hasher.update(&row[0], row.size());
+    }
+  }
+  else {
+    const int bytes = image->getRowStrideSize(bounds.w);
+    for (int y=bounds.y; y<bounds.y2(); ++y)
+      hasher.update(image->getPixelAddress(bounds.x, y), bytes);
+  }
+
+  return hasher.digest();
+}
+
+ImageTileHashes::ImageTileHashes(int tileSize)
+  : m_tileSize(tileSize)
+  , m_format(-1)
+{
+  ASSERT(tileSize > 0);
+}
+
+void ImageTileHashes::invalidate()
+{
+  std::fill(m_dirty.begin(), m_dirty.end(), true);
+}
+
+void ImageTileHashes::invalidate(const gfx::Rect& bounds)
+{
+  gfx::Rect rc = bounds.createIntersection(gfx::Rect(m_size));
+  if (rc.isEmpty())
+    return;
+
+  int tx1 = rc.x / m_tileSize;
+  int ty1 = rc.y / m_tileSize;
+  int tx2 = (rc.x2()-1) / m_tileSize;
+  int ty2 = (rc.y2()-1) / m_tileSize;
+
+  for (int ty=ty1; ty<=ty2; ++ty)
+    for (int tx=tx1; tx<=tx2; ++tx)
+      m_dirty[ty*m_tiles.w + tx] = true;
+}
+
+void ImageTileHashes::invalidate(const gfx::Region& region)
+{
+  for (const gfx::Rect& rc : region)
+    invalidate(rc);
+}
+
+uint64_t ImageTileHashes::hash(const Image* image)
+{
+  if (m_format != image->pixelFormat() || m_size != image->size()) {
+    m_format = image->pixelFormat();
+    m_size = image->size();
+    m_tiles = gfx::Size((m_size.w + m_tileSize - 1) / m_tileSize,
+                        (m_size.h + m_tileSize - 1) / m_tileSize);
+    m_hashes.assign(m_tiles.w*m_tiles.h, 0);
+    m_dirty.assign(m_tiles.w*m_tiles.h, true);
+  }
+
+  std::vector<int> dirty;
+  for (int i=0; i<int(m_dirty.size()); ++i)
+    if (m_dirty[i])
+      dirty.push_back(i);
+
+  auto hashTile = [this, image, &dirty](int j) {
+    int i = dirty[j];
+    gfx::Rect tile((i % m_tiles.w) * m_tileSize,
+                   (i / m_tiles.w) * m_tileSize,
+                   m_tileSize, m_tileSize);
+    m_hashes[i] = hash_image(image, tile.createIntersection(image->bounds()));
+  };
+
+  if (int(dirty.size())*m_tileSize*m_tileSize >= kParallelPixels)
+    base::thread_pool::global().parallel_for(int(dirty.size()), hashTile);
+  else
+    for (int j=0; j<int(dirty.size()); ++j)
+      hashTile(j);
+
+  std::fill(m_dirty.begin(), m_dirty.end(), false);
+
+  return hash_bytes(m_hashes.empty() ? NULL: &m_hashes[0],
+                    m_hashes.size()*sizeof(uint64_t),
+                    image_seed(image, image->bounds()));
+}
+
+uint64_t ImageTileHashes::tileHash(int x, int y) const
+{
+  ASSERT(gfx::Rect(m_size).contains(gfx::Point(x, y)));
+  return m_hashes[(y / m_tileSize)*m_tiles.w + (x / m_tileSize)];
+}
+
+} // namespace doc
@@ -0,0 +1,71 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_HASH_H_INCLUDED
+#define DOC_IMAGE_HASH_H_INCLUDED
+#pragma once
+
+#include "gfx/rect.h"
+#include "gfx/size.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace gfx {
+  class Region;
+}
+
+namespace doc {
+
+  class Image;
+
+  // XXH64 of the given bytes (a fast non-cryptographic hash).
+  uint64_t hash_bytes(const void* data, std::size_t size, uint64_t seed = 0);
+
+  // Fast non-cryptographic hash of the pixels of the image (or the
+  // given bounds of the image). Images with the same pixel format,
+  // size and pixels have the same hash. It isn't a secure hash: it
+  // can be used for caches, but equal hashes must be confirmed
+  // comparing the pixels.
+  uint64_t hash_image(const Image* image);
+  uint64_t hash_image(const Image* image, const gfx::Rect& bounds);
+
+  // Keeps the hashes of the tiles of an image, so after a change only
+  // the modified tiles (invalidated with invalidate()) are hashed
+  // again. The hash of the whole image is calculated from the hashes
+  // of the tiles (so it's different from hash_image()).
+  class ImageTileHashes {
+  public:
+    ImageTileHashes(int tileSize = 64);
+
+    int tileSize() const { return m_tileSize; }
+
+    // Marks tiles to be hashed again in the next hash() call.
+    void invalidate();
+    void invalidate(const gfx::Rect& bounds);
+    void invalidate(const gfx::Region& region);
+
+    // Hashes the invalidated tiles of the image and returns the
+    // hash of the whole image. If the pixel format or the size of
+    // the image changed, all tiles are hashed again.
+    uint64_t hash(const Image* image);
+
+    // Hash of the tile that contains the given image pixel (valid
+    // after calling hash()).
+    uint64_t tileHash(int x, int y) const;
+
+  private:
+    int m_tileSize;
+    int m_format;
+    gfx::Size m_size;           // Image size
+    gfx::Size m_tiles;          // Number of tiles
+    std::vector<uint64_t> m_hashes;
+    std::vector<bool> m_dirty;
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,111 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_hash.h"
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+#include <string>
+
+using namespace doc;
+
+TEST(ImageHash, XXH64Vectors)
+{
+  EXPECT_EQ(0xef46db3751d8e999ULL, hash_bytes("", 0));
+  EXPECT_EQ(0xd24ec4f1a98c6e5bULL, hash_bytes("a", 1));
+  EXPECT_EQ(0x44bc2cf5ad770999ULL, hash_bytes("abc", 3));
+}
+
+TEST(ImageHash, SameResultByParts)
+{
+  // The hash of an image is calculated row by row, so the result
+  // must be the same for rows of any size.
+  std::string data;
+  for (int i=0; i<1000; ++i)
+    data.push_back(char(i*7 + i/13));
+
+  for (int w : { 1, 3, 8, 31, 32, 33, 100 }) {
+    int h = 1000 / w;
+    ImageRef image(Image::create(IMAGE_INDEXED, w, h));
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x)
+        put_pixel(image.get(), x, y, (uint8_t)data[y*w+x]);
+
+    ImageRef copy(Image::create(IMAGE_INDEXED, w*h, 1));
+    for (int i=0; i<w*h; ++i)
+      put_pixel(copy.get(), i, 0, (uint8_t)data[i]);
+
+    // The size is different so the hash must be different too
+    EXPECT_NE(hash_image(image.get()), hash_image(copy.get()));
+
+    uint64_t seed = (uint64_t(IMAGE_INDEXED) << 56) ^ (uint64_t(w) << 28) ^ uint64_t(h);
+    EXPECT_EQ(hash_bytes(data.c_str(), w*h, seed), hash_image(image.get()));
+  }
+}
+
+TEST(ImageHash, Bounds)
+{
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP }) {
+    ImageRef a(Image::create(format, 40, 30));
+    ImageRef b(Image::create(format, 23, 17));
+    clear_image(a.get(), 0);
+    clear_image(b.get(), 0);
+    for (int y=0; y<b->height(); ++y)
+      for (int x=0; x<b->width(); ++x) {
+        color_t c = (format == IMAGE_BITMAP ? (x+y) % 3 == 0: (x*31 + y*17) & 0xff);
+        put_pixel(a.get(), x+5, y+9, c);
+        put_pixel(b.get(), x, y, c);
+      }
+
+    EXPECT_EQ(hash_image(b.get()), hash_image(a.get(), gfx::Rect(5, 9, 23, 17)))
+      << "Format " << format;
+    EXPECT_NE(hash_image(b.get()), hash_image(a.get(), gfx::Rect(6, 9, 23, 17)))
+      << "Format " << format;
+  }
+}
+
+TEST(ImageHash, TileHashes)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 200, 150));
+  clear_image(image.get(), 0);
+
+  ImageTileHashes tiles(64);
+  uint64_t h1 = tiles.hash(image.get());
+  EXPECT_EQ(h1, tiles.hash(image.get()));
+
+  put_pixel(image.get(), 130, 70, rgba(255, 0, 0, 255));
+
+  // The tile wasn't invalidated
+  EXPECT_EQ(h1, tiles.hash(image.get()));
+
+  tiles.invalidate(gfx::Rect(130, 70, 1, 1));
+  uint64_t h2 = tiles.hash(image.get());
+  EXPECT_NE(h1, h2);
+  EXPECT_NE(tiles.tileHash(0, 0), tiles.tileHash(130, 70));
+  EXPECT_EQ(hash_image(image.get(), gfx::Rect(128, 64, 64, 64)), tiles.tileHash(130, 70));
+
+  // Same result hashing all tiles again
+  ImageTileHashes tiles2(64);
+  EXPECT_EQ(h2, tiles2.hash(image.get()));
+
+  put_pixel(image.get(), 130, 70, 0);
+  tiles.invalidate();
+  EXPECT_EQ(h1, tiles.hash(image.get()));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
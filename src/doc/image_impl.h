@@ -8,9 +8,12 @@
 #define DOC_IMAGE_IMPL_H_INCLUDED
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
+#include "doc/bitmap_ops.h"
 #include "doc/blend.h"
 #include "doc/image.h"
 #include "doc/image_bits.h"
@@ -26,54 +29,99 @@ namespace doc {
     typedef typename Traits::const_address_t const_address_t;
 
     ImageBufferPtr m_buffer;
-    address_t m_bits;
-    address_t* m_rows;
+    int m_alignment;
 
-    inline address_t getBitsAddress() {
-      return m_bits;
+    inline address_t getLineAddress(int y) const {
+      return (address_t)getRowAddress(y);
     }
 
-    inline const_address_t getBitsAddress() const {
-      return m_bits;
-    }
-
-    inline address_t getLineAddress(int y) {
-      ASSERT(y >= 0 && y < height());
-      return m_rows[y];
-    }
-
-    inline const_address_t getLineAddress(int y) const {
-      ASSERT(y >= 0 && y < height());
-      return m_rows[y];
+    static uint8_t* alignBits(uint8_t* bits, int alignment) {
+      if (alignment > 1) {
+        ASSERT((alignment & (alignment-1)) == 0);
+        std::uintptr_t addr = (std::uintptr_t)bits;
+        addr = (addr + alignment - 1) & ~std::uintptr_t(alignment - 1);
+        bits = (uint8_t*)addr;
+      }
+      return bits;
     }
 
   public:
     inline address_t address(int x, int y) const {
-      return (address_t)(m_rows[y] + x / (Traits::pixels_per_byte == 0 ? 1 : Traits::pixels_per_byte));
+      return getLineAddress(y) + x / (Traits::pixels_per_byte == 0 ? 1 : Traits::pixels_per_byte);
     }
 
+    // If "alignment" is greater than 1 (a power of two), the first
+    // row and the stride of each row are aligned to that number of
+    // bytes (so SIMD kernels can use aligned loads), in other case
+    // rows are contiguous.
     ImageImpl(int width, int height,
-              const ImageBufferPtr& buffer)
+              const ImageBufferPtr& buffer,
+              int alignment = 0)
       : Image(static_cast<PixelFormat>(Traits::pixel_format), width, height)
       , m_buffer(buffer)
+      , m_alignment(alignment)
     {
-      std::size_t for_rows = sizeof(address_t) * height;
-      std::size_t rowstride_bytes = Traits::getRowStrideBytes(width);
-      std::size_t required_size = for_rows + rowstride_bytes*height;
+      std::size_t required_size = get_image_buffer_size(
+        static_cast<PixelFormat>(Traits::pixel_format), width, height, alignment);
 
       if (!m_buffer)
         m_buffer.reset(new ImageBuffer(required_size));
       else
         m_buffer->resizeIfNecessary(required_size);
 
-      m_rows = (address_t*)m_buffer->buffer();
-      m_bits = (address_t)(m_buffer->buffer() + for_rows);
+      setBitsAddress(alignBits(m_buffer->buffer(), alignment),
+                     calculate_rowstride_bytes(
+                       static_cast<PixelFormat>(Traits::pixel_format), width, alignment));
+    }
+
+    // Uses external memory for the pixels (without a buffer).
+    ImageImpl(int width, int height, uint8_t* bits, int rowStride)
+      : Image(static_cast<PixelFormat>(Traits::pixel_format), width, height)
+      , m_alignment(0)
+    {
+      ASSERT(rowStride >= Traits::getRowStrideBytes(width));
+      setBitsAddress(bits, rowStride);
+    }
+
+    // Uses the same buffer of "other" (see Image::createSharedCopy()).
+    // Images that use external memory don't have a buffer to share,
+    // so their pixels are copied.
+    explicit ImageImpl(const ImageImpl* other)
+      : Image(static_cast<PixelFormat>(Traits::pixel_format), other->width(), other->height())
+      , m_buffer(other->m_buffer)
+      , m_alignment(other->m_alignment)
+    {
+      setMaskColor(other->maskColor());
 
-      address_t addr = m_bits;
-      for (int y=0; y<height; ++y) {
-        m_rows[y] = addr;
-        addr = (address_t)(((uint8_t*)addr) + rowstride_bytes);
+      if (m_buffer) {
+        setBitsAddress(other->getBitsAddress(), other->rowStride());
       }
+      else {
+        m_buffer.reset(new ImageBuffer(std::size_t(other->rowStride())*other->height()));
+        std::memcpy(m_buffer->buffer(), other->getBitsAddress(),
+                    std::size_t(other->rowStride())*other->height());
+        setBitsAddress(m_buffer->buffer(), other->rowStride());
+      }
+    }
+
+    bool isBufferShared() const override {
+      return (m_buffer && !m_buffer.unique());
+    }
+
+    void unshareBuffer() override {
+      if (!isBufferShared())
+        return;
+
+      ImageBufferPtr buffer(new ImageBuffer(
+          get_image_buffer_size(
+            static_cast<PixelFormat>(Traits::pixel_format),
+            width(), height(), m_alignment)));
+
+      uint8_t* bits = alignBits(buffer->buffer(), m_alignment);
+      std::memcpy(bits, getBitsAddress(), std::size_t(rowStride())*height());
+
+      m_buffer = buffer;
+      setBitsAddress(bits, rowStride());
     }
 
     uint8_t* getPixelAddress(int x, int y) const override {
@@ -208,13 +256,12 @@ namespace doc {
 
   template<>
   inline void ImageImpl<IndexedTraits>::clear(color_t color) {
-    std::memset(m_bits, color, width()*height());
+    std::memset(getBitsAddress(), color, rowStride()*height());
   }
 
   template<>
   inline void ImageImpl<BitmapTraits>::clear(color_t color) {
-    std::memset(m_bits, (color ? 0xff: 0x00),
-      BitmapTraits::getRowStrideBytes(width()) * height());
+    std::memset(getBitsAddress(), (color ? 0xff: 0x00), rowStride()*height());
   }
 
   template<>
@@ -223,7 +270,7 @@ namespace doc {
     ASSERT(y >= 0 && y < height());
 
     std::div_t d = std::div(x, 8);
-    return ((*(m_rows[y] + d.quot)) & (1<<d.rem)) ? 1: 0;
+    return ((*(getLineAddress(y) + d.quot)) & (1<<d.rem)) ? 1: 0;
   }
 
   template<>
@@ -233,9 +280,9 @@ namespace doc {
 
     std::div_t d = std::div(x, 8);
     if (color)
-      (*(m_rows[y] + d.quot)) |= (1 << d.rem);
+      (*(getLineAddress(y) + d.quot)) |= (1 << d.rem);
     else
-      (*(m_rows[y] + d.quot)) &= ~(1 << d.rem);
+      (*(getLineAddress(y) + d.quot)) &= ~(1 << d.rem);
   }
 
   template<>
@@ -257,23 +304,28 @@ namespace doc {
     if (!area.clip(width(), height(), src->width(), src->height()))
       return;
 
-    // Copy process
-    ImageConstIterator<BitmapTraits> src_it(src, area.srcBounds(), area.src.x, area.src.y);
-    ImageIterator<BitmapTraits> dst_it(this, area.dstBounds(), area.dst.x, area.dst.y);
-
-    int end_x = area.dst.x+area.size.w;
-
+    // Copy process (the bits of each row are shifted to the
+    // destination position)
     for (int end_y=area.dst.y+area.size.h;
          area.dst.y<end_y;
          ++area.dst.y, ++area.src.y) {
-      for (int x=area.dst.x; x<end_x; ++x) {
-        *dst_it = *src_it;
-        ++src_it;
-        ++dst_it;
-      }
+      bitmap_row_copy(getLineAddress(area.dst.y), area.dst.x,
+                      src->getPixelAddress(0, area.src.y), area.src.x,
+                      area.size.w);
     }
   }
 
+  template<>
+  inline void ImageImpl<BitmapTraits>::drawHLine(int x1, int y, int x2, color_t color) {
+    bitmap_row_fill(getLineAddress(y), x1, x2-x1+1, color ? true: false);
+  }
+
+  template<>
+  inline void ImageImpl<BitmapTraits>::fillRect(int x1, int y1, int x2, int y2, color_t color) {
+    for (int y=y1; y<=y2; ++y)
+      bitmap_row_fill(getLineAddress(y), x1, x2-x1+1, color ? true: false);
+  }
+
 } // namespace doc
 
 #endif
@@ -23,9 +23,10 @@ namespace doc {
 using namespace base::serialization;
 using namespace base::serialization::little_endian;
 
-// TODO Create a zlib wrapper for iostreams
+// Size of the buffers used to compress/uncompress pixels
+const std::size_t kBufferSize = 64*1024;
 
-void write_image(std::ostream& os, const Image* image)
+void write_image(std::ostream& os, const Image* image, int compressionLevel)
 {
   write32(os, image->id());
   write8(os, image->pixelFormat());    // Pixel format
@@ -48,17 +49,22 @@ void write_image(std::ostream& os, const Image* image)
     zstream.zalloc = (alloc_func)0;
     zstream.zfree  = (free_func)0;
     zstream.opaque = (voidpf)0;
-    int err = deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+    int err = deflateInit(&zstream, compressionLevel);
     if (err != Z_OK)
       throw base::Exception("ZLib error %d in deflateInit().", err);
 
-    std::vector<uint8_t> compressed(4096);
+    std::vector<uint8_t> compressed(kBufferSize);
     int total_output_bytes = 0;
 
-    for (int y=0; y<image->height(); y++) {
+    // If rows are contiguous in memory, all pixels are given to
+    // deflate() at once
+    const bool contiguous = (image->rowStride() == rowSize);
+    const int rowsPerChunk = (contiguous ? image->height(): 1);
+
+    for (int y=0; y<image->height(); y+=rowsPerChunk) {
       zstream.next_in = (Bytef*)image->getPixelAddress(0, y);
-      zstream.avail_in = rowSize;
-      int flush = (y == image->height()-1 ? Z_FINISH: Z_NO_FLUSH);
+      zstream.avail_in = rowSize*rowsPerChunk;
+      int flush = (y+rowsPerChunk >= image->height() ? Z_FINISH: Z_NO_FLUSH);
 
       do {
         zstream.next_out = (Bytef*)&compressed[0];
@@ -132,7 +138,7 @@ Image* read_image(std::istream& is, bool setId)
     int uncompressed_offset = 0;
     int remain = avail_bytes;
 
-    std::vector<uint8_t> compressed(4096);
+    std::vector<uint8_t> compressed(kBufferSize);
     uint8_t* address = image->getPixelAddress(0, 0);
     uint8_t* address_end = image->getPixelAddress(0, 0) + uncompressed_size;
 
@@ -14,7 +14,9 @@ namespace doc {
 
   class Image;
 
-  void write_image(std::ostream& os, const Image* image);
+  // The compression level is the zlib one (-1 is the default
+  // compression, 1 the fastest one).
+  void write_image(std::ostream& os, const Image* image, int compressionLevel = -1);
   Image* read_image(std::istream& is, bool setId = true);
 
 } // namespace doc
@@ -0,0 +1,36 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_LOADER_H_INCLUDED
+#define DOC_IMAGE_LOADER_H_INCLUDED
+#pragma once
+
+#include "base/shared_ptr.h"
+#include "gfx/size.h"
+
+namespace doc {
+
+  class Image;
+
+  // Creates the image of a cel when it's needed (e.g. decoding its
+  // pixels from a file). It can be called several times if the image
+  // is unloaded to save memory.
+  class ImageLoader {
+  public:
+    virtual ~ImageLoader() { }
+
+    // Size of the image (without loading it)
+    virtual gfx::Size imageSize() const = 0;
+
+    // Returns a new image with the pixels
+    virtual Image* loadImage() = 0;
+  };
+
+  typedef base::SharedPtr<ImageLoader> ImageLoaderRef;
+
+} // namespace doc
+
+#endif
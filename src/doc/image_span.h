@@ -0,0 +1,137 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_SPAN_H_INCLUDED
+#define DOC_IMAGE_SPAN_H_INCLUDED
+#pragma once
+
+#include "doc/image.h"
+#include "doc/image_traits.h"
+#include "gfx/rect.h"
+
+namespace doc {
+
+  // Consecutive pixels of one row of an image. Pixels are accessed
+  // directly (there is no virtual call per pixel), and indexes are
+  // checked with ASSERT() in debug mode.
+  template<typename ImageTraits>
+  class ImageSpan {
+  public:
+    typedef typename ImageTraits::pixel_t pixel_t;
+    typedef pixel_t* iterator;
+
+    ImageSpan(pixel_t* pixels, int size)
+      : m_pixels(pixels), m_size(size) {
+    }
+
+    int size() const { return m_size; }
+    iterator begin() const { return m_pixels; }
+    iterator end() const { return m_pixels + m_size; }
+
+    pixel_t& operator[](int i) const {
+      ASSERT(i >= 0 && i < m_size);
+      return m_pixels[i];
+    }
+
+    pixel_t get(int i) const { return (*this)[i]; }
+    void put(int i, pixel_t color) const { (*this)[i] = color; }
+
+    // Pixels [x, x+w) of this span
+    ImageSpan subspan(int x, int w) const {
+      ASSERT(x >= 0 && w >= 0 && x+w <= m_size);
+      return ImageSpan(m_pixels + x, w);
+    }
+
+  private:
+    pixel_t* m_pixels;
+    int m_size;
+  };
+
+  // Bitmaps have 8 pixels in each byte, so pixels can be accessed
+  // only through get()/put().
+  template<>
+  class ImageSpan<BitmapTraits> {
+  public:
+    typedef BitmapTraits::pixel_t pixel_t;
+
+    ImageSpan(uint8_t* bits, int size, int firstBit = 0)
+      : m_bits(bits), m_size(size), m_firstBit(firstBit) {
+    }
+
+    int size() const { return m_size; }
+
+    pixel_t get(int i) const {
+      ASSERT(i >= 0 && i < m_size);
+      i += m_firstBit;
+      return (m_bits[i / 8] & (1 << (i % 8))) ? 1: 0;
+    }
+
+    void put(int i, pixel_t color) const {
+      ASSERT(i >= 0 && i < m_size);
+      i += m_firstBit;
+      if (color)
+        m_bits[i / 8] |= (1 << (i % 8));
+      else
+        m_bits[i / 8] &= ~(1 << (i % 8));
+    }
+
+    ImageSpan subspan(int x, int w) const {
+      ASSERT(x >= 0 && w >= 0 && x+w <= m_size);
+      x += m_firstBit;
+      return ImageSpan(m_bits + x / 8, w, x % 8);
+    }
+
+  private:
+    uint8_t* m_bits;
+    int m_size;
+    int m_firstBit;
+  };
+
+  template<typename ImageTraits>
+  inline ImageSpan<ImageTraits> Image::row(int y) const {
+    ASSERT(pixelFormat() == ImageTraits::pixel_format);
+    return ImageSpan<ImageTraits>(
+      (typename ImageTraits::pixel_t*)getRowAddress(y), width());
+  }
+
+  template<>
+  inline ImageSpan<BitmapTraits> Image::row<BitmapTraits>(int y) const {
+    ASSERT(pixelFormat() == BitmapTraits::pixel_format);
+    return ImageSpan<BitmapTraits>(getRowAddress(y), width());
+  }
+
+  // Calls f(span, y) for each row of the given bounds of the image,
+  // where "span" contains the pixels [bounds.x, bounds.x2()) of the
+  // row "y".
+  template<typename ImageTraits, typename F>
+  inline void for_each_row(const Image* image, const gfx::Rect& bounds, F&& f)
+  {
+    ASSERT(image->bounds().contains(bounds) || bounds.isEmpty());
+    for (int y=bounds.y; y<bounds.y2(); ++y)
+      f(image->row<ImageTraits>(y).subspan(bounds.x, bounds.w), y);
+  }
+
+  // Dispatches the pixel format of the image only once and calls
+  // f(span, y) for each row of the bounds with the ImageSpan of the
+  // image traits. "f" must be a functor with a template operator()
+  // for all traits, e.g.:
+  //
+  //   template<typename ImageTraits>
+  //   void operator()(const ImageSpan<ImageTraits>& span, int y);
+  template<typename F>
+  inline void for_each_row(const Image* image, const gfx::Rect& bounds, F&& f)
+  {
+    switch (image->pixelFormat()) {
+      case IMAGE_RGB:       for_each_row<RgbTraits>(image, bounds, f); break;
+      case IMAGE_GRAYSCALE: for_each_row<GrayscaleTraits>(image, bounds, f); break;
+      case IMAGE_INDEXED:   for_each_row<IndexedTraits>(image, bounds, f); break;
+      case IMAGE_BITMAP:    for_each_row<BitmapTraits>(image, bounds, f); break;
+    }
+  }
+
+} // namespace doc
+
+#endif
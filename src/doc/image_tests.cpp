@@ -13,6 +13,7 @@
 #include "base/unique_ptr.h"
 #include "doc/image.h"
 #include "doc/image_bits.h"
+#include "doc/image_span.h"
 #include "doc/primitives.h"
 
 using namespace base;
@@ -144,6 +145,84 @@ TEST(Image, DiffRgbImages)
   ASSERT_EQ(2, count_diff_between_images(a, b));
 }
 
+TEST(Image, CreateFromMemory)
+{
+  // 3x2 image in the middle of a 5x4 block of memory
+  std::vector<uint32_t> memory(5*4, 0);
+  UniquePtr<Image> a(Image::createFromMemory(IMAGE_RGB, 3, 2,
+      (uint8_t*)&memory[5+1], 5*4));
+
+  EXPECT_EQ(5*4, a->rowStride());
+  clear_image(a, rgba(1, 2, 3, 4));
+  put_pixel(a, 2, 1, rgba(5, 6, 7, 8));
+
+  EXPECT_EQ(0, memory[5]);
+  EXPECT_EQ(rgba(1, 2, 3, 4), memory[5+1]);
+  EXPECT_EQ(rgba(1, 2, 3, 4), memory[5+3]);
+  EXPECT_EQ(0, memory[5+4]);
+  EXPECT_EQ(rgba(1, 2, 3, 4), memory[10+1]);
+  EXPECT_EQ(rgba(5, 6, 7, 8), memory[10+3]);
+  EXPECT_EQ(0, memory[15+1]);
+
+  // The memory isn't freed by the image
+  a.reset();
+  EXPECT_EQ(rgba(5, 6, 7, 8), memory[10+3]);
+}
+
+TYPED_TEST(ImageAllTypes, SameImage)
+{
+  typedef TypeParam ImageTraits;
+  UniquePtr<Image> a(Image::create(ImageTraits::pixel_format, 13, 5));
+  UniquePtr<Image> b(Image::create(ImageTraits::pixel_format, 13, 5));
+  UniquePtr<Image> c(Image::create(ImageTraits::pixel_format, 5, 13));
+
+  clear_image(a, 0);
+  clear_image(b, 0);
+  clear_image(c, 0);
+  EXPECT_TRUE(is_same_image(a, b));
+  EXPECT_FALSE(is_same_image(a, c));
+
+  put_pixel(a, 12, 4, 1);
+  EXPECT_FALSE(is_same_image(a, b));
+
+  put_pixel(b, 12, 4, 1);
+  EXPECT_TRUE(is_same_image(a, b));
+}
+
+TYPED_TEST(ImageAllTypes, SharedCopy)
+{
+  typedef TypeParam ImageTraits;
+  UniquePtr<Image> a(Image::createAligned(ImageTraits::pixel_format, 13, 5, 32));
+  clear_image(a, 0);
+  put_pixel(a, 3, 2, 1);
+  EXPECT_FALSE(a->isBufferShared());
+
+  UniquePtr<Image> b(Image::createSharedCopy(a));
+  EXPECT_NE(a->id(), b->id());
+  EXPECT_TRUE(a->isBufferShared());
+  EXPECT_TRUE(b->isBufferShared());
+  EXPECT_EQ(a->getRowAddress(0), b->getRowAddress(0));
+  EXPECT_TRUE(is_same_image(a, b));
+
+  // The modified image gets its own pixels
+  b->unshareBuffer();
+  EXPECT_FALSE(a->isBufferShared());
+  EXPECT_FALSE(b->isBufferShared());
+  EXPECT_NE(a->getRowAddress(0), b->getRowAddress(0));
+  EXPECT_EQ(0, (std::uintptr_t)b->getRowAddress(0) & 31);
+  EXPECT_TRUE(is_same_image(a, b));
+
+  put_pixel(b, 12, 4, 1);
+  EXPECT_EQ(0, get_pixel(a, 12, 4));
+  EXPECT_EQ(1, get_pixel(b, 3, 2));
+
+  // Deleting the copy makes the buffer unique again
+  UniquePtr<Image> c(Image::createSharedCopy(a));
+  EXPECT_TRUE(a->isBufferShared());
+  c.reset();
+  EXPECT_FALSE(a->isBufferShared());
+}
+
 TYPED_TEST(ImageAllTypes, DrawHLine)
 {
   typedef TypeParam ImageTraits;
@@ -179,6 +258,104 @@ TYPED_TEST(ImageAllTypes, DrawHLine)
   }
 }
 
+TYPED_TEST(ImageAllTypes, AlignedRows)
+{
+  typedef TypeParam ImageTraits;
+
+  for (int alignment : { 32, 64 }) {
+    for (int w : { 1, 7, 33, 100 }) {
+      const int h = 5;
+      UniquePtr<Image> image(Image::createAligned(ImageTraits::pixel_format, w, h, alignment));
+      UniquePtr<Image> copy(Image::create(ImageTraits::pixel_format, w, h));
+
+      ASSERT_EQ(0, image->rowStride() % alignment);
+      ASSERT_LE(image->getRowStrideSize(), image->rowStride());
+      ASSERT_EQ(copy->getRowStrideSize(), copy->rowStride());
+
+      for (int y=0; y<h; ++y)
+        ASSERT_EQ(0, std::uintptr_t(image->getPixelAddress(0, y)) % alignment);
+
+      clear_image(image, 0);
+      for (int y=0; y<h; ++y)
+        for (int x=0; x<w; ++x)
+          put_pixel(image, x, y, (x+y*3) & ImageTraits::max_value);
+
+      copy_image(copy, image);
+      for (int y=0; y<h; ++y)
+        for (int x=0; x<w; ++x) {
+          ASSERT_EQ((x+y*3) & ImageTraits::max_value, get_pixel(image, x, y));
+          ASSERT_EQ(get_pixel(image, x, y), get_pixel(copy, x, y));
+        }
+
+      int i = 0;
+      const LockImageBits<ImageTraits> bits((const Image*)image.get());
+      for (auto it=bits.begin(), end=bits.end(); it != end; ++it, ++i)
+        ASSERT_EQ((i%w + (i/w)*3) & ImageTraits::max_value, *it);
+      ASSERT_EQ(w*h, i);
+    }
+  }
+}
+
+namespace {
+
+// Counts the pixels of the given color in each row
+struct CountPixels {
+  color_t color;
+  std::vector<int>& counts;
+
+  CountPixels(color_t color, std::vector<int>& counts)
+    : color(color), counts(counts) { }
+
+  template<typename ImageTraits>
+  void operator()(const ImageSpan<ImageTraits>& span, int y) const {
+    for (int i=0; i<span.size(); ++i)
+      if (span.get(i) == color)
+        ++counts[y];
+  }
+};
+
+} // anonymous namespace
+
+TYPED_TEST(ImageAllTypes, RowSpans)
+{
+  typedef TypeParam ImageTraits;
+  const int w = 37, h = 9;
+
+  UniquePtr<Image> image(Image::create(ImageTraits::pixel_format, w, h));
+  image->clear(0);
+
+  for (int y=0; y<h; ++y) {
+    ImageSpan<ImageTraits> span = image->row<ImageTraits>(y);
+    ASSERT_EQ(w, span.size());
+    for (int x=0; x<w; ++x)
+      span.put(x, (x+y) & 1);
+  }
+
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      ASSERT_EQ(color_t((x+y) & 1), get_pixel(image, x, y));
+
+  // Sub-spans (bitmaps don't start in the first bit of a byte)
+  gfx::Rect bounds(3, 2, 21, 5);
+  for_each_row<ImageTraits>(image, bounds,
+    [](const ImageSpan<ImageTraits>& span, int y) {
+      for (int i=0; i<span.size(); ++i)
+        span.put(i, 1);
+    });
+
+  std::vector<int> counts(h, 0);
+  for_each_row(image, image->bounds(), CountPixels(1, counts));
+  for (int y=0; y<h; ++y) {
+    int expected = 0;
+    for (int x=0; x<w; ++x) {
+      color_t c = (bounds.contains(gfx::Point(x, y)) ? 1: color_t((x+y) & 1));
+      EXPECT_EQ(c, get_pixel(image, x, y));
+      expected += c;
+    }
+    EXPECT_EQ(expected, counts[y]);
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
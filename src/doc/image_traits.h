@@ -40,6 +40,12 @@ namespace doc {
       ASSERT(blend_mode >= 0 && blend_mode < BLEND_MODE_MAX);
       return rgba_blenders[blend_mode];
     }
+
+    static inline BLEND_SPAN get_span_blender(int blend_mode)
+    {
+      ASSERT(blend_mode >= 0 && blend_mode < BLEND_MODE_MAX);
+      return rgba_span_blenders[blend_mode];
+    }
   };
 
   struct GrayscaleTraits {
@@ -124,16 +124,22 @@ void LayerImage::destroyAllCels()
 
 Cel* LayerImage::cel(frame_t frame) const
 {
-  CelConstIterator it = getCelBegin();
-  CelConstIterator end = getCelEnd();
-
-  for (; it != end; ++it) {
-    Cel* cel = *it;
-    if (cel->frame() == frame)
-      return cel;
-  }
+  CelConstIterator it = findCel(frame);
+  if (it != getCelEnd() && (*it)->frame() == frame)
+    return *it;
+  else
+    return NULL;
+}
 
-  return NULL;
+// Returns the first cel with a frame >= the given frame (m_cels is
+// sorted by frame).
+CelConstIterator LayerImage::findCel(frame_t frame) const
+{
+  return std::lower_bound(
+    m_cels.begin(), m_cels.end(), frame,
+    [](const Cel* cel, frame_t frame) {
+      return cel->frame() < frame;
+    });
 }
 
 void LayerImage::getCels(CelList& cels) const
@@ -157,17 +163,19 @@ void LayerImage::addCel(Cel* cel)
 {
   ASSERT(cel->data() && "The cel doesn't contain CelData");
 
-  CelIterator it = getCelBegin();
-  CelIterator end = getCelEnd();
-
-  for (; it != end; ++it) {
-    if ((*it)->frame() > cel->frame())
-      break;
-  }
+  // Insert the cel after all cels with a frame <= cel->frame()
+  CelIterator it = std::upper_bound(
+    m_cels.begin(), m_cels.end(), cel->frame(),
+    [](frame_t frame, const Cel* cel) {
+      return frame < cel->frame();
+    });
 
   m_cels.insert(it, cel);
 
   cel->setParentLayer(this);
+
+  if (Sprite* sprite = this->sprite())
+    sprite->indexCel(cel);
 }
 
 /**
@@ -178,7 +186,8 @@ void LayerImage::addCel(Cel* cel)
  */
 void LayerImage::removeCel(Cel* cel)
 {
-  CelIterator it = std::find(m_cels.begin(), m_cels.end(), cel);
+  CelIterator it = m_cels.begin() + (findCel(cel->frame()) - getCelBegin());
+  it = std::find(it, m_cels.end(), cel);
 
   ASSERT(it != m_cels.end());
 
@@ -212,22 +221,51 @@ void LayerImage::configureAsBackground()
   sprite()->folder()->stackLayer(this, NULL);
 }
 
+// All cels from "fromThis" are displaced by the same delta, so they
+// keep their order in m_cels and they can be renumbered in one pass.
 void LayerImage::displaceFrames(frame_t fromThis, frame_t delta)
 {
-  Sprite* sprite = this->sprite();
+  CelIterator it = m_cels.begin() + (findCel(fromThis) - getCelBegin());
 
-  if (delta > 0) {
-    for (frame_t c=sprite->lastFrame(); c>=fromThis; --c) {
-      if (Cel* cel = this->cel(c))
-        moveCel(cel, c+delta);
-    }
+  // The frames where the cels are displaced must be empty
+  ASSERT(delta >= 0 ||
+         it == m_cels.begin() ||
+         (*(it-1))->frame() < fromThis+delta);
+
+  for (; it != m_cels.end(); ++it)
+    (*it)->m_frame += delta;
+}
+
+void LayerImage::moveFrame(frame_t frame, frame_t beforeFrame)
+{
+  frame_t first, last;          // Range of frames that can change [first, last)
+  if (frame < beforeFrame) {
+    first = frame;
+    last = beforeFrame;
   }
-  else {
-    for (frame_t c=fromThis; c<=sprite->lastFrame(); ++c) {
-      if (Cel* cel = this->cel(c))
-        moveCel(cel, c+delta);
-    }
+  else if (beforeFrame < frame) {
+    first = beforeFrame;
+    last = frame+1;
+  }
+  else
+    return;
+
+  CelIterator begin = m_cels.begin() + (findCel(first) - getCelBegin());
+  CelIterator end = m_cels.begin() + (findCel(last) - getCelBegin());
+
+  for (CelIterator it=begin; it != end; ++it) {
+    Cel* cel = *it;
+    if (cel->m_frame == frame)
+      cel->m_frame = (frame < beforeFrame ? beforeFrame-1: beforeFrame);
+    else
+      cel->m_frame += (frame < beforeFrame ? -1: +1);
   }
+
+  // Only cels in the range can be unsorted now
+  std::sort(begin, end,
+            [](const Cel* a, const Cel* b) {
+              return a->frame() < b->frame();
+            });
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -283,6 +321,9 @@ void LayerFolder::addLayer(Layer* layer)
 {
   m_layers.push_back(layer);
   layer->setParent(this);
+
+  if (sprite())
+    sprite()->invalidateLayersIndex();
 }
 
 void LayerFolder::removeLayer(Layer* layer)
@@ -292,6 +333,9 @@ void LayerFolder::removeLayer(Layer* layer)
   m_layers.erase(it);
 
   layer->setParent(NULL);
+
+  if (sprite())
+    sprite()->invalidateLayersIndex();
 }
 
 void LayerFolder::stackLayer(Layer* layer, Layer* after)
@@ -312,6 +356,9 @@ void LayerFolder::stackLayer(Layer* layer, Layer* after)
   }
   else
     m_layers.push_front(layer);
+
+  if (sprite())
+    sprite()->invalidateLayersIndex();
 }
 
 void LayerFolder::displaceFrames(frame_t fromThis, frame_t delta)
@@ -320,4 +367,10 @@ void LayerFolder::displaceFrames(frame_t fromThis, frame_t delta)
     layer->displaceFrames(fromThis, delta);
 }
 
+void LayerFolder::moveFrame(frame_t frame, frame_t beforeFrame)
+{
+  for (Layer* layer : m_layers)
+    layer->moveFrame(frame, beforeFrame);
+}
+
 } // namespace doc
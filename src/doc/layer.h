@@ -96,6 +96,10 @@ namespace doc {
     virtual void getCels(CelList& cels) const = 0;
     virtual void displaceFrames(frame_t fromThis, frame_t delta) = 0;
 
+    // Moves the cels of the given frame before "beforeFrame" (cels
+    // between both frames are moved one frame to fill the gap).
+    virtual void moveFrame(frame_t frame, frame_t beforeFrame) = 0;
+
   private:
     std::string m_name;           // layer name
     Sprite* m_sprite;             // owner of the layer
@@ -124,6 +128,7 @@ namespace doc {
     Cel* cel(frame_t frame) const override;
     void getCels(CelList& cels) const override;
     void displaceFrames(frame_t fromThis, frame_t delta) override;
+    void moveFrame(frame_t frame, frame_t beforeFrame) override;
     Cel* getLastCel() const;
 
     void configureAsBackground();
@@ -134,6 +139,10 @@ namespace doc {
     CelConstIterator getCelEnd() const { return m_cels.end(); }
     int getCelsCount() const { return (int)m_cels.size(); }
 
+    // Returns the first cel with a frame >= the given frame (e.g. to
+    // iterate the cels of a range of frames).
+    CelConstIterator findCel(frame_t frame) const;
+
   private:
     void destroyAllCels();
 
@@ -166,6 +175,7 @@ namespace doc {
 
     void getCels(CelList& cels) const override;
     void displaceFrames(frame_t fromThis, frame_t delta) override;
+    void moveFrame(frame_t frame, frame_t beforeFrame) override;
 
   private:
     void destroyAllLayers();
@@ -11,8 +11,10 @@
 #include "doc/mask.h"
 
 #include "base/memory.h"
+#include "base/thread_pool.h"
+#include "doc/algorithm/color_range.h"
+#include "doc/bitmap_ops.h"
 #include "doc/image.h"
-#include "doc/image_bits.h"
 
 #include <cstdlib>
 #include <cstring>
@@ -41,6 +43,15 @@ void Mask::initialize()
 {
   m_freeze_count = 0;
   m_bounds = gfx::Rect(0, 0, 0, 0);
+  m_rectangular = false;
+}
+
+void Mask::createRectangularBitmap() const
+{
+  if (m_rectangular && !m_bitmap) {
+    m_bitmap.reset(Image::create(IMAGE_BITMAP, m_bounds.w, m_bounds.h, m_buffer));
+    clear_image(m_bitmap.get(), 1);
+  }
 }
 
 int Mask::getMemSize() const
@@ -71,14 +82,16 @@ void Mask::unfreeze()
 
 bool Mask::isRectangular() const
 {
+  if (m_rectangular)
+    return true;
+
   if (!m_bitmap)
     return false;
 
-  LockImageBits<BitmapTraits> bits(m_bitmap.get());
-  LockImageBits<BitmapTraits>::iterator it = bits.begin(), end = bits.end();
-
-  for (; it != end; ++it) {
-    if (*it == 0)
+  // Look for unselected pixels (64 pixels at once)
+  for (int y=0; y<m_bounds.h; ++y) {
+    const uint8_t* row = m_bitmap->getPixelAddress(0, y);
+    if (bitmap_row_find(row, 0, m_bounds.w, false) != m_bounds.w)
       return false;
   }
 
@@ -90,12 +103,15 @@ void Mask::copyFrom(const Mask* sourceMask)
   clear();
   setName(sourceMask->name().c_str());
 
-  if (sourceMask->bitmap()) {
+  if (sourceMask->m_rectangular) {
+    replace(sourceMask->bounds());
+  }
+  else if (sourceMask->m_bitmap) {
     // Add all the area of "mask"
     add(sourceMask->bounds());
 
     // And copy the "mask" bitmap
-    copy_image(m_bitmap.get(), sourceMask->m_bitmap.get());
+    copy_image(bitmap(), sourceMask->m_bitmap.get());
   }
 }
 
@@ -108,34 +124,54 @@ void Mask::clear()
 {
   m_bitmap.reset();
   m_bounds = gfx::Rect(0, 0, 0, 0);
+  m_rectangular = false;
 }
 
 void Mask::invert()
 {
-  if (!m_bitmap)
+  // Nothing is selected inside the bounds of a rectangle
+  if (m_rectangular && m_freeze_count == 0) {
+    clear();
     return;
+  }
 
-  LockImageBits<BitmapTraits> bits(m_bitmap.get());
-  LockImageBits<BitmapTraits>::iterator it = bits.begin(), end = bits.end();
+  if (isEmpty())
+    return;
 
-  for (; it != end; ++it)
-    *it = (*it ? 0: 1);
+  bitmap();                     // The bitmap is modified
+  bitmap_invert(m_bitmap.get());
 
   shrink();
 }
 
 void Mask::replace(const gfx::Rect& bounds)
 {
-  m_bounds = bounds;
+  if (bounds.isEmpty()) {
+    clear();
+    return;
+  }
 
-  m_bitmap.reset(Image::create(IMAGE_BITMAP, bounds.w, bounds.h, m_buffer));
-  clear_image(m_bitmap.get(), 1);
+  // The bitmap is created when it's needed
+  m_bounds = bounds;
+  m_bitmap.reset();
+  m_rectangular = true;
 }
 
 void Mask::add(const gfx::Rect& bounds)
 {
-  if (m_freeze_count == 0)
+  if (m_freeze_count == 0) {
+    // Keep the mask as a rectangle if it's possible
+    if (isEmpty() || (m_rectangular && bounds.contains(m_bounds))) {
+      replace(bounds);
+      return;
+    }
+    else if (m_rectangular && m_bounds.contains(bounds))
+      return;
+
     reserve(bounds);
+  }
+  else
+    bitmap();                   // The bitmap is modified
 
   fill_rect(m_bitmap.get(),
     bounds.x-m_bounds.x,
@@ -146,9 +182,45 @@ void Mask::add(const gfx::Rect& bounds)
 
 void Mask::subtract(const gfx::Rect& bounds)
 {
-  if (!m_bitmap)
+  if (isEmpty())
     return;
 
+  if (m_rectangular) {
+    gfx::Rect r = m_bounds.createIntersection(bounds);
+    if (r.isEmpty())
+      return;
+
+    // The result is a rectangle if the subtracted area covers whole
+    // rows or columns at one side of the rectangle.
+    gfx::Rect newBounds = m_bounds;
+    if (r.x == m_bounds.x && r.w == m_bounds.w) {
+      if (r.y == m_bounds.y)
+        newBounds = gfx::Rect(m_bounds.x, r.y2(), m_bounds.w, m_bounds.y2()-r.y2());
+      else if (r.y2() == m_bounds.y2())
+        newBounds = gfx::Rect(m_bounds.x, m_bounds.y, m_bounds.w, r.y-m_bounds.y);
+    }
+    else if (r.y == m_bounds.y && r.h == m_bounds.h) {
+      if (r.x == m_bounds.x)
+        newBounds = gfx::Rect(r.x2(), m_bounds.y, m_bounds.x2()-r.x2(), m_bounds.h);
+      else if (r.x2() == m_bounds.x2())
+        newBounds = gfx::Rect(m_bounds.x, m_bounds.y, r.x-m_bounds.x, m_bounds.h);
+    }
+
+    if (newBounds != m_bounds) {
+      if (m_freeze_count == 0)
+        replace(newBounds);
+      else {
+        // Frozen masks keep their bounds
+        bitmap();
+        fill_rect(m_bitmap.get(),
+          r.x-m_bounds.x, r.y-m_bounds.y,
+          r.x-m_bounds.x+r.w-1, r.y-m_bounds.y+r.h-1, 0);
+      }
+      return;
+    }
+  }
+
+  bitmap();                     // The bitmap is modified
   fill_rect(m_bitmap.get(),
     bounds.x-m_bounds.x,
     bounds.y-m_bounds.y,
@@ -160,11 +232,16 @@ void Mask::subtract(const gfx::Rect& bounds)
 
 void Mask::intersect(const gfx::Rect& bounds)
 {
-  if (!m_bitmap)
+  if (isEmpty())
     return;
 
   gfx::Rect newBounds = m_bounds.createIntersection(bounds);
 
+  if (m_rectangular) {
+    replace(newBounds);
+    return;
+  }
+
   Image* image = NULL;
 
   if (!newBounds.isEmpty()) {
@@ -183,105 +260,31 @@ void Mask::intersect(const gfx::Rect& bounds)
 
 void Mask::byColor(const Image *src, int color, int fuzziness)
 {
-  replace(src->bounds());
-
-  Image* dst = m_bitmap.get();
-
-  switch (src->pixelFormat()) {
-
-    case IMAGE_RGB: {
-      const LockImageBits<RgbTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<RgbTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      int src_r, src_g, src_b, src_a;
-      int dst_r, dst_g, dst_b, dst_a;
-      color_t c;
-
-      dst_r = rgba_getr(color);
-      dst_g = rgba_getg(color);
-      dst_b = rgba_getb(color);
-      dst_a = rgba_geta(color);
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        src_r = rgba_getr(c);
-        src_g = rgba_getg(c);
-        src_b = rgba_getb(c);
-        src_a = rgba_geta(c);
-
-        if (!((src_r >= dst_r-fuzziness) && (src_r <= dst_r+fuzziness) &&
-              (src_g >= dst_g-fuzziness) && (src_g <= dst_g+fuzziness) &&
-              (src_b >= dst_b-fuzziness) && (src_b <= dst_b+fuzziness) &&
-              (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
-
-    case IMAGE_GRAYSCALE: {
-      const LockImageBits<GrayscaleTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<GrayscaleTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      int src_k, src_a;
-      int dst_k, dst_a;
-      color_t c;
-
-      dst_k = graya_getv(color);
-      dst_a = graya_geta(color);
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        src_k = graya_getv(c);
-        src_a = graya_geta(c);
-
-        if (!((src_k >= dst_k-fuzziness) && (src_k <= dst_k+fuzziness) &&
-              (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
-
-    case IMAGE_INDEXED: {
-      const LockImageBits<IndexedTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<IndexedTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      color_t c, min, max;
+  if (fuzziness < 0) {
+    clear();
+    return;
+  }
 
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
+  replace(src->bounds());
 
-        if (color > fuzziness)
-          min = color-fuzziness;
-        else
-          min = 0;
-        max = color + fuzziness;
-
-        if (!((c >= min) && (c <= max)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
-  }
+  Image* dst = bitmap();
+  const int w = src->width();
+  const int h = src->height();
+
+  // Each band of rows writes its own bytes of the bitmap, so they can
+  // be processed in parallel (bands of at least 64K pixels).
+  const int bandRows = MAX(1, 65536 / MAX(1, w));
+  const int bands = (h + bandRows - 1) / bandRows;
+
+  base::thread_pool::global().parallel_for(
+    bands, [=](int band) {
+      int y = band * bandRows;
+      int y2 = MIN(y + bandRows, h);
+      for (; y<y2; ++y)
+        algorithm::row_in_color_range(
+          src, 0, y, w, color, fuzziness, false,
+          (uint8_t*)dst->getPixelAddress(0, y));
+    });
 
   shrink();
 }
@@ -313,7 +316,7 @@ void Mask::crop(const Image *image)
   int done;
   color_t old_color;
 
-  if (!m_bitmap)
+  if (isEmpty())
     return;
 
   beg_x1 = m_bounds.x;
@@ -355,6 +358,9 @@ void Mask::reserve(const gfx::Rect& bounds)
 {
   ASSERT(!bounds.isEmpty());
 
+  // The reserved area will be modified
+  bitmap();
+
   if (!m_bitmap) {
     m_bounds = bounds;
     m_bitmap.reset(Image::create(IMAGE_BITMAP, bounds.w, bounds.h, m_buffer));
@@ -381,58 +387,31 @@ void Mask::shrink()
   if (m_freeze_count > 0)
     return;
 
-#define SHRINK_SIDE(u_begin, u_op, u_final, u_add,                      \
-                    v_begin, v_op, v_final, v_add, U, V, var)           \
-  {                                                                     \
-    for (u = u_begin; u u_op u_final; u u_add) {                        \
-      for (v = v_begin; v v_op v_final; v v_add) {                      \
-        if (m_bitmap->getPixel(U, V))                                   \
-          break;                                                        \
-      }                                                                 \
-      if (v == v_final)                                                 \
-        var;                                                            \
-      else                                                              \
-        break;                                                          \
-    }                                                                   \
-  }
-
-  int u, v, x1, y1, x2, y2;
-
-  x1 = m_bounds.x;
-  y1 = m_bounds.y;
-  x2 = m_bounds.x+m_bounds.w-1;
-  y2 = m_bounds.y+m_bounds.h-1;
-
-  SHRINK_SIDE(0, <, m_bounds.w, ++,
-              0, <, m_bounds.h, ++, u, v, x1++);
-
-  SHRINK_SIDE(0, <, m_bounds.h, ++,
-              0, <, m_bounds.w, ++, v, u, y1++);
-
-  SHRINK_SIDE(m_bounds.w-1, >, 0, --,
-              0, <, m_bounds.h, ++, u, v, x2--);
-
-  SHRINK_SIDE(m_bounds.h-1, >, 0, --,
-              0, <, m_bounds.w, ++, v, u, y2--);
+  // Rectangles are already shrunk
+  if (m_rectangular || !m_bitmap)
+    return;
 
-  if ((x1 > x2) || (y1 > y2)) {
+  if (m_bounds.isEmpty()) {
     clear();
+    return;
   }
-  else if ((x1 != m_bounds.x) || (x2 != m_bounds.x+m_bounds.w-1) ||
-           (y1 != m_bounds.y) || (y2 != m_bounds.y+m_bounds.h-1)) {
-    u = m_bounds.x;
-    v = m_bounds.y;
 
-    m_bounds.x = x1;
-    m_bounds.y = y1;
-    m_bounds.w = x2 - x1 + 1;
-    m_bounds.h = y2 - y1 + 1;
+  // Bounds of the selected pixels (skipping empty words)
+  gfx::Rect bounds = bitmap_bounds(m_bitmap.get());
+  if (bounds.isEmpty()) {
+    clear();
+    return;
+  }
 
-    Image* image = crop_image(m_bitmap.get(), m_bounds.x-u, m_bounds.y-v, m_bounds.w, m_bounds.h, 0);
+  if (bounds != m_bitmap->bounds()) {
+    Image* image = crop_image(m_bitmap.get(), bounds.x, bounds.y, bounds.w, bounds.h, 0);
     m_bitmap.reset(image);
-  }
 
-#undef SHRINK_SIDE
+    m_bounds.x += bounds.x;
+    m_bounds.y += bounds.y;
+    m_bounds.w = bounds.w;
+    m_bounds.h = bounds.h;
+  }
 }
 
 } // namespace doc
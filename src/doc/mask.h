@@ -20,6 +20,11 @@
 namespace doc {
 
   // Represents the selection (selected pixels, 0/1, 0=non-selected, 1=selected)
+  //
+  // Rectangular selections (e.g. Select All, or a rectangle
+  // intersected/subtracted with other rectangles) are kept just as
+  // bounds, and the bitmap is created the first time it's requested,
+  // so they don't allocate/scan huge bitmaps on big sprites.
   class Mask : public Object {
   public:
     Mask();
@@ -31,20 +36,33 @@ namespace doc {
     void setName(const char *name);
     const std::string& name() const { return m_name; }
 
-    const Image* bitmap() const { return m_bitmap.get(); }
-    Image* bitmap() { return m_bitmap.get(); }
+    // Returns the bitmap of the mask (creating it if the mask is
+    // just a rectangle). The non-const version assumes that the
+    // bitmap will be modified.
+    const Image* bitmap() const {
+      createRectangularBitmap();
+      return m_bitmap.get();
+    }
+    Image* bitmap() {
+      createRectangularBitmap();
+      m_rectangular = false;
+      return m_bitmap.get();
+    }
 
     // Returns true if the mask is completely empty (i.e. nothing
     // selected)
     bool isEmpty() const {
-      return (!m_bitmap ? true: false);
+      return (!m_bitmap && !m_rectangular);
     }
 
     // Returns true if the point is inside the mask
     bool containsPoint(int u, int v) const {
-      return (m_bitmap.get() &&
-              u >= m_bounds.x && u < m_bounds.x+m_bounds.w &&
-              v >= m_bounds.y && v < m_bounds.y+m_bounds.h &&
+      if (isEmpty() ||
+          u < m_bounds.x || u >= m_bounds.x+m_bounds.w ||
+          v < m_bounds.y || v >= m_bounds.y+m_bounds.h)
+        return false;
+
+      return (m_rectangular ||
               get_pixel(m_bitmap.get(), u-m_bounds.x, v-m_bounds.y));
     }
 
@@ -99,12 +117,14 @@ namespace doc {
 
   private:
     void initialize();
+    void createRectangularBitmap() const;
 
     int m_freeze_count;
     std::string m_name;           // Mask name
     gfx::Rect m_bounds;           // Region bounds
-    ImageRef m_bitmap;            // Bitmapped image mask
-    ImageBufferPtr m_buffer;      // Buffer used in m_bitmap
+    bool m_rectangular;           // True if all pixels in m_bounds are selected
+    mutable ImageRef m_bitmap;    // Bitmapped image mask (can be NULL if m_rectangular)
+    mutable ImageBufferPtr m_buffer; // Buffer used in m_bitmap
 
     Mask& operator=(const Mask& mask);
   };
@@ -0,0 +1,204 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+
+using namespace doc;
+
+// Compares the selected pixels of both masks in the given area
+static void expect_same_pixels(const Mask& a, const Mask& b, const gfx::Rect& area)
+{
+  for (int y=area.y; y<area.y2(); ++y)
+    for (int x=area.x; x<area.x2(); ++x)
+      EXPECT_EQ(a.containsPoint(x, y), b.containsPoint(x, y)) << x << "," << y;
+}
+
+TEST(Mask, RectangleDoesntCreateBitmap)
+{
+  Mask mask;
+  EXPECT_TRUE(mask.isEmpty());
+
+  mask.replace(gfx::Rect(0, 0, 100000, 100000));
+  EXPECT_FALSE(mask.isEmpty());
+  EXPECT_TRUE(mask.isRectangular());
+  EXPECT_TRUE(mask.containsPoint(99999, 99999));
+  EXPECT_FALSE(mask.containsPoint(100000, 0));
+  EXPECT_LT(mask.getMemSize(), 1024);
+
+  mask.intersect(gfx::Rect(10, 20, 30, 40));
+  EXPECT_EQ(gfx::Rect(10, 20, 30, 40), mask.bounds());
+  EXPECT_TRUE(mask.isRectangular());
+
+  mask.subtract(gfx::Rect(0, 0, 20, 100));
+  EXPECT_EQ(gfx::Rect(20, 20, 20, 40), mask.bounds());
+  EXPECT_TRUE(mask.isRectangular());
+
+  mask.subtract(gfx::Rect(0, 50, 100, 100));
+  EXPECT_EQ(gfx::Rect(20, 20, 20, 30), mask.bounds());
+  EXPECT_TRUE(mask.isRectangular());
+
+  mask.subtract(mask.bounds());
+  EXPECT_TRUE(mask.isEmpty());
+}
+
+TEST(Mask, RectangleBitmap)
+{
+  Mask mask;
+  mask.replace(gfx::Rect(2, 3, 13, 5));
+
+  const Mask& constMask = mask;
+  const Image* bitmap = constMask.bitmap();
+  ASSERT_TRUE(bitmap != NULL);
+  EXPECT_EQ(13, bitmap->width());
+  EXPECT_EQ(5, bitmap->height());
+  for (int y=0; y<5; ++y)
+    for (int x=0; x<13; ++x)
+      EXPECT_EQ(1, get_pixel(bitmap, x, y));
+  EXPECT_TRUE(mask.isRectangular());
+
+  // The non-const bitmap can be modified
+  put_pixel(mask.bitmap(), 0, 0, 0);
+  EXPECT_FALSE(mask.isRectangular());
+  EXPECT_FALSE(mask.containsPoint(2, 3));
+  EXPECT_TRUE(mask.containsPoint(3, 3));
+}
+
+TEST(Mask, RectangleOpsMatchBitmapOps)
+{
+  const gfx::Rect area(-5, -5, 60, 60);
+  const gfx::Rect rects[] = {
+    gfx::Rect(10, 10, 20, 20),
+    gfx::Rect(0, 0, 50, 50),
+    gfx::Rect(15, 0, 5, 50),
+    gfx::Rect(10, 10, 20, 5),
+    gfx::Rect(25, 10, 10, 20),
+    gfx::Rect(12, 12, 4, 4),
+  };
+
+  for (const gfx::Rect& base : rects) {
+    for (const gfx::Rect& rc : rects) {
+      for (int op=0; op<3; ++op) {
+        // "a" is a rectangle (without bitmap), "b" uses a bitmap
+        Mask a, b;
+        a.replace(base);
+        b.replace(base);
+        b.bitmap();
+        EXPECT_FALSE(b.isRectangular() && b.bounds() != base);
+
+        switch (op) {
+          case 0: a.add(rc); b.add(rc); break;
+          case 1: a.subtract(rc); b.subtract(rc); break;
+          case 2: a.intersect(rc); b.intersect(rc); break;
+        }
+
+        EXPECT_EQ(b.isEmpty(), a.isEmpty());
+        EXPECT_EQ(b.bounds(), a.bounds());
+        expect_same_pixels(a, b, area);
+
+        Mask c(a);
+        expect_same_pixels(a, c, area);
+        EXPECT_EQ(a.bounds(), c.bounds());
+      }
+    }
+  }
+}
+
+TEST(Mask, ShrinkBitmap)
+{
+  Mask mask;
+  mask.replace(gfx::Rect(0, 0, 37, 21));
+  mask.subtract(gfx::Rect(0, 0, 37, 21));
+  EXPECT_TRUE(mask.isEmpty());
+
+  mask.replace(gfx::Rect(0, 0, 37, 21));
+  mask.subtract(gfx::Rect(1, 1, 35, 19));
+  mask.subtract(gfx::Rect(0, 0, 37, 3));
+  mask.subtract(gfx::Rect(0, 18, 37, 3));
+  mask.subtract(gfx::Rect(0, 0, 4, 21));
+  // Only the right column from y=3 to y=17 is selected
+  EXPECT_EQ(gfx::Rect(36, 3, 1, 15), mask.bounds());
+  EXPECT_TRUE(mask.containsPoint(36, 10));
+  EXPECT_TRUE(mask.isRectangular());
+
+  mask.invert();
+  EXPECT_TRUE(mask.isEmpty());
+}
+
+TEST(Mask, ByColor)
+{
+  const PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED };
+  const int fuzziness[] = { 0, 1, 16, 255 };
+
+  std::srand(1);
+  for (PixelFormat format : formats) {
+    // The width isn't a multiple of 8 or 16 to test incomplete bytes
+    ImageRef image(Image::create(format, 45, 19));
+    color_t color = 0;
+    for (int y=0; y<image->height(); ++y) {
+      for (int x=0; x<image->width(); ++x) {
+        int v = 100 + (std::rand() % 32);
+        int a = (std::rand() % 4 ? 255: 0);
+        color_t c;
+        switch (format) {
+          case IMAGE_RGB: c = rgba(v, v/2, 255-v, a); break;
+          case IMAGE_GRAYSCALE: c = graya(v, a); break;
+          default: c = v; break;
+        }
+        put_pixel(image.get(), x, y, c);
+        if (x == 20 && y == 10)
+          color = c;
+      }
+    }
+
+    for (int fuzz : fuzziness) {
+      Mask mask;
+      mask.byColor(image.get(), color, fuzz);
+
+      for (int y=0; y<image->height(); ++y) {
+        for (int x=0; x<image->width(); ++x) {
+          color_t c = get_pixel(image.get(), x, y);
+          bool expected;
+          switch (format) {
+            case IMAGE_RGB:
+              expected =
+                (std::abs(int(rgba_getr(c)) - int(rgba_getr(color))) <= fuzz &&
+                 std::abs(int(rgba_getg(c)) - int(rgba_getg(color))) <= fuzz &&
+                 std::abs(int(rgba_getb(c)) - int(rgba_getb(color))) <= fuzz &&
+                 std::abs(int(rgba_geta(c)) - int(rgba_geta(color))) <= fuzz);
+              break;
+            case IMAGE_GRAYSCALE:
+              expected =
+                (std::abs(int(graya_getv(c)) - int(graya_getv(color))) <= fuzz &&
+                 std::abs(int(graya_geta(c)) - int(graya_geta(color))) <= fuzz);
+              break;
+            default:
+              expected = (std::abs(int(c) - int(color)) <= fuzz);
+              break;
+          }
+          EXPECT_EQ(expected, mask.containsPoint(x, y))
+            << "format=" << format << " fuzz=" << fuzz << " " << x << "," << y;
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
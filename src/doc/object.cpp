@@ -13,14 +13,62 @@
 #include "base/mutex.h"
 #include "base/scoped_lock.h"
 
-#include <map>
+#include <atomic>
 
 namespace doc {
 
-static base::mutex mutex;
-static ObjectId newId = 0;
-// TODO Profile this and see if an unordered_map works best.
-static std::map<ObjectId, Object*> objects;
+namespace {
+
+// Table of objects indexed by ID. Each ID is split in three parts to
+// index the root, a middle page, and a leaf page with the object
+// pointers. Pages are created on demand (with the mutex locked) and
+// never deleted, so get_object() can read the table from any thread
+// without locking.
+const int kLeafBits = 12;
+const int kMidBits = 10;
+const int kRootBits = 32 - kMidBits - kLeafBits;
+
+typedef std::atomic<Object*> ObjectSlot;
+
+struct LeafPage {
+  ObjectSlot slots[1 << kLeafBits];
+};
+
+struct MidPage {
+  std::atomic<LeafPage*> leaves[1 << kMidBits];
+};
+
+base::mutex mutex;
+ObjectId newId = 0;
+std::atomic<MidPage*> root[1 << kRootBits];
+
+// Returns the slot of the given ID, or nullptr if the page for this
+// ID wasn't created yet and "create" is false. The mutex must be
+// locked to create pages.
+ObjectSlot* find_slot(ObjectId id, bool create)
+{
+  std::atomic<MidPage*>& midRef = root[id >> (kMidBits + kLeafBits)];
+  MidPage* mid = midRef.load(std::memory_order_acquire);
+  if (!mid) {
+    if (!create)
+      return nullptr;
+    mid = new MidPage();
+    midRef.store(mid, std::memory_order_release);
+  }
+
+  std::atomic<LeafPage*>& leafRef = mid->leaves[(id >> kLeafBits) & ((1 << kMidBits) - 1)];
+  LeafPage* leaf = leafRef.load(std::memory_order_acquire);
+  if (!leaf) {
+    if (!create)
+      return nullptr;
+    leaf = new LeafPage();
+    leafRef.store(leaf, std::memory_order_release);
+  }
+
+  return &leaf->slots[id & ((1 << kLeafBits) - 1)];
+}
+
+} // anonymous namespace
 
 Object::Object(ObjectType type)
   : m_type(type)
@@ -50,32 +98,37 @@ int Object::getMemSize() const
 const ObjectId Object::id() const
 {
   // The first time the ID is request, we store the object in the
-  // "objects" hash table.
+  // objects table.
   if (!m_id) {
-    base::scoped_unlock hold(mutex);
-    m_id = ++newId;
-    objects.insert(std::make_pair(m_id, const_cast<Object*>(this)));
+    base::scoped_lock hold(mutex);
+    if (!m_id) {
+      ObjectId id = ++newId;
+      find_slot(id, true)->store(const_cast<Object*>(this),
+                                 std::memory_order_release);
+      m_id = id;
+    }
   }
   return m_id;
 }
 
 void Object::setId(ObjectId id)
 {
-  base::scoped_unlock hold(mutex);
+  base::scoped_lock hold(mutex);
 
   if (m_id) {
-    auto it = objects.find(m_id);
-    ASSERT(it != objects.end());
-    ASSERT(it->second == this);
-    if (it != objects.end())
-      objects.erase(it);
+    ObjectSlot* slot = find_slot(m_id, false);
+    ASSERT(slot);
+    ASSERT(slot->load() == this);
+    if (slot)
+      slot->store(nullptr, std::memory_order_release);
   }
 
   m_id = id;
 
   if (m_id) {
-    ASSERT(objects.find(m_id) == objects.end());
-    objects.insert(std::make_pair(m_id, this));
+    ObjectSlot* slot = find_slot(m_id, true);
+    ASSERT(slot->load() == nullptr);
+    slot->store(this, std::memory_order_release);
   }
 }
 
@@ -86,10 +139,12 @@ void Object::setVersion(ObjectVersion version)
 
 Object* get_object(ObjectId id)
 {
-  base::scoped_unlock hold(mutex);
-  auto it = objects.find(id);
-  if (it != objects.end())
-    return it->second;
+  if (!id)
+    return nullptr;
+
+  ObjectSlot* slot = find_slot(id, false);
+  if (slot)
+    return slot->load(std::memory_order_acquire);
   else
     return nullptr;
 }
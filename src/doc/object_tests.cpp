@@ -0,0 +1,77 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/object.h"
+
+using namespace doc;
+
+class TestObject : public Object {
+public:
+  TestObject() : Object(ObjectType::Image) { }
+};
+
+TEST(Object, GetObjectById)
+{
+  EXPECT_EQ(nullptr, get_object(NullId));
+
+  TestObject a, b;
+  ObjectId aId = a.id();
+  ObjectId bId = b.id();
+  EXPECT_NE(NullId, aId);
+  EXPECT_NE(aId, bId);
+  EXPECT_EQ(&a, get<TestObject>(aId));
+  EXPECT_EQ(&b, get<TestObject>(bId));
+
+  {
+    TestObject c;
+    ObjectId cId = c.id();
+    EXPECT_EQ(&c, get_object(cId));
+    c.setId(NullId);
+    EXPECT_EQ(nullptr, get_object(cId));
+    c.setId(cId);
+    EXPECT_EQ(&c, get_object(cId));
+  }
+}
+
+TEST(Object, DestroyedObjectsAreRemoved)
+{
+  ObjectId id;
+  {
+    TestObject a;
+    id = a.id();
+  }
+  EXPECT_EQ(nullptr, get_object(id));
+}
+
+TEST(Object, SetIdOfRestoredObjects)
+{
+  // IDs from other sessions (e.g. restored from a crash backup) can
+  // be anywhere in the ID range.
+  ObjectId ids[] = { 0x00400000, 0x7fffffff, 0xffffffff };
+  for (ObjectId id : ids) {
+    EXPECT_EQ(nullptr, get_object(id));
+
+    TestObject a;
+    a.setId(id);
+    EXPECT_EQ(id, a.id());
+    EXPECT_EQ(&a, get_object(id));
+    EXPECT_EQ(nullptr, get_object(id-1));
+  }
+  for (ObjectId id : ids)
+    EXPECT_EQ(nullptr, get_object(id));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -14,7 +14,6 @@
 #include "doc/remap.h"
 
 #include <algorithm>
-#include <limits>
 
 namespace doc {
 
@@ -37,6 +36,7 @@ Palette::Palette(const Palette& palette)
 {
   m_frame = palette.m_frame;
   m_colors = palette.m_colors;
+  m_index = palette.m_index;
   m_modifications = 0;
 }
 
@@ -78,6 +78,7 @@ void Palette::resize(int ncolors)
               rgba(0, 0, 0, 255));
   }
 
+  m_index.reset(m_colors);
   ++m_modifications;
 }
 
@@ -98,6 +99,7 @@ void Palette::setEntry(int i, color_t color)
 {
   ASSERT(i >= 0 && i < size());
 
+  m_index.update(i, m_colors[i], color);
   m_colors[i] = color;
   ++m_modifications;
 }
@@ -105,6 +107,7 @@ void Palette::setEntry(int i, color_t color)
 void Palette::copyColorsTo(Palette* dst) const
 {
   dst->m_colors = m_colors;
+  dst->m_index = m_index;
   ++dst->m_modifications;
 }
 
@@ -146,6 +149,7 @@ bool Palette::isBlack() const
 void Palette::makeBlack()
 {
   std::fill(m_colors.begin(), m_colors.end(), rgba(0, 0, 0, 255));
+  m_index.reset(m_colors);
   ++m_modifications;
 }
 
@@ -258,67 +262,21 @@ int Palette::findExactMatch(int r, int g, int b) const
   return -1;
 }
 
-//////////////////////////////////////////////////////////////////////
-// Based on Allegro's bestfit_color
-
-static unsigned int col_diff[3*128];
-
-static void bestfit_init()
+int Palette::findBestfit(int r, int g, int b, int mask_index) const
 {
-  int i, k;
-
-  for (i=1; i<64; i++) {
-    k = i * i;
-    col_diff[0  +i] = col_diff[0  +128-i] = k * (59 * 59);
-    col_diff[128+i] = col_diff[128+128-i] = k * (30 * 30);
-    col_diff[256+i] = col_diff[256+128-i] = k * (11 * 11);
-  }
+  return findBestfit(r, g, b, mask_index, 5);
 }
 
-int Palette::findBestfit(int r, int g, int b, int mask_index) const
+int Palette::findBestfit(int r, int g, int b, int mask_index, int bits) const
 {
-#ifdef __GNUC__
-  register int bestfit asm("%eax");
-#else
-  register int bestfit;
-#endif
-  int i, coldiff, lowest;
-
   ASSERT(r >= 0 && r <= 255);
   ASSERT(g >= 0 && g <= 255);
   ASSERT(b >= 0 && b <= 255);
+  ASSERT(bits >= 3 && bits <= 8);
 
-  if (col_diff[1] == 0)
-    bestfit_init();
-
-  bestfit = 0;
-  lowest = std::numeric_limits<int>::max();
-
-  r >>= 3;
-  g >>= 3;
-  b >>= 3;
-
-  i = 0;
-  while (i < size()) {
-    color_t rgb = m_colors[i];
-
-    coldiff = (col_diff + 0) [ ((rgba_getg(rgb)>>3) - g) & 0x7F ];
-    if (coldiff < lowest) {
-      coldiff += (col_diff + 128) [ ((rgba_getr(rgb)>>3) - r) & 0x7F ];
-      if (coldiff < lowest) {
-        coldiff += (col_diff + 256) [ ((rgba_getb(rgb)>>3) - b) & 0x7F ];
-        if (coldiff < lowest && i != mask_index) {
-          bestfit = i;
-          if (coldiff == 0)
-            return bestfit;
-          lowest = coldiff;
-        }
-      }
-    }
-    i++;
-  }
-
-  return bestfit;
+  int shift = 8 - bits;
+  return m_index.findBestfit(m_colors, r>>shift, g>>shift, b>>shift,
+                             bits, mask_index);
 }
 
 } // namespace doc
@@ -11,6 +11,7 @@
 #include "doc/color.h"
 #include "doc/frame.h"
 #include "doc/object.h"
+#include "doc/palette_index.h"
 
 #include <vector>
 #include <string>
@@ -69,9 +70,14 @@ namespace doc {
     int findExactMatch(int r, int g, int b) const;
     int findBestfit(int r, int g, int b, int mask_index = 0) const;
 
+    // Like findBestfit() but comparing colors with the given number
+    // of bits per channel (findBestfit() uses 5 bits).
+    int findBestfit(int r, int g, int b, int mask_index, int bits) const;
+
   private:
     frame_t m_frame;
     std::vector<color_t> m_colors;
+    PaletteIndex m_index;       // To find the best fit of a color quickly
     int m_modifications;
     std::string m_filename; // If the palette is associated with a file.
   };
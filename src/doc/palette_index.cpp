@@ -0,0 +1,180 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/palette_index.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+namespace doc {
+
+// Weights of each channel for the color distance (as in Allegro's
+// bestfit_color)
+static const int kRedWeight = 30 * 30;
+static const int kGreenWeight = 59 * 59;
+static const int kBlueWeight = 11 * 11;
+
+PaletteIndex::PaletteIndex()
+{
+  std::fill(m_cellStart, m_cellStart+kCells+1, 0);
+}
+
+// static
+int PaletteIndex::cellOf(color_t color)
+{
+  const int shift = 8 - kCellBits;
+  return
+    (((rgba_getr(color) >> shift) << (2*kCellBits)) |
+     ((rgba_getg(color) >> shift) << kCellBits) |
+     ((rgba_getb(color) >> shift)));
+}
+
+// Returns the minimum weighted distance (in one channel) from the
+// value "v" (of the cell "c") to the values of the cells that are
+// more than "k" cells away.
+// static
+int PaletteIndex::channelBound(int v, int c, int k, int valuesPerCell, int weight)
+{
+  int bound = std::numeric_limits<int>::max();
+  if (c-k > 0) {
+    int d = v - ((c-k)*valuesPerCell - 1);
+    bound = weight*d*d;
+  }
+  if (c+k < kCellsPerChannel-1) {
+    int d = (c+k+1)*valuesPerCell - v;
+    bound = std::min(bound, weight*d*d);
+  }
+  return bound;
+}
+
+void PaletteIndex::reset(const std::vector<color_t>& colors)
+{
+  int count[kCells+1];
+  std::fill(count, count+kCells+1, 0);
+
+  int n = int(colors.size());
+  for (int i=0; i<n; ++i)
+    ++count[cellOf(colors[i])+1];
+
+  m_cellStart[0] = 0;
+  for (int c=1; c<=kCells; ++c)
+    m_cellStart[c] = m_cellStart[c-1] + count[c];
+
+  std::copy(m_cellStart, m_cellStart+kCells, count);
+  m_entries.resize(n);
+  for (int i=0; i<n; ++i)
+    m_entries[count[cellOf(colors[i])]++] = uint8_t(i);
+}
+
+void PaletteIndex::update(int i, color_t oldColor, color_t newColor)
+{
+  int a = cellOf(oldColor);
+  int b = cellOf(newColor);
+  if (a == b)
+    return;
+
+  std::vector<uint8_t>::iterator begin = m_entries.begin();
+  std::vector<uint8_t>::iterator it =
+    std::find(begin+m_cellStart[a], begin+m_cellStart[a+1], uint8_t(i));
+  ASSERT(it != begin+m_cellStart[a+1]);
+
+  if (a < b) {
+    // Move the entry to the last position of the cell "b"
+    std::rotate(it, it+1, begin+m_cellStart[b]);
+    for (int c=a+1; c<=b; ++c)
+      --m_cellStart[c];
+  }
+  else {
+    // Move the entry to the first position of the cell "b+1", which
+    // becomes the last position of the cell "b"
+    std::rotate(begin+m_cellStart[b+1], it, it+1);
+    for (int c=b+1; c<=a; ++c)
+      ++m_cellStart[c];
+  }
+}
+
+int PaletteIndex::findBestfit(const std::vector<color_t>& colors,
+                              int r, int g, int b, int bits,
+                              int mask_index) const
+{
+  ASSERT(bits >= kCellBits && bits <= 8);
+  ASSERT(r >= 0 && r < (1 << bits));
+  ASSERT(g >= 0 && g < (1 << bits));
+  ASSERT(b >= 0 && b < (1 << bits));
+
+  const int shift = 8 - bits;
+  const int valuesPerCell = (1 << (bits - kCellBits));
+  const int cr = r / valuesPerCell;
+  const int cg = g / valuesPerCell;
+  const int cb = b / valuesPerCell;
+  const int maxCell = kCellsPerChannel-1;
+
+  int bestfit = -1;
+  int lowest = std::numeric_limits<int>::max();
+
+  // Visit the cells in "shells" of increasing distance k (in cells)
+  // around the cell of the given color.
+  for (int k=0; k<=maxCell; ++k) {
+    int r1 = std::max(cr-k, 0), r2 = std::min(cr+k, maxCell);
+    int g1 = std::max(cg-k, 0), g2 = std::min(cg+k, maxCell);
+    int b1 = std::max(cb-k, 0), b2 = std::min(cb+k, maxCell);
+
+    for (int x=r1; x<=r2; ++x) {
+      for (int y=g1; y<=g2; ++y) {
+        // Cells inside the previous shell were already visited
+        bool inner = (std::abs(x-cr) < k && std::abs(y-cg) < k);
+        int zstep = (inner ? 2*k: 1);
+
+        for (int z=(inner ? cb-k: b1); z<=b2; z+=zstep) {
+          if (z < b1)
+            continue;
+
+          int c = (x << (2*kCellBits)) | (y << kCellBits) | z;
+          for (int j=m_cellStart[c]; j<m_cellStart[c+1]; ++j) {
+            int i = m_entries[j];
+            if (i == mask_index)
+              continue;
+
+            color_t rgb = colors[i];
+            int dr = (rgba_getr(rgb)>>shift) - r;
+            int dg = (rgba_getg(rgb)>>shift) - g;
+            int db = (rgba_getb(rgb)>>shift) - b;
+            int coldiff =
+              kGreenWeight*dg*dg +
+              kRedWeight*dr*dr +
+              kBlueWeight*db*db;
+
+            if (coldiff < lowest ||
+                (coldiff == lowest && i < bestfit)) {
+              bestfit = i;
+              lowest = coldiff;
+            }
+          }
+        }
+      }
+    }
+
+    // Minimum distance to an entry outside the visited cells
+    int bound = std::min(
+      channelBound(r, cr, k, valuesPerCell, kRedWeight),
+      std::min(channelBound(g, cg, k, valuesPerCell, kGreenWeight),
+               channelBound(b, cb, k, valuesPerCell, kBlueWeight)));
+
+    // Entries at the same distance can have a lower index, so we
+    // stop only when the rest of cells are farther.
+    if (bound > lowest)
+      break;
+  }
+
+  return (bestfit >= 0 ? bestfit: 0);
+}
+
+} // namespace doc
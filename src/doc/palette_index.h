@@ -0,0 +1,59 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_PALETTE_INDEX_H_INCLUDED
+#define DOC_PALETTE_INDEX_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+
+#include <vector>
+
+namespace doc {
+
+  // Spatial index of palette entries used by Palette::findBestfit().
+  // Entries are grouped in a 8x8x8 grid of cells (using the 3 most
+  // significant bits of each channel), so a search only visits the
+  // cells near the given color. Palette keeps the index updated each
+  // time an entry changes.
+  class PaletteIndex {
+  public:
+    PaletteIndex();
+
+    // Re-creates the whole index for the given colors.
+    void reset(const std::vector<color_t>& colors);
+
+    // Moves the entry "i" to the cell of its new color.
+    void update(int i, color_t oldColor, color_t newColor);
+
+    // Returns the index of the color nearest to r/g/b and different
+    // from "mask_index", or 0 if there is no such entry. Colors are
+    // compared using the given precision ("bits" per channel, from 3
+    // to 8), and r/g/b must be in that precision too. On ties the
+    // lowest index wins.
+    int findBestfit(const std::vector<color_t>& colors,
+                    int r, int g, int b, int bits,
+                    int mask_index) const;
+
+  private:
+    enum {
+      kCellBits = 3,                            // 8 cells per channel
+      kCellsPerChannel = 1 << kCellBits,
+      kCells = kCellsPerChannel * kCellsPerChannel * kCellsPerChannel,
+    };
+
+    static int cellOf(color_t color);
+    static int channelBound(int v, int c, int k, int valuesPerCell, int weight);
+
+    // Palette entries sorted by cell, m_entries[m_cellStart[c]] is
+    // the first entry of the cell "c".
+    std::vector<uint8_t> m_entries;
+    int m_cellStart[kCells+1];
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,110 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/color_scales.h"
+#include "doc/palette.h"
+
+#include <cstdlib>
+#include <limits>
+
+using namespace doc;
+
+// Brute-force search (the original Allegro's bestfit_color algorithm)
+static int bruteforce_bestfit(const Palette* pal, int r, int g, int b, int mask_index)
+{
+  int bestfit = 0;
+  int lowest = std::numeric_limits<int>::max();
+
+  r >>= 3;
+  g >>= 3;
+  b >>= 3;
+
+  for (int i=0; i<pal->size(); ++i) {
+    color_t rgb = pal->getEntry(i);
+    int dr = (rgba_getr(rgb)>>3) - r;
+    int dg = (rgba_getg(rgb)>>3) - g;
+    int db = (rgba_getb(rgb)>>3) - b;
+    int coldiff = 59*59*dg*dg + 30*30*dr*dr + 11*11*db*db;
+    if (coldiff < lowest && i != mask_index) {
+      bestfit = i;
+      lowest = coldiff;
+    }
+  }
+  return bestfit;
+}
+
+static void expect_same_bestfit(const Palette* pal, int mask_index)
+{
+  int errors = 0;
+  for (int r=0; r<32; ++r)
+    for (int g=0; g<32; ++g)
+      for (int b=0; b<32; ++b) {
+        int r8 = scale_5bits_to_8bits(r);
+        int g8 = scale_5bits_to_8bits(g);
+        int b8 = scale_5bits_to_8bits(b);
+        if (pal->findBestfit(r8, g8, b8, mask_index) !=
+            bruteforce_bestfit(pal, r8, g8, b8, mask_index))
+          ++errors;
+      }
+  EXPECT_EQ(0, errors);
+}
+
+TEST(Palette, FindBestfitMatchesBruteForce)
+{
+  std::srand(1);
+
+  int sizes[] = { 1, 2, 16, 256 };
+  for (int n : sizes) {
+    Palette pal(frame_t(0), n);
+    for (int i=0; i<n; ++i)
+      pal.setEntry(i, rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+
+    expect_same_bestfit(&pal, 0);
+    expect_same_bestfit(&pal, -1);
+  }
+}
+
+TEST(Palette, FindBestfitAfterEntryChanges)
+{
+  std::srand(2);
+
+  // Few colors in a corner of the RGB cube (to search far cells)
+  Palette pal(frame_t(0), 8);
+  for (int i=0; i<8; ++i)
+    pal.setEntry(i, rgba(std::rand() & 31, std::rand() & 31, std::rand() & 31, 255));
+  expect_same_bestfit(&pal, 0);
+
+  // Duplicated colors (the lowest index must win)
+  pal.setEntry(5, pal.getEntry(2));
+  pal.setEntry(7, pal.getEntry(2));
+  expect_same_bestfit(&pal, 0);
+  expect_same_bestfit(&pal, 2);
+
+  // Move entries between cells
+  for (int j=0; j<100; ++j)
+    pal.setEntry(std::rand() % 8, rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+  expect_same_bestfit(&pal, 0);
+
+  pal.resize(32);
+  expect_same_bestfit(&pal, 0);
+
+  Palette copy(pal);
+  copy.setEntry(31, rgba(255, 255, 255, 255));
+  expect_same_bestfit(&copy, 0);
+  expect_same_bestfit(&pal, 0);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,138 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/polygon.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+struct Span {
+  int x1, y, x2;
+  bool operator==(const Span& o) const { return x1 == o.x1 && y == o.y && x2 == o.x2; }
+  bool operator<(const Span& o) const {
+    return (y < o.y || (y == o.y && (x1 < o.x1 || (x1 == o.x1 && x2 < o.x2))));
+  }
+};
+
+typedef std::vector<Span> Spans;
+
+void add_span(int x1, int y, int x2, Spans* spans)
+{
+  Span span = { x1, y, x2 };
+  spans->push_back(span);
+}
+
+// The old polygon filler (intersects each scanline with all edges)
+Spans reference_polygon(const std::vector<int>& points)
+{
+  const int n = points.size()/2;
+  int miny = points[1], maxy = points[1];
+  for (int i=1; i<n; ++i) {
+    miny = std::min(miny, points[i*2+1]);
+    maxy = std::max(maxy, points[i*2+1]);
+  }
+
+  Spans spans;
+  for (int y=miny; y<=maxy; ++y) {
+    std::vector<int> ints;
+    for (int i=0; i<n; ++i) {
+      int a = (i ? i-1: n-1), b = i;
+      int x1 = points[a*2], y1 = points[a*2+1];
+      int x2 = points[b*2], y2 = points[b*2+1];
+      if (y1 > y2) { std::swap(x1, x2); std::swap(y1, y2); }
+      else if (y1 == y2) continue;
+
+      if ((y >= y1 && y < y2) || (y == maxy && y > y1 && y <= y2))
+        ints.push_back((int)((float)((y - y1) * (x2 - x1)) / (float)(y2 - y1) + 0.5 + x1));
+    }
+    std::sort(ints.begin(), ints.end());
+    for (size_t i=0; i+1<ints.size(); i+=2)
+      add_span(ints[i], y, ints[i+1], &spans);
+  }
+  return spans;
+}
+
+Spans fill_polygon(const std::vector<int>& points)
+{
+  Spans spans;
+  algorithm::polygon(points.size()/2, &points[0], &spans, (AlgoHLine)add_span);
+  return spans;
+}
+
+void expect_same_fill(const std::vector<int>& points)
+{
+  Spans expected = reference_polygon(points);
+  Spans result = fill_polygon(points);
+
+  // Spans of the same scanline can be generated in any order
+  std::sort(expected.begin(), expected.end());
+  std::sort(result.begin(), result.end());
+  EXPECT_TRUE(expected == result) << expected.size() << " vs " << result.size() << " spans";
+}
+
+} // anonymous namespace
+
+TEST(Polygon, Rectangle)
+{
+  int pts[] = { 2, 3, 10, 3, 10, 7, 2, 7 };
+  Spans spans = fill_polygon(std::vector<int>(pts, pts+8));
+
+  ASSERT_EQ(5, int(spans.size()));
+  for (int i=0; i<5; ++i) {
+    Span span = { 2, 3+i, 10 };
+    EXPECT_TRUE(span == spans[i]);
+  }
+}
+
+TEST(Polygon, Degenerated)
+{
+  int pts[] = { 5, 5, 8, 5, 1, 5 };
+  expect_same_fill(std::vector<int>(pts, pts+2));
+  expect_same_fill(std::vector<int>(pts, pts+6));
+}
+
+TEST(Polygon, CompareWithReference)
+{
+  std::srand(1);
+
+  // Random polygons (with self-intersections)
+  for (int i=0; i<50; ++i) {
+    std::vector<int> points;
+    for (int j=3+std::rand()%30; j>0; --j) {
+      points.push_back(std::rand()%200 - 50);
+      points.push_back(std::rand()%100 - 10);
+    }
+    expect_same_fill(points);
+  }
+
+  // Freehand-like contour with many vertices
+  std::vector<int> points;
+  for (int i=0; i<5000; ++i) {
+    double a = 2*3.14159265*i/5000;
+    double r = 300 + 40*std::sin(a*37);
+    points.push_back(int(r*std::cos(a)));
+    points.push_back(int(r*std::sin(a)));
+  }
+  expect_same_fill(points);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -10,14 +10,19 @@
 
 #include "doc/primitives.h"
 
+#include "base/thread_pool.h"
 #include "doc/algo.h"
+#include "doc/algorithm/row_bands.h"
 #include "doc/blend.h"
 #include "doc/brush.h"
 #include "doc/image.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
+#include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 namespace doc {
@@ -79,46 +84,109 @@ Image* crop_image(const Image* image, int x, int y, int w, int h, color_t bg, co
   return trim;
 }
 
+namespace {
+
+// Pixels are rotated in blocks of kRotateBlock x kRotateBlock, so the
+// rows of the source and destination images used by a block are in
+// cache.
+const int kRotateBlock = 64;
+
+template<typename ImageTraits>
+void rotate_image_tpl(const Image* src, Image* dst, int angle)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+  const int w = src->width();
+  const int h = src->height();
+
+  if (angle == 180) {
+    algorithm::for_each_row_band(w, h,
+      [src, dst, w, h](int y1, int y2) {
+        for (int y=y1; y<y2; ++y) {
+          const pixel_t* s = (const pixel_t*)src->getPixelAddress(0, y);
+          pixel_t* d = (pixel_t*)dst->getPixelAddress(0, h-y-1);
+          std::reverse_copy(s, s+w, d);
+        }
+      });
+    return;
+  }
+
+  // Each task rotates a band of kRotateBlock rows (which are written
+  // as columns of "dst")
+  base::thread_pool::global().parallel_for(
+    (h + kRotateBlock - 1) / kRotateBlock,
+    [src, dst, w, h, angle](int band) {
+      pixel_t* dstRows[kRotateBlock];
+      const int y1 = band*kRotateBlock;
+      const int y2 = std::min(h, y1+kRotateBlock);
+
+      for (int x1=0; x1<w; x1+=kRotateBlock) {
+        const int x2 = std::min(w, x1+kRotateBlock);
+
+        // Rows of "dst" where the columns [x1, x2) of "src" go
+        for (int x=x1; x<x2; ++x)
+          dstRows[x-x1] = (pixel_t*)dst->getPixelAddress(0, angle == 90 ? x: w-x-1);
+
+        for (int y=y1; y<y2; ++y) {
+          const pixel_t* s = (const pixel_t*)src->getPixelAddress(0, y);
+          const int u = (angle == 90 ? h-y-1: y);
+          for (int x=x1; x<x2; ++x)
+            dstRows[x-x1][u] = s[x];
+        }
+      }
+    });
+}
+
+// Different columns of a bitmap can be in the same byte, so it's
+// rotated in one thread.
+template<>
+void rotate_image_tpl<BitmapTraits>(const Image* src, Image* dst, int angle)
+{
+  const int w = src->width();
+  const int h = src->height();
+
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      color_t c = get_pixel_fast<BitmapTraits>(src, x, y);
+      switch (angle) {
+        case 180: put_pixel_fast<BitmapTraits>(dst, w-x-1, h-y-1, c); break;
+        case 90:  put_pixel_fast<BitmapTraits>(dst, h-y-1, x, c); break;
+        case -90: put_pixel_fast<BitmapTraits>(dst, y, w-x-1, c); break;
+      }
+    }
+  }
+}
+
+} // anonymous namespace
+
 void rotate_image(const Image* src, Image* dst, int angle)
 {
   ASSERT(src);
   ASSERT(dst);
-  int x, y;
 
   switch (angle) {
 
     case 180:
       ASSERT(dst->width() == src->width());
       ASSERT(dst->height() == src->height());
-
-      for (y=0; y<src->height(); ++y)
-        for (x=0; x<src->width(); ++x)
-          dst->putPixel(src->width() - x - 1,
-                        src->height() - y - 1, src->getPixel(x, y));
       break;
 
     case 90:
-      ASSERT(dst->width() == src->height());
-      ASSERT(dst->height() == src->width());
-
-      for (y=0; y<src->height(); ++y)
-        for (x=0; x<src->width(); ++x)
-          dst->putPixel(src->height() - y - 1, x, src->getPixel(x, y));
-      break;
-
     case -90:
       ASSERT(dst->width() == src->height());
       ASSERT(dst->height() == src->width());
-
-      for (y=0; y<src->height(); ++y)
-        for (x=0; x<src->width(); ++x)
-          dst->putPixel(y, src->width() - x - 1, src->getPixel(x, y));
       break;
 
     // bad angle
     default:
       throw std::invalid_argument("Invalid angle specified to rotate the image");
   }
+
+  switch (src->pixelFormat()) {
+    case IMAGE_RGB:       rotate_image_tpl<RgbTraits>(src, dst, angle); break;
+    case IMAGE_GRAYSCALE: rotate_image_tpl<GrayscaleTraits>(src, dst, angle); break;
+    case IMAGE_INDEXED:   rotate_image_tpl<IndexedTraits>(src, dst, angle); break;
+    case IMAGE_BITMAP:    rotate_image_tpl<BitmapTraits>(src, dst, angle); break;
+  }
 }
 
 void draw_hline(Image* image, int x1, int y, int x2, color_t color)
@@ -330,4 +398,29 @@ int count_diff_between_images(const Image* i1, const Image* i2)
   return -1;
 }
 
+bool is_same_image(const Image* i1, const Image* i2)
+{
+  if ((i1->pixelFormat() != i2->pixelFormat()) ||
+      (i1->width() != i2->width()) ||
+      (i1->height() != i2->height()))
+    return false;
+
+  // The last byte of bitmap rows can contain bits outside the image
+  int bytes = i1->getRowStrideSize();
+  uint8_t lastMask = 0;
+  if (i1->pixelFormat() == IMAGE_BITMAP && (i1->width() % 8) != 0) {
+    --bytes;
+    lastMask = (1 << (i1->width() % 8)) - 1;
+  }
+
+  for (int y=0; y<i1->height(); ++y) {
+    const uint8_t* a = i1->getRowAddress(y);
+    const uint8_t* b = i2->getRowAddress(y);
+    if (std::memcmp(a, b, bytes) != 0 ||
+        (lastMask && ((a[bytes] ^ b[bytes]) & lastMask)))
+      return false;
+  }
+  return true;
+}
+
 } // namespace doc
@@ -39,6 +39,10 @@ namespace doc {
 
   int count_diff_between_images(const Image* i1, const Image* i2);
 
+  // Returns true if both images have the same format, size and
+  // pixels (it compares whole rows with memcmp()).
+  bool is_same_image(const Image* i1, const Image* i2);
+
 } // namespace doc
 
 #endif
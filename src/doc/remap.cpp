@@ -10,8 +10,11 @@
 
 #include "doc/remap.h"
 
+#include "doc/image.h"
 #include "doc/palette_picks.h"
 
+#include <cstring>
+
 namespace doc {
 
 Remap create_remap_to_move_picks(const PalettePicks& picks, int beforeIndex)
@@ -78,4 +81,45 @@ Remap Remap::invert() const
   return inv;
 }
 
+void remap_image(Image* image, const Remap& remap)
+{
+  ASSERT(image->pixelFormat() == IMAGE_INDEXED);
+  ASSERT(remap.size() == 256);
+
+  // Table of bytes (instead of ints) to remap each row in place
+  uint8_t table[256];
+  for (int i=0; i<256; ++i)
+    table[i] = uint8_t(remap[i]);
+
+  const int w = image->width();
+  for (int y=0; y<image->height(); ++y) {
+    uint8_t* p = image->getRowAddress(y);
+    uint8_t* end = p+w;
+    for (; p != end; ++p)
+      *p = table[*p];
+  }
+}
+
+void get_used_indexes(const Image* image, std::bitset<256>& used)
+{
+  ASSERT(image->pixelFormat() == IMAGE_INDEXED);
+
+  // A table of bytes is faster than setting bits for each pixel
+  uint8_t table[256];
+  std::memset(table, 0, sizeof(table));
+
+  const int w = image->width();
+  for (int y=0; y<image->height(); ++y) {
+    const uint8_t* p = image->getRowAddress(y);
+    const uint8_t* end = p+w;
+    for (; p != end; ++p)
+      table[*p] = 1;
+  }
+
+  used.reset();
+  for (int i=0; i<256; ++i)
+    if (table[i])
+      used.set(i);
+}
+
 } // namespace doc
@@ -8,10 +8,12 @@
 #define DOC_REMAP_H_INCLUDED
 #pragma once
 
+#include <bitset>
 #include <vector>
 
 namespace doc {
 
+  class Image;
   class PalettePicks;
 
   class Remap {
@@ -51,6 +53,14 @@ namespace doc {
 
   Remap create_remap_to_expand_palette(int size, int count, int beforeIndex);
 
+  // Replaces each pixel "i" of the indexed image with remap[i] (the
+  // remap must have 256 entries).
+  void remap_image(Image* image, const Remap& remap);
+
+  // Sets the bit of each index used by the pixels of the indexed
+  // image.
+  void get_used_indexes(const Image* image, std::bitset<256>& used);
+
 } // namespace doc
 
 #endif
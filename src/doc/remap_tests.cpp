@@ -10,6 +10,9 @@
 
 #include <gtest/gtest.h>
 
+#include "base/unique_ptr.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/palette_picks.h"
 
@@ -99,6 +102,23 @@ TEST(Remap, RemapToExpandPalette)
   EXPECT_EQ(9, map[9]);
 }
 
+TEST(Remap, RemapImage)
+{
+  base::UniquePtr<Image> image(Image::create(IMAGE_INDEXED, 3, 2));
+  for (int y=0; y<2; ++y)
+    for (int x=0; x<3; ++x)
+      put_pixel(image, x, y, x+y*3);
+
+  Remap map(256);
+  for (int i=0; i<256; ++i)
+    map.map(i, 255-i);
+  remap_image(image, map);
+
+  for (int y=0; y<2; ++y)
+    for (int x=0; x<3; ++x)
+      EXPECT_EQ(255-(x+y*3), get_pixel(image, x, y));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
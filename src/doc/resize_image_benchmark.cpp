@@ -0,0 +1,98 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "tests/benchmark.h"
+
+#include "base/unique_ptr.h"
+#include "doc/algorithm/resize_image.h"
+#include "doc/color.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/rgbmap.h"
+
+using namespace doc;
+using namespace doc::algorithm;
+
+static void fill_image(Image* image)
+{
+  uint32_t seed = 1;
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x) {
+      seed = seed*1103515245 + 12345;
+      switch (image->pixelFormat()) {
+        case IMAGE_RGB: put_pixel(image, x, y, seed); break;
+        case IMAGE_GRAYSCALE: put_pixel(image, x, y, seed & 0xffff); break;
+        case IMAGE_INDEXED: put_pixel(image, x, y, (seed >> 16) & 0xff); break;
+        case IMAGE_BITMAP: put_pixel(image, x, y, (seed >> 16) & 1); break;
+      }
+    }
+}
+
+// Resizes a 256x256 image of the pixel format range_x to 400x400
+// with the method range_y
+static void BM_ResizeImage(benchmark::State& state)
+{
+  const PixelFormat format = PixelFormat(state.range_x());
+  const ResizeMethod method = ResizeMethod(state.range_y());
+
+  base::UniquePtr<Image> src(Image::create(format, 256, 256));
+  base::UniquePtr<Image> dst(Image::create(format, 400, 400));
+  fill_image(src);
+
+  Palette pal(frame_t(0), 256);
+  for (int i=0; i<256; ++i)
+    pal.setEntry(i, rgba(i, 255-i, (i*7) & 0xff, 255));
+  RgbMap rgbmap;
+  rgbmap.regenerate(&pal, 0);
+
+  while (state.KeepRunning())
+    resize_image(src, dst, method, &pal, &rgbmap);
+
+  state.SetItemsProcessed(state.iterations() * dst->width() * dst->height());
+}
+BENCHMARK(BM_ResizeImage)
+  ->ArgPair(IMAGE_RGB, RESIZE_METHOD_NEAREST_NEIGHBOR)
+  ->ArgPair(IMAGE_RGB, RESIZE_METHOD_BILINEAR)
+  ->ArgPair(IMAGE_GRAYSCALE, RESIZE_METHOD_BILINEAR)
+  ->ArgPair(IMAGE_INDEXED, RESIZE_METHOD_NEAREST_NEIGHBOR)
+  ->ArgPair(IMAGE_INDEXED, RESIZE_METHOD_BILINEAR);
+
+// Resizes a 256x256 image of the pixel format range_x with the
+// integer factor range_y (nearest neighbor)
+static void BM_ResizeImageIntegerFactor(benchmark::State& state)
+{
+  const PixelFormat format = PixelFormat(state.range_x());
+  const int factor = state.range_y();
+
+  base::UniquePtr<Image> src(Image::create(format, 256, 256));
+  base::UniquePtr<Image> dst(Image::create(format, 256*factor, 256*factor));
+  fill_image(src);
+
+  while (state.KeepRunning())
+    resize_image(src, dst, RESIZE_METHOD_NEAREST_NEIGHBOR, nullptr, nullptr);
+
+  state.SetItemsProcessed(state.iterations() * dst->width() * dst->height());
+}
+BENCHMARK(BM_ResizeImageIntegerFactor)
+  ->ArgPair(IMAGE_RGB, 2)
+  ->ArgPair(IMAGE_RGB, 4)
+  ->ArgPair(IMAGE_INDEXED, 4);
+
+static void BM_FixupTransparentColors(benchmark::State& state)
+{
+  const PixelFormat format = PixelFormat(state.range_x());
+  base::UniquePtr<Image> image(Image::create(format, 256, 256));
+  fill_image(image);
+
+  // Transparent pixels are only modified in the first call, but all
+  // calls scan the same neighbors
+  while (state.KeepRunning())
+    fixup_image_transparent_colors(image);
+}
+BENCHMARK(BM_FixupTransparentColors)
+  ->Arg(IMAGE_RGB)
+  ->Arg(IMAGE_GRAYSCALE);
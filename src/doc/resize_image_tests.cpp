@@ -15,6 +15,8 @@
 #include "doc/image.h"
 #include "doc/primitives.h"
 
+#include <algorithm>
+
 using namespace std;
 using namespace doc;
 
@@ -90,6 +92,103 @@ TEST(ResizeImage, BilinearInterpRGBType)
 }
 #endif
 
+// Per-pixel bilinear interpolation (with the coordinates accumulated
+// pixel by pixel as resize_image() does)
+static color_t reference_bilinear(const Image* src, int dstW, int dstH, int x, int y)
+{
+  double du = (src->width()-1) * 1.0 / (dstW-1);
+  double dv = (src->height()-1) * 1.0 / (dstH-1);
+  double u = 0.0, v = 0.0;
+  for (int i=0; i<x; ++i) u += du;
+  for (int i=0; i<y; ++i) v += dv;
+
+  int u1 = std::min(int(u), src->width()-1);
+  int v1 = std::min(int(v), src->height()-1);
+  int u2 = std::min(u1+1, src->width()-1);
+  int v2 = std::min(v1+1, src->height()-1);
+  double fu = u - u1, fv = v - v1;
+
+  color_t c[4] = { get_pixel(src, u1, v1), get_pixel(src, u2, v1),
+                   get_pixel(src, u1, v2), get_pixel(src, u2, v2) };
+  int channels[4];
+  int n = (src->pixelFormat() == IMAGE_RGB ? 4: 2);
+  for (int i=0; i<n; ++i) {
+    int k[4];
+    for (int j=0; j<4; ++j)
+      k[j] = (c[j] >> (i*8)) & 0xff;
+    channels[i] = int((k[0]*(1-fu) + k[1]*fu)*(1-fv) +
+                      (k[2]*(1-fu) + k[3]*fu)*fv);
+  }
+  return (n == 4 ? rgba(channels[0], channels[1], channels[2], channels[3]):
+                   graya(channels[0], channels[1]));
+}
+
+TEST(ResizeImage, BilinearInterp)
+{
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE }) {
+    Image* src = Image::create(format, 13, 7);
+    for (int y=0; y<src->height(); ++y)
+      for (int x=0; x<src->width(); ++x)
+        src->putPixel(x, y, (x*37 + y*91) * 0x01030507);
+
+    Image* dst = Image::create(format, 31, 20);
+    algorithm::resize_image(src, dst, algorithm::RESIZE_METHOD_BILINEAR, NULL, NULL);
+
+    for (int y=0; y<dst->height(); ++y)
+      for (int x=0; x<dst->width(); ++x)
+        ASSERT_EQ(reference_bilinear(src, dst->width(), dst->height(), x, y),
+                  dst->getPixel(x, y)) << x << "," << y;
+
+    delete src;
+    delete dst;
+  }
+}
+
+TEST(ResizeImage, NearestNeighborFormats)
+{
+  for (PixelFormat format : { IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP }) {
+    Image* src = Image::create(format, 10, 6);
+    for (int y=0; y<src->height(); ++y)
+      for (int x=0; x<src->width(); ++x)
+        src->putPixel(x, y, (format == IMAGE_BITMAP ? (x+y) & 1: x*10+y));
+
+    Image* dst = Image::create(format, 23, 4);
+    algorithm::resize_image(src, dst, algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR, NULL, NULL);
+
+    for (int y=0; y<dst->height(); ++y)
+      for (int x=0; x<dst->width(); ++x)
+        ASSERT_EQ(src->getPixel(x*10/23, y*6/4), dst->getPixel(x, y)) << x << "," << y;
+
+    delete src;
+    delete dst;
+  }
+}
+
+TEST(ResizeImage, NearestNeighborIntegerUpscales)
+{
+  const int sizes[][2] = { { 2, 2 }, { 3, 3 }, { 4, 4 }, { 5, 5 }, { 2, 3 }, { 4, 1 } };
+
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    for (const auto& size : sizes) {
+      Image* src = Image::create(format, 7, 5);
+      for (int y=0; y<src->height(); ++y)
+        for (int x=0; x<src->width(); ++x)
+          src->putPixel(x, y, (format == IMAGE_RGB ? rgba(x*30, y*40, x+y, 255-x): x*10+y));
+
+      Image* dst = Image::create(format, 7*size[0], 5*size[1]);
+      algorithm::resize_image(src, dst, algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR, NULL, NULL);
+
+      for (int y=0; y<dst->height(); ++y)
+        for (int x=0; x<dst->width(); ++x)
+          ASSERT_EQ(src->getPixel(x/size[0], y/size[1]), dst->getPixel(x, y))
+            << size[0] << "x" << size[1] << " " << x << "," << y;
+
+      delete src;
+      delete dst;
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -10,6 +10,7 @@
 
 #include "doc/rgbmap.h"
 
+#include "base/thread_pool.h"
 #include "doc/color_scales.h"
 #include "doc/palette.h"
 
@@ -17,12 +18,31 @@ namespace doc {
 
 #define MAPSIZE 32*32*32
 
-RgbMap::RgbMap()
+RgbMap::RgbMap(int bits)
   : Object(ObjectType::RgbMap)
-  , m_map(MAPSIZE)
+  , m_bits(bits)
+  , m_pages(NULL)
   , m_palette(NULL)
   , m_modifications(0)
+  , m_maskIndex(0)
 {
+  ASSERT(bits >= 5 && bits <= 8);
+
+  if (m_bits == 5)
+    m_map.resize(MAPSIZE);
+  else {
+    m_pages = new std::atomic<LazyEntry*>[MAPSIZE];
+    for (int i=0; i<MAPSIZE; ++i)
+      m_pages[i].store(NULL, std::memory_order_relaxed);
+  }
+}
+
+RgbMap::~RgbMap()
+{
+  if (m_pages) {
+    deletePages();
+    delete[] m_pages;
+  }
 }
 
 bool RgbMap::match(const Palette* palette) const
@@ -35,27 +55,75 @@ void RgbMap::regenerate(const Palette* palette, int mask_index)
 {
   m_palette = palette;
   m_modifications = palette->getModifications();
+  m_maskIndex = mask_index;
+
+  // Lazy maps are re-calculated on demand
+  if (m_pages) {
+    deletePages();
+    return;
+  }
 
-  int i = 0;
-  for (int r=0; r<32; ++r) {
-    for (int g=0; g<32; ++g) {
-      for (int b=0; b<32; ++b) {
-        m_map[i++] =
-          palette->findBestfit(
-            scale_5bits_to_8bits(r),
-            scale_5bits_to_8bits(g),
-            scale_5bits_to_8bits(b), mask_index);
+  // Each red value is a plane of 32x32 entries of the map that can
+  // be filled independently.
+  base::thread_pool::global().parallel_for(
+    32, [this, palette, mask_index](int r) {
+      int i = (r << 10);
+      for (int g=0; g<32; ++g) {
+        for (int b=0; b<32; ++b) {
+          m_map[i++] =
+            palette->findBestfit(
+              scale_5bits_to_8bits(r),
+              scale_5bits_to_8bits(g),
+              scale_5bits_to_8bits(b), mask_index);
+        }
       }
-    }
+    });
+}
+
+int RgbMap::mapColorLazy(int r, int g, int b) const
+{
+  ASSERT(m_palette);
+
+  const int extraBits = m_bits - 5;
+  const int lowMask = (1 << extraBits) - 1;
+  const int shift = 8 - m_bits;
+
+  std::atomic<LazyEntry*>& page =
+    m_pages[((r>>3) << 10) + ((g>>3) << 5) + (b>>3)];
+  LazyEntry* entries = page.load(std::memory_order_acquire);
+  if (!entries) {
+    int n = (1 << (3*extraBits));
+    LazyEntry* newEntries = new LazyEntry[n];
+    for (int i=0; i<n; ++i)
+      newEntries[i].store(kUnknown, std::memory_order_relaxed);
+
+    // Other thread could create the same page at the same time
+    if (page.compare_exchange_strong(entries, newEntries,
+                                     std::memory_order_acq_rel))
+      entries = newEntries;
+    else
+      delete[] newEntries;
   }
+
+  LazyEntry& entry = entries[
+    (((((r>>shift) & lowMask) << extraBits) |
+      ((g>>shift) & lowMask)) << extraBits) |
+    ((b>>shift) & lowMask)];
+
+  int index = entry.load(std::memory_order_relaxed);
+  if (index == kUnknown) {
+    index = m_palette->findBestfit(r, g, b, m_maskIndex, m_bits);
+    entry.store(uint16_t(index), std::memory_order_relaxed);
+  }
+  return index;
 }
 
-int RgbMap::mapColor(int r, int g, int b) const
+void RgbMap::deletePages()
 {
-  ASSERT(r >= 0 && r < 256);
-  ASSERT(g >= 0 && g < 256);
-  ASSERT(b >= 0 && b < 256);
-  return m_map[((r>>3) << 10) + ((g>>3) << 5) + (b>>3)];
+  for (int i=0; i<MAPSIZE; ++i) {
+    delete[] m_pages[i].load(std::memory_order_relaxed);
+    m_pages[i].store(NULL, std::memory_order_relaxed);
+  }
 }
 
 } // namespace doc
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,6 +11,7 @@
 #include "base/disable_copying.h"
 #include "doc/object.h"
 
+#include <atomic>
 #include <vector>
 
 namespace doc {
@@ -19,17 +20,50 @@ namespace doc {
 
   class RgbMap : public Object {
   public:
-    RgbMap();
+    // Creates a map of colors with the given precision (bits per
+    // channel, from 5 to 8). A 5 bits map is filled completely in
+    // regenerate(). Maps with more bits are filled lazily on each
+    // mapColor() call (the palette given to regenerate() must be
+    // alive and unmodified while the map is used).
+    explicit RgbMap(int bits = 5);
+    ~RgbMap();
+
+    int bits() const { return m_bits; }
+    const Palette* palette() const { return m_palette; }
+    int maskIndex() const { return m_maskIndex; }
 
     bool match(const Palette* palette) const;
     void regenerate(const Palette* palette, int mask_index);
 
-    int mapColor(int r, int g, int b) const;
+    int mapColor(int r, int g, int b) const {
+      ASSERT(r >= 0 && r < 256);
+      ASSERT(g >= 0 && g < 256);
+      ASSERT(b >= 0 && b < 256);
+      if (m_bits == 5)
+        return m_map[((r>>3) << 10) + ((g>>3) << 5) + (b>>3)];
+      else
+        return mapColorLazy(r, g, b);
+    }
 
   private:
+    // Entries of lazy maps, kUnknown means that the entry wasn't
+    // calculated yet.
+    typedef std::atomic<uint16_t> LazyEntry;
+    enum { kUnknown = 0xffff };
+
+    int mapColorLazy(int r, int g, int b) const;
+    void deletePages();
+
+    int m_bits;
     std::vector<uint8_t> m_map;
+
+    // Lazy maps are divided in pages, one page for each 5 bits color
+    // (32x32x32 pages), which are created on demand.
+    std::atomic<LazyEntry*>* m_pages;
+
     const Palette* m_palette;
     int m_modifications;
+    int m_maskIndex;
 
     DISABLE_COPYING(RgbMap);
   };
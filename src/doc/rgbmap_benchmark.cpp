@@ -0,0 +1,74 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "tests/benchmark.h"
+
+#include "doc/color.h"
+#include "doc/palette.h"
+#include "doc/rgbmap.h"
+
+#include <vector>
+
+using namespace doc;
+
+static void fill_palette(Palette& pal)
+{
+  uint32_t seed = 1;
+  for (int i=0; i<pal.size(); ++i) {
+    seed = seed*1103515245 + 12345;
+    pal.setEntry(i, rgba((seed >> 8) & 0xff, (seed >> 16) & 0xff, (seed >> 24) & 0xff, 255));
+  }
+}
+
+// Regenerates a map of range_x bits per channel for a palette of
+// range_y colors
+static void BM_RgbMapRegenerate(benchmark::State& state)
+{
+  Palette pal(frame_t(0), state.range_y());
+  fill_palette(pal);
+
+  while (state.KeepRunning()) {
+    RgbMap rgbmap(state.range_x());
+    rgbmap.regenerate(&pal, 0);
+    benchmark::DoNotOptimize(rgbmap);
+  }
+}
+BENCHMARK(BM_RgbMapRegenerate)
+  ->ArgPair(5, 16)
+  ->ArgPair(5, 256)
+  ->ArgPair(8, 256);
+
+// Maps random colors with a map of range_x bits per channel (lazy
+// maps are filled in the first iterations)
+static void BM_RgbMapMapColor(benchmark::State& state)
+{
+  Palette pal(frame_t(0), state.range_y());
+  fill_palette(pal);
+
+  RgbMap rgbmap(state.range_x());
+  rgbmap.regenerate(&pal, 0);
+
+  std::vector<uint32_t> colors(4096);
+  uint32_t seed = 2;
+  for (size_t i=0; i<colors.size(); ++i) {
+    seed = seed*1103515245 + 12345;
+    colors[i] = seed;
+  }
+
+  int sum = 0;
+  while (state.KeepRunning()) {
+    for (size_t i=0; i<colors.size(); ++i) {
+      uint32_t c = colors[i];
+      sum += rgbmap.mapColor((c >> 8) & 0xff, (c >> 16) & 0xff, (c >> 24) & 0xff);
+    }
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations() * colors.size());
+}
+BENCHMARK(BM_RgbMapMapColor)
+  ->ArgPair(5, 256)
+  ->ArgPair(6, 256)
+  ->ArgPair(8, 256);
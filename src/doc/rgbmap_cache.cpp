@@ -0,0 +1,130 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/rgbmap_cache.h"
+
+#include "doc/palette.h"
+#include "doc/rgbmap.h"
+
+#include <cstdint>
+
+namespace doc {
+
+namespace {
+
+// The map is generated from this copy of the palette (RgbMap needs
+// the palette while it's used)
+struct PaletteMap {
+  Palette palette;
+  RgbMap map;
+
+  PaletteMap(const Palette& palette) : palette(palette) { }
+};
+
+// FNV-1a hash of the palette colors
+uint32_t palette_hash(const Palette* palette)
+{
+  uint32_t hash = 2166136261u;
+  for (int i=0; i<palette->size(); ++i) {
+    hash ^= palette->getEntry(i);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+} // anonymous namespace
+
+struct RgbMapCache::Entry {
+  uint32_t hash;
+  int maskIndex;
+  std::shared_ptr<PaletteMap> paletteMap;
+
+  bool match(uint32_t hash, const Palette* palette, int maskIndex) const {
+    return (this->hash == hash &&
+            this->maskIndex == maskIndex &&
+            paletteMap->palette.size() == palette->size() &&
+            paletteMap->palette.countDiff(palette, nullptr, nullptr) == 0);
+  }
+
+  RgbMapRef map() const {
+    // Shares the ownership of the whole PaletteMap
+    return RgbMapRef(paletteMap, &paletteMap->map);
+  }
+};
+
+RgbMapCache::RgbMapCache(int maxMaps)
+  : m_maxMaps(maxMaps)
+{
+}
+
+RgbMapCache::~RgbMapCache()
+{
+}
+
+RgbMapRef RgbMapCache::get(const Palette* palette, int maskIndex)
+{
+  const uint32_t hash = palette_hash(palette);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it=m_entries.begin(); it != m_entries.end(); ++it) {
+      if (it->match(hash, palette, maskIndex)) {
+        m_entries.splice(m_entries.begin(), m_entries, it);
+        return it->map();
+      }
+    }
+  }
+
+  // Generate the map without locking the cache (so other threads can
+  // get other maps in the meantime)
+  Entry entry;
+  entry.hash = hash;
+  entry.maskIndex = maskIndex;
+  entry.paletteMap = std::make_shared<PaletteMap>(*palette);
+  entry.paletteMap->map.regenerate(&entry.paletteMap->palette, maskIndex);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // Other thread could have generated the same map
+  for (auto it=m_entries.begin(); it != m_entries.end(); ++it) {
+    if (it->match(hash, palette, maskIndex)) {
+      m_entries.splice(m_entries.begin(), m_entries, it);
+      return it->map();
+    }
+  }
+
+  m_entries.push_front(entry);
+  while (int(m_entries.size()) > m_maxMaps)
+    m_entries.pop_back();
+
+  return entry.map();
+}
+
+int RgbMapCache::size() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return int(m_entries.size());
+}
+
+void RgbMapCache::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.clear();
+}
+
+// static
+RgbMapCache& RgbMapCache::global()
+{
+  // Each 5 bits map uses 32KB
+  static RgbMapCache cache(16);
+  return cache;
+}
+
+} // namespace doc
@@ -0,0 +1,58 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_RGBMAP_CACHE_H_INCLUDED
+#define DOC_RGBMAP_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace doc {
+
+  class Palette;
+  class RgbMap;
+
+  typedef std::shared_ptr<RgbMap> RgbMapRef;
+
+  // Cache of RGB maps shared by all sprites, keyed by the colors of
+  // the palette and the mask index, so documents with the same
+  // palette (or frames with repeated palettes) use the same map
+  // instead of generating identical tables. Each map is generated
+  // from its own copy of the palette, so it can be used after the
+  // given palette is modified/deleted. Maps are reference counted:
+  // the least recently used map is removed from the cache when there
+  // are too many, and it's deleted when its last user releases it.
+  // It's thread-safe.
+  class RgbMapCache {
+  public:
+    explicit RgbMapCache(int maxMaps);
+    ~RgbMapCache();
+
+    RgbMapRef get(const Palette* palette, int maskIndex);
+
+    // Number of maps in the cache.
+    int size() const;
+    void clear();
+
+    static RgbMapCache& global();
+
+  private:
+    struct Entry;
+
+    mutable std::mutex m_mutex;
+    std::list<Entry> m_entries;   // The most recently used first
+    int m_maxMaps;
+
+    DISABLE_COPYING(RgbMapCache);
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,90 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/rgbmap_cache.h"
+
+#include "base/thread_pool.h"
+#include "doc/palette.h"
+#include "doc/rgbmap.h"
+
+using namespace doc;
+
+static Palette create_palette(int index)
+{
+  Palette pal(frame_t(0), 4);
+  pal.setEntry(0, rgba(0, 0, 0, 255));
+  pal.setEntry(1, rgba(255, 0, 0, 255));
+  pal.setEntry(2, rgba(0, 255, 0, 255));
+  pal.setEntry(3, rgba(index, index, 255, 255));
+  return pal;
+}
+
+TEST(RgbMapCache, ShareMapsOfPalettesWithSameColors)
+{
+  RgbMapCache cache(8);
+  Palette a = create_palette(0);
+  Palette b = create_palette(0);
+  Palette c = create_palette(100);
+
+  RgbMapRef mapA = cache.get(&a, 0);
+  EXPECT_EQ(mapA, cache.get(&b, 0));
+  EXPECT_NE(mapA, cache.get(&a, -1));
+  EXPECT_NE(mapA, cache.get(&c, 0));
+  EXPECT_EQ(3, cache.size());
+
+  // The map doesn't depend on the original palette
+  a.setEntry(1, rgba(0, 0, 0, 255));
+  EXPECT_EQ(1, mapA->mapColor(255, 0, 0));
+  EXPECT_NE(mapA, cache.get(&a, 0));
+}
+
+TEST(RgbMapCache, EvictedMapsAreAliveWhileTheyAreUsed)
+{
+  RgbMapCache cache(2);
+  Palette a = create_palette(0);
+  RgbMapRef mapA = cache.get(&a, 0);
+
+  for (int i=1; i<=4; ++i) {
+    Palette pal = create_palette(i);
+    cache.get(&pal, 0);
+  }
+  EXPECT_EQ(2, cache.size());
+  EXPECT_EQ(2, mapA->mapColor(0, 255, 0));
+
+  // The map was evicted, so a new one is generated
+  RgbMapRef mapA2 = cache.get(&a, 0);
+  EXPECT_NE(mapA, mapA2);
+  EXPECT_EQ(2, mapA2->mapColor(0, 255, 0));
+}
+
+TEST(RgbMapCache, GetFromSeveralThreads)
+{
+  RgbMapCache cache(4);
+  std::vector<RgbMapRef> maps(64);
+
+  base::thread_pool::global().parallel_for(
+    int(maps.size()),
+    [&](int i) {
+      Palette pal = create_palette(i % 2);
+      maps[i] = cache.get(&pal, 0);
+    });
+
+  for (int i=2; i<int(maps.size()); ++i)
+    EXPECT_EQ(maps[i % 2], maps[i]);
+  EXPECT_EQ(2, cache.size());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,76 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/palette.h"
+#include "doc/rgbmap.h"
+
+#include <cstdlib>
+#include <limits>
+
+using namespace doc;
+
+// Nearest color comparing all bits of each channel
+static int bruteforce_bestfit(const Palette* pal, int r, int g, int b, int mask_index)
+{
+  int bestfit = 0;
+  int lowest = std::numeric_limits<int>::max();
+  for (int i=0; i<pal->size(); ++i) {
+    color_t rgb = pal->getEntry(i);
+    int dr = rgba_getr(rgb) - r;
+    int dg = rgba_getg(rgb) - g;
+    int db = rgba_getb(rgb) - b;
+    int coldiff = 59*59*dg*dg + 30*30*dr*dr + 11*11*db*db;
+    if (coldiff < lowest && i != mask_index) {
+      bestfit = i;
+      lowest = coldiff;
+    }
+  }
+  return bestfit;
+}
+
+TEST(RgbMap, PrecisionModes)
+{
+  std::srand(3);
+
+  Palette pal(frame_t(0), 256);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+
+  RgbMap map5, map6(6), map8(8);
+  map5.regenerate(&pal, 0);
+  map6.regenerate(&pal, 0);
+  map8.regenerate(&pal, 0);
+  EXPECT_TRUE(map8.match(&pal));
+
+  for (int j=0; j<20000; ++j) {
+    int r = std::rand() & 255;
+    int g = std::rand() & 255;
+    int b = std::rand() & 255;
+    EXPECT_EQ(pal.findBestfit(r, g, b, 0), map5.mapColor(r, g, b));
+    EXPECT_EQ(pal.findBestfit(r, g, b, 0, 6), map6.mapColor(r, g, b));
+    EXPECT_EQ(bruteforce_bestfit(&pal, r, g, b, 0), map8.mapColor(r, g, b));
+    // Second lookup uses the calculated entry
+    EXPECT_EQ(bruteforce_bestfit(&pal, r, g, b, 0), map8.mapColor(r, g, b));
+  }
+
+  // Lazy maps are re-calculated when the palette changes
+  pal.setEntry(1, rgba(10, 20, 30, 255));
+  EXPECT_FALSE(map8.match(&pal));
+  map8.regenerate(&pal, 0);
+  EXPECT_EQ(1, map8.mapColor(10, 20, 30));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
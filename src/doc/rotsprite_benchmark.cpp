@@ -0,0 +1,96 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "tests/benchmark.h"
+
+#include "base/unique_ptr.h"
+#include "doc/algorithm/rotate.h"
+#include "doc/algorithm/rotsprite.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <cmath>
+
+using namespace doc;
+
+namespace {
+
+// Corners of a square of the given size rotated 30 degrees around
+// the center of a destination image of "size*3/2" pixels
+struct Corners {
+  int x[4], y[4];
+
+  Corners(int size) {
+    const double a = 30.0 * 3.14159265358979 / 180.0;
+    const double c = size*3/4.0;
+    const double sx[4] = { -1, 1, 1, -1 };
+    const double sy[4] = { -1, -1, 1, 1 };
+    for (int i=0; i<4; ++i) {
+      double px = sx[i] * size / 2.0;
+      double py = sy[i] * size / 2.0;
+      x[i] = int(c + px*std::cos(a) - py*std::sin(a));
+      y[i] = int(c + px*std::sin(a) + py*std::cos(a));
+    }
+  }
+};
+
+void fill_image(Image* image)
+{
+  // Some shapes (RotSprite looks for similar neighbors)
+  clear_image(image, 0);
+  for (int i=0; i<8; ++i) {
+    int v = (image->pixelFormat() == IMAGE_INDEXED ? i+1: rgba(32*i, 255-32*i, 64, 255));
+    fill_ellipse(image, i*image->width()/16, i*image->height()/16,
+                 image->width()-1-i*image->width()/16, image->height()-1-i*image->height()/16, v);
+  }
+}
+
+} // anonymous namespace
+
+// Rotates a square image of pixel format range_x and size range_y
+static void BM_RotSprite(benchmark::State& state)
+{
+  const PixelFormat format = PixelFormat(state.range_x());
+  const int size = state.range_y();
+
+  base::UniquePtr<Image> spr(Image::create(format, size, size));
+  base::UniquePtr<Image> bmp(Image::create(format, size*3/2, size*3/2));
+  fill_image(spr);
+
+  Corners c(size);
+  while (state.KeepRunning()) {
+    clear_image(bmp, 0);
+    algorithm::rotsprite_image(bmp, spr,
+      c.x[0], c.y[0], c.x[1], c.y[1], c.x[2], c.y[2], c.x[3], c.y[3]);
+  }
+  state.SetItemsProcessed(state.iterations() * bmp->width() * bmp->height());
+}
+BENCHMARK(BM_RotSprite)
+  ->ArgPair(IMAGE_RGB, 32)
+  ->ArgPair(IMAGE_RGB, 128)
+  ->ArgPair(IMAGE_INDEXED, 128);
+
+// The same with the fast rotation algorithm (for comparison)
+static void BM_Parallelogram(benchmark::State& state)
+{
+  const PixelFormat format = PixelFormat(state.range_x());
+  const int size = state.range_y();
+
+  base::UniquePtr<Image> spr(Image::create(format, size, size));
+  base::UniquePtr<Image> bmp(Image::create(format, size*3/2, size*3/2));
+  fill_image(spr);
+
+  Corners c(size);
+  while (state.KeepRunning()) {
+    clear_image(bmp, 0);
+    algorithm::parallelogram(bmp, spr,
+      c.x[0], c.y[0], c.x[1], c.y[1], c.x[2], c.y[2], c.x[3], c.y[3]);
+  }
+  state.SetItemsProcessed(state.iterations() * bmp->width() * bmp->height());
+}
+BENCHMARK(BM_Parallelogram)
+  ->ArgPair(IMAGE_RGB, 128)
+  ->ArgPair(IMAGE_INDEXED, 128);
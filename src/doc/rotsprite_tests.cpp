@@ -0,0 +1,176 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/rotate.h"
+#include "doc/algorithm/rotsprite.h"
+#include "doc/color.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+
+using namespace doc;
+
+namespace {
+
+void scale2x(Image* dst, const Image* src)
+{
+  int w = src->width();
+  int h = src->height();
+
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      color_t P = get_pixel(src, x, y);
+      color_t A = (y > 0 ? get_pixel(src, x, y-1): P);
+      color_t B = (x < w-1 ? get_pixel(src, x+1, y): P);
+      color_t C = (x > 0 ? get_pixel(src, x-1, y): P);
+      color_t D = (y < h-1 ? get_pixel(src, x, y+1): P);
+
+      put_pixel(dst, 2*x,   2*y,   (C == A && C != D && A != B ? A: P));
+      put_pixel(dst, 2*x+1, 2*y,   (A == B && A != C && B != D ? B: P));
+      put_pixel(dst, 2*x,   2*y+1, (D == C && D != B && C != A ? C: P));
+      put_pixel(dst, 2*x+1, 2*y+1, (B == D && B != A && D != C ? D: P));
+    }
+  }
+}
+
+// RotSprite upscaling the whole sprite (the original implementation)
+void reference_rotsprite(Image* bmp, Image* spr,
+                         int x1, int y1, int x2, int y2,
+                         int x3, int y3, int x4, int y4)
+{
+  const int scale = 8;
+  ImageRef bmpCopy(Image::create(bmp->pixelFormat(), bmp->width()*scale, bmp->height()*scale));
+  ImageRef sprCopy(Image::createCopy(spr));
+
+  bmpCopy->setMaskColor(spr->maskColor());
+  clear_image(bmpCopy.get(), bmp->maskColor());
+
+  for (int i=0; i<3; ++i) {
+    ImageRef tmp(Image::create(spr->pixelFormat(), sprCopy->width()*2, sprCopy->height()*2));
+    tmp->setMaskColor(spr->maskColor());
+    scale2x(tmp.get(), sprCopy.get());
+    sprCopy = tmp;
+  }
+
+  algorithm::parallelogram(bmpCopy.get(), sprCopy.get(),
+    x1*scale, y1*scale, x2*scale, y2*scale,
+    x3*scale, y3*scale, x4*scale, y4*scale);
+
+  algorithm::scale_image(bmp, bmpCopy.get(), 0, 0, bmp->width(), bmp->height());
+}
+
+ImageRef random_sprite(PixelFormat format, int w, int h)
+{
+  ImageRef image(Image::create(format, w, h));
+  image->setMaskColor(0);
+
+  // Few colors, so Scale2x finds equal neighbors
+  std::srand(w*h);
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      int i = std::rand() % 4;
+      color_t c;
+      switch (format) {
+        case IMAGE_RGB: c = (i ? rgba(64*i, 255-64*i, 0, 255): 0); break;
+        case IMAGE_GRAYSCALE: c = (i ? graya(64*i, 255): 0); break;
+        default: c = i; break;
+      }
+      put_pixel(image.get(), x, y, c);
+    }
+  }
+  return image;
+}
+
+// Returns how many pixels are different in both images
+int count_diffs(const Image* a, const Image* b)
+{
+  int diffs = 0;
+  for (int y=0; y<a->height(); ++y)
+    for (int x=0; x<a->width(); ++x)
+      if (get_pixel(a, x, y) != get_pixel(b, x, y))
+        ++diffs;
+  return diffs;
+}
+
+void test_transformation(PixelFormat format, int sprW, int sprH,
+                         int bmpW, int bmpH,
+                         int x1, int y1, int x2, int y2,
+                         int x3, int y3, int x4, int y4)
+{
+  ImageRef spr = random_sprite(format, sprW, sprH);
+  ImageRef expected(Image::create(format, bmpW, bmpH));
+  ImageRef result(Image::create(format, bmpW, bmpH));
+  clear_image(expected.get(), 0);
+  clear_image(result.get(), 0);
+
+  reference_rotsprite(expected.get(), spr.get(), x1, y1, x2, y2, x3, y3, x4, y4);
+  algorithm::rotsprite_image(result.get(), spr.get(), x1, y1, x2, y2, x3, y3, x4, y4);
+
+  // Only some pixels in the edges of the parallelogram can be
+  // different (the original version rasterizes the edges with fixed
+  // point numbers).
+  int diffs = count_diffs(expected.get(), result.get());
+  EXPECT_LE(diffs, 2*(bmpW+bmpH)) << "Format " << format;
+}
+
+} // anonymous namespace
+
+TEST(RotSprite, SameSize)
+{
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    ImageRef spr = random_sprite(format, 37, 21);
+    ImageRef expected(Image::create(format, 37, 21));
+    ImageRef result(Image::create(format, 37, 21));
+    clear_image(expected.get(), 0);
+    clear_image(result.get(), 0);
+
+    reference_rotsprite(expected.get(), spr.get(), 0, 0, 37, 0, 37, 21, 0, 21);
+    algorithm::rotsprite_image(result.get(), spr.get(), 0, 0, 37, 0, 37, 21, 0, 21);
+
+    EXPECT_EQ(0, count_diffs(expected.get(), result.get()));
+  }
+}
+
+TEST(RotSprite, Rotation)
+{
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    // 90 degrees
+    test_transformation(format, 40, 30, 50, 60,
+                        40, 5, 40, 45, 10, 45, 10, 5);
+    // ~30 degrees
+    test_transformation(format, 80, 50, 150, 150,
+                        20, 40, 89, 80, 64, 123, -5, 83);
+  }
+}
+
+TEST(RotSprite, Scale)
+{
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_INDEXED }) {
+    // Upscaled (several tiles sample the same sprite pixels)
+    test_transformation(format, 30, 20, 200, 150,
+                        10, 10, 190, 10, 190, 130, 10, 130);
+    // Downscaled (tiles are subdivided)
+    test_transformation(format, 400, 300, 60, 50,
+                        5, 5, 55, 5, 55, 45, 5, 45);
+    // Flipped
+    test_transformation(format, 30, 30, 40, 40,
+                        35, 35, 5, 35, 5, 5, 35, 5);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
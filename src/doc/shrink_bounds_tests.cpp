@@ -0,0 +1,111 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/shrink_bounds.h"
+#include "doc/color.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "gfx/rect.h"
+#include "gfx/rect_io.h"
+
+#include <cstdlib>
+
+using namespace doc;
+
+namespace {
+
+bool is_same_pixel(PixelFormat format, color_t a, color_t b)
+{
+  switch (format) {
+    case IMAGE_RGB: if (rgba_geta(a) == 0 && rgba_geta(b) == 0) return true; break;
+    case IMAGE_GRAYSCALE: if (graya_geta(a) == 0 && graya_geta(b) == 0) return true; break;
+  }
+  return a == b;
+}
+
+// Bounding box of the pixels different to the reference pixel
+gfx::Rect reference_bounds(const Image* image, color_t refpixel)
+{
+  gfx::Rect bounds;
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      if (!is_same_pixel(image->pixelFormat(), get_pixel(image, x, y), refpixel))
+        bounds |= gfx::Rect(x, y, 1, 1);
+  return bounds;
+}
+
+color_t random_color(PixelFormat format)
+{
+  switch (format) {
+    case IMAGE_RGB: return rgba(std::rand() & 255, 0, 0, (std::rand() % 2) * 128);
+    case IMAGE_GRAYSCALE: return graya(std::rand() & 255, (std::rand() % 2) * 128);
+    case IMAGE_INDEXED: return std::rand() % 4;
+    default: return 1;
+  }
+}
+
+} // anonymous namespace
+
+TEST(ShrinkBounds, CompareWithReference)
+{
+  std::srand(1);
+
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP }) {
+    for (int i=0; i<200; ++i) {
+      // Sizes that aren't multiple of 16 bytes
+      int w = 1 + std::rand() % 70;
+      int h = 1 + std::rand() % 40;
+      color_t refpixel = (format == IMAGE_BITMAP ? 0: random_color(format));
+
+      ImageRef image(Image::create(format, w, h));
+      clear_image(image.get(), refpixel);
+
+      // Transparent pixels with other RGB values are equal to a
+      // transparent refpixel
+      if (format == IMAGE_RGB && rgba_geta(refpixel) == 0)
+        put_pixel(image.get(), std::rand() % w, std::rand() % h, rgba(1, 2, 3, 0));
+
+      for (int j=std::rand()%4; j>0; --j)
+        put_pixel(image.get(), std::rand() % w, std::rand() % h, random_color(format));
+
+      gfx::Rect expected = reference_bounds(image.get(), refpixel);
+      gfx::Rect bounds;
+      bool result = algorithm::shrink_bounds(image.get(), bounds, refpixel);
+
+      EXPECT_EQ(!expected.isEmpty(), result) << "Format " << format;
+      if (result) {
+        EXPECT_EQ(expected, bounds) << "Format " << format;
+      }
+    }
+  }
+}
+
+TEST(ShrinkBounds, Empty)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 64, 32));
+  clear_image(image.get(), rgba(255, 0, 0, 0));
+
+  gfx::Rect bounds;
+  EXPECT_FALSE(algorithm::shrink_bounds(image.get(), bounds, 0));
+  EXPECT_TRUE(bounds.isEmpty());
+
+  put_pixel(image.get(), 63, 31, rgba(0, 0, 0, 255));
+  EXPECT_TRUE(algorithm::shrink_bounds(image.get(), bounds, 0));
+  EXPECT_EQ(gfx::Rect(63, 31, 1, 1), bounds);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
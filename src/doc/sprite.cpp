@@ -12,24 +12,30 @@
 
 #include "base/memory.h"
 #include "base/remove_from_container.h"
+#include "base/scoped_lock.h"
+#include "base/thread_pool.h"
 #include "base/unique_ptr.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/frame_tag.h"
-#include "doc/image_bits.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/rgbmap.h"
 
+#include <algorithm>
 #include <cstring>
+#include <map>
+#include <set>
 #include <vector>
 
 namespace doc {
 
-static Layer* index2layer(const Layer* layer, const LayerIndex& index, int* index_count);
-static LayerIndex layer2index(const Layer* layer, const Layer* find_layer, int* index_count);
+static void flatten_layers(const LayerFolder* folder, std::vector<Layer*>& layers);
+
+// Maximum number of RGB maps cached in each sprite
+static const int kMaxRgbMaps = 4;
 
 //////////////////////////////////////////////////////////////////////
 // Constructors/Destructor
@@ -42,6 +48,8 @@ Sprite::Sprite(PixelFormat format, int width, int height, int ncolors)
   , m_height(height)
   , m_frames(1)
   , m_frameTags(this)
+  , m_hasLayersIndex(false)
+  , m_hasCelIndexes(false)
 {
   ASSERT(width > 0 && height > 0);
 
@@ -70,9 +78,6 @@ Sprite::Sprite(PixelFormat format, int width, int height, int ncolors)
       break;
   }
 
-  // Initial RGB map
-  m_rgbMap = NULL;
-
   // The transparent color for indexed images is 0 by default
   m_transparentColor = 0;
 
@@ -92,8 +97,6 @@ Sprite::~Sprite()
       delete *it;               // palette
   }
 
-  // Destroy RGB map
-  delete m_rgbMap;
 }
 
 // static
@@ -191,6 +194,44 @@ int Sprite::getMemSize() const
   return size;
 }
 
+void Sprite::getMemoryUsage(MemoryUsage& usage) const
+{
+  usage = MemoryUsage();
+  usage.other = sizeof(Sprite) + m_frlens.size()*sizeof(int);
+
+  std::vector<Layer*> layers;
+  getLayersList(layers);
+  for (const Layer* layer : layers)
+    usage.other += (layer->isImage() ? sizeof(LayerImage): sizeof(LayerFolder));
+  usage.other += sizeof(LayerFolder); // Main folder
+
+  // Number of cels that use each image
+  std::map<const Image*, int> images;
+  std::set<const CelData*> celDatas;
+  for (const Cel* cel : cels()) {
+    usage.other += sizeof(Cel);
+    if (celDatas.insert(cel->data()).second)
+      usage.other += sizeof(CelData);
+    ++images[cel->image()];
+  }
+
+  for (const auto& it : images) {
+    std::size_t bytes = it.first->getMemSize();
+    if (it.second > 1 || it.first->isBufferShared())
+      usage.sharedImages += bytes;
+    else
+      usage.images += bytes;
+  }
+
+  for (const Palette* pal : m_palettes)
+    usage.palettes += sizeof(Palette) + pal->size()*sizeof(color_t);
+
+  for (const FrameTag* tag : m_frameTags)
+    usage.other += sizeof(FrameTag) + tag->name().size();
+
+  usage.other += m_usedIndexes.size() * (sizeof(ObjectId) + sizeof(UsedIndexes));
+}
+
 //////////////////////////////////////////////////////////////////////
 // Layers
 
@@ -237,14 +278,46 @@ Layer* Sprite::indexToLayer(LayerIndex index) const
   if (index < LayerIndex(0))
     return NULL;
 
-  int index_count = -1;
-  return index2layer(folder(), index, &index_count);
+  base::scoped_lock lock(m_layersIndexMutex);
+  updateLayersIndex();
+
+  if (index < LayerIndex(int(m_layersIndex.size())))
+    return m_layersIndex[index];
+  else
+    return NULL;
 }
 
 LayerIndex Sprite::layerToIndex(const Layer* layer) const
 {
-  int index_count = -1;
-  return layer2index(folder(), layer, &index_count);
+  base::scoped_lock lock(m_layersIndexMutex);
+  updateLayersIndex();
+
+  auto it = m_layerIndexes.find(layer);
+  if (it != m_layerIndexes.end())
+    return LayerIndex(it->second);
+  else
+    return LayerIndex(-1);
+}
+
+void Sprite::invalidateLayersIndex()
+{
+  base::scoped_lock lock(m_layersIndexMutex);
+  m_hasLayersIndex = false;
+  m_layersIndex.clear();
+  m_layerIndexes.clear();
+}
+
+// The mutex must be locked
+void Sprite::updateLayersIndex() const
+{
+  if (m_hasLayersIndex)
+    return;
+
+  flatten_layers(m_folder, m_layersIndex);
+  for (int i=0; i<int(m_layersIndex.size()); ++i)
+    m_layerIndexes[m_layersIndex[i]] = i;
+
+  m_hasLayersIndex = true;
 }
 
 void Sprite::getLayersList(std::vector<Layer*>& layers) const
@@ -261,26 +334,23 @@ void Sprite::getLayersList(std::vector<Layer*>& layers) const
 //////////////////////////////////////////////////////////////////////
 // Palettes
 
+// Returns the last palette with frame() <= the given frame
+// (m_palettes is sorted by frame).
 Palette* Sprite::palette(frame_t frame) const
 {
   ASSERT(frame >= 0);
+  ASSERT(!m_palettes.empty());
 
-  Palette* found = NULL;
+  PalettesList::const_iterator it = std::upper_bound(
+    m_palettes.begin(), m_palettes.end(), frame,
+    [](frame_t frame, const Palette* pal) {
+      return frame < pal->frame();
+    });
 
-  PalettesList::const_iterator end = m_palettes.end();
-  PalettesList::const_iterator it = m_palettes.begin();
-  for (; it != end; ++it) {
-    Palette* pal = *it;
-    if (frame < pal->frame())
-      break;
+  if (it != m_palettes.begin())
+    --it;
 
-    found = pal;
-    if (frame == pal->frame())
-      break;
-  }
-
-  ASSERT(found != NULL);
-  return found;
+  return *it;
 }
 
 const PalettesList& Sprite::getPalettes() const
@@ -297,19 +367,15 @@ void Sprite::setPalette(const Palette* pal, bool truncate)
     pal->copyColorsTo(sprite_pal);
   }
   else {
-    Palette* other;
-
-    PalettesList::iterator end = m_palettes.end();
-    PalettesList::iterator it = m_palettes.begin();
-    for (; it != end; ++it) {
-      other = *it;
-
-      if (pal->frame() == other->frame()) {
-        pal->copyColorsTo(other);
-        return;
-      }
-      else if (pal->frame() < other->frame())
-        break;
+    PalettesList::iterator it = std::lower_bound(
+      m_palettes.begin(), m_palettes.end(), pal->frame(),
+      [](const Palette* other, frame_t frame) {
+        return other->frame() < frame;
+      });
+
+    if (it != m_palettes.end() && (*it)->frame() == pal->frame()) {
+      pal->copyColorsTo(*it);
+      return;
     }
 
     m_palettes.insert(it, new Palette(*pal));
@@ -324,6 +390,7 @@ void Sprite::resetPalettes()
   if (it != end) {
     ++it;                       // Leave the first palette only.
     while (it != end) {
+      deleteRgbMaps(*it);
       delete *it;               // palette
       it = m_palettes.erase(it);
       end = m_palettes.end();
@@ -338,6 +405,7 @@ void Sprite::deletePalette(frame_t frame)
     Palette* pal = *it;
 
     if (pal->frame() == frame) {
+      deleteRgbMaps(pal);
       delete pal;                   // delete palette
       m_palettes.erase(it);
       break;
@@ -347,17 +415,43 @@ void Sprite::deletePalette(frame_t frame)
 
 RgbMap* Sprite::rgbMap(frame_t frame) const
 {
+  const Palette* pal = palette(frame);
   int mask_color = (backgroundLayer() ? -1: transparentColor());
 
-  if (m_rgbMap == NULL) {
-    m_rgbMap = new RgbMap();
-    m_rgbMap->regenerate(palette(frame), mask_color);
-  }
-  else if (!m_rgbMap->match(palette(frame))) {
-    m_rgbMap->regenerate(palette(frame), mask_color);
+  // Look for the map of this palette (without modifications)
+  for (auto it=m_rgbMaps.begin(); it != m_rgbMaps.end(); ++it) {
+    if (it->palette == pal &&
+        it->modifications == pal->getModifications() &&
+        it->map->maskIndex() == mask_color) {
+      std::rotate(m_rgbMaps.begin(), it, it+1);
+      return m_rgbMaps.front().map.get();
+    }
   }
 
-  return m_rgbMap;
+  // Get the map from the shared cache (palettes with the same colors
+  // use the same map, e.g. GIF files can repeat the same local color
+  // table in several frames)
+  PaletteRgbMap item;
+  item.palette = pal;
+  item.modifications = pal->getModifications();
+  item.map = RgbMapCache::global().get(pal, mask_color);
+
+  if (int(m_rgbMaps.size()) >= kMaxRgbMaps)
+    m_rgbMaps.pop_back();
+  m_rgbMaps.insert(m_rgbMaps.begin(), item);
+  return item.map.get();
+}
+
+// Forgets the maps of the given palette (if a new palette is created
+// in the same address, it must not use the old maps)
+void Sprite::deleteRgbMaps(const Palette* pal)
+{
+  m_rgbMaps.erase(
+    std::remove_if(m_rgbMaps.begin(), m_rgbMaps.end(),
+                   [pal](const PaletteRgbMap& item) {
+                     return item.palette == pal;
+                   }),
+    m_rgbMaps.end());
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -382,6 +476,27 @@ void Sprite::removeFrame(frame_t frame)
   setTotalFrames(newTotal);
 }
 
+// Moves the given frame (its duration and cels) before "beforeFrame"
+void Sprite::moveFrame(frame_t frame, frame_t beforeFrame)
+{
+  ASSERT(frame >= 0 && frame < m_frames);
+  ASSERT(beforeFrame >= 0 && beforeFrame <= m_frames);
+
+  if (frame < beforeFrame)
+    std::rotate(m_frlens.begin()+frame,
+                m_frlens.begin()+frame+1,
+                m_frlens.begin()+beforeFrame);
+  else if (beforeFrame < frame)
+    std::rotate(m_frlens.begin()+beforeFrame,
+                m_frlens.begin()+frame,
+                m_frlens.begin()+frame+1);
+  else
+    return;
+
+  m_frameTimes.clear();
+  folder()->moveFrame(frame, beforeFrame);
+}
+
 void Sprite::setTotalFrames(frame_t frames)
 {
   frames = MAX(frame_t(1), frames);
@@ -393,6 +508,7 @@ void Sprite::setTotalFrames(frame_t frames)
   }
 
   m_frames = frames;
+  m_frameTimes.clear();
 }
 
 int Sprite::frameDuration(frame_t frame) const
@@ -405,8 +521,10 @@ int Sprite::frameDuration(frame_t frame) const
 
 void Sprite::setFrameDuration(frame_t frame, int msecs)
 {
-  if (frame >= 0 && frame < m_frames)
+  if (frame >= 0 && frame < m_frames) {
     m_frlens[frame] = MID(1, msecs, 65535);
+    m_frameTimes.clear();
+  }
 }
 
 void Sprite::setFrameRangeDuration(frame_t from, frame_t to, int msecs)
@@ -414,11 +532,46 @@ void Sprite::setFrameRangeDuration(frame_t from, frame_t to, int msecs)
   std::fill(
     m_frlens.begin()+(std::size_t)from,
     m_frlens.begin()+(std::size_t)to+1, MID(1, msecs, 65535));
+  m_frameTimes.clear();
 }
 
 void Sprite::setDurationForAllFrames(int msecs)
 {
   std::fill(m_frlens.begin(), m_frlens.end(), MID(1, msecs, 65535));
+  m_frameTimes.clear();
+}
+
+int Sprite::frameTime(frame_t frame) const
+{
+  ASSERT(frame >= 0 && frame <= m_frames);
+
+  if (m_frameTimes.empty()) {
+    // m_frameTimes[i] is the sum of durations of frames [0, i)
+    m_frameTimes.resize(m_frames+1);
+    m_frameTimes[0] = 0;
+    for (frame_t i=0; i<m_frames; ++i)
+      m_frameTimes[i+1] = m_frameTimes[i] + m_frlens[i];
+  }
+
+  return m_frameTimes[MID(0, frame, m_frames)];
+}
+
+frame_t Sprite::frameAtTime(int msecs) const
+{
+  if (msecs <= 0)
+    return 0;
+  else if (msecs >= duration())
+    return lastFrame();
+
+  // First frame that starts after "msecs" (frameTime() created the
+  // prefix-sum in the call to duration())
+  auto it = std::upper_bound(m_frameTimes.begin(), m_frameTimes.end(), msecs);
+  return frame_t(it - m_frameTimes.begin()) - 1;
+}
+
+int Sprite::duration() const
+{
+  return frameTime(m_frames);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -426,31 +579,115 @@ void Sprite::setDurationForAllFrames(int msecs)
 
 ImageRef Sprite::getImageRef(ObjectId imageId)
 {
-  for (Cel* cel : cels()) {
-    if (cel->image()->id() == imageId)
-      return cel->imageRef();
-  }
-  return ImageRef(nullptr);
+  std::vector<Cel*> cels;
+  if (findImageCels(imageId, cels))
+    return cels.front()->imageRef();
+  else
+    return ImageRef(nullptr);
 }
 
 CelDataRef Sprite::getCelDataRef(ObjectId celDataId)
 {
-  for (Cel* cel : cels()) {
-    if (cel->dataRef()->id() == celDataId)
-      return cel->dataRef();
+  for (int i=0; i<2; ++i) {
+    auto it = m_celDataCels.find(celDataId);
+    if (it != m_celDataCels.end()) {
+      Cel* cel = indexedCel(it->second);
+      if (cel && cel->data()->id() == celDataId)
+        return cel->dataRef();
+    }
+
+    // Create the indexes (the first time, or if they aren't updated)
+    // and try again
+    if (i == 0)
+      createCelIndexes();
   }
   return CelDataRef(nullptr);
 }
 
+void Sprite::indexCel(Cel* cel)
+{
+  if (!m_hasCelIndexes)
+    return;
+
+  // Linked cels share the cel data, so only one cel is needed for
+  // each data (unless the indexed one is not valid anymore)
+  auto res = m_celDataCels.insert(std::make_pair(cel->data()->id(), cel->id()));
+  if (!res.second) {
+    if (indexedCel(res.first->second) == nullptr)
+      res.first->second = cel->id();
+    else
+      return;
+  }
+
+  if (ObjectId imageId = cel->data()->imageId())
+    m_imageCels[imageId].push_back(cel->id());
+}
+
+void Sprite::createCelIndexes()
+{
+  m_imageCels.clear();
+  m_celDataCels.clear();
+  m_hasCelIndexes = true;
+
+  for (Cel* cel : uniqueCels())
+    indexCel(cel);
+}
+
+// Returns all cels (one for each cel data) that use the given image.
+bool Sprite::findImageCels(ObjectId imageId, std::vector<Cel*>& cels)
+{
+  for (int i=0; i<2; ++i) {
+    auto it = m_imageCels.find(imageId);
+    if (it != m_imageCels.end()) {
+      for (ObjectId celId : it->second) {
+        Cel* cel = indexedCel(celId);
+        if (!cel || cel->data()->imageId() != imageId) {
+          cels.clear();
+          break;
+        }
+        cels.push_back(cel);
+      }
+      if (!cels.empty())
+        return true;
+    }
+
+    if (i == 0)
+      createCelIndexes();
+  }
+  return false;
+}
+
+// Returns the cel with the given ID if it still exists and it's in
+// this sprite.
+Cel* Sprite::indexedCel(ObjectId celId) const
+{
+  Object* obj = get_object(celId);
+  if (!obj || obj->type() != ObjectType::Cel)
+    return nullptr;
+
+  Cel* cel = static_cast<Cel*>(obj);
+  const Layer* layer = cel->layer();
+  while (layer && layer != m_folder)
+    layer = layer->parent();
+
+  return (layer ? cel: nullptr);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Images
 
 void Sprite::replaceImage(ObjectId curImageId, const ImageRef& newImage)
 {
-  for (Cel* cel : cels()) {
-    if (cel->image()->id() == curImageId)
-      cel->data()->setImage(newImage);
+  std::vector<Cel*> cels;
+  if (!findImageCels(curImageId, cels))
+    return;
+
+  std::vector<ObjectId>& newImageCels = m_imageCels[newImage->id()];
+  for (Cel* cel : cels) {
+    cel->data()->setImage(newImage);
+    newImageCels.push_back(cel->id());
   }
+  m_imageCels.erase(curImageId);
 }
 
 // TODO replace it with a images iterator
@@ -465,20 +702,65 @@ void Sprite::remapImages(frame_t frameFrom, frame_t frameTo, const Remap& remap)
   ASSERT(m_format == IMAGE_INDEXED);
   ASSERT(remap.size() == 256);
 
+  // Indexes modified by the remap
+  std::bitset<256> changed;
+  for (int i=0; i<256; ++i)
+    if (remap[i] != i)
+      changed.set(i);
+  if (changed.none())
+    return;
+
+  // Images inside the specified range
+  std::vector<Image*> images;
   for (const Cel* cel : uniqueCels()) {
-    // Remap this Cel because is inside the specified range
     if (cel->frame() >= frameFrom &&
-        cel->frame() <= frameTo) {
-      Image* image = cel->image();
-      LockImageBits<IndexedTraits> bits(image);
-      LockImageBits<IndexedTraits>::iterator
-        it = bits.begin(),
-        end = bits.end();
-
-      for (; it != end; ++it)
-        *it = remap[*it];
+        cel->frame() <= frameTo)
+      images.push_back(cel->image());
+  }
+
+  const int n = int(images.size());
+  std::vector<UsedIndexes> used(n);
+  std::vector<char> cached(n, 0);
+  std::vector<char> modified(n, 0);
+
+  for (int i=0; i<n; ++i) {
+    auto it = m_usedIndexes.find(images[i]->id());
+    if (it != m_usedIndexes.end() &&
+        it->second.version == images[i]->version()) {
+      used[i] = it->second;
+      cached[i] = 1;
     }
   }
+
+  base::thread_pool::global().parallel_for(
+    n, [&](int i) {
+      Image* image = images[i];
+      if (!cached[i])
+        get_used_indexes(image, used[i].indexes);
+
+      if ((used[i].indexes & changed).none())
+        return;
+
+      image->unshareBuffer();
+      remap_image(image, remap);
+      modified[i] = 1;
+
+      std::bitset<256> remapped;
+      for (int j=0; j<256; ++j)
+        if (used[i].indexes[j])
+          remapped.set(remap[j]);
+      used[i].indexes = remapped;
+    });
+
+  // Rebuild the cache with the new versions of the images
+  m_usedIndexes.clear();
+  for (int i=0; i<n; ++i) {
+    if (modified[i])
+      images[i]->incrementVersion();
+
+    used[i].version = images[i]->version();
+    m_usedIndexes[images[i]->id()] = used[i];
+  }
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -551,49 +833,17 @@ CelsRange Sprite::uniqueCels() const
 
 //////////////////////////////////////////////////////////////////////
 
-static Layer* index2layer(const Layer* layer, const LayerIndex& index, int* index_count)
+static void flatten_layers(const LayerFolder* folder, std::vector<Layer*>& layers)
 {
-  if (index == *index_count)
-    return (Layer*)layer;
-  else {
-    (*index_count)++;
-
-    if (layer->isFolder()) {
-      Layer *found;
+  LayerConstIterator it = folder->getLayerBegin();
+  LayerConstIterator end = folder->getLayerEnd();
 
-      LayerConstIterator it = static_cast<const LayerFolder*>(layer)->getLayerBegin();
-      LayerConstIterator end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
-
-      for (; it != end; ++it) {
-        if ((found = index2layer(*it, index, index_count)))
-          return found;
-      }
-    }
-
-    return NULL;
-  }
-}
-
-static LayerIndex layer2index(const Layer* layer, const Layer* find_layer, int* index_count)
-{
-  if (layer == find_layer)
-    return LayerIndex(*index_count);
-  else {
-    (*index_count)++;
-
-    if (layer->isFolder()) {
-      int found;
-
-      LayerConstIterator it = static_cast<const LayerFolder*>(layer)->getLayerBegin();
-      LayerConstIterator end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
-
-      for (; it != end; ++it) {
-        if ((found = layer2index(*it, find_layer, index_count)) >= 0)
-          return LayerIndex(found);
-      }
-    }
+  for (; it != end; ++it) {
+    Layer* layer = *it;
+    layers.push_back(layer);
 
-    return LayerIndex(-1);
+    if (layer->isFolder())
+      flatten_layers(static_cast<const LayerFolder*>(layer), layers);
   }
 }
 
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "base/disable_copying.h"
+#include "base/mutex.h"
 #include "doc/cel_data.h"
 #include "doc/cel_list.h"
 #include "doc/color.h"
@@ -18,9 +19,13 @@
 #include "doc/layer_index.h"
 #include "doc/object.h"
 #include "doc/pixel_format.h"
+#include "doc/rgbmap_cache.h"
 #include "doc/sprite_position.h"
 #include "gfx/rect.h"
 
+#include <bitset>
+#include <map>
+#include <unordered_map>
 #include <vector>
 
 namespace doc {
@@ -75,6 +80,26 @@ namespace doc {
 
     virtual int getMemSize() const override;
 
+    // Bytes used by the sprite by category. Each image is counted
+    // once: images used by several cels (linked cels or cels sharing
+    // the same image) and images that share their pixels with other
+    // images (see Image::createSharedCopy()) are counted in
+    // "sharedImages".
+    struct MemoryUsage {
+      std::size_t images;
+      std::size_t sharedImages;
+      std::size_t palettes;
+      std::size_t other;        // Layers, cels, and frame tags
+
+      MemoryUsage() : images(0), sharedImages(0), palettes(0), other(0) { }
+
+      std::size_t total() const {
+        return images + sharedImages + palettes + other;
+      }
+    };
+
+    void getMemoryUsage(MemoryUsage& usage) const;
+
     ////////////////////////////////////////
     // Layers
 
@@ -89,6 +114,12 @@ namespace doc {
     Layer* indexToLayer(LayerIndex index) const;
     LayerIndex layerToIndex(const Layer* layer) const;
 
+    // Both functions use a cached list of all layers (folders before
+    // their children), which is created again after this function
+    // is called (by LayerFolder when layers are added, removed or
+    // moved).
+    void invalidateLayersIndex();
+
     void getLayersList(std::vector<Layer*>& layers) const;
 
     ////////////////////////////////////////
@@ -114,6 +145,7 @@ namespace doc {
 
     void addFrame(frame_t newFrame);
     void removeFrame(frame_t frame);
+    void moveFrame(frame_t frame, frame_t beforeFrame);
     void setTotalFrames(frame_t frames);
 
     int frameDuration(frame_t frame) const;
@@ -121,20 +153,39 @@ namespace doc {
     void setFrameRangeDuration(frame_t from, frame_t to, int msecs);
     void setDurationForAllFrames(int msecs);
 
+    // Time (in msecs) where the given frame starts, and the frame
+    // that is displayed in the given time (from 0 to duration()-1).
+    // They use a prefix-sum of frame durations that is calculated
+    // again only when a duration changes or frames are added/removed.
+    int frameTime(frame_t frame) const;
+    frame_t frameAtTime(int msecs) const;
+    int duration() const;
+
     const FrameTags& frameTags() const { return m_frameTags; }
     FrameTags& frameTags() { return m_frameTags; }
 
     ////////////////////////////////////////
     // Shared Images and CelData (for linked Cels)
 
+    // Images and cel data are found through indexes of the cels
+    // that use them, so undo/redo of commands that look for them by
+    // ID doesn't iterate all cels each time.
     ImageRef getImageRef(ObjectId imageId);
     CelDataRef getCelDataRef(ObjectId celDataId);
 
+    // Adds the image and cel data of the given cel to the indexes
+    // (called by LayerImage::addCel() and Cel::setDataRef()).
+    void indexCel(Cel* cel);
+
     ////////////////////////////////////////
     // Images
 
     void replaceImage(ObjectId curImageId, const ImageRef& newImage);
     void getImages(std::vector<Image*>& images) const;
+    // Remaps the images of the given range of frames (in parallel)
+    // and increments the version of the modified images. Images that
+    // don't use any of the remapped indexes are skipped (the used
+    // indexes of each image are cached by image version).
     void remapImages(frame_t frameFrom, frame_t frameTo, const Remap& remap);
     void pickCels(int x, int y, frame_t frame, int opacityThreshold, CelList& cels) const;
 
@@ -143,23 +194,61 @@ namespace doc {
     CelsRange uniqueCels() const;
 
   private:
+    void deleteRgbMaps(const Palette* pal);
+
     Document* m_document;
     PixelFormat m_format;                  // pixel format
     int m_width;                           // image width (in pixels)
     int m_height;                          // image height (in pixels)
     frame_t m_frames;                      // how many frames has this sprite
     std::vector<int> m_frlens;             // duration per frame
+    mutable std::vector<int> m_frameTimes; // start time of each frame (empty if it must be calculated)
     PalettesList m_palettes;               // list of palettes
     LayerFolder* m_folder;                 // main folder of layers
 
-    // Current rgb map
-    mutable RgbMap* m_rgbMap;
+    // Recently used rgb maps (the most recent first) of each palette
+    // (maps are shared with other sprites through RgbMapCache).
+    struct PaletteRgbMap {
+      const Palette* palette;
+      int modifications;        // Palette::getModifications() when the map was got
+      RgbMapRef map;
+    };
+    mutable std::vector<PaletteRgbMap> m_rgbMaps;
 
     // Transparent color used in indexed images
     color_t m_transparentColor;
 
     FrameTags m_frameTags;
 
+    // Indexes used by each image in the last remapImages() call
+    struct UsedIndexes {
+      ObjectVersion version;
+      std::bitset<256> indexes;
+    };
+    std::map<ObjectId, UsedIndexes> m_usedIndexes;
+
+    // IDs of the cels that use each image/cel data. They are created
+    // in the first search, and updated when cels are added or their
+    // data changes. Removed cels and cels with other image are
+    // detected when they are found, and then the indexes are created
+    // again.
+    void createCelIndexes();
+    bool findImageCels(ObjectId imageId, std::vector<Cel*>& cels);
+    Cel* indexedCel(ObjectId celId) const;
+
+    void updateLayersIndex() const;
+
+    // Layers in LayerIndex order and the index of each one (accessed
+    // with the mutex locked, as several threads can read the sprite)
+    mutable base::mutex m_layersIndexMutex;
+    mutable bool m_hasLayersIndex;
+    mutable std::vector<Layer*> m_layersIndex;
+    mutable std::unordered_map<const Layer*, int> m_layerIndexes;
+
+    bool m_hasCelIndexes;
+    std::unordered_map<ObjectId, std::vector<ObjectId> > m_imageCels;
+    std::unordered_map<ObjectId, ObjectId> m_celDataCels;
+
     // Disable default constructor and copying
     Sprite();
     DISABLE_COPYING(Sprite);
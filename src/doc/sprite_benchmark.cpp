@@ -0,0 +1,246 @@
+// Aseprite Document Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "tests/benchmark.h"
+#include "tests/benchmark_allocs.h"
+
+#include "base/unique_ptr.h"
+#include "doc/cel.h"
+#include "doc/frame_tag.h"
+#include "doc/frame_tags.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+#include <vector>
+
+using namespace doc;
+
+typedef base::UniquePtr<Sprite> SpritePtr;
+
+// Synthetic sprite with "layers" image layers and one small image
+// in each cel (so the cost of the operations depends on the number
+// of cels and not on pixels).
+static Sprite* create_sprite(int layers, int frames)
+{
+  Sprite* sprite = new Sprite(IMAGE_RGB, 16, 16, 256);
+  sprite->setTotalFrames(frame_t(frames));
+
+  for (int i=0; i<layers; ++i) {
+    LayerImage* layer = new LayerImage(sprite);
+    sprite->folder()->addLayer(layer);
+
+    for (frame_t frame(0); frame<frames; ++frame) {
+      ImageRef image(Image::create(IMAGE_RGB, 4, 4));
+      clear_image(image.get(), 0);
+      layer->addCel(new Cel(frame, image));
+    }
+  }
+
+  // Creates the cached list of layers
+  sprite->indexToLayer(LayerIndex(0));
+  return sprite;
+}
+
+// Random values from 0 to n-1 (the same sequence in each run)
+static std::vector<int> random_values(int count, int n, uint32_t seed)
+{
+  std::vector<int> values(count);
+  for (int i=0; i<count; ++i) {
+    seed = seed*1103515245 + 12345;
+    values[i] = int((seed >> 8) % uint32_t(n));
+  }
+  return values;
+}
+
+static void report_allocs(benchmark::State& state, const benchmark::AllocCounter& allocs)
+{
+  double n = allocs.perIteration(state);
+  state.counters["allocs"] = n;
+}
+
+// range_x = layers, range_y = frames (from 1k to 100k cels)
+static void sprite_sizes(benchmark::Benchmark* b)
+{
+  b->ArgPair(10, 100)
+   ->ArgPair(100, 100)
+   ->ArgPair(1000, 100)
+   ->ArgPair(10, 10000)
+   ->ArgPair(100, 1000);
+}
+
+static const int kLookups = 1024;
+
+static void BM_LayerImageCel(benchmark::State& state)
+{
+  const int layers = state.range_x();
+  const int frames = state.range_y();
+  SpritePtr sprite(create_sprite(layers, frames));
+  std::vector<int> l = random_values(kLookups, layers, 1);
+  std::vector<int> f = random_values(kLookups, frames, 2);
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    for (int i=0; i<kLookups; ++i)
+      benchmark::DoNotOptimize(sprite->layer(l[i])->cel(frame_t(f[i])));
+  }
+  state.SetItemsProcessed(state.iterations() * kLookups);
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_LayerImageCel)->Apply(sprite_sizes);
+
+static void BM_SpriteGetImageRef(benchmark::State& state)
+{
+  const int layers = state.range_x();
+  const int frames = state.range_y();
+  SpritePtr sprite(create_sprite(layers, frames));
+
+  std::vector<ObjectId> ids;
+  std::vector<int> l = random_values(kLookups, layers, 1);
+  std::vector<int> f = random_values(kLookups, frames, 2);
+  for (int i=0; i<kLookups; ++i)
+    ids.push_back(sprite->layer(l[i])->cel(frame_t(f[i]))->image()->id());
+
+  // The first search creates the indexes of images
+  sprite->getImageRef(ids[0]);
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    for (int i=0; i<kLookups; ++i)
+      benchmark::DoNotOptimize(sprite->getImageRef(ids[i]));
+  }
+  state.SetItemsProcessed(state.iterations() * kLookups);
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_SpriteGetImageRef)->Apply(sprite_sizes);
+
+static void BM_SpriteIndexToLayer(benchmark::State& state)
+{
+  const int layers = state.range_x();
+  SpritePtr sprite(create_sprite(layers, state.range_y()));
+  std::vector<int> l = random_values(kLookups, layers, 1);
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    for (int i=0; i<kLookups; ++i)
+      benchmark::DoNotOptimize(sprite->indexToLayer(LayerIndex(l[i])));
+  }
+  state.SetItemsProcessed(state.iterations() * kLookups);
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_SpriteIndexToLayer)->Apply(sprite_sizes);
+
+// Adds a layer on top (and removes it), and finds the first layer
+// again (so the cached list of layers is created again).
+static void BM_LayerFolderAddRemoveLayer(benchmark::State& state)
+{
+  SpritePtr sprite(create_sprite(state.range_x(), state.range_y()));
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    LayerImage* layer = new LayerImage(sprite);
+    sprite->folder()->addLayer(layer);
+    benchmark::DoNotOptimize(sprite->indexToLayer(LayerIndex(0)));
+
+    sprite->folder()->removeLayer(layer);
+    delete layer;
+    benchmark::DoNotOptimize(sprite->indexToLayer(LayerIndex(0)));
+  }
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_LayerFolderAddRemoveLayer)->Apply(sprite_sizes);
+
+static void BM_LayerImageAddRemoveCel(benchmark::State& state)
+{
+  const int layers = state.range_x();
+  const int frames = state.range_y();
+  SpritePtr sprite(create_sprite(layers, frames));
+  std::vector<int> l = random_values(kLookups, layers, 1);
+  std::vector<int> f = random_values(kLookups, frames, 2);
+
+  benchmark::AllocCounter allocs;
+  int i = 0;
+  while (state.KeepRunning()) {
+    LayerImage* layer = static_cast<LayerImage*>(sprite->layer(l[i]));
+    Cel* cel = layer->cel(frame_t(f[i]));
+    layer->removeCel(cel);
+    layer->addCel(cel);
+    i = (i+1) % kLookups;
+  }
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_LayerImageAddRemoveCel)->Apply(sprite_sizes);
+
+// Moves a cel after the last frame (and back to its frame)
+static void BM_LayerImageMoveCel(benchmark::State& state)
+{
+  const int layers = state.range_x();
+  const int frames = state.range_y();
+  SpritePtr sprite(create_sprite(layers, frames));
+  std::vector<int> l = random_values(kLookups, layers, 1);
+  std::vector<int> f = random_values(kLookups, frames, 2);
+
+  benchmark::AllocCounter allocs;
+  int i = 0;
+  while (state.KeepRunning()) {
+    LayerImage* layer = static_cast<LayerImage*>(sprite->layer(l[i]));
+    Cel* cel = layer->cel(frame_t(f[i]));
+    layer->moveCel(cel, frame_t(frames));
+    layer->moveCel(cel, frame_t(f[i]));
+    i = (i+1) % kLookups;
+  }
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_LayerImageMoveCel)->Apply(sprite_sizes);
+
+// Adds and removes a frame in the middle of the sprite (only the
+// frame durations, cels are moved by app::DocumentApi), and gets the
+// total duration again.
+static void BM_SpriteAddRemoveFrame(benchmark::State& state)
+{
+  const int frames = state.range_y();
+  SpritePtr sprite(create_sprite(state.range_x(), frames));
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    sprite->addFrame(frame_t(frames/2));
+    benchmark::DoNotOptimize(sprite->duration());
+    sprite->removeFrame(frame_t(frames/2));
+    benchmark::DoNotOptimize(sprite->duration());
+  }
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_SpriteAddRemoveFrame)->Apply(sprite_sizes);
+
+// range_x = tags (of 10 frames each), range_y = frames
+static void BM_FrameTagsInnerTag(benchmark::State& state)
+{
+  const int tags = state.range_x();
+  const int frames = state.range_y();
+  SpritePtr sprite(new Sprite(IMAGE_RGB, 16, 16, 256));
+  sprite->setTotalFrames(frame_t(frames));
+  for (int i=0; i<tags; ++i) {
+    frame_t from((frames - 10) * i / tags);
+    sprite->frameTags().add(new FrameTag(from, from+9));
+  }
+  std::vector<int> f = random_values(kLookups, frames, 2);
+
+  // The first search creates the segments of tags
+  sprite->frameTags().innerTag(frame_t(0));
+
+  benchmark::AllocCounter allocs;
+  while (state.KeepRunning()) {
+    for (int i=0; i<kLookups; ++i)
+      benchmark::DoNotOptimize(sprite->frameTags().innerTag(frame_t(f[i])));
+  }
+  state.SetItemsProcessed(state.iterations() * kLookups);
+  report_allocs(state, allocs);
+}
+BENCHMARK(BM_FrameTagsInnerTag)
+  ->ArgPair(10, 1000)
+  ->ArgPair(100, 1000)
+  ->ArgPair(1000, 10000);
@@ -13,9 +13,15 @@
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/layer.h"
+#include "doc/palette.h"
 #include "doc/pixel_format.h"
+#include "doc/primitives.h"
+#include "doc/remap.h"
+#include "doc/rgbmap.h"
 #include "doc/sprite.h"
 
+#include <algorithm>
+
 using namespace doc;
 
 // lay1 = A _ B
@@ -101,6 +107,376 @@ TEST(Sprite, CelsRange)
   EXPECT_EQ(2, i);
 }
 
+// Cels added in any order are kept sorted by frame
+TEST(Sprite, LayerImageCelsByFrame)
+{
+  Sprite* spr = new Sprite(IMAGE_RGB, 32, 32, 256);
+  spr->setTotalFrames(10);
+
+  LayerImage* lay = new LayerImage(spr);
+  spr->folder()->addLayer(lay);
+
+  frame_t frames[] = { 5, 1, 8, 0, 3 };
+  for (frame_t frame : frames)
+    lay->addCel(new Cel(frame, ImageRef(Image::create(IMAGE_RGB, 4, 4))));
+
+  frame_t prev = -1;
+  for (CelConstIterator it=lay->getCelBegin(); it != lay->getCelEnd(); ++it) {
+    EXPECT_LT(prev, (*it)->frame());
+    prev = (*it)->frame();
+  }
+
+  for (frame_t frame=0; frame<10; ++frame) {
+    bool exists = (std::find(frames, frames+5, frame) != frames+5);
+    Cel* cel = lay->cel(frame);
+    EXPECT_EQ(exists, cel != NULL);
+    if (cel) {
+      EXPECT_EQ(frame, cel->frame());
+    }
+  }
+
+  Cel* cel = lay->cel(3);
+  lay->moveCel(cel, 9);
+  EXPECT_EQ(NULL, lay->cel(3));
+  EXPECT_EQ(cel, lay->cel(9));
+  EXPECT_EQ(cel, lay->getLastCel());
+
+  lay->removeCel(cel);
+  EXPECT_EQ(NULL, lay->cel(9));
+  EXPECT_EQ(4, lay->getCelsCount());
+  delete cel;
+
+  delete spr;
+}
+
+// Frames are added/moved/removed renumbering the cels in one pass
+TEST(Sprite, AddMoveAndRemoveFrames)
+{
+  Sprite* spr = new Sprite(IMAGE_RGB, 32, 32, 256);
+  spr->setTotalFrames(6);
+  for (frame_t frame=0; frame<6; ++frame)
+    spr->setFrameDuration(frame, 100+frame);
+
+  LayerImage* lay = new LayerImage(spr);
+  spr->folder()->addLayer(lay);
+
+  Cel* cels[6] = { nullptr };
+  frame_t frames[] = { 0, 2, 3, 5 };
+  for (frame_t frame : frames) {
+    cels[frame] = new Cel(frame, ImageRef(Image::create(IMAGE_RGB, 4, 4)));
+    lay->addCel(cels[frame]);
+  }
+
+  // Frames: 0 1 2 3 4 5 -> 0 2 3 4 1 5
+  spr->moveFrame(1, 5);
+  EXPECT_EQ(cels[0], lay->cel(0));
+  EXPECT_EQ(cels[2], lay->cel(1));
+  EXPECT_EQ(cels[3], lay->cel(2));
+  EXPECT_EQ(NULL, lay->cel(3));
+  EXPECT_EQ(NULL, lay->cel(4));
+  EXPECT_EQ(cels[5], lay->cel(5));
+  EXPECT_EQ(102, spr->frameDuration(1));
+  EXPECT_EQ(101, spr->frameDuration(4));
+  EXPECT_EQ(105, spr->frameDuration(5));
+
+  // Frames: 0 2 3 4 1 5 -> 5 0 2 3 4 1
+  spr->moveFrame(5, 0);
+  EXPECT_EQ(cels[5], lay->cel(0));
+  EXPECT_EQ(cels[0], lay->cel(1));
+  EXPECT_EQ(cels[2], lay->cel(2));
+  EXPECT_EQ(cels[3], lay->cel(3));
+  EXPECT_EQ(105, spr->frameDuration(0));
+  EXPECT_EQ(101, spr->frameDuration(5));
+
+  spr->addFrame(1);
+  EXPECT_EQ(7, spr->totalFrames());
+  EXPECT_EQ(cels[5], lay->cel(0));
+  EXPECT_EQ(NULL, lay->cel(1));
+  EXPECT_EQ(cels[0], lay->cel(2));
+  EXPECT_EQ(cels[3], lay->cel(4));
+
+  lay->removeCel(cels[5]);
+  delete cels[5];
+  spr->removeFrame(0);
+  EXPECT_EQ(6, spr->totalFrames());
+  EXPECT_EQ(cels[0], lay->cel(1));
+  EXPECT_EQ(cels[2], lay->cel(2));
+  EXPECT_EQ(cels[3], lay->cel(3));
+  EXPECT_EQ(3, lay->getCelsCount());
+
+  frame_t prev = -1;
+  for (CelConstIterator it=lay->getCelBegin(); it != lay->getCelEnd(); ++it) {
+    EXPECT_LT(prev, (*it)->frame());
+    prev = (*it)->frame();
+  }
+
+  delete spr;
+}
+
+TEST(Sprite, FrameTimes)
+{
+  Sprite* spr = new Sprite(IMAGE_RGB, 32, 32, 256);
+  spr->setTotalFrames(4);
+  spr->setFrameDuration(0, 100);
+  spr->setFrameDuration(1, 50);
+  spr->setFrameDuration(2, 200);
+  spr->setFrameDuration(3, 10);
+
+  EXPECT_EQ(0, spr->frameTime(0));
+  EXPECT_EQ(100, spr->frameTime(1));
+  EXPECT_EQ(150, spr->frameTime(2));
+  EXPECT_EQ(350, spr->frameTime(3));
+  EXPECT_EQ(360, spr->duration());
+
+  EXPECT_EQ(0, spr->frameAtTime(-5));
+  EXPECT_EQ(0, spr->frameAtTime(99));
+  EXPECT_EQ(1, spr->frameAtTime(100));
+  EXPECT_EQ(1, spr->frameAtTime(149));
+  EXPECT_EQ(2, spr->frameAtTime(150));
+  EXPECT_EQ(3, spr->frameAtTime(359));
+  EXPECT_EQ(3, spr->frameAtTime(1000));
+
+  // Times are updated when durations/frames change
+  spr->setFrameDuration(1, 150);
+  EXPECT_EQ(250, spr->frameTime(2));
+  EXPECT_EQ(1, spr->frameAtTime(150));
+
+  spr->removeFrame(0);
+  EXPECT_EQ(3, spr->totalFrames());
+  EXPECT_EQ(150, spr->frameTime(1));
+  EXPECT_EQ(360, spr->duration());
+
+  spr->moveFrame(2, 0);
+  EXPECT_EQ(10, spr->frameTime(1));
+  EXPECT_EQ(2, spr->frameAtTime(160));
+
+  delete spr;
+}
+
+TEST(Sprite, PalettesByFrame)
+{
+  Sprite* spr = new Sprite(IMAGE_INDEXED, 32, 32, 256);
+  spr->setTotalFrames(10);
+
+  Palette pal(frame_t(0), 256);
+  for (int i=0; i<256; ++i)
+    pal.setEntry(i, rgba(i, 0, 0, 255));
+  pal.setFrame(6);
+  spr->setPalette(&pal, true);
+  pal.setFrame(3);
+  spr->setPalette(&pal, true);
+  pal.setEntry(1, rgba(0, 255, 0, 255));
+  pal.setFrame(8);
+  spr->setPalette(&pal, true);
+  ASSERT_EQ(4, int(spr->getPalettes().size()));
+
+  EXPECT_EQ(0, spr->palette(0)->frame());
+  EXPECT_EQ(0, spr->palette(2)->frame());
+  EXPECT_EQ(3, spr->palette(3)->frame());
+  EXPECT_EQ(3, spr->palette(5)->frame());
+  EXPECT_EQ(6, spr->palette(7)->frame());
+  EXPECT_EQ(8, spr->palette(9)->frame());
+
+  // Palettes with the same colors share the RGB map
+  RgbMap* map3 = spr->rgbMap(3);
+  EXPECT_EQ(map3, spr->rgbMap(6));
+  EXPECT_EQ(map3, spr->rgbMap(4));
+  RgbMap* map8 = spr->rgbMap(8);
+  EXPECT_NE(map3, map8);
+  EXPECT_EQ(1, map8->mapColor(0, 255, 0));
+  EXPECT_EQ(map3, spr->rgbMap(7));
+
+  spr->deletePalette(3);
+  EXPECT_EQ(0, spr->palette(5)->frame());
+  EXPECT_NE(map3, spr->rgbMap(5));
+  EXPECT_EQ(map3, spr->rgbMap(6));
+
+  delete spr;
+}
+
+TEST(Sprite, MemoryUsage)
+{
+  Sprite* spr = new Sprite(IMAGE_RGB, 32, 32, 256);
+  spr->setTotalFrames(2);
+
+  LayerImage* lay1 = new LayerImage(spr);
+  LayerImage* lay2 = new LayerImage(spr);
+  spr->folder()->addLayer(lay1);
+  spr->folder()->addLayer(lay2);
+
+  ImageRef imgA(Image::create(IMAGE_RGB, 32, 32));
+  Cel* celA = new Cel(frame_t(0), imgA);
+  Cel* celB = Cel::createLink(celA);
+  celB->setFrame(frame_t(1));
+  lay1->addCel(celA);
+  lay1->addCel(celB);
+
+  ImageRef imgC(Image::create(IMAGE_RGB, 16, 16));
+  lay2->addCel(new Cel(frame_t(0), imgC));
+
+  Sprite::MemoryUsage usage;
+  spr->getMemoryUsage(usage);
+  EXPECT_EQ(std::size_t(imgC->getMemSize()), usage.images);
+  EXPECT_EQ(std::size_t(imgA->getMemSize()), usage.sharedImages);
+  EXPECT_LT(std::size_t(256*4), usage.palettes);
+  EXPECT_LT(std::size_t(0), usage.other);
+  EXPECT_EQ(usage.images + usage.sharedImages + usage.palettes + usage.other,
+            usage.total());
+
+  delete spr;
+}
+
+TEST(Sprite, RemapImages)
+{
+  Sprite* spr = new Sprite(IMAGE_INDEXED, 4, 4, 256);
+  spr->setTotalFrames(2);
+
+  LayerImage* lay = new LayerImage(spr);
+  spr->folder()->addLayer(lay);
+
+  ImageRef imgA(Image::create(IMAGE_INDEXED, 4, 4));
+  ImageRef imgB(Image::create(IMAGE_INDEXED, 4, 4));
+  clear_image(imgA.get(), 1);
+  clear_image(imgB.get(), 5);
+  put_pixel(imgA.get(), 2, 2, 7);
+  lay->addCel(new Cel(frame_t(0), imgA));
+  lay->addCel(new Cel(frame_t(1), imgB));
+
+  ObjectVersion versionA = imgA->version();
+  ObjectVersion versionB = imgB->version();
+
+  // Swap 1 and 2
+  Remap remap(256);
+  for (int i=0; i<256; ++i)
+    remap.map(i, i);
+  remap.map(1, 2);
+  remap.map(2, 1);
+
+  spr->remapImages(0, spr->lastFrame(), remap);
+  EXPECT_EQ(2, get_pixel(imgA.get(), 0, 0));
+  EXPECT_EQ(7, get_pixel(imgA.get(), 2, 2));
+  EXPECT_EQ(5, get_pixel(imgB.get(), 0, 0));
+  EXPECT_NE(versionA, imgA->version());
+  EXPECT_EQ(versionB, imgB->version()); // Skipped, it doesn't use 1 or 2
+
+  // Undo (using the cached used indexes)
+  versionA = imgA->version();
+  spr->remapImages(0, spr->lastFrame(), remap.invert());
+  EXPECT_EQ(1, get_pixel(imgA.get(), 0, 0));
+  EXPECT_EQ(7, get_pixel(imgA.get(), 2, 2));
+  EXPECT_NE(versionA, imgA->version());
+  EXPECT_EQ(versionB, imgB->version());
+
+  // The cache is invalidated when the image is modified
+  put_pixel(imgB.get(), 0, 0, 2);
+  imgB->incrementVersion();
+  versionB = imgB->version();
+  spr->remapImages(0, spr->lastFrame(), remap);
+  EXPECT_EQ(1, get_pixel(imgB.get(), 0, 0));
+  EXPECT_EQ(5, get_pixel(imgB.get(), 1, 0));
+  EXPECT_NE(versionB, imgB->version());
+
+  delete spr;
+}
+
+TEST(Sprite, ImageAndCelDataIndexes)
+{
+  Sprite* spr = new Sprite(IMAGE_RGB, 4, 4, 256);
+  spr->setTotalFrames(3);
+
+  LayerImage* lay = new LayerImage(spr);
+  spr->folder()->addLayer(lay);
+
+  ImageRef imgA(Image::create(IMAGE_RGB, 4, 4));
+  Cel* celA = new Cel(frame_t(0), imgA);
+  Cel* celB = Cel::createLink(celA);
+  celB->setFrame(frame_t(1));
+  lay->addCel(celA);
+  lay->addCel(celB);
+
+  EXPECT_EQ(imgA.get(), spr->getImageRef(imgA->id()).get());
+  EXPECT_EQ(celA->data(), spr->getCelDataRef(celA->data()->id()).get());
+  EXPECT_FALSE(spr->getImageRef(spr->id()));
+
+  // Cels added after the indexes were created
+  ImageRef imgC(Image::create(IMAGE_RGB, 4, 4));
+  Cel* celC = new Cel(frame_t(2), imgC);
+  lay->addCel(celC);
+  EXPECT_EQ(imgC.get(), spr->getImageRef(imgC->id()).get());
+  EXPECT_EQ(celC->data(), spr->getCelDataRef(celC->data()->id()).get());
+
+  // Replaced images
+  ImageRef imgD(Image::create(IMAGE_RGB, 4, 4));
+  ObjectId imgAId = imgA->id();
+  spr->replaceImage(imgAId, imgD);
+  EXPECT_EQ(imgD.get(), celA->image());
+  EXPECT_EQ(imgD.get(), celB->image());
+  EXPECT_FALSE(spr->getImageRef(imgAId));
+  EXPECT_EQ(imgD.get(), spr->getImageRef(imgD->id()).get());
+
+  // Removed cels
+  ObjectId celDataCId = celC->data()->id();
+  lay->removeCel(celC);
+  EXPECT_FALSE(spr->getImageRef(imgC->id()));
+  EXPECT_FALSE(spr->getCelDataRef(celDataCId));
+  delete celC;
+
+  // The linked cel keeps the cel data in the sprite
+  ObjectId celDataAId = celA->data()->id();
+  lay->removeCel(celA);
+  EXPECT_EQ(celB->data(), spr->getCelDataRef(celDataAId).get());
+  EXPECT_EQ(imgD.get(), spr->getImageRef(imgD->id()).get());
+  delete celA;
+
+  delete spr;
+}
+
+// lay1
+// fold1
+//   lay2
+//   lay3
+// lay4
+TEST(Sprite, LayersIndex)
+{
+  Sprite* spr = new Sprite(IMAGE_RGB, 4, 4, 256);
+
+  LayerImage* lay1 = new LayerImage(spr);
+  LayerFolder* fold1 = new LayerFolder(spr);
+  LayerImage* lay2 = new LayerImage(spr);
+  LayerImage* lay3 = new LayerImage(spr);
+  LayerImage* lay4 = new LayerImage(spr);
+  spr->folder()->addLayer(lay1);
+  spr->folder()->addLayer(fold1);
+  fold1->addLayer(lay2);
+  fold1->addLayer(lay3);
+  spr->folder()->addLayer(lay4);
+
+  Layer* expected[] = { lay1, fold1, lay2, lay3, lay4 };
+  for (int i=0; i<5; ++i) {
+    EXPECT_EQ(expected[i], spr->indexToLayer(LayerIndex(i)));
+    EXPECT_EQ(i, spr->layerToIndex(expected[i]));
+  }
+  EXPECT_EQ(nullptr, spr->indexToLayer(LayerIndex(5)));
+  EXPECT_EQ(nullptr, spr->indexToLayer(LayerIndex(-1)));
+  EXPECT_EQ(-1, spr->layerToIndex(spr->folder()));
+
+  // Move, remove and add layers
+  fold1->stackLayer(lay2, lay3);
+  EXPECT_EQ(lay3, spr->indexToLayer(LayerIndex(2)));
+  EXPECT_EQ(3, spr->layerToIndex(lay2));
+
+  spr->folder()->removeLayer(fold1);
+  EXPECT_EQ(lay4, spr->indexToLayer(LayerIndex(1)));
+  EXPECT_EQ(-1, spr->layerToIndex(lay2));
+
+  spr->folder()->addLayer(fold1);
+  EXPECT_EQ(fold1, spr->indexToLayer(LayerIndex(2)));
+  EXPECT_EQ(3, spr->layerToIndex(lay3));
+  EXPECT_EQ(4, spr->layerToIndex(lay2));
+
+  delete spr;
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
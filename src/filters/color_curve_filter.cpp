@@ -16,6 +16,7 @@
 #include "filters/color_curve.h"
 #include "filters/filter_indexed_data.h"
 #include "filters/filter_manager.h"
+#include "filters/point_kernels.h"
 #include "doc/image.h"
 #include "doc/palette.h"
 #include "doc/rgbmap.h"
@@ -41,6 +42,9 @@ void ColorCurveFilter::setCurve(ColorCurve* curve)
   m_curve->getValues(0, 255, m_cmap);
   for (int c=0; c<256; c++)
     m_cmap[c] = MID(0, m_cmap[c], 255);
+
+  m_rgbaLut.setMap(&m_cmap[0]);
+  m_grayaLut.setMap(&m_cmap[0]);
 }
 
 const char* ColorCurveFilter::getName()
@@ -52,58 +56,24 @@ void ColorCurveFilter::applyToRgba(FilterManager* filterMgr)
 {
   const uint32_t* src_address = (uint32_t*)filterMgr->getSourceAddress();
   uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
   Target target = filterMgr->getTarget();
-  int x, c, r, g, b, a;
-
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
 
-    r = rgba_getr(c);
-    g = rgba_getg(c);
-    b = rgba_getb(c);
-    a = rgba_geta(c);
-
-    if (target & TARGET_RED_CHANNEL) r = m_cmap[r];
-    if (target & TARGET_GREEN_CHANNEL) g = m_cmap[g];
-    if (target & TARGET_BLUE_CHANNEL) b = m_cmap[b];
-    if (target & TARGET_ALPHA_CHANNEL) a = m_cmap[a];
-
-    *(dst_address++) = rgba(r, g, b, a);
-  }
+  for_each_selected_run(
+    filterMgr, [&](int x, int n) {
+      m_rgbaLut.apply(src_address+x, dst_address+x, n, target);
+    });
 }
 
 void ColorCurveFilter::applyToGrayscale(FilterManager* filterMgr)
 {
   const uint16_t* src_address = (uint16_t*)filterMgr->getSourceAddress();
   uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
   Target target = filterMgr->getTarget();
-  int x, c, k, a;
 
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
-
-    k = graya_getv(c);
-    a = graya_geta(c);
-
-    if (target & TARGET_GRAY_CHANNEL) k = m_cmap[k];
-    if (target & TARGET_ALPHA_CHANNEL) a = m_cmap[a];
-
-    *(dst_address++) = graya(k, a);
-  }
+  for_each_selected_run(
+    filterMgr, [&](int x, int n) {
+      m_grayaLut.apply(src_address+x, dst_address+x, n, target);
+    });
 }
 
 void ColorCurveFilter::applyToIndexed(FilterManager* filterMgr)
@@ -12,6 +12,7 @@
 #include <vector>
 
 #include "filters/filter.h"
+#include "filters/point_kernels.h"
 
 namespace filters {
 
@@ -34,6 +35,8 @@ namespace filters {
   private:
     ColorCurve* m_curve;
     std::vector<int> m_cmap;
+    RgbaLut m_rgbaLut;          // m_cmap for each channel
+    GrayaLut m_grayaLut;
   };
 
 } // namespace filters
@@ -20,6 +20,9 @@
 #include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
 
+#include <algorithm>
+#include <cstdlib>
+
 namespace filters {
 
 using namespace doc;
@@ -110,18 +113,242 @@ namespace {
 
   };
 
+  // Pixels of a row convolved in each step of the 1-D passes (so the
+  // sums of a step fit in the stack, without allocations for each row)
+  const int kRowChunk = 256;
+
+  // Wider matrices are applied with get_neighboring_pixels()
+  const int kMaxRowPassesWidth = 64;
+
+  // Sums of each channel for a row of pixels convolved with a
+  // separable matrix. The vertical pass accumulates one sum for each
+  // source column (using the column factors of the matrix), and the
+  // horizontal pass accumulates those column sums for each
+  // destination pixel (using the row factors).
+  template<int N>
+  class SeparableSums {
+  public:
+    SeparableSums() : m_n(0), m_count(0) { }
+
+    // Prepares the sums to convolve "n" pixels (n <= kRowChunk)
+    void reset(int n, int matrixWidth) {
+      ASSERT(n <= kRowChunk);
+      ASSERT(matrixWidth <= kMaxRowPassesWidth);
+      m_n = n;
+      m_count = n+matrixWidth-1;
+      clearCols();
+      for (int k=0; k<N; ++k)
+        std::fill(m_rows[k], m_rows[k]+m_n, 0);
+    }
+
+    int* cols(int k) { return m_cols[k]; }
+    int row(int k, int i) const { return m_rows[k][i]; }
+
+    void clearCols() {
+      for (int k=0; k<N; ++k)
+        std::fill(m_cols[k], m_cols[k]+m_count, 0);
+    }
+
+    void horizontalPass(const int* rowFactors, int matrixWidth) {
+      for (int k=0; k<N; ++k) {
+        int* out = m_rows[k];
+        for (int dx=0; dx<matrixWidth; ++dx) {
+          const int f = rowFactors[dx];
+          if (f == 0)
+            continue;
+
+          // Simple loop over contiguous arrays (vectorized by the
+          // compiler)
+          const int* in = m_cols[k]+dx;
+          for (int i=0; i<m_n; ++i)
+            out[i] += f * in[i];
+        }
+      }
+    }
+
+  private:
+    int m_n;
+    int m_count;
+    int m_cols[N][kRowChunk+kMaxRowPassesWidth-1];
+    int m_rows[N][kRowChunk];
+  };
+
+  // Source columns of the n+matrixWidth-1 pixels needed to convolve
+  // the "n" pixels starting from "x" (tiled mode and image limits are
+  // resolved one time for each column). Returns the number of columns.
+  int neighboring_columns(const Image* src, int x, int n,
+                          const ConvolutionMatrix* matrix,
+                          TiledMode tiledMode,
+                          int* cols)
+  {
+    const bool tiledX = ((int(tiledMode) & int(TiledMode::X_AXIS)) != 0);
+    const int count = n + matrix->getWidth() - 1;
+    const int t0 = x - matrix->getCenterX();
+
+    for (int i=0; i<count; ++i)
+      cols[i] = get_neighboring_coord(t0+i, src->width(), tiledX);
+    return count;
+  }
+
+  // Calculates the sums to convolve the "n" pixels of the row "y"
+  // starting from "x". The vertical pass calls addPixel(sums, i,
+  // color, factor) for each source pixel of the n+matrixWidth-1
+  // columns needed. Tiled mode and image limits are resolved one time
+  // for each column and row (not for each pixel of the matrix).
+  template<typename Traits, int N, typename AddPixel>
+  void separable_passes(const Image* src, int x, int y, int n,
+                        const ConvolutionMatrix* matrix,
+                        const std::vector<int>& rowFactors,
+                        const std::vector<int>& colFactors,
+                        TiledMode tiledMode,
+                        SeparableSums<N>& sums,
+                        AddPixel addPixel)
+  {
+    const bool tiledY = ((int(tiledMode) & int(TiledMode::Y_AXIS)) != 0);
+    int cols[kRowChunk+kMaxRowPassesWidth-1];
+    const int count = neighboring_columns(src, x, n, matrix, tiledMode, cols);
+
+    sums.reset(n, matrix->getWidth());
+    for (int dy=0; dy<matrix->getHeight(); ++dy) {
+      const int f = colFactors[dy];
+      if (f == 0)
+        continue;
+
+      int sy = get_neighboring_coord(y - matrix->getCenterY() + dy, src->height(), tiledY);
+      const typename Traits::pixel_t* srcRow =
+        reinterpret_cast<const typename Traits::pixel_t*>(src->getPixelAddress(0, sy));
+
+      for (int i=0; i<count; ++i)
+        addPixel(sums, i, srcRow[cols[i]], f);
+    }
+
+    sums.horizontalPass(&rowFactors[0], matrix->getWidth());
+  }
+
+  // Channels of SeparableSums for each image type
+
+  struct AddPixelRgba {
+    enum { R, G, B, A, TransparentFactors, N };
+
+    void operator()(SeparableSums<N>& sums, int i, RgbTraits::pixel_t color, int f) const {
+      if (rgba_geta(color) == 0)
+        sums.cols(TransparentFactors)[i] += f;
+      else {
+        sums.cols(R)[i] += rgba_getr(color) * f;
+        sums.cols(G)[i] += rgba_getg(color) * f;
+        sums.cols(B)[i] += rgba_getb(color) * f;
+        sums.cols(A)[i] += rgba_geta(color) * f;
+      }
+    }
+  };
+
+  struct AddPixelGrayscale {
+    enum { V, A, TransparentFactors, N };
+
+    void operator()(SeparableSums<N>& sums, int i, GrayscaleTraits::pixel_t color, int f) const {
+      if (graya_geta(color) == 0)
+        sums.cols(TransparentFactors)[i] += f;
+      else {
+        sums.cols(V)[i] += graya_getv(color) * f;
+        sums.cols(A)[i] += graya_geta(color) * f;
+      }
+    }
+  };
+
+  struct AddPixelIndexed {
+    enum { R, G, B, Index, N };
+    const Palette* pal;
+
+    AddPixelIndexed(const Palette* pal) : pal(pal) { }
+
+    void operator()(SeparableSums<N>& sums, int i, IndexedTraits::pixel_t color, int f) const {
+      sums.cols(R)[i] += rgba_getr(pal->getEntry(color)) * f;
+      sums.cols(G)[i] += rgba_getg(pal->getEntry(color)) * f;
+      sums.cols(B)[i] += rgba_getb(pal->getEntry(color)) * f;
+      sums.cols(Index)[i] += color * f;
+    }
+  };
+
 }
 
 ConvolutionMatrixFilter::ConvolutionMatrixFilter()
   : m_matrix(NULL)
   , m_tiledMode(TiledMode::NONE)
+  , m_separable(false)
 {
 }
 
+static int gcd(int a, int b)
+{
+  while (b != 0) {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
 void ConvolutionMatrixFilter::setMatrix(const base::SharedPtr<ConvolutionMatrix>& matrix)
 {
   m_matrix = matrix;
-  m_lines.resize(matrix->getHeight());
+  m_separable = false;
+  m_rowFactors.clear();
+  m_colFactors.clear();
+
+  const int w = matrix->getWidth();
+  const int h = matrix->getHeight();
+  if (w < 2 || h < 2)
+    return;
+
+  // Find the first non-zero value
+  int x0 = -1, y0 = -1;
+  for (int y=0; y<h && y0<0; ++y)
+    for (int x=0; x<w; ++x)
+      if (matrix->value(x, y) != 0) {
+        x0 = x;
+        y0 = y;
+        break;
+      }
+  if (y0 < 0)
+    return;
+
+  // Row factors: the first non-zero row divided by the GCD of its
+  // values (so all rows of a separable matrix are integer multiples
+  // of these factors)
+  int g = 0;
+  for (int x=0; x<w; ++x)
+    g = gcd(g, std::abs(matrix->value(x, y0)));
+  if (matrix->value(x0, y0) < 0)
+    g = -g;
+
+  std::vector<int> rowFactors(w);
+  for (int x=0; x<w; ++x)
+    rowFactors[x] = matrix->value(x, y0) / g;
+
+  std::vector<int> colFactors(h);
+  for (int y=0; y<h; ++y) {
+    int c = matrix->value(x0, y) / rowFactors[x0];
+    for (int x=0; x<w; ++x)
+      if (matrix->value(x, y) != c * rowFactors[x])
+        return;                 // Not separable
+    colFactors[y] = c;
+  }
+
+  m_separable = true;
+  m_rowFactors.swap(rowFactors);
+  m_colFactors.swap(colFactors);
+}
+
+// The 1-D passes give exactly the same result as the whole matrix,
+// except when the matrix is wider than the image (where
+// get_neighboring_pixels() doesn't clamp the X coordinate). Matrices
+// that aren't separable use get_neighboring_pixels() (applying each
+// row of the matrix with a 1-D pass isn't faster with GCC -O2).
+bool ConvolutionMatrixFilter::useRowPasses(const Image* src) const
+{
+  return (m_separable &&
+          m_matrix->getWidth() <= src->width() &&
+          m_matrix->getWidth() <= kMaxRowPassesWidth);
 }
 
 void ConvolutionMatrixFilter::setTiledMode(TiledMode tiledMode)
@@ -145,23 +372,44 @@ void ConvolutionMatrixFilter::applyToRgba(FilterManager* filterMgr)
   uint32_t color;
   GetPixelsDelegateRgba delegate;
   int x = filterMgr->x();
+  int x1 = x;
   int x2 = x+filterMgr->getWidth();
   int y = filterMgr->y();
 
+  typedef AddPixelRgba C;
+  bool rowPasses = useRowPasses(src);
+  SeparableSums<C::N> sums;
+
   for (; x<x2; ++x) {
+    // Sums of the next chunk of pixels
+    if (rowPasses && (x-x1) % kRowChunk == 0)
+      separable_passes<RgbTraits>(src, x, y, std::min(kRowChunk, x2-x), m_matrix.get(),
+                                  m_rowFactors, m_colFactors,
+                                  m_tiledMode, sums, C());
+
     // Avoid the non-selected region
     if (filterMgr->skipPixel()) {
       ++dst_address;
       continue;
     }
 
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<RgbTraits>(src, x, y,
-                                      m_matrix->getWidth(),
-                                      m_matrix->getHeight(),
-                                      m_matrix->getCenterX(),
-                                      m_matrix->getCenterY(),
-                                      m_tiledMode, delegate);
+    if (rowPasses) {
+      int i = (x - x1) % kRowChunk;
+      delegate.div = m_matrix->getDiv() - sums.row(C::TransparentFactors, i);
+      delegate.r = sums.row(C::R, i);
+      delegate.g = sums.row(C::G, i);
+      delegate.b = sums.row(C::B, i);
+      delegate.a = sums.row(C::A, i);
+    }
+    else {
+      delegate.reset(m_matrix.get());
+      get_neighboring_pixels<RgbTraits>(src, x, y,
+                                        m_matrix->getWidth(),
+                                        m_matrix->getHeight(),
+                                        m_matrix->getCenterX(),
+                                        m_matrix->getCenterY(),
+                                        m_tiledMode, delegate);
+    }
 
     color = get_pixel_fast<RgbTraits>(src, x, y);
     if (delegate.div == 0) {
@@ -212,23 +460,42 @@ void ConvolutionMatrixFilter::applyToGrayscale(FilterManager* filterMgr)
   uint16_t color;
   GetPixelsDelegateGrayscale delegate;
   int x = filterMgr->x();
+  int x1 = x;
   int x2 = x+filterMgr->getWidth();
   int y = filterMgr->y();
 
+  typedef AddPixelGrayscale C;
+  bool rowPasses = useRowPasses(src);
+  SeparableSums<C::N> sums;
+
   for (; x<x2; ++x) {
+    // Sums of the next chunk of pixels
+    if (rowPasses && (x-x1) % kRowChunk == 0)
+      separable_passes<GrayscaleTraits>(src, x, y, std::min(kRowChunk, x2-x), m_matrix.get(),
+                                        m_rowFactors, m_colFactors,
+                                        m_tiledMode, sums, C());
+
     // Avoid the non-selected region
     if (filterMgr->skipPixel()) {
       ++dst_address;
       continue;
     }
 
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y,
-                                            m_matrix->getWidth(),
-                                            m_matrix->getHeight(),
-                                            m_matrix->getCenterX(),
-                                            m_matrix->getCenterY(),
-                                            m_tiledMode, delegate);
+    if (rowPasses) {
+      int i = (x - x1) % kRowChunk;
+      delegate.div = m_matrix->getDiv() - sums.row(C::TransparentFactors, i);
+      delegate.v = sums.row(C::V, i);
+      delegate.a = sums.row(C::A, i);
+    }
+    else {
+      delegate.reset(m_matrix.get());
+      get_neighboring_pixels<GrayscaleTraits>(src, x, y,
+                                              m_matrix->getWidth(),
+                                              m_matrix->getHeight(),
+                                              m_matrix->getCenterX(),
+                                              m_matrix->getCenterY(),
+                                              m_tiledMode, delegate);
+    }
 
     color = get_pixel_fast<GrayscaleTraits>(src, x, y);
     if (delegate.div == 0) {
@@ -267,23 +534,44 @@ void ConvolutionMatrixFilter::applyToIndexed(FilterManager* filterMgr)
   uint8_t color;
   GetPixelsDelegateIndexed delegate(pal);
   int x = filterMgr->x();
+  int x1 = x;
   int x2 = x+filterMgr->getWidth();
   int y = filterMgr->y();
 
+  typedef AddPixelIndexed C;
+  bool rowPasses = useRowPasses(src);
+  SeparableSums<C::N> sums;
+
   for (; x<x2; ++x) {
+    // Sums of the next chunk of pixels
+    if (rowPasses && (x-x1) % kRowChunk == 0)
+      separable_passes<IndexedTraits>(src, x, y, std::min(kRowChunk, x2-x), m_matrix.get(),
+                                      m_rowFactors, m_colFactors,
+                                      m_tiledMode, sums, C(pal));
+
     // Avoid the non-selected region
     if (filterMgr->skipPixel()) {
       ++dst_address;
       continue;
     }
 
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<IndexedTraits>(src, x, y,
-                                          m_matrix->getWidth(),
-                                          m_matrix->getHeight(),
-                                          m_matrix->getCenterX(),
-                                          m_matrix->getCenterY(),
-                                          m_tiledMode, delegate);
+    if (rowPasses) {
+      int i = (x - x1) % kRowChunk;
+      delegate.div = m_matrix->getDiv();
+      delegate.r = sums.row(C::R, i);
+      delegate.g = sums.row(C::G, i);
+      delegate.b = sums.row(C::B, i);
+      delegate.index = sums.row(C::Index, i);
+    }
+    else {
+      delegate.reset(m_matrix.get());
+      get_neighboring_pixels<IndexedTraits>(src, x, y,
+                                            m_matrix->getWidth(),
+                                            m_matrix->getHeight(),
+                                            m_matrix->getCenterX(),
+                                            m_matrix->getCenterY(),
+                                            m_tiledMode, delegate);
+    }
 
     color = get_pixel_fast<IndexedTraits>(src, x, y);
     if (delegate.div == 0) {
@@ -15,6 +15,10 @@
 #include "filters/filter.h"
 #include "filters/tiled_mode.h"
 
+namespace doc {
+  class Image;
+}
+
 namespace filters {
 
   class ConvolutionMatrix;
@@ -36,9 +40,17 @@ namespace filters {
     void applyToIndexed(FilterManager* filterMgr);
 
   private:
+    bool useRowPasses(const doc::Image* src) const;
+
     base::SharedPtr<ConvolutionMatrix> m_matrix;
     TiledMode m_tiledMode;
-    std::vector<uint8_t*> m_lines;
+
+    // If the matrix is separable (i.e. value(x, y) == m_rowFactors[x]
+    // * m_colFactors[y]), the filter is applied in two 1-D passes. In
+    // other case, the whole matrix is applied to each pixel.
+    bool m_separable;
+    std::vector<int> m_rowFactors;
+    std::vector<int> m_colFactors;
   };
 
 } // namespace filters
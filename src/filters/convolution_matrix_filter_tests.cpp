@@ -0,0 +1,292 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include <gtest/gtest.h>
+
+#include "base/base.h"
+#include "base/unique_ptr.h"
+#include "filters/convolution_matrix.h"
+#include "filters/convolution_matrix_filter.h"
+#include "filters/neighboring_pixels.h"
+#include "filters/test_filter_manager.h"
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+  // Sums all the neighboring pixels of the whole matrix (as the
+  // filter did before the 1-D passes of separable matrices).
+  struct Sums {
+    const ConvolutionMatrix* matrix;
+    const Palette* pal;
+    const int* factor;
+    int div, r, g, b, a, v, index;
+
+    Sums(const ConvolutionMatrix* matrix, const Palette* pal)
+      : matrix(matrix), pal(pal), factor(&matrix->value(0, 0))
+      , div(matrix->getDiv()), r(0), g(0), b(0), a(0), v(0), index(0) {
+    }
+
+    void operator()(RgbTraits::pixel_t c) {
+      if (*factor) {
+        if (rgba_geta(c) == 0)
+          div -= *factor;
+        else {
+          r += rgba_getr(c) * (*factor);
+          g += rgba_getg(c) * (*factor);
+          b += rgba_getb(c) * (*factor);
+          a += rgba_geta(c) * (*factor);
+        }
+      }
+      ++factor;
+    }
+
+    void operator()(GrayscaleTraits::pixel_t c) {
+      if (*factor) {
+        if (graya_geta(c) == 0)
+          div -= *factor;
+        else {
+          v += graya_getv(c) * (*factor);
+          a += graya_geta(c) * (*factor);
+        }
+      }
+      ++factor;
+    }
+
+    void operator()(IndexedTraits::pixel_t c) {
+      if (*factor) {
+        color_t rgb = pal->getEntry(c);
+        r += rgba_getr(rgb) * (*factor);
+        g += rgba_getg(rgb) * (*factor);
+        b += rgba_getb(rgb) * (*factor);
+        index += c * (*factor);
+      }
+      ++factor;
+    }
+
+    int channel(Target target, Target channel, int sum, int div, int original) const {
+      if (target & channel)
+        return MID(0, sum / div + matrix->getBias(), 255);
+      else
+        return original;
+    }
+  };
+
+  // Applies the whole matrix with get_neighboring_pixels() to each
+  // pixel of "src"
+  template<typename Traits>
+  void reference_filter(const Image* src, Image* dst,
+                        const ConvolutionMatrix* matrix,
+                        TiledMode tiledMode, Target target,
+                        const Palette* pal, const RgbMap* rgbmap)
+  {
+    for (int y=0; y<src->height(); ++y) {
+      for (int x=0; x<src->width(); ++x) {
+        Sums s(matrix, pal);
+        get_neighboring_pixels<Traits>(src, x, y,
+                                       matrix->getWidth(), matrix->getHeight(),
+                                       matrix->getCenterX(), matrix->getCenterY(),
+                                       tiledMode, s);
+
+        color_t c = get_pixel(src, x, y);
+        if (s.div == 0) {
+          put_pixel(dst, x, y, c);
+          continue;
+        }
+
+        switch (src->pixelFormat()) {
+          case IMAGE_RGB:
+            put_pixel(dst, x, y,
+                      rgba(s.channel(target, TARGET_RED_CHANNEL, s.r, s.div, rgba_getr(c)),
+                           s.channel(target, TARGET_GREEN_CHANNEL, s.g, s.div, rgba_getg(c)),
+                           s.channel(target, TARGET_BLUE_CHANNEL, s.b, s.div, rgba_getb(c)),
+                           s.channel(target, TARGET_ALPHA_CHANNEL, s.a, matrix->getDiv(), rgba_geta(c))));
+            break;
+          case IMAGE_GRAYSCALE:
+            put_pixel(dst, x, y,
+                      graya(s.channel(target, TARGET_GRAY_CHANNEL, s.v, s.div, graya_getv(c)),
+                            s.channel(target, TARGET_ALPHA_CHANNEL, s.a, matrix->getDiv(), graya_geta(c))));
+            break;
+          case IMAGE_INDEXED:
+            if (target & TARGET_INDEX_CHANNEL)
+              put_pixel(dst, x, y, s.channel(target, TARGET_INDEX_CHANNEL, s.index, s.div, c));
+            else
+              put_pixel(dst, x, y,
+                        rgbmap->mapColor(
+                          s.channel(target, TARGET_RED_CHANNEL, s.r, s.div, rgba_getr(pal->getEntry(c))),
+                          s.channel(target, TARGET_GREEN_CHANNEL, s.g, s.div, rgba_getg(pal->getEntry(c))),
+                          s.channel(target, TARGET_BLUE_CHANNEL, s.b, s.div, rgba_getb(pal->getEntry(c)))));
+            break;
+        }
+      }
+    }
+  }
+
+  void fill_image(Image* image)
+  {
+    uint32_t seed = 1;
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x) {
+        seed = seed*1103515245 + 12345;
+        uint32_t value = seed >> 8;
+        switch (image->pixelFormat()) {
+          case IMAGE_RGB:
+            // Some transparent pixels
+            put_pixel(image, x, y, (value & 0x7) == 0 ? value & 0xffffff: value | 0xff000000);
+            break;
+          case IMAGE_GRAYSCALE:
+            put_pixel(image, x, y, (value & 0x7) == 0 ? value & 0xff: value | 0xff00);
+            break;
+          case IMAGE_INDEXED:
+            put_pixel(image, x, y, value & 0xff);
+            break;
+        }
+      }
+  }
+
+  // A box blur (separable), a sharpen (separable with negative
+  // values), and a non-separable matrix
+  base::SharedPtr<ConvolutionMatrix> create_matrix(int type, int w, int h)
+  {
+    base::SharedPtr<ConvolutionMatrix> matrix(new ConvolutionMatrix(w, h));
+    int div = 0;
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x) {
+        int value;
+        switch (type) {
+          case 0: value = 1; break;
+          case 1: value = (x == w/2 ? 3: -1) * (y+1); break;
+          default: value = (x+2*y) % 3; break;
+        }
+        matrix->value(x, y) = value * ConvolutionMatrix::Precision;
+        div += value;
+      }
+    matrix->setDiv((div > 0 ? div: 1) * ConvolutionMatrix::Precision);
+    matrix->setBias(type == 1 ? 16: 0);
+    matrix->setCenterX(w/2);
+    matrix->setCenterY(h/2);
+    return matrix;
+  }
+
+  void test_format(PixelFormat format, int width, int height)
+  {
+    base::UniquePtr<Image> src(Image::create(format, width, height));
+    base::UniquePtr<Image> dst(Image::create(format, width, height));
+    base::UniquePtr<Image> expected(Image::create(format, width, height));
+    fill_image(src);
+
+    const Target targets[] = {
+      TARGET_RED_CHANNEL | TARGET_GREEN_CHANNEL | TARGET_BLUE_CHANNEL |
+      TARGET_ALPHA_CHANNEL | TARGET_GRAY_CHANNEL,
+      TARGET_RED_CHANNEL | TARGET_BLUE_CHANNEL | TARGET_GRAY_CHANNEL,
+      TARGET_GREEN_CHANNEL | TARGET_ALPHA_CHANNEL,
+      TARGET_INDEX_CHANNEL | TARGET_ALPHA_CHANNEL,
+    };
+    const TiledMode tiledModes[] = {
+      TiledMode::NONE, TiledMode::X_AXIS, TiledMode::Y_AXIS, TiledMode::BOTH
+    };
+    const int sizes[][2] = { { 3, 3 }, { 5, 3 }, { 2, 7 }, { 7, 7 }, { width+2, 3 } };
+
+    for (int type=0; type<3; ++type)
+      for (const auto& size : sizes) {
+        base::SharedPtr<ConvolutionMatrix> matrix = create_matrix(type, size[0], size[1]);
+
+        for (TiledMode tiledMode : tiledModes)
+          for (Target target : targets) {
+            ConvolutionMatrixFilter filter;
+            filter.setTiledMode(tiledMode);
+            filter.setMatrix(matrix);
+
+            TestFilterManager mgr(src, dst);
+            mgr.setTarget(target);
+            clear_image(dst, 0);
+            mgr.apply(&filter);
+
+            clear_image(expected, 0);
+            switch (format) {
+              case IMAGE_RGB:
+                reference_filter<RgbTraits>(src, expected, matrix.get(), tiledMode, target,
+                                            mgr.getPalette(), mgr.getRgbMap());
+                break;
+              case IMAGE_GRAYSCALE:
+                reference_filter<GrayscaleTraits>(src, expected, matrix.get(), tiledMode, target,
+                                                  mgr.getPalette(), mgr.getRgbMap());
+                break;
+              case IMAGE_INDEXED:
+                reference_filter<IndexedTraits>(src, expected, matrix.get(), tiledMode, target,
+                                                mgr.getPalette(), mgr.getRgbMap());
+                break;
+            }
+
+            EXPECT_EQ(0, count_diff_between_images(expected, dst))
+              << "matrix type " << type << ", size " << size[0] << "x" << size[1]
+              << ", tiled mode " << int(tiledMode) << ", target " << target;
+          }
+      }
+  }
+
+} // anonymous namespace
+
+// The image is wider than the chunks of pixels summed by the 1-D
+// passes of separable matrices
+TEST(ConvolutionMatrixFilter, RgbIsEqualToWholeMatrix)
+{
+  test_format(IMAGE_RGB, 300, 9);
+}
+
+TEST(ConvolutionMatrixFilter, GrayscaleIsEqualToWholeMatrix)
+{
+  test_format(IMAGE_GRAYSCALE, 300, 9);
+}
+
+TEST(ConvolutionMatrixFilter, IndexedIsEqualToWholeMatrix)
+{
+  test_format(IMAGE_INDEXED, 300, 9);
+}
+
+TEST(ConvolutionMatrixFilter, SmallImages)
+{
+  test_format(IMAGE_RGB, 4, 2);
+  test_format(IMAGE_GRAYSCALE, 1, 5);
+  test_format(IMAGE_INDEXED, 6, 1);
+}
+
+TEST(ConvolutionMatrixFilter, SkipNonSelectedPixels)
+{
+  base::UniquePtr<Image> src(Image::create(IMAGE_RGB, 300, 4));
+  base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, 300, 4));
+  base::UniquePtr<Image> expected(Image::create(IMAGE_RGB, 300, 4));
+  base::UniquePtr<Image> mask(Image::create(IMAGE_BITMAP, 300, 4));
+  fill_image(src);
+  clear_image(mask, 0);
+  fill_rect(mask, 10, 0, 20, 3, 1);
+  fill_rect(mask, 250, 1, 270, 2, 1);
+
+  base::SharedPtr<ConvolutionMatrix> matrix = create_matrix(0, 5, 5);
+  ConvolutionMatrixFilter filter;
+  filter.setTiledMode(TiledMode::NONE);
+  filter.setMatrix(matrix);
+
+  TestFilterManager mgr(src, dst);
+  mgr.setMask(mask);
+  clear_image(dst, 0);
+  mgr.apply(&filter);
+
+  reference_filter<RgbTraits>(src, expected, matrix.get(), TiledMode::NONE,
+                              mgr.getTarget(), NULL, NULL);
+  for (int y=0; y<4; ++y)
+    for (int x=0; x<300; ++x)
+      EXPECT_EQ(get_pixel(mask, x, y) ? get_pixel(expected, x, y): 0,
+                get_pixel(dst, x, y)) << "pixel " << x << "," << y;
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
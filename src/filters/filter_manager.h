@@ -58,6 +58,18 @@ namespace filters {
     // selection is actived).
     virtual bool skipPixel() = 0;
 
+    // Skips a run of pixels (at most "n") with the same selection
+    // state starting from the current pixel, and returns the number
+    // of pixels in the run (at least 1). "skip" is set to true if the
+    // pixels of the run must be skipped. It's like calling
+    // skipPixel() for each pixel of the run, but implementations can
+    // check several pixels of the mask at once. Don't mix calls to
+    // skipPixel() and skipRun() in the same row.
+    virtual int skipRun(int n, bool& skip) {
+      skip = skipPixel();
+      return 1;
+    }
+
     //////////////////////////////////////////////////////////////////////
     // Special members for 2D filters like convolution matrices.
 
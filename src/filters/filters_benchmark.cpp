@@ -0,0 +1,169 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include "tests/benchmark.h"
+
+#include "base/unique_ptr.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+#include "filters/color_curve.h"
+#include "filters/color_curve_filter.h"
+#include "filters/convolution_matrix.h"
+#include "filters/convolution_matrix_filter.h"
+#include "filters/invert_color_filter.h"
+#include "filters/median_filter.h"
+#include "filters/replace_color_filter.h"
+#include "filters/test_filter_manager.h"
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+void fill_image(Image* image)
+{
+  uint32_t seed = 1;
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x) {
+      seed = seed*1103515245 + 12345;
+      switch (image->pixelFormat()) {
+        case IMAGE_RGB: put_pixel(image, x, y, seed); break;
+        case IMAGE_GRAYSCALE: put_pixel(image, x, y, seed & 0xffff); break;
+        case IMAGE_INDEXED: put_pixel(image, x, y, (seed >> 16) & 0xff); break;
+      }
+    }
+}
+
+} // anonymous namespace
+
+// Median filter of size range_y x range_y in a 256x256 image of the
+// pixel format range_x
+static void BM_MedianFilter(benchmark::State& state)
+{
+  const PixelFormat format = PixelFormat(state.range_x());
+  base::UniquePtr<Image> src(Image::create(format, 256, 256));
+  base::UniquePtr<Image> dst(Image::create(format, 256, 256));
+  fill_image(src);
+
+  MedianFilter filter;
+  filter.setTiledMode(TiledMode::NONE);
+  filter.setSize(state.range_y(), state.range_y());
+
+  TestFilterManager mgr(src, dst);
+  while (state.KeepRunning())
+    mgr.apply(&filter);
+
+  state.SetItemsProcessed(state.iterations() * src->width() * src->height());
+}
+BENCHMARK(BM_MedianFilter)
+  ->ArgPair(IMAGE_RGB, 3)
+  ->ArgPair(IMAGE_RGB, 7)
+  ->ArgPair(IMAGE_GRAYSCALE, 3)
+  ->ArgPair(IMAGE_INDEXED, 3);
+
+// Applies a convolution matrix of size "size" x "size" to a 256x256
+// image. A separable matrix is a box blur, the non-separable one is
+// the same matrix with a different center value.
+static void convolution_matrix_benchmark(benchmark::State& state,
+                                         PixelFormat format, int size,
+                                         bool separable)
+{
+  base::UniquePtr<Image> src(Image::create(format, 256, 256));
+  base::UniquePtr<Image> dst(Image::create(format, 256, 256));
+  fill_image(src);
+
+  base::SharedPtr<ConvolutionMatrix> matrix(new ConvolutionMatrix(size, size));
+  for (int y=0; y<size; ++y)
+    for (int x=0; x<size; ++x)
+      matrix->value(x, y) = ConvolutionMatrix::Precision;
+  if (!separable)
+    matrix->value(size/2, size/2) = 2*ConvolutionMatrix::Precision;
+  matrix->setDiv((size*size + (separable ? 0: 1)) * ConvolutionMatrix::Precision);
+
+  ConvolutionMatrixFilter filter;
+  filter.setTiledMode(TiledMode::NONE);
+  filter.setMatrix(matrix);
+
+  TestFilterManager mgr(src, dst);
+  while (state.KeepRunning())
+    mgr.apply(&filter);
+
+  state.SetItemsProcessed(state.iterations() * src->width() * src->height());
+}
+
+// Pixel format range_x, matrix size range_y
+static void BM_ConvolutionMatrix(benchmark::State& state)
+{
+  convolution_matrix_benchmark(state, PixelFormat(state.range_x()), state.range_y(), true);
+}
+BENCHMARK(BM_ConvolutionMatrix)
+  ->ArgPair(IMAGE_RGB, 3)
+  ->ArgPair(IMAGE_RGB, 7)
+  ->ArgPair(IMAGE_GRAYSCALE, 7)
+  ->ArgPair(IMAGE_INDEXED, 7);
+
+static void BM_ConvolutionMatrixNonSeparable(benchmark::State& state)
+{
+  convolution_matrix_benchmark(state, PixelFormat(state.range_x()), state.range_y(), false);
+}
+BENCHMARK(BM_ConvolutionMatrixNonSeparable)
+  ->ArgPair(IMAGE_RGB, 3)
+  ->ArgPair(IMAGE_RGB, 7)
+  ->ArgPair(IMAGE_GRAYSCALE, 3)
+  ->ArgPair(IMAGE_GRAYSCALE, 7)
+  ->ArgPair(IMAGE_INDEXED, 3)
+  ->ArgPair(IMAGE_INDEXED, 7);
+
+// Point filters in a 256x256 image of the pixel format range_x
+static void point_filter_benchmark(benchmark::State& state, Filter* filter)
+{
+  const PixelFormat format = PixelFormat(state.range_x());
+  base::UniquePtr<Image> src(Image::create(format, 256, 256));
+  base::UniquePtr<Image> dst(Image::create(format, 256, 256));
+  fill_image(src);
+
+  TestFilterManager mgr(src, dst);
+  while (state.KeepRunning())
+    mgr.apply(filter);
+
+  state.SetItemsProcessed(state.iterations() * src->width() * src->height());
+}
+
+static void BM_ColorCurve(benchmark::State& state)
+{
+  ColorCurve curve(ColorCurve::Linear);
+  curve.addPoint(gfx::Point(0, 255));
+  curve.addPoint(gfx::Point(255, 0));
+
+  ColorCurveFilter filter;
+  filter.setCurve(&curve);
+  point_filter_benchmark(state, &filter);
+}
+BENCHMARK(BM_ColorCurve)
+  ->Arg(IMAGE_RGB)
+  ->Arg(IMAGE_GRAYSCALE);
+
+static void BM_InvertColor(benchmark::State& state)
+{
+  InvertColorFilter filter;
+  point_filter_benchmark(state, &filter);
+}
+BENCHMARK(BM_InvertColor)
+  ->Arg(IMAGE_RGB)
+  ->Arg(IMAGE_GRAYSCALE);
+
+static void BM_ReplaceColor(benchmark::State& state)
+{
+  ReplaceColorFilter filter;
+  filter.setFrom(0x80808080);
+  filter.setTo(0);
+  filter.setTolerance(64);
+  point_filter_benchmark(state, &filter);
+}
+BENCHMARK(BM_ReplaceColor)
+  ->Arg(IMAGE_RGB)
+  ->Arg(IMAGE_GRAYSCALE);
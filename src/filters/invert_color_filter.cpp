@@ -13,6 +13,7 @@
 
 #include "filters/filter_indexed_data.h"
 #include "filters/filter_manager.h"
+#include "filters/point_kernels.h"
 #include "doc/image.h"
 #include "doc/palette.h"
 #include "doc/rgbmap.h"
@@ -30,58 +31,34 @@ void InvertColorFilter::applyToRgba(FilterManager* filterMgr)
 {
   const uint32_t* src_address = (uint32_t*)filterMgr->getSourceAddress();
   uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
   Target target = filterMgr->getTarget();
-  int x, c, r, g, b, a;
-
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
-
-    r = rgba_getr(c);
-    g = rgba_getg(c);
-    b = rgba_getb(c);
-    a = rgba_geta(c);
+  uint32_t mask = 0;
 
-    if (target & TARGET_RED_CHANNEL) r ^= 0xff;
-    if (target & TARGET_GREEN_CHANNEL) g ^= 0xff;
-    if (target & TARGET_BLUE_CHANNEL) b ^= 0xff;
-    if (target & TARGET_ALPHA_CHANNEL) a ^= 0xff;
+  if (target & TARGET_RED_CHANNEL) mask |= rgba_r_mask;
+  if (target & TARGET_GREEN_CHANNEL) mask |= rgba_g_mask;
+  if (target & TARGET_BLUE_CHANNEL) mask |= rgba_b_mask;
+  if (target & TARGET_ALPHA_CHANNEL) mask |= rgba_a_mask;
 
-    *(dst_address++) = rgba(r, g, b, a);
-  }
+  for_each_selected_run(
+    filterMgr, [&](int x, int n) {
+      apply_xor(src_address+x, dst_address+x, n, mask);
+    });
 }
 
 void InvertColorFilter::applyToGrayscale(FilterManager* filterMgr)
 {
   const uint16_t* src_address = (uint16_t*)filterMgr->getSourceAddress();
   uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
   Target target = filterMgr->getTarget();
-  int x, c, k, a;
-
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
-
-    k = graya_getv(c);
-    a = graya_geta(c);
+  uint16_t mask = 0;
 
-    if (target & TARGET_GRAY_CHANNEL) k ^= 0xff;
-    if (target & TARGET_ALPHA_CHANNEL) a ^= 0xff;
+  if (target & TARGET_GRAY_CHANNEL) mask |= graya_v_mask;
+  if (target & TARGET_ALPHA_CHANNEL) mask |= graya_a_mask;
 
-    *(dst_address++) = graya(k, a);
-  }
+  for_each_selected_run(
+    filterMgr, [&](int x, int n) {
+      apply_xor(src_address+x, dst_address+x, n, mask);
+    });
 }
 
 void InvertColorFilter::applyToIndexed(FilterManager* filterMgr)
@@ -28,72 +28,188 @@ namespace filters {
 using namespace doc;
 
 namespace {
+
+  // Histogram of the values of one channel in the window of pixels
+  // around the current pixel. The median is searched from the
+  // previous one (it moves a little when the window moves one pixel).
+  class ChannelHistogram {
+  public:
+    ChannelHistogram() { reset(); }
+
+    void reset() {
+      std::fill(m_count, m_count+256, 0);
+      m_value = 0;
+      m_below = 0;
+    }
+
+    void add(int value, int delta) {
+      m_count[value] += delta;
+      if (value < m_value)
+        m_below += delta;
+    }
+
+    // Returns the k-th value (starting from 0) of the sorted window.
+    int getValue(int k) {
+      while (m_below > k)
+        m_below -= m_count[--m_value];
+      while (m_below + m_count[m_value] <= k)
+        m_below += m_count[m_value++];
+      return m_value;
+    }
+
+  private:
+    int m_count[256];
+    int m_value;
+    int m_below;                // Number of values < m_value
+  };
+
   struct GetPixelsDelegateRgba {
-    std::vector<std::vector<uint8_t> >& channel;
-    int c;
+    ChannelHistogram* hist;
+    int delta;
 
-    GetPixelsDelegateRgba(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+    GetPixelsDelegateRgba(ChannelHistogram* hist) : hist(hist), delta(1) { }
 
-    void reset() { c = 0; }
+    void reset() {
+      for (int i=0; i<4; ++i)
+        hist[i].reset();
+    }
 
     void operator()(RgbTraits::pixel_t color)
     {
-      channel[0][c] = rgba_getr(color);
-      channel[1][c] = rgba_getg(color);
-      channel[2][c] = rgba_getb(color);
-      channel[3][c] = rgba_geta(color);
-      c++;
+      hist[0].add(rgba_getr(color), delta);
+      hist[1].add(rgba_getg(color), delta);
+      hist[2].add(rgba_getb(color), delta);
+      hist[3].add(rgba_geta(color), delta);
     }
   };
 
   struct GetPixelsDelegateGrayscale {
-    std::vector<std::vector<uint8_t> >& channel;
-    int c;
+    ChannelHistogram* hist;
+    int delta;
 
-    GetPixelsDelegateGrayscale(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+    GetPixelsDelegateGrayscale(ChannelHistogram* hist) : hist(hist), delta(1) { }
 
-    void reset() { c = 0; }
+    void reset() {
+      for (int i=0; i<2; ++i)
+        hist[i].reset();
+    }
 
     void operator()(GrayscaleTraits::pixel_t color)
     {
-      channel[0][c] = graya_getv(color);
-      channel[1][c] = graya_geta(color);
-      c++;
+      hist[0].add(graya_getv(color), delta);
+      hist[1].add(graya_geta(color), delta);
     }
   };
 
   struct GetPixelsDelegateIndexed {
     const Palette* pal;
-    std::vector<std::vector<uint8_t> >& channel;
+    ChannelHistogram* hist;
     Target target;
-    int c;
+    int delta;
 
-    GetPixelsDelegateIndexed(const Palette* pal, std::vector<std::vector<uint8_t> >& channel, Target target)
-      : pal(pal), channel(channel), target(target) { }
+    GetPixelsDelegateIndexed(const Palette* pal, ChannelHistogram* hist, Target target)
+      : pal(pal), hist(hist), target(target), delta(1) { }
 
-    void reset() { c = 0; }
+    void reset() {
+      for (int i=0; i<3; ++i)
+        hist[i].reset();
+    }
 
     void operator()(IndexedTraits::pixel_t color)
     {
       if (target & TARGET_INDEX_CHANNEL) {
-        channel[0][c] = color;
+        hist[0].add(color, delta);
+      }
+      else {
+        hist[0].add(rgba_getr(pal->getEntry(color)), delta);
+        hist[1].add(rgba_getg(pal->getEntry(color)), delta);
+        hist[2].add(rgba_getb(pal->getEntry(color)), delta);
+      }
+    }
+  };
+
+  // Window of width*height pixels that moves from left to right
+  // through a row of the image. Each time it moves one pixel, the
+  // delegate removes the left column from the histograms and adds
+  // the new right column, so the cost for each pixel depends on the
+  // window height only (instead of width*height).
+  template<typename Traits, typename Delegate>
+  class SlidingWindow {
+  public:
+    SlidingWindow(const Image* src, int y, int width, int height,
+                  TiledMode tiledMode, Delegate& delegate)
+      : m_src(src)
+      , m_y(y)
+      , m_width(width)
+      , m_height(height)
+      , m_tiledMode(tiledMode)
+      , m_delegate(delegate)
+      // If the window is wider than the image,
+      // get_neighboring_pixels() doesn't clamp X coordinates, so we
+      // get all pixels again for each position.
+      , m_sliding(width <= src->width())
+      , m_valid(false)
+      , m_x(0)
+      , m_rows(height)
+    {
+      bool tiledY = ((int(tiledMode) & int(TiledMode::Y_AXIS)) != 0);
+      for (int dy=0; dy<height; ++dy) {
+        int sy = get_neighboring_coord(y - height/2 + dy, src->height(), tiledY);
+        m_rows[dy] = reinterpret_cast<typename Traits::const_address_t>(
+          src->getPixelAddress(0, sy));
+      }
+    }
+
+    // Fills the histograms with the pixels around (x, y).
+    void moveTo(int x) {
+      // Moving the window column by column is cheaper than getting
+      // all pixels again when the distance is less than half window.
+      if (m_sliding && m_valid && x > m_x && 2*(x-m_x) <= m_width) {
+        for (; m_x<x; ++m_x) {
+          addColumn(m_x - m_width/2, -1);
+          addColumn(m_x + m_width - m_width/2, 1);
+        }
       }
       else {
-        channel[0][c] = rgba_getr(pal->getEntry(color));
-        channel[1][c] = rgba_getg(pal->getEntry(color));
-        channel[2][c] = rgba_getb(pal->getEntry(color));
+        m_delegate.reset();
+        m_delegate.delta = 1;
+        get_neighboring_pixels<Traits>(m_src, x, m_y, m_width, m_height,
+                                       m_width/2, m_height/2,
+                                       m_tiledMode, m_delegate);
+        m_valid = true;
+        m_x = x;
       }
-      c++;
     }
+
+  private:
+    void addColumn(int t, int delta) {
+      bool tiledX = ((int(m_tiledMode) & int(TiledMode::X_AXIS)) != 0);
+      int sx = get_neighboring_coord(t, m_src->width(), tiledX);
+
+      m_delegate.delta = delta;
+      for (int dy=0; dy<m_height; ++dy)
+        m_delegate(m_rows[dy][sx]);
+    }
+
+    const Image* m_src;
+    int m_y;
+    int m_width;
+    int m_height;
+    TiledMode m_tiledMode;
+    Delegate& m_delegate;
+    bool m_sliding;
+    bool m_valid;
+    int m_x;
+    std::vector<typename Traits::const_address_t> m_rows;
   };
-};
+
+}
 
 MedianFilter::MedianFilter()
   : m_tiledMode(TiledMode::NONE)
   , m_width(0)
   , m_height(0)
   , m_ncolors(0)
-  , m_channel(4)
 {
 }
 
@@ -107,9 +223,6 @@ void MedianFilter::setSize(int width, int height)
   m_width = width;
   m_height = height;
   m_ncolors = width*height;
-
-  for (int c = 0; c < 4; ++c)
-    m_channel[c].resize(m_ncolors);
 }
 
 const char* MedianFilter::getName()
@@ -124,10 +237,15 @@ void MedianFilter::applyToRgba(FilterManager* filterMgr)
   Target target = filterMgr->getTarget();
   int color;
   int r, g, b, a;
-  GetPixelsDelegateRgba delegate(m_channel);
+  // Each call uses its own histograms (rows can be filtered in parallel)
+  ChannelHistogram hist[4];
+  GetPixelsDelegateRgba delegate(hist);
   int x = filterMgr->x();
   int x2 = x+filterMgr->getWidth();
   int y = filterMgr->y();
+  int k = m_ncolors/2;
+  SlidingWindow<RgbTraits, GetPixelsDelegateRgba>
+    window(src, y, m_width, m_height, m_tiledMode, delegate);
 
   for (; x<x2; ++x) {
     // Avoid the non-selected region
@@ -136,37 +254,27 @@ void MedianFilter::applyToRgba(FilterManager* filterMgr)
       continue;
     }
 
-    delegate.reset();
-    get_neighboring_pixels<RgbTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                      m_tiledMode, delegate);
+    window.moveTo(x);
 
     color = get_pixel_fast<RgbTraits>(src, x, y);
 
-    if (target & TARGET_RED_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      r = m_channel[0][m_ncolors/2];
-    }
+    if (target & TARGET_RED_CHANNEL)
+      r = hist[0].getValue(k);
     else
       r = rgba_getr(color);
 
-    if (target & TARGET_GREEN_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      g = m_channel[1][m_ncolors/2];
-    }
+    if (target & TARGET_GREEN_CHANNEL)
+      g = hist[1].getValue(k);
     else
       g = rgba_getg(color);
 
-    if (target & TARGET_BLUE_CHANNEL) {
-      std::sort(m_channel[2].begin(), m_channel[2].end());
-      b = m_channel[2][m_ncolors/2];
-    }
+    if (target & TARGET_BLUE_CHANNEL)
+      b = hist[2].getValue(k);
     else
       b = rgba_getb(color);
 
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[3].begin(), m_channel[3].end());
-      a = m_channel[3][m_ncolors/2];
-    }
+    if (target & TARGET_ALPHA_CHANNEL)
+      a = hist[3].getValue(k);
     else
       a = rgba_geta(color);
 
@@ -179,11 +287,15 @@ void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
   const Image* src = filterMgr->getSourceImage();
   uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
   Target target = filterMgr->getTarget();
-  int color, k, a;
-  GetPixelsDelegateGrayscale delegate(m_channel);
+  int color, v, a;
+  ChannelHistogram hist[2];
+  GetPixelsDelegateGrayscale delegate(hist);
   int x = filterMgr->x();
   int x2 = x+filterMgr->getWidth();
   int y = filterMgr->y();
+  int k = m_ncolors/2;
+  SlidingWindow<GrayscaleTraits, GetPixelsDelegateGrayscale>
+    window(src, y, m_width, m_height, m_tiledMode, delegate);
 
   for (; x<x2; ++x) {
     // Avoid the non-selected region
@@ -192,27 +304,21 @@ void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
       continue;
     }
 
-    delegate.reset();
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                            m_tiledMode, delegate);
+    window.moveTo(x);
 
     color = get_pixel_fast<GrayscaleTraits>(src, x, y);
 
-    if (target & TARGET_GRAY_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      k = m_channel[0][m_ncolors/2];
-    }
+    if (target & TARGET_GRAY_CHANNEL)
+      v = hist[0].getValue(k);
     else
-      k = graya_getv(color);
+      v = graya_getv(color);
 
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      a = m_channel[1][m_ncolors/2];
-    }
+    if (target & TARGET_ALPHA_CHANNEL)
+      a = hist[1].getValue(k);
     else
       a = graya_geta(color);
 
-    *(dst_address++) = graya(k, a);
+    *(dst_address++) = graya(v, a);
   }
 }
 
@@ -224,10 +330,14 @@ void MedianFilter::applyToIndexed(FilterManager* filterMgr)
   const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
   Target target = filterMgr->getTarget();
   int color, r, g, b;
-  GetPixelsDelegateIndexed delegate(pal, m_channel, target);
+  ChannelHistogram hist[3];
+  GetPixelsDelegateIndexed delegate(pal, hist, target);
   int x = filterMgr->x();
   int x2 = x+filterMgr->getWidth();
   int y = filterMgr->y();
+  int k = m_ncolors/2;
+  SlidingWindow<IndexedTraits, GetPixelsDelegateIndexed>
+    window(src, y, m_width, m_height, m_tiledMode, delegate);
 
   for (; x<x2; ++x) {
     // Avoid the non-selected region
@@ -236,35 +346,26 @@ void MedianFilter::applyToIndexed(FilterManager* filterMgr)
       continue;
     }
 
-    delegate.reset();
-    get_neighboring_pixels<IndexedTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                          m_tiledMode, delegate);
+    window.moveTo(x);
 
     if (target & TARGET_INDEX_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      *(dst_address++) = m_channel[0][m_ncolors/2];
+      *(dst_address++) = hist[0].getValue(k);
     }
     else {
       color = get_pixel_fast<IndexedTraits>(src, x, y);
 
-      if (target & TARGET_RED_CHANNEL) {
-        std::sort(m_channel[0].begin(), m_channel[0].end());
-        r = m_channel[0][m_ncolors/2];
-      }
+      if (target & TARGET_RED_CHANNEL)
+        r = hist[0].getValue(k);
       else
         r = rgba_getr(pal->getEntry(color));
 
-      if (target & TARGET_GREEN_CHANNEL) {
-        std::sort(m_channel[1].begin(), m_channel[1].end());
-        g = m_channel[1][m_ncolors/2];
-      }
+      if (target & TARGET_GREEN_CHANNEL)
+        g = hist[1].getValue(k);
       else
         g = rgba_getg(pal->getEntry(color));
 
-      if (target & TARGET_BLUE_CHANNEL) {
-        std::sort(m_channel[2].begin(), m_channel[2].end());
-        b = m_channel[2][m_ncolors/2];
-      }
+      if (target & TARGET_BLUE_CHANNEL)
+        b = hist[2].getValue(k);
       else
         b = rgba_getb(pal->getEntry(color));
 
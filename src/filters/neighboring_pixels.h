@@ -18,6 +18,20 @@
 namespace filters {
   using namespace doc;
 
+  // Returns the coordinate of the pixel used for the position "t"
+  // (which can be outside the image) in the same way that
+  // get_neighboring_pixels() does (only when the matrix isn't wider
+  // than the image, in other case X coordinates are not clamped).
+  inline int get_neighboring_coord(int t, int size, bool tiled)
+  {
+    if (t < 0)
+      return (tiled ? size - (-(t+1) % size) - 1: 0);
+    else if (t >= size)
+      return (tiled ? t % size: size-1);
+    else
+      return t;
+  }
+
   // Calls the specified "delegate" for all neighboring pixels in a 2D
   // (width*height) matrix located in (x,y) where its center is the
   // (centerX,centerY) element of the matrix.
@@ -0,0 +1,225 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "filters/point_kernels.h"
+
+#include "doc/color.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define FILTERS_POINT_KERNELS_SSE2
+  #include <emmintrin.h>
+#endif
+
+namespace filters {
+
+using namespace doc;
+
+static const Target rgba_targets[4] = {
+  TARGET_RED_CHANNEL,
+  TARGET_GREEN_CHANNEL,
+  TARGET_BLUE_CHANNEL,
+  TARGET_ALPHA_CHANNEL
+};
+
+static const uint32_t rgba_shifts[4] = {
+  rgba_r_shift, rgba_g_shift, rgba_b_shift, rgba_a_shift
+};
+
+static const Target graya_targets[2] = {
+  TARGET_GRAY_CHANNEL,
+  TARGET_ALPHA_CHANNEL
+};
+
+static const uint16_t graya_shifts[2] = {
+  graya_v_shift, graya_a_shift
+};
+
+RgbaLut::RgbaLut()
+{
+  for (int i=0; i<4; ++i)
+    for (int c=0; c<256; ++c)
+      m_mapped[i][c] = m_identity[i][c] = uint32_t(c) << rgba_shifts[i];
+}
+
+void RgbaLut::setMap(const int* map)
+{
+  for (int i=0; i<4; ++i)
+    for (int c=0; c<256; ++c)
+      m_mapped[i][c] = uint32_t(map[c]) << rgba_shifts[i];
+}
+
+void RgbaLut::apply(const uint32_t* src, uint32_t* dst, int n, Target target) const
+{
+  const uint32_t* lut[4];
+  for (int i=0; i<4; ++i)
+    lut[i] = (target & rgba_targets[i] ? m_mapped[i]: m_identity[i]);
+
+  for (int i=0; i<n; ++i) {
+    uint32_t c = src[i];
+    dst[i] =
+      lut[0][(c >> rgba_r_shift) & 0xff] |
+      lut[1][(c >> rgba_g_shift) & 0xff] |
+      lut[2][(c >> rgba_b_shift) & 0xff] |
+      lut[3][(c >> rgba_a_shift) & 0xff];
+  }
+}
+
+GrayaLut::GrayaLut()
+{
+  for (int i=0; i<2; ++i)
+    for (int c=0; c<256; ++c)
+      m_mapped[i][c] = m_identity[i][c] = uint16_t(c << graya_shifts[i]);
+}
+
+void GrayaLut::setMap(const int* map)
+{
+  for (int i=0; i<2; ++i)
+    for (int c=0; c<256; ++c)
+      m_mapped[i][c] = uint16_t(map[c] << graya_shifts[i]);
+}
+
+void GrayaLut::apply(const uint16_t* src, uint16_t* dst, int n, Target target) const
+{
+  const uint16_t* lut[2];
+  for (int i=0; i<2; ++i)
+    lut[i] = (target & graya_targets[i] ? m_mapped[i]: m_identity[i]);
+
+  for (int i=0; i<n; ++i) {
+    uint16_t c = src[i];
+    dst[i] = uint16_t(
+      lut[0][(c >> graya_v_shift) & 0xff] |
+      lut[1][(c >> graya_a_shift) & 0xff]);
+  }
+}
+
+#ifdef FILTERS_POINT_KERNELS_SSE2
+
+static inline __m128i set1_128(uint32_t v) { return _mm_set1_epi32(int(v)); }
+static inline __m128i set1_128(uint16_t v) { return _mm_set1_epi16(short(v)); }
+
+// Sets all bits of the pixels where all bytes are 0xff
+static inline __m128i all_bytes_set(__m128i v, uint32_t) { return _mm_cmpeq_epi32(v, _mm_set1_epi32(-1)); }
+static inline __m128i all_bytes_set(__m128i v, uint16_t) { return _mm_cmpeq_epi16(v, _mm_set1_epi16(-1)); }
+
+#endif
+
+template<typename pixel_t>
+static void xor_pixels(const pixel_t* src, pixel_t* dst, int n, pixel_t mask)
+{
+  int i = 0;
+
+#ifdef FILTERS_POINT_KERNELS_SSE2
+  const int k = 16 / sizeof(pixel_t);   // Pixels in 16 bytes
+  const __m128i m = set1_128(mask);
+
+  for (; i+k <= n; i+=k)
+    _mm_storeu_si128((__m128i*)(dst+i),
+                     _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src+i)), m));
+#endif
+
+  for (; i<n; ++i)
+    dst[i] = src[i] ^ mask;
+}
+
+void apply_xor(const uint32_t* src, uint32_t* dst, int n, uint32_t mask)
+{
+  xor_pixels(src, dst, n, mask);
+}
+
+void apply_xor(const uint16_t* src, uint16_t* dst, int n, uint16_t mask)
+{
+  xor_pixels(src, dst, n, mask);
+}
+
+// Replaces the pixels of the blocks of 16 bytes at the beginning of
+// "src" and returns the number of processed pixels (the rest must be
+// processed by the scalar loop). All channels are bytes, so a pixel
+// matches when all its bytes are in the tolerance.
+template<typename pixel_t>
+static int replace_blocks(const pixel_t* src, pixel_t* dst, int n,
+                          pixel_t from, pixel_t to, int tolerance)
+{
+  int i = 0;
+
+#ifdef FILTERS_POINT_KERNELS_SSE2
+  const int k = 16 / sizeof(pixel_t);
+  const __m128i f = set1_128(from);
+  const __m128i t = set1_128(to);
+  const __m128i tol = _mm_set1_epi8(char(tolerance));
+  const __m128i zero = _mm_setzero_si128();
+
+  for (; i+k <= n; i+=k) {
+    __m128i c = _mm_loadu_si128((const __m128i*)(src+i));
+
+    // |c-f| <= tolerance for each byte
+    __m128i diff = _mm_or_si128(_mm_subs_epu8(c, f), _mm_subs_epu8(f, c));
+    __m128i match = all_bytes_set(
+      _mm_cmpeq_epi8(_mm_subs_epu8(diff, tol), zero), pixel_t());
+
+    _mm_storeu_si128((__m128i*)(dst+i),
+                     _mm_or_si128(_mm_and_si128(match, t),
+                                  _mm_andnot_si128(match, c)));
+  }
+#endif
+
+  return i;
+}
+
+// Returns 1 if "a" and "b" are in the given tolerance (without
+// branches: |a-b| <= t is the same as unsigned(a-b+t) <= unsigned(2t))
+static inline uint32_t in_tolerance(int a, int b, int tolerance)
+{
+  return (uint32_t(a - b + tolerance) <= uint32_t(2*tolerance) ? 1: 0);
+}
+
+void replace_rgba(const uint32_t* src, uint32_t* dst, int n,
+                  uint32_t from, uint32_t to, int tolerance)
+{
+  ASSERT(tolerance >= 0 && tolerance <= 255);
+  const int r = rgba_getr(from);
+  const int g = rgba_getg(from);
+  const int b = rgba_getb(from);
+  const int a = rgba_geta(from);
+
+  for (int i=replace_blocks(src, dst, n, from, to, tolerance); i<n; ++i) {
+    uint32_t c = src[i];
+    uint32_t match =
+      in_tolerance(rgba_getr(c), r, tolerance) &
+      in_tolerance(rgba_getg(c), g, tolerance) &
+      in_tolerance(rgba_getb(c), b, tolerance) &
+      in_tolerance(rgba_geta(c), a, tolerance);
+
+    // All bits set if the pixel matches
+    uint32_t mask = 0 - match;
+    dst[i] = (to & mask) | (c & ~mask);
+  }
+}
+
+void replace_graya(const uint16_t* src, uint16_t* dst, int n,
+                   uint16_t from, uint16_t to, int tolerance)
+{
+  ASSERT(tolerance >= 0 && tolerance <= 255);
+
+  const int k = graya_getv(from);
+  const int a = graya_geta(from);
+
+  for (int i=replace_blocks(src, dst, n, from, to, tolerance); i<n; ++i) {
+    uint16_t c = src[i];
+    uint16_t match = uint16_t(
+      in_tolerance(graya_getv(c), k, tolerance) &
+      in_tolerance(graya_geta(c), a, tolerance));
+
+    uint16_t mask = uint16_t(0 - match);
+    dst[i] = uint16_t((to & mask) | (c & ~mask));
+  }
+}
+
+} // namespace filters
@@ -0,0 +1,85 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef FILTERS_POINT_KERNELS_H_INCLUDED
+#define FILTERS_POINT_KERNELS_H_INCLUDED
+#pragma once
+
+#include "base/base.h"
+#include "filters/filter_manager.h"
+#include "filters/target.h"
+
+namespace filters {
+
+  // Kernels for filters that modify each pixel independently (color
+  // curve, invert color, replace color). They process a span of
+  // pixels without branches in the inner loop. With SSE2,
+  // apply_xor() and replace_rgba/graya() process 16 bytes at the
+  // same time (the LUT kernels keep a scalar loop as they are limited
+  // by the table lookups).
+
+  // Lookup tables to map the channels of RGBA/grayscale pixels. Each
+  // entry contains the new value of the channel shifted to its
+  // position, so a pixel is mapped ORing one entry of each channel.
+  // apply() can be called from several threads at the same time.
+  class RgbaLut {
+  public:
+    RgbaLut();
+
+    // Maps all channels with "map" (256 values from 0 to 255).
+    void setMap(const int* map);
+
+    // Maps the channels included in "target", other channels are
+    // unmodified.
+    void apply(const uint32_t* src, uint32_t* dst, int n, Target target) const;
+
+  private:
+    uint32_t m_mapped[4][256];
+    uint32_t m_identity[4][256];
+  };
+
+  class GrayaLut {
+  public:
+    GrayaLut();
+    void setMap(const int* map);
+    void apply(const uint16_t* src, uint16_t* dst, int n, Target target) const;
+
+  private:
+    uint16_t m_mapped[2][256];
+    uint16_t m_identity[2][256];
+  };
+
+  // dst[i] = src[i] ^ mask (used to invert channels)
+  void apply_xor(const uint32_t* src, uint32_t* dst, int n, uint32_t mask);
+  void apply_xor(const uint16_t* src, uint16_t* dst, int n, uint16_t mask);
+
+  // Replaces pixels with all their channels in the range
+  // [from-tolerance, from+tolerance] with "to".
+  void replace_rgba(const uint32_t* src, uint32_t* dst, int n,
+                    uint32_t from, uint32_t to, int tolerance);
+  void replace_graya(const uint16_t* src, uint16_t* dst, int n,
+                     uint16_t from, uint16_t to, int tolerance);
+
+  // Calls f(x, n) for each run of "n" pixels of the current row
+  // (starting from the pixel "x" of the row) that must be filtered,
+  // skipping the non-selected pixels in runs (see
+  // FilterManager::skipRun()).
+  template<typename Func>
+  inline void for_each_selected_run(FilterManager* filterMgr, Func f) {
+    const int w = filterMgr->getWidth();
+    bool skip;
+    for (int x=0; x<w; ) {
+      int n = filterMgr->skipRun(w-x, skip);
+      if (!skip)
+        f(x, n);
+      x += n;
+    }
+  }
+
+} // namespace filters
+
+#endif
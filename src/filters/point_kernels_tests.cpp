@@ -0,0 +1,236 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#include <gtest/gtest.h>
+
+#include "base/base.h"
+#include "base/unique_ptr.h"
+#include "filters/invert_color_filter.h"
+#include "filters/point_kernels.h"
+#include "filters/replace_color_filter.h"
+#include "filters/test_filter_manager.h"
+
+#include <vector>
+
+using namespace doc;
+using namespace filters;
+
+namespace {
+
+  // Per-pixel code of InvertColorFilter and ReplaceColorFilter before
+  // the kernels of point_kernels.h
+
+  uint32_t old_invert_rgba(uint32_t c, Target target)
+  {
+    int r = rgba_getr(c);
+    int g = rgba_getg(c);
+    int b = rgba_getb(c);
+    int a = rgba_geta(c);
+
+    if (target & TARGET_RED_CHANNEL) r ^= 0xff;
+    if (target & TARGET_GREEN_CHANNEL) g ^= 0xff;
+    if (target & TARGET_BLUE_CHANNEL) b ^= 0xff;
+    if (target & TARGET_ALPHA_CHANNEL) a ^= 0xff;
+
+    return rgba(r, g, b, a);
+  }
+
+  uint16_t old_invert_graya(uint16_t c, Target target)
+  {
+    int k = graya_getv(c);
+    int a = graya_geta(c);
+
+    if (target & TARGET_GRAY_CHANNEL) k ^= 0xff;
+    if (target & TARGET_ALPHA_CHANNEL) a ^= 0xff;
+
+    return graya(k, a);
+  }
+
+  uint32_t old_replace_rgba(uint32_t c, uint32_t from, uint32_t to, int tolerance)
+  {
+    if ((ABS(int(rgba_getr(c))-int(rgba_getr(from))) <= tolerance) &&
+        (ABS(int(rgba_getg(c))-int(rgba_getg(from))) <= tolerance) &&
+        (ABS(int(rgba_getb(c))-int(rgba_getb(from))) <= tolerance) &&
+        (ABS(int(rgba_geta(c))-int(rgba_geta(from))) <= tolerance))
+      return to;
+    else
+      return c;
+  }
+
+  uint16_t old_replace_graya(uint16_t c, uint16_t from, uint16_t to, int tolerance)
+  {
+    if ((ABS(int(graya_getv(c))-int(graya_getv(from))) <= tolerance) &&
+        (ABS(int(graya_geta(c))-int(graya_geta(from))) <= tolerance))
+      return to;
+    else
+      return c;
+  }
+
+  // Pixels near to "from" (so some of them are in the tolerance)
+  template<typename T>
+  std::vector<T> random_pixels(int n, T from)
+  {
+    std::vector<T> pixels(n);
+    uint32_t seed = 1;
+    for (int i=0; i<n; ++i) {
+      seed = seed*1103515245 + 12345;
+      T c = T(seed >> 8);
+      if (seed & 0x10000) {
+        // Each byte of "from" +/- 0..31
+        T delta = T((seed >> 3) & 0x1f1f1f1f);
+        c = T((seed & 0x20000) ? from + delta: from - delta);
+      }
+      pixels[i] = c;
+    }
+    return pixels;
+  }
+
+  const Target targets[] = {
+    TARGET_RED_CHANNEL | TARGET_GREEN_CHANNEL | TARGET_BLUE_CHANNEL |
+    TARGET_ALPHA_CHANNEL | TARGET_GRAY_CHANNEL,
+    TARGET_RED_CHANNEL | TARGET_GRAY_CHANNEL,
+    TARGET_GREEN_CHANNEL | TARGET_BLUE_CHANNEL | TARGET_ALPHA_CHANNEL,
+    0,
+  };
+
+  const int tolerances[] = { 0, 1, 8, 31, 128, 255 };
+
+} // anonymous namespace
+
+// All lengths and alignments of the spans (to test the scalar loop
+// after the 16 bytes blocks)
+TEST(PointKernels, XorIsEqualToOldInvertColor)
+{
+  const int n = 80;
+  std::vector<uint32_t> rgbaSrc = random_pixels<uint32_t>(n, 0);
+  std::vector<uint16_t> grayaSrc = random_pixels<uint16_t>(n, 0);
+
+  for (Target target : targets) {
+    uint32_t rgbaMask = 0;
+    if (target & TARGET_RED_CHANNEL) rgbaMask |= rgba_r_mask;
+    if (target & TARGET_GREEN_CHANNEL) rgbaMask |= rgba_g_mask;
+    if (target & TARGET_BLUE_CHANNEL) rgbaMask |= rgba_b_mask;
+    if (target & TARGET_ALPHA_CHANNEL) rgbaMask |= rgba_a_mask;
+
+    uint16_t grayaMask = 0;
+    if (target & TARGET_GRAY_CHANNEL) grayaMask |= graya_v_mask;
+    if (target & TARGET_ALPHA_CHANNEL) grayaMask |= graya_a_mask;
+
+    for (int offset=0; offset<4; ++offset)
+      for (int len=0; offset+len<=n; ++len) {
+        std::vector<uint32_t> rgbaDst(n, 0);
+        std::vector<uint16_t> grayaDst(n, 0);
+        apply_xor(&rgbaSrc[offset], &rgbaDst[offset], len, rgbaMask);
+        apply_xor(&grayaSrc[offset], &grayaDst[offset], len, grayaMask);
+
+        for (int i=0; i<n; ++i) {
+          bool inside = (i >= offset && i < offset+len);
+          ASSERT_EQ(inside ? old_invert_rgba(rgbaSrc[i], target): 0, rgbaDst[i]);
+          ASSERT_EQ(inside ? old_invert_graya(grayaSrc[i], target): 0, grayaDst[i]);
+        }
+      }
+  }
+}
+
+TEST(PointKernels, ReplaceIsEqualToOldReplaceColor)
+{
+  const int n = 80;
+  const uint32_t rgbaFrom = rgba(40, 128, 250, 200);
+  const uint32_t rgbaTo = rgba(1, 2, 3, 4);
+  const uint16_t grayaFrom = graya(5, 240);
+  const uint16_t grayaTo = graya(100, 0);
+  std::vector<uint32_t> rgbaSrc = random_pixels<uint32_t>(n, rgbaFrom);
+  std::vector<uint16_t> grayaSrc = random_pixels<uint16_t>(n, grayaFrom);
+
+  for (int tolerance : tolerances)
+    for (int offset=0; offset<4; ++offset)
+      for (int len=0; offset+len<=n; ++len) {
+        std::vector<uint32_t> rgbaDst(n, 0);
+        std::vector<uint16_t> grayaDst(n, 0);
+        replace_rgba(&rgbaSrc[offset], &rgbaDst[offset], len, rgbaFrom, rgbaTo, tolerance);
+        replace_graya(&grayaSrc[offset], &grayaDst[offset], len, grayaFrom, grayaTo, tolerance);
+
+        for (int i=0; i<n; ++i) {
+          bool inside = (i >= offset && i < offset+len);
+          ASSERT_EQ(inside ? old_replace_rgba(rgbaSrc[i], rgbaFrom, rgbaTo, tolerance): 0,
+                    rgbaDst[i]) << "tolerance " << tolerance << ", pixel " << i;
+          ASSERT_EQ(inside ? old_replace_graya(grayaSrc[i], grayaFrom, grayaTo, tolerance): 0,
+                    grayaDst[i]) << "tolerance " << tolerance << ", pixel " << i;
+        }
+      }
+}
+
+// The filters with runs of selected pixels
+TEST(PointKernels, FiltersWithMask)
+{
+  const int w = 67, h = 3;
+  base::UniquePtr<Image> mask(Image::create(IMAGE_BITMAP, w, h));
+  clear_image(mask, 0);
+  fill_rect(mask, 1, 0, 40, 0, 1);
+  fill_rect(mask, 3, 1, 5, 1, 1);
+  fill_rect(mask, 20, 1, 66, 1, 1);
+  fill_rect(mask, 0, 2, 66, 2, 1);
+
+  for (int format=0; format<2; ++format) {
+    PixelFormat pixelFormat = (format == 0 ? IMAGE_RGB: IMAGE_GRAYSCALE);
+    base::UniquePtr<Image> src(Image::create(pixelFormat, w, h));
+    base::UniquePtr<Image> dst(Image::create(pixelFormat, w, h));
+    color_t from = (format == 0 ? rgba(40, 128, 250, 200): graya(5, 240));
+    color_t to = (format == 0 ? rgba(1, 2, 3, 4): graya(100, 0));
+
+    for (int y=0; y<h; ++y) {
+      if (format == 0) {
+        std::vector<uint32_t> row = random_pixels<uint32_t>(w, from);
+        for (int x=0; x<w; ++x)
+          put_pixel(src, x, y, row[(x+y*7) % w]);
+      }
+      else {
+        std::vector<uint16_t> row = random_pixels<uint16_t>(w, uint16_t(from));
+        for (int x=0; x<w; ++x)
+          put_pixel(src, x, y, row[(x+y*7) % w]);
+      }
+    }
+
+    for (Target target : targets) {
+      InvertColorFilter invert;
+      ReplaceColorFilter replace;
+      replace.setFrom(from);
+      replace.setTo(to);
+      replace.setTolerance(31);
+
+      for (int f=0; f<2; ++f) {
+        TestFilterManager mgr(src, dst);
+        mgr.setMask(mask);
+        mgr.setTarget(target);
+        clear_image(dst, 0);
+        mgr.apply(f == 0 ? (Filter*)&invert: (Filter*)&replace);
+
+        for (int y=0; y<h; ++y)
+          for (int x=0; x<w; ++x) {
+            color_t c = get_pixel(src, x, y);
+            color_t expected = 0;
+            if (get_pixel(mask, x, y)) {
+              if (format == 0)
+                expected = (f == 0 ? old_invert_rgba(c, target):
+                                     old_replace_rgba(c, from, to, 31));
+              else
+                expected = (f == 0 ? old_invert_graya(c, target):
+                                     old_replace_graya(c, from, to, 31));
+            }
+            ASSERT_EQ(expected, get_pixel(dst, x, y))
+              << "format " << format << ", filter " << f << ", pixel " << x << "," << y;
+          }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -12,6 +12,7 @@
 #include "filters/replace_color_filter.h"
 
 #include "filters/filter_manager.h"
+#include "filters/point_kernels.h"
 #include "doc/image.h"
 
 namespace filters {
@@ -47,70 +48,24 @@ void ReplaceColorFilter::applyToRgba(FilterManager* filterMgr)
 {
   const uint32_t* src_address = (uint32_t*)filterMgr->getSourceAddress();
   uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
-  int src_r, src_g, src_b, src_a;
-  int dst_r, dst_g, dst_b, dst_a;
-  int x, c;
-
-  dst_r = rgba_getr(m_from);
-  dst_g = rgba_getg(m_from);
-  dst_b = rgba_getb(m_from);
-  dst_a = rgba_geta(m_from);
 
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
-
-    src_r = rgba_getr(c);
-    src_g = rgba_getg(c);
-    src_b = rgba_getb(c);
-    src_a = rgba_geta(c);
-
-    if ((ABS(src_r-dst_r) <= m_tolerance) &&
-        (ABS(src_g-dst_g) <= m_tolerance) &&
-        (ABS(src_b-dst_b) <= m_tolerance) &&
-        (ABS(src_a-dst_a) <= m_tolerance))
-      *(dst_address++) = m_to;
-    else
-      *(dst_address++) = c;
-  }
+  for_each_selected_run(
+    filterMgr, [&](int x, int n) {
+      replace_rgba(src_address+x, dst_address+x, n,
+                   m_from, m_to, m_tolerance);
+    });
 }
 
 void ReplaceColorFilter::applyToGrayscale(FilterManager* filterMgr)
 {
   const uint16_t* src_address = (uint16_t*)filterMgr->getSourceAddress();
   uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
-  int w = filterMgr->getWidth();
-  int src_k, src_a;
-  int dst_k, dst_a;
-  int x, c;
-
-  dst_k = graya_getv(m_from);
-  dst_a = graya_geta(m_from);
 
-  for (x=0; x<w; x++) {
-    if (filterMgr->skipPixel()) {
-      ++src_address;
-      ++dst_address;
-      continue;
-    }
-
-    c = *(src_address++);
-
-    src_k = graya_getv(c);
-    src_a = graya_geta(c);
-
-    if ((ABS(src_k-dst_k) <= m_tolerance) &&
-        (ABS(src_a-dst_a) <= m_tolerance))
-      *(dst_address++) = m_to;
-    else
-      *(dst_address++) = c;
-  }
+  for_each_selected_run(
+    filterMgr, [&](int x, int n) {
+      replace_graya(src_address+x, dst_address+x, n,
+                    m_from, m_to, m_tolerance);
+    });
 }
 
 void ReplaceColorFilter::applyToIndexed(FilterManager* filterMgr)
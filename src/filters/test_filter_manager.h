@@ -0,0 +1,100 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef FILTERS_TEST_FILTER_MANAGER_H_INCLUDED
+#define FILTERS_TEST_FILTER_MANAGER_H_INCLUDED
+#pragma once
+
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/rgbmap.h"
+#include "filters/filter.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+
+namespace filters {
+
+  // Applies a filter to a whole image row by row (like the
+  // FilterManagerImpl of the app, without undo) for tests and
+  // benchmarks. Pixels that aren't in the mask (a IMAGE_BITMAP of the
+  // size of the image) are skipped.
+  class TestFilterManager : public FilterManager
+                          , public FilterIndexedData {
+  public:
+    TestFilterManager(const doc::Image* src, doc::Image* dst)
+      : m_src(src), m_dst(dst), m_mask(NULL), m_x(0), m_y(0)
+      , m_target(TARGET_RED_CHANNEL | TARGET_GREEN_CHANNEL | TARGET_BLUE_CHANNEL |
+                 TARGET_ALPHA_CHANNEL | TARGET_GRAY_CHANNEL | TARGET_INDEX_CHANNEL)
+      , m_palette(doc::frame_t(0), 256) {
+      for (int i=0; i<256; ++i)
+        m_palette.setEntry(i, doc::rgba(i, 255-i, (i*7) & 0xff, 255));
+      m_rgbmap.regenerate(&m_palette, 0);
+    }
+
+    void setTarget(Target target) { m_target = target; }
+    void setMask(const doc::Image* mask) { m_mask = mask; }
+
+    void apply(Filter* filter) {
+      for (m_y=0; m_y<m_src->height(); ++m_y) {
+        m_x = 0;
+        switch (m_src->pixelFormat()) {
+          case doc::IMAGE_RGB: filter->applyToRgba(this); break;
+          case doc::IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+          case doc::IMAGE_INDEXED: filter->applyToIndexed(this); break;
+        }
+      }
+    }
+
+    // FilterManager implementation
+    const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_y); }
+    void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_y); }
+    int getWidth() override { return m_src->width(); }
+    Target getTarget() override { return m_target; }
+    FilterIndexedData* getIndexedData() override { return this; }
+
+    bool skipPixel() override {
+      bool skip = !selected(m_x);
+      ++m_x;
+      return skip;
+    }
+
+    int skipRun(int n, bool& skip) override {
+      bool value = selected(m_x);
+      int i = 1;
+      while (i < n && selected(m_x+i) == value)
+        ++i;
+      skip = !value;
+      m_x += i;
+      return i;
+    }
+
+    const doc::Image* getSourceImage() override { return m_src; }
+    int x() override { return 0; }
+    int y() override { return m_y; }
+
+    // FilterIndexedData implementation
+    doc::Palette* getPalette() override { return &m_palette; }
+    doc::RgbMap* getRgbMap() override { return &m_rgbmap; }
+
+  private:
+    bool selected(int x) const {
+      return (!m_mask || doc::get_pixel(m_mask, x, m_y) != 0);
+    }
+
+    const doc::Image* m_src;
+    doc::Image* m_dst;
+    const doc::Image* m_mask;
+    int m_x, m_y;
+    Target m_target;
+    doc::Palette m_palette;
+    doc::RgbMap m_rgbmap;
+  };
+
+} // namespace filters
+
+#endif
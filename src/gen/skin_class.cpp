@@ -9,6 +9,7 @@
 #include "base/string.h"
 #include "gen/common.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
@@ -17,6 +18,7 @@ void gen_skin_class(TiXmlDocument* doc, const std::string& inputFn)
   std::vector<std::string> dimensions;
   std::vector<std::string> colors;
   std::vector<std::string> styles;
+  std::vector<std::string> parts;
 
   TiXmlHandle handle(doc);
   TiXmlElement* elem = handle
@@ -39,6 +41,17 @@ void gen_skin_class(TiXmlDocument* doc, const std::string& inputFn)
     elem = elem->NextSiblingElement();
   }
 
+  elem = handle
+    .FirstChild("skin")
+    .FirstChild("parts")
+    .FirstChild("part").ToElement();
+  while (elem) {
+    const char* id = elem->Attribute("id");
+    if (std::find(parts.begin(), parts.end(), id) == parts.end())
+      parts.push_back(id);
+    elem = elem->NextSiblingElement();
+  }
+
   elem = handle
     .FirstChild("skin")
     .FirstChild("stylesheet")
@@ -126,11 +139,33 @@ void gen_skin_class(TiXmlDocument* doc, const std::string& inputFn)
   std::cout
     << "    };\n";
 
+  // Parts sub class
+  std::cout
+    << "\n"
+    << "    class Parts {\n"
+    << "      template<typename> friend class SkinFile;\n"
+    << "    public:\n";
+  for (auto part : parts) {
+    std::string id = convert_xmlid_to_cppid(part, false);
+    std::cout
+      << "      const skin::SkinPartPtr& " << id << "() const { return m_" << id << "; }\n";
+  }
+  std::cout
+    << "    private:\n";
+  for (auto part : parts) {
+    std::string id = convert_xmlid_to_cppid(part, false);
+    std::cout
+      << "      skin::SkinPartPtr m_" << id << ";\n";
+  }
+  std::cout
+    << "    };\n";
+
   std::cout
     << "\n"
     << "    Dimensions dimensions;\n"
     << "    Colors colors;\n"
     << "    Styles styles;\n"
+    << "    Parts parts;\n"
     << "\n"
     << "  protected:\n"
     << "    void updateInternals() {\n";
@@ -149,6 +184,11 @@ void gen_skin_class(TiXmlDocument* doc, const std::string& inputFn)
     std::cout << "      styles.m_" << id
               << " = styleById(\"" << style << "\");\n";
   }
+  for (auto part : parts) {
+    std::string id = convert_xmlid_to_cppid(part, false);
+    std::cout << "      parts.m_" << id
+              << " = partById(\"" << part << "\");\n";
+  }
   std::cout
     << "    }\n"
     << "\n"
@@ -161,6 +201,9 @@ void gen_skin_class(TiXmlDocument* doc, const std::string& inputFn)
     << "    }\n"
     << "    skin::Style* styleById(const std::string& id) {\n"
     << "      return static_cast<T*>(this)->getStyle(id);\n"
+    << "    }\n"
+    << "    skin::SkinPartPtr partById(const std::string& id) {\n"
+    << "      return static_cast<T*>(this)->getPartById(id);\n"
     << "    }\n";
 
   std::cout
@@ -15,6 +15,8 @@ template<typename T> class PointT;
 template<typename T> class RectT;
 template<typename T> class SizeT;
 
+class Region;
+
 typedef BorderT<int> Border;
 typedef PointT<int> Point;
 typedef RectT<int> Rect;
@@ -1,5 +1,5 @@
 // Aseprite Gfx Library
-// Copyright (C) 2001-2014 David Capello
+// Copyright (C) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,9 +10,10 @@
 
 #include "gfx/packing_rects.h"
 
-#include "gfx/region.h"
 #include "gfx/size.h"
 
+#include <algorithm>
+
 namespace gfx {
 
 void PackingRects::add(const Size& sz)
@@ -30,10 +31,13 @@ Size PackingRects::bestFit()
   Size size(0, 0);
 
   // Calculate the amount of pixels that we need, the texture cannot
-  // be smaller than that.
+  // be smaller than that (nor than the biggest rectangle).
   int neededArea = 0;
+  Size maxSize(0, 0);
   for (const auto& rc : m_rects) {
     neededArea += rc.w * rc.h;
+    maxSize.w = std::max(maxSize.w, rc.w);
+    maxSize.h = std::max(maxSize.h, rc.h);
   }
 
   int w = 1;
@@ -41,7 +45,7 @@ Size PackingRects::bestFit()
   int z = 0;
   bool fit = false;
   while (true) {
-    if (w*h >= neededArea) {
+    if (w*h >= neededArea && w >= maxSize.w && h >= maxSize.h) {
       fit = pack(Size(w, h));
       if (fit) {
         size = Size(w, h);
@@ -58,38 +62,132 @@ Size PackingRects::bestFit()
   return size;
 }
 
-static bool by_area(const Rect* a, const Rect* b) {
-  return a->w*a->h > b->w*b->h;
-}
+namespace {
+
+  // Skyline bottom-left packer: the top border of the packed area is
+  // kept as a list of horizontal segments sorted by x, and each
+  // rectangle is placed in the lowest (and then left-most) position
+  // over that border.
+  class Skyline {
+  public:
+    Skyline(const Size& size) : m_size(size) {
+      m_nodes.push_back(Node(0, 0, size.w));
+    }
+
+    bool insert(Rect& rc) {
+      int bestY = m_size.h;
+      int bestNode = -1;
+
+      for (int i=0; i<int(m_nodes.size()); ++i) {
+        int y;
+        if (fit(i, rc.w, rc.h, y) && y < bestY) {
+          bestY = y;
+          bestNode = i;
+        }
+      }
+
+      if (bestNode < 0)
+        return false;
+
+      rc.x = m_nodes[bestNode].x;
+      rc.y = bestY;
+      addNode(bestNode, rc);
+      return true;
+    }
+
+  private:
+    struct Node {
+      int x, y, w;
+      Node(int x, int y, int w) : x(x), y(y), w(w) { }
+    };
+
+    // Returns true if a w*h rectangle can be placed over the i-th
+    // segment, "y" is the lowest position where it can be placed.
+    bool fit(int i, int w, int h, int& y) const {
+      if (m_nodes[i].x + w > m_size.w)
+        return false;
+
+      y = m_nodes[i].y;
+      int remaining = w;
+      while (remaining > 0) {
+        y = std::max(y, m_nodes[i].y);
+        if (y + h > m_size.h)
+          return false;
+
+        remaining -= m_nodes[i].w;
+        ++i;
+      }
+      return true;
+    }
+
+    void addNode(int i, const Rect& rc) {
+      m_nodes.insert(m_nodes.begin()+i, Node(rc.x, rc.y+rc.h, rc.w));
+
+      // Remove (or shrink) the segments covered by the new one
+      int right = rc.x + rc.w;
+      for (++i; i<int(m_nodes.size()); ) {
+        Node& node = m_nodes[i];
+        if (node.x >= right)
+          break;
+
+        int shrink = right - node.x;
+        if (node.w <= shrink)
+          m_nodes.erase(m_nodes.begin()+i);
+        else {
+          node.x += shrink;
+          node.w -= shrink;
+          break;
+        }
+      }
+
+      // Merge segments at the same height
+      for (i=0; i+1<int(m_nodes.size()); ) {
+        if (m_nodes[i].y == m_nodes[i+1].y) {
+          m_nodes[i].w += m_nodes[i+1].w;
+          m_nodes.erase(m_nodes.begin()+i+1);
+        }
+        else
+          ++i;
+      }
+    }
+
+    Size m_size;
+    std::vector<Node> m_nodes;
+  };
+
+  bool by_height_and_width(const Rect* a, const Rect* b) {
+    if (a->h != b->h)
+      return a->h > b->h;
+    else
+      return a->w > b->w;
+  }
+
+} // anonymous namespace
 
 bool PackingRects::pack(const Size& size)
 {
   m_bounds = Rect(size);
 
-  // We cannot sort m_rects because we want to 
+  // We cannot sort m_rects because we want to keep the same order
+  // given in add() calls.
   std::vector<Rect*> rectPtrs(m_rects.size());
   int i = 0;
   for (auto& rc : m_rects)
     rectPtrs[i++] = &rc;
-  std::sort(rectPtrs.begin(), rectPtrs.end(), by_area);
+  std::stable_sort(rectPtrs.begin(), rectPtrs.end(), by_height_and_width);
 
-  gfx::Region rgn(m_bounds);
+  Skyline skyline(size);
   for (auto rcPtr : rectPtrs) {
     gfx::Rect& rc = *rcPtr;
 
-    for (int v=0; v<=m_bounds.h-rc.h; ++v) {
-      for (int u=0; u<=m_bounds.w-rc.w; ++u) {
-        gfx::Rect possible(u, v, rc.w, rc.h);
-        Region::Overlap overlap = rgn.contains(possible);
-        if (overlap == Region::In) {
-          rc = possible;
-          rgn.createSubtraction(rgn, gfx::Region(rc));
-          goto next_rc;
-        }
-      }
+    // Empty rectangles don't need space
+    if (rc.isEmpty()) {
+      rc.x = rc.y = 0;
+      continue;
     }
-    return false; // There is not enough room for "rc"
-  next_rc:;
+
+    if (!skyline.insert(rc))
+      return false; // There is not enough room for "rc"
   }
 
   return true;
@@ -1,5 +1,5 @@
 // Aseprite Gfx Library
-// Copyright (C) 2001-2014 David Capello
+// Copyright (C) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -93,6 +93,21 @@ TEST(PackingRects, KeepSameRectsOrder)
   EXPECT_EQ(Rect(0, 0, 30, 30), pr[2]);
 }
 
+TEST(PackingRects, ManyRects)
+{
+  PackingRects pr;
+  for (int i=0; i<10000; ++i)
+    pr.add(Size(1 + (i*7) % 31, 1 + (i*13) % 29));
+  Size sz = pr.bestFit();
+
+  EXPECT_EQ(Rect(sz), pr.bounds());
+  for (std::size_t i=0; i<pr.size(); ++i) {
+    EXPECT_TRUE(pr.bounds().contains(pr[i]));
+    for (std::size_t j=i+1; j<pr.size(); ++j)
+      ASSERT_FALSE(pr[i].intersects(pr[j]));
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -145,6 +145,30 @@ Region& Region::createSubtraction(const Region& a, const Region& b)
   return *this;
 }
 
+Region& Region::simplify(std::size_t maxRects, double maxOverdraw)
+{
+  int n = 0;
+  const pixman_box32* boxes = pixman_region32_rectangles(&m_region, &n);
+  if (n <= 1)
+    return *this;
+
+  pixman_box32 extents = *pixman_region32_extents(&m_region);
+  bool merge = (std::size_t(n) > maxRects);
+  if (!merge) {
+    double area = 0.0;
+    for (int i=0; i<n; ++i)
+      area += double(boxes[i].x2 - boxes[i].x1) * double(boxes[i].y2 - boxes[i].y1);
+
+    double boundsArea =
+      double(extents.x2 - extents.x1) * double(extents.y2 - extents.y1);
+    merge = (boundsArea <= area * maxOverdraw);
+  }
+
+  if (merge)
+    pixman_region32_reset(&m_region, &extents);
+  return *this;
+}
+
 bool Region::contains(const PointT<int>& pt) const
 {
   return pixman_region32_contains_point(&m_region, pt.x, pt.y, NULL) ? true: false;
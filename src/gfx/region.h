@@ -93,6 +93,15 @@ namespace gfx {
     Region& createUnion(const Region& a, const Region& b);
     Region& createSubtraction(const Region& a, const Region& b);
 
+    // Replaces the region with its bounds if it has more than
+    // "maxRects" rectangles, or if the bounds area is at most
+    // "maxOverdraw" times the area of the region. It's useful for
+    // regions that accumulate areas to be redrawn (where updating
+    // some extra pixels is cheaper than handling thousands of small
+    // rectangles). A region with one rectangle doesn't use extra
+    // memory.
+    Region& simplify(std::size_t maxRects = 32, double maxOverdraw = 1.5);
+
     bool contains(const PointT<int>& pt) const;
     Overlap contains(const Rect& rect) const;
 
@@ -123,6 +123,42 @@ TEST(Region, Iterators)
   EXPECT_EQ(2, c);
 }
 
+TEST(Region, Simplify)
+{
+  // Two near rectangles are merged
+  Region a(Rect(0, 0, 10, 10));
+  a.createUnion(a, Region(Rect(10, 1, 10, 10)));
+  EXPECT_EQ(3, a.size());
+  a.simplify();
+  EXPECT_EQ(1, a.size());
+  EXPECT_EQ(Rect(0, 0, 20, 11), a[0]);
+
+  // Two far rectangles are kept
+  Region b(Rect(0, 0, 10, 10));
+  b.createUnion(b, Region(Rect(100, 100, 10, 10)));
+  b.simplify();
+  EXPECT_EQ(2, b.size());
+  EXPECT_EQ(Rect(0, 0, 10, 10), b[0]);
+  EXPECT_EQ(Rect(100, 100, 10, 10), b[1]);
+
+  // Too many rectangles
+  Region c;
+  for (int i=0; i<8; ++i)
+    c.createUnion(c, Region(Rect(i*20, i*20, 2, 2)));
+  EXPECT_EQ(8, c.size());
+  c.simplify(8, 1.0);
+  EXPECT_EQ(8, c.size());
+  c.simplify(7, 1.0);
+  EXPECT_EQ(1, c.size());
+  EXPECT_EQ(Rect(0, 0, 142, 142), c.bounds());
+
+  // Empty regions and single rectangles don't change
+  Region d;
+  EXPECT_TRUE(d.simplify(0, 1.0).isEmpty());
+  d = Rect(1, 2, 3, 4);
+  EXPECT_EQ(Rect(1, 2, 3, 4), d.simplify(0, 1.0)[0]);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
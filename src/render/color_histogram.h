@@ -8,6 +8,7 @@
 #define RENDER_COLOR_HISTOGRAM_H_INCLUDED
 #pragma once
 
+#include <algorithm>
 #include <limits>
 #include <vector>
 
@@ -15,6 +16,7 @@
 #include "doc/image_traits.h"
 #include "doc/palette.h"
 
+#include "render/kmeans.h"
 #include "render/median_cut.h"
 
 namespace render {
@@ -75,11 +77,47 @@ namespace render {
       }
     }
 
+    // Adds all samples of the "other" histogram, as if they were added
+    // after the samples of this histogram (the result doesn't depend on
+    // how the samples were split between histograms).
+    void addSamples(const ColorHistogram& other)
+    {
+      for (std::size_t i=0; i<m_histogram.size(); ++i) {
+        std::size_t count = other.m_histogram[i];
+
+        if (m_histogram[i] < std::numeric_limits<std::size_t>::max()-count) // Avoid overflow
+          m_histogram[i] += count;
+        else
+          m_histogram[i] = std::numeric_limits<std::size_t>::max();
+      }
+
+      if (m_useHighPrecision) {
+        if (!other.m_useHighPrecision) {
+          m_useHighPrecision = false;
+          return;
+        }
+
+        for (uint32_t color : other.m_highPrecision) {
+          if (std::find(m_highPrecision.begin(), m_highPrecision.end(), color) != m_highPrecision.end())
+            continue;
+
+          if (m_highPrecision.size() < 256)
+            m_highPrecision.push_back(color);
+          else {
+            m_useHighPrecision = false;
+            break;
+          }
+        }
+      }
+    }
+
     // Creates a set of entries for the given palette in the given range
     // with the more important colors in the histogram. Returns the
     // number of used entries in the palette (maybe the range [from,to]
-    // is more than necessary).
-    int createOptimizedPalette(Palette* palette, int from, int to)
+    // is more than necessary). If "kmeansIterations" is greater than
+    // zero, the median-cut colors are refined with kmeans_refine().
+    int createOptimizedPalette(Palette* palette, int from, int to,
+                               int kmeansIterations = 0, int kmeansMsecs = 0)
     {
       // Can we use the high-precision table?
       if (m_useHighPrecision && int(m_highPrecision.size()) <= (to-from+1)) {
@@ -93,6 +131,7 @@ namespace render {
       else {
         std::vector<uint32_t> result;
         median_cut(*this, to-from+1, result);
+        kmeans_refine(*this, result, kmeansIterations, kmeansMsecs);
 
         for (int i=0; i<(int)result.size(); ++i)
           palette->setEntry(from+i, result[i]);
@@ -0,0 +1,167 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/content_cache.h"
+
+#include "base/tracing.h"
+#include "doc/image.h"
+#include "doc/image_traits.h"
+
+#include <algorithm>
+
+namespace render {
+
+using namespace doc;
+
+static base::tracing::counter hits_counter("render.content_cache.hits");
+static base::tracing::counter misses_counter("render.content_cache.misses");
+
+template<typename ImageTraits>
+inline bool is_opaque_pixel(typename ImageTraits::pixel_t c, color_t maskColor);
+
+template<>
+inline bool is_opaque_pixel<RgbTraits>(RgbTraits::pixel_t c, color_t maskColor)
+{
+  return (rgba_geta(c) == 255);
+}
+
+template<>
+inline bool is_opaque_pixel<GrayscaleTraits>(GrayscaleTraits::pixel_t c, color_t maskColor)
+{
+  return (graya_geta(c) == 255);
+}
+
+template<>
+inline bool is_opaque_pixel<IndexedTraits>(IndexedTraits::pixel_t c, color_t maskColor)
+{
+  return (c != maskColor);
+}
+
+template<typename ImageTraits>
+static ContentCache::Content calculate_content(const Image* image)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+  const pixel_t mask = pixel_t(image->maskColor());
+  const int w = image->width();
+  const int h = image->height();
+  int x1 = w, y1 = h, x2 = -1, y2 = -1;
+  bool opaque = true;
+
+  for (int y=0; y<h; ++y) {
+    const pixel_t* p = (const pixel_t*)image->getPixelAddress(0, y);
+    int first = -1, last = -1;
+
+    for (int x=0; x<w; ++x) {
+      if (p[x] != mask) {
+        if (first < 0)
+          first = x;
+        last = x;
+      }
+      if (opaque && !is_opaque_pixel<ImageTraits>(p[x], mask))
+        opaque = false;
+    }
+
+    if (first >= 0) {
+      x1 = std::min(x1, first);
+      x2 = std::max(x2, last);
+      if (y1 == h)
+        y1 = y;
+      y2 = y;
+    }
+  }
+
+  ContentCache::Content content;
+  if (x2 >= 0)
+    content.bounds = gfx::Rect(x1, y1, x2-x1+1, y2-y1+1);
+  content.opaque = opaque;
+  return content;
+}
+
+static ContentCache::Content calculate_content(const Image* image)
+{
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       return calculate_content<RgbTraits>(image);
+    case IMAGE_GRAYSCALE: return calculate_content<GrayscaleTraits>(image);
+    case IMAGE_INDEXED:   return calculate_content<IndexedTraits>(image);
+  }
+
+  // Bitmaps are never clipped nor opaque
+  ContentCache::Content content;
+  content.bounds = image->bounds();
+  content.opaque = false;
+  return content;
+}
+
+ContentCache::ContentCache(std::size_t maxImages)
+  : m_maxImages(maxImages)
+{
+}
+
+ContentCache::~ContentCache()
+{
+}
+
+ContentCache::Content ContentCache::content(const Image* image)
+{
+  {
+    std::unique_lock<std::mutex> hold(m_mutex);
+
+    auto mapIt = m_map.find(image->id());
+    if (mapIt != m_map.end()) {
+      Entries::iterator it = mapIt->second;
+      if (it->version == image->version() &&
+          it->width == image->width() &&
+          it->height == image->height() &&
+          it->pixelFormat == int(image->pixelFormat()) &&
+          it->maskColor == image->maskColor()) {
+        // Move the entry to the front (most recently used)
+        m_entries.splice(m_entries.begin(), m_entries, it);
+        hits_counter.add(1);
+        return it->content;
+      }
+    }
+  }
+
+  // Pixels are scanned without the mutex locked (other threads can
+  // use the cache meanwhile)
+  misses_counter.add(1);
+  Entry entry;
+  entry.id = image->id();
+  entry.version = image->version();
+  entry.width = image->width();
+  entry.height = image->height();
+  entry.pixelFormat = int(image->pixelFormat());
+  entry.maskColor = image->maskColor();
+  entry.content = calculate_content(image);
+
+  std::unique_lock<std::mutex> hold(m_mutex);
+
+  auto mapIt = m_map.find(entry.id);
+  if (mapIt != m_map.end())
+    m_entries.erase(mapIt->second);
+
+  m_entries.push_front(entry);
+  m_map[entry.id] = m_entries.begin();
+
+  while (m_entries.size() > m_maxImages) {
+    m_map.erase(m_entries.back().id);
+    m_entries.pop_back();
+  }
+  return entry.content;
+}
+
+void ContentCache::clear()
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  m_entries.clear();
+  m_map.clear();
+}
+
+} // namespace render
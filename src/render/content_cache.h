@@ -0,0 +1,73 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_CONTENT_CACHE_H_INCLUDED
+#define RENDER_CONTENT_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/color.h"
+#include "doc/object.h"
+#include "gfx/rect.h"
+
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace doc {
+  class Image;
+}
+
+namespace render {
+
+  // Keeps the bounds of the pixels of each image that aren't the
+  // mask color (pixels with the mask color are never blended), and
+  // if all its pixels are opaque, so Render::renderLayer() can skip
+  // transparent margins of cels and layers below opaque cels (see
+  // Render::setContentCache()).
+  //
+  // The content of an image is calculated again when its version
+  // changes, and the least recently used images are discarded when
+  // the cache has more than the given number of images. The cache
+  // can be used from several threads at the same time.
+  class ContentCache {
+  public:
+    struct Content {
+      gfx::Rect bounds;         // Empty if all pixels are the mask color
+      bool opaque;              // Alpha = 255 in all pixels (RGB and
+                                // grayscale images), or no pixel is
+                                // the mask color (indexed images)
+    };
+
+    explicit ContentCache(std::size_t maxImages = 4096);
+    ~ContentCache();
+
+    Content content(const doc::Image* image);
+
+    void clear();
+
+  private:
+    struct Entry {
+      doc::ObjectId id;
+      doc::ObjectVersion version;
+      int width, height;
+      int pixelFormat;
+      doc::color_t maskColor;
+      Content content;
+    };
+    typedef std::list<Entry> Entries;
+
+    std::size_t m_maxImages;
+    Entries m_entries;          // Most recently used first
+    std::map<doc::ObjectId, Entries::iterator> m_map;
+    std::mutex m_mutex;
+
+    DISABLE_COPYING(ContentCache);
+  };
+
+} // namespace render
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -8,20 +8,35 @@
 #include "config.h"
 #endif
 
+#include "render/get_sprite_pixel.h"
+
 #include "doc/doc.h"
+#include "doc/image_buffer_recycler.h"
 #include "gfx/clip.h"
+#include "gfx/region.h"
 #include "render/render.h"
 
+#include <algorithm>
+
 namespace render {
 
 using namespace doc;
 
+// Size of the cached tiles (small enough to render one quickly, and
+// big enough to contain several mouse movements)
+static const int kTileSize = 64;
+
+// Maximum number of tiles (1MB for RGB images)
+static const std::size_t kMaxTiles = 64;
+
 color_t get_sprite_pixel(const Sprite* sprite, int x, int y, frame_t frame)
 {
   color_t color = 0;
 
   if ((x >= 0) && (y >= 0) && (x < sprite->width()) && (y < sprite->height())) {
-    base::UniquePtr<Image> image(Image::create(sprite->pixelFormat(), 1, 1));
+    base::UniquePtr<Image> image(
+      Image::create(sprite->pixelFormat(), 1, 1,
+        ImageBufferRecycler::global().getForImage(sprite->pixelFormat(), 1, 1)));
 
     render::Render().renderSprite(image, sprite, frame,
       gfx::Clip(0, 0, x, y, 1, 1));
@@ -32,4 +47,79 @@ color_t get_sprite_pixel(const Sprite* sprite, int x, int y, frame_t frame)
   return color;
 }
 
+SpritePixelCache::SpritePixelCache()
+  : m_tilesPerRow(0)
+{
+}
+
+SpritePixelCache::~SpritePixelCache()
+{
+}
+
+color_t SpritePixelCache::getPixel(const Sprite* sprite, int x, int y, frame_t frame)
+{
+  if ((x < 0) || (y < 0) || (x >= sprite->width()) || (y >= sprite->height()))
+    return 0;
+
+  Render render;
+  render.getRenderKey(sprite, frame, m_tmpKey);
+  if (m_tmpKey != m_key) {
+    m_tiles.clear();
+    std::swap(m_key, m_tmpKey);
+    m_tilesPerRow = (sprite->width()+kTileSize-1) / kTileSize;
+  }
+
+  const int tx = x / kTileSize;
+  const int ty = y / kTileSize;
+  const int index = ty*m_tilesPerRow + tx;
+
+  Tiles::iterator it = m_tiles.find(index);
+  if (it == m_tiles.end()) {
+    if (m_tiles.size() >= kMaxTiles)
+      m_tiles.clear();
+
+    gfx::Rect bounds =
+      gfx::Rect(tx*kTileSize, ty*kTileSize, kTileSize, kTileSize)
+      .createIntersection(gfx::Rect(0, 0, sprite->width(), sprite->height()));
+
+    ImageRef tile(Image::create(sprite->pixelFormat(), bounds.w, bounds.h));
+    render.renderSprite(tile.get(), sprite, frame, gfx::Clip(0, 0, bounds));
+
+    it = m_tiles.insert(std::make_pair(index, tile)).first;
+  }
+
+  return get_pixel(it->second.get(), x - tx*kTileSize, y - ty*kTileSize);
+}
+
+void SpritePixelCache::invalidate()
+{
+  m_key.clear();
+  m_tiles.clear();
+}
+
+void SpritePixelCache::invalidate(const gfx::Region& region)
+{
+  if (m_tiles.empty() || m_tilesPerRow == 0)
+    return;
+
+  for (const gfx::Rect& rc : region) {
+    if (rc.isEmpty())
+      continue;
+
+    const int x1 = std::max(rc.x, 0) / kTileSize;
+    const int y1 = std::max(rc.y, 0) / kTileSize;
+    const int x2 = std::min((rc.x2()-1) / kTileSize, m_tilesPerRow-1);
+    const int y2 = (rc.y2()-1) / kTileSize;
+
+    for (Tiles::iterator it=m_tiles.begin(); it!=m_tiles.end(); ) {
+      const int tx = it->first % m_tilesPerRow;
+      const int ty = it->first / m_tilesPerRow;
+      if (tx >= x1 && tx <= x2 && ty >= y1 && ty <= y2)
+        it = m_tiles.erase(it);
+      else
+        ++it;
+    }
+  }
+}
+
 } // namespace render
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2001-2014 David Capello
+// Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -8,12 +8,22 @@
 #define RENDER_GET_SPRITE_PIXEL_H_INCLUDED
 #pragma once
 
+#include "base/disable_copying.h"
+#include "doc/color.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
+
+#include <map>
+#include <vector>
 
 namespace doc {
   class Sprite;
 }
 
+namespace gfx {
+  class Region;
+}
+
 namespace render {
   using namespace doc;
 
@@ -22,6 +32,37 @@ namespace render {
   // return the 0 color (the mask-color).
   color_t get_sprite_pixel(const Sprite* sprite, int x, int y, frame_t frame);
 
+  // Keeps tiles of the composited frame of a sprite, so several
+  // samples near the same position (e.g. the eyedropper on each
+  // mouse movement) don't render all the layers again. Tiles are
+  // discarded when the Render::getRenderKey() of the sampled frame
+  // changes, or when invalidate() is called (images don't increment
+  // their version while they are being painted).
+  class SpritePixelCache {
+  public:
+    SpritePixelCache();
+    ~SpritePixelCache();
+
+    // Same as get_sprite_pixel().
+    color_t getPixel(const Sprite* sprite, int x, int y, frame_t frame);
+
+    void invalidate();
+
+    // Invalidates the tiles that intersect the given region (in
+    // sprite coordinates).
+    void invalidate(const gfx::Region& region);
+
+  private:
+    typedef std::map<int, ImageRef> Tiles;
+
+    std::vector<int> m_key;
+    std::vector<int> m_tmpKey;
+    int m_tilesPerRow;
+    Tiles m_tiles;
+
+    DISABLE_COPYING(SpritePixelCache);
+  };
+
 } // namespace render
 
 #endif
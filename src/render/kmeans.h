@@ -0,0 +1,134 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_KMEANS_H_INCLUDED
+#define RENDER_KMEANS_H_INCLUDED
+#pragma once
+
+#include "base/chrono.h"
+#include "base/thread_pool.h"
+#include "doc/color.h"
+#include "doc/palette_index.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace render {
+
+  // Refines the given colors (e.g. the result of median_cut()) with
+  // k-means (Lloyd's algorithm) over the non-empty entries of the
+  // histogram. Each iteration assigns each entry (weighted by its
+  // number of points) to the nearest color using a doc::PaletteIndex
+  // (the same metric used by Palette::findBestfit()), and moves each
+  // color to the mean of its entries. It stops when no entry changes
+  // of color, after "maxIterations", or after the first iteration
+  // that exceeds "maxMsecs" (if it's greater than zero).
+  //
+  // Entries are assigned in parallel by chunks, and the sums are
+  // integers, so the result doesn't depend on the number of threads
+  // (only on the number of iterations done).
+  template<class Histogram>
+  void kmeans_refine(const Histogram& histogram,
+                     std::vector<uint32_t>& colors,
+                     int maxIterations, int maxMsecs)
+  {
+    const int ncolors = int(colors.size());
+    if (ncolors == 0 || ncolors > 256 || maxIterations <= 0)
+      return;
+
+    base::Chrono chrono;
+
+    struct Entry {
+      int r, g, b;
+      uint64_t count;
+    };
+    std::vector<Entry> entries;
+    for (int k=0; k<Histogram::BElements; ++k)
+      for (int j=0; j<Histogram::GElements; ++j)
+        for (int i=0; i<Histogram::RElements; ++i) {
+          std::size_t count = histogram.at(i, j, k);
+          if (count == 0)
+            continue;
+
+          // Saturated counts are limited so the sums cannot overflow
+          Entry entry = {
+            255 * i / (Histogram::RElements-1),
+            255 * j / (Histogram::GElements-1),
+            255 * k / (Histogram::BElements-1),
+            std::min<uint64_t>(count, uint64_t(1) << 32) };
+          entries.push_back(entry);
+        }
+
+    const int nentries = int(entries.size());
+    if (nentries == 0)
+      return;
+
+    struct Sum {
+      uint64_t r, g, b, count;
+    };
+    const int minEntriesPerChunk = 1024;
+    const int chunks = std::max(1, std::min(base::thread_pool::global().workers()+1,
+                                            nentries / minEntriesPerChunk));
+    std::vector<Sum> sums(chunks*ncolors);
+    std::vector<char> changed(chunks);
+    std::vector<int> nearest(nentries, -1);
+    doc::PaletteIndex index;
+
+    for (int iteration=0; iteration<maxIterations; ++iteration) {
+      index.reset(colors);
+
+      Sum zero = { 0, 0, 0, 0 };
+      std::fill(sums.begin(), sums.end(), zero);
+      std::fill(changed.begin(), changed.end(), 0);
+
+      base::thread_pool::global().parallel_for(
+        chunks, [&](int c) {
+          Sum* chunkSums = &sums[c*ncolors];
+          int end = nentries * (c+1) / chunks;
+          for (int e=nentries * c / chunks; e<end; ++e) {
+            const Entry& entry = entries[e];
+            int i = index.findBestfit(colors, entry.r, entry.g, entry.b, 8, -1);
+            if (nearest[e] != i) {
+              nearest[e] = i;
+              changed[c] = 1;
+            }
+
+            Sum& sum = chunkSums[i];
+            sum.r += entry.r * entry.count;
+            sum.g += entry.g * entry.count;
+            sum.b += entry.b * entry.count;
+            sum.count += entry.count;
+          }
+        });
+
+      if (std::find(changed.begin(), changed.end(), 1) == changed.end())
+        break;
+
+      for (int i=0; i<ncolors; ++i) {
+        Sum total = zero;
+        for (int c=0; c<chunks; ++c) {
+          const Sum& sum = sums[c*ncolors + i];
+          total.r += sum.r;
+          total.g += sum.g;
+          total.b += sum.b;
+          total.count += sum.count;
+        }
+
+        // Colors without entries are kept as they are
+        if (total.count > 0)
+          colors[i] = doc::rgba(int((total.r + total.count/2) / total.count),
+                                int((total.g + total.count/2) / total.count),
+                                int((total.b + total.count/2) / total.count), 255);
+      }
+
+      if (maxMsecs > 0 && chrono.elapsed()*1000.0 >= maxMsecs)
+        break;
+    }
+  }
+
+} // namespace render
+
+#endif
@@ -0,0 +1,84 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/layers_cache.h"
+
+#include "doc/image.h"
+
+namespace render {
+
+bool LayersCache::Key::operator==(const Key& other) const
+{
+  if (sprite != other.sprite ||
+      frame != other.frame ||
+      activeLayer != other.activeLayer ||
+      spriteVersion != other.spriteVersion ||
+      palette != other.palette ||
+      paletteVersion != other.paletteVersion ||
+      nbases != other.nbases ||
+      layers != other.layers)
+    return false;
+
+  for (int i=0; i<nbases; ++i)
+    if (bases[i] != other.bases[i])
+      return false;
+
+  return true;
+}
+
+LayersCache::LayersCache()
+  : m_valid(false)
+{
+}
+
+LayersCache::~LayersCache()
+{
+}
+
+void LayersCache::invalidate()
+{
+  m_valid = false;
+}
+
+void LayersCache::clear()
+{
+  m_valid = false;
+  m_images[0].reset();
+  m_images[1].reset();
+}
+
+std::size_t LayersCache::memSize() const
+{
+  std::size_t size = 0;
+  for (const auto& image : m_images)
+    if (image)
+      size += image->getMemSize();
+  return size;
+}
+
+void LayersCache::onGeneralUpdate(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onPixelFormatChanged(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onAddLayer(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onAddFrame(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onAddCel(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onAfterRemoveLayer(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onRemoveFrame(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onRemoveCel(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onSpriteSizeChanged(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onSpriteTransparentColorChanged(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onLayerRestacked(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onLayerMergedDown(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onCelMoved(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onCelCopied(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onCelFrameChanged(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onCelPositionChanged(doc::DocumentEvent& ev) { invalidate(); }
+void LayersCache::onCelOpacityChanged(doc::DocumentEvent& ev) { invalidate(); }
+
+} // namespace render
@@ -0,0 +1,109 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_LAYERS_CACHE_H_INCLUDED
+#define RENDER_LAYERS_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/unique_ptr.h"
+#include "doc/color.h"
+#include "doc/document_observer.h"
+#include "doc/frame.h"
+#include "doc/object.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace doc {
+  class Image;
+  class Layer;
+  class Sprite;
+}
+
+namespace render {
+
+  // Keeps the layers below the active layer of a sprite frame
+  // composited (in sprite coordinates), so Render can repaint the
+  // active layer and the layers above it without compositing all the
+  // layers below again (see Render::setLayersCache()).
+  //
+  // The cache is validated on each render comparing the ID/version
+  // of each layer/cel/image below the active layer (pixel changes are
+  // detected through the image versions, as the crash backup does).
+  // Structural changes are notified through doc::DocumentObserver.
+  // onSpritePixelsModified()/onExposeSpritePixels() don't invalidate
+  // the cache because they are generated while the active layer is
+  // being painted.
+  class LayersCache : public doc::DocumentObserver {
+  public:
+    LayersCache();
+    ~LayersCache();
+
+    void invalidate();
+
+    // Invalidates the cache and releases its images.
+    void clear();
+
+    // Bytes used by the cached images.
+    std::size_t memSize() const;
+
+    // doc::DocumentObserver impl
+    void onGeneralUpdate(doc::DocumentEvent& ev) override;
+    void onPixelFormatChanged(doc::DocumentEvent& ev) override;
+    void onAddLayer(doc::DocumentEvent& ev) override;
+    void onAddFrame(doc::DocumentEvent& ev) override;
+    void onAddCel(doc::DocumentEvent& ev) override;
+    void onAfterRemoveLayer(doc::DocumentEvent& ev) override;
+    void onRemoveFrame(doc::DocumentEvent& ev) override;
+    void onRemoveCel(doc::DocumentEvent& ev) override;
+    void onSpriteSizeChanged(doc::DocumentEvent& ev) override;
+    void onSpriteTransparentColorChanged(doc::DocumentEvent& ev) override;
+    void onLayerRestacked(doc::DocumentEvent& ev) override;
+    void onLayerMergedDown(doc::DocumentEvent& ev) override;
+    void onCelMoved(doc::DocumentEvent& ev) override;
+    void onCelCopied(doc::DocumentEvent& ev) override;
+    void onCelFrameChanged(doc::DocumentEvent& ev) override;
+    void onCelPositionChanged(doc::DocumentEvent& ev) override;
+    void onCelOpacityChanged(doc::DocumentEvent& ev) override;
+
+  private:
+    friend class Render;
+
+    // Identifies the state of everything that affects the cached
+    // images.
+    struct Key {
+      const doc::Sprite* sprite;
+      doc::frame_t frame;
+      doc::ObjectId activeLayer;
+      doc::ObjectVersion spriteVersion;
+      doc::ObjectId palette;
+      doc::ObjectVersion paletteVersion;
+      int nbases;
+      doc::color_t bases[2];
+      // (layer ID, visible, cel ID, image ID, image version, x, y, opacity)
+      std::vector<int> layers;
+
+      bool operator==(const Key& other) const;
+    };
+
+    bool m_valid;
+    Key m_key;
+
+    // Image layers below the active layer (sorted by address to be
+    // used with std::binary_search()).
+    std::vector<const doc::Layer*> m_belowLayers;
+
+    // One RGB image for each base color (two images when the checked
+    // background is visible, one for each color of the pattern).
+    base::UniquePtr<doc::Image> m_images[2];
+
+    DISABLE_COPYING(LayersCache);
+  };
+
+} // namespace render
+
+#endif
@@ -0,0 +1,154 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/mipmap_cache.h"
+
+#include "base/tracing.h"
+#include "doc/image.h"
+#include "doc/image_traits.h"
+
+namespace render {
+
+using namespace doc;
+
+static base::tracing::counter hits_counter("render.mipmap_cache.hits");
+static base::tracing::counter misses_counter("render.mipmap_cache.misses");
+
+template<typename ImageTraits>
+static void pick_level_pixels(const Image* src, Image* dst, int level)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  for (int y=0; y<dst->height(); ++y) {
+    const pixel_t* src_ptr = (const pixel_t*)src->getPixelAddress(0, y << level);
+    pixel_t* dst_ptr = (pixel_t*)dst->getPixelAddress(0, y);
+
+    for (int x=0; x<dst->width(); ++x, src_ptr += (1 << level))
+      dst_ptr[x] = *src_ptr;
+  }
+}
+
+static Image* create_level(const Image* src, int level)
+{
+  int round = (1 << level) - 1;
+  Image* dst = Image::create(src->pixelFormat(),
+                             (src->width() + round) >> level,
+                             (src->height() + round) >> level);
+  dst->setMaskColor(src->maskColor());
+
+  switch (src->pixelFormat()) {
+    case IMAGE_RGB:       pick_level_pixels<RgbTraits>(src, dst, level); break;
+    case IMAGE_GRAYSCALE: pick_level_pixels<GrayscaleTraits>(src, dst, level); break;
+    case IMAGE_INDEXED:   pick_level_pixels<IndexedTraits>(src, dst, level); break;
+    default:
+      ASSERT(false);
+      break;
+  }
+  return dst;
+}
+
+MipmapCache::MipmapCache(std::size_t maxBytes)
+  : m_maxBytes(maxBytes)
+  , m_bytes(0)
+{
+}
+
+MipmapCache::~MipmapCache()
+{
+}
+
+ImageRef MipmapCache::level(const Image* image, int level)
+{
+  ASSERT(level >= 1);
+
+  if (image->pixelFormat() == IMAGE_BITMAP ||
+      (image->width() >> level) == 0 ||
+      (image->height() >> level) == 0)
+    return ImageRef(nullptr);
+
+  std::unique_lock<std::mutex> hold(m_mutex);
+
+  Entries::iterator it;
+  auto mapIt = m_map.find(image->id());
+  if (mapIt != m_map.end()) {
+    it = mapIt->second;
+
+    // Move the entry to the front (most recently used)
+    m_entries.splice(m_entries.begin(), m_entries, it);
+
+    // The image was modified, all levels must be re-created
+    if (it->version != image->version() ||
+        it->width != image->width() ||
+        it->height != image->height() ||
+        it->pixelFormat != int(image->pixelFormat()) ||
+        it->maskColor != image->maskColor()) {
+      m_bytes -= it->bytes;
+      it->bytes = 0;
+      it->levels.clear();
+    }
+  }
+  else {
+    m_entries.push_front(Entry());
+    it = m_entries.begin();
+    it->id = image->id();
+    it->bytes = 0;
+    m_map[image->id()] = it;
+  }
+
+  it->version = image->version();
+  it->width = image->width();
+  it->height = image->height();
+  it->pixelFormat = int(image->pixelFormat());
+  it->maskColor = image->maskColor();
+
+  if (int(it->levels.size()) < level)
+    it->levels.resize(level);
+
+  ImageRef result = it->levels[level-1];
+  if (result)
+    hits_counter.add(1);
+  else {
+    misses_counter.add(1);
+    result.reset(create_level(image, level));
+    it->levels[level-1] = result;
+    it->bytes += result->getMemSize();
+    m_bytes += result->getMemSize();
+    shrink();
+  }
+  return result;
+}
+
+void MipmapCache::clear()
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  m_entries.clear();
+  m_map.clear();
+  m_bytes = 0;
+}
+
+std::size_t MipmapCache::bytes() const
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  return m_bytes;
+}
+
+void MipmapCache::shrink()
+{
+  // Discard the least recently used images (but never the most
+  // recently used one, which is being rendered).
+  while (m_bytes > m_maxBytes && m_entries.size() > 1) {
+    Entry& entry = m_entries.back();
+    m_bytes -= entry.bytes;
+    m_map.erase(entry.id);
+    m_entries.pop_back();
+  }
+}
+
+} // namespace render
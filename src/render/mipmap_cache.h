@@ -0,0 +1,78 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_MIPMAP_CACHE_H_INCLUDED
+#define RENDER_MIPMAP_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/color.h"
+#include "doc/image_ref.h"
+#include "doc/object.h"
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace doc {
+  class Image;
+}
+
+namespace render {
+
+  // Keeps reduced copies of images (levels of 1/2, 1/4, 1/8, etc.)
+  // to render zoomed out views reading less (and contiguous) memory
+  // (see Render::setMipmapCache()).
+  //
+  // The pixel (x, y) of the level "n" is the pixel (x*2^n, y*2^n) of
+  // the original image (there is no filtering), so rendering a level
+  // at zoom 2^n/N gives the same result as rendering the original
+  // image at zoom 1/N. Levels are created the first time they are
+  // used, and all levels of an image are re-created when the image
+  // version changes. The least recently used images are discarded
+  // when the levels use more than the given amount of memory.
+  //
+  // The cache can be used from several threads at the same time
+  // (e.g. in tiled rendering).
+  class MipmapCache {
+  public:
+    explicit MipmapCache(std::size_t maxBytes = 64*1024*1024);
+    ~MipmapCache();
+
+    // Returns the level of the given image (level >= 1).
+    doc::ImageRef level(const doc::Image* image, int level);
+
+    void clear();
+
+    std::size_t bytes() const;
+
+  private:
+    struct Entry {
+      doc::ObjectId id;
+      doc::ObjectVersion version;
+      int width, height;
+      int pixelFormat;
+      doc::color_t maskColor;
+      std::size_t bytes;
+      std::vector<doc::ImageRef> levels; // levels[i] is the level i+1
+    };
+    typedef std::list<Entry> Entries;
+
+    void shrink();
+
+    std::size_t m_maxBytes;
+    std::size_t m_bytes;
+    Entries m_entries;          // Most recently used first
+    std::map<doc::ObjectId, Entries::iterator> m_map;
+    mutable std::mutex m_mutex;
+
+    DISABLE_COPYING(MipmapCache);
+  };
+
+} // namespace render
+
+#endif
@@ -0,0 +1,36 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/onionskin_cache.h"
+
+#include "doc/image.h"
+
+namespace render {
+
+OnionskinCache::OnionskinCache(std::size_t maxBytes)
+  : m_maxBytes(maxBytes)
+{
+}
+
+void OnionskinCache::clear()
+{
+  m_entries.clear();
+}
+
+std::size_t OnionskinCache::memSize() const
+{
+  std::size_t size = 0;
+  for (const Entry& entry : m_entries)
+    if (entry.image)
+      size += entry.image->getMemSize();
+  return size;
+}
+
+} // namespace render
@@ -0,0 +1,61 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_ONIONSKIN_CACHE_H_INCLUDED
+#define RENDER_ONIONSKIN_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace render {
+
+  // Keeps the frames displayed with the onion skin composited (all
+  // layers of each frame in an RGB image in sprite coordinates), so
+  // Render can draw each neighboring frame blending just one image
+  // instead of compositing all its layers again (see
+  // Render::setOnionskinCache()).
+  //
+  // Each frame is validated on each render comparing the
+  // IDs/versions of its layers/cels/images (as LayersCache does), so
+  // painting in the current frame doesn't re-composite the other
+  // frames. Frames that aren't displayed anymore are discarded.
+  //
+  // It isn't thread-safe (Render uses it before splitting the area
+  // in tiles).
+  class OnionskinCache {
+  public:
+    explicit OnionskinCache(std::size_t maxBytes = 128*1024*1024);
+
+    void clear();
+
+    std::size_t maxBytes() const { return m_maxBytes; }
+
+    // Bytes used by the cached frames.
+    std::size_t memSize() const;
+
+  private:
+    friend class Render;
+
+    struct Entry {
+      doc::frame_t frame;
+      std::vector<int> key;
+      doc::ImageRef image;
+    };
+
+    std::size_t m_maxBytes;
+    std::vector<Entry> m_entries;
+
+    DISABLE_COPYING(OnionskinCache);
+  };
+
+} // namespace render
+
+#endif
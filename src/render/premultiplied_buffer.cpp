@@ -0,0 +1,150 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/premultiplied_buffer.h"
+
+#include "doc/image.h"
+#include "doc/image_traits.h"
+#include "doc/palette.h"
+#include "gfx/rect.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define RENDER_PREMULTIPLIED_SSE2
+  #include <emmintrin.h>
+#endif
+
+namespace render {
+
+using namespace doc;
+
+namespace {
+
+// Table to convert channels from [0, 255] to [0, 1]
+struct Channels {
+  float values[256];
+  Channels() {
+    for (int i=0; i<256; ++i)
+      values[i] = float(i) / 255.0f;
+  }
+};
+
+const Channels channels;
+
+// Blends the straight alpha color "c" with "opacity" (in [0, 1])
+// over the premultiplied pixel "dst" (four floats).
+inline void blend_pixel(float* dst, color_t c, float opacity)
+{
+  const float* k = channels.values;
+  const float a = k[rgba_geta(c)] * opacity;
+  if (a == 0.0f)
+    return;
+
+#ifdef RENDER_PREMULTIPLIED_SSE2
+  __m128 s = _mm_mul_ps(_mm_set_ps(1.0f, k[rgba_getb(c)], k[rgba_getg(c)], k[rgba_getr(c)]),
+                        _mm_set1_ps(a));
+  __m128 d = _mm_loadu_ps(dst);
+  _mm_storeu_ps(dst, _mm_add_ps(s, _mm_mul_ps(d, _mm_set1_ps(1.0f - a))));
+#else
+  const float ia = 1.0f - a;
+  dst[0] = k[rgba_getr(c)]*a + dst[0]*ia;
+  dst[1] = k[rgba_getg(c)]*a + dst[1]*ia;
+  dst[2] = k[rgba_getb(c)]*a + dst[2]*ia;
+  dst[3] = a + dst[3]*ia;
+#endif
+}
+
+inline int to_channel(float v)
+{
+  return std::min(255, int(v*255.0f + 0.5f));
+}
+
+} // anonymous namespace
+
+PremultipliedBuffer::PremultipliedBuffer(int width, int height)
+  : m_width(width)
+  , m_height(height)
+  , m_pixels(std::size_t(width)*height*4, 0.0f)
+{
+}
+
+void PremultipliedBuffer::blendImage(const Image* src, const Palette* palette,
+                                     int x, int y, int opacity)
+{
+  gfx::Rect bounds = gfx::Rect(x, y, src->width(), src->height())
+    .createIntersection(gfx::Rect(0, 0, m_width, m_height));
+  if (bounds.isEmpty() || opacity <= 0)
+    return;
+
+  const float k = channels.values[std::min(opacity, 255)];
+  const color_t mask = src->maskColor();
+
+  for (int v=bounds.y; v<bounds.y2(); ++v) {
+    float* dst = &m_pixels[(std::size_t(v)*m_width + bounds.x)*4];
+    const uint8_t* row = src->getPixelAddress(bounds.x - x, v - y);
+
+    switch (src->pixelFormat()) {
+
+      case IMAGE_RGB: {
+        const RgbTraits::pixel_t* it = (const RgbTraits::pixel_t*)row;
+        for (int u=0; u<bounds.w; ++u, ++it, dst+=4)
+          if (*it != mask)
+            blend_pixel(dst, *it, k);
+        break;
+      }
+
+      case IMAGE_GRAYSCALE: {
+        const GrayscaleTraits::pixel_t* it = (const GrayscaleTraits::pixel_t*)row;
+        for (int u=0; u<bounds.w; ++u, ++it, dst+=4)
+          if (*it != mask) {
+            int g = graya_getv(*it);
+            blend_pixel(dst, rgba(g, g, g, graya_geta(*it)), k);
+          }
+        break;
+      }
+
+      case IMAGE_INDEXED: {
+        const IndexedTraits::pixel_t* it = (const IndexedTraits::pixel_t*)row;
+        for (int u=0; u<bounds.w; ++u, ++it, dst+=4)
+          if (*it != mask)
+            blend_pixel(dst, palette->getEntry(*it), k);
+        break;
+      }
+
+      default:
+        ASSERT(false);
+        return;
+    }
+  }
+}
+
+void PremultipliedBuffer::copyToImage(Image* dst) const
+{
+  ASSERT(dst->pixelFormat() == IMAGE_RGB);
+  ASSERT(dst->width() == m_width);
+  ASSERT(dst->height() == m_height);
+
+  const float* src = &m_pixels[0];
+  for (int y=0; y<m_height; ++y) {
+    RgbTraits::pixel_t* it = (RgbTraits::pixel_t*)dst->getPixelAddress(0, y);
+    for (int x=0; x<m_width; ++x, ++it, src+=4) {
+      const int a = to_channel(src[3]);
+      if (a == 0)
+        *it = 0;
+      else
+        *it = rgba(to_channel(src[0] / src[3]),
+                   to_channel(src[1] / src[3]),
+                   to_channel(src[2] / src[3]), a);
+    }
+  }
+}
+
+} // namespace render
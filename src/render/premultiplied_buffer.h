@@ -0,0 +1,59 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_PREMULTIPLIED_BUFFER_H_INCLUDED
+#define RENDER_PREMULTIPLIED_BUFFER_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <vector>
+
+namespace doc {
+  class Image;
+  class Palette;
+}
+
+namespace render {
+
+  // Buffer of RGBA pixels with premultiplied alpha (a float for each
+  // channel) used to composite several layers with the normal blend
+  // mode. Blending a pixel is a multiply-add of the four channels
+  // (D = S + D*(1-S_a)) without the division of the destination
+  // alpha needed by straight alpha colors (see rgba_blend_normal()),
+  // and the result is converted to straight alpha only at the end.
+  //
+  // An image blended over the initial transparent buffer gives
+  // exactly the same pixels as rgba_blend_normal().
+  class PremultipliedBuffer {
+  public:
+    // Creates a transparent buffer.
+    PremultipliedBuffer(int width, int height);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    // Blends the pixels of the image (of any pixel format but
+    // IMAGE_BITMAP) at the given position with the normal blend
+    // mode. Pixels with the mask color of the image are skipped.
+    void blendImage(const doc::Image* src, const doc::Palette* palette,
+                    int x, int y, int opacity);
+
+    // Converts the buffer to straight alpha colors in the given
+    // IMAGE_RGB image (of the same size).
+    void copyToImage(doc::Image* dst) const;
+
+  private:
+    int m_width;
+    int m_height;
+    std::vector<float> m_pixels;
+
+    DISABLE_COPYING(PremultipliedBuffer);
+  };
+
+} // namespace render
+
+#endif
@@ -10,6 +10,7 @@
 
 #include "render/quantization.h"
 
+#include "base/thread_pool.h"
 #include "doc/blend.h"
 #include "doc/image.h"
 #include "doc/image_bits.h"
@@ -41,6 +42,14 @@ static Image* ordered_dithering(
   const RgbMap* rgbmap,
   const Palette* palette);
 
+// Converts a RGB image to indexed with Floyd-Steinberg error
+// diffusion.
+static Image* error_diffusion_dithering(
+  const Image* src_image,
+  Image* dst_image,
+  const RgbMap* rgbmap,
+  const Palette* palette);
+
 Palette* create_palette_from_rgb(
   const Sprite* sprite,
   frame_t fromFrame,
@@ -54,18 +63,34 @@ Palette* create_palette_from_rgb(
 
   bool has_background_layer = (sprite->backgroundLayer() != nullptr);
 
-  // Add a flat image with the current sprite's frame rendered
-  ImageRef flat_image(Image::create(IMAGE_RGB,
-      sprite->width(), sprite->height()));
+  // Feed the optimizer with all rendered frames. Each thread renders
+  // a consecutive range of frames in its own optimizer, then they are
+  // fed in order (the palette doesn't depend on the number of threads).
+  int nframes = toFrame - fromFrame + 1;
+  int ranges = std::max(1, std::min(nframes, base::thread_pool::global().workers()+1));
+  std::vector<PaletteOptimizer> optimizers(ranges);
+
+  base::thread_pool::global().parallel_for(
+    ranges, [&optimizers, sprite, fromFrame, nframes, ranges](int i) {
+      // Add a flat image with the current sprite's frame rendered
+      ImageRef flat_image(Image::create(IMAGE_RGB,
+          sprite->width(), sprite->height()));
+
+      render::Render render;
+      frame_t frame = fromFrame + frame_t(nframes * i / ranges);
+      frame_t end = fromFrame + frame_t(nframes * (i+1) / ranges);
+      for (; frame<end; ++frame) {
+        render.renderSprite(flat_image.get(), sprite, frame);
+        optimizers[i].feedWithImage(flat_image.get());
+      }
+    });
 
-  // Feed the optimizer with all rendered frames
-  render::Render render;
-  for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-    render.renderSprite(flat_image.get(), sprite, frame);
-    optimizer.feedWithImage(flat_image.get());
-  }
+  for (const auto& rangeOptimizer : optimizers)
+    optimizer.feedWithOptimizer(rangeOptimizer);
 
-  // Generate an optimized palette
+  // Generate an optimized palette (refined with k-means as it's
+  // calculated only once for the whole sprite)
+  optimizer.setKMeansRefinement(16, 500);
   optimizer.calculate(palette, has_background_layer);
 
   return palette;
@@ -90,6 +115,13 @@ Image* convert_pixel_format(
     return ordered_dithering(image, new_image, 0, 0, rgbmap, palette);
   }
 
+  // RGB -> Indexed with error diffusion
+  if (image->pixelFormat() == IMAGE_RGB &&
+      pixelFormat == IMAGE_INDEXED &&
+      ditheringMethod == DitheringMethod::ERROR_DIFFUSION) {
+    return error_diffusion_dithering(image, new_image, rgbmap, palette);
+  }
+
   color_t c;
   int r, g, b;
 
@@ -333,9 +365,11 @@ static int pattern[8][8] = {
                                  4 * ((g1)-(g2)) * ((g1)-(g2)) +        \
                                  2 * ((b1)-(b2)) * ((b1)-(b2)))
 
-static Image* ordered_dithering(
+// Converts the rows [y1, y2) of the image with ordered dithering.
+static void ordered_dithering_rows(
   const Image* src_image,
   Image* dst_image,
+  int y1, int y2,
   int offsetx, int offsety,
   const RgbMap* rgbmap,
   const Palette* palette)
@@ -345,19 +379,13 @@ static Image* ordered_dithering(
   int nr, ng, nb;
   int r, g, b, a;
   int nearestcm;
-  int x, y;
   color_t c;
 
-  const LockImageBits<RgbTraits> src_bits(src_image);
-  LockImageBits<IndexedTraits> dst_bits(dst_image);
-  LockImageBits<RgbTraits>::const_iterator src_it = src_bits.begin();
-  LockImageBits<IndexedTraits>::iterator dst_it = dst_bits.begin();
-
-  for (y=0; y<src_image->height(); ++y) {
-    for (x=0; x<src_image->width(); ++x, ++src_it, ++dst_it) {
-      ASSERT(src_it != src_bits.end());
-      ASSERT(dst_it != dst_bits.end());
+  for (int y=y1; y<y2; ++y) {
+    const RgbTraits::pixel_t* src_it = (RgbTraits::address_t)src_image->getPixelAddress(0, y);
+    IndexedTraits::pixel_t* dst_it = (IndexedTraits::address_t)dst_image->getPixelAddress(0, y);
 
+    for (int x=0; x<src_image->width(); ++x, ++src_it, ++dst_it) {
       c = *src_it;
 
       r = rgba_getr(c);
@@ -406,6 +434,133 @@ static Image* ordered_dithering(
       *dst_it = nearestcm;
     }
   }
+}
+
+static Image* ordered_dithering(
+  const Image* src_image,
+  Image* dst_image,
+  int offsetx, int offsety,
+  const RgbMap* rgbmap,
+  const Palette* palette)
+{
+  // Each pixel depends only on its own color and position, so the
+  // image can be split in bands of rows converted in parallel (the
+  // lazy RgbMap can be shared between threads).
+  const int minPixelsPerBand = 128*128;
+  int bands = std::min(base::thread_pool::global().workers()+1,
+                       src_image->width()*src_image->height() / minPixelsPerBand);
+  bands = std::max(1, std::min(bands, src_image->height()));
+
+  if (bands == 1) {
+    ordered_dithering_rows(src_image, dst_image, 0, src_image->height(),
+                           offsetx, offsety, rgbmap, palette);
+    return dst_image;
+  }
+
+  base::thread_pool::global().parallel_for(
+    bands, [=](int i) {
+      ordered_dithering_rows(src_image, dst_image,
+                             src_image->height() * i / bands,
+                             src_image->height() * (i+1) / bands,
+                             offsetx, offsety, rgbmap, palette);
+    });
+
+  return dst_image;
+}
+
+// Height of each band of the error diffusion. It doesn't depend on
+// the number of threads, so the result is always the same.
+static const int kDiffusionBandHeight = 64;
+
+// Rows above each band that are processed (but not written) to
+// accumulate the error that comes from the previous band, so the
+// seams between bands aren't visible.
+static const int kDiffusionSeamRows = 16;
+
+// Converts the rows [y1, y2) of the image with Floyd-Steinberg error
+// diffusion, starting with zero error in the row "startY" (<= y1).
+// Rows are processed in serpentine order (the direction depends on
+// the parity of each row).
+static void error_diffusion_rows(
+  const Image* src_image,
+  Image* dst_image,
+  int startY, int y1, int y2,
+  const RgbMap* rgbmap,
+  const Palette* palette)
+{
+  const int w = src_image->width();
+
+  // Errors of the current and the next row (scaled by 16) for each
+  // channel, with one extra pixel at each side to avoid checking
+  // the borders.
+  std::vector<int> errors1(3*(w+2), 0);
+  std::vector<int> errors2(3*(w+2), 0);
+  int* cur = &errors1[0];
+  int* next = &errors2[0];
+  int err[3];
+
+  for (int y=startY; y<y2; ++y) {
+    const RgbTraits::pixel_t* src_row = (RgbTraits::address_t)src_image->getPixelAddress(0, y);
+    IndexedTraits::pixel_t* dst_row = (y >= y1 ? (IndexedTraits::address_t)dst_image->getPixelAddress(0, y): nullptr);
+    const int dir = ((y & 1) == 0 ? 1: -1);
+
+    std::fill(next, next+3*(w+2), 0);
+
+    for (int i=0, x=(dir > 0 ? 0: w-1); i<w; ++i, x+=dir) {
+      color_t c = src_row[x];
+      int* e = cur + 3*(x+1);
+      int index;
+
+      if (rgba_geta(c) == 0) {
+        // Transparent pixels don't spread their error
+        index = 0;
+      }
+      else {
+        int r = MID(0, rgba_getr(c) + e[0]/16, 255);
+        int g = MID(0, rgba_getg(c) + e[1]/16, 255);
+        int b = MID(0, rgba_getb(c) + e[2]/16, 255);
+
+        index = rgbmap->mapColor(r, g, b);
+        color_t p = palette->getEntry(index);
+        err[0] = r - rgba_getr(p);
+        err[1] = g - rgba_getg(p);
+        err[2] = b - rgba_getb(p);
+
+        int* ahead = e + 3*dir;
+        int* below = next + 3*(x+1);
+        for (int k=0; k<3; ++k) {
+          ahead[k] += 7*err[k];
+          below[k-3*dir] += 3*err[k];
+          below[k] += 5*err[k];
+          below[k+3*dir] += err[k];
+        }
+      }
+
+      if (dst_row)
+        dst_row[x] = index;
+    }
+
+    std::swap(cur, next);
+  }
+}
+
+static Image* error_diffusion_dithering(
+  const Image* src_image,
+  Image* dst_image,
+  const RgbMap* rgbmap,
+  const Palette* palette)
+{
+  const int h = src_image->height();
+  const int bands = (h + kDiffusionBandHeight - 1) / kDiffusionBandHeight;
+
+  base::thread_pool::global().parallel_for(
+    bands, [=](int i) {
+      int y1 = i * kDiffusionBandHeight;
+      int y2 = std::min(h, y1 + kDiffusionBandHeight);
+      error_diffusion_rows(src_image, dst_image,
+                           std::max(0, y1 - kDiffusionSeamRows), y1, y2,
+                           rgbmap, palette);
+    });
 
   return dst_image;
 }
@@ -414,41 +569,59 @@ static Image* ordered_dithering(
 // Creation of optimized palette for RGB images
 // by David Capello
 
-void PaletteOptimizer::feedWithImage(Image* image)
+// Adds the non-transparent pixels of rows [y1, y2) to the histogram.
+// Runs of the same color are added at once (the high precision table
+// is searched just one time for each run).
+template<typename Histogram>
+static void feed_histogram_with_rows(Histogram& histogram, const Image* image, int y1, int y2)
 {
+  uint32_t run_color = 0;
+  std::size_t run_count = 0;
   uint32_t color;
 
-  ASSERT(image);
   switch (image->pixelFormat()) {
 
     case IMAGE_RGB:
-      {
-        const LockImageBits<RgbTraits> bits(image);
-        LockImageBits<RgbTraits>::const_iterator it = bits.begin(), end = bits.end();
+      for (int y=y1; y<y2; ++y) {
+        const RgbTraits::pixel_t* it = (RgbTraits::address_t)image->getPixelAddress(0, y);
+        const RgbTraits::pixel_t* end = it + image->width();
 
         for (; it != end; ++it) {
           color = *it;
-
-          if (rgba_geta(color) > 0) {
-            color |= rgba(0, 0, 0, 255);
-            m_histogram.addSamples(color, 1);
+          if (rgba_geta(color) == 0)
+            continue;
+
+          color |= rgba(0, 0, 0, 255);
+          if (color != run_color || run_count == 0) {
+            if (run_count > 0)
+              histogram.addSamples(run_color, run_count);
+            run_color = color;
+            run_count = 0;
           }
+          ++run_count;
         }
       }
       break;
 
     case IMAGE_GRAYSCALE:
-      {
-        const LockImageBits<RgbTraits> bits(image);
-        LockImageBits<RgbTraits>::const_iterator it = bits.begin(), end = bits.end();
+      for (int y=y1; y<y2; ++y) {
+        const GrayscaleTraits::pixel_t* it = (GrayscaleTraits::address_t)image->getPixelAddress(0, y);
+        const GrayscaleTraits::pixel_t* end = it + image->width();
 
         for (; it != end; ++it) {
           color = *it;
-
-          if (graya_geta(color) > 0) {
-            color = graya_getv(color);
-            m_histogram.addSamples(rgba(color, color, color, 255), 1);
+          if (graya_geta(color) == 0)
+            continue;
+
+          color = graya_getv(color);
+          color = rgba(color, color, color, 255);
+          if (color != run_color || run_count == 0) {
+            if (run_count > 0)
+              histogram.addSamples(run_color, run_count);
+            run_color = color;
+            run_count = 0;
           }
+          ++run_count;
         }
       }
       break;
@@ -458,6 +631,44 @@ void PaletteOptimizer::feedWithImage(Image* image)
       break;
 
   }
+
+  if (run_count > 0)
+    histogram.addSamples(run_color, run_count);
+}
+
+void PaletteOptimizer::feedWithImage(Image* image)
+{
+  ASSERT(image);
+
+  // Small images are not worth the histograms of each band
+  const int minPixelsPerBand = 256*256;
+  int bands = std::min(base::thread_pool::global().workers()+1,
+                       image->width()*image->height() / minPixelsPerBand);
+  bands = std::min(bands, image->height());
+
+  if (bands <= 1) {
+    feed_histogram_with_rows(m_histogram, image, 0, image->height());
+    return;
+  }
+
+  // Each band is collected in its own histogram, then they are added
+  // in order (so the result is the same as feeding all rows in this
+  // thread).
+  std::vector<ColorHistogram<5, 6, 5> > histograms(bands);
+  base::thread_pool::global().parallel_for(
+    bands, [&histograms, image, bands](int i) {
+      feed_histogram_with_rows(histograms[i], image,
+                               image->height() * i / bands,
+                               image->height() * (i+1) / bands);
+    });
+
+  for (const auto& histogram : histograms)
+    m_histogram.addSamples(histogram);
+}
+
+void PaletteOptimizer::feedWithOptimizer(const PaletteOptimizer& other)
+{
+  m_histogram.addSamples(other.m_histogram);
 }
 
 void PaletteOptimizer::calculate(Palette* palette, bool has_background_layer)
@@ -468,7 +679,8 @@ void PaletteOptimizer::calculate(Palette* palette, bool has_background_layer)
   // Indexed).
   int first_usable_entry = (has_background_layer ? 0: 1);
   //int used_colors =
-  m_histogram.createOptimizedPalette(palette, first_usable_entry, palette->size()-1);
+  m_histogram.createOptimizedPalette(palette, first_usable_entry, palette->size()-1,
+                                     m_kmeansIterations, m_kmeansMsecs);
   //palette->resize(first_usable_entry+used_colors);   // TODO
 }
 
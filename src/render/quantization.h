@@ -28,11 +28,30 @@ namespace render {
 
  class PaletteOptimizer {
  public:
+   PaletteOptimizer() : m_kmeansIterations(0), m_kmeansMsecs(0) { }
+
+   // Refines the median-cut palette with up to "maxIterations" of
+   // k-means, stopping after "maxMsecs" (zero means no time limit).
+   // Disabled by default.
+   void setKMeansRefinement(int maxIterations, int maxMsecs) {
+     m_kmeansIterations = maxIterations;
+     m_kmeansMsecs = maxMsecs;
+   }
+
+   // Adds the colors of the image to the histogram. Big images are
+   // split in bands of rows processed in parallel.
    void feedWithImage(Image* image);
+
+   // Adds all colors fed to "other" (e.g. to collect the colors of
+   // different images in different threads).
+   void feedWithOptimizer(const PaletteOptimizer& other);
+
    void calculate(Palette* palette, bool has_background_layer);
 
   private:
     ColorHistogram<5, 6, 5> m_histogram;
+    int m_kmeansIterations;
+    int m_kmeansMsecs;
   };
 
   void create_palette_from_images(
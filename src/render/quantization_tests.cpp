@@ -0,0 +1,219 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "render/quantization.h"
+
+#include "base/unique_ptr.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/rgbmap.h"
+
+using namespace doc;
+using namespace render;
+
+// Creates a palette feeding the optimizer with the whole image (in
+// parallel bands) and another one feeding it row by row (each row
+// is too small to be split), both palettes must be equal.
+static void expect_same_palette_by_rows(const Image* image)
+{
+  PaletteOptimizer whole, rows;
+  whole.feedWithImage(const_cast<Image*>(image));
+
+  base::UniquePtr<Image> row(Image::create(image->pixelFormat(), image->width(), 1));
+  for (int y=0; y<image->height(); ++y) {
+    row->copy(image, gfx::Clip(0, 0, 0, y, image->width(), 1));
+    rows.feedWithImage(row);
+  }
+
+  Palette a(frame_t(0), 256), b(frame_t(0), 256);
+  whole.calculate(&a, false);
+  rows.calculate(&b, false);
+
+  EXPECT_EQ(0, a.countDiff(&b, NULL, NULL));
+}
+
+TEST(PaletteOptimizer, ParallelFeedWithManyColors)
+{
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 600, 600));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image, x, y, rgba((x*7) & 255, (y*3) & 255, (x+y) & 255,
+                                  (x % 13) == 0 ? 0: 255));
+
+  expect_same_palette_by_rows(image);
+}
+
+TEST(PaletteOptimizer, ParallelFeedWithFewColors)
+{
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 600, 600));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image, x, y, rgba(((x/40)*50) & 255, ((y/60)*20) & 255, 0, 255));
+
+  expect_same_palette_by_rows(image);
+}
+
+TEST(PaletteOptimizer, ParallelFeedGrayscale)
+{
+  base::UniquePtr<Image> image(Image::create(IMAGE_GRAYSCALE, 600, 600));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image, x, y, graya((x+y) & 255, (y % 5) == 0 ? 0: 255));
+
+  expect_same_palette_by_rows(image);
+}
+
+TEST(PaletteOptimizer, FeedWithOptimizer)
+{
+  base::UniquePtr<Image> image1(Image::create(IMAGE_RGB, 32, 32));
+  base::UniquePtr<Image> image2(Image::create(IMAGE_RGB, 32, 32));
+  for (int y=0; y<32; ++y)
+    for (int x=0; x<32; ++x) {
+      put_pixel(image1, x, y, rgba(x*8, y*8, 0, 255));
+      put_pixel(image2, x, y, rgba(0, x*8, y*8, 255));
+    }
+
+  PaletteOptimizer all, first, second;
+  all.feedWithImage(image1);
+  all.feedWithImage(image2);
+  first.feedWithImage(image1);
+  second.feedWithImage(image2);
+  first.feedWithOptimizer(second);
+
+  Palette a(frame_t(0), 256), b(frame_t(0), 256);
+  all.calculate(&a, true);
+  first.calculate(&b, true);
+
+  EXPECT_EQ(0, a.countDiff(&b, NULL, NULL));
+}
+
+// Sum of squared differences between each pixel and the nearest
+// palette entry (using the weights of Palette::findBestfit()).
+static double quantization_error(const Image* image, const Palette& palette)
+{
+  double error = 0.0;
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x) {
+      color_t c = get_pixel(image, x, y);
+      color_t p = palette.getEntry(
+        palette.findBestfit(rgba_getr(c), rgba_getg(c), rgba_getb(c), -1, 8));
+      double dr = rgba_getr(c) - rgba_getr(p);
+      double dg = rgba_getg(c) - rgba_getg(p);
+      double db = rgba_getb(c) - rgba_getb(p);
+      error += 30*30*dr*dr + 59*59*dg*dg + 11*11*db*db;
+    }
+  return error;
+}
+
+TEST(PaletteOptimizer, KMeansRefinement)
+{
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 256, 256));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image, x, y, rgba(x, (x*y/64) & 255, (255-y) ^ (x/16), 255));
+
+  PaletteOptimizer plain, refined;
+  plain.feedWithImage(image);
+  refined.feedWithImage(image);
+  refined.setKMeansRefinement(16, 0);
+
+  Palette a(frame_t(0), 32), b(frame_t(0), 32);
+  plain.calculate(&a, true);
+  refined.calculate(&b, true);
+
+  EXPECT_NE(0, a.countDiff(&b, NULL, NULL));
+  EXPECT_LT(quantization_error(image, b), quantization_error(image, a));
+}
+
+// Black & white palette (with a transparent entry at index 0)
+static void create_bw_palette(Palette& palette, RgbMap& rgbmap)
+{
+  palette.resize(3);
+  palette.setEntry(0, rgba(0, 0, 0, 255));
+  palette.setEntry(1, rgba(0, 0, 0, 255));
+  palette.setEntry(2, rgba(255, 255, 255, 255));
+  rgbmap.regenerate(&palette, 0);
+}
+
+TEST(Dithering, OrderedIsSplitInBands)
+{
+  Palette palette(frame_t(0), 3);
+  RgbMap rgbmap(8);
+  create_bw_palette(palette, rgbmap);
+
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 300, 300));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image, x, y, rgba(x*255/300, x*255/300, x*255/300,
+                                  (y % 7) == 0 ? 0: 255));
+
+  // The whole image (split in bands) is equal to the conversion of
+  // each row (where the dithering pattern is displaced to the row
+  // position).
+  base::UniquePtr<Image> whole(
+    convert_pixel_format(image, NULL, IMAGE_INDEXED,
+                         DitheringMethod::ORDERED, &rgbmap, &palette, false));
+
+  base::UniquePtr<Image> row(Image::create(IMAGE_RGB, image->width(), 8));
+  for (int y=0; y<image->height(); y+=8) {
+    row->copy(image, gfx::Clip(0, 0, 0, y, image->width(), 8));
+    base::UniquePtr<Image> rowResult(
+      convert_pixel_format(row, NULL, IMAGE_INDEXED,
+                           DitheringMethod::ORDERED, &rgbmap, &palette, false));
+
+    for (int v=0; v<8 && y+v<image->height(); ++v)
+      for (int x=0; x<image->width(); ++x)
+        ASSERT_EQ(get_pixel(whole, x, y+v), get_pixel(rowResult, x, v));
+  }
+}
+
+TEST(Dithering, ErrorDiffusion)
+{
+  Palette palette(frame_t(0), 3);
+  RgbMap rgbmap(8);
+  create_bw_palette(palette, rgbmap);
+
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 100, 300));
+  clear_image(image, rgba(128, 128, 128, 255));
+  put_pixel(image, 10, 10, rgba(0, 0, 0, 0));
+
+  base::UniquePtr<Image> a(
+    convert_pixel_format(image, NULL, IMAGE_INDEXED,
+                         DitheringMethod::ERROR_DIFFUSION, &rgbmap, &palette, false));
+  base::UniquePtr<Image> b(
+    convert_pixel_format(image, NULL, IMAGE_INDEXED,
+                         DitheringMethod::ERROR_DIFFUSION, &rgbmap, &palette, false));
+
+  // Deterministic
+  EXPECT_EQ(0, count_diff_between_images(a, b));
+
+  // Transparent pixel
+  EXPECT_EQ(0, get_pixel(a, 10, 10));
+
+  // Mid-gray is ~50% white in each pair of rows (even in the rows
+  // at the beginning of each band)
+  for (int y=0; y<a->height(); y+=2) {
+    int whites = 0;
+    for (int v=0; v<2; ++v)
+      for (int x=0; x<a->width(); ++x)
+        if (get_pixel(a, x, y+v) == 2)
+          ++whites;
+    EXPECT_NEAR(100, whites, 10) << "Rows " << y << "-" << y+1;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -10,17 +10,43 @@
 
 #include "render/render.h"
 
+#include "render/content_cache.h"
+#include "render/layers_cache.h"
+#include "render/mipmap_cache.h"
+#include "render/onionskin_cache.h"
+#include "render/premultiplied_buffer.h"
+
 #include "doc/doc.h"
 #include "doc/handle_anidir.h"
+#include "doc/image_buffer_recycler.h"
+#include "base/thread_pool.h"
+#include "base/unique_ptr.h"
+#include "base/tracing.h"
 #include "gfx/clip.h"
 #include "gfx/region.h"
 
+#include <algorithm>
+#include <exception>
+#include <vector>
+
 namespace render {
 
+// Counters used by the performance HUD
+static base::tracing::counter layers_counter("render.layers");
+static base::tracing::counter pixels_counter("render.pixels");
+static base::tracing::counter layers_cache_hits_counter("render.layers_cache.hits");
+static base::tracing::counter layers_cache_misses_counter("render.layers_cache.misses");
+static base::tracing::counter onionskin_cache_hits_counter("render.onionskin_cache.hits");
+static base::tracing::counter onionskin_cache_misses_counter("render.onionskin_cache.misses");
+
 //////////////////////////////////////////////////////////////////////
 // Scaled composite
 
-template<class DstTraits, class SrcTraits>
+// The NormalMaxOpacity flag selects (at compile time) specialized
+// blenders for the normal blend mode with opacity = 255, which is the
+// most common case. They give exactly the same result as the generic
+// blenders, but copy opaque pixels directly.
+template<class DstTraits, class SrcTraits, bool NormalMaxOpacity = false>
 class BlenderHelper {
   BLEND_COLOR m_blend_color;
   color_t m_mask_color;
@@ -125,14 +151,180 @@ public:
   }
 };
 
+template<>
+class BlenderHelper<RgbTraits, RgbTraits> {
+  BLEND_COLOR m_blend_color;
+  BLEND_SPAN m_blend_span;
+  color_t m_mask_color;
+public:
+  BlenderHelper(const Image* src, const Palette* pal, int blend_mode)
+  {
+    m_blend_color = RgbTraits::get_blender(blend_mode);
+    m_blend_span = RgbTraits::get_span_blender(blend_mode);
+    m_mask_color = src->maskColor();
+  }
+  inline void operator()(RgbTraits::pixel_t& scanline,
+                         const RgbTraits::pixel_t& dst,
+                         const RgbTraits::pixel_t& src,
+                         int opacity)
+  {
+    if (src != m_mask_color)
+      scanline = (*m_blend_color)(dst, src, opacity);
+    else
+      scanline = dst;
+  }
+  inline void blendSpan(RgbTraits::pixel_t* dst,
+                        const RgbTraits::pixel_t* src,
+                        int n, int opacity)
+  {
+    (*m_blend_span)(dst, src, n, opacity, m_mask_color);
+  }
+};
+
+// Same result as rgba_blend_normal(back, front, 255): an opaque front
+// pixel (or any pixel over a transparent back) replaces the back.
+static inline color_t rgba_blend_normal_max_opacity(color_t back, color_t front)
+{
+  if ((front & rgba_a_mask) == rgba_a_mask || (back & rgba_a_mask) == 0)
+    return front;
+  else if ((front & rgba_a_mask) == 0)
+    return back;
+  else
+    return rgba_blend_normal(back, front, 255);
+}
+
+template<>
+class BlenderHelper<RgbTraits, RgbTraits, true> {
+  color_t m_mask_color;
+public:
+  BlenderHelper(const Image* src, const Palette* pal, int blend_mode)
+  {
+    ASSERT(blend_mode == BLEND_MODE_NORMAL);
+    m_mask_color = src->maskColor();
+  }
+  inline void operator()(RgbTraits::pixel_t& scanline,
+                         const RgbTraits::pixel_t& dst,
+                         const RgbTraits::pixel_t& src,
+                         int opacity)
+  {
+    if (src != m_mask_color)
+      scanline = rgba_blend_normal_max_opacity(dst, src);
+    else
+      scanline = dst;
+  }
+  // Copies runs of opaque pixels, and uses the span blender for the
+  // rest of pixels.
+  inline void blendSpan(RgbTraits::pixel_t* dst,
+                        const RgbTraits::pixel_t* src,
+                        int n, int opacity)
+  {
+    ASSERT(opacity == 255);
+    int i = 0;
+    while (i < n) {
+      int j = i;
+      while (j < n && isOpaque(src[j])) ++j;
+      std::copy(src+i, src+j, dst+i);
+
+      i = j;
+      while (j < n && !isOpaque(src[j])) ++j;
+      if (j > i)
+        rgba_blend_span_normal(dst+i, src+i, j-i, 255, m_mask_color);
+      i = j;
+    }
+  }
+private:
+  inline bool isOpaque(RgbTraits::pixel_t c) const {
+    return ((c & rgba_a_mask) == rgba_a_mask && c != m_mask_color);
+  }
+};
+
+template<>
+class BlenderHelper<RgbTraits, IndexedTraits, true> {
+  const Palette* m_pal;
+  color_t m_mask_color;
+public:
+  BlenderHelper(const Image* src, const Palette* pal, int blend_mode)
+  {
+    ASSERT(blend_mode == BLEND_MODE_NORMAL);
+    m_mask_color = src->maskColor();
+    m_pal = pal;
+  }
+  inline void operator()(RgbTraits::pixel_t& scanline,
+                         const RgbTraits::pixel_t& dst,
+                         const IndexedTraits::pixel_t& src,
+                         int opacity)
+  {
+    if (src != m_mask_color)
+      scanline = rgba_blend_normal_max_opacity(dst, m_pal->getEntry(src));
+    else
+      scanline = dst;
+  }
+};
+
+// Pixel formats with a BlenderHelper<DstTraits, SrcTraits, true>
+// specialization.
 template<class DstTraits, class SrcTraits>
+struct HasNormalMaxOpacityBlender { static const bool value = false; };
+template<>
+struct HasNormalMaxOpacityBlender<RgbTraits, RgbTraits> { static const bool value = true; };
+template<>
+struct HasNormalMaxOpacityBlender<RgbTraits, IndexedTraits> { static const bool value = true; };
+
+// Blends "n" src pixels over "n" dst pixels (in place).
+template<class DstTraits, class SrcTraits, bool NormalMaxOpacity>
+static inline void blend_span(BlenderHelper<DstTraits, SrcTraits, NormalMaxOpacity>& blender,
+                              typename DstTraits::pixel_t* dst,
+                              const typename SrcTraits::pixel_t* src,
+                              int n, int opacity)
+{
+  for (int i=0; i<n; ++i)
+    blender(dst[i], dst[i], src[i], opacity);
+}
+
+// RGB over RGB uses the rgba_span_blenders (one call per span).
+static inline void blend_span(BlenderHelper<RgbTraits, RgbTraits>& blender,
+                              RgbTraits::pixel_t* dst,
+                              const RgbTraits::pixel_t* src,
+                              int n, int opacity)
+{
+  blender.blendSpan(dst, src, n, opacity);
+}
+
+static inline void blend_span(BlenderHelper<RgbTraits, RgbTraits, true>& blender,
+                              RgbTraits::pixel_t* dst,
+                              const RgbTraits::pixel_t* src,
+                              int n, int opacity)
+{
+  blender.blendSpan(dst, src, n, opacity);
+}
+
+template<class DstTraits, class SrcTraits, bool NormalMaxOpacity>
+static void compose_image_without_zoom(
+  Image* dst, const Image* src, const Palette* pal,
+  gfx::Clip area,
+  int opacity, int blend_mode)
+{
+  BlenderHelper<DstTraits, SrcTraits, NormalMaxOpacity> blender(src, pal, blend_mode);
+
+  if (!area.clip(dst->width(), dst->height(), src->width(), src->height()))
+    return;
+
+  for (int y=0; y<area.size.h; ++y) {
+    blend_span(
+      blender,
+      (typename DstTraits::pixel_t*)dst->getPixelAddress(area.dst.x, area.dst.y+y),
+      (const typename SrcTraits::pixel_t*)src->getPixelAddress(area.src.x, area.src.y+y),
+      area.size.w, opacity);
+  }
+}
+
+template<class DstTraits, class SrcTraits, bool NormalMaxOpacity>
 static void compose_scaled_image_scale_up(
   Image* dst, const Image* src, const Palette* pal,
   gfx::Clip area,
   int opacity, int blend_mode, Zoom zoom)
 {
-  BlenderHelper<DstTraits, SrcTraits> blender(src, pal, blend_mode);
-  int px_x, px_y;
+  BlenderHelper<DstTraits, SrcTraits, NormalMaxOpacity> blender(src, pal, blend_mode);
 
   if (!area.clip(dst->width(), dst->height(),
       zoom.apply(src->width()),
@@ -146,7 +338,6 @@ static void compose_scaled_image_scale_up(
   gfx::Rect srcBounds = zoom.remove(area.srcBounds());
   gfx::Rect dstBounds = area.dstBounds();
   int bottom = area.dst.y+area.size.h-1;
-  int line_h;
 
   if ((area.src.x+area.size.w) % px_w > 0) ++srcBounds.w;
   if ((area.src.y+area.size.h) % px_h > 0) ++srcBounds.h;
@@ -154,111 +345,59 @@ static void compose_scaled_image_scale_up(
   if (srcBounds.isEmpty())
     return;
 
-  // the scanline variable is used to blend src/dst pixels one time for each pixel
-  typedef std::vector<typename DstTraits::pixel_t> Scanline;
-  Scanline scanline(srcBounds.w);
-  typename Scanline::iterator scanline_it;
-#ifdef _DEBUG
-  typename Scanline::iterator scanline_end = scanline.end();
-#endif
-
-  // Lock all necessary bits
-  const LockImageBits<SrcTraits> srcBits(src, srcBounds);
-  LockImageBits<DstTraits> dstBits(dst, dstBounds);
-  typename LockImageBits<SrcTraits>::const_iterator src_it = srcBits.begin();
-#ifdef _DEBUG
-  typename LockImageBits<SrcTraits>::const_iterator src_end = srcBits.end();
-#endif
-  typename LockImageBits<DstTraits>::iterator dst_it, dst_end;
+  // The scanline variable is used to blend src/dst pixels one time
+  // for each 'src' pixel
+  typedef typename DstTraits::pixel_t dst_pixel_t;
+  std::vector<dst_pixel_t> scanline(srcBounds.w);
+  int w = dstBounds.w;
 
   // For each line to draw of the source image...
-  dstBounds.h = 1;
   for (int y=0; y<srcBounds.h; ++y) {
-    dst_it = dstBits.begin_area(dstBounds);
-    dst_end = dstBits.end_area(dstBounds);
-
-    // Read 'src' and 'dst' and blend them, put the result in `scanline'
-    scanline_it = scanline.begin();
-    for (int x=0; x<srcBounds.w; ++x) {
-      ASSERT(src_it >= srcBits.begin() && src_it < src_end);
-      ASSERT(dst_it >= dstBits.begin() && dst_it < dst_end);
-      ASSERT(scanline_it >= scanline.begin() && scanline_it < scanline_end);
-
-      blender(*scanline_it, *dst_it, *src_it, opacity);
-      ++src_it;
-
-      int delta;
-      if (x == 0)
-        delta = first_px_w;
-      else
-        delta = px_w;
-
-      while (dst_it != dst_end && delta-- > 0)
-        ++dst_it;
-
-      ++scanline_it;
+    dst_pixel_t* dst_row = (dst_pixel_t*)dst->getPixelAddress(dstBounds.x, dstBounds.y);
+
+    // Read 'dst' pixels (one for each 'src' pixel) in `scanline'
+    dst_pixel_t dst_pixel = dst_row[0];
+    for (int x=0, offset=0; x<srcBounds.w; ++x) {
+      if (offset < w)
+        dst_pixel = dst_row[offset];
+      scanline[x] = dst_pixel;
+      offset += (x == 0 ? first_px_w: px_w);
     }
 
-    // Get the 'height' of the line to be painted in 'dst'
-    if ((y == 0) && (first_px_h > 0))
-      line_h = first_px_h;
-    else
-      line_h = px_h;
-
-    // Draw the line in 'dst'
-    for (px_y=0; px_y<line_h; ++px_y) {
-      dst_it = dstBits.begin_area(dstBounds);
-      dst_end = dstBits.end_area(dstBounds);
-      scanline_it = scanline.begin();
-
-      int x = 0;
+    // Blend the 'src' line in `scanline'
+    blend_span(
+      blender, &scanline[0],
+      (const typename SrcTraits::pixel_t*)src->getPixelAddress(srcBounds.x, srcBounds.y+y),
+      srcBounds.w, opacity);
 
-      // first pixel
-      for (px_x=0; px_x<first_px_w; ++px_x) {
-        ASSERT(scanline_it != scanline_end);
-        ASSERT(dst_it != dst_end);
+    // Draw the first line in 'dst' replicating each pixel
+    // horizontally
+    std::fill_n(dst_row, MIN(first_px_w, w), scanline[0]);
+    for (int x=1, offset=first_px_w; x<srcBounds.w && offset<w; ++x, offset+=px_w)
+      std::fill_n(dst_row+offset, MIN(px_w, w-offset), scanline[x]);
 
-        *dst_it = *scanline_it;
-
-        ++dst_it;
-        if (dst_it == dst_end)
-          goto done_with_line;
-      }
-
-      ++scanline_it;
-      ++x;
-
-      // the rest of the line
-      for (; x<srcBounds.w; ++x) {
-        for (px_x=0; px_x<px_w; ++px_x) {
-          ASSERT(dst_it !=  dst_end);
-
-          *dst_it = *scanline_it;
-
-          ++dst_it;
-          if (dst_it == dst_end)
-            goto done_with_line;
-        }
-
-        ++scanline_it;
-      }
+    // Get the 'height' of the line to be painted in 'dst'
+    int line_h = (y == 0 ? first_px_h: px_h);
 
-done_with_line:;
-      if (++dstBounds.y > bottom)
-        goto done_with_blit;
+    // Copy the first line in the rest of lines
+    for (int px_y=1; px_y<line_h && dstBounds.y+px_y <= bottom; ++px_y) {
+      std::copy(dst_row, dst_row+w,
+                (dst_pixel_t*)dst->getPixelAddress(dstBounds.x, dstBounds.y+px_y));
     }
-  }
 
-done_with_blit:;
+    dstBounds.y += line_h;
+    if (dstBounds.y > bottom)
+      break;
+  }
 }
 
-template<class DstTraits, class SrcTraits>
+template<class DstTraits, class SrcTraits, bool NormalMaxOpacity>
 static void compose_scaled_image_scale_down(
   Image* dst, const Image* src, const Palette* pal,
   gfx::Clip area,
   int opacity, int blend_mode, Zoom zoom)
 {
-  BlenderHelper<DstTraits, SrcTraits> blender(src, pal, blend_mode);
+  BlenderHelper<DstTraits, SrcTraits, NormalMaxOpacity> blender(src, pal, blend_mode);
   int unbox_w = zoom.remove(1);
   int unbox_h = zoom.remove(1);
 
@@ -274,51 +413,67 @@ static void compose_scaled_image_scale_down(
   if (srcBounds.isEmpty())
     return;
 
-  // Lock all necessary bits
-  const LockImageBits<SrcTraits> srcBits(src, srcBounds);
-  LockImageBits<DstTraits> dstBits(dst, dstBounds);
-  typename LockImageBits<SrcTraits>::const_iterator src_it = srcBits.begin();
-  typename LockImageBits<SrcTraits>::const_iterator src_end = srcBits.end();
-  typename LockImageBits<DstTraits>::iterator dst_it, dst_end;
+  // Number of pixels to draw in each 'dst' line
+  int w = MIN(dstBounds.w, (srcBounds.w + unbox_w - 1) / unbox_w);
+  if (w <= 0)
+    return;
+
+  // The scanline contains the 'src' pixels to be blended in each line
+  typedef std::vector<typename SrcTraits::pixel_t> Scanline;
+  Scanline scanline(w);
 
   // For each line to draw of the source image...
-  dstBounds.h = 1;
   for (int y=0; y<srcBounds.h; y+=unbox_h) {
-    dst_it = dstBits.begin_area(dstBounds);
-    dst_end = dstBits.end_area(dstBounds);
-
-    for (int x=0; x<srcBounds.w; x+=unbox_w) {
-      ASSERT(src_it >= srcBits.begin() && src_it < src_end);
-      ASSERT(dst_it >= dstBits.begin() && dst_it < dst_end);
+    const typename SrcTraits::pixel_t* src_ptr =
+      (const typename SrcTraits::pixel_t*)src->getPixelAddress(srcBounds.x, srcBounds.y+y);
 
-      blender(*dst_it, *dst_it, *src_it, opacity);
+    // Pick one 'src' pixel of each box
+    for (int x=0; x<w; ++x, src_ptr+=unbox_w)
+      scanline[x] = *src_ptr;
 
-      // Skip source pixels
-      for (int delta=0; delta < unbox_w && src_it != src_end; ++delta)
-        ++src_it;
-
-      ++dst_it;
-    }
+    blend_span(
+      blender,
+      (typename DstTraits::pixel_t*)dst->getPixelAddress(dstBounds.x, dstBounds.y),
+      &scanline[0], w, opacity);
 
     if (++dstBounds.y > bottom)
       break;
-
-    // Skip lines
-    for (int delta=0; delta < srcBounds.w * (unbox_h-1) && src_it != src_end; ++delta)
-      ++src_it;
   }
 }
 
+template<class DstTraits, class SrcTraits, bool NormalMaxOpacity>
+static void compose_scaled_image_with_blender(
+  Image* dst, const Image* src, const Palette* pal,
+  const gfx::Clip& area,
+  int opacity, int blend_mode, Zoom zoom)
+{
+  if (zoom.scale() == 1.0)
+    compose_image_without_zoom<DstTraits, SrcTraits, NormalMaxOpacity>(dst, src, pal, area, opacity, blend_mode);
+  else if (zoom.scale() >= 1.0)
+    compose_scaled_image_scale_up<DstTraits, SrcTraits, NormalMaxOpacity>(dst, src, pal, area, opacity, blend_mode, zoom);
+  else
+    compose_scaled_image_scale_down<DstTraits, SrcTraits, NormalMaxOpacity>(dst, src, pal, area, opacity, blend_mode, zoom);
+}
+
 template<class DstTraits, class SrcTraits>
 static void compose_scaled_image(
   Image* dst, const Image* src, const Palette* pal,
   const gfx::Clip& area,
   int opacity, int blend_mode, Zoom zoom)
 {
-  if (zoom.scale() >= 1.0)
-    compose_scaled_image_scale_up<DstTraits, SrcTraits>(dst, src, pal, area, opacity, blend_mode, zoom);
-  else
-    compose_scaled_image_scale_down<DstTraits, SrcTraits>(dst, src, pal, area, opacity, blend_mode, zoom);
+  const bool hasNormalMaxOpacity =
+    HasNormalMaxOpacityBlender<DstTraits, SrcTraits>::value;
+
+  if (hasNormalMaxOpacity &&
+      blend_mode == BLEND_MODE_NORMAL &&
+      opacity == 255) {
+    compose_scaled_image_with_blender<DstTraits, SrcTraits, hasNormalMaxOpacity>(
+      dst, src, pal, area, opacity, blend_mode, zoom);
+  }
+  else {
+    compose_scaled_image_with_blender<DstTraits, SrcTraits, false>(
+      dst, src, pal, area, opacity, blend_mode, zoom);
+  }
 }
 
 Render::Render()
@@ -328,13 +483,25 @@ Render::Render()
   , m_extraType(ExtraType::NONE)
   , m_extraCel(NULL)
   , m_extraImage(NULL)
+  , m_extraBlendMode(BLEND_MODE_NORMAL)
   , m_bgType(BgType::TRANSPARENT)
+  , m_bgZoom(false)
+  , m_bgColor1(0)
+  , m_bgColor2(0)
   , m_bgCheckedSize(16, 16)
   , m_globalOpacity(255)
   , m_selectedLayer(nullptr)
   , m_selectedFrame(-1)
   , m_previewImage(nullptr)
   , m_onionskin(OnionskinType::NONE)
+  , m_tiledRendering(true)
+  , m_layersCache(nullptr)
+  , m_cacheActiveLayer(nullptr)
+  , m_soloLayer(nullptr)
+  , m_layersFilter(LayersFilter::ALL)
+  , m_mipmapCache(nullptr)
+  , m_contentCache(nullptr)
+  , m_onionskinCache(nullptr)
 {
 }
 
@@ -405,6 +572,43 @@ void Render::disableOnionskin()
   m_onionskin.type(OnionskinType::NONE);
 }
 
+void Render::setTiledRendering(bool state)
+{
+  m_tiledRendering = state;
+}
+
+void Render::setSoloLayer(const Layer* layer)
+{
+  m_soloLayer = layer;
+}
+
+void Render::setLayersCache(LayersCache* cache, const Layer* activeLayer)
+{
+  m_layersCache = cache;
+  m_cacheActiveLayer = activeLayer;
+}
+
+void Render::removeLayersCache()
+{
+  m_layersCache = nullptr;
+  m_cacheActiveLayer = nullptr;
+}
+
+void Render::setMipmapCache(MipmapCache* cache)
+{
+  m_mipmapCache = cache;
+}
+
+void Render::setContentCache(ContentCache* cache)
+{
+  m_contentCache = cache;
+}
+
+void Render::setOnionskinCache(OnionskinCache* cache)
+{
+  m_onionskinCache = cache;
+}
+
 void Render::renderSprite(
   Image* dstImage,
   const Sprite* sprite,
@@ -476,7 +680,7 @@ void Render::renderSprite(
     switch (dstImage->pixelFormat()) {
       case IMAGE_RGB:
       case IMAGE_GRAYSCALE:
-        if (bgLayer && bgLayer->isVisible())
+        if (bgLayer && isLayerVisible(bgLayer))
           bg_color = m_sprite->palette(frame)->getEntry(m_sprite->transparentColor());
         break;
       case IMAGE_INDEXED:
@@ -489,7 +693,7 @@ void Render::renderSprite(
   switch (m_bgType) {
 
     case BgType::CHECKED:
-      if (bgLayer && bgLayer->isVisible())
+      if (bgLayer && isLayerVisible(bgLayer))
         fill_rect(dstImage, area.dstBounds(), bg_color);
       else
         renderBackground(dstImage, area, zoom);
@@ -500,63 +704,768 @@ void Render::renderSprite(
       break;
   }
 
+  // Draw the layers below the active layer from the cache
+  bool fromActiveLayer =
+    (m_layersCache &&
+     renderLayersCache(dstImage, frame, area, zoom, bg_color,
+                       (m_bgType == BgType::CHECKED &&
+                        !(bgLayer && isLayerVisible(bgLayer)))));
+
+  // Composite the frames of the onion skin (before the area is split
+  // in tiles, because the cache isn't thread-safe)
+  m_onionskinImages.clear();
+  if (m_onionskinCache) {
+    if (m_onionskin.type() != OnionskinType::NONE &&
+        dstImage->pixelFormat() == IMAGE_RGB)
+      prepareOnionskinCache(frame);
+    else
+      m_onionskinCache->clear();
+  }
+
+  // Split big areas in tiles that are rendered in parallel. Each
+  // tile is rendered with its own copy of this Render instance
+  // because the onion skin changes m_globalOpacity. The background
+  // is drawn above for the whole area because the checked pattern
+  // depends on the area origin.
+  base::thread_pool& pool = base::thread_pool::global();
+  if (m_tiledRendering && pool.workers() > 0) {
+    std::vector<gfx::Clip> tiles;
+    getRenderTiles(area, zoom, tiles);
+    if (tiles.size() > 1) {
+      pool.parallel_for(int(tiles.size()),
+        [this, dstImage, frame, zoom, scaled_func, fromActiveLayer, &tiles](int i){
+          Render tileRender(*this);
+          tileRender.renderSpriteArea(dstImage, frame, tiles[i],
+                                      zoom, scaled_func, fromActiveLayer);
+        });
+      return;
+    }
+  }
+
+  renderSpriteArea(dstImage, frame, area, zoom, scaled_func, fromActiveLayer);
+}
+
+void Render::renderSpriteArea(
+  Image* dstImage,
+  frame_t frame,
+  const gfx::Clip& area,
+  Zoom zoom,
+  RenderScaledImage scaled_func,
+  bool fromActiveLayer)
+{
   // Draw the current frame.
   m_globalOpacity = 255;
-  renderLayer(
-    m_sprite->folder(), dstImage,
-    area, frame, zoom, scaled_func,
-    true, true, -1);
+  m_layersFilter = (fromActiveLayer ? LayersFilter::FROM_ACTIVE:
+                                      LayersFilter::ALL);
+  if (!canRenderInIndexSpace(frame) ||
+      !renderLayersInIndexSpace(dstImage, frame, area, zoom)) {
+    renderLayer(
+      m_sprite->folder(), dstImage,
+      area, frame, zoom, scaled_func,
+      true, true, -1);
+  }
+  m_layersFilter = LayersFilter::ALL;
 
   // Onion-skin feature: Draw previous/next frames with different
   // opacity (<255)
   if (m_onionskin.type() != OnionskinType::NONE) {
-    FrameTag* loop = m_onionskin.loopTag();
-    frame_t frameIn;
-
-    for (frame_t frameOut = frame - m_onionskin.prevFrames();
-         frameOut <= frame + m_onionskin.nextFrames();
-         ++frameOut) {
-      if (loop) {
-        bool pingPongForward = true;
-        frameIn =
-          calculate_next_frame(m_sprite,
-                               frame, frameOut - frame,
-                               loop, pingPongForward);
+    std::vector<OnionskinFrame> frames;
+    getOnionskinFrames(frame, frames);
+
+    for (const OnionskinFrame& onionFrame : frames) {
+      m_globalOpacity = onionFrame.opacity;
+
+      // Blend the composited frame from the onion skin cache
+      ImageRef image = getOnionskinImage(onionFrame.frame);
+      if (image) {
+        gfx::Rect srcBounds =
+          area.srcBounds().createIntersection(
+            gfx::Rect(0, 0,
+                      zoom.apply(image->width()),
+                      zoom.apply(image->height())));
+        if (srcBounds.isEmpty())
+          continue;
+
+        RenderScaledImage rgb_func =
+          getRenderScaledImageFunc(dstImage->pixelFormat(), IMAGE_RGB);
+        (*rgb_func)(dstImage, image.get(),
+          m_sprite->palette(onionFrame.frame),
+          gfx::Clip(
+            area.dst.x + srcBounds.x - area.src.x,
+            area.dst.y + srcBounds.y - area.src.y,
+            srcBounds.x, srcBounds.y,
+            srcBounds.w, srcBounds.h),
+          m_globalOpacity, onionFrame.blendMode, zoom);
       }
       else {
-        frameIn = frameOut;
+        renderLayer(m_sprite->folder(), dstImage,
+          area, onionFrame.frame, zoom, scaled_func,
+          true, true, onionFrame.blendMode);
       }
+    }
+  }
+}
 
-      if (frameIn == frame ||
-          frameIn < 0 ||
-          frameIn > m_sprite->lastFrame()) {
-        continue;
-      }
+// Returns true if the layers of an indexed sprite can be composited
+// in an indexed image (where the top-most index that isn't the mask
+// color wins) and then converted to RGB, instead of blending each
+// layer in RGB. It's possible only if all visible cels are blended
+// with the normal blend mode at full opacity.
+bool Render::canRenderInIndexSpace(frame_t frame) const
+{
+  if (m_sprite->pixelFormat() != IMAGE_INDEXED ||
+      m_globalOpacity != 255)
+    return false;
+
+  if (m_previewImage &&
+      m_previewImage->pixelFormat() != IMAGE_INDEXED)
+    return false;
+
+  if (m_extraCel && m_extraImage &&
+      m_currentFrame == frame &&
+      m_extraType != ExtraType::NONE &&
+      (m_extraImage->pixelFormat() != IMAGE_INDEXED ||
+       m_extraCel->opacity() != 255 ||
+       m_extraBlendMode != BLEND_MODE_NORMAL))
+    return false;
+
+  return hasOnlyNormalCels(m_sprite->folder(), frame, true);
+}
+
+// Returns true if all visible cels of the layer (and its children)
+// use the normal blend mode (and full opacity if "opaque" is true).
+bool Render::hasOnlyNormalCels(const Layer* layer, frame_t frame, bool opaque) const
+{
+  if (!isLayerVisible(layer))
+    return true;
+
+  switch (layer->type()) {
+
+    case ObjectType::LayerImage: {
+      if (static_cast<const LayerImage*>(layer)->getBlendMode() != BLEND_MODE_NORMAL)
+        return false;
+
+      const Cel* cel = layer->cel(frame);
+      return (!cel || !opaque || cel->opacity() == 255);
+    }
+
+    case ObjectType::LayerFolder: {
+      LayerConstIterator it = static_cast<const LayerFolder*>(layer)->getLayerBegin();
+      LayerConstIterator end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
+      for (; it != end; ++it)
+        if (!hasOnlyNormalCels(*it, frame, opaque))
+          return false;
+      return true;
+    }
+
+  }
+
+  return false;
+}
+
+// Composites the layers of the frame in a temporary indexed image and
+// converts the result to RGB with the palette at the end (only the
+// indexes that aren't the mask color replace the pixels of the RGB
+// image). Returns false if the palette has translucent colors (so
+// the result wouldn't be the same as blending each layer in RGB).
+bool Render::renderLayersInIndexSpace(
+  Image* dstImage,
+  frame_t frame,
+  const gfx::Clip& area,
+  Zoom zoom)
+{
+  if (dstImage->pixelFormat() != IMAGE_RGB)
+    return false;
+
+  const Palette* pal = m_sprite->palette(frame);
+  const color_t maskColor = m_sprite->transparentColor();
+
+  color_t colors[256];
+  for (int i=0; i<256; ++i) {
+    if (i < pal->size()) {
+      colors[i] = pal->getEntry(i);
+      if (rgba_geta(colors[i]) != 255 && color_t(i) != maskColor)
+        return false;
+    }
+    else
+      colors[i] = 0;
+  }
+
+  gfx::Rect dstBounds = area.dstBounds().createIntersection(dstImage->bounds());
+  if (dstBounds.isEmpty())
+    return true;
+
+  ImageBufferPtr buffer = ImageBufferRecycler::global().getForImage(
+    IMAGE_INDEXED, dstBounds.w, dstBounds.h);
+  base::UniquePtr<Image> indexed(
+    Image::create(IMAGE_INDEXED, dstBounds.w, dstBounds.h, buffer));
+  indexed->setMaskColor(maskColor);
+  indexed->clear(maskColor);
+
+  renderLayer(
+    m_sprite->folder(), indexed.get(),
+    gfx::Clip(0, 0,
+              area.src.x + dstBounds.x - area.dst.x,
+              area.src.y + dstBounds.y - area.dst.y,
+              dstBounds.w, dstBounds.h),
+    frame, zoom,
+    getRenderScaledImageFunc(IMAGE_INDEXED, IMAGE_INDEXED),
+    true, true, -1);
+
+  for (int y=0; y<dstBounds.h; ++y) {
+    const IndexedTraits::pixel_t* src = (IndexedTraits::address_t)indexed->getPixelAddress(0, y);
+    RgbTraits::pixel_t* dst = (RgbTraits::address_t)dstImage->getPixelAddress(dstBounds.x, dstBounds.y+y);
+    for (int x=0; x<dstBounds.w; ++x) {
+      if (src[x] != maskColor)
+        dst[x] = colors[src[x]];
+    }
+  }
+
+  return true;
+}
+
+// Returns the frames that are displayed with the onion skin around
+// the given frame (in drawing order).
+void Render::getOnionskinFrames(frame_t frame,
+                                std::vector<OnionskinFrame>& frames) const
+{
+  FrameTag* loop = m_onionskin.loopTag();
+  frame_t frameIn;
+
+  for (frame_t frameOut = frame - m_onionskin.prevFrames();
+       frameOut <= frame + m_onionskin.nextFrames();
+       ++frameOut) {
+    if (loop) {
+      bool pingPongForward = true;
+      frameIn =
+        calculate_next_frame(m_sprite,
+                             frame, frameOut - frame,
+                             loop, pingPongForward);
+    }
+    else {
+      frameIn = frameOut;
+    }
+
+    if (frameIn == frame ||
+        frameIn < 0 ||
+        frameIn > m_sprite->lastFrame()) {
+      continue;
+    }
+
+    int opacity;
+    if (frameOut < frame) {
+      opacity = m_onionskin.opacityBase() - m_onionskin.opacityStep() * ((frame - frameOut)-1);
+    }
+    else {
+      opacity = m_onionskin.opacityBase() - m_onionskin.opacityStep() * ((frameOut - frame)-1);
+    }
 
-      if (frameOut < frame) {
-        m_globalOpacity = m_onionskin.opacityBase() - m_onionskin.opacityStep() * ((frame - frameOut)-1);
+    if (opacity > 0) {
+      OnionskinFrame onionFrame;
+      onionFrame.frame = frameIn;
+      onionFrame.opacity = MID(0, opacity, 255);
+      onionFrame.blendMode = -1;
+      if (m_onionskin.type() == OnionskinType::MERGE)
+        onionFrame.blendMode = BLEND_MODE_NORMAL;
+      else if (m_onionskin.type() == OnionskinType::RED_BLUE_TINT)
+        onionFrame.blendMode = (frameOut < frame ? BLEND_MODE_RED_TINT: BLEND_MODE_BLUE_TINT);
+      frames.push_back(onionFrame);
+    }
+  }
+}
+
+// Returns the first multiple of "tile" greater than "x".
+static inline int next_tile_edge(int x, int tile)
+{
+  int n = (x >= 0 ? x / tile: -((-x-1) / tile) - 1);
+  return (n+1) * tile;
+}
+
+// Splits the given area in tiles of (approximately) kTileSize x
+// kTileSize pixels. Tile edges are aligned to the zoomed pixel grid
+// of the sprite (in "area.src" coordinates), so each tile produces
+// exactly the same pixels as rendering the whole area at once.
+void Render::getRenderTiles(
+  const gfx::Clip& area,
+  Zoom zoom,
+  std::vector<gfx::Clip>& tiles)
+{
+  const int kTileSize = 256;
+
+  if (area.size.w <= 0 || area.size.h <= 0)
+    return;
+
+  int px = MAX(1, zoom.apply(1));
+  int tile = ((kTileSize + px - 1) / px) * px;
+
+  int x2 = area.src.x + area.size.w;
+  int y2 = area.src.y + area.size.h;
+
+  for (int v=area.src.y; v<y2; ) {
+    int v2 = MIN(y2, next_tile_edge(v, tile));
+
+    for (int u=area.src.x; u<x2; ) {
+      int u2 = MIN(x2, next_tile_edge(u, tile));
+
+      tiles.push_back(
+        gfx::Clip(area.dst.x + u - area.src.x,
+                  area.dst.y + v - area.src.y,
+                  u, v, u2-u, v2-v));
+      u = u2;
+    }
+    v = v2;
+  }
+}
+
+// Collects the image layers below "activeLayer" (in rendering
+// order) and the IDs/versions that identify their content in the
+// given frame. Returns true if "activeLayer" was found.
+static bool collect_below_layers(const LayerFolder* folder,
+                                 const Layer* activeLayer,
+                                 bool visible,
+                                 frame_t frame,
+                                 std::vector<const Layer*>& layers,
+                                 std::vector<int>& key)
+{
+  LayerConstIterator it = folder->getLayerBegin();
+  LayerConstIterator end = folder->getLayerEnd();
+
+  for (; it != end; ++it) {
+    const Layer* layer = *it;
+    if (layer == activeLayer)
+      return true;
+
+    bool layerVisible = (visible && layer->isVisible());
+
+    switch (layer->type()) {
+
+      case ObjectType::LayerImage: {
+        const Cel* cel = layer->cel(frame);
+        layers.push_back(layer);
+        key.push_back(layer->id());
+        key.push_back(layerVisible ? 1: 0);
+        key.push_back(cel ? cel->id(): 0);
+        key.push_back(cel && cel->image() ? cel->image()->id(): 0);
+        key.push_back(cel && cel->image() ? cel->image()->version(): 0);
+        key.push_back(cel ? cel->x(): 0);
+        key.push_back(cel ? cel->y(): 0);
+        key.push_back(cel ? cel->opacity(): 0);
+        break;
       }
-      else {
-        m_globalOpacity = m_onionskin.opacityBase() - m_onionskin.opacityStep() * ((frameOut - frame)-1);
+
+      case ObjectType::LayerFolder:
+        key.push_back(layer->id());
+        if (collect_below_layers(static_cast<const LayerFolder*>(layer),
+                                 activeLayer, layerVisible, frame,
+                                 layers, key))
+          return true;
+        break;
+    }
+  }
+  return false;
+}
+
+void Render::getRenderKey(const Sprite* sprite, frame_t frame,
+                          std::vector<int>& key) const
+{
+  key.clear();
+  key.push_back(sprite->id());
+  key.push_back(sprite->version());
+  key.push_back(int(sprite->pixelFormat()));
+  key.push_back(sprite->width());
+  key.push_back(sprite->height());
+  key.push_back(int(sprite->transparentColor()));
+  key.push_back(frame);
+
+  const Palette* pal = sprite->palette(frame);
+  key.push_back(pal->id());
+  key.push_back(pal->version());
+
+  key.push_back(int(m_bgType));
+  key.push_back(m_bgZoom ? 1: 0);
+  key.push_back(int(m_bgColor1));
+  key.push_back(int(m_bgColor2));
+  key.push_back(m_bgCheckedSize.w);
+  key.push_back(m_bgCheckedSize.h);
+
+  key.push_back(int(m_extraType));
+  if (m_extraType != ExtraType::NONE) {
+    key.push_back(m_extraCel ? m_extraCel->id(): 0);
+    key.push_back(m_extraCel ? m_extraCel->x(): 0);
+    key.push_back(m_extraCel ? m_extraCel->y(): 0);
+    key.push_back(m_extraCel ? m_extraCel->opacity(): 0);
+    key.push_back(m_extraImage ? m_extraImage->id(): 0);
+    key.push_back(m_extraImage ? m_extraImage->version(): 0);
+    key.push_back(m_extraBlendMode);
+    key.push_back(m_currentLayer ? m_currentLayer->id(): 0);
+    key.push_back(m_currentFrame);
+  }
+
+  key.push_back(m_soloLayer ? m_soloLayer->id(): 0);
+
+  key.push_back(m_previewImage ? m_previewImage->id(): 0);
+  if (m_previewImage) {
+    key.push_back(m_previewImage->version());
+    key.push_back(m_selectedLayer ? m_selectedLayer->id(): 0);
+    key.push_back(m_selectedFrame);
+  }
+
+  // All frames that can be rendered with the onion skin (without
+  // the loop tag, frames outside the tag are included anyway)
+  frame_t fromFrame = frame;
+  frame_t toFrame = frame;
+  key.push_back(int(m_onionskin.type()));
+  if (m_onionskin.type() != OnionskinType::NONE) {
+    key.push_back(m_onionskin.prevFrames());
+    key.push_back(m_onionskin.nextFrames());
+    key.push_back(m_onionskin.opacityBase());
+    key.push_back(m_onionskin.opacityStep());
+    key.push_back(m_onionskin.loopTag() ? m_onionskin.loopTag()->id(): 0);
+    if (m_onionskin.loopTag()) {
+      key.push_back(m_onionskin.loopTag()->fromFrame());
+      key.push_back(m_onionskin.loopTag()->toFrame());
+      key.push_back(int(m_onionskin.loopTag()->aniDir()));
+      fromFrame = 0;
+      toFrame = sprite->lastFrame();
+    }
+    else {
+      fromFrame = MAX(0, frame - m_onionskin.prevFrames());
+      toFrame = MIN(sprite->lastFrame(), frame + m_onionskin.nextFrames());
+    }
+  }
+
+  std::vector<const Layer*> layers;
+  for (frame_t f=fromFrame; f<=toFrame; ++f)
+    collect_below_layers(sprite->folder(), nullptr, true, f, layers, key);
+}
+
+// Fills "key" with the IDs/versions of everything that modifies the
+// composition of all layers of the given frame.
+static void get_frame_key(const Sprite* sprite, frame_t frame,
+                          std::vector<int>& key)
+{
+  key.clear();
+  key.push_back(sprite->id());
+  key.push_back(sprite->version());
+  key.push_back(int(sprite->pixelFormat()));
+  key.push_back(sprite->width());
+  key.push_back(sprite->height());
+  key.push_back(int(sprite->transparentColor()));
+
+  const Palette* pal = sprite->palette(frame);
+  key.push_back(pal->id());
+  key.push_back(pal->version());
+
+  std::vector<const Layer*> layers;
+  collect_below_layers(sprite->folder(), nullptr, true, frame, layers, key);
+}
+
+// Updates the onion skin cache with the composition of all layers of
+// each frame displayed around the given frame. Modified frames are
+// rendered again (in parallel).
+void Render::prepareOnionskinCache(frame_t frame)
+{
+  std::vector<OnionskinFrame> frames;
+  getOnionskinFrames(frame, frames);
+
+  std::size_t imageBytes =
+    std::size_t(m_sprite->width()) * m_sprite->height() * 4;
+  std::size_t maxEntries =
+    (imageBytes > 0 ? m_onionskinCache->maxBytes() / imageBytes: 0);
+
+  std::vector<OnionskinCache::Entry> entries;
+  std::vector<int> modified;    // Entries to be rendered again
+  for (const OnionskinFrame& onionFrame : frames) {
+    if (entries.size() >= maxEntries)
+      break;
+
+    // The preview image is displayed in one frame only, so that frame
+    // cannot be cached (it's rendered layer by layer).
+    if (m_previewImage && m_selectedFrame == onionFrame.frame)
+      continue;
+
+    auto it = std::find_if(entries.begin(), entries.end(),
+      [&onionFrame](const OnionskinCache::Entry& e) {
+        return e.frame == onionFrame.frame;
+      });
+    if (it != entries.end())
+      continue;
+
+    OnionskinCache::Entry entry;
+    entry.frame = onionFrame.frame;
+    get_frame_key(m_sprite, entry.frame, entry.key);
+
+    it = std::find_if(m_onionskinCache->m_entries.begin(),
+                      m_onionskinCache->m_entries.end(),
+      [&entry](const OnionskinCache::Entry& e) {
+        return e.frame == entry.frame;
+      });
+    if (it != m_onionskinCache->m_entries.end() && it->key == entry.key) {
+      entry.image = it->image;
+      onionskin_cache_hits_counter.add(1);
+    }
+    else {
+      modified.push_back(int(entries.size()));
+      onionskin_cache_misses_counter.add(1);
+    }
+
+    entries.push_back(entry);
+  }
+
+  if (!modified.empty()) {
+    // Renders the whole frame (all layers, without the extra cel and
+    // with full opacity)
+    Render frameRender(*this);
+    frameRender.m_onionskin = OnionskinOptions(OnionskinType::NONE);
+    frameRender.m_onionskinCache = nullptr;
+    frameRender.m_onionskinImages.clear();
+    frameRender.m_layersCache = nullptr;
+    frameRender.m_cacheActiveLayer = nullptr;
+    frameRender.m_extraType = ExtraType::NONE;
+    frameRender.m_extraCel = nullptr;
+    frameRender.m_extraImage = nullptr;
+    frameRender.m_previewImage = nullptr;
+    frameRender.m_globalOpacity = 255;
+
+    RenderScaledImage scaled_func =
+      getRenderScaledImageFunc(IMAGE_RGB, m_sprite->pixelFormat());
+
+    std::vector<std::exception_ptr> errors(modified.size());
+    base::thread_pool::global().parallel_for(int(modified.size()),
+      [this, &frameRender, scaled_func, &entries, &modified, &errors](int i){
+        try {
+          OnionskinCache::Entry& entry = entries[modified[i]];
+          Render render(frameRender);
+          ImageRef image(Image::create(IMAGE_RGB,
+                                       m_sprite->width(),
+                                       m_sprite->height()));
+          if (!render.renderFramePremultiplied(image.get(), entry.frame)) {
+            clear_image(image.get(), 0);
+            render.renderLayer(m_sprite->folder(), image.get(),
+                               gfx::Clip(m_sprite->bounds()),
+                               entry.frame, Zoom(1, 1), scaled_func,
+                               true, true, -1);
+          }
+          entry.image = image;
+        }
+        catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+
+    for (const std::exception_ptr& error : errors) {
+      if (error) {
+        m_onionskinCache->clear();
+        std::rethrow_exception(error);
       }
+    }
+  }
 
-      if (m_globalOpacity > 0) {
-        m_globalOpacity = MID(0, m_globalOpacity, 255);
+  // Frames that aren't displayed anymore are removed from the cache
+  m_onionskinCache->m_entries = entries;
 
-        int blend_mode = -1;
-        if (m_onionskin.type() == OnionskinType::MERGE)
-          blend_mode = BLEND_MODE_NORMAL;
-        else if (m_onionskin.type() == OnionskinType::RED_BLUE_TINT)
-          blend_mode = (frameOut < frame ? BLEND_MODE_RED_TINT: BLEND_MODE_BLUE_TINT);
+  for (const OnionskinCache::Entry& entry : entries)
+    m_onionskinImages.push_back(std::make_pair(entry.frame, entry.image));
+}
 
-        renderLayer(m_sprite->folder(), dstImage,
-          area, frameIn, zoom, scaled_func,
-          true, true, blend_mode);
+// Composites all layers of the frame (over a transparent image) in a
+// PremultipliedBuffer, which is faster than blending each layer with
+// straight alpha when there are several translucent layers. Returns
+// false if a layer uses a blend mode other than the normal one.
+bool Render::renderFramePremultiplied(Image* dstImage, frame_t frame)
+{
+  if (dstImage->pixelFormat() != IMAGE_RGB ||
+      dstImage->width() != m_sprite->width() ||
+      dstImage->height() != m_sprite->height() ||
+      !hasOnlyNormalCels(m_sprite->folder(), frame, false))
+    return false;
+
+  PremultipliedBuffer buffer(dstImage->width(), dstImage->height());
+  renderLayerPremultiplied(m_sprite->folder(), buffer, frame);
+  buffer.copyToImage(dstImage);
+  return true;
+}
+
+void Render::renderLayerPremultiplied(const Layer* layer,
+                                      PremultipliedBuffer& buffer,
+                                      frame_t frame)
+{
+  if (!isLayerVisible(layer))
+    return;
+
+  switch (layer->type()) {
+
+    case ObjectType::LayerImage: {
+      const Cel* cel = layer->cel(frame);
+      if (cel && cel->image()) {
+        int t, opacity = MID(0, cel->opacity(), 255);
+        opacity = INT_MULT(opacity, m_globalOpacity, t);
+
+        layers_counter.add(1);
+        pixels_counter.add(cel->image()->width() * cel->image()->height());
+
+        buffer.blendImage(cel->image(), m_sprite->palette(frame),
+                          cel->x(), cel->y(), opacity);
       }
+      break;
+    }
+
+    case ObjectType::LayerFolder: {
+      LayerConstIterator it = static_cast<const LayerFolder*>(layer)->getLayerBegin();
+      LayerConstIterator end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
+      for (; it != end; ++it)
+        renderLayerPremultiplied(*it, buffer, frame);
+      break;
     }
+
   }
 }
 
+ImageRef Render::getOnionskinImage(frame_t frame) const
+{
+  for (const auto& item : m_onionskinImages) {
+    if (item.first == frame)
+      return item.second;
+  }
+  return ImageRef(nullptr);
+}
+
+// Replaces the background of the given area with the cached
+// composition of the layers below the active layer. Returns false if
+// the cache cannot be used (the caller must render all layers).
+bool Render::renderLayersCache(
+  Image* dstImage,
+  frame_t frame,
+  const gfx::Clip& area,
+  Zoom zoom,
+  color_t bg_color,
+  bool checked_bg)
+{
+  if (!m_cacheActiveLayer ||
+      m_soloLayer ||
+      dstImage->pixelFormat() != IMAGE_RGB ||
+      zoom.scale() < 1.0 ||
+      m_bgType == BgType::NONE ||
+      (m_previewImage && m_selectedLayer != m_cacheActiveLayer) ||
+      (m_extraType != ExtraType::NONE && m_extraCel &&
+       m_currentLayer != m_cacheActiveLayer))
+    return false;
+
+  // The area must be inside the sprite bounds
+  gfx::Clip clip = area;
+  if (!clip.clip(dstImage->width(), dstImage->height(),
+                 zoom.apply(m_sprite->width()),
+                 zoom.apply(m_sprite->height())) ||
+      clip.src != area.src ||
+      clip.size != area.size)
+    return false;
+
+  LayersCache* cache = m_layersCache;
+  LayersCache::Key key;
+  key.sprite = m_sprite;
+  key.frame = frame;
+  key.activeLayer = m_cacheActiveLayer->id();
+  key.spriteVersion = m_sprite->version();
+  key.palette = m_sprite->palette(frame)->id();
+  key.paletteVersion = m_sprite->palette(frame)->version();
+  if (checked_bg) {
+    key.nbases = 2;
+    key.bases[0] = m_bgColor1;
+    key.bases[1] = m_bgColor2;
+  }
+  else {
+    key.nbases = 1;
+    key.bases[0] = key.bases[1] = bg_color;
+  }
+
+  std::vector<const Layer*> below;
+  if (!collect_below_layers(m_sprite->folder(), m_cacheActiveLayer,
+                            true, frame, below, key.layers))
+    return false;
+
+  // Re-composite the layers below the active layer (one time for
+  // each base color)
+  if (!cache->m_valid || !(cache->m_key == key)) {
+    layers_cache_misses_counter.add(1);
+
+    std::sort(below.begin(), below.end());
+    cache->m_belowLayers = below;
+
+    Render belowRender(*this);
+    belowRender.m_layersFilter = LayersFilter::BELOW_ACTIVE;
+    belowRender.m_extraType = ExtraType::NONE;
+    belowRender.m_extraCel = nullptr;
+    belowRender.m_globalOpacity = 255;
+
+    RenderScaledImage scaled_func =
+      getRenderScaledImageFunc(IMAGE_RGB, m_sprite->pixelFormat());
+
+    for (int i=0; i<key.nbases; ++i) {
+      base::UniquePtr<Image>& image = cache->m_images[i];
+      if (!image ||
+          image->width() != m_sprite->width() ||
+          image->height() != m_sprite->height())
+        image.reset(Image::create(IMAGE_RGB,
+                                  m_sprite->width(),
+                                  m_sprite->height()));
+
+      clear_image(image, key.bases[i]);
+      belowRender.renderLayer(
+        m_sprite->folder(), image,
+        gfx::Clip(m_sprite->bounds()), frame, Zoom(1, 1), scaled_func,
+        true, true, -1);
+    }
+
+    cache->m_key = key;
+    cache->m_valid = true;
+  }
+  else
+    layers_cache_hits_counter.add(1);
+
+  // Draw the cached images. When the zoom is bigger than 100%, all
+  // the pixels of a zoomed pixel (box) are rendered from the
+  // background color of the first pixel of the box (as
+  // compose_scaled_image_scale_up() does), so we use the same color
+  // to select the cached image.
+  const int px = zoom.apply(1);
+  const Image* image0 = cache->m_images[0];
+  const Image* image1 = cache->m_images[key.nbases-1];
+  const int x1 = area.src.x;
+  const int x2 = area.src.x + area.size.w;
+  const int y2 = area.src.y + area.size.h;
+  std::vector<RgbTraits::pixel_t> scanline(area.size.w);
+
+  for (int v=area.src.y; v<y2; ) {
+    int sy = v / px;
+    int v2 = MIN(y2, (sy+1)*px);
+
+    const RgbTraits::pixel_t* dst =
+      (const RgbTraits::pixel_t*)dstImage->getPixelAddress(
+        area.dst.x, area.dst.y + v - area.src.y);
+    const RgbTraits::pixel_t* src0 =
+      (const RgbTraits::pixel_t*)image0->getPixelAddress(0, sy);
+    const RgbTraits::pixel_t* src1 =
+      (const RgbTraits::pixel_t*)image1->getPixelAddress(0, sy);
+
+    for (int u=x1; u<x2; ) {
+      int sx = u / px;
+      int u2 = MIN(x2, (sx+1)*px);
+      RgbTraits::pixel_t c =
+        (dst[u-x1] == key.bases[1] ? src1[sx]: src0[sx]);
+      for (; u<u2; ++u)
+        scanline[u-x1] = c;
+    }
+
+    for (; v<v2; ++v) {
+      std::copy(scanline.begin(), scanline.end(),
+                (RgbTraits::pixel_t*)dstImage->getPixelAddress(
+                  area.dst.x, area.dst.y + v - area.src.y));
+    }
+  }
+
+  return true;
+}
+
 void Render::renderBackground(Image* image,
   const gfx::Clip& area,
   Zoom zoom)
@@ -619,6 +1528,14 @@ void Render::renderImage(Image* dst_image, const Image* src_image,
     opacity, blend_mode, zoom);
 }
 
+bool Render::isLayerVisible(const Layer* layer) const
+{
+  if (m_soloLayer && layer->parent() == m_sprite->folder())
+    return (layer == m_soloLayer);
+  else
+    return layer->isVisible();
+}
+
 void Render::renderLayer(
   const Layer* layer,
   Image *image,
@@ -629,8 +1546,10 @@ void Render::renderLayer(
   bool render_transparent,
   int blend_mode)
 {
+  TRACE_ZONE("Render::renderLayer");
+
   // we can't read from this layer
-  if (!layer->isVisible())
+  if (!isLayerVisible(layer))
     return;
 
   gfx::Rect extraArea;
@@ -660,6 +1579,14 @@ void Render::renderLayer(
           (!render_transparent && !layer->isBackground()))
         break;
 
+      if (m_layersFilter != LayersFilter::ALL) {
+        bool below = std::binary_search(m_layersCache->m_belowLayers.begin(),
+                                        m_layersCache->m_belowLayers.end(),
+                                        layer);
+        if (below != (m_layersFilter == LayersFilter::BELOW_ACTIVE))
+          break;
+      }
+
       const Cel* cel = layer->cel(frame);
       if (cel != NULL) {
         Palette* pal = m_sprite->palette(frame);
@@ -721,6 +1648,17 @@ void Render::renderLayer(
       LayerConstIterator it = static_cast<const LayerFolder*>(layer)->getLayerBegin();
       LayerConstIterator end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
 
+      // Layers below the top-most opaque cel that covers the whole
+      // area are not visible
+      if (m_contentCache) {
+        for (LayerConstIterator it2=it; it2 != end; ++it2) {
+          if (isOpaqueLayer(*it2, image, area, frame, zoom,
+                            render_background, render_transparent,
+                            blend_mode))
+            it = it2;
+        }
+      }
+
       for (; it != end; ++it) {
         renderLayer(*it, image,
           area, frame, zoom, scaled_func,
@@ -768,9 +1706,55 @@ void Render::renderCel(
         cel_x, cel_y,
         zoom.apply(cel_image->width()),
         zoom.apply(cel_image->height())));
+
+  // Pixels with the mask color are not blended (except with the copy
+  // blend mode), so we can skip the margins of the cel image with
+  // these pixels. Only for integer zooms, where the zoomed bounds of
+  // each pixel are exact.
+  if (m_contentCache &&
+      blend_mode != BLEND_MODE_COPY &&
+      cel_image == cel->image() &&
+      !src_bounds.isEmpty()) {
+    int scale = zoom.apply(1);
+    if (scale >= 1 && zoom.scale() == double(scale)) {
+      gfx::Rect content = m_contentCache->content(cel_image).bounds;
+      src_bounds = src_bounds.createIntersection(
+        gfx::Rect(cel_x + content.x*scale,
+                  cel_y + content.y*scale,
+                  content.w*scale,
+                  content.h*scale));
+    }
+  }
+
   if (src_bounds.isEmpty())
     return;
 
+  layers_counter.add(1);
+  pixels_counter.add(src_bounds.w * src_bounds.h);
+
+  // In zoomed out views (1/N) we can use the level "n" of the cel
+  // image (if 2^n divides N) at zoom 2^n/N. The area was already
+  // clipped with the original image size, so the result is the same.
+  ImageRef level_image;
+  if (m_mipmapCache &&
+      zoom.scale() < 1.0 &&
+      cel_image == cel->image()) {
+    int unbox = zoom.remove(1);
+    if (zoom.apply(unbox) == 1) {
+      int level = 0;
+      while (((unbox >> level) & 1) == 0)
+        ++level;
+
+      if (level > 0) {
+        level_image = m_mipmapCache->level(cel_image, level);
+        if (level_image) {
+          cel_image = level_image.get();
+          zoom = Zoom(1, unbox >> level);
+        }
+      }
+    }
+  }
+
   (*scaled_func)(dst_image, cel_image, pal,
     gfx::Clip(
       area.dst.x + src_bounds.x - area.src.x,
@@ -782,6 +1766,57 @@ void Render::renderCel(
     opacity, blend_mode, zoom);
 }
 
+// Returns true if the given layer replaces all pixels of the area
+// (an opaque cel with normal blend mode that covers the whole area),
+// so the layers below it don't need to be rendered.
+bool Render::isOpaqueLayer(
+  const Layer* layer,
+  const Image* image,
+  const gfx::Clip& area,
+  frame_t frame, Zoom zoom,
+  bool render_background,
+  bool render_transparent,
+  int blend_mode)
+{
+  if (!layer->isImage() ||
+      !isLayerVisible(layer) ||
+      (!render_background  &&  layer->isBackground()) ||
+      (!render_transparent && !layer->isBackground()) ||
+      m_layersFilter != LayersFilter::ALL ||
+      m_globalOpacity != 255 ||
+      // The preview or a patch can replace a part of the cel
+      (m_previewImage && m_selectedLayer == layer) ||
+      (m_extraCel && m_currentLayer == layer))
+    return false;
+
+  const Cel* cel = layer->cel(frame);
+  if (!cel || cel->opacity() != 255)
+    return false;
+
+  int layer_blend_mode =
+    (blend_mode < 0 ?
+     static_cast<const LayerImage*>(layer)->getBlendMode():
+     blend_mode);
+  if (layer_blend_mode != BLEND_MODE_NORMAL)
+    return false;
+
+  // Only formats where an opaque pixel replaces the destination pixel
+  const Image* cel_image = cel->image();
+  if (!cel_image ||
+      !((image->pixelFormat() == IMAGE_RGB && cel_image->pixelFormat() == IMAGE_RGB) ||
+        (image->pixelFormat() == IMAGE_INDEXED && cel_image->pixelFormat() == IMAGE_INDEXED)))
+    return false;
+
+  gfx::Rect celBounds(zoom.apply(cel->x()),
+                      zoom.apply(cel->y()),
+                      zoom.apply(cel_image->width()),
+                      zoom.apply(cel_image->height()));
+  if (!celBounds.contains(area.srcBounds()))
+    return false;
+
+  return m_contentCache->content(cel_image).opaque;
+}
+
 // static
 Render::RenderScaledImage Render::getRenderScaledImageFunc(
   PixelFormat dstFormat,
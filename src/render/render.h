@@ -11,12 +11,15 @@
 #include "doc/anidir.h"
 #include "doc/color.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/pixel_format.h"
 #include "gfx/fwd.h"
 #include "gfx/size.h"
 #include "render/extra_type.h"
 #include "render/zoom.h"
 
+#include <vector>
+
 namespace gfx {
   class Clip;
 }
@@ -33,6 +36,12 @@ namespace doc {
 namespace render {
   using namespace doc;
 
+  class ContentCache;
+  class LayersCache;
+  class MipmapCache;
+  class OnionskinCache;
+  class PremultipliedBuffer;
+
   enum class BgType {
     NONE,
     TRANSPARENT,
@@ -107,6 +116,53 @@ namespace render {
     void setOnionskin(const OnionskinOptions& options);
     void disableOnionskin();
 
+    // Enables/disables the rendering of big areas in tiles using
+    // several threads (see base::thread_pool::global()). It's
+    // enabled by default.
+    void setTiledRendering(bool state);
+
+    // Renders only the given top-level layer (even if it's hidden)
+    // and skips the other ones, without modifying the visibility of
+    // the sprite layers. So several threads can render different
+    // layers of the same sprite at the same time (e.g. to save each
+    // layer in a different file). NULL renders the visible layers.
+    void setSoloLayer(const Layer* layer);
+
+    // Uses the given cache to keep the layers below "activeLayer"
+    // composited between calls to renderSprite() (see LayersCache).
+    // The cache is used only in the cases where the result is the
+    // same as rendering all layers (RGB destination image, zoom >=
+    // 100%, background enabled, area inside the sprite bounds).
+    void setLayersCache(LayersCache* cache, const Layer* activeLayer);
+    void removeLayersCache();
+
+    // Uses the reduced images of the given cache to render cel
+    // images in zoomed out views (zoom 1/N with N even). It doesn't
+    // change the result (see MipmapCache). Can be NULL.
+    void setMipmapCache(MipmapCache* cache);
+
+    // Uses the content bounds of cel images in the given cache to
+    // skip their transparent margins (in zooms >= 100%) and the
+    // layers below an opaque cel that covers the whole area. It
+    // doesn't change the result (see ContentCache). Can be NULL.
+    void setContentCache(ContentCache* cache);
+
+    // Uses the given cache to keep the frames displayed with the onion
+    // skin composited between calls to renderSprite() (only when the
+    // destination image is RGB). Each neighboring frame is blended
+    // as one image (with all its layers merged) instead of blending
+    // each layer with the onion skin opacity. Can be NULL.
+    void setOnionskinCache(OnionskinCache* cache);
+
+    // Fills "key" with the IDs/versions of everything that affects
+    // the rendering of the given sprite frame with the current
+    // settings. Two renderings with equal keys (and equal zoom/area)
+    // produce the same pixels, so a caller can know if a previous
+    // result is still valid (e.g. the editor tiles rendered in
+    // background threads).
+    void getRenderKey(const Sprite* sprite, frame_t frame,
+                      std::vector<int>& key) const;
+
     void renderSprite(
       Image* dstImage,
       const Sprite* sprite,
@@ -150,11 +206,63 @@ namespace render {
       int opacity, int blend_mode);
 
   private:
+    enum class LayersFilter {
+      ALL,                      // Render all layers
+      BELOW_ACTIVE,             // Only the layers below the active layer
+      FROM_ACTIVE,              // From the active layer to the top
+    };
+
     typedef void (*RenderScaledImage)(
       Image* dst, const Image* src, const Palette* pal,
       const gfx::Clip& area,
       int opacity, int blend_mode, Zoom zoom);
 
+    // A frame displayed with the onion skin
+    struct OnionskinFrame {
+      frame_t frame;
+      int opacity;
+      int blendMode;
+    };
+
+    void getOnionskinFrames(frame_t frame,
+                            std::vector<OnionskinFrame>& frames) const;
+    void prepareOnionskinCache(frame_t frame);
+    ImageRef getOnionskinImage(frame_t frame) const;
+
+    void renderSpriteArea(
+      Image* dstImage,
+      frame_t frame,
+      const gfx::Clip& area,
+      Zoom zoom,
+      RenderScaledImage scaled_func,
+      bool fromActiveLayer);
+
+    bool canRenderInIndexSpace(frame_t frame) const;
+    bool hasOnlyNormalCels(const Layer* layer, frame_t frame, bool opaque) const;
+    bool renderLayersInIndexSpace(
+      Image* dstImage,
+      frame_t frame,
+      const gfx::Clip& area,
+      Zoom zoom);
+
+    bool renderFramePremultiplied(Image* dstImage, frame_t frame);
+    void renderLayerPremultiplied(const Layer* layer,
+                                  PremultipliedBuffer& buffer,
+                                  frame_t frame);
+
+    bool renderLayersCache(
+      Image* dstImage,
+      frame_t frame,
+      const gfx::Clip& area,
+      Zoom zoom,
+      color_t bg_color,
+      bool checked_bg);
+
+    static void getRenderTiles(
+      const gfx::Clip& area,
+      Zoom zoom,
+      std::vector<gfx::Clip>& tiles);
+
     void renderLayer(
       const Layer* layer,
       Image* image,
@@ -174,6 +282,17 @@ namespace render {
       RenderScaledImage scaled_func,
       int opacity, int blend_mode, Zoom zoom);
 
+    bool isOpaqueLayer(
+      const Layer* layer,
+      const Image* image,
+      const gfx::Clip& area,
+      frame_t frame, Zoom zoom,
+      bool render_background,
+      bool render_transparent,
+      int blend_mode);
+
+    bool isLayerVisible(const Layer* layer) const;
+
     static RenderScaledImage getRenderScaledImageFunc(
       PixelFormat dstFormat,
       PixelFormat srcFormat);
@@ -196,6 +315,18 @@ namespace render {
     frame_t m_selectedFrame;
     Image* m_previewImage;
     OnionskinOptions m_onionskin;
+    bool m_tiledRendering;
+    LayersCache* m_layersCache;
+    const Layer* m_cacheActiveLayer;
+    const Layer* m_soloLayer;
+    LayersFilter m_layersFilter;
+    MipmapCache* m_mipmapCache;
+    ContentCache* m_contentCache;
+    OnionskinCache* m_onionskinCache;
+
+    // Composited frames of the onion skin cache to be used in the
+    // current renderSprite() call
+    std::vector<std::pair<frame_t, ImageRef> > m_onionskinImages;
   };
 
   void composite_image(Image* dst, const Image* src,
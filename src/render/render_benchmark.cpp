@@ -0,0 +1,101 @@
+// Aseprite Render Library
+// Copyright (c) 2001-2015 David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "tests/benchmark.h"
+
+#include "render/render.h"
+
+#include "base/unique_ptr.h"
+#include "doc/cel.h"
+#include "doc/context.h"
+#include "doc/document.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+using namespace doc;
+using namespace render;
+
+static void fill_image(Image* image, uint32_t seed)
+{
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x) {
+      seed = seed*1103515245 + 12345;
+      switch (image->pixelFormat()) {
+        case IMAGE_RGB: put_pixel(image, x, y, seed | rgba_a_mask); break;
+        case IMAGE_GRAYSCALE: put_pixel(image, x, y, (seed >> 16) | graya_a_mask); break;
+        case IMAGE_INDEXED: put_pixel(image, x, y, (seed >> 16) & 0xff); break;
+      }
+    }
+}
+
+// Renders a 256x256 source image of the pixel format range_x in a
+// RGB image with the zoom range_y (negative values are zoom 1/N).
+// This is the compose_scaled_image() kernel used by the editor.
+static void BM_RenderImage(benchmark::State& state)
+{
+  const PixelFormat format = PixelFormat(state.range_x());
+  const Zoom zoom = (state.range_y() > 0 ? Zoom(state.range_y(), 1):
+                                           Zoom(1, -state.range_y()));
+
+  base::UniquePtr<Image> src(Image::create(format, 256, 256));
+  base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, zoom.apply(256), zoom.apply(256)));
+  fill_image(src, 1);
+
+  Palette pal(frame_t(0), 256);
+  for (int i=0; i<256; ++i)
+    pal.setEntry(i, rgba(i, 255-i, (i*7) & 0xff, 255));
+
+  Render render;
+  while (state.KeepRunning())
+    render.renderImage(dst, src, &pal, 0, 0, zoom, 128, BLEND_MODE_NORMAL);
+
+  state.SetItemsProcessed(state.iterations() * dst->width() * dst->height());
+}
+BENCHMARK(BM_RenderImage)
+  ->ArgPair(IMAGE_RGB, 1)
+  ->ArgPair(IMAGE_RGB, 4)
+  ->ArgPair(IMAGE_RGB, -2)
+  ->ArgPair(IMAGE_GRAYSCALE, 1)
+  ->ArgPair(IMAGE_INDEXED, 1)
+  ->ArgPair(IMAGE_INDEXED, 4);
+
+// Renders a 256x256 sprite of the pixel format range_x with range_y
+// layers in a RGB image (zoom 2x)
+static void BM_RenderSprite(benchmark::State& state)
+{
+  const PixelFormat format = PixelFormat(state.range_x());
+  const int layers = state.range_y();
+
+  Context ctx;
+  Document* doc = ctx.documents().add(256, 256, ColorMode(format));
+  Sprite* sprite = doc->sprite();
+  fill_image(sprite->layer(0)->cel(0)->image(), 1);
+
+  for (int i=1; i<layers; ++i) {
+    LayerImage* layer = new LayerImage(sprite);
+    sprite->folder()->addLayer(layer);
+
+    ImageRef image(Image::create(format, 256, 256));
+    fill_image(image.get(), i+1);
+    layer->addCel(new Cel(frame_t(0), image));
+  }
+
+  base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, 512, 512));
+
+  Render render;
+  while (state.KeepRunning())
+    render.renderSprite(dst, sprite, frame_t(0),
+                        gfx::Clip(0, 0, 0, 0, 512, 512), Zoom(2, 1));
+
+  state.SetItemsProcessed(state.iterations() * dst->width() * dst->height() * layers);
+}
+BENCHMARK(BM_RenderSprite)
+  ->ArgPair(IMAGE_RGB, 1)
+  ->ArgPair(IMAGE_RGB, 8)
+  ->ArgPair(IMAGE_INDEXED, 8);
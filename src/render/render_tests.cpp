@@ -12,6 +12,13 @@
 
 #include "render/render.h"
 
+#include "render/content_cache.h"
+#include "render/get_sprite_pixel.h"
+#include "render/premultiplied_buffer.h"
+#include "render/layers_cache.h"
+#include "render/mipmap_cache.h"
+#include "render/onionskin_cache.h"
+
 #include "base/unique_ptr.h"
 #include "doc/cel.h"
 #include "doc/context.h"
@@ -20,6 +27,8 @@
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "gfx/region.h"
 
 using namespace doc;
 using namespace render;
@@ -214,6 +223,586 @@ TEST(Render, ZoomAndDstBounds)
     0, 0, 0, 0);
 }
 
+TEST(Render, ZoomInWithClipping)
+{
+  Context ctx;
+  Document* doc = ctx.documents().add(20, 10, ColorMode::RGB);
+  Image* src = doc->sprite()->layer(0)->cel(0)->image();
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x)
+      put_pixel(src, x, y, rgba(x*10, y*20, 0, 255));
+
+  Zoom zooms[] = { Zoom(2, 1), Zoom(5, 1), Zoom(16, 1) };
+  for (const Zoom& zoom : zooms) {
+    // Start and end in the middle of zoomed pixels
+    gfx::Clip area(2, 3, 7, 9, 61, 43);
+
+    base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, 80, 60));
+    clear_image(dst, 0);
+
+    Render render;
+    render.setBgType(BgType::NONE);
+    render.renderSprite(dst, doc->sprite(), frame_t(0), area, zoom);
+
+    for (int y=0; y<dst->height(); ++y)
+      for (int x=0; x<dst->width(); ++x) {
+        int u = x - area.dst.x + area.src.x;
+        int v = y - area.dst.y + area.src.y;
+        color_t expected = 0;
+        if (x >= area.dst.x && x < area.dst.x+area.size.w &&
+            y >= area.dst.y && y < area.dst.y+area.size.h &&
+            zoom.remove(u) < src->width() &&
+            zoom.remove(v) < src->height())
+          expected = get_pixel(src, zoom.remove(u), zoom.remove(v));
+
+        ASSERT_EQ(expected, get_pixel(dst, x, y))
+          << "zoom " << zoom.scale() << " x=" << x << " y=" << y;
+      }
+  }
+}
+
+TEST(Render, TiledRenderingMatchesSerialRendering)
+{
+  Context ctx;
+  Document* doc = ctx.documents().add(300, 200, ColorMode::RGB);
+  Image* src = doc->sprite()->layer(0)->cel(0)->image();
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x)
+      put_pixel(src, x, y, rgba(x & 255, y & 255, (x*y) & 255, (x+y) & 255));
+
+  Zoom zooms[] = { Zoom(1, 1), Zoom(3, 1), Zoom(1, 2) };
+  for (const Zoom& zoom : zooms) {
+    gfx::Clip area(3, 5, 7, 11, 700, 500);
+
+    base::UniquePtr<Image> serial(Image::create(IMAGE_RGB, 720, 520));
+    base::UniquePtr<Image> tiled(Image::create(IMAGE_RGB, 720, 520));
+    clear_image(serial, 0);
+    clear_image(tiled, 0);
+
+    Render render;
+    render.setBgType(BgType::CHECKED);
+    render.setBgZoom(true);
+    render.setBgColor1(rgba(255, 255, 255, 255));
+    render.setBgColor2(rgba(128, 128, 128, 255));
+
+    render.setTiledRendering(false);
+    render.renderSprite(serial, doc->sprite(), frame_t(0), area, zoom);
+    render.setTiledRendering(true);
+    render.renderSprite(tiled, doc->sprite(), frame_t(0), area, zoom);
+
+    EXPECT_EQ(0, count_diff_between_images(serial, tiled));
+  }
+}
+
+TEST(Render, LayersCacheMatchesFullRendering)
+{
+  Context ctx;
+  Document* doc = ctx.documents().add(20, 10, ColorMode::RGB);
+  Sprite* sprite = doc->sprite();
+
+  // Three layers, the cels of the two top layers are translucent
+  LayerImage* layers[3] = { static_cast<LayerImage*>(sprite->layer(0)), nullptr, nullptr };
+  for (int i=1; i<3; ++i) {
+    layers[i] = new LayerImage(sprite);
+    sprite->folder()->addLayer(layers[i]);
+    ImageRef image(Image::create(IMAGE_RGB, 12, 8));
+    Cel* cel = new Cel(frame_t(0), image);
+    cel->setPosition(i*3, i);
+    layers[i]->addCel(cel);
+  }
+  for (int i=0; i<3; ++i) {
+    Image* image = layers[i]->cel(0)->image();
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        put_pixel(image, x, y, rgba((x*40+i*80) & 255, (y*30) & 255, i*100, 50+i*60+x));
+  }
+
+  LayersCache cache;
+  Render render;
+  render.setBgType(BgType::CHECKED);
+  render.setBgZoom(true);
+  render.setBgColor1(rgba(255, 255, 255, 255));
+  render.setBgColor2(rgba(128, 128, 128, 255));
+  render.setBgCheckedSize(gfx::Size(3, 3));
+
+  for (int step=0; step<2; ++step) {
+    for (int z=1; z<=3; ++z) {
+      Zoom zoom(z, 1);
+      gfx::Clip area(1, 2, 1, 0, zoom.apply(20)-1, zoom.apply(10)-2);
+
+      base::UniquePtr<Image> expected(Image::create(IMAGE_RGB, area.size.w+2, area.size.h+2));
+      base::UniquePtr<Image> cached(Image::create(IMAGE_RGB, area.size.w+2, area.size.h+2));
+      clear_image(expected, 0);
+      clear_image(cached, 0);
+
+      render.renderSprite(expected, sprite, frame_t(0), area, zoom);
+
+      // The second render uses the cached layers
+      render.setLayersCache(&cache, layers[2]);
+      render.renderSprite(cached, sprite, frame_t(0), area, zoom);
+      EXPECT_EQ(0, count_diff_between_images(expected, cached));
+      clear_image(cached, 0);
+      render.renderSprite(cached, sprite, frame_t(0), area, zoom);
+      EXPECT_EQ(0, count_diff_between_images(expected, cached));
+      render.removeLayersCache();
+    }
+
+    // Modify a layer below the active one, the cache must be
+    // re-composited.
+    Image* image = layers[1]->cel(0)->image();
+    fill_rect(image, 2, 2, 6, 5, rgba(10, 200, 30, 90));
+    image->incrementVersion();
+  }
+}
+
+TEST(Render, IndexedLayersInIndexSpace)
+{
+  Context ctx;
+  Document* doc = ctx.documents().add(20, 10, ColorMode::INDEXED);
+  Sprite* sprite = doc->sprite();
+  sprite->setTransparentColor(3);
+
+  Palette* pal = sprite->palette(frame_t(0));
+  for (int i=0; i<pal->size(); ++i)
+    pal->setEntry(i, rgba(i, 255-i, (i*7) & 255, 255));
+
+  // Two layers, the top one with a cel that doesn't cover the sprite
+  LayerImage* layers[2] = { static_cast<LayerImage*>(sprite->layer(0)), new LayerImage(sprite) };
+  sprite->folder()->addLayer(layers[1]);
+  {
+    ImageRef image(Image::create(IMAGE_INDEXED, 12, 8));
+    Cel* cel = new Cel(frame_t(0), image);
+    cel->setPosition(5, 1);
+    layers[1]->addCel(cel);
+  }
+  for (int i=0; i<2; ++i) {
+    Image* image = layers[i]->cel(0)->image();
+    image->setMaskColor(3);
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        put_pixel(image, x, y, ((x+y+i) % 4) == 0 ? 3: (x*5+y*3+i*50) & 255);
+  }
+
+  const color_t bg = rgba(1, 2, 3, 4);
+  for (int z=1; z<=3; ++z) {
+    Zoom zoom(z, 1);
+    base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, zoom.apply(20), zoom.apply(10)));
+    clear_image(dst, bg);
+
+    Render render;
+    render.renderSprite(dst, sprite, frame_t(0),
+                        gfx::Clip(0, 0, 0, 0, dst->width(), dst->height()), zoom);
+
+    for (int y=0; y<dst->height(); ++y)
+      for (int x=0; x<dst->width(); ++x) {
+        int u = x/z, v = y/z;
+        color_t expected = 0;   // Default background is transparent
+        for (int i=0; i<2; ++i) {
+          const Cel* cel = layers[i]->cel(0);
+          if (cel->bounds().contains(gfx::Point(u, v))) {
+            color_t c = get_pixel(cel->image(), u-cel->x(), v-cel->y());
+            if (c != 3)
+              expected = pal->getEntry(c);
+          }
+        }
+        ASSERT_EQ(expected, get_pixel(dst, x, y)) << "Pixel " << x << "," << y << " zoom " << z;
+      }
+  }
+}
+
+TEST(Render, MipmapCacheMatchesFullRendering)
+{
+  Context ctx;
+  Document* doc = ctx.documents().add(301, 203, ColorMode::RGB);
+  Sprite* sprite = doc->sprite();
+  Image* src = sprite->layer(0)->cel(0)->image();
+  for (int y=0; y<src->height(); ++y)
+    for (int x=0; x<src->width(); ++x)
+      put_pixel(src, x, y, rgba(x & 255, y & 255, (x*y) & 255, (x+y) & 255));
+
+  MipmapCache cache;
+  Zoom zooms[] = { Zoom(1, 2), Zoom(1, 3), Zoom(1, 4), Zoom(1, 6), Zoom(1, 8), Zoom(1, 32) };
+  for (int i=0; i<2; ++i) {
+    for (const Zoom& zoom : zooms) {
+      gfx::Clip area(3, 1, 5, 7, 90, 80);
+
+      base::UniquePtr<Image> expected(Image::create(IMAGE_RGB, 100, 90));
+      base::UniquePtr<Image> result(Image::create(IMAGE_RGB, 100, 90));
+      clear_image(expected, 0);
+      clear_image(result, 0);
+
+      Render render;
+      render.setBgType(BgType::CHECKED);
+      render.setBgZoom(true);
+      render.setBgColor1(rgba(255, 255, 255, 255));
+      render.setBgColor2(rgba(128, 128, 128, 255));
+
+      render.renderSprite(expected, sprite, frame_t(0), area, zoom);
+      render.setMipmapCache(&cache);
+      render.renderSprite(result, sprite, frame_t(0), area, zoom);
+
+      EXPECT_EQ(0, count_diff_between_images(expected, result))
+        << "zoom 1/" << zoom.remove(1);
+    }
+
+    // Modify the image, the levels must be re-created
+    fill_rect(src, 10, 10, 200, 150, rgba(10, 200, 30, 90));
+    src->incrementVersion();
+  }
+
+  EXPECT_LT(0u, cache.bytes());
+}
+
+TEST(Render, RenderKeyChangesWithTheContent)
+{
+  Context ctx;
+  Document* doc = ctx.documents().add(8, 8, ColorMode::RGB);
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->layer(0));
+  Cel* cel = layer->cel(0);
+
+  Render render;
+  std::vector<int> key, key2;
+  render.getRenderKey(sprite, frame_t(0), key);
+  render.getRenderKey(sprite, frame_t(0), key2);
+  EXPECT_EQ(key, key2);
+
+  cel->image()->incrementVersion();
+  render.getRenderKey(sprite, frame_t(0), key2);
+  EXPECT_NE(key, key2);
+
+  render.getRenderKey(sprite, frame_t(0), key);
+  cel->setPosition(1, 0);
+  render.getRenderKey(sprite, frame_t(0), key2);
+  EXPECT_NE(key, key2);
+
+  render.getRenderKey(sprite, frame_t(0), key);
+  layer->setVisible(false);
+  render.getRenderKey(sprite, frame_t(0), key2);
+  EXPECT_NE(key, key2);
+
+  render.getRenderKey(sprite, frame_t(0), key);
+  render.setBgType(BgType::CHECKED);
+  render.getRenderKey(sprite, frame_t(0), key2);
+  EXPECT_NE(key, key2);
+}
+
+TEST(Render, SpritePixelCache)
+{
+  Context ctx;
+  Document* doc = ctx.documents().add(100, 80, ColorMode::RGB);
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->layer(0));
+  Image* image = layer->cel(0)->image();
+  const color_t red = rgba(255, 0, 0, 255);
+  const color_t blue = rgba(0, 0, 255, 255);
+
+  clear_image(image, 0);
+  put_pixel(image, 3, 4, red);
+  put_pixel(image, 70, 75, blue);
+
+  SpritePixelCache cache;
+  for (int y=0; y<sprite->height(); y+=7)
+    for (int x=0; x<sprite->width(); x+=3)
+      EXPECT_EQ(get_sprite_pixel(sprite, x, y, frame_t(0)),
+                cache.getPixel(sprite, x, y, frame_t(0)));
+  EXPECT_EQ(red, cache.getPixel(sprite, 3, 4, frame_t(0)));
+  EXPECT_EQ(blue, cache.getPixel(sprite, 70, 75, frame_t(0)));
+  EXPECT_EQ(0, cache.getPixel(sprite, -1, 4, frame_t(0)));
+  EXPECT_EQ(0, cache.getPixel(sprite, 100, 4, frame_t(0)));
+
+  // The image is modified without a new version (as when it's
+  // painted), so the cache needs to be invalidated
+  put_pixel(image, 3, 4, blue);
+  put_pixel(image, 70, 75, red);
+  EXPECT_EQ(red, cache.getPixel(sprite, 3, 4, frame_t(0)));
+  cache.invalidate(gfx::Region(gfx::Rect(3, 4, 1, 1)));
+  EXPECT_EQ(blue, cache.getPixel(sprite, 3, 4, frame_t(0)));
+  EXPECT_EQ(blue, cache.getPixel(sprite, 70, 75, frame_t(0)));
+
+  // A new version of the image discards all tiles
+  image->incrementVersion();
+  EXPECT_EQ(red, cache.getPixel(sprite, 70, 75, frame_t(0)));
+
+  layer->setVisible(false);
+  EXPECT_EQ(0, cache.getPixel(sprite, 70, 75, frame_t(0)));
+}
+
+TEST(Render, OnionskinCacheMatchesFullRendering)
+{
+  Context ctx;
+  Document* doc = ctx.documents().add(16, 12, ColorMode::RGB);
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->layer(0));
+
+  // Five frames with one cel each (this is the case where blending
+  // merged frames gives the same result as blending each layer)
+  sprite->setTotalFrames(frame_t(5));
+  for (frame_t f=0; f<5; ++f) {
+    if (f > 0) {
+      ImageRef image(Image::create(IMAGE_RGB, 10, 8));
+      Cel* cel = new Cel(f, image);
+      cel->setPosition(f, f/2);
+      layer->addCel(cel);
+    }
+    Image* image = layer->cel(f)->image();
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        put_pixel(image, x, y, rgba((x*30+f*50) & 255, (y*20) & 255, f*60, 100+x*10));
+  }
+
+  OnionskinOptions onionskin(OnionskinType::MERGE);
+  onionskin.prevFrames(2);
+  onionskin.nextFrames(2);
+  onionskin.opacityBase(128);
+  onionskin.opacityStep(32);
+
+  OnionskinCache cache;
+  Render render;
+  render.setBgType(BgType::CHECKED);
+  render.setBgColor1(rgba(255, 255, 255, 255));
+  render.setBgColor2(rgba(128, 128, 128, 255));
+
+  for (int step=0; step<3; ++step) {
+    render.setOnionskin(onionskin);
+
+    for (int z=1; z<=2; ++z) {
+      Zoom zoom(z, 1);
+      gfx::Clip area(0, 0, 1, 1, zoom.apply(16)-2, zoom.apply(12)-1);
+
+      base::UniquePtr<Image> expected(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+      base::UniquePtr<Image> cached(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+      clear_image(expected, 0);
+      clear_image(cached, 0);
+
+      render.setOnionskinCache(nullptr);
+      render.renderSprite(expected, sprite, frame_t(2), area, zoom);
+
+      // Twice, the first time the cache is filled
+      render.setOnionskinCache(&cache);
+      for (int i=0; i<2; ++i) {
+        render.renderSprite(cached, sprite, frame_t(2), area, zoom);
+        EXPECT_EQ(0, count_diff_between_images(expected, cached));
+      }
+    }
+
+    // Modify a neighboring frame, it must be composited again
+    Image* image = layer->cel(frame_t(step == 0 ? 1: 4))->image();
+    fill_rect(image, 1, 1, 5, 4, rgba(10, 200, 30, 200));
+    image->incrementVersion();
+
+    onionskin.type(OnionskinType::RED_BLUE_TINT);
+  }
+}
+
+TEST(Render, PremultipliedBufferMatchesBlendFunction)
+{
+  base::UniquePtr<Image> a(Image::create(IMAGE_RGB, 16, 16));
+  base::UniquePtr<Image> b(Image::create(IMAGE_RGB, 16, 16));
+  for (int y=0; y<16; ++y)
+    for (int x=0; x<16; ++x) {
+      put_pixel(a, x, y, rgba(x*16, y*16, (x*y) & 255, x*17));
+      put_pixel(b, x, y, rgba(255-y*16, x*13, 40, y*17));
+    }
+
+  base::UniquePtr<Image> result(Image::create(IMAGE_RGB, 16, 16));
+  for (int opacity : { 255, 128, 7 }) {
+    // One image over the transparent buffer is exactly the same as
+    // rgba_blend_normal()
+    PremultipliedBuffer buffer(16, 16);
+    buffer.blendImage(a, nullptr, 0, 0, opacity);
+    buffer.copyToImage(result);
+    for (int y=0; y<16; ++y)
+      for (int x=0; x<16; ++x) {
+        color_t expected = rgba_blend_normal(0, get_pixel(a, x, y), opacity);
+        if (rgba_geta(expected) == 0)
+          expected = 0;
+        ASSERT_EQ(expected, get_pixel(result, x, y));
+      }
+
+    // Two images (compared with the exact result, the precision of
+    // the buffer is better than rgba_blend_normal())
+    buffer.blendImage(b, nullptr, 0, 0, opacity);
+    buffer.copyToImage(result);
+    for (int y=0; y<16; ++y)
+      for (int x=0; x<16; ++x) {
+        color_t ca = get_pixel(a, x, y);
+        color_t cb = get_pixel(b, x, y);
+        double aa = rgba_geta(ca) * opacity / (255.0*255.0);
+        double ab = rgba_geta(cb) * opacity / (255.0*255.0);
+        double alpha = ab + aa*(1.0-ab);
+        color_t c = get_pixel(result, x, y);
+
+        EXPECT_NEAR(alpha*255.0, rgba_geta(c), 0.51);
+        if (rgba_geta(c) > 0) {
+          EXPECT_NEAR((rgba_getr(cb)*ab + rgba_getr(ca)*aa*(1.0-ab)) / alpha, rgba_getr(c), 0.51);
+          EXPECT_NEAR((rgba_getg(cb)*ab + rgba_getg(ca)*aa*(1.0-ab)) / alpha, rgba_getg(c), 0.51);
+          EXPECT_NEAR((rgba_getb(cb)*ab + rgba_getb(ca)*aa*(1.0-ab)) / alpha, rgba_getb(c), 0.51);
+        }
+      }
+  }
+}
+
+TEST(Render, SoloLayerMatchesHidingOtherLayers)
+{
+  Context ctx;
+  Document* doc = ctx.documents().add(8, 6, ColorMode::RGB);
+  Sprite* sprite = doc->sprite();
+
+  // Three layers, the middle one is hidden
+  LayerImage* layers[3] = { static_cast<LayerImage*>(sprite->layer(0)), nullptr, nullptr };
+  for (int i=1; i<3; ++i) {
+    layers[i] = new LayerImage(sprite);
+    sprite->folder()->addLayer(layers[i]);
+    ImageRef image(Image::create(IMAGE_RGB, 5, 4));
+    Cel* cel = new Cel(frame_t(0), image);
+    cel->setPosition(i, i);
+    layers[i]->addCel(cel);
+  }
+  for (int i=0; i<3; ++i)
+    clear_image(layers[i]->cel(0)->image(), rgba(i*100, 255-i*100, 50, 200));
+  layers[1]->setVisible(false);
+
+  Render render;
+  base::UniquePtr<Image> expected(Image::create(IMAGE_RGB, 8, 6));
+  base::UniquePtr<Image> solo(Image::create(IMAGE_RGB, 8, 6));
+
+  for (int i=0; i<3; ++i) {
+    bool visible[3];
+    for (int j=0; j<3; ++j) {
+      visible[j] = layers[j]->isVisible();
+      layers[j]->setVisible(i == j);
+    }
+    clear_image(expected, 0);
+    render.renderSprite(expected, sprite, frame_t(0));
+    for (int j=0; j<3; ++j)
+      layers[j]->setVisible(visible[j]);
+
+    clear_image(solo, 0);
+    render.setSoloLayer(layers[i]);
+    render.renderSprite(solo, sprite, frame_t(0));
+    render.setSoloLayer(nullptr);
+    EXPECT_EQ(0, count_diff_between_images(expected, solo));
+  }
+
+  // The visibility of the layers wasn't modified by the solo layer
+  EXPECT_TRUE(layers[0]->isVisible());
+  EXPECT_FALSE(layers[1]->isVisible());
+  EXPECT_TRUE(layers[2]->isVisible());
+}
+
+TEST(Render, ContentCacheMatchesFullRendering)
+{
+  Context ctx;
+  Document* doc = ctx.documents().add(40, 30, ColorMode::RGB);
+  Sprite* sprite = doc->sprite();
+
+  // A translucent layer, an opaque cel covering the sprite, and a
+  // cel with transparent margins on top
+  LayerImage* layers[3] = { static_cast<LayerImage*>(sprite->layer(0)), nullptr, nullptr };
+  for (int i=1; i<3; ++i) {
+    layers[i] = new LayerImage(sprite);
+    sprite->folder()->addLayer(layers[i]);
+    ImageRef image(Image::create(IMAGE_RGB, (i == 1 ? 40: 30), (i == 1 ? 30: 20)));
+    Cel* cel = new Cel(frame_t(0), image);
+    cel->setPosition((i == 1 ? 0: 3), (i == 1 ? 0: 4));
+    layers[i]->addCel(cel);
+  }
+  Image* image0 = layers[0]->cel(0)->image();
+  Image* image1 = layers[1]->cel(0)->image();
+  Image* image2 = layers[2]->cel(0)->image();
+  clear_image(image0, rgba(200, 10, 10, 128));
+  for (int y=0; y<image1->height(); ++y)
+    for (int x=0; x<image1->width(); ++x)
+      put_pixel(image1, x, y, rgba(x*6, y*8, 50, 255));
+  clear_image(image2, image2->maskColor());
+  fill_rect(image2, 5, 6, 12, 10, rgba(10, 200, 30, 90));
+
+  ContentCache cache;
+  for (int step=0; step<2; ++step) {
+    for (int z=0; z<3; ++z) {
+      Zoom zoom = (z == 0 ? Zoom(1, 2): Zoom(z, 1));
+      gfx::Clip area(0, 0, 0, 0, zoom.apply(40), zoom.apply(30));
+
+      base::UniquePtr<Image> expected(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+      base::UniquePtr<Image> result(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+      clear_image(expected, 0);
+      clear_image(result, 0);
+
+      Render render;
+      render.setBgType(BgType::CHECKED);
+      render.setBgColor1(rgba(255, 255, 255, 255));
+      render.setBgColor2(rgba(128, 128, 128, 255));
+
+      render.renderSprite(expected, sprite, frame_t(0), area, zoom);
+      render.setContentCache(&cache);
+      render.renderSprite(result, sprite, frame_t(0), area, zoom);
+      EXPECT_EQ(0, count_diff_between_images(expected, result)) << step << " " << z;
+    }
+
+    // The opaque cel isn't opaque anymore
+    put_pixel(image1, 20, 15, rgba(0, 0, 0, 0));
+    image1->incrementVersion();
+  }
+
+  ContentCache::Content content = cache.content(image2);
+  EXPECT_EQ(gfx::Rect(5, 6, 8, 5), content.bounds);
+  EXPECT_FALSE(content.opaque);
+  EXPECT_FALSE(cache.content(image1).opaque);
+}
+
+TEST(Render, NormalMaxOpacityMatchesBlendFunction)
+{
+  // Opaque, translucent, transparent, and mask color pixels
+  const color_t colors[] = {
+    rgba(255, 0, 0, 255), rgba(0, 255, 0, 128),
+    rgba(0, 0, 255, 0), rgba(0, 0, 0, 0)
+  };
+  Palette pal(frame_t(0), 4);
+  for (int i=0; i<4; ++i)
+    pal.setEntry(i, colors[i]);
+
+  base::UniquePtr<Image> rgbSrc(Image::create(IMAGE_RGB, 9, 7));
+  base::UniquePtr<Image> indexedSrc(Image::create(IMAGE_INDEXED, 9, 7));
+  indexedSrc->setMaskColor(3);
+  for (int y=0; y<7; ++y)
+    for (int x=0; x<9; ++x) {
+      int i = ((x/2)+y) % 4;
+      put_pixel(rgbSrc, x, y, colors[i]);
+      put_pixel(indexedSrc, x, y, i);
+    }
+
+  const color_t bgs[] = { rgba(0, 0, 0, 0), rgba(10, 20, 30, 100), rgba(40, 50, 60, 255) };
+  const Image* srcs[] = { rgbSrc, indexedSrc };
+  for (const Image* src : srcs) {
+    for (color_t bg : bgs) {
+      for (int z=0; z<3; ++z) {
+        Zoom zoom = (z == 0 ? Zoom(1, 2): Zoom(z, 1));
+        int w = zoom.apply(src->width());
+        int h = zoom.apply(src->height());
+        base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, w, h));
+        clear_image(dst, bg);
+
+        Render render;
+        render.renderImage(dst, src, &pal, 0, 0, zoom, 255, BLEND_MODE_NORMAL);
+
+        for (int y=0; y<h; ++y)
+          for (int x=0; x<w; ++x) {
+            color_t c = get_pixel(src, zoom.remove(x), zoom.remove(y));
+            if (c == src->maskColor())
+              c = bg;
+            else {
+              if (src->pixelFormat() == IMAGE_INDEXED)
+                c = pal.getEntry(c);
+              c = rgba_blend_normal(bg, c, 255);
+            }
+            ASSERT_EQ(c, get_pixel(dst, x, y)) << x << " " << y << " " << z;
+          }
+      }
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
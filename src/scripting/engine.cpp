@@ -30,4 +30,8 @@ namespace scripting {
     m_impl->eval(script);
   }
 
+  void Engine::setImage(const std::string& name, doc::Image* image) {
+    m_impl->setImage(name, image);
+  }
+
 } // namespace scripting
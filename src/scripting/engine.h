@@ -11,6 +11,10 @@
 
 #include <string>
 
+namespace doc {
+  class Image;
+}
+
 namespace scripting {
 
   class Engine {
@@ -21,6 +25,14 @@ namespace scripting {
     bool supportEval() const;
     void eval(const std::string& script);
 
+    // Makes the image accessible from scripts as a global object
+    // with the given name. Rows of the image are exposed as typed
+    // arrays over the image buffer (image.row(y)) without copying
+    // pixels, and fill()/blend()/remap() are executed natively. The
+    // image must be alive (or removed with setImage(name, nullptr))
+    // while scripts are evaluated.
+    void setImage(const std::string& name, doc::Image* image);
+
   private:
     class EngineImpl;
     EngineImpl* m_impl;
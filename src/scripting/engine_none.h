@@ -19,4 +19,7 @@ public:
   void eval(const std::string& scriptString) {
   }
 
+  void setImage(const std::string& name, doc::Image* image) {
+  }
+
 };
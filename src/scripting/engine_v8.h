@@ -7,10 +7,112 @@
 
 #include "scripting/engine.h"
 
+#include "doc/image.h"
+#include "doc/primitives.h"
+#include "doc/remap.h"
+
+#include <map>
 #include <v8.h>
 
 using namespace v8;
 
+namespace {
+
+doc::Image* unwrap_image(const Arguments& args)
+{
+  Local<External> wrap = Local<External>::Cast(args.Holder()->GetInternalField(0));
+  return static_cast<doc::Image*>(wrap->Value());
+}
+
+// Optional (x, y, w, h) arguments from the index "i" (the whole
+// image by default).
+gfx::Rect bounds_argument(const Arguments& args, int i, const doc::Image* image)
+{
+  if (args.Length() < i+4)
+    return image->bounds();
+
+  return gfx::Rect(args[i]->Int32Value(),
+                   args[i+1]->Int32Value(),
+                   args[i+2]->Int32Value(),
+                   args[i+3]->Int32Value())
+    .createIntersection(image->bounds());
+}
+
+// image.row(y): Typed array over the pixels of the row "y" (it
+// references the image buffer, modifying the array modifies the
+// image). Bitmap rows are arrays of bytes with 8 pixels each one.
+Handle<Value> image_row(const Arguments& args)
+{
+  HandleScope handle_scope;
+  doc::Image* image = unwrap_image(args);
+  int y = args[0]->Int32Value();
+  if (y < 0 || y >= image->height())
+    return ThrowException(Exception::RangeError(String::New("Row out of bounds")));
+
+  ExternalArrayType type;
+  int length = image->width();
+  switch (image->pixelFormat()) {
+    case doc::IMAGE_RGB:       type = kExternalUnsignedIntArray; break;
+    case doc::IMAGE_GRAYSCALE: type = kExternalUnsignedShortArray; break;
+    case doc::IMAGE_INDEXED:   type = kExternalUnsignedByteArray; break;
+    default:
+      type = kExternalUnsignedByteArray;
+      length = image->getRowStrideSize();
+      break;
+  }
+
+  Local<Object> row = Object::New();
+  row->SetIndexedPropertiesToExternalArrayData(image->getRowAddress(y), type, length);
+  row->Set(String::New("length"), Integer::New(length));
+  return handle_scope.Close(row);
+}
+
+// image.fill(color [, x, y, w, h])
+Handle<Value> image_fill(const Arguments& args)
+{
+  doc::Image* image = unwrap_image(args);
+  gfx::Rect rc = bounds_argument(args, 1, image);
+  if (!rc.isEmpty())
+    doc::fill_rect(image, rc, args[0]->Uint32Value());
+  return Undefined();
+}
+
+// image.blend(color, opacity [, x, y, w, h])
+Handle<Value> image_blend(const Arguments& args)
+{
+  doc::Image* image = unwrap_image(args);
+  gfx::Rect rc = bounds_argument(args, 2, image);
+  if (!rc.isEmpty())
+    doc::blend_rect(image, rc.x, rc.y, rc.x2()-1, rc.y2()-1,
+                    args[0]->Uint32Value(), args[1]->Int32Value());
+  return Undefined();
+}
+
+// image.remap(array): Replaces each index "i" of an indexed image
+// with array[i] (indexes outside the array are kept).
+Handle<Value> image_remap(const Arguments& args)
+{
+  doc::Image* image = unwrap_image(args);
+  if (image->pixelFormat() != doc::IMAGE_INDEXED)
+    return ThrowException(Exception::TypeError(String::New("Only indexed images can be remapped")));
+  if (!args[0]->IsArray())
+    return ThrowException(Exception::TypeError(String::New("Expected an array of indexes")));
+
+  Local<Array> array = Local<Array>::Cast(args[0]);
+  doc::Remap remap(256);
+  for (int i=0; i<256; ++i) {
+    int j = (i < int(array->Length()) ? array->Get(i)->Int32Value(): i);
+    if (j < 0 || j > 255)
+      return ThrowException(Exception::RangeError(String::New("Index out of range")));
+    remap.map(i, j);
+  }
+
+  doc::remap_image(image, remap);
+  return Undefined();
+}
+
+} // anonymous namespace
+
 class scripting::Engine::EngineImpl
 {
 public:
@@ -26,6 +128,9 @@ public:
     Persistent<Context> context = Context::New();
     Context::Scope context_scope(context);
 
+    for (const auto& it : m_images)
+      context->Global()->Set(String::New(it.first.c_str()), wrapImage(it.second));
+
     Handle<String> source = String::New(scriptString.c_str());
     Handle<Script> script = Script::Compile(source);
     Handle<Value> result = script->Run();
@@ -35,4 +140,28 @@ public:
     printf("%s\n", *ascii);
   }
 
+  void setImage(const std::string& name, doc::Image* image) {
+    if (image)
+      m_images[name] = image;
+    else
+      m_images.erase(name);
+  }
+
+private:
+  Local<Object> wrapImage(doc::Image* image) {
+    Local<ObjectTemplate> tmpl = ObjectTemplate::New();
+    tmpl->SetInternalFieldCount(1);
+    tmpl->Set(String::New("row"), FunctionTemplate::New(image_row));
+    tmpl->Set(String::New("fill"), FunctionTemplate::New(image_fill));
+    tmpl->Set(String::New("blend"), FunctionTemplate::New(image_blend));
+    tmpl->Set(String::New("remap"), FunctionTemplate::New(image_remap));
+
+    Local<Object> obj = tmpl->NewInstance();
+    obj->SetInternalField(0, External::New(image));
+    obj->Set(String::New("width"), Integer::New(image->width()));
+    obj->Set(String::New("height"), Integer::New(image->height()));
+    return obj;
+  }
+
+  std::map<std::string, doc::Image*> m_images;
 };
@@ -0,0 +1,134 @@
+// SHE library
+// Copyright (C) 2012-2015  David Capello
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef SHE_ALLEG4_SCALE_H_INCLUDED
+#define SHE_ALLEG4_SCALE_H_INCLUDED
+#pragma once
+
+#include <allegro.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define SHE_SCALE_SSE2
+  #include <emmintrin.h>
+#endif
+
+namespace she {
+
+namespace scale_details {
+
+  // Repeats each pixel of "src" "scale" times in "dst".
+  template<typename pixel_t>
+  inline void scale_row(const pixel_t* src, pixel_t* dst, int w, int scale) {
+    switch (scale) {
+      case 2:
+        for (const pixel_t* end=src+w; src != end; ++src, dst+=2)
+          dst[0] = dst[1] = *src;
+        break;
+      default:
+        for (const pixel_t* end=src+w; src != end; ++src, dst+=scale)
+          std::fill(dst, dst+scale, *src);
+        break;
+    }
+  }
+
+#ifdef SHE_SCALE_SSE2
+
+  // 32bpp rows are the common case (desktop color depth), so 2x and
+  // 4x scales replicate 4 pixels at the same time.
+  template<>
+  inline void scale_row<uint32_t>(const uint32_t* src, uint32_t* dst, int w, int scale) {
+    int x = 0;
+    if (scale == 2) {
+      for (; x+4 <= w; x+=4, dst+=8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src+x));
+        _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi32(v, v));
+        _mm_storeu_si128((__m128i*)(dst+4), _mm_unpackhi_epi32(v, v));
+      }
+    }
+    else if (scale == 4) {
+      for (; x+4 <= w; x+=4, dst+=16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src+x));
+        __m128i lo = _mm_unpacklo_epi32(v, v);
+        __m128i hi = _mm_unpackhi_epi32(v, v);
+        _mm_storeu_si128((__m128i*)dst,      _mm_unpacklo_epi64(lo, lo));
+        _mm_storeu_si128((__m128i*)(dst+4),  _mm_unpackhi_epi64(lo, lo));
+        _mm_storeu_si128((__m128i*)(dst+8),  _mm_unpacklo_epi64(hi, hi));
+        _mm_storeu_si128((__m128i*)(dst+12), _mm_unpackhi_epi64(hi, hi));
+      }
+    }
+    for (; x<w; ++x, dst+=scale)
+      std::fill(dst, dst+scale, src[x]);
+  }
+
+#endif
+
+  // 24bpp pixels are copied byte by byte
+  inline void scale_row_24(const uint8_t* src, uint8_t* dst, int w, int scale) {
+    for (const uint8_t* end=src+3*w; src != end; src+=3) {
+      for (int i=0; i<scale; ++i, dst+=3) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+      }
+    }
+  }
+
+  template<typename pixel_t>
+  inline void scale_rect(BITMAP* src, BITMAP* dst,
+                         int sx, int sy, int dx, int dy,
+                         int w, int h, int scale) {
+    const int rowBytes = w*scale*sizeof(pixel_t);
+    for (int y=0; y<h; ++y) {
+      pixel_t* dstRow = ((pixel_t*)dst->line[dy+y*scale]) + dx;
+      scale_row<pixel_t>(((const pixel_t*)src->line[sy+y]) + sx,
+                         dstRow, w, scale);
+
+      // Duplicate the scaled row
+      for (int i=1; i<scale; ++i)
+        std::memcpy(((pixel_t*)dst->line[dy+y*scale+i]) + dx, dstRow, rowBytes);
+    }
+  }
+
+} // namespace scale_details
+
+  // Copies the rectangle (sx, sy, w, h) of "src" to (dx, dy) of "dst"
+  // with each pixel repeated scale x scale times. Both must be memory
+  // bitmaps with the same color depth, and "dst" must contain the
+  // scaled rectangle.
+  inline void scale_blit(BITMAP* src, BITMAP* dst,
+                         int sx, int sy, int dx, int dy,
+                         int w, int h, int scale) {
+    ASSERT(bitmap_color_depth(src) == bitmap_color_depth(dst));
+    ASSERT(dx+w*scale <= dst->w && dy+h*scale <= dst->h);
+
+    switch (bitmap_color_depth(src)) {
+      case 8:
+        scale_details::scale_rect<uint8_t>(src, dst, sx, sy, dx, dy, w, h, scale);
+        break;
+      case 15:
+      case 16:
+        scale_details::scale_rect<uint16_t>(src, dst, sx, sy, dx, dy, w, h, scale);
+        break;
+      case 24:
+        for (int y=0; y<h; ++y) {
+          uint8_t* dstRow = dst->line[dy+y*scale] + 3*dx;
+          scale_details::scale_row_24(src->line[sy+y] + 3*sx, dstRow, w, scale);
+          for (int i=1; i<scale; ++i)
+            std::memcpy(dst->line[dy+y*scale+i] + 3*dx, dstRow, 3*w*scale);
+        }
+        break;
+      case 32:
+        scale_details::scale_rect<uint32_t>(src, dst, sx, sy, dx, dy, w, h, scale);
+        break;
+    }
+  }
+
+} // namespace she
+
+#endif
@@ -10,10 +10,14 @@
 
 #include "she/she.h"
 
+#include "base/chrono.h"
 #include "base/concurrent_queue.h"
 #include "base/exception.h"
 #include "base/string.h"
+#include "base/thread.h"
 #include "base/unique_ptr.h"
+#include "gfx/region.h"
+#include "she/alleg4/scale.h"
 #include "she/alleg4/surface.h"
 #include "she/common/system.h"
 #include "she/logger.h"
@@ -122,21 +126,37 @@ public:
     clock_exit();
   }
 
-  void getEvent(Event& event, bool canWait) override {
-    (void)canWait;              // Ignore this parameter
+  void getEvent(Event& event, double timeout) override {
+    base::Chrono chrono;
 
-    close_button_generate_events();
+    for (;;) {
+      close_button_generate_events();
 
 #ifdef USE_KEY_POLLER
-    key_poller_generate_events();
+      key_poller_generate_events();
 #endif
 
 #ifdef USE_MOUSE_POLLER
-    mouse_poller_generate_events();
+      mouse_poller_generate_events();
 #endif
 
-    if (!m_events.try_pop(event))
-      event.setType(Event::None);
+      if (m_events.try_pop(event))
+        return;
+
+      // Allegro 4 doesn't give us a way to wait for input (keyboard
+      // and mouse are polled), so we poll again in short intervals
+      // until the timeout elapses.
+      double elapsed = chrono.elapsed();
+      if (timeout == 0.0 || (timeout > 0.0 && elapsed >= timeout))
+        break;
+
+      double sleep = kPollInterval;
+      if (timeout > 0.0 && timeout - elapsed < sleep)
+        sleep = timeout - elapsed;
+      base::this_thread::sleep_for(sleep);
+    }
+
+    event.setType(Event::None);
   }
 
   void queueEvent(const Event& event) override {
@@ -144,12 +164,18 @@ public:
   }
 
 private:
+  // Seconds between each poll of the input while we are waiting an
+  // event
+  static const double kPollInterval;
+
   // We need a concurrent queue because events are generated in one
   // thread (the thread created by Allegro 4 for the HWND), and
   // consumed in the other thread (the main/program logic thread).
   base::concurrent_queue<Event> m_events;
 };
 
+const double Alleg4EventQueue::kPollInterval = 0.010;
+
 Display* unique_display = NULL;
 int display_scale;
 
@@ -439,6 +465,7 @@ class Alleg4Display : public Display {
 public:
   Alleg4Display(int width, int height, int scale)
     : m_surface(NULL)
+    , m_scaledBmp(NULL)
     , m_scale(0)
     , m_nativeCursor(kNoCursor) {
     unique_display = this;
@@ -488,6 +515,8 @@ public:
 #endif
 
     m_surface->dispose();
+    if (m_scaledBmp)
+      destroy_bitmap(m_scaledBmp);
     set_gfx_mode(GFX_TEXT, 0, 0, 0, 0);
   }
 
@@ -536,6 +565,12 @@ public:
   }
 
   bool flip() override {
+    return flip(gfx::Region(gfx::Rect(0, 0,
+                                      m_surface->width(),
+                                      m_surface->height())));
+  }
+
+  bool flip(const gfx::Region& dirtyRegion) override {
 #ifdef ALLEGRO4_WITH_RESIZE_PATCH
     if (display_flags & DISPLAY_FLAG_WINDOW_RESIZE) {
       display_flags ^= DISPLAY_FLAG_WINDOW_RESIZE;
@@ -550,13 +585,25 @@ public:
 #endif
 
     BITMAP* bmp = reinterpret_cast<BITMAP*>(m_surface->nativeHandle());
-    if (m_scale == 1) {
-      blit(bmp, screen, 0, 0, 0, 0, SCREEN_W, SCREEN_H);
-    }
-    else {
-      stretch_blit(bmp, screen,
-                   0, 0, bmp->w, bmp->h,
-                   0, 0, SCREEN_W, SCREEN_H);
+    gfx::Rect bounds(0, 0, bmp->w, bmp->h);
+
+    for (const gfx::Rect& dirty : dirtyRegion) {
+      gfx::Rect rc = dirty.createIntersection(bounds);
+      if (rc.isEmpty())
+        continue;
+
+      if (m_scale == 1) {
+        blit(bmp, screen, rc.x, rc.y, rc.x, rc.y, rc.w, rc.h);
+      }
+      else {
+        // The dirty rectangle is scaled in a memory bitmap (replicating
+        // pixels) and uploaded to the screen with a regular blit.
+        BITMAP* scaled = scaledBitmap(bmp, rc.w*m_scale, rc.h*m_scale);
+        scale_blit(bmp, scaled, rc.x, rc.y, 0, 0, rc.w, rc.h, m_scale);
+        blit(scaled, screen, 0, 0,
+             rc.x*m_scale, rc.y*m_scale,
+             rc.w*m_scale, rc.h*m_scale);
+      }
     }
 
     return true;
@@ -670,7 +717,25 @@ public:
   }
 
 private:
+  // Returns a memory bitmap (with the color depth of "bmp") to scale
+  // dirty rectangles of at least w x h pixels. It's reused between
+  // flips (it only grows).
+  BITMAP* scaledBitmap(BITMAP* bmp, int w, int h) {
+    if (m_scaledBmp &&
+        (bitmap_color_depth(m_scaledBmp) != bitmap_color_depth(bmp) ||
+         m_scaledBmp->w < w || m_scaledBmp->h < h)) {
+      w = std::max(w, m_scaledBmp->w);
+      h = std::max(h, m_scaledBmp->h);
+      destroy_bitmap(m_scaledBmp);
+      m_scaledBmp = NULL;
+    }
+    if (!m_scaledBmp)
+      m_scaledBmp = create_bitmap_ex(bitmap_color_depth(bmp), w, h);
+    return m_scaledBmp;
+  }
+
   Surface* m_surface;
+  BITMAP* m_scaledBmp;
   int m_scale;
   NativeCursor m_nativeCursor;
 };
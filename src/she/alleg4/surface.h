@@ -14,6 +14,7 @@
 #include "base/string.h"
 #include "gfx/point.h"
 #include "gfx/rect.h"
+#include "she/alleg4/scale.h"
 #include "she/locked_surface.h"
 #include "she/surface.h"
 #include "she/common/locked_surface.h"
@@ -175,9 +176,7 @@ namespace she {
           m_bmp->w*scale,
           m_bmp->h*scale);
 
-      for (int y=0; y<scaled->h; ++y)
-        for (int x=0; x<scaled->w; ++x)
-          putpixel(scaled, x, y, getpixel(m_bmp, x/scale, y/scale));
+      scale_blit(m_bmp, scaled, 0, 0, 0, 0, m_bmp->w, m_bmp->h, scale);
 
       if (m_destroy & DestroyHandle)
         destroy_bitmap(m_bmp);
@@ -365,6 +364,12 @@ namespace she {
       draw_trans_sprite(m_bmp, static_cast<const Alleg4Surface*>(src)->m_bmp, dstx, dsty);
     }
 
+    void drawScaledSurface(const LockedSurface* src, const gfx::Rect& srcRect, const gfx::Rect& dstRect) override {
+      stretch_blit(static_cast<const Alleg4Surface*>(src)->m_bmp, m_bmp,
+                   srcRect.x, srcRect.y, srcRect.w, srcRect.h,
+                   dstRect.x, dstRect.y, dstRect.w, dstRect.h);
+    }
+
   private:
     BITMAP* m_bmp;
     DestroyFlag m_destroy;
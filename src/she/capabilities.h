@@ -14,6 +14,9 @@ namespace she {
     kMultipleDisplaysCapability = 1,
     kCanResizeDisplayCapability = 2,
     kDisplayScaleCapability = 4,
+    // The display surface is drawn by the GPU (e.g. scaled surfaces
+    // are composited in the GPU).
+    kGpuAccelerationCapability = 8,
   };
 
 } // namespace she
@@ -14,6 +14,8 @@
 #include "she/scoped_surface_lock.h"
 #include "she/surface.h"
 
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace she {
@@ -42,12 +44,22 @@ public:
   }
 
   int textLength(const std::string& str) const override {
+    // The same texts are measured on each repaint (labels, menus,
+    // word-wrapped paragraphs, etc.), so we cache their lengths.
+    auto cached = m_textLengths.find(str);
+    if (cached != m_textLengths.end())
+      return cached->second;
+
     base::utf8_const_iterator it(str.begin()), end(str.end());
     int x = 0;
     while (it != end) {
       x += charWidth(*it);
       ++it;
     }
+
+    if (m_textLengths.size() >= kMaxCachedTextLengths)
+      m_textLengths.clear();
+    m_textLengths[str] = x;
     return x;
   }
 
@@ -118,8 +130,11 @@ private:
   }
 
 private:
+  static const std::size_t kMaxCachedTextLengths = 4096;
+
   Surface* m_sheet;
   std::vector<gfx::Rect> m_chars;
+  mutable std::unordered_map<std::string, int> m_textLengths;
 };
 
 } // namespace she
@@ -100,10 +100,17 @@ public:
   }
 
   void drawString(Font* font, gfx::Color fg, gfx::Color bg, int x, int y, const std::string& str) override {
+    CommonFont* commonFont = static_cast<CommonFont*>(font);
+
+    // Lock the glyphs sheet just one time for the whole string
+    ScopedSurfaceLock lock(commonFont->getSurfaceSheet());
+
     base::utf8_const_iterator it(str.begin()), end(str.end());
     while (it != end) {
-      drawChar(font, fg, bg, x, y, *it);
-      x += font->charWidth(*it);
+      gfx::Rect charBounds = commonFont->getCharBounds(*it);
+      if (!charBounds.isEmpty())
+        drawColoredRgbaSurface(lock, fg, bg, gfx::Clip(x, y, charBounds));
+      x += charBounds.w;
       ++it;
     }
   }
@@ -14,6 +14,10 @@
 
 #include <string>
 
+namespace gfx {
+  class Region;
+}
+
 namespace she {
 
   class NonDisposableSurface;
@@ -49,6 +53,10 @@ namespace she {
     // resized.
     virtual bool flip() = 0;
 
+    // Flips only the given region of the surface (in surface
+    // coordinates, without the scale applied).
+    virtual bool flip(const gfx::Region& dirtyRegion) = 0;
+
     virtual void maximize() = 0;
     virtual bool isMaximized() const = 0;
 
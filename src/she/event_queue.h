@@ -15,7 +15,11 @@ namespace she {
   class EventQueue {
   public:
     virtual ~EventQueue() { }
-    virtual void getEvent(Event& ev, bool canWait) = 0;
+
+    // Gets the next event in the queue, or an Event::None event if
+    // there is no event after waiting "timeout" seconds (0 means
+    // don't wait, and a negative value waits until an event arrives).
+    virtual void getEvent(Event& ev, double timeout) = 0;
     virtual void queueEvent(const Event& ev) = 0;
   };
 
@@ -49,6 +49,11 @@ namespace she {
     virtual void drawRgbaSurface(const LockedSurface* src, int dstx, int dsty) = 0;
     virtual void drawColoredRgbaSurface(const LockedSurface* src, gfx::Color fg, gfx::Color bg, const gfx::Clip& clip) = 0;
 
+    // Copies "srcRect" of the "src" surface to "dstRect" (scaling
+    // pixels with nearest-neighbor and without alpha blending). With
+    // kGpuAccelerationCapability the scaling is done by the GPU.
+    virtual void drawScaledSurface(const LockedSurface* src, const gfx::Rect& srcRect, const gfx::Rect& dstRect) = 0;
+
     virtual void drawChar(Font* font, gfx::Color fg, gfx::Color bg, int x, int y, int chr) = 0;
     virtual void drawString(Font* font, gfx::Color fg, gfx::Color bg, int x, int y, const std::string& str) = 0;
   };
@@ -8,19 +8,27 @@
 #define SHE_OSX_EVENT_QUEUE_INCLUDED
 #pragma once
 
-#include "base/concurrent_queue.h"
 #include "she/event.h"
 #include "she/event_queue.h"
 
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+
 namespace she {
 
+// Events are queued from the Cocoa main thread and consumed from the
+// user thread (see OSXApp::run()), so getEvent() can wait until the
+// main thread wakes it up.
 class OSXEventQueue : public EventQueue {
 public:
-  void getEvent(Event& ev, bool canWait) override;
+  void getEvent(Event& ev, double timeout) override;
   void queueEvent(const Event& ev) override;
 
 private:
-  base::concurrent_queue<Event> m_events;
+  std::queue<Event> m_events;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
 };
 
 typedef OSXEventQueue EventQueueImpl;
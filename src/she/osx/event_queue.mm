@@ -16,16 +16,35 @@
 
 namespace she {
 
-void OSXEventQueue::getEvent(Event& ev, bool canWait)
+void OSXEventQueue::getEvent(Event& ev, double timeout)
 {
-  if (!m_events.try_pop(ev)) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  if (m_events.empty() && timeout != 0.0) {
+    if (timeout < 0.0)
+      m_cv.wait(lock, [this]{ return !m_events.empty(); });
+    else
+      m_cv.wait_for(lock,
+                    std::chrono::microseconds(int64_t(timeout * 1000000.0)),
+                    [this]{ return !m_events.empty(); });
+  }
+
+  if (m_events.empty()) {
     ev.setType(Event::None);
   }
+  else {
+    ev = m_events.front();
+    m_events.pop();
+  }
 }
 
 void OSXEventQueue::queueEvent(const Event& ev)
 {
-  m_events.push(ev);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.push(ev);
+  }
+  m_cv.notify_one();
 }
 
 } // namespace she
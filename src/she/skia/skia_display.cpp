@@ -10,6 +10,7 @@
 
 #include "she/skia/skia_display.h"
 
+#include "gfx/region.h"
 #include "she/skia/skia_surface.h"
 #include "she/system.h"
 
@@ -89,16 +90,29 @@ NonDisposableSurface* SkiaDisplay::getSurface()
 // false if the flip couldn't be done because the display was
 // resized.
 bool SkiaDisplay::flip()
+{
+  return flip(gfx::Region(gfx::Rect(0, 0,
+                                    m_surface->width(),
+                                    m_surface->height())));
+}
+
+bool SkiaDisplay::flip(const gfx::Region& dirtyRegion)
 {
   if (m_recreated) {
     m_recreated = false;
     return false;
   }
 
-  m_window.updateWindow();
+  if (!dirtyRegion.isEmpty())
+    m_window.updateWindow(dirtyRegion);
   return true;
 }
 
+bool SkiaDisplay::isGpuAccelerated() const
+{
+  return (m_window.backend() != SkiaWindow::Backend::NONE);
+}
+
 void SkiaDisplay::maximize()
 {
   m_window.maximize();
@@ -44,6 +44,7 @@ public:
   // false if the flip couldn't be done because the display was
   // resized.
   bool flip() override;
+  bool flip(const gfx::Region& dirtyRegion) override;
   void maximize() override;
   bool isMaximized() const override;
   void setTitleBar(const std::string& title) override;
@@ -56,6 +57,10 @@ public:
   // Returns the HWND on Windows.
   DisplayHandle nativeHandle() override;
 
+  // True if the display surface is a GPU render target (the GL
+  // backend of the window is being used).
+  bool isGpuAccelerated() const;
+
 private:
   SkiaWindow m_window;
   SkiaSurface* m_surface;
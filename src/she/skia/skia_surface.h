@@ -385,6 +385,18 @@ public:
       ((SkiaSurface*)src)->m_bitmap, &srcRect, dstRect, &paint);
   }
 
+  void drawScaledSurface(const LockedSurface* src, const gfx::Rect& srcRect, const gfx::Rect& dstRect) override {
+    SkRect srcRc = SkRect::Make(SkIRect::MakeXYWH(srcRect.x, srcRect.y, srcRect.w, srcRect.h));
+    SkRect dstRc = SkRect::Make(SkIRect::MakeXYWH(dstRect.x, dstRect.y, dstRect.w, dstRect.h));
+
+    // Without bitmap filtering (nearest-neighbor)
+    SkPaint paint;
+    paint.setXfermodeMode(SkXfermode::kSrc_Mode);
+
+    m_canvas->drawBitmapRectToRect(
+      ((SkiaSurface*)src)->m_bitmap, &srcRc, dstRc, &paint);
+  }
+
   void drawColoredRgbaSurface(const LockedSurface* src, gfx::Color fg, gfx::Color bg, const gfx::Clip& clipbase) override {
     gfx::Clip clip(clipbase);
     if (!clip.clip(lockedWidth(), lockedHeight(), src->lockedWidth(), src->lockedHeight()))
@@ -423,10 +435,39 @@ public:
   }
 
   void drawString(Font* font, gfx::Color fg, gfx::Color bg, int x, int y, const std::string& str) override {
+    CommonFont* commonFont = static_cast<CommonFont*>(font);
+    int width = commonFont->textLength(str);
+    if (width <= 0)
+      return;
+
+    if (gfx::geta(bg) > 0) {
+      SkPaint paint;
+      paint.setColor(to_skia(bg));
+      paint.setStyle(SkPaint::kFill_Style);
+      m_canvas->drawRect(
+        SkRect::Make(SkIRect::MakeXYWH(x, y, width, commonFont->height())),
+        paint);
+    }
+
+    // Draw all glyphs from the sheet with the same paint
+    ScopedSurfaceLock lock(commonFont->getSurfaceSheet());
+    const SkBitmap& sheet = ((SkiaSurface*)(LockedSurface*)lock)->m_bitmap;
+
+    SkPaint paint;
+    paint.setXfermodeMode(SkXfermode::kSrcOver_Mode);
+    SkAutoTUnref<SkColorFilter> colorFilter(
+      SkColorFilter::CreateModeFilter(to_skia(fg), SkXfermode::kSrcIn_Mode));
+    paint.setColorFilter(colorFilter);
+
     base::utf8_const_iterator it(str.begin()), end(str.end());
     while (it != end) {
-      drawChar(font, fg, bg, x, y, *it);
-      x += font->charWidth(*it);
+      gfx::Rect charBounds = commonFont->getCharBounds(*it);
+      if (!charBounds.isEmpty()) {
+        SkRect srcRect = SkRect::Make(SkIRect::MakeXYWH(charBounds.x, charBounds.y, charBounds.w, charBounds.h));
+        SkRect dstRect = SkRect::Make(SkIRect::MakeXYWH(x, y, charBounds.w, charBounds.h));
+        m_canvas->drawBitmapRectToRect(sheet, &srcRect, dstRect, &paint);
+      }
+      x += charBounds.w;
       ++it;
     }
   }
@@ -48,7 +48,9 @@ public:
     return Capabilities(
       int(kMultipleDisplaysCapability) |
       int(kCanResizeDisplayCapability) |
-      int(kDisplayScaleCapability));
+      int(kDisplayScaleCapability) |
+      (m_defaultDisplay && m_defaultDisplay->isGpuAccelerated() ?
+       int(kGpuAccelerationCapability): 0));
   }
 
   EventQueue* eventQueue() override {
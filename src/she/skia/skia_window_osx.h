@@ -13,6 +13,10 @@
 
 #include <string>
 
+namespace gfx {
+  class Region;
+}
+
 namespace she {
 
 class EventQueue;
@@ -25,6 +29,8 @@ public:
   SkiaWindow(EventQueue* queue, SkiaDisplay* display);
   ~SkiaWindow();
 
+  Backend backend() const { return Backend::NONE; }
+
   int scale() const;
   void setScale(int scale);
   void setVisible(bool visible);
@@ -37,7 +43,7 @@ public:
   void releaseMouse();
   void setMousePosition(const gfx::Point& position);
   void setNativeMouseCursor(NativeCursor cursor);
-  void updateWindow();
+  void updateWindow(const gfx::Region& region);
   void* handle();
 
 private:
@@ -107,9 +107,22 @@ void SkiaWindow::paintHDC(HDC hdc)
   ASSERT(bitmap.width() * bitmap.bytesPerPixel() == bitmap.rowBytes());
   bitmap.lockPixels();
 
+  // Copy only the invalidated area of the window (see
+  // WinWindow::updateWindow())
+  int scale = this->scale();
+  gfx::Rect src(0, 0, bitmap.width(), bitmap.height());
+  RECT clip;
+  if (GetClipBox(hdc, &clip) != NULLREGION &&
+      clip.right > clip.left && clip.bottom > clip.top) {
+    gfx::Rect rc(gfx::Point(clip.left / scale, clip.top / scale),
+                 gfx::Point((clip.right + scale - 1) / scale,
+                            (clip.bottom + scale - 1) / scale));
+    src = src.createIntersection(rc);
+  }
+
   int ret = StretchDIBits(hdc,
-    0, 0, bitmap.width()*scale(), bitmap.height()*scale(),
-    0, 0, bitmap.width(), bitmap.height(),
+    src.x*scale, src.y*scale, src.w*scale, src.h*scale,
+    src.x, src.y, src.w, src.h,
     bitmap.getPixels(),
     &bmi, DIB_RGB_COLORS, SRCCOPY);
   (void)ret;
@@ -28,6 +28,8 @@ public:
   SkiaWindow(EventQueue* queue, SkiaDisplay* display);
   ~SkiaWindow();
 
+  Backend backend() const { return m_backend; }
+
   void queueEventImpl(Event& ev);
   void paintImpl(HDC hdc);
   void resizeImpl(const gfx::Size& size);
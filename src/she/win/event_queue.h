@@ -19,26 +19,26 @@ namespace she {
 
 class WinEventQueue : public EventQueue {
 public:
-  void getEvent(Event& ev, bool canWait) override {
+  void getEvent(Event& ev, double timeout) override {
     MSG msg;
+    bool waited = false;
 
     while (m_events.empty()) {
-      BOOL res;
-
-      if (canWait) {
-        ASSERT(false);          // Not yet supported
-        res = GetMessage(&msg, nullptr, 0, 0);
-      }
-      else {
-        res = PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE);
-      }
-
-      if (res) {
+      if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
         TranslateMessage(&msg);
         DispatchMessage(&msg);
+        continue;
       }
-      else if (!canWait)
+
+      if (timeout == 0.0 || waited)
         break;
+
+      // Sleep until a new message arrives (or the timeout elapses)
+      MsgWaitForMultipleObjectsEx(
+        0, nullptr,
+        (timeout < 0.0 ? INFINITE: DWORD(timeout * 1000.0)),
+        QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+      waited = true;
     }
 
     if (m_events.empty()) {
@@ -13,6 +13,7 @@
 #include <commctrl.h>
 #include <shellapi.h>
 
+#include "gfx/region.h"
 #include "gfx/size.h"
 #include "she/event.h"
 #include "she/keys.h"
@@ -149,8 +150,15 @@ namespace she {
       m_hcursor = hcursor;
     }
 
-    void updateWindow() {
-      InvalidateRect(m_hwnd, NULL, FALSE);
+    // Repaints the given region of the window (in surface
+    // coordinates, i.e. without the scale applied).
+    void updateWindow(const gfx::Region& region) {
+      for (const gfx::Rect& rc : region) {
+        RECT rect = {
+          rc.x*m_scale, rc.y*m_scale,
+          (rc.x+rc.w)*m_scale, (rc.y+rc.h)*m_scale };
+        InvalidateRect(m_hwnd, &rect, FALSE);
+      }
       UpdateWindow(m_hwnd);
     }
 
@@ -0,0 +1,450 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef TESTS_BENCHMARK_H_INCLUDED
+#define TESTS_BENCHMARK_H_INCLUDED
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/chrono.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Minimal harness for *_benchmark.cpp files. It implements a subset
+// of the Google Benchmark API (so benchmarks can be moved to it
+// without changes):
+//
+//   static void BM_Something(benchmark::State& state) {
+//     ...prepare data for state.range_x() and state.range_y()...
+//     while (state.KeepRunning()) {
+//       ...code to measure...
+//     }
+//     state.SetBytesProcessed(state.iterations() * bytes);
+//     state.counters["other_value"] = value;
+//   }
+//   BENCHMARK(BM_Something)->ArgPair(IMAGE_RGB, 256);
+//
+// Include "tests/benchmark_allocs.h" too to count the allocations
+// made by the measured code.
+//
+// Command line options:
+//
+//   --benchmark_filter=<text>   Run benchmarks which name contains <text>
+//   --benchmark_min_time=<sec>  Minimum time to measure each benchmark
+//   --benchmark_format=<fmt>    Output format: console, json or csv
+//   --benchmark_out=<file>      Write the results to <file>
+//
+// The json format uses the same fields as Google Benchmark, so
+// results can be compared with the same scripts. The exit code is 1
+// if some benchmark was stopped with State::SkipWithError().
+
+namespace benchmark {
+
+  class State {
+  public:
+    State(int x, int y, long long maxIterations)
+      : m_x(x), m_y(y)
+      , m_iterations(0)
+      , m_maxIterations(maxIterations)
+      , m_elapsed(0.0)
+      , m_bytes(0)
+      , m_items(0) {
+    }
+
+    // Returns true while more iterations must be measured. The time
+    // is measured from the first call.
+    bool KeepRunning() {
+      if (!m_error.empty())
+        return false;
+
+      if (m_iterations == 0)
+        m_chrono.reset();
+
+      if (m_iterations < m_maxIterations) {
+        ++m_iterations;
+        return true;
+      }
+
+      m_elapsed = m_chrono.elapsed();
+      return false;
+    }
+
+    int range_x() const { return m_x; }
+    int range_y() const { return m_y; }
+    long long iterations() const { return m_iterations; }
+
+    void SetBytesProcessed(long long bytes) { m_bytes = bytes; }
+    void SetItemsProcessed(long long items) { m_items = items; }
+    void SetLabel(const std::string& label) { m_label = label; }
+
+    // Stops the benchmark (the next KeepRunning() returns false) and
+    // reports the error instead of the results.
+    void SkipWithError(const std::string& msg) { m_error = msg; }
+
+    double elapsed() const { return m_elapsed; }
+    long long bytesProcessed() const { return m_bytes; }
+    long long itemsProcessed() const { return m_items; }
+    const std::string& label() const { return m_label; }
+    const std::string& error() const { return m_error; }
+
+    // Other values to report (e.g. time of each phase of the
+    // benchmark)
+    std::map<std::string, double> counters;
+
+  private:
+    int m_x, m_y;
+    long long m_iterations;
+    long long m_maxIterations;
+    base::Chrono m_chrono;
+    double m_elapsed;
+    long long m_bytes;
+    long long m_items;
+    std::string m_label;
+    std::string m_error;
+  };
+
+  typedef void (*Function)(State&);
+
+  class Benchmark {
+  public:
+    struct Args {
+      int n;                    // Number of arguments (0, 1 or 2)
+      int x, y;
+    };
+
+    Benchmark(const char* name, Function func)
+      : m_name(name), m_func(func) {
+    }
+
+    Benchmark* Arg(int x) {
+      Args args = { 1, x, 0 };
+      m_args.push_back(args);
+      return this;
+    }
+
+    Benchmark* ArgPair(int x, int y) {
+      Args args = { 2, x, y };
+      m_args.push_back(args);
+      return this;
+    }
+
+    // Calls "func" to add the same arguments to several benchmarks.
+    Benchmark* Apply(void (*func)(Benchmark*)) {
+      func(this);
+      return this;
+    }
+
+    const std::string& name() const { return m_name; }
+    Function function() const { return m_func; }
+
+    // Returns the arguments of each run (with one run without
+    // arguments if Arg()/ArgPair() were not used).
+    std::vector<Args> runs() const {
+      if (m_args.empty()) {
+        Args args = { 0, 0, 0 };
+        return std::vector<Args>(1, args);
+      }
+      return m_args;
+    }
+
+  private:
+    std::string m_name;
+    Function m_func;
+    std::vector<Args> m_args;
+  };
+
+  inline std::vector<Benchmark*>& benchmarks() {
+    static std::vector<Benchmark*> list;
+    return list;
+  }
+
+  inline Benchmark* register_benchmark(const char* name, Function func) {
+    Benchmark* benchmark = new Benchmark(name, func);
+    benchmarks().push_back(benchmark);
+    return benchmark;
+  }
+
+  // Avoids that the compiler removes the calculation of "value"
+  // because it isn't used.
+  template<typename T>
+  inline void DoNotOptimize(const T& value) {
+    static const volatile void* volatile sink;
+    sink = &value;
+    (void)sink;
+  }
+
+  namespace details {
+
+    struct Result {
+      std::string name;
+      std::string label;
+      long long iterations;
+      double realTime;          // Nanoseconds per iteration
+      double bytesPerSecond;
+      double itemsPerSecond;
+      std::map<std::string, double> counters;
+      std::string error;
+    };
+
+    inline std::string escape_json(const std::string& s) {
+      std::string res;
+      for (std::string::const_iterator it=s.begin(); it!=s.end(); ++it) {
+        if (*it == '\n')
+          res += "\\n";
+        else {
+          if (*it == '"' || *it == '\\')
+            res.push_back('\\');
+          res.push_back(*it);
+        }
+      }
+      return res;
+    }
+
+    // Name of a run, e.g. "BM_Something/0/256"
+    inline std::string run_name(const Benchmark* benchmark, const Benchmark::Args& args) {
+      std::string name = benchmark->name();
+      if (args.n >= 1) name += "/" + std::to_string(args.x);
+      if (args.n >= 2) name += "/" + std::to_string(args.y);
+      return name;
+    }
+
+    inline Result run(const Benchmark* benchmark, const Benchmark::Args& args, double minTime) {
+      Result result;
+      result.name = run_name(benchmark, args);
+
+      // Increase the number of iterations until the measured time is
+      // enough to be significant.
+      long long iterations = 1;
+      for (;;) {
+        State state(args.x, args.y, iterations);
+        benchmark->function()(state);
+
+        double elapsed = state.elapsed();
+        if (!state.error().empty()) {
+          result.error = state.error();
+          result.iterations = 0;
+          result.realTime = 0.0;
+          result.bytesPerSecond = 0.0;
+          result.itemsPerSecond = 0.0;
+          return result;
+        }
+
+        if (elapsed >= minTime || iterations >= 1000000000LL) {
+          result.label = state.label();
+          result.iterations = state.iterations();
+          result.realTime = 1e9 * elapsed / double(state.iterations());
+          result.bytesPerSecond = (elapsed > 0.0 ? double(state.bytesProcessed()) / elapsed: 0.0);
+          result.itemsPerSecond = (elapsed > 0.0 ? double(state.itemsProcessed()) / elapsed: 0.0);
+          result.counters = state.counters;
+          return result;
+        }
+
+        double multiplier = 10.0;
+        if (elapsed > minTime / 100.0)
+          multiplier = 1.4 * minTime / elapsed;
+        iterations = std::max(iterations+1, (long long)(double(iterations) * multiplier));
+        if (iterations > 1000000000LL)
+          iterations = 1000000000LL;
+      }
+    }
+
+    inline void print_console(FILE* f, const Result& r) {
+      if (!r.error.empty()) {
+        std::fprintf(f, "%-40s ERROR: %s\n", r.name.c_str(), r.error.c_str());
+        return;
+      }
+
+      std::fprintf(f, "%-40s %14.0f ns %12lld", r.name.c_str(), r.realTime, r.iterations);
+      if (r.bytesPerSecond > 0.0)
+        std::fprintf(f, " %10.2f MB/s", r.bytesPerSecond / (1024.0*1024.0));
+      if (r.itemsPerSecond > 0.0)
+        std::fprintf(f, " %10.2f M items/s", r.itemsPerSecond / 1e6);
+      for (const auto& counter : r.counters)
+        std::fprintf(f, " %s=%g", counter.first.c_str(), counter.second);
+      if (!r.label.empty())
+        std::fprintf(f, " %s", r.label.c_str());
+      std::fprintf(f, "\n");
+    }
+
+    // Counters are in the last column as "name=value;name=value"
+    inline void print_csv(FILE* f, const Result& r) {
+      std::fprintf(f, "\"%s\",%lld,%.2f,ns,%.0f,%.0f,\"%s\",\"",
+                   escape_json(r.name).c_str(), r.iterations, r.realTime,
+                   r.bytesPerSecond, r.itemsPerSecond,
+                   escape_json(r.error.empty() ? r.label: "ERROR: " + r.error).c_str());
+      for (std::map<std::string, double>::const_iterator
+             it=r.counters.begin(); it!=r.counters.end(); ++it)
+        std::fprintf(f, "%s%s=%g", (it == r.counters.begin() ? "": ";"),
+                     it->first.c_str(), it->second);
+      std::fprintf(f, "\"\n");
+    }
+
+    inline void print_json(FILE* f, const Result& r, bool first) {
+      if (!r.error.empty()) {
+        std::fprintf(f, "%s    {\n"
+                     "      \"name\": \"%s\",\n"
+                     "      \"error_occurred\": true,\n"
+                     "      \"error_message\": \"%s\"\n"
+                     "    }",
+                     (first ? "": ",\n"),
+                     escape_json(r.name).c_str(),
+                     escape_json(r.error).c_str());
+        return;
+      }
+
+      std::fprintf(f, "%s    {\n"
+                   "      \"name\": \"%s\",\n"
+                   "      \"iterations\": %lld,\n"
+                   "      \"real_time\": %.2f,\n"
+                   "      \"time_unit\": \"ns\"",
+                   (first ? "": ",\n"),
+                   escape_json(r.name).c_str(), r.iterations, r.realTime);
+      if (r.bytesPerSecond > 0.0)
+        std::fprintf(f, ",\n      \"bytes_per_second\": %.0f", r.bytesPerSecond);
+      if (r.itemsPerSecond > 0.0)
+        std::fprintf(f, ",\n      \"items_per_second\": %.0f", r.itemsPerSecond);
+      for (const auto& counter : r.counters)
+        std::fprintf(f, ",\n      \"%s\": %g", escape_json(counter.first).c_str(), counter.second);
+      if (!r.label.empty())
+        std::fprintf(f, ",\n      \"label\": \"%s\"", escape_json(r.label).c_str());
+      std::fprintf(f, "\n    }");
+    }
+
+  } // namespace details
+
+} // namespace benchmark
+
+#ifdef LINKED_WITH_SHE
+  #undef main
+  #ifdef _WIN32
+    int main(int argc, char* argv[]) {
+      extern int app_main(int argc, char* argv[]);
+      return app_main(argc, argv);
+    }
+  #endif
+  #define main app_main
+#endif
+
+#define BENCHMARK(func)                                                 \
+  static benchmark::Benchmark* benchmark_##func =                       \
+    benchmark::register_benchmark(#func, func)
+
+int main(int argc, char* argv[])
+{
+  using namespace benchmark;
+
+  std::string filter;
+  std::string format = "console";
+  std::string out;
+  double minTime = 0.5;
+
+  for (int i=1; i<argc; ++i) {
+    std::string arg = argv[i];
+    std::string value = (arg.find('=') != std::string::npos ? arg.substr(arg.find('=')+1): "");
+
+    if (arg.find("--benchmark_filter=") == 0)
+      filter = (value == "." || value == "all" ? "": value);
+    else if (arg.find("--benchmark_min_time=") == 0)
+      minTime = std::atof(value.c_str());
+    else if (arg.find("--benchmark_format=") == 0)
+      format = value;
+    else if (arg.find("--benchmark_out=") == 0)
+      out = value;
+    else {
+      std::fprintf(stderr,
+                   "Usage: %s [--benchmark_filter=<text>] [--benchmark_min_time=<sec>]\n"
+                   "       [--benchmark_format=console|json|csv] [--benchmark_out=<file>]\n",
+                   argv[0]);
+      return 1;
+    }
+  }
+
+  if (format != "console" && format != "json" && format != "csv") {
+    std::fprintf(stderr, "Invalid format '%s'\n", format.c_str());
+    return 1;
+  }
+
+  FILE* f = stdout;
+  if (!out.empty()) {
+    f = std::fopen(out.c_str(), "w");
+    if (!f) {
+      std::fprintf(stderr, "Error opening '%s'\n", out.c_str());
+      return 1;
+    }
+  }
+
+  if (format == "json") {
+    char date[64];
+    std::time_t now = std::time(NULL);
+    std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+
+    std::fprintf(f, "{\n"
+                 "  \"context\": {\n"
+                 "    \"date\": \"%s\",\n"
+                 "    \"executable\": \"%s\",\n"
+                 "    \"num_cpus\": %d,\n"
+#ifdef NDEBUG
+                 "    \"library_build_type\": \"release\"\n"
+#else
+                 "    \"library_build_type\": \"debug\"\n"
+#endif
+                 "  },\n"
+                 "  \"benchmarks\": [\n",
+                 date,
+                 details::escape_json(argv[0]).c_str(),
+                 int(std::thread::hardware_concurrency()));
+  }
+  else if (format == "csv")
+    std::fprintf(f, "name,iterations,real_time,time_unit,bytes_per_second,items_per_second,label,counters\n");
+
+  bool first = true;
+  bool errors = false;
+  for (const Benchmark* benchmark : benchmarks()) {
+    for (const Benchmark::Args& args : benchmark->runs()) {
+      if (!filter.empty() &&
+          details::run_name(benchmark, args).find(filter) == std::string::npos)
+        continue;
+
+      details::Result result = details::run(benchmark, args, minTime);
+      if (!result.error.empty())
+        errors = true;
+
+      if (format == "json")
+        details::print_json(f, result, first);
+      else if (format == "csv")
+        details::print_csv(f, result);
+      else
+        details::print_console(f, result);
+      std::fflush(f);
+      first = false;
+    }
+  }
+
+  if (format == "json")
+    std::fprintf(f, "\n  ]\n}\n");
+
+  if (f != stdout)
+    std::fclose(f);
+
+  for (Benchmark* benchmark : benchmarks())
+    delete benchmark;
+  benchmarks().clear();
+  return (errors ? 1: 0);
+}
+
+#endif
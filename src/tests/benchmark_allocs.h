@@ -0,0 +1,59 @@
+// Aseprite
+// Copyright (C) 2001-2015  David Capello
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 2 as
+// published by the Free Software Foundation.
+
+#ifndef TESTS_BENCHMARK_ALLOCS_H_INCLUDED
+#define TESTS_BENCHMARK_ALLOCS_H_INCLUDED
+#pragma once
+
+#include "base/memory.h"
+#include "tests/benchmark.h"
+
+// Counts the allocations of a benchmark with the allocation
+// profiling of base/memory.cpp:
+//
+//   benchmark::AllocCounter allocs;
+//   while (state.KeepRunning()) {
+//     ...
+//   }
+//   double n = allocs.perIteration(state);
+//   state.counters["allocs"] = n;
+//
+// (perIteration() is called before counters[] so the allocation of
+// the counter isn't counted.)
+
+namespace benchmark {
+
+  // Allocations since it was created (e.g. excluding the
+  // allocations to prepare the data of the benchmark).
+  class AllocCounter {
+  public:
+    AllocCounter() : m_oldProfiling(base::alloc_profiling()) {
+      base::set_alloc_profiling(true);
+      m_start = base::alloc_count();
+    }
+
+    ~AllocCounter() {
+      base::set_alloc_profiling(m_oldProfiling);
+    }
+
+    long long count() const {
+      return (long long)(base::alloc_count() - m_start);
+    }
+
+    double perIteration(const State& state) const {
+      return (state.iterations() > 0 ?
+              double(count()) / double(state.iterations()): 0.0);
+    }
+
+  private:
+    bool m_oldProfiling;
+    uint64_t m_start;
+  };
+
+} // namespace benchmark
+
+#endif
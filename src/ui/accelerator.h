@@ -28,6 +28,12 @@ namespace ui {
     bool isPressed(KeyModifiers modifiers, KeyScancode scancode, int unicodeChar) const;
     bool isPressed() const;
 
+    // Converts the values of a keyboard message to the values that
+    // are compared with the accelerator fields in isPressed(), e.g.
+    // Ctrl+letter is converted to the unicode letter without
+    // scancode.
+    static void preprocessKey(KeyModifiers& modifiers, KeyScancode& scancode, int& unicodeChar);
+
     bool operator==(const Accelerator& other) const;
     bool operator!=(const Accelerator& other) const {
       return !operator==(other);
@@ -65,6 +65,7 @@ void ButtonBase::setIconInterface(IButtonIcon* iconInterface)
 
   m_iconInterface = iconInterface;
 
+  invalidateLayout();
   invalidate();
 }
 
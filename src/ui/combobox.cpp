@@ -87,6 +87,10 @@ ComboBox::ComboBox()
   // TODO this separation should be from the Theme*
   this->child_spacing = 0;
 
+  // The preferred size depends on the text of the items (which are
+  // not children of the combobox)
+  disableSizeCache();
+
   m_entry->setExpansive(true);
 
   // When the "m_button" is clicked ("Click" signal) call onButtonClick() method
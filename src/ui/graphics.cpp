@@ -21,10 +21,32 @@
 #include "she/scoped_surface_lock.h"
 #include "she/surface.h"
 #include "she/system.h"
+#include "ui/system.h"
 #include "ui/theme.h"
 
 namespace ui {
 
+// Removes the '&' marks of a UI string ("&&" is a '&' character),
+// returning the byte position (in "text") of the underscored
+// character (or std::string::npos).
+static void remove_mnemonic_marks(const std::string& str,
+                                  std::string& text,
+                                  std::size_t& underscored)
+{
+  text.reserve(str.size());
+  underscored = std::string::npos;
+
+  for (std::size_t i=0; i<str.size(); ++i) {
+    if (str[i] == '&') {
+      if (++i == str.size())
+        break;
+      if (str[i] != '&')
+        underscored = text.size();
+    }
+    text.push_back(str[i]);
+  }
+}
+
 Graphics::Graphics(she::Surface* surface, int dx, int dy)
   : m_surface(surface)
   , m_dx(dx)
@@ -32,6 +54,13 @@ Graphics::Graphics(she::Surface* surface, int dx, int dy)
 {
 }
 
+// Adds the given bounds (in surface coordinates) to the modified
+// area of the surface.
+void Graphics::dirty(const gfx::Rect& bounds)
+{
+  m_dirtyBounds |= bounds;
+}
+
 Graphics::~Graphics()
 {
 }
@@ -86,18 +115,21 @@ void Graphics::putPixel(gfx::Color color, int x, int y)
 {
   she::ScopedSurfaceLock dst(m_surface);
   dst->putPixel(color, m_dx+x, m_dy+y);
+  dirty(gfx::Rect(m_dx+x, m_dy+y, 1, 1));
 }
 
 void Graphics::drawHLine(gfx::Color color, int x, int y, int w)
 {
   she::ScopedSurfaceLock dst(m_surface);
   dst->drawHLine(color, m_dx+x, m_dy+y, w);
+  dirty(gfx::Rect(m_dx+x, m_dy+y, w, 1));
 }
 
 void Graphics::drawVLine(gfx::Color color, int x, int y, int h)
 {
   she::ScopedSurfaceLock dst(m_surface);
   dst->drawVLine(color, m_dx+x, m_dy+y, h);
+  dirty(gfx::Rect(m_dx+x, m_dy+y, 1, h));
 }
 
 void Graphics::drawLine(gfx::Color color, const gfx::Point& a, const gfx::Point& b)
@@ -106,18 +138,22 @@ void Graphics::drawLine(gfx::Color color, const gfx::Point& a, const gfx::Point&
   dst->drawLine(color,
     gfx::Point(m_dx+a.x, m_dy+a.y),
     gfx::Point(m_dx+b.x, m_dy+b.y));
+  dirty(gfx::Rect(gfx::Point(m_dx+a.x, m_dy+a.y),
+                  gfx::Point(m_dx+b.x, m_dy+b.y)).inflate(1, 1));
 }
 
 void Graphics::drawRect(gfx::Color color, const gfx::Rect& rc)
 {
   she::ScopedSurfaceLock dst(m_surface);
   dst->drawRect(color, gfx::Rect(rc).offset(m_dx, m_dy));
+  dirty(gfx::Rect(rc).offset(m_dx, m_dy));
 }
 
 void Graphics::fillRect(gfx::Color color, const gfx::Rect& rc)
 {
   she::ScopedSurfaceLock dst(m_surface);
   dst->fillRect(color, gfx::Rect(rc).offset(m_dx, m_dy));
+  dirty(gfx::Rect(rc).offset(m_dx, m_dy));
 }
 
 void Graphics::fillRegion(gfx::Color color, const gfx::Region& rgn)
@@ -143,6 +179,7 @@ void Graphics::drawSurface(she::Surface* surface, int x, int y)
   she::ScopedSurfaceLock src(surface);
   she::ScopedSurfaceLock dst(m_surface);
   dst->drawSurface(src, m_dx+x, m_dy+y);
+  dirty(gfx::Rect(m_dx+x, m_dy+y, surface->width(), surface->height()));
 }
 
 void Graphics::drawRgbaSurface(she::Surface* surface, int x, int y)
@@ -150,6 +187,7 @@ void Graphics::drawRgbaSurface(she::Surface* surface, int x, int y)
   she::ScopedSurfaceLock src(surface);
   she::ScopedSurfaceLock dst(m_surface);
   dst->drawRgbaSurface(src, m_dx+x, m_dy+y);
+  dirty(gfx::Rect(m_dx+x, m_dy+y, surface->width(), surface->height()));
 }
 
 void Graphics::drawColoredRgbaSurface(she::Surface* surface, gfx::Color color, int x, int y)
@@ -158,6 +196,15 @@ void Graphics::drawColoredRgbaSurface(she::Surface* surface, gfx::Color color, i
   she::ScopedSurfaceLock dst(m_surface);
   dst->drawColoredRgbaSurface(src, color, gfx::ColorNone,
     gfx::Clip(m_dx+x, m_dy+y, 0, 0, surface->width(), surface->height()));
+  dirty(gfx::Rect(m_dx+x, m_dy+y, surface->width(), surface->height()));
+}
+
+void Graphics::drawScaledSurface(she::Surface* surface, const gfx::Rect& srcRect, const gfx::Rect& dstRect)
+{
+  she::ScopedSurfaceLock src(surface);
+  she::ScopedSurfaceLock dst(m_surface);
+  dst->drawScaledSurface(src, srcRect, gfx::Rect(dstRect).offset(m_dx, m_dy));
+  dirty(gfx::Rect(dstRect).offset(m_dx, m_dy));
 }
 
 void Graphics::blit(she::Surface* srcSurface, int srcx, int srcy, int dstx, int dsty, int w, int h)
@@ -165,6 +212,7 @@ void Graphics::blit(she::Surface* srcSurface, int srcx, int srcy, int dstx, int
   she::ScopedSurfaceLock src(srcSurface);
   she::ScopedSurfaceLock dst(m_surface);
   src->blitTo(dst, srcx, srcy, m_dx+dstx, m_dy+dsty, w, h);
+  dirty(gfx::Rect(m_dx+dstx, m_dy+dsty, w, h));
 }
 
 void Graphics::setFont(she::Font* font)
@@ -176,40 +224,40 @@ void Graphics::drawChar(int chr, gfx::Color fg, gfx::Color bg, int x, int y)
 {
   she::ScopedSurfaceLock dst(m_surface);
   dst->drawChar(m_font, fg, bg, m_dx+x, m_dy+y, chr);
+  dirty(gfx::Rect(m_dx+x, m_dy+y, m_font->charWidth(chr), m_font->height()));
 }
 
 void Graphics::drawString(const std::string& str, gfx::Color fg, gfx::Color bg, const gfx::Point& pt)
 {
   she::ScopedSurfaceLock dst(m_surface);
   dst->drawString(m_font, fg, bg, m_dx+pt.x, m_dy+pt.y, str);
+  dirty(gfx::Rect(m_dx+pt.x, m_dy+pt.y, m_font->textLength(str), m_font->height()));
 }
 
 void Graphics::drawUIString(const std::string& str, gfx::Color fg, gfx::Color bg, const gfx::Point& pt)
 {
+  // Remove the '&' marks, so the whole text can be drawn as one run
+  std::string text;
+  std::size_t underscored = std::string::npos;
+  remove_mnemonic_marks(str, text, underscored);
+
   she::ScopedSurfaceLock dst(m_surface);
-  base::utf8_const_iterator it(str.begin()), end(str.end());
   int x = m_dx+pt.x;
   int y = m_dy+pt.y;
-  int underscored_x;
-  int underscored_w = -1;
-
-  while (it != end) {
-    if (*it == '&') {
-      ++it;
-      if (it != end && *it != '&') {
-        underscored_x = x;
-        underscored_w = m_font->charWidth(*it);
-      }
+  int w = m_font->textLength(text);
+
+  dst->drawString(m_font, fg, bg, x, y, text);
+  dirty(gfx::Rect(x, y, w, m_font->height()+guiscale()));
+
+  if (underscored != std::string::npos) {
+    int underscored_x = x + m_font->textLength(text.substr(0, underscored));
+    int underscored_w = m_font->charWidth(
+      *base::utf8_const_iterator(text.begin()+underscored));
+    if (underscored_w > 0) {
+      y += m_font->height();
+      dst->fillRect(fg,
+        gfx::Rect(underscored_x, y, underscored_w, guiscale()));
     }
-    dst->drawChar(m_font, fg, bg, x, y, *it);
-    x += m_font->charWidth(*it);
-    ++it;
-  }
-
-  if (underscored_w > 0) {
-    y += m_font->height();
-    dst->fillRect(fg,
-      gfx::Rect(underscored_x, y, underscored_w, guiscale()));
   }
 }
 
@@ -235,18 +283,14 @@ gfx::Size Graphics::measureUIString(const std::string& str)
 // static
 int Graphics::measureUIStringLength(const std::string& str, she::Font* font)
 {
-  base::utf8_const_iterator it(str.begin()), end(str.end());
-  int length = 0;
-
-  while (it != end) {
-    if (*it == '&')
-      ++it;
-
-    length += font->charWidth(*it);
-    ++it;
-  }
+  // Fonts cache the length of the measured texts
+  if (str.find('&') == std::string::npos)
+    return font->textLength(str);
 
-  return length;
+  std::string text;
+  std::size_t underscored;
+  remove_mnemonic_marks(str, text, underscored);
+  return font->textLength(text);
 }
 
 gfx::Size Graphics::fitString(const std::string& str, int maxWidth, int align)
@@ -365,6 +409,11 @@ ScreenGraphics::ScreenGraphics()
 
 ScreenGraphics::~ScreenGraphics()
 {
+  // Everything we've drawn directly in the screen must be flipped
+  gfx::Rect bounds = getDirtyBounds().createIntersection(
+    gfx::Rect(0, 0, width(), height()));
+  if (!bounds.isEmpty())
+    add_dirty_display_region(gfx::Region(bounds));
 }
 
 } // namespace ui
@@ -69,6 +69,7 @@ namespace ui {
     void drawSurface(she::Surface* surface, int x, int y);
     void drawRgbaSurface(she::Surface* surface, int x, int y);
     void drawColoredRgbaSurface(she::Surface* surface, gfx::Color color, int x, int y);
+    void drawScaledSurface(she::Surface* surface, const gfx::Rect& srcRect, const gfx::Rect& dstRect);
 
     void blit(she::Surface* src, int srcx, int srcy, int dstx, int dsty, int w, int h);
 
@@ -89,13 +90,19 @@ namespace ui {
     static int measureUIStringLength(const std::string& str, she::Font* font);
     gfx::Size fitString(const std::string& str, int maxWidth, int align);
 
+    // Returns the bounds (in surface coordinates) of everything that
+    // was drawn with this Graphics.
+    const gfx::Rect& getDirtyBounds() const { return m_dirtyBounds; }
+
   private:
+    void dirty(const gfx::Rect& bounds);
     gfx::Size doUIStringAlgorithm(const std::string& str, gfx::Color fg, gfx::Color bg, const gfx::Rect& rc, int align, bool draw);
 
     she::Surface* m_surface;
     int m_dx;
     int m_dy;
     gfx::Rect m_clipBounds;
+    gfx::Rect m_dirtyBounds;
     she::Font* m_font;
   };
 
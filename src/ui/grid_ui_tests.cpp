@@ -194,3 +194,47 @@ TEST(Grid, Intrincate3x3Grid)
 
   delete grid;
 }
+
+// Tests that the cached preferred size and layout of the grid are
+// updated when a child changes.
+TEST(Grid, UpdateCachedLayout)
+{
+  Grid* grid = new Grid(2, false);
+  Widget* w1 = new Widget(kGenericWidget);
+  Widget* w2 = new Widget(kGenericWidget);
+
+  w1->setMinSize(gfx::Size(10, 10));
+  w2->setMinSize(gfx::Size(10, 10));
+
+  grid->addChildInCell(w1, 1, 1, 0);
+  grid->addChildInCell(w2, 1, 1, 0);
+
+  Size reqSize = grid->getPreferredSize();
+  EXPECT_EQ(20, reqSize.w);
+  EXPECT_EQ(10, reqSize.h);
+
+  grid->setBounds(gfx::Rect(0, 0, 40, 20));
+  EXPECT_EQ(10, w1->getBounds().w);
+  EXPECT_EQ(10, w2->getBounds().x);
+
+  // Change the size of the first child (the grid is laid out again
+  // in the same bounds)
+  w1->setMinSize(gfx::Size(20, 15));
+  reqSize = grid->getPreferredSize();
+  EXPECT_EQ(30, reqSize.w);
+  EXPECT_EQ(15, reqSize.h);
+
+  grid->setBounds(gfx::Rect(0, 0, 40, 20));
+  EXPECT_EQ(20, w1->getBounds().w);
+  EXPECT_EQ(20, w2->getBounds().x);
+
+  // Add a new child
+  Widget* w3 = new Widget(kGenericWidget);
+  w3->setMinSize(gfx::Size(5, 30));
+  grid->addChildInCell(w3, 1, 1, 0);
+  reqSize = grid->getPreferredSize();
+  EXPECT_EQ(30, reqSize.w);
+  EXPECT_EQ(45, reqSize.h);
+
+  delete grid;
+}
@@ -24,13 +24,59 @@ using namespace gfx;
 
 ListBox::ListBox()
   : Widget(kListBoxWidget)
+  , m_model(nullptr)
+  , m_fixedItemHeight(0)
+  , m_itemHeight(0)
+  , m_maxItemWidth(0)
+  , m_selected(-1)
 {
   setFocusStop(true);
   initTheme();
 }
 
+void ListBox::setModel(ListBoxModel* model, int itemHeight)
+{
+  ASSERT(m_model || getChildren().empty());
+
+  m_model = model;
+  m_fixedItemHeight = itemHeight;
+
+  // The preferred size depends on the number of items of the model
+  disableSizeCache();
+  resetItems();
+}
+
+void ListBox::resetItems()
+{
+  ASSERT(m_model);
+
+  for (auto& item : m_modelItems) {
+    removeChild(item.second);
+    item.second->deferDelete();
+  }
+  m_modelItems.clear();
+
+  // Measure the first item again (it can be a different one)
+  m_itemHeight = m_fixedItemHeight;
+  m_maxItemWidth = 0;
+
+  if (m_selected >= (int)getItemsCount())
+    m_selected = -1;
+
+  View* view = View::getView(this);
+  if (view)
+    view->updateView();
+  else if (!getBounds().isEmpty())
+    layout();
+}
+
 Widget* ListBox::getSelectedChild()
 {
+  if (m_model) {
+    auto it = m_modelItems.find(m_selected);
+    return (it != m_modelItems.end() ? it->second: nullptr);
+  }
+
   for (Widget* child : getChildren())
     if (child->isSelected())
       return child;
@@ -40,6 +86,9 @@ Widget* ListBox::getSelectedChild()
 
 int ListBox::getSelectedIndex()
 {
+  if (m_model)
+    return m_selected;
+
   int i = 0;
 
   for (Widget* child : getChildren()) {
@@ -54,6 +103,13 @@ int ListBox::getSelectedIndex()
 
 void ListBox::selectChild(Widget* item)
 {
+  if (m_model) {
+    int index = (item ? getItemIndex(item): -1);
+    if (!item || index >= 0)
+      selectModelItem(index);
+    return;
+  }
+
   for (Widget* child : getChildren()) {
     if (child->isSelected()) {
       if (item && child == item)
@@ -64,22 +120,8 @@ void ListBox::selectChild(Widget* item)
   }
 
   if (item) {
-    View* view = View::getView(this);
-
     item->setSelected(true);
-
-    if (view) {
-      gfx::Rect vp = view->getViewportBounds();
-      gfx::Point scroll = view->getViewScroll();
-
-      if (item->getBounds().y < vp.y)
-        scroll.y = item->getBounds().y - getBounds().y;
-      else if (item->getBounds().y > vp.y + vp.h - item->getBounds().h)
-        scroll.y = (item->getBounds().y - getBounds().y
-                    - vp.h + item->getBounds().h);
-
-      view->setViewScroll(scroll);
-    }
+    makeItemVisible(item->getBounds());
   }
 
   onChangeSelectedItem();
@@ -87,32 +129,40 @@ void ListBox::selectChild(Widget* item)
 
 void ListBox::selectIndex(int index)
 {
-  const WidgetsList& children = getChildren();
-  if (index < 0 || index >= (int)children.size())
+  if (index < 0 || index >= (int)getItemsCount())
+    return;
+
+  if (m_model) {
+    selectModelItem(index);
     return;
+  }
 
-  ListItem* child = static_cast<ListItem*>(children[index]);
+  ListItem* child = static_cast<ListItem*>(getChildren()[index]);
   ASSERT(child);
   selectChild(child);
 }
 
 std::size_t ListBox::getItemsCount() const
 {
-  return getChildren().size();
+  if (m_model)
+    return m_model->getItemsCount();
+  else
+    return getChildren().size();
 }
 
 // Setup the scroll to center the selected item in the viewport
 void ListBox::centerScroll()
 {
   View* view = View::getView(this);
-  Widget* item = getSelectedChild();
+  int index = getSelectedIndex();
 
-  if (view && item) {
+  if (view && index >= 0) {
     gfx::Rect vp = view->getViewportBounds();
     gfx::Point scroll = view->getViewScroll();
+    gfx::Rect itemBounds = getItemBounds(index);
 
-    scroll.y = ((item->getBounds().y - getBounds().y)
-                - vp.h/2 + item->getBounds().h/2);
+    scroll.y = ((itemBounds.y - getBounds().y)
+                - vp.h/2 + itemBounds.h/2);
 
     view->setViewScroll(scroll);
   }
@@ -124,6 +174,9 @@ inline bool sort_by_text(Widget* a, Widget* b) {
 
 void ListBox::sortItems()
 {
+  // The model must sort its items
+  ASSERT(!m_model);
+
   WidgetsList widgets = getChildren();
   std::sort(widgets.begin(), widgets.end(), &sort_by_text);
 
@@ -202,10 +255,10 @@ bool ListBox::onProcessMessage(Message* msg)
     }
 
     case kKeyDownMessage:
-      if (hasFocus() && !getChildren().empty()) {
+      if (hasFocus() && getItemsCount() > 0) {
         int select = getSelectedIndex();
         View* view = View::getView(this);
-        int bottom = MAX(0, getChildren().size()-1);
+        int bottom = MAX(0, int(getItemsCount())-1);
         KeyMessage* keymsg = static_cast<KeyMessage*>(msg);
 
         switch (keymsg->scancode()) {
@@ -281,6 +334,11 @@ void ListBox::onResize(ResizeEvent& ev)
 {
   setBoundsQuietly(ev.getBounds());
 
+  if (m_model) {
+    updateModelItems();
+    return;
+  }
+
   Rect cpos = getChildrenBounds();
 
   UI_FOREACH_WIDGET(getChildren(), it) {
@@ -297,11 +355,24 @@ void ListBox::onPreferredSize(PreferredSizeEvent& ev)
 {
   int w = 0, h = 0;
 
-  UI_FOREACH_WIDGET_WITH_END(getChildren(), it, end) {
-    Size reqSize = static_cast<ListItem*>(*it)->getPreferredSize();
+  if (m_model) {
+    int count = int(getItemsCount());
+    if (count > 0) {
+      measureModelItem();
 
-    w = MAX(w, reqSize.w);
-    h += reqSize.h + (it+1 != end ? this->child_spacing: 0);
+      // Only the width of the created items is known
+      w = m_maxItemWidth;
+      h = count*m_itemHeight + (count-1)*this->child_spacing;
+    }
+  }
+
+  else {
+    UI_FOREACH_WIDGET_WITH_END(getChildren(), it, end) {
+      Size reqSize = static_cast<ListItem*>(*it)->getPreferredSize();
+
+      w = MAX(w, reqSize.w);
+      h += reqSize.h + (it+1 != end ? this->child_spacing: 0);
+    }
   }
 
   w += this->border_width.l + this->border_width.r;
@@ -320,4 +391,134 @@ void ListBox::onDoubleClickItem()
   DoubleClickItem();
 }
 
+int ListBox::getItemIndex(Widget* item)
+{
+  if (m_model) {
+    for (const auto& modelItem : m_modelItems)
+      if (modelItem.second == item)
+        return modelItem.first;
+  }
+  else {
+    int i = 0;
+    for (Widget* child : getChildren()) {
+      if (child == item)
+        return i;
+      ++i;
+    }
+  }
+  return -1;
+}
+
+gfx::Rect ListBox::getItemBounds(int index)
+{
+  if (m_model) {
+    measureModelItem();
+
+    gfx::Rect rc = getChildrenBounds();
+    rc.y += index*(m_itemHeight + this->child_spacing);
+    rc.h = m_itemHeight;
+    return rc;
+  }
+  else
+    return getChildren()[index]->getBounds();
+}
+
+void ListBox::makeItemVisible(const gfx::Rect& itemBounds)
+{
+  View* view = View::getView(this);
+  if (!view)
+    return;
+
+  gfx::Rect vp = view->getViewportBounds();
+  gfx::Point scroll = view->getViewScroll();
+
+  if (itemBounds.y < vp.y)
+    scroll.y = itemBounds.y - getBounds().y;
+  else if (itemBounds.y > vp.y + vp.h - itemBounds.h)
+    scroll.y = (itemBounds.y - getBounds().y
+                - vp.h + itemBounds.h);
+
+  view->setViewScroll(scroll);
+}
+
+void ListBox::selectModelItem(int index)
+{
+  if (index >= 0 && index == m_selected)
+    return;
+
+  m_selected = index;
+  for (auto& item : m_modelItems)
+    item.second->setSelected(item.first == index);
+
+  if (index >= 0)
+    makeItemVisible(getItemBounds(index));
+
+  onChangeSelectedItem();
+}
+
+// Calculates the height of all items using the first one
+void ListBox::measureModelItem()
+{
+  if (m_itemHeight > 0 || getItemsCount() == 0)
+    return;
+
+  ListItem*& item = m_modelItems[0];
+  if (!item) {
+    item = m_model->createItem(0);
+    item->setSelected(m_selected == 0);
+    addChild(item);
+  }
+
+  gfx::Size sz = item->getPreferredSize();
+  m_itemHeight = MAX(1, sz.h);
+  m_maxItemWidth = MAX(m_maxItemWidth, sz.w);
+}
+
+void ListBox::updateModelItems()
+{
+  measureModelItem();
+
+  const int step = m_itemHeight + this->child_spacing;
+  Rect cpos = getChildrenBounds();
+  int first = 0;
+  int last = int(getItemsCount())-1;
+
+  // Range of items inside the viewport
+  View* view = View::getView(this);
+  if (view) {
+    gfx::Rect vp = view->getViewportBounds();
+    first = MAX(first, (vp.y - cpos.y) / step);
+    last = MIN(last, (vp.y + vp.h - cpos.y) / step);
+  }
+
+  // Destroy the items that are not visible anymore
+  for (auto it=m_modelItems.begin(); it != m_modelItems.end(); ) {
+    if (it->first < first || it->first > last) {
+      removeChild(it->second);
+      it->second->deferDelete();
+      it = m_modelItems.erase(it);
+    }
+    else
+      ++it;
+  }
+
+  int maxItemWidth = m_maxItemWidth;
+
+  for (int i=first; i<=last; ++i) {
+    ListItem*& item = m_modelItems[i];
+    if (!item) {
+      item = m_model->createItem(i);
+      item->setSelected(i == m_selected);
+      addChild(item);
+
+      maxItemWidth = MAX(maxItemWidth, item->getPreferredSize().w);
+    }
+
+    item->setBounds(Rect(cpos.x, cpos.y + i*step, cpos.w, m_itemHeight));
+  }
+
+  // The view will use the new width the next time it's updated
+  m_maxItemWidth = maxItemWidth;
+}
+
 } // namespace ui
@@ -11,14 +11,37 @@
 #include "base/signal.h"
 #include "ui/widget.h"
 
+#include <map>
+
 namespace ui {
 
   class ListItem;
 
+  // Items of a virtual ListBox (see ListBox::setModel()).
+  class ListBoxModel {
+  public:
+    virtual ~ListBoxModel() { }
+    virtual int getItemsCount() = 0;
+
+    // Creates the widget to show the given item. The ListBox destroys
+    // it when the item is not visible anymore.
+    virtual ListItem* createItem(int index) = 0;
+  };
+
   class ListBox : public Widget {
   public:
     ListBox();
 
+    // Uses the given model to create only the items that are visible
+    // in the view (all items must have the same height). It's useful
+    // for lists with thousands of items. If itemHeight is 0, the
+    // preferred height of the first item is used.
+    void setModel(ListBoxModel* model, int itemHeight = 0);
+    ListBoxModel* getModel() const { return m_model; }
+
+    // Recreates the visible items when the model changes.
+    void resetItems();
+
     Widget* getSelectedChild();
     int getSelectedIndex();
 
@@ -40,6 +63,21 @@ namespace ui {
     virtual void onPreferredSize(PreferredSizeEvent& ev) override;
     virtual void onChangeSelectedItem();
     virtual void onDoubleClickItem();
+
+  private:
+    int getItemIndex(Widget* item);
+    gfx::Rect getItemBounds(int index);
+    void makeItemVisible(const gfx::Rect& itemBounds);
+    void selectModelItem(int index);
+    void measureModelItem();
+    void updateModelItems();
+
+    ListBoxModel* m_model;
+    int m_fixedItemHeight;                   // Height specified in setModel()
+    int m_itemHeight;                        // Current height of each item
+    int m_maxItemWidth;
+    int m_selected;                          // Selected item in the model
+    std::map<int, ListItem*> m_modelItems;   // Widgets of visible items
   };
 
 } // namespace ui
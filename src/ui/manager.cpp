@@ -14,7 +14,9 @@
 
 #include "ui/manager.h"
 
+#include "base/chrono.h"
 #include "base/scoped_value.h"
+#include "base/tracing.h"
 #include "she/display.h"
 #include "she/event.h"
 #include "she/event_queue.h"
@@ -32,8 +34,11 @@
 #include <iostream>
 #endif
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
 #include <list>
+#include <unordered_map>
 #include <vector>
 
 namespace ui {
@@ -65,12 +70,66 @@ Manager* Manager::m_defaultManager = NULL;
 static WidgetsList new_windows; // Windows that we should show
 static WidgetsList mouse_widgets_list; // List of widgets to send mouse events
 static Messages msg_queue;             // Messages queue
+
+// Queued messages of each widget/timer, so we can remove the messages
+// of a widget/timer without iterating the whole queue. A message is
+// indexed once for each recipient.
+typedef std::unordered_map<Widget*, std::vector<Message*> > MessagesByWidget;
+typedef std::unordered_map<Timer*, std::vector<Message*> > MessagesByTimer;
+static MessagesByWidget msg_by_widget;
+static MessagesByTimer msg_by_timer;
 static Filters msg_filters[NFILTERS]; // Filters for every enqueued message
 
 static Widget* focus_widget;    // The widget with the focus
 static Widget* mouse_widget;    // The widget with the mouse
 static Widget* capture_widget;  // The widget that captures the mouse
 
+static void remove_from_index(std::vector<Message*>& messages, Message* msg)
+{
+  auto it = std::find(messages.begin(), messages.end(), msg);
+  ASSERT(it != messages.end());
+  if (it != messages.end())
+    messages.erase(it);
+}
+
+static void index_message(Message* msg)
+{
+  for (Widget* widget : msg->recipients())
+    if (widget)
+      msg_by_widget[widget].push_back(msg);
+
+  if (msg->type() == kTimerMessage)
+    msg_by_timer[static_cast<TimerMessage*>(msg)->timer()].push_back(msg);
+}
+
+// Removes the message from the indexes (before it's deleted).
+static void unindex_message(Message* msg)
+{
+  for (Widget* widget : msg->recipients()) {
+    if (!widget)
+      continue;
+
+    auto it = msg_by_widget.find(widget);
+    ASSERT(it != msg_by_widget.end());
+    if (it != msg_by_widget.end()) {
+      remove_from_index(it->second, msg);
+      if (it->second.empty())
+        msg_by_widget.erase(it);
+    }
+  }
+
+  if (msg->type() == kTimerMessage &&
+      static_cast<TimerMessage*>(msg)->timer()) {
+    auto it = msg_by_timer.find(static_cast<TimerMessage*>(msg)->timer());
+    ASSERT(it != msg_by_timer.end());
+    if (it != msg_by_timer.end()) {
+      remove_from_index(it->second, msg);
+      if (it->second.empty())
+        msg_by_timer.erase(it);
+    }
+  }
+}
+
 static bool first_time = true;    // true when we don't enter in poll yet
 
 /* keyboard focus movement stuff */
@@ -90,7 +149,17 @@ Manager::Manager()
   , m_eventQueue(NULL)
   , m_lockedWindow(NULL)
   , m_mouseButtons(kButtonNone)
+  , m_measurePaintTime(false)
+  , m_paintTime(0.0)
+  , m_frameInterval(1.0 / 60.0)
+  , m_nextFrameTime(0.0)
+  , m_frameWorkTime(0.0)
+  , m_immediatePaint(false)
+  , m_framePending(false)
 {
+  // The preferred size depends on the display size
+  disableSizeCache();
+
   if (!m_defaultManager) {
     // Empty lists
     ASSERT(msg_queue.empty());
@@ -146,7 +215,10 @@ Manager::~Manager()
 void Manager::setDisplay(she::Display* display)
 {
   m_display = display;
-  m_eventQueue = she::instance()->eventQueue();
+
+  // Keep the queue if it was replaced with setEventQueue()
+  if (!m_eventQueue)
+    m_eventQueue = she::instance()->eventQueue();
 }
 
 void Manager::setClipboard(she::Clipboard* clipboard)
@@ -154,6 +226,13 @@ void Manager::setClipboard(she::Clipboard* clipboard)
   m_clipboard = clipboard;
 }
 
+double Manager::takePaintTime()
+{
+  double t = m_paintTime;
+  m_paintTime = 0.0;
+  return t;
+}
+
 void Manager::run()
 {
   MessageLoop loop(this);
@@ -206,8 +285,13 @@ bool Manager::generateMessages()
   // Generate messages for timers
   Timer::pollTimers();
 
-  // Generate redraw events.
-  flushRedraw();
+  // Generate redraw events (only once per frame, in the meantime the
+  // invalidated regions are accumulated in each widget).
+  if ((this->flags & JI_DIRTY) && isFrameDue()) {
+    flushRedraw();
+    m_immediatePaint = false;
+    m_framePending = true;
+  }
 
   if (!msg_queue.empty())
     return true;
@@ -239,13 +323,32 @@ void Manager::generateMessagesFromSheEvents()
 {
   she::Event lastMouseMoveEvent;
 
+  // If there is nothing to do, we can sleep until the next event
+  // arrives or the next timer must tick.
+  double timeout = 0.0;
+  if (msg_queue.empty() &&
+      new_windows.empty() &&
+      m_garbage.empty()) {
+    int nextTick = Timer::getNextTickTimeout();
+    timeout = (nextTick < 0 ? -1.0: nextTick / 1000.0);
+
+    // Invalidated regions are painted in the next frame
+    if (this->flags & JI_DIRTY) {
+      if (isFrameDue())
+        timeout = 0.0;
+      else {
+        double nextFrame = m_nextFrameTime - m_frameClock.elapsed();
+        timeout = (timeout < 0.0 ? nextFrame: std::min(timeout, nextFrame));
+      }
+    }
+  }
+
   // Events from "she" layer.
   she::Event sheEvent;
   for (;;) {
-    // bool canWait = (msg_queue.empty());
-    bool canWait = false;
+    m_eventQueue->getEvent(sheEvent, timeout);
+    timeout = 0.0;              // Wait only for the first event
 
-    m_eventQueue->getEvent(sheEvent, canWait);
     if (sheEvent.type() == she::Event::None)
       break;
 
@@ -449,11 +552,46 @@ void Manager::handleWindowZOrder()
 
 void Manager::dispatchMessages()
 {
+  TRACE_ZONE("Manager::dispatchMessages");
+
   // Add the "Queue Processing" message for the manager.
   enqueueMessage(newMouseMessage(kQueueProcessingMessage, this,
       get_mouse_position(), _internal_get_mouse_buttons()));
 
-  pumpQueue();
+  if (m_framePending) {
+    // The paint messages and the flip (in the kQueueProcessingMessage)
+    // of a new frame are dispatched now.
+    double frameStart = m_frameClock.elapsed();
+    pumpQueue();
+    scheduleNextFrame(frameStart, m_frameClock.elapsed() - frameStart);
+    m_framePending = false;
+  }
+  else
+    pumpQueue();
+}
+
+bool Manager::isFrameDue() const
+{
+  return (m_immediatePaint ||
+          m_frameInterval <= 0.0 ||
+          m_frameClock.elapsed() >= m_nextFrameTime);
+}
+
+void Manager::scheduleNextFrame(double frameStart, double frameTime)
+{
+  if (m_frameInterval <= 0.0)
+    return;
+
+  // Average time to paint and flip a frame (limited to one interval,
+  // so a slow frame doesn't skip the following ones)
+  frameTime = std::min(frameTime, m_frameInterval);
+  m_frameWorkTime = (m_frameWorkTime*3.0 + frameTime) / 4.0;
+
+  // The next frame starts before the next deadline (a multiple of
+  // the interval) so it's flipped on time.
+  double deadline = m_frameInterval *
+    (std::floor((frameStart + m_frameWorkTime) / m_frameInterval) + 1.0);
+  m_nextFrameTime = deadline - m_frameWorkTime;
 }
 
 void Manager::addToGarbage(Widget* widget)
@@ -487,8 +625,10 @@ void Manager::enqueueMessage(Message* msg)
     }
   }
 
-  if (msg->hasRecipients())
+  if (msg->hasRecipients()) {
     msg_queue.push_back(msg);
+    index_message(msg);
+  }
   else
     delete msg;
 }
@@ -749,29 +889,45 @@ void Manager::removeMessage(Message* msg)
 {
   Messages::iterator it = std::find(msg_queue.begin(), msg_queue.end(), msg);
   ASSERT(it != msg_queue.end());
+  unindex_message(msg);
   msg_queue.erase(it);
 }
 
 void Manager::removeMessagesFor(Widget* widget)
 {
-  for (Messages::iterator it=msg_queue.begin(), end=msg_queue.end();
-       it != end; ++it)
-    removeWidgetFromRecipients(widget, *it);
+  auto it = msg_by_widget.find(widget);
+  if (it == msg_by_widget.end())
+    return;
+
+  // The message stays in the queue without this recipient
+  for (Message* msg : it->second)
+    removeWidgetFromRecipients(widget, msg);
+
+  msg_by_widget.erase(it);
 }
 
 void Manager::removeMessagesForTimer(Timer* timer)
 {
-  for (Messages::iterator it=msg_queue.begin(); it != msg_queue.end(); ) {
-    Message* msg = *it;
+  auto it = msg_by_timer.find(timer);
+  if (it == msg_by_timer.end())
+    return;
 
-    if (!msg->isUsed() &&
-        msg->type() == kTimerMessage &&
-        static_cast<TimerMessage*>(msg)->timer() == timer) {
-      delete msg;
-      it = msg_queue.erase(it);
-    }
-    else
-      ++it;
+  // The message that is being dispatched (if any) is kept as is
+  std::vector<Message*> messages;
+  for (Message* msg : it->second)
+    if (!msg->isUsed())
+      messages.push_back(msg);
+
+  // Other messages stay in the queue without timer and recipients
+  // (they are discarded in pumpQueue())
+  for (Message* msg : messages) {
+    unindex_message(msg);
+    static_cast<TimerMessage*>(msg)->_resetTimer();
+
+    WidgetsList recipients = msg->recipients();
+    for (Widget* widget : recipients)
+      if (widget)
+        removeWidgetFromRecipients(widget, msg);
   }
 }
 
@@ -1059,8 +1215,8 @@ void Manager::pumpQueue()
     Message* first_msg = msg;
 
     // Call Timer::tick() if this is a tick message.
-    if (msg->type() == kTimerMessage) {
-      ASSERT(static_cast<TimerMessage*>(msg)->timer() != NULL);
+    if (msg->type() == kTimerMessage &&
+        static_cast<TimerMessage*>(msg)->timer()) {
       static_cast<TimerMessage*>(msg)->timer()->tick();
     }
 
@@ -1121,6 +1277,7 @@ void Manager::pumpQueue()
 
         if (surface->intersectClipRect(paintMsg->rect())) {
           dirty_display_flag = true;
+          add_dirty_display_region(gfx::Region(surface->getClipBounds()));
 
 #ifdef REPORT_EVENTS
           std::cout << " - clip("
@@ -1137,7 +1294,7 @@ void Manager::pumpQueue()
             lock->fillRect(gfx::rgba(0, 0, 255), paintMsg->rect());
           }
 
-          if (!m_display->flip())
+          if (!flip_display(m_display))
             surface = NULL;
 
           base::this_thread::sleep_for(0.002);
@@ -1145,7 +1302,13 @@ void Manager::pumpQueue()
 
           if (surface) {
             // Call the message handler
-            done = widget->sendMessage(msg);
+            if (m_measurePaintTime) {
+              base::Chrono chrono;
+              done = widget->sendMessage(msg);
+              m_paintTime += chrono.elapsed();
+            }
+            else
+              done = widget->sendMessage(msg);
 
             // Restore clip region for paint messages.
             surface->setClipBounds(oldClip);
@@ -1162,6 +1325,7 @@ void Manager::pumpQueue()
     }
 
     // Remove the message from the msg_queue
+    unindex_message(first_msg);
     it = msg_queue.erase(it);
 
     // Destroy the message
@@ -8,6 +8,7 @@
 #define UI_MANAGER_H_INCLUDED
 #pragma once
 
+#include "base/chrono.h"
 #include "ui/message_type.h"
 #include "ui/mouse_buttons.h"
 #include "ui/widget.h"
@@ -39,6 +40,31 @@ namespace ui {
     void setDisplay(she::Display* display);
     void setClipboard(she::Clipboard* clipboard);
 
+    // Events are read from the queue of the she::System by default,
+    // it can be replaced with another queue (e.g. to record or
+    // replay the user input).
+    she::EventQueue* getEventQueue() { return m_eventQueue; }
+    void setEventQueue(she::EventQueue* queue) { m_eventQueue = queue; }
+
+    // Measures the time used to process kPaintMessage messages
+    // (disabled by default). takePaintTime() returns the time in
+    // seconds since the previous call.
+    void setMeasurePaintTime(bool state) { m_measurePaintTime = state; }
+    double takePaintTime();
+
+    // Invalidated regions are accumulated and painted once per frame
+    // (every "seconds"). Each frame starts before the deadline as much
+    // as the previous frames took to be painted and flipped, so the
+    // flip is done near it. Zero paints as soon as possible (each
+    // time messages are generated).
+    void setFrameInterval(double seconds) { m_frameInterval = seconds; }
+    double frameInterval() const { return m_frameInterval; }
+
+    // Paints the invalidated regions in the next generateMessages()
+    // without waiting for the next frame (e.g. for the feedback of a
+    // stroke).
+    void requestImmediatePaint() { m_immediatePaint = true; }
+
     void run();
 
     // Returns true if there are messages in the queue to be
@@ -100,6 +126,8 @@ namespace ui {
     void handleMouseDoubleClick(const gfx::Point& mousePos, MouseButtons mouseButtons);
     void handleMouseWheel(const gfx::Point& mousePos, MouseButtons mouseButtons, const gfx::Point& wheelDelta);
     void handleWindowZOrder();
+    bool isFrameDue() const;
+    void scheduleNextFrame(double frameStart, double frameTime);
 
     void pumpQueue();
     static void removeWidgetFromRecipients(Widget* widget, Message* msg);
@@ -123,6 +151,17 @@ namespace ui {
 
     // Current pressed buttons.
     MouseButtons m_mouseButtons;
+
+    bool m_measurePaintTime;
+    double m_paintTime;
+
+    // Frame scheduling (times in seconds from m_frameClock)
+    base::Chrono m_frameClock;
+    double m_frameInterval;
+    double m_nextFrameTime;
+    double m_frameWorkTime;     // Average time to paint and flip a frame
+    bool m_immediatePaint;
+    bool m_framePending;        // Paint messages of a frame are queued
   };
 
 } // namespace ui
@@ -199,6 +199,9 @@ MenuItem::MenuItem(const std::string& text)
   m_submenu = NULL;
   m_submenu_menubox = NULL;
 
+  // The preferred size depends on the parent (a menu bar or not)
+  disableSizeCache();
+
   setText(text);
   initTheme();
 }
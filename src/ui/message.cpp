@@ -15,9 +15,67 @@
 #include "ui/widget.h"
 
 #include <cstring>
+#include <new>
 
 namespace ui {
 
+namespace {
+
+// Sizes of blocks in the free-lists (multiples of kBlockGranularity
+// up to kMaxBlockSize, bigger messages aren't recycled).
+const std::size_t kBlockGranularity = 16;
+const std::size_t kMaxBlockSize = 256;
+const std::size_t kMaxFreeBlocks = 256; // For each list
+const std::size_t kFreeLists = kMaxBlockSize / kBlockGranularity;
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+FreeBlock* free_lists[kFreeLists];
+std::size_t free_blocks[kFreeLists];
+
+inline std::size_t free_list_index(std::size_t size) {
+  return (size > 0 ? (size-1) / kBlockGranularity: 0);
+}
+
+} // anonymous namespace
+
+// static
+void* Message::operator new(std::size_t size)
+{
+  if (size > kMaxBlockSize)
+    return ::operator new(size);
+
+  std::size_t i = free_list_index(size);
+  if (free_lists[i]) {
+    FreeBlock* block = free_lists[i];
+    free_lists[i] = block->next;
+    --free_blocks[i];
+    return block;
+  }
+
+  return ::operator new((i+1) * kBlockGranularity);
+}
+
+// static
+void Message::operator delete(void* ptr, std::size_t size)
+{
+  if (!ptr)
+    return;
+
+  std::size_t i = free_list_index(size);
+  if (size > kMaxBlockSize || free_blocks[i] >= kMaxFreeBlocks) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  FreeBlock* block = static_cast<FreeBlock*>(ptr);
+  block->next = free_lists[i];
+  free_lists[i] = block;
+  ++free_blocks[i];
+}
+
 Message::Message(MessageType type)
   : m_type(type)
   , m_used(false)
@@ -16,6 +16,7 @@
 #include "ui/mouse_buttons.h"
 #include "ui/widgets_list.h"
 
+#include <cstddef>
 #include <string>
 #include <vector>
 
@@ -31,6 +32,12 @@ namespace ui {
     Message(MessageType type);
     virtual ~Message();
 
+    // Messages are allocated from free-lists of recycled blocks
+    // (messages are created/deleted all the time, e.g. for each paint
+    // or mouse movement). They must be created in the UI thread.
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr, std::size_t size);
+
     MessageType type() const { return m_type; }
     const WidgetsList& recipients() const { return m_recipients; }
     bool hasRecipients() const { return !m_recipients.empty(); }
@@ -131,6 +138,10 @@ namespace ui {
     int count() const { return m_count; }
     Timer* timer() { return m_timer; }
 
+    // Used by the Manager when the timer is deleted before this
+    // message is dispatched.
+    void _resetTimer() { m_timer = NULL; }
+
   private:
     int m_count;                    // Accumulated calls
     Timer* m_timer;                 // Timer handle
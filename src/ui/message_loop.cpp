@@ -10,8 +10,6 @@
 
 #include "ui/message_loop.h"
 
-#include "base/chrono.h"
-#include "base/thread.h"
 #include "ui/manager.h"
 
 namespace ui {
@@ -23,23 +21,15 @@ MessageLoop::MessageLoop(Manager* manager)
 
 void MessageLoop::pumpMessages()
 {
-  base::Chrono chrono;
-
+  // Manager::generateMessages() sleeps waiting for new events when
+  // there is nothing to do (until the next timer tick), so we don't
+  // need to sleep here.
   if (m_manager->generateMessages()) {
     m_manager->dispatchMessages();
   }
   else {
     m_manager->collectGarbage();
   }
-
-  // If the dispatching of messages was faster than 10 milliseconds,
-  // it means that the process is not using a lot of CPU, so we can
-  // wait the difference to cover those 10 milliseconds
-  // sleeping. With this code we can avoid 100% CPU usage (a
-  // property of Allegro 4 polling nature).
-  double elapsedMSecs = chrono.elapsed() * 1000.0;
-  if (elapsedMSecs > 0.0 && elapsedMSecs < 10.0)
-    base::this_thread::sleep_for((10.0 - elapsedMSecs) / 1000.0);
 }
 
 } // namespace ui
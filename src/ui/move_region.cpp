@@ -10,11 +10,14 @@
 
 #include "ui/manager.h"
 
+#include "gfx/region.h"
+
 #include "she/display.h"
 #include "she/locked_surface.h"
 #include "she/scoped_surface_lock.h"
 #include "she/surface.h"
 #include "she/system.h"
+#include "ui/system.h"
 
 #include <vector>
 
@@ -33,6 +36,10 @@ void move_region(Manager* manager, const Region& region, int dx, int dy)
   she::ScopedSurfaceLock lock(display->getSurface());
   std::size_t nrects = region.size();
 
+  Region dirty(region);
+  dirty.offset(dx, dy);
+  add_dirty_display_region(dirty);
+
   // Blit directly screen to screen.
   if (nrects == 1) {
     Rect rc = region[0];
@@ -10,10 +10,12 @@
 
 #include "ui/overlay_manager.h"
 
+#include "gfx/region.h"
 #include "she/display.h"
 #include "she/scoped_surface_lock.h"
 #include "ui/manager.h"
 #include "ui/overlay.h"
+#include "ui/system.h"
 
 #include <algorithm>
 
@@ -79,8 +81,10 @@ void OverlayManager::restoreOverlappedAreas()
 
   she::Surface* displaySurface = manager->getDisplay()->getSurface();
   she::ScopedSurfaceLock lockedDisplaySurface(displaySurface);
-  for (Overlay* overlay : *this)
+  for (Overlay* overlay : *this) {
     overlay->restoreOverlappedArea(lockedDisplaySurface);
+    add_dirty_display_region(gfx::Region(overlay->getBounds()));
+  }
 }
 
 void OverlayManager::drawOverlays()
@@ -91,8 +95,10 @@ void OverlayManager::drawOverlays()
 
   she::Surface* displaySurface = manager->getDisplay()->getSurface();
   she::ScopedSurfaceLock lockedDisplaySurface(displaySurface);
-  for (Overlay* overlay : *this)
+  for (Overlay* overlay : *this) {
     overlay->drawOverlay(lockedDisplaySurface);
+    add_dirty_display_region(gfx::Region(overlay->getBounds()));
+  }
 }
 
 } // namespace ui
@@ -24,6 +24,9 @@ PopupWindow::PopupWindow(const std::string& text, ClickBehavior clickBehavior)
   , m_clickBehavior(clickBehavior)
   , m_filtering(false)
 {
+  // The preferred size depends on the current bounds
+  disableSizeCache();
+
   setSizeable(false);
   setMoveable(false);
   setWantFocus(false);
@@ -43,6 +43,7 @@ void Slider::setRange(int min, int max)
   m_max = max;
   m_value = MID(min, m_value, max);
 
+  invalidateLayout();
   invalidate();
 }
 
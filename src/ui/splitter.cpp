@@ -39,6 +39,7 @@ void Splitter::setPosition(double pos)
   m_pos = pos;
   limitPos();
 
+  invalidateLayout();
   invalidate();
 }
 
@@ -11,6 +11,7 @@
 #include "ui/system.h"
 
 #include "gfx/point.h"
+#include "gfx/region.h"
 #include "she/clock.h"
 #include "she/display.h"
 #include "she/surface.h"
@@ -26,6 +27,9 @@ namespace ui {
 
 bool dirty_display_flag = true;
 
+// Modified areas of the display surface since the last flip.
+static gfx::Region dirty_display_region;
+
 // Current mouse cursor type.
 
 static CursorType mouse_cursor_type = kNoCursor;
@@ -144,6 +148,19 @@ static void update_mouse_cursor()
   dirty_display_flag = true;
 }
 
+void add_dirty_display_region(const gfx::Region& region)
+{
+  dirty_display_region.createUnion(dirty_display_region, region);
+  dirty_display_region.simplify();
+}
+
+bool flip_display(she::Display* display)
+{
+  bool result = display->flip(dirty_display_region);
+  dirty_display_region.clear();
+  return result;
+}
+
 int _ji_system_init()
 {
   mouse_cursor_type = kNoCursor;
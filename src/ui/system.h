@@ -23,6 +23,16 @@ namespace ui {
   // so a flip to the real screen is needed.
   extern bool dirty_display_flag;
 
+  // Adds an area (in display surface coordinates) that was modified
+  // in the display surface, so it's copied to the real screen in the
+  // next flip_display().
+  void add_dirty_display_region(const gfx::Region& region);
+
+  // Copies the modified areas of the display surface to the real
+  // screen. Returns false if the flip couldn't be done because the
+  // display was resized.
+  bool flip_display(she::Display* display);
+
   void set_display(she::Display* display);
   int display_w();
   int display_h();
@@ -23,6 +23,8 @@ namespace ui {
 TextBox::TextBox(const std::string& text, int align)
  : Widget(kTextBoxWidget)
 {
+  // The preferred size depends on the size of the view
+  disableSizeCache();
   setFocusStop(true);
   setAlign(align);
   setText(text);
@@ -16,29 +16,110 @@
 #include "ui/widget.h"
 
 #include <algorithm>
-#include <list>
+#include <vector>
 
 namespace ui {
 
-typedef std::list<Timer*> Timers;
+typedef std::vector<Timer*> Timers;
 
-static Timers timers; // Registered timers
+// Running timers in a binary min-heap sorted by the time of their next
+// tick, so pollTimers() only checks the timers that must tick, and
+// start()/stop() are O(log n). Each timer knows its position in the
+// heap (Timer::m_heapIndex).
+static Timers running_timers;
+static int timers_count = 0;    // Number of registered timers
+
+static inline int next_tick(const Timer* timer)
+{
+  return timer->m_lastTime + timer->m_interval;
+}
+
+static void heap_swap(int i, int j)
+{
+  std::swap(running_timers[i], running_timers[j]);
+  running_timers[i]->m_heapIndex = i;
+  running_timers[j]->m_heapIndex = j;
+}
+
+static void heap_up(int i)
+{
+  while (i > 0) {
+    int parent = (i-1) / 2;
+    if (next_tick(running_timers[parent]) <= next_tick(running_timers[i]))
+      break;
+    heap_swap(i, parent);
+    i = parent;
+  }
+}
+
+static void heap_down(int i)
+{
+  int n = int(running_timers.size());
+  for (;;) {
+    int child = 2*i + 1;
+    if (child >= n)
+      break;
+    if (child+1 < n &&
+        next_tick(running_timers[child+1]) < next_tick(running_timers[child]))
+      ++child;
+    if (next_tick(running_timers[i]) <= next_tick(running_timers[child]))
+      break;
+    heap_swap(i, child);
+    i = child;
+  }
+}
+
+static void heap_insert(Timer* timer)
+{
+  ASSERT(timer->m_heapIndex < 0);
+  timer->m_heapIndex = int(running_timers.size());
+  running_timers.push_back(timer);
+  heap_up(timer->m_heapIndex);
+}
+
+static void heap_remove(Timer* timer)
+{
+  int i = timer->m_heapIndex;
+  ASSERT(i >= 0 && i < int(running_timers.size()));
+  ASSERT(running_timers[i] == timer);
+
+  int last = int(running_timers.size())-1;
+  if (i != last) {
+    heap_swap(i, last);
+    running_timers.pop_back();
+    heap_up(i);
+    heap_down(running_timers[i]->m_heapIndex);
+  }
+  else
+    running_timers.pop_back();
+
+  timer->m_heapIndex = -1;
+}
+
+// Moves the timer to its new place in the heap after changing its
+// next tick time.
+static void heap_update(Timer* timer)
+{
+  heap_up(timer->m_heapIndex);
+  heap_down(timer->m_heapIndex);
+}
 
 Timer::Timer(int interval, Widget* owner)
   : m_owner(owner ? owner: Manager::getDefault())
   , m_interval(interval)
   , m_lastTime(-1)
+  , m_heapIndex(-1)
 {
   ASSERT(m_owner != NULL);
 
-  timers.push_back(this);
+  ++timers_count;
 }
 
 Timer::~Timer()
 {
-  Timers::iterator it = std::find(timers.begin(), timers.end(), this);
-  ASSERT(it != timers.end());
-  timers.erase(it);
+  if (m_heapIndex >= 0)
+    heap_remove(this);
+  --timers_count;
 
   // Remove messages of this timer in the queue
   Manager::getDefault()->removeMessagesForTimer(this);
@@ -52,10 +133,18 @@ bool Timer::isRunning() const
 void Timer::start()
 {
   m_lastTime = ui::clock();
+
+  if (m_heapIndex >= 0)
+    heap_update(this);
+  else
+    heap_insert(this);
 }
 
 void Timer::stop()
 {
+  if (m_heapIndex >= 0)
+    heap_remove(this);
+
   m_lastTime = -1;
 }
 
@@ -67,6 +156,9 @@ void Timer::tick()
 void Timer::setInterval(int interval)
 {
   m_interval = interval;
+
+  if (m_heapIndex >= 0)
+    heap_update(this);
 }
 
 void Timer::onTick()
@@ -78,40 +170,51 @@ void Timer::onTick()
 void Timer::pollTimers()
 {
   // Generate messages for timers
-  if (!timers.empty()) {
+  if (!running_timers.empty()) {
     int t = ui::clock();
     int count;
 
-    for (Timers::iterator it=timers.begin(), end=timers.end(); it != end; ++it) {
-      Timer* timer = *it;
-      if (timer && timer->m_lastTime >= 0) {
-        count = 0;
-        while (t - timer->m_lastTime > timer->m_interval) {
-          timer->m_lastTime += timer->m_interval;
-          ++count;
-
-          /* we spend too much time here */
-          if (ui::clock() - t > timer->m_interval) {
-            timer->m_lastTime = ui::clock();
-            break;
-          }
-        }
+    while (!running_timers.empty()) {
+      Timer* timer = running_timers.front();
+      if (t - timer->m_lastTime <= timer->m_interval)
+        break;                  // The other timers tick later
 
-        if (count > 0) {
-          ASSERT(timer->m_owner != NULL);
+      count = 0;
+      while (t - timer->m_lastTime > timer->m_interval) {
+        timer->m_lastTime += timer->m_interval;
+        ++count;
 
-          Message* msg = new TimerMessage(count, timer);
-          msg->addRecipient(timer->m_owner);
-          Manager::getDefault()->enqueueMessage(msg);
+        /* we spend too much time here */
+        if (ui::clock() - t > timer->m_interval) {
+          timer->m_lastTime = ui::clock();
+          break;
         }
       }
+
+      // Now the next tick of this timer is after "t"
+      heap_down(0);
+
+      ASSERT(timer->m_owner != NULL);
+
+      Message* msg = new TimerMessage(count, timer);
+      msg->addRecipient(timer->m_owner);
+      Manager::getDefault()->enqueueMessage(msg);
     }
   }
 }
 
+int Timer::getNextTickTimeout()
+{
+  if (running_timers.empty())
+    return -1;
+
+  // pollTimers() generates a tick when "t - m_lastTime > m_interval"
+  return std::max(0, next_tick(running_timers.front()) + 1 - ui::clock());
+}
+
 void Timer::checkNoTimers()
 {
-  ASSERT(timers.empty());
+  ASSERT(timers_count == 0);
 }
 
 } // namespace ui
@@ -36,6 +36,11 @@ namespace ui {
     static void pollTimers();
     static void checkNoTimers();
 
+    // Returns the milliseconds until the next tick of a running timer
+    // (0 if some timer must tick right now), or -1 if there is no
+    // running timer. It's O(1).
+    static int getNextTickTimeout();
+
   protected:
     virtual void onTick();
 
@@ -43,6 +48,7 @@ namespace ui {
     Widget* m_owner;
     int m_interval;
     int m_lastTime;
+    int m_heapIndex;            // Index in the heap of running timers
 
     DISABLE_COPYING(Timer);
   };
@@ -186,6 +186,8 @@ TipWindow::TipWindow(const char* text, const gfx::Rect& target)
   , m_arrowAlign(0)
   , m_target(target)
 {
+  // The preferred size depends on the current bounds
+  disableSizeCache();
   setTransparent(true);
 
   makeFixed();
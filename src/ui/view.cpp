@@ -32,6 +32,10 @@ View::View()
 {
   m_hasBars = true;
 
+  // Scroll bars depend on the size of the viewable widget (which can
+  // change without notifying us, e.g. an editor zoom).
+  disableResizeCache();
+
   this->setFocusStop(true);
   addChild(&m_viewport);
   setScrollableSize(Size(0, 0));
@@ -24,6 +24,8 @@ using namespace gfx;
 Viewport::Viewport()
   : Widget(kViewViewportWidget)
 {
+  // The child position depends on the scroll of the view
+  disableResizeCache();
   initTheme();
 }
 
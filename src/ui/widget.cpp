@@ -34,6 +34,7 @@
 #include "ui/view.h"
 #include "ui/window.h"
 
+#include <algorithm>
 #include <cctype>
 #include <climits>
 #include <cstdarg>
@@ -54,6 +55,36 @@ static inline void mark_dirty_flag(Widget* widget)
   }
 }
 
+// Fields used by onPreferredSize() that can be modified directly
+// (without calling any member function).
+static const int kSizeStateLen = 10;
+
+struct Widget::SizeCache {
+  bool valid;                   // "size" is the current preferred size for "fitIn"
+  bool layoutValid;             // Children were arranged in the current bounds
+  gfx::Size fitIn;
+  gfx::Size size;
+  int state[kSizeStateLen];
+};
+
+// False if the preferred size being calculated depends on a widget
+// which cannot be cached.
+static bool cacheable_size = true;
+
+static void get_size_state(const Widget* widget, int state[kSizeStateLen])
+{
+  state[0] = widget->border_width.l;
+  state[1] = widget->border_width.t;
+  state[2] = widget->border_width.r;
+  state[3] = widget->border_width.b;
+  state[4] = widget->child_spacing;
+  state[5] = widget->min_w;
+  state[6] = widget->min_h;
+  state[7] = widget->max_w;
+  state[8] = widget->max_h;
+  state[9] = widget->getAlign();
+}
+
 WidgetType register_widget_type()
 {
   static int type = (int)kFirstUserWidget;
@@ -84,6 +115,9 @@ Widget::Widget(WidgetType type)
   this->m_bgColor = gfx::ColorNone;
 
   m_preferredSize = NULL;
+  m_sizeCache = NULL;
+  m_sizeCacheEnabled = true;
+  m_resizeCacheEnabled = true;
   m_doubleBuffered = false;
   m_transparent = false;
 }
@@ -109,6 +143,7 @@ Widget::~Widget()
 
   // Delete the preferred size
   delete m_preferredSize;
+  delete m_sizeCache;
 
   // Low level free
   removeWidget(this);
@@ -123,6 +158,7 @@ void Widget::initTheme()
 {
   InitThemeEvent ev(this, m_theme);
   onInitTheme(ev);
+  invalidateLayout();
 }
 
 int Widget::getTextInt() const
@@ -163,6 +199,7 @@ void Widget::setTextQuiet(const std::string& text)
 {
   m_text = text;
   flags |= JI_HASTEXT;
+  invalidateLayout();
 }
 
 she::Font* Widget::getFont() const
@@ -177,6 +214,13 @@ she::Font* Widget::getFont() const
 void Widget::resetFont()
 {
   m_font = nullptr;
+  invalidateLayout();
+}
+
+void Widget::setAlign(int align)
+{
+  m_align = align;
+  invalidateLayout();
 }
 
 void Widget::setBgColor(gfx::Color color)
@@ -189,6 +233,7 @@ void Widget::setTheme(Theme* theme)
 {
   m_theme = theme;
   m_font = nullptr;
+  invalidateLayout();
 }
 
 // ===============================================================
@@ -201,6 +246,9 @@ void Widget::setVisible(bool state)
     if (this->flags & JI_HIDDEN) {
       this->flags &= ~JI_HIDDEN;
       invalidate();
+
+      if (m_parent)
+        m_parent->invalidateLayout();
     }
   }
   else {
@@ -208,6 +256,9 @@ void Widget::setVisible(bool state)
       getManager()->freeWidget(this); // Free from manager
 
       this->flags |= JI_HIDDEN;
+
+      if (m_parent)
+        m_parent->invalidateLayout();
     }
   }
 }
@@ -260,6 +311,9 @@ void Widget::setExpansive(bool state)
     this->flags |= JI_EXPANSIVE;
   else
     this->flags &= ~JI_EXPANSIVE;
+
+  if (m_parent)
+    m_parent->invalidateLayout();
 }
 
 void Widget::setDecorative(bool state)
@@ -485,6 +539,7 @@ void Widget::addChild(Widget* child)
 
   m_children.push_back(child);
   child->m_parent = this;
+  invalidateLayout();
 }
 
 void Widget::removeChild(WidgetsList::iterator& it)
@@ -501,6 +556,7 @@ void Widget::removeChild(WidgetsList::iterator& it)
     manager->freeWidget(child);
 
   child->m_parent = NULL;
+  invalidateLayout();
 }
 
 void Widget::removeChild(Widget* child)
@@ -544,6 +600,7 @@ void Widget::insertChild(int index, Widget* child)
 
   m_children.insert(m_children.begin()+index, child);
   child->m_parent = this;
+  invalidateLayout();
 }
 
 // ===============================================================
@@ -552,6 +609,10 @@ void Widget::insertChild(int index, Widget* child)
 
 void Widget::layout()
 {
+  // Arrange the children again even if the bounds are the same
+  if (m_sizeCache)
+    m_sizeCache->layoutValid = false;
+
   setBounds(getBounds());
   invalidate();
 }
@@ -622,8 +683,24 @@ Rect Widget::getClientChildrenBounds() const
 
 void Widget::setBounds(const Rect& rc)
 {
+  // Skip the layout of the whole subtree if nothing changed since
+  // the last time it was arranged in these same bounds.
+  if (m_resizeCacheEnabled &&
+      m_sizeCache &&
+      m_sizeCache->valid &&
+      m_sizeCache->layoutValid &&
+      m_bounds == rc) {
+    int state[kSizeStateLen];
+    get_size_state(this, state);
+    if (std::equal(state, state+kSizeStateLen, m_sizeCache->state))
+      return;
+  }
+
   ResizeEvent ev(this, rc);
   onResize(ev);
+
+  if (m_sizeCache)
+    m_sizeCache->layoutValid = true;
 }
 
 void Widget::setBoundsQuietly(const gfx::Rect& rc)
@@ -643,6 +720,7 @@ void Widget::setBorder(const Border& br)
   border_width.t = br.top();
   border_width.r = br.right();
   border_width.b = br.bottom();
+  invalidateLayout();
 }
 
 void Widget::noBorderNoChildSpacing()
@@ -652,6 +730,7 @@ void Widget::noBorderNoChildSpacing()
   border_width.r = 0;
   border_width.b = 0;
   child_spacing = 0;
+  invalidateLayout();
 }
 
 void Widget::getRegion(gfx::Region& region)
@@ -877,12 +956,14 @@ void Widget::setMinSize(const gfx::Size& sz)
 {
   min_w = sz.w;
   min_h = sz.h;
+  invalidateLayout();
 }
 
 void Widget::setMaxSize(const gfx::Size& sz)
 {
   max_w = sz.w;
   max_h = sz.h;
+  invalidateLayout();
 }
 
 void Widget::flushRedraw()
@@ -1094,6 +1175,9 @@ public:
       src->blitTo(dst, 0, 0, m_pt.x, m_pt.y,
         m_surface->width(), m_surface->height());
     }
+    add_dirty_display_region(
+      gfx::Region(gfx::Rect(m_pt.x, m_pt.y,
+                            m_surface->width(), m_surface->height())));
     m_surface->dispose();
     delete graphics;
   }
@@ -1103,6 +1187,18 @@ private:
   she::Surface* m_surface;
 };
 
+// Graphics that draws directly on the display surface.
+class DeleteDisplayGraphics {
+public:
+  void operator()(Graphics* graphics) {
+    gfx::Rect bounds = graphics->getDirtyBounds().createIntersection(
+      gfx::Rect(0, 0, graphics->width(), graphics->height()));
+    if (!bounds.isEmpty())
+      add_dirty_display_region(gfx::Region(bounds));
+    delete graphics;
+  }
+};
+
 GraphicsPtr Widget::getGraphics(const gfx::Rect& clip)
 {
   GraphicsPtr graphics;
@@ -1119,7 +1215,8 @@ GraphicsPtr Widget::getGraphics(const gfx::Rect& clip)
   // In other case, we can draw directly onto the screen.
   else {
     surface = defaultSurface;
-    graphics.reset(new Graphics(surface, getBounds().x, getBounds().y));
+    graphics.reset(new Graphics(surface, getBounds().x, getBounds().y),
+      DeleteDisplayGraphics());
   }
 
   graphics->setFont(getFont());
@@ -1167,17 +1264,7 @@ void Widget::broadcastMouseMessage(WidgetsList& targets)
 */
 Size Widget::getPreferredSize()
 {
-  if (m_preferredSize != NULL)
-    return *m_preferredSize;
-  else {
-    PreferredSizeEvent ev(this, Size(0, 0));
-    onPreferredSize(ev);
-
-    Size sz(ev.getPreferredSize());
-    sz.w = MID(this->min_w, sz.w, this->max_w);
-    sz.h = MID(this->min_h, sz.h, this->max_h);
-    return sz;
-  }
+  return getPreferredSize(Size(0, 0));
 }
 
 /**
@@ -1198,15 +1285,45 @@ Size Widget::getPreferredSize(const Size& fitIn)
 {
   if (m_preferredSize != NULL)
     return *m_preferredSize;
-  else {
-    PreferredSizeEvent ev(this, fitIn);
-    onPreferredSize(ev);
 
-    Size sz(ev.getPreferredSize());
-    sz.w = MID(this->min_w, sz.w, this->max_w);
-    sz.h = MID(this->min_h, sz.h, this->max_h);
-    return sz;
+  // Use the last calculated size if nothing has changed since then
+  int state[kSizeStateLen];
+  get_size_state(this, state);
+  if (m_sizeCache &&
+      m_sizeCache->valid &&
+      m_sizeCache->fitIn == fitIn &&
+      std::equal(state, state+kSizeStateLen, m_sizeCache->state))
+    return m_sizeCache->size;
+
+  // Children measured by onPreferredSize() can make this size
+  // non-cacheable too
+  bool oldCacheable = cacheable_size;
+  cacheable_size = m_sizeCacheEnabled;
+
+  PreferredSizeEvent ev(this, fitIn);
+  onPreferredSize(ev);
+
+  Size sz(ev.getPreferredSize());
+  sz.w = MID(this->min_w, sz.w, this->max_w);
+  sz.h = MID(this->min_h, sz.h, this->max_h);
+
+  bool cacheable = cacheable_size;
+  cacheable_size = (oldCacheable && cacheable);
+
+  if (cacheable) {
+    if (!m_sizeCache) {
+      m_sizeCache = new SizeCache;
+      m_sizeCache->layoutValid = false;
+    }
+    m_sizeCache->valid = true;
+    m_sizeCache->fitIn = fitIn;
+    m_sizeCache->size = sz;
+    std::copy(state, state+kSizeStateLen, m_sizeCache->state);
   }
+  else if (m_sizeCache)
+    m_sizeCache->valid = false;
+
+  return sz;
 }
 
 /**
@@ -1217,6 +1334,17 @@ void Widget::setPreferredSize(const Size& fixedSize)
 {
   delete m_preferredSize;
   m_preferredSize = new Size(fixedSize);
+  invalidateLayout();
+}
+
+void Widget::invalidateLayout()
+{
+  for (Widget* widget=this; widget; widget=widget->m_parent) {
+    if (widget->m_sizeCache) {
+      widget->m_sizeCache->valid = false;
+      widget->m_sizeCache->layoutValid = false;
+    }
+  }
 }
 
 void Widget::setPreferredSize(int fixedWidth, int fixedHeight)
@@ -79,7 +79,7 @@ namespace ui {
     void setId(const char* id) { m_id = id; }
 
     int getAlign() const { return m_align; }
-    void setAlign(int align) { m_align = align; }
+    void setAlign(int align);
 
     // Text property.
 
@@ -323,6 +323,13 @@ namespace ui {
     void setPreferredSize(const gfx::Size& fixedSize);
     void setPreferredSize(int fixedWidth, int fixedHeight);
 
+    // Discards the cached preferred size and layout of this widget
+    // and its ancestors. It's called automatically when the text,
+    // font, children, visibility, or size limits change, and must be
+    // called by widgets when something else used by onPreferredSize()
+    // or onResize() changes.
+    void invalidateLayout();
+
     // ===============================================================
     // MOUSE, FOCUS & KEYBOARD
     // ===============================================================
@@ -373,6 +380,16 @@ namespace ui {
     virtual void onSetText();
     virtual void onSetBgColor();
 
+    // Must be called by widgets that use something external in
+    // onPreferredSize() (e.g. the size of the parent view) so they
+    // (and their parents) are measured each time.
+    void disableSizeCache() { m_sizeCacheEnabled = false; }
+
+    // Must be called by widgets that use something external in
+    // onResize() (e.g. the scroll position) so they are laid out
+    // each time setBounds() is called.
+    void disableResizeCache() { m_resizeCacheEnabled = false; }
+
   private:
     void removeChild(WidgetsList::iterator& it);
     void paint(Graphics* graphics, const gfx::Region& drawRegion);
@@ -389,6 +406,10 @@ namespace ui {
     WidgetsList m_children;       // Sub-widgets
     Widget* m_parent;             // Who is the parent?
     gfx::Size* m_preferredSize;
+    struct SizeCache;
+    SizeCache* m_sizeCache;       // Last result of onPreferredSize()
+    bool m_sizeCacheEnabled;
+    bool m_resizeCacheEnabled;
     bool m_doubleBuffered;
     bool m_transparent;
   };
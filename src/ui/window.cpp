@@ -43,6 +43,11 @@ Window::Window(Type type, const std::string& text)
 {
   m_killer = NULL;
   m_isDesktop = (type == DesktopWindow);
+
+  // Desktop windows use all the space of the manager
+  if (m_isDesktop)
+    disableSizeCache();
+
   m_isMoveable = !m_isDesktop;
   m_isSizeable = !m_isDesktop;
   m_isOnTop = false;
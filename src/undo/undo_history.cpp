@@ -80,6 +80,45 @@ void UndoHistory::clearRedo()
   }
 }
 
+bool UndoHistory::deleteFirstState()
+{
+  UndoState* first = m_first;
+  if (!first)
+    return false;
+
+  UndoState* p = m_cur;
+  while (p && p != first)
+    p = p->m_parent;
+  bool executed = (p != nullptr);
+
+  // The first state doesn't have a parent, so states created from it
+  // are root states now (if it's executed).
+  assert(!first->m_parent);
+  for (UndoState* state = first->m_next; state; state = state->m_next) {
+    if (state->m_parent == first) {
+      if (!executed)
+        return false;
+      state->m_parent = nullptr;
+    }
+  }
+  for (UndoState* state = first->m_next; state; state = state->m_next) {
+    if (state->m_jump == first)
+      state->m_jump = nullptr;
+  }
+
+  if (m_cur == first)
+    m_cur = nullptr;
+
+  m_first = first->m_next;
+  if (m_first)
+    m_first->m_prev = nullptr;
+  else
+    m_last = nullptr;
+
+  delete first;
+  return true;
+}
+
 void UndoHistory::add(UndoCommand* cmd)
 {
   UndoState* state = new UndoState(cmd);
@@ -87,6 +126,20 @@ void UndoHistory::add(UndoCommand* cmd)
   state->m_next = nullptr;
   state->m_parent = m_cur;
 
+  // Jump pointers of a skew-binary list: the jump of each state is
+  // its parent or the jump of the jump of its parent, so any ancestor
+  // can be reached in O(log depth) steps.
+  UndoState* p = m_cur;
+  if (p) {
+    state->m_depth = p->m_depth+1;
+    if (p->m_jump && p->m_jump->m_jump &&
+        p->m_depth - p->m_jump->m_depth ==
+        p->m_jump->m_depth - p->m_jump->m_jump->m_depth)
+      state->m_jump = p->m_jump->m_jump;
+    else
+      state->m_jump = p;
+  }
+
   if (!m_first)
     m_first = state;
 
@@ -98,25 +151,49 @@ void UndoHistory::add(UndoCommand* cmd)
   }
 }
 
-UndoState* UndoHistory::findCommonParent(UndoState* a, UndoState* b)
+// Returns the ancestor of the given state with the given depth (or
+// nullptr if its parent was deleted with deleteFirstState()). Jump
+// pointers to deleted states are nullptr, in that case we go through
+// the parent.
+// static
+UndoState* UndoHistory::findAncestor(UndoState* state, int depth)
 {
-  UndoState* pA = a;
-  UndoState* pB = b;
+  while (state && state->m_depth > depth) {
+    if (state->m_jump && state->m_jump->m_depth >= depth)
+      state = state->m_jump;
+    else
+      state = state->m_parent;
+  }
+  return state;
+}
 
-  if (pA == nullptr || pB == nullptr)
+// static
+UndoState* UndoHistory::findCommonParent(UndoState* a, UndoState* b)
+{
+  if (a == nullptr || b == nullptr)
     return nullptr;
 
-  while (pA != pB) {
-    pA = pA->m_parent;
-    if (!pA) {
-      pA = a;
-      pB = pB->m_parent;
-      if (!pB)
-        return nullptr;
+  if (a->m_depth > b->m_depth)
+    a = findAncestor(a, b->m_depth);
+  else if (b->m_depth > a->m_depth)
+    b = findAncestor(b, a->m_depth);
+
+  while (a && b && a != b) {
+    // Both states are in the same depth, and their jumps too (unless
+    // some jump was deleted)
+    if (a->m_jump != b->m_jump &&
+        a->m_jump && b->m_jump &&
+        a->m_jump->m_depth == b->m_jump->m_depth) {
+      a = a->m_jump;
+      b = b->m_jump;
+    }
+    else {
+      a = a->m_parent;
+      b = b->m_parent;
     }
   }
 
-  return pA;
+  return (a == b ? a: nullptr);
 }
 
 void UndoHistory::moveTo(UndoState* new_state)
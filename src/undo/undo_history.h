@@ -30,8 +30,17 @@ namespace undo {
 
     void clearRedo();
 
+    // Deletes the oldest state to release its memory. If it's
+    // executed (i.e. it's the current state or a parent of it), it
+    // cannot be undone anymore. If it's not executed, it can be
+    // deleted only if other states don't depend on it (it's the end
+    // of an abandoned branch). Returns false if the state cannot be
+    // deleted.
+    bool deleteFirstState();
+
   private:
-    UndoState* findCommonParent(UndoState* a, UndoState* b);
+    static UndoState* findAncestor(UndoState* state, int depth);
+    static UndoState* findCommonParent(UndoState* a, UndoState* b);
     void moveTo(UndoState* new_state);
 
     UndoState* m_first;
@@ -24,6 +24,8 @@ namespace undo {
       : m_prev(nullptr)
       , m_next(nullptr)
       , m_parent(nullptr)
+      , m_jump(nullptr)
+      , m_depth(0)
       , m_cmd(cmd) {
     }
     ~UndoState() {
@@ -37,6 +39,8 @@ namespace undo {
     UndoState* m_prev;
     UndoState* m_next;
     UndoState* m_parent;             // Parent state, after we undo
+    UndoState* m_jump;               // Ancestor to skip parents faster
+    int m_depth;                     // Number of ancestors
     UndoCommand* m_cmd;
   };
 
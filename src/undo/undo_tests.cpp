@@ -12,6 +12,12 @@
 
 #include "undo/undo_command.h"
 #include "undo/undo_history.h"
+#include "undo/undo_state.h"
+
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <vector>
 
 using namespace undo;
 
@@ -175,6 +181,104 @@ TEST(Undo, ComplexTree)
   EXPECT_FALSE(history.canRedo());
 }
 
+TEST(Undo, DeleteFirstState)
+{
+  // 1 --- 2
+  //  \
+  //   ------ 3 --- 4
+  int model = 0;
+  Cmd cmd1(model, 1, 0);
+  Cmd cmd2(model, 2, 1);
+  Cmd cmd3(model, 3, 1);
+  Cmd cmd4(model, 4, 3);
+
+  UndoHistory history;
+  EXPECT_FALSE(history.deleteFirstState());
+
+  cmd1.redo(); history.add(&cmd1);
+  cmd2.redo(); history.add(&cmd2);
+  history.undo();
+  history.undo();
+
+  // The first state is undone, it cannot be deleted
+  EXPECT_EQ(0, model);
+  EXPECT_FALSE(history.deleteFirstState());
+
+  history.redo();
+  cmd3.redo(); history.add(&cmd3);
+  cmd4.redo(); history.add(&cmd4);
+
+  EXPECT_TRUE(history.deleteFirstState());
+  EXPECT_EQ(4, model);
+  history.undo();
+  EXPECT_EQ(3, model);
+  history.undo();
+  EXPECT_EQ(2, model);
+  history.undo();
+  EXPECT_EQ(1, model);
+  EXPECT_FALSE(history.canUndo());
+  history.redo();
+  EXPECT_EQ(2, model);
+  history.redo();
+  EXPECT_EQ(3, model);
+  history.redo();
+  EXPECT_EQ(4, model);
+  EXPECT_FALSE(history.canRedo());
+
+  EXPECT_TRUE(history.deleteFirstState()); // 2
+  EXPECT_TRUE(history.deleteFirstState()); // 3
+  EXPECT_TRUE(history.deleteFirstState()); // 4
+  EXPECT_FALSE(history.deleteFirstState());
+  EXPECT_FALSE(history.canUndo());
+  EXPECT_FALSE(history.canRedo());
+  EXPECT_EQ(nullptr, history.firstState());
+  EXPECT_EQ(nullptr, history.lastState());
+}
+
+TEST(Undo, LongNonlinearHistory)
+{
+  // Random branches with thousands of states, the model must be equal
+  // to the value of the current state after each undo/redo
+  int model = 0;
+  std::vector<std::unique_ptr<Cmd>> cmds;
+  std::map<const UndoCommand*, int> values;
+  UndoHistory history;
+  std::srand(1);
+
+  for (int i=1; i<=5000; ++i) {
+    switch (std::rand() % 4) {
+      case 0:
+        if (history.canUndo())
+          history.undo();
+        break;
+      case 1:
+        if (history.canRedo())
+          history.redo();
+        break;
+      default:
+        cmds.emplace_back(new Cmd(model, i, model));
+        cmds.back()->redo();
+        history.add(cmds.back().get());
+        values[cmds.back().get()] = i;
+        break;
+    }
+
+    const UndoState* state = history.currentState();
+    ASSERT_EQ(state ? values[state->cmd()]: 0, model);
+  }
+
+  // Go to the first state and back through all branches
+  while (history.canUndo()) {
+    history.undo();
+    const UndoState* state = history.currentState();
+    ASSERT_EQ(state ? values[state->cmd()]: 0, model);
+  }
+  while (history.canRedo()) {
+    history.redo();
+    ASSERT_EQ(values[history.currentState()->cmd()], model);
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);